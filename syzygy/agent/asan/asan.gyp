@@ -38,6 +38,8 @@
         'crt_interceptors_macros.h',
         'error_info.cc',
         'error_info.h',
+        'error_report_queue.cc',
+        'error_report_queue.h',
         'heap.cc',
         'heap.h',
         'heap_checker.cc',
@@ -47,6 +49,12 @@
         'heap_managers/block_heap_manager.h',
         'heap_managers/deferred_free_thread.cc',
         'heap_managers/deferred_free_thread.h',
+        'heap_managers/quarantine_checker_thread.cc',
+        'heap_managers/quarantine_checker_thread.h',
+        'heap_managers/thread_block_cache.cc',
+        'heap_managers/thread_block_cache.h',
+        'heap_profiler.cc',
+        'heap_profiler.h',
         'heaps/internal_heap.cc',
         'heaps/internal_heap.h',
         'heaps/large_block_heap.cc',
@@ -59,6 +67,8 @@
         'heaps/zebra_block_heap.h',
         'iat_patcher.cc',
         'iat_patcher.h',
+        'lock_free_page_allocator.h',
+        'lock_free_page_allocator_impl.h',
         'logger.cc',
         'logger.h',
         'memory_interceptors.cc',
@@ -92,6 +102,8 @@
         'reporter.h',
         'runtime.cc',
         'runtime.h',
+        'runtime_counters.cc',
+        'runtime_counters.h',
         'runtime_util.cc',
         'runtime_util.h',
         'scoped_page_protections.cc',
@@ -103,6 +115,8 @@
         'shadow_marker.h',
         'stack_capture_cache.cc',
         'stack_capture_cache.h',
+        'stack_id_filter.cc',
+        'stack_id_filter.h',
         'system_interceptors.cc',
         'system_interceptors.h',
         'timed_try.h',
@@ -174,8 +188,11 @@
         'block_utils_unittest.cc',
         'circular_queue_unittest.cc',
         'error_info_unittest.cc',
+        'error_report_queue_unittest.cc',
         'heap_checker_unittest.cc',
+        'heap_profiler_unittest.cc',
         'iat_patcher_unittest.cc',
+        'lock_free_page_allocator_unittest.cc',
         'logger_unittest.cc',
         'memory_interceptors_patcher_unittest.cc',
         'memory_interceptors_unittest.cc',
@@ -185,11 +202,13 @@
         'rtl_impl_unittest.cc',
         'rtl_unittest.cc',
         'rtl_utils_unittest.cc',
+        'runtime_counters_unittest.cc',
         'runtime_unittest.cc',
         'scoped_page_protections_unittest.cc',
         'shadow_marker_unittest.cc',
         'shadow_unittest.cc',
         'stack_capture_cache_unittest.cc',
+        'stack_id_filter_unittest.cc',
         'static_shadow.cc',
         'system_interceptors_unittest.cc',
         'timed_try_unittest.cc',
@@ -201,6 +220,8 @@
         'heaps/zebra_block_heap_unittest.cc',
         'heap_managers/block_heap_manager_unittest.cc',
         'heap_managers/deferred_free_thread_unittest.cc',
+        'heap_managers/quarantine_checker_thread_unittest.cc',
+        'heap_managers/thread_block_cache_unittest.cc',
         'memory_notifiers/shadow_memory_notifier_unittest.cc',
         'quarantines/sharded_quarantine_unittest.cc',
         'quarantines/size_limited_quarantine_unittest.cc',
@@ -243,6 +264,28 @@
         'SYZYGY_UNITTESTS_USE_LONG_TIMEOUT=1',
       ],
     },
+    {
+      'target_name': 'syzyasan_benchmarks',
+      'type': 'executable',
+      'sources': [
+        'static_shadow.cc',
+        'syzyasan_benchmarks.cc',
+      ],
+      'dependencies': [
+        'syzyasan_rtl_lib',
+        '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/agent/common/common.gyp:agent_common_lib',
+        '<(src)/syzygy/common/common.gyp:common_lib',
+        '<(src)/syzygy/core/core.gyp:core_lib',
+       ],
+      'msvs_settings': {
+        'VCLinkerTool': {
+          # Disable support for large address spaces, as the memory access
+          # probes use the static shadow memory.
+          'LargeAddressAware': 1,
+        },
+      },
+    },
     {
       'target_name': 'syzyasan_hp_lib',
       'type': 'static_library',
@@ -251,6 +294,8 @@
         'hp_crt_interceptors.h',
         'hot_patching_asan_runtime.cc',
         'hot_patching_asan_runtime.h',
+        'hot_patching_policy.cc',
+        'hot_patching_policy.h',
       ],
       'dependencies': [
         'syzyasan_rtl_lib',
@@ -292,6 +337,7 @@
       'type': 'executable',
       'sources': [
         'hot_patching_asan_runtime_unittest.cc',
+        'hot_patching_policy_unittest.cc',
         'static_shadow.cc',
         '<(src)/syzygy/testing/run_all_unittests.cc',
       ],
@@ -14,8 +14,11 @@
 
 #include "syzygy/agent/asan/block.h"
 
+#include <emmintrin.h>
+#include <nmmintrin.h>
 #include <algorithm>
 
+#include "base/cpu.h"
 #include "base/hash.h"
 #include "base/logging.h"
 #include "syzygy/agent/asan/runtime.h"
@@ -110,6 +113,70 @@ uint32_t CombineUInt32IntoBlockChecksum(uint32_t val) {
   return checksum;
 }
 
+// A hash function used to calculate block checksums. The seed lets the hashes
+// of several ranges of memory be chained together.
+typedef uint32_t (*BlockHashFunction)(uint32_t seed,
+                                      const void* data,
+                                      size_t length);
+
+uint32_t SuperFastHashWithSeed(uint32_t seed, const void* data, size_t length) {
+  // SuperFastHash can't be seeded, so the seed gets mixed into its result.
+  // The multiplication keeps the hashes of identical ranges from cancelling
+  // each other out.
+  uint32_t hash = base::SuperFastHash(reinterpret_cast<const char*>(data),
+                                      static_cast<int>(length));
+  return (seed * 31) ^ hash;
+}
+
+uint32_t Crc32cWithSeed(uint32_t seed, const void* data, size_t length) {
+  const uint8_t* cursor = reinterpret_cast<const uint8_t*>(data);
+  const uint8_t* end = cursor + length;
+  uint32_t crc = ~seed;
+  while (cursor < end && !IsAligned(cursor, sizeof(uint32_t)))
+    crc = _mm_crc32_u8(crc, *cursor++);
+  for (; static_cast<size_t>(end - cursor) >= sizeof(uint32_t);
+       cursor += sizeof(uint32_t)) {
+    crc = _mm_crc32_u32(crc, *reinterpret_cast<const uint32_t*>(cursor));
+  }
+  while (cursor < end)
+    crc = _mm_crc32_u8(crc, *cursor++);
+  return ~crc;
+}
+
+// The hash function used for the block checksums. This is selected lazily as
+// SSE4.2 support can only be determined at runtime. The race between threads
+// doing the selection is benign as they all make the same choice.
+BlockHashFunction g_block_hash_function = nullptr;
+
+// Indicates if the bodies of large blocks are sampled when calculating their
+// checksums.
+bool g_block_checksum_sampling = false;
+
+BlockHashFunction GetBlockHashFunction() {
+  if (g_block_hash_function == nullptr) {
+    base::CPU cpu;
+    g_block_hash_function =
+        cpu.has_sse42() ? &Crc32cWithSeed : &SuperFastHashWithSeed;
+  }
+  return g_block_hash_function;
+}
+
+// Hashes the body of a large block by sampling it.
+uint32_t HashSampledBody(BlockHashFunction hash_function,
+                         uint32_t seed,
+                         const BlockInfo& block_info) {
+  DCHECK_LT(kBlockChecksumSampleSize, block_info.body_size);
+  uint32_t hash = seed;
+  size_t last_sample = block_info.body_size - kBlockChecksumSampleSize;
+  for (size_t offset = 0; offset < last_sample;
+       offset += kBlockChecksumSampleStride) {
+    hash = hash_function(hash, block_info.RawBody() + offset,
+                         kBlockChecksumSampleSize);
+  }
+  return hash_function(hash, block_info.RawBody() + last_sample,
+                       kBlockChecksumSampleSize);
+}
+
 // Global callback invoked by exception handlers when exceptions occur. This is
 // a testing seam.
 OnExceptionCallback g_on_exception_callback;
@@ -430,26 +497,36 @@ bool BlockChecksumIsValid(const BlockInfo& block_info) {
 void BlockSetChecksum(const BlockInfo& block_info) {
   block_info.header->checksum = 0;
 
+  BlockHashFunction hash_function = GetBlockHashFunction();
   uint32_t checksum = 0;
   switch (static_cast<BlockState>(block_info.header->state)) {
     case ALLOCATED_BLOCK:
     case QUARANTINED_FLOODED_BLOCK: {
       // Only checksum the header and trailer regions.
-      checksum = base::SuperFastHash(
-          reinterpret_cast<const char*>(block_info.header),
-          block_info.TotalHeaderSize());
-      checksum ^= base::SuperFastHash(
-          reinterpret_cast<const char*>(block_info.trailer_padding),
-          block_info.TotalTrailerSize());
+      checksum = hash_function(checksum, block_info.header,
+                               block_info.TotalHeaderSize());
+      checksum = hash_function(checksum, block_info.trailer_padding,
+                               block_info.TotalTrailerSize());
       break;
     }
 
     // The checksum is the calculated in the same way in these two cases.
     case QUARANTINED_BLOCK:
     case FREED_BLOCK: {
-      checksum = base::SuperFastHash(
-          reinterpret_cast<const char*>(block_info.header),
-          block_info.block_size);
+      if (!g_block_checksum_sampling ||
+          block_info.body_size <= kBlockChecksumSamplingThreshold) {
+        checksum = hash_function(checksum, block_info.header,
+                                 block_info.block_size);
+        break;
+      }
+
+      // Checksum the header and trailer regions entirely, but only sample
+      // the body.
+      checksum = hash_function(checksum, block_info.header,
+                               block_info.TotalHeaderSize());
+      checksum = HashSampledBody(hash_function, checksum, block_info);
+      checksum = hash_function(checksum, block_info.trailer_padding,
+                               block_info.TotalTrailerSize());
       break;
     }
   }
@@ -459,6 +536,29 @@ void BlockSetChecksum(const BlockInfo& block_info) {
   block_info.header->checksum = checksum;
 }
 
+void BlockFloodFillBody(const BlockInfo& block_info) {
+  uint8_t* body = block_info.RawBody();
+  uint8_t* body_end = body + block_info.body_size;
+  if (block_info.body_size < kBlockNonTemporalFloodFillThreshold) {
+    ::memset(body, kBlockFloodFillByte, block_info.body_size);
+    return;
+  }
+
+  // The unaligned ends of the body are filled with normal stores, and the
+  // rest with streaming stores that go straight to memory.
+  uint8_t* begin = ::common::AlignUp(body, sizeof(__m128i));
+  uint8_t* end = ::common::AlignDown(body_end, sizeof(__m128i));
+  ::memset(body, kBlockFloodFillByte, begin - body);
+  const __m128i fill = _mm_set1_epi8(static_cast<char>(kBlockFloodFillByte));
+  for (uint8_t* cursor = begin; cursor < end; cursor += sizeof(__m128i))
+    _mm_stream_si128(reinterpret_cast<__m128i*>(cursor), fill);
+  ::memset(end, kBlockFloodFillByte, body_end - end);
+
+  // Streaming stores are weakly ordered. Make them visible before the block
+  // is checksummed or published to the other threads.
+  _mm_sfence();
+}
+
 bool BlockBodyIsFloodFilled(const BlockInfo& block_info) {
   // TODO(chrisha): Move the memspn-like function from shadow.cc to a common
   // place and reuse it here.
@@ -940,6 +1040,40 @@ void BlockAnalyze(BlockState block_state,
   }
 }
 
+bool SetBlockChecksumHash(BlockChecksumHash hash) {
+  switch (hash) {
+    case SUPER_FAST_HASH_CHECKSUM: {
+      g_block_hash_function = &SuperFastHashWithSeed;
+      return true;
+    }
+
+    case CRC32C_CHECKSUM: {
+      base::CPU cpu;
+      if (!cpu.has_sse42())
+        return false;
+      g_block_hash_function = &Crc32cWithSeed;
+      return true;
+    }
+  }
+
+  NOTREACHED();
+  return false;
+}
+
+BlockChecksumHash GetBlockChecksumHash() {
+  if (GetBlockHashFunction() == &Crc32cWithSeed)
+    return CRC32C_CHECKSUM;
+  return SUPER_FAST_HASH_CHECKSUM;
+}
+
+void SetBlockChecksumSampling(bool enabled) {
+  g_block_checksum_sampling = enabled;
+}
+
+bool BlockChecksumSamplingIsEnabled() {
+  return g_block_checksum_sampling;
+}
+
 void SetOnExceptionCallback(OnExceptionCallback callback) {
   g_on_exception_callback = callback;
 }
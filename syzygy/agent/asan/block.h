@@ -110,10 +110,32 @@ static const uint8_t kBlockHeaderPaddingByte = 0x1C;
 static const uint8_t kBlockTrailerPaddingByte = 0xC3;
 static const uint8_t kBlockFloodFillByte = 0xFD;
 
+// Bodies of at least this many bytes are flood-filled with non-temporal
+// stores, so that filling them doesn't evict the working set of the freeing
+// thread from the caches.
+static const uint32_t kBlockNonTemporalFloodFillThreshold = 64 * 1024;
+
 // The number of bits in the checksum field. This is parameterized so that
 // it can be referred to by the checksumming code.
 static const size_t kBlockHeaderChecksumBits = 13;
 
+// When checksum sampling is enabled the body of a block bigger than this is
+// only partially checksummed: the first kBlockChecksumSampleSize bytes of
+// every kBlockChecksumSampleStride bytes are covered, as well as the last
+// kBlockChecksumSampleSize bytes of the body.
+static const size_t kBlockChecksumSamplingThreshold = 64 * 1024;
+static const size_t kBlockChecksumSampleStride = 1024;
+static const size_t kBlockChecksumSampleSize = 64;
+
+// The hash functions that can be used to calculate the block checksums.
+enum BlockChecksumHash {
+  // A portable hash. This is always available.
+  SUPER_FAST_HASH_CHECKSUM,
+  // CRC32C, calculated with the SSE4.2 crc32 instruction. This is used by
+  // default if the CPU supports it.
+  CRC32C_CHECKSUM,
+};
+
 // The state of an Asan block. These are in the order that reflects the typical
 // lifespan of an allocation.
 enum BlockState {
@@ -429,6 +451,34 @@ bool BlockChecksumIsValid(const BlockInfo& block_info);
 void BlockSetChecksum(const BlockInfo& block_info);
 // @}
 
+// @name Checksum configuration functions. Changing the configuration
+//     invalidates the checksums of all existing blocks, so this must happen
+//     before any block is created.
+// @{
+// Selects the hash function used to calculate the block checksums.
+// @param hash The hash function to use.
+// @returns true on success, false if the CPU doesn't support @p hash.
+bool SetBlockChecksumHash(BlockChecksumHash hash);
+
+// @returns the hash function used to calculate the block checksums.
+BlockChecksumHash GetBlockChecksumHash();
+
+// Enables or disables the sampling of the bodies of large blocks when
+// calculating their checksums. This bounds the cost of freeing a large block,
+// at the expense of missing some corruptions of its body.
+// @param enabled True to enable sampling, false to checksum entire bodies.
+void SetBlockChecksumSampling(bool enabled);
+
+// @returns true if the bodies of large blocks are sampled when calculating
+//     their checksums.
+bool BlockChecksumSamplingIsEnabled();
+// @}
+
+// Flood-fills the body of a block with kBlockFloodFillByte. Bodies of at least
+// kBlockNonTemporalFloodFillThreshold bytes are filled with streaming stores.
+// @param block_info The block whose body is to be filled.
+void BlockFloodFillBody(const BlockInfo& block_info);
+
 // Determines if the body of a block is a valid flood-filled body.
 // @param block_info The block to be checked.
 // @returns true if the body is appropriately flood-filled.
@@ -14,8 +14,10 @@
 
 #include "syzygy/agent/asan/block.h"
 
+#include <algorithm>
 #include <memory>
 #include <set>
+#include <vector>
 
 #include "windows.h"
 
@@ -708,6 +710,98 @@ TEST_F(BlockTest, ChecksumDetectsTampering) {
   ASSERT_NO_FATAL_FAILURE(runtime.TearDown());
 }
 
+namespace {
+
+// Returns true if modifying the body byte at |offset| changes the checksum of
+// the block. A handful of values are tried to make checksum collisions
+// unlikely.
+bool BodyTamperingChangesChecksum(const BlockInfo& block_info, size_t offset) {
+  uint8_t* byte_to_modify = block_info.RawBody() + offset;
+  uint8_t original_value = *byte_to_modify;
+  BlockSetChecksum(block_info);
+  uint32_t checksum = block_info.header->checksum;
+  bool detected = false;
+  for (size_t i = 0; i < 4 && !detected; ++i) {
+    ++(*byte_to_modify);
+    detected = BlockCalculateChecksum(block_info) != checksum;
+  }
+  *byte_to_modify = original_value;
+  return detected;
+}
+
+}  // namespace
+
+TEST_F(BlockTest, ChecksumHashes) {
+  BlockChecksumHash default_hash = GetBlockChecksumHash();
+
+  BlockLayout layout = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, 1000, 0, 0,
+                              &layout));
+  std::unique_ptr<uint8_t[]> data(new uint8_t[layout.block_size]);
+  ::memset(data.get(), 0, layout.block_size);
+  BlockInfo info = {};
+  BlockInitialize(layout, data.get(), false, &info);
+  info.header->state = QUARANTINED_BLOCK;
+
+  EXPECT_TRUE(SetBlockChecksumHash(SUPER_FAST_HASH_CHECKSUM));
+  EXPECT_EQ(SUPER_FAST_HASH_CHECKSUM, GetBlockChecksumHash());
+  EXPECT_TRUE(BodyTamperingChangesChecksum(info, 0));
+  EXPECT_TRUE(BodyTamperingChangesChecksum(info, 999));
+
+  // CRC32C is only available on CPUs supporting SSE4.2.
+  if (SetBlockChecksumHash(CRC32C_CHECKSUM)) {
+    EXPECT_EQ(CRC32C_CHECKSUM, GetBlockChecksumHash());
+    EXPECT_TRUE(BodyTamperingChangesChecksum(info, 0));
+    EXPECT_TRUE(BodyTamperingChangesChecksum(info, 999));
+    BlockSetChecksum(info);
+    EXPECT_TRUE(BlockChecksumIsValid(info));
+  }
+
+  EXPECT_TRUE(SetBlockChecksumHash(default_hash));
+}
+
+TEST_F(BlockTest, SampledChecksums) {
+  const size_t kBodySize = 2 * kBlockChecksumSamplingThreshold;
+  BlockLayout layout = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, kBodySize, 0, 0,
+                              &layout));
+  std::unique_ptr<uint8_t[]> data(new uint8_t[layout.block_size]);
+  ::memset(data.get(), 0, layout.block_size);
+  BlockInfo info = {};
+  BlockInitialize(layout, data.get(), false, &info);
+  info.header->state = QUARANTINED_BLOCK;
+
+  ASSERT_FALSE(BlockChecksumSamplingIsEnabled());
+  EXPECT_TRUE(BodyTamperingChangesChecksum(info, kBlockChecksumSampleSize));
+
+  SetBlockChecksumSampling(true);
+  EXPECT_TRUE(BlockChecksumSamplingIsEnabled());
+
+  // The sampled cache lines are covered by the checksum.
+  EXPECT_TRUE(BodyTamperingChangesChecksum(info, 0));
+  EXPECT_TRUE(BodyTamperingChangesChecksum(
+      info, kBlockChecksumSampleStride + kBlockChecksumSampleSize - 1));
+  EXPECT_TRUE(BodyTamperingChangesChecksum(info, kBodySize - 1));
+
+  // The rest of the body isn't.
+  EXPECT_FALSE(BodyTamperingChangesChecksum(info, kBlockChecksumSampleSize));
+  EXPECT_FALSE(BodyTamperingChangesChecksum(
+      info, 2 * kBlockChecksumSampleStride - 1));
+
+  // Small blocks are still checksummed entirely.
+  BlockLayout small_layout = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio,
+                              kBlockChecksumSamplingThreshold, 0, 0,
+                              &small_layout));
+  BlockInfo small_info = {};
+  BlockInitialize(small_layout, data.get(), false, &small_info);
+  small_info.header->state = QUARANTINED_BLOCK;
+  EXPECT_TRUE(BodyTamperingChangesChecksum(small_info,
+                                           kBlockChecksumSampleSize));
+
+  SetBlockChecksumSampling(false);
+}
+
 TEST_F(BlockTest, BlockBodyIsFloodFilled) {
   static char dummy_body[3] = { 0x00, 0x00, 0x00 };
   BlockInfo dummy_info = {};
@@ -720,6 +814,26 @@ TEST_F(BlockTest, BlockBodyIsFloodFilled) {
   EXPECT_TRUE(BlockBodyIsFloodFilled(dummy_info));
 }
 
+TEST_F(BlockTest, BlockFloodFillBody) {
+  // A buffer with guard bytes around the bodies, which start at every
+  // misalignment of a vector register.
+  const uint32_t kLargeSize = kBlockNonTemporalFloodFillThreshold + 13;
+  const uint32_t kSizes[] = {3, kLargeSize};
+  std::vector<uint8_t> buffer(kLargeSize + 64, 0);
+  for (uint32_t size : kSizes) {
+    for (size_t offset = 1; offset <= 16; ++offset) {
+      std::fill(buffer.begin(), buffer.end(), 0);
+      BlockInfo info = {};
+      info.body = reinterpret_cast<BlockBody*>(buffer.data() + offset);
+      info.body_size = size;
+      BlockFloodFillBody(info);
+      EXPECT_TRUE(BlockBodyIsFloodFilled(info));
+      EXPECT_EQ(0u, buffer[offset - 1]);
+      EXPECT_EQ(0u, buffer[offset + size]);
+    }
+  }
+}
+
 TEST_F(BlockTest, BlockDetermineMostLikelyState) {
   AsanLogger logger;
   Shadow shadow;
@@ -23,6 +23,7 @@ namespace {
 
 size_t page_size = 0;
 size_t allocation_granularity = 0;
+size_t processor_count = 0;
 
 void InitializeConstants() {
   if (page_size == 0) {
@@ -30,6 +31,7 @@ void InitializeConstants() {
     ::GetSystemInfo(&system_info);
     page_size = system_info.dwPageSize;
     allocation_granularity = system_info.dwAllocationGranularity;
+    processor_count = system_info.dwNumberOfProcessors;
   }
 }
 
@@ -45,5 +47,10 @@ size_t GetAllocationGranularity() {
   return allocation_granularity;
 }
 
+size_t GetProcessorCount() {
+  InitializeConstants();
+  return processor_count;
+}
+
 }  // namespace asan
 }  // namespace agent
@@ -25,6 +25,12 @@ namespace asan {
 static const size_t kShadowRatioLog = 3;
 static const size_t kShadowRatio = (1 << kShadowRatioLog);
 
+// The largest memory range that is considered accessible if both of its ends
+// are. This is no larger than the smallest redzone separating two heap blocks,
+// so such a range can't skip over one. This is used by the fast paths of the
+// range checks, and to bound the span of coalesced memory access checks.
+static const size_t kMaxSmallRangeSize = 16;
+
 // Expected page sizes and allocation granularities. Some usages of these are
 // at compile time, thus we need accessible constants.
 static const size_t kUsualPageSize = 4096;
@@ -44,6 +50,11 @@ size_t GetPageSize();
 //     fiasco.
 size_t GetAllocationGranularity();
 
+// @returns the number of logical processors available to the process.
+// @note Declaring this as a constant might result in an initialization order
+//     fiasco.
+size_t GetProcessorCount();
+
 }  // namespace asan
 }  // namespace agent
 
@@ -17,6 +17,7 @@
 #include <algorithm>
 
 #include "base/logging.h"
+#include "syzygy/agent/asan/constants.h"
 #include "syzygy/agent/asan/error_info.h"
 #include "syzygy/agent/asan/rtl_utils.h"
 #include "syzygy/agent/asan/shadow.h"
@@ -24,7 +25,7 @@
 namespace {
 
 using agent::asan::Shadow;
-using agent::asan::TestMemoryRange;
+using agent::asan::TestSmallMemoryRange;
 
 // The global shadow memory that is used by the CRT interceptors.
 Shadow* crt_interceptor_shadow_ = nullptr;
@@ -48,40 +49,40 @@ extern "C" {
 void* __cdecl asan_memcpy(void* destination,
                           const void* source,
                           size_t num) {
-  TestMemoryRange(crt_interceptor_shadow_,
-                  reinterpret_cast<const uint8_t*>(source), num,
-                  agent::asan::ASAN_READ_ACCESS);
-  TestMemoryRange(crt_interceptor_shadow_,
-                  reinterpret_cast<uint8_t*>(destination), num,
-                  agent::asan::ASAN_WRITE_ACCESS);
+  TestSmallMemoryRange(crt_interceptor_shadow_,
+                       reinterpret_cast<const uint8_t*>(source), num,
+                       agent::asan::ASAN_READ_ACCESS);
+  TestSmallMemoryRange(crt_interceptor_shadow_,
+                       reinterpret_cast<uint8_t*>(destination), num,
+                       agent::asan::ASAN_WRITE_ACCESS);
   return ::memcpy(destination, source, num);
 }
 
 void* __cdecl asan_memmove(void* destination,
                            const void* source,
                            size_t num) {
-  TestMemoryRange(crt_interceptor_shadow_,
-                  reinterpret_cast<const uint8_t*>(source), num,
-                  agent::asan::ASAN_READ_ACCESS);
-  TestMemoryRange(crt_interceptor_shadow_,
-                  reinterpret_cast<uint8_t*>(destination), num,
-                  agent::asan::ASAN_WRITE_ACCESS);
+  TestSmallMemoryRange(crt_interceptor_shadow_,
+                       reinterpret_cast<const uint8_t*>(source), num,
+                       agent::asan::ASAN_READ_ACCESS);
+  TestSmallMemoryRange(crt_interceptor_shadow_,
+                       reinterpret_cast<uint8_t*>(destination), num,
+                       agent::asan::ASAN_WRITE_ACCESS);
   return ::memmove(destination, source, num);
 }
 
 void* __cdecl asan_memset(void* ptr, int value, size_t num) {
-  TestMemoryRange(crt_interceptor_shadow_,
-                  reinterpret_cast<uint8_t*>(ptr), num,
-                  agent::asan::ASAN_WRITE_ACCESS);
+  TestSmallMemoryRange(crt_interceptor_shadow_,
+                       reinterpret_cast<uint8_t*>(ptr), num,
+                       agent::asan::ASAN_WRITE_ACCESS);
   return ::memset(ptr, value, num);
 }
 
 const void* __cdecl asan_memchr(const void* ptr,
                                 int value,
                                 size_t num) {
-  TestMemoryRange(crt_interceptor_shadow_,
-                  reinterpret_cast<const uint8_t*>(ptr), num,
-                  agent::asan::ASAN_READ_ACCESS);
+  TestSmallMemoryRange(crt_interceptor_shadow_,
+                       reinterpret_cast<const uint8_t*>(ptr), num,
+                       agent::asan::ASAN_READ_ACCESS);
   return ::memchr(ptr, value, num);
 }
 
@@ -241,9 +242,9 @@ char* __cdecl asan_strncpy(char* destination, const char* source, size_t num) {
     }
     // We can't use the GetNullTerminatedArraySize function here, as destination
     // might not be null terminated.
-    TestMemoryRange(crt_interceptor_shadow_,
-                    reinterpret_cast<const uint8_t*>(destination), num,
-                    agent::asan::ASAN_WRITE_ACCESS);
+    TestSmallMemoryRange(crt_interceptor_shadow_,
+                         reinterpret_cast<const uint8_t*>(destination), num,
+                         agent::asan::ASAN_WRITE_ACCESS);
   }
   return ::strncpy(destination, source, num);
 }
@@ -267,9 +268,10 @@ char* __cdecl asan_strncat(char* destination, const char* source, size_t num) {
                       agent::asan::ASAN_WRITE_ACCESS);
     } else {
       // Test if we can append the source to the destination.
-      TestMemoryRange(crt_interceptor_shadow_,
-                      reinterpret_cast<const uint8_t*>(destination + dst_size),
-                      std::min(num, src_size), agent::asan::ASAN_WRITE_ACCESS);
+      TestSmallMemoryRange(
+          crt_interceptor_shadow_,
+          reinterpret_cast<const uint8_t*>(destination + dst_size),
+          std::min(num, src_size), agent::asan::ASAN_WRITE_ACCESS);
     }
   }
   return ::strncat(destination, source, num);
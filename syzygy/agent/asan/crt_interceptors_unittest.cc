@@ -136,6 +136,36 @@ TEST_F(CrtInterceptorsTest, AsanCheckMemcpy) {
   ResetLog();
 }
 
+TEST_F(CrtInterceptorsTest, AsanCheckSmallMemcpy) {
+  // Exercise the sizes for which the shadow bytes are checked inline, with
+  // ranges ending in a partially accessible word.
+  const uint8_t kSrcSize = 16;
+  const uint8_t kDstSize = 13;
+  ScopedAsanAlloc<uint8_t> mem_src(this, kSrcSize);
+  ASSERT_TRUE(mem_src.get() != NULL);
+  ScopedAsanAlloc<uint8_t> mem_dst(this, kDstSize);
+  ASSERT_TRUE(mem_dst.get() != NULL);
+  for (uint8_t i = 0; i < kSrcSize; ++i)
+    mem_src[i] = i;
+
+  SetCallBackFunction(&AsanErrorCallback);
+  for (size_t size = 1; size <= kDstSize; ++size) {
+    EXPECT_EQ(mem_dst.get(),
+              memcpyFunction(mem_dst.get(), mem_src.get(), size));
+    for (size_t i = 0; i < size; ++i)
+      EXPECT_EQ(mem_src[i], mem_dst[i]);
+  }
+  EXPECT_FALSE(LogContains(kHeapBufferOverFlow));
+
+  // Overflow the destination by one byte.
+  for (size_t size = 1; size <= kDstSize; ++size) {
+    memcpyFunctionFailing(mem_dst.get() + kDstSize - size + 1, mem_src.get(),
+                          size);
+    EXPECT_TRUE(LogContains(kHeapBufferOverFlow));
+    ResetLog();
+  }
+}
+
 TEST_F(CrtInterceptorsTest, DISABLED_AsanCheckStrcspn) {
   // TODO(sebmarchand): Reactivate this unittest once the implementation of
   //     this interceptor has been fixed.
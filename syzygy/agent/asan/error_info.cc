@@ -29,19 +29,22 @@ namespace asan {
 namespace {
 
 // Copy a stack capture object into an array.
+// @param stack_cache The stack cache owning the stack capture.
 // @param stack_capture The stack capture that we want to copy.
-// @param dst Will receive the stack frames.
+// @param dst Will receive the stack frames. This must have room for
+//     common::StackCapture::kMaxNumFrames frames.
 // @param dst_size Will receive the number of frames that has been copied.
-void CopyStackCaptureToArray(const common::StackCapture* stack_capture,
-                             void* dst,
+void CopyStackCaptureToArray(const StackCaptureCache* stack_cache,
+                             const common::StackCapture* stack_capture,
+                             void** dst,
                              uint8_t* dst_size) {
+  DCHECK_NE(static_cast<StackCaptureCache*>(nullptr), stack_cache);
   DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_capture);
-  DCHECK_NE(static_cast<void*>(nullptr), dst);
+  DCHECK_NE(static_cast<void**>(nullptr), dst);
   DCHECK_NE(static_cast<uint8_t*>(nullptr), dst_size);
-  ::memcpy(dst,
-           stack_capture->frames(),
-           stack_capture->num_frames() * sizeof(void*));
-  *dst_size = static_cast<uint8_t>(stack_capture->num_frames());
+  // This takes care of decompressing the frames, if need be.
+  *dst_size = static_cast<uint8_t>(stack_cache->GetStackFrames(
+      stack_capture, dst, common::StackCapture::kMaxNumFrames));
 }
 
 // Get the information about an address relative to a block.
@@ -283,14 +286,16 @@ void ErrorInfoGetAsanBlockInfo(const Shadow* shadow,
   //                once, rather than recalculating this.
   if (stack_cache->StackCapturePointerIsValid(
           block_info.header->alloc_stack)) {
-    CopyStackCaptureToArray(block_info.header->alloc_stack,
+    CopyStackCaptureToArray(stack_cache,
+                            block_info.header->alloc_stack,
                             asan_block_info->alloc_stack,
                             &asan_block_info->alloc_stack_size);
   }
   if (block_info.header->state != ALLOCATED_BLOCK &&
       stack_cache->StackCapturePointerIsValid(
           block_info.header->free_stack)) {
-    CopyStackCaptureToArray(block_info.header->free_stack,
+    CopyStackCaptureToArray(stack_cache,
+                            block_info.header->free_stack,
                             asan_block_info->free_stack,
                             &asan_block_info->free_stack_size);
   }
@@ -660,7 +665,7 @@ void PopulateAsanParameters(const AsanErrorInfo& error_info,
 
   // Any new parameter added to the parameters structure should also be added
   // here.
-  static_assert(14 == ::common::kAsanParametersVersion,
+  static_assert(30 == ::common::kAsanParametersVersion,
                 "Pointers in the params must be linked up here.");
   crashdata::Dictionary* param_dict = crashdata::DictAddDict("asan-parameters",
                                                              dict);
@@ -700,6 +705,27 @@ void PopulateAsanParameters(const AsanErrorInfo& error_info,
   crashdata::LeafSetReal(
       error_info.asan_parameters.quarantine_flood_fill_rate,
       crashdata::DictAddLeaf("quarantine-flood-fill-rate", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.heap_profile_sampling_interval,
+      crashdata::DictAddLeaf("heap-profile-sampling-interval", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.alloc_stack_capture_period,
+      crashdata::DictAddLeaf("alloc-stack-capture-period", param_dict));
+  crashdata::LeafSetReal(
+      error_info.asan_parameters.hot_patching_activation_rate,
+      crashdata::DictAddLeaf("hot-patching-activation-rate", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.max_hot_patched_blocks,
+      crashdata::DictAddLeaf("max-hot-patched-blocks", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.heap_partition_count,
+      crashdata::DictAddLeaf("heap-partition-count", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.allocation_guard_site_threshold,
+      crashdata::DictAddLeaf("allocation-guard-site-threshold", param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.allocation_guard_seed,
+      crashdata::DictAddLeaf("allocation-guard-seed", param_dict));
 }
 
 }  // namespace
@@ -0,0 +1,195 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/error_report_queue.h"
+
+#include <unordered_map>
+
+#include "base/logging.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+// @returns the signed distance between two positions of the queue. The
+//     positions wrap around, so this is computed with unsigned arithmetic.
+LONG GetDistance(LONG from, LONG to) {
+  return static_cast<LONG>(static_cast<ULONG>(to) - static_cast<ULONG>(from));
+}
+
+}  // namespace
+
+const int ErrorReportQueue::kReportIntervalMs = 500;
+
+ErrorReportQueue::ErrorReportQueue(const ReportCallback& report_callback)
+    : report_callback_(report_callback),
+      enqueue_position_(0),
+      dequeue_position_(0),
+      dropped_count_(0),
+      reported_dropped_count_(0),
+      stop_event_(true, false),
+      ready_event_(false, false) {
+  static_assert((kQueueSize & (kQueueSize - 1)) == 0,
+                "The queue size must be a power of two.");
+  static_assert(
+      (kReportedErrorsTableSize & (kReportedErrorsTableSize - 1)) == 0,
+      "The table size must be a power of two.");
+  DCHECK(!report_callback_.is_null());
+
+  for (size_t i = 0; i < kQueueSize; ++i)
+    queue_[i].sequence = static_cast<LONG>(i);
+  ::memset(const_cast<LONG*>(reported_errors_), 0, sizeof(reported_errors_));
+}
+
+ErrorReportQueue::~ErrorReportQueue() {
+}
+
+bool ErrorReportQueue::Start() {
+  if (!base::PlatformThread::CreateWithPriority(
+          0, this, &thread_handle_, base::ThreadPriority::BACKGROUND)) {
+    return false;
+  }
+  ready_event_.Wait();
+  return true;
+}
+
+void ErrorReportQueue::Stop() {
+  stop_event_.Signal();
+  base::PlatformThread::Join(thread_handle_);
+  Flush();
+}
+
+bool ErrorReportQueue::MarkReported(const CompactError& error) {
+  LONG key = GetErrorKey(error);
+  size_t index = static_cast<size_t>(key) & (kReportedErrorsTableSize - 1);
+  for (size_t i = 0; i < kReportedErrorsTableSize; ++i) {
+    volatile LONG* slot =
+        &reported_errors_[(index + i) & (kReportedErrorsTableSize - 1)];
+    LONG value = *slot;
+    if (value == 0)
+      value = ::InterlockedCompareExchange(slot, key, 0);
+    if (value == 0)
+      return true;
+    if (value == key)
+      return false;
+  }
+
+  // The table is full, so nothing can be deduplicated anymore.
+  return true;
+}
+
+bool ErrorReportQueue::Push(const CompactError& error) {
+  LONG position = enqueue_position_;
+  Slot* slot = nullptr;
+  while (true) {
+    slot = &queue_[static_cast<size_t>(position) & (kQueueSize - 1)];
+    LONG distance = GetDistance(position, slot->sequence);
+    if (distance == 0) {
+      // The slot is free, try to claim it.
+      LONG current = ::InterlockedCompareExchange(
+          &enqueue_position_, position + 1, position);
+      if (current == position)
+        break;
+      position = current;
+    } else if (distance < 0) {
+      // The slot still holds an error from the previous round, so the queue
+      // is full.
+      base::subtle::NoBarrier_AtomicIncrement(&dropped_count_, 1);
+      return false;
+    } else {
+      // Another thread claimed the slot in the meantime.
+      position = enqueue_position_;
+    }
+  }
+
+  // Publish the error. The interlocked operation ensures that it's visible
+  // before the new sequence number.
+  slot->error = error;
+  ::InterlockedExchange(&slot->sequence, position + 1);
+  return true;
+}
+
+void ErrorReportQueue::Flush() {
+  base::AutoLock lock(flush_lock_);
+
+  // Aggregate the repeats of each error.
+  RepeatedErrors repeated_errors;
+  std::unordered_map<LONG, size_t> indices;
+  CompactError error = {};
+  while (PopUnlocked(&error)) {
+    auto result =
+        indices.insert(std::make_pair(GetErrorKey(error),
+                                      repeated_errors.size()));
+    if (result.second) {
+      RepeatedError repeated_error = { error, 0 };
+      repeated_errors.push_back(repeated_error);
+    }
+    RepeatedError& repeated_error = repeated_errors[result.first->second];
+    repeated_error.error = error;
+    ++repeated_error.count;
+  }
+
+  base::subtle::Atomic32 dropped_count =
+      base::subtle::NoBarrier_Load(&dropped_count_);
+  size_t new_dropped_count = static_cast<size_t>(
+      dropped_count - reported_dropped_count_);
+  reported_dropped_count_ = dropped_count;
+
+  if (repeated_errors.empty() && new_dropped_count == 0)
+    return;
+  report_callback_.Run(repeated_errors, new_dropped_count);
+}
+
+size_t ErrorReportQueue::dropped_count() const {
+  return static_cast<size_t>(base::subtle::NoBarrier_Load(&dropped_count_));
+}
+
+void ErrorReportQueue::ThreadMain() {
+  base::PlatformThread::SetName("SyzyASAN Error Report Thread");
+  ready_event_.Signal();
+  const base::TimeDelta kReportInterval =
+      base::TimeDelta::FromMilliseconds(kReportIntervalMs);
+  while (!stop_event_.TimedWait(kReportInterval))
+    Flush();
+}
+
+bool ErrorReportQueue::PopUnlocked(CompactError* error) {
+  DCHECK_NE(static_cast<CompactError*>(nullptr), error);
+  flush_lock_.AssertAcquired();
+
+  Slot* slot =
+      &queue_[static_cast<size_t>(dequeue_position_) & (kQueueSize - 1)];
+  if (GetDistance(dequeue_position_ + 1, slot->sequence) < 0)
+    return false;
+
+  // Read the error, and free the slot for the next round of the queue.
+  *error = slot->error;
+  ::InterlockedExchange(&slot->sequence,
+                        dequeue_position_ + static_cast<LONG>(kQueueSize));
+  ++dequeue_position_;
+  return true;
+}
+
+// static
+LONG ErrorReportQueue::GetErrorKey(const CompactError& error) {
+  ULONG key = error.crash_stack_id * 31 +
+      static_cast<ULONG>(error.error_type) + 1;
+  if (key == 0)
+    key = 1;
+  return static_cast<LONG>(key);
+}
+
+}  // namespace asan
+}  // namespace agent
@@ -0,0 +1,181 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares ErrorReportQueue, which takes the reporting of repeated errors
+// off of the threads that trigger them.
+
+#ifndef SYZYGY_AGENT_ASAN_ERROR_REPORT_QUEUE_H_
+#define SYZYGY_AGENT_ASAN_ERROR_REPORT_QUEUE_H_
+
+#include <windows.h>
+
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/callback.h"
+#include "base/synchronization/lock.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+#include "syzygy/agent/asan/error_info.h"
+
+namespace agent {
+namespace asan {
+
+// Deduplicates the errors reported by the runtime. The first occurrence of an
+// error, identified by its crash stack ID and its type, goes through the
+// usual reporting path. Its repeats are recorded in a compact form in a
+// bounded lock-free queue, and a low-priority background thread hands them
+// over to a callback in batches, aggregated per error.
+//
+// Neither marking an error as reported nor queuing it ever blocks, so that a
+// hot bug doesn't stall the application when errors aren't fatal. Repeats
+// that don't fit in the queue are only counted.
+//
+// Note that the thread must be cleanly shutdown by calling Stop before the
+// callback becomes invalid.
+class ErrorReportQueue : public base::PlatformThread::Delegate {
+ public:
+  // The compact record of an error.
+  struct CompactError {
+    // The relative ID of the stack where the error occurred.
+    ::common::AsanStackId crash_stack_id;
+    // The address of the bad access.
+    const void* location;
+    // The type of the error.
+    BadAccessKind error_type;
+  };
+
+  // The repeats of an error, as handed out to the report callback.
+  struct RepeatedError {
+    // The last occurrence of the error.
+    CompactError error;
+    // The number of repeats in the batch.
+    size_t count;
+  };
+  typedef std::vector<RepeatedError> RepeatedErrors;
+
+  // The callback receives the repeated errors of a batch, in the order in
+  // which they first appear in it, and the number of repeats that have been
+  // dropped since the previous batch.
+  typedef base::Callback<void(const RepeatedErrors&, size_t)> ReportCallback;
+
+  // The number of errors that can be queued. This must be a power of two.
+  static const size_t kQueueSize = 1024;
+
+  // The number of distinct errors that can be deduplicated. This must be a
+  // power of two. Further errors are always reported in full.
+  static const size_t kReportedErrorsTableSize = 4096;
+
+  // The interval between two batches.
+  static const int kReportIntervalMs;
+
+  // Constructor.
+  // @param report_callback The callback receiving the batches of repeated
+  //     errors. This must be valid from the moment Start is called and until
+  //     Stop is called.
+  explicit ErrorReportQueue(const ReportCallback& report_callback);
+
+  ~ErrorReportQueue() override;
+
+  // Starts the thread and waits until it signals that it's ready to work.
+  // Must not be called if the thread has already been started.
+  // @returns true if successful, false if the thread failed to be launched.
+  bool Start();
+
+  // Stops the thread and waits until it exits cleanly, then reports the
+  // remaining repeats. Must not be called if the thread has not been started.
+  void Stop();
+
+  // Records that an error is about to be reported. This is lock-free.
+  // @param error The error.
+  // @returns true if it's the first time that this error is being reported,
+  //     false if it's a repeat.
+  bool MarkReported(const CompactError& error);
+
+  // Queues a repeated error. This is lock-free and never blocks.
+  // @param error The error.
+  // @returns true if the error was queued, false if the queue was full. In
+  //     the latter case the error is only counted as dropped.
+  bool Push(const CompactError& error);
+
+  // Hands the queued errors over to the report callback, if there are any.
+  // This is called periodically by the thread.
+  void Flush();
+
+  // @returns the total number of errors that have been dropped.
+  size_t dropped_count() const;
+
+ protected:
+  // A slot of the queue. The sequence number of a slot tells whether it's
+  // free or holds an error, and for which round of the queue.
+  struct Slot {
+    volatile LONG sequence;
+    CompactError error;
+  };
+
+  // Implementation of PlatformThread::Delegate:
+  void ThreadMain() override;
+
+  // Removes the oldest error from the queue. Must be called under
+  // flush_lock_.
+  // @param error Will receive the error.
+  // @returns true on success, false if the queue was empty.
+  bool PopUnlocked(CompactError* error);
+
+  // @returns the nonzero key identifying an error in reported_errors_.
+  static LONG GetErrorKey(const CompactError& error);
+
+  // The callback receiving the repeated errors, set by the constructor.
+  ReportCallback report_callback_;
+
+  // The queued errors.
+  Slot queue_[kQueueSize];
+
+  // The position of the next error pushed to the queue. This is only modified
+  // with interlocked operations.
+  volatile LONG enqueue_position_;
+
+  // The position of the next error popped from the queue. Under flush_lock_.
+  LONG dequeue_position_;
+
+  // The keys of the errors that have been reported, in an open addressing
+  // hash table. This is only modified with interlocked operations.
+  volatile LONG reported_errors_[kReportedErrorsTableSize];
+
+  // The total number of dropped errors, and the number of them that have
+  // already been reported. These are accessed atomically.
+  base::subtle::Atomic32 dropped_count_;
+  base::subtle::Atomic32 reported_dropped_count_;
+
+  // Serializes the consumers of the queue.
+  base::Lock flush_lock_;
+
+  // Used to signal that the thread must exit.
+  base::WaitableEvent stop_event_;
+
+  // Used to signal that the background thread has spawned up and is ready to
+  // work.
+  base::WaitableEvent ready_event_;
+
+  // Handle to the thread, used to join the thread when stopping.
+  base::PlatformThreadHandle thread_handle_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ErrorReportQueue);
+};
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_ERROR_REPORT_QUEUE_H_
@@ -0,0 +1,177 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/error_report_queue.h"
+
+#include <memory>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/threading/simple_thread.h"
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+class ErrorReportQueueTest : public testing::Test {
+ public:
+  ErrorReportQueueTest() : dropped_count_(0) {}
+
+  void SetUp() override {
+    queue_.reset(new ErrorReportQueue(base::Bind(
+        &ErrorReportQueueTest::OnReport, base::Unretained(this))));
+  }
+
+  void OnReport(const ErrorReportQueue::RepeatedErrors& repeated_errors,
+                size_t dropped_count) {
+    batches_.push_back(repeated_errors);
+    dropped_count_ += dropped_count;
+  }
+
+  static ErrorReportQueue::CompactError MakeError(
+      ::common::AsanStackId stack_id, uintptr_t location,
+      BadAccessKind error_type) {
+    ErrorReportQueue::CompactError error = {
+        stack_id, reinterpret_cast<const void*>(location), error_type};
+    return error;
+  }
+
+ protected:
+  std::unique_ptr<ErrorReportQueue> queue_;
+  std::vector<ErrorReportQueue::RepeatedErrors> batches_;
+  size_t dropped_count_;
+};
+
+// Pushes the same error over and over.
+class PushRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  static const size_t kNumErrors = 200;
+
+  PushRunner(ErrorReportQueue* queue, ::common::AsanStackId stack_id)
+      : queue_(queue), stack_id_(stack_id), pushed_(0) {}
+
+  void Run() override {
+    ErrorReportQueue::CompactError error = {
+        stack_id_, nullptr, HEAP_BUFFER_OVERFLOW};
+    for (size_t i = 0; i < kNumErrors; ++i) {
+      if (queue_->Push(error))
+        ++pushed_;
+    }
+  }
+
+  size_t pushed() const { return pushed_; }
+
+ private:
+  ErrorReportQueue* queue_;
+  ::common::AsanStackId stack_id_;
+  size_t pushed_;
+};
+
+}  // namespace
+
+TEST_F(ErrorReportQueueTest, MarkReported) {
+  EXPECT_TRUE(queue_->MarkReported(MakeError(1, 0x1000, USE_AFTER_FREE)));
+  EXPECT_FALSE(queue_->MarkReported(MakeError(1, 0x1000, USE_AFTER_FREE)));
+
+  // The address doesn't matter, but the type of the error does.
+  EXPECT_FALSE(queue_->MarkReported(MakeError(1, 0x2000, USE_AFTER_FREE)));
+  EXPECT_TRUE(queue_->MarkReported(MakeError(1, 0x1000, DOUBLE_FREE)));
+  EXPECT_TRUE(queue_->MarkReported(MakeError(2, 0x1000, USE_AFTER_FREE)));
+}
+
+TEST_F(ErrorReportQueueTest, FlushAggregatesRepeats) {
+  // Nothing is reported when there are no repeats.
+  queue_->Flush();
+  EXPECT_TRUE(batches_.empty());
+
+  EXPECT_TRUE(queue_->Push(MakeError(1, 0x1000, USE_AFTER_FREE)));
+  EXPECT_TRUE(queue_->Push(MakeError(2, 0x2000, WILD_ACCESS)));
+  EXPECT_TRUE(queue_->Push(MakeError(1, 0x1004, USE_AFTER_FREE)));
+  queue_->Flush();
+
+  ASSERT_EQ(1u, batches_.size());
+  ASSERT_EQ(2u, batches_[0].size());
+  EXPECT_EQ(1u, batches_[0][0].error.crash_stack_id);
+  EXPECT_EQ(reinterpret_cast<const void*>(0x1004),
+            batches_[0][0].error.location);
+  EXPECT_EQ(2u, batches_[0][0].count);
+  EXPECT_EQ(2u, batches_[0][1].error.crash_stack_id);
+  EXPECT_EQ(WILD_ACCESS, batches_[0][1].error.error_type);
+  EXPECT_EQ(1u, batches_[0][1].count);
+  EXPECT_EQ(0u, dropped_count_);
+
+  // The queue has been emptied.
+  queue_->Flush();
+  EXPECT_EQ(1u, batches_.size());
+}
+
+TEST_F(ErrorReportQueueTest, DropsErrorsWhenFull) {
+  static const size_t kNumDropped = 5;
+  for (size_t i = 0; i < ErrorReportQueue::kQueueSize; ++i)
+    EXPECT_TRUE(queue_->Push(MakeError(1, i, HEAP_BUFFER_OVERFLOW)));
+  for (size_t i = 0; i < kNumDropped; ++i)
+    EXPECT_FALSE(queue_->Push(MakeError(1, i, HEAP_BUFFER_OVERFLOW)));
+  EXPECT_EQ(kNumDropped, queue_->dropped_count());
+
+  queue_->Flush();
+  ASSERT_EQ(1u, batches_.size());
+  ASSERT_EQ(1u, batches_[0].size());
+  EXPECT_EQ(ErrorReportQueue::kQueueSize, batches_[0][0].count);
+  EXPECT_EQ(kNumDropped, dropped_count_);
+
+  // The slots are reused once they have been flushed, and the dropped errors
+  // are only reported once.
+  EXPECT_TRUE(queue_->Push(MakeError(1, 0, HEAP_BUFFER_OVERFLOW)));
+  queue_->Flush();
+  ASSERT_EQ(2u, batches_.size());
+  EXPECT_EQ(1u, batches_[1][0].count);
+  EXPECT_EQ(kNumDropped, dropped_count_);
+}
+
+TEST_F(ErrorReportQueueTest, ConcurrentPushes) {
+  ASSERT_TRUE(queue_->Start());
+
+  static const size_t kNumThreads = 4;
+  std::vector<std::unique_ptr<PushRunner>> runners;
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> threads;
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    runners.push_back(std::unique_ptr<PushRunner>(
+        new PushRunner(queue_.get(), static_cast<::common::AsanStackId>(i))));
+    threads.push_back(std::unique_ptr<base::DelegateSimpleThread>(
+        new base::DelegateSimpleThread(runners.back().get(), "PushRunner")));
+  }
+  for (auto& thread : threads)
+    thread->Start();
+  for (auto& thread : threads)
+    thread->Join();
+
+  // Stopping the queue reports the remaining errors.
+  queue_->Stop();
+
+  size_t pushed = 0;
+  for (auto& runner : runners)
+    pushed += runner->pushed();
+  size_t reported = 0;
+  for (const auto& batch : batches_) {
+    for (const auto& repeated_error : batch)
+      reported += repeated_error.count;
+  }
+  EXPECT_EQ(pushed, reported);
+  EXPECT_EQ(kNumThreads * PushRunner::kNumErrors, pushed + dropped_count_);
+}
+
+}  // namespace asan
+}  // namespace agent
@@ -187,11 +187,11 @@ asan_check_1_byte_read_access_2gb PROC  ; Probe #0.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_0
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
 shadow_reference_0 LABEL NEAR
-  cmp dl, 0
   jnz check_access_slow_0
   add esp, 4
   ; Restore original EDX.
@@ -202,6 +202,8 @@ shadow_reference_0 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_0 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_1 LABEL NEAR
   js report_failure_0
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -264,11 +266,11 @@ asan_check_1_byte_write_access_2gb PROC  ; Probe #1.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_1
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_1 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_2 LABEL NEAR
   jnz check_access_slow_1
   add esp, 4
   ; Restore original EDX.
@@ -279,6 +281,8 @@ shadow_reference_1 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_1 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_3 LABEL NEAR
   js report_failure_1
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -341,11 +345,11 @@ asan_check_2_byte_read_access_2gb PROC  ; Probe #2.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_2
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_2 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_4 LABEL NEAR
   jnz check_access_slow_2
   add esp, 4
   ; Restore original EDX.
@@ -356,6 +360,8 @@ shadow_reference_2 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_2 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_5 LABEL NEAR
   js report_failure_2
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -418,11 +424,11 @@ asan_check_2_byte_write_access_2gb PROC  ; Probe #3.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_3 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_6 LABEL NEAR
   jnz check_access_slow_3
   add esp, 4
   ; Restore original EDX.
@@ -433,6 +439,8 @@ shadow_reference_3 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_3 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_7 LABEL NEAR
   js report_failure_3
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -495,11 +503,11 @@ asan_check_4_byte_read_access_2gb PROC  ; Probe #4.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_4
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_4 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_8 LABEL NEAR
   jnz check_access_slow_4
   add esp, 4
   ; Restore original EDX.
@@ -510,6 +518,8 @@ shadow_reference_4 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_4 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_9 LABEL NEAR
   js report_failure_4
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -572,11 +582,11 @@ asan_check_4_byte_write_access_2gb PROC  ; Probe #5.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_5
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_5 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_10 LABEL NEAR
   jnz check_access_slow_5
   add esp, 4
   ; Restore original EDX.
@@ -587,6 +597,8 @@ shadow_reference_5 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_5 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_11 LABEL NEAR
   js report_failure_5
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -649,11 +661,11 @@ asan_check_8_byte_read_access_2gb PROC  ; Probe #6.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_6
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_6 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_12 LABEL NEAR
   jnz check_access_slow_6
   add esp, 4
   ; Restore original EDX.
@@ -664,6 +676,8 @@ shadow_reference_6 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_6 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_13 LABEL NEAR
   js report_failure_6
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -726,11 +740,11 @@ asan_check_8_byte_write_access_2gb PROC  ; Probe #7.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_7
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_7 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_14 LABEL NEAR
   jnz check_access_slow_7
   add esp, 4
   ; Restore original EDX.
@@ -741,6 +755,8 @@ shadow_reference_7 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_7 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_15 LABEL NEAR
   js report_failure_7
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -803,11 +819,11 @@ asan_check_10_byte_read_access_2gb PROC  ; Probe #8.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_8
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_8 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_16 LABEL NEAR
   jnz check_access_slow_8
   add esp, 4
   ; Restore original EDX.
@@ -818,6 +834,8 @@ shadow_reference_8 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_8 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_17 LABEL NEAR
   js report_failure_8
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -880,11 +898,11 @@ asan_check_10_byte_write_access_2gb PROC  ; Probe #9.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_9
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_9 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_18 LABEL NEAR
   jnz check_access_slow_9
   add esp, 4
   ; Restore original EDX.
@@ -895,6 +913,8 @@ shadow_reference_9 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_9 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_19 LABEL NEAR
   js report_failure_9
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -957,11 +977,11 @@ asan_check_16_byte_read_access_2gb PROC  ; Probe #10.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_10
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_10 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_20 LABEL NEAR
   jnz check_access_slow_10
   add esp, 4
   ; Restore original EDX.
@@ -972,6 +992,8 @@ shadow_reference_10 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_10 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_21 LABEL NEAR
   js report_failure_10
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -1034,11 +1056,11 @@ asan_check_16_byte_write_access_2gb PROC  ; Probe #11.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_11
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_11 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_22 LABEL NEAR
   jnz check_access_slow_11
   add esp, 4
   ; Restore original EDX.
@@ -1049,6 +1071,8 @@ shadow_reference_11 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_11 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_23 LABEL NEAR
   js report_failure_11
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -1111,11 +1135,11 @@ asan_check_32_byte_read_access_2gb PROC  ; Probe #12.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_12
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_12 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_24 LABEL NEAR
   jnz check_access_slow_12
   add esp, 4
   ; Restore original EDX.
@@ -1126,6 +1150,8 @@ shadow_reference_12 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_12 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_25 LABEL NEAR
   js report_failure_12
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -1188,11 +1214,11 @@ asan_check_32_byte_write_access_2gb PROC  ; Probe #13.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_13
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_13 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_26 LABEL NEAR
   jnz check_access_slow_13
   add esp, 4
   ; Restore original EDX.
@@ -1203,6 +1229,8 @@ shadow_reference_13 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_13 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_27 LABEL NEAR
   js report_failure_13
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -1261,17 +1289,19 @@ asan_check_1_byte_read_access_no_flags_2gb PROC  ; Probe #14.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_14
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_14 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_28 LABEL NEAR
   jnz check_access_slow_14
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_14 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_29 LABEL NEAR
   js report_failure_14
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -1322,17 +1352,19 @@ asan_check_1_byte_write_access_no_flags_2gb PROC  ; Probe #15.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_15
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_15 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_30 LABEL NEAR
   jnz check_access_slow_15
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_15 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_31 LABEL NEAR
   js report_failure_15
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -1383,17 +1415,19 @@ asan_check_2_byte_read_access_no_flags_2gb PROC  ; Probe #16.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_16
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_16 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_32 LABEL NEAR
   jnz check_access_slow_16
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_16 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_33 LABEL NEAR
   js report_failure_16
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -1444,17 +1478,19 @@ asan_check_2_byte_write_access_no_flags_2gb PROC  ; Probe #17.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_17
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_17 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_34 LABEL NEAR
   jnz check_access_slow_17
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_17 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_35 LABEL NEAR
   js report_failure_17
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -1505,17 +1541,19 @@ asan_check_4_byte_read_access_no_flags_2gb PROC  ; Probe #18.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_18
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_18 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_36 LABEL NEAR
   jnz check_access_slow_18
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_18 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_37 LABEL NEAR
   js report_failure_18
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -1566,17 +1604,19 @@ asan_check_4_byte_write_access_no_flags_2gb PROC  ; Probe #19.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_19
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_19 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_38 LABEL NEAR
   jnz check_access_slow_19
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_19 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_39 LABEL NEAR
   js report_failure_19
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -1627,17 +1667,19 @@ asan_check_8_byte_read_access_no_flags_2gb PROC  ; Probe #20.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_20
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_20 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_40 LABEL NEAR
   jnz check_access_slow_20
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_20 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_41 LABEL NEAR
   js report_failure_20
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -1688,17 +1730,19 @@ asan_check_8_byte_write_access_no_flags_2gb PROC  ; Probe #21.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_21
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_21 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_42 LABEL NEAR
   jnz check_access_slow_21
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_21 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_43 LABEL NEAR
   js report_failure_21
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -1749,17 +1793,19 @@ asan_check_10_byte_read_access_no_flags_2gb PROC  ; Probe #22.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_22
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_22 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_44 LABEL NEAR
   jnz check_access_slow_22
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_22 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_45 LABEL NEAR
   js report_failure_22
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -1810,17 +1856,19 @@ asan_check_10_byte_write_access_no_flags_2gb PROC  ; Probe #23.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_23
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_23 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_46 LABEL NEAR
   jnz check_access_slow_23
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_23 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_47 LABEL NEAR
   js report_failure_23
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -1871,17 +1919,19 @@ asan_check_16_byte_read_access_no_flags_2gb PROC  ; Probe #24.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_24
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_24 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_48 LABEL NEAR
   jnz check_access_slow_24
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_24 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_49 LABEL NEAR
   js report_failure_24
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -1932,17 +1982,19 @@ asan_check_16_byte_write_access_no_flags_2gb PROC  ; Probe #25.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_25
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_25 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_50 LABEL NEAR
   jnz check_access_slow_25
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_25 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_51 LABEL NEAR
   js report_failure_25
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -1993,17 +2045,19 @@ asan_check_32_byte_read_access_no_flags_2gb PROC  ; Probe #26.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_26
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_26 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_52 LABEL NEAR
   jnz check_access_slow_26
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_26 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_53 LABEL NEAR
   js report_failure_26
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -2054,17 +2108,19 @@ asan_check_32_byte_write_access_no_flags_2gb PROC  ; Probe #27.
   ; threshold, and the check will fail.
   sar edx, 3
   js report_failure_27
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_27 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_54 LABEL NEAR
   jnz check_access_slow_27
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_27 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_55 LABEL NEAR
   js report_failure_27
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -2117,11 +2173,11 @@ asan_check_1_byte_read_access_4gb PROC  ; Probe #28.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_28 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_56 LABEL NEAR
   jnz check_access_slow_28
   add esp, 4
   ; Restore original EDX.
@@ -2132,6 +2188,8 @@ shadow_reference_28 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_28 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_57 LABEL NEAR
   js report_failure_28
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -2192,11 +2250,11 @@ asan_check_1_byte_write_access_4gb PROC  ; Probe #29.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_29 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_58 LABEL NEAR
   jnz check_access_slow_29
   add esp, 4
   ; Restore original EDX.
@@ -2207,6 +2265,8 @@ shadow_reference_29 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_29 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_59 LABEL NEAR
   js report_failure_29
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -2267,11 +2327,11 @@ asan_check_2_byte_read_access_4gb PROC  ; Probe #30.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_30 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_60 LABEL NEAR
   jnz check_access_slow_30
   add esp, 4
   ; Restore original EDX.
@@ -2282,6 +2342,8 @@ shadow_reference_30 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_30 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_61 LABEL NEAR
   js report_failure_30
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -2342,11 +2404,11 @@ asan_check_2_byte_write_access_4gb PROC  ; Probe #31.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_31 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_62 LABEL NEAR
   jnz check_access_slow_31
   add esp, 4
   ; Restore original EDX.
@@ -2357,6 +2419,8 @@ shadow_reference_31 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_31 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_63 LABEL NEAR
   js report_failure_31
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -2417,11 +2481,11 @@ asan_check_4_byte_read_access_4gb PROC  ; Probe #32.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_32 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_64 LABEL NEAR
   jnz check_access_slow_32
   add esp, 4
   ; Restore original EDX.
@@ -2432,6 +2496,8 @@ shadow_reference_32 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_32 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_65 LABEL NEAR
   js report_failure_32
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -2492,11 +2558,11 @@ asan_check_4_byte_write_access_4gb PROC  ; Probe #33.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_33 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_66 LABEL NEAR
   jnz check_access_slow_33
   add esp, 4
   ; Restore original EDX.
@@ -2507,6 +2573,8 @@ shadow_reference_33 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_33 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_67 LABEL NEAR
   js report_failure_33
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -2567,11 +2635,11 @@ asan_check_8_byte_read_access_4gb PROC  ; Probe #34.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_34 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_68 LABEL NEAR
   jnz check_access_slow_34
   add esp, 4
   ; Restore original EDX.
@@ -2582,6 +2650,8 @@ shadow_reference_34 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_34 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_69 LABEL NEAR
   js report_failure_34
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -2642,11 +2712,11 @@ asan_check_8_byte_write_access_4gb PROC  ; Probe #35.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_35 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_70 LABEL NEAR
   jnz check_access_slow_35
   add esp, 4
   ; Restore original EDX.
@@ -2657,6 +2727,8 @@ shadow_reference_35 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_35 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_71 LABEL NEAR
   js report_failure_35
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -2717,11 +2789,11 @@ asan_check_10_byte_read_access_4gb PROC  ; Probe #36.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_36 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_72 LABEL NEAR
   jnz check_access_slow_36
   add esp, 4
   ; Restore original EDX.
@@ -2732,6 +2804,8 @@ shadow_reference_36 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_36 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_73 LABEL NEAR
   js report_failure_36
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -2792,11 +2866,11 @@ asan_check_10_byte_write_access_4gb PROC  ; Probe #37.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_37 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_74 LABEL NEAR
   jnz check_access_slow_37
   add esp, 4
   ; Restore original EDX.
@@ -2807,6 +2881,8 @@ shadow_reference_37 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_37 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_75 LABEL NEAR
   js report_failure_37
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -2867,11 +2943,11 @@ asan_check_16_byte_read_access_4gb PROC  ; Probe #38.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_38 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_76 LABEL NEAR
   jnz check_access_slow_38
   add esp, 4
   ; Restore original EDX.
@@ -2882,6 +2958,8 @@ shadow_reference_38 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_38 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_77 LABEL NEAR
   js report_failure_38
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -2942,11 +3020,11 @@ asan_check_16_byte_write_access_4gb PROC  ; Probe #39.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_39 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_78 LABEL NEAR
   jnz check_access_slow_39
   add esp, 4
   ; Restore original EDX.
@@ -2957,6 +3035,8 @@ shadow_reference_39 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_39 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_79 LABEL NEAR
   js report_failure_39
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -3017,11 +3097,11 @@ asan_check_32_byte_read_access_4gb PROC  ; Probe #40.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_40 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_80 LABEL NEAR
   jnz check_access_slow_40
   add esp, 4
   ; Restore original EDX.
@@ -3032,6 +3112,8 @@ shadow_reference_40 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_40 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_81 LABEL NEAR
   js report_failure_40
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -3092,11 +3174,11 @@ asan_check_32_byte_write_access_4gb PROC  ; Probe #41.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_41 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_82 LABEL NEAR
   jnz check_access_slow_41
   add esp, 4
   ; Restore original EDX.
@@ -3107,6 +3189,8 @@ shadow_reference_41 LABEL NEAR
   pop eax
   ret 4
 check_access_slow_41 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_83 LABEL NEAR
   js report_failure_41
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -3163,17 +3247,19 @@ asan_check_1_byte_read_access_no_flags_4gb PROC  ; Probe #42.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_42 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_84 LABEL NEAR
   jnz check_access_slow_42
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_42 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_85 LABEL NEAR
   js report_failure_42
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -3222,17 +3308,19 @@ asan_check_1_byte_write_access_no_flags_4gb PROC  ; Probe #43.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_43 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_86 LABEL NEAR
   jnz check_access_slow_43
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_43 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_87 LABEL NEAR
   js report_failure_43
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -3281,17 +3369,19 @@ asan_check_2_byte_read_access_no_flags_4gb PROC  ; Probe #44.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_44 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_88 LABEL NEAR
   jnz check_access_slow_44
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_44 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_89 LABEL NEAR
   js report_failure_44
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -3340,17 +3430,19 @@ asan_check_2_byte_write_access_no_flags_4gb PROC  ; Probe #45.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_45 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_90 LABEL NEAR
   jnz check_access_slow_45
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_45 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_91 LABEL NEAR
   js report_failure_45
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -3399,17 +3491,19 @@ asan_check_4_byte_read_access_no_flags_4gb PROC  ; Probe #46.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_46 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_92 LABEL NEAR
   jnz check_access_slow_46
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_46 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_93 LABEL NEAR
   js report_failure_46
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -3458,17 +3552,19 @@ asan_check_4_byte_write_access_no_flags_4gb PROC  ; Probe #47.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_47 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_94 LABEL NEAR
   jnz check_access_slow_47
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_47 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_95 LABEL NEAR
   js report_failure_47
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -3517,17 +3613,19 @@ asan_check_8_byte_read_access_no_flags_4gb PROC  ; Probe #48.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_48 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_96 LABEL NEAR
   jnz check_access_slow_48
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_48 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_97 LABEL NEAR
   js report_failure_48
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -3576,17 +3674,19 @@ asan_check_8_byte_write_access_no_flags_4gb PROC  ; Probe #49.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_49 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_98 LABEL NEAR
   jnz check_access_slow_49
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_49 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_99 LABEL NEAR
   js report_failure_49
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -3635,17 +3735,19 @@ asan_check_10_byte_read_access_no_flags_4gb PROC  ; Probe #50.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_50 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_100 LABEL NEAR
   jnz check_access_slow_50
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_50 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_101 LABEL NEAR
   js report_failure_50
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -3694,17 +3796,19 @@ asan_check_10_byte_write_access_no_flags_4gb PROC  ; Probe #51.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_51 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_102 LABEL NEAR
   jnz check_access_slow_51
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_51 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_103 LABEL NEAR
   js report_failure_51
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -3753,17 +3857,19 @@ asan_check_16_byte_read_access_no_flags_4gb PROC  ; Probe #52.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_52 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_104 LABEL NEAR
   jnz check_access_slow_52
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_52 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_105 LABEL NEAR
   js report_failure_52
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -3812,17 +3918,19 @@ asan_check_16_byte_write_access_no_flags_4gb PROC  ; Probe #53.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_53 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_106 LABEL NEAR
   jnz check_access_slow_53
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_53 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_107 LABEL NEAR
   js report_failure_53
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -3871,17 +3979,19 @@ asan_check_32_byte_read_access_no_flags_4gb PROC  ; Probe #54.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_54 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_108 LABEL NEAR
   jnz check_access_slow_54
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_54 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_109 LABEL NEAR
   js report_failure_54
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -3930,17 +4040,19 @@ asan_check_32_byte_write_access_no_flags_4gb PROC  ; Probe #55.
   ; Divide by 8 to convert the address to a shadow index. No range check is
   ; needed as the address space is 4GB.
   shr edx, 3
-  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+  cmp BYTE PTR[edx + asan_memory_interceptors_shadow_memory], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_55 LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_110 LABEL NEAR
   jnz check_access_slow_55
   add esp, 4
   ; Restore original EDX.
   mov edx, DWORD PTR[esp + 4]
   ret 4
 check_access_slow_55 LABEL NEAR
+  movzx edx, BYTE PTR[edx + asan_memory_interceptors_shadow_memory]
+shadow_reference_111 LABEL NEAR
   js report_failure_55
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -4799,62 +4911,118 @@ asan_check_1_byte_stos_access ENDP
 ; runtime by the dynamic RTL.
 ALIGN 4
 asan_shadow_references LABEL FAR
-  DWORD shadow_reference_0 - 4
+  DWORD shadow_reference_0 - 5
   DWORD shadow_reference_1 - 4
-  DWORD shadow_reference_2 - 4
+  DWORD shadow_reference_2 - 5
   DWORD shadow_reference_3 - 4
-  DWORD shadow_reference_4 - 4
+  DWORD shadow_reference_4 - 5
   DWORD shadow_reference_5 - 4
-  DWORD shadow_reference_6 - 4
+  DWORD shadow_reference_6 - 5
   DWORD shadow_reference_7 - 4
-  DWORD shadow_reference_8 - 4
+  DWORD shadow_reference_8 - 5
   DWORD shadow_reference_9 - 4
-  DWORD shadow_reference_10 - 4
+  DWORD shadow_reference_10 - 5
   DWORD shadow_reference_11 - 4
-  DWORD shadow_reference_12 - 4
+  DWORD shadow_reference_12 - 5
   DWORD shadow_reference_13 - 4
-  DWORD shadow_reference_14 - 4
+  DWORD shadow_reference_14 - 5
   DWORD shadow_reference_15 - 4
-  DWORD shadow_reference_16 - 4
+  DWORD shadow_reference_16 - 5
   DWORD shadow_reference_17 - 4
-  DWORD shadow_reference_18 - 4
+  DWORD shadow_reference_18 - 5
   DWORD shadow_reference_19 - 4
-  DWORD shadow_reference_20 - 4
+  DWORD shadow_reference_20 - 5
   DWORD shadow_reference_21 - 4
-  DWORD shadow_reference_22 - 4
+  DWORD shadow_reference_22 - 5
   DWORD shadow_reference_23 - 4
-  DWORD shadow_reference_24 - 4
+  DWORD shadow_reference_24 - 5
   DWORD shadow_reference_25 - 4
-  DWORD shadow_reference_26 - 4
+  DWORD shadow_reference_26 - 5
   DWORD shadow_reference_27 - 4
-  DWORD shadow_reference_28 - 4
+  DWORD shadow_reference_28 - 5
   DWORD shadow_reference_29 - 4
-  DWORD shadow_reference_30 - 4
+  DWORD shadow_reference_30 - 5
   DWORD shadow_reference_31 - 4
-  DWORD shadow_reference_32 - 4
+  DWORD shadow_reference_32 - 5
   DWORD shadow_reference_33 - 4
-  DWORD shadow_reference_34 - 4
+  DWORD shadow_reference_34 - 5
   DWORD shadow_reference_35 - 4
-  DWORD shadow_reference_36 - 4
+  DWORD shadow_reference_36 - 5
   DWORD shadow_reference_37 - 4
-  DWORD shadow_reference_38 - 4
+  DWORD shadow_reference_38 - 5
   DWORD shadow_reference_39 - 4
-  DWORD shadow_reference_40 - 4
+  DWORD shadow_reference_40 - 5
   DWORD shadow_reference_41 - 4
-  DWORD shadow_reference_42 - 4
+  DWORD shadow_reference_42 - 5
   DWORD shadow_reference_43 - 4
-  DWORD shadow_reference_44 - 4
+  DWORD shadow_reference_44 - 5
   DWORD shadow_reference_45 - 4
-  DWORD shadow_reference_46 - 4
+  DWORD shadow_reference_46 - 5
   DWORD shadow_reference_47 - 4
-  DWORD shadow_reference_48 - 4
+  DWORD shadow_reference_48 - 5
   DWORD shadow_reference_49 - 4
-  DWORD shadow_reference_50 - 4
+  DWORD shadow_reference_50 - 5
   DWORD shadow_reference_51 - 4
-  DWORD shadow_reference_52 - 4
+  DWORD shadow_reference_52 - 5
   DWORD shadow_reference_53 - 4
-  DWORD shadow_reference_54 - 4
+  DWORD shadow_reference_54 - 5
   DWORD shadow_reference_55 - 4
+  DWORD shadow_reference_56 - 5
+  DWORD shadow_reference_57 - 4
+  DWORD shadow_reference_58 - 5
+  DWORD shadow_reference_59 - 4
+  DWORD shadow_reference_60 - 5
+  DWORD shadow_reference_61 - 4
+  DWORD shadow_reference_62 - 5
+  DWORD shadow_reference_63 - 4
+  DWORD shadow_reference_64 - 5
+  DWORD shadow_reference_65 - 4
+  DWORD shadow_reference_66 - 5
+  DWORD shadow_reference_67 - 4
+  DWORD shadow_reference_68 - 5
+  DWORD shadow_reference_69 - 4
+  DWORD shadow_reference_70 - 5
+  DWORD shadow_reference_71 - 4
+  DWORD shadow_reference_72 - 5
+  DWORD shadow_reference_73 - 4
+  DWORD shadow_reference_74 - 5
+  DWORD shadow_reference_75 - 4
+  DWORD shadow_reference_76 - 5
+  DWORD shadow_reference_77 - 4
+  DWORD shadow_reference_78 - 5
+  DWORD shadow_reference_79 - 4
+  DWORD shadow_reference_80 - 5
+  DWORD shadow_reference_81 - 4
+  DWORD shadow_reference_82 - 5
+  DWORD shadow_reference_83 - 4
+  DWORD shadow_reference_84 - 5
+  DWORD shadow_reference_85 - 4
+  DWORD shadow_reference_86 - 5
+  DWORD shadow_reference_87 - 4
+  DWORD shadow_reference_88 - 5
+  DWORD shadow_reference_89 - 4
+  DWORD shadow_reference_90 - 5
+  DWORD shadow_reference_91 - 4
+  DWORD shadow_reference_92 - 5
+  DWORD shadow_reference_93 - 4
+  DWORD shadow_reference_94 - 5
+  DWORD shadow_reference_95 - 4
+  DWORD shadow_reference_96 - 5
+  DWORD shadow_reference_97 - 4
+  DWORD shadow_reference_98 - 5
+  DWORD shadow_reference_99 - 4
+  DWORD shadow_reference_100 - 5
+  DWORD shadow_reference_101 - 4
+  DWORD shadow_reference_102 - 5
+  DWORD shadow_reference_103 - 4
+  DWORD shadow_reference_104 - 5
+  DWORD shadow_reference_105 - 4
+  DWORD shadow_reference_106 - 5
+  DWORD shadow_reference_107 - 4
+  DWORD shadow_reference_108 - 5
+  DWORD shadow_reference_109 - 4
+  DWORD shadow_reference_110 - 5
+  DWORD shadow_reference_111 - 4
   DWORD 0
 
 .rdata ENDS
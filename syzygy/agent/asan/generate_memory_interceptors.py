@@ -129,7 +129,7 @@ _SHADOW_REFERENCE_TABLE_HEADER = """\
 ALIGN 4
 asan_shadow_references LABEL FAR"""
 _SHADOW_REFERENCE_TABLE_ENTRY = """\
-  DWORD shadow_reference_{shadow_index!s} - 4"""
+  DWORD shadow_reference_{shadow_index!s} - {offset}"""
 _SHADOW_REFERENCE_TABLE_FOOTER = """\
   DWORD 0
 """
@@ -242,19 +242,20 @@ _4GB_CHECK = """\
 # This does the following:
 #   - Saves the memory location in EDX for the slow path.
 #   - Does an address check if neccessary.
-#   - Checks for zero shadow for this memory location. We use the cmp
-#       instruction so it'll set the sign flag if the upper bit of the shadow
-#       value of this memory location is set to 1.
+#   - Checks for zero shadow for this memory location. We compare the shadow
+#       byte directly in memory so that the common case is a single
+#       instruction. The cmp instruction will set the sign flag if the upper
+#       bit of the shadow value of this memory location is set to 1.
 #   - If the shadow byte is not equal to zero then it jumps to the slow path.
 #   - Otherwise it removes the memory location from the top of the stack.
 _FAST_PATH = """\
   push edx
   {range_check}
-  movzx edx, BYTE PTR[edx + {shadow}]
+  cmp BYTE PTR[edx + {shadow}], 0
   ; This is a label to the previous shadow memory reference. It will be
-  ; referenced by the table at the end of the 'asan_probes' procedure.
-shadow_reference_{shadow_index!s} LABEL NEAR
-  cmp dl, 0
+  ; referenced by the table at the end of the 'asan_probes' procedure. The
+  ; immediate operand follows the shadow memory address in this instruction.
+shadow_reference_{shadow_index_imm8!s} LABEL NEAR
   jnz check_access_slow_{probe_index}
   add esp, 4"""
 
@@ -262,18 +263,21 @@ shadow_reference_{shadow_index!s} LABEL NEAR
 # This is the common part of the slow path shared between the different
 # implementations of the hooks.
 #
-# The memory location is expected to be on top of the stack and the shadow
-# value for it is assumed to be in DL at this point.
+# The memory location is expected to be on top of the stack and its shadow
+# index is assumed to be in EDX at this point.
 # This also relies on the fact that the shadow non accessible byte mask has
 # its upper bit set to 1 and that we jump to this macro after doing a
 # "cmp shadow_byte, 0", so the sign flag would be set to 1 if the value isn't
 # accessible.
 # We inline the Shadow::IsAccessible function for performance reasons.
 # This function does the following:
+#   - Loads the shadow byte in DL. This doesn't modify the flags.
 #   - Checks if this byte is accessible and jumps to the error path if it's
 #     not.
 #   - Removes the memory location from the top of the stack.
 _SLOW_PATH = """\
+  movzx edx, BYTE PTR[edx + {shadow}]
+shadow_reference_{shadow_index!s} LABEL NEAR
   js report_failure_{probe_index}
   mov dh, BYTE PTR[esp]
   and dh, 7
@@ -606,39 +610,59 @@ _STRING_ACCESSORS = [
 ]
 
 
-class ToStringCounter(object):
-  """A helper class that counts how often it is converted to a string."""
+class ShadowReferenceCounter(object):
+  """A helper class that counts the shadow memory references, and keeps track
+  of the position of the shadow memory address in each of them."""
+
+  class _Reference(object):
+    """A proxy that records a new reference every time it is converted to a
+    string."""
 
-  def __init__(self, count=0):
-    self._count = count
+    def __init__(self, counter, offset):
+      self._counter = counter
+      self._offset = offset
 
-  def __str__(self):
-    self._count += 1
-    return str(self._count - 1)
+    def __str__(self):
+      return str(self._counter.add(self._offset))
 
-  def count(self):
-    return self._count
+  def __init__(self):
+    self._offsets = []
+
+  def at(self, offset):
+    """Returns a proxy recording references whose shadow memory address lies
+    |offset| bytes before the label that follows the instruction."""
+    return ShadowReferenceCounter._Reference(self, offset)
+
+  def add(self, offset):
+    """Records a new reference and returns its index."""
+    self._offsets.append(offset)
+    return len(self._offsets) - 1
+
+  def offsets(self):
+    return self._offsets
 
 
 def _IterateOverInterceptors(parts,
                              formatter,
                              format,
                              format_no_flags,
-                             probe_index=0,
-                             shadow_index=0):
+                             probe_index=0):
   """Helper for _GenerateInterceptorsAsmFile."""
   f = formatter
 
-  # This variable hides a counter which automatically increments for every
-  # reference made to it. This allows the probes to use arbitrarily many
+  # These variables hide a counter which automatically increments for every
+  # reference made to them. This allows the probes to use arbitrarily many
   # references to the shadow memory and the generator will implicitly track
   # these and emit a table entry per reference.
   #
   # For this mechanism to work reliably all references to 'shadow_index' in the
   # formatting strings must be specified using '{shadow_index!s}'. This
-  # guarantees that the __str__ method of the ToStringCounter instance will be
-  # called.
-  shadow_index = ToStringCounter(shadow_index)
+  # guarantees that the __str__ method of the counter's proxy will be called.
+  # References in instructions whose shadow memory address is followed by an
+  # 8-bit immediate operand use '{shadow_index_imm8!s}' instead.
+  shadow_counter = ShadowReferenceCounter()
+  shadow_index = shadow_counter.at(4)
+  shadow_index_imm8 = shadow_counter.at(5)
 
   for mem_model, range_check in _MEMORY_MODELS:
     # Iterate over the probes that have flags.
@@ -653,7 +677,8 @@ def _IterateOverInterceptors(parts,
                               probe_index=probe_index,
                               range_check=formatted_range_check,
                               shadow=_SHADOW,
-                              shadow_index=shadow_index))
+                              shadow_index=shadow_index,
+                              shadow_index_imm8=shadow_index_imm8))
         probe_index += 1
 
     for access_size in _ACCESS_SIZES:
@@ -667,11 +692,12 @@ def _IterateOverInterceptors(parts,
                               probe_index=probe_index,
                               range_check=formatted_range_check,
                               shadow=_SHADOW,
-                              shadow_index=shadow_index))
+                              shadow_index=shadow_index,
+                              shadow_index_imm8=shadow_index_imm8))
         probe_index += 1
 
-  # Return the probe and shadow memory reference counts.
-  return (probe_index, shadow_index.count())
+  # Return the probe count and the shadow memory reference offsets.
+  return (probe_index, shadow_counter.offsets())
 
 
 def _IterateOverStringInterceptors(parts, formatter, format, probe_index=0):
@@ -700,12 +726,11 @@ def _GenerateInterceptorsAsmFile():
   parts.append(f.format(_INTERCEPTORS_PREAMBLE, shadow=_SHADOW))
 
   probe_index = 0
-  shadow_index = 0
 
   # Generate the block of public label declarations.
-  (probe_index, shadow_index) = _IterateOverInterceptors(parts, f,
+  (probe_index, _) = _IterateOverInterceptors(parts, f,
       _CHECK_FUNCTION_DECL, _CHECK_FUNCTION_NO_FLAGS_DECL,
-      probe_index=probe_index, shadow_index=shadow_index)
+      probe_index=probe_index)
   probe_index = _IterateOverStringInterceptors(parts, f, _CHECK_STRINGS_DECL,
       probe_index=probe_index)
   parts.append('')
@@ -724,14 +749,12 @@ def _GenerateInterceptorsAsmFile():
   #     bottleneck is then the nicest, but the easiest is probably to pass in
   #     the redirector function itself...
 
-  # Reset the probe and shadow indices.
+  # Reset the probe index.
   probe_index = 0
-  shadow_index = 0
 
   # Output the actual interceptors themselves
-  (probe_index, shadow_index) = _IterateOverInterceptors(parts, f,
-      _CHECK_FUNCTION, _CHECK_FUNCTION_NO_FLAGS, probe_index=probe_index,
-      shadow_index=shadow_index)
+  (probe_index, shadow_offsets) = _IterateOverInterceptors(parts, f,
+      _CHECK_FUNCTION, _CHECK_FUNCTION_NO_FLAGS, probe_index=probe_index)
 
   # Generate string operation accessors.
   probe_index = _IterateOverStringInterceptors(parts, f, _CHECK_STRINGS,
@@ -743,8 +766,9 @@ def _GenerateInterceptorsAsmFile():
   # Output the table of shadow references to .rdata.
   parts.append(f.format(_RDATA_SEGMENT_HEADER))
   parts.append(f.format(_SHADOW_REFERENCE_TABLE_HEADER))
-  for i in range(0, shadow_index):
-    parts.append(f.format(_SHADOW_REFERENCE_TABLE_ENTRY, shadow_index=i))
+  for i, offset in enumerate(shadow_offsets):
+    parts.append(f.format(_SHADOW_REFERENCE_TABLE_ENTRY, shadow_index=i,
+                          offset=offset))
   parts.append(_SHADOW_REFERENCE_TABLE_FOOTER)
   parts.append(f.format(_RDATA_SEGMENT_FOOTER))
 
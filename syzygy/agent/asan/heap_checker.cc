@@ -14,16 +14,169 @@
 
 #include "syzygy/agent/asan/heap_checker.h"
 
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "base/macros.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+#include "syzygy/agent/asan/constants.h"
 #include "syzygy/agent/asan/page_protection_helpers.h"
 #include "syzygy/agent/asan/runtime.h"
 #include "syzygy/agent/asan/shadow.h"
+#include "syzygy/common/align.h"
 
 namespace agent {
 namespace asan {
 
+namespace {
+
+// The time given to a helper thread to start up. This can time out if the
+// loader lock is held, in which case the helper thread isn't used.
+const int kHelperThreadStartTimeoutMs = 1000;
+
+}  // namespace
+
+// A thread that walks a slab of the shadow memory on behalf of the thread
+// calling IsHeapCorrupt.
+class HeapChecker::HelperThread : public base::PlatformThread::Delegate {
+ public:
+  explicit HelperThread(HeapChecker* owner)
+      : owner_(owner),
+        lower_bound_(nullptr),
+        length_(0),
+        created_(false),
+        stopping_(0),
+        ready_event_(false, false),
+        work_event_(false, false),
+        done_event_(false, false) {
+    DCHECK_NE(static_cast<HeapChecker*>(nullptr), owner);
+    // Memory can't be allocated while walking the slab.
+    result_.corrupt_ranges.reserve(kMaxCorruptRangesPerHelperThread);
+    result_.max_corrupt_range_count = kMaxCorruptRangesPerHelperThread;
+  }
+
+  // Launches the thread and waits until it's ready to work.
+  // @returns true on success, false otherwise. If the thread was created but
+  //     didn't start in time then it will exit as soon as it gets to run, and
+  //     this object must be leaked as the thread still refers to it.
+  bool Start() {
+    if (!base::PlatformThread::Create(0, this, &handle_))
+      return false;
+    created_ = true;
+    if (ready_event_.TimedWait(
+            base::TimeDelta::FromMilliseconds(kHelperThreadStartTimeoutMs))) {
+      return true;
+    }
+    base::subtle::NoBarrier_Store(&stopping_, 1);
+    work_event_.Signal();
+    return false;
+  }
+
+  // Wakes up the thread so that it can exit, and joins it.
+  void Stop() {
+    base::subtle::NoBarrier_Store(&stopping_, 1);
+    work_event_.Signal();
+    base::PlatformThread::Join(handle_);
+  }
+
+  // Starts walking a slab.
+  // @param lower_bound The lower bound of the slab.
+  // @param length The length of the slab.
+  void StartWalk(const uint8_t* lower_bound, size_t length) {
+    lower_bound_ = lower_bound;
+    length_ = length;
+    work_event_.Signal();
+  }
+
+  // Waits until the walk started by StartWalk is done.
+  void WaitForWalk() { done_event_.Wait(); }
+
+  // @name Accessors.
+  // @{
+  bool created() const { return created_; }
+  const uint8_t* lower_bound() const { return lower_bound_; }
+  size_t length() const { return length_; }
+  const SlabResult& result() const { return result_; }
+  // @}
+
+ private:
+  // Implementation of PlatformThread::Delegate:
+  void ThreadMain() override {
+    base::PlatformThread::SetName("SyzyASAN Heap Checker Thread");
+    ready_event_.Signal();
+    while (true) {
+      work_event_.Wait();
+      if (base::subtle::NoBarrier_Load(&stopping_))
+        break;
+      owner_->GetCorruptRangesInSlab(lower_bound_, length_, &result_);
+      done_event_.Signal();
+    }
+  }
+
+  // The checker that owns this thread.
+  HeapChecker* owner_;
+
+  // The slab being walked, and its results.
+  const uint8_t* lower_bound_;
+  size_t length_;
+  SlabResult result_;
+
+  // Indicates if the thread has been created.
+  bool created_;
+
+  // Set when the thread must exit.
+  base::subtle::Atomic32 stopping_;
+
+  // Used to signal that the thread is ready, that a slab has to be walked,
+  // and that the walk is done.
+  base::WaitableEvent ready_event_;
+  base::WaitableEvent work_event_;
+  base::WaitableEvent done_event_;
+
+  // Handle to the thread, used to join the thread when stopping.
+  base::PlatformThreadHandle handle_;
+
+  DISALLOW_COPY_AND_ASSIGN(HelperThread);
+};
+
+const size_t HeapChecker::kMaxThreadCount = 4;
+const size_t HeapChecker::kMaxCorruptRangesPerHelperThread = 16;
+
+HeapChecker::SlabResult::SlabResult()
+    : max_corrupt_range_count(std::numeric_limits<size_t>::max()),
+      has_blocks(false),
+      first_block_is_corrupt(false),
+      last_block_is_corrupt(false),
+      overflowed(false) {
+}
+
 HeapChecker::HeapChecker(Shadow* shadow)
+    : HeapChecker(shadow, std::min(GetProcessorCount(), kMaxThreadCount)) {
+}
+
+HeapChecker::HeapChecker(Shadow* shadow, size_t thread_count)
     : shadow_(shadow) {
   DCHECK_NE(static_cast<Shadow*>(nullptr), shadow);
+  DCHECK_LT(0u, thread_count);
+
+  for (size_t i = 1; i < thread_count; ++i) {
+    std::unique_ptr<HelperThread> helper_thread(new HelperThread(this));
+    if (helper_thread->Start()) {
+      helper_threads_.push_back(std::move(helper_thread));
+      continue;
+    }
+    // Make do with the threads that have been started so far.
+    if (helper_thread->created())
+      ignore_result(helper_thread.release());
+    break;
+  }
+}
+
+HeapChecker::~HeapChecker() {
+  for (auto& helper_thread : helper_threads_)
+    helper_thread->Stop();
 }
 
 bool HeapChecker::IsHeapCorrupt(CorruptRangesVector* corrupt_ranges) {
@@ -33,25 +186,66 @@ bool HeapChecker::IsHeapCorrupt(CorruptRangesVector* corrupt_ranges) {
 
   // Grab the page protection lock. This prevents multiple heap checkers from
   // running simultaneously, and also prevents page protections from being
-  // modified from underneath us.
+  // modified from underneath us. The helper threads modify the protections
+  // on our behalf.
   ::common::AutoRecursiveLock scoped_lock(block_protect_lock);
 
-  // Walk over all of the addressable memory to find the corrupt blocks.
+  // Walk over all of the addressable memory to find the corrupt blocks. It is
+  // split in one slab per thread, the first one being walked by this thread.
   // TODO(sebmarchand): Iterates over the heap slabs once we have switched to
   //     a new memory allocator.
-  GetCorruptRangesInSlab(
-      reinterpret_cast<const uint8_t*>(Shadow::kAddressLowerBound),
-      shadow_->memory_size() - Shadow::kAddressLowerBound - 1, corrupt_ranges);
+  const uint8_t* lower_bound =
+      reinterpret_cast<const uint8_t*>(Shadow::kAddressLowerBound);
+  size_t length = shadow_->memory_size() - Shadow::kAddressLowerBound - 1;
+  size_t slab_size = ::common::AlignUp(
+      (length + thread_count() - 1) / thread_count(), GetPageSize());
+
+  size_t helper_thread_count = 0;
+  for (; helper_thread_count < helper_threads_.size(); ++helper_thread_count) {
+    size_t offset = (helper_thread_count + 1) * slab_size;
+    if (offset >= length)
+      break;
+    helper_threads_[helper_thread_count]->StartWalk(
+        lower_bound + offset, std::min(slab_size, length - offset));
+  }
+
+  SlabResult result;
+  GetCorruptRangesInSlab(lower_bound, std::min(slab_size, length), &result);
+  bool previous_block_is_corrupt = false;
+  MergeSlabResult(result, &previous_block_is_corrupt, corrupt_ranges);
+
+  // Gather the results of the helper threads, in the order of their slabs.
+  for (size_t i = 0; i < helper_thread_count; ++i) {
+    HelperThread* helper_thread = helper_threads_[i].get();
+    helper_thread->WaitForWalk();
+    if (!helper_thread->result().overflowed) {
+      MergeSlabResult(helper_thread->result(), &previous_block_is_corrupt,
+                      corrupt_ranges);
+      continue;
+    }
+
+    // The helper thread couldn't hold all of the ranges, walk the slab again.
+    GetCorruptRangesInSlab(helper_thread->lower_bound(),
+                           helper_thread->length(), &result);
+    MergeSlabResult(result, &previous_block_is_corrupt, corrupt_ranges);
+  }
 
   return !corrupt_ranges->empty();
 }
 
 void HeapChecker::GetCorruptRangesInSlab(const uint8_t* lower_bound,
                                          size_t length,
-                                         CorruptRangesVector* corrupt_ranges) {
+                                         SlabResult* result) {
   DCHECK_NE(static_cast<const uint8_t*>(nullptr), lower_bound);
   DCHECK_NE(0U, length);
-  DCHECK_NE(static_cast<CorruptRangesVector*>(nullptr), corrupt_ranges);
+  DCHECK_NE(static_cast<SlabResult*>(nullptr), result);
+
+  CorruptRangesVector* corrupt_ranges = &result->corrupt_ranges;
+  corrupt_ranges->clear();
+  result->has_blocks = false;
+  result->first_block_is_corrupt = false;
+  result->last_block_is_corrupt = false;
+  result->overflowed = false;
 
   ShadowWalker shadow_walker(
       shadow_, false, lower_bound, lower_bound + length);
@@ -63,14 +257,25 @@ void HeapChecker::GetCorruptRangesInSlab(const uint8_t* lower_bound,
   while (shadow_walker.Next(&block_info)) {
     // Remove the protections on this block so its checksum can be safely
     // validated. We leave the protections permanently removed so that the
-    // minidump generation has free access to block contents.
-    BlockProtectNone(block_info, shadow_);
+    // minidump generation has free access to block contents. The caller of
+    // IsHeapCorrupt holds the protection lock.
+    BlockProtectNoneUnlocked(block_info, shadow_);
 
     bool current_block_is_corrupt = IsBlockCorrupt(block_info);
+    if (!result->has_blocks) {
+      result->has_blocks = true;
+      result->first_block_is_corrupt = current_block_is_corrupt;
+    }
+    result->last_block_is_corrupt = current_block_is_corrupt;
+
     // If the current block is corrupt and |current_corrupt_range| is nullptr
     // then this means that the current block is at the beginning of a corrupt
     // range.
     if (current_block_is_corrupt && current_corrupt_range == nullptr) {
+      if (corrupt_ranges->size() == result->max_corrupt_range_count) {
+        result->overflowed = true;
+        return;
+      }
       AsanCorruptBlockRange corrupt_range;
       corrupt_range.address = block_info.header;
       corrupt_range.length = 0;
@@ -98,5 +303,33 @@ void HeapChecker::GetCorruptRangesInSlab(const uint8_t* lower_bound,
   }
 }
 
+void HeapChecker::MergeSlabResult(const SlabResult& result,
+                                  bool* previous_block_is_corrupt,
+                                  CorruptRangesVector* corrupt_ranges) {
+  DCHECK_NE(static_cast<bool*>(nullptr), previous_block_is_corrupt);
+  DCHECK_NE(static_cast<CorruptRangesVector*>(nullptr), corrupt_ranges);
+  DCHECK(!result.overflowed);
+
+  // Empty slabs don't break the ranges.
+  if (!result.has_blocks)
+    return;
+
+  auto range = result.corrupt_ranges.begin();
+  if (*previous_block_is_corrupt && result.first_block_is_corrupt) {
+    // The first range of this slab is the continuation of the last one.
+    DCHECK(!corrupt_ranges->empty());
+    DCHECK(range != result.corrupt_ranges.end());
+    AsanCorruptBlockRange* last_range = &corrupt_ranges->back();
+    last_range->block_count += range->block_count;
+    last_range->length =
+        reinterpret_cast<const uint8_t*>(range->address) + range->length -
+        reinterpret_cast<const uint8_t*>(last_range->address);
+    ++range;
+  }
+  corrupt_ranges->insert(corrupt_ranges->end(), range,
+                         result.corrupt_ranges.end());
+  *previous_block_is_corrupt = result.last_block_is_corrupt;
+}
+
 }  // namespace asan
 }  // namespace agent
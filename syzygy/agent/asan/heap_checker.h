@@ -17,6 +17,7 @@
 #ifndef SYZYGY_AGENT_ASAN_HEAP_CHECKER_H_
 #define SYZYGY_AGENT_ASAN_HEAP_CHECKER_H_
 
+#include <memory>
 #include <vector>
 
 #include "base/logging.h"
@@ -31,14 +32,36 @@ class AsanRuntime;
 class Shadow;
 
 // A class to analyze the heap and to check if it's corrupt.
+//
+// The shadow memory is split in as many slabs as there are threads, and the
+// slabs are walked in parallel. The helper threads are started when the
+// checker is created so that none have to be started once the heaps are
+// locked, as the thread startup code might need to allocate memory.
 class HeapChecker {
  public:
   typedef std::vector<AsanCorruptBlockRange> CorruptRangesVector;
 
-  // Constructor.
+  // The maximum number of threads used by default.
+  static const size_t kMaxThreadCount;
+
+  // The number of corrupt ranges that a helper thread can report for its slab.
+  // If a slab has more than this then it gets walked again by the thread
+  // calling IsHeapCorrupt, as the helper threads mustn't allocate memory.
+  static const size_t kMaxCorruptRangesPerHelperThread;
+
+  // Constructor. Uses one thread per processor, up to kMaxThreadCount.
   // @param shadow The shadow memory to query.
   explicit HeapChecker(Shadow* shadow);
 
+  // Constructor.
+  // @param shadow The shadow memory to query.
+  // @param thread_count The number of threads walking the shadow, including
+  //     the one calling IsHeapCorrupt. Must be at least 1.
+  HeapChecker(Shadow* shadow, size_t thread_count);
+
+  // Destructor. Stops the helper threads.
+  ~HeapChecker();
+
   // Checks if the heap is corrupt and returns the information about the
   // corrupt ranges. This permanently removes all page protections as it
   // walks through memory.
@@ -47,23 +70,60 @@ class HeapChecker {
   // @returns true if the heap is corrupt, false otherwise.
   bool IsHeapCorrupt(CorruptRangesVector* corrupt_ranges);
 
+  // @returns the number of threads used to walk the shadow, including the one
+  //     calling IsHeapCorrupt.
+  size_t thread_count() const { return helper_threads_.size() + 1; }
+
   // TODO(sebmarchand): Add a testing seam that controls the range of memory
   //     that is walked by HeapChecker to keep unittest times to something
   //     reasonable.
 
  private:
-  // Get the information about the corrupt ranges in a heap slab.
+  class HelperThread;
+
+  // The results of the walk of a slab.
+  struct SlabResult {
+    SlabResult();
+
+    // The corrupt ranges in the slab.
+    CorruptRangesVector corrupt_ranges;
+    // The maximum number of entries in |corrupt_ranges|.
+    size_t max_corrupt_range_count;
+    // True if at least one block was found in the slab.
+    bool has_blocks;
+    // Indicates if the first and the last blocks of the slab are corrupt, so
+    // that the ranges spanning several slabs can be merged.
+    bool first_block_is_corrupt;
+    bool last_block_is_corrupt;
+    // True if the slab had more than |max_corrupt_range_count| ranges.
+    bool overflowed;
+  };
+
+  // Get the information about the corrupt ranges in a heap slab. Blocks
+  // starting in the slab are walked entirely, even if they extend beyond it.
   // @param lower_bound The lower bound for this slab.
   // @param length The length of this slab.
-  // @param corrupt_ranges Will receive the information about the corrupt ranges
-  //     in this slab.
+  // @param result Will receive the results for this slab.
   void GetCorruptRangesInSlab(const uint8_t* lower_bound,
                               size_t length,
+                              SlabResult* result);
+
+  // Appends the ranges found in a slab to the ranges of the previous slabs,
+  // merging the ranges that span the slab boundary.
+  // @param result The results for the slab.
+  // @param previous_block_is_corrupt Indicates if the last block before this
+  //     slab is corrupt. Updated on return.
+  // @param corrupt_ranges The ranges of the previous slabs.
+  static void MergeSlabResult(const SlabResult& result,
+                              bool* previous_block_is_corrupt,
                               CorruptRangesVector* corrupt_ranges);
 
   // The shadow memory that will be analyzed.
   Shadow* shadow_;
 
+  // The helper threads, and the results of their slabs.
+  std::vector<std::unique_ptr<HelperThread>> helper_threads_;
+
   DISALLOW_COPY_AND_ASSIGN(HeapChecker);
 };
 
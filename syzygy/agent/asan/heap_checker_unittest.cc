@@ -206,5 +206,63 @@ TEST_F(HeapCheckerTest, IsHeapCorrupt) {
   ::free(global_alloc);
 }
 
+TEST_F(HeapCheckerTest, ParallelWalkMatchesSequentialWalk) {
+  const size_t kAllocSize = 100;
+
+  BlockLayout block_layout = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, kAllocSize, 0, 0,
+                              &block_layout));
+
+  // Use enough blocks to have more corrupt ranges than a helper thread can
+  // report on its own.
+  const size_t kNumberOfBlocks =
+      4 * HeapChecker::kMaxCorruptRangesPerHelperThread;
+  size_t total_alloc_size = block_layout.block_size * kNumberOfBlocks;
+  uint8_t* global_alloc =
+      reinterpret_cast<uint8_t*>(::malloc(total_alloc_size));
+
+  std::vector<BlockHeader*> block_headers;
+  for (size_t i = 0; i < kNumberOfBlocks; ++i) {
+    BlockInfo block_info = {};
+    BlockInitialize(block_layout, global_alloc + i * block_layout.block_size,
+                    false, &block_info);
+    runtime_->shadow()->PoisonAllocatedBlock(block_info);
+    BlockSetChecksum(block_info);
+    block_headers.push_back(block_info.header);
+  }
+
+  // Corrupt every other block.
+  for (size_t i = 0; i < kNumberOfBlocks; i += 2)
+    block_headers[i]->magic++;
+
+  HeapChecker sequential_heap_checker(runtime_->shadow(), 1);
+  EXPECT_EQ(1u, sequential_heap_checker.thread_count());
+  HeapChecker::CorruptRangesVector sequential_corrupt_ranges;
+  EXPECT_TRUE(
+      sequential_heap_checker.IsHeapCorrupt(&sequential_corrupt_ranges));
+  EXPECT_EQ(kNumberOfBlocks / 2, sequential_corrupt_ranges.size());
+
+  HeapChecker parallel_heap_checker(runtime_->shadow(), 4);
+  EXPECT_GE(4u, parallel_heap_checker.thread_count());
+  HeapChecker::CorruptRangesVector parallel_corrupt_ranges;
+  EXPECT_TRUE(parallel_heap_checker.IsHeapCorrupt(&parallel_corrupt_ranges));
+
+  ASSERT_EQ(sequential_corrupt_ranges.size(), parallel_corrupt_ranges.size());
+  for (size_t i = 0; i < sequential_corrupt_ranges.size(); ++i) {
+    EXPECT_EQ(sequential_corrupt_ranges[i].address,
+              parallel_corrupt_ranges[i].address);
+    EXPECT_EQ(sequential_corrupt_ranges[i].length,
+              parallel_corrupt_ranges[i].length);
+    EXPECT_EQ(sequential_corrupt_ranges[i].block_count,
+              parallel_corrupt_ranges[i].block_count);
+  }
+
+  for (size_t i = 0; i < kNumberOfBlocks; i += 2)
+    block_headers[i]->magic--;
+
+  runtime_->shadow()->Unpoison(global_alloc, total_alloc_size);
+  ::free(global_alloc);
+}
+
 }  // namespace asan
 }  // namespace agent
@@ -63,6 +63,15 @@ class HeapManagerInterface {
   // @returns the size of the block on success, 0 otherwise.
   virtual uint32_t Size(HeapId heap, const void* alloc) = 0;
 
+  // Tries to resize a heap allocation without moving it.
+  // @param heap A hint on the heap that might contain this allocation.
+  // @param alloc The pointer to the allocation to be resized. This must be a
+  //     value that was previously returned by a call to 'Allocate'.
+  // @param bytes The new size of the allocation, in bytes.
+  // @returns true if the allocation now has a size of @p bytes, false if it
+  //     was left untouched and must be moved to be resized.
+  virtual bool ResizeInPlace(HeapId heap, void* alloc, uint32_t bytes) = 0;
+
   // Locks a heap.
   // @param heap The ID of the heap that should be locked.
   virtual void Lock(HeapId heap) = 0;
@@ -19,8 +19,11 @@
 
 #include "base/bind.h"
 #include "base/rand_util.h"
+#include "syzygy/agent/asan/block_utils.h"
+#include "syzygy/agent/asan/constants.h"
 #include "syzygy/agent/asan/page_protection_helpers.h"
 #include "syzygy/agent/asan/runtime.h"
+#include "syzygy/agent/asan/runtime_counters.h"
 #include "syzygy/agent/asan/shadow.h"
 #include "syzygy/agent/asan/timed_try.h"
 #include "syzygy/agent/asan/heaps/internal_heap.h"
@@ -45,6 +48,32 @@ using heaps::ZebraBlockHeap;
 // TODO(georgesak): allow this to be changed through the parameters.
 enum : uint32_t { kOverbudgetSizePercentage = 20 };
 
+// The maximum number of blocks that are popped from a quarantine at once when
+// trimming it. This bounds the time spent holding a shard lock.
+enum : size_t { kTrimBatchSize = 32 };
+
+// The maximum number of workers of the deferred free thread. Trimming mostly
+// contends on the heaps, so more workers than this don't help.
+enum : size_t { kMaxDeferredFreeWorkerCount = 4 };
+
+// The maximum rate at which the quarantine checker thread can be asked to
+// check blocks, per second. This bounds the time spent holding the shard locks
+// of the shared quarantine.
+enum : size_t { kMaxQuarantineCheckRate = 100000 };
+
+// Hashes the seed of the allocation guard sampling, an allocation site and
+// the count of one of its allocations. This is the finalizer of MurmurHash3,
+// which is cheap and mixes all the bits of its input.
+uint32_t HashSiteAllocation(uint32_t seed, uint32_t stack_id, uint32_t count) {
+  uint32_t h = seed ^ (stack_id * 0x9E3779B9u) ^ (count * 0x85EBCA6Bu);
+  h ^= h >> 16;
+  h *= 0x85EBCA6Bu;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35u;
+  h ^= h >> 16;
+  return h;
+}
+
 // Return the position of the most significant bit in a 32 bit unsigned value.
 size_t GetMSBIndex(size_t n) {
   // Algorithm taken from
@@ -75,15 +104,25 @@ BlockHeapManager::BlockHeapManager(Shadow* shadow,
       stack_cache_(stack_cache),
       memory_notifier_(memory_notifier),
       initialized_(false),
+      heap_table_(nullptr),
+      heap_table_readers_(0),
       process_heap_(nullptr),
       process_heap_underlying_heap_(nullptr),
       process_heap_id_(0),
       zebra_block_heap_(nullptr),
       zebra_block_heap_id_(0),
       large_block_heap_id_(0),
+      heap_partition_count_(0),
       locked_heaps_(nullptr),
       enable_page_protections_(true),
-      corrupt_block_registry_cache_(L"SyzyAsanCorruptBlocks") {
+      corrupt_block_registry_cache_(L"SyzyAsanCorruptBlocks"),
+      corrupt_block_registry_cache_loaded_(false),
+      thread_block_cache_tls_(TLS_OUT_OF_INDEXES),
+      alloc_stack_id_tls_(TLS_OUT_OF_INDEXES),
+      allocs_until_stack_capture_tls_(TLS_OUT_OF_INDEXES),
+      deferred_free_async_trim_count_(0),
+      deferred_free_sync_trim_count_(0),
+      quarantine_check_cursor_(0) {
   DCHECK_NE(static_cast<Shadow*>(nullptr), shadow);
   DCHECK_NE(static_cast<StackCaptureCache*>(nullptr), stack_cache);
   DCHECK_NE(static_cast<MemoryNotifierInterface*>(nullptr), memory_notifier);
@@ -94,6 +133,16 @@ BlockHeapManager::BlockHeapManager(Shadow* shadow,
   CHECK_NE(TLS_OUT_OF_INDEXES, allocation_filter_flag_tls_);
   // And disable it by default.
   set_allocation_filter_flag(false);
+
+  // The thread block caches are created lazily.
+  thread_block_cache_tls_ = ::TlsAlloc();
+  CHECK_NE(TLS_OUT_OF_INDEXES, thread_block_cache_tls_);
+
+  // The sampled allocation stacks. Threads start by capturing a stack.
+  alloc_stack_id_tls_ = ::TlsAlloc();
+  CHECK_NE(TLS_OUT_OF_INDEXES, alloc_stack_id_tls_);
+  allocs_until_stack_capture_tls_ = ::TlsAlloc();
+  CHECK_NE(TLS_OUT_OF_INDEXES, allocs_until_stack_capture_tls_);
 }
 
 BlockHeapManager::~BlockHeapManager() {
@@ -106,7 +155,6 @@ void BlockHeapManager::Init() {
   {
     base::AutoLock lock(lock_);
     InitInternalHeap();
-    corrupt_block_registry_cache_.Init();
   }
 
   // This takes care of its own locking, as its reentrant.
@@ -133,6 +181,7 @@ HeapId BlockHeapManager::CreateHeap() {
   underlying_heaps_map_.insert(std::make_pair(heap, underlying_heap));
   HeapMetadata metadata = { &shared_quarantine_, false };
   auto result = heaps_.insert(std::make_pair(heap, metadata));
+  PublishHeapTableUnlocked();
   return GetHeapId(result);
 }
 
@@ -142,12 +191,17 @@ bool BlockHeapManager::DestroyHeap(HeapId heap_id) {
   BlockHeapInterface* heap = GetHeapFromId(heap_id);
   BlockQuarantineInterface* quarantine = GetQuarantineFromId(heap_id);
 
+  // The blocks whose flood fill is pending aren't in the quarantine yet, and
+  // would otherwise outlive their heap.
+  ApplyPendingFloodFills();
+
   {
     // Move the heap from the active to the dying list. This prevents it from
     // being used while it's being torn down.
     base::AutoLock lock(lock_);
     auto iter = heaps_.find(heap);
     iter->second.is_dying = true;
+    PublishHeapTableUnlocked();
   }
 
   // Destroy the heap and flush its quarantine. This is done outside of the
@@ -161,6 +215,7 @@ bool BlockHeapManager::DestroyHeap(HeapId heap_id) {
     base::AutoLock lock(lock_);
     DestroyHeapResourcesUnlocked(heap, quarantine);
     heaps_.erase(heaps_.find(heap));
+    PublishHeapTableUnlocked();
   }
 
   return true;
@@ -170,44 +225,79 @@ void* BlockHeapManager::Allocate(HeapId heap_id, uint32_t bytes) {
   DCHECK(initialized_);
   DCHECK(IsValidHeapId(heap_id, false));
 
-  // Some allocations can pass through without instrumentation.
-  if (parameters_.allocation_guard_rate < 1.0 &&
+  // Some allocations can pass through without instrumentation. Unless the
+  // guard rates are per site, this is decided by a coin toss before the stack
+  // is captured.
+  if (parameters_.allocation_guard_site_threshold == 0 &&
+      parameters_.allocation_guard_rate < 1.0 &&
       base::RandDouble() >= parameters_.allocation_guard_rate) {
-    BlockHeapInterface* heap = GetHeapFromId(heap_id);
-    void* alloc = heap->Allocate(bytes);
-    if ((heap->GetHeapFeatures() &
-        HeapInterface::kHeapReportsReservations) != 0) {
-      shadow_->Unpoison(alloc, bytes);
-    }
-    return alloc;
+    return AllocateUnguarded(heap_id, bytes);
   }
 
   // Capture the current stack. InitFromStack is inlined to preserve the
-  // greatest number of stack frames.
+  // greatest number of stack frames. When the allocation stacks are sampled
+  // most allocations skip this, and are attributed the stack last captured
+  // by this thread instead.
   common::StackCapture stack;
-  stack.InitFromStack();
+  const common::StackCapture* alloc_stack = ReuseThreadAllocStack();
+  if (alloc_stack == nullptr)
+    stack.InitFromStack();
+
+  // The per-site guard rates are looked up by allocation stack.
+  if (parameters_.allocation_guard_site_threshold != 0 &&
+      !ShouldGuardSiteAllocation(alloc_stack != nullptr ?
+          alloc_stack->absolute_stack_id() : stack.absolute_stack_id())) {
+    if (alloc_stack != nullptr)
+      stack_cache_->ReleaseStackTrace(alloc_stack);
+    return AllocateUnguarded(heap_id, bytes);
+  }
 
   // Build the set of heaps that will be used to satisfy the allocation. This
   // is a stack of heaps, and they will be tried in the reverse order they are
   // inserted.
 
+  // When the allocations are filtered by stack the allocation stack is needed
+  // to choose the heaps, so it's saved right away. Its relative ID is only
+  // computed once per stack in the cache.
+  if (alloc_stack == nullptr && parameters_.enable_allocation_filter &&
+      allocation_filter_stack_ids_.get() != nullptr) {
+    alloc_stack = stack_cache_->SaveStackTrace(stack);
+    SetThreadAllocStack(alloc_stack);
+  }
+  bool allocation_filtered = IsAllocationFiltered(alloc_stack);
+
+  // The allocations made on the process heap are spread over its partitions,
+  // according to their allocation stack.
+  if (heap_id == process_heap_id_) {
+    size_t partition_count = GetHeapPartitionCount();
+    if (partition_count != 0) {
+      heap_id = SelectHeapPartition(alloc_stack != nullptr ?
+          alloc_stack->absolute_stack_id() : stack.absolute_stack_id(),
+          partition_count);
+    }
+  }
+
   // We can always use the heap that was passed in.
   HeapId heaps[3] = { heap_id, 0, 0 };
   size_t heap_count = 1;
-  if (MayUseLargeBlockHeap(bytes)) {
+  if (MayUseLargeBlockHeap(bytes, allocation_filtered)) {
     DCHECK_LT(heap_count, arraysize(heaps));
     heaps[heap_count++] = large_block_heap_id_;
   }
 
-  if (MayUseZebraBlockHeap(bytes)) {
+  if (MayUseZebraBlockHeap(bytes, allocation_filtered)) {
     DCHECK_LT(heap_count, arraysize(heaps));
     heaps[heap_count++] = zebra_block_heap_id_;
   }
 
-  // Use the selected heaps to try to satisfy the allocation.
+  // Use the selected heaps to try to satisfy the allocation. If only the
+  // requested heap can be used then first try the thread block cache.
   void* alloc = nullptr;
   BlockLayout block_layout = {};
-  for (int i = static_cast<int>(heap_count) - 1; i >= 0; --i) {
+  if (heap_count == 1)
+    alloc = AllocateFromThreadBlockCache(heap_id, bytes, &block_layout);
+  for (int i = static_cast<int>(heap_count) - 1;
+       alloc == nullptr && i >= 0; --i) {
     BlockHeapInterface* heap = GetHeapFromId(heaps[i]);
     alloc = heap->AllocateBlock(
         bytes,
@@ -221,8 +311,11 @@ void* BlockHeapManager::Allocate(HeapId heap_id, uint32_t bytes) {
   }
 
   // The allocation can fail if we're out of memory.
-  if (alloc == nullptr)
+  if (alloc == nullptr) {
+    if (alloc_stack != nullptr)
+      stack_cache_->ReleaseStackTrace(alloc_stack);
     return nullptr;
+  }
 
   DCHECK_NE(static_cast<void*>(nullptr), alloc);
   DCHECK_EQ(0u, reinterpret_cast<size_t>(alloc) % kShadowRatio);
@@ -232,9 +325,18 @@ void* BlockHeapManager::Allocate(HeapId heap_id, uint32_t bytes) {
   // Poison the redzones in the shadow memory as early as possible.
   shadow_->PoisonAllocatedBlock(block);
 
-  block.header->alloc_stack = stack_cache_->SaveStackTrace(stack);
+  if (alloc_stack == nullptr) {
+    alloc_stack = stack_cache_->SaveStackTrace(stack);
+    SetThreadAllocStack(alloc_stack);
+  }
+  block.header->alloc_stack = alloc_stack;
   block.header->free_stack = nullptr;
   block.header->state = ALLOCATED_BLOCK;
+  AddRuntimeCounter(kAllocationCountCounter, 1);
+  AddRuntimeCounter(kAllocatedBytesCounter, bytes);
+
+  if (heap_profiler_.get() != nullptr)
+    heap_profiler_->RecordAllocation(bytes, stack);
 
   block.trailer->heap_id = heap_id;
 
@@ -253,6 +355,8 @@ bool BlockHeapManager::Free(HeapId heap_id, void* alloc) {
   if (alloc == nullptr)
     return true;
 
+  AddRuntimeCounter(kFreeCountCounter, 1);
+
   BlockInfo block_info = {};
   if (!shadow_->IsBeginningOfBlockBody(alloc) ||
       !GetBlockInfo(shadow_, reinterpret_cast<BlockBody*>(alloc),
@@ -286,8 +390,9 @@ bool BlockHeapManager::Free(HeapId heap_id, void* alloc) {
   BlockQuarantineInterface* quarantine = GetQuarantineFromId(heap_id);
 
   // Poison the released alloc (marked as freed) and quarantine the block.
-  // Note that the original data is left intact. This may make it easier
-  // to debug a crash report/dump on access to a quarantined block.
+  // Note that the original data is left intact, unless its pages are
+  // decommitted. This may make it easier to debug a crash report/dump on
+  // access to a quarantined block.
   shadow_->MarkAsFreed(block_info.body, block_info.body_size);
 
   // We need to update the block's metadata before pushing it into the
@@ -300,22 +405,56 @@ bool BlockHeapManager::Free(HeapId heap_id, void* alloc) {
   block_info.trailer->free_ticks = ::GetTickCount();
   block_info.trailer->free_tid = ::GetCurrentThreadId();
 
+  // Release the physical memory of the whole pages of the body. These read as
+  // zeros from now on, so the checksum of the body still catches any write to
+  // them, but the block isn't flooded as that would commit them again.
+  bool decommitted = parameters_.decommit_quarantined_pages &&
+      BlockDecommitBodyPages(block_info);
+
   // Flip a coin and sometimes flood the block. When flooded, overwrites are
   // clearly visible; when not flooded, the original contents are left visible.
-  bool flood = parameters_.quarantine_flood_fill_rate > 0.0 &&
+  bool flood = !decommitted && parameters_.quarantine_flood_fill_rate > 0.0 &&
       base::RandDouble() <= parameters_.quarantine_flood_fill_rate;
-  if (flood) {
-    block_info.header->state = QUARANTINED_FLOODED_BLOCK;
-    ::memset(block_info.body, kBlockFloodFillByte, block_info.body_size);
-  } else {
+  if (!flood) {
     block_info.header->state = QUARANTINED_BLOCK;
+    return QuarantineBlock(&block_info, quarantine);
+  }
+
+  // The flood fill can be left to the deferred free thread. Until then the
+  // block is checksummed as an unflooded quarantined block, which keeps the
+  // double free and corruption checks valid. This is done under the lock of
+  // the thread so that DisableDeferredFreeThread sees the pending block.
+  if (parameters_.defer_quarantine_flood_fill) {
+    base::AutoLock lock(deferred_free_thread_lock_);
+    if (deferred_free_thread_) {
+      block_info.header->state = QUARANTINED_BLOCK;
+      BlockSetChecksum(block_info);
+      CompactBlockInfo compact = {};
+      ConvertBlockInfo(block_info, &compact);
+      {
+        base::AutoLock pending_lock(pending_flood_fills_lock_);
+        pending_flood_fills_.push_back(compact);
+      }
+      deferred_free_thread_->SignalWork(1);
+      return true;
+    }
   }
 
+  block_info.header->state = QUARANTINED_FLOODED_BLOCK;
+  BlockFloodFillBody(block_info);
+  return QuarantineBlock(&block_info, quarantine);
+}
+
+bool BlockHeapManager::QuarantineBlock(BlockInfo* block_info,
+                                       BlockQuarantineInterface* quarantine) {
+  DCHECK_NE(static_cast<BlockInfo*>(nullptr), block_info);
+  DCHECK_NE(static_cast<BlockQuarantineInterface*>(nullptr), quarantine);
+
   // Update the block checksum.
-  BlockSetChecksum(block_info);
+  BlockSetChecksum(*block_info);
 
   CompactBlockInfo compact = {};
-  ConvertBlockInfo(block_info, &compact);
+  ConvertBlockInfo(*block_info, &compact);
 
   PushResult push_result = {};
   {
@@ -324,8 +463,10 @@ bool BlockHeapManager::Free(HeapId heap_id, void* alloc) {
     push_result = quarantine->Push(compact);
     if (!push_result.push_successful) {
       TrimOrScheduleIfNecessary(push_result.trim_status, quarantine);
-      return FreePristineBlock(&block_info);
+      return FreePristineBlock(block_info);
     }
+    AddRuntimeCounter(kQuarantineCountCounter, 1);
+    AddRuntimeCounter(kQuarantineSizeCounter, compact.block_size);
 
     if (enable_page_protections_) {
       // The recently pushed block can be popped out in TrimQuarantine if the
@@ -333,7 +474,7 @@ bool BlockHeapManager::Free(HeapId heap_id, void* alloc) {
       // properly unprotecting and freeing the block. If the protection is set
       // blindly after TrimQuarantine we could end up protecting a free (not
       // quarantined, not allocated) block.
-      BlockProtectAll(block_info, shadow_);
+      BlockProtectAll(*block_info, shadow_);
     }
   }
 
@@ -342,17 +483,44 @@ bool BlockHeapManager::Free(HeapId heap_id, void* alloc) {
   return true;
 }
 
+void BlockHeapManager::ApplyPendingFloodFills() {
+  std::vector<CompactBlockInfo> blocks;
+  {
+    base::AutoLock lock(pending_flood_fills_lock_);
+    blocks.swap(pending_flood_fills_);
+  }
+
+  for (const CompactBlockInfo& compact : blocks) {
+    BlockInfo block_info = {};
+    ConvertBlockInfo(compact, &block_info);
+
+    // A use after free may have happened since the block was freed. It is
+    // reported rather than hidden by the flood fill.
+    if (!BlockChecksumIsValid(block_info)) {
+      if (ShouldReportCorruptBlock(&block_info))
+        ReportHeapError(block_info.header, CORRUPT_BLOCK);
+      FreeCorruptBlock(&block_info);
+      continue;
+    }
+
+    block_info.header->state = QUARANTINED_FLOODED_BLOCK;
+    BlockFloodFillBody(block_info);
+    QuarantineBlock(&block_info,
+                    GetQuarantineFromId(block_info.trailer->heap_id));
+  }
+}
+
 uint32_t BlockHeapManager::Size(HeapId heap_id, const void* alloc) {
   DCHECK(initialized_);
   DCHECK(IsValidHeapId(heap_id, false));
 
   if (shadow_->IsBeginningOfBlockBody(alloc)) {
-    BlockInfo block_info = {};
-    if (!GetBlockInfo(shadow_, reinterpret_cast<const BlockBody*>(alloc),
-                      &block_info)) {
+    uint32_t body_size = 0;
+    if (!GetBlockBodySize(shadow_, reinterpret_cast<const BlockBody*>(alloc),
+                          &body_size)) {
       return 0;
     }
-    return block_info.body_size;
+    return body_size;
   }
 
   BlockHeapInterface* heap = GetHeapFromId(heap_id);
@@ -364,6 +532,78 @@ uint32_t BlockHeapManager::Size(HeapId heap_id, const void* alloc) {
   }
 }
 
+bool BlockHeapManager::ResizeInPlace(HeapId heap_id,
+                                     void* alloc,
+                                     uint32_t bytes) {
+  DCHECK(initialized_);
+  DCHECK(IsValidHeapId(heap_id, false));
+
+  // Only the guarded blocks are resized, the unguarded allocations and the
+  // corrupt blocks are left to the path that moves them.
+  BlockInfo block_info = {};
+  if (alloc == nullptr || !shadow_->IsBeginningOfBlockBody(alloc) ||
+      !GetBlockInfo(shadow_, reinterpret_cast<BlockBody*>(alloc),
+                    &block_info)) {
+    return false;
+  }
+  if (block_info.is_nested)
+    return false;
+
+  // The body grows into the trailer padding, or gives bytes back to it, and
+  // the trailer stays in place. The requested right redzone is preserved.
+  uint32_t available = block_info.body_size + block_info.trailer_padding_size;
+  if (bytes > available)
+    return false;
+  uint32_t padding_size = available - bytes;
+  if (padding_size < parameters_.trailer_padding_size)
+    return false;
+
+  // The shortest trailer paddings aren't encoded, they are implied by the
+  // body size. Those that don't match it require a new layout.
+  if (padding_size <= kShadowRatio / 2) {
+    uint32_t implied_size = 0;
+    if ((bytes % kShadowRatio) != (kShadowRatio / 2))
+      implied_size = (kShadowRatio / 2) - (bytes % (kShadowRatio / 2));
+    if (padding_size != implied_size)
+      return false;
+  }
+
+  if (enable_page_protections_)
+    BlockProtectNone(block_info, shadow_);
+
+  // A quarantined block is reported by the path that frees it again, and its
+  // protections are restored.
+  if (block_info.header->state != ALLOCATED_BLOCK) {
+    if (enable_page_protections_)
+      BlockProtectAll(block_info, shadow_);
+    return false;
+  }
+  if (!BlockChecksumIsValid(block_info)) {
+    if (enable_page_protections_)
+      BlockProtectRedzones(block_info, shadow_);
+    return false;
+  }
+
+  // Rewrite the body size and the trailer padding, then refresh the layout.
+  uint8_t* padding = block_info.RawBody() + bytes;
+  ::memset(padding, kBlockTrailerPaddingByte, padding_size);
+  if (padding_size > kShadowRatio / 2)
+    *reinterpret_cast<uint32_t*>(padding) = padding_size;
+  block_info.header->body_size = bytes;
+  block_info.header->has_excess_trailer_padding =
+      padding_size > kShadowRatio / 2;
+  bool parsed = BlockInfoFromMemory(block_info.header, &block_info);
+  DCHECK(parsed);
+  DCHECK_EQ(bytes, block_info.body_size);
+
+  shadow_->PoisonAllocatedBlock(block_info);
+  BlockSetChecksum(block_info);
+  if (enable_page_protections_)
+    BlockProtectRedzones(block_info, shadow_);
+
+  return true;
+}
+
 void BlockHeapManager::Lock(HeapId heap_id) {
   DCHECK(initialized_);
   DCHECK(IsValidHeapId(heap_id, false));
@@ -425,6 +665,10 @@ void BlockHeapManager::set_parameters(
 }
 
 void BlockHeapManager::TearDownHeapManager() {
+  // Move the blocks whose flood fill is pending to their quarantine, so that
+  // they are freed along with it.
+  ApplyPendingFloodFills();
+
   base::AutoLock lock(lock_);
 
   // This would indicate that we have outstanding heap locks being
@@ -438,12 +682,33 @@ void BlockHeapManager::TearDownHeapManager() {
   for (; iter_heaps != heaps_.end(); ++iter_heaps) {
     DCHECK(!iter_heaps->second.is_dying);
     iter_heaps->second.is_dying = true;
+    PublishHeapTableUnlocked();
     DestroyHeapContents(iter_heaps->first, iter_heaps->second.quarantine);
     DestroyHeapResourcesUnlocked(iter_heaps->first,
                                  iter_heaps->second.quarantine);
   }
-  // Clear the active heap list.
+  // Clear the active heap list. Nothing can be reading the heap tables
+  // anymore, so they're all freed.
   heaps_.clear();
+  delete heap_table_;
+  heap_table_ = nullptr;
+  for (HeapTable* table : retired_heap_tables_)
+    delete table;
+  retired_heap_tables_.clear();
+
+  // The thread block caches have been emptied along with the heaps.
+  {
+    base::AutoLock caches_lock(thread_block_caches_lock_);
+    for (ThreadBlockCache* cache : thread_block_caches_) {
+      cache->~ThreadBlockCache();
+      internal_heap_->Free(cache);
+    }
+    thread_block_caches_.clear();
+  }
+  if (thread_block_cache_tls_ != TLS_OUT_OF_INDEXES) {
+    ::TlsFree(thread_block_cache_tls_);
+    thread_block_cache_tls_ = TLS_OUT_OF_INDEXES;
+  }
 
   // Clear the specialized heap references since they were deleted.
   process_heap_ = nullptr;
@@ -452,12 +717,23 @@ void BlockHeapManager::TearDownHeapManager() {
   zebra_block_heap_ = nullptr;
   zebra_block_heap_id_ = 0;
   large_block_heap_id_ = 0;
+  base::subtle::Release_Store(&heap_partition_count_, 0);
 
   // Free the allocation-filter flag (TLS).
   if (allocation_filter_flag_tls_ != TLS_OUT_OF_INDEXES) {
     ::TlsFree(allocation_filter_flag_tls_);
     allocation_filter_flag_tls_ = TLS_OUT_OF_INDEXES;
   }
+
+  // Free the allocation stack sampling state (TLS).
+  if (alloc_stack_id_tls_ != TLS_OUT_OF_INDEXES) {
+    ::TlsFree(alloc_stack_id_tls_);
+    alloc_stack_id_tls_ = TLS_OUT_OF_INDEXES;
+  }
+  if (allocs_until_stack_capture_tls_ != TLS_OUT_OF_INDEXES) {
+    ::TlsFree(allocs_until_stack_capture_tls_);
+    allocs_until_stack_capture_tls_ = TLS_OUT_OF_INDEXES;
+  }
 }
 
 HeapId BlockHeapManager::GetHeapId(
@@ -476,7 +752,6 @@ bool BlockHeapManager::IsValidHeapIdUnsafe(HeapId heap_id, bool allow_dying) {
   HeapQuarantinePair* hq = reinterpret_cast<HeapQuarantinePair*>(heap_id);
   if (!IsValidHeapIdUnsafeUnlockedImpl1(hq))
     return false;
-  base::AutoLock auto_lock(lock_);
   if (!IsValidHeapIdUnlockedImpl2(hq, allow_dying))
     return false;
   return true;
@@ -498,7 +773,6 @@ bool BlockHeapManager::IsValidHeapId(HeapId heap_id, bool allow_dying) {
   HeapQuarantinePair* hq = reinterpret_cast<HeapQuarantinePair*>(heap_id);
   if (!IsValidHeapIdUnlockedImpl1(hq))
     return false;
-  base::AutoLock auto_lock(lock_);
   if (!IsValidHeapIdUnlockedImpl2(hq, allow_dying))
     return false;
   return true;
@@ -540,15 +814,56 @@ bool BlockHeapManager::IsValidHeapIdUnlockedImpl1(
 
 bool BlockHeapManager::IsValidHeapIdUnlockedImpl2(HeapQuarantinePair* hq,
                                                   bool allow_dying) {
-  // Look in the list of live heaps first.
-  auto it = heaps_.find(hq->first);
-  if (it != heaps_.end()) {
-    HeapId heap_id = GetHeapId(it);
-    if (heap_id == reinterpret_cast<HeapId>(hq))
-      return !it->second.is_dying || allow_dying;
+  // The heap table is consistent even while heaps_ is being modified, so this
+  // is safe to call without lock_.
+  return HeapTableContains(reinterpret_cast<HeapId>(hq), allow_dying);
+}
+
+void BlockHeapManager::PublishHeapTableUnlocked() {
+  lock_.AssertAcquired();
+  std::unique_ptr<HeapTable> table(new HeapTable());
+  table->reserve(heaps_.size());
+  for (auto it = heaps_.begin(); it != heaps_.end(); ++it) {
+    HeapTableEntry entry = { GetHeapId(it), it->second.is_dying };
+    table->push_back(entry);
   }
+  std::sort(table->begin(), table->end(),
+            [](const HeapTableEntry& entry1, const HeapTableEntry& entry2) {
+              return entry1.heap_id < entry2.heap_id;
+            });
+
+  // The exchange is a full barrier. A reader that isn't counted by the time
+  // it's done will load the new table, so the old ones can be freed if there
+  // are no readers.
+  HeapTable* old_table = reinterpret_cast<HeapTable*>(
+      ::InterlockedExchangePointer(
+          reinterpret_cast<PVOID volatile*>(&heap_table_), table.release()));
+  if (old_table != nullptr)
+    retired_heap_tables_.push_back(old_table);
+  if (heap_table_readers_ == 0) {
+    for (HeapTable* retired_table : retired_heap_tables_)
+      delete retired_table;
+    retired_heap_tables_.clear();
+  }
+}
 
-  return false;
+bool BlockHeapManager::HeapTableContains(HeapId heap_id, bool allow_dying) {
+  // The increment is a full barrier, so the table loaded after it can't be
+  // freed until the reader is uncounted.
+  ::InterlockedIncrement(&heap_table_readers_);
+  const HeapTable* table = heap_table_;
+  bool found = false;
+  if (table != nullptr) {
+    auto it = std::lower_bound(
+        table->begin(), table->end(), heap_id,
+        [](const HeapTableEntry& entry, HeapId heap_id) {
+          return entry.heap_id < heap_id;
+        });
+    if (it != table->end() && it->heap_id == heap_id)
+      found = !it->is_dying || allow_dying;
+  }
+  ::InterlockedDecrement(&heap_table_readers_);
+  return found;
 }
 
 BlockHeapInterface* BlockHeapManager::GetHeapFromId(HeapId heap_id) {
@@ -583,7 +898,10 @@ void BlockHeapManager::PropagateParameters() {
     // Initialize the zebra heap only if it isn't already initialized.
     // The zebra heap cannot be resized once created.
     base::AutoLock lock(lock_);
+    size_t stripe_count = parameters_.zebra_block_heap_multi_stripe ?
+        ZebraBlockHeap::kMaxStripeCount : 1;
     zebra_block_heap_ = new ZebraBlockHeap(parameters_.zebra_block_heap_size,
+                                           stripe_count,
                                            memory_notifier_,
                                            internal_heap_.get());
     // The zebra block heap is its own quarantine.
@@ -591,6 +909,7 @@ void BlockHeapManager::PropagateParameters() {
     auto result = heaps_.insert(std::make_pair(zebra_block_heap_,
                                                heap_metadata));
     zebra_block_heap_id_ = GetHeapId(result);
+    PublishHeapTableUnlocked();
   }
 
   if (zebra_block_heap_ != nullptr) {
@@ -603,11 +922,43 @@ void BlockHeapManager::PropagateParameters() {
   // Create the LargeBlockHeap if need be.
   if (parameters_.enable_large_block_heap && large_block_heap_id_ == 0) {
     base::AutoLock lock(lock_);
-    BlockHeapInterface* heap = new LargeBlockHeap(
+    LargeBlockHeap* heap = new LargeBlockHeap(
         memory_notifier_, internal_heap_.get());
+    heap->set_pooling_enabled(parameters_.large_block_heap_pooling);
     HeapMetadata metadata = { &shared_quarantine_, false };
     auto result = heaps_.insert(std::make_pair(heap, metadata));
     large_block_heap_id_ = GetHeapId(result);
+    PublishHeapTableUnlocked();
+  }
+
+  // Create the partitions of the process heap if need be.
+  if (parameters_.heap_partition_count != 0 && GetHeapPartitionCount() == 0) {
+    base::AutoLock lock(lock_);
+    size_t partition_count = std::min<size_t>(
+        parameters_.heap_partition_count, kMaxHeapPartitions);
+    for (size_t i = 0; i < partition_count; ++i) {
+      HeapInterface* underlying_heap = new heaps::WinHeap();
+      BlockHeapInterface* heap = new heaps::SimpleBlockHeap(underlying_heap);
+      underlying_heaps_map_.insert(std::make_pair(heap, underlying_heap));
+      HeapMetadata metadata = { &shared_quarantine_, false };
+      auto result = heaps_.insert(std::make_pair(heap, metadata));
+      heap_partitions_[i] = GetHeapId(result);
+    }
+    // The release store makes the partitions visible to the readers of the
+    // count.
+    base::subtle::Release_Store(
+        &heap_partition_count_,
+        static_cast<base::subtle::Atomic32>(partition_count));
+    PublishHeapTableUnlocked();
+  }
+
+  // Create the heap profiler if need be. Its sampling interval can't be
+  // changed once it's running.
+  if (parameters_.heap_profile_sampling_interval != 0 &&
+      heap_profiler_.get() == nullptr) {
+    base::AutoLock lock(lock_);
+    heap_profiler_.reset(new HeapProfiler(
+        stack_cache_, parameters_.heap_profile_sampling_interval));
   }
 
   // TODO(chrisha|sebmarchand): Clean up existing blocks that exceed the
@@ -624,22 +975,50 @@ void BlockHeapManager::set_allocation_filter_flag(bool value) {
   ::TlsSetValue(allocation_filter_flag_tls_, reinterpret_cast<void*>(value));
 }
 
+void BlockHeapManager::set_allocation_filter_stack_ids(
+    const std::set<StackIdFilter::StackId>& stack_ids) {
+  if (stack_ids.empty()) {
+    allocation_filter_stack_ids_.reset();
+    return;
+  }
+  allocation_filter_stack_ids_.reset(new StackIdFilter(stack_ids));
+}
+
 void BlockHeapManager::EnableDeferredFreeThread() {
   // The thread will be shutdown before this BlockHeapManager object is
   // destroyed, so passing |this| unretained is safe.
-  EnableDeferredFreeThreadWithCallback(base::Bind(
-      &BlockHeapManager::DeferredFreeDoWork, base::Unretained(this)));
+  // Use up to half of the processors, the other half being left to the
+  // threads that are freeing.
+  size_t worker_count = std::max<size_t>(1, GetProcessorCount() / 2);
+  worker_count = std::min<size_t>(worker_count, kMaxDeferredFreeWorkerCount);
+  EnableDeferredFreeThreadWithCallback(
+      base::Bind(&BlockHeapManager::DeferredFreeDoWork, base::Unretained(this)),
+      worker_count);
 }
 
 void BlockHeapManager::DisableDeferredFreeThread() {
   DCHECK(IsDeferredFreeThreadRunning());
-  // Stop the thread and wait for it to exit.
-  base::AutoLock lock(deferred_free_thread_lock_);
-  if (deferred_free_thread_)
-    deferred_free_thread_->Stop();
-  deferred_free_thread_.reset();
-  // Set the overbudget size to 0 to remove the hysteresis.
-  shared_quarantine_.SetOverbudgetSize(0);
+  {
+    // Stop the thread and wait for it to exit.
+    base::AutoLock lock(deferred_free_thread_lock_);
+    if (deferred_free_thread_) {
+      VLOG(1) << "Deferred free thread stopping with "
+              << deferred_free_thread_->max_pending_work_count()
+              << " maximum pending work, "
+              << base::subtle::NoBarrier_Load(&deferred_free_async_trim_count_)
+              << " asynchronous trims and "
+              << base::subtle::NoBarrier_Load(&deferred_free_sync_trim_count_)
+              << " synchronous trims.";
+      deferred_free_thread_->Stop();
+    }
+    deferred_free_thread_.reset();
+    // Set the overbudget size to 0 to remove the hysteresis.
+    shared_quarantine_.SetOverbudgetSize(0);
+  }
+
+  // No flood fill is deferred from now on, and those that the workers didn't
+  // get to are applied here. This trims synchronously if need be.
+  ApplyPendingFloodFills();
 }
 
 bool BlockHeapManager::IsDeferredFreeThreadRunning() {
@@ -647,6 +1026,25 @@ bool BlockHeapManager::IsDeferredFreeThreadRunning() {
   return deferred_free_thread_ != nullptr;
 }
 
+void BlockHeapManager::GetDeferredFreeStatistics(
+    DeferredFreeStatistics* statistics) {
+  DCHECK_NE(static_cast<DeferredFreeStatistics*>(nullptr), statistics);
+  ::memset(statistics, 0, sizeof(*statistics));
+  statistics->async_trim_count =
+      base::subtle::NoBarrier_Load(&deferred_free_async_trim_count_);
+  statistics->sync_trim_count =
+      base::subtle::NoBarrier_Load(&deferred_free_sync_trim_count_);
+
+  base::AutoLock lock(deferred_free_thread_lock_);
+  if (deferred_free_thread_) {
+    statistics->worker_count = deferred_free_thread_->worker_count();
+    statistics->pending_work_count =
+        deferred_free_thread_->pending_work_count();
+    statistics->max_pending_work_count =
+        deferred_free_thread_->max_pending_work_count();
+  }
+}
+
 HeapType BlockHeapManager::GetHeapTypeUnlocked(HeapId heap_id) {
   DCHECK(initialized_);
   DCHECK(IsValidHeapIdUnlocked(heap_id, true));
@@ -690,23 +1088,24 @@ bool BlockHeapManager::DestroyHeapContents(
     }
   }
 
-  // Restore the blocks that don't belong to this quarantine.
-  for (const auto& iter_block : blocks_to_reinsert) {
-    BlockInfo expanded = {};
-    ConvertBlockInfo(iter_block, &expanded);
-
-    BlockQuarantineInterface::AutoQuarantineLock quarantine_lock(quarantine,
-                                                                 iter_block);
-    if (quarantine->Push(iter_block).push_successful) {
-      if (enable_page_protections_) {
-        // Restore protection to quarantined block.
-        BlockProtectAll(expanded, shadow_);
-      }
-    } else {
-      // Avoid memory leak.
-      FreeBlock(iter_block);
+  // Restore the blocks that don't belong to this quarantine. They are protected
+  // before being pushed back, as they can be popped as soon as they're in.
+  if (enable_page_protections_) {
+    for (const auto& iter_block : blocks_to_reinsert) {
+      BlockInfo expanded = {};
+      ConvertBlockInfo(iter_block, &expanded);
+      BlockProtectAll(expanded, shadow_);
     }
   }
+  BlockQuarantineInterface::ObjectVector blocks_rejected;
+  quarantine->PushBatch(blocks_to_reinsert, &blocks_rejected);
+  // Avoid memory leak.
+  for (const auto& iter_block : blocks_rejected)
+    FreeBlock(iter_block);
+
+  // Finally, hand back the blocks of this heap that were cached by any
+  // thread. This includes the blocks freed above.
+  FlushThreadBlockCaches(heap);
 
   return true;
 }
@@ -732,6 +1131,8 @@ void BlockHeapManager::TrimQuarantine(TrimColor stop_color,
   DCHECK(initialized_);
   DCHECK_NE(static_cast<BlockQuarantineInterface*>(nullptr), quarantine);
 
+  AddRuntimeCounter(kQuarantineTrimCountCounter, 1);
+
   // Trim the quarantine to the required color.
   if (parameters_.quarantine_size == 0) {
     BlockQuarantineInterface::ObjectVector blocks_to_free;
@@ -739,12 +1140,16 @@ void BlockHeapManager::TrimQuarantine(TrimColor stop_color,
     for (const auto& block : blocks_to_free)
       FreeBlock(block);
   } else {
-    CompactBlockInfo compact = {};
+    BlockQuarantineInterface::ObjectVector blocks_to_free;
+    blocks_to_free.reserve(kTrimBatchSize);
     while (true) {
-      PopResult result = quarantine->Pop(&compact);
+      blocks_to_free.clear();
+      PopResult result =
+          quarantine->PopBatch(stop_color, kTrimBatchSize, &blocks_to_free);
       if (!result.pop_successful)
         break;
-      FreeBlock(compact);
+      for (const auto& block : blocks_to_free)
+        FreeBlock(block);
       if (result.trim_color <= stop_color)
         break;
     }
@@ -752,6 +1157,11 @@ void BlockHeapManager::TrimQuarantine(TrimColor stop_color,
 }
 
 void BlockHeapManager::FreeBlock(const BlockQuarantineInterface::Object& obj) {
+  // This is only used for the blocks coming out of a quarantine.
+  AddRuntimeCounter(kQuarantineCountCounter, -1);
+  AddRuntimeCounter(kQuarantineSizeCounter,
+                    -static_cast<int64_t>(obj.block_size));
+
   BlockInfo expanded = {};
   ConvertBlockInfo(obj, &expanded);
   CHECK(FreePotentiallyCorruptBlock(&expanded));
@@ -826,6 +1236,13 @@ bool BlockHeapManager::FreePristineBlock(BlockInfo* block_info) {
   } else {
     shadow_->Unpoison(block_info->header, block_info->block_size);
   }
+
+  // Small blocks may be kept around to serve future allocations, rather than
+  // being returned to the heap. They have already been through the
+  // quarantine so this doesn't weaken use-after-free detection.
+  if (PushToThreadBlockCache(*block_info))
+    return true;
+
   return heap->FreeBlock(*block_info);
 }
 
@@ -895,8 +1312,15 @@ void BlockHeapManager::InitInternalHeap() {
             internal_win_heap_.get());
 
   internal_win_heap_.reset(new heaps::WinHeap);
-  internal_heap_.reset(
-      new heaps::InternalHeap(memory_notifier_, internal_win_heap_.get()));
+  heaps::InternalHeap* internal_heap =
+      new heaps::InternalHeap(memory_notifier_, internal_win_heap_.get());
+
+  // The small internal allocations, such as the bookkeeping of the
+  // specialized heaps, are served from per-thread spans. Without a TLS slot
+  // they simply go to the wrapped heap.
+  if (!internal_heap->EnableThreadCaches())
+    LOG(WARNING) << "Unable to enable the internal heap thread caches.";
+  internal_heap_.reset(internal_heap);
 }
 
 void BlockHeapManager::InitProcessHeap() {
@@ -908,9 +1332,65 @@ void BlockHeapManager::InitProcessHeap() {
   HeapMetadata heap_metadata = { &shared_quarantine_, false };
   auto result = heaps_.insert(std::make_pair(process_heap_, heap_metadata));
   process_heap_id_ = GetHeapId(result);
+  PublishHeapTableUnlocked();
+}
+
+bool BlockHeapManager::ShouldGuardSiteAllocation(StackId stack_id) {
+  DCHECK_NE(0u, parameters_.allocation_guard_site_threshold);
+
+  // The first allocations of a site are always guarded. The later ones are
+  // guarded at a rate of threshold / count, so that the number of guarded
+  // allocations of a site only grows logarithmically with its count. The
+  // rate doesn't go below the global allocation guard rate.
+  uint32_t threshold = parameters_.allocation_guard_site_threshold;
+  uint32_t count = stack_cache_->CountSiteAllocation(stack_id);
+  if (count <= threshold)
+    return true;
+  double rate = std::max(
+      static_cast<double>(threshold) / count,
+      static_cast<double>(parameters_.allocation_guard_rate));
+
+  // The draw is a hash rather than a random number, so the guarded
+  // allocations of a site only depend on the seed and on the count.
+  uint32_t hash = HashSiteAllocation(parameters_.allocation_guard_seed,
+                                     stack_id, count);
+  return static_cast<double>(hash) < rate * 4294967296.0;
 }
 
-bool BlockHeapManager::MayUseLargeBlockHeap(size_t bytes) const {
+void* BlockHeapManager::AllocateUnguarded(HeapId heap_id, uint32_t bytes) {
+  BlockHeapInterface* heap = GetHeapFromId(heap_id);
+  void* alloc = heap->Allocate(bytes);
+  if ((heap->GetHeapFeatures() &
+      HeapInterface::kHeapReportsReservations) != 0) {
+    shadow_->Unpoison(alloc, bytes);
+  }
+  if (alloc != nullptr) {
+    AddRuntimeCounter(kAllocationCountCounter, 1);
+    AddRuntimeCounter(kAllocatedBytesCounter, bytes);
+  }
+  return alloc;
+}
+
+HeapId BlockHeapManager::SelectHeapPartition(StackId stack_id,
+                                             size_t partition_count) const {
+  DCHECK_NE(0u, partition_count);
+  return heap_partitions_[stack_id % partition_count];
+}
+
+bool BlockHeapManager::IsAllocationFiltered(
+    const common::StackCapture* alloc_stack) const {
+  if (!parameters_.enable_allocation_filter)
+    return false;
+  if (allocation_filter_flag())
+    return true;
+  return alloc_stack != nullptr &&
+         allocation_filter_stack_ids_.get() != nullptr &&
+         allocation_filter_stack_ids_->MayContain(
+             alloc_stack->relative_stack_id());
+}
+
+bool BlockHeapManager::MayUseLargeBlockHeap(size_t bytes,
+                                            bool allocation_filtered) const {
   DCHECK(initialized_);
   if (!parameters_.enable_large_block_heap)
     return false;
@@ -918,29 +1398,40 @@ bool BlockHeapManager::MayUseLargeBlockHeap(size_t bytes) const {
     return true;
 
   // If we get here we're treating a small allocation. If the allocation
-  // filter is in effect and the flag set then allow it.
-  if (parameters_.enable_allocation_filter && allocation_filter_flag())
+  // filter is in effect and lets it through then allow it.
+  if (allocation_filtered)
     return true;
 
   return false;
 }
 
-bool BlockHeapManager::MayUseZebraBlockHeap(size_t bytes) const {
+bool BlockHeapManager::MayUseZebraBlockHeap(size_t bytes,
+                                            bool allocation_filtered) const {
   DCHECK(initialized_);
   if (!parameters_.enable_zebra_block_heap)
     return false;
-  if (bytes > ZebraBlockHeap::kMaximumBlockAllocationSize)
+  if (zebra_block_heap_ == nullptr ||
+      bytes > zebra_block_heap_->maximum_block_allocation_size()) {
     return false;
+  }
 
   // If the allocation filter is in effect only allow filtered allocations
   // into the zebra heap.
   if (parameters_.enable_allocation_filter)
-    return allocation_filter_flag();
+    return allocation_filtered;
 
   // Otherwise, allow everything through.
   return true;
 }
 
+void BlockHeapManager::InitCorruptBlockRegistryCache() {
+  base::AutoLock lock(corrupt_block_registry_cache_lock_);
+  if (corrupt_block_registry_cache_loaded_)
+    return;
+  corrupt_block_registry_cache_.Init();
+  corrupt_block_registry_cache_loaded_ = true;
+}
+
 bool BlockHeapManager::ShouldReportCorruptBlock(const BlockInfo* block_info) {
   DCHECK_NE(static_cast<const BlockInfo*>(nullptr), block_info);
 
@@ -950,6 +1441,9 @@ bool BlockHeapManager::ShouldReportCorruptBlock(const BlockInfo* block_info) {
   const common::StackCapture* alloc_stack = block_info->header->alloc_stack;
   StackId relative_alloc_stack_id = alloc_stack->relative_stack_id();
 
+  InitCorruptBlockRegistryCache();
+  base::AutoLock lock(corrupt_block_registry_cache_lock_);
+
   // Look at the registry cache to see if an error has already been reported
   // for this allocation stack trace, if so prevent from reporting another one.
   if (corrupt_block_registry_cache_.DoesIdExist(relative_alloc_stack_id))
@@ -975,34 +1469,126 @@ void BlockHeapManager::TrimOrScheduleIfNecessary(
   }
 
   // Signal the deferred thread to wake up and/or trim synchronously, as needed.
-  if (trim_status & TrimStatusBits::ASYNC_TRIM_REQUIRED)
-    DeferredFreeThreadSignalWork();
-  if (trim_status & TrimStatusBits::SYNC_TRIM_REQUIRED)
+  // Going into RED wakes up a single worker. Reaching BLACK means that the
+  // workers aren't keeping up, so all of them are put to work on top of the
+  // synchronous trimming. They each start from a random shard of the
+  // quarantine, which splits the work between them.
+  if (trim_status & TrimStatusBits::ASYNC_TRIM_REQUIRED) {
+    base::subtle::NoBarrier_AtomicIncrement(&deferred_free_async_trim_count_,
+                                            1);
+    DeferredFreeThreadSignalWork(1);
+  }
+  if (trim_status & TrimStatusBits::SYNC_TRIM_REQUIRED) {
+    base::subtle::NoBarrier_AtomicIncrement(&deferred_free_sync_trim_count_,
+                                            1);
+    DeferredFreeThreadSignalWork(kMaxDeferredFreeWorkerCount);
     TrimQuarantine(TrimColor::YELLOW, quarantine);
+  }
 }
 
-void BlockHeapManager::DeferredFreeThreadSignalWork() {
+void BlockHeapManager::DeferredFreeThreadSignalWork(size_t worker_count) {
   DCHECK(IsDeferredFreeThreadRunning());
   base::AutoLock lock(deferred_free_thread_lock_);
-  deferred_free_thread_->SignalWork();
+  deferred_free_thread_->SignalWork(worker_count);
 }
 
 void BlockHeapManager::DeferredFreeDoWork() {
-  DCHECK_EQ(GetDeferredFreeThreadId(), base::PlatformThread::CurrentId());
+  DCHECK(IsDeferredFreeWorkerThread(base::PlatformThread::CurrentId()));
+  // Apply the deferred flood fills first, as they add to the quarantine.
+  ApplyPendingFloodFills();
+
   // As of now, only the shared quarantine gets trimmed asynchronously. This
   // will bring it back in the GREEN color.
   BlockQuarantineInterface* shared_quarantine = &shared_quarantine_;
   TrimQuarantine(TrimColor::GREEN, shared_quarantine);
 }
 
-base::PlatformThreadId BlockHeapManager::GetDeferredFreeThreadId() {
+bool BlockHeapManager::IsDeferredFreeWorkerThread(
+    base::PlatformThreadId thread_id) {
   DCHECK(IsDeferredFreeThreadRunning());
   base::AutoLock lock(deferred_free_thread_lock_);
-  return deferred_free_thread_->deferred_free_thread_id();
+  return deferred_free_thread_->IsWorkerThread(thread_id);
+}
+
+// Checks the blocks visited in the shared quarantine, and reports the corrupt
+// ones. This runs under the lock of the quarantine shard holding the block, so
+// the block can't leave the quarantine while it's being checked.
+class BlockHeapManager::QuarantinedBlockChecker
+    : public BlockQuarantineInterface::ObjectVisitor {
+ public:
+  explicit QuarantinedBlockChecker(BlockHeapManager* heap_manager)
+      : heap_manager_(heap_manager) {
+    DCHECK_NE(static_cast<BlockHeapManager*>(nullptr), heap_manager);
+  }
+
+  void Visit(const CompactBlockInfo& compact) override {
+    BlockInfo block_info = {};
+    ConvertBlockInfo(compact, &block_info);
+
+    // Blocks under page protection can't be read, and can't have been
+    // corrupted either.
+    if (block_info.block_pages_size > 0 &&
+        heap_manager_->shadow_->PageIsProtected(block_info.block_pages)) {
+      return;
+    }
+
+    if (!IsBlockCorrupt(block_info))
+      return;
+    if (heap_manager_->ShouldReportCorruptBlock(&block_info))
+      heap_manager_->ReportHeapError(block_info.header, CORRUPT_BLOCK);
+  }
+
+ private:
+  BlockHeapManager* heap_manager_;
+
+  DISALLOW_COPY_AND_ASSIGN(QuarantinedBlockChecker);
+};
+
+void BlockHeapManager::EnableQuarantineCheckerThread(
+    size_t blocks_per_second) {
+  DCHECK(!IsQuarantineCheckerThreadRunning());
+  blocks_per_second = std::min<size_t>(
+      std::max<size_t>(1, blocks_per_second), kMaxQuarantineCheckRate);
+
+  // The thread will be shutdown before this BlockHeapManager object is
+  // destroyed, so passing |this| unretained is safe.
+  base::AutoLock lock(quarantine_checker_thread_lock_);
+  quarantine_checker_thread_.reset(new QuarantineCheckerThread(
+      base::Bind(&BlockHeapManager::CheckQuarantinedBlocks,
+                 base::Unretained(this)),
+      blocks_per_second));
+  if (!quarantine_checker_thread_->Start())
+    quarantine_checker_thread_.reset();
+}
+
+void BlockHeapManager::DisableQuarantineCheckerThread() {
+  DCHECK(IsQuarantineCheckerThreadRunning());
+  // Stop the thread and wait for it to exit.
+  base::AutoLock lock(quarantine_checker_thread_lock_);
+  if (quarantine_checker_thread_) {
+    VLOG(1) << "Quarantine checker thread stopping after checking "
+            << quarantine_checker_thread_->checked_block_count()
+            << " blocks.";
+    quarantine_checker_thread_->Stop();
+  }
+  quarantine_checker_thread_.reset();
+}
+
+bool BlockHeapManager::IsQuarantineCheckerThreadRunning() {
+  base::AutoLock lock(quarantine_checker_thread_lock_);
+  return quarantine_checker_thread_ != nullptr;
+}
+
+size_t BlockHeapManager::CheckQuarantinedBlocks(size_t max_count) {
+  DCHECK(initialized_);
+  QuarantinedBlockChecker checker(this);
+  return shared_quarantine_.VisitObjects(
+      max_count, &quarantine_check_cursor_, &checker);
 }
 
 void BlockHeapManager::EnableDeferredFreeThreadWithCallback(
-    DeferredFreeThread::Callback deferred_free_callback) {
+    DeferredFreeThread::Callback deferred_free_callback,
+    size_t worker_count) {
   DCHECK(!IsDeferredFreeThreadRunning());
 
   shared_quarantine_.SetOverbudgetSize(
@@ -1011,10 +1597,162 @@ void BlockHeapManager::EnableDeferredFreeThreadWithCallback(
 
   // Create the thread and wait for it to start.
   base::AutoLock lock(deferred_free_thread_lock_);
-  deferred_free_thread_.reset(new DeferredFreeThread(deferred_free_callback));
+  deferred_free_thread_.reset(
+      new DeferredFreeThread(deferred_free_callback, worker_count));
   deferred_free_thread_->Start();
 }
 
+ThreadBlockCache* BlockHeapManager::GetThreadBlockCache(bool create) {
+  ThreadBlockCache* cache = reinterpret_cast<ThreadBlockCache*>(
+      ::TlsGetValue(thread_block_cache_tls_));
+  if (cache != nullptr || !create)
+    return cache;
+
+  // The cache is allocated from the internal heap so that the shadow
+  // memory knows about it.
+  void* alloc = internal_heap_->Allocate(sizeof(ThreadBlockCache));
+  if (alloc == nullptr)
+    return nullptr;
+  cache = new (alloc) ThreadBlockCache();
+  {
+    base::AutoLock lock(thread_block_caches_lock_);
+    thread_block_caches_.push_back(cache);
+  }
+  ::TlsSetValue(thread_block_cache_tls_, cache);
+  return cache;
+}
+
+void* BlockHeapManager::AllocateFromThreadBlockCache(HeapId heap_id,
+                                                     uint32_t bytes,
+                                                     BlockLayout* layout) {
+  DCHECK_NE(static_cast<BlockLayout*>(nullptr), layout);
+  if (!parameters_.thread_block_cache)
+    return nullptr;
+
+  // Only the blocks of the simple block heaps are cached. Their layout is
+  // entirely determined by the size of the allocation.
+  BlockHeapInterface* heap = GetHeapFromId(heap_id);
+  if (heap->GetHeapType() != kWinHeap)
+    return nullptr;
+  if (!BlockPlanLayout(kShadowRatio, kShadowRatio, bytes, 0,
+                       parameters_.trailer_padding_size + sizeof(BlockTrailer),
+                       layout)) {
+    return nullptr;
+  }
+  if (!ThreadBlockCache::IsCacheableSize(layout->block_size))
+    return nullptr;
+
+  // Create the cache on the first allocation, so that it gets populated by
+  // the blocks that this thread later frees.
+  ThreadBlockCache* cache = GetThreadBlockCache(true);
+  if (cache == nullptr)
+    return nullptr;
+  CompactBlockInfo block = {};
+  if (!cache->Pop(heap, layout->block_size, &block))
+    return nullptr;
+  return block.header;
+}
+
+bool BlockHeapManager::PushToThreadBlockCache(const BlockInfo& block_info) {
+  if (!parameters_.thread_block_cache)
+    return false;
+  if (!ThreadBlockCache::IsCacheableSize(block_info.block_size) ||
+      block_info.header->is_nested) {
+    return false;
+  }
+
+  BlockHeapInterface* heap = GetHeapFromId(block_info.trailer->heap_id);
+  if (heap->GetHeapType() != kWinHeap)
+    return false;
+  ThreadBlockCache* cache = GetThreadBlockCache(false);
+  if (cache == nullptr)
+    return false;
+
+  CompactBlockInfo compact = {};
+  ConvertBlockInfo(block_info, &compact);
+  return cache->Push(heap, compact);
+}
+
+void BlockHeapManager::OnThreadDetach() {
+  if (thread_block_cache_tls_ == TLS_OUT_OF_INDEXES)
+    return;
+  ThreadBlockCache* cache = GetThreadBlockCache(false);
+  if (cache == nullptr)
+    return;
+  ::TlsSetValue(thread_block_cache_tls_, nullptr);
+
+  // The lock is held while the blocks are freed so that none of their heaps
+  // can be destroyed in the meantime: FlushThreadBlockCaches would no longer
+  // see this cache.
+  base::AutoLock lock(thread_block_caches_lock_);
+  auto it = std::find(thread_block_caches_.begin(),
+                      thread_block_caches_.end(), cache);
+  DCHECK(it != thread_block_caches_.end());
+  thread_block_caches_.erase(it);
+
+  ThreadBlockCache::EntryVector entries;
+  cache->EmptyAll(&entries);
+  for (const auto& entry : entries) {
+    BlockInfo expanded = {};
+    ConvertBlockInfo(entry.block, &expanded);
+    CHECK(entry.heap->FreeBlock(expanded));
+  }
+
+  cache->~ThreadBlockCache();
+  internal_heap_->Free(cache);
+}
+
+void BlockHeapManager::FlushThreadBlockCaches(BlockHeapInterface* heap) {
+  DCHECK_NE(static_cast<BlockHeapInterface*>(nullptr), heap);
+  ThreadBlockCache::ObjectVector blocks;
+  {
+    base::AutoLock lock(thread_block_caches_lock_);
+    for (ThreadBlockCache* cache : thread_block_caches_)
+      cache->EmptyHeap(heap, &blocks);
+  }
+
+  for (const auto& block : blocks) {
+    BlockInfo expanded = {};
+    ConvertBlockInfo(block, &expanded);
+    CHECK(heap->FreeBlock(expanded));
+  }
+}
+
+const common::StackCapture* BlockHeapManager::ReuseThreadAllocStack() {
+  // The heap profiler needs the full stack of the allocations it samples.
+  if (parameters_.alloc_stack_capture_period <= 1 ||
+      heap_profiler_.get() != nullptr) {
+    return nullptr;
+  }
+
+  uintptr_t allocs_until_capture = reinterpret_cast<uintptr_t>(
+      ::TlsGetValue(allocs_until_stack_capture_tls_));
+  if (allocs_until_capture == 0)
+    return nullptr;
+  ::TlsSetValue(allocs_until_stack_capture_tls_,
+                reinterpret_cast<void*>(allocs_until_capture - 1));
+
+  // The stack may have been evicted from the cache since it was captured, in
+  // which case it has to be captured again.
+  StackId alloc_stack_id = static_cast<StackId>(reinterpret_cast<uintptr_t>(
+      ::TlsGetValue(alloc_stack_id_tls_)));
+  return stack_cache_->SaveKnownStackTrace(alloc_stack_id);
+}
+
+void BlockHeapManager::SetThreadAllocStack(
+    const common::StackCapture* alloc_stack) {
+  DCHECK_NE(static_cast<const common::StackCapture*>(nullptr), alloc_stack);
+  if (parameters_.alloc_stack_capture_period <= 1 ||
+      heap_profiler_.get() != nullptr || !alloc_stack->IsValid()) {
+    return;
+  }
+
+  ::TlsSetValue(alloc_stack_id_tls_, reinterpret_cast<void*>(
+      static_cast<uintptr_t>(alloc_stack->absolute_stack_id())));
+  ::TlsSetValue(allocs_until_stack_capture_tls_, reinterpret_cast<void*>(
+      static_cast<uintptr_t>(parameters_.alloc_stack_capture_period - 1)));
+}
+
 }  // namespace heap_managers
 }  // namespace asan
 }  // namespace agent
@@ -20,18 +20,25 @@
 #include <windows.h>
 
 #include <memory>
+#include <set>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
+#include "base/atomicops.h"
 #include "base/logging.h"
 #include "syzygy/agent/asan/block_utils.h"
 #include "syzygy/agent/asan/error_info.h"
 #include "syzygy/agent/asan/heap.h"
 #include "syzygy/agent/asan/heap_manager.h"
+#include "syzygy/agent/asan/heap_profiler.h"
 #include "syzygy/agent/asan/quarantine.h"
 #include "syzygy/agent/asan/registry_cache.h"
 #include "syzygy/agent/asan/stack_capture_cache.h"
+#include "syzygy/agent/asan/stack_id_filter.h"
 #include "syzygy/agent/asan/heap_managers/deferred_free_thread.h"
+#include "syzygy/agent/asan/heap_managers/quarantine_checker_thread.h"
+#include "syzygy/agent/asan/heap_managers/thread_block_cache.h"
 #include "syzygy/agent/asan/memory_notifiers/shadow_memory_notifier.h"
 #include "syzygy/agent/asan/quarantines/sharded_quarantine.h"
 #include "syzygy/agent/common/stack_capture.h"
@@ -65,8 +72,17 @@ namespace heap_managers {
 // The zebra heap is created once, when enabled for the first time, with a
 // specified size. It can't be resized after creation. Disabling the zebra
 // heap only disables allocations on it, deallocations will continue to work.
+//
+// The allocations made on the process heap can also be spread over a set of
+// heap partitions, chosen by hashing their allocation stack. Each partition is
+// a separate WinHeap with its own lock, so unrelated allocation sites don't
+// contend with each other, and the objects of a site are kept together. Like
+// the zebra heap, the partitions are created once and can't be resized.
 class BlockHeapManager : public HeapManagerInterface {
  public:
+  // The maximum number of heap partitions.
+  static const size_t kMaxHeapPartitions = 32;
+
   // Constructor.
   // @param shadow The shadow memory to use.
   // @param stack_cache The stack cache to use.
@@ -89,6 +105,7 @@ class BlockHeapManager : public HeapManagerInterface {
    void* Allocate(HeapId heap_id, uint32_t bytes) override;
    bool Free(HeapId heap_id, void* alloc) override;
    uint32_t Size(HeapId heap_id, const void* alloc) override;
+  bool ResizeInPlace(HeapId heap_id, void* alloc, uint32_t bytes) override;
    void Lock(HeapId heap_id) override;
    void Unlock(HeapId heap_id) override;
    void BestEffortLockAll() override;
@@ -115,6 +132,15 @@ class BlockHeapManager : public HeapManagerInterface {
   // Returns the process heap ID.
   HeapId process_heap() { return process_heap_id_; }
 
+  // @returns the heap profiler, or nullptr if heap profiling is disabled.
+  HeapProfiler* heap_profiler() { return heap_profiler_.get(); }
+
+  // Loads the registry cache of the corrupt blocks that have already been
+  // reported. This reads and prunes the registry, so it's only done when
+  // duplicate corruption crashes are prevented. It's done by the first corrupt
+  // block if it hasn't already been done ahead of time. Thread safe.
+  void InitCorruptBlockRegistryCache();
+
   // Returns the allocation-filter flag value.
   // @returns the allocation-filter flag value.
   // @note The flag is stored per-thread using TLS. Multiple threads do not
@@ -127,6 +153,16 @@ class BlockHeapManager : public HeapManagerInterface {
   //     share the same flag.
   void set_allocation_filter_flag(bool value);
 
+  // Sets the allocation stacks that get through the allocation filter, in
+  // addition to the allocations made while the allocation filter flag is set.
+  // They are kept in a Bloom filter, so a few other stacks get through too.
+  // @param stack_ids The relative IDs of the allocation stacks. An empty set
+  //     disables filtering the allocations by stack.
+  // @note This isn't thread-safe, it's meant to be called while setting up
+  //     the heap manager.
+  void set_allocation_filter_stack_ids(
+      const std::set<StackIdFilter::StackId>& stack_ids);
+
   // Enables the deferred free thread mechanism. Must not be called if the
   // thread is already running. Typical usage is to enable the thread at startup
   // and disable it at shutdown.
@@ -140,6 +176,45 @@ class BlockHeapManager : public HeapManagerInterface {
   // @returns true if the deferred thread is currently running.
   bool IsDeferredFreeThreadRunning();
 
+  // Statistics about the deferred free mechanism. These help tuning the size
+  // of the quarantine against the latency of the frees.
+  struct DeferredFreeStatistics {
+    // The number of workers of the deferred free thread, 0 if it's not
+    // running.
+    size_t worker_count;
+    // The number of workers that have been signaled but haven't started
+    // trimming yet, and the maximum it reached.
+    size_t pending_work_count;
+    size_t max_pending_work_count;
+    // The number of times the deferred free thread got signaled.
+    size_t async_trim_count;
+    // The number of times the quarantine still had to be trimmed
+    // synchronously while the deferred free thread was running.
+    size_t sync_trim_count;
+  };
+
+  // Gets the current statistics of the deferred free mechanism. The trim
+  // counts accumulate over the lifetime of the heap manager.
+  // @param statistics Will receive the statistics.
+  void GetDeferredFreeStatistics(DeferredFreeStatistics* statistics);
+
+  // Enables the thread that checks the quarantined blocks for corruption in
+  // the background. Must not be called if the thread is already running.
+  // @param blocks_per_second The maximum number of blocks to check per second.
+  void EnableQuarantineCheckerThread(size_t blocks_per_second);
+
+  // Disables the quarantine checker thread. Must be called before the
+  // destructor if the thread is enabled. Must also never be called if the
+  // thread is not enabled.
+  void DisableQuarantineCheckerThread();
+
+  // @returns true if the quarantine checker thread is currently running.
+  bool IsQuarantineCheckerThreadRunning();
+
+  // Returns the blocks cached by the calling thread to their heaps and frees
+  // its block cache. This is meant to be called when the thread exits.
+  void OnThreadDetach();
+
  protected:
   // This allows the runtime access to our internals, necessary for crash
   // processing.
@@ -173,6 +248,15 @@ class BlockHeapManager : public HeapManagerInterface {
       std::unordered_map<BlockHeapInterface*, HeapMetadata>;
   using HeapQuarantinePair = BlockHeapManager::HeapQuarantineMap::value_type;
 
+  // An immutable snapshot of the heaps, sorted by ID. A new table is
+  // published each time the heaps change, so that heap IDs can be validated
+  // with a binary search and without taking lock_.
+  struct HeapTableEntry {
+    HeapId heap_id;
+    bool is_dying;
+  };
+  using HeapTable = std::vector<HeapTableEntry>;
+
   using StackId = agent::common::StackCapture::StackId;
 
   // Causes the heap manager to tear itself down. If the heap manager
@@ -207,8 +291,8 @@ class BlockHeapManager : public HeapManagerInterface {
   bool IsValidHeapId(HeapId heap_id, bool allow_dying);
   bool IsValidHeapIdUnlocked(HeapId heap_id, bool allow_dying);
 
-  // Helpers for the above functions. This is split into two to keep the
-  // locking as narrow as possible.
+  // Helpers for the above functions. This is split into two so that only the
+  // first one can raise access violations.
   // @param hq The heap quarantine pair being queried.
   // @param allow_dying If true then also consider heaps that are in the
   //     process of dying. Otherwise, only consider live heaps.
@@ -217,6 +301,18 @@ class BlockHeapManager : public HeapManagerInterface {
   bool IsValidHeapIdUnlockedImpl2(HeapQuarantinePair* hq, bool allow_dying);
   // @}
 
+  // Publishes a new heap table reflecting the current content of heaps_. The
+  // table it replaces is retired, and freed once no reader uses it.
+  // @note Under lock_.
+  void PublishHeapTableUnlocked();
+
+  // Looks up a heap in the published heap table. This doesn't take lock_.
+  // @param heap_id The ID of the heap to look up.
+  // @param allow_dying If true then also consider heaps that are in the
+  //     process of dying.
+  // @returns true if the heap is in the table.
+  bool HeapTableContains(HeapId heap_id, bool allow_dying);
+
   // Given a heap ID, returns the underlying heap.
   // @param heap_id The ID of the heap to look up.
   // @returns a pointer to the heap implementation.
@@ -293,6 +389,21 @@ class BlockHeapManager : public HeapManagerInterface {
   //     otherwise.
   bool FreeUnguardedAlloc(HeapId heap_id, void* alloc);
 
+  // Checksums a block that has been marked as freed and pushes it into a
+  // quarantine, trimming it if need be. The block is freed if the quarantine
+  // doesn't accept it.
+  // @param block_info The information about this block.
+  // @param quarantine The quarantine of the heap owning the block.
+  // @returns true on success, false otherwise.
+  bool QuarantineBlock(BlockInfo* block_info,
+                       BlockQuarantineInterface* quarantine);
+
+  // Flood-fills and quarantines the blocks whose flood fill was deferred by
+  // Free. This is invoked by the deferred free workers, and whenever the
+  // pending blocks must reach their quarantine, such as before a heap is
+  // destroyed.
+  void ApplyPendingFloodFills();
+
   // Clears the metadata of a corrupt block. After calling this function the
   // block can safely be passed to FreeBlock.
   // @param block_info The information about this block.
@@ -316,19 +427,57 @@ class BlockHeapManager : public HeapManagerInterface {
   // Exposed for unittesting.
   void InitProcessHeap();
 
+  // Determines if an allocation gets through the allocation filter, either
+  // because the allocation filter flag is set or because of its stack.
+  // @param alloc_stack The allocation stack, if it has already been saved.
+  // @returns true if the allocation filter is in effect and the allocation
+  //     gets through it, false otherwise.
+  bool IsAllocationFiltered(const common::StackCapture* alloc_stack) const;
+
   // Determines if the large block heap should be used for an allocation of
   // the given size.
   // @param bytes The allocation size.
+  // @param allocation_filtered Indicates if the allocation gets through the
+  //     allocation filter. See IsAllocationFiltered.
   // @returns true if the large block heap should be used for this allocation,
   //     false otherwise.
-  bool MayUseLargeBlockHeap(size_t bytes) const;
+  bool MayUseLargeBlockHeap(size_t bytes, bool allocation_filtered) const;
+
+  // Determines if an allocation gets guarded, according to the allocation
+  // guard rate of its site. Each call counts an allocation of the site.
+  // @param stack_id The absolute ID of the allocation stack.
+  // @returns true if the allocation should be guarded, false otherwise.
+  // @note This is only used if allocation_guard_site_threshold is set.
+  bool ShouldGuardSiteAllocation(StackId stack_id);
+
+  // Allocates a block without any guard.
+  // @param heap_id The ID of the heap to allocate from.
+  // @param bytes The allocation size.
+  // @returns the allocation, or nullptr on failure.
+  void* AllocateUnguarded(HeapId heap_id, uint32_t bytes);
+
+  // @returns the number of partitions of the process heap, or 0 if it isn't
+  //     partitioned. The partitions are visible once this returns non-zero.
+  size_t GetHeapPartitionCount() const {
+    return static_cast<size_t>(
+        base::subtle::Acquire_Load(&heap_partition_count_));
+  }
+
+  // Selects the heap partition serving an allocation made on the process heap.
+  // @param stack_id The ID of the allocation stack.
+  // @param partition_count The number of partitions, as returned by
+  //     GetHeapPartitionCount. This must not be zero.
+  // @returns the ID of the partition.
+  HeapId SelectHeapPartition(StackId stack_id, size_t partition_count) const;
 
   // Determines if the zebra block heap should be used for an allocation of
   // the given size.
   // @param bytes The allocation size.
+  // @param allocation_filtered Indicates if the allocation gets through the
+  //     allocation filter. See IsAllocationFiltered.
   // @returns true if the zebra heap should be used for this allocation, false
   //     otherwise.
-  bool MayUseZebraBlockHeap(size_t bytes) const;
+  bool MayUseZebraBlockHeap(size_t bytes, bool allocation_filtered) const;
 
   // Indicates if a corrupt block error should be reported.
   // @param block_info The corrupt block.
@@ -345,22 +494,84 @@ class BlockHeapManager : public HeapManagerInterface {
 
   // Used by TrimOrScheduleIfNecessary to signal the deferred free thread that
   // the quarantine needs trimming (ie. asynchronous trimming).
-  void DeferredFreeThreadSignalWork();
+  // @param worker_count The number of workers to wake up.
+  void DeferredFreeThreadSignalWork(size_t worker_count);
 
-  // Invoked by the deferred free thread when it is signaled that the quarantine
-  // needs trimming.
+  // Invoked by the deferred free workers when they are signaled that the
+  // quarantine needs trimming. This can run on several workers at once.
   void DeferredFreeDoWork();
 
   // Implementation of EnableDeferredFreeThread that takes the callback. Used
   // also by tests to override the callback.
   // @param deferred_free_callback The callback.
+  // @param worker_count The number of workers to spawn.
   void EnableDeferredFreeThreadWithCallback(
-      DeferredFreeThread::Callback deferred_free_callback);
+      DeferredFreeThread::Callback deferred_free_callback,
+      size_t worker_count);
+
+  // Checks if a thread is one of the deferred free workers. Must not be called
+  // if the thread is not running.
+  // @param thread_id The ID of the thread.
+  // @returns true if the thread is a deferred free worker.
+  bool IsDeferredFreeWorkerThread(base::PlatformThreadId thread_id);
+
+  // Checks some of the blocks of the shared quarantine for corruption,
+  // resuming where the previous call left off, and reports the corrupt ones.
+  // Invoked by the quarantine checker thread. Blocks whose pages are protected
+  // are skipped, as they can't have been corrupted.
+  // @param max_count The maximum number of blocks to check.
+  // @returns the number of blocks checked.
+  size_t CheckQuarantinedBlocks(size_t max_count);
+
+  // The quarantine visitor used by CheckQuarantinedBlocks.
+  class QuarantinedBlockChecker;
+
+  // @name Thread block cache functions.
+  // @{
+  // Returns the block cache of the current thread.
+  // @param create If true then the cache will be created if the thread
+  //     doesn't have one yet.
+  // @returns the cache, or nullptr if the thread doesn't have one.
+  ThreadBlockCache* GetThreadBlockCache(bool create);
+
+  // Tries to serve an allocation from the block cache of the current thread.
+  // @param heap_id The heap from which the allocation is to be served.
+  // @param bytes The size of the allocation.
+  // @param layout Will receive the layout of the block.
+  // @returns a pointer to the block on success, nullptr otherwise.
+  void* AllocateFromThreadBlockCache(HeapId heap_id,
+                                     uint32_t bytes,
+                                     BlockLayout* layout);
+
+  // Tries to cache a block that is being freed in the block cache of the
+  // current thread. Only threads that allocate have a cache, so this does
+  // nothing on the deferred free thread.
+  // @param block_info The block to cache. It must already have been released
+  //     by FreePristineBlock.
+  // @returns true if the block was cached, false if it needs to be returned
+  //     to its heap.
+  bool PushToThreadBlockCache(const BlockInfo& block_info);
+
+  // Evicts the blocks belonging to a heap from all of the thread caches, and
+  // returns them to the heap.
+  // @param heap The heap whose blocks are to be evicted.
+  void FlushThreadBlockCaches(BlockHeapInterface* heap);
+  // @}
 
-  // Returns the ID of the deferred free thread. Must not be called if the
-  // thread is not running.
-  // @returns the thread ID.
-  base::PlatformThreadId GetDeferredFreeThreadId();
+  // @name Allocation stack sampling functions.
+  // @{
+  // Attributes an allocation the stack last captured by the current thread,
+  // if the allocation stacks are sampled and this one isn't due to be
+  // captured.
+  // @returns a saved stack capture with a new reference, or nullptr if the
+  //     stack of the allocation must be captured.
+  const common::StackCapture* ReuseThreadAllocStack();
+
+  // Remembers the allocation stack that was captured by the current thread,
+  // and restarts the countdown to the next capture.
+  // @param alloc_stack The saved allocation stack.
+  void SetThreadAllocStack(const common::StackCapture* alloc_stack);
+  // @}
 
   // The shadow memory that is notified by all activity in this heap manager.
   Shadow* shadow_;
@@ -387,6 +598,13 @@ class BlockHeapManager : public HeapManagerInterface {
   // Map the block heaps to their underlying heap.
   UnderlyingHeapMap underlying_heaps_map_;  // Under lock_.
 
+  // The published heap table, and the number of threads reading it. The
+  // tables that are replaced while they may still be read are retired, and
+  // freed by the next writer that finds no reader.
+  HeapTable* volatile heap_table_;
+  volatile LONG heap_table_readers_;
+  std::vector<HeapTable*> retired_heap_tables_;  // Under lock_.
+
   // The parameters of this heap manager.
   ::common::AsanParameters parameters_;
 
@@ -418,9 +636,21 @@ class BlockHeapManager : public HeapManagerInterface {
   // The ID of the large block heap. Allows accessing it directly.
   HeapId large_block_heap_id_;
 
+  // The IDs of the partitions of the process heap. Like the zebra heap, their
+  // lifetime is managed by the HeapQuarantineMap. The count is only set once
+  // all the partitions have been created, and is published with a release
+  // store so that Allocate can read it without the lock. Use
+  // GetHeapPartitionCount to read it.
+  HeapId heap_partitions_[kMaxHeapPartitions];
+  base::subtle::Atomic32 heap_partition_count_;
+
   // Stores the AllocationFilterFlag TLS slot.
   DWORD allocation_filter_flag_tls_;
 
+  // The allocation stacks that get through the allocation filter. This is
+  // null if the allocations aren't filtered by stack.
+  std::unique_ptr<StackIdFilter> allocation_filter_stack_ids_;
+
   // A list of all heaps whose locks were acquired by the last call to
   // BestEffortLockAll. This uses the internal heap, otherwise the default
   // allocator makes use of the process heap. The process heap may itself
@@ -433,8 +663,27 @@ class BlockHeapManager : public HeapManagerInterface {
   bool enable_page_protections_;
 
   // The registry cache that we use to store the allocation stack ID of the
-  // corrupt block for which we've already reported an error.
+  // corrupt block for which we've already reported an error. This is loaded
+  // lazily by InitCorruptBlockRegistryCache.
+  base::Lock corrupt_block_registry_cache_lock_;
+  // Under corrupt_block_registry_cache_lock_.
   RegistryCache corrupt_block_registry_cache_;
+  bool corrupt_block_registry_cache_loaded_;
+
+  // Stores the ThreadBlockCache TLS slot.
+  DWORD thread_block_cache_tls_;
+
+  // The block caches of all the threads. These are allocated from the
+  // internal heap, and are only freed when the heap manager is torn down.
+  base::Lock thread_block_caches_lock_;
+  // Under thread_block_caches_lock_.
+  std::vector<ThreadBlockCache*> thread_block_caches_;
+
+  // Store the ID of the allocation stack last captured by each thread, and
+  // the number of allocations left until the next capture. These TLS slots
+  // are only used when the allocation stacks are sampled.
+  DWORD alloc_stack_id_tls_;
+  DWORD allocs_until_stack_capture_tls_;
 
  private:
   // Background thread that takes care of trimming the quarantine
@@ -443,6 +692,32 @@ class BlockHeapManager : public HeapManagerInterface {
   // Under deferred_free_thread_lock_.
   std::unique_ptr<DeferredFreeThread> deferred_free_thread_;
 
+  // The freed blocks waiting for the deferred free thread to flood-fill them.
+  // They are in the QUARANTINED_BLOCK state with a valid checksum, so they
+  // are checked like the unflooded quarantined blocks until then, but they
+  // aren't in a quarantine yet and can't be trimmed.
+  base::Lock pending_flood_fills_lock_;
+  // Under pending_flood_fills_lock_.
+  std::vector<CompactBlockInfo> pending_flood_fills_;
+
+  // The number of asynchronous and synchronous trims requested while the
+  // deferred free thread was running. These are accessed atomically.
+  base::subtle::Atomic32 deferred_free_async_trim_count_;
+  base::subtle::Atomic32 deferred_free_sync_trim_count_;
+
+  // Background thread that checks the quarantined blocks.
+  base::Lock quarantine_checker_thread_lock_;
+  // Under quarantine_checker_thread_lock_.
+  std::unique_ptr<QuarantineCheckerThread> quarantine_checker_thread_;
+
+  // The sampling heap profiler. This is created by PropagateParameters if
+  // heap profiling is enabled, and lives as long as the heap manager.
+  std::unique_ptr<HeapProfiler> heap_profiler_;
+
+  // The position of CheckQuarantinedBlocks in the shared quarantine. Only
+  // accessed by CheckQuarantinedBlocks, which doesn't run concurrently.
+  size_t quarantine_check_cursor_;
+
   DISALLOW_COPY_AND_ASSIGN(BlockHeapManager);
 };
 
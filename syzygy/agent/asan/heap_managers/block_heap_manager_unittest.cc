@@ -14,6 +14,8 @@
 
 #include "syzygy/agent/asan/heap_managers/block_heap_manager.h"
 
+#include <algorithm>
+#include <set>
 #include <vector>
 
 #include "base/bind.h"
@@ -213,23 +215,33 @@ class TestBlockHeapManager : public BlockHeapManager {
  public:
   using BlockHeapManager::HeapQuarantinePair;
 
+  using BlockHeapManager::CheckQuarantinedBlocks;
   using BlockHeapManager::FreePotentiallyCorruptBlock;
   using BlockHeapManager::GetHeapId;
+  using BlockHeapManager::GetHeapPartitionCount;
   using BlockHeapManager::GetHeapFromId;
   using BlockHeapManager::GetHeapTypeUnlocked;
   using BlockHeapManager::GetQuarantineFromId;
+  using BlockHeapManager::GetThreadBlockCache;
   using BlockHeapManager::HeapMetadata;
   using BlockHeapManager::HeapQuarantineMap;
+  using BlockHeapManager::IsValidHeapId;
   using BlockHeapManager::IsValidHeapIdUnlocked;
+  using BlockHeapManager::PublishHeapTableUnlocked;
   using BlockHeapManager::SetHeapErrorCallback;
   using BlockHeapManager::ShardedBlockQuarantine;
+  using BlockHeapManager::ShouldGuardSiteAllocation;
   using BlockHeapManager::TrimQuarantine;
 
   using BlockHeapManager::allocation_filter_flag_tls_;
+  using BlockHeapManager::heap_partitions_;
+  using BlockHeapManager::heap_table_;
   using BlockHeapManager::heaps_;
   using BlockHeapManager::large_block_heap_id_;
+  using BlockHeapManager::lock_;
   using BlockHeapManager::locked_heaps_;
   using BlockHeapManager::parameters_;
+  using BlockHeapManager::retired_heap_tables_;
   using BlockHeapManager::shared_quarantine_;
   using BlockHeapManager::zebra_block_heap_;
   using BlockHeapManager::zebra_block_heap_id_;
@@ -289,7 +301,8 @@ class TestBlockHeapManager : public BlockHeapManager {
                                   base::WaitableEvent* end_event) {
     EnableDeferredFreeThreadWithCallback(
         base::Bind(&TestBlockHeapManager::DeferredFreeDoWorkWithSync,
-                   base::Unretained(this), start_event, end_event));
+                   base::Unretained(this), start_event, end_event),
+        1);
   }
 };
 
@@ -641,6 +654,45 @@ TEST_F(BlockHeapManagerTest, FreeUnguardedAlloc) {
                                   process_heap_wrapper_alloc));
 }
 
+TEST_F(BlockHeapManagerTest, HeapPartitions) {
+  const size_t kAllocSize = 100;
+  const size_t kPartitionCount = 4;
+  ::common::AsanParameters params = heap_manager_->parameters();
+  params.heap_partition_count = kPartitionCount;
+  heap_manager_->set_parameters(params);
+  ASSERT_EQ(kPartitionCount, heap_manager_->GetHeapPartitionCount());
+
+  // The allocations made on the process heap are served by its partitions.
+  HeapId process_heap = heap_manager_->process_heap();
+  void* alloc = heap_manager_->Allocate(process_heap, kAllocSize);
+  ASSERT_NE(static_cast<void*>(nullptr), alloc);
+  BlockInfo block_info = {};
+  ASSERT_TRUE(GetBlockInfo(runtime_->shadow(),
+                           reinterpret_cast<BlockBody*>(alloc), &block_info));
+  HeapId* partitions_end =
+      heap_manager_->heap_partitions_ + kPartitionCount;
+  EXPECT_NE(partitions_end, std::find(heap_manager_->heap_partitions_,
+                                      partitions_end,
+                                      block_info.trailer->heap_id));
+  EXPECT_EQ(kWinHeap,
+            heap_manager_->GetHeapTypeUnlocked(block_info.trailer->heap_id));
+  EXPECT_TRUE(heap_manager_->Free(process_heap, alloc));
+
+  // The allocations made on the other heaps aren't affected.
+  ScopedHeap heap(heap_manager_);
+  alloc = heap.Allocate(kAllocSize);
+  ASSERT_NE(static_cast<void*>(nullptr), alloc);
+  ASSERT_TRUE(GetBlockInfo(runtime_->shadow(),
+                           reinterpret_cast<BlockBody*>(alloc), &block_info));
+  EXPECT_EQ(heap.Id(), block_info.trailer->heap_id);
+  EXPECT_TRUE(heap.Free(alloc));
+
+  // The partitions can't be resized.
+  params.heap_partition_count = 2 * kPartitionCount;
+  heap_manager_->set_parameters(params);
+  EXPECT_EQ(kPartitionCount, heap_manager_->GetHeapPartitionCount());
+}
+
 TEST_F(BlockHeapManagerTest, PopOnSetQuarantineMaxSize) {
   const size_t kAllocSize = 100;
   size_t real_alloc_size = GetAllocSize(kAllocSize);
@@ -661,6 +713,65 @@ TEST_F(BlockHeapManagerTest, PopOnSetQuarantineMaxSize) {
   ASSERT_FALSE(heap.InQuarantine(mem));
 }
 
+TEST_F(BlockHeapManagerTest, HeapProfiler) {
+  EXPECT_EQ(static_cast<HeapProfiler*>(nullptr),
+            heap_manager_->heap_profiler());
+
+  ::common::AsanParameters parameters = heap_manager_->parameters();
+  parameters.heap_profile_sampling_interval = 1000;
+  heap_manager_->set_parameters(parameters);
+  HeapProfiler* profiler = heap_manager_->heap_profiler();
+  ASSERT_NE(static_cast<HeapProfiler*>(nullptr), profiler);
+
+  ScopedHeap heap(heap_manager_);
+  void* mem = heap.Allocate(100);
+  ASSERT_NE(static_cast<void*>(nullptr), mem);
+  EXPECT_EQ(100u, profiler->total_bytes());
+  EXPECT_EQ(1u, profiler->GetHistogramCount(
+      HeapProfiler::GetHistogramBucket(100)));
+  EXPECT_TRUE(heap.Free(mem));
+}
+
+TEST_F(BlockHeapManagerTest, SampledAllocStacks) {
+  ScopedHeap heap(heap_manager_);
+
+  // Allocations made from different places have different stacks.
+  void* mem1 = heap.Allocate(10);
+  void* mem2 = heap.Allocate(10);
+  ASSERT_NE(static_cast<void*>(nullptr), mem1);
+  ASSERT_NE(static_cast<void*>(nullptr), mem2);
+  EXPECT_NE(BlockGetHeaderFromBody(
+                reinterpret_cast<BlockBody*>(mem1))->alloc_stack,
+            BlockGetHeaderFromBody(
+                reinterpret_cast<BlockBody*>(mem2))->alloc_stack);
+  EXPECT_TRUE(heap.Free(mem1));
+  EXPECT_TRUE(heap.Free(mem2));
+
+  // When sampled, only the first of every 3 allocations captures its stack.
+  ::common::AsanParameters parameters = heap_manager_->parameters();
+  parameters.alloc_stack_capture_period = 3;
+  heap_manager_->set_parameters(parameters);
+  void* mem[4] = {};
+  mem[0] = heap.Allocate(10);
+  mem[1] = heap.Allocate(10);
+  mem[2] = heap.Allocate(10);
+  mem[3] = heap.Allocate(10);
+  const common::StackCapture* stacks[arraysize(mem)] = {};
+  for (size_t i = 0; i < arraysize(mem); ++i) {
+    ASSERT_NE(static_cast<void*>(nullptr), mem[i]);
+    stacks[i] =
+        BlockGetHeaderFromBody(reinterpret_cast<BlockBody*>(mem[i]))
+            ->alloc_stack;
+  }
+  EXPECT_EQ(stacks[0], stacks[1]);
+  EXPECT_EQ(stacks[0], stacks[2]);
+  EXPECT_NE(stacks[0], stacks[3]);
+  EXPECT_LE(3u, stacks[0]->ref_count());
+
+  for (size_t i = 0; i < arraysize(mem); ++i)
+    EXPECT_TRUE(heap.Free(mem[i]));
+}
+
 TEST_F(BlockHeapManagerTest, Quarantine) {
   const size_t kAllocSize = 100;
   size_t real_alloc_size = GetAllocSize(kAllocSize);
@@ -691,6 +802,80 @@ TEST_F(BlockHeapManagerTest, Quarantine) {
   EXPECT_EQ(number_of_allocs, blocks_in_quarantine);
 }
 
+TEST_F(BlockHeapManagerTest, ThreadBlockCache) {
+  const size_t kAllocSize = 100;
+  size_t real_alloc_size = GetAllocSize(kAllocSize);
+  ScopedHeap heap(heap_manager_);
+
+  ::common::AsanParameters parameters = heap_manager_->parameters();
+  parameters.quarantine_size = real_alloc_size;
+  parameters.thread_block_cache = true;
+  heap_manager_->set_parameters(parameters);
+
+  // Freeing a second block pushes one of them out of the quarantine, at which
+  // point it goes into this thread's cache.
+  void* mem1 = heap.Allocate(kAllocSize);
+  void* mem2 = heap.Allocate(kAllocSize);
+  ASSERT_NE(static_cast<void*>(nullptr), mem1);
+  ASSERT_NE(static_cast<void*>(nullptr), mem2);
+  ASSERT_TRUE(heap.Free(mem1));
+  ASSERT_TRUE(heap.InQuarantine(mem1));
+  ASSERT_TRUE(heap.Free(mem2));
+  ASSERT_NE(heap.InQuarantine(mem1), heap.InQuarantine(mem2));
+  void* evicted = heap.InQuarantine(mem1) ? mem2 : mem1;
+
+  // The next allocation of the same size reuses the evicted block, but never
+  // the quarantined one.
+  void* mem3 = heap.Allocate(kAllocSize);
+  EXPECT_EQ(evicted, mem3);
+  EXPECT_TRUE(runtime_->shadow()->IsRangeAccessible(mem3, kAllocSize));
+  EXPECT_FALSE(runtime_->shadow()->IsAccessible(
+      reinterpret_cast<uint8_t*>(mem3) + kAllocSize));
+  EXPECT_TRUE(heap.Free(mem3));
+
+  // Allocations of a different size aren't served from the cache.
+  void* mem4 = heap.Allocate(kAllocSize * 2);
+  EXPECT_NE(evicted, mem4);
+  EXPECT_TRUE(heap.Free(mem4));
+
+  // Destroying the heap flushes its blocks from the cache.
+  heap.ReleaseHeap();
+}
+
+TEST_F(BlockHeapManagerTest, ThreadBlockCacheFlushedOnThreadDetach) {
+  const size_t kAllocSize = 100;
+  size_t real_alloc_size = GetAllocSize(kAllocSize);
+  ScopedHeap heap(heap_manager_);
+
+  ::common::AsanParameters parameters = heap_manager_->parameters();
+  parameters.quarantine_size = real_alloc_size;
+  parameters.thread_block_cache = true;
+  heap_manager_->set_parameters(parameters);
+
+  // Get a block into this thread's cache.
+  void* mem1 = heap.Allocate(kAllocSize);
+  void* mem2 = heap.Allocate(kAllocSize);
+  ASSERT_NE(static_cast<void*>(nullptr), mem1);
+  ASSERT_NE(static_cast<void*>(nullptr), mem2);
+  ASSERT_TRUE(heap.Free(mem1));
+  ASSERT_TRUE(heap.Free(mem2));
+  ThreadBlockCache* cache = heap_manager_->GetThreadBlockCache(false);
+  ASSERT_NE(static_cast<ThreadBlockCache*>(nullptr), cache);
+  EXPECT_EQ(1u, cache->size());
+
+  // The cache is handed back to the heap and released when the thread exits.
+  heap_manager_->OnThreadDetach();
+  EXPECT_EQ(static_cast<ThreadBlockCache*>(nullptr),
+            heap_manager_->GetThreadBlockCache(false));
+
+  // Subsequent allocations create a new cache.
+  void* mem3 = heap.Allocate(kAllocSize);
+  ASSERT_NE(static_cast<void*>(nullptr), mem3);
+  EXPECT_NE(static_cast<ThreadBlockCache*>(nullptr),
+            heap_manager_->GetThreadBlockCache(false));
+  EXPECT_TRUE(heap.Free(mem3));
+}
+
 TEST_F(BlockHeapManagerTest, QuarantineLargeBlock) {
   const size_t kLargeAllocSize = 100;
   const size_t kSmallAllocSize = 25;
@@ -836,6 +1021,73 @@ TEST_F(BlockHeapManagerTest, Size) {
   }
 }
 
+TEST_F(BlockHeapManagerTest, ResizeInPlace) {
+  const size_t kAllocSize = 64;
+  ScopedHeap heap(heap_manager_);
+  void* mem = heap.Allocate(kAllocSize);
+  ASSERT_NE(static_cast<void*>(nullptr), mem);
+
+  // Shrinking by a multiple of kShadowRatio keeps the trailer aligned, and
+  // gives the bytes to its padding.
+  const size_t kShrunkSize = kAllocSize - kShadowRatio;
+  EXPECT_TRUE(heap_manager_->ResizeInPlace(heap.Id(), mem, kShrunkSize));
+  EXPECT_EQ(kShrunkSize, heap_manager_->Size(heap.Id(), mem));
+  ASSERT_NO_FATAL_FAILURE(VerifyAllocAccess(mem, kShrunkSize));
+
+  // The block can then grow back into its padding.
+  EXPECT_TRUE(heap_manager_->ResizeInPlace(heap.Id(), mem, kAllocSize));
+  EXPECT_EQ(kAllocSize, heap_manager_->Size(heap.Id(), mem));
+  ASSERT_NO_FATAL_FAILURE(VerifyAllocAccess(mem, kAllocSize));
+
+  // But not beyond its trailer.
+  EXPECT_FALSE(heap_manager_->ResizeInPlace(heap.Id(), mem, 2 * kAllocSize));
+  EXPECT_EQ(kAllocSize, heap_manager_->Size(heap.Id(), mem));
+
+  // The resized block is still valid when it's freed.
+  EXPECT_TRUE(heap.Free(mem));
+}
+
+TEST_F(BlockHeapManagerTest, DecommitQuarantinedPages) {
+  const size_t kAllocSize = 3 * GetPageSize();
+  ScopedHeap heap(heap_manager_);
+  ::common::AsanParameters parameters = heap_manager_->parameters();
+  parameters.quarantine_size = GetAllocSize(kAllocSize);
+  parameters.quarantine_flood_fill_rate = 1.0f;
+  parameters.decommit_quarantined_pages = true;
+  heap_manager_->set_parameters(parameters);
+
+  uint8_t* mem = static_cast<uint8_t*>(heap.Allocate(kAllocSize));
+  ASSERT_NE(static_cast<uint8_t*>(nullptr), mem);
+  ::memset(mem, 0xAB, kAllocSize);
+  ASSERT_TRUE(heap.Free(mem));
+
+  BlockHeader* header = BlockGetHeaderFromBody(
+      reinterpret_cast<BlockBody*>(mem));
+  BlockInfo block_info = {};
+  ASSERT_TRUE(BlockInfoFromMemory(header, &block_info));
+  EXPECT_EQ(QUARANTINED_BLOCK, static_cast<BlockState>(header->state));
+
+  // The whole pages of the body read as zeros, the rest is left intact.
+  uint8_t* pages = reinterpret_cast<uint8_t*>(
+      ::common::AlignUp(reinterpret_cast<uintptr_t>(mem), GetPageSize()));
+  uint8_t* pages_end = reinterpret_cast<uint8_t*>(::common::AlignDown(
+      reinterpret_cast<uintptr_t>(mem + kAllocSize), GetPageSize()));
+  ASSERT_LT(pages, pages_end);
+  BlockProtectNone(block_info, runtime_->shadow());
+  for (uint8_t* byte = mem; byte < mem + kAllocSize; ++byte) {
+    if (byte >= pages && byte < pages_end)
+      ASSERT_EQ(0u, *byte);
+    else
+      ASSERT_EQ(0xABu, *byte);
+  }
+  EXPECT_TRUE(BlockChecksumIsValid(block_info));
+  BlockProtectAll(block_info, runtime_->shadow());
+
+  // The block leaves the quarantine without being reported as corrupt.
+  heap.FlushQuarantine();
+  EXPECT_TRUE(errors_.empty());
+}
+
 TEST_F(BlockHeapManagerTest, AllocsAccessibility) {
   const size_t kMaxAllocSize = 134584;
   ScopedHeap heap(heap_manager_);
@@ -1017,6 +1269,50 @@ TEST_F(BlockHeapManagerTest, CorruptAsExitsQuarantine) {
   }
 }
 
+TEST_F(BlockHeapManagerTest, CorruptionIsDetectedInQuarantine) {
+  const size_t kAllocSize = 100;
+  ::common::AsanParameters parameters = heap_manager_->parameters();
+  parameters.quarantine_size = 10 * GetAllocSize(kAllocSize);
+  heap_manager_->set_parameters(parameters);
+
+  ScopedHeap heap(heap_manager_);
+  // This can fail because of a checksum collision. However, we run it a
+  // handful of times to keep the chances as small as possible.
+  for (size_t i = 0; i < kChecksumRepeatCount; ++i) {
+    heap.FlushQuarantine();
+    void* mem = heap.Allocate(kAllocSize);
+    ASSERT_NE(static_cast<void*>(nullptr), mem);
+    EXPECT_TRUE(heap.Free(mem));
+    EXPECT_NE(0u, heap_manager_->CheckQuarantinedBlocks(100));
+    EXPECT_TRUE(errors_.empty());
+
+    // Corrupt the block while it sits in the quarantine. The checker should
+    // find it without the block being evicted.
+    reinterpret_cast<int32_t*>(mem)[0] = rand();
+    heap_manager_->CheckQuarantinedBlocks(100);
+
+    // Try again for all but the last attempt if this appears to have failed.
+    if (errors_.empty() && i + 1 < kChecksumRepeatCount)
+      continue;
+
+    EXPECT_EQ(1u, errors_.size());
+    EXPECT_EQ(CORRUPT_BLOCK, errors_[0].error_type);
+    EXPECT_EQ(reinterpret_cast<const BlockHeader*>(mem) - 1,
+              reinterpret_cast<const BlockHeader*>(errors_[0].location));
+
+    break;
+  }
+}
+
+TEST_F(BlockHeapManagerTest, EnableQuarantineCheckerThreadTest) {
+  ScopedHeap heap(heap_manager_);
+  ASSERT_FALSE(heap_manager_->IsQuarantineCheckerThreadRunning());
+  heap_manager_->EnableQuarantineCheckerThread(1000);
+  ASSERT_TRUE(heap_manager_->IsQuarantineCheckerThreadRunning());
+  heap_manager_->DisableQuarantineCheckerThread();
+  ASSERT_FALSE(heap_manager_->IsQuarantineCheckerThreadRunning());
+}
+
 TEST_F(BlockHeapManagerTest, CorruptAsExitsQuarantineOnHeapDestroy) {
   const size_t kAllocSize = 100;
   ::common::AsanParameters parameters = heap_manager_->parameters();
@@ -1238,6 +1534,72 @@ TEST_F(BlockHeapManagerTest, SubsampledAllocationGuards) {
   EXPECT_GT(6 * kAllocationCount / 10, guarded_allocations);
 }
 
+TEST_F(BlockHeapManagerTest, SiteAllocationGuardRates) {
+  const uint32_t kThreshold = 8;
+  const StackCaptureCache::StackId kSite = 0x12345;
+  const StackCaptureCache::StackId kOtherSite = 0x12346;
+  ::common::AsanParameters parameters = heap_manager_->parameters();
+  parameters.allocation_guard_rate = 0.0;
+  parameters.allocation_guard_site_threshold = kThreshold;
+  parameters.allocation_guard_seed = 42;
+  heap_manager_->set_parameters(parameters);
+
+  // The first allocations of a site are always guarded.
+  for (uint32_t i = 0; i < kThreshold; ++i)
+    EXPECT_TRUE(heap_manager_->ShouldGuardSiteAllocation(kSite));
+
+  // The later ones are guarded less and less often. After the threshold the
+  // expected number of guarded allocations is about
+  // kThreshold * ln(kAllocationCount / kThreshold), which is 57.
+  const size_t kAllocationCount = 10000;
+  size_t guarded_allocations = 0;
+  for (size_t i = 0; i < kAllocationCount; ++i) {
+    if (heap_manager_->ShouldGuardSiteAllocation(kSite))
+      ++guarded_allocations;
+  }
+  EXPECT_LT(20u, guarded_allocations);
+  EXPECT_GT(150u, guarded_allocations);
+
+  // The other sites have rates of their own.
+  for (uint32_t i = 0; i < kThreshold; ++i)
+    EXPECT_TRUE(heap_manager_->ShouldGuardSiteAllocation(kOtherSite));
+
+  // The rate doesn't go below the global allocation guard rate.
+  parameters.allocation_guard_rate = 1.0;
+  heap_manager_->set_parameters(parameters);
+  for (size_t i = 0; i < 100; ++i)
+    EXPECT_TRUE(heap_manager_->ShouldGuardSiteAllocation(kSite));
+}
+
+TEST_F(BlockHeapManagerTest, SiteAllocationGuards) {
+  const uint32_t kThreshold = 4;
+  ::common::AsanParameters parameters = heap_manager_->parameters();
+  parameters.allocation_guard_rate = 0.0;
+  parameters.allocation_guard_site_threshold = kThreshold;
+  heap_manager_->set_parameters(parameters);
+  ScopedHeap heap(heap_manager_);
+
+  // The allocations are all made from the same site.
+  const size_t kAllocationCount = 1000;
+  const size_t kAllocSize = 100;
+  size_t guarded_allocations = 0;
+  for (size_t i = 0; i < kAllocationCount; ++i) {
+    void* alloc = heap.Allocate(kAllocSize);
+    ASSERT_NE(static_cast<void*>(nullptr), alloc);
+    BlockHeader* header = BlockGetHeaderFromBody(
+        reinterpret_cast<BlockBody*>(alloc));
+    if (header != nullptr)
+      ++guarded_allocations;
+    else
+      EXPECT_LE(kThreshold, i);
+    EXPECT_TRUE(heap.Free(alloc));
+  }
+  EXPECT_NO_FATAL_FAILURE(heap.FlushQuarantine());
+
+  EXPECT_LE(kThreshold, guarded_allocations);
+  EXPECT_GT(kAllocationCount / 10, guarded_allocations);
+}
+
 // Ensures that the ZebraBlockHeap overrides the provided heap.
 TEST_F(BlockHeapManagerTest, ZebraHeapIdInTrailerAfterAllocation) {
   EnableTestZebraBlockHeap();
@@ -1567,6 +1929,55 @@ TEST_F(BlockHeapManagerTest, AllocationFilterFlag) {
   EXPECT_TRUE(heap_manager_->allocation_filter_flag());
 }
 
+TEST_F(BlockHeapManagerTest, AllocationFilterStackIds) {
+  EnableTestZebraBlockHeap();
+  ::common::AsanParameters params = heap_manager_->parameters();
+  params.enable_allocation_filter = true;
+  heap_manager_->set_parameters(params);
+
+  // Allocate twice from the same stack, and let the allocations made from it
+  // through the filter after the first one. Only the second one should go to
+  // the zebra heap.
+  ScopedHeap heap(heap_manager_);
+  const size_t kAllocSize = 0x100;
+  HeapId heap_ids[2] = {};
+  for (size_t i = 0; i < arraysize(heap_ids); ++i) {
+    void* alloc = heap.Allocate(kAllocSize);
+    ASSERT_NE(static_cast<void*>(nullptr), alloc);
+
+    BlockInfo block_info = {};
+    EXPECT_TRUE(runtime_->shadow()->BlockInfoFromShadow(alloc, &block_info));
+    std::set<StackIdFilter::StackId> stack_ids;
+    {
+      ScopedBlockAccess block_access(block_info, runtime_->shadow());
+      heap_ids[i] = block_info.trailer->heap_id;
+      stack_ids.insert(block_info.header->alloc_stack->relative_stack_id());
+    }
+    EXPECT_TRUE(heap.Free(alloc));
+
+    heap_manager_->set_allocation_filter_stack_ids(stack_ids);
+  }
+
+  EXPECT_NE(heap_manager_->zebra_block_heap_id_, heap_ids[0]);
+  EXPECT_EQ(heap_manager_->zebra_block_heap_id_, heap_ids[1]);
+
+  // The allocation filter flag still lets the allocations through on its own.
+  heap_manager_->set_allocation_filter_stack_ids(
+      std::set<StackIdFilter::StackId>());
+  heap_manager_->set_allocation_filter_flag(true);
+  void* alloc = heap.Allocate(kAllocSize);
+  heap_manager_->set_allocation_filter_flag(false);
+  ASSERT_NE(static_cast<void*>(nullptr), alloc);
+  BlockInfo block_info = {};
+  EXPECT_TRUE(runtime_->shadow()->BlockInfoFromShadow(alloc, &block_info));
+  {
+    ScopedBlockAccess block_access(block_info, runtime_->shadow());
+    EXPECT_EQ(heap_manager_->zebra_block_heap_id_,
+              block_info.trailer->heap_id);
+  }
+  EXPECT_TRUE(heap.Free(alloc));
+}
+
 namespace {
 
 size_t CountLockedHeaps(HeapInterface** heaps) {
@@ -1682,6 +2093,34 @@ TEST_F(BlockHeapManagerTest, IsValidHeapIdUnlocked) {
   }
 }
 
+TEST_F(BlockHeapManagerTest, IsValidHeapIdFollowsHeapLifetime) {
+  HeapId heap_id = heap_manager_->CreateHeap();
+  EXPECT_TRUE(heap_manager_->IsValidHeapId(heap_id, false));
+  EXPECT_TRUE(heap_manager_->IsValidHeapIdUnlocked(heap_id, false));
+
+  // Dying heaps are in the table until they're destroyed.
+  auto it = heap_manager_->heaps_.find(heap_manager_->GetHeapFromId(heap_id));
+  ASSERT_NE(heap_manager_->heaps_.end(), it);
+  {
+    base::AutoLock lock(heap_manager_->lock_);
+    it->second.is_dying = true;
+    heap_manager_->PublishHeapTableUnlocked();
+  }
+  EXPECT_FALSE(heap_manager_->IsValidHeapId(heap_id, false));
+  EXPECT_TRUE(heap_manager_->IsValidHeapId(heap_id, true));
+  {
+    base::AutoLock lock(heap_manager_->lock_);
+    it->second.is_dying = false;
+    heap_manager_->PublishHeapTableUnlocked();
+  }
+
+  // The heap is dropped from the table when it's destroyed. As there are no
+  // readers, the replaced tables are freed right away.
+  EXPECT_TRUE(heap_manager_->DestroyHeap(heap_id));
+  EXPECT_TRUE(heap_manager_->retired_heap_tables_.empty());
+  EXPECT_EQ(heap_manager_->heaps_.size(), heap_manager_->heap_table_->size());
+}
+
 TEST_F(BlockHeapManagerTest, GetHeapTypeUnlocked) {
   ASSERT_FALSE(heap_manager_->heaps_.empty());
   for (auto& hq_pair : heap_manager_->heaps_) {
@@ -1755,8 +2194,66 @@ TEST_F(BlockHeapManagerTest, DeferredFreeThreadTest) {
   EXPECT_EQ(GREEN,
             heap_manager_->shared_quarantine_.GetQuarantineColor(current_size));
 
+  // Going into RED signaled the thread once, and it never fell behind.
+  BlockHeapManager::DeferredFreeStatistics statistics = {};
+  heap_manager_->GetDeferredFreeStatistics(&statistics);
+  EXPECT_EQ(1u, statistics.worker_count);
+  EXPECT_EQ(1u, statistics.async_trim_count);
+  EXPECT_EQ(0u, statistics.sync_trim_count);
+  EXPECT_EQ(1u, statistics.max_pending_work_count);
+
   heap_manager_->DisableDeferredFreeThread();
   EXPECT_FALSE(heap_manager_->IsDeferredFreeThreadRunning());
+
+  heap_manager_->GetDeferredFreeStatistics(&statistics);
+  EXPECT_EQ(0u, statistics.worker_count);
+  EXPECT_EQ(1u, statistics.async_trim_count);
+}
+
+TEST_F(BlockHeapManagerTest, DeferredQuarantineFloodFill) {
+  const size_t kAllocSize = 100;
+  ScopedHeap heap(heap_manager_);
+  ::common::AsanParameters parameters = heap_manager_->parameters();
+  parameters.quarantine_size = 10 * GetAllocSize(kAllocSize);
+  parameters.quarantine_flood_fill_rate = 1.0f;
+  parameters.defer_quarantine_flood_fill = true;
+  heap_manager_->set_parameters(parameters);
+
+  base::WaitableEvent deferred_free_callback_start(false, false);
+  base::WaitableEvent deferred_free_callback_end(false, false);
+  heap_manager_->EnableDeferredFreeWithSync(&deferred_free_callback_start,
+                                            &deferred_free_callback_end);
+
+  uint8_t* mem = static_cast<uint8_t*>(heap.Allocate(kAllocSize));
+  ASSERT_NE(static_cast<uint8_t*>(nullptr), mem);
+  ::memset(mem, 0xAB, kAllocSize);
+  ASSERT_TRUE(heap.Free(mem));
+
+  // The fill is pending: the block is checked as an unflooded quarantined
+  // block, and isn't in the quarantine yet.
+  BlockHeader* header = BlockGetHeaderFromBody(
+      reinterpret_cast<BlockBody*>(mem));
+  BlockInfo block_info = {};
+  ASSERT_TRUE(BlockInfoFromMemory(header, &block_info));
+  EXPECT_EQ(QUARANTINED_BLOCK, static_cast<BlockState>(header->state));
+  EXPECT_EQ(0xABu, mem[0]);
+  EXPECT_TRUE(BlockChecksumIsValid(block_info));
+  EXPECT_FALSE(heap.InQuarantine(mem));
+  EXPECT_FALSE(heap.Free(mem));
+  ASSERT_EQ(1u, errors_.size());
+  EXPECT_EQ(DOUBLE_FREE, errors_[0].error_type);
+
+  // The worker applies the fill and quarantines the block.
+  deferred_free_callback_start.Signal();
+  deferred_free_callback_end.Wait();
+  EXPECT_EQ(QUARANTINED_FLOODED_BLOCK, static_cast<BlockState>(header->state));
+  EXPECT_TRUE(BlockBodyIsFloodFilled(block_info));
+  EXPECT_TRUE(BlockChecksumIsValid(block_info));
+  EXPECT_TRUE(heap.InQuarantine(mem));
+
+  heap_manager_->DisableDeferredFreeThread();
+  heap.FlushQuarantine();
+  EXPECT_EQ(1u, errors_.size());
 }
 
 namespace {
@@ -14,20 +14,122 @@
 
 #include "syzygy/agent/asan/heap_managers/deferred_free_thread.h"
 
+#include <algorithm>
+#include <utility>
+
+#include "base/synchronization/waitable_event.h"
+
 namespace agent {
 namespace asan {
 namespace heap_managers {
 
+// A single background thread of the pool.
+class DeferredFreeThread::Worker : public base::PlatformThread::Delegate {
+ public:
+  explicit Worker(DeferredFreeThread* owner)
+      : owner_(owner),
+        deferred_free_event_(false, false),
+        deferred_free_signaled_(0),
+        deferred_free_thread_id_(0),
+        ready_event_(false, false) {
+    DCHECK_NE(static_cast<DeferredFreeThread*>(nullptr), owner);
+  }
+
+  // Launches the thread and waits until it's ready to work.
+  // @returns true on success, false otherwise.
+  bool Start() {
+    if (!base::PlatformThread::CreateWithPriority(
+            0, this, &deferred_free_thread_handle_,
+            base::ThreadPriority::BACKGROUND)) {
+      return false;
+    }
+    ready_event_.Wait();
+    return true;
+  }
+
+  // Wakes up the thread so that it can exit, and joins it.
+  void Stop() {
+    deferred_free_event_.Signal();
+    base::PlatformThread::Join(deferred_free_thread_handle_);
+  }
+
+  // Signals the thread that there's work, unless it's already signaled.
+  // @returns true if the thread was signaled by this call.
+  bool Signal() {
+    auto initial_deferred_free_signaled =
+        base::subtle::NoBarrier_CompareAndSwap(&deferred_free_signaled_, 0, 1);
+    if (initial_deferred_free_signaled)
+      return false;
+    deferred_free_event_.Signal();
+    return true;
+  }
+
+  // @returns the thread ID.
+  base::PlatformThreadId deferred_free_thread_id() const {
+    return deferred_free_thread_id_;
+  }
+
+ private:
+  // Implementation of PlatformThread::Delegate:
+  void ThreadMain() override {
+    base::PlatformThread::SetName("SyzyASAN Deferred Free Thread");
+    deferred_free_thread_id_ = base::PlatformThread::CurrentId();
+    ready_event_.Signal();
+    while (true) {
+      deferred_free_event_.Wait();
+      if (!base::subtle::NoBarrier_Load(&owner_->enabled_))
+        break;
+      // Clear the |deferred_free_signaled_| flag before executing the
+      // callback.
+      auto initial_deferred_free_signaled =
+          base::subtle::NoBarrier_CompareAndSwap(&deferred_free_signaled_, 1,
+                                                 0);
+      DCHECK(initial_deferred_free_signaled);
+      owner_->OnWorkStarted();
+      owner_->deferred_free_callback_.Run();
+    }
+  }
+
+  // The pool that owns this worker.
+  DeferredFreeThread* owner_;
+
+  // Used to signal that work is ready (wakes up the background thread).
+  base::WaitableEvent deferred_free_event_;
+  // This atomic is set when the thread is signaled and cleared when the thread
+  // wakes up. The objective is to limit the amount of over signaling possible.
+  base::subtle::Atomic32 deferred_free_signaled_;
+
+  // Handle to the thread, used to join the thread when stopping.
+  base::PlatformThreadHandle deferred_free_thread_handle_;
+
+  // The thread ID, can be used by callbacks to validate that they're running on
+  // the right thread.
+  base::PlatformThreadId deferred_free_thread_id_;
+
+  // Used to signal that the background thread has spawned up and is ready to
+  // work.
+  base::WaitableEvent ready_event_;
+
+  DISALLOW_COPY_AND_ASSIGN(Worker);
+};
+
 DeferredFreeThread::DeferredFreeThread(Callback deferred_free_callback)
+    : DeferredFreeThread(deferred_free_callback, 1) {
+}
+
+DeferredFreeThread::DeferredFreeThread(Callback deferred_free_callback,
+                                       size_t worker_count)
     : deferred_free_callback_(deferred_free_callback),
-      deferred_free_event_(false, false),
-      deferred_free_signaled_(0),
-      ready_event_(false, false),
+      requested_worker_count_(worker_count),
+      pending_work_count_(0),
+      max_pending_work_count_(0),
       enabled_(0) {
+  DCHECK_LT(0u, worker_count);
 }
 
 DeferredFreeThread::~DeferredFreeThread() {
   DCHECK_EQ(0, base::subtle::NoBarrier_Load(&enabled_));
+  DCHECK(workers_.empty());
 }
 
 bool DeferredFreeThread::Start() {
@@ -35,13 +137,14 @@ bool DeferredFreeThread::Start() {
   DCHECK_EQ(0, old_enabled);
   // Make sure the change to |enabled_| is not reordered.
   base::subtle::MemoryBarrier();
-  if (!base::PlatformThread::CreateWithPriority(
-          0, this, &deferred_free_thread_handle_,
-          base::ThreadPriority::BACKGROUND)) {
-    return false;
+  DCHECK(workers_.empty());
+  for (size_t i = 0; i < requested_worker_count_; ++i) {
+    std::unique_ptr<Worker> worker(new Worker(this));
+    if (!worker->Start())
+      break;
+    workers_.push_back(std::move(worker));
   }
-  ready_event_.Wait();
-  return true;
+  return !workers_.empty();
 }
 
 void DeferredFreeThread::Stop() {
@@ -49,36 +152,62 @@ void DeferredFreeThread::Stop() {
   DCHECK_EQ(1, old_enabled);
   // Make sure the change to |enabled_| is not reordered.
   base::subtle::MemoryBarrier();
-  // Signal so that the thread can exit cleanly and then join it.
-  deferred_free_event_.Signal();
-  base::PlatformThread::Join(deferred_free_thread_handle_);
+  // Signal so that the workers can exit cleanly and then join them.
+  for (auto& worker : workers_)
+    worker->Stop();
+  workers_.clear();
 }
 
-void DeferredFreeThread::SignalWork() {
-  // Avoid over signaling by trying to raise the |deferred_free_signaled_| flag
-  // and bailing if the flag was already raised.
-  auto initial_deferred_free_signaled =
-      base::subtle::NoBarrier_CompareAndSwap(&deferred_free_signaled_, 0, 1);
-  if (initial_deferred_free_signaled)
-    return;
+void DeferredFreeThread::SignalWork(size_t worker_count) {
+  worker_count = std::min(worker_count, workers_.size());
+  for (size_t i = 0; i < worker_count; ++i) {
+    if (!workers_[i]->Signal())
+      continue;
 
-  deferred_free_event_.Signal();
+    // Keep track of the depth of the work queue.
+    auto pending_work_count =
+        base::subtle::NoBarrier_AtomicIncrement(&pending_work_count_, 1);
+    auto max_pending_work_count =
+        base::subtle::NoBarrier_Load(&max_pending_work_count_);
+    while (pending_work_count > max_pending_work_count) {
+      auto previous = base::subtle::NoBarrier_CompareAndSwap(
+          &max_pending_work_count_, max_pending_work_count,
+          pending_work_count);
+      if (previous == max_pending_work_count)
+        break;
+      max_pending_work_count = previous;
+    }
+  }
 }
 
-void DeferredFreeThread::ThreadMain() {
-  base::PlatformThread::SetName("SyzyASAN Deferred Free Thread");
-  deferred_free_thread_id_ = base::PlatformThread::CurrentId();
-  ready_event_.Signal();
-  while (true) {
-    deferred_free_event_.Wait();
-    if (!base::subtle::NoBarrier_Load(&enabled_))
-      break;
-    // Clear the |deferred_free_signaled_| flag before executing the callback.
-    auto initial_deferred_free_signaled =
-        base::subtle::NoBarrier_CompareAndSwap(&deferred_free_signaled_, 1, 0);
-    DCHECK(initial_deferred_free_signaled);
-    deferred_free_callback_.Run();
+base::PlatformThreadId DeferredFreeThread::deferred_free_thread_id() const {
+  DCHECK(!workers_.empty());
+  return workers_[0]->deferred_free_thread_id();
+}
+
+bool DeferredFreeThread::IsWorkerThread(
+    base::PlatformThreadId thread_id) const {
+  for (const auto& worker : workers_) {
+    if (worker->deferred_free_thread_id() == thread_id)
+      return true;
   }
+  return false;
+}
+
+size_t DeferredFreeThread::pending_work_count() const {
+  auto pending_work_count =
+      base::subtle::NoBarrier_Load(&pending_work_count_);
+  // The count can briefly go negative, as a worker may wake up before the
+  // signaling thread gets to increment it.
+  return pending_work_count > 0 ? pending_work_count : 0;
+}
+
+size_t DeferredFreeThread::max_pending_work_count() const {
+  return base::subtle::NoBarrier_Load(&max_pending_work_count_);
+}
+
+void DeferredFreeThread::OnWorkStarted() {
+  base::subtle::NoBarrier_AtomicIncrement(&pending_work_count_, -1);
 }
 
 }  // namespace heap_managers
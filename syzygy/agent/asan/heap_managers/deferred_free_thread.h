@@ -18,6 +18,9 @@
 #ifndef SYZYGY_AGENT_ASAN_HEAP_MANAGERS_DEFERRED_FREE_THREAD_H_
 #define SYZYGY_AGENT_ASAN_HEAP_MANAGERS_DEFERRED_FREE_THREAD_H_
 
+#include <memory>
+#include <vector>
+
 #include "base/callback.h"
 #include "base/synchronization/condition_variable.h"
 #include "base/threading/platform_thread.h"
@@ -27,75 +30,100 @@ namespace agent {
 namespace asan {
 namespace heap_managers {
 
-// This object can be created by each process. It spawns a low-priority
-// background thread that is responsible for performing deferred work that
-// Free() would otherwise be doing on the critical path. The goal is to improve
-// responsiveness.
+// This object can be created by each process. It spawns a pool of low-priority
+// background threads (workers) that are responsible for performing deferred
+// work that Free() would otherwise be doing on the critical path. The goal is
+// to improve responsiveness.
 //
 // As of now, this is responsible of trimming the shared quarantine. For more
 // information on the trimming and the different modes and colors, see
-// quarantine.h.
+// quarantine.h. The callback may run on several workers at once, and must be
+// thread-safe.
 //
 // Note that the thread must be cleanly shutdown by calling Stop before the
 // HeapManager is cleaned up, otherwise the callback might still be running
 // after the HeapManager no longer exists.
-class DeferredFreeThread : public base::PlatformThread::Delegate {
+class DeferredFreeThread {
  public:
   typedef base::Closure Callback;
+
+  // Constructor, for a single worker.
   // @param deferred_free_callback Callback that is called by the thread when
   // signaled. This callback must be valid from the moment Start is called and
   // until Stop is called.
   explicit DeferredFreeThread(Callback deferred_free_callback);
-  ~DeferredFreeThread() override;
 
-  // Starts the thread and waits until it signals that it's ready to work. Must
-  // be called before use. Must not be called if the thread has already been
-  // started.
-  // @returns true if successful, false if the thread failed to be launched.
+  // Constructor.
+  // @param deferred_free_callback Callback that is called by the workers when
+  // signaled. This callback must be valid from the moment Start is called and
+  // until Stop is called.
+  // @param worker_count The number of workers to spawn. Must be at least 1.
+  DeferredFreeThread(Callback deferred_free_callback, size_t worker_count);
+
+  ~DeferredFreeThread();
+
+  // Starts the workers and waits until they signal that they're ready to work.
+  // Must be called before use. Must not be called if the thread has already
+  // been started.
+  // @returns true if successful, false if no worker could be launched. If only
+  //     some of the workers failed to launch then the others are used.
   bool Start();
 
-  // Stops the thread and waits until it exists cleanly. Must be called before
+  // Stops the workers and waits until they exit cleanly. Must be called before
   // the destruction of this object and before the callback is no longer valid.
   // Must not be called if the thread has not been started previously.
   void Stop();
 
-  // Used to signal to the thread that work is required (wakes up the thread).
-  // It avoids over signaling (slow operation) by raising a flag
-  // (|deferred_free_signaled_|) and bailing if it's already set (flag gets
-  // unset by the thread). It's therefore ok to call this repeatedly.
-  void SignalWork();
+  // Used to signal to the thread that work is required (wakes up a worker).
+  // It avoids over signaling (slow operation) by raising a flag per worker and
+  // bailing if it's already set (flag gets unset by the worker). It's
+  // therefore ok to call this repeatedly.
+  void SignalWork() { SignalWork(1); }
+
+  // Wakes up to |worker_count| workers, for when a single one is not keeping
+  // up. Workers that are already signaled count toward that number.
+  // @param worker_count The number of workers to wake.
+  void SignalWork(size_t worker_count);
 
-  // @returns the thread ID.
-  base::PlatformThreadId deferred_free_thread_id() const {
-    return deferred_free_thread_id_;
-  }
+  // @returns the thread ID of the first worker.
+  base::PlatformThreadId deferred_free_thread_id() const;
+
+  // @param thread_id A thread ID.
+  // @returns true if the given thread is one of the workers.
+  bool IsWorkerThread(base::PlatformThreadId thread_id) const;
+
+  // @returns the number of running workers.
+  size_t worker_count() const { return workers_.size(); }
+
+  // @returns the number of workers that have been signaled but haven't yet
+  //     started to run the callback. This is the depth of the work queue.
+  size_t pending_work_count() const;
+
+  // @returns the largest value that pending_work_count reached.
+  size_t max_pending_work_count() const;
 
  private:
-  // Implementation of PlatformThread::Delegate:
-  void ThreadMain() override;
+  class Worker;
+
+  // Called by a worker when it wakes up to do some work.
+  void OnWorkStarted();
 
   // Callback to the deferred free function, set by the constructor.
   Callback deferred_free_callback_;
 
-  // Used to signal that work is ready (wakes up the background thread).
-  base::WaitableEvent deferred_free_event_;
-  // This atomic is set when the thread is signaled and cleared when the thread
-  // wakes up. The objective is to limit the amount of over signaling possible.
-  base::subtle::Atomic32 deferred_free_signaled_;
-
-  // Handle to the thread, used to join the thread when stopping.
-  base::PlatformThreadHandle deferred_free_thread_handle_;
+  // The number of workers requested at construction.
+  size_t requested_worker_count_;
 
-  // The thread ID, can be used by callbacks to validate that they're running on
-  // the right thread.
-  base::PlatformThreadId deferred_free_thread_id_;
+  // The running workers.
+  std::vector<std::unique_ptr<Worker>> workers_;
 
-  // Used to signal that the background thread has spawned up and is ready to
-  // work.
-  base::WaitableEvent ready_event_;
+  // The current and maximum number of signaled workers that haven't started
+  // their work yet. These are accessed atomically.
+  base::subtle::Atomic32 pending_work_count_;
+  base::subtle::Atomic32 max_pending_work_count_;
 
-  // Atomic that controls the execution of the background thread (loops while
-  // this is true).
+  // Atomic that controls the execution of the workers (they loop while this is
+  // true).
   base::subtle::Atomic32 enabled_;
 
   DISALLOW_COPY_AND_ASSIGN(DeferredFreeThread);
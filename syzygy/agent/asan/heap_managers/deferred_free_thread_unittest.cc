@@ -30,13 +30,18 @@ class DeferredFreeThreadTest : public testing::Test {
  public:
   DeferredFreeThreadTest() : nb_callbacks_(0), callback_event_(false, false) {}
 
-  void SetUp() override {
+  void SetUp() override { StartThread(1); }
+
+  void TearDown() override { StopThread(); }
+
+  void StartThread(size_t worker_count) {
     deferred_free_thread_.reset(new DeferredFreeThread(
-        base::Bind(&DeferredFreeThreadTest::Callback, base::Unretained(this))));
-    deferred_free_thread_->Start();
+        base::Bind(&DeferredFreeThreadTest::Callback, base::Unretained(this)),
+        worker_count));
+    ASSERT_TRUE(deferred_free_thread_->Start());
   }
 
-  void TearDown() override {
+  void StopThread() {
     deferred_free_thread_->Stop();
     deferred_free_thread_.reset();
   }
@@ -51,8 +56,8 @@ class DeferredFreeThreadTest : public testing::Test {
   }
 
   void Callback() {
-    EXPECT_EQ(deferred_free_thread_->deferred_free_thread_id(),
-              base::PlatformThread::CurrentId());
+    EXPECT_TRUE(deferred_free_thread_->IsWorkerThread(
+        base::PlatformThread::CurrentId()));
     base::AutoLock auto_lock(nb_callbacks_lock_);
     ++nb_callbacks_;
     callback_event_.Signal();
@@ -85,6 +90,29 @@ TEST_F(DeferredFreeThreadTest, CallbackSignalingTest) {
   EXPECT_EQ(3, nb_callbacks());
 }
 
+TEST_F(DeferredFreeThreadTest, MultipleWorkers) {
+  StopThread();
+  StartThread(3);
+  EXPECT_EQ(3u, deferred_free_thread()->worker_count());
+  EXPECT_FALSE(deferred_free_thread()->IsWorkerThread(
+      base::PlatformThread::CurrentId()));
+
+  // Wake up all of the workers. Asking for more than there are is fine.
+  deferred_free_thread()->SignalWork(10);
+  while (nb_callbacks() < 3)
+    WaitForCallback();
+  EXPECT_EQ(3u, nb_callbacks());
+  EXPECT_LE(1u, deferred_free_thread()->max_pending_work_count());
+  EXPECT_GE(3u, deferred_free_thread()->max_pending_work_count());
+
+  // A single worker gets woken up by default.
+  deferred_free_thread()->SignalWork();
+  while (nb_callbacks() < 4)
+    WaitForCallback();
+  EXPECT_EQ(4u, nb_callbacks());
+  EXPECT_EQ(0u, deferred_free_thread()->pending_work_count());
+}
+
 }  // namespace heap_managers
 }  // namespace asan
 }  // namespace agent
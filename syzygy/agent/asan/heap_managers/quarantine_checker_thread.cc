@@ -0,0 +1,75 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/heap_managers/quarantine_checker_thread.h"
+
+#include <algorithm>
+
+namespace agent {
+namespace asan {
+namespace heap_managers {
+
+const int QuarantineCheckerThread::kCheckIntervalMs = 100;
+
+QuarantineCheckerThread::QuarantineCheckerThread(Callback check_callback,
+                                                 size_t blocks_per_second)
+    : check_callback_(check_callback),
+      blocks_per_check_(std::max<size_t>(
+          1, blocks_per_second * kCheckIntervalMs / 1000)),
+      checked_block_count_(0),
+      stop_event_(true, false),
+      ready_event_(false, false),
+      thread_id_(0) {
+  DCHECK_LT(0u, blocks_per_second);
+}
+
+QuarantineCheckerThread::~QuarantineCheckerThread() {
+}
+
+bool QuarantineCheckerThread::Start() {
+  if (!base::PlatformThread::CreateWithPriority(
+          0, this, &thread_handle_, base::ThreadPriority::BACKGROUND)) {
+    return false;
+  }
+  ready_event_.Wait();
+  return true;
+}
+
+void QuarantineCheckerThread::Stop() {
+  stop_event_.Signal();
+  base::PlatformThread::Join(thread_handle_);
+}
+
+size_t QuarantineCheckerThread::checked_block_count() const {
+  return base::subtle::NoBarrier_Load(&checked_block_count_);
+}
+
+void QuarantineCheckerThread::ThreadMain() {
+  base::PlatformThread::SetName("SyzyASAN Quarantine Checker Thread");
+  thread_id_ = base::PlatformThread::CurrentId();
+  ready_event_.Signal();
+  const base::TimeDelta kCheckInterval =
+      base::TimeDelta::FromMilliseconds(kCheckIntervalMs);
+  while (!stop_event_.TimedWait(kCheckInterval)) {
+    size_t checked_block_count = check_callback_.Run(blocks_per_check_);
+    DCHECK_GE(blocks_per_check_, checked_block_count);
+    base::subtle::NoBarrier_AtomicIncrement(
+        &checked_block_count_,
+        static_cast<base::subtle::Atomic32>(checked_block_count));
+  }
+}
+
+}  // namespace heap_managers
+}  // namespace asan
+}  // namespace agent
@@ -0,0 +1,112 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Implementation of a background thread that incrementally checks the
+// quarantined blocks for corruption.
+
+#ifndef SYZYGY_AGENT_ASAN_HEAP_MANAGERS_QUARANTINE_CHECKER_THREAD_H_
+#define SYZYGY_AGENT_ASAN_HEAP_MANAGERS_QUARANTINE_CHECKER_THREAD_H_
+
+#include "base/atomicops.h"
+#include "base/callback.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+
+namespace agent {
+namespace asan {
+namespace heap_managers {
+
+// A low-priority background thread that periodically checks a few of the
+// quarantined blocks, so that corruptions are detected close to when they
+// happen rather than when the blocks leave the quarantine. The number of
+// blocks checked per second is bounded so that the thread doesn't compete
+// with the application for the quarantine locks.
+//
+// Note that the thread must be cleanly shutdown by calling Stop before the
+// HeapManager is cleaned up, otherwise the callback might still be running
+// after the HeapManager no longer exists.
+class QuarantineCheckerThread : public base::PlatformThread::Delegate {
+ public:
+  // The callback checks up to the given number of blocks, and returns the
+  // number of blocks that it actually checked.
+  typedef base::Callback<size_t(size_t)> Callback;
+
+  // The interval between two invocations of the callback.
+  static const int kCheckIntervalMs;
+
+  // Constructor.
+  // @param check_callback Callback that is called periodically by the thread.
+  //     This callback must be valid from the moment Start is called and until
+  //     Stop is called.
+  // @param blocks_per_second The maximum number of blocks to check per second.
+  //     Must be at least 1.
+  QuarantineCheckerThread(Callback check_callback, size_t blocks_per_second);
+
+  ~QuarantineCheckerThread() override;
+
+  // Starts the thread and waits until it signals that it's ready to work.
+  // Must be called before use. Must not be called if the thread has already
+  // been started.
+  // @returns true if successful, false if the thread failed to be launched.
+  bool Start();
+
+  // Stops the thread and waits until it exits cleanly. Must be called before
+  // the destruction of this object and before the callback is no longer valid.
+  // Must not be called if the thread has not been started previously.
+  void Stop();
+
+  // @returns the maximum number of blocks checked per invocation of the
+  //     callback.
+  size_t blocks_per_check() const { return blocks_per_check_; }
+
+  // @returns the number of blocks checked so far.
+  size_t checked_block_count() const;
+
+  // @returns the thread ID.
+  base::PlatformThreadId thread_id() const { return thread_id_; }
+
+ private:
+  // Implementation of PlatformThread::Delegate:
+  void ThreadMain() override;
+
+  // Callback to the check function, set by the constructor.
+  Callback check_callback_;
+
+  // The maximum number of blocks checked per invocation of the callback.
+  size_t blocks_per_check_;
+
+  // The number of blocks checked so far. This is accessed atomically.
+  base::subtle::Atomic32 checked_block_count_;
+
+  // Used to signal that the thread must exit.
+  base::WaitableEvent stop_event_;
+
+  // Used to signal that the background thread has spawned up and is ready to
+  // work.
+  base::WaitableEvent ready_event_;
+
+  // Handle to the thread, used to join the thread when stopping.
+  base::PlatformThreadHandle thread_handle_;
+
+  // The thread ID.
+  base::PlatformThreadId thread_id_;
+
+  DISALLOW_COPY_AND_ASSIGN(QuarantineCheckerThread);
+};
+
+}  // namespace heap_managers
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_HEAP_MANAGERS_QUARANTINE_CHECKER_THREAD_H_
@@ -0,0 +1,96 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/heap_managers/quarantine_checker_thread.h"
+
+#include <memory>
+
+#include "base/bind.h"
+#include "base/synchronization/lock.h"
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+namespace heap_managers {
+
+namespace {
+
+class QuarantineCheckerThreadTest : public testing::Test {
+ public:
+  QuarantineCheckerThreadTest()
+      : nb_callbacks_(0), max_count_(0), callback_event_(false, false) {}
+
+  size_t nb_callbacks() {
+    base::AutoLock auto_lock(lock_);
+    return nb_callbacks_;
+  }
+
+  size_t max_count() {
+    base::AutoLock auto_lock(lock_);
+    return max_count_;
+  }
+
+  // Pretends to check all of the blocks it's allowed to.
+  size_t Callback(size_t max_count) {
+    EXPECT_EQ(thread_->thread_id(), base::PlatformThread::CurrentId());
+    base::AutoLock auto_lock(lock_);
+    ++nb_callbacks_;
+    max_count_ = max_count;
+    callback_event_.Signal();
+    return max_count;
+  }
+
+  void WaitForCallback() { callback_event_.Wait(); }
+
+ protected:
+  std::unique_ptr<QuarantineCheckerThread> thread_;
+
+ private:
+  base::Lock lock_;
+  size_t nb_callbacks_;
+  size_t max_count_;
+  base::WaitableEvent callback_event_;
+};
+
+}  // namespace
+
+TEST_F(QuarantineCheckerThreadTest, CallbackIsRateLimited) {
+  thread_.reset(new QuarantineCheckerThread(
+      base::Bind(&QuarantineCheckerThreadTest::Callback,
+                 base::Unretained(this)),
+      1000));
+  EXPECT_EQ(1000u * QuarantineCheckerThread::kCheckIntervalMs / 1000,
+            thread_->blocks_per_check());
+  ASSERT_TRUE(thread_->Start());
+
+  while (nb_callbacks() < 2)
+    WaitForCallback();
+  thread_->Stop();
+
+  EXPECT_EQ(thread_->blocks_per_check(), max_count());
+  EXPECT_EQ(nb_callbacks() * thread_->blocks_per_check(),
+            thread_->checked_block_count());
+}
+
+TEST_F(QuarantineCheckerThreadTest, ChecksAtLeastOneBlock) {
+  thread_.reset(new QuarantineCheckerThread(
+      base::Bind(&QuarantineCheckerThreadTest::Callback,
+                 base::Unretained(this)),
+      1));
+  EXPECT_EQ(1u, thread_->blocks_per_check());
+}
+
+}  // namespace heap_managers
+}  // namespace asan
+}  // namespace agent
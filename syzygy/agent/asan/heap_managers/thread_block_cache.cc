@@ -0,0 +1,128 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/heap_managers/thread_block_cache.h"
+
+namespace agent {
+namespace asan {
+namespace heap_managers {
+
+ThreadBlockCache::ThreadBlockCache() : size_(0) {
+  ::memset(magazines_, 0, sizeof(magazines_));
+}
+
+ThreadBlockCache::~ThreadBlockCache() {
+  // The blocks must have been handed back to their heaps.
+  DCHECK_EQ(0u, size_);
+}
+
+// static
+bool ThreadBlockCache::IsCacheableSize(size_t block_size) {
+  return block_size > 0 && block_size <= kMaxBlockSize &&
+         (block_size % kShadowRatio) == 0;
+}
+
+bool ThreadBlockCache::Push(BlockHeapInterface* heap,
+                            const CompactBlockInfo& block) {
+  DCHECK_NE(static_cast<BlockHeapInterface*>(nullptr), heap);
+  DCHECK(IsCacheableSize(block.block_size));
+
+  base::AutoLock lock(lock_);
+  Magazine& magazine = magazines_[GetSizeClass(block.block_size)];
+  if (magazine.count == kMagazineSize)
+    return false;
+  Entry& entry = magazine.entries[magazine.count++];
+  entry.heap = heap;
+  entry.block = block;
+  ++size_;
+  return true;
+}
+
+bool ThreadBlockCache::Pop(BlockHeapInterface* heap,
+                           size_t block_size,
+                           CompactBlockInfo* block) {
+  DCHECK_NE(static_cast<BlockHeapInterface*>(nullptr), heap);
+  DCHECK_NE(static_cast<CompactBlockInfo*>(nullptr), block);
+  if (!IsCacheableSize(block_size))
+    return false;
+
+  base::AutoLock lock(lock_);
+  Magazine& magazine = magazines_[GetSizeClass(block_size)];
+
+  // Look for the most recently cached block from the given heap. This is
+  // usually the top of the magazine.
+  for (size_t i = magazine.count; i > 0; --i) {
+    if (magazine.entries[i - 1].heap != heap)
+      continue;
+    *block = magazine.entries[i - 1].block;
+    DCHECK_EQ(block_size, block->block_size);
+    // Close the gap left by the entry.
+    for (; i < magazine.count; ++i)
+      magazine.entries[i - 1] = magazine.entries[i];
+    --magazine.count;
+    --size_;
+    return true;
+  }
+
+  return false;
+}
+
+void ThreadBlockCache::EmptyHeap(BlockHeapInterface* heap,
+                                 ObjectVector* blocks) {
+  DCHECK_NE(static_cast<BlockHeapInterface*>(nullptr), heap);
+  DCHECK_NE(static_cast<ObjectVector*>(nullptr), blocks);
+
+  base::AutoLock lock(lock_);
+  for (size_t i = 0; i < kSizeClassCount; ++i) {
+    Magazine& magazine = magazines_[i];
+    size_t kept = 0;
+    for (size_t j = 0; j < magazine.count; ++j) {
+      if (magazine.entries[j].heap == heap) {
+        blocks->push_back(magazine.entries[j].block);
+        --size_;
+      } else {
+        magazine.entries[kept++] = magazine.entries[j];
+      }
+    }
+    magazine.count = kept;
+  }
+}
+
+void ThreadBlockCache::EmptyAll(EntryVector* entries) {
+  DCHECK_NE(static_cast<EntryVector*>(nullptr), entries);
+
+  base::AutoLock lock(lock_);
+  for (size_t i = 0; i < kSizeClassCount; ++i) {
+    Magazine& magazine = magazines_[i];
+    entries->insert(entries->end(), magazine.entries,
+                    magazine.entries + magazine.count);
+    magazine.count = 0;
+  }
+  size_ = 0;
+}
+
+size_t ThreadBlockCache::size() const {
+  base::AutoLock lock(lock_);
+  return size_;
+}
+
+// static
+size_t ThreadBlockCache::GetSizeClass(size_t block_size) {
+  DCHECK(IsCacheableSize(block_size));
+  return block_size / kShadowRatio - 1;
+}
+
+}  // namespace heap_managers
+}  // namespace asan
+}  // namespace agent
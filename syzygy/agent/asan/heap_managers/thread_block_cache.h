@@ -0,0 +1,123 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a small cache of freed blocks, meant to be used by a single
+// thread in front of the block heaps.
+
+#ifndef SYZYGY_AGENT_ASAN_HEAP_MANAGERS_THREAD_BLOCK_CACHE_H_
+#define SYZYGY_AGENT_ASAN_HEAP_MANAGERS_THREAD_BLOCK_CACHE_H_
+
+#include <vector>
+
+#include "base/logging.h"
+#include "base/synchronization/lock.h"
+#include "syzygy/agent/asan/block.h"
+#include "syzygy/agent/asan/constants.h"
+#include "syzygy/agent/asan/heap.h"
+
+namespace agent {
+namespace asan {
+namespace heap_managers {
+
+// A cache of blocks that have made their way through the quarantine and would
+// otherwise be returned to their heap. The blocks are grouped in magazines by
+// size class, so that an allocation of the same size from the same heap can
+// reuse one without touching the heap itself.
+//
+// Each thread that allocates owns one of these, so the lock is essentially
+// never contended. It is only taken by other threads when a heap is destroyed
+// and its blocks need to be evicted from all of the caches.
+class ThreadBlockCache {
+ public:
+  typedef std::vector<CompactBlockInfo> ObjectVector;
+
+  // A cached block and the heap that owns it.
+  struct Entry {
+    BlockHeapInterface* heap;
+    CompactBlockInfo block;
+  };
+  typedef std::vector<Entry> EntryVector;
+
+  // The largest block that will be cached.
+  static const size_t kMaxBlockSize = 512;
+
+  // The number of size classes. There is one per multiple of kShadowRatio.
+  static const size_t kSizeClassCount = kMaxBlockSize / kShadowRatio;
+
+  // The maximum number of blocks cached per size class.
+  static const size_t kMagazineSize = 8;
+
+  ThreadBlockCache();
+  ~ThreadBlockCache();
+
+  // @param block_size The size of a block.
+  // @returns true if blocks of the given size may be cached.
+  static bool IsCacheableSize(size_t block_size);
+
+  // Adds a block to the cache.
+  // @param heap The heap that owns the block.
+  // @param block The block to be cached. Its size must be cacheable.
+  // @returns true if the block was cached, false if the magazine for its size
+  //     class is full.
+  bool Push(BlockHeapInterface* heap, const CompactBlockInfo& block);
+
+  // Removes a block from the cache.
+  // @param heap The heap that must own the block.
+  // @param block_size The exact size of the block.
+  // @param block Will receive the block.
+  // @returns true if a block was found, false otherwise.
+  bool Pop(BlockHeapInterface* heap, size_t block_size,
+           CompactBlockInfo* block);
+
+  // Removes all of the blocks belonging to a given heap from the cache.
+  // @param heap The heap whose blocks are to be removed.
+  // @param blocks The removed blocks will be appended to this vector.
+  void EmptyHeap(BlockHeapInterface* heap, ObjectVector* blocks);
+
+  // Removes all of the blocks from the cache.
+  // @param entries The removed blocks and their heaps will be appended to
+  //     this vector.
+  void EmptyAll(EntryVector* entries);
+
+  // @returns the number of blocks in the cache.
+  size_t size() const;
+
+ protected:
+  // The cached blocks of a single size class, in a LIFO.
+  struct Magazine {
+    size_t count;
+    Entry entries[kMagazineSize];
+  };
+
+  // @param block_size The size of a cacheable block.
+  // @returns the index of the size class for the given block size.
+  static size_t GetSizeClass(size_t block_size);
+
+  mutable base::Lock lock_;
+
+  // The magazines of each size class. Under lock_.
+  Magazine magazines_[kSizeClassCount];
+
+  // The total number of cached blocks. Under lock_.
+  size_t size_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ThreadBlockCache);
+};
+
+}  // namespace heap_managers
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_HEAP_MANAGERS_THREAD_BLOCK_CACHE_H_
@@ -0,0 +1,133 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/heap_managers/thread_block_cache.h"
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+namespace heap_managers {
+
+namespace {
+
+// The cache never dereferences the heaps or the blocks, so fake ones do.
+BlockHeapInterface* const kHeap1 =
+    reinterpret_cast<BlockHeapInterface*>(0x1000);
+BlockHeapInterface* const kHeap2 =
+    reinterpret_cast<BlockHeapInterface*>(0x2000);
+
+CompactBlockInfo MakeBlock(uintptr_t address, uint32_t block_size) {
+  CompactBlockInfo block = {};
+  block.header = reinterpret_cast<BlockHeader*>(address);
+  block.block_size = block_size;
+  return block;
+}
+
+}  // namespace
+
+TEST(ThreadBlockCacheTest, IsCacheableSize) {
+  EXPECT_FALSE(ThreadBlockCache::IsCacheableSize(0));
+  EXPECT_TRUE(ThreadBlockCache::IsCacheableSize(kShadowRatio));
+  EXPECT_FALSE(ThreadBlockCache::IsCacheableSize(kShadowRatio + 1));
+  EXPECT_TRUE(ThreadBlockCache::IsCacheableSize(
+      ThreadBlockCache::kMaxBlockSize));
+  EXPECT_FALSE(ThreadBlockCache::IsCacheableSize(
+      ThreadBlockCache::kMaxBlockSize + kShadowRatio));
+}
+
+TEST(ThreadBlockCacheTest, PushAndPop) {
+  ThreadBlockCache cache;
+  CompactBlockInfo block = {};
+  EXPECT_FALSE(cache.Pop(kHeap1, 64, &block));
+
+  EXPECT_TRUE(cache.Push(kHeap1, MakeBlock(0x10000, 64)));
+  EXPECT_TRUE(cache.Push(kHeap1, MakeBlock(0x20000, 64)));
+  EXPECT_TRUE(cache.Push(kHeap1, MakeBlock(0x30000, 128)));
+  EXPECT_EQ(3u, cache.size());
+
+  // Only blocks of the exact size can be popped, most recent first.
+  EXPECT_FALSE(cache.Pop(kHeap1, 72, &block));
+  EXPECT_TRUE(cache.Pop(kHeap1, 64, &block));
+  EXPECT_EQ(reinterpret_cast<BlockHeader*>(0x20000), block.header);
+  EXPECT_TRUE(cache.Pop(kHeap1, 64, &block));
+  EXPECT_EQ(reinterpret_cast<BlockHeader*>(0x10000), block.header);
+  EXPECT_FALSE(cache.Pop(kHeap1, 64, &block));
+  EXPECT_TRUE(cache.Pop(kHeap1, 128, &block));
+  EXPECT_EQ(reinterpret_cast<BlockHeader*>(0x30000), block.header);
+  EXPECT_EQ(0u, cache.size());
+}
+
+TEST(ThreadBlockCacheTest, MagazineIsBounded) {
+  ThreadBlockCache cache;
+  for (size_t i = 0; i < ThreadBlockCache::kMagazineSize; ++i)
+    EXPECT_TRUE(cache.Push(kHeap1, MakeBlock(0x10000 * (i + 1), 64)));
+  EXPECT_FALSE(cache.Push(kHeap1, MakeBlock(0x1000000, 64)));
+
+  // Other size classes are unaffected.
+  EXPECT_TRUE(cache.Push(kHeap1, MakeBlock(0x1000000, 72)));
+
+  ThreadBlockCache::ObjectVector blocks;
+  cache.EmptyHeap(kHeap1, &blocks);
+  EXPECT_EQ(ThreadBlockCache::kMagazineSize + 1, blocks.size());
+}
+
+TEST(ThreadBlockCacheTest, BlocksStayWithTheirHeap) {
+  ThreadBlockCache cache;
+  EXPECT_TRUE(cache.Push(kHeap1, MakeBlock(0x10000, 64)));
+  EXPECT_TRUE(cache.Push(kHeap2, MakeBlock(0x20000, 64)));
+  EXPECT_TRUE(cache.Push(kHeap1, MakeBlock(0x30000, 64)));
+
+  // Popping from a heap skips over the blocks of other heaps.
+  CompactBlockInfo block = {};
+  EXPECT_TRUE(cache.Pop(kHeap2, 64, &block));
+  EXPECT_EQ(reinterpret_cast<BlockHeader*>(0x20000), block.header);
+  EXPECT_FALSE(cache.Pop(kHeap2, 64, &block));
+
+  EXPECT_TRUE(cache.Push(kHeap2, MakeBlock(0x40000, 64)));
+  ThreadBlockCache::ObjectVector blocks;
+  cache.EmptyHeap(kHeap1, &blocks);
+  ASSERT_EQ(2u, blocks.size());
+  EXPECT_EQ(reinterpret_cast<BlockHeader*>(0x10000), blocks[0].header);
+  EXPECT_EQ(reinterpret_cast<BlockHeader*>(0x30000), blocks[1].header);
+  EXPECT_EQ(1u, cache.size());
+
+  blocks.clear();
+  cache.EmptyHeap(kHeap2, &blocks);
+  ASSERT_EQ(1u, blocks.size());
+  EXPECT_EQ(reinterpret_cast<BlockHeader*>(0x40000), blocks[0].header);
+  EXPECT_EQ(0u, cache.size());
+}
+
+TEST(ThreadBlockCacheTest, EmptyAll) {
+  ThreadBlockCache cache;
+  EXPECT_TRUE(cache.Push(kHeap1, MakeBlock(0x10000, 64)));
+  EXPECT_TRUE(cache.Push(kHeap2, MakeBlock(0x20000, 128)));
+
+  ThreadBlockCache::EntryVector entries;
+  cache.EmptyAll(&entries);
+  ASSERT_EQ(2u, entries.size());
+  EXPECT_EQ(kHeap1, entries[0].heap);
+  EXPECT_EQ(reinterpret_cast<BlockHeader*>(0x10000), entries[0].block.header);
+  EXPECT_EQ(kHeap2, entries[1].heap);
+  EXPECT_EQ(reinterpret_cast<BlockHeader*>(0x20000), entries[1].block.header);
+  EXPECT_EQ(0u, cache.size());
+
+  CompactBlockInfo block = {};
+  EXPECT_FALSE(cache.Pop(kHeap1, 64, &block));
+}
+
+}  // namespace heap_managers
+}  // namespace asan
+}  // namespace agent
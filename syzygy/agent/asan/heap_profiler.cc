@@ -0,0 +1,111 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/heap_profiler.h"
+
+#include <algorithm>
+
+#include "base/bits.h"
+#include "base/strings/stringprintf.h"
+#include "syzygy/agent/asan/logger.h"
+#include "syzygy/agent/asan/stack_capture_cache.h"
+
+namespace agent {
+namespace asan {
+
+HeapProfiler::HeapProfiler(StackCaptureCache* stack_cache,
+                           uint32_t sampling_interval)
+    : stack_cache_(stack_cache),
+      sampling_interval_(sampling_interval),
+      total_bytes_(0) {
+  DCHECK_NE(static_cast<StackCaptureCache*>(nullptr), stack_cache);
+  DCHECK_LT(0u, sampling_interval);
+  ::memset(histogram_, 0, sizeof(histogram_));
+}
+
+void HeapProfiler::RecordAllocation(uint32_t bytes,
+                                    const common::StackCapture& stack) {
+  base::subtle::NoBarrier_AtomicIncrement(
+      &histogram_[GetHistogramBucket(bytes)], 1);
+
+  // The allocation is sampled once for every multiple of the sampling
+  // interval that the total crosses. As every thread sees a disjoint range
+  // of the total this is exact, even with concurrent allocations.
+  uint64_t old_total = static_cast<uint64_t>(
+      ::InterlockedExchangeAdd64(&total_bytes_, bytes));
+  uint64_t new_total = old_total + bytes;
+  uint64_t sample_count =
+      new_total / sampling_interval_ - old_total / sampling_interval_;
+  if (sample_count == 0)
+    return;
+
+  stack_cache_->AddHeapProfileSample(stack, sample_count * sampling_interval_);
+}
+
+void HeapProfiler::Log(AsanLogger* logger) const {
+  DCHECK_NE(static_cast<AsanLogger*>(nullptr), logger);
+
+  StackCaptureCache::HeapProfile profile;
+  stack_cache_->GetHeapProfile(&profile);
+
+  logger->Write(base::StringPrintf(
+      "PID=%d; Heap profile: sampling interval=%u bytes; "
+      "total allocated=%llu bytes; stacks=%d",
+      ::GetCurrentProcessId(), sampling_interval_, total_bytes(),
+      profile.size()));
+
+  // Log the non-empty buckets of the histogram, each on its own line.
+  for (size_t i = 0; i < kHistogramBucketCount; ++i) {
+    uint32_t count = GetHistogramCount(i);
+    if (count == 0)
+      continue;
+    uint64_t lower = i == 0 ? 0 : 1ULL << (i - 1);
+    uint64_t upper = 1ULL << i;
+    logger->Write(base::StringPrintf(
+        "Allocation sizes [%llu, %llu): %u", lower, upper, count));
+  }
+
+  // Log the heaviest stacks, along with their frames.
+  size_t stack_count = std::min(profile.size(), kMaxLoggedStackCount);
+  for (size_t i = 0; i < stack_count; ++i) {
+    const StackCaptureCache::HeapProfileEntry& entry = profile[i];
+    void* frames[common::StackCapture::kMaxNumFrames] = {};
+    size_t num_frames = stack_cache_->GetStackFrames(
+        entry.stack_capture, frames, arraysize(frames));
+
+    std::string message = base::StringPrintf(
+        "Heap profile stack %u: samples=%d; bytes=%llu; frames=",
+        entry.stack_capture->relative_stack_id(), entry.sample_count,
+        entry.bytes);
+    for (size_t j = 0; j < num_frames; ++j)
+      base::StringAppendF(&message, "%s%p", j == 0 ? "" : " ", frames[j]);
+    logger->Write(message);
+  }
+}
+
+// static
+size_t HeapProfiler::GetHistogramBucket(uint32_t bytes) {
+  if (bytes == 0)
+    return 0;
+  return base::bits::Log2Floor(bytes) + 1;
+}
+
+uint32_t HeapProfiler::GetHistogramCount(size_t bucket) const {
+  DCHECK_GT(kHistogramBucketCount, bucket);
+  return static_cast<uint32_t>(
+      base::subtle::NoBarrier_Load(&histogram_[bucket]));
+}
+
+}  // namespace asan
+}  // namespace agent
@@ -0,0 +1,100 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares HeapProfiler, a sampling heap profiler. An allocation is sampled
+// every time the total number of bytes allocated crosses a multiple of the
+// sampling interval, so an allocation is sampled with a probability that is
+// proportional to its size. Each sample stands for a sampling interval's
+// worth of bytes, and the samples are aggregated per allocation stack in the
+// StackCaptureCache. A histogram of the sizes of all the allocations is also
+// maintained.
+
+#ifndef SYZYGY_AGENT_ASAN_HEAP_PROFILER_H_
+#define SYZYGY_AGENT_ASAN_HEAP_PROFILER_H_
+
+#include <windows.h>
+
+#include "base/atomicops.h"
+#include "base/logging.h"
+#include "syzygy/agent/common/stack_capture.h"
+
+namespace agent {
+namespace asan {
+
+// Forward declarations.
+class AsanLogger;
+class StackCaptureCache;
+
+// The sampling heap profiler. This is thread safe.
+class HeapProfiler {
+ public:
+  // The number of buckets of the allocation size histogram. Bucket 0 counts
+  // the empty allocations, and bucket i > 0 counts the allocations whose size
+  // is in [2^(i - 1), 2^i).
+  static const size_t kHistogramBucketCount = 33;
+
+  // The maximum number of stacks that are logged by Log.
+  static const size_t kMaxLoggedStackCount = 256;
+
+  // Constructor.
+  // @param stack_cache The stack cache in which the samples are recorded.
+  // @param sampling_interval The average number of bytes between two
+  //     samples. Must be greater than zero.
+  HeapProfiler(StackCaptureCache* stack_cache, uint32_t sampling_interval);
+
+  // Records an allocation.
+  // @param bytes The size of the allocation.
+  // @param stack The stack of the allocation.
+  void RecordAllocation(uint32_t bytes, const common::StackCapture& stack);
+
+  // Writes the histogram and the heap profile to a logger.
+  // @param logger The logger to use.
+  void Log(AsanLogger* logger) const;
+
+  // @returns the histogram bucket that counts allocations of the given size.
+  static size_t GetHistogramBucket(uint32_t bytes);
+
+  // @returns the number of allocations counted in a histogram bucket.
+  uint32_t GetHistogramCount(size_t bucket) const;
+
+  // @returns the total number of bytes allocated.
+  uint64_t total_bytes() const {
+    return static_cast<uint64_t>(total_bytes_);
+  }
+
+  // @returns the sampling interval.
+  uint32_t sampling_interval() const { return sampling_interval_; }
+
+ protected:
+  // The stack cache in which the samples are recorded.
+  StackCaptureCache* stack_cache_;
+
+  // The sampling interval, in bytes.
+  const uint32_t sampling_interval_;
+
+  // The total number of bytes allocated. This is only modified with
+  // interlocked operations.
+  volatile LONGLONG total_bytes_;
+
+  // The allocation size histogram. These are accessed atomically.
+  base::subtle::Atomic32 histogram_[kHistogramBucketCount];
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(HeapProfiler);
+};
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_HEAP_PROFILER_H_
@@ -0,0 +1,99 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/heap_profiler.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/agent/asan/logger.h"
+#include "syzygy/agent/asan/stack_capture_cache.h"
+#include "syzygy/agent/asan/memory_notifiers/null_memory_notifier.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+using agent::common::StackCapture;
+
+class HeapProfilerTest : public testing::Test {
+ public:
+  HeapProfilerTest() : stack_cache_(&logger_, &null_memory_notifier_) {
+  }
+
+  void SetUp() override {
+    StackCapture::Init();
+    StackCaptureCache::Init();
+  }
+
+ protected:
+  AsanLogger logger_;
+  memory_notifiers::NullMemoryNotifier null_memory_notifier_;
+  StackCaptureCache stack_cache_;
+};
+
+}  // namespace
+
+TEST_F(HeapProfilerTest, GetHistogramBucket) {
+  EXPECT_EQ(0u, HeapProfiler::GetHistogramBucket(0));
+  EXPECT_EQ(1u, HeapProfiler::GetHistogramBucket(1));
+  EXPECT_EQ(2u, HeapProfiler::GetHistogramBucket(2));
+  EXPECT_EQ(2u, HeapProfiler::GetHistogramBucket(3));
+  EXPECT_EQ(3u, HeapProfiler::GetHistogramBucket(4));
+  EXPECT_EQ(11u, HeapProfiler::GetHistogramBucket(1024));
+  EXPECT_EQ(HeapProfiler::kHistogramBucketCount - 1,
+            HeapProfiler::GetHistogramBucket(0xFFFFFFFF));
+}
+
+TEST_F(HeapProfilerTest, RecordAllocation) {
+  HeapProfiler profiler(&stack_cache_, 1000);
+  EXPECT_EQ(1000u, profiler.sampling_interval());
+
+  StackCapture stack1;
+  stack1.InitFromStack();
+  StackCapture stack2;
+  stack2.InitFromStack();
+
+  // None of these cross the sampling interval.
+  for (size_t i = 0; i < 9; ++i)
+    profiler.RecordAllocation(100, stack1);
+  StackCaptureCache::HeapProfile profile;
+  stack_cache_.GetHeapProfile(&profile);
+  EXPECT_TRUE(profile.empty());
+  EXPECT_EQ(9u, profiler.GetHistogramCount(7));
+
+  // This crosses the interval once, and the next allocation crosses it
+  // three times.
+  profiler.RecordAllocation(100, stack1);
+  profiler.RecordAllocation(3000, stack2);
+  EXPECT_EQ(4000u, profiler.total_bytes());
+  EXPECT_EQ(10u, profiler.GetHistogramCount(7));
+  EXPECT_EQ(1u, profiler.GetHistogramCount(12));
+
+  stack_cache_.GetHeapProfile(&profile);
+  ASSERT_EQ(2u, profile.size());
+  EXPECT_EQ(stack2.absolute_stack_id(),
+            profile[0].stack_capture->absolute_stack_id());
+  EXPECT_EQ(1u, profile[0].sample_count);
+  EXPECT_EQ(3000u, profile[0].bytes);
+  EXPECT_EQ(stack1.absolute_stack_id(),
+            profile[1].stack_capture->absolute_stack_id());
+  EXPECT_EQ(1u, profile[1].sample_count);
+  EXPECT_EQ(1000u, profile[1].bytes);
+
+  // Logging without a bound logger shouldn't crash.
+  profiler.Log(&logger_);
+}
+
+}  // namespace asan
+}  // namespace agent
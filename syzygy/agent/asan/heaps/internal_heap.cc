@@ -31,17 +31,88 @@ struct InternalHeapEntry {
 
 const size_t kBodyOffset = offsetof(InternalHeapEntry, body);
 
+// An entry of a span that is on the free list of a thread cache. This
+// overlays an InternalHeapEntry.
+struct FreeSpanEntry {
+  uint32_t size;
+  FreeSpanEntry* next;
+};
+
+// The header of a span. Its entries follow it.
+struct SpanHeader {
+  SpanHeader* next;
+};
+
+// These flags are set in the size of the entries carved from a span.
+const uint32_t kSpanEntryFlag = 0x80000000;
+const uint32_t kFreeSpanEntryFlag = 0x40000000;
+const uint32_t kSizeMask = ~(kSpanEntryFlag | kFreeSpanEntryFlag);
+
+// The size classes of the thread caches are the powers of two from
+// kMinSizeClass to InternalHeap::kMaxCachedSize.
+const uint32_t kMinSizeClass = 16;
+const size_t kSizeClassCount = 5;
+
+size_t GetSizeClass(uint32_t size) {
+  size_t size_class = 0;
+  while ((kMinSizeClass << size_class) < size)
+    ++size_class;
+  DCHECK_GT(kSizeClassCount, size_class);
+  return size_class;
+}
+
 }  // namespace
 
+// The free lists and the spans of a thread. The cache is only used by its
+// thread, except when the heap is destroyed.
+struct InternalHeap::ThreadCache {
+  ThreadCache* next;  // Under thread_caches_lock_.
+  SpanHeader* spans;
+  FreeSpanEntry* free_lists[kSizeClassCount];
+};
+
 InternalHeap::InternalHeap(MemoryNotifierInterface* memory_notifier,
                            HeapInterface* heap)
-    : memory_notifier_(memory_notifier), heap_(heap) {
+    : memory_notifier_(memory_notifier),
+      heap_(heap),
+      thread_cache_tls_(TLS_OUT_OF_INDEXES),
+      thread_caches_(nullptr) {
   DCHECK_NE(static_cast<MemoryNotifierInterface*>(NULL), memory_notifier);
   DCHECK_NE(static_cast<HeapInterface*>(NULL), heap);
+  static_assert(kMinSizeClass << (kSizeClassCount - 1) == kMaxCachedSize,
+                "The size classes must end at kMaxCachedSize.");
   notifying_heap_ =
       heap_->GetHeapFeatures() & HeapInterface::kHeapReportsReservations;
 }
 
+InternalHeap::~InternalHeap() {
+  if (!thread_caches_enabled())
+    return;
+
+  base::AutoLock lock(thread_caches_lock_);
+  while (thread_caches_ != nullptr) {
+    ThreadCache* cache = thread_caches_;
+    thread_caches_ = cache->next;
+    while (cache->spans != nullptr) {
+      SpanHeader* span = cache->spans;
+      cache->spans = span->next;
+      FreeToHeap(span, kSpanSize);
+    }
+    InternalHeapEntry* entry = reinterpret_cast<InternalHeapEntry*>(
+        reinterpret_cast<uint8_t*>(cache) - kBodyOffset);
+    FreeToHeap(entry, entry->size);
+  }
+  ::TlsFree(thread_cache_tls_);
+  thread_cache_tls_ = TLS_OUT_OF_INDEXES;
+}
+
+bool InternalHeap::EnableThreadCaches() {
+  if (thread_caches_enabled())
+    return true;
+  thread_cache_tls_ = ::TlsAlloc();
+  return thread_caches_enabled();
+}
+
 HeapType InternalHeap::GetHeapType() const {
   return heap_->GetHeapType();
 }
@@ -55,14 +126,27 @@ uint32_t InternalHeap::GetHeapFeatures() const {
 void* InternalHeap::Allocate(uint32_t bytes) {
   uint32_t size = static_cast<uint32_t>(
       ::common::AlignUp(bytes + kBodyOffset, kShadowRatio));
-  void* alloc = heap_->Allocate(size);
-  if (alloc == NULL)
-    return NULL;
 
-  InternalHeapEntry* entry = reinterpret_cast<InternalHeapEntry*>(alloc);
-  entry->size = size;
-  memory_notifier_->NotifyInternalUse(entry, size);
+  // Small allocations are popped from the free lists of the thread, which
+  // are in spans that are already notified.
+  if (thread_caches_enabled() && size <= kMaxCachedSize) {
+    ThreadCache* cache = GetThreadCache();
+    size_t size_class = GetSizeClass(size);
+    if (cache != nullptr && (cache->free_lists[size_class] != nullptr ||
+                             CarveSpan(cache, size_class))) {
+      FreeSpanEntry* free_entry = cache->free_lists[size_class];
+      cache->free_lists[size_class] = free_entry->next;
+      InternalHeapEntry* entry =
+          reinterpret_cast<InternalHeapEntry*>(free_entry);
+      entry->size = (kMinSizeClass << size_class) | kSpanEntryFlag;
+      return entry->body;
+    }
+  }
 
+  InternalHeapEntry* entry =
+      reinterpret_cast<InternalHeapEntry*>(AllocateFromHeap(size));
+  if (entry == NULL)
+    return NULL;
   return entry->body;
 }
 
@@ -71,18 +155,25 @@ bool InternalHeap::Free(void* alloc) {
     uint8_t* bytes = reinterpret_cast<uint8_t*>(alloc);
     InternalHeapEntry* entry = reinterpret_cast<InternalHeapEntry*>(
         bytes - kBodyOffset);
-    if (notifying_heap_) {
-      // A notifying heap redzones the memory from which allocations are made.
-      // We return the redzone to its initial state.
-      memory_notifier_->NotifyFutureHeapUse(entry, entry->size);
-    } else {
-      // A non-notifying heap serves memory from greenzoned pages, so indicate
-      // the memory has returned to the OS.
-      memory_notifier_->NotifyReturnedToOS(entry, entry->size);
+
+    if ((entry->size & kSpanEntryFlag) != 0) {
+      DCHECK_EQ(0u, entry->size & kFreeSpanEntryFlag);
+      entry->size |= kFreeSpanEntryFlag;
+
+      // The entry goes to the cache of the freeing thread. If that cache
+      // can't be created the entry isn't reused, but it's still retired
+      // along with its span.
+      ThreadCache* cache = GetThreadCache();
+      if (cache != nullptr) {
+        size_t size_class = GetSizeClass(entry->size & kSizeMask);
+        FreeSpanEntry* free_entry = reinterpret_cast<FreeSpanEntry*>(entry);
+        free_entry->next = cache->free_lists[size_class];
+        cache->free_lists[size_class] = free_entry;
+      }
+      return true;
     }
 
-    // Adjust the allocation pointer to that of the wrapped heap.
-    alloc = entry;
+    return FreeToHeap(entry, entry->size);
   }
 
   return heap_->Free(alloc);
@@ -92,6 +183,10 @@ bool InternalHeap::IsAllocated(const void* alloc) {
   if (alloc != NULL) {
     const uint32_t* header = reinterpret_cast<const uint32_t*>(alloc) - 1;
     alloc = header;
+
+    // The header is only read once it's known to be in a span.
+    if (thread_caches_enabled() && IsInSpan(header))
+      return (*header & kFreeSpanEntryFlag) == 0;
   }
   return heap_->IsAllocated(alloc);
 }
@@ -103,7 +198,7 @@ uint32_t InternalHeap::GetAllocationSize(const void* alloc) {
   const uint8_t* bytes = reinterpret_cast<const uint8_t*>(alloc);
   const InternalHeapEntry* entry =
       reinterpret_cast<const InternalHeapEntry*>(bytes - kBodyOffset);
-  return entry->size;
+  return entry->size & kSizeMask;
 }
 
 void InternalHeap::Lock() {
@@ -118,6 +213,101 @@ bool InternalHeap::TryLock() {
   return heap_->TryLock();
 }
 
+void* InternalHeap::AllocateFromHeap(uint32_t size) {
+  void* alloc = heap_->Allocate(size);
+  if (alloc == NULL)
+    return NULL;
+
+  InternalHeapEntry* entry = reinterpret_cast<InternalHeapEntry*>(alloc);
+  entry->size = size;
+  memory_notifier_->NotifyInternalUse(entry, size);
+
+  return entry;
+}
+
+bool InternalHeap::FreeToHeap(void* alloc, uint32_t size) {
+  DCHECK_NE(static_cast<void*>(NULL), alloc);
+  if (notifying_heap_) {
+    // A notifying heap redzones the memory from which allocations are made.
+    // We return the redzone to its initial state.
+    memory_notifier_->NotifyFutureHeapUse(alloc, size);
+  } else {
+    // A non-notifying heap serves memory from greenzoned pages, so indicate
+    // the memory has returned to the OS.
+    memory_notifier_->NotifyReturnedToOS(alloc, size);
+  }
+  return heap_->Free(alloc);
+}
+
+InternalHeap::ThreadCache* InternalHeap::GetThreadCache() {
+  DCHECK(thread_caches_enabled());
+  ThreadCache* cache =
+      reinterpret_cast<ThreadCache*>(::TlsGetValue(thread_cache_tls_));
+  if (cache != nullptr)
+    return cache;
+
+  // The cache itself is a regular allocation of the wrapped heap, so that it
+  // doesn't depend on a span.
+  uint32_t size = static_cast<uint32_t>(
+      ::common::AlignUp(sizeof(ThreadCache) + kBodyOffset, kShadowRatio));
+  InternalHeapEntry* entry =
+      reinterpret_cast<InternalHeapEntry*>(AllocateFromHeap(size));
+  if (entry == nullptr)
+    return nullptr;
+  cache = reinterpret_cast<ThreadCache*>(entry->body);
+  ::memset(cache, 0, sizeof(*cache));
+  {
+    base::AutoLock lock(thread_caches_lock_);
+    cache->next = thread_caches_;
+    thread_caches_ = cache;
+  }
+  ::TlsSetValue(thread_cache_tls_, cache);
+  return cache;
+}
+
+bool InternalHeap::CarveSpan(ThreadCache* cache, size_t size_class) {
+  DCHECK_NE(static_cast<ThreadCache*>(nullptr), cache);
+  DCHECK_GT(kSizeClassCount, size_class);
+  DCHECK_EQ(static_cast<FreeSpanEntry*>(nullptr),
+            cache->free_lists[size_class]);
+
+  // The whole span is notified at once. Its entries are then handed out
+  // without any further notification.
+  uint8_t* span = reinterpret_cast<uint8_t*>(heap_->Allocate(kSpanSize));
+  if (span == nullptr)
+    return false;
+  memory_notifier_->NotifyInternalUse(span, kSpanSize);
+
+  SpanHeader* header = reinterpret_cast<SpanHeader*>(span);
+  header->next = cache->spans;
+  cache->spans = header;
+
+  // The entries keep the kShadowRatio alignment of the span.
+  uint32_t entry_size = kMinSizeClass << size_class;
+  size_t offset = ::common::AlignUp(sizeof(SpanHeader), kShadowRatio);
+  for (; offset + entry_size <= kSpanSize; offset += entry_size) {
+    FreeSpanEntry* entry = reinterpret_cast<FreeSpanEntry*>(span + offset);
+    entry->size = entry_size | kSpanEntryFlag | kFreeSpanEntryFlag;
+    entry->next = cache->free_lists[size_class];
+    cache->free_lists[size_class] = entry;
+  }
+  return true;
+}
+
+bool InternalHeap::IsInSpan(const void* header) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(header);
+  base::AutoLock lock(thread_caches_lock_);
+  for (ThreadCache* cache = thread_caches_; cache != nullptr;
+       cache = cache->next) {
+    for (SpanHeader* span = cache->spans; span != nullptr; span = span->next) {
+      const uint8_t* begin = reinterpret_cast<const uint8_t*>(span);
+      if (bytes >= begin && bytes < begin + kSpanSize)
+        return true;
+    }
+  }
+  return false;
+}
+
 }  // namespace heaps
 }  // namespace asan
 }  // namespace agent
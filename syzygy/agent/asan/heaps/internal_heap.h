@@ -14,11 +14,20 @@
 //
 // Defines InternalHeap, a simple wrapper of any other HeapInterface that
 // adds internal-use notifications via a MemoryNotifierInterface.
+//
+// The small allocations can optionally be served from per-thread caches of
+// spans. A span is notified as being for internal use once, when it's
+// created, and is carved into entries of a single size class. The entries
+// then get allocated and freed without taking any lock and without notifying
+// the shadow memory. The spans are only retired when the heap is destroyed.
 
 #ifndef SYZYGY_AGENT_ASAN_HEAPS_INTERNAL_HEAP_H_
 #define SYZYGY_AGENT_ASAN_HEAPS_INTERNAL_HEAP_H_
 
+#include <windows.h>
+
 #include "base/logging.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/agent/asan/heap.h"
 #include "syzygy/agent/asan/memory_notifier.h"
 
@@ -43,8 +52,20 @@ class InternalHeap : public HeapInterface {
   InternalHeap(MemoryNotifierInterface* memory_notifier,
                HeapInterface* heap);
 
-  // Destructor.
-  virtual ~InternalHeap() { }
+  // Destructor. This retires the spans of the thread caches, which must no
+  // longer be in use.
+  virtual ~InternalHeap();
+
+  // Enables the per-thread caches for the small allocations. This must be
+  // called before the heap is shared between threads.
+  // @returns true on success, false if no TLS slot is available.
+  bool EnableThreadCaches();
+
+  // @returns true if the small allocations are served from per-thread
+  //     caches.
+  bool thread_caches_enabled() const {
+    return thread_cache_tls_ != TLS_OUT_OF_INDEXES;
+  }
 
   // @name HeapInterface functions.
   // @{
@@ -54,12 +75,45 @@ class InternalHeap : public HeapInterface {
   virtual bool Free(void* alloc);
   virtual bool IsAllocated(const void* alloc);
   virtual uint32_t GetAllocationSize(const void* alloc);
+  // @note The allocations served from a thread cache don't take the lock.
   virtual void Lock();
   virtual void Unlock();
   virtual bool TryLock();
   // @}
 
+  // The size of the spans carved by the thread caches, and the largest
+  // allocation they serve. This includes the header of each allocation.
+  static const uint32_t kSpanSize = 4096;
+  static const uint32_t kMaxCachedSize = 256;
+
  protected:
+  struct ThreadCache;
+
+  // Allocates directly from the wrapped heap, and notifies the allocation.
+  // @param size The size of the allocation, including its header.
+  // @returns the header of the allocation, or nullptr on failure.
+  void* AllocateFromHeap(uint32_t size);
+
+  // Notifies that some memory is no longer in internal use, and frees it to
+  // the wrapped heap.
+  // @param alloc The allocation returned by the wrapped heap.
+  // @param size The size of the allocation.
+  // @returns the result of the wrapped heap.
+  bool FreeToHeap(void* alloc, uint32_t size);
+
+  // @returns the cache of the calling thread, creating it if need be. Returns
+  //     nullptr if the cache can't be created.
+  ThreadCache* GetThreadCache();
+
+  // Carves a new span into free entries of a size class.
+  // @param cache The cache that will own the span.
+  // @param size_class The index of the size class.
+  // @returns true on success, false otherwise.
+  bool CarveSpan(ThreadCache* cache, size_t size_class);
+
+  // @returns true if @p header lies in one of the spans of the thread caches.
+  bool IsInSpan(const void* header);
+
   // The interface that will be notified of all memory use. Has its own
   // locking.
   MemoryNotifierInterface* memory_notifier_;
@@ -70,6 +124,15 @@ class InternalHeap : public HeapInterface {
   // This is true if the wrapped heap is a notifying heap.
   bool notifying_heap_;
 
+  // The TLS slot of the thread caches, or TLS_OUT_OF_INDEXES if they're
+  // disabled.
+  DWORD thread_cache_tls_;
+
+  // The list of all the thread caches, which outlive their threads so that
+  // their spans can be retired with the heap.
+  base::Lock thread_caches_lock_;
+  ThreadCache* thread_caches_;  // Under thread_caches_lock_.
+
  private:
   DISALLOW_COPY_AND_ASSIGN(InternalHeap);
 };
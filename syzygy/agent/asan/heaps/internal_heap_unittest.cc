@@ -14,6 +14,8 @@
 
 #include "syzygy/agent/asan/heaps/internal_heap.h"
 
+#include <vector>
+
 #include "gtest/gtest.h"
 #include "syzygy/agent/asan/unittest_util.h"
 #include "syzygy/agent/asan/heaps/large_block_heap.h"
@@ -26,6 +28,7 @@ namespace heaps {
 namespace {
 
 using testing::_;
+using testing::Ne;
 using testing::Return;
 
 }  // namespace
@@ -114,6 +117,61 @@ TEST(InternalHeapTest, HeaderIsAllocated) {
   EXPECT_TRUE(h.Free(alloc));
 }
 
+TEST(InternalHeapTest, ThreadCachesNotifySpans) {
+  testing::MockMemoryNotifier mock_notifier;
+  WinHeap win_heap;
+
+  {
+    InternalHeap h(&mock_notifier, &win_heap);
+    ASSERT_TRUE(h.EnableThreadCaches());
+    EXPECT_TRUE(h.thread_caches_enabled());
+
+    // The first allocation creates the cache of the thread and a span. The
+    // following ones are carved from that span without notification.
+    EXPECT_CALL(mock_notifier, NotifyInternalUse(_, InternalHeap::kSpanSize))
+        .Times(1);
+    EXPECT_CALL(mock_notifier,
+                NotifyInternalUse(_, Ne(InternalHeap::kSpanSize))).Times(1);
+    std::vector<void*> allocs;
+    for (size_t i = 0; i < 10; ++i) {
+      void* alloc = h.Allocate(8);
+      ASSERT_TRUE(alloc != NULL);
+      EXPECT_TRUE(h.IsAllocated(alloc));
+      EXPECT_EQ(16u, h.GetAllocationSize(alloc));
+      allocs.push_back(alloc);
+    }
+    testing::Mock::VerifyAndClearExpectations(&mock_notifier);
+
+    // Freeing the entries doesn't notify either, and they get reused.
+    EXPECT_TRUE(h.Free(allocs.back()));
+    EXPECT_FALSE(h.IsAllocated(allocs.back()));
+    EXPECT_EQ(allocs.back(), h.Allocate(8));
+    for (void* alloc : allocs)
+      EXPECT_TRUE(h.Free(alloc));
+
+    // The span and the cache are retired with the heap.
+    EXPECT_CALL(mock_notifier, NotifyReturnedToOS(_, InternalHeap::kSpanSize))
+        .Times(1);
+    EXPECT_CALL(mock_notifier,
+                NotifyReturnedToOS(_, Ne(InternalHeap::kSpanSize))).Times(1);
+  }
+}
+
+TEST(InternalHeapTest, ThreadCachesSkipLargeAllocations) {
+  testing::MockMemoryNotifier mock_notifier;
+  WinHeap win_heap;
+  InternalHeap h(&mock_notifier, &win_heap);
+  ASSERT_TRUE(h.EnableThreadCaches());
+
+  // Allocations larger than the size classes go to the wrapped heap.
+  EXPECT_CALL(mock_notifier, NotifyInternalUse(_, 264)).Times(1);
+  EXPECT_CALL(mock_notifier, NotifyReturnedToOS(_, 264)).Times(1);
+  void* alloc = h.Allocate(InternalHeap::kMaxCachedSize);
+  ASSERT_TRUE(alloc != NULL);
+  EXPECT_EQ(264u, h.GetAllocationSize(alloc));
+  EXPECT_TRUE(h.Free(alloc));
+}
+
 TEST(InternalHeapTest, Lock) {
   memory_notifiers::NullMemoryNotifier mock_notifier;
   testing::DummyHeap heap;
@@ -27,9 +27,32 @@ namespace agent {
 namespace asan {
 namespace heaps {
 
+namespace {
+
+// Returns the size of the reservation backing an allocation of |bytes|.
+size_t GetReservationSize(size_t bytes) {
+  // Always allocate some memory so as to guarantee that zero-sized
+  // allocations get an actual distinct address each time.
+  size_t size = std::max<size_t>(bytes, 1u);
+
+  // TODO(chrisha): Make this allocate with the OS allocation granularity.
+  return ::common::AlignUp(size, GetPageSize());
+}
+
+}  // namespace
+
+// The image decoding buffers that motivated the pooling are between 64 and
+// 512KB, keep some margin over that.
+const size_t LargeBlockHeap::kMaxPooledReservationSize = 1024 * 1024;
+const size_t LargeBlockHeap::kMaxPooledBytes = 64 * 1024 * 1024;
+
 LargeBlockHeap::LargeBlockHeap(MemoryNotifierInterface* memory_notifier,
                                HeapInterface* internal_heap)
     : allocs_(HeapAllocator<void*>(internal_heap)),
+      pool_(std::less<size_t>(),
+            HeapAllocator<std::pair<const size_t, void*>>(internal_heap)),
+      pooled_bytes_(0),
+      pooling_enabled_(false),
       memory_notifier_(memory_notifier) {
   DCHECK_NE(static_cast<MemoryNotifierInterface*>(nullptr), memory_notifier);
 }
@@ -42,6 +65,7 @@ LargeBlockHeap::~LargeBlockHeap() {
   // it means that there's a memory leak), but it's not always the case in
   // Chrome so we need to release all the resources that we've acquired.
   FreeAllAllocations();
+  ReleasePool();
 
   CHECK(allocs_.empty());
 }
@@ -56,13 +80,12 @@ uint32_t LargeBlockHeap::GetHeapFeatures() const {
 }
 
 void* LargeBlockHeap::Allocate(uint32_t bytes) {
-  // Always allocate some memory so as to guarantee that zero-sized
-  // allocations get an actual distinct address each time.
-  size_t size = std::max<size_t>(bytes, 1u);
-
-  // TODO(chrisha): Make this allocate with the OS allocation granularity.
-  size = ::common::AlignUp(size, GetPageSize());
-  void* alloc = ::VirtualAlloc(NULL, size, MEM_COMMIT, PAGE_READWRITE);
+  size_t size = GetReservationSize(bytes);
+  void* alloc = nullptr;
+  if (pooling_enabled_)
+    alloc = AllocateFromPool(size);
+  if (alloc == nullptr)
+    alloc = ::VirtualAlloc(NULL, size, MEM_COMMIT, PAGE_READWRITE);
   Allocation allocation = { alloc, bytes };
 
   if (alloc != NULL) {
@@ -92,7 +115,12 @@ bool LargeBlockHeap::Free(void* alloc) {
 
   // Notify the OS that this memory has been returned.
   memory_notifier_->NotifyReturnedToOS(alloc, size);
-  ::VirtualFree(alloc, 0, MEM_RELEASE);
+  size_t reservation_size = GetReservationSize(size);
+  if (pooling_enabled_ && reservation_size <= kMaxPooledReservationSize) {
+    ReturnToPool(alloc, reservation_size);
+  } else {
+    ::VirtualFree(alloc, 0, MEM_RELEASE);
+  }
   return true;
 }
 
@@ -155,6 +183,22 @@ bool LargeBlockHeap::FreeBlock(const BlockInfo& block_info) {
   return Free(block_info.header);
 }
 
+void LargeBlockHeap::set_pooling_enabled(bool pooling_enabled) {
+  pooling_enabled_ = pooling_enabled;
+  if (!pooling_enabled)
+    ReleasePool();
+}
+
+size_t LargeBlockHeap::pooled_reservation_count() {
+  ::common::AutoRecursiveLock lock(lock_);
+  return pool_.size();
+}
+
+size_t LargeBlockHeap::pooled_bytes() {
+  ::common::AutoRecursiveLock lock(lock_);
+  return pooled_bytes_;
+}
+
 void LargeBlockHeap::FreeAllAllocations() {
   // Start by copying the blocks into a temporary vector as the call to |Free|
   // will remove them from |allocs_|.
@@ -164,6 +208,61 @@ void LargeBlockHeap::FreeAllAllocations() {
     CHECK(Free(const_cast<void*>(alloc.address)));
 }
 
+void* LargeBlockHeap::AllocateFromPool(size_t size) {
+  DCHECK_EQ(0u, size % GetPageSize());
+
+  void* reservation = nullptr;
+  {
+    ::common::AutoRecursiveLock lock(lock_);
+    ReservationPool::iterator it = pool_.find(size);
+    if (it == pool_.end())
+      return nullptr;
+    reservation = it->second;
+    pool_.erase(it);
+    DCHECK_LE(size, pooled_bytes_);
+    pooled_bytes_ -= size;
+  }
+
+  // Committing the pages gives back zeroed memory, as a fresh reservation
+  // would.
+  void* alloc = ::VirtualAlloc(reservation, size, MEM_COMMIT, PAGE_READWRITE);
+  if (alloc == nullptr) {
+    ::VirtualFree(reservation, 0, MEM_RELEASE);
+    return nullptr;
+  }
+  DCHECK_EQ(reservation, alloc);
+  return alloc;
+}
+
+void LargeBlockHeap::ReturnToPool(void* alloc, size_t size) {
+  DCHECK_NE(static_cast<void*>(nullptr), alloc);
+  DCHECK_EQ(0u, size % GetPageSize());
+
+  // Decommit the pages so that the pooled reservations don't use any
+  // physical memory, and so that any access to them faults.
+  if (::VirtualFree(alloc, size, MEM_DECOMMIT)) {
+    ::common::AutoRecursiveLock lock(lock_);
+    if (pooled_bytes_ + size <= kMaxPooledBytes) {
+      pool_.insert(std::make_pair(size, alloc));
+      pooled_bytes_ += size;
+      return;
+    }
+  }
+
+  ::VirtualFree(alloc, 0, MEM_RELEASE);
+}
+
+void LargeBlockHeap::ReleasePool() {
+  ReservationPool pool(pool_.key_comp(), pool_.get_allocator());
+  {
+    ::common::AutoRecursiveLock lock(lock_);
+    pool.swap(pool_);
+    pooled_bytes_ = 0;
+  }
+  for (const auto& reservation : pool)
+    ::VirtualFree(reservation.second, 0, MEM_RELEASE);
+}
+
 }  // namespace heaps
 }  // namespace asan
 }  // namespace agent
@@ -23,10 +23,17 @@
 // then allocations being fed into the large block heap should be at least
 // 32KB in size. Ideally the large allocation heap should not be leaned on too
 // heavily as it can cause significant memory fragmentation.
+//
+// The heap can optionally pool the reservations that it releases: instead of
+// being returned to the OS they are decommitted and kept around, bucketed by
+// size, and are recommitted when an allocation of the same size comes in.
+// This saves the cost of reserving and releasing address space for workloads
+// that churn through allocations of a few common sizes.
 
 #ifndef SYZYGY_AGENT_ASAN_HEAPS_LARGE_BLOCK_HEAP_H_
 #define SYZYGY_AGENT_ASAN_HEAPS_LARGE_BLOCK_HEAP_H_
 
+#include <map>
 #include <unordered_set>
 
 #include "syzygy/agent/asan/allocators.h"
@@ -42,6 +49,12 @@ namespace heaps {
 
 class LargeBlockHeap : public BlockHeapInterface {
  public:
+  // The largest reservation that will be pooled.
+  static const size_t kMaxPooledReservationSize;
+
+  // The maximum amount of address space that can be kept in the pool.
+  static const size_t kMaxPooledBytes;
+
   // Constructor.
   // @param memory_notifier The memory notifier to use.
   // @param internal_heap The heap to use for making internal allocations.
@@ -76,6 +89,20 @@ class LargeBlockHeap : public BlockHeapInterface {
   // @returns the number of active allocations in this heap.
   size_t size() const { return allocs_.size(); }
 
+  // @name Accessors for the reservation pool.
+  // @{
+  // @returns true if the released reservations are pooled.
+  bool pooling_enabled() const { return pooling_enabled_; }
+  // Enables or disables the pooling of the released reservations. Disabling
+  // it returns the pooled reservations to the OS.
+  // @param pooling_enabled True to enable the pooling, false otherwise.
+  void set_pooling_enabled(bool pooling_enabled);
+  // @returns the number of reservations currently in the pool.
+  size_t pooled_reservation_count();
+  // @returns the number of bytes of address space currently in the pool.
+  size_t pooled_bytes();
+  // @}
+
  protected:
   // Information about an allocation made by this allocator.
   struct Allocation {
@@ -110,9 +137,40 @@ class LargeBlockHeap : public BlockHeapInterface {
       HeapAllocator<Allocation>> AllocationSet;
   AllocationSet allocs_;  // Under lock_.
 
+  // The pool of decommitted reservations, keyed by their size. This is a
+  // multimap so that each size acts as a bucket of reservations.
+  typedef std::multimap<
+      size_t,
+      void*,
+      std::less<size_t>,
+      HeapAllocator<std::pair<const size_t, void*>>> ReservationPool;
+  ReservationPool pool_;  // Under lock_.
+
+  // The total size of the reservations in |pool_|.
+  size_t pooled_bytes_;  // Under lock_.
+
+  // Indicates if the released reservations should be pooled.
+  bool pooling_enabled_;
+
   // Free all the allocations owned by this heap.
   void FreeAllAllocations();
 
+  // Tries to get a reservation of a given size from the pool, and commits it.
+  // @param size The size of the reservation, in bytes. This must be a
+  //     multiple of the page size.
+  // @returns a pointer to the committed memory, or nullptr if there was no
+  //     suitable reservation.
+  void* AllocateFromPool(size_t size);
+
+  // Decommits a reservation and puts it in the pool. If the pool is full then
+  // the reservation is released instead.
+  // @param alloc The address of the reservation.
+  // @param size The size of the reservation, in bytes.
+  void ReturnToPool(void* alloc, size_t size);
+
+  // Returns all the reservations in the pool to the OS.
+  void ReleasePool();
+
   // The global lock for this allocator.
   ::common::RecursiveLock lock_;
 
@@ -179,6 +179,56 @@ TEST(LargeBlockHeapTest, DestructionWithOutstandingAllocationsSucceeds) {
   EXPECT_EQ(kAllocCount, h.size());
 }
 
+TEST(LargeBlockHeapTest, PooledReservationsAreReused) {
+  const size_t kAllocSize = 64 * 1024;
+  TestLargeBlockHeap h;
+  EXPECT_FALSE(h.pooling_enabled());
+  h.set_pooling_enabled(true);
+  EXPECT_EQ(0u, h.pooled_reservation_count());
+
+  uint8_t* alloc = reinterpret_cast<uint8_t*>(h.Allocate(kAllocSize));
+  ASSERT_NE(static_cast<uint8_t*>(nullptr), alloc);
+  ::memset(alloc, 0xAB, kAllocSize);
+  EXPECT_TRUE(h.Free(alloc));
+  EXPECT_EQ(1u, h.pooled_reservation_count());
+  EXPECT_EQ(kAllocSize, h.pooled_bytes());
+
+  // An allocation of a different size doesn't use the pooled reservation.
+  void* other_alloc = h.Allocate(2 * kAllocSize);
+  ASSERT_NE(static_cast<void*>(nullptr), other_alloc);
+  EXPECT_NE(alloc, other_alloc);
+  EXPECT_EQ(1u, h.pooled_reservation_count());
+
+  // An allocation of the same size gets the pooled reservation back, and its
+  // contents have been cleared.
+  uint8_t* reused_alloc = reinterpret_cast<uint8_t*>(h.Allocate(kAllocSize));
+  EXPECT_EQ(alloc, reused_alloc);
+  EXPECT_EQ(0u, h.pooled_reservation_count());
+  EXPECT_EQ(0u, h.pooled_bytes());
+  for (size_t i = 0; i < kAllocSize; ++i)
+    EXPECT_EQ(0u, reused_alloc[i]);
+  EXPECT_EQ(kAllocSize, h.GetAllocationSize(reused_alloc));
+
+  EXPECT_TRUE(h.Free(reused_alloc));
+  EXPECT_TRUE(h.Free(other_alloc));
+  EXPECT_EQ(2u, h.pooled_reservation_count());
+
+  // Disabling the pooling empties the pool.
+  h.set_pooling_enabled(false);
+  EXPECT_EQ(0u, h.pooled_reservation_count());
+  EXPECT_EQ(0u, h.pooled_bytes());
+}
+
+TEST(LargeBlockHeapTest, BigReservationsAreNotPooled) {
+  TestLargeBlockHeap h;
+  h.set_pooling_enabled(true);
+  void* alloc = h.Allocate(
+      static_cast<uint32_t>(LargeBlockHeap::kMaxPooledReservationSize + 1));
+  ASSERT_NE(static_cast<void*>(nullptr), alloc);
+  EXPECT_TRUE(h.Free(alloc));
+  EXPECT_EQ(0u, h.pooled_reservation_count());
+}
+
 }  // namespace heaps
 }  // namespace asan
 }  // namespace agent
@@ -30,22 +30,50 @@ const size_t ZebraBlockHeap::kMaximumAllocationSize = GetPageSize();
 const size_t ZebraBlockHeap::kMaximumBlockAllocationSize =
     GetPageSize() - sizeof(BlockHeader);
 
+ZebraBlockHeap::Stripe::Stripe(size_t slab_size,
+                               size_t slab_count,
+                               uint8_t* address,
+                               size_t first_slab_index,
+                               HeapInterface* internal_heap)
+    : slab_size(slab_size),
+      slab_count(slab_count),
+      address(address),
+      first_slab_index(first_slab_index),
+      quarantine_ratio(::common::kDefaultZebraBlockHeapQuarantineRatio),
+      free_slabs(slab_count, HeapAllocator<size_t>(internal_heap)),
+      quarantine(slab_count, HeapAllocator<size_t>(internal_heap)) {
+  for (size_t i = 0; i < slab_count; ++i)
+    free_slabs.push(first_slab_index + i);
+}
+
 ZebraBlockHeap::ZebraBlockHeap(size_t heap_size,
                                MemoryNotifierInterface* memory_notifier,
                                HeapInterface* internal_heap)
+    : ZebraBlockHeap(heap_size, 1, memory_notifier, internal_heap) {
+}
+
+ZebraBlockHeap::ZebraBlockHeap(size_t heap_size,
+                               size_t stripe_count,
+                               MemoryNotifierInterface* memory_notifier,
+                               HeapInterface* internal_heap)
     : heap_address_(NULL),
-      // Makes the heap_size a multiple of kSlabSize to avoid incomplete slabs
-      // at the end of the reserved memory.
-      heap_size_(::common::AlignUp(heap_size, kSlabSize)),
-      slab_count_(heap_size_ / kSlabSize),
-      slab_info_(HeapAllocator<SlabInfo>(internal_heap)),
+      heap_size_(0),
+      slab_count_(0),
       quarantine_ratio_(::common::kDefaultZebraBlockHeapQuarantineRatio),
-      free_slabs_(slab_count_,
-                  HeapAllocator<size_t>(internal_heap)),
-      quarantine_(slab_count_,
-                  HeapAllocator<size_t>(internal_heap)),
+      stripes_(HeapAllocator<Stripe>(internal_heap)),
+      slab_info_(HeapAllocator<SlabInfo>(internal_heap)),
       memory_notifier_(memory_notifier) {
   DCHECK_NE(static_cast<MemoryNotifierInterface*>(nullptr), memory_notifier);
+  DCHECK_LT(0u, stripe_count);
+  DCHECK_GE(kMaxStripeCount, stripe_count);
+
+  // Every stripe gets an equal share of the memory. Makes each share a
+  // multiple of the biggest slab size to avoid incomplete slabs, and to keep
+  // all of the slabs aligned on their size.
+  size_t max_slab_size = kSlabSize << (stripe_count - 1);
+  size_t stripe_size = ::common::AlignUp(heap_size / stripe_count,
+                                         max_slab_size);
+  heap_size_ = stripe_size * stripe_count;
 
   // Allocate the chunk of memory directly from the OS.
   heap_address_ = static_cast<uint8_t*>(::VirtualAlloc(
@@ -54,12 +82,22 @@ ZebraBlockHeap::ZebraBlockHeap(size_t heap_size,
   DCHECK(::common::IsAligned(heap_address_, GetPageSize()));
   memory_notifier_->NotifyFutureHeapUse(heap_address_, heap_size_);
 
+  // Carve the stripes out of the memory, by increasing slab size.
+  stripes_.reserve(stripe_count);
+  for (size_t i = 0; i < stripe_count; ++i) {
+    size_t slab_size = kSlabSize << i;
+    size_t slab_count = stripe_size / slab_size;
+    stripes_.push_back(Stripe(slab_size, slab_count,
+                              heap_address_ + i * stripe_size, slab_count_,
+                              internal_heap));
+    slab_count_ += slab_count;
+  }
+
   // Initialize the metadata describing the state of our heap.
   slab_info_.resize(slab_count_);
   for (size_t i = 0; i < slab_count_; ++i) {
     slab_info_[i].state = kFreeSlab;
     ::memset(&slab_info_[i].info, 0, sizeof(slab_info_[i].info));
-    free_slabs_.push(i);
   }
 }
 
@@ -106,7 +144,7 @@ bool ZebraBlockHeap::Free(void* alloc) {
   slab_info_[slab_index].state = kFreeSlab;
   ::memset(&slab_info_[slab_index].info, 0,
            sizeof(slab_info_[slab_index].info));
-  free_slabs_.push(slab_index);
+  GetStripe(slab_index).free_slabs.push(slab_index);
   return true;
 }
 
@@ -155,52 +193,64 @@ void* ZebraBlockHeap::AllocateBlock(uint32_t size,
                                     uint32_t min_right_redzone_size,
                                     BlockLayout* layout) {
   DCHECK_NE(static_cast<BlockLayout*>(nullptr), layout);
-  // Abort if the redzones do not fit in a page. Even if the allocation
+  // Abort if the right redzone does not fit in a page. Even if the allocation
   // is possible it will lead to a non-standard block layout.
-  if (min_left_redzone_size + size > GetPageSize())
-    return NULL;
   if (min_right_redzone_size > GetPageSize())
     return NULL;
 
-  // Plan the block layout.
-  if (!BlockPlanLayout(static_cast<uint32_t>(GetPageSize()),
-                       kShadowRatio,
-                       size,
-                       min_left_redzone_size,
-                       std::max(static_cast<uint32_t>(GetPageSize()),
-                                min_right_redzone_size),
-                       layout)) {
-    return nullptr;
-  }
-
-  if (layout->block_size != kSlabSize)
-    return nullptr;
-  uint32_t right_redzone_size = layout->trailer_size +
-      layout->trailer_padding_size;
-  // Part of the body lies inside an "odd" page.
-  if (right_redzone_size < GetPageSize())
-    return nullptr;
-  // There should be less than kShadowRatio bytes between the body end
-  // and the "odd" page.
-  if (right_redzone_size - GetPageSize() >= kShadowRatio)
-    return nullptr;
-
-  // Allocate space for the block, and update the slab info to reflect the right
-  // redzone.
-  void* alloc = nullptr;
-  SlabInfo* slab_info = AllocateImpl(static_cast<uint32_t>(GetPageSize()));
-  if (slab_info != nullptr) {
+  // Try the stripes by increasing slab size, moving on to the bigger slabs if
+  // the smaller ones are exhausted.
+  for (size_t i = 0; i < stripes_.size(); ++i) {
+    const Stripe& stripe = stripes_[i];
+
+    // Skip the stripe if the redzones do not fit in its slabs. Even if the
+    // allocation is possible it will lead to a non-standard block layout.
+    if (min_left_redzone_size + size > GetMaximumAllocationSize(stripe))
+      continue;
+
+    // Plan the block layout. The block is aligned on the slab size so that it
+    // spans exactly one slab. A layout that can't be planned for this stripe
+    // might still fit in the next one.
+    if (!BlockPlanLayout(static_cast<uint32_t>(stripe.slab_size),
+                         kShadowRatio,
+                         size,
+                         min_left_redzone_size,
+                         std::max(static_cast<uint32_t>(GetPageSize()),
+                                  min_right_redzone_size),
+                         layout)) {
+      continue;
+    }
+
+    if (layout->block_size != stripe.slab_size)
+      continue;
+    uint32_t right_redzone_size = layout->trailer_size +
+        layout->trailer_padding_size;
+    // Part of the body lies inside an "odd" page.
+    if (right_redzone_size < GetPageSize())
+      continue;
+    // There should be less than kShadowRatio bytes between the body end
+    // and the "odd" page.
+    if (right_redzone_size - GetPageSize() >= kShadowRatio)
+      continue;
+
+    // Allocate space for the block, and update the slab info to reflect the
+    // right redzone.
+    SlabInfo* slab_info = AllocateImpl(
+        i, static_cast<uint32_t>(GetMaximumAllocationSize(stripe)));
+    if (slab_info == nullptr)
+      continue;
     slab_info->info.block_size = layout->block_size;
     slab_info->info.header_size = layout->header_size +
         layout->header_padding_size;
     slab_info->info.trailer_size = layout->trailer_size +
         layout->trailer_padding_size;
     slab_info->info.is_nested = false;
-    alloc = slab_info->info.header;
+    void* alloc = slab_info->info.header;
+    DCHECK_EQ(0u, reinterpret_cast<uintptr_t>(alloc) % kShadowRatio);
+    return alloc;
   }
 
-  DCHECK_EQ(0u, reinterpret_cast<uintptr_t>(alloc) % kShadowRatio);
-  return alloc;
+  return nullptr;
 }
 
 bool ZebraBlockHeap::FreeBlock(const BlockInfo& block_info) {
@@ -223,7 +273,7 @@ PushResult ZebraBlockHeap::Push(const CompactBlockInfo& info) {
     return result;
   }
 
-  quarantine_.push(slab_index);
+  GetStripe(slab_index).quarantine.push(slab_index);
   slab_info_[slab_index].state = kQuarantinedSlab;
   result.push_successful = true;
   result.trim_status |= TrimStatusBits::SYNC_TRIM_REQUIRED;
@@ -233,37 +283,47 @@ PushResult ZebraBlockHeap::Push(const CompactBlockInfo& info) {
 PopResult ZebraBlockHeap::Pop(CompactBlockInfo* info) {
   ::common::AutoRecursiveLock lock(lock_);
   PopResult result = {false, TrimColor::GREEN};
-  if (QuarantineInvariantIsSatisfied())
-    return result;
 
-  size_t slab_index = quarantine_.front();
-  DCHECK_NE(kInvalidSlabIndex, slab_index);
-  quarantine_.pop();
+  // Pop from the first stripe whose invariant doesn't hold.
+  for (auto& stripe : stripes_) {
+    if (QuarantineInvariantIsSatisfied(stripe))
+      continue;
 
-  DCHECK_EQ(kQuarantinedSlab, slab_info_[slab_index].state);
-  slab_info_[slab_index].state = kAllocatedSlab;
-  *info = slab_info_[slab_index].info;
+    size_t slab_index = stripe.quarantine.front();
+    DCHECK_NE(kInvalidSlabIndex, slab_index);
+    stripe.quarantine.pop();
+
+    DCHECK_EQ(kQuarantinedSlab, slab_info_[slab_index].state);
+    slab_info_[slab_index].state = kAllocatedSlab;
+    *info = slab_info_[slab_index].info;
 
-  result.pop_successful = true;
+    result.pop_successful = true;
+    break;
+  }
   return result;
 }
 
 void ZebraBlockHeap::Empty(ObjectVector* infos) {
   ::common::AutoRecursiveLock lock(lock_);
-  while (!quarantine_.empty()) {
-    size_t slab_index = quarantine_.front();
-    DCHECK_NE(kInvalidSlabIndex, slab_index);
-    quarantine_.pop();
-
-    // Do not free the slab, only release it from the quarantine.
-    slab_info_[slab_index].state = kAllocatedSlab;
-    infos->push_back(slab_info_[slab_index].info);
+  for (auto& stripe : stripes_) {
+    while (!stripe.quarantine.empty()) {
+      size_t slab_index = stripe.quarantine.front();
+      DCHECK_NE(kInvalidSlabIndex, slab_index);
+      stripe.quarantine.pop();
+
+      // Do not free the slab, only release it from the quarantine.
+      slab_info_[slab_index].state = kAllocatedSlab;
+      infos->push_back(slab_info_[slab_index].info);
+    }
   }
 }
 
 size_t ZebraBlockHeap::GetCountForTesting() {
   ::common::AutoRecursiveLock lock(lock_);
-  return quarantine_.size();
+  size_t count = 0;
+  for (const auto& stripe : stripes_)
+    count += stripe.quarantine.size();
+  return count;
 }
 
 void ZebraBlockHeap::set_quarantine_ratio(float quarantine_ratio) {
@@ -271,25 +331,71 @@ void ZebraBlockHeap::set_quarantine_ratio(float quarantine_ratio) {
   DCHECK_GE(1, quarantine_ratio);
   ::common::AutoRecursiveLock lock(lock_);
   quarantine_ratio_ = quarantine_ratio;
+  for (auto& stripe : stripes_)
+    stripe.quarantine_ratio = quarantine_ratio;
+}
+
+size_t ZebraBlockHeap::slab_size(size_t stripe) const {
+  DCHECK_LT(stripe, stripes_.size());
+  return stripes_[stripe].slab_size;
+}
+
+float ZebraBlockHeap::quarantine_ratio(size_t stripe) const {
+  DCHECK_LT(stripe, stripes_.size());
+  return stripes_[stripe].quarantine_ratio;
+}
+
+void ZebraBlockHeap::set_quarantine_ratio(size_t stripe,
+                                          float quarantine_ratio) {
+  DCHECK_LT(stripe, stripes_.size());
+  DCHECK_LE(0, quarantine_ratio);
+  DCHECK_GE(1, quarantine_ratio);
+  ::common::AutoRecursiveLock lock(lock_);
+  stripes_[stripe].quarantine_ratio = quarantine_ratio;
+}
+
+size_t ZebraBlockHeap::maximum_block_allocation_size() const {
+  return GetMaximumAllocationSize(stripes_.back()) - sizeof(BlockHeader);
 }
 
 ZebraBlockHeap::SlabInfo* ZebraBlockHeap::AllocateImpl(uint32_t bytes) {
   CHECK_LE(bytes, (1u << 30));
-  if (bytes == 0 || bytes > GetPageSize())
+  if (bytes == 0)
     return NULL;
   ::common::AutoRecursiveLock lock(lock_);
 
-  if (free_slabs_.empty())
+  // Use the smallest slabs that fit, moving on to the bigger ones if they are
+  // exhausted.
+  for (size_t i = 0; i < stripes_.size(); ++i) {
+    if (bytes > GetMaximumAllocationSize(stripes_[i]))
+      continue;
+    SlabInfo* slab_info = AllocateImpl(i, bytes);
+    if (slab_info != NULL)
+      return slab_info;
+  }
+
+  return NULL;
+}
+
+ZebraBlockHeap::SlabInfo* ZebraBlockHeap::AllocateImpl(size_t stripe_index,
+                                                      uint32_t bytes) {
+  DCHECK_LT(stripe_index, stripes_.size());
+  ::common::AutoRecursiveLock lock(lock_);
+  Stripe& stripe = stripes_[stripe_index];
+  DCHECK_LT(0u, bytes);
+  DCHECK_GE(GetMaximumAllocationSize(stripe), bytes);
+
+  if (stripe.free_slabs.empty())
     return NULL;
 
-  size_t slab_index = free_slabs_.front();
+  size_t slab_index = stripe.free_slabs.front();
   DCHECK_NE(kInvalidSlabIndex, slab_index);
-  free_slabs_.pop();
+  stripe.free_slabs.pop();
   uint8_t* slab_address = GetSlabAddress(slab_index);
   DCHECK_NE(static_cast<uint8_t*>(nullptr), slab_address);
 
-  // Push the allocation to the end of the even page.
-  uint8_t* alloc = slab_address + GetPageSize() - bytes;
+  // Push the allocation to the end of the even pages.
+  uint8_t* alloc = slab_address + GetMaximumAllocationSize(stripe) - bytes;
   alloc = ::common::AlignDown(alloc, kShadowRatio);
 
   // Update the slab info.
@@ -305,22 +411,47 @@ ZebraBlockHeap::SlabInfo* ZebraBlockHeap::AllocateImpl(uint32_t bytes) {
 }
 
 bool ZebraBlockHeap::QuarantineInvariantIsSatisfied() {
-  return quarantine_.empty() ||
-         (quarantine_.size() / static_cast<float>(slab_count_) <=
-             quarantine_ratio_);
+  for (const auto& stripe : stripes_) {
+    if (!QuarantineInvariantIsSatisfied(stripe))
+      return false;
+  }
+  return true;
+}
+
+bool ZebraBlockHeap::QuarantineInvariantIsSatisfied(const Stripe& stripe) {
+  return stripe.quarantine.empty() ||
+         (stripe.quarantine.size() / static_cast<float>(stripe.slab_count) <=
+             stripe.quarantine_ratio);
+}
+
+ZebraBlockHeap::Stripe& ZebraBlockHeap::GetStripe(size_t slab_index) {
+  DCHECK_LT(slab_index, slab_count_);
+  // There are at most kMaxStripeCount stripes, so this is constant time.
+  size_t i = stripes_.size() - 1;
+  while (slab_index < stripes_[i].first_slab_index)
+    --i;
+  return stripes_[i];
 }
 
 uint8_t* ZebraBlockHeap::GetSlabAddress(size_t index) {
   if (index >= slab_count_)
     return NULL;
-  return heap_address_ + index * kSlabSize;
+  const Stripe& stripe = GetStripe(index);
+  return stripe.address + (index - stripe.first_slab_index) * stripe.slab_size;
 }
 
 size_t ZebraBlockHeap::GetSlabIndex(const void* address) {
   if (address < heap_address_ || address >= heap_address_ + heap_size_)
     return kInvalidSlabIndex;
-  return (static_cast<const uint8_t*>(address) - heap_address_) /
-         kSlabSize;
+  // The stripes are contiguous and sorted by address, so this takes at most
+  // kMaxStripeCount comparisons.
+  size_t i = stripes_.size() - 1;
+  while (address < stripes_[i].address)
+    --i;
+  const Stripe& stripe = stripes_[i];
+  return stripe.first_slab_index +
+         (static_cast<const uint8_t*>(address) - stripe.address) /
+             stripe.slab_size;
 }
 
 }  // namespace heaps
@@ -66,6 +66,13 @@ namespace heaps {
 // +--------+----------------+------+--+-------------------------+---------+
 // |-header-|                |-body-|                            |-trailer-|
 //
+// The heap can also be split into several stripes, each made of slabs of a
+// different size: 2 pages (one even and one odd page, as above), 4 pages and
+// 8 pages. In the bigger slabs the allocation spans all of the pages but the
+// last one, which still acts as the odd page. Each stripe has its own free
+// list and quarantine, and allocations go to the stripe with the smallest
+// slabs that can hold them.
+//
 // Calling Free on a quarantined address is an invalid operation.
 class ZebraBlockHeap : public BlockHeapInterface,
                        public BlockQuarantineInterface {
@@ -73,6 +80,10 @@ class ZebraBlockHeap : public BlockHeapInterface,
   // The size of a 2-page slab (2 * kPageSize).
   static const size_t kSlabSize;
 
+  // The maximum number of stripes. Stripe |i| is made of slabs of
+  // kSlabSize << i bytes.
+  static const size_t kMaxStripeCount = 3;
+
   // The maximum raw allocation size. Anything bigger than this will always
   // fail a call to 'Allocate'.
   static const size_t kMaximumAllocationSize;
@@ -90,6 +101,18 @@ class ZebraBlockHeap : public BlockHeapInterface,
                  MemoryNotifierInterface* memory_notifier,
                  HeapInterface* internal_heap);
 
+  // Constructor for a heap with several stripes. The memory is evenly split
+  // between the stripes.
+  // @param heap_size The amount of memory reserved by the heap in bytes.
+  // @param stripe_count The number of stripes, between 1 and kMaxStripeCount.
+  // @param memory_notifier The MemoryNotifierInterface used to report
+  //     allocation information.
+  // @param internal_heap The heap to use for making internal allocations.
+  ZebraBlockHeap(size_t heap_size,
+                 size_t stripe_count,
+                 MemoryNotifierInterface* memory_notifier,
+                 HeapInterface* internal_heap);
+
   // Virtual destructor. Frees all the allocated memory.
   virtual ~ZebraBlockHeap();
 
@@ -135,9 +158,27 @@ class ZebraBlockHeap : public BlockHeapInterface,
   // Get the ratio of the memory used by the quarantine.
   float quarantine_ratio() const { return quarantine_ratio_; }
 
-  // Set the ratio of the memory used by the quarantine.
+  // Set the ratio of the memory used by the quarantine, for all the stripes.
   void set_quarantine_ratio(float quarantine_ratio);
 
+  // @returns the number of stripes.
+  size_t stripe_count() const { return stripes_.size(); }
+
+  // @name Accessors for the individual stripes.
+  // @param stripe The index of the stripe.
+  // @{
+  // @returns the size of the slabs of the stripe.
+  size_t slab_size(size_t stripe) const;
+  // @returns the ratio of the memory of the stripe used by the quarantine.
+  float quarantine_ratio(size_t stripe) const;
+  // Sets the ratio of the memory of the stripe used by the quarantine.
+  void set_quarantine_ratio(size_t stripe, float quarantine_ratio);
+  // @}
+
+  // @returns the maximum size of a block body that can be allocated, taking
+  //     all of the stripes into account.
+  size_t maximum_block_allocation_size() const;
+
  protected:
   // The set of possible states of the slabs.
   enum SlabState {
@@ -153,14 +194,60 @@ class ZebraBlockHeap : public BlockHeapInterface,
     CompactBlockInfo info;
   };
 
+  typedef CircularQueue<size_t, HeapAllocator<size_t>> SlabIndexQueue;
+
+  // A range of slabs of the same size.
+  struct Stripe {
+    Stripe(size_t slab_size,
+           size_t slab_count,
+           uint8_t* address,
+           size_t first_slab_index,
+           HeapInterface* internal_heap);
+
+    // The size of the slabs, the last page of each being the odd page.
+    size_t slab_size;
+    // The number of slabs.
+    size_t slab_count;
+    // The address of the first slab.
+    uint8_t* address;
+    // The index of the first slab in slab_info_.
+    size_t first_slab_index;
+    // The ratio [0 .. 1] of the slabs used by the quarantine.
+    float quarantine_ratio;
+    // Holds the indices of free slabs.
+    SlabIndexQueue free_slabs;
+    // Holds the indices of the quarantined slabs.
+    SlabIndexQueue quarantine;
+  };
+
   // Performs an allocation, and returns a pointer to the SlabInfo where the
-  // allocation was made.
+  // allocation was made. Uses the stripe with the smallest slabs that can
+  // satisfy the allocation.
   SlabInfo* AllocateImpl(uint32_t bytes);
 
+  // Performs an allocation in the given stripe.
+  SlabInfo* AllocateImpl(size_t stripe, uint32_t bytes);
+
   // Checks if the quarantine invariant is satisfied.
   // @returns true if the quarantine invariant is satisfied, false otherwise.
   bool QuarantineInvariantIsSatisfied();
 
+  // Checks if the quarantine invariant is satisfied for a given stripe.
+  // @param stripe The stripe to check.
+  // @returns true if the quarantine invariant is satisfied, false otherwise.
+  bool QuarantineInvariantIsSatisfied(const Stripe& stripe);
+
+  // Gives the stripe containing a slab.
+  // @param slab_index The 0-based index of the slab.
+  // @returns the stripe containing the slab.
+  Stripe& GetStripe(size_t slab_index);
+
+  // @param stripe The stripe.
+  // @returns the maximum allocation size of the slabs in the stripe.
+  static size_t GetMaximumAllocationSize(const Stripe& stripe) {
+    return stripe.slab_size - GetPageSize();
+  }
+
   // Gives the 0-based index of the slab containing 'address'.
   // @param address address.
   // @returns The 0-based index of the slab containing 'address', or
@@ -187,13 +274,9 @@ class ZebraBlockHeap : public BlockHeapInterface,
   // The ratio [0 .. 1] of the memory used by the quarantine. Under lock_.
   float quarantine_ratio_;
 
-  typedef CircularQueue<size_t, HeapAllocator<size_t>> SlabIndexQueue;
-
-  // Holds the indices of free slabs. Under lock_.
-  SlabIndexQueue free_slabs_;
-
-  // Holds the indices of the quarantined slabs. Under lock_.
-  SlabIndexQueue quarantine_;
+  // The stripes, by increasing slab size. They are laid out contiguously in
+  // memory in that order. Under lock_.
+  std::vector<Stripe, HeapAllocator<Stripe>> stripes_;
 
   typedef std::vector<SlabInfo,
                       HeapAllocator<SlabInfo>> SlabInfoVector;
@@ -62,12 +62,22 @@ class TestZebraBlockHeap : public ZebraBlockHeap {
   explicit TestZebraBlockHeap(MemoryNotifierInterface* memory_notifier)
       : ZebraBlockHeap(kInitialHeapSize, memory_notifier, &dummy_heap) { }
 
+  // Creates a test heap with 8 MB initial (and maximum) memory split in
+  // @p stripe_count stripes.
+  explicit TestZebraBlockHeap(size_t stripe_count)
+      : ZebraBlockHeap(kInitialHeapSize, stripe_count, &null_notifier,
+                       &dummy_heap) { }
+
   // Allows to know if the heap can handle more allocations.
   // @returns true if the heap is full (no more allocations allowed),
   // false otherwise.
   bool IsHeapFull() {
-    // No free slabs.
-    return free_slabs_.empty();
+    // No free slabs in any of the stripes.
+    for (const auto& stripe : stripes_) {
+      if (!stripe.free_slabs.empty())
+        return false;
+    }
+    return true;
   }
 };
 
@@ -161,6 +171,49 @@ TEST(ZebraBlockHeapTest, BlocksHaveCorrectAlignment) {
   }
 }
 
+TEST(ZebraBlockHeapTest, MultipleStripes) {
+  TestZebraBlockHeap h(ZebraBlockHeap::kMaxStripeCount);
+  ASSERT_EQ(3u, h.stripe_count());
+  EXPECT_EQ(2 * GetPageSize(), h.slab_size(0));
+  EXPECT_EQ(4 * GetPageSize(), h.slab_size(1));
+  EXPECT_EQ(8 * GetPageSize(), h.slab_size(2));
+  EXPECT_EQ(7 * GetPageSize() - sizeof(BlockHeader),
+            h.maximum_block_allocation_size());
+
+  // A plain allocation that doesn't fit in a 2-page slab goes in the 4-page
+  // stripe, right against the odd page.
+  uint8_t* alloc = reinterpret_cast<uint8_t*>(h.Allocate(2 * GetPageSize()));
+  ASSERT_NE(static_cast<uint8_t*>(nullptr), alloc);
+  EXPECT_TRUE(IsAligned(alloc, GetPageSize()));
+  EXPECT_TRUE(IsAligned(alloc + 3 * GetPageSize(), 4 * GetPageSize()));
+  EXPECT_EQ(2 * GetPageSize(), h.GetAllocationSize(alloc));
+  EXPECT_TRUE(h.Free(alloc));
+
+  // Blocks are laid out so that the body ends against the odd page.
+  BlockLayout layout = {};
+  BlockInfo block = {};
+  void* block_alloc = h.AllocateBlock(3 * GetPageSize(), 0, 0, &layout);
+  ASSERT_NE(static_cast<void*>(nullptr), block_alloc);
+  BlockInitialize(layout, block_alloc, false, &block);
+  EXPECT_EQ(4 * GetPageSize(), block.block_size);
+  EXPECT_TRUE(IsAligned(block.trailer + 1, GetPageSize()));
+  size_t body_offset = AlignUp(block.RawTrailerPadding(), GetPageSize()) -
+      block.RawTrailerPadding();
+  EXPECT_GT(kShadowRatio, body_offset);
+  EXPECT_TRUE(h.FreeBlock(block));
+
+  // Too big for any of the stripes.
+  EXPECT_EQ(nullptr, h.AllocateBlock(8 * GetPageSize(), 0, 0, &layout));
+
+  // Each stripe has its own quarantine ratio.
+  h.set_quarantine_ratio(1, 0.5f);
+  EXPECT_EQ(0.5f, h.quarantine_ratio(1));
+  EXPECT_NE(0.5f, h.quarantine_ratio(0));
+  h.set_quarantine_ratio(0.25f);
+  for (size_t i = 0; i < h.stripe_count(); ++i)
+    EXPECT_EQ(0.25f, h.quarantine_ratio(i));
+}
+
 TEST(ZebraBlockHeapTest, AllocateSizeLimits) {
   TestZebraBlockHeap h;
 
@@ -14,17 +14,79 @@
 
 #include "syzygy/agent/asan/hot_patching_asan_runtime.h"
 
+#include <algorithm>
+#include <utility>
+
+#include "base/bind.h"
 #include "base/command_line.h"
 #include "base/environment.h"
+#include "base/rand_util.h"
+#include "base/strings/stringprintf.h"
+#include "base/strings/sys_string_conversions.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/win/pe_image.h"
 #include "syzygy/agent/asan/logger.h"
+#include "syzygy/common/asan_parameters.h"
+#include "syzygy/common/defs.h"
 #include "syzygy/trace/client/client_utils.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 
 namespace agent {
 namespace asan {
 
-HotPatchingAsanRuntime::HotPatchingAsanRuntime() { }
+namespace {
+
+using block_graph::HotPatchingBlockMetadata;
+using block_graph::HotPatchingMetadataHeader;
+
+// Reads the hot patching metadata of a module.
+// @param module The handle to the module.
+// @param blocks Will receive the hot patchable blocks, sorted by address.
+// @returns true on success, false if the module has no valid metadata.
+bool ReadHotPatchingMetadata(
+    HMODULE module,
+    HotPatchingAsanRuntime::HotPatchableBlocks* blocks) {
+  DCHECK_NE(static_cast<HotPatchingAsanRuntime::HotPatchableBlocks*>(nullptr),
+            blocks);
+
+  base::win::PEImage image(module);
+  const IMAGE_SECTION_HEADER* section = image.GetImageSectionHeaderByName(
+      ::common::kHotPatchingMetadataSectionName);
+  if (section == nullptr)
+    return false;
+
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(
+      image.RVAToAddr(section->VirtualAddress));
+  size_t size = section->Misc.VirtualSize;
+  if (size < sizeof(HotPatchingMetadataHeader))
+    return false;
+
+  const HotPatchingMetadataHeader* header =
+      reinterpret_cast<const HotPatchingMetadataHeader*>(data);
+  if (header->version != block_graph::kHotPatchingMetadataVersion)
+    return false;
+  if (header->number_of_blocks > (size - sizeof(*header)) /
+                                     sizeof(HotPatchingBlockMetadata)) {
+    return false;
+  }
+
+  const HotPatchingBlockMetadata* first_block =
+      reinterpret_cast<const HotPatchingBlockMetadata*>(header + 1);
+  blocks->assign(first_block, first_block + header->number_of_blocks);
+  std::sort(blocks->begin(), blocks->end(),
+            [](const HotPatchingBlockMetadata& block1,
+               const HotPatchingBlockMetadata& block2) {
+              return block1.relative_address < block2.relative_address;
+            });
+  return true;
+}
+
+}  // namespace
+
+HotPatchingAsanRuntime::HotPatchingAsanRuntime()
+    : block_patcher_(base::Bind(&HotPatchingAsanRuntime::PatchBlock,
+                                base::Unretained(this))) {
+}
 
 HotPatchingAsanRuntime::~HotPatchingAsanRuntime() { }
 
@@ -40,18 +102,140 @@ bool HotPatchingAsanRuntime::HotPatch(HINSTANCE instance) {
   }
   hot_patched_modules_.insert(instance);
 
-  // TODO(cseri): Do the hot patching.
-  logger_->Write("HPSyzyAsan: Hot patching not yet implemented.");
+  HotPatchableModule hot_patchable_module;
+  if (!ReadHotPatchingMetadata(instance, &hot_patchable_module.blocks)) {
+    logger_->Write("HPSyzyAsan: No valid hot patching metadata, exiting.");
+    return false;
+  }
+  hot_patchable_module.states.resize(hot_patchable_module.blocks.size(),
+                                     kBlockInactive);
+  logger_->Write("HPSyzyAsan: Found " +
+      std::to_string(hot_patchable_module.blocks.size()) +
+      " hot patchable blocks.");
+
+  base::AutoLock auto_lock(lock_);
+  hot_patchable_modules_[instance] = std::move(hot_patchable_module);
 
   return true;
 }
 
+bool HotPatchingAsanRuntime::ActivateBlock(HMODULE module,
+                                           uint32_t relative_address) {
+  base::AutoLock auto_lock(lock_);
+
+  auto module_it = hot_patchable_modules_.find(module);
+  if (module_it == hot_patchable_modules_.end())
+    return false;
+  HotPatchableModule& hot_patchable_module = module_it->second;
+  const HotPatchableBlocks& blocks = hot_patchable_module.blocks;
+
+  // Find the block containing the address.
+  auto block_it = std::upper_bound(
+      blocks.begin(), blocks.end(), relative_address,
+      [](uint32_t address, const HotPatchingBlockMetadata& block) {
+        return address < block.relative_address;
+      });
+  if (block_it == blocks.begin())
+    return false;
+  --block_it;
+  if (relative_address - block_it->relative_address >= block_it->block_size)
+    return false;
+
+  BlockState& state =
+      hot_patchable_module.states[block_it - blocks.begin()];
+  if (state != kBlockInactive)
+    return state == kBlockActive;
+
+  state = kBlockDeclined;
+  if (policy_.get() == nullptr ||
+      !policy_->ShouldActivate(block_it->relative_address)) {
+    return false;
+  }
+  if (!block_patcher_.Run(module, *block_it))
+    return false;
+  state = kBlockActive;
+  return true;
+}
+
+bool HotPatchingAsanRuntime::ActivateBlockAt(const void* address) {
+  HMODULE module = nullptr;
+  if (!::GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+                               GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                           reinterpret_cast<LPCWSTR>(address), &module)) {
+    return false;
+  }
+  uint32_t relative_address = static_cast<uint32_t>(
+      reinterpret_cast<const uint8_t*>(address) -
+      reinterpret_cast<const uint8_t*>(module));
+  return ActivateBlock(module, relative_address);
+}
+
+const HotPatchingAsanRuntime::HotPatchableBlocks*
+HotPatchingAsanRuntime::GetHotPatchableBlocks(HMODULE module) {
+  base::AutoLock auto_lock(lock_);
+  auto module_it = hot_patchable_modules_.find(module);
+  if (module_it == hot_patchable_modules_.end())
+    return nullptr;
+  return &module_it->second.blocks;
+}
+
+void HotPatchingAsanRuntime::set_block_patcher(
+    const BlockPatcher& block_patcher) {
+  base::AutoLock auto_lock(lock_);
+  if (block_patcher.is_null()) {
+    block_patcher_ = base::Bind(&HotPatchingAsanRuntime::PatchBlock,
+                                base::Unretained(this));
+  } else {
+    block_patcher_ = block_patcher;
+  }
+}
+
+void HotPatchingAsanRuntime::ResetPolicy(float activation_rate,
+                                         size_t max_activated_blocks,
+                                         uint32_t seed) {
+  base::AutoLock auto_lock(lock_);
+  policy_.reset(
+      new HotPatchingPolicy(activation_rate, max_activated_blocks, seed));
+}
+
 void HotPatchingAsanRuntime::SetUp() {
   SetUpLogger();
+  SetUpPolicy();
 
   logger_->Write("HPSyzyAsan: Runtime loaded.");
 }
 
+void HotPatchingAsanRuntime::SetUpPolicy() {
+  ::common::InflatedAsanParameters params;
+  ::common::SetDefaultAsanParameters(&params);
+
+  // The options are only taken from the environment, as the hot patched
+  // modules don't carry any parameters.
+  std::unique_ptr<base::Environment> env(base::Environment::Create());
+  std::string options;
+  if (env->GetVar(::common::kSyzyAsanOptionsEnvVar, &options) &&
+      !::common::ParseAsanParameters(base::SysUTF8ToWide(options), &params)) {
+    logger_->Write("HPSyzyAsan: Failed to parse the options, using the "
+                   "defaults.");
+    ::common::SetDefaultAsanParameters(&params);
+  }
+
+  float activation_rate = std::min(
+      std::max(params.hot_patching_activation_rate, 0.0f), 1.0f);
+  ResetPolicy(activation_rate, params.max_hot_patched_blocks,
+              static_cast<uint32_t>(base::RandUint64()));
+}
+
+bool HotPatchingAsanRuntime::PatchBlock(
+    HMODULE module,
+    const HotPatchingBlockMetadata& block) {
+  // TODO(cseri): Do the hot patching.
+  logger_->Write(base::StringPrintf(
+      "HPSyzyAsan: Hot patching not yet implemented, can't activate the "
+      "block at RVA 0x%08X.", block.relative_address));
+  return false;
+}
+
 void HotPatchingAsanRuntime::SetUpLogger() {
   // Setup variables we're going to use.
   std::unique_ptr<base::Environment> env(base::Environment::Create());
@@ -24,11 +24,17 @@
 #include <windows.h>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
+#include "base/callback.h"
 #include "base/logging.h"
 #include "base/memory/singleton.h"
+#include "base/synchronization/lock.h"
+#include "syzygy/agent/asan/hot_patching_policy.h"
 #include "syzygy/agent/common/entry_frame.h"
+#include "syzygy/block_graph/hot_patching_metadata.h"
 
 namespace agent {
 namespace asan {
@@ -37,6 +43,16 @@ class AsanLogger;
 
 class HotPatchingAsanRuntime {
  public:
+  // The hot patchable blocks of a module, sorted by address.
+  typedef std::vector<block_graph::HotPatchingBlockMetadata>
+      HotPatchableBlocks;
+
+  // The callback that hot patches a block of a module.
+  // @returns true on success, false otherwise.
+  typedef base::Callback<bool(HMODULE,
+                              const block_graph::HotPatchingBlockMetadata&)>
+      BlockPatcher;
+
   // Hot patching Asan transform instruments the entry point of the modules so
   // that this function is called before each DllMain call of the instrumented
   // modules. At this point the code of the hot patching runtime module is
@@ -52,13 +68,47 @@ class HotPatchingAsanRuntime {
     return base::Singleton<HotPatchingAsanRuntime>::get();
   }
 
-  // Activates the hot patching Asan mode on a given module.
+  // Activates the hot patching Asan mode on a given module. This reads the
+  // hot patching metadata of the module, but doesn't patch any block: they
+  // are activated lazily, by ActivateBlock.
   // @param instance The handle to the module.
   // NOTE: The current implementation of this function is not thread-safe. This
   //     is not a problem for now, because we call this function under the
   //     loader lock.
   bool HotPatch(HINSTANCE instance);
 
+  // Reports that a block has been executed, for instance by the sampling
+  // profiler, and hot patches it if the policy allows it. Blocks that the
+  // policy declines are never considered again. This is thread-safe.
+  // @param module The handle to a module that has been hot patched.
+  // @param relative_address Any RVA in the block.
+  // @returns true if the block is active, false otherwise.
+  bool ActivateBlock(HMODULE module, uint32_t relative_address);
+
+  // Same as above, for the block containing a given address.
+  // @param address Any address in the block.
+  // @returns true if the block is active, false otherwise.
+  bool ActivateBlockAt(const void* address);
+
+  // @param module The handle to a module.
+  // @returns the hot patchable blocks of @p module, or nullptr if the module
+  //     has not been hot patched. This remains valid as long as the module
+  //     is loaded.
+  const HotPatchableBlocks* GetHotPatchableBlocks(HMODULE module);
+
+  // Replaces the policy deciding which blocks get activated. The blocks that
+  // have already been activated or declined aren't reconsidered. See
+  // HotPatchingPolicy for the meaning of the parameters.
+  void ResetPolicy(float activation_rate,
+                   size_t max_activated_blocks,
+                   uint32_t seed);
+
+  // Sets the callback that hot patches the blocks. This is mostly for
+  // testing.
+  // @param block_patcher The new block patcher. A null callback restores the
+  //     default one.
+  void set_block_patcher(const BlockPatcher& block_patcher);
+
   // Sets up the hot patching Asan runtime.
   void SetUp();
 
@@ -75,8 +125,33 @@ class HotPatchingAsanRuntime {
   }
 
  protected:
+  // The state of a hot patchable block.
+  enum BlockState : uint8_t {
+    // The block has not been reported as executed yet.
+    kBlockInactive,
+    // The block has been hot patched.
+    kBlockActive,
+    // The block has been reported as executed, but either the policy
+    // declined it or patching it failed.
+    kBlockDeclined,
+  };
+
+  // The hot patchable blocks of a module, and their states.
+  struct HotPatchableModule {
+    HotPatchableBlocks blocks;
+    std::vector<BlockState> states;
+  };
+
   void SetUpLogger();
 
+  // Sets up the policy from the options in the environment.
+  void SetUpPolicy();
+
+  // The default block patcher. This declines all the blocks for now, so the
+  // activation isn't exported by the runtime yet.
+  bool PatchBlock(HMODULE module,
+                  const block_graph::HotPatchingBlockMetadata& block);
+
   // The shared logger instance that will be used to report errors and runtime
   // information.
   std::unique_ptr<AsanLogger> logger_;
@@ -85,6 +160,18 @@ class HotPatchingAsanRuntime {
   // patch the same module twice.
   std::unordered_set<HMODULE> hot_patched_modules_;
 
+  // Protects the state of the lazy activation of the blocks.
+  base::Lock lock_;
+
+  // The hot patchable modules, by handle. Under lock_.
+  std::unordered_map<HMODULE, HotPatchableModule> hot_patchable_modules_;
+
+  // The policy deciding which blocks get activated. Under lock_.
+  std::unique_ptr<HotPatchingPolicy> policy_;
+
+  // The callback that hot patches the blocks. Under lock_.
+  BlockPatcher block_patcher_;
+
  private:
   friend struct base::DefaultSingletonTraits<HotPatchingAsanRuntime>;
   friend class HotPatchingAsanRuntimeTest;
@@ -14,6 +14,9 @@
 
 #include "syzygy/agent/asan/hot_patching_asan_runtime.h"
 
+#include <vector>
+
+#include "base/bind.h"
 #include "gtest/gtest.h"
 
 #include "syzygy/agent/asan/unittest_util.h"
@@ -110,6 +113,13 @@ class HotPatchingAsanRuntimeTest : public testing::TestWithAsanLogger {
               runtime_);
   }
 
+  // A block patcher that only records the blocks that it's asked to patch.
+  bool PatchBlock(HMODULE module,
+                  const block_graph::HotPatchingBlockMetadata& block) {
+    patched_blocks_.push_back(block.relative_address);
+    return true;
+  }
+
   void TearDown() override {
     if (asan_hp_rtl_ != nullptr) {
       ::FreeLibrary(asan_hp_rtl_);
@@ -125,6 +135,9 @@ class HotPatchingAsanRuntimeTest : public testing::TestWithAsanLogger {
 
   // The hot patching Asan runtime.
   agent::asan::HotPatchingAsanRuntime* runtime_;
+
+  // The RVAs of the blocks that have been patched by PatchBlock.
+  std::vector<uint32_t> patched_blocks_;
 };
 
 // This test fails under coverage instrumentation.
@@ -154,5 +167,59 @@ TEST_F(HotPatchingAsanRuntimeTest, TestRuntime) {
   ASSERT_EQ(1U, runtime_->hot_patched_modules().count(relink_helper.module_));
 }
 
+#ifdef _COVERAGE_BUILD
+TEST_F(HotPatchingAsanRuntimeTest, DISABLED_LazyActivation) {
+#else
+TEST_F(HotPatchingAsanRuntimeTest, LazyActivation) {
+#endif
+  HotPatchingAsanRelinkHelper relink_helper;
+  relink_helper.SetUp();
+  relink_helper.InstrumentAndLoadTestDll();
+  relink_helper.LoadTestDll(relink_helper.hp_test_dll_path_,
+                            &relink_helper.module_);
+  HMODULE module = relink_helper.module_;
+
+  // The blocks of the module are known, but none of them is active.
+  const HotPatchingAsanRuntime::HotPatchableBlocks* blocks =
+      runtime_->GetHotPatchableBlocks(module);
+  ASSERT_NE(static_cast<const HotPatchingAsanRuntime::HotPatchableBlocks*>(
+                nullptr),
+            blocks);
+  ASSERT_LE(2U, blocks->size());
+  EXPECT_EQ(nullptr, runtime_->GetHotPatchableBlocks(asan_hp_rtl_));
+
+  // Only allow a single block to be activated.
+  runtime_->ResetPolicy(1.0f, 1, 0);
+  runtime_->set_block_patcher(base::Bind(
+      &HotPatchingAsanRuntimeTest::PatchBlock, base::Unretained(this)));
+
+  // Any address in the block activates it, and it's only patched once.
+  const block_graph::HotPatchingBlockMetadata& block1 = blocks->at(0);
+  EXPECT_TRUE(runtime_->ActivateBlock(
+      module, block1.relative_address + block1.block_size - 1));
+  EXPECT_TRUE(runtime_->ActivateBlockAt(
+      reinterpret_cast<const uint8_t*>(module) + block1.relative_address));
+  ASSERT_EQ(1U, patched_blocks_.size());
+  EXPECT_EQ(block1.relative_address, patched_blocks_[0]);
+
+  // The budget of the policy is exhausted.
+  const block_graph::HotPatchingBlockMetadata& block2 = blocks->at(1);
+  EXPECT_FALSE(runtime_->ActivateBlock(module, block2.relative_address));
+  EXPECT_EQ(1U, patched_blocks_.size());
+
+  // Declined blocks aren't reconsidered.
+  runtime_->ResetPolicy(1.0f, 0, 0);
+  EXPECT_FALSE(runtime_->ActivateBlock(module, block2.relative_address));
+  EXPECT_EQ(1U, patched_blocks_.size());
+
+  // Addresses outside of the hot patched modules are ignored.
+  EXPECT_FALSE(runtime_->ActivateBlock(asan_hp_rtl_, 0x1000));
+  EXPECT_FALSE(runtime_->ActivateBlock(module, 0));
+
+  // Restore the default block patcher, as this fixture doesn't outlive the
+  // runtime.
+  runtime_->set_block_patcher(HotPatchingAsanRuntime::BlockPatcher());
+}
+
 }  // namespace asan
 }  // namespace agent
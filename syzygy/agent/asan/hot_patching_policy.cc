@@ -0,0 +1,74 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/hot_patching_policy.h"
+
+#include "base/logging.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+const uint64_t kNumHashValues = 1ULL << 32;
+
+// Mixes the bits of a block address with the seed, so that any fraction of
+// the blocks is drawn uniformly.
+uint32_t HashBlock(uint32_t relative_address, uint32_t seed) {
+  uint32_t hash = relative_address ^ seed;
+  hash ^= hash >> 16;
+  hash *= 0x85EBCA6B;
+  hash ^= hash >> 13;
+  hash *= 0xC2B2AE35;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+}  // namespace
+
+HotPatchingPolicy::HotPatchingPolicy(float activation_rate,
+                                     size_t max_activated_blocks,
+                                     uint32_t seed)
+    : eligibility_threshold_(0),
+      max_activated_blocks_(max_activated_blocks),
+      seed_(seed),
+      activated_blocks_(0) {
+  DCHECK_LE(0.0f, activation_rate);
+  DCHECK_GE(1.0f, activation_rate);
+
+  if (activation_rate >= 1.0f) {
+    eligibility_threshold_ = kNumHashValues;
+  } else if (activation_rate > 0.0f) {
+    eligibility_threshold_ =
+        static_cast<uint64_t>(activation_rate * kNumHashValues);
+  }
+}
+
+bool HotPatchingPolicy::IsEligible(uint32_t relative_address) const {
+  return HashBlock(relative_address, seed_) < eligibility_threshold_;
+}
+
+bool HotPatchingPolicy::ShouldActivate(uint32_t relative_address) {
+  if (max_activated_blocks_ != 0 &&
+      activated_blocks_ >= max_activated_blocks_) {
+    return false;
+  }
+  if (!IsEligible(relative_address))
+    return false;
+  ++activated_blocks_;
+  return true;
+}
+
+}  // namespace asan
+}  // namespace agent
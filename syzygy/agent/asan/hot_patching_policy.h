@@ -0,0 +1,77 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares HotPatchingPolicy, which decides which of the hot patchable blocks
+// of a process get activated.
+
+#ifndef SYZYGY_AGENT_ASAN_HOT_PATCHING_POLICY_H_
+#define SYZYGY_AGENT_ASAN_HOT_PATCHING_POLICY_H_
+
+#include <stdint.h>
+
+#include "base/macros.h"
+
+namespace agent {
+namespace asan {
+
+// The hot patching policy only lets a bounded, random subset of the blocks
+// get activated in a process. When the same binary runs on a large population
+// of machines, each process then pays for the instrumentation of a small
+// fraction of the code, while the population as a whole covers all of it.
+//
+// A block is only considered once it has been reported as executed, so that
+// the budget isn't wasted on code that never runs.
+class HotPatchingPolicy {
+ public:
+  // Constructor.
+  // @param activation_rate The fraction of the blocks that are eligible for
+  //     activation, between 0 and 1.
+  // @param max_activated_blocks The maximum number of blocks that get
+  //     activated. A value of 0 means no limit.
+  // @param seed The seed drawing the eligible blocks. Processes with the same
+  //     seed activate the same blocks.
+  HotPatchingPolicy(float activation_rate,
+                    size_t max_activated_blocks,
+                    uint32_t seed);
+
+  // @param relative_address The RVA of a block.
+  // @returns true if the block is part of the eligible subset. This only
+  //     depends on the seed and on the block.
+  bool IsEligible(uint32_t relative_address) const;
+
+  // Decides whether to activate an executed block. A block that is activated
+  // counts against the budget of the policy.
+  // @param relative_address The RVA of the block.
+  // @returns true if the block should be activated.
+  bool ShouldActivate(uint32_t relative_address);
+
+  // @returns the number of blocks that have been activated.
+  size_t activated_blocks() const { return activated_blocks_; }
+
+ protected:
+  // The eligible blocks are those whose hash is strictly below this. This
+  // is 2^32 if all of them are.
+  uint64_t eligibility_threshold_;
+  size_t max_activated_blocks_;
+  uint32_t seed_;
+  size_t activated_blocks_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(HotPatchingPolicy);
+};
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_HOT_PATCHING_POLICY_H_
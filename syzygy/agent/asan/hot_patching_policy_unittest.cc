@@ -0,0 +1,84 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/hot_patching_policy.h"
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+const size_t kNumBlocks = 10000;
+
+// @returns the RVA of the i-th test block.
+uint32_t GetBlockAddress(size_t i) {
+  return static_cast<uint32_t>(0x1000 + i * 0x10);
+}
+
+}  // namespace
+
+TEST(HotPatchingPolicyTest, ActivatesEverything) {
+  HotPatchingPolicy policy(1.0f, 0, 42);
+  for (size_t i = 0; i < kNumBlocks; ++i)
+    EXPECT_TRUE(policy.ShouldActivate(GetBlockAddress(i)));
+  EXPECT_EQ(kNumBlocks, policy.activated_blocks());
+}
+
+TEST(HotPatchingPolicyTest, ActivatesNothing) {
+  HotPatchingPolicy policy(0.0f, 0, 42);
+  for (size_t i = 0; i < kNumBlocks; ++i)
+    EXPECT_FALSE(policy.ShouldActivate(GetBlockAddress(i)));
+  EXPECT_EQ(0u, policy.activated_blocks());
+}
+
+TEST(HotPatchingPolicyTest, ActivatesAFraction) {
+  HotPatchingPolicy policy(0.1f, 0, 42);
+  for (size_t i = 0; i < kNumBlocks; ++i)
+    policy.ShouldActivate(GetBlockAddress(i));
+
+  // Allow for some slack around the expected 1000 blocks.
+  EXPECT_LT(800u, policy.activated_blocks());
+  EXPECT_GT(1200u, policy.activated_blocks());
+}
+
+TEST(HotPatchingPolicyTest, DependsOnSeed) {
+  HotPatchingPolicy policy1(0.5f, 0, 1);
+  HotPatchingPolicy policy2(0.5f, 0, 1);
+  HotPatchingPolicy policy3(0.5f, 0, 2);
+  size_t differences = 0;
+  for (size_t i = 0; i < kNumBlocks; ++i) {
+    uint32_t relative_address = GetBlockAddress(i);
+    EXPECT_EQ(policy1.IsEligible(relative_address),
+              policy2.IsEligible(relative_address));
+    if (policy1.IsEligible(relative_address) !=
+        policy3.IsEligible(relative_address)) {
+      ++differences;
+    }
+  }
+  EXPECT_LT(0u, differences);
+}
+
+TEST(HotPatchingPolicyTest, RespectsBudget) {
+  static const size_t kMaxActivatedBlocks = 10;
+  HotPatchingPolicy policy(1.0f, kMaxActivatedBlocks, 42);
+  for (size_t i = 0; i < kMaxActivatedBlocks; ++i)
+    EXPECT_TRUE(policy.ShouldActivate(GetBlockAddress(i)));
+  EXPECT_FALSE(policy.ShouldActivate(GetBlockAddress(kMaxActivatedBlocks)));
+  EXPECT_EQ(kMaxActivatedBlocks, policy.activated_blocks());
+}
+
+}  // namespace asan
+}  // namespace agent
@@ -69,13 +69,22 @@ class IATPatchWorker {
   }
 
  private:
+  // An IAT entry to be patched, and the function it should point to.
+  using PendingPatch = std::pair<PIMAGE_THUNK_DATA, FunctionPointer>;
+
   static bool VisitImport(const base::win::PEImage &image, LPCSTR module,
                           DWORD ordinal, LPCSTR name, DWORD hint,
                           PIMAGE_THUNK_DATA iat, PVOID cookie);
-  PatchResult OnImport(const char* name, PIMAGE_THUNK_DATA iat);
+  void OnImport(const char* name, PIMAGE_THUNK_DATA iat);
+
+  // Makes the IAT entries to be patched writable. When they all lie in the
+  // IAT directory of the image, which is the common case, the range they
+  // span is unprotected at once.
+  PatchResult UnprotectPendingPatches(base::win::PEImage* image);
 
   ScopedPageProtections scoped_page_protections_;
   const IATPatchMap& patch_;
+  std::vector<PendingPatch> pending_patches_;
   PatchResult result_;
 
   DISALLOW_COPY_AND_ASSIGN(IATPatchWorker);
@@ -91,9 +100,25 @@ PatchResult IATPatchWorker::PatchImage(base::win::PEImage* image) {
   // This is actually '0', so ORing error conditions to it is just fine.
   result_ = PATCH_SUCCEEDED;
 
-  // The IAT patching takes place during enumeration.
+  // Collect the IAT entries to patch, so that the page protections only get
+  // modified once for all of them.
+  pending_patches_.clear();
   image->EnumAllImports(&VisitImport, this);
 
+  result_ |= UnprotectPendingPatches(image);
+  if (result_ == PATCH_SUCCEEDED) {
+    for (const auto& pending_patch : pending_patches_) {
+      PatchResult result =
+          UpdateImportThunk(pending_patch.first, pending_patch.second);
+      if (result != PATCH_SUCCEEDED) {
+        // Remember the reason for failure.
+        result_ |= result;
+        break;
+      }
+    }
+  }
+  pending_patches_.clear();
+
   // Clean up whatever we soiled, success or failure be damned.
   if (!scoped_page_protections_.RestorePageProtections())
     result_ |= PATCH_FAILED_REPROTECT_FAILED;
@@ -108,28 +133,58 @@ bool IATPatchWorker::VisitImport(
     return true;
 
   IATPatchWorker* worker = reinterpret_cast<IATPatchWorker*>(cookie);
-  PatchResult result = worker->OnImport(name, iat);
-  if (result == PATCH_SUCCEEDED)
-    return true;
-
-  // Remember the reason for failure.
-  worker->result_ |= result;
-  return false;
+  worker->OnImport(name, iat);
+  return true;
 }
 
-PatchResult IATPatchWorker::OnImport(const char* name, PIMAGE_THUNK_DATA iat) {
+void IATPatchWorker::OnImport(const char* name, PIMAGE_THUNK_DATA iat) {
   auto it = patch_.find(name);
   // See whether this is a function we care about.
   if (it == patch_.end())
+    return;
+
+  pending_patches_.push_back(std::make_pair(iat, it->second));
+}
+
+PatchResult IATPatchWorker::UnprotectPendingPatches(
+    base::win::PEImage* image) {
+  DCHECK_NE(static_cast<base::win::PEImage*>(nullptr), image);
+  if (pending_patches_.empty())
+    return PATCH_SUCCEEDED;
+
+  // Find the range spanned by the IAT entries to patch.
+  uint8_t* begin = nullptr;
+  uint8_t* end = nullptr;
+  for (const auto& pending_patch : pending_patches_) {
+    uint8_t* entry = reinterpret_cast<uint8_t*>(pending_patch.first);
+    if (begin == nullptr || entry < begin)
+      begin = entry;
+    if (end == nullptr || entry + sizeof(IMAGE_THUNK_DATA) > end)
+      end = entry + sizeof(IMAGE_THUNK_DATA);
+  }
+
+  uint8_t* iat_begin = reinterpret_cast<uint8_t*>(
+      image->GetImageDirectoryEntryAddr(IMAGE_DIRECTORY_ENTRY_IAT));
+  uint8_t* iat_end =
+      iat_begin + image->GetImageDirectoryEntrySize(IMAGE_DIRECTORY_ENTRY_IAT);
+  if (iat_begin != nullptr && begin >= iat_begin && end <= iat_end) {
+    if (!scoped_page_protections_.EnsureContainingPagesWritable(
+            begin, end - begin)) {
+      return PATCH_FAILED_UNPROTECT_FAILED;
+    }
     return PATCH_SUCCEEDED;
+  }
 
-  // Make the containing page writable.
-  if (!scoped_page_protections_.EnsureContainingPagesWritable(
-          iat, sizeof(IMAGE_THUNK_DATA))) {
-    return PATCH_FAILED_UNPROTECT_FAILED;
+  // Otherwise the entries may be scattered across the image, only unprotect
+  // the pages containing them.
+  for (const auto& pending_patch : pending_patches_) {
+    if (!scoped_page_protections_.EnsureContainingPagesWritable(
+            pending_patch.first, sizeof(IMAGE_THUNK_DATA))) {
+      return PATCH_FAILED_UNPROTECT_FAILED;
+    }
   }
 
-  return UpdateImportThunk(iat, it->second);
+  return PATCH_SUCCEEDED;
 }
 
 }  // namespace
@@ -57,7 +57,9 @@ using IATPatchMap = std::map<base::StringPiece, FunctionPointer>;
 // Testing callback.
 
 // Modifies the IAT of @p module such that each function named in @p patch_map
-// points to the associated function.
+// points to the associated function. All the entries are patched in one
+// batch: the pages they span are made writable at once before any of them is
+// written, and their protections are restored once they all are.
 // @param module the module to patch up.
 // @param patch_map a map from name to the desired function.
 // @param on_unprotect Callback function that is invoked as page protections
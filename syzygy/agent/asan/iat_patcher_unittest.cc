@@ -22,6 +22,7 @@
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/agent/asan/constants.h"
+#include "syzygy/common/align.h"
 #include "syzygy/core/unittest_util.h"
 
 namespace agent {
@@ -79,7 +80,47 @@ class LenientIATPatcherTest : public testing::Test {
 
   MOCK_METHOD2(OnUnprotect, void(void*, DWORD));
 
+  // @returns a patch map redirecting all the named imports of @p module to
+  //     @p function. The names are owned by the module.
+  IATPatchMap GetPatchMapForAllImports(HMODULE module,
+                                       FunctionPointer function) {
+    base::win::PEImage image(module);
+    IATPatchMap patches;
+    patches[""] = function;
+
+    image.EnumAllImports(OnNamedImport, &patches);
+
+    patches.erase("");
+    return patches;
+  }
+
+  // @returns the number of pages spanned by the IAT of @p module.
+  size_t GetIATPageCount(HMODULE module) {
+    base::win::PEImage image(module);
+
+    const uint8_t* iat = reinterpret_cast<const uint8_t*>(
+        image.GetImageDirectoryEntryAddr(IMAGE_DIRECTORY_ENTRY_IAT));
+    size_t iat_size =
+        image.GetImageDirectoryEntrySize(IMAGE_DIRECTORY_ENTRY_IAT);
+    const uint8_t* pages_begin =
+        ::common::AlignDown(iat, agent::asan::GetPageSize());
+    const uint8_t* pages_end =
+        ::common::AlignUp(iat + iat_size, agent::asan::GetPageSize());
+
+    return (pages_end - pages_begin) / agent::asan::GetPageSize();
+  }
+
  protected:
+  static bool OnNamedImport(const base::win::PEImage &image, LPCSTR module,
+                            DWORD ordinal, LPCSTR name, DWORD hint,
+                            PIMAGE_THUNK_DATA iat, PVOID cookie) {
+    IATPatchMap* patches = reinterpret_cast<IATPatchMap*>(cookie);
+    if (name != nullptr)
+      (*patches)[name] = (*patches)[""];
+
+    return true;
+  }
+
   static bool OnImport(const base::win::PEImage &image, LPCSTR module,
                        DWORD ordinal, LPCSTR name, DWORD hint,
                        PIMAGE_THUNK_DATA iat, PVOID cookie) {
@@ -163,5 +204,34 @@ TEST_F(IATPatcherTest, FailsWithAccessViolation) {
   EXPECT_EQ(iat_before, iat_after);
 }
 
+TEST_F(IATPatcherTest, PatchesInBatch) {
+  // Patch all the named imports of the module.
+  IATPatchMap patches = GetPatchMapForAllImports(test_dll_, PatchDestination);
+  ASSERT_LT(2U, patches.size());
+
+  // Create a callback to the mock.
+  ScopedPageProtections::OnUnprotectCallback on_unprotect =
+      base::Bind(&IATPatcherTest::OnUnprotect, base::Unretained(this));
+
+  // Expect each page of the IAT to be unprotected at most once, rather than
+  // once per patched import.
+  EXPECT_CALL(*this, OnUnprotect(testing::_, testing::_))
+      .Times(testing::Between(1, static_cast<int>(GetIATPageCount(test_dll_))));
+
+  DWORD prot_before = GetIATPageProtection(test_dll_);
+  ASSERT_EQ(PATCH_SUCCEEDED, PatchIATForModule(test_dll_, patches,
+                                               on_unprotect));
+  ASSERT_EQ(prot_before, GetIATPageProtection(test_dll_));
+
+  // All of the named imports got redirected.
+  ImportTable iat_after = GetIAT(test_dll_);
+  size_t patched = 0;
+  for (auto func : iat_after) {
+    if (func == &PatchDestination)
+      ++patched;
+  }
+  EXPECT_LE(patches.size(), patched);
+}
+
 }  // namespace asan
 }  // namespace agent
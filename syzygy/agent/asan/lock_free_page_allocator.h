@@ -0,0 +1,204 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Defines LockFreePageAllocator. This is a variant of PageAllocator whose
+// free lists are lock-free stacks, so that threads returning and reusing
+// objects never wait on each other. The top of each stack is a tagged pointer
+// whose tag is incremented on every update, which protects against the ABA
+// problem. The memory of an object is never returned to the OS while the
+// allocator is alive, so reading the link of an object that has been popped
+// by another thread in the meantime is safe.
+//
+// Fresh objects are still carved from the current page under a lock, but
+// several groups of objects are carved at once and the extras are pushed to
+// the free list, so the lock is only taken once for every kCarveCount
+// allocations that miss the free lists.
+//
+// Like PageAllocator this uses as much memory as the 'high waterline'.
+
+#ifndef SYZYGY_AGENT_ASAN_LOCK_FREE_PAGE_ALLOCATOR_H_
+#define SYZYGY_AGENT_ASAN_LOCK_FREE_PAGE_ALLOCATOR_H_
+
+#include <windows.h>
+
+#include "base/synchronization/lock.h"
+#include "syzygy/agent/asan/page_allocator.h"
+
+namespace agent {
+namespace asan {
+
+// An untyped LockFreePageAllocator. Thread safety is provided by this object.
+// @tparam kObjectSize The size of objects returned by the allocator,
+//     in bytes. Objects will be tightly packed so any alignment constraints
+//     should be reflected in this size. Must be at least as big as a pointer.
+// @tparam kMaxObjectCount The maximum number of consecutive objects that
+//     will be requested at once by the allocator. The allocator will
+//     maintain separate free lists for each possible length from 1 to
+//     kMaxObjectCount.
+// @tparam kPageSize The amount of memory to be allocated at a time as
+//     the pool grows. This is rounded up in the same way as for
+//     PageAllocator.
+template<size_t kObjectSize,
+         size_t kMaxObjectCount,
+         size_t kPageSize>
+class LockFreePageAllocator {
+ public:
+  typedef detail::PageAllocatorPage<kObjectSize, kPageSize> Page;
+  typedef typename Page::Object Object;
+
+  // The number of groups of objects that are carved from the current page
+  // at once when the free lists can't satisfy an allocation.
+  static const size_t kCarveCount = 8;
+
+  // Constructor.
+  LockFreePageAllocator();
+
+  // Destructor.
+  ~LockFreePageAllocator();
+
+  // Allocates @p count objects of the configured size.
+  // @param count The number of objects to allocate. Must be > 0.
+  // @returns A pointer to the allocated objects, or NULL on failure.
+  void* Allocate(size_t count);
+
+  // Frees the given objects.
+  // @param object The object to be returned.
+  // @param count The number of objects to return. This must match the
+  //     number of objects originally allocated.
+  void Free(void* object, size_t count);
+
+  // @returns the number of pages that have been allocated.
+  size_t page_count();
+
+ protected:
+  // The top of a free list. This packs a pointer to the first object of the
+  // list with a tag, so that both can be updated with a single 64-bit
+  // compare-and-swap.
+  typedef LONGLONG FreeListTop;
+
+  // @name Accessors for the fields of a FreeListTop.
+  // @{
+  static Object* GetFreeListObject(FreeListTop top);
+  static FreeListTop MakeFreeListTop(Object* object, FreeListTop old_top);
+  // @}
+
+  // Pops the top item from the given free list.
+  // @param count The size class.
+  // @returns a pointer to the popped item, NULL if there was none.
+  Object* FreePop(size_t count);
+
+  // Pushes a chain of objects to the specified free list.
+  // @param first The first group of objects in the chain.
+  // @param last The last group of objects in the chain. This may be the same
+  //     as @p first.
+  // @param count The size class.
+  void FreePush(Object* first, Object* last, size_t count);
+
+  // Carves groups of objects from the current page, reserving a new page if
+  // need be.
+  // @param count The size class.
+  // @param last Will be set to the last group of the chain of carved
+  //     objects.
+  // @returns the first group of the chain of carved objects, NULL on failure.
+  //     The groups are chained through their next_free pointers.
+  // @note Assumes the lock_ has already been acquired.
+  Object* CarveLocked(size_t count, Object** last);
+
+  // Reserves a new page of objects, modifying page_ and object_. Any remaining
+  // unallocated objects are pushed to the appropriate freed list. There may
+  // be no more than kMaxObjectCount of them.
+  // @returns true if the allocation was successful, false otherwise.
+  // @note Assumes the lock_ has already been acquired.
+  bool AllocatePageLocked();
+
+  // Determines if an allocation is currently in the freed list of this
+  // allocator.
+  // @param object The object to be checked.
+  // @param count The size class of the allocation.
+  // @returns true if the given object is the first object in a range that was
+  //     freed by the allocator.
+  // @note This is only meant for testing, as the free list may be modified
+  //     concurrently.
+  bool IsInFreeList(const void* object, size_t count);
+
+  // The number of pages that have been allocated. Under lock_.
+  size_t page_count_;
+
+  // The current slab of reserved memory we are working from. Under lock_.
+  Page* slab_;
+  Page* slab_cursor_;
+
+  // The currently active page. Under lock_.
+  Page* page_;
+
+  // The next object to be allocated in the current page. Under lock_.
+  Object* object_;
+
+  // The lock-free stacks of freed objects, one per possible size category.
+  // These must only be modified with interlocked operations.
+  volatile FreeListTop free_[kMaxObjectCount];
+
+  // The lock protecting the pages.
+  base::Lock lock_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(LockFreePageAllocator);
+};
+
+// A templated LockFreePageAllocator with convenience functions for allocating
+// and freeing typed objects.
+// @tparam ObjectType The type of object that is returned by the allocator.
+// @tparam kMaxObjectCount The maximum number of consecutive objects that
+//     will be requested at once by the allocator.
+// @tparam kPageSize The amount of memory to be allocated at a time as
+//     the pool grows.
+template<typename ObjectType,
+         size_t kMaxObjectCount,
+         size_t kPageSize>
+class TypedLockFreePageAllocator
+    : public LockFreePageAllocator<sizeof(ObjectType),
+                                   kMaxObjectCount,
+                                   kPageSize> {
+ public:
+  // The parent type for this class.
+  typedef LockFreePageAllocator<sizeof(ObjectType), kMaxObjectCount,
+                                kPageSize> Super;
+
+  // Constructor.
+  TypedLockFreePageAllocator() { }
+
+  // Destructor.
+  ~TypedLockFreePageAllocator() { }
+
+  // Allocates objects.
+  // @param count The number of objects to allocate. Must be > 0.
+  // @returns A pointer to the allocated object, or NULL on failure.
+  ObjectType* Allocate(size_t count);
+
+  // Frees the given object.
+  // @param object The object to be returned.
+  // @param count The number of objects to return. This must match the
+  //     number of objects originally allocated.
+  void Free(ObjectType* object, size_t count);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(TypedLockFreePageAllocator);
+};
+
+}  // namespace asan
+}  // namespace agent
+
+#include "syzygy/agent/asan/lock_free_page_allocator_impl.h"
+
+#endif  // SYZYGY_AGENT_ASAN_LOCK_FREE_PAGE_ALLOCATOR_H_
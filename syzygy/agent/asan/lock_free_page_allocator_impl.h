@@ -0,0 +1,344 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Implementation details for LockFreePageAllocator. This is not meant to be
+// included directly.
+
+#ifndef SYZYGY_AGENT_ASAN_LOCK_FREE_PAGE_ALLOCATOR_IMPL_H_
+#define SYZYGY_AGENT_ASAN_LOCK_FREE_PAGE_ALLOCATOR_IMPL_H_
+
+#include <windows.h>
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "syzygy/agent/asan/constants.h"
+#include "syzygy/common/align.h"
+
+namespace agent {
+namespace asan {
+
+namespace detail {
+
+// The position of the tag in the top of a free list. The pointer lives in
+// the bits below it.
+#ifdef _WIN64
+// User-mode addresses fit in 47 bits, which leaves the upper 16 bits for the
+// tag.
+static const size_t kLockFreePageAllocatorTagShift = 48;
+#else
+static const size_t kLockFreePageAllocatorTagShift = 32;
+#endif
+
+static const uint64_t kLockFreePageAllocatorPointerMask =
+    (1ULL << kLockFreePageAllocatorTagShift) - 1;
+
+}  // namespace detail
+
+template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize>
+LockFreePageAllocator<kObjectSize, kMaxObjectCount, kPageSize>::
+LockFreePageAllocator()
+    : page_count_(0), slab_(nullptr), slab_cursor_(nullptr), page_(nullptr),
+      object_(nullptr) {
+  static_assert(kPageSize > kObjectSize,
+                "Page size should be bigger than the object size.");
+  static_assert(kObjectSize >= sizeof(uintptr_t), "Object size is too small.");
+  static_assert(kObjectSize <= sizeof(Object), "Object is too small.");
+  static_assert(sizeof(Object) < kObjectSize + 4, "Object is too large.");
+  static_assert(kPageSize <= sizeof(Page), "Page is too small.");
+  static_assert(sizeof(Page) % kUsualPageSize == 0, "Invalid page size.");
+  static_assert(kCarveCount * kMaxObjectCount <= Page::kObjectsPerPage,
+                "Too many objects carved at once.");
+
+  // The interlocked operations require the free lists to be naturally
+  // aligned.
+  DCHECK(::common::IsAligned(const_cast<FreeListTop*>(free_),
+                             sizeof(FreeListTop)));
+
+  // Clear the freelists.
+  for (size_t i = 0; i < kMaxObjectCount; ++i)
+    free_[i] = 0;
+}
+
+template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize>
+LockFreePageAllocator<kObjectSize, kMaxObjectCount, kPageSize>::
+~LockFreePageAllocator() {
+  // Pages are chained in reverse order, and allocated moving forward through
+  // a slab. Thus it is safe to release an entire slab when encountering its
+  // first page, as its other pages will already have been iterated through.
+  Page* page = page_;
+  size_t page_count = 0;
+  while (page) {
+    ++page_count;
+    Page* prev_page = page->prev_page;
+    if (::common::IsAligned(page, kUsualAllocationGranularity))
+      CHECK_EQ(TRUE, ::VirtualFree(page, 0, MEM_RELEASE));
+    page = prev_page;
+  }
+  DCHECK_EQ(page_count_, page_count);
+}
+
+template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize>
+void* LockFreePageAllocator<kObjectSize, kMaxObjectCount, kPageSize>::
+Allocate(size_t count) {
+  DCHECK_LT(0u, count);
+  DCHECK_GE(kMaxObjectCount, count);
+
+  // Look to the lists of freed objects and try to use one of those. Use the
+  // first one that's big enough, and push the leftover objects to another
+  // freed list.
+  for (size_t n = count; n <= kMaxObjectCount; ++n) {
+    // This is racy, but it's cheaper than a failed pop.
+    if (GetFreeListObject(free_[n - 1]) == nullptr)
+      continue;
+
+    Object* object = FreePop(n);
+    if (object == nullptr)
+      continue;
+
+    if (count < n) {
+      Object* remaining = object + count;
+      FreePush(remaining, remaining, n - count);
+    }
+    return object;
+  }
+
+  // Carve fresh objects from a page. Only the first group is returned, the
+  // others are pushed to the free list once the lock has been released.
+  Object* first = nullptr;
+  Object* last = nullptr;
+  {
+    base::AutoLock lock(lock_);
+    first = CarveLocked(count, &last);
+  }
+  if (first == nullptr)
+    return nullptr;
+  if (first != last)
+    FreePush(first->next_free, last, count);
+  first->next_free = nullptr;
+
+  return first;
+}
+
+template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize>
+void LockFreePageAllocator<kObjectSize, kMaxObjectCount, kPageSize>::
+Free(void* object, size_t count) {
+  DCHECK_NE(static_cast<void*>(nullptr), object);
+  DCHECK_LT(0u, count);
+  DCHECK_GE(kMaxObjectCount, count);
+
+  Object* free = reinterpret_cast<Object*>(object);
+  FreePush(free, free, count);
+}
+
+template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize>
+size_t LockFreePageAllocator<kObjectSize, kMaxObjectCount, kPageSize>::
+page_count() {
+  base::AutoLock lock(lock_);
+  return page_count_;
+}
+
+template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize>
+typename LockFreePageAllocator<kObjectSize, kMaxObjectCount, kPageSize>::Object*
+LockFreePageAllocator<kObjectSize, kMaxObjectCount, kPageSize>::
+    GetFreeListObject(FreeListTop top) {
+  uint64_t pointer = static_cast<uint64_t>(top) &
+      detail::kLockFreePageAllocatorPointerMask;
+  return reinterpret_cast<Object*>(static_cast<uintptr_t>(pointer));
+}
+
+template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize>
+typename LockFreePageAllocator<kObjectSize, kMaxObjectCount, kPageSize>::
+    FreeListTop
+LockFreePageAllocator<kObjectSize, kMaxObjectCount, kPageSize>::
+    MakeFreeListTop(Object* object, FreeListTop old_top) {
+  uint64_t pointer = reinterpret_cast<uintptr_t>(object);
+  DCHECK_EQ(0u, pointer & ~detail::kLockFreePageAllocatorPointerMask);
+  uint64_t tag = (static_cast<uint64_t>(old_top) >>
+      detail::kLockFreePageAllocatorTagShift) + 1;
+  return static_cast<FreeListTop>(
+      (tag << detail::kLockFreePageAllocatorTagShift) | pointer);
+}
+
+template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize>
+typename LockFreePageAllocator<kObjectSize, kMaxObjectCount, kPageSize>::Object*
+LockFreePageAllocator<kObjectSize, kMaxObjectCount, kPageSize>::
+    FreePop(size_t count) {
+  DCHECK_LT(0u, count);
+  DCHECK_GE(kMaxObjectCount, count);
+
+  // On 32-bit builds this read may be torn. This is harmless: the pointer is
+  // always one that has been at the top of the list at some point, and the
+  // compare-and-swap below fails if the tag doesn't match.
+  volatile FreeListTop* free = &free_[count - 1];
+  FreeListTop old_top = *free;
+  while (true) {
+    Object* object = GetFreeListObject(old_top);
+    if (object == nullptr)
+      return nullptr;
+
+    // The object may be popped and reused by another thread while its link
+    // is being read. The tag will then have changed and the exchange will
+    // fail.
+    FreeListTop new_top = MakeFreeListTop(object->next_free, old_top);
+    FreeListTop top = ::InterlockedCompareExchange64(free, new_top, old_top);
+    if (top == old_top) {
+      object->next_free = nullptr;
+      return object;
+    }
+    old_top = top;
+  }
+}
+
+template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize>
+void LockFreePageAllocator<kObjectSize, kMaxObjectCount, kPageSize>::
+    FreePush(Object* first, Object* last, size_t count) {
+  DCHECK_NE(static_cast<Object*>(nullptr), first);
+  DCHECK_NE(static_cast<Object*>(nullptr), last);
+  DCHECK_LT(0u, count);
+  DCHECK_GE(kMaxObjectCount, count);
+
+  volatile FreeListTop* free = &free_[count - 1];
+  FreeListTop old_top = *free;
+  while (true) {
+    last->next_free = GetFreeListObject(old_top);
+    FreeListTop new_top = MakeFreeListTop(first, old_top);
+    FreeListTop top = ::InterlockedCompareExchange64(free, new_top, old_top);
+    if (top == old_top)
+      return;
+    old_top = top;
+  }
+}
+
+template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize>
+typename LockFreePageAllocator<kObjectSize, kMaxObjectCount, kPageSize>::Object*
+LockFreePageAllocator<kObjectSize, kMaxObjectCount, kPageSize>::
+    CarveLocked(size_t count, Object** last) {
+  DCHECK_LT(0u, count);
+  DCHECK_GE(kMaxObjectCount, count);
+  DCHECK_NE(static_cast<Object**>(nullptr), last);
+  lock_.AssertAcquired();
+
+  // If the current page is not big enough for the requested allocation then
+  // get a new page.
+  if (page_ == nullptr ||
+      static_cast<size_t>(page_->end() - object_) < count) {
+    if (!AllocatePageLocked())
+      return nullptr;
+  }
+
+  size_t group_count = std::min<size_t>(
+      kCarveCount, (page_->end() - object_) / count);
+  DCHECK_LT(0u, group_count);
+
+  // Chain the groups together.
+  Object* first = object_;
+  Object* group = first;
+  for (size_t i = 1; i < group_count; ++i) {
+    group->next_free = group + count;
+    group += count;
+  }
+  group->next_free = nullptr;
+
+  object_ = group + count;
+  *last = group;
+  return first;
+}
+
+template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize>
+bool LockFreePageAllocator<kObjectSize, kMaxObjectCount, kPageSize>::
+    AllocatePageLocked() {
+  lock_.AssertAcquired();
+
+  // If there are remaining objects push them to the appropriately sized free
+  // list.
+  if (page_ && object_ < page_->end()) {
+    size_t n = page_->end() - object_;
+    DCHECK_LT(0u, n);
+    DCHECK_GE(kMaxObjectCount, n);
+    FreePush(object_, object_, n);
+  }
+
+  Page* slab_end = slab_ + Page::kPagesPerSlab;
+
+  // Grab a new slab if needed.
+  if (slab_ == nullptr || slab_cursor_ >= slab_end) {
+    void* slab = ::VirtualAlloc(
+        nullptr, Page::kSlabSize, MEM_RESERVE, PAGE_NOACCESS);
+    if (slab == nullptr)
+      return false;
+
+    // Update the slab and next page cursor.
+    slab_ = reinterpret_cast<Page*>(slab);
+    slab_cursor_ = slab_;
+  }
+
+  // Commit the next page.
+  Page* page = reinterpret_cast<Page*>(::VirtualAlloc(
+      slab_cursor_, sizeof(Page), MEM_COMMIT, PAGE_READWRITE));
+  if (page == nullptr)
+    return false;
+  DCHECK_EQ(page, slab_cursor_);
+
+  // Update the slab cursor.
+  ++slab_cursor_;
+
+  // Keep a pointer to the previous page, and set up the next object pointer.
+  page->prev_page = page_;
+  page_ = page;
+  object_ = page->objects;
+  ++page_count_;
+
+  return true;
+}
+
+template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize>
+bool LockFreePageAllocator<kObjectSize, kMaxObjectCount, kPageSize>::
+IsInFreeList(const void* object, size_t count) {
+  DCHECK_LT(0u, count);
+  DCHECK_GE(kMaxObjectCount, count);
+
+  Object* free = GetFreeListObject(free_[count - 1]);
+  while (free) {
+    if (free == object)
+      return true;
+    free = free->next_free;
+  }
+
+  return false;
+}
+
+template<typename ObjectType, size_t kMaxObjectCount, size_t kPageSize>
+ObjectType*
+TypedLockFreePageAllocator<ObjectType, kMaxObjectCount, kPageSize>::
+    Allocate(size_t count) {
+  DCHECK_LT(0u, count);
+  DCHECK_GE(kMaxObjectCount, count);
+  void* object = Super::Allocate(count);
+  return reinterpret_cast<ObjectType*>(object);
+}
+
+template<typename ObjectType, size_t kMaxObjectCount, size_t kPageSize>
+void TypedLockFreePageAllocator<ObjectType, kMaxObjectCount, kPageSize>::
+    Free(ObjectType* object, size_t count) {
+  DCHECK_NE(static_cast<ObjectType*>(nullptr), object);
+  DCHECK_LT(0u, count);
+  DCHECK_GE(kMaxObjectCount, count);
+  Super::Free(object, count);
+}
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_LOCK_FREE_PAGE_ALLOCATOR_IMPL_H_
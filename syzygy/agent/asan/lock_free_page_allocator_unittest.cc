@@ -0,0 +1,191 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/lock_free_page_allocator.h"
+
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "base/threading/simple_thread.h"
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+template<size_t kObjectSize,
+         size_t kMaxObjectCount,
+         size_t kPageSize>
+class TestLockFreePageAllocator
+    : public LockFreePageAllocator<kObjectSize, kMaxObjectCount, kPageSize> {
+ public:
+  typedef LockFreePageAllocator<kObjectSize, kMaxObjectCount, kPageSize>
+      Super;
+
+  // Counts the number of free objects in the given size class.
+  size_t FreeObjects(size_t count) {
+    size_t free_objects = 0;
+    Object* free = GetFreeListObject(free_[count - 1]);
+    while (free) {
+      free_objects += count;
+      free = free->next_free;
+    }
+    return free_objects;
+  }
+
+  using Super::IsInFreeList;
+  using Super::page_;
+  using Super::object_;
+};
+
+// There are 256 16-byte objects in a 4KB page, so we should get 255 objects.
+typedef TestLockFreePageAllocator<16, 1, 4096> TestLockFreePageAllocator255;
+typedef TestLockFreePageAllocator<16, 4, 4096>
+    TestLockFreePageAllocatorMulti255;
+
+// Repeatedly allocates objects, stamps them and frees them, checking that no
+// other thread was handed the same objects in the meantime.
+class AllocAndFreeRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  static const size_t kNumObjects = 64;
+  static const size_t kNumIterations = 2000;
+
+  AllocAndFreeRunner(TestLockFreePageAllocator255* allocator, uint32_t stamp)
+      : allocator_(allocator), stamp_(stamp) {
+  }
+
+  void Run() override {
+    uint32_t* objects[kNumObjects] = {};
+    for (size_t i = 0; i < kNumIterations; ++i) {
+      for (size_t j = 0; j < kNumObjects; ++j) {
+        objects[j] = reinterpret_cast<uint32_t*>(allocator_->Allocate(1));
+        ASSERT_NE(static_cast<uint32_t*>(nullptr), objects[j]);
+        objects[j][1] = stamp_;
+      }
+      for (size_t j = 0; j < kNumObjects; ++j) {
+        EXPECT_EQ(stamp_, objects[j][1]);
+        allocator_->Free(objects[j], 1);
+      }
+    }
+  }
+
+ private:
+  TestLockFreePageAllocator255* allocator_;
+  uint32_t stamp_;
+};
+
+}  // namespace
+
+TEST(LockFreePageAllocatorTest, Constructor) {
+  TestLockFreePageAllocator255 pa;
+  EXPECT_EQ(255, TestLockFreePageAllocator255::Page::kObjectsPerPage);
+  EXPECT_TRUE(pa.page_ == nullptr);
+  EXPECT_TRUE(pa.object_ == nullptr);
+  EXPECT_EQ(0u, pa.FreeObjects(1));
+  EXPECT_EQ(0u, pa.page_count());
+}
+
+TEST(LockFreePageAllocatorTest, CarvesSeveralObjectsAtOnce) {
+  TestLockFreePageAllocator255 pa;
+  uint8_t* first = reinterpret_cast<uint8_t*>(pa.Allocate(1));
+  ASSERT_NE(static_cast<uint8_t*>(nullptr), first);
+  EXPECT_EQ(1u, pa.page_count());
+
+  // The other carved objects are waiting in the free list.
+  const size_t kCarveCount = TestLockFreePageAllocator255::kCarveCount;
+  EXPECT_EQ(kCarveCount - 1, pa.FreeObjects(1));
+  EXPECT_TRUE(pa.IsInFreeList(first + 16, 1));
+  EXPECT_FALSE(pa.IsInFreeList(first, 1));
+
+  // They get handed out before the page is carved any further.
+  auto object = pa.object_;
+  for (size_t i = 1; i < kCarveCount; ++i)
+    EXPECT_NE(static_cast<void*>(nullptr), pa.Allocate(1));
+  EXPECT_EQ(0u, pa.FreeObjects(1));
+  EXPECT_EQ(object, pa.object_);
+
+  EXPECT_NE(static_cast<void*>(nullptr), pa.Allocate(1));
+  EXPECT_EQ(kCarveCount - 1, pa.FreeObjects(1));
+  EXPECT_NE(object, pa.object_);
+}
+
+TEST(LockFreePageAllocatorTest, ReusesFreedObjects) {
+  TestLockFreePageAllocatorMulti255 pa;
+  void* alloc1 = pa.Allocate(1);
+  ASSERT_NE(static_cast<void*>(nullptr), alloc1);
+  pa.Free(alloc1, 1);
+  EXPECT_TRUE(pa.IsInFreeList(alloc1, 1));
+  EXPECT_EQ(alloc1, pa.Allocate(1));
+  EXPECT_FALSE(pa.IsInFreeList(alloc1, 1));
+
+  // Bigger groups are split to satisfy smaller allocations when there's
+  // nothing else available.
+  uint8_t* alloc4 = reinterpret_cast<uint8_t*>(pa.Allocate(4));
+  ASSERT_NE(static_cast<uint8_t*>(nullptr), alloc4);
+  while (pa.FreeObjects(4) > 0)
+    pa.Allocate(4);
+  pa.Free(alloc4, 4);
+  while (pa.FreeObjects(3) > 0)
+    pa.Allocate(3);
+  EXPECT_EQ(alloc4, pa.Allocate(3));
+  EXPECT_TRUE(pa.IsInFreeList(alloc4 + 3 * 16, 1));
+}
+
+TEST(LockFreePageAllocatorTest, SpansSeveralPages) {
+  const size_t kObjectsPerPage =
+      TestLockFreePageAllocator255::Page::kObjectsPerPage;
+  TestLockFreePageAllocator255 pa;
+  std::set<void*> objects;
+  for (size_t i = 0; i < 3 * kObjectsPerPage; ++i) {
+    void* object = pa.Allocate(1);
+    ASSERT_NE(static_cast<void*>(nullptr), object);
+    EXPECT_TRUE(objects.insert(object).second);
+  }
+  EXPECT_EQ(3u, pa.page_count());
+}
+
+TEST(LockFreePageAllocatorTest, ConcurrentAllocsAndFrees) {
+  TestLockFreePageAllocator255 pa;
+
+  static const size_t kNumThreads = 4;
+  std::vector<std::unique_ptr<AllocAndFreeRunner>> runners;
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> threads;
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    runners.push_back(std::unique_ptr<AllocAndFreeRunner>(
+        new AllocAndFreeRunner(&pa, static_cast<uint32_t>(i + 1))));
+    threads.push_back(std::unique_ptr<base::DelegateSimpleThread>(
+        new base::DelegateSimpleThread(runners.back().get(),
+                                       "AllocAndFreeRunner")));
+  }
+  for (auto& thread : threads)
+    thread->Start();
+  for (auto& thread : threads)
+    thread->Join();
+
+  // The objects are reused, so only a few pages should have been needed.
+  EXPECT_GE(4u, pa.page_count());
+}
+
+TEST(TypedLockFreePageAllocatorTest, EndToEnd) {
+  TypedLockFreePageAllocator<uint32_t, 10, 1000> pa;
+  uint32_t* alloc = pa.Allocate(5);
+  ASSERT_NE(static_cast<uint32_t*>(nullptr), alloc);
+  pa.Free(alloc, 5);
+  EXPECT_EQ(alloc, pa.Allocate(5));
+}
+
+}  // namespace asan
+}  // namespace agent
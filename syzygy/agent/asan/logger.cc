@@ -23,6 +23,7 @@
 #include "base/process/launch.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
+#include "syzygy/common/com_utils.h"
 #include "syzygy/common/rpc/helpers.h"
 #include "syzygy/trace/rpc/logger_rpc.h"
 
@@ -57,7 +58,16 @@ void InitExecutionContext(const CONTEXT& rtl_context,
 
 }  // namespace
 
-AsanLogger::AsanLogger() : log_as_text_(true), minidump_on_failure_(false) {
+AsanLogger::AsanLogger()
+    : log_as_text_(true),
+      minidump_on_failure_(false),
+      use_log_buffer_(false),
+      log_buffer_view_(nullptr) {
+}
+
+AsanLogger::~AsanLogger() {
+  if (log_buffer_view_ != nullptr)
+    ignore_result(::UnmapViewOfFile(log_buffer_view_));
 }
 
 void AsanLogger::Init() {
@@ -81,15 +91,22 @@ void AsanLogger::Init() {
     if (!success)
       rpc_binding_.Close();
   }
+
+  if (success && use_log_buffer_)
+    SetUpLogBuffer();
 }
 
 void AsanLogger::Stop() {
   if (rpc_binding_.Get() != NULL) {
+    FlushLogBuffer();
     ::common::rpc::InvokeRpc(&LoggerClient_Stop, rpc_binding_.Get());
   }
 }
 
 void AsanLogger::Write(const std::string& message) {
+  if (AppendToLogBuffer(message, nullptr, 0))
+    return;
+
   // If we're bound to a logging endpoint, log the message there.
   if (rpc_binding_.Get() != NULL) {
     ::common::rpc::InvokeRpc(
@@ -102,6 +119,9 @@ void AsanLogger::WriteWithContext(const std::string& message,
                                   const CONTEXT& context) {
   // If we're bound to a logging endpoint, log the message there.
   if (rpc_binding_.Get() != NULL) {
+    // The logger captures the stack trace while this thread is blocked, so
+    // this can't go through the log buffer.
+    FlushLogBuffer();
     ExecutionContext exec_context = {};
     InitExecutionContext(context, &exec_context);
     ::common::rpc::InvokeRpc(
@@ -113,6 +133,11 @@ void AsanLogger::WriteWithContext(const std::string& message,
 void AsanLogger::WriteWithStackTrace(const std::string& message,
                                      const void * const * trace_data,
                                      uint32_t trace_length) {
+  if (AppendToLogBuffer(message, reinterpret_cast<const DWORD*>(trace_data),
+                        trace_length)) {
+    return;
+  }
+
   // If we're bound to a logging endpoint, log the message there.
   if (rpc_binding_.Get() != NULL) {
     ::common::rpc::InvokeRpc(
@@ -133,6 +158,9 @@ void AsanLogger::SaveMinidumpWithProtobufAndMemoryRanges(
   if (rpc_binding_.Get() == NULL)
     return;
 
+  // Make sure that the messages preceding the minidump have been logged.
+  FlushLogBuffer();
+
   // Convert the memory ranges to arrays.
   std::vector<const void*> base_addresses;
   std::vector<size_t> range_lengths;
@@ -159,5 +187,54 @@ void AsanLogger::SaveMinidumpWithProtobufAndMemoryRanges(
       static_cast<uint32_t>(memory_ranges.size()));
 }
 
+void AsanLogger::SetUpLogBuffer() {
+  DCHECK(rpc_binding_.Get() != NULL);
+  DCHECK(!log_buffer_.initialized());
+
+  unsigned long handle = 0;
+  unsigned long buffer_size = 0;
+  if (!::common::rpc::InvokeRpc(&LoggerClient_CreateLogBuffer,
+                                rpc_binding_.Get(), &handle,
+                                &buffer_size).succeeded()) {
+    return;
+  }
+  log_buffer_handle_.Set(reinterpret_cast<HANDLE>(handle));
+
+  void* view = ::MapViewOfFile(log_buffer_handle_.Get(), FILE_MAP_WRITE, 0, 0,
+                               buffer_size);
+  if (view == nullptr) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map view of log buffer: "
+               << ::common::LogWe(error) << ".";
+    return;
+  }
+  log_buffer_view_ = view;
+
+  if (!log_buffer_.Attach(log_buffer_view_, buffer_size)) {
+    ignore_result(::UnmapViewOfFile(log_buffer_view_));
+    log_buffer_view_ = nullptr;
+  }
+}
+
+bool AsanLogger::AppendToLogBuffer(const std::string& message,
+                                   const DWORD* trace_data,
+                                   size_t trace_length) {
+  if (!log_buffer_.initialized())
+    return false;
+  if (log_buffer_.Append(message, trace_data, trace_length))
+    return true;
+
+  // The buffer is full, so make room and try again. A message that doesn't
+  // fit in an empty buffer is sent with an RPC.
+  FlushLogBuffer();
+  return log_buffer_.Append(message, trace_data, trace_length);
+}
+
+void AsanLogger::FlushLogBuffer() {
+  if (!log_buffer_.initialized())
+    return;
+  ::common::rpc::InvokeRpc(&LoggerClient_FlushLogBuffer, rpc_binding_.Get());
+}
+
 }  // namespace asan
 }  // namespace agent
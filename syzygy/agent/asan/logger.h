@@ -18,8 +18,10 @@
 #include <string>
 
 #include "base/logging.h"
+#include "base/win/scoped_handle.h"
 #include "syzygy/agent/asan/error_info.h"
 #include "syzygy/common/rpc/helpers.h"
+#include "syzygy/trace/common/log_buffer.h"
 
 namespace agent {
 namespace asan {
@@ -30,6 +32,7 @@ struct AsanErrorInfo;
 class AsanLogger {
  public:
   AsanLogger();
+  ~AsanLogger();
 
   // Set the RPC instance ID to use. If an instance-id is to be used by the
   // logger, it must be set before calling Init().
@@ -47,6 +50,15 @@ class AsanLogger {
   bool minidump_on_failure() const { return minidump_on_failure_; }
   void set_minidump_on_failure(bool value) { minidump_on_failure_ = value; }
 
+  // Set whether to send the messages through a log buffer shared with the
+  // logger, rather than with an RPC each. This must be set before calling
+  // Init().
+  bool use_log_buffer() const { return use_log_buffer_; }
+  void set_use_log_buffer(bool value) {
+    DCHECK(rpc_binding_.Get() == NULL);
+    use_log_buffer_ = value;
+  }
+
   // Initialize the logger.
   void Init();
 
@@ -80,6 +92,26 @@ class AsanLogger {
       const MemoryRanges& memory_ranges);
 
  protected:
+  // Has the logger create the log buffer, and maps it. On failure, the
+  // messages keep being sent with an RPC each.
+  void SetUpLogBuffer();
+
+  // Appends a message to the log buffer, if there is one. If the buffer is
+  // full, this waits until the logger has rendered it.
+  // @param message The message.
+  // @param trace_data The frames of the stack trace to attach to the message,
+  //     if any.
+  // @param trace_length The number of frames in @p trace_data.
+  // @returns true on success, false if the message must be sent with an RPC.
+  bool AppendToLogBuffer(const std::string& message,
+                         const DWORD* trace_data,
+                         size_t trace_length);
+
+  // Waits until the logger has rendered the pending records of the log
+  // buffer, if there is one. This keeps them in order with the requests sent
+  // with an RPC.
+  void FlushLogBuffer();
+
   // The RPC binding.
   ::common::rpc::ScopedRpcBinding rpc_binding_;
 
@@ -94,6 +126,16 @@ class AsanLogger {
   // Default: false.
   bool minidump_on_failure_;
 
+  // True if the messages should be sent through a log buffer.
+  // Default: false.
+  bool use_log_buffer_;
+
+  // The handle to the shared memory of the log buffer, its view in this
+  // process, and the log buffer itself.
+  base::win::ScopedHandle log_buffer_handle_;
+  void* log_buffer_view_;
+  trace::common::LogBuffer log_buffer_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(AsanLogger);
 };
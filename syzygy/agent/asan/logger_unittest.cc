@@ -45,6 +45,7 @@ using testing::Return;
 class TestAsanLogger : public AsanLogger {
  public:
   using AsanLogger::instance_id_;
+  using AsanLogger::log_buffer_;
   using AsanLogger::rpc_binding_;
 };
 
@@ -131,6 +132,67 @@ TEST_F(AsanLoggerTest, EndToEnd) {
   // TODO(rogerm): Inspect the contents of the minidump.
 }
 
+TEST_F(AsanLoggerTest, LogBuffer) {
+  const std::string kMessage1("This is the first message\n");
+  const std::string kMessage2("This is the second message\n");
+  const std::string kMessage3("This is the third message\n");
+
+  {
+    // Setup a log file destination.
+    base::ScopedFILE destination(base::OpenFile(temp_path_, "wb"));
+
+    // Start up the logging service.
+    trace::agent_logger::AgentLogger server;
+    trace::agent_logger::RpcLoggerInstanceManager instance_manager(&server);
+    server.set_instance_id(instance_id_);
+    server.set_destination(destination.get());
+    server.set_symbolize_stack_traces(false);
+    ASSERT_TRUE(server.Start());
+
+    // Use the AsanLogger client, through a log buffer.
+    client_.set_instance_id(instance_id_);
+    client_.set_use_log_buffer(true);
+    client_.Init();
+    ASSERT_TRUE(client_.rpc_binding_.Get() != NULL);
+    ASSERT_TRUE(client_.log_buffer_.initialized());
+
+    client_.Write(kMessage1);
+    const void* const kTrace[] = {
+        reinterpret_cast<const void*>(0x1000),
+        reinterpret_cast<const void*>(0x2000)};
+    client_.WriteWithStackTrace(kMessage2, kTrace, arraysize(kTrace));
+
+    // A message that doesn't fit in the log buffer is sent with an RPC, after
+    // the pending records.
+    std::string huge_message(
+        trace::agent_logger::AgentLogger::kLogBufferDataSize, 'x');
+    client_.Write(huge_message);
+    client_.Write(kMessage3);
+
+    // Shutdown the logging service. This renders the pending records.
+    ASSERT_TRUE(server.Stop());
+    ASSERT_TRUE(server.Join());
+  }
+
+  std::string content;
+  ASSERT_TRUE(base::ReadFileToString(temp_path_, &content));
+  size_t pos1 = content.find(kMessage1);
+  size_t pos2 = content.find(kMessage2);
+  size_t pos_huge = content.find("xxxx");
+  size_t pos3 = content.find(kMessage3);
+  ASSERT_NE(std::string::npos, pos1);
+  ASSERT_NE(std::string::npos, pos2);
+  ASSERT_NE(std::string::npos, pos_huge);
+  ASSERT_NE(std::string::npos, pos3);
+  EXPECT_LT(pos1, pos2);
+  EXPECT_LT(pos2, pos_huge);
+  EXPECT_LT(pos_huge, pos3);
+
+  // The stack trace has been rendered by the logger.
+  EXPECT_NE(std::string::npos, content.find("0x000000001000", pos2));
+  EXPECT_NE(std::string::npos, content.find("0x000000002000", pos2));
+}
+
 TEST_F(AsanLoggerTest, Stop) {
   // Setup a log file destination.
   base::ScopedFILE destination(base::OpenFile(temp_path_, "wb"));
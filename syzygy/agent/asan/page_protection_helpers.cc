@@ -14,6 +14,8 @@
 
 #include "syzygy/agent/asan/page_protection_helpers.h"
 
+#include "syzygy/common/align.h"
+
 namespace agent {
 namespace asan {
 
@@ -59,12 +61,47 @@ bool GetBlockInfo(const Shadow* shadow,
   return true;
 }
 
+bool GetBlockBodySize(const Shadow* shadow,
+                      const BlockBody* body,
+                      uint32_t* body_size) {
+  DCHECK_NE(static_cast<Shadow*>(nullptr), shadow);
+  DCHECK_NE(static_cast<BlockBody*>(nullptr), body);
+  DCHECK_NE(static_cast<uint32_t*>(nullptr), body_size);
+
+  // The size is used as a copy length by HeapReAlloc, so the header isn't
+  // trusted on its own: the shadow memory guards against a stale header in a
+  // body that merely looks like one, and BlockInfoFromMemory validates the
+  // layout against the trailer.
+  CompactBlockInfo block_info = {};
+  const uint8_t* addr_in_redzone = reinterpret_cast<const uint8_t*>(body) - 1;
+  bool found = false;
+  if (!shadow->PageIsProtected(addr_in_redzone)) {
+    BlockHeader* header = BlockGetHeaderFromBody(body);
+    found = header != nullptr && shadow->IsBlockStartByte(header) &&
+        BlockInfoFromMemory(header, &block_info);
+  }
+  if (!found && !shadow->BlockInfoFromShadow(body, &block_info))
+    return false;
+
+  *body_size = block_info.block_size - block_info.header_size -
+      block_info.trailer_size;
+  return true;
+}
+
 void BlockProtectNone(const BlockInfo& block_info, Shadow* shadow) {
   DCHECK_NE(static_cast<Shadow*>(nullptr), shadow);
   if (block_info.block_pages_size == 0)
     return;
 
   ::common::AutoRecursiveLock lock(block_protect_lock);
+  BlockProtectNoneUnlocked(block_info, shadow);
+}
+
+void BlockProtectNoneUnlocked(const BlockInfo& block_info, Shadow* shadow) {
+  DCHECK_NE(static_cast<Shadow*>(nullptr), shadow);
+  if (block_info.block_pages_size == 0)
+    return;
+
   DCHECK_NE(static_cast<uint8_t*>(nullptr), block_info.block_pages);
   DWORD old_protection = 0;
   DWORD ret = ::VirtualProtect(block_info.block_pages,
@@ -124,6 +161,27 @@ void BlockProtectAll(const BlockInfo& block_info, Shadow* shadow) {
                              block_info.block_pages_size);
 }
 
+bool BlockDecommitBodyPages(const BlockInfo& block_info) {
+  uintptr_t body_start = reinterpret_cast<uintptr_t>(block_info.body);
+  uintptr_t body_end = body_start + block_info.body_size;
+  body_start = ::common::AlignUp(body_start, GetPageSize());
+  body_end = ::common::AlignDown(body_end, GetPageSize());
+  if (body_start >= body_end)
+    return false;
+
+  ::common::AutoRecursiveLock lock(block_protect_lock);
+  void* pages = reinterpret_cast<void*>(body_start);
+  size_t pages_size = body_end - body_start;
+  if (!::VirtualFree(pages, pages_size, MEM_DECOMMIT))
+    return false;
+
+  // The pages belong to the heap that owns the block, so they have to be
+  // committed again before the block is handed back to it.
+  void* ret = ::VirtualAlloc(pages, pages_size, MEM_COMMIT, PAGE_READWRITE);
+  CHECK_EQ(pages, ret);
+  return true;
+}
+
 void BlockProtectAuto(const BlockInfo& block_info, Shadow* shadow) {
   DCHECK_NE(static_cast<Shadow*>(nullptr), shadow);
   if (block_info.block_pages_size == 0)
@@ -48,6 +48,21 @@ bool GetBlockInfo(const Shadow* shadow,
                   const BlockBody* body,
                   BlockInfo* block_info);
 
+// Given a pointer to the body of a block returns the size of the body. This
+// is a lighter version of GetBlockInfo: the layout is read from the header
+// and the trailer when the header is readable, the shadow memory confirms
+// that a block starts there and the layout is valid. Only otherwise is the
+// layout inferred from the shadow memory. The expanded block info is never
+// computed.
+// @param shadow The shadow to query.
+// @param body A pointer to the body of a block.
+// @param body_size Receives the size of the body.
+// @returns true if a valid block was encountered at the provided location,
+//     false otherwise.
+bool GetBlockBodySize(const Shadow* shadow,
+                      const BlockBody* body,
+                      uint32_t* body_size);
+
 // Unprotects all pages fully covered by the given block. All pages
 // intersecting but not fully covered by the block will be left in their
 // current state.
@@ -56,6 +71,13 @@ bool GetBlockInfo(const Shadow* shadow,
 // @note Under block_protect_lock.
 void BlockProtectNone(const BlockInfo& block_info, Shadow* shadow);
 
+// Same as BlockProtectNone, but doesn't acquire block_protect_lock. This is
+// meant for helper threads working on behalf of a thread that holds the lock,
+// which guarantees that nobody else is modifying the protections.
+// @param block_info The block whose protections are to be modified.
+// @param shadow The shadow to update.
+void BlockProtectNoneUnlocked(const BlockInfo& block_info, Shadow* shadow);
+
 // Protects all entire pages that are spanned by the redzones of the
 // block. All pages intersecting the body of the block will be explicitly
 // unprotected. All pages not intersecting the body but only partially
@@ -73,6 +95,15 @@ void BlockProtectRedzones(const BlockInfo& block_info, Shadow* shadow);
 // @note Under block_protect_lock.
 void BlockProtectAll(const BlockInfo& block_info, Shadow* shadow);
 
+// Decommits the pages entirely covered by the body of a block, and commits
+// them again. This releases their physical memory, and they read as zeros
+// until they are written again. The pages must not be protected.
+// @param block_info The block whose body pages are to be decommitted.
+// @returns true if the body of the block spans at least one whole page, and
+//     its pages have been decommitted, false otherwise.
+// @note Under block_protect_lock.
+bool BlockDecommitBodyPages(const BlockInfo& block_info);
+
 // Sets the block protections according to the block state. If in the allocated
 // state uses BlockProtectRedzones. If in quarantined or freed uses
 // BlockProtectAll.
@@ -249,6 +249,52 @@ TEST_F(PageProtectionHelpersTest, GetBlockInfo) {
   ::VirtualFree(alloc, layout.block_size, MEM_RELEASE);
 }
 
+TEST_F(PageProtectionHelpersTest, GetBlockBodySize) {
+  // Plan a layout that is subject to page protections.
+  BlockLayout layout = {};
+  BlockPlanLayout(4096, 4096, 4096, 4096, 4096, &layout);
+
+  void* alloc = ::VirtualAlloc(
+      nullptr, layout.block_size, MEM_COMMIT, PAGE_READWRITE);
+  ASSERT_TRUE(alloc != nullptr);
+  ::memset(alloc, 0, layout.block_size);
+
+  BlockInfo info = {};
+  BlockInitialize(layout, alloc, false, &info);
+  shadow_.PoisonAllocatedBlock(info);
+
+  // The size is read from the header in the usual case.
+  uint32_t body_size = 0;
+  EXPECT_TRUE(GetBlockBodySize(&shadow_, info.body, &body_size));
+  EXPECT_EQ(info.body_size, body_size);
+
+  // A corrupt header falls back to the shadow memory.
+  body_size = 0;
+  info.header->magic++;
+  EXPECT_TRUE(GetBlockBodySize(&shadow_, info.body, &body_size));
+  EXPECT_EQ(info.body_size, body_size);
+  info.header->magic--;
+
+  // So does a header whose body size doesn't match the layout.
+  body_size = 0;
+  uint32_t header_body_size = info.header->body_size;
+  info.header->body_size = header_body_size + 4096;
+  EXPECT_TRUE(GetBlockBodySize(&shadow_, info.body, &body_size));
+  EXPECT_EQ(info.body_size, body_size);
+  info.header->body_size = header_body_size;
+
+  // So does a protected header.
+  body_size = 0;
+  BlockProtectRedzones(info, &shadow_);
+  EXPECT_TRUE(GetBlockBodySize(&shadow_, info.body, &body_size));
+  EXPECT_EQ(info.body_size, body_size);
+  BlockProtectNone(info, &shadow_);
+
+  // Clean up.
+  shadow_.Unpoison(info.header, info.block_size);
+  ::VirtualFree(alloc, layout.block_size, MEM_RELEASE);
+}
+
 TEST_F(PageProtectionHelpersTest, ProtectionTransitions) {
   // Left and right guard pages, everything page aligned.
   EXPECT_NO_FATAL_FAILURE(TestAllProtectionTransitions(
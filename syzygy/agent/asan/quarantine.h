@@ -95,10 +95,92 @@ class QuarantineInterface {
   // @returns a PopResult.
   virtual PopResult Pop(Object* object) = 0;
 
+  // Places several objects in the quarantine. Unlike Push this routine must be
+  // thread-safe, and implement its own locking. Implementations are expected
+  // to take each lock only once for the whole batch; the default
+  // implementation simply pushes the objects one at a time.
+  // @param objects The objects to place in the quarantine.
+  // @param rejected Will receive the objects that could not be placed in the
+  //     quarantine. These are still owned by the caller.
+  // @returns a PushResult. The push is successful if at least one object made
+  //     it into the quarantine, and the trim status accounts for all of them.
+  virtual PushResult PushBatch(const ObjectVector& objects,
+                               ObjectVector* rejected) {
+    DCHECK_NE(static_cast<ObjectVector*>(nullptr), rejected);
+    PushResult result = {false, 0};
+    for (const auto& object : objects) {
+      AutoQuarantineLock quarantine_lock(this, object);
+      PushResult push_result = Push(object);
+      if (!push_result.push_successful) {
+        rejected->push_back(object);
+        continue;
+      }
+      result.push_successful = true;
+      result.trim_status |= push_result.trim_status;
+    }
+    return result;
+  }
+
+  // Removes up to |max_count| objects from the quarantine, stopping as soon as
+  // it has been trimmed down to |stop_color|. At least one object is removed if
+  // the quarantine is not GREEN. This routine must be thread-safe, and
+  // implement its own locking. Implementations are expected to take each lock
+  // only once for the whole batch; the default implementation simply pops the
+  // objects one at a time.
+  // @param stop_color The color at which to stop popping.
+  // @param max_count The maximum number of objects to remove.
+  // @param objects The removed objects will be appended to this vector.
+  // @returns a PopResult. The pop is successful if at least one object was
+  //     removed, and the color is the one of the quarantine post-pop.
+  virtual PopResult PopBatch(TrimColor stop_color,
+                             size_t max_count,
+                             ObjectVector* objects) {
+    DCHECK_NE(static_cast<ObjectVector*>(nullptr), objects);
+    PopResult result = {false, TrimColor::GREEN};
+    for (size_t i = 0; i < max_count; ++i) {
+      Object object = {};
+      PopResult pop_result = Pop(&object);
+      if (!pop_result.pop_successful)
+        break;
+      objects->push_back(object);
+      result = pop_result;
+      if (result.trim_color <= stop_color)
+        break;
+    }
+    return result;
+  }
+
   // Removes all objects from the quarantine, placing them in the provided
   // vector. This routine must be thread-safe, and implement its own locking.
   virtual void Empty(ObjectVector* objects) = 0;
 
+  // An interface for inspecting the objects in the quarantine.
+  class ObjectVisitor {
+   public:
+    virtual ~ObjectVisitor() { }
+
+    // Called for each visited object. The object can't be removed from the
+    // quarantine during this call.
+    // @param object The visited object.
+    virtual void Visit(const Object& object) = 0;
+  };
+
+  // Visits some of the objects in the quarantine, resuming where a previous
+  // call left off. This allows a quarantine to be inspected incrementally; as
+  // objects come and go between calls some of them may be visited twice or
+  // missed in a given pass. This routine must be thread-safe, and implement
+  // its own locking. The default implementation visits nothing.
+  // @param max_count The maximum number of objects to visit.
+  // @param cursor The position at which to resume the visit. This must be 0
+  //     for the first call, and is updated on return.
+  // @param visitor The visitor to invoke on the objects.
+  // @returns the number of objects visited.
+  virtual size_t VisitObjects(size_t max_count,
+                              size_t* cursor,
+                              ObjectVisitor* visitor) {
+    return 0;
+  }
+
   // The number of objects currently in the quarantine. Only used in testing, as
   // the implementation is racy.
   // @returns the number of objects in the quarantine.
@@ -18,7 +18,7 @@
 #define SYZYGY_AGENT_ASAN_QUARANTINES_SHARDED_QUARANTINE_H_
 
 #include "base/synchronization/lock.h"
-#include "syzygy/agent/asan/page_allocator.h"
+#include "syzygy/agent/asan/lock_free_page_allocator.h"
 #include "syzygy/agent/asan/quarantines/size_limited_quarantine.h"
 
 namespace agent {
@@ -59,6 +59,15 @@ class ShardedQuarantine
   // Virtual destructor.
   virtual ~ShardedQuarantine() { }
 
+  // @name QuarantineInterface implementation.
+  // @{
+  // The cursor identifies a shard and a position in that shard. The shards
+  // are locked one at a time.
+  size_t VisitObjects(size_t max_count,
+                      size_t* cursor,
+                      ObjectVisitor* visitor) override;
+  // @}
+
  protected:
   // @name SizeLimitedQuarantineImpl implementation.
   // @{
@@ -68,6 +77,11 @@ class ShardedQuarantine
   size_t GetLockIdImpl(const Object& object) override;
   void LockImpl(size_t id) override;
   void UnlockImpl(size_t id) override;
+  void PushBatchImpl(const ObjectVector& objects,
+                     ObjectVector* rejected) override;
+  size_t PopBatchImpl(size_t size,
+                      size_t max_count,
+                      ObjectVector* objects) override;
   // @}
 
   // The internal type used for storing objects. This augments them with a
@@ -79,13 +93,15 @@ class ShardedQuarantine
   };
 
   // A simple page allocator that can only allocate individual nodes, and
-  // does no bookkeeping. This has its own synchronization primitives.
+  // does no bookkeeping. Its free list is lock-free, so the batched
+  // operations that allocate and free nodes outside of the shard locks don't
+  // serialize on it.
   // Typical quarantine sizes are 16MB, which is about 120K allocations
   // given Chrome's typical allocation size. This in turn translates to
   // about 1MB of Node data. Typical 16 way sharding means about 65KB.
   // All of this to justify a 32KB page size to balance fragmentation and
   // number of pages, and to respect the system allocation granularity.
-  typedef TypedPageAllocator<Node, 1, 32 * 1024, false> NodeCache;
+  typedef TypedLockFreePageAllocator<Node, 1, 32 * 1024> NodeCache;
 
   // Linked lists containing quarantined objects. Each shard is under the
   // corresponding locks_ entry. Objects are inserted at the tail, and
@@ -93,7 +109,7 @@ class ShardedQuarantine
   Node* heads_[kShardingFactor];
   Node* tails_[kShardingFactor];
 
-  // Storage for nodes, one per shard. Each is under its own internal lock.
+  // Storage for nodes, one per shard. Each is internally synchronized.
   NodeCache node_caches_[kShardingFactor];
 
   // Locks, one per linked list.
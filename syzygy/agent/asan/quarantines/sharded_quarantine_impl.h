@@ -61,6 +61,43 @@ ShardedQuarantine<OT, SFT, HFT, SF>::ShardedQuarantine(
   ::memset(tails_, 0, sizeof(tails_));
 }
 
+template<typename OT, typename SFT, typename HFT, size_t SF>
+size_t ShardedQuarantine<OT, SFT, HFT, SF>::VisitObjects(
+    size_t max_count,
+    size_t* cursor,
+    ObjectVisitor* visitor) {
+  DCHECK_NE(static_cast<size_t*>(NULL), cursor);
+  DCHECK_NE(static_cast<ObjectVisitor*>(NULL), visitor);
+
+  // The cursor encodes the shard and the position of the next object in it.
+  size_t shard = *cursor % kShardingFactor;
+  size_t position = *cursor / kShardingFactor;
+
+  // Visit the shards in turn, going around them at most once.
+  size_t count = 0;
+  for (size_t i = 0; i < kShardingFactor && count < max_count; ++i) {
+    {
+      base::AutoLock lock(locks_[shard]);
+      Node* node = heads_[shard];
+      for (size_t j = 0; j < position && node != NULL; ++j)
+        node = node->next;
+      for (; node != NULL && count < max_count; node = node->next) {
+        visitor->Visit(node->object);
+        ++position;
+        ++count;
+      }
+      // Stay on this shard if it hasn't been visited entirely.
+      if (node != NULL)
+        break;
+    }
+    shard = (shard + 1) % kShardingFactor;
+    position = 0;
+  }
+
+  *cursor = shard + position * kShardingFactor;
+  return count;
+}
+
 template<typename OT, typename SFT, typename HFT, size_t SF>
 bool ShardedQuarantine<OT, SFT, HFT, SF>::PushImpl(const Object& object) {
   size_t hash = hash_functor_(object);
@@ -124,6 +161,101 @@ bool ShardedQuarantine<OT, SFT, HFT, SF>::PopImpl(Object* object) {
   return true;
 }
 
+template<typename OT, typename SFT, typename HFT, size_t SF>
+void ShardedQuarantine<OT, SFT, HFT, SF>::PushBatchImpl(
+    const ObjectVector& objects,
+    ObjectVector* rejected) {
+  DCHECK_NE(static_cast<ObjectVector*>(NULL), rejected);
+
+  // Chain the objects by shard first. The node caches are lock-free, so
+  // this doesn't require holding any of the shard locks.
+  Node* heads[kShardingFactor] = {};
+  Node* tails[kShardingFactor] = {};
+  for (const auto& object : objects) {
+    size_t hash = hash_functor_(object);
+    size_t shard = detail::ShardedQuarantineHash<kShardingFactor>(hash);
+    Node* node = node_caches_[shard].Allocate(1);
+    if (node == NULL) {
+      rejected->push_back(object);
+      continue;
+    }
+    node->object = object;
+    node->next = NULL;
+    if (tails[shard] != NULL) {
+      tails[shard]->next = node;
+    } else {
+      heads[shard] = node;
+    }
+    tails[shard] = node;
+  }
+
+  // Append each chain to the tail of its shard, taking each lock only once.
+  for (size_t i = 0; i < kShardingFactor; ++i) {
+    if (heads[i] == NULL)
+      continue;
+    base::AutoLock lock(locks_[i]);
+    if (tails_[i] != NULL) {
+      DCHECK_NE(static_cast<Node*>(NULL), heads_[i]);
+      tails_[i]->next = heads[i];
+    } else {
+      DCHECK_EQ(static_cast<Node*>(NULL), heads_[i]);
+      heads_[i] = heads[i];
+    }
+    tails_[i] = tails[i];
+  }
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+size_t ShardedQuarantine<OT, SFT, HFT, SF>::PopBatchImpl(
+    size_t size,
+    size_t max_count,
+    ObjectVector* objects) {
+  DCHECK_NE(static_cast<ObjectVector*>(NULL), objects);
+
+  // Start from a random shard like PopImpl, but detach as many nodes as
+  // possible from the head of each visited shard under a single lock
+  // acquisition. Move on to the following shards only if that wasn't enough.
+  size_t popped_size = 0;
+  size_t popped_count = 0;
+  size_t shard = rand() % kShardingFactor;
+  for (size_t i = 0; i < kShardingFactor; ++i) {
+    if (popped_size >= size || popped_count >= max_count)
+      break;
+
+    Node* head = NULL;
+    {
+      base::AutoLock lock(locks_[shard]);
+      Node* tail = NULL;
+      Node* node = heads_[shard];
+      while (node != NULL && popped_size < size && popped_count < max_count) {
+        popped_size += this->size_functor_(node->object);
+        ++popped_count;
+        tail = node;
+        node = node->next;
+      }
+      if (tail != NULL) {
+        head = heads_[shard];
+        tail->next = NULL;
+        heads_[shard] = node;
+        if (node == NULL)
+          tails_[shard] = NULL;
+      }
+    }
+
+    // The detached nodes are copied out and freed outside of the shard lock.
+    while (head != NULL) {
+      objects->push_back(head->object);
+      Node* next_node = head->next;
+      node_caches_[shard].Free(head, 1);
+      head = next_node;
+    }
+
+    shard = (shard + 1) % kShardingFactor;
+  }
+
+  return popped_size;
+}
+
 template<typename OT, typename SFT, typename HFT, size_t SF>
 void ShardedQuarantine<OT, SFT, HFT, SF>::EmptyImpl(ObjectVector* objects) {
   DCHECK_NE(static_cast<ObjectVector*>(NULL), objects);
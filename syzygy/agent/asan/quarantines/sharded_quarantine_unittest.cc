@@ -86,6 +86,16 @@ class TestShardedQuarantine
   std::set<size_t> lock_set_;
 };
 
+// A visitor that records the hashes of the objects it visits.
+class HashRecordingVisitor : public TestShardedQuarantine::ObjectVisitor {
+ public:
+  void Visit(const DummyObject& object) override {
+    hashes_.insert(object.hash);
+  }
+
+  std::set<size_t> hashes_;
+};
+
 }  // namespace
 
 TEST(ShardedQuarantineTest, EvenLoading) {
@@ -192,6 +202,105 @@ TEST(ShardedQuarantineTest, StressTest) {
   EXPECT_EQ(old_size, emptied_size);
 }
 
+TEST(ShardedQuarantineTest, PushAndPopBatch) {
+  TestShardedQuarantine q;
+  q.set_max_object_size(10);
+  q.set_max_quarantine_size(100);
+
+  // Spread a batch over all of the shards, with one object that is too big.
+  DummyObjectVector batch;
+  for (size_t i = 0; i < 50; ++i) {
+    DummyObject d(2);
+    d.hash = i;
+    batch.push_back(d);
+  }
+  batch.push_back(DummyObject(20));
+
+  DummyObjectVector rejected;
+  PushResult push_result = q.PushBatch(batch, &rejected);
+  EXPECT_TRUE(push_result.push_successful);
+  EXPECT_EQ(TRIM_NOT_REQUIRED, push_result.trim_status);
+  ASSERT_EQ(1u, rejected.size());
+  EXPECT_EQ(20u, rejected[0].size);
+  EXPECT_EQ(100u, q.GetSizeForTesting());
+  EXPECT_EQ(50u, q.GetCountForTesting());
+  size_t shard_count = 0;
+  for (size_t i = 0; i < q.kShardingFactor; ++i)
+    shard_count += q.ShardCount(i);
+  EXPECT_EQ(50u, shard_count);
+
+  // Go over budget.
+  batch.resize(10);
+  rejected.clear();
+  push_result = q.PushBatch(batch, &rejected);
+  EXPECT_TRUE(push_result.push_successful);
+  EXPECT_NE(0u, push_result.trim_status & SYNC_TRIM_REQUIRED);
+  EXPECT_TRUE(rejected.empty());
+  EXPECT_EQ(120u, q.GetSizeForTesting());
+
+  // The batch size is honored.
+  DummyObjectVector popped;
+  PopResult pop_result = q.PopBatch(TrimColor::YELLOW, 3, &popped);
+  EXPECT_TRUE(pop_result.pop_successful);
+  EXPECT_EQ(TrimColor::BLACK, pop_result.trim_color);
+  EXPECT_EQ(3u, popped.size());
+  EXPECT_EQ(114u, q.GetSizeForTesting());
+
+  // Popping stops as soon as the stop color is reached.
+  popped.clear();
+  pop_result = q.PopBatch(TrimColor::YELLOW, 100, &popped);
+  EXPECT_TRUE(pop_result.pop_successful);
+  EXPECT_GE(TrimColor::YELLOW, pop_result.trim_color);
+  EXPECT_EQ(7u, popped.size());
+  EXPECT_EQ(100u, q.GetSizeForTesting());
+  EXPECT_EQ(50u, q.GetCountForTesting());
+
+  popped.clear();
+  EXPECT_FALSE(q.PopBatch(TrimColor::YELLOW, 100, &popped).pop_successful);
+  EXPECT_TRUE(popped.empty());
+
+  DummyObjectVector emptied;
+  q.Empty(&emptied);
+  EXPECT_EQ(50u, emptied.size());
+  EXPECT_EQ(0u, q.GetSizeForTesting());
+  EXPECT_EQ(0u, q.GetCountForTesting());
+}
+
+TEST(ShardedQuarantineTest, VisitObjects) {
+  TestShardedQuarantine q;
+  q.set_max_object_size(TestShardedQuarantine::kUnboundedSize);
+  q.set_max_quarantine_size(1000);
+
+  HashRecordingVisitor visitor;
+  size_t cursor = 0;
+  EXPECT_EQ(0u, q.VisitObjects(10, &cursor, &visitor));
+  EXPECT_TRUE(visitor.hashes_.empty());
+
+  DummyObjectVector batch;
+  for (size_t i = 0; i < 50; ++i) {
+    DummyObject d(1);
+    d.hash = i;
+    batch.push_back(d);
+  }
+  DummyObjectVector rejected;
+  EXPECT_TRUE(q.PushBatch(batch, &rejected).push_successful);
+
+  // The visit is done in bounded steps, and covers all of the objects.
+  cursor = 0;
+  size_t visited = 0;
+  for (size_t i = 0; i < 5; ++i)
+    visited += q.VisitObjects(10, &cursor, &visitor);
+  EXPECT_EQ(50u, visited);
+  EXPECT_EQ(50u, visitor.hashes_.size());
+
+  // The objects are still in the quarantine, and the visit wraps around.
+  EXPECT_EQ(50u, q.GetCountForTesting());
+  EXPECT_EQ(10u, q.VisitObjects(10, &cursor, &visitor));
+
+  DummyObjectVector emptied;
+  q.Empty(&emptied);
+}
+
 TEST(ShardedQuarantineTest, LockUnlock) {
   TestShardedQuarantine q;
   DummyObject dummy;
@@ -124,6 +124,10 @@ class ScopedQuarantineSizeCountLock {
 //   bool PopImpl(ObjectType* object);
 //   void EmptyImpl(ObjectVector* object);
 //
+// The batched PushBatch/PopBatch methods are implemented on top of
+// PushBatchImpl/PopBatchImpl, which default to the single object versions.
+// Derived classes can override these to amortize their locking.
+//
 // Calculates the sizes of objects using the provided SizeFunctor. This
 // must satisfy the following interface:
 //
@@ -229,6 +233,11 @@ class SizeLimitedQuarantineImpl : public QuarantineInterface<ObjectType> {
   // @{
   virtual PushResult Push(const Object& object);
   virtual PopResult Pop(Object* object);
+  virtual PushResult PushBatch(const ObjectVector& objects,
+                               ObjectVector* rejected);
+  virtual PopResult PopBatch(TrimColor stop_color,
+                             size_t max_count,
+                             ObjectVector* objects);
   virtual void Empty(ObjectVector* objects);
   virtual size_t GetCountForTesting();
   virtual size_t GetLockId(const Object& object);
@@ -247,6 +256,38 @@ class SizeLimitedQuarantineImpl : public QuarantineInterface<ObjectType> {
   virtual void UnlockImpl(size_t id) = 0;
   // @}
 
+  // @name Batched SizeLimitedQuarantine interface. These are called without
+  //     any lock held, and the default implementations defer to the single
+  //     object functions above.
+  // @{
+  // Pushes a batch of objects.
+  // @param objects The objects to push.
+  // @param rejected Will receive the objects that could not be pushed.
+  virtual void PushBatchImpl(const ObjectVector& objects,
+                             ObjectVector* rejected);
+  // Pops objects until their cumulative size reaches |size|, or until
+  // |max_count| objects have been popped.
+  // @param size The cumulative size of the objects to pop.
+  // @param max_count The maximum number of objects to pop.
+  // @param objects The popped objects will be appended to this vector.
+  // @returns the cumulative size of the popped objects.
+  virtual size_t PopBatchImpl(size_t size,
+                              size_t max_count,
+                              ObjectVector* objects);
+  // @}
+
+  // Returns the maximum size of a certain color. This is racy in the same way
+  // as GetQuarantineColor.
+  // @param color The color for which the size is queried.
+  // @returns the size.
+  size_t GetMaxSizeForColor(TrimColor color) const;
+
+  // Determines the trimming required after the size of the quarantine grew.
+  // @param old_size The size of the quarantine before the push.
+  // @param new_size The size of the quarantine after the push.
+  // @returns the required trim status.
+  TrimStatus GetTrimStatus(size_t old_size, size_t new_size) const;
+
   // Parameters controlling the quarantine invariant.
   size_t max_object_size_;
   size_t max_quarantine_size_;
@@ -54,33 +54,7 @@ PushResult SizeLimitedQuarantineImpl<OT, SFT>::Push(const Object& object) {
     new_size = size_count_.Decrement(size, 1);
   }
 
-  // Note that because GetQuarantineColor can return the wrong color (see note
-  // in its implementation), this function might miss a transition to RED/BLACK
-  // which would result in not signaling the asynchronous thread (under
-  // signaling). This is a tradeoff for not having to lock the overbudget size.
-  // As for the synchronous trimming, unless the wrong color is returned forever
-  // (which would obviously be a bug), it will eventually be signaled when BLACK
-  // is returned (regardless of transition).
-  TrimColor new_color = GetQuarantineColor(new_size);
-  TrimColor old_color = GetQuarantineColor(old_size);
-
-  if (new_color == TrimColor::BLACK) {
-    // If the current color is BLACK, always request synchronous trimming. As
-    // stated above, this ensures that regardless of the transition, the
-    // quarantine will eventually get trimmed (no "run away" situation should be
-    // possible).
-    result.trim_status |= TrimStatusBits::SYNC_TRIM_REQUIRED;
-    if (old_color < TrimColor::RED) {
-      // If going from GREEN/YELLOW to BLACK, also schedule asynchronous
-      // trimming (this is by design to improve the performance).
-      result.trim_status |= TrimStatusBits::ASYNC_TRIM_REQUIRED;
-    }
-  } else if (new_color == TrimColor::RED) {
-    if (old_color < TrimColor::RED) {
-      // If going from GREEN/YELLOW to RED, schedule asynchronous trimming.
-      result.trim_status |= TrimStatusBits::ASYNC_TRIM_REQUIRED;
-    }
-  }
+  result.trim_status = GetTrimStatus(old_size, new_size);
   return result;
 }
 
@@ -122,6 +96,102 @@ PopResult SizeLimitedQuarantineImpl<OT, SFT>::Pop(Object* object) {
   return result;
 }
 
+template <typename OT, typename SFT>
+PushResult SizeLimitedQuarantineImpl<OT, SFT>::PushBatch(
+    const ObjectVector& objects,
+    ObjectVector* rejected) {
+  DCHECK_NE(static_cast<ObjectVector*>(NULL), rejected);
+  PushResult result = {false, 0};
+
+  // Objects that are too big are rejected up front, as in Push. Only pay for
+  // a filtered copy of the batch if there are any.
+  const ObjectVector* objects_to_push = &objects;
+  ObjectVector filtered_objects;
+  if (max_object_size_ != kUnboundedSize) {
+    for (const auto& object : objects) {
+      if (size_functor_(object) <= max_object_size_)
+        continue;
+      for (const auto& o : objects) {
+        if (size_functor_(o) > max_object_size_)
+          rejected->push_back(o);
+        else
+          filtered_objects.push_back(o);
+      }
+      objects_to_push = &filtered_objects;
+      break;
+    }
+  }
+
+  if (objects_to_push->empty())
+    return result;
+  size_t size = 0;
+  for (const auto& object : *objects_to_push)
+    size += size_functor_(object);
+
+  // Account for the whole batch at once. See the notes in Push about the
+  // consistency of the size and count.
+  size_t new_size = 0;
+  {
+    ScopedQuarantineSizeCountLock size_count_lock(size_count_);
+    new_size = size_count_.Increment(size, objects_to_push->size());
+  }
+  size_t old_size = new_size - size;
+
+  // Back out the objects that the implementation failed to push.
+  size_t first_rejected = rejected->size();
+  PushBatchImpl(*objects_to_push, rejected);
+  size_t rejected_count = rejected->size() - first_rejected;
+  if (rejected_count != 0) {
+    size_t rejected_size = 0;
+    for (size_t i = first_rejected; i < rejected->size(); ++i)
+      rejected_size += size_functor_(rejected->at(i));
+    ScopedQuarantineSizeCountLock size_count_lock(size_count_);
+    new_size = size_count_.Decrement(rejected_size, rejected_count);
+  }
+
+  result.push_successful = rejected_count < objects_to_push->size();
+  result.trim_status = GetTrimStatus(old_size, new_size);
+  return result;
+}
+
+template <typename OT, typename SFT>
+PopResult SizeLimitedQuarantineImpl<OT, SFT>::PopBatch(
+    TrimColor stop_color,
+    size_t max_count,
+    ObjectVector* objects) {
+  DCHECK_NE(static_cast<ObjectVector*>(NULL), objects);
+  PopResult result = {false, TrimColor::GREEN};
+
+  if (max_quarantine_size_ == kUnboundedSize || max_count == 0)
+    return result;
+
+  // Work out how much needs to be popped to reach |stop_color|. This always
+  // pops at least one object, like a sequence of calls to Pop would. See the
+  // note in Pop about the raciness of this.
+  size_t size_to_pop = 0;
+  {
+    ScopedQuarantineSizeCountLock size_count_lock(size_count_);
+    size_t size = size_count_.size();
+    if (GetQuarantineColor(size) == TrimColor::GREEN)
+      return result;
+    size_t stop_size = GetMaxSizeForColor(stop_color);
+    size_to_pop = size > stop_size ? size - stop_size : 1;
+  }
+
+  size_t count = objects->size();
+  size_t size = PopBatchImpl(size_to_pop, max_count, objects);
+  count = objects->size() - count;
+  if (count == 0)
+    return result;
+
+  ScopedQuarantineSizeCountLock size_count_lock(size_count_);
+  size_t new_size = size_count_.Decrement(size, count);
+
+  result.pop_successful = true;
+  result.trim_color = GetQuarantineColor(new_size);
+  return result;
+}
+
 template<typename OT, typename SFT>
 void SizeLimitedQuarantineImpl<OT, SFT>::Empty(
     ObjectVector* objects) {
@@ -165,6 +235,36 @@ void SizeLimitedQuarantineImpl<OT, SFT>::Unlock(size_t id) {
   UnlockImpl(id);
 }
 
+template <typename OT, typename SFT>
+void SizeLimitedQuarantineImpl<OT, SFT>::PushBatchImpl(
+    const ObjectVector& objects,
+    ObjectVector* rejected) {
+  for (const auto& object : objects) {
+    size_t id = GetLockIdImpl(object);
+    LockImpl(id);
+    bool pushed = PushImpl(object);
+    UnlockImpl(id);
+    if (!pushed)
+      rejected->push_back(object);
+  }
+}
+
+template <typename OT, typename SFT>
+size_t SizeLimitedQuarantineImpl<OT, SFT>::PopBatchImpl(
+    size_t size,
+    size_t max_count,
+    ObjectVector* objects) {
+  size_t popped_size = 0;
+  for (size_t i = 0; i < max_count && popped_size < size; ++i) {
+    Object object = {};
+    if (!PopImpl(&object))
+      break;
+    popped_size += size_functor_(object);
+    objects->push_back(object);
+  }
+  return popped_size;
+}
+
 template <typename OT, typename SFT>
 TrimColor SizeLimitedQuarantineImpl<OT, SFT>::GetQuarantineColor(
     size_t size) const {
@@ -212,10 +312,16 @@ TrimColor SizeLimitedQuarantineImpl<OT, SFT>::GetQuarantineColor(
 template <typename OT, typename SFT>
 size_t SizeLimitedQuarantineImpl<OT, SFT>::GetMaxSizeForColorForTesting(
     TrimColor color) const {
+  return GetMaxSizeForColor(color);
+}
+
+template <typename OT, typename SFT>
+size_t SizeLimitedQuarantineImpl<OT, SFT>::GetMaxSizeForColor(
+    TrimColor color) const {
   // Note that this is racy by design, to avoid contention. If
   // |overbudget_size_| is modified before the end of the function, the wrong
-  // size can be returned. Since this function is only used in testing, this is
-  // not an issue.
+  // size can be returned. Callers only use this as a trimming target, so this
+  // is not an issue.
   if (color == TrimColor::BLACK || max_quarantine_size_ == kUnboundedSize)
     return kUnboundedSize;
 
@@ -235,6 +341,42 @@ size_t SizeLimitedQuarantineImpl<OT, SFT>::GetMaxSizeForColorForTesting(
   return kUnboundedSize;
 }
 
+template <typename OT, typename SFT>
+TrimStatus SizeLimitedQuarantineImpl<OT, SFT>::GetTrimStatus(
+    size_t old_size,
+    size_t new_size) const {
+  TrimStatus trim_status = TRIM_NOT_REQUIRED;
+
+  // Note that because GetQuarantineColor can return the wrong color (see note
+  // in its implementation), this function might miss a transition to RED/BLACK
+  // which would result in not signaling the asynchronous thread (under
+  // signaling). This is a tradeoff for not having to lock the overbudget size.
+  // As for the synchronous trimming, unless the wrong color is returned forever
+  // (which would obviously be a bug), it will eventually be signaled when BLACK
+  // is returned (regardless of transition).
+  TrimColor new_color = GetQuarantineColor(new_size);
+  TrimColor old_color = GetQuarantineColor(old_size);
+
+  if (new_color == TrimColor::BLACK) {
+    // If the current color is BLACK, always request synchronous trimming. As
+    // stated above, this ensures that regardless of the transition, the
+    // quarantine will eventually get trimmed (no "run away" situation should be
+    // possible).
+    trim_status |= TrimStatusBits::SYNC_TRIM_REQUIRED;
+    if (old_color < TrimColor::RED) {
+      // If going from GREEN/YELLOW to BLACK, also schedule asynchronous
+      // trimming (this is by design to improve the performance).
+      trim_status |= TrimStatusBits::ASYNC_TRIM_REQUIRED;
+    }
+  } else if (new_color == TrimColor::RED) {
+    if (old_color < TrimColor::RED) {
+      // If going from GREEN/YELLOW to RED, schedule asynchronous trimming.
+      trim_status |= TrimStatusBits::ASYNC_TRIM_REQUIRED;
+    }
+  }
+  return trim_status;
+}
+
 template <typename OT, typename SFT>
 void SizeLimitedQuarantineImpl<OT, SFT>::SetOverbudgetSize(
     size_t overbudget_size) {
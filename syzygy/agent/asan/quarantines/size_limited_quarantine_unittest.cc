@@ -166,6 +166,52 @@ TEST(SizeLimitedQuarantineTest, EmptyWorks) {
   EXPECT_THAT(os, testing::ElementsAre(o, o, o));
 }
 
+TEST(SizeLimitedQuarantineTest, PushAndPopBatch) {
+  TestQuarantine q;
+  q.set_max_object_size(20);
+  q.set_max_quarantine_size(50);
+
+  DummyObjectVector batch;
+  batch.push_back(DummyObject(10));
+  batch.push_back(DummyObject(30));
+  batch.push_back(DummyObject(20));
+  batch.push_back(DummyObject(20));
+
+  DummyObjectVector rejected;
+  PushResult push_result = q.PushBatch(batch, &rejected);
+  EXPECT_TRUE(push_result.push_successful);
+  EXPECT_EQ(TRIM_NOT_REQUIRED, push_result.trim_status);
+  EXPECT_THAT(rejected, testing::ElementsAre(DummyObject(30)));
+  EXPECT_EQ(50u, q.GetSizeForTesting());
+  EXPECT_EQ(3u, q.GetCountForTesting());
+
+  // Everything in the batch is rejected.
+  rejected.clear();
+  batch.assign(2, DummyObject(30));
+  push_result = q.PushBatch(batch, &rejected);
+  EXPECT_FALSE(push_result.push_successful);
+  EXPECT_EQ(2u, rejected.size());
+  EXPECT_EQ(50u, q.GetSizeForTesting());
+
+  // Nothing to pop while the invariant holds.
+  DummyObjectVector popped;
+  EXPECT_FALSE(q.PopBatch(TrimColor::GREEN, 10, &popped).pop_successful);
+
+  batch.assign(1, DummyObject(15));
+  rejected.clear();
+  EXPECT_TRUE(q.PushBatch(batch, &rejected).push_successful);
+  EXPECT_EQ(65u, q.GetSizeForTesting());
+
+  // The most recent objects come out first in this quarantine, until enough
+  // has been popped.
+  PopResult pop_result = q.PopBatch(TrimColor::GREEN, 10, &popped);
+  EXPECT_TRUE(pop_result.pop_successful);
+  EXPECT_EQ(TrimColor::GREEN, pop_result.trim_color);
+  EXPECT_THAT(popped, testing::ElementsAre(DummyObject(15)));
+  EXPECT_EQ(50u, q.GetSizeForTesting());
+  EXPECT_EQ(3u, q.GetCountForTesting());
+}
+
 TEST(SizeLimitedQuarantineTest, GetQuarantineColor) {
   const size_t kMaxSize = 1000;
   const size_t kOverbudgetSize = 10;
@@ -18,6 +18,8 @@
 
 #include <windows.h>
 
+#include "syzygy/agent/asan/runtime_counters.h"
+
 namespace agent {
 namespace asan {
 
@@ -111,6 +113,12 @@ typedef void(WINAPI* AsanExperimentCallback)(const char* experiment_name,
 void WINAPI asan_EnumExperiments(AsanExperimentCallback callback);
 // @}
 
+// Gets the counters of the runtime.
+// @param counters Receives the counters. Its size field must be set to the
+//     size of the structure, and is updated to the number of bytes written.
+// @returns TRUE on success, FALSE otherwise.
+BOOL WINAPI asan_GetRuntimeCounters(AsanRuntimeCounters* counters);
+
 int asan_CrashForException(EXCEPTION_POINTERS* exception);
 
 }  // extern "C"
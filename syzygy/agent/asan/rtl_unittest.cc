@@ -667,5 +667,43 @@ TEST_F(AsanRtlTest, EnumFeatures) {
   EXPECT_EQ(3U, experiments.size());
 }
 
+TEST_F(AsanRtlTest, GetRuntimeCounters) {
+  typedef BOOL(WINAPI * GetRuntimeCountersFn)(AsanRuntimeCounters* counters);
+
+  GetRuntimeCountersFn get_runtime_counters_fn =
+      reinterpret_cast<GetRuntimeCountersFn>(
+          ::GetProcAddress(asan_rtl_, "asan_GetRuntimeCounters"));
+  ASSERT_TRUE(get_runtime_counters_fn != nullptr);
+
+  AsanRuntimeCounters before = {};
+  before.size = sizeof(before);
+  ASSERT_TRUE(get_runtime_counters_fn(&before));
+  EXPECT_EQ(sizeof(before), before.size);
+
+  void* mem = HeapAllocFunction(heap_, 0, kAllocSize);
+  ASSERT_NE(static_cast<void*>(nullptr), mem);
+  ASSERT_TRUE(HeapFreeFunction(heap_, 0, mem));
+
+  AsanRuntimeCounters after = {};
+  after.size = sizeof(after);
+  ASSERT_TRUE(get_runtime_counters_fn(&after));
+  EXPECT_EQ(before.allocation_count + 1, after.allocation_count);
+  EXPECT_EQ(before.allocated_bytes + static_cast<int64_t>(kAllocSize),
+            after.allocated_bytes);
+  EXPECT_EQ(before.free_count + 1, after.free_count);
+
+  // Only as much as the caller knows about is written.
+  AsanRuntimeCounters truncated = {};
+  truncated.size = offsetof(AsanRuntimeCounters, free_count);
+  truncated.free_count = 42;
+  ASSERT_TRUE(get_runtime_counters_fn(&truncated));
+  EXPECT_EQ(offsetof(AsanRuntimeCounters, free_count), truncated.size);
+  EXPECT_EQ(42, truncated.free_count);
+
+  AsanRuntimeCounters too_small = {};
+  too_small.size = sizeof(too_small.size);
+  EXPECT_FALSE(get_runtime_counters_fn(&too_small));
+}
+
 }  // namespace asan
 }  // namespace agent
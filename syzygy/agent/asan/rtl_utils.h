@@ -19,13 +19,13 @@
 #include <windows.h>
 
 #include "syzygy/agent/asan/error_info.h"
+#include "syzygy/agent/asan/shadow.h"
 
 namespace agent {
 namespace asan {
 
 // Forward declarations.
 class AsanRuntime;
-class Shadow;
 
 // Contents of the registers before calling the Asan memory check function.
 // Note: the order of fields is significant!
@@ -93,6 +93,33 @@ void TestMemoryRange(Shadow* shadow,
                      size_t size,
                      AccessMode access_mode);
 
+// Test that a memory range is accessible, like TestMemoryRange, with a fast
+// path for the ranges of at most kMaxSmallRangeSize bytes. For those, the
+// shadow bytes of both ends of the range are read directly and
+// TestMemoryRange is only called if one of them isn't zero, e.g. when the
+// range ends in a partially accessible word.
+// @param shadow The shadow memory to use.
+// @param memory The pointer to the beginning of the memory range that we want
+//     to check.
+// @param size The size of the memory range that we want to check.
+// @param access_mode The access mode.
+inline void TestSmallMemoryRange(Shadow* shadow,
+                                 const uint8_t* memory,
+                                 size_t size,
+                                 AccessMode access_mode) {
+  if (shadow != nullptr && size != 0U && size <= kMaxSmallRangeSize) {
+    uintptr_t first = reinterpret_cast<uintptr_t>(memory);
+    uintptr_t last = first + size - 1;
+    first >>= kShadowRatioLog;
+    last >>= kShadowRatioLog;
+    if (first <= last && last < shadow->length() &&
+        (shadow->shadow()[first] | shadow->shadow()[last]) == 0) {
+      return;
+    }
+  }
+  TestMemoryRange(shadow, memory, size, access_mode);
+}
+
 // Helper function to test if the memory range of a given structure is
 // accessible.
 // @tparam T the type of the structure to be tested.
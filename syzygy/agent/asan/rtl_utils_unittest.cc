@@ -142,6 +142,32 @@ TEST(AsanRtlUtilsTest, TestMemoryRange) {
   runtime.shadow()->Unpoison(test_buffer.get(), kTestBufferSize);
 }
 
+TEST(AsanRtlUtilsTest, TestSmallMemoryRange) {
+  TestAsanRuntime runtime;
+  SetAsanRuntimeInstance(&runtime);
+  AccessMode access_mode = ASAN_WRITE_ACCESS;
+  const size_t kTestBufferSize = 2 * kMaxSmallRangeSize;
+  std::unique_ptr<uint8_t[]> test_buffer(new uint8_t[kTestBufferSize]);
+
+  // Poison the second half of the buffer.
+  runtime.shadow()->Poison(test_buffer.get() + kTestBufferSize / 2,
+                           kTestBufferSize / 2, kUserRedzoneMarker);
+
+  TestSmallMemoryRange(runtime.shadow(), test_buffer.get(),
+                       kMaxSmallRangeSize, access_mode);
+  EXPECT_FALSE(memory_error_detected);
+
+  // A small range straddling the poisoned memory takes the slow path, which
+  // reports the first poisoned byte.
+  TestSmallMemoryRange(runtime.shadow(), test_buffer.get() + 4,
+                       kMaxSmallRangeSize, access_mode);
+  EXPECT_TRUE(memory_error_detected);
+  EXPECT_EQ(test_buffer.get() + kTestBufferSize / 2, last_error_info.location);
+  EXPECT_EQ(access_mode, last_error_info.access_mode);
+
+  runtime.shadow()->Unpoison(test_buffer.get(), kTestBufferSize);
+}
+
 TEST(AsanRtlUtilsTest, TestStructure) {
   TestAsanRuntime runtime;
   SetAsanRuntimeInstance(&runtime);
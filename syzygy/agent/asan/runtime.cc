@@ -22,6 +22,7 @@
 #include "base/command_line.h"
 #include "base/environment.h"
 #include "base/file_version_info.h"
+#include "base/format_macros.h"
 #include "base/logging.h"
 #include "base/path_service.h"
 #include "base/rand_util.h"
@@ -379,8 +380,9 @@ size_t MaxSafeAllocaSize() {
   } else {                                                                  \
     runtime_->logger_->Write(                                               \
         "SyzyASAN: Heap checker enabled, processing exception.");           \
-    AutoHeapManagerLock lock((runtime)->heap_manager_.get());               \
+    /* The helper threads must be started before the heaps are locked. */   \
     HeapChecker heap_checker((runtime)->shadow());                          \
+    AutoHeapManagerLock lock((runtime)->heap_manager_.get());               \
     HeapChecker::CorruptRangesVector corrupt_ranges;                        \
     heap_checker.IsHeapCorrupt(&corrupt_ranges);                            \
     size_t size = (runtime)->CalculateCorruptHeapInfoSize(corrupt_ranges);  \
@@ -463,6 +465,20 @@ std::unique_ptr<ReporterInterface> CreateCrashReporterWithTypeHint(
   return reporter;
 }
 
+// Runs a closure on a thread of its own.
+class ClosureThread : public base::PlatformThread::Delegate {
+ public:
+  explicit ClosureThread(const base::Closure& closure) : closure_(closure) {}
+
+  // PlatformThread::Delegate implementation.
+  void ThreadMain() override { closure_.Run(); }
+
+ private:
+  base::Closure closure_;
+
+  DISALLOW_COPY_AND_ASSIGN(ClosureThread);
+};
+
 }  // namespace
 
 base::Lock AsanRuntime::lock_;
@@ -475,7 +491,8 @@ AsanRuntime::AsanRuntime()
       stack_cache_(),
       asan_error_callback_(),
       heap_manager_(),
-      random_key_(::__rdtsc()) {
+      random_key_(::__rdtsc()),
+      deferred_set_up_done_(true, false) {
   ::common::SetDefaultAsanParameters(&params_);
   starting_ticks_ = ::GetTickCount();
 }
@@ -488,9 +505,18 @@ bool AsanRuntime::SetUp(const std::wstring& flags_command_line) {
   DCHECK(!runtime_);
   runtime_ = this;
 
+  // The shadow memory is set up before the flags are parsed, but the way it
+  // is allocated depends on one of them. Peek at it ahead of time.
+  bool sparse_shadow = params_.sparse_shadow != 0;
+  {
+    ::common::InflatedAsanParameters params(params_);
+    if (::common::ParseAsanParameters(flags_command_line, &params))
+      sparse_shadow = params.sparse_shadow != 0;
+  }
+
   // Setup the shadow memory first. If this fails the dynamic runtime can
   // safely disable the instrumentation.
-  if (!SetUpShadow())
+  if (!SetUpShadow(sparse_shadow))
     return false;
 
   // Parse and propagate any flags set via the environment variable. This logs
@@ -516,50 +542,15 @@ bool AsanRuntime::SetUp(const std::wstring& flags_command_line) {
     return false;
   WindowsHeapAdapter::SetUp(heap_manager_.get());
 
-  // Determine the preferred crash reporter type, as specified in the
-  // environment. If this isn't present it defaults to
-  // kDefaultCrashReporterType, in which case experiments or command-line flags
-  // may specify the crash reporter to use.
-  CrashReporterType crash_reporter_type =
-      GetCrashReporterTypeFromEnvironment(logger());
-
+  AsanFeatureSet feature_set = static_cast<AsanFeatureSet>(0U);
   if (params_.feature_randomization) {
-    AsanFeatureSet feature_set = GenerateRandomFeatureSet();
+    feature_set = GenerateRandomFeatureSet();
     PropagateFeatureSet(feature_set);
-
-    // If no specific crash reporter has been specified, then allow the
-    // experiment to specify it.
-    if (crash_reporter_type == kDefaultCrashReporterType &&
-        (feature_set & ASAN_FEATURE_ENABLE_CRASHPAD) != 0) {
-      crash_reporter_type = kCrashpadCrashReporterType;
-    }
   }
 
   // Propagates the flags values to the different modules.
   PropagateParams();
 
-  // The name 'disable_breakpad_reporting' is legacy; this actually means to
-  // disable all external crash reporting integration.
-  if (!params_.disable_breakpad_reporting) {
-    // This will create the crash reporter with a preference for creating a
-    // reporter of the hinted type. If such a reporter isn't available, it will
-    // fall back to trying to create the most 'modern' reporter available.
-    crash_reporter_.reset(CreateCrashReporterWithTypeHint(
-        logger(), crash_reporter_type).release());
-  }
-
-  // Set up the appropriate error handler depending on whether or not
-  // we successfully initialized a crash reporter.
-  if (crash_reporter_.get() != nullptr) {
-    logger_->Write(base::StringPrintf(
-        "SyzyASAN: Using %s for error reporting.",
-        crash_reporter_->GetName()));
-    SetErrorCallBack(base::Bind(&CrashReporterErrorHandler));
-  } else {
-    logger_->Write("SyzyASAN: Using default error reporting handler.");
-    SetErrorCallBack(base::Bind(&DefaultErrorHandler));
-  }
-
   // Install the unhandled exception handler. This is only installed once
   // across all runtime instances in a process so we check that it hasn't
   // already been installed.
@@ -571,12 +562,34 @@ bool AsanRuntime::SetUp(const std::wstring& flags_command_line) {
     previous_uef_ = ::SetUnhandledExceptionFilter(&UnhandledExceptionFilter);
   }
 
+  // The checksums of existing blocks would be invalidated by a change in the
+  // way they are calculated, so this is only decided once, before the first
+  // block gets allocated.
+  SetBlockChecksumSampling(params_.sample_large_block_checksums != 0);
+
   // Finally, initialize the heap manager. This comes after parsing all
   // parameters as some decisions can only be made once.
   heap_manager_->Init();
 
-  // Set some early crash keys.
-  SetEarlyCrashKeysIfPossible(this);
+  if (!SetUpErrorReportQueue())
+    return false;
+
+  // The crash reporter discovery and the registry accesses are the slowest
+  // parts of the setup, and are only needed to report errors. They can be
+  // deferred to a background thread. This doesn't start running until the
+  // loader lock is released, but the error reports wait for it for a bounded
+  // time only.
+  if (params_.deferred_startup) {
+    deferred_set_up_delegate_.reset(new ClosureThread(base::Bind(
+        &AsanRuntime::DeferredSetUp, base::Unretained(this), feature_set)));
+    if (!base::PlatformThread::Create(0, deferred_set_up_delegate_.get(),
+                                      &deferred_set_up_thread_)) {
+      LOG(ERROR) << "Unable to start the deferred setup thread.";
+      deferred_set_up_delegate_.reset();
+    }
+  }
+  if (deferred_set_up_delegate_.get() == nullptr)
+    DeferredSetUp(feature_set);
 
   return true;
 }
@@ -584,10 +597,24 @@ bool AsanRuntime::SetUp(const std::wstring& flags_command_line) {
 void AsanRuntime::TearDown() {
   base::AutoLock auto_lock(lock_);
 
+  // The deferred setup uses the logger and the heap manager. A thread that
+  // was killed by the process exit can also be joined.
+  if (deferred_set_up_delegate_.get() != nullptr) {
+    base::PlatformThread::Join(deferred_set_up_thread_);
+    deferred_set_up_delegate_.reset();
+  }
+  deferred_set_up_done_.Reset();
+
   // The WindowsHeapAdapter will only have been initialized if the heap manager
   // was successfully created and initialized.
-  if (heap_manager_.get() != nullptr)
+  if (heap_manager_.get() != nullptr) {
     WindowsHeapAdapter::TearDown();
+
+    // Dump the heap profile while the stacks it refers to are still alive.
+    LogHeapProfile();
+    LogRuntimeCounters();
+  }
+  TearDownErrorReportQueue();
   TearDownHeapManager();
   TearDownStackCache();
   TearDownLogger();
@@ -632,6 +659,21 @@ void AsanRuntime::OnErrorImpl(AsanErrorInfo* error_info) {
 void AsanRuntime::OnError(AsanErrorInfo* error_info) {
   DCHECK_NE(reinterpret_cast<AsanErrorInfo*>(NULL), error_info);
 
+  AddRuntimeCounter(kErrorCountCounter, 1);
+
+  // Only the first occurrence of an error is reported in full. Its repeats
+  // are handed over to the error report queue without inspecting the heap.
+  if (error_report_queue_.get() != nullptr &&
+      error_info->crash_stack_id != 0) {
+    ErrorReportQueue::CompactError error = {
+        error_info->crash_stack_id, error_info->location,
+        error_info->error_type};
+    if (!error_report_queue_->MarkReported(error)) {
+      error_report_queue_->Push(error);
+      return;
+    }
+  }
+
   // Grab the global page protection lock to prevent page protection settings
   // from being modified while processing the error.
   ::common::AutoRecursiveLock lock(block_protect_lock);
@@ -640,18 +682,83 @@ void AsanRuntime::OnError(AsanErrorInfo* error_info) {
   // stack allocations.
   CHECK_HEAP_CORRUPTION(this, error_info);
 
+  // The error callback may still be being set up. If it takes too long then
+  // the error is reported without the crash reporter.
+  bool set_up_done = WaitForDeferredSetUp();
+
   OnErrorImpl(error_info);
 
   // Call the callback to handle this error.
+  if (!set_up_done) {
+    DefaultErrorHandler(error_info);
+    return;
+  }
   DCHECK(!asan_error_callback_.is_null());
   asan_error_callback_.Run(error_info);
 }
 
+bool AsanRuntime::WaitForDeferredSetUp() {
+  return deferred_set_up_done_.TimedWait(
+      base::TimeDelta::FromMilliseconds(kDeferredSetUpTimeoutMs));
+}
+
 void AsanRuntime::SetErrorCallBack(const AsanOnErrorCallBack& callback) {
+  // Don't let the deferred setup override this callback.
+  WaitForDeferredSetUp();
   asan_error_callback_ = callback;
 }
 
-bool AsanRuntime::SetUpShadow() {
+void AsanRuntime::DeferredSetUp(AsanFeatureSet feature_set) {
+  // Determine the preferred crash reporter type, as specified in the
+  // environment. If this isn't present it defaults to
+  // kDefaultCrashReporterType, in which case experiments or command-line flags
+  // may specify the crash reporter to use.
+  CrashReporterType crash_reporter_type =
+      GetCrashReporterTypeFromEnvironment(logger());
+
+  // If no specific crash reporter has been specified, then allow the
+  // experiment to specify it.
+  if (crash_reporter_type == kDefaultCrashReporterType &&
+      (feature_set & ASAN_FEATURE_ENABLE_CRASHPAD) != 0) {
+    crash_reporter_type = kCrashpadCrashReporterType;
+  }
+
+  // The name 'disable_breakpad_reporting' is legacy; this actually means to
+  // disable all external crash reporting integration.
+  if (!params_.disable_breakpad_reporting) {
+    // This will create the crash reporter with a preference for creating a
+    // reporter of the hinted type. If such a reporter isn't available, it will
+    // fall back to trying to create the most 'modern' reporter available.
+    crash_reporter_.reset(CreateCrashReporterWithTypeHint(
+        logger(), crash_reporter_type).release());
+  }
+
+  // Set up the appropriate error handler depending on whether or not
+  // we successfully initialized a crash reporter. A callback that was set
+  // while this was still running is kept.
+  AsanOnErrorCallBack error_callback;
+  if (crash_reporter_.get() != nullptr) {
+    logger_->Write(base::StringPrintf(
+        "SyzyASAN: Using %s for error reporting.",
+        crash_reporter_->GetName()));
+    error_callback = base::Bind(&CrashReporterErrorHandler);
+  } else {
+    logger_->Write("SyzyASAN: Using default error reporting handler.");
+    error_callback = base::Bind(&DefaultErrorHandler);
+  }
+  if (asan_error_callback_.is_null())
+    asan_error_callback_ = error_callback;
+  deferred_set_up_done_.Signal();
+
+  // Set some early crash keys.
+  SetEarlyCrashKeysIfPossible(this);
+
+  // Load the registry cache ahead of the first corrupt block.
+  if (params_.prevent_duplicate_corruption_crashes)
+    heap_manager_->InitCorruptBlockRegistryCache();
+}
+
+bool AsanRuntime::SetUpShadow(bool sparse) {
   // If a non-trivial static shadow is provided, but it's the wrong size, then
   // this runtime is unable to support hotpatching and its being run in the
   // wrong memory model.
@@ -668,8 +775,10 @@ bool AsanRuntime::SetUpShadow() {
     shadow_.reset(new Shadow(asan_memory_interceptors_shadow_memory,
                              asan_memory_interceptors_shadow_memory_size));
   } else {
-    // Otherwise dynamically allocate the shadow memory.
-    shadow_.reset(new Shadow());
+    // Otherwise dynamically allocate the shadow memory. The static shadow
+    // lives in the image's uninitialized data, which the OS already commits on
+    // demand, so only this one can be sparse.
+    shadow_.reset(new Shadow(Shadow::RequiredLength(), sparse));
 
     // If the allocation fails, then return false.
     if (shadow_->shadow() == nullptr)
@@ -695,6 +804,11 @@ void AsanRuntime::TearDownShadow() {
   if (shadow_->shadow() == nullptr)
     return;
 
+  if (shadow_->sparse()) {
+    VLOG(1) << "Sparse shadow memory had " << shadow_->committed_page_count()
+            << " pages committed.";
+  }
+
   shadow_->TearDown();
   agent::asan::SetCrtInterceptorShadow(nullptr);
   agent::asan::SetMemoryInterceptorShadow(nullptr);
@@ -745,6 +859,7 @@ bool AsanRuntime::SetUpLogger() {
   // Initialize the client.
   client->set_instance_id(
       base::UTF8ToWide(trace::client::GetInstanceIdForThisModule()));
+  client->set_use_log_buffer(params_.use_log_buffer);
   client->Init();
 
   // Register the client singleton instance.
@@ -771,6 +886,10 @@ bool AsanRuntime::SetUpStackCache() {
   DCHECK_EQ(static_cast<StackCaptureCache*>(nullptr), stack_cache_.get());
   stack_cache_.reset(
       new StackCaptureCache(logger_.get(), memory_notifier_.get()));
+  // This can't be changed once stack traces have been saved, so it is set
+  // here rather than in PropagateParams.
+  stack_cache_->set_compress_stack_captures(
+      params_.compress_stack_captures != 0);
   memory_notifier_->NotifyInternalUse(stack_cache_.get(),
                                       sizeof(*stack_cache_.get()));
 
@@ -830,6 +949,52 @@ void AsanRuntime::TearDownHeapManager() {
   heap_manager_.reset();
 }
 
+bool AsanRuntime::SetUpErrorReportQueue() {
+  if (!params_.deduplicate_error_reports)
+    return true;
+
+  error_report_queue_.reset(new ErrorReportQueue(base::Bind(
+      &AsanRuntime::LogRepeatedErrors, base::Unretained(this))));
+  if (!error_report_queue_->Start()) {
+    error_report_queue_.reset();
+    return false;
+  }
+  return true;
+}
+
+void AsanRuntime::TearDownErrorReportQueue() {
+  if (error_report_queue_.get() == nullptr)
+    return;
+  error_report_queue_->Stop();
+  error_report_queue_.reset();
+}
+
+void AsanRuntime::LogRepeatedErrors(
+    const ErrorReportQueue::RepeatedErrors& repeated_errors,
+    size_t dropped_count) {
+  DCHECK_NE(static_cast<AsanLogger*>(nullptr), logger_.get());
+
+  std::string message;
+  for (const auto& repeated_error : repeated_errors) {
+    const ErrorReportQueue::CompactError& error = repeated_error.error;
+    if (ShouldIgnoreError(error.crash_stack_id))
+      continue;
+    base::StringAppendF(
+        &message,
+        "SyzyASAN: %" PRIuS " repeats of %s at stack ID 0x%08X, last on "
+        "address 0x%p.\n",
+        repeated_error.count, ErrorInfoAccessTypeToStr(error.error_type),
+        error.crash_stack_id, error.location);
+  }
+  if (dropped_count != 0) {
+    base::StringAppendF(&message,
+                        "SyzyASAN: %" PRIuS " repeated errors were dropped.\n",
+                        dropped_count);
+  }
+  if (!message.empty())
+    logger_->Write(message);
+}
+
 bool AsanRuntime::GetAsanFlagsEnvVar(std::wstring* env_var_wstr) {
   std::unique_ptr<base::Environment> env(base::Environment::Create());
   if (env.get() == NULL) {
@@ -852,25 +1017,36 @@ void AsanRuntime::PropagateParams() {
   // This function has to be kept in sync with the AsanParameters struct. These
   // checks will ensure that this is the case.
 #ifdef _WIN64
-  static_assert(sizeof(::common::AsanParameters) == 64,
+  static_assert(sizeof(::common::AsanParameters) == 96,
                 "Must propagate parameters.");
 #else
-  static_assert(sizeof(::common::AsanParameters) == 60,
+  static_assert(sizeof(::common::AsanParameters) == 88,
                 "Must propagate parameters.");
 #endif
-  static_assert(::common::kAsanParametersVersion == 14,
+  static_assert(::common::kAsanParametersVersion == 30,
                 "Must update parameters version.");
 
   // Push the configured parameter values to the appropriate endpoints.
   heap_manager_->set_parameters(params_);
+  heap_manager_->set_allocation_filter_stack_ids(
+      params_.allocation_filter_stack_ids_set);
   StackCaptureCache::set_compression_reporting_period(params_.reporting_period);
   common::StackCapture::set_bottom_frames_to_skip(
       params_.bottom_frames_to_skip);
   stack_cache_->set_max_num_frames(params_.max_num_frames);
+  // compress_stack_captures is used by SetUpStackCache.
+  // sparse_shadow is used by SetUpShadow.
   // ignored_stack_ids is used locally by AsanRuntime.
   logger_->set_log_as_text(params_.log_as_text);
   // exit_on_failure is used locally by AsanRuntime.
   logger_->set_minidump_on_failure(params_.minidump_on_failure);
+  // use_log_buffer is used by SetUpLogger.
+  // deferred_startup is used locally by AsanRuntime.
+  // defer_quarantine_flood_fill is used by the heap manager.
+  // allocation_guard_site_threshold and allocation_guard_seed are used by the
+  // heap manager.
+  // hot_patching_activation_rate and max_hot_patched_blocks are used by the
+  // hot patching Asan runtime.
 }
 
 size_t AsanRuntime::CalculateCorruptHeapInfoSize(
@@ -1066,6 +1242,11 @@ void AsanRuntime::AddThreadId(uint32_t thread_id) {
   thread_ids_.insert(thread_id);
 }
 
+void AsanRuntime::OnThreadDetach() {
+  DCHECK(heap_manager_);
+  heap_manager_->OnThreadDetach();
+}
+
 bool AsanRuntime::ThreadIdIsValid(uint32_t thread_id) {
   base::AutoLock lock(thread_ids_lock_);
   return thread_ids_.count(thread_id) > 0;
@@ -1224,7 +1405,8 @@ LONG AsanRuntime::ExceptionFilterImpl(bool is_unhandled,
   }
 
   // If a crash reporter is present then use it.
-  if (emit_asan_error && runtime_->crash_reporter() != nullptr) {
+  if (emit_asan_error && runtime_->WaitForDeferredSetUp() &&
+      runtime_->crash_reporter() != nullptr) {
     DumpAndCrashViaReporter(&error_info, exception);
     return EXCEPTION_CONTINUE_SEARCH;
   }
@@ -1251,13 +1433,72 @@ void AsanRuntime::DisableDeferredFreeThread() {
   heap_manager_->DisableDeferredFreeThread();
 }
 
+void AsanRuntime::EnableQuarantineCheckerThread(size_t blocks_per_second) {
+  DCHECK(heap_manager_);
+  heap_manager_->EnableQuarantineCheckerThread(blocks_per_second);
+}
+
+void AsanRuntime::DisableQuarantineCheckerThread() {
+  DCHECK(heap_manager_);
+  heap_manager_->DisableQuarantineCheckerThread();
+}
+
+void AsanRuntime::LogHeapProfile() {
+  DCHECK(heap_manager_);
+  DCHECK(logger_);
+  HeapProfiler* heap_profiler = heap_manager_->heap_profiler();
+  if (heap_profiler != nullptr)
+    heap_profiler->Log(logger_.get());
+}
+
+bool AsanRuntime::GetRuntimeCounters(AsanRuntimeCounters* counters) {
+  DCHECK_NE(static_cast<AsanRuntimeCounters*>(nullptr), counters);
+  if (counters->size <= offsetof(AsanRuntimeCounters, allocation_count))
+    return false;
+
+  AsanRuntimeCounters all_counters = {};
+  all_counters.size = sizeof(all_counters);
+  RuntimeCounters::process_counters()->GetAll(&all_counters);
+
+  // The gauges that aren't counted as they change are read now.
+  if (heap_manager_) {
+    heap_managers::BlockHeapManager::DeferredFreeStatistics statistics = {};
+    heap_manager_->GetDeferredFreeStatistics(&statistics);
+    all_counters.deferred_free_backlog = statistics.pending_work_count;
+  }
+
+  // Only write as much as the caller knows about, and report how much that
+  // is.
+  uint32_t size = std::min(counters->size, all_counters.size);
+  ::memcpy(counters, &all_counters, size);
+  counters->size = size;
+  return true;
+}
+
+void AsanRuntime::LogRuntimeCounters() {
+  DCHECK(logger_);
+  AsanRuntimeCounters counters = {};
+  counters.size = sizeof(counters);
+  GetRuntimeCounters(&counters);
+
+  std::string message = "Runtime counters:";
+#define APPEND_RUNTIME_COUNTER(id, name)  \
+  base::StringAppendF(&message, " %s=%lld", #name, counters.name);
+  ASAN_RUNTIME_COUNTERS(APPEND_RUNTIME_COUNTER)
+#undef APPEND_RUNTIME_COUNTER
+  base::StringAppendF(&message, " deferred_free_backlog=%lld.",
+                      counters.deferred_free_backlog);
+  logger_->Write(message);
+}
+
 AsanFeatureSet AsanRuntime::GetEnabledFeatureSet() {
   AsanFeatureSet enabled_features = static_cast<AsanFeatureSet>(0U);
   if (heap_manager_->enable_page_protections_)
     enabled_features |= ASAN_FEATURE_ENABLE_PAGE_PROTECTIONS;
   if (params_.enable_large_block_heap)
     enabled_features |= ASAN_FEATURE_ENABLE_LARGE_BLOCK_HEAP;
-  if (crash_reporter_.get() != nullptr &&
+  if (deferred_set_up_done_.IsSignaled() &&
+      crash_reporter_.get() != nullptr &&
       crash_reporter_->GetName() == reporters::CrashpadReporter::kName) {
     enabled_features |= ASAN_FEATURE_ENABLE_CRASHPAD;
   }
@@ -24,10 +24,14 @@
 #include "base/callback.h"
 #include "base/logging.h"
 #include "base/synchronization/lock.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
 #include "syzygy/agent/asan/error_info.h"
+#include "syzygy/agent/asan/error_report_queue.h"
 #include "syzygy/agent/asan/heap_checker.h"
 #include "syzygy/agent/asan/memory_notifier.h"
 #include "syzygy/agent/asan/reporter.h"
+#include "syzygy/agent/asan/runtime_counters.h"
 #include "syzygy/agent/asan/heap_managers/block_heap_manager.h"
 #include "syzygy/agent/common/stack_capture.h"
 #include "syzygy/common/asan_parameters.h"
@@ -94,7 +98,17 @@ class AsanRuntime {
   // @param error_info The information about this error.
   void OnError(AsanErrorInfo* error_info);
 
-  // Set the callback called on error.
+  // Waits for the deferred part of the setup to be done, for at most
+  // kDeferredSetUpTimeoutMs. Until then no crash reporter or error callback
+  // may be used.
+  // @returns true if the deferred setup is done, false if it timed out.
+  bool WaitForDeferredSetUp();
+
+  // The maximum time an error report waits for the deferred setup.
+  static const uint32_t kDeferredSetUpTimeoutMs = 5000;
+
+  // Set the callback called on error. This waits for the deferred setup, so
+  // that it doesn't override the callback.
   // TODO(sebmarchand): Move the signature of this callback to an header file
   //     so it'll be easier to update it.
   void SetErrorCallBack(const AsanOnErrorCallBack& callback);
@@ -155,6 +169,10 @@ class AsanRuntime {
   // @param thread_id The thread ID that has been observed.
   void AddThreadId(uint32_t thread_id);
 
+  // Releases the per-thread resources of the calling thread. This is meant to
+  // be called when the thread exits.
+  void OnThreadDetach();
+
   // Determines if a thread ID has already been seen.
   // @param thread_id The thread ID to be queried.
   // @returns true if a given thread ID is valid for this process.
@@ -191,6 +209,28 @@ class AsanRuntime {
   // Disables the deferred free thread.
   void DisableDeferredFreeThread();
 
+  // Enables the quarantine checker thread.
+  // @param blocks_per_second The maximum number of blocks to check per second.
+  void EnableQuarantineCheckerThread(size_t blocks_per_second);
+
+  // Disables the quarantine checker thread.
+  void DisableQuarantineCheckerThread();
+
+  // Writes the heap profile to the logger. This does nothing if the heap
+  // profiler is disabled.
+  void LogHeapProfile();
+
+  // Gets the runtime counters.
+  // @param counters Receives the counters. Its size field must be set, and
+  //     only that many bytes are written.
+  // @returns true on success, false if the size is too small to hold any
+  //     counter. On success the size field is set to the number of bytes
+  //     written.
+  bool GetRuntimeCounters(AsanRuntimeCounters* counters);
+
+  // Writes the runtime counters to the logger.
+  void LogRuntimeCounters();
+
   // @returns the list of enabled features.
   AsanFeatureSet GetEnabledFeatureSet();
 
@@ -233,8 +273,10 @@ class AsanRuntime {
 
  private:
   // Sets up the shadow memory.
+  // @param sparse If true then a dynamically allocated shadow memory will be
+  //     committed lazily.
   // @returns true on success, false otherwise.
-  bool SetUpShadow();
+  bool SetUpShadow(bool sparse);
 
   // Tears down the shadow memory.
   void TearDownShadow();
@@ -267,6 +309,28 @@ class AsanRuntime {
   // Tear down the heap manager.
   void TearDownHeapManager();
 
+  // Sets up the crash reporter and the error callback, sets the early crash
+  // keys and loads the registry cache. This is slow, so it's done by a
+  // background thread when the startup is deferred.
+  // @param feature_set The randomly enabled features, which may request a
+  //     crash reporter.
+  void DeferredSetUp(AsanFeatureSet feature_set);
+
+  // Set up the error report queue, if error reports are deduplicated.
+  // @returns true on success, false otherwise.
+  bool SetUpErrorReportQueue();
+
+  // Tear down the error report queue, reporting any remaining errors.
+  void TearDownErrorReportQueue();
+
+  // Logs a batch of repeated errors. This is called by the error report
+  // queue on its own thread.
+  // @param repeated_errors The repeated errors.
+  // @param dropped_count The number of repeats that have been dropped.
+  void LogRepeatedErrors(
+      const ErrorReportQueue::RepeatedErrors& repeated_errors,
+      size_t dropped_count);
+
   // The unhandled exception filter registered by this runtime. This is used
   // to catch unhandled exceptions so we can augment them with information
   // about the corrupt heap.
@@ -327,6 +391,16 @@ class AsanRuntime {
   // is available.
   std::unique_ptr<ReporterInterface> crash_reporter_;
 
+  // Signaled once the crash reporter and the error callback are set up, and
+  // the thread doing it when the startup is deferred.
+  base::WaitableEvent deferred_set_up_done_;
+  std::unique_ptr<base::PlatformThread::Delegate> deferred_set_up_delegate_;
+  base::PlatformThreadHandle deferred_set_up_thread_;
+
+  // The queue taking the repeated errors off of the faulting threads. This
+  // is left null unless error reports are deduplicated.
+  std::unique_ptr<ErrorReportQueue> error_report_queue_;
+
   DISALLOW_COPY_AND_ASSIGN(AsanRuntime);
 };
 
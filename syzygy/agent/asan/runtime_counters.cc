@@ -0,0 +1,45 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/runtime_counters.h"
+
+#include "base/logging.h"
+
+namespace agent {
+namespace asan {
+
+RuntimeCounters RuntimeCounters::process_counters_;
+
+int64_t RuntimeCounters::Get(RuntimeCounterId id) const {
+  DCHECK_GT(kRuntimeCounterIdMax, id);
+  // The slots aren't read at once, so concurrent updates may or may not be
+  // accounted for. Each of them is read atomically though, which a plain
+  // read of a 64-bit value doesn't guarantee on x86.
+  int64_t value = 0;
+  for (size_t i = 0; i < kSlotCount; ++i) {
+    value += ::InterlockedCompareExchange64(
+        const_cast<volatile LONG64*>(&slots_[i].values[id]), 0, 0);
+  }
+  return value;
+}
+
+void RuntimeCounters::GetAll(AsanRuntimeCounters* counters) const {
+  DCHECK_NE(static_cast<AsanRuntimeCounters*>(nullptr), counters);
+#define GET_RUNTIME_COUNTER(id, name) counters->name = Get(id);
+  ASAN_RUNTIME_COUNTERS(GET_RUNTIME_COUNTER)
+#undef GET_RUNTIME_COUNTER
+}
+
+}  // namespace asan
+}  // namespace agent
@@ -0,0 +1,137 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the always-on counters of the runtime, and the structure through
+// which they're exported.
+
+#ifndef SYZYGY_AGENT_ASAN_RUNTIME_COUNTERS_H_
+#define SYZYGY_AGENT_ASAN_RUNTIME_COUNTERS_H_
+
+#include <stdint.h>
+#include <windows.h>
+
+// The runtime counters, as pairs of an identifier and of the name of the
+// exported field. Those flagged as being gauges are incremented and
+// decremented, and reflect a current state rather than an accumulated count.
+#define ASAN_RUNTIME_COUNTERS(F)  \
+    /* The number of allocations made through the heap manager. */  \
+    F(kAllocationCountCounter, allocation_count)  \
+    /* The total number of bytes requested by these allocations. */  \
+    F(kAllocatedBytesCounter, allocated_bytes)  \
+    /* The number of frees made through the heap manager. */  \
+    F(kFreeCountCounter, free_count)  \
+    /* The number of blocks in the quarantines. This is a gauge. */  \
+    F(kQuarantineCountCounter, quarantine_count)  \
+    /* The total size of the blocks in the quarantines. This is a gauge. */  \
+    F(kQuarantineSizeCounter, quarantine_size)  \
+    /* The number of times a quarantine got trimmed. */  \
+    F(kQuarantineTrimCountCounter, quarantine_trim_count)  \
+    /* The number of stack traces that were found in the stack cache. */  \
+    F(kStackCacheHitCountCounter, stack_cache_hit_count)  \
+    /* The number of stack traces that had to be added to the stack cache. */  \
+    F(kStackCacheMissCountCounter, stack_cache_miss_count)  \
+    /* The number of errors detected, including the repeated ones. */  \
+    F(kErrorCountCounter, error_count)
+
+// The counters, as returned by asan_GetRuntimeCounters.
+struct AsanRuntimeCounters {
+  // The size of this structure. This must be set by the caller, and only
+  // this many bytes are written. This allows adding counters while keeping
+  // the clients that don't know about them working.
+  uint32_t size;
+  uint32_t reserved;
+#define DECLARE_ASAN_RUNTIME_COUNTER(id, name) int64_t name;
+  ASAN_RUNTIME_COUNTERS(DECLARE_ASAN_RUNTIME_COUNTER)
+#undef DECLARE_ASAN_RUNTIME_COUNTER
+  // The number of workers of the deferred free thread that have been
+  // signaled but haven't started trimming yet.
+  int64_t deferred_free_backlog;
+};
+
+namespace agent {
+namespace asan {
+
+// The identifiers of the runtime counters.
+enum RuntimeCounterId {
+#define DECLARE_RUNTIME_COUNTER_ID(id, name) id,
+  ASAN_RUNTIME_COUNTERS(DECLARE_RUNTIME_COUNTER_ID)
+#undef DECLARE_RUNTIME_COUNTER_ID
+  kRuntimeCounterIdMax,
+};
+
+// Keeps the runtime counters cheaply enough that they can always be enabled.
+// The threads update their counters in slots of their own, which are each on
+// a separate cache line, so that they don't contend with each other. The
+// slots get aggregated when the counters are read, which is rare.
+//
+// There is a fixed number of slots, and threads are mapped to them by their
+// ID. Two threads sharing a slot still get the right counts as the updates
+// are atomic, they only pay for the contention.
+//
+// This has no constructor, so that static instances are zero-initialized
+// without requiring a static initializer.
+class RuntimeCounters {
+ public:
+  // The number of slots.
+  static const size_t kSlotCount = 64;
+
+  // Adds a value to a counter.
+  // @param id The counter to update.
+  // @param value The value to add, which is negative to decrement a gauge.
+  void Add(RuntimeCounterId id, int64_t value) {
+    ::InterlockedExchangeAdd64(&GetSlot()->values[id], value);
+  }
+
+  // @param id The counter to read.
+  // @returns the value of the counter, summed over all the slots.
+  int64_t Get(RuntimeCounterId id) const;
+
+  // Reads all the counters.
+  // @param counters Receives the counters. The fields that don't come from
+  //     these counters are left unchanged.
+  void GetAll(AsanRuntimeCounters* counters) const;
+
+  // @returns the counters shared by the whole process.
+  static RuntimeCounters* process_counters() { return &process_counters_; }
+
+ protected:
+  // The counters of a group of threads. This fills whole cache lines.
+  struct __declspec(align(64)) Slot {
+    volatile LONG64 values[kRuntimeCounterIdMax];
+  };
+  static_assert(sizeof(Slot) % 64 == 0,
+                "The slots must fill whole cache lines.");
+
+  // @returns the slot of the calling thread.
+  Slot* GetSlot() {
+    // The thread IDs are multiples of 4.
+    return &slots_[(::GetCurrentThreadId() >> 2) % kSlotCount];
+  }
+
+  Slot slots_[kSlotCount];
+
+  static RuntimeCounters process_counters_;
+};
+
+// Adds a value to one of the counters of the process.
+// @param id The counter to update.
+// @param value The value to add.
+inline void AddRuntimeCounter(RuntimeCounterId id, int64_t value) {
+  RuntimeCounters::process_counters()->Add(id, value);
+}
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_RUNTIME_COUNTERS_H_
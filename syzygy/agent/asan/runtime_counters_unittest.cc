@@ -0,0 +1,97 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/runtime_counters.h"
+
+#include <memory>
+#include <vector>
+
+#include "base/threading/simple_thread.h"
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+const size_t kThreadCount = 16;
+const size_t kIncrementsPerThread = 10000;
+
+class IncrementRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  explicit IncrementRunner(RuntimeCounters* counters) : counters_(counters) {}
+
+  void Run() override {
+    for (size_t i = 0; i < kIncrementsPerThread; ++i) {
+      counters_->Add(kAllocationCountCounter, 1);
+      counters_->Add(kAllocatedBytesCounter, 16);
+    }
+  }
+
+ private:
+  RuntimeCounters* counters_;
+};
+
+}  // namespace
+
+TEST(RuntimeCountersTest, AddAndGet) {
+  std::unique_ptr<RuntimeCounters> counters(new RuntimeCounters());
+  EXPECT_EQ(0, counters->Get(kAllocationCountCounter));
+
+  counters->Add(kAllocationCountCounter, 3);
+  counters->Add(kQuarantineSizeCounter, 100);
+  counters->Add(kQuarantineSizeCounter, -40);
+  EXPECT_EQ(3, counters->Get(kAllocationCountCounter));
+  EXPECT_EQ(60, counters->Get(kQuarantineSizeCounter));
+  EXPECT_EQ(0, counters->Get(kFreeCountCounter));
+
+  AsanRuntimeCounters all = {};
+  all.deferred_free_backlog = 7;
+  counters->GetAll(&all);
+  EXPECT_EQ(3, all.allocation_count);
+  EXPECT_EQ(60, all.quarantine_size);
+  EXPECT_EQ(0, all.free_count);
+  EXPECT_EQ(7, all.deferred_free_backlog);
+}
+
+TEST(RuntimeCountersTest, AggregatesThreads) {
+  std::unique_ptr<RuntimeCounters> counters(new RuntimeCounters());
+
+  std::vector<std::unique_ptr<IncrementRunner>> runners;
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> threads;
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    runners.push_back(std::unique_ptr<IncrementRunner>(
+        new IncrementRunner(counters.get())));
+    threads.push_back(std::unique_ptr<base::DelegateSimpleThread>(
+        new base::DelegateSimpleThread(runners.back().get(), "increment")));
+    threads.back()->Start();
+  }
+  for (auto& thread : threads)
+    thread->Join();
+
+  const int64_t kExpectedCount = kThreadCount * kIncrementsPerThread;
+  EXPECT_EQ(kExpectedCount, counters->Get(kAllocationCountCounter));
+  EXPECT_EQ(kExpectedCount * 16, counters->Get(kAllocatedBytesCounter));
+}
+
+TEST(RuntimeCountersTest, ProcessCounters) {
+  RuntimeCounters* counters = RuntimeCounters::process_counters();
+  ASSERT_NE(static_cast<RuntimeCounters*>(nullptr), counters);
+  int64_t errors = counters->Get(kErrorCountCounter);
+  AddRuntimeCounter(kErrorCountCounter, 1);
+  EXPECT_EQ(errors + 1, counters->Get(kErrorCountCounter));
+}
+
+}  // namespace asan
+}  // namespace agent
@@ -137,6 +137,55 @@ TEST_F(AsanRuntimeTest, OnError) {
                          sizeof(::common::AsanParameters)));
 }
 
+TEST_F(AsanRuntimeTest, DeduplicateErrorReports) {
+  current_command_line_.AppendSwitch(
+      ::common::kParamDeduplicateErrorReports);
+  ASSERT_NO_FATAL_FAILURE(
+      asan_runtime_.SetUp(current_command_line_.GetCommandLineString()));
+
+  // Disable the heap checking as this really slows down the unittests.
+  asan_runtime_.params().check_heap_on_failure = false;
+  asan_runtime_.SetErrorCallBack(base::Bind(&TestCallback));
+  AsanErrorInfo bad_access_info = {};
+  RtlCaptureContext(&bad_access_info.context);
+  bad_access_info.crash_stack_id = 0xCAFEBABE;
+  bad_access_info.error_type = USE_AFTER_FREE;
+
+  // Only the first occurrence of the error is reported synchronously.
+  callback_called = false;
+  asan_runtime_.OnError(&bad_access_info);
+  EXPECT_TRUE(callback_called);
+  callback_called = false;
+  asan_runtime_.OnError(&bad_access_info);
+  asan_runtime_.OnError(&bad_access_info);
+  EXPECT_FALSE(callback_called);
+
+  // The repeats are logged by the time the runtime is torn down.
+  ASSERT_NO_FATAL_FAILURE(asan_runtime_.TearDown());
+  EXPECT_TRUE(LogContains("SyzyASAN: 2 repeats of heap-use-after-free"));
+}
+
+TEST_F(AsanRuntimeTest, DeferredStartup) {
+  current_command_line_.AppendSwitch(::common::kParamDeferredStartup);
+  ASSERT_NO_FATAL_FAILURE(
+      asan_runtime_.SetUp(current_command_line_.GetCommandLineString()));
+  EXPECT_TRUE(asan_runtime_.params().deferred_startup);
+
+  // The error handler is set up by the background thread, and errors are
+  // reported once it's done.
+  EXPECT_TRUE(asan_runtime_.WaitForDeferredSetUp());
+  asan_runtime_.params().check_heap_on_failure = false;
+  asan_runtime_.SetErrorCallBack(base::Bind(&TestCallback));
+  callback_called = false;
+  AsanErrorInfo bad_access_info = {};
+  RtlCaptureContext(&bad_access_info.context);
+  asan_runtime_.OnError(&bad_access_info);
+  EXPECT_TRUE(callback_called);
+
+  ASSERT_NO_FATAL_FAILURE(asan_runtime_.TearDown());
+  EXPECT_TRUE(LogContains("error reporting"));
+}
+
 TEST_F(AsanRuntimeTest, SetCompressionReportingPeriod) {
   ASSERT_EQ(StackCaptureCache::GetDefaultCompressionReportingPeriod(),
             StackCaptureCache::compression_reporting_period());
@@ -17,6 +17,8 @@
 
 #include "syzygy/agent/asan/scoped_page_protections.h"
 
+#include <algorithm>
+
 #include "base/logging.h"
 #include "syzygy/agent/asan/constants.h"
 #include "syzygy/common/align.h"
@@ -37,9 +39,25 @@ bool ScopedPageProtections::EnsureContainingPagesWritable(void* addr,
   uint8_t* page_begin = common::AlignDown(cursor, GetPageSize());
   uint8_t* page_end = common::AlignUp(cursor + size, GetPageSize());
   while (page_begin < page_end) {
-    if (!EnsurePageWritable(page_begin))
+    // Skip over the pages that have already been unprotected.
+    auto next_unprotected = unprotected_pages_.lower_bound(page_begin);
+    if (next_unprotected != unprotected_pages_.end() &&
+        next_unprotected->first == page_begin) {
+      page_begin += GetPageSize();
+      continue;
+    }
+
+    // Unprotect the pages up to the next one that already is.
+    uint8_t* run_end = page_end;
+    if (next_unprotected != unprotected_pages_.end() &&
+        next_unprotected->first < run_end) {
+      run_end = reinterpret_cast<uint8_t*>(next_unprotected->first);
+    }
+
+    size_t run_size = 0;
+    if (!EnsurePagesWritable(page_begin, run_end - page_begin, &run_size))
       return false;
-    page_begin += GetPageSize();
+    page_begin += run_size;
   }
 
   return true;
@@ -50,42 +68,65 @@ bool ScopedPageProtections::RestorePageProtections() {
   UnprotectedPages to_unprotect;
   unprotected_pages_.swap(to_unprotect);
 
-  // Best-effort restore the old page protections, and remember pages for
-  // which the effort failed.
+  // Best-effort restore the old page protections, one run of contiguous pages
+  // with the same protection at a time.
   bool did_succeed = true;
-  for (const auto& unprotected_page : to_unprotect) {
-    DWORD old_prot = 0;
-    if (!::VirtualProtect(unprotected_page.first, GetPageSize(),
-                          unprotected_page.second, &old_prot)) {
-      DWORD error = ::GetLastError();
-      LOG(ERROR) << "VirtualProtect failed: " << common::LogWe(error);
-
-      // Pages that failed to be unprotected are reinserted into the set of
-      // pages being tracked.
-      bool inserted = unprotected_pages_.insert(unprotected_page).second;
-      DCHECK(inserted);
-
-      did_succeed = false;
+  auto run_begin = to_unprotect.begin();
+  while (run_begin != to_unprotect.end()) {
+    auto run_end = run_begin;
+    size_t page_count = 0;
+    do {
+      ++run_end;
+      ++page_count;
+    } while (run_end != to_unprotect.end() &&
+             run_end->second == run_begin->second &&
+             run_end->first == reinterpret_cast<uint8_t*>(run_begin->first) +
+                                   page_count * GetPageSize());
+
+    if (!RestorePages(run_begin->first, page_count, run_begin->second)) {
+      // The pages of a run can belong to different allocations, which
+      // VirtualProtect doesn't support. Fall back to restoring them one by
+      // one, and remember the pages for which the effort failed.
+      for (auto page = run_begin; page != run_end; ++page) {
+        if (page_count > 1 && RestorePages(page->first, 1, page->second))
+          continue;
+
+        // Pages that failed to be unprotected are reinserted into the set of
+        // pages being tracked.
+        bool inserted = unprotected_pages_.insert(*page).second;
+        DCHECK(inserted);
+
+        did_succeed = false;
+      }
     }
+
+    run_begin = run_end;
   }
 
   return did_succeed;
 }
 
-bool ScopedPageProtections::EnsurePageWritable(void* page) {
+bool ScopedPageProtections::EnsurePagesWritable(void* page,
+                                                size_t max_size,
+                                                size_t* size) {
   DCHECK(common::IsAligned(page, GetPageSize()));
+  DCHECK(common::IsAligned(max_size, GetPageSize()));
+  DCHECK_NE(0u, max_size);
+  DCHECK_NE(static_cast<size_t*>(nullptr), size);
+  DCHECK(unprotected_pages_.find(page) == unprotected_pages_.end());
 
-  // Check whether we've already unprotected this page.
-  if (unprotected_pages_.find(page) != unprotected_pages_.end())
-    return true;
-
-  // We didn't unprotect this yet, make the page writable.
+  // Find the run of pages that share the protection of the first one.
   MEMORY_BASIC_INFORMATION memory_info{};
   if (!::VirtualQuery(page, &memory_info, sizeof(memory_info))) {
     DWORD error = ::GetLastError();
     LOG(ERROR) << "VirtualQuery failed: " << common::LogWe(error);
     return false;
   }
+  uint8_t* run_begin = reinterpret_cast<uint8_t*>(page);
+  uint8_t* region_end = reinterpret_cast<uint8_t*>(memory_info.BaseAddress) +
+                        memory_info.RegionSize;
+  size_t run_size = std::min(max_size,
+                             static_cast<size_t>(region_end - run_begin));
 
   // Preserve executable status while patching.
   DWORD is_executable = (PAGE_EXECUTE | PAGE_EXECUTE_READ |
@@ -96,21 +137,40 @@ bool ScopedPageProtections::EnsurePageWritable(void* page) {
     new_prot = PAGE_EXECUTE_READWRITE;
 
   DWORD old_prot = 0;
-  if (!::VirtualProtect(page, GetPageSize(), new_prot, &old_prot)) {
+  ++protection_changes_;
+  if (!::VirtualProtect(page, run_size, new_prot, &old_prot)) {
     DWORD error = ::GetLastError();
     LOG(ERROR) << "VirtualProtect failed: " << common::LogWe(error);
     return false;
   }
 
-  // Make a note that we modified this page, as well as its original settings.
-  bool inserted =
-      unprotected_pages_.insert(std::make_pair(page, old_prot)).second;
-  DCHECK(inserted);
+  // Make a note that we modified these pages, as well as their original
+  // settings. They all shared the same protection.
+  for (size_t offset = 0; offset < run_size; offset += GetPageSize()) {
+    void* unprotected_page = run_begin + offset;
+    bool inserted = unprotected_pages_.insert(
+        std::make_pair(unprotected_page, old_prot)).second;
+    DCHECK(inserted);
+
+    // Callback as a testing seam.
+    if (!on_unprotect_.is_null())
+      on_unprotect_.Run(unprotected_page, old_prot);
+  }
 
-  // Callback as a testing seam.
-  if (!on_unprotect_.is_null())
-    on_unprotect_.Run(page, old_prot);
+  *size = run_size;
+  return true;
+}
 
+bool ScopedPageProtections::RestorePages(void* pages,
+                                         size_t page_count,
+                                         DWORD prot) {
+  DWORD old_prot = 0;
+  ++protection_changes_;
+  if (!::VirtualProtect(pages, page_count * GetPageSize(), prot, &old_prot)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "VirtualProtect failed: " << common::LogWe(error);
+    return false;
+  }
   return true;
 }
 
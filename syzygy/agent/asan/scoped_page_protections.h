@@ -38,17 +38,20 @@ class ScopedPageProtections {
   using OnUnprotectCallback = base::Callback<void(void* /* page */,
                                                   DWORD /* old_prot */)>;
 
-  ScopedPageProtections() {}
+  ScopedPageProtections() : protection_changes_(0) {}
   ~ScopedPageProtections();
 
   // Makes the page(s) containing @p size bytes starting at @p addr writable.
+  // Contiguous pages sharing the same protection are unprotected with a
+  // single protection change.
   // @param addr The address to be written.
   // @param size The number of bytes to be written.
   // @returns true on success, false otherwise.
   bool EnsureContainingPagesWritable(void* addr, size_t size);
 
   // Restores all page protections that have been modified. This is
-  // automatically invoked on destruction. Specifically remembers pages for
+  // automatically invoked on destruction. Contiguous pages that had the same
+  // protection are restored together. Specifically remembers pages for
   // which restoring protections failed. Repeated calls to this function
   // will try again for those pages.
   // @returns true on success, false otherwise.
@@ -59,17 +62,35 @@ class ScopedPageProtections {
     on_unprotect_ = on_unprotect;
   }
 
+  // @returns the number of calls to VirtualProtect made by this object. This
+  //     is a testing seam.
+  size_t protection_changes() const { return protection_changes_; }
+
  private:
-  // Helper function for EnsureContainingPagesWritable.
-  // @pre page Points to the beginning of a page.
-  // @param page The address of the page to make writable.
-  bool EnsurePageWritable(void* page);
+  // Helper function for EnsureContainingPagesWritable. Makes a run of pages
+  // sharing the same protection writable.
+  // @pre page Points to the beginning of a page that isn't unprotected yet.
+  // @param page The address of the first page to make writable.
+  // @param max_size The maximum size of the run, in bytes. This is a
+  //     multiple of the page size.
+  // @param size Receives the size of the run that was made writable.
+  bool EnsurePagesWritable(void* page, size_t max_size, size_t* size);
+
+  // Helper function for RestorePageProtections.
+  // @param pages The address of the first page to restore.
+  // @param page_count The number of pages to restore.
+  // @param prot The protection to restore.
+  // @returns true on success, false otherwise.
+  bool RestorePages(void* pages, size_t page_count, DWORD prot);
 
   using UnprotectedPages = std::map<void*, DWORD>;
 
   // Stores the pages unprotected with their original settings.
   UnprotectedPages unprotected_pages_;
 
+  // The number of calls to VirtualProtect.
+  size_t protection_changes_;
+
   // Optional callback.
   OnUnprotectCallback on_unprotect_;
 
@@ -140,5 +140,46 @@ TEST_F(ScopedPageProtectionsTest, RestoresProtectionsInDestructor) {
   EXPECT_EQ(PAGE_READONLY, GetProtection(0));
 }
 
+TEST_F(ScopedPageProtectionsTest, GroupsContiguousPages) {
+  ScopedPageProtections spp;
+
+  // The fixture should guarantee this. The three pages share the same
+  // protection, so they're unprotected and restored at once.
+  ASSERT_EQ(PAGE_READONLY, GetProtection(0));
+  EXPECT_TRUE(spp.EnsureContainingPagesWritable(BaseOfPage(0),
+                                                kPageCount * GetPageSize()));
+  EXPECT_EQ(1u, spp.protection_changes());
+  for (size_t i = 0; i < kPageCount; ++i)
+    EXPECT_EQ(PAGE_READWRITE, GetProtection(i));
+
+  // Pages that are already writable aren't unprotected again.
+  EXPECT_TRUE(spp.EnsureContainingPagesWritable(BaseOfPage(1), 1));
+  EXPECT_EQ(1u, spp.protection_changes());
+
+  EXPECT_TRUE(spp.RestorePageProtections());
+  EXPECT_EQ(2u, spp.protection_changes());
+  for (size_t i = 0; i < kPageCount; ++i)
+    EXPECT_EQ(PAGE_READONLY, GetProtection(i));
+}
+
+TEST_F(ScopedPageProtectionsTest, SplitsRunsAroundUnprotectedPages) {
+  ScopedPageProtections spp;
+
+  // Unprotect the middle page first, then the whole range.
+  EXPECT_TRUE(spp.EnsureContainingPagesWritable(BaseOfPage(1), 1));
+  EXPECT_EQ(1u, spp.protection_changes());
+  EXPECT_TRUE(spp.EnsureContainingPagesWritable(BaseOfPage(0),
+                                                kPageCount * GetPageSize()));
+  EXPECT_EQ(3u, spp.protection_changes());
+  for (size_t i = 0; i < kPageCount; ++i)
+    EXPECT_EQ(PAGE_READWRITE, GetProtection(i));
+
+  // All of the pages had the same protection, so they're restored at once.
+  EXPECT_TRUE(spp.RestorePageProtections());
+  EXPECT_EQ(4u, spp.protection_changes());
+  for (size_t i = 0; i < kPageCount; ++i)
+    EXPECT_EQ(PAGE_READONLY, GetProtection(i));
+}
+
 }  // namespace asan
 }  // namespace agent
@@ -15,8 +15,12 @@
 #include "syzygy/agent/asan/shadow.h"
 
 #include <windows.h>
+#include <emmintrin.h>
+#include <immintrin.h>
+#include <intrin.h>
 #include <algorithm>
 
+#include "base/lazy_instance.h"
 #include "base/strings/stringprintf.h"
 #include "base/win/pe_image.h"
 #include "syzygy/common/align.h"
@@ -28,40 +32,300 @@ namespace {
 
 static const size_t kPageSize = GetPageSize();
 
-// Converts an address to a page index and bit mask.
+// The number of pages tracked by each word of the page bits.
+static const size_t kPagesPerWord = sizeof(LONG) * 8;
+
+// Converts an address to a page bits word index and bit mask.
 inline void AddressToPageMask(const void* address,
                               size_t* index,
-                              uint8_t* mask) {
+                              LONG* mask) {
   DCHECK_NE(static_cast<size_t*>(nullptr), index);
-  DCHECK_NE(static_cast<uint8_t*>(nullptr), mask);
+  DCHECK_NE(static_cast<LONG*>(nullptr), mask);
 
   size_t i = reinterpret_cast<uintptr_t>(address) / kPageSize;
-  *index = i / 8;
-  *mask = 1 << (i % 8);
+  *index = i / kPagesPerWord;
+  *mask = static_cast<LONG>(1u << (i % kPagesPerWord));
+}
+
+// Sets or clears the bits of a range of pages.
+// @param words The page bits words.
+// @param first_page The index of the first page of the range.
+// @param page_count The number of pages in the range.
+// @param protect True if the bits are to be set, false if cleared.
+void UpdatePageBits(LONG* words,
+                    size_t first_page,
+                    size_t page_count,
+                    bool protect) {
+  DCHECK_NE(static_cast<LONG*>(nullptr), words);
+
+  size_t page = first_page;
+  const size_t page_end = first_page + page_count;
+  while (page < page_end) {
+    volatile LONG* word = words + page / kPagesPerWord;
+    size_t bit = page % kPagesPerWord;
+    size_t bit_end = std::min(kPagesPerWord, bit + (page_end - page));
+    page += bit_end - bit;
+
+    // A word that is entirely covered has no bits belonging to other ranges,
+    // so it is simply overwritten.
+    if (bit == 0 && bit_end == kPagesPerWord) {
+      ::InterlockedExchange(word, protect ? ~0L : 0L);
+      continue;
+    }
+
+    uint32_t mask = (bit_end == kPagesPerWord ? ~0u : (1u << bit_end) - 1) &
+                    ~((1u << bit) - 1);
+    if (protect)
+      ::InterlockedOr(word, static_cast<LONG>(mask));
+    else
+      ::InterlockedAnd(word, static_cast<LONG>(~mask));
+  }
+}
+
+// The signature of a shadow scanning kernel.
+typedef const uint8_t* (*FindFirstNonZeroByteFunc)(const uint8_t* start,
+                                                   const uint8_t* end);
+
+// Ranges shorter than this are scanned with the generic kernel, as the setup
+// cost of the vectorized kernels isn't worth it.
+static const size_t kMinVectorizedScanLength = 64;
+
+// Shadow ranges at least this long are cleared and marked as freed using the
+// bulk implementations. This corresponds to 32KB of application memory.
+static const size_t kBulkShadowClearThreshold = 4096;
+
+// The granularity at which the bulk clear checks for already clean shadow.
+static const size_t kBulkShadowClearChunk = 1024;
+
+// The sparse shadows that are currently alive, and the registration of the
+// vectored exception handler that services them.
+struct SparseShadowList {
+  SparseShadowList() : head(nullptr), handler(nullptr) {}
+
+  base::Lock lock;
+  Shadow* head;  // Under lock.
+  void* handler;  // Under lock.
+};
+base::LazyInstance<SparseShadowList>::Leaky g_sparse_shadows =
+    LAZY_INSTANCE_INITIALIZER;
+
+// Selects the fastest kernel supported by this CPU.
+FindFirstNonZeroByteFunc SelectFindFirstNonZeroByte() {
+  if (internal::CpuSupportsAvx2())
+    return &internal::FindFirstNonZeroByteAvx2;
+  if (internal::CpuSupportsSse2())
+    return &internal::FindFirstNonZeroByteSse2;
+  return &internal::FindFirstNonZeroByteGeneric;
+}
+
+// The kernel used for long ranges. This is selected once at startup.
+const FindFirstNonZeroByteFunc g_find_first_non_zero_byte =
+    SelectFindFirstNonZeroByte();
+
+// Scans bytes one at a time from |start| to |end|.
+inline const uint8_t* FindFirstNonZeroByteImpl8(const uint8_t* start,
+                                                const uint8_t* end) {
+  for (; start != end; ++start) {
+    if (*start != 0)
+      return start;
+  }
+  return end;
 }
 
 }  // namespace
 
-Shadow::Shadow() : own_memory_(false), shadow_(nullptr), length_(0) {
+namespace internal {
+
+void ClearShadowBytes(uint8_t* begin, uint8_t* end) {
+  DCHECK_LE(begin, end);
+  size_t length = end - begin;
+  if (length < kBulkShadowClearThreshold) {
+    ::memset(begin, kHeapAddressableMarker, length);
+    return;
+  }
+
+  // Large allocations are typically carved from memory whose shadow is
+  // already clean, having been unpoisoned when last freed or never been used
+  // at all. A read-only vectorized scan is much cheaper than dirtying the
+  // entire range, so only write to the chunks that actually need it.
+  static_assert(kHeapAddressableMarker == 0,
+                "Bulk clearing assumes addressable memory has a zero marker.");
+  uint8_t* cursor = begin;
+  while (cursor != end) {
+    uint8_t* chunk_end = ::common::AlignUp(cursor + 1, kBulkShadowClearChunk);
+    chunk_end = std::min(chunk_end, end);
+    if (FindFirstNonZeroByte(cursor, chunk_end) != chunk_end)
+      ::memset(cursor, kHeapAddressableMarker, chunk_end - cursor);
+    cursor = chunk_end;
+  }
+}
+
+const uint8_t* FindFirstNonZeroByteGeneric(const uint8_t* start,
+                                           const uint8_t* end) {
+  DCHECK_LE(start, end);
+  if (static_cast<size_t>(end - start) < 2 * sizeof(uint64_t))
+    return FindFirstNonZeroByteImpl8(start, end);
+
+  const uint8_t* start_aligned = ::common::AlignUp(start, sizeof(uint64_t));
+  const uint8_t* end_aligned = ::common::AlignDown(end, sizeof(uint64_t));
+
+  const uint8_t* ret = FindFirstNonZeroByteImpl8(start, start_aligned);
+  if (ret != start_aligned)
+    return ret;
+
+  const uint64_t* cursor = reinterpret_cast<const uint64_t*>(start_aligned);
+  const uint64_t* cursor_end = reinterpret_cast<const uint64_t*>(end_aligned);
+  for (; cursor != cursor_end; ++cursor) {
+    if (*cursor != 0) {
+      const uint8_t* bytes = reinterpret_cast<const uint8_t*>(cursor);
+      return FindFirstNonZeroByteImpl8(bytes, bytes + sizeof(uint64_t));
+    }
+  }
+
+  return FindFirstNonZeroByteImpl8(end_aligned, end);
+}
+
+const uint8_t* FindFirstNonZeroByteSse2(const uint8_t* start,
+                                        const uint8_t* end) {
+  static const size_t kVectorSize = sizeof(__m128i);
+  DCHECK_LE(start, end);
+  if (static_cast<size_t>(end - start) < 2 * kVectorSize)
+    return FindFirstNonZeroByteGeneric(start, end);
+
+  const uint8_t* start_aligned = ::common::AlignUp(start, kVectorSize);
+  const uint8_t* end_aligned = ::common::AlignDown(end, kVectorSize);
+
+  const uint8_t* ret = FindFirstNonZeroByteGeneric(start, start_aligned);
+  if (ret != start_aligned)
+    return ret;
+
+  // Compare 16 bytes at a time against zero. The mask has a bit set for each
+  // byte that is zero, so any unset bit indicates a poisoned byte.
+  const __m128i zero = _mm_setzero_si128();
+  for (const uint8_t* cursor = start_aligned; cursor != end_aligned;
+       cursor += kVectorSize) {
+    __m128i value = _mm_load_si128(reinterpret_cast<const __m128i*>(cursor));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(value, zero));
+    if (mask != 0xFFFF) {
+      unsigned long index = 0;
+      _BitScanForward(&index, ~mask & 0xFFFF);
+      return cursor + index;
+    }
+  }
+
+  return FindFirstNonZeroByteGeneric(end_aligned, end);
+}
+
+const uint8_t* FindFirstNonZeroByteAvx2(const uint8_t* start,
+                                        const uint8_t* end) {
+  static const size_t kVectorSize = sizeof(__m256i);
+  DCHECK_LE(start, end);
+  if (static_cast<size_t>(end - start) < 2 * kVectorSize)
+    return FindFirstNonZeroByteSse2(start, end);
+
+  const uint8_t* start_aligned = ::common::AlignUp(start, kVectorSize);
+  const uint8_t* end_aligned = ::common::AlignDown(end, kVectorSize);
+
+  const uint8_t* ret = FindFirstNonZeroByteSse2(start, start_aligned);
+  if (ret != start_aligned)
+    return ret;
+
+  // Same as the SSE2 version, but 32 bytes at a time.
+  ret = nullptr;
+  const __m256i zero = _mm256_setzero_si256();
+  for (const uint8_t* cursor = start_aligned; cursor != end_aligned;
+       cursor += kVectorSize) {
+    __m256i value =
+        _mm256_load_si256(reinterpret_cast<const __m256i*>(cursor));
+    unsigned int mask = static_cast<unsigned int>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(value, zero)));
+    if (mask != 0xFFFFFFFF) {
+      unsigned long index = 0;
+      _BitScanForward(&index, ~mask);
+      ret = cursor + index;
+      break;
+    }
+  }
+
+  // Avoid AVX to SSE transition penalties in the caller.
+  _mm256_zeroupper();
+
+  if (ret != nullptr)
+    return ret;
+  return FindFirstNonZeroByteSse2(end_aligned, end);
+}
+
+bool CpuSupportsSse2() {
+#ifdef _WIN64
+  // SSE2 is part of the x64 baseline.
+  return true;
+#else
+  return ::IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE) != 0;
+#endif
+}
+
+bool CpuSupportsAvx2() {
+  int info[4] = {};
+  ::__cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+
+  // The OS must have enabled XSAVE and the saving of the YMM registers.
+  static const int kOsxsaveBit = 1 << 27;
+  static const int kAvxBit = 1 << 28;
+  ::__cpuid(info, 1);
+  if ((info[2] & kOsxsaveBit) == 0 || (info[2] & kAvxBit) == 0)
+    return false;
+  static const unsigned __int64 kXmmYmmState = 0x6;
+  if ((::_xgetbv(0) & kXmmYmmState) != kXmmYmmState)
+    return false;
+
+  static const int kAvx2Bit = 1 << 5;
+  ::__cpuidex(info, 7, 0);
+  return (info[1] & kAvx2Bit) != 0;
+}
+
+const uint8_t* FindFirstNonZeroByte(const uint8_t* start, const uint8_t* end) {
+  if (static_cast<size_t>(end - start) < kMinVectorizedScanLength)
+    return FindFirstNonZeroByteGeneric(start, end);
+  return (*g_find_first_non_zero_byte)(start, end);
+}
+
+}  // namespace internal
+
+Shadow::Shadow()
+    : own_memory_(false), shadow_(nullptr), length_(0), sparse_(false),
+      committed_page_count_(0), next_sparse_shadow_(nullptr) {
   Init(RequiredLength());
 }
 
 Shadow::Shadow(size_t length)
-    : own_memory_(false), shadow_(nullptr), length_(0) {
+    : own_memory_(false), shadow_(nullptr), length_(0), sparse_(false),
+      committed_page_count_(0), next_sparse_shadow_(nullptr) {
   Init(length);
 }
 
+Shadow::Shadow(size_t length, bool sparse)
+    : own_memory_(false), shadow_(nullptr), length_(0), sparse_(false),
+      committed_page_count_(0), next_sparse_shadow_(nullptr) {
+  Init(length, sparse);
+}
+
 Shadow::Shadow(void* shadow, size_t length)
-    : own_memory_(false), shadow_(nullptr), length_(0) {
+    : own_memory_(false), shadow_(nullptr), length_(0), sparse_(false),
+      committed_page_count_(0), next_sparse_shadow_(nullptr) {
   Init(false, shadow, length);
 }
 
 Shadow::~Shadow() {
+  if (sparse_)
+    UnregisterSparseShadow();
   if (own_memory_)
     CHECK(::VirtualFree(shadow_, 0, MEM_RELEASE));
   own_memory_ = false;
   shadow_ = nullptr;
   length_ = 0;
+  sparse_ = false;
 }
 
 // static
@@ -93,7 +357,12 @@ void Shadow::SetUp() {
   // Poison the first 64k of the memory as they're not addressable.
   Poison(0, kAddressLowerBound, kInvalidAddressMarker);
   // Poison the protection bits array.
-  Poison(page_bits_.data(), page_bits_.size(), kAsanMemoryMarker);
+  Poison(page_bits(), page_bits_size(), kAsanMemoryMarker);
+  // Poison the commit bits array.
+  if (!committed_page_bits_.empty()) {
+    Poison(committed_page_bits_.data(), committed_page_bits_.size(),
+           kAsanMemoryMarker);
+  }
 }
 
 void Shadow::TearDown() {
@@ -110,7 +379,10 @@ void Shadow::TearDown() {
   // Unpoison the first 64k of the memory.
   Unpoison(0, kAddressLowerBound);
   // Unpoison the protection bits array.
-  Unpoison(page_bits_.data(), page_bits_.size());
+  Unpoison(page_bits(), page_bits_size());
+  // Unpoison the commit bits array.
+  if (!committed_page_bits_.empty())
+    Unpoison(committed_page_bits_.data(), committed_page_bits_.size());
 }
 
 bool Shadow::IsClean() const {
@@ -122,9 +394,17 @@ bool Shadow::IsClean() const {
       reinterpret_cast<uintptr_t>(shadow_ + length_) >> kShadowRatioLog;
 
   const size_t page_bits_begin =
-      reinterpret_cast<uintptr_t>(page_bits_.data()) >> kShadowRatioLog;
+      reinterpret_cast<uintptr_t>(page_bits()) >> kShadowRatioLog;
   const size_t page_bits_end =
-      reinterpret_cast<uintptr_t>(page_bits_.data() + page_bits_.size()) >>
+      reinterpret_cast<uintptr_t>(page_bits() + page_bits_size()) >>
+          kShadowRatioLog;
+
+  const size_t committed_bits_begin =
+      reinterpret_cast<uintptr_t>(committed_page_bits_.data()) >>
+          kShadowRatioLog;
+  const size_t committed_bits_end =
+      reinterpret_cast<uintptr_t>(committed_page_bits_.data() +
+                                  committed_page_bits_.size()) >>
           kShadowRatioLog;
 
   void const* self = nullptr;
@@ -136,20 +416,22 @@ bool Shadow::IsClean() const {
       (reinterpret_cast<uintptr_t>(self) + self_size + kShadowRatio - 1) >>
           kShadowRatioLog;
 
+  // This uses PeekShadowByte so as not to commit all of a sparse shadow.
   size_t i = 0;
   for (; i < innac_end; ++i) {
-    if (shadow_[i] != kInvalidAddressMarker)
+    if (PeekShadowByte(i) != kInvalidAddressMarker)
       return false;
   }
 
   for (; i < length_; ++i) {
     if ((i >= shadow_begin && i < shadow_end) ||
         (i >= page_bits_begin && i < page_bits_end) ||
+        (i >= committed_bits_begin && i < committed_bits_end) ||
         (i >= this_begin && i < this_end)) {
-      if (shadow_[i] != kAsanMemoryMarker)
+      if (PeekShadowByte(i) != kAsanMemoryMarker)
         return false;
     } else {
-      if (shadow_[i] != kHeapAddressableMarker)
+      if (PeekShadowByte(i) != kHeapAddressableMarker)
         return false;
     }
   }
@@ -184,11 +466,25 @@ void Shadow::GetPointerAndSizeImpl(void const** self, size_t* size) const {
 }
 
 void Shadow::Init(size_t length) {
+  Init(length, false);
+}
+
+void Shadow::Init(size_t length, bool sparse) {
   DCHECK_LT(0u, length);
 
-  // The allocation may fail and it needs to be handled gracefully.
-  void* mem = ::VirtualAlloc(nullptr, length, MEM_COMMIT, PAGE_READWRITE);
+  // The allocation may fail and it needs to be handled gracefully. A sparse
+  // shadow only reserves its address space, and commits it on demand.
+  void* mem = nullptr;
+  if (sparse) {
+    DCHECK_EQ(0u, length % kPageSize);
+    mem = ::VirtualAlloc(nullptr, length, MEM_RESERVE, PAGE_NOACCESS);
+  } else {
+    mem = ::VirtualAlloc(nullptr, length, MEM_COMMIT, PAGE_READWRITE);
+  }
+  sparse_ = sparse && mem != nullptr;
   Init(true, mem, length);
+  if (sparse_)
+    RegisterSparseShadow();
 }
 
 void Shadow::Init(bool own_memory, void* shadow, size_t length) {
@@ -211,20 +507,183 @@ void Shadow::Init(bool own_memory, void* shadow, size_t length) {
   uint64_t memory_size = static_cast<uint64_t>(length) << kShadowRatioLog;
   DCHECK_EQ(0u, memory_size % kPageSize);
   size_t page_count = memory_size / kPageSize;
-  size_t page_bytes = page_count / 8;
-  page_bits_.resize(page_bytes);
+  page_bits_.resize((page_count + kPagesPerWord - 1) / kPagesPerWord);
+
+  // Initialize the commit bits array.
+  if (sparse_) {
+    size_t shadow_page_count = (length + kPageSize - 1) / kPageSize;
+    committed_page_bits_.resize((shadow_page_count + 7) / 8);
+  }
 
   // Zero the memory.
   Reset();
 }
 
 void Shadow::Reset() {
-  ::memset(shadow_, 0, length_);
-  ::memset(page_bits_.data(), 0, page_bits_.size());
+  if (sparse_) {
+    // Decommitted pages read as zero once they are committed again, so this
+    // is equivalent to clearing them.
+    base::AutoLock lock(commit_lock_);
+    CHECK(::VirtualFree(shadow_, length_, MEM_DECOMMIT));
+    ::memset(committed_page_bits_.data(), 0, committed_page_bits_.size());
+    committed_page_count_ = 0;
+  } else {
+    ::memset(shadow_, 0, length_);
+  }
+  ::memset(page_bits_.data(), 0, page_bits_size());
 
   SetShadowMemory(0, kShadowRatio * length_, kHeapAddressableMarker);
 }
 
+size_t Shadow::committed_page_count() const {
+  if (!sparse_)
+    return (length_ + kPageSize - 1) / kPageSize;
+  base::AutoLock lock(commit_lock_);
+  return committed_page_count_;
+}
+
+bool Shadow::ShadowIsCommittedForAddress(const void* addr) const {
+  size_t index = reinterpret_cast<uintptr_t>(addr) >> kShadowRatioLog;
+  DCHECK_LT(index, length_);
+  return ShadowPageIsCommitted(index / kPageSize);
+}
+
+bool Shadow::CommitShadowPages(size_t index, size_t count) {
+  if (!sparse_ || count == 0)
+    return true;
+  DCHECK_LE(index + count, length_);
+
+  size_t page = index / kPageSize;
+  size_t last_page = (index + count - 1) / kPageSize;
+
+  // Check without the lock first, as in the common case the pages are already
+  // committed.
+  while (page <= last_page && ShadowPageIsCommitted(page))
+    ++page;
+  if (page > last_page)
+    return true;
+
+  base::AutoLock lock(commit_lock_);
+  while (page <= last_page) {
+    if (ShadowPageIsCommitted(page)) {
+      ++page;
+      continue;
+    }
+
+    // Commit runs of uncommitted pages with a single call.
+    size_t run_end = page + 1;
+    while (run_end <= last_page && !ShadowPageIsCommitted(run_end))
+      ++run_end;
+    if (::VirtualAlloc(shadow_ + page * kPageSize, (run_end - page) * kPageSize,
+                       MEM_COMMIT, PAGE_READWRITE) == nullptr) {
+      return false;
+    }
+
+    // Only publish the bits once the pages are actually committed.
+    committed_page_count_ += run_end - page;
+    for (; page < run_end; ++page)
+      committed_page_bits_[page / 8] |= 1 << (page % 8);
+  }
+
+  return true;
+}
+
+void Shadow::ClearShadow(size_t index, size_t count) {
+  if (!sparse_) {
+    internal::ClearShadowBytes(shadow_ + index, shadow_ + index + count);
+    return;
+  }
+
+  // Only clear the parts of the range that are committed, as the rest are
+  // implicitly clean.
+  size_t end = index + count;
+  while (index < end) {
+    size_t page = index / kPageSize;
+    size_t page_end = std::min(end, (page + 1) * kPageSize);
+    if (ShadowPageIsCommitted(page))
+      internal::ClearShadowBytes(shadow_ + index, shadow_ + page_end);
+    index = page_end;
+  }
+}
+
+bool Shadow::ShadowPageIsCommitted(size_t page) const {
+  if (!sparse_)
+    return true;
+  DCHECK_LT(page / 8, committed_page_bits_.size());
+  return (committed_page_bits_[page / 8] & (1 << (page % 8))) != 0;
+}
+
+uint8_t Shadow::PeekShadowByte(size_t index) const {
+  DCHECK_LT(index, length_);
+  if (!ShadowPageIsCommitted(index / kPageSize))
+    return kHeapAddressableMarker;
+  return shadow_[index];
+}
+
+void Shadow::RegisterSparseShadow() {
+  DCHECK(sparse_);
+  SparseShadowList* list = g_sparse_shadows.Pointer();
+  base::AutoLock lock(list->lock);
+  next_sparse_shadow_ = list->head;
+  list->head = this;
+
+  // The handler is installed first in line, so that faults in the shadow are
+  // serviced before any other handler sees them.
+  if (list->handler == nullptr) {
+    list->handler =
+        ::AddVectoredExceptionHandler(TRUE, &SparseShadowExceptionHandler);
+    CHECK_NE(static_cast<void*>(nullptr), list->handler);
+  }
+}
+
+void Shadow::UnregisterSparseShadow() {
+  DCHECK(sparse_);
+  SparseShadowList* list = g_sparse_shadows.Pointer();
+  base::AutoLock lock(list->lock);
+  Shadow** link = &list->head;
+  while (*link != this) {
+    DCHECK_NE(static_cast<Shadow*>(nullptr), *link);
+    link = &(*link)->next_sparse_shadow_;
+  }
+  *link = next_sparse_shadow_;
+  next_sparse_shadow_ = nullptr;
+
+  if (list->head == nullptr) {
+    ::RemoveVectoredExceptionHandler(list->handler);
+    list->handler = nullptr;
+  }
+}
+
+// static
+LONG CALLBACK Shadow::SparseShadowExceptionHandler(
+    EXCEPTION_POINTERS* exception) {
+  const EXCEPTION_RECORD* record = exception->ExceptionRecord;
+  if (record->ExceptionCode != EXCEPTION_ACCESS_VIOLATION ||
+      record->NumberParameters < 2) {
+    return EXCEPTION_CONTINUE_SEARCH;
+  }
+
+  const uint8_t* address =
+      reinterpret_cast<const uint8_t*>(record->ExceptionInformation[1]);
+  SparseShadowList* list = g_sparse_shadows.Pointer();
+  base::AutoLock lock(list->lock);
+  for (Shadow* shadow = list->head; shadow != nullptr;
+       shadow = shadow->next_sparse_shadow_) {
+    if (address < shadow->shadow_ ||
+        address >= shadow->shadow_ + shadow->length_) {
+      continue;
+    }
+
+    // The page may have been committed by another thread in the meantime, in
+    // which case this is a no-op and the access simply needs to be retried.
+    if (!shadow->CommitShadowPages(address - shadow->shadow_, 1))
+      return EXCEPTION_CONTINUE_SEARCH;
+    return EXCEPTION_CONTINUE_EXECUTION;
+  }
+
+  return EXCEPTION_CONTINUE_SEARCH;
+}
+
 void Shadow::Poison(const void* addr, size_t size, ShadowMarker shadow_val) {
   uintptr_t index = reinterpret_cast<uintptr_t>(addr);
   uintptr_t start = index & (kShadowRatio - 1);
@@ -233,6 +692,8 @@ void Shadow::Poison(const void* addr, size_t size, ShadowMarker shadow_val) {
   SetShadowMemory(addr, size, shadow_val);
 
   index >>= kShadowRatioLog;
+  size_t count = (size + start) >> kShadowRatioLog;
+  CHECK(CommitShadowPages(index, count));
   if (start)
     shadow_[index++] = start;
 
@@ -251,10 +712,12 @@ void Shadow::Unpoison(const void* addr, size_t size) {
   index >>= kShadowRatioLog;
   size >>= kShadowRatioLog;
   DCHECK_GT(length_, index + size);
-  ::memset(shadow_ + index, kHeapAddressableMarker, size);
+  ClearShadow(index, size);
 
-  if (remainder != 0)
+  if (remainder != 0) {
+    CHECK(CommitShadowPages(index + size, 1));
     shadow_[index + size] = remainder;
+  }
 }
 
 namespace {
@@ -301,7 +764,42 @@ inline void MarkAsFreedImplAligned64(uint64_t* cursor, uint64_t* cursor_end) {
   }
 }
 
+// Marks the given range of shadow bytes as freed, preserving left and right
+// redzone bytes. |cursor| and |cursor_end| must be 16-byte aligned. This
+// handles 16 bytes at a time, falling back to the 64-bit implementation for
+// any 16 byte group that isn't entirely addressable.
+inline void MarkAsFreedImplAlignedSse2(uint8_t* cursor, uint8_t* cursor_end) {
+  DCHECK(::common::IsAligned(cursor, sizeof(__m128i)));
+  DCHECK(::common::IsAligned(cursor_end, sizeof(__m128i)));
+
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i freed = _mm_set1_epi8(static_cast<char>(kHeapFreedMarker));
+  for (; cursor != cursor_end; cursor += sizeof(__m128i)) {
+    __m128i* vector = reinterpret_cast<__m128i*>(cursor);
+    __m128i value = _mm_load_si128(vector);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(value, zero)) == 0xFFFF) {
+      _mm_store_si128(vector, freed);
+    } else {
+      MarkAsFreedImplAligned64(
+          reinterpret_cast<uint64_t*>(cursor),
+          reinterpret_cast<uint64_t*>(cursor + sizeof(__m128i)));
+    }
+  }
+}
+
 inline void MarkAsFreedImpl64(uint8_t* cursor, uint8_t* cursor_end) {
+  // Large ranges use the SSE2 implementation, if available.
+  if (cursor_end - cursor >= kBulkShadowClearThreshold &&
+      internal::CpuSupportsSse2()) {
+    uint8_t* cursor_aligned = ::common::AlignUp(cursor, sizeof(__m128i));
+    uint8_t* cursor_end_aligned =
+        ::common::AlignDown(cursor_end, sizeof(__m128i));
+    MarkAsFreedImpl8(cursor, cursor_aligned);
+    MarkAsFreedImplAlignedSse2(cursor_aligned, cursor_end_aligned);
+    MarkAsFreedImpl8(cursor_end_aligned, cursor_end);
+    return;
+  }
+
   if (cursor_end - cursor >= 2 * sizeof(uint64_t)) {
     uint8_t* cursor_aligned = ::common::AlignUp(cursor, sizeof(uint64_t));
     uint8_t* cursor_end_aligned =
@@ -327,6 +825,7 @@ void Shadow::MarkAsFreed(const void* addr, size_t size) {
   size_t length = (size + kShadowRatio - 1) / kShadowRatio;
   DCHECK_LE(index, length_);
   DCHECK_LE(index + length, length_);
+  CHECK(CommitShadowPages(index, length));
 
   uint8_t* cursor = shadow_ + index;
   uint8_t* cursor_end = static_cast<uint8_t*>(cursor) + length;
@@ -391,9 +890,15 @@ bool Shadow::IsRangeAccessible(const void* addr, size_t size) const {
     return false;
 
   // Now run over the shadow bytes from start to end, which all need to be
-  // zero.
-  if (!internal::IsZeroBufferImpl<uint64_t>(&shadow_[start], &shadow_[end]))
+  // zero. Short ranges are the common case and are best served by the
+  // inlined implementation, while long ranges go to the vectorized kernels.
+  if (end - start < kMinVectorizedScanLength) {
+    if (!internal::IsZeroBufferImpl<uint64_t>(&shadow_[start], &shadow_[end]))
       return false;
+  } else if (internal::FindFirstNonZeroByte(&shadow_[start], &shadow_[end]) !=
+             &shadow_[end]) {
+    return false;
+  }
 
   // Finally test the end point if there's a tail offset.
   if (end_offs == 0U)
@@ -448,12 +953,19 @@ const void* Shadow::FindFirstPoisonedByte(const void* addr, size_t size) const {
   if (end > length_)
     return out_addr;
 
-  for (size_t curr = start; curr < end; ++curr, out_addr += kShadowRatio) {
-    shadow = shadow_[curr];
-    if (ShadowMarkerHelper::IsRedzone(shadow))
-      return out_addr;
-    if (shadow != 0)
+  // Skip over the accessible shadow bytes in bulk, and then look at the
+  // first poisoned one, if any.
+  if (start < end) {
+    const uint8_t* poisoned =
+        internal::FindFirstNonZeroByte(&shadow_[start], &shadow_[end]);
+    if (poisoned != &shadow_[end]) {
+      out_addr += (poisoned - &shadow_[start]) * kShadowRatio;
+      shadow = *poisoned;
+      if (ShadowMarkerHelper::IsRedzone(shadow))
+        return out_addr;
       return out_addr + shadow;
+    }
+    out_addr += (end - start) * kShadowRatio;
   }
 
   // Finally test the end point if there's a tail offset.
@@ -561,12 +1073,20 @@ void Shadow::PoisonAllocatedBlock(const BlockInfo& info) {
   uint8_t trailer_marker =
       ShadowMarkerHelper::BuildBlockEnd(true, info.header->is_nested);
 
+  // Commit the shadow for the redzones of a sparse shadow. The body is
+  // cleared by ClearShadow, which leaves untouched pages uncommitted.
+  size_t right_redzone_index = index + left_redzone_bytes + body_bytes;
+  CHECK(CommitShadowPages(index, left_redzone_bytes));
+  if (body_size_mod > 0)
+    CHECK(CommitShadowPages(right_redzone_index - 1, 1));
+  CHECK(CommitShadowPages(right_redzone_index, right_redzone_bytes));
+
   // Poison the header and left padding.
   uint8_t* cursor = shadow_ + index;
   ::memset(cursor, header_marker, 1);
   ::memset(cursor + 1, kHeapLeftPaddingMarker, left_redzone_bytes - 1);
   cursor += left_redzone_bytes;
-  ::memset(cursor, kHeapAddressableMarker, body_bytes);
+  ClearShadow(index + left_redzone_bytes, body_bytes);
   cursor += body_bytes;
 
   // Poison the right padding and the trailer.
@@ -635,61 +1155,42 @@ bool Shadow::IsBeginningOfBlockBody(const void* addr) const {
 }
 
 bool Shadow::PageIsProtected(const void* addr) const {
-  // Since the page bit is read very frequently this is not performed
-  // under a lock. The values change quite rarely, so this will almost always
-  // be correct. However, consumers of this knowledge have to be robust to
+  // Since the page bit is read very frequently this is not an interlocked
+  // read. The values change quite rarely, so this will almost always be
+  // correct. However, consumers of this knowledge have to be robust to
   // getting incorrect data.
   size_t index = 0;
-  uint8_t mask = 0;
+  LONG mask = 0;
   AddressToPageMask(addr, &index, &mask);
   return (page_bits_[index] & mask) == mask;
 }
 
 void Shadow::MarkPageProtected(const void* addr) {
   size_t index = 0;
-  uint8_t mask = 0;
+  LONG mask = 0;
   AddressToPageMask(addr, &index, &mask);
-
-  base::AutoLock lock(page_bits_lock_);
-  page_bits_[index] |= mask;
+  ::InterlockedOr(&page_bits_[index], mask);
 }
 
 void Shadow::MarkPageUnprotected(const void* addr) {
   size_t index = 0;
-  uint8_t mask = 0;
+  LONG mask = 0;
   AddressToPageMask(addr, &index, &mask);
-  mask = ~mask;
-
-  base::AutoLock lock(page_bits_lock_);
-  page_bits_[index] &= mask;
+  ::InterlockedAnd(&page_bits_[index], ~mask);
 }
 
 void Shadow::MarkPagesProtected(const void* addr, size_t size) {
-  const uint8_t* page = reinterpret_cast<const uint8_t*>(addr);
-  const uint8_t* page_end = page + size;
-  size_t index = 0;
-  uint8_t mask = 0;
-
-  base::AutoLock lock(page_bits_lock_);
-  while (page < page_end) {
-    AddressToPageMask(page, &index, &mask);
-    page_bits_[index] |= mask;
-    page += kPageSize;
-  }
+  size_t first_page = reinterpret_cast<uintptr_t>(addr) / kPageSize;
+  size_t page_count = (size + kPageSize - 1) / kPageSize;
+  DCHECK_LE(first_page + page_count, page_bits_.size() * kPagesPerWord);
+  UpdatePageBits(page_bits_.data(), first_page, page_count, true);
 }
 
 void Shadow::MarkPagesUnprotected(const void* addr, size_t size) {
-  const uint8_t* page = reinterpret_cast<const uint8_t*>(addr);
-  const uint8_t* page_end = page + size;
-  size_t index = 0;
-  uint8_t mask = 0;
-
-  base::AutoLock lock(page_bits_lock_);
-  while (page < page_end) {
-    AddressToPageMask(page, &index, &mask);
-    page_bits_[index] &= ~mask;
-    page += kPageSize;
-  }
+  size_t first_page = reinterpret_cast<uintptr_t>(addr) / kPageSize;
+  size_t page_count = (size + kPageSize - 1) / kPageSize;
+  DCHECK_LE(first_page + page_count, page_bits_.size() * kPagesPerWord);
+  UpdatePageBits(page_bits_.data(), first_page, page_count, false);
 }
 
 void Shadow::AppendShadowByteText(const char *prefix,
@@ -1023,7 +1524,9 @@ bool ShadowWalker::Next(BlockInfo* info) {
   DCHECK_NE(static_cast<BlockInfo*>(NULL), info);
 
   // Iterate until a reportable block is encountered, or the slab is exhausted.
-  for (; cursor_ != upper_bound_; cursor_ += kShadowRatio) {
+  // The cursor can end up past the upper bound when the last block of the
+  // slab extends beyond it.
+  for (; cursor_ < upper_bound_; cursor_ += kShadowRatio) {
     uint8_t marker = shadow_->GetShadowMarkerForAddress(cursor_);
 
     // Update the nesting depth when block end markers are encountered.
@@ -67,6 +67,8 @@
 #ifndef SYZYGY_AGENT_ASAN_SHADOW_H_
 #define SYZYGY_AGENT_ASAN_SHADOW_H_
 
+#include <windows.h>
+#include <emmintrin.h>
 #include <string>
 #include <vector>
 
@@ -109,6 +111,15 @@ class Shadow {
   //     nullptr. If this is true the object should not be used.
   explicit Shadow(size_t length);
 
+  // Shadow constructor. Allocates shadow memory internally.
+  // @param length The length of the shadow memory in bytes. This implicitly
+  //     encodes the maximum addressable address of the shadow.
+  // @param sparse If true then the shadow memory is only reserved, and its
+  //     pages are committed lazily as they are first written or read.
+  // @note The allocation may fail, in which case 'shadow()' will return
+  //     nullptr. If this is true the object should not be used.
+  Shadow(size_t length, bool sparse);
+
   // Shadow constructor.
   // @param shadow The array to use for storing the shadow memory. The shadow
   //     memory allocation *must* be kShadowRatio byte aligned.
@@ -275,24 +286,28 @@ class Shadow {
 
   // Marks a given page as being protected.
   // @param addr An address in the page to be protected.
-  // @note Grabs a global shadow lock.
+  // @note This is an interlocked update of a single word of the page bits,
+  //     and takes no lock.
   void MarkPageProtected(const void* addr);
 
   // Marks a given page as being unprotected.
   // @param addr An address in the page to be protected.
-  // @note Grabs a global shadow lock.
+  // @note This is an interlocked update of a single word of the page bits,
+  //     and takes no lock.
   void MarkPageUnprotected(const void* addr);
 
   // Marks a given range of pages as being protected.
   // @param addr The first page to be marked.
   // @param size The extent of the memory to be marked.
-  // @note Grabs a global shadow lock.
+  // @note The words of the page bits entirely covered by the range are
+  //     written at once, and those at its ends are updated with interlocked
+  //     operations. No lock is taken.
   void MarkPagesProtected(const void* addr, size_t size);
 
   // Marks a given range of pages as being unprotected.
   // @param addr The first page to be marked.
   // @param size The extent of the memory to be marked.
-  // @note Grabs a global shadow lock.
+  // @note See MarkPagesProtected.
   void MarkPagesUnprotected(const void* addr, size_t size);
 
   // Returns the size of memory represented by the shadow.
@@ -305,11 +320,32 @@ class Shadow {
   // Returns the length of the shadow array.
   size_t length() const { return length_; }
 
-  // Read only accessor of page protection bits.
-  const uint8_t* page_bits() const { return page_bits_.data(); }
+  // @returns true if the shadow memory is committed lazily.
+  bool sparse() const { return sparse_; }
+
+  // @returns the number of pages of shadow memory that are currently
+  //     committed. For a shadow that isn't sparse this is all of them.
+  size_t committed_page_count() const;
+
+  // Determines if the shadow memory for the given address is committed. This
+  // is always true for a shadow that isn't sparse.
+  // @param addr The address whose shadow memory is to be queried.
+  // @returns true if the page of shadow memory for @p addr is committed.
+  // @note The read does not occur under a lock, so it is possible to get
+  //     stale data.
+  bool ShadowIsCommittedForAddress(const void* addr) const;
+
+  // Read only accessor of page protection bits. The bits are stored in
+  // little-endian words, so this byte view has bit (i % 8) of byte (i / 8)
+  // set when page i is protected.
+  const uint8_t* page_bits() const {
+    return reinterpret_cast<const uint8_t*>(page_bits_.data());
+  }
 
-  // Returns the length of the page bits array.
-  size_t const page_bits_size() const { return page_bits_.size(); }
+  // Returns the length of the page bits array, in bytes.
+  size_t const page_bits_size() const {
+    return page_bits_.size() * sizeof(page_bits_[0]);
+  }
 
   // Determines if the shadow memory is clean. That is, it reflects the
   // state of shadow memory immediately after construction and a call to
@@ -336,9 +372,51 @@ class Shadow {
   void Init(size_t length);
   void Init(bool own_memory, void* shadow, size_t length);
 
+  // Initializes this shadow object with internally allocated memory.
+  // @param length The length of the shadow memory in bytes.
+  // @param sparse If true then the memory is only reserved.
+  void Init(size_t length, bool sparse);
+
   // Reset the shadow memory.
   void Reset();
 
+  // @name Sparse shadow helpers.
+  // @{
+  // Commits the shadow pages covering the shadow bytes
+  // shadow_[index] to shadow_[index + count - 1]. This is a no-op if the
+  // shadow isn't sparse.
+  // @param index The index of the first shadow byte.
+  // @param count The number of shadow bytes.
+  // @returns true on success, false if the memory couldn't be committed.
+  bool CommitShadowPages(size_t index, size_t count);
+
+  // Sets the shadow bytes shadow_[index] to shadow_[index + count - 1] to
+  // kHeapAddressableMarker. This doesn't commit pages of a sparse shadow that
+  // aren't already committed, as those implicitly read as zero.
+  // @param index The index of the first shadow byte.
+  // @param count The number of shadow bytes.
+  void ClearShadow(size_t index, size_t count);
+
+  // @param page The index of a page of shadow memory.
+  // @returns true if the given shadow page has been committed.
+  bool ShadowPageIsCommitted(size_t page) const;
+
+  // Reads a shadow byte, without committing the page it lives on.
+  // @param index The index of the shadow byte to read.
+  // @returns the shadow byte, or zero if it isn't committed.
+  uint8_t PeekShadowByte(size_t index) const;
+
+  // Adds or removes this shadow from the list of sparse shadows whose faults
+  // are serviced by SparseShadowExceptionHandler.
+  void RegisterSparseShadow();
+  void UnregisterSparseShadow();
+
+  // The vectored exception handler that commits the pages of sparse shadows
+  // as they are accessed.
+  static LONG CALLBACK SparseShadowExceptionHandler(
+      EXCEPTION_POINTERS* exception);
+  // @}
+
   // Appends a line of shadow byte text for the bytes ranging from
   // shadow_[index] to shadow_[index + 7], prefixed by @p prefix. If the index
   // @p bug_index is present in this range then its value will be surrounded by
@@ -391,12 +469,28 @@ class Shadow {
   // The length of the underlying shadow.
   size_t length_;
 
-  // A lock under which page protection bits are modified.
-  base::Lock page_bits_lock_;
+  // Data about which pages are protected, one bit per page. This is updated
+  // with interlocked operations on whole words, so that concurrent updates
+  // of neighbouring pages don't need to be serialized.
+  std::vector<LONG> page_bits_;
+
+  // If this is true then the shadow memory is only reserved, and is committed
+  // a page at a time as it is used.
+  bool sparse_;
+
+  // A lock under which the pages of a sparse shadow are committed.
+  mutable base::Lock commit_lock_;
+
+  // Data about which pages of a sparse shadow are committed. Bits are only
+  // ever set once the corresponding page is committed, so they may be read
+  // without the lock. Under commit_lock_.
+  std::vector<uint8_t> committed_page_bits_;
+
+  // The number of committed pages of a sparse shadow. Under commit_lock_.
+  size_t committed_page_count_;
 
-  // Data about which pages are protected. This changes relatively rarely, so
-  // is reasonable to synchronize. Under page_bits_lock_.
-  std::vector<uint8_t> page_bits_;
+  // The next sparse shadow in the list used by the exception handler.
+  Shadow* next_sparse_shadow_;
 };
 
 // A helper class to walk over the blocks contained in a given memory region.
@@ -441,8 +535,9 @@ class ShadowWalker {
   const uint8_t* lower_bound_;
   const uint8_t* upper_bound_;
 
-  // The current cursor of the shadow walker. This points to upper_bound_ when
-  // the walk is terminated.
+  // The current cursor of the shadow walker. This points to upper_bound_, or
+  // to the end of the last block if it extends beyond it, when the walk is
+  // terminated.
   const uint8_t* cursor_;
 
   // The shadow cursor. This is maintained simply for debugging and to ensure
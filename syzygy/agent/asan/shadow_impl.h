@@ -18,6 +18,24 @@
 #ifndef SYZYGY_AGENT_ASAN_SHADOW_IMPL_H_
 #define SYZYGY_AGENT_ASAN_SHADOW_IMPL_H_
 
+namespace internal {
+
+// The number of bytes of an array scanned at once by
+// GetNullTerminatedArraySize. This is covered by two shadow bytes.
+static const size_t kNullScanChunkSize = sizeof(__m128i);
+
+// Returns a mask with a bit set for each byte of the null elements of
+// @p chunk, which are @p element_size bytes wide.
+inline int GetNullElementsMask(__m128i chunk, size_t element_size) {
+  __m128i zero = _mm_setzero_si128();
+  if (element_size == sizeof(uint16_t))
+    return _mm_movemask_epi8(_mm_cmpeq_epi16(chunk, zero));
+  DCHECK_EQ(sizeof(uint8_t), element_size);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, zero));
+}
+
+}  // namespace internal
+
 template <typename type>
 bool Shadow::GetNullTerminatedArraySize(const void* addr,
                                         size_t max_size,
@@ -35,8 +53,28 @@ bool Shadow::GetNullTerminatedArraySize(const void* addr,
 
   // Scan the input array 8 bytes at a time until we've found a NULL value or
   // we've reached the end of an accessible memory block.
-  // TODO(sebmarchand): Look into doing this more efficiently.
   while (true) {
+    // Once the array is suitably aligned, skip over it 16 bytes at a time for
+    // as long as both of the shadow bytes covering them are clear and they
+    // contain no null value. The slow loop below takes over to deal with the
+    // chunk containing the null value, the end of the accessible memory or
+    // the last bytes before |max_size|.
+    if ((reinterpret_cast<uintptr_t>(addr_value) &
+            (internal::kNullScanChunkSize - 1)) == 0) {
+      while (index + 1 < length_ &&
+             *reinterpret_cast<const uint16_t*>(shadow_ + index) == 0 &&
+             (max_size == 0 ||
+                 max_size - *size > internal::kNullScanChunkSize)) {
+        __m128i chunk =
+            _mm_load_si128(reinterpret_cast<const __m128i*>(addr_value));
+        if (internal::GetNullElementsMask(chunk, sizeof(type)) != 0)
+          break;
+        *size += internal::kNullScanChunkSize;
+        addr_value += internal::kNullScanChunkSize / sizeof(type);
+        index += internal::kNullScanChunkSize >> kShadowRatioLog;
+      }
+    }
+
     uint8_t shadow = shadow_[index++];
     if (ShadowMarkerHelper::IsRedzone(shadow))
       return false;
@@ -117,6 +155,41 @@ bool IsZeroBufferImpl(const uint8_t* start_in, const uint8_t* end_in) {
   return true;
 }
 
+// @name Shadow scanning kernels.
+// Each of these returns a pointer to the first non-zero byte in the range
+// [@p start, @p end), or @p end if all of the bytes are zero. Unlike
+// IsZeroBufferImpl these never read outside of the provided range. The
+// vectorized versions must only be called if the CPU supports the
+// corresponding instruction set.
+// @{
+const uint8_t* FindFirstNonZeroByteGeneric(const uint8_t* start,
+                                           const uint8_t* end);
+const uint8_t* FindFirstNonZeroByteSse2(const uint8_t* start,
+                                        const uint8_t* end);
+const uint8_t* FindFirstNonZeroByteAvx2(const uint8_t* start,
+                                        const uint8_t* end);
+// @}
+
+// Sets the shadow bytes in the range [@p begin, @p end) to
+// kHeapAddressableMarker. For large ranges this only writes to the parts of
+// the range that aren't already clean.
+// @param begin The first shadow byte to clear.
+// @param end The byte after the last shadow byte to clear.
+void ClearShadowBytes(uint8_t* begin, uint8_t* end);
+
+// @returns true if the CPU and OS support AVX2.
+bool CpuSupportsAvx2();
+
+// @returns true if the CPU supports SSE2.
+bool CpuSupportsSse2();
+
+// Dispatches to the fastest shadow scanning kernel supported by the CPU.
+// @param start The first byte to test.
+// @param end The byte after the last byte to test.
+// @returns a pointer to the first non-zero byte in [@p start, @p end), or
+//     @p end if there are none.
+const uint8_t* FindFirstNonZeroByte(const uint8_t* start, const uint8_t* end);
+
 }  // namespace internal
 
 #endif  // SYZYGY_AGENT_ASAN_SHADOW_IMPL_H_
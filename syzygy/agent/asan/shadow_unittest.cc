@@ -18,6 +18,7 @@
 
 #include "base/rand_util.h"
 #include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
 #include "gtest/gtest.h"
 #include "syzygy/common/align.h"
 #include "syzygy/testing/metrics.h"
@@ -76,12 +77,43 @@ void ShadowUtilTest() {
   }
 }
 
+// Tests a shadow scanning kernel against all head and tail alignments, and
+// with a non-zero byte at every position.
+void ShadowScanKernelTest(
+    const uint8_t* (*kernel)(const uint8_t* start, const uint8_t* end)) {
+  const size_t kBufSize = 256;
+  ALIGNAS(32) uint8_t buf[kBufSize] = {};
+  uint8_t* end = buf + kBufSize;
+
+  for (size_t i = 0; i < 32; ++i) {
+    for (size_t j = 0; j < 32; ++j) {
+      // The bytes outside of the range are non-zero, and must be ignored.
+      ::memset(buf, 0xCC, i);
+      ::memset(buf + i, 0, kBufSize - i - j);
+      ::memset(end - j, 0xCC, j);
+      ASSERT_EQ(end - j, kernel(buf + i, end - j));
+
+      for (size_t k = i; k < kBufSize - j; ++k) {
+        buf[k] = 1;
+        ASSERT_EQ(buf + k, kernel(buf + i, end - j));
+        buf[k] = 0;
+      }
+    }
+  }
+
+  // An empty range.
+  EXPECT_EQ(buf, kernel(buf, buf));
+}
+
 // A derived class to expose protected members for unit-testing.
 class TestShadow : public Shadow {
  public:
   TestShadow() : Shadow(kTestShadowSize) {
   }
 
+  TestShadow(size_t length, bool sparse) : Shadow(length, sparse) {
+  }
+
   // We'll simulate memory as being 1GB in size.
   static const size_t kTestShadowSize =
       (1 * 1024 * 1024 * 1024) >> kShadowRatioLog;
@@ -113,6 +145,36 @@ TEST_F(ShadowTest, IsZeroBufferImplTest) {
   ShadowUtilTest<uint64_t>();
 }
 
+TEST_F(ShadowTest, FindFirstNonZeroByteKernels) {
+  ShadowScanKernelTest(&internal::FindFirstNonZeroByteGeneric);
+  ShadowScanKernelTest(&internal::FindFirstNonZeroByte);
+  if (internal::CpuSupportsSse2())
+    ShadowScanKernelTest(&internal::FindFirstNonZeroByteSse2);
+  if (internal::CpuSupportsAvx2())
+    ShadowScanKernelTest(&internal::FindFirstNonZeroByteAvx2);
+}
+
+TEST_F(ShadowTest, LargeRangeQueries) {
+  // Use a range that is long enough to be served by the vectorized kernels.
+  const size_t kSize = 64 * 1024;
+  std::unique_ptr<uint8_t[]> buffer(new uint8_t[kSize + 2 * kShadowRatio]);
+  uint8_t* data = ::common::AlignUp(buffer.get(), kShadowRatio);
+
+  test_shadow.Unpoison(data, kSize);
+  EXPECT_TRUE(test_shadow.IsRangeAccessible(data, kSize));
+  EXPECT_EQ(nullptr, test_shadow.FindFirstPoisonedByte(data, kSize));
+
+  // Poison a single shadow byte in the middle of the range.
+  uint8_t* poisoned = data + kSize / 2 + kShadowRatio * 3;
+  test_shadow.Poison(poisoned, kShadowRatio, kAsanReservedMarker);
+  EXPECT_FALSE(test_shadow.IsRangeAccessible(data, kSize));
+  EXPECT_EQ(poisoned, test_shadow.FindFirstPoisonedByte(data, kSize));
+  EXPECT_TRUE(test_shadow.IsRangeAccessible(data, poisoned - data));
+  EXPECT_EQ(nullptr, test_shadow.FindFirstPoisonedByte(data, poisoned - data));
+
+  test_shadow.Unpoison(data, kSize);
+}
+
 TEST_F(ShadowTest, PoisonUnpoisonAccess) {
   for (size_t count = 0; count < 100; ++count) {
     // Use a random 8-byte aligned end address.
@@ -235,6 +297,56 @@ TEST_F(ShadowTest, GetNullTerminatedArraySize) {
   test_shadow.Unpoison(aligned_test_array, aligned_array_length);
 }
 
+TEST_F(ShadowTest, GetNullTerminatedArraySizeOfLongArrays) {
+  // Long enough arrays, at an alignment that lets them be scanned 16 bytes at
+  // a time.
+  const size_t kArrayLength = 0x100;
+  ALIGNAS(16) uint8_t test_array[kArrayLength];
+  const uint8_t kMarkerValue = 0xAA;
+  ::memset(test_array, kMarkerValue, kArrayLength);
+  test_shadow.Poison(test_array, kArrayLength, kAsanReservedMarker);
+
+  const size_t kLongSizesToTest[] = {16, 17, 32, 33, 100, 160, 200};
+  for (size_t size_to_test : kLongSizesToTest) {
+    test_shadow.Unpoison(test_array, size_to_test);
+    size_t size = 0;
+
+    // The null byte is found in the middle of a chunk.
+    test_array[size_to_test - 1] = 0;
+    EXPECT_TRUE(test_shadow.GetNullTerminatedArraySize<uint8_t>(
+        test_array, 0U, &size));
+    EXPECT_EQ(size_to_test, size);
+
+    // The size limit is honored.
+    EXPECT_TRUE(test_shadow.GetNullTerminatedArraySize<uint8_t>(
+        test_array, size_to_test / 2, &size));
+    EXPECT_EQ(size_to_test / 2, size);
+
+    // A single null byte doesn't terminate an array of 16-bit values.
+    if (size_to_test % sizeof(uint16_t) == 0) {
+      EXPECT_FALSE(test_shadow.GetNullTerminatedArraySize<uint16_t>(
+          test_array, 0U, &size));
+      EXPECT_EQ(size_to_test, size);
+      test_array[size_to_test - sizeof(uint16_t)] = 0;
+      EXPECT_TRUE(test_shadow.GetNullTerminatedArraySize<uint16_t>(
+          test_array, 0U, &size));
+      EXPECT_EQ(size_to_test, size);
+      test_array[size_to_test - sizeof(uint16_t)] = kMarkerValue;
+    }
+    test_array[size_to_test - 1] = kMarkerValue;
+
+    // Without a null byte the scan stops at the end of the accessible memory.
+    EXPECT_FALSE(test_shadow.GetNullTerminatedArraySize<uint8_t>(
+        test_array, 0U, &size));
+    EXPECT_EQ(size_to_test, size);
+
+    test_shadow.Poison(test_array,
+                       ::common::AlignUp(size_to_test, kShadowRatio),
+                       kAsanReservedMarker);
+  }
+  test_shadow.Unpoison(test_array, kArrayLength);
+}
+
 TEST_F(ShadowTest, IsAccessibleRange) {
   ScopedAlignedArray scoped_test_array;
   const uint8_t* aligned_test_array = scoped_test_array.get_aligned_array();
@@ -411,6 +523,103 @@ TEST_F(ShadowTest, PoisonAllocatedBlock) {
   delete [] data;
 }
 
+TEST_F(ShadowTest, ClearShadowBytes) {
+  // Use a range long enough to exercise the bulk implementation, with a few
+  // dirty bytes scattered about.
+  const size_t kSize = 3 * 4096 + 17;
+  std::unique_ptr<uint8_t[]> buffer(new uint8_t[kSize + 2]);
+  ::memset(buffer.get(), 0, kSize + 2);
+  uint8_t* begin = buffer.get() + 1;
+  uint8_t* end = begin + kSize;
+  begin[0] = kHeapLeftPaddingMarker;
+  begin[1500] = kHeapFreedMarker;
+  begin[kSize - 1] = kHeapRightPaddingMarker;
+  // Canaries outside of the range.
+  begin[-1] = kAsanReservedMarker;
+  end[0] = kAsanReservedMarker;
+
+  internal::ClearShadowBytes(begin, end);
+  EXPECT_EQ(end, internal::FindFirstNonZeroByte(begin, end));
+  EXPECT_EQ(kAsanReservedMarker, begin[-1]);
+  EXPECT_EQ(kAsanReservedMarker, end[0]);
+}
+
+TEST_F(ShadowTest, PoisonAndFreeLargeBlock) {
+  // A block whose body shadow is long enough to go through the bulk paths.
+  BlockLayout layout = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, 256 * 1024 + 3, 0, 0,
+                              &layout));
+
+  std::unique_ptr<uint8_t[]> data(new uint8_t[layout.block_size]);
+  BlockInfo info = {};
+  BlockInitialize(layout, data.get(), false, &info);
+
+  // Dirty the shadow first, as if the memory had previously been freed.
+  test_shadow.MarkAsFreed(info.RawBlock(), info.block_size);
+  test_shadow.PoisonAllocatedBlock(info);
+  EXPECT_TRUE(test_shadow.IsRangeAccessible(info.body, info.body_size));
+  EXPECT_FALSE(test_shadow.IsAccessible(info.RawBody() + info.body_size));
+  EXPECT_TRUE(test_shadow.IsLeftRedzone(info.RawHeader()));
+  EXPECT_TRUE(test_shadow.IsRightRedzone(info.RawBody() + info.body_size));
+
+  test_shadow.MarkAsFreed(info.body, info.body_size);
+  for (size_t i = 0; i < info.body_size; i += kShadowRatio) {
+    ASSERT_EQ(kHeapFreedMarker,
+              test_shadow.GetShadowMarkerForAddress(info.RawBody() + i));
+  }
+  EXPECT_TRUE(test_shadow.IsLeftRedzone(info.RawHeader()));
+
+  test_shadow.Unpoison(info.RawBlock(), info.block_size);
+  EXPECT_TRUE(test_shadow.IsRangeAccessible(info.RawBlock(), info.block_size));
+}
+
+TEST_F(ShadowTest, SparseShadow) {
+  TestShadow sparse_shadow(TestShadow::kTestShadowSize, true);
+  ASSERT_NE(static_cast<const uint8_t*>(nullptr), sparse_shadow.shadow());
+  EXPECT_TRUE(sparse_shadow.sparse());
+  EXPECT_FALSE(test_shadow.sparse());
+  EXPECT_EQ(0u, sparse_shadow.committed_page_count());
+
+  // Poisoning a block commits the shadow covering it.
+  BlockLayout layout = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, 100, 0, 0, &layout));
+  std::unique_ptr<uint8_t[]> data(new uint8_t[layout.block_size]);
+  BlockInfo info = {};
+  BlockInitialize(layout, data.get(), false, &info);
+  EXPECT_FALSE(sparse_shadow.ShadowIsCommittedForAddress(info.header));
+  sparse_shadow.PoisonAllocatedBlock(info);
+  EXPECT_TRUE(sparse_shadow.ShadowIsCommittedForAddress(info.header));
+  size_t committed_page_count = sparse_shadow.committed_page_count();
+  EXPECT_LT(0u, committed_page_count);
+  EXPECT_TRUE(sparse_shadow.IsRangeAccessible(info.body, info.body_size));
+  EXPECT_TRUE(sparse_shadow.IsLeftRedzone(info.RawHeader()));
+  EXPECT_TRUE(sparse_shadow.IsRightRedzone(info.RawBody() + info.body_size));
+
+  // Unpoisoning memory whose shadow was never committed leaves it that way.
+  const size_t kBytesPerShadowPage = GetPageSize() << kShadowRatioLog;
+  uint8_t* far_away =
+      ::common::AlignUp(info.RawBlock(), kBytesPerShadowPage) +
+      16 * kBytesPerShadowPage;
+  ASSERT_LT(far_away, reinterpret_cast<uint8_t*>(sparse_shadow.memory_size()));
+  EXPECT_FALSE(sparse_shadow.ShadowIsCommittedForAddress(far_away));
+  sparse_shadow.Unpoison(far_away, GetPageSize());
+  EXPECT_FALSE(sparse_shadow.ShadowIsCommittedForAddress(far_away));
+  EXPECT_EQ(committed_page_count, sparse_shadow.committed_page_count());
+
+  // Reading from uncommitted shadow memory commits it via the exception
+  // handler.
+  EXPECT_EQ(kHeapAddressableMarker,
+            sparse_shadow.GetShadowMarkerForAddress(far_away));
+  EXPECT_TRUE(sparse_shadow.ShadowIsCommittedForAddress(far_away));
+  EXPECT_EQ(committed_page_count + 1, sparse_shadow.committed_page_count());
+
+  // Resetting the shadow decommits everything.
+  sparse_shadow.Reset();
+  EXPECT_EQ(0u, sparse_shadow.committed_page_count());
+  EXPECT_FALSE(sparse_shadow.ShadowIsCommittedForAddress(info.header));
+  EXPECT_TRUE(sparse_shadow.IsAccessible(info.header));
+}
+
 TEST_F(ShadowTest, ScanLeftAndRight) {
   size_t offset = test_shadow.length() / 2;
   size_t l = 0;
@@ -731,6 +940,97 @@ TEST_F(ShadowTest, PageBits) {
   EXPECT_FALSE(test_shadow.PageIsProtected(addr2 + 4096));
 }
 
+TEST_F(ShadowTest, PageBitsRangeSpansWords) {
+  // A range that starts and ends in the middle of a word of the page bits,
+  // and covers two whole words.
+  const size_t kFirstPage = 64 + 5;
+  const size_t kPageCount = 2 * 32 + 20;
+  const uint8_t* addr = reinterpret_cast<const uint8_t*>(kFirstPage * 4096);
+  test_shadow.MarkPagesProtected(addr, kPageCount * 4096);
+  for (size_t i = 64; i < kFirstPage + kPageCount + 32; ++i) {
+    const uint8_t* page = reinterpret_cast<const uint8_t*>(i * 4096);
+    bool in_range = i >= kFirstPage && i < kFirstPage + kPageCount;
+    EXPECT_EQ(in_range, test_shadow.PageIsProtected(page));
+
+    // The byte view of the bits matches the pages.
+    EXPECT_EQ(in_range, (test_shadow.page_bits()[i / 8] & (1 << (i % 8))) != 0);
+  }
+
+  // Unprotect the middle of the range only.
+  test_shadow.MarkPagesUnprotected(addr + 10 * 4096, 40 * 4096);
+  for (size_t i = kFirstPage; i < kFirstPage + kPageCount; ++i) {
+    const uint8_t* page = reinterpret_cast<const uint8_t*>(i * 4096);
+    bool unprotected = i >= kFirstPage + 10 && i < kFirstPage + 50;
+    EXPECT_EQ(!unprotected, test_shadow.PageIsProtected(page));
+  }
+
+  test_shadow.MarkPagesUnprotected(addr, kPageCount * 4096);
+  for (size_t i = kFirstPage; i < kFirstPage + kPageCount; ++i) {
+    EXPECT_FALSE(test_shadow.PageIsProtected(
+        reinterpret_cast<const uint8_t*>(i * 4096)));
+  }
+}
+
+namespace {
+
+// Repeatedly protects and unprotects the pages of a given residue, which
+// share the words of the page bits with the pages of the other threads.
+class PageBitsToggler : public base::DelegateSimpleThread::Delegate {
+ public:
+  static const size_t kFirstPage = 128;
+  static const size_t kPageCount = 256;
+
+  PageBitsToggler(Shadow* shadow, size_t residue, size_t stride)
+      : shadow_(shadow), residue_(residue), stride_(stride) {}
+
+  void Run() override {
+    for (size_t iteration = 0; iteration < 100; ++iteration) {
+      for (size_t i = residue_; i < kPageCount; i += stride_)
+        shadow_->MarkPageProtected(Page(i));
+      for (size_t i = residue_; i < kPageCount; i += stride_)
+        shadow_->MarkPageUnprotected(Page(i));
+    }
+    // Leave the even residues protected.
+    if (residue_ % 2 == 0) {
+      for (size_t i = residue_; i < kPageCount; i += stride_)
+        shadow_->MarkPageProtected(Page(i));
+    }
+  }
+
+  static const void* Page(size_t i) {
+    return reinterpret_cast<const void*>((kFirstPage + i) * 4096);
+  }
+
+ private:
+  Shadow* shadow_;
+  size_t residue_;
+  size_t stride_;
+};
+
+}  // namespace
+
+TEST_F(ShadowTest, ConcurrentPageBitsUpdates) {
+  const size_t kThreadCount = 4;
+  std::vector<std::unique_ptr<PageBitsToggler>> togglers;
+  base::DelegateSimpleThreadPool pool("page_bits", kThreadCount);
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    togglers.push_back(std::unique_ptr<PageBitsToggler>(
+        new PageBitsToggler(&test_shadow, i, kThreadCount)));
+    pool.AddWork(togglers.back().get());
+  }
+  pool.Start();
+  pool.JoinAll();
+
+  // No update was lost to those of the other threads.
+  for (size_t i = 0; i < PageBitsToggler::kPageCount; ++i) {
+    bool protect = (i % kThreadCount) % 2 == 0;
+    EXPECT_EQ(protect,
+              test_shadow.PageIsProtected(PageBitsToggler::Page(i)));
+  }
+  test_shadow.MarkPagesUnprotected(PageBitsToggler::Page(0),
+                                   PageBitsToggler::kPageCount * 4096);
+}
+
 namespace {
 
 // A fixture for shadow walker tests.
@@ -795,6 +1095,40 @@ TEST_F(ShadowWalkerTest, WalksNonNestedBlocks) {
   delete [] data;
 }
 
+TEST_F(ShadowWalkerTest, WalksBlocksStraddlingTheBounds) {
+  BlockLayout l = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, 7, 0, 0, &l));
+
+  size_t data_size = l.block_size * 2;
+  uint8_t* data = new uint8_t[data_size];
+  uint8_t* data0 = data;
+  uint8_t* data1 = data0 + l.block_size;
+
+  BlockInfo i0 = {}, i1 = {};
+  BlockInitialize(l, data0, false, &i0);
+  BlockInitialize(l, data1, false, &i1);
+
+  test_shadow.PoisonAllocatedBlock(i0);
+  test_shadow.PoisonAllocatedBlock(i1);
+
+  // A block that starts in the range is reported even if it extends beyond
+  // the upper bound, and the walk then terminates.
+  BlockInfo i = {};
+  ShadowWalker w0(&test_shadow, false, data, data + kShadowRatio);
+  EXPECT_TRUE(w0.Next(&i));
+  EXPECT_EQ(0, ::memcmp(&i, &i0, sizeof(i)));
+  EXPECT_FALSE(w0.Next(&i));
+
+  // A block that starts before the lower bound isn't reported.
+  ShadowWalker w1(&test_shadow, false, data + kShadowRatio, data + data_size);
+  EXPECT_TRUE(w1.Next(&i));
+  EXPECT_EQ(0, ::memcmp(&i, &i1, sizeof(i)));
+  EXPECT_FALSE(w1.Next(&i));
+
+  test_shadow.Unpoison(data, data_size);
+  delete [] data;
+}
+
 TEST_F(ShadowWalkerTest, WalksNestedBlocks) {
   BlockLayout b0 = {}, b1 = {}, b2 = {}, b00 = {}, b01 = {}, b10 = {},
       b100 = {};
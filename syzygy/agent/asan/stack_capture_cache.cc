@@ -21,6 +21,7 @@
 #include "base/strings/stringprintf.h"
 #include "syzygy/agent/asan/logger.h"
 #include "syzygy/agent/asan/memory_notifier.h"
+#include "syzygy/agent/asan/runtime_counters.h"
 #include "syzygy/agent/common/stack_capture.h"
 #include "syzygy/common/align.h"
 
@@ -110,11 +111,16 @@ StackCaptureCache::StackCaptureCache(
     : logger_(logger),
       memory_notifier_(memory_notifier),
       max_num_frames_(common::StackCapture::kMaxNumFrames),
+      compress_stack_captures_(false),
+      known_stacks_table_(nullptr),
+      site_counts_table_(nullptr),
       current_page_(nullptr) {
   DCHECK_NE(static_cast<AsanLogger*>(nullptr), logger);
   DCHECK_NE(static_cast<MemoryNotifierInterface*>(nullptr), memory_notifier);
 
   AllocateCachePage();
+  AllocateKnownStacksTable();
+  AllocateSiteCountsTable();
 
   ::memset(&statistics_, 0, sizeof(statistics_));
   ::memset(reclaimed_, 0, sizeof(reclaimed_));
@@ -127,6 +133,9 @@ StackCaptureCache::StackCaptureCache(
     : logger_(logger),
       memory_notifier_(memory_notifier),
       max_num_frames_(0),
+      compress_stack_captures_(false),
+      known_stacks_table_(nullptr),
+      site_counts_table_(nullptr),
       current_page_(nullptr) {
   DCHECK_NE(static_cast<AsanLogger*>(nullptr), logger);
   DCHECK_NE(static_cast<MemoryNotifierInterface*>(nullptr), memory_notifier);
@@ -135,12 +144,33 @@ StackCaptureCache::StackCaptureCache(
       std::min(max_num_frames, common::StackCapture::kMaxNumFrames));
 
   AllocateCachePage();
+  AllocateKnownStacksTable();
+  AllocateSiteCountsTable();
   ::memset(&statistics_, 0, sizeof(statistics_));
   ::memset(reclaimed_, 0, sizeof(reclaimed_));
   statistics_.size = sizeof(CachePage);
 }
 
 StackCaptureCache::~StackCaptureCache() {
+  // Release the stacks referenced by the heap profile.
+  ClearHeapProfile();
+
+  // Clean up the known stacks table.
+  if (known_stacks_table_ != nullptr) {
+    void* table = const_cast<common::StackCapture**>(known_stacks_table_);
+    memory_notifier_->NotifyReturnedToOS(table, kKnownStacksTableBytes);
+    CHECK_EQ(TRUE, ::VirtualFree(table, 0, MEM_RELEASE));
+    known_stacks_table_ = nullptr;
+  }
+
+  // Clean up the table of allocation site counts.
+  if (site_counts_table_ != nullptr) {
+    memory_notifier_->NotifyReturnedToOS(site_counts_table_,
+                                         kSiteCountsTableBytes);
+    CHECK_EQ(TRUE, ::VirtualFree(site_counts_table_, 0, MEM_RELEASE));
+    site_counts_table_ = nullptr;
+  }
+
   // Clean up the linked list of cache pages.
   while (current_page_ != nullptr) {
     CachePage* page = current_page_;
@@ -161,23 +191,39 @@ void StackCaptureCache::Init() {
 
 const common::StackCapture* StackCaptureCache::SaveStackTrace(
     const common::StackCapture& stack_capture) {
-  auto frames = stack_capture.frames();
-  auto num_frames = stack_capture.num_frames();
-  auto absolute_stack_id = stack_capture.absolute_stack_id();
-  DCHECK_NE(static_cast<void**>(nullptr), frames);
+  DCHECK_NE(static_cast<const void* const*>(nullptr), stack_capture.frames());
   DCHECK_NE(static_cast<CachePage*>(nullptr), current_page_);
 
   // If the number of frames is zero, the stack_capture was not captured
   // correctly. In that case, return an empty stack_capture. Otherwise, saving a
   // zero framed stack capture and then releasing it will lead to an explosion.
-  if (!num_frames)
+  if (!stack_capture.num_frames())
     return &g_empty_stack_capture.Get();
 
+  // Truncate the stack trace to the configured maximum depth. This changes its
+  // ID, so it's done prior to looking it up.
+  const common::StackCapture* source = &stack_capture;
+  common::StackCapture truncated_stack_capture;
+  if (max_num_frames_ != 0 && stack_capture.num_frames() > max_num_frames_) {
+    truncated_stack_capture.InitFromBuffer(stack_capture.frames(),
+                                           max_num_frames_);
+    source = &truncated_stack_capture;
+  }
+  auto num_frames = source->num_frames();
+  auto absolute_stack_id = source->absolute_stack_id();
+  size_t stored_frames = num_frames;
+
   bool already_cached = false;
-  common::StackCapture* stack_trace = nullptr;
   bool saturated = false;
 
-  {
+  // Try the lock-free path first. This succeeds for the vast majority of
+  // requests in a process that has warmed up.
+  common::StackCapture* stack_trace =
+      LookupKnownStack(absolute_stack_id, &saturated);
+  if (stack_trace != nullptr)
+    already_cached = true;
+
+  if (stack_trace == nullptr) {
     size_t known_stack_shard = absolute_stack_id % kKnownStacksSharding;
     // Get or insert the current stack trace while under the lock for this
     // bucket.
@@ -190,9 +236,15 @@ const common::StackCapture* StackCaptureCache::SaveStackTrace(
     // If this capture has not already been cached then we have to initialize
     // the data.
     if (result == known_stacks_[known_stack_shard].end()) {
-      stack_trace = GetStackCapture(num_frames);
-      DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_trace);
-      stack_trace->InitFromExistingStack(stack_capture);
+      if (compress_stack_captures_) {
+        stack_trace = GetCompressedStackCapture(*source);
+        stored_frames = stack_trace->max_num_frames();
+      } else {
+        stack_trace = GetStackCapture(num_frames);
+        DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_trace);
+        stack_trace->InitFromExistingStack(*source);
+      }
+      DCHECK_EQ(absolute_stack_id, stack_trace->absolute_stack_id());
       auto result = known_stacks_[known_stack_shard].insert(
           std::make_pair(absolute_stack_id, stack_trace));
       DCHECK(result.second);
@@ -208,46 +260,42 @@ const common::StackCapture* StackCaptureCache::SaveStackTrace(
     } else {
       saturated = true;
     }
-  }
-  DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_trace);
 
-  bool must_log = false;
-  Statistics statistics = {};
-  // Update the statistics.
-  if (compression_reporting_period_ != 0) {
-    base::AutoLock stats_lock(stats_lock_);
-    if (already_cached) {
-      // If the existing stack capture is previously unreferenced and becoming
-      // referenced again, then decrement the unreferenced counter.
-      if (stack_trace->HasNoRefs()) {
-        DCHECK_LT(0u, statistics_.unreferenced);
-        --statistics_.unreferenced;
-      }
-    } else {
-      ++statistics_.cached;
-      statistics_.frames_alive += num_frames;
-      ++statistics_.allocated;
-    }
-    if (!saturated && stack_trace->RefCountIsSaturated()) {
-      saturated = true;
-      ++statistics_.saturated;
-    }
-    ++statistics_.requested;
-    ++statistics_.references;
-    statistics_.frames_stored += num_frames;
-    if (statistics_.requested % compression_reporting_period_ == 0) {
-      must_log = true;
-      GetStatisticsUnlocked(&statistics);
+    // Publish the stack trace to lock-free readers. This is done after the
+    // reference has been acquired, and evicts any colliding stack trace
+    // when this one is new. The interlocked operation also ensures that the
+    // initialized contents of the stack capture are visible first.
+    common::StackCapture* volatile* slot =
+        GetKnownStacksTableSlot(absolute_stack_id);
+    if (!already_cached || *slot == nullptr) {
+      ::InterlockedExchangePointer(
+          reinterpret_cast<void* volatile*>(slot), stack_trace);
     }
   }
+  DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_trace);
 
-  if (must_log)
-    LogStatisticsImpl(statistics);
+  UpdateSaveStatistics(stack_trace, already_cached, saturated, num_frames,
+                       stored_frames);
 
   // Return the stack trace pointer that is now in the cache.
   return stack_trace;
 }
 
+const common::StackCapture* StackCaptureCache::SaveKnownStackTrace(
+    StackId absolute_stack_id) {
+  // Only the lock-free table is consulted. Stacks that aren't in it are left
+  // for the caller to capture and save.
+  bool saturated = false;
+  common::StackCapture* stack_trace =
+      LookupKnownStack(absolute_stack_id, &saturated);
+  if (stack_trace == nullptr)
+    return nullptr;
+
+  UpdateSaveStatistics(stack_trace, true, saturated,
+                       stack_trace->num_frames(), 0);
+  return stack_trace;
+}
+
 void StackCaptureCache::ReleaseStackTrace(
     const common::StackCapture* stack_capture) {
   DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_capture);
@@ -257,48 +305,48 @@ void StackCaptureCache::ReleaseStackTrace(
     return;
   }
 
-  size_t known_stack_shard =
-      stack_capture->absolute_stack_id() % kKnownStacksSharding;
-  bool add_to_reclaimed_list = false;
-  common::StackCapture* stack = nullptr;
-  {
-    base::AutoLock auto_lock(known_stacks_locks_[known_stack_shard]);
+  // We own the stack so its fine to remove the const.
+  ReleaseStackTraceImpl(const_cast<common::StackCapture*>(stack_capture),
+                        true);
+}
 
-    // We own the stack so its fine to remove the const. We double check this
-    // is the case in debug builds with the DCHECK.
-    stack = const_cast<common::StackCapture*>(stack_capture);
+void StackCaptureCache::AddHeapProfileSample(
+    const common::StackCapture& stack_capture, uint64_t bytes) {
+  base::AutoLock lock(heap_profile_lock_);
+  auto result = heap_profile_.insert(
+      std::make_pair(stack_capture.absolute_stack_id(), HeapProfileEntry()));
+  HeapProfileEntry& entry = result.first->second;
+  if (result.second) {
+    entry.stack_capture = SaveStackTrace(stack_capture);
+    entry.sample_count = 0;
+    entry.bytes = 0;
+  }
+  ++entry.sample_count;
+  entry.bytes += bytes;
+}
 
-    stack->RemoveRef();
+void StackCaptureCache::GetHeapProfile(HeapProfile* heap_profile) const {
+  DCHECK_NE(static_cast<HeapProfile*>(nullptr), heap_profile);
+  heap_profile->clear();
 
-    if (stack->HasNoRefs()) {
-      add_to_reclaimed_list = true;
-      // Remove this from the known stacks as we're going to reclaim it and
-      // overwrite part of its data as we insert into the reclaimed_ list.
-      size_t num_erased = known_stacks_[known_stack_shard].erase(
-          stack_capture->absolute_stack_id());
-      DCHECK_EQ(num_erased, 1u);
-    }
+  {
+    base::AutoLock lock(heap_profile_lock_);
+    heap_profile->reserve(heap_profile_.size());
+    for (const auto& entry : heap_profile_)
+      heap_profile->push_back(entry.second);
   }
 
-  // Update the statistics.
-  if (compression_reporting_period_ != 0) {
-    base::AutoLock stats_lock(stats_lock_);
-    DCHECK_LT(0u, statistics_.references);
-    --statistics_.references;
-    statistics_.frames_stored -= stack->num_frames();
-    if (add_to_reclaimed_list) {
-      --statistics_.cached;
-      ++statistics_.unreferenced;
-      // The frames in this stack capture are no longer alive.
-      statistics_.frames_alive -= stack->num_frames();
-    }
-  }
+  std::sort(heap_profile->begin(), heap_profile->end(),
+            [](const HeapProfileEntry& e1, const HeapProfileEntry& e2) {
+              return e1.bytes > e2.bytes;
+            });
+}
 
-  // Link this stack capture into the list of reclaimed stacks. This
-  // must come after the statistics updating, as we modify the |num_frames|
-  // parameter in place.
-  if (add_to_reclaimed_list)
-    AddStackCaptureToReclaimedList(stack);
+void StackCaptureCache::ClearHeapProfile() {
+  base::AutoLock lock(heap_profile_lock_);
+  for (const auto& entry : heap_profile_)
+    ReleaseStackTrace(entry.second.stack_capture);
+  heap_profile_.clear();
 }
 
 bool StackCaptureCache::StackCapturePointerIsValid(
@@ -323,7 +371,7 @@ bool StackCaptureCache::StackCapturePointerIsValid(
     if (stack_capture_addr >= page->data() &&
         stack_capture_addr + kMinSize <= page_end &&
         stack_capture_addr + stack_capture->Size() <= page_end &&
-        stack_capture->num_frames() <= stack_capture->max_num_frames() &&
+        stack_capture->num_frames() <= GetMaxNumDecodedFrames(stack_capture) &&
         stack_capture->max_num_frames() <=
             common::StackCapture::kMaxNumFrames) {
       return true;
@@ -341,6 +389,21 @@ void StackCaptureCache::RemoveObserver(Observer* obs) {
   observer_list_.RemoveObserver(obs);
 }
 
+uint32_t StackCaptureCache::CountSiteAllocation(StackId absolute_stack_id) {
+  DCHECK_NE(static_cast<SiteCount*>(nullptr), site_counts_table_);
+  SiteCount* site_count = site_counts_table_ +
+      (absolute_stack_id & (kSiteCountsTableSize - 1));
+
+  // The slot is taken over without synchronization. At worst two sites that
+  // race for a slot are counted together for a while, which only skews their
+  // counts.
+  if (site_count->stack_id != absolute_stack_id) {
+    site_count->stack_id = absolute_stack_id;
+    site_count->count = 0;
+  }
+  return static_cast<uint32_t>(::InterlockedIncrement(&site_count->count));
+}
+
 void StackCaptureCache::LogStatistics()  {
   Statistics statistics = {};
 
@@ -485,6 +548,264 @@ common::StackCapture* StackCaptureCache::GetStackCapture(size_t num_frames) {
   return stack_capture;
 }
 
+// static
+size_t StackCaptureCache::CompressFrames(const void* const* frames,
+                                         size_t num_frames,
+                                         uint8_t* buffer,
+                                         size_t buffer_size) {
+  DCHECK_NE(static_cast<const void* const*>(nullptr), frames);
+  DCHECK_NE(static_cast<uint8_t*>(nullptr), buffer);
+  DCHECK_LE(num_frames * kMaxCompressedFrameSize, buffer_size);
+
+  // Each frame is stored as the difference from the previous frame, zigzag
+  // encoded and then written as a little-endian base-128 varint. Consecutive
+  // frames tend to live in the same module, so these deltas are
+  // typically much smaller than the frame addresses themselves.
+  uint8_t* cursor = buffer;
+  uintptr_t previous = 0;
+  for (size_t i = 0; i < num_frames; ++i) {
+    uintptr_t frame = reinterpret_cast<uintptr_t>(frames[i]);
+    intptr_t delta = static_cast<intptr_t>(frame - previous);
+    uintptr_t zigzag = (static_cast<uintptr_t>(delta) << 1) ^
+        static_cast<uintptr_t>(delta >> (sizeof(delta) * 8 - 1));
+    previous = frame;
+
+    do {
+      uint8_t byte = static_cast<uint8_t>(zigzag & 0x7F);
+      zigzag >>= 7;
+      if (zigzag != 0)
+        byte |= 0x80;
+      *cursor++ = byte;
+    } while (zigzag != 0);
+  }
+
+  DCHECK_LE(cursor, buffer + buffer_size);
+  return cursor - buffer;
+}
+
+// static
+bool StackCaptureCache::DecompressFrames(const uint8_t* buffer,
+                                         size_t buffer_size,
+                                         size_t num_frames,
+                                         void** frames) {
+  DCHECK_NE(static_cast<const uint8_t*>(nullptr), buffer);
+  DCHECK_NE(static_cast<void**>(nullptr), frames);
+
+  const uint8_t* cursor = buffer;
+  const uint8_t* end = buffer + buffer_size;
+  uintptr_t previous = 0;
+  for (size_t i = 0; i < num_frames; ++i) {
+    uintptr_t zigzag = 0;
+    size_t shift = 0;
+    while (true) {
+      if (cursor == end || shift >= sizeof(zigzag) * 8)
+        return false;
+      uint8_t byte = *cursor++;
+      zigzag |= static_cast<uintptr_t>(byte & 0x7F) << shift;
+      shift += 7;
+      if ((byte & 0x80) == 0)
+        break;
+    }
+
+    intptr_t delta = static_cast<intptr_t>(zigzag >> 1) ^
+        -static_cast<intptr_t>(zigzag & 1);
+    previous += static_cast<uintptr_t>(delta);
+    frames[i] = reinterpret_cast<void*>(previous);
+  }
+
+  return true;
+}
+
+size_t StackCaptureCache::GetStackFrames(
+    const common::StackCapture* stack_capture,
+    void** frames,
+    size_t max_num_frames) const {
+  DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_capture);
+  DCHECK_NE(static_cast<void**>(nullptr), frames);
+
+  size_t num_frames = std::min(stack_capture->num_frames(), max_num_frames);
+  if (num_frames == 0)
+    return 0;
+
+  // Stacks in an uncompressed cache are stored as is.
+  if (!compress_stack_captures_) {
+    ::memcpy(frames, stack_capture->frames(), num_frames * sizeof(void*));
+    return num_frames;
+  }
+
+  // Frames can only be decoded in order, so decode all of them.
+  void* decoded[common::StackCapture::kMaxNumFrames] = {};
+  if (stack_capture->num_frames() > arraysize(decoded) ||
+      !DecompressFrames(
+          reinterpret_cast<const uint8_t*>(stack_capture->frames()),
+          stack_capture->max_num_frames() * sizeof(void*),
+          stack_capture->num_frames(), decoded)) {
+    return 0;
+  }
+  ::memcpy(frames, decoded, num_frames * sizeof(void*));
+  return num_frames;
+}
+
+void StackCaptureCache::UpdateSaveStatistics(
+    const common::StackCapture* stack_trace,
+    bool already_cached,
+    bool saturated,
+    size_t num_frames,
+    size_t stored_frames) {
+  DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_trace);
+
+  // The runtime counters are always kept, unlike the detailed statistics.
+  AddRuntimeCounter(already_cached ? kStackCacheHitCountCounter
+                                   : kStackCacheMissCountCounter, 1);
+
+  bool must_log = false;
+  Statistics statistics = {};
+  // Update the statistics.
+  if (compression_reporting_period_ != 0) {
+    base::AutoLock stats_lock(stats_lock_);
+    if (already_cached) {
+      // If the existing stack capture is previously unreferenced and becoming
+      // referenced again, then decrement the unreferenced counter.
+      if (stack_trace->HasNoRefs()) {
+        DCHECK_LT(0u, statistics_.unreferenced);
+        --statistics_.unreferenced;
+      }
+    } else {
+      ++statistics_.cached;
+      statistics_.frames_alive += stored_frames;
+      ++statistics_.allocated;
+    }
+    if (!saturated && stack_trace->RefCountIsSaturated())
+      ++statistics_.saturated;
+    ++statistics_.requested;
+    ++statistics_.references;
+    statistics_.frames_stored += num_frames;
+    if (statistics_.requested % compression_reporting_period_ == 0) {
+      must_log = true;
+      GetStatisticsUnlocked(&statistics);
+    }
+  }
+
+  if (must_log)
+    LogStatisticsImpl(statistics);
+}
+
+common::StackCapture* StackCaptureCache::LookupKnownStack(
+    StackId absolute_stack_id, bool* saturated) {
+  DCHECK_NE(static_cast<bool*>(nullptr), saturated);
+
+  common::StackCapture* stack =
+      *GetKnownStacksTableSlot(absolute_stack_id);
+  if (stack == nullptr || stack->absolute_stack_id() != absolute_stack_id)
+    return nullptr;
+
+  // Stack captures are never returned to the OS while the cache is alive, so
+  // it is always safe to touch |stack|. However, it may have been released
+  // and recycled since it was read from the table. Reclaimed stack captures
+  // have no references, so this will fail for them.
+  *saturated = stack->RefCountIsSaturated();
+  if (!stack->TryAddRef())
+    return nullptr;
+
+  // The stack capture was referenced, but it may have been recycled for
+  // another stack in the meantime. A recycled stack capture is fully
+  // initialized before it acquires its first reference, so checking the ID
+  // after acquiring our own reference is sufficient.
+  if (stack->absolute_stack_id() != absolute_stack_id) {
+    ReleaseStackTraceImpl(stack, false);
+    return nullptr;
+  }
+
+  return stack;
+}
+
+void StackCaptureCache::ReleaseStackTraceImpl(
+    common::StackCapture* stack_capture, bool update_references) {
+  DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_capture);
+
+  size_t known_stack_shard =
+      stack_capture->absolute_stack_id() % kKnownStacksSharding;
+  bool add_to_reclaimed_list = false;
+  {
+    base::AutoLock auto_lock(known_stacks_locks_[known_stack_shard]);
+
+    // The reference count can be concurrently incremented by lock-free
+    // readers, but never from zero. Thus, checking for no references while
+    // under the lock is sufficient to decide whether to reclaim the stack.
+    stack_capture->RemoveRef();
+
+    if (stack_capture->HasNoRefs()) {
+      add_to_reclaimed_list = true;
+      // Remove this from the known stacks as we're going to reclaim it and
+      // overwrite part of its data as we insert into the reclaimed_ list.
+      size_t num_erased = known_stacks_[known_stack_shard].erase(
+          stack_capture->absolute_stack_id());
+      DCHECK_EQ(num_erased, 1u);
+
+      // Also remove it from the lock-free table, if it is there.
+      ::InterlockedCompareExchangePointer(
+          reinterpret_cast<void* volatile*>(GetKnownStacksTableSlot(
+              stack_capture->absolute_stack_id())),
+          nullptr, stack_capture);
+    }
+  }
+
+  // Update the statistics.
+  if (compression_reporting_period_ != 0) {
+    base::AutoLock stats_lock(stats_lock_);
+    if (update_references) {
+      DCHECK_LT(0u, statistics_.references);
+      --statistics_.references;
+      statistics_.frames_stored -= stack_capture->num_frames();
+    }
+    if (add_to_reclaimed_list) {
+      --statistics_.cached;
+      ++statistics_.unreferenced;
+      // The frames in this stack capture are no longer alive.
+      statistics_.frames_alive -= GetNumStoredFrames(stack_capture);
+    }
+  }
+
+  // Link this stack capture into the list of reclaimed stacks. This
+  // must come after the statistics updating, as we modify the |num_frames|
+  // parameter in place.
+  if (add_to_reclaimed_list)
+    AddStackCaptureToReclaimedList(stack_capture);
+}
+
+void StackCaptureCache::AllocateKnownStacksTable() {
+  static_assert(kKnownStacksTableSize % kKnownStacksSharding == 0,
+                "kKnownStacksTableSize must be a multiple of the number of "
+                "known stacks shards.");
+  static_assert((kKnownStacksTableSize & (kKnownStacksTableSize - 1)) == 0,
+                "kKnownStacksTableSize must be a power of two.");
+
+  DCHECK_EQ(static_cast<common::StackCapture* volatile*>(nullptr),
+            known_stacks_table_);
+  void* table = ::VirtualAlloc(nullptr, kKnownStacksTableBytes, MEM_COMMIT,
+                               PAGE_READWRITE);
+  CHECK_NE(static_cast<void*>(nullptr), table);
+
+  // VirtualAlloc returns zero initialized memory, so all slots are empty.
+  known_stacks_table_ = reinterpret_cast<common::StackCapture* volatile*>(
+      table);
+  memory_notifier_->NotifyInternalUse(table, kKnownStacksTableBytes);
+}
+
+void StackCaptureCache::AllocateSiteCountsTable() {
+  static_assert((kSiteCountsTableSize & (kSiteCountsTableSize - 1)) == 0,
+                "kSiteCountsTableSize must be a power of two.");
+
+  DCHECK_EQ(static_cast<SiteCount*>(nullptr), site_counts_table_);
+  void* table = ::VirtualAlloc(nullptr, kSiteCountsTableBytes, MEM_COMMIT,
+                               PAGE_READWRITE);
+  CHECK_NE(static_cast<void*>(nullptr), table);
+
+  // VirtualAlloc returns zero initialized memory, so all counts are zero.
+  site_counts_table_ = reinterpret_cast<SiteCount*>(table);
+  memory_notifier_->NotifyInternalUse(table, kSiteCountsTableBytes);
+}
+
 namespace {
 
 class PrivateStackCapture : public common::StackCapture {
@@ -492,8 +813,61 @@ class PrivateStackCapture : public common::StackCapture {
   // Expose the actual number of frames. We use this to make reclaimed
   // stack captures look invalid when they're in a free list.
   using common::StackCapture::num_frames_;
+
+  // Initializes this stack capture with compressed frame data.
+  // @param stack_capture The uncompressed stack capture.
+  // @param data The compressed frames.
+  // @param data_size The size of the compressed frames, in bytes. This must
+  //     fit within max_num_frames_ frames.
+  void InitCompressed(const common::StackCapture& stack_capture,
+                      const uint8_t* data,
+                      size_t data_size) {
+    DCHECK_LE(data_size, max_num_frames_ * sizeof(void*));
+    absolute_stack_id_ = stack_capture.absolute_stack_id();
+    // The relative stack ID can't be computed from the compressed frames, so
+    // it is calculated up front.
+    relative_stack_id_ = stack_capture.relative_stack_id();
+    num_frames_ = static_cast<uint8_t>(stack_capture.num_frames());
+    ::memset(frames_, 0, max_num_frames_ * sizeof(void*));
+    ::memcpy(frames_, data, data_size);
+  }
 };
 
+}  // namespace
+
+common::StackCapture* StackCaptureCache::GetCompressedStackCapture(
+    const common::StackCapture& stack_capture) {
+  DCHECK(compress_stack_captures_);
+
+  uint8_t buffer[common::StackCapture::kMaxNumFrames *
+                 kMaxCompressedFrameSize];
+  size_t bytes = CompressFrames(stack_capture.frames(),
+                                stack_capture.num_frames(),
+                                buffer,
+                                sizeof(buffer));
+  size_t words = (bytes + sizeof(void*) - 1) / sizeof(void*);
+  DCHECK_LT(0u, words);
+
+  common::StackCapture* compressed = GetStackCapture(words);
+  DCHECK_NE(static_cast<common::StackCapture*>(nullptr), compressed);
+  reinterpret_cast<PrivateStackCapture*>(compressed)->InitCompressed(
+      stack_capture, buffer, bytes);
+  return compressed;
+}
+
+size_t StackCaptureCache::GetNumStoredFrames(
+    const common::StackCapture* stack_capture) const {
+  if (compress_stack_captures_)
+    return stack_capture->max_num_frames();
+  return stack_capture->num_frames();
+}
+
+size_t StackCaptureCache::GetMaxNumDecodedFrames(
+    const common::StackCapture* stack_capture) const {
+  // Every frame takes at least one byte when compressed.
+  if (compress_stack_captures_)
+    return stack_capture->max_num_frames() * sizeof(void*);
+  return stack_capture->max_num_frames();
 }
 
 void StackCaptureCache::AddStackCaptureToReclaimedList(
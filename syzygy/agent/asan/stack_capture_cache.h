@@ -16,6 +16,7 @@
 #define SYZYGY_AGENT_ASAN_STACK_CAPTURE_CACHE_H_
 
 #include <unordered_map>
+#include <vector>
 
 #include "base/observer_list.h"
 #include "base/synchronization/lock.h"
@@ -31,6 +32,12 @@ class AsanLogger;
 class MemoryNotifierInterface;
 
 // A class which manages a thread-safe cache of unique stack traces, by ID.
+//
+// Lookups of stack traces that are already in the cache are lock-free: a
+// direct-mapped table of known stack captures is consulted first, and a
+// reference is acquired using an interlocked operation. Only insertions,
+// table collisions and the final release of a stack capture fall back to the
+// sharded locks.
 class StackCaptureCache {
  public:
   // The size of a page of stack captures, in bytes. This should be in the
@@ -39,15 +46,38 @@ class StackCaptureCache {
   // incremental growth is not too large.
   static const size_t kCachePageSize = 1024 * 1024;
 
+  // The number of slots in the lock-free table of known stacks. This must be
+  // a power of two and a multiple of kKnownStacksSharding, so that a given
+  // slot is only ever written under a single known stacks lock.
+  static const size_t kKnownStacksTableSize = 64 * 1024;
+
+  // The number of slots in the table of allocation site counts. This must be
+  // a power of two.
+  static const size_t kSiteCountsTableSize = 16 * 1024;
+
   // The type used to uniquely identify a stack.
   typedef common::StackCapture::StackId StackId;
 
   // Forward declaration.
   class CachePage;
 
-  // TODO(chrisha): Plumb a command-line parameter through to control the
-  //     max depth of stack traces in the StackCaptureCache. This should get us
-  //     significant memory savings in the stack trace cache.
+  // An entry of the heap profile, which aggregates the sampled allocations
+  // made from a given stack.
+  struct HeapProfileEntry {
+    // The saved stack capture of the allocations. The heap profile holds a
+    // reference to it.
+    const common::StackCapture* stack_capture;
+    // The number of sampled allocations.
+    size_t sample_count;
+    // The estimated number of bytes allocated from this stack.
+    uint64_t bytes;
+  };
+
+  // The type used to report the heap profile.
+  typedef std::vector<HeapProfileEntry> HeapProfile;
+
+  // The maximum number of bytes used by a single compressed frame.
+  static const size_t kMaxCompressedFrameSize = (sizeof(void*) * 8 + 6) / 7;
 
   // Initializes a new stack capture cache.
   // @param logger The logger to use.
@@ -71,11 +101,59 @@ class StackCaptureCache {
   size_t max_num_frames() const { return max_num_frames_; }
 
   // Sets the current maximum number of frames supported by saved stack traces.
+  // Stack traces that are deeper than this are truncated when saved.
   // @param max_num_frames The maximum number of frames to set.
   void set_max_num_frames(size_t max_num_frames) {
     max_num_frames_ = max_num_frames;
   }
 
+  // @returns true if saved stack traces are stored in compressed form.
+  bool compress_stack_captures() const { return compress_stack_captures_; }
+
+  // Enables or disables the compressed storage of stack traces. In this mode
+  // the frames of a saved StackCapture are not directly accessible, and must
+  // be retrieved with GetStackFrames. This is not thread safe, and must be
+  // called prior to saving any stack traces.
+  // @param compress_stack_captures True to enable compression.
+  void set_compress_stack_captures(bool compress_stack_captures) {
+    compress_stack_captures_ = compress_stack_captures;
+  }
+
+  // Retrieves the frames of a stack trace saved in this cache, decompressing
+  // them if necessary. This is meant to be used when reporting an error.
+  // @param stack_capture A stack capture returned by SaveStackTrace.
+  // @param frames The buffer that will receive the frames.
+  // @param max_num_frames The size of |frames|.
+  // @returns the number of frames written to |frames|.
+  size_t GetStackFrames(const common::StackCapture* stack_capture,
+                        void** frames,
+                        size_t max_num_frames) const;
+
+  // @name Frame compression helpers. These are exposed for unittesting.
+  // @{
+  // Compresses an array of frames.
+  // @param frames The frames to compress.
+  // @param num_frames The number of frames.
+  // @param buffer The buffer that will receive the compressed frames. It
+  //     must be at least num_frames * kMaxCompressedFrameSize bytes in size.
+  // @param buffer_size The size of the buffer.
+  // @returns the number of bytes written to |buffer|.
+  static size_t CompressFrames(const void* const* frames,
+                               size_t num_frames,
+                               uint8_t* buffer,
+                               size_t buffer_size);
+  // Decompresses frames produced by CompressFrames.
+  // @param buffer The compressed frames.
+  // @param buffer_size The size of |buffer|.
+  // @param num_frames The number of frames to decompress.
+  // @param frames The array that will receive the decompressed frames.
+  // @returns true on success, false if |buffer| is malformed.
+  static bool DecompressFrames(const uint8_t* buffer,
+                               size_t buffer_size,
+                               size_t num_frames,
+                               void** frames);
+  // @}
+
   // @returns the default compression reporting period value.
   static size_t GetDefaultCompressionReportingPeriod() {
     return ::common::kDefaultReportingPeriod;
@@ -101,11 +179,48 @@ class StackCaptureCache {
   const common::StackCapture* SaveStackTrace(
       const common::StackCapture& stack_capture);
 
+  // Retrieves a stack capture that is already in the cache, given its ID. This
+  // is lock-free, and is meant to be used to save a recently seen stack again
+  // without capturing it.
+  // @param absolute_stack_id The ID of a stack previously returned by
+  //     SaveStackTrace.
+  // @returns a pointer to the saved stack capture, or nullptr if the stack
+  //     isn't readily available. In the latter case the caller must capture
+  //     the stack and use SaveStackTrace.
+  const common::StackCapture* SaveKnownStackTrace(StackId absolute_stack_id);
+
   // Releases a previously referenced stack trace. This decrements the reference
   // count and potentially cleans up the stack trace.
   // @param stack_capture The stack capture to be released.
   void ReleaseStackTrace(const common::StackCapture* stack_capture);
 
+  // @name Heap profile functions. These are thread safe.
+  // @{
+  // Records a sampled allocation in the heap profile. The stack is saved in
+  // the cache the first time it's seen, and stays referenced until the heap
+  // profile is cleared.
+  // @param stack_capture The stack of the sampled allocation.
+  // @param bytes The number of bytes that this sample stands for.
+  void AddHeapProfileSample(const common::StackCapture& stack_capture,
+                            uint64_t bytes);
+  // Gets a snapshot of the heap profile.
+  // @param heap_profile Will receive the entries of the heap profile, sorted
+  //     by decreasing number of bytes.
+  void GetHeapProfile(HeapProfile* heap_profile) const;
+  // Clears the heap profile, releasing the stacks it references.
+  void ClearHeapProfile();
+  // @}
+
+  // Counts an allocation made from an allocation site. This is lock-free.
+  // The sites are identified by the absolute ID of their allocation stack,
+  // and share a direct-mapped table of counts: a site that takes over the
+  // slot of another one starts counting anew. The stack doesn't have to be
+  // saved in the cache.
+  // @param absolute_stack_id The ID of the allocation stack of the site.
+  // @returns the number of allocations counted for the site, including this
+  //     one.
+  uint32_t CountSiteAllocation(StackId absolute_stack_id);
+
   // Logs the current stack capture cache statistics. This method is thread
   // safe.
   void LogStatistics();
@@ -181,6 +296,20 @@ class StackCaptureCache {
   // Allocates a CachePage.
   void AllocateCachePage();
 
+  // The slot of an allocation site in the table of allocation site counts.
+  struct SiteCount {
+    // The absolute ID of the allocation stack of the site.
+    volatile StackId stack_id;
+    // The number of allocations counted for the site.
+    volatile LONG count;
+  };
+
+  // Allocates the lock-free table of known stacks.
+  void AllocateKnownStacksTable();
+
+  // Allocates the table of allocation site counts.
+  void AllocateSiteCountsTable();
+
   // Gets the current cache statistics. This must be called under lock_.
   // @param statistics Will be populated with current cache statistics.
   void GetStatisticsUnlocked(Statistics* statistics) const;
@@ -194,6 +323,60 @@ class StackCaptureCache {
   // @param num_frames The minimum number of frames that are required.
   common::StackCapture* GetStackCapture(size_t num_frames);
 
+  // Looks up a stack capture in the lock-free table of known stacks, and
+  // acquires a reference to it. This does not take any locks.
+  // @param absolute_stack_id The ID of the stack to look up.
+  // @param saturated Will be set to true if the reference count of the
+  //     returned stack capture was already saturated.
+  // @returns the referenced stack capture, or nullptr if it's not in the
+  //     table. In the latter case the caller must fall back to the locked
+  //     path.
+  common::StackCapture* LookupKnownStack(StackId absolute_stack_id,
+                                         bool* saturated);
+
+  // Updates the statistics after a stack trace has been saved.
+  // @param stack_trace The saved stack trace.
+  // @param already_cached True if the stack trace was already in the cache.
+  // @param saturated True if its reference count was already saturated.
+  // @param num_frames The number of frames of the saved stack trace.
+  // @param stored_frames The number of frame slots used by the stack trace.
+  //     This is only used for stack traces that weren't already cached.
+  void UpdateSaveStatistics(const common::StackCapture* stack_trace,
+                            bool already_cached,
+                            bool saturated,
+                            size_t num_frames,
+                            size_t stored_frames);
+
+  // Implementation of ReleaseStackTrace.
+  // @param stack_capture The stack capture to be released.
+  // @param update_references If true then the reference statistics are
+  //     updated. This is false when returning a reference that was never
+  //     accounted for.
+  void ReleaseStackTraceImpl(common::StackCapture* stack_capture,
+                             bool update_references);
+
+  // @returns the table slot used by the given stack ID.
+  common::StackCapture* volatile* GetKnownStacksTableSlot(
+      StackId absolute_stack_id) {
+    return known_stacks_table_ + (absolute_stack_id % kKnownStacksTableSize);
+  }
+
+  // Grabs a temporary StackCapture and initializes it with the compressed
+  // frames of |stack_capture|. Must be called under lock_.
+  // @param stack_capture The stack capture to compress.
+  // @returns the compressed stack capture.
+  common::StackCapture* GetCompressedStackCapture(
+      const common::StackCapture& stack_capture);
+
+  // @returns the number of frame slots physically used by a saved stack
+  //     capture.
+  size_t GetNumStoredFrames(const common::StackCapture* stack_capture) const;
+
+  // @returns the maximum number of frames that a saved stack capture can
+  //     represent.
+  size_t GetMaxNumDecodedFrames(
+      const common::StackCapture* stack_capture) const;
+
   // Links a stack capture into the reclaimed_ list. Meant to be called by
   // ReturnStackCapture only. Must be called under lock_. Takes care of
   // updating frames_dead (on behalf of ReturnStackCapture).
@@ -203,6 +386,14 @@ class StackCaptureCache {
   // The default number of known stacks sets that we keep.
   static const size_t kKnownStacksSharding = 16;
 
+  // The size of the lock-free table of known stacks, in bytes.
+  static const size_t kKnownStacksTableBytes =
+      kKnownStacksTableSize * sizeof(common::StackCapture*);
+
+  // The size of the table of allocation site counts, in bytes.
+  static const size_t kSiteCountsTableBytes =
+      kSiteCountsTableSize * sizeof(SiteCount);
+
   // The number of allocations between reports of the stack trace cache
   // compression ratio. Zero (0) means do not report. Values like 1 million
   // seem to be pretty good with Chrome.
@@ -221,9 +412,25 @@ class StackCaptureCache {
   // doesn't really make sense to do so.
   size_t max_num_frames_;
 
+  // Indicates whether stack captures are stored in compressed form.
+  bool compress_stack_captures_;
+
   // The maps of known stacks. Accessed under known_stacks_locks_.
   StackMap known_stacks_[kKnownStacksSharding];
 
+  // A direct-mapped table of known stacks, indexed by absolute stack ID. This
+  // is read without locks, but is only ever modified using interlocked
+  // operations while holding the known stacks lock of the shard to which the
+  // slot belongs. This is a subset of the contents of known_stacks_. Allocated
+  // via VirtualAlloc.
+  common::StackCapture* volatile* known_stacks_table_;
+
+  // The counts of the allocations made from each allocation site, indexed by
+  // absolute stack ID. This is only modified using interlocked operations,
+  // apart from the benign races of the sites taking over slots. Allocated via
+  // VirtualAlloc.
+  SiteCount* site_counts_table_;
+
   // A lock protecting access to current_page_.
   base::Lock current_page_lock_;
 
@@ -249,6 +456,13 @@ class StackCaptureCache {
   // The list of observers.
   base::ObserverList<Observer> observer_list_;
 
+  // A lock protecting access to heap_profile_.
+  mutable base::Lock heap_profile_lock_;
+
+  // The heap profile, indexed by the absolute ID of the stacks that were
+  // recorded. Accessed under heap_profile_lock_.
+  std::unordered_map<StackId, HeapProfileEntry> heap_profile_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(StackCaptureCache);
 };
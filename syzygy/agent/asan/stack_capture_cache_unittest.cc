@@ -14,7 +14,11 @@
 
 #include "syzygy/agent/asan/stack_capture_cache.h"
 
+#include <algorithm>
 #include <memory>
+#include <vector>
+
+#include "base/threading/simple_thread.h"
 #include "gtest/gtest.h"
 #include "syzygy/agent/asan/logger.h"
 #include "syzygy/agent/asan/memory_notifiers/null_memory_notifier.h"
@@ -73,6 +77,43 @@ class TestStackCaptureCacheObserver : public StackCaptureCache::Observer {
   MOCK_METHOD1(OnNewStack, void(common::StackCapture* new_stack));
 };
 
+// Repeatedly saves and releases a small set of stack traces.
+class SaveAndReleaseRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  static const size_t kNumStacks = 8;
+  static const size_t kNumIterations = 10000;
+
+  explicit SaveAndReleaseRunner(StackCaptureCache* cache) : cache_(cache) {
+    void* frames[4] = {};
+    for (size_t i = 0; i < kNumStacks; ++i) {
+      frames[0] = reinterpret_cast<void*>(i + 1);
+      stacks_[i].InitFromBuffer(frames, arraysize(frames));
+    }
+  }
+
+  void Run() override {
+    const StackCapture* saved[kNumStacks] = {};
+    for (size_t i = 0; i < kNumIterations; ++i) {
+      size_t j = i % kNumStacks;
+      if (saved[j] != nullptr) {
+        cache_->ReleaseStackTrace(saved[j]);
+        saved[j] = nullptr;
+        continue;
+      }
+      saved[j] = cache_->SaveStackTrace(stacks_[j]);
+      EXPECT_EQ(stacks_[j].absolute_stack_id(), saved[j]->absolute_stack_id());
+    }
+    for (size_t j = 0; j < kNumStacks; ++j) {
+      if (saved[j] != nullptr)
+        cache_->ReleaseStackTrace(saved[j]);
+    }
+  }
+
+ private:
+  StackCaptureCache* cache_;
+  StackCapture stacks_[kNumStacks];
+};
+
 }  // namespace
 
 TEST_F(StackCaptureCacheTest, CachePageTest) {
@@ -128,7 +169,9 @@ TEST_F(StackCaptureCacheTest, SaveStackTrace) {
   // We should be able to save the captures stack trace.
   const StackCapture* s1 = cache.SaveStackTrace(capture);
   ASSERT_TRUE(s1 != NULL);
-  EXPECT_EQ(capture.num_frames(), s1->max_num_frames());
+  size_t expected_num_frames = std::min<size_t>(capture.num_frames(), 20u);
+  EXPECT_EQ(expected_num_frames, s1->max_num_frames());
+  EXPECT_EQ(expected_num_frames, s1->num_frames());
 
   // We should get a pointer to the initial stack capture object if we attempt
   // to save the same trace again.
@@ -156,7 +199,9 @@ TEST_F(StackCaptureCacheTest, RestrictedStackTraces) {
   // We should be able to save the captures stack trace.
   const StackCapture* s1 = cache.SaveStackTrace(capture);
   ASSERT_TRUE(s1 != NULL);
-  EXPECT_EQ(capture.num_frames(), s1->max_num_frames());
+  size_t expected_num_frames = std::min<size_t>(capture.num_frames(), 20u);
+  EXPECT_EQ(expected_num_frames, s1->max_num_frames());
+  EXPECT_EQ(expected_num_frames, s1->num_frames());
 
   // We should get a pointer to the initial stack capture object if we attempt
   // to save the same trace again.
@@ -170,7 +215,101 @@ TEST_F(StackCaptureCacheTest, RestrictedStackTraces) {
   // to save a different trace.
   const StackCapture* s3 = cache.SaveStackTrace(capture);
   EXPECT_NE(s1, s3);
-  EXPECT_EQ(capture.num_frames(), s1->max_num_frames());
+  EXPECT_EQ(expected_num_frames, s1->max_num_frames());
+}
+
+TEST_F(StackCaptureCacheTest, TruncatedStackTraces) {
+  AsanLogger logger;
+  TestStackCaptureCache cache(&logger);
+  cache.set_max_num_frames(5);
+
+  void* frames[10] = {};
+  for (size_t i = 0; i < arraysize(frames); ++i)
+    frames[i] = reinterpret_cast<void*>(i + 1);
+
+  // Two stacks that only differ beyond the maximum depth should map to the
+  // same truncated stack capture.
+  StackCapture capture1;
+  capture1.InitFromBuffer(frames, arraysize(frames));
+  frames[9] = reinterpret_cast<void*>(42);
+  StackCapture capture2;
+  capture2.InitFromBuffer(frames, arraysize(frames));
+  EXPECT_NE(capture1.absolute_stack_id(), capture2.absolute_stack_id());
+
+  const StackCapture* s1 = cache.SaveStackTrace(capture1);
+  const StackCapture* s2 = cache.SaveStackTrace(capture2);
+  EXPECT_EQ(s1, s2);
+  EXPECT_EQ(5u, s1->num_frames());
+
+  StackCapture expected;
+  expected.InitFromBuffer(frames, 5);
+  EXPECT_EQ(expected.absolute_stack_id(), s1->absolute_stack_id());
+
+  cache.ReleaseStackTrace(s1);
+  cache.ReleaseStackTrace(s2);
+}
+
+TEST_F(StackCaptureCacheTest, CompressFrames) {
+  const void* kFrames[] = {
+      reinterpret_cast<void*>(0x10001234),
+      reinterpret_cast<void*>(0x10001000),
+      reinterpret_cast<void*>(0x10004567),
+      reinterpret_cast<void*>(0x7FFE0000),
+      reinterpret_cast<void*>(0x00000001),
+      reinterpret_cast<void*>(UINTPTR_MAX) };
+
+  uint8_t buffer[arraysize(kFrames) *
+                 StackCaptureCache::kMaxCompressedFrameSize] = {};
+  size_t bytes = StackCaptureCache::CompressFrames(
+      kFrames, arraysize(kFrames), buffer, sizeof(buffer));
+  EXPECT_LT(0u, bytes);
+  EXPECT_GE(sizeof(buffer), bytes);
+
+  void* frames[arraysize(kFrames)] = {};
+  EXPECT_TRUE(StackCaptureCache::DecompressFrames(
+      buffer, bytes, arraysize(kFrames), frames));
+  for (size_t i = 0; i < arraysize(kFrames); ++i)
+    EXPECT_EQ(kFrames[i], frames[i]);
+
+  // Decompressing more frames than were encoded should fail.
+  void* too_many_frames[arraysize(kFrames) + 1] = {};
+  EXPECT_FALSE(StackCaptureCache::DecompressFrames(
+      buffer, bytes, arraysize(too_many_frames), too_many_frames));
+}
+
+TEST_F(StackCaptureCacheTest, CompressedStackTraces) {
+  AsanLogger logger;
+  TestStackCaptureCache cache(&logger);
+  cache.set_compress_stack_captures(true);
+  EXPECT_TRUE(cache.compress_stack_captures());
+
+  StackCapture capture;
+  capture.InitFromStack();
+  ASSERT_LT(0u, capture.num_frames());
+
+  const StackCapture* s1 = cache.SaveStackTrace(capture);
+  ASSERT_NE(static_cast<const StackCapture*>(nullptr), s1);
+  EXPECT_TRUE(cache.StackCapturePointerIsValid(s1));
+  EXPECT_EQ(capture.num_frames(), s1->num_frames());
+  EXPECT_EQ(capture.absolute_stack_id(), s1->absolute_stack_id());
+  EXPECT_EQ(capture.relative_stack_id(), s1->relative_stack_id());
+
+  // The compressed representation should be smaller than the original.
+  EXPECT_GT(capture.num_frames(), s1->max_num_frames());
+
+  // The frames should survive the round trip.
+  void* frames[StackCapture::kMaxNumFrames] = {};
+  EXPECT_EQ(capture.num_frames(),
+            cache.GetStackFrames(s1, frames, arraysize(frames)));
+  for (size_t i = 0; i < capture.num_frames(); ++i)
+    EXPECT_EQ(capture.frames()[i], frames[i]);
+
+  // Saving the same stack again should return the same capture.
+  const StackCapture* s2 = cache.SaveStackTrace(capture);
+  EXPECT_EQ(s1, s2);
+
+  cache.ReleaseStackTrace(s1);
+  cache.ReleaseStackTrace(s2);
 }
 
 TEST_F(StackCaptureCacheTest, MaxNumFrames) {
@@ -421,6 +560,141 @@ TEST_F(StackCaptureCacheTest, AllocateMultiplePages) {
   EXPECT_NE(page, cache.current_page());
 }
 
+TEST_F(StackCaptureCacheTest, KnownStacksAreShared) {
+  AsanLogger logger;
+  TestStackCaptureCache cache(&logger);
+
+  StackCapture stack;
+  stack.InitFromStack();
+
+  // The second lookup is served by the lock-free table and must return the
+  // same stack capture with an additional reference.
+  const StackCapture* s1 = cache.SaveStackTrace(stack);
+  const StackCapture* s2 = cache.SaveStackTrace(stack);
+  EXPECT_EQ(s1, s2);
+  EXPECT_EQ(2u, s1->ref_count());
+
+  cache.ReleaseStackTrace(s2);
+  EXPECT_EQ(1u, s1->ref_count());
+  cache.ReleaseStackTrace(s1);
+
+  // Once released, the stack must be reinserted on the next lookup.
+  const StackCapture* s3 = cache.SaveStackTrace(stack);
+  EXPECT_EQ(1u, s3->ref_count());
+  cache.ReleaseStackTrace(s3);
+}
+
+TEST_F(StackCaptureCacheTest, SaveKnownStackTrace) {
+  AsanLogger logger;
+  TestStackCaptureCache cache(&logger);
+
+  StackCapture stack;
+  stack.InitFromStack();
+
+  // Unknown stacks can't be saved by ID.
+  EXPECT_EQ(static_cast<const StackCapture*>(nullptr),
+            cache.SaveKnownStackTrace(stack.absolute_stack_id()));
+
+  const StackCapture* s1 = cache.SaveStackTrace(stack);
+  const StackCapture* s2 =
+      cache.SaveKnownStackTrace(s1->absolute_stack_id());
+  EXPECT_EQ(s1, s2);
+  EXPECT_EQ(2u, s1->ref_count());
+  cache.ReleaseStackTrace(s2);
+  cache.ReleaseStackTrace(s1);
+
+  // Released stacks must be captured again.
+  EXPECT_EQ(static_cast<const StackCapture*>(nullptr),
+            cache.SaveKnownStackTrace(stack.absolute_stack_id()));
+}
+
+TEST_F(StackCaptureCacheTest, CountSiteAllocation) {
+  AsanLogger logger;
+  TestStackCaptureCache cache(&logger);
+
+  const StackCaptureCache::StackId kSite = 0x1234;
+  EXPECT_EQ(1u, cache.CountSiteAllocation(kSite));
+  EXPECT_EQ(2u, cache.CountSiteAllocation(kSite));
+  EXPECT_EQ(1u, cache.CountSiteAllocation(kSite + 1));
+  EXPECT_EQ(3u, cache.CountSiteAllocation(kSite));
+
+  // A site that shares the slot of another one takes it over, and both count
+  // anew.
+  const StackCaptureCache::StackId kOtherSite =
+      kSite + StackCaptureCache::kSiteCountsTableSize;
+  EXPECT_EQ(1u, cache.CountSiteAllocation(kOtherSite));
+  EXPECT_EQ(1u, cache.CountSiteAllocation(kSite));
+}
+
+TEST_F(StackCaptureCacheTest, ConcurrentSaveAndRelease) {
+  AsanLogger logger;
+  TestStackCaptureCache cache(&logger);
+  // Enable statistics tracking, but without ever actually logging.
+  cache.set_compression_reporting_period(1000000U);
+
+  static const size_t kNumThreads = 4;
+  std::vector<std::unique_ptr<SaveAndReleaseRunner>> runners;
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> threads;
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    runners.push_back(std::unique_ptr<SaveAndReleaseRunner>(
+        new SaveAndReleaseRunner(&cache)));
+    threads.push_back(std::unique_ptr<base::DelegateSimpleThread>(
+        new base::DelegateSimpleThread(runners.back().get(),
+                                       "SaveAndReleaseRunner")));
+  }
+  for (auto& thread : threads)
+    thread->Start();
+  for (auto& thread : threads)
+    thread->Join();
+
+  // All references have been returned, so no stacks should remain cached.
+  TestStackCaptureCache::Statistics s = {};
+  cache.GetStatistics(&s);
+  EXPECT_EQ(0u, s.cached);
+  EXPECT_EQ(0u, s.references);
+  cache.set_compression_reporting_period(
+      StackCaptureCache::GetDefaultCompressionReportingPeriod());
+}
+
+TEST_F(StackCaptureCacheTest, HeapProfile) {
+  AsanLogger logger;
+  TestStackCaptureCache cache(&logger);
+
+  StackCapture stack1;
+  stack1.InitFromStack();
+  StackCapture stack2;
+  stack2.InitFromStack();
+  ASSERT_NE(stack1.absolute_stack_id(), stack2.absolute_stack_id());
+
+  cache.AddHeapProfileSample(stack1, 100);
+  cache.AddHeapProfileSample(stack2, 300);
+  cache.AddHeapProfileSample(stack1, 100);
+
+  // The entries are sorted by decreasing size.
+  StackCaptureCache::HeapProfile profile;
+  cache.GetHeapProfile(&profile);
+  ASSERT_EQ(2u, profile.size());
+  EXPECT_EQ(stack2.absolute_stack_id(),
+            profile[0].stack_capture->absolute_stack_id());
+  EXPECT_EQ(1u, profile[0].sample_count);
+  EXPECT_EQ(300u, profile[0].bytes);
+  EXPECT_EQ(stack1.absolute_stack_id(),
+            profile[1].stack_capture->absolute_stack_id());
+  EXPECT_EQ(2u, profile[1].sample_count);
+  EXPECT_EQ(200u, profile[1].bytes);
+
+  // The profile holds a single reference to each of its stacks.
+  const StackCapture* s1 = cache.SaveStackTrace(stack1);
+  EXPECT_EQ(profile[1].stack_capture, s1);
+  EXPECT_EQ(2u, s1->ref_count());
+
+  cache.ClearHeapProfile();
+  EXPECT_EQ(1u, s1->ref_count());
+  cache.GetHeapProfile(&profile);
+  EXPECT_TRUE(profile.empty());
+  cache.ReleaseStackTrace(s1);
+}
+
 TEST_F(StackCaptureCacheTest, EmptyStackCapture) {
   AsanLogger logger;
   TestStackCaptureCache cache(&logger);
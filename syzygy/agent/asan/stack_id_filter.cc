@@ -0,0 +1,87 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "syzygy/agent/asan/stack_id_filter.h"
+
+#include <algorithm>
+
+#include "base/bits.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+// Derives the two hashes from which the bits of a stack ID are chosen. Stack
+// IDs are already hashes, but they get mixed again so that the bits of the
+// filter are evenly used.
+void HashStackId(StackIdFilter::StackId stack_id,
+                 uint32_t* hash1,
+                 uint32_t* hash2) {
+  uint64_t hash = stack_id;
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDULL;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ULL;
+  hash ^= hash >> 33;
+  *hash1 = static_cast<uint32_t>(hash);
+  // The second hash is odd so that the bits chosen from the two hashes are
+  // all different.
+  *hash2 = static_cast<uint32_t>(hash >> 32) | 1;
+}
+
+}  // namespace
+
+StackIdFilter::StackIdFilter(const std::set<StackId>& stack_ids) {
+  size_t size_in_bits = kBitsPerWord;
+  if (!stack_ids.empty()) {
+    size_in_bits = std::max(
+        size_in_bits,
+        static_cast<size_t>(1) << base::bits::Log2Ceiling(
+            static_cast<uint32_t>(stack_ids.size() * kBitsPerStackId)));
+  }
+  bits_.resize(size_in_bits / kBitsPerWord, 0);
+  bit_index_mask_ = static_cast<uint32_t>(size_in_bits - 1);
+
+  for (StackId stack_id : stack_ids) {
+    uint32_t hash1 = 0;
+    uint32_t hash2 = 0;
+    HashStackId(stack_id, &hash1, &hash2);
+    for (size_t i = 0; i < kBitsPerQuery; ++i) {
+      uint32_t index = (hash1 + static_cast<uint32_t>(i) * hash2) &
+                       bit_index_mask_;
+      bits_[index / kBitsPerWord] |= 1U << (index % kBitsPerWord);
+    }
+  }
+}
+
+bool StackIdFilter::MayContain(StackId stack_id) const {
+  uint32_t hash1 = 0;
+  uint32_t hash2 = 0;
+  HashStackId(stack_id, &hash1, &hash2);
+
+  // All the bits are tested, rather than stopping at the first one that isn't
+  // set, so that the loop is unrolled into straight-line code.
+  uint32_t result = 1;
+  for (size_t i = 0; i < kBitsPerQuery; ++i) {
+    uint32_t index = (hash1 + static_cast<uint32_t>(i) * hash2) &
+                     bit_index_mask_;
+    result &= bits_[index / kBitsPerWord] >> (index % kBitsPerWord);
+  }
+  return (result & 1) != 0;
+}
+
+}  // namespace asan
+}  // namespace agent
@@ -0,0 +1,74 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//
+// Declares StackIdFilter, a compact Bloom filter of stack IDs.
+
+#ifndef SYZYGY_AGENT_ASAN_STACK_ID_FILTER_H_
+#define SYZYGY_AGENT_ASAN_STACK_ID_FILTER_H_
+
+#include <stdint.h>
+
+#include <set>
+#include <vector>
+
+#include "base/macros.h"
+#include "syzygy/agent/common/stack_capture.h"
+
+namespace agent {
+namespace asan {
+
+// A Bloom filter of stack IDs. It answers membership queries in constant time
+// and without branching, using a few bits per stack ID, so that even a filter
+// of thousands of stacks fits in the cache. A query for a stack that was
+// inserted always succeeds, while a query for another one succeeds with a
+// small probability.
+class StackIdFilter {
+ public:
+  typedef agent::common::StackCapture::StackId StackId;
+
+  // The number of bits of the filter per stack ID that it contains. This
+  // gives a false positive rate below 0.5%.
+  static const size_t kBitsPerStackId = 16;
+  // The number of bits that are set for each stack ID.
+  static const size_t kBitsPerQuery = 4;
+
+  // Constructor.
+  // @param stack_ids The stack IDs in the filter.
+  explicit StackIdFilter(const std::set<StackId>& stack_ids);
+
+  // @param stack_id The stack ID to look up.
+  // @returns true if @p stack_id may be in the filter, false if it certainly
+  //     isn't.
+  bool MayContain(StackId stack_id) const;
+
+  // @returns the size of the filter, in bits. This is a power of two.
+  size_t size_in_bits() const { return bits_.size() * kBitsPerWord; }
+
+ protected:
+  static const size_t kBitsPerWord = 32;
+
+  // The bits of the filter.
+  std::vector<uint32_t> bits_;
+  // Masks the index of a bit in the filter.
+  uint32_t bit_index_mask_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(StackIdFilter);
+};
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_STACK_ID_FILTER_H_
@@ -0,0 +1,69 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "syzygy/agent/asan/stack_id_filter.h"
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+typedef StackIdFilter::StackId StackId;
+
+// @returns the i-th test stack ID.
+StackId GetStackId(size_t i) {
+  return static_cast<StackId>(0x10000 + i * 0x9E3779B9);
+}
+
+}  // namespace
+
+TEST(StackIdFilterTest, EmptyFilter) {
+  StackIdFilter filter((std::set<StackId>()));
+  EXPECT_EQ(32u, filter.size_in_bits());
+  for (size_t i = 0; i < 1000; ++i)
+    EXPECT_FALSE(filter.MayContain(GetStackId(i)));
+}
+
+TEST(StackIdFilterTest, ContainsInsertedStackIds) {
+  static const size_t kNumStackIds = 5000;
+  std::set<StackId> stack_ids;
+  for (size_t i = 0; i < kNumStackIds; ++i)
+    stack_ids.insert(GetStackId(i));
+
+  StackIdFilter filter(stack_ids);
+
+  // The filter is sized to the number of stack IDs it contains.
+  EXPECT_LE(kNumStackIds * StackIdFilter::kBitsPerStackId,
+            filter.size_in_bits());
+  EXPECT_GT(2 * kNumStackIds * StackIdFilter::kBitsPerStackId,
+            filter.size_in_bits());
+
+  // There are no false negatives.
+  for (StackId stack_id : stack_ids)
+    EXPECT_TRUE(filter.MayContain(stack_id));
+
+  // False positives are rare. Allow for some slack over the expected rate.
+  size_t false_positives = 0;
+  for (size_t i = kNumStackIds; i < 11 * kNumStackIds; ++i) {
+    if (filter.MayContain(GetStackId(i)))
+      ++false_positives;
+  }
+  EXPECT_GT(kNumStackIds / 10, false_positives);
+}
+
+}  // namespace asan
+}  // namespace agent
@@ -304,6 +304,22 @@ _PARAM_CHECKS_TEMPLATE = Template("""
 """)
 
 
+# String template for an Asan check on a parameter pointing to a fixed size
+# structure, e.g. a DWORD receiving a byte count or an OVERLAPPED structure. The
+# size of the structure is known at compile time, which lets
+# TestStructureArgument take a fast path for the small ones.
+#
+# Here's the description of the different identifiers in this template:
+#     - param_to_check: The parameter to check.
+#     - access_type: The access type to the parameter.
+_STRUCTURE_CHECKS_TEMPLATE = Template("""
+  if (${param_to_check} != NULL) {
+    TestStructureArgument(${param_to_check},
+                          agent::asan::ASAN_${access_type}_ACCESS);
+  }
+""")
+
+
 class SystemInterceptorGenerator(object):
   """Implement the Asan system interceptor generator class.
 
@@ -419,14 +435,9 @@ class SystemInterceptorGenerator(object):
       # Check if this argument should be checked prior to a call to the
       # intercepted function.
       if m_iter.group('SAL_tag') in _TAGS_TO_CHECK_PRECALL:
-        param_keyword = ''
-        if m_iter.group('var_keyword'):
-          param_keyword = m_iter.group('var_keyword')
-        param_check_str = _PARAM_CHECKS_TEMPLATE.substitute(
+        param_check_str = _STRUCTURE_CHECKS_TEMPLATE.substitute(
             param_to_check=m_iter.group('var_name'),
-            param_size='sizeof(*%s)' % m_iter.group('var_name'),
-            access_type='READ' if 'In' in m_iter.group('SAL_tag') else 'WRITE',
-            param_keyword=param_keyword)
+            access_type='READ' if 'In' in m_iter.group('SAL_tag') else 'WRITE')
         param_checks_precall += param_check_str
         # Check if it should also be checked once the function returns.
         if m_iter.group('SAL_tag') in _TAGS_TO_CHECK_POSTCALL:
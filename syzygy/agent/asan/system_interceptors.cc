@@ -27,7 +27,7 @@
 namespace {
 
 using agent::asan::Shadow;
-using agent::asan::TestMemoryRange;
+using agent::asan::TestSmallMemoryRange;
 
 // The global shadow memory that is used by the system interceptors.
 Shadow* system_interceptor_shadow_ = nullptr;
@@ -37,6 +37,21 @@ Shadow* system_interceptor_shadow_ = nullptr;
 // only.
 InterceptorTailCallback interceptor_tail_callback = NULL;
 
+// Test that an argument pointing to a fixed size structure is accessible,
+// using the fast path of TestSmallMemoryRange for the small ones, e.g. the
+// DWORD receiving a byte count.
+// @tparam T The type of the structure.
+// @param argument The argument to check.
+// @param access_mode The access mode.
+template <typename T>
+inline void TestStructureArgument(const volatile T* argument,
+                                  agent::asan::AccessMode access_mode) {
+  TestSmallMemoryRange(
+      system_interceptor_shadow_,
+      reinterpret_cast<const uint8_t*>(const_cast<const T*>(argument)),
+      sizeof(T), access_mode);
+}
+
 }  // namespace
 
 namespace agent {
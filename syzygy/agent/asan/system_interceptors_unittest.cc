@@ -151,6 +151,21 @@ TEST_F(AsanRtlReadFileTest, AsanReadFileUAFOnOverlapped) {
   EXPECT_TRUE(LogContains(kHeapUseAfterFree));
 }
 
+TEST_F(AsanRtlReadFileTest, AsanReadFileUAFOnBytesRead) {
+  ScopedAsanAlloc<char> alloc(this, kTestStringLength);
+  // Test a use-after-free on the small structure receiving the number of bytes
+  // read, which gets checked on the fast path.
+  ScopedAsanAlloc<DWORD> bytes_read(this, sizeof(DWORD));
+  DWORD* bytes_read_ptr = bytes_read.get();
+  bytes_read.reset(NULL);
+  ReadFileFunctionFailing(temp_file_handle_.Get(),
+                          alloc.get(),
+                          kTestStringLength,
+                          bytes_read_ptr,
+                          NULL);
+  EXPECT_TRUE(LogContains(kHeapUseAfterFree));
+}
+
 TEST_F(AsanRtlReadFileTest, AsanReadFileUseAfterFree) {
   // Test if an use-after-free on the destination buffer is correctly detected.
   DWORD bytes_read = 0;
@@ -0,0 +1,496 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Micro-benchmarks of the hot paths of the Asan runtime: the heap manager,
+// the shadow memory, the memory access probes and the CRT interceptors. Each
+// benchmark is run with a fixed amount of work on an increasing number of
+// threads, and the timings are written as JSON so that they can be compared
+// across versions of the runtime.
+//
+// The output looks like the following:
+//
+//   {
+//     "benchmarks": [
+//       {
+//         "name": "heap_alloc_free_small",
+//         "iterations": 100000,
+//         "runs": [
+//           {
+//             "threads": 1,
+//             "min_ns_per_op": 150.3,
+//             "median_ns_per_op": 153.9
+//           },
+//           ...
+//         ]
+//       },
+//       ...
+//     ]
+//   }
+
+#include <windows.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/at_exit.h"
+#include "base/command_line.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_file.h"
+#include "base/logging.h"
+#include "base/macros.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/simple_thread.h"
+#include "base/time/time.h"
+#include "syzygy/agent/asan/crt_interceptors.h"
+#include "syzygy/agent/asan/memory_interceptors.h"
+#include "syzygy/agent/asan/runtime.h"
+#include "syzygy/agent/asan/shadow.h"
+#include "syzygy/agent/asan/windows_heap_adapter.h"
+#include "syzygy/core/json_file_writer.h"
+
+namespace {
+
+using agent::asan::AsanRuntime;
+using agent::asan::Shadow;
+using agent::asan::WindowsHeapAdapter;
+
+const char kUsage[] =
+    "Usage: syzyasan_benchmarks [options]\n"
+    "\n"
+    "  Runs micro-benchmarks of the Asan runtime and writes the timings as\n"
+    "  JSON.\n"
+    "\n"
+    "Options:\n"
+    "  --output-file=<path>  The file receiving the results. Defaults to\n"
+    "                        the standard output.\n"
+    "  --filter=<string>     Only runs the benchmarks whose name contains\n"
+    "                        this string.\n"
+    "  --iterations=<n>      The number of operations performed by each\n"
+    "                        thread. Defaults to 100000.\n"
+    "  --repetitions=<n>     The number of times each measurement is made.\n"
+    "                        Defaults to 5.\n"
+    "  --max-threads=<n>     The largest number of threads to run the\n"
+    "                        benchmarks on. They are run on 1, 2, 4, ...\n"
+    "                        threads up to this. Defaults to 8.\n"
+    "  --pretty-print        Pretty prints the JSON output.\n"
+    "\n";
+
+const char kOutputFile[] = "output-file";
+const char kFilter[] = "filter";
+const char kIterations[] = "iterations";
+const char kRepetitions[] = "repetitions";
+const char kMaxThreads[] = "max-threads";
+const char kPrettyPrint[] = "pretty-print";
+
+const size_t kDefaultIterations = 100000;
+const size_t kDefaultRepetitions = 5;
+const size_t kDefaultMaxThreads = 8;
+
+// The sizes of the allocations. The large one is above the default large
+// allocation threshold, so that it's served by the large block heap.
+const size_t kSmallAllocationSize = 32;
+const size_t kLargeAllocationSize = 64 * 1024;
+
+// The size of the memory that each thread works on in the shadow, probe and
+// CRT interceptor benchmarks.
+const size_t kBufferSize = 4096;
+
+// The runtime flags of the benchmarks. They are completely specified so that
+// the results don't depend on the defaults of a given version.
+const wchar_t kDefaultFlags[] = L"--feature_randomization=0";
+const wchar_t kZebraFlags[] =
+    L"--feature_randomization=0 --enable_zebra_block_heap";
+
+// The state shared by the threads of a benchmark run. It's set up before the
+// threads are started.
+struct BenchmarkContext {
+  // A heap created through the heap adapter, and thus managed by the
+  // BlockHeapManager.
+  HANDLE heap;
+  // The size of the allocations made by the heap benchmarks.
+  size_t allocation_size;
+};
+
+// The per-thread memory of the shadow, probe and CRT interceptor benchmarks.
+struct ThreadBuffers {
+  // Memory that isn't managed by the runtime, and whose shadow is the
+  // thread's to modify.
+  uint8_t* raw;
+  // An allocation of kBufferSize bytes from the runtime's heap, with
+  // redzones on both sides.
+  uint8_t* block;
+  // A second allocation of the same size.
+  uint8_t* other_block;
+};
+
+// The body of a benchmark. It performs @p iterations operations.
+typedef void (*BenchmarkFunction)(const BenchmarkContext& context,
+                                  const ThreadBuffers& buffers,
+                                  size_t iterations);
+
+struct Benchmark {
+  const char* name;
+  // The runtime flags of the benchmark.
+  const wchar_t* flags;
+  // The size of the allocations made by the heap benchmarks.
+  size_t allocation_size;
+  BenchmarkFunction function;
+};
+
+// @name The benchmark functions.
+// @{
+void HeapAllocFree(const BenchmarkContext& context,
+                   const ThreadBuffers& buffers,
+                   size_t iterations) {
+  for (size_t i = 0; i < iterations; ++i) {
+    void* alloc = WindowsHeapAdapter::HeapAlloc(context.heap, 0,
+                                                context.allocation_size);
+    CHECK_NE(static_cast<void*>(nullptr), alloc);
+    WindowsHeapAdapter::HeapFree(context.heap, 0, alloc);
+  }
+}
+
+void ShadowPoisonUnpoison(const BenchmarkContext& context,
+                          const ThreadBuffers& buffers,
+                          size_t iterations) {
+  Shadow* shadow = AsanRuntime::runtime()->shadow();
+  for (size_t i = 0; i < iterations; ++i) {
+    shadow->Poison(buffers.raw, kBufferSize, agent::asan::kUserRedzoneMarker);
+    shadow->Unpoison(buffers.raw, kBufferSize);
+  }
+}
+
+void ShadowIsAccessible(const BenchmarkContext& context,
+                        const ThreadBuffers& buffers,
+                        size_t iterations) {
+  Shadow* shadow = AsanRuntime::runtime()->shadow();
+  size_t accessible = 0;
+  for (size_t i = 0; i < iterations; ++i) {
+    if (shadow->IsAccessible(buffers.block + i % kBufferSize))
+      ++accessible;
+  }
+  CHECK_EQ(iterations, accessible);
+}
+
+void ShadowIsRangeAccessible(const BenchmarkContext& context,
+                             const ThreadBuffers& buffers,
+                             size_t iterations) {
+  Shadow* shadow = AsanRuntime::runtime()->shadow();
+  for (size_t i = 0; i < iterations; ++i)
+    CHECK(shadow->IsRangeAccessible(buffers.block, kBufferSize));
+}
+
+#if defined(_M_IX86)
+// The probes have a custom calling convention, so they're invoked from
+// assembly.
+agent::asan::MemoryAccessorFunction probe_4_byte_read_access =
+    asan_check_4_byte_read_access_2gb;
+agent::asan::MemoryAccessorFunction probe_4_byte_write_access =
+    asan_check_4_byte_write_access_2gb;
+
+void CallProbe(agent::asan::MemoryAccessorFunction probe,
+               const void* location) {
+  __asm {
+    // The probe expects the caller to have saved EDX, and restores it.
+    push edx
+    mov edx, location
+    call dword ptr[probe]
+  }
+}
+
+void Probe4ByteReadAccess(const BenchmarkContext& context,
+                          const ThreadBuffers& buffers,
+                          size_t iterations) {
+  for (size_t i = 0; i < iterations; ++i) {
+    CallProbe(probe_4_byte_read_access,
+              buffers.block + (i % (kBufferSize / 4)) * 4);
+  }
+}
+
+void Probe4ByteWriteAccess(const BenchmarkContext& context,
+                           const ThreadBuffers& buffers,
+                           size_t iterations) {
+  for (size_t i = 0; i < iterations; ++i) {
+    CallProbe(probe_4_byte_write_access,
+              buffers.block + (i % (kBufferSize / 4)) * 4);
+  }
+}
+#endif  // defined(_M_IX86)
+
+void CrtMemcpy(const BenchmarkContext& context,
+               const ThreadBuffers& buffers,
+               size_t iterations) {
+  for (size_t i = 0; i < iterations; ++i)
+    asan_memcpy(buffers.block, buffers.other_block, kBufferSize);
+}
+
+void CrtMemset(const BenchmarkContext& context,
+               const ThreadBuffers& buffers,
+               size_t iterations) {
+  for (size_t i = 0; i < iterations; ++i)
+    asan_memset(buffers.block, static_cast<int>(i), kBufferSize);
+}
+
+void CrtStrlen(const BenchmarkContext& context,
+               const ThreadBuffers& buffers,
+               size_t iterations) {
+  // |other_block| holds a string filling the whole allocation.
+  const char* str = reinterpret_cast<const char*>(buffers.other_block);
+  for (size_t i = 0; i < iterations; ++i)
+    CHECK_EQ(kBufferSize - 1, asan_strlen(str));
+}
+// @}
+
+// The heap benchmarks use the process heap type, which is the default, the
+// large block heap and the zebra block heap.
+const Benchmark kBenchmarks[] = {
+    { "heap_alloc_free_small", kDefaultFlags, kSmallAllocationSize,
+      &HeapAllocFree },
+    { "heap_alloc_free_large", kDefaultFlags, kLargeAllocationSize,
+      &HeapAllocFree },
+    { "heap_alloc_free_zebra", kZebraFlags, kSmallAllocationSize,
+      &HeapAllocFree },
+    { "shadow_poison_unpoison", kDefaultFlags, 0, &ShadowPoisonUnpoison },
+    { "shadow_is_accessible", kDefaultFlags, 0, &ShadowIsAccessible },
+    { "shadow_is_range_accessible", kDefaultFlags, 0,
+      &ShadowIsRangeAccessible },
+#if defined(_M_IX86)
+    { "probe_4_byte_read_access", kDefaultFlags, 0, &Probe4ByteReadAccess },
+    { "probe_4_byte_write_access", kDefaultFlags, 0, &Probe4ByteWriteAccess },
+#endif
+    { "crt_memcpy", kDefaultFlags, 0, &CrtMemcpy },
+    { "crt_memset", kDefaultFlags, 0, &CrtMemset },
+    { "crt_strlen", kDefaultFlags, 0, &CrtStrlen },
+};
+
+// Runs a benchmark on one thread. The thread sets up its buffers, then waits
+// for all the other threads to be ready before doing its work.
+class BenchmarkRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  BenchmarkRunner(const Benchmark& benchmark,
+                  const BenchmarkContext& context,
+                  size_t iterations,
+                  base::WaitableEvent* ready,
+                  base::WaitableEvent* start)
+      : benchmark_(benchmark),
+        context_(context),
+        iterations_(iterations),
+        ready_(ready),
+        start_(start) {
+    DCHECK_NE(static_cast<base::WaitableEvent*>(nullptr), ready);
+    DCHECK_NE(static_cast<base::WaitableEvent*>(nullptr), start);
+  }
+
+  void Run() override {
+    ThreadBuffers buffers = {};
+    buffers.raw = reinterpret_cast<uint8_t*>(::VirtualAlloc(
+        nullptr, kBufferSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+    buffers.block = reinterpret_cast<uint8_t*>(
+        WindowsHeapAdapter::HeapAlloc(context_.heap, 0, kBufferSize));
+    buffers.other_block = reinterpret_cast<uint8_t*>(
+        WindowsHeapAdapter::HeapAlloc(context_.heap, 0, kBufferSize));
+    CHECK_NE(static_cast<uint8_t*>(nullptr), buffers.raw);
+    CHECK_NE(static_cast<uint8_t*>(nullptr), buffers.block);
+    CHECK_NE(static_cast<uint8_t*>(nullptr), buffers.other_block);
+    ::memset(buffers.other_block, 'a', kBufferSize - 1);
+    buffers.other_block[kBufferSize - 1] = 0;
+
+    ready_->Signal();
+    start_->Wait();
+    benchmark_.function(context_, buffers, iterations_);
+
+    WindowsHeapAdapter::HeapFree(context_.heap, 0, buffers.other_block);
+    WindowsHeapAdapter::HeapFree(context_.heap, 0, buffers.block);
+    ::VirtualFree(buffers.raw, 0, MEM_RELEASE);
+  }
+
+ private:
+  const Benchmark& benchmark_;
+  const BenchmarkContext& context_;
+  size_t iterations_;
+  base::WaitableEvent* ready_;
+  base::WaitableEvent* start_;
+
+  DISALLOW_COPY_AND_ASSIGN(BenchmarkRunner);
+};
+
+// Times one run of a benchmark.
+// @param benchmark The benchmark to run.
+// @param context The state shared by the threads.
+// @param iterations The number of operations performed by each thread.
+// @param thread_count The number of threads to run the benchmark on.
+// @returns the average wall time of an operation, in nanoseconds.
+double TimeBenchmark(const Benchmark& benchmark,
+                     const BenchmarkContext& context,
+                     size_t iterations,
+                     size_t thread_count) {
+  base::WaitableEvent start(true, false);
+  std::vector<std::unique_ptr<base::WaitableEvent>> ready_events;
+  std::vector<std::unique_ptr<BenchmarkRunner>> runners;
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> threads;
+  for (size_t i = 0; i < thread_count; ++i) {
+    ready_events.push_back(std::unique_ptr<base::WaitableEvent>(
+        new base::WaitableEvent(false, false)));
+    runners.push_back(std::unique_ptr<BenchmarkRunner>(new BenchmarkRunner(
+        benchmark, context, iterations, ready_events.back().get(), &start)));
+    threads.push_back(std::unique_ptr<base::DelegateSimpleThread>(
+        new base::DelegateSimpleThread(runners.back().get(),
+                                       benchmark.name)));
+    threads.back()->Start();
+  }
+
+  // Only start the clock once all the threads are ready to go, so that the
+  // time spent creating them and their buffers isn't measured.
+  for (auto& ready : ready_events)
+    ready->Wait();
+  base::TimeTicks start_time = base::TimeTicks::Now();
+  start.Signal();
+  for (auto& thread : threads)
+    thread->Join();
+  base::TimeDelta elapsed = base::TimeTicks::Now() - start_time;
+
+  // With perfect scaling the threads run concurrently and the time taken by
+  // an operation stays the same as the thread count grows.
+  return elapsed.InMicrosecondsF() * 1000.0 / iterations;
+}
+
+// Runs a benchmark on each of the thread counts and writes its results.
+// @returns true on success, false otherwise.
+bool RunBenchmark(const Benchmark& benchmark,
+                  size_t iterations,
+                  size_t repetitions,
+                  size_t max_threads,
+                  core::JSONFileWriter* json_file) {
+  DCHECK_NE(static_cast<core::JSONFileWriter*>(nullptr), json_file);
+
+  LOG(INFO) << "Running " << benchmark.name << ".";
+
+  // Each benchmark gets a fresh runtime, so that they don't depend on the
+  // state left by the previous ones.
+  AsanRuntime runtime;
+  if (!runtime.SetUp(benchmark.flags)) {
+    LOG(ERROR) << "Unable to set up the runtime for " << benchmark.name << ".";
+    return false;
+  }
+
+  BenchmarkContext context = {};
+  context.heap = WindowsHeapAdapter::HeapCreate(0, 0, 0);
+  context.allocation_size = benchmark.allocation_size;
+
+  bool success = json_file->OpenDict() &&
+                 json_file->OutputKey("name") &&
+                 json_file->OutputString(benchmark.name) &&
+                 json_file->OutputKey("iterations") &&
+                 json_file->OutputInteger(static_cast<int>(iterations)) &&
+                 json_file->OutputKey("runs") &&
+                 json_file->OpenList();
+
+  for (size_t threads = 1; success && threads <= max_threads; threads *= 2) {
+    std::vector<double> timings;
+    for (size_t i = 0; i < repetitions; ++i)
+      timings.push_back(TimeBenchmark(benchmark, context, iterations, threads));
+    std::sort(timings.begin(), timings.end());
+
+    success = json_file->OpenDict() &&
+              json_file->OutputKey("threads") &&
+              json_file->OutputInteger(static_cast<int>(threads)) &&
+              json_file->OutputKey("min_ns_per_op") &&
+              json_file->OutputDouble(timings.front()) &&
+              json_file->OutputKey("median_ns_per_op") &&
+              json_file->OutputDouble(timings[timings.size() / 2]) &&
+              json_file->CloseDict();
+  }
+
+  WindowsHeapAdapter::HeapDestroy(context.heap);
+  runtime.TearDown();
+
+  return success && json_file->CloseList() && json_file->CloseDict();
+}
+
+// Parses a strictly positive number from the command-line.
+// @param cmd_line The command-line.
+// @param switch_name The name of the switch holding the number.
+// @param value Receives the number. This is left unchanged if the switch is
+//     not present.
+// @returns true on success, false if the value of the switch is invalid.
+bool ParseCount(const base::CommandLine& cmd_line,
+                const char* switch_name,
+                size_t* value) {
+  DCHECK_NE(static_cast<size_t*>(nullptr), value);
+  if (!cmd_line.HasSwitch(switch_name))
+    return true;
+  std::string str = cmd_line.GetSwitchValueASCII(switch_name);
+  unsigned int count = 0;
+  if (!base::StringToUint(str, &count) || count == 0) {
+    LOG(ERROR) << "Invalid value for --" << switch_name << ": " << str << ".";
+    return false;
+  }
+  *value = count;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, const char* const* argv) {
+  base::AtExitManager at_exit;
+  base::CommandLine::Init(argc, argv);
+  const base::CommandLine* cmd_line = base::CommandLine::ForCurrentProcess();
+
+  size_t iterations = kDefaultIterations;
+  size_t repetitions = kDefaultRepetitions;
+  size_t max_threads = kDefaultMaxThreads;
+  if (!ParseCount(*cmd_line, kIterations, &iterations) ||
+      !ParseCount(*cmd_line, kRepetitions, &repetitions) ||
+      !ParseCount(*cmd_line, kMaxThreads, &max_threads) ||
+      !cmd_line->GetArgs().empty()) {
+    ::fprintf(stderr, "%s", kUsage);
+    return 1;
+  }
+  std::string filter = cmd_line->GetSwitchValueASCII(kFilter);
+
+  base::ScopedFILE output_file;
+  FILE* output = stdout;
+  base::FilePath output_path = cmd_line->GetSwitchValuePath(kOutputFile);
+  if (!output_path.empty()) {
+    output_file.reset(base::OpenFile(output_path, "wb"));
+    if (output_file.get() == nullptr) {
+      LOG(ERROR) << "Unable to open " << output_path.value() << ".";
+      return 1;
+    }
+    output = output_file.get();
+  }
+
+  core::JSONFileWriter json_file(output, cmd_line->HasSwitch(kPrettyPrint));
+  bool success = json_file.OpenDict() &&
+                 json_file.OutputKey("benchmarks") &&
+                 json_file.OpenList();
+  for (const Benchmark& benchmark : kBenchmarks) {
+    if (!success)
+      break;
+    if (std::string(benchmark.name).find(filter) == std::string::npos)
+      continue;
+    success = RunBenchmark(benchmark, iterations, repetitions, max_threads,
+                           &json_file);
+  }
+  if (!success || !json_file.Flush()) {
+    LOG(ERROR) << "Failed to run the benchmarks.";
+    return 1;
+  }
+
+  return 0;
+}
@@ -184,9 +184,13 @@ BOOL WINAPI DllMain(HMODULE instance, DWORD reason, LPVOID reserved) {
       break;
     }
 
-    case DLL_THREAD_DETACH:
-      // Nothing to do here.
+    case DLL_THREAD_DETACH: {
+      // Hand the blocks cached by the exiting thread back to their heaps.
+      agent::asan::AsanRuntime* runtime = agent::asan::AsanRuntime::runtime();
+      if (runtime != nullptr)
+        runtime->OnThreadDetach();
       break;
+    }
 
     case DLL_PROCESS_DETACH: {
       base::CommandLine::Reset();
@@ -218,6 +222,33 @@ VOID WINAPI asan_DisableDeferredFreeThread() {
   asan_runtime->DisableDeferredFreeThread();
 }
 
+// Enables the background checking of the quarantined blocks, at a rate of at
+// most |blocks_per_second| blocks per second. This can be called only once per
+// execution.
+VOID WINAPI asan_EnableQuarantineCheckerThread(size_t blocks_per_second) {
+  asan_runtime->EnableQuarantineCheckerThread(blocks_per_second);
+}
+
+// Disables the background checking of the quarantined blocks. This must be
+// called before shutdown if the thread was started.
+VOID WINAPI asan_DisableQuarantineCheckerThread() {
+  asan_runtime->DisableQuarantineCheckerThread();
+}
+
+// Writes the heap profile to the logger. The profile is also written when
+// the runtime is torn down.
+VOID WINAPI asan_DumpHeapProfile() {
+  asan_runtime->LogHeapProfile();
+}
+
+// Gets the runtime counters. The size field of @p counters must be set to the
+// size of the structure known by the caller.
+BOOL WINAPI asan_GetRuntimeCounters(AsanRuntimeCounters* counters) {
+  if (asan_runtime == nullptr || counters == nullptr)
+    return FALSE;
+  return asan_runtime->GetRuntimeCounters(counters);
+}
+
 void WINAPI asan_EnumExperiments(AsanExperimentCallback callback) {
   DCHECK(callback != nullptr);
 
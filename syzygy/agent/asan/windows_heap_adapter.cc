@@ -82,7 +82,21 @@ LPVOID WINAPI WindowsHeapAdapter::HeapReAlloc(HANDLE heap,
                                               LPVOID mem,
                                               SIZE_T bytes) {
   DCHECK_NE(reinterpret_cast<HeapManagerInterface*>(NULL), heap_manager_);
-  // Always fail in-place reallocation requests.
+
+  // Try to resize the allocation without moving it first. This avoids a
+  // copy of the whole allocation when it only grows by a few bytes.
+  if (mem != NULL) {
+    SIZE_T size = 0;
+    if ((flags & HEAP_ZERO_MEMORY) != 0)
+      size = HeapSize(heap, 0, mem);
+    if (heap_manager_->ResizeInPlace(HandleToHeapId(heap), mem, bytes)) {
+      if (bytes > size && (flags & HEAP_ZERO_MEMORY) != 0)
+        ::memset(reinterpret_cast<uint8_t*>(mem) + size, 0, bytes - size);
+      return mem;
+    }
+  }
+
+  // Fail the in-place reallocation requests that couldn't be satisfied.
   if ((flags & HEAP_REALLOC_IN_PLACE_ONLY) != 0)
     return NULL;
 
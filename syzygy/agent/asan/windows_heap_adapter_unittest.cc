@@ -37,6 +37,7 @@ class LenientMockHeapManager : public HeapManagerInterface {
   MOCK_METHOD2(Size, size_t(HeapId, const void*));
   MOCK_METHOD2(Allocate, void*(HeapId, size_t));
   MOCK_METHOD2(Free, bool(HeapId, void*));
+  MOCK_METHOD3(ResizeInPlace, bool(HeapId, void*, size_t));
   MOCK_METHOD1(Lock, void(HeapId));
   MOCK_METHOD1(Unlock, void(HeapId));
   MOCK_METHOD0(BestEffortLockAll, void());
@@ -111,10 +112,14 @@ TEST_F(WindowsHeapAdapterTest, HeapAllocWithZeroMemoryFlag) {
 TEST_F(WindowsHeapAdapterTest, HeapReAlloc) {
   void* kFakeAlloc = reinterpret_cast<void*>(0x12345678);
   void* kFakeReAlloc = reinterpret_cast<void*>(0x87654321);
-  // A successful call to WindowsHeapAdapter::HeapReAlloc should end up calling
+  // A successful call to WindowsHeapAdapter::HeapReAlloc that can't resize
+  // the allocation in place should end up calling
   // HeapManagerInterface::Allocate, HeapManagerInterface::Size and
   // HeapManagerInterface::Free.
   const size_t kReAllocSize = 200;
+  EXPECT_CALL(mock_heap_manager_,
+              ResizeInPlace(kFakeHeapId, kFakeAlloc, kReAllocSize))
+      .WillOnce(Return(false));
   EXPECT_CALL(mock_heap_manager_, Allocate(kFakeHeapId, kReAllocSize)).WillOnce(
       Return(kFakeReAlloc));
   EXPECT_CALL(mock_heap_manager_, Free(kFakeHeapId, kFakeAlloc)).WillOnce(
@@ -151,6 +156,40 @@ TEST_F(WindowsHeapAdapterTest, HeapReAllocFailForInPlaceReallocations) {
                                       kReAllocSize));
 }
 
+TEST_F(WindowsHeapAdapterTest, HeapReAllocInPlace) {
+  void* kFakeAlloc = reinterpret_cast<void*>(0x12345678);
+  const size_t kReAllocSize = 10;
+  EXPECT_CALL(mock_heap_manager_,
+              ResizeInPlace(kFakeHeapId, kFakeAlloc, kReAllocSize))
+      .WillOnce(Return(true));
+  EXPECT_CALL(mock_heap_manager_, Allocate(_, _)).Times(0);
+  EXPECT_EQ(kFakeAlloc,
+      WindowsHeapAdapter::HeapReAlloc(reinterpret_cast<HANDLE>(kFakeHeapId),
+                                      HEAP_REALLOC_IN_PLACE_ONLY,
+                                      kFakeAlloc,
+                                      kReAllocSize));
+}
+
+TEST_F(WindowsHeapAdapterTest, HeapReAllocInPlaceZeroesGrowth) {
+  const size_t kAllocSize = 10;
+  const size_t kReAllocSize = kAllocSize * 2;
+  uint8_t buffer[kReAllocSize];
+  ::memset(buffer, 0xAB, sizeof(buffer));
+
+  EXPECT_CALL(mock_heap_manager_, Size(kFakeHeapId, buffer)).WillOnce(
+      Return(kAllocSize));
+  EXPECT_CALL(mock_heap_manager_,
+              ResizeInPlace(kFakeHeapId, buffer, kReAllocSize))
+      .WillOnce(Return(true));
+  EXPECT_EQ(buffer,
+      WindowsHeapAdapter::HeapReAlloc(reinterpret_cast<HANDLE>(kFakeHeapId),
+                                      HEAP_ZERO_MEMORY,
+                                      buffer,
+                                      kReAllocSize));
+  for (size_t i = 0; i < kReAllocSize; ++i)
+    EXPECT_EQ(i < kAllocSize ? 0xAB : 0, buffer[i]);
+}
+
 TEST_F(WindowsHeapAdapterTest, HeapReAllocFailOnOOM) {
   const size_t kReAllocSize = 10;
   // Return NULL in the internal call that allocates the new buffer.
@@ -178,6 +217,9 @@ TEST_F(WindowsHeapAdapterTest, HeapReallocCopyData) {
   EXPECT_EQ(reinterpret_cast<void*>(kDummyBuffer1), alloc);
   base::RandBytes(alloc, kAllocSize);
 
+  EXPECT_CALL(mock_heap_manager_, ResizeInPlace(kFakeHeapId, alloc,
+                                                kReAllocSize))
+      .WillOnce(Return(false));
   EXPECT_CALL(mock_heap_manager_, Allocate(kFakeHeapId, kReAllocSize)).WillOnce(
       Return(reinterpret_cast<void*>(kDummyBuffer2)));
   EXPECT_CALL(mock_heap_manager_, Free(kFakeHeapId, alloc)).WillOnce(
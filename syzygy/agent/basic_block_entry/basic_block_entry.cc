@@ -57,13 +57,22 @@
 //    metrics. The trace segment with be dump to a file for post-processing.
 //
 //    There are two mechanisms to collect metrics:
-//    - Basic mode: In the basic mode, the hook acquires a lock and updates a
-//      process-wide segment shared by all threads. In this mode, no events can
-//      be lost.
+//    - Basic mode: In the basic mode, the hook updates the counters of the
+//      thread right away.
 //    - Buffered mode: A per-thread buffer is used to collect execution
-//      information. A batch commit is done when the buffer is full. In this
-//      mode, under a non-standard execution (crash, force exit, ...) pending
-//      events may be lost.
+//      information. A batch commit is done when the buffer is full.
+//
+//    When tracing, each thread counts into its own array of counters, which
+//    lives in cache lines of its own, so that the counters are incremented
+//    with plain adds and without locking. The arrays are merged into the
+//    process-wide segment shared by all threads when the thread detaches,
+//    and at least once a second while the thread keeps counting. Under a
+//    non-standard execution (crash, force exit, ...) pending counts may be
+//    lost. The counters are 32-bit by default, and can be made 8 or 16-bit
+//    to save memory with --counter-width in SYZYGY_BASIC_BLOCK_ENTRY_OPTIONS.
+//    A narrow counter that fills up is spilled to the shared segment.
+//    Without tracing, the hooks update the shared fall-back counters under
+//    a lock.
 //
 //    The agent keeps a ThreadState for each running thread. The thread state
 //    is accessible through a TLS mechanism and contains information needed by
@@ -78,19 +87,28 @@
 //      See: http://en.wikipedia.org/wiki/Win32_Thread_Information_Block.
 //      There is no API to check whether another module is using this slot, thus
 //      this mechanism must be used in a controlled environment.
+//      The slot points to the BranchEventBuffer of the thread state, to which
+//      the inline branch instrumentation appends its events directly. For
+//      basic-block entry data, it points to the 32-bit counters of the
+//      thread, which the inline fast path increments directly.
 
 #include "syzygy/agent/basic_block_entry/basic_block_entry.h"
+
+#include <malloc.h>
+#include <limits>
 #include <memory>
 
 #include "base/at_exit.h"
 #include "base/command_line.h"
 #include "base/environment.h"
 #include "base/lazy_instance.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 #include "syzygy/agent/common/agent.h"
 #include "syzygy/agent/common/process_utils.h"
 #include "syzygy/agent/common/scoped_last_error_keeper.h"
+#include "syzygy/common/align.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/common/indexed_frequency_data.h"
 #include "syzygy/common/logging.h"
@@ -210,6 +228,15 @@ BBPROBE_REDIRECT_CALL_SLOT(_branch_exit, BranchExitHookSlot, DWORD, 2)
 BBPROBE_REDIRECT_CALL_SLOT(_branch_exit, BranchExitHookSlot, DWORD, 3)
 BBPROBE_REDIRECT_CALL_SLOT(_branch_exit, BranchExitHookSlot, DWORD, 4)
 
+// This is expected to be called by the inline branch instrumentation when the
+// event buffer of the thread is full, or missing, and looks like:
+//    push event
+//    call [function_name]
+BBPROBE_REDIRECT_CALL_SLOT(_branch_event, BranchEventHookSlot, DWORD, 1)
+BBPROBE_REDIRECT_CALL_SLOT(_branch_event, BranchEventHookSlot, DWORD, 2)
+BBPROBE_REDIRECT_CALL_SLOT(_branch_event, BranchEventHookSlot, DWORD, 3)
+BBPROBE_REDIRECT_CALL_SLOT(_branch_event, BranchEventHookSlot, DWORD, 4)
+
 // This is expected to be called via a thunk that looks like:
 //    push module_data
 //    push function
@@ -259,6 +286,7 @@ namespace basic_block_entry {
 
 namespace {
 
+using ::common::BranchEventBuffer;
 using ::common::IndexedFrequencyData;
 using agent::common::ScopedLastErrorKeeper;
 using trace::client::TraceFileSegment;
@@ -267,17 +295,27 @@ const uint32_t kUserApplicationSlot = 0x700;
 const uint32_t kNumSlots = 4U;
 const uint32_t kInvalidBasicBlockId = ~0U;
 
-// The indexed_frequency_data for the bbentry instrumentation mode has 1 column.
-struct BBEntryFrequency {
-  uint32_t frequency;
+// The columns of the indexed_frequency_data for the branch instrumentation
+// mode. The bbentry instrumentation mode only has the frequency column.
+enum BranchColumn {
+  kFrequencyColumn,
+  kBranchTakenColumn,
+  kMispredictedColumn,
 };
 
-// The indexed_frequency_data for the branch instrumentation mode has 3 columns.
-struct BranchFrequency {
-  uint32_t frequency;
-  uint32_t branch_taken;
-  uint32_t mispredicted;
-};
+// The environment variable that holds the options of the agent.
+const char kParametersEnvVar[] = "SYZYGY_BASIC_BLOCK_ENTRY_OPTIONS";
+
+// The width in bits of the per-thread counters: 8, 16 or 32.
+const char kParamCounterWidth[] = "counter-width";
+
+// The size of a cache line, on which the per-thread counters are aligned.
+const size_t kCacheLineSize = 64;
+
+// The per-thread counters are merged into the shared ones at least this
+// often, checked every kMergeCheckPeriod increments.
+const DWORD kMergeIntervalMs = 1000;
+const uint32_t kMergeCheckPeriod = 1 << 16;
 
 // An entry in the basic block id buffer.
 struct BranchBufferEntry {
@@ -291,9 +329,63 @@ base::LazyInstance<BasicBlockEntry> static_bbentry_instance =
 
 // Increment and saturate a 32-bit value.
 inline uint32_t IncrementAndSaturate(uint32_t value) {
-  if (value != ~0U)
-    ++value;
-  return value;
+  return value + (value != ~0U ? 1 : 0);
+}
+
+// Add and saturate 32-bit values.
+inline uint32_t AddAndSaturate(uint32_t value, uint32_t addend) {
+  uint32_t sum = value + addend;
+  return sum < value ? ~0U : sum;
+}
+
+// Increments a per-thread counter.
+// @returns true if the counter is full and must be spilled.
+template <typename CounterType>
+inline bool IncrementThreadCounter(void* counters, size_t index) {
+  CounterType& counter = static_cast<CounterType*>(counters)[index];
+  ++counter;
+  return counter == std::numeric_limits<CounterType>::max();
+}
+
+// Clears a per-thread counter.
+// @returns the count it held.
+template <typename CounterType>
+inline uint32_t TakeCount(void* counters, size_t index) {
+  CounterType& counter = static_cast<CounterType*>(counters)[index];
+  uint32_t count = counter;
+  counter = 0;
+  return count;
+}
+
+// Reads the width of the per-thread counters from the agent options.
+// @returns the width in bytes.
+size_t GetCounterWidthFromEnv() {
+  std::unique_ptr<base::Environment> env(base::Environment::Create());
+  DCHECK(env.get() != NULL);
+
+  std::string options;
+  if (!env->GetVar(kParametersEnvVar, &options))
+    return sizeof(uint32_t);
+
+  // Prepends the options with a dummy executable name to keep the
+  // base::CommandLine parser happy.
+  std::wstring str = base::UTF8ToWide(options);
+  str.insert(0, L"dummy.exe ");
+  base::CommandLine cmd_line = base::CommandLine::FromString(str);
+
+  std::string value = cmd_line.GetSwitchValueASCII(kParamCounterWidth);
+  if (value.empty())
+    return sizeof(uint32_t);
+
+  unsigned bits = 0;
+  if (!base::StringToUint(value, &bits) ||
+      (bits != 8 && bits != 16 && bits != 32)) {
+    LOG(ERROR) << "Invalid value for --" << kParamCounterWidth << ": "
+               << value << ".";
+    return sizeof(uint32_t);
+  }
+
+  return bits / 8;
 }
 
 // Get the address of the module containing @p addr. We do this by querying
@@ -407,6 +499,12 @@ class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
   // Allocate temporary space to simulate a branch predictor.
   void AllocatePredictorCache();
 
+  // Allocate the counters of this thread, which are merged into the shared
+  // frequency data later on. Without them, the shared frequency data is
+  // updated right away.
+  // @param counter_width the width of the counters, in bytes.
+  void AllocateCounters(size_t counter_width);
+
   // Saturation increment the frequency record for @p index. Note that in
   // Release mode, no range checking is performed on index.
   // @param basic_block_id the basic block index.
@@ -432,6 +530,33 @@ class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
   // Flush pending values in the basic block ids buffer.
   void Flush();
 
+  // Allocate the buffer to which the inline branch instrumentation appends
+  // its events.
+  void AllocateEventBuffer();
+
+  // Append an event to the event buffer, processing the buffered events first
+  // if it is full. The event is processed right away if there is no buffer.
+  // @param event the basic block id of the event, with kBranchExitEventFlag
+  //     set for an exit.
+  void PushEvent(uint32_t event);
+
+  // Process the events in the event buffer, and empty it.
+  void FlushEvents();
+
+  // @returns the event buffer header that the FS slot of the thread points
+  //     to.
+  BranchEventBuffer* event_buffer() { return &event_buffer_; }
+
+  // @returns the 32-bit counters of this thread, which the inline fast path
+  //     of the basic-block entry instrumentation increments through the FS
+  //     slot, or NULL if the thread has no such counters. As these counts
+  //     aren't tracked, they are assumed to be pending from then on.
+  uint32_t* GetInlineCounters();
+
+  // Merge the counters of this thread into the shared frequency data. This
+  // must be called under trace_lock_.
+  void Merge();
+
   // Return the id of the most recent basic block executed.
   uint32_t last_basic_block_id() { return last_basic_block_id_; }
 
@@ -441,15 +566,8 @@ class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
   // Return the lock associated with 'trace_data_' for atomic update.
   base::Lock* trace_lock() { return trace_lock_; }
 
-  // For a given basic block id, returns the corresponding BBEntryFrequency.
-  // @param basic_block_id the basic block index.
-  // @returns the bbentry frequency entry for a given basic block id.
-  BBEntryFrequency& GetBBEntryFrequency(uint32_t basic_block_id);
-
-  // For a given basic block id, returns the corresponding BranchFrequency.
-  // @param basic_block_id the basic block index.
-  // @returns the branch frequency entry for a given basic block id.
-  BranchFrequency& GetBranchFrequency(uint32_t basic_block_id);
+  // @returns true if this thread has counts that were not merged yet.
+  bool has_pending_counts() const { return has_pending_counts_; }
 
   // Retrieve the indexed_frequency_data specific fields for this agent.
   // @returns a pointer to the specific fields.
@@ -478,13 +596,53 @@ class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
   // Current offset of the next available entry in the basic block id buffer.
   uint32_t basic_block_id_buffer_offset_;
 
+  // The events appended by the inline branch instrumentation, and the header
+  // through which it appends them.
+  std::vector<uint32_t> events_;
+  BranchEventBuffer event_buffer_;
+
   // The branch predictor state (2-bit saturating counter).
   std::vector<uint8_t> predictor_data_;
 
   // The last basic block id executed.
   uint32_t last_basic_block_id_;
 
+  // The counters of this thread, laid out like the shared frequency data but
+  // with counter_width_ bytes per counter, or NULL if the shared frequency
+  // data is updated right away. They are aligned on, and padded to, cache
+  // lines so that no other thread writes to the same lines.
+  void* counters_;
+  size_t counter_width_;
+  size_t num_counters_;
+
+  // True if counters_ holds counts that were not merged yet.
+  bool has_pending_counts_;
+
+  // The number of increments left before checking whether the counters are
+  // due to be merged, and the tick count of the last merge.
+  uint32_t merge_countdown_;
+  DWORD last_merge_ticks_;
+
  private:
+  // Increments the counter in @p column of @p basic_block_id.
+  void IncrementCounter(uint32_t basic_block_id, BranchColumn column);
+
+  // Updates the state and the frequencies for an entry or an exit event.
+  void ProcessEvent(uint32_t event);
+
+  // Moves the count of a full counter of this thread to the shared frequency
+  // data.
+  // @param index the index of the counter.
+  void SpillCounter(size_t index);
+
+  // Merges the counters into the shared frequency data if the last merge is
+  // old enough.
+  void MaybeMerge();
+
+  // Adds the count of the counter at @p index to the shared frequency data,
+  // and clears it. Must be called under trace_lock_.
+  void MoveCount(size_t index);
+
   DISALLOW_COPY_AND_ASSIGN(ThreadState);
 };
 
@@ -495,18 +653,37 @@ BasicBlockEntry::ThreadState::ThreadState(IndexedFrequencyData* module_data,
       module_data_(module_data),
       trace_lock_(lock),
       basic_block_id_buffer_offset_(0),
-      last_basic_block_id_(kInvalidBasicBlockId) {
+      last_basic_block_id_(kInvalidBasicBlockId),
+      counters_(NULL),
+      counter_width_(0),
+      num_counters_(0),
+      has_pending_counts_(false),
+      merge_countdown_(kMergeCheckPeriod),
+      last_merge_ticks_(::GetTickCount()) {
+  event_buffer_.next = NULL;
+  event_buffer_.end = NULL;
+  event_buffer_.thread_state = this;
 }
 
 BasicBlockEntry::ThreadState::~ThreadState() {
   if (!basic_block_id_buffer_.empty())
     Flush();
+  FlushEvents();
 
+  // The counts of a thread that detached were merged already. Those of a
+  // thread that died without detaching are merged here.
+  if (has_pending_counts_) {
+    base::AutoLock scoped_lock(*trace_lock_);
+    Merge();
+  }
+
+  // Unpublish the counters before releasing them.
   uint32_t slot = GetBasicBlockData()->fs_slot;
   if (slot != 0) {
     uint32_t address = kUserApplicationSlot + 4 * (slot - 1);
     __writefsdword(address, 0);
   }
+  _aligned_free(counters_);
 }
 
 void BasicBlockEntry::ThreadState::AllocateBasicBlockIdBuffer() {
@@ -514,6 +691,13 @@ void BasicBlockEntry::ThreadState::AllocateBasicBlockIdBuffer() {
   basic_block_id_buffer_.resize(kBufferSize * sizeof(BranchBufferEntry));
 }
 
+void BasicBlockEntry::ThreadState::AllocateEventBuffer() {
+  DCHECK(events_.empty());
+  events_.resize(kBufferSize);
+  event_buffer_.next = &events_[0];
+  event_buffer_.end = event_buffer_.next + events_.size();
+}
+
 void BasicBlockEntry::ThreadState::AllocatePredictorCache() {
   DCHECK(predictor_data_.empty());
   predictor_data_.resize(kPredictorCacheSize);
@@ -523,60 +707,134 @@ void BasicBlockEntry::ThreadState::reset_last_basic_block_id() {
   last_basic_block_id_ = kInvalidBasicBlockId;
 }
 
-BBEntryFrequency& BasicBlockEntry::ThreadState::GetBBEntryFrequency(
-    uint32_t basic_block_id) {
-  DCHECK(frequency_data_ != NULL);
-  BBEntryFrequency* frequencies =
-      reinterpret_cast<BBEntryFrequency*>(frequency_data_);
-  BBEntryFrequency& entry = frequencies[basic_block_id];
-  return entry;
+void BasicBlockEntry::ThreadState::AllocateCounters(size_t counter_width) {
+  DCHECK(counters_ == NULL);
+  DCHECK(counter_width == sizeof(uint8_t) ||
+         counter_width == sizeof(uint16_t) ||
+         counter_width == sizeof(uint32_t));
+
+  size_t num_counters = module_data_->num_entries * module_data_->num_columns;
+  size_t size = ::common::AlignUp(num_counters * counter_width, kCacheLineSize);
+  counters_ = _aligned_malloc(size, kCacheLineSize);
+  if (counters_ == NULL) {
+    LOG(ERROR) << "Failed to allocate the counters of the thread.";
+    return;
+  }
+  ::memset(counters_, 0, size);
+
+  counter_width_ = counter_width;
+  num_counters_ = num_counters;
 }
 
-BranchFrequency& BasicBlockEntry::ThreadState::GetBranchFrequency(
-    uint32_t basic_block_id) {
-  DCHECK(frequency_data_ != NULL);
-  BranchFrequency* frequencies =
-      reinterpret_cast<BranchFrequency*>(frequency_data_);
-  BranchFrequency& entry = frequencies[basic_block_id];
-  return entry;
+uint32_t* BasicBlockEntry::ThreadState::GetInlineCounters() {
+  if (counters_ == NULL || counter_width_ != sizeof(uint32_t))
+    return NULL;
+
+  has_pending_counts_ = true;
+  return static_cast<uint32_t*>(counters_);
 }
 
-inline void BasicBlockEntry::ThreadState::Increment(uint32_t basic_block_id) {
+inline void BasicBlockEntry::ThreadState::IncrementCounter(
+    uint32_t basic_block_id, BranchColumn column) {
   DCHECK(frequency_data_ != NULL);
   DCHECK(module_data_ != NULL);
   DCHECK_LT(basic_block_id, module_data_->num_entries);
+  DCHECK_LT(static_cast<uint32_t>(column), module_data_->num_columns);
+
+  size_t index = basic_block_id * module_data_->num_columns + column;
+
+  // Without counters of its own, this thread updates the shared ones.
+  if (counters_ == NULL) {
+    base::AutoLock scoped_lock(*trace_lock_);
+    frequency_data_[index] = IncrementAndSaturate(frequency_data_[index]);
+    return;
+  }
+
+  bool full = false;
+  switch (counter_width_) {
+    case sizeof(uint8_t):
+      full = IncrementThreadCounter<uint8_t>(counters_, index);
+      break;
+    case sizeof(uint16_t):
+      full = IncrementThreadCounter<uint16_t>(counters_, index);
+      break;
+    default:
+      full = IncrementThreadCounter<uint32_t>(counters_, index);
+      break;
+  }
+  has_pending_counts_ = true;
+
+  if (full)
+    SpillCounter(index);
 
-  // Retrieve information for the basic block.
-  BBEntryFrequency& entry = GetBBEntryFrequency(basic_block_id);
-  entry.frequency = IncrementAndSaturate(entry.frequency);
+  if (--merge_countdown_ == 0)
+    MaybeMerge();
+}
+
+void BasicBlockEntry::ThreadState::SpillCounter(size_t index) {
+  base::AutoLock scoped_lock(*trace_lock_);
+  MoveCount(index);
+}
+
+void BasicBlockEntry::ThreadState::MaybeMerge() {
+  merge_countdown_ = kMergeCheckPeriod;
+  if (::GetTickCount() - last_merge_ticks_ < kMergeIntervalMs)
+    return;
+
+  base::AutoLock scoped_lock(*trace_lock_);
+  Merge();
+}
+
+void BasicBlockEntry::ThreadState::Merge() {
+  if (counters_ != NULL) {
+    for (size_t i = 0; i < num_counters_; ++i)
+      MoveCount(i);
+  }
+
+  has_pending_counts_ = false;
+  last_merge_ticks_ = ::GetTickCount();
+}
+
+void BasicBlockEntry::ThreadState::MoveCount(size_t index) {
+  DCHECK(counters_ != NULL);
+  DCHECK_LT(index, num_counters_);
+
+  uint32_t count = 0;
+  switch (counter_width_) {
+    case sizeof(uint8_t):
+      count = TakeCount<uint8_t>(counters_, index);
+      break;
+    case sizeof(uint16_t):
+      count = TakeCount<uint16_t>(counters_, index);
+      break;
+    default:
+      count = TakeCount<uint32_t>(counters_, index);
+      break;
+  }
+
+  frequency_data_[index] = AddAndSaturate(frequency_data_[index], count);
+}
+
+inline void BasicBlockEntry::ThreadState::Increment(uint32_t basic_block_id) {
+  IncrementCounter(basic_block_id, kFrequencyColumn);
 }
 
 void BasicBlockEntry::ThreadState::Enter(uint32_t basic_block_id,
                                          uint32_t last_basic_block_id) {
-  DCHECK(frequency_data_ != NULL);
   DCHECK(module_data_ != NULL);
   DCHECK_LT(basic_block_id, module_data_->num_entries);
 
-  // Retrieve information for the current basic block.
-  BranchFrequency& current = GetBranchFrequency(basic_block_id);
-
   // Count the execution of this basic block.
-  if (current.frequency != kInvalidBasicBlockId)
-    current.frequency = IncrementAndSaturate(current.frequency);
+  IncrementCounter(basic_block_id, kFrequencyColumn);
 
   // Check if entering from a jump or something else (call).
   if (last_basic_block_id == kInvalidBasicBlockId)
     return;
 
-  // Retrieve information for the previous basic block.
-  BranchFrequency& previous = GetBranchFrequency(last_basic_block_id);
-
   // If last jump was taken, count the branch taken in the previous basic block.
   bool taken = (basic_block_id != last_basic_block_id + 1);
-  if (taken) {
-    if (previous.branch_taken != kInvalidBasicBlockId)
-      previous.branch_taken = IncrementAndSaturate(previous.branch_taken);
-  }
+  if (taken)
+    IncrementCounter(last_basic_block_id, kBranchTakenColumn);
 
   // Simulate the branch predictor.
   // see: http://en.wikipedia.org/wiki/Branch_predictor
@@ -593,12 +851,12 @@ void BasicBlockEntry::ThreadState::Enter(uint32_t basic_block_id,
     uint8_t& state = predictor_data_[offset];
     if (taken) {
       if (state < 2)
-        previous.mispredicted = IncrementAndSaturate(previous.mispredicted);
+        IncrementCounter(last_basic_block_id, kMispredictedColumn);
       if (state < 3)
         ++state;
     } else {
       if (state > 1)
-        previous.mispredicted = IncrementAndSaturate(previous.mispredicted);
+        IncrementCounter(last_basic_block_id, kMispredictedColumn);
       if (state != 0)
         --state;
     }
@@ -640,11 +898,48 @@ void BasicBlockEntry::ThreadState::Flush() {
   basic_block_id_buffer_offset_ = 0;
 }
 
+void BasicBlockEntry::ThreadState::PushEvent(uint32_t event) {
+  if (event_buffer_.next == event_buffer_.end) {
+    FlushEvents();
+    if (event_buffer_.next == event_buffer_.end) {
+      ProcessEvent(event);
+      return;
+    }
+  }
+
+  *event_buffer_.next = event;
+  ++event_buffer_.next;
+}
+
+void BasicBlockEntry::ThreadState::FlushEvents() {
+  if (events_.empty())
+    return;
+
+  for (const uint32_t* event = &events_[0]; event != event_buffer_.next;
+       ++event) {
+    ProcessEvent(*event);
+  }
+
+  // Reset buffer.
+  event_buffer_.next = &events_[0];
+}
+
+void BasicBlockEntry::ThreadState::ProcessEvent(uint32_t event) {
+  if ((event & ::common::kBranchExitEventFlag) != 0) {
+    Leave(event & ~::common::kBranchExitEventFlag);
+    return;
+  }
+
+  Enter(event, last_basic_block_id_);
+  reset_last_basic_block_id();
+}
+
 BasicBlockEntry* BasicBlockEntry::Instance() {
   return static_bbentry_instance.Pointer();
 }
 
-BasicBlockEntry::BasicBlockEntry() : registered_slots_() {
+BasicBlockEntry::BasicBlockEntry()
+    : registered_slots_(), counter_width_(GetCounterWidthFromEnv()) {
   // Create a session.
   trace::client::InitializeRpcSession(&session_, &segment_);
 }
@@ -749,8 +1044,11 @@ BasicBlockEntry::ThreadState* BasicBlockEntry::CreateThreadState(
     // Sanity check: The slot must be available (not used by an other tool).
     DWORD content = __readfsdword(address);
     CHECK_EQ(content, 0U);
-    // Put the current state to the TLS slot.
-    __writefsdword(address, reinterpret_cast<unsigned long>(state));
+    // Put the event buffer of the current state to the TLS slot.
+    if (module_data->data_type == ::common::IndexedFrequencyData::BRANCH) {
+      __writefsdword(address,
+                     reinterpret_cast<unsigned long>(state->event_buffer()));
+    }
   }
 
   // Nothing to allocate? We're done!
@@ -760,12 +1058,30 @@ BasicBlockEntry::ThreadState* BasicBlockEntry::CreateThreadState(
   }
 
   // Allocate space used by branch instrumentation.
-  if (module_data->data_type == ::common::IndexedFrequencyData::BRANCH)
+  if (module_data->data_type == ::common::IndexedFrequencyData::BRANCH) {
     state->AllocatePredictorCache();
+    if (slot != 0)
+      state->AllocateEventBuffer();
+  }
 
   // Allocate buffer to which basic block id are pushed before being committed.
   state->AllocateBasicBlockIdBuffer();
 
+  // Allocate the counters that this thread increments without locking.
+  state->AllocateCounters(counter_width_);
+
+  // The inline fast path of the basic-block entry instrumentation increments
+  // the counters through the TLS slot. Until they're published, it falls back
+  // to calling the agent.
+  if (slot != 0 &&
+      module_data->data_type != ::common::IndexedFrequencyData::BRANCH) {
+    uint32_t* counters = state->GetInlineCounters();
+    if (counters != NULL) {
+      __writefsdword(kUserApplicationSlot + 4 * (slot - 1),
+                     reinterpret_cast<unsigned long>(counters));
+    }
+  }
+
   return state;
 }
 
@@ -788,7 +1104,12 @@ template<int S>
 inline BasicBlockEntry::ThreadState* BasicBlockEntry::GetThreadStateSlot() {
   uint32_t address = kUserApplicationSlot + 4 * (S - 1);
   DWORD content = __readfsdword(address);
-  return reinterpret_cast<BasicBlockEntry::ThreadState*>(content);
+  BranchEventBuffer* event_buffer =
+      reinterpret_cast<BranchEventBuffer*>(content);
+  if (event_buffer == NULL)
+    return NULL;
+  return static_cast<BasicBlockEntry::ThreadState*>(
+      event_buffer->thread_state);
 }
 
 void WINAPI BasicBlockEntry::IncrementIndexedFreqDataHook(
@@ -804,7 +1125,6 @@ void WINAPI BasicBlockEntry::IncrementIndexedFreqDataHook(
     state = Instance()->CreateThreadState(entry_frame->module_data);
   }
 
-  base::AutoLock scoped_lock(*state->trace_lock());
   state->Increment(entry_frame->index);
 }
 
@@ -820,7 +1140,6 @@ void WINAPI BasicBlockEntry::BranchEnterHook(
     state = Instance()->CreateThreadState(entry_frame->module_data);
   }
 
-  base::AutoLock scoped_lock(*state->trace_lock());
   uint32_t last_basic_block_id = state->last_basic_block_id();
   state->Enter(entry_frame->index, last_basic_block_id);
   state->reset_last_basic_block_id();
@@ -838,10 +1157,8 @@ void WINAPI BasicBlockEntry::BranchEnterBufferedHook(
     state = Instance()->CreateThreadState(entry_frame->module_data);
   }
 
-  if (state->Push(entry_frame->index)) {
-    base::AutoLock scoped_lock(*state->trace_lock());
+  if (state->Push(entry_frame->index))
     state->Flush();
-  }
   state->reset_last_basic_block_id();
 }
 
@@ -869,7 +1186,6 @@ void __fastcall BasicBlockEntry::BranchEnterHookSlot(uint32_t index) {
   if (state == NULL)
     return;
 
-  base::AutoLock scoped_lock(*state->trace_lock());
   uint32_t last_basic_block_id = state->last_basic_block_id();
   state->Enter(index, last_basic_block_id);
   state->reset_last_basic_block_id();
@@ -881,13 +1197,20 @@ void __fastcall BasicBlockEntry::BranchEnterBufferedHookSlot(uint32_t index) {
   if (state == NULL)
     return;
 
-  if (state->Push(index)) {
-    base::AutoLock scoped_lock(*state->trace_lock());
+  if (state->Push(index))
     state->Flush();
-  }
   state->reset_last_basic_block_id();
 }
 
+template <int S>
+void __fastcall BasicBlockEntry::BranchEventHookSlot(uint32_t event) {
+  ThreadState* state = GetThreadStateSlot<S>();
+  if (state == NULL)
+    return;
+
+  state->PushEvent(event);
+}
+
 template <int S>
 void __fastcall BasicBlockEntry::BranchExitHookSlot(uint32_t index) {
   ThreadState* state = GetThreadStateSlot<S>();
@@ -1051,6 +1374,11 @@ void BasicBlockEntry::OnThreadDetach(IndexedFrequencyData* module_data) {
     return;
 
   state->Flush();
+  state->FlushEvents();
+  if (state->has_pending_counts()) {
+    base::AutoLock scoped_lock(lock_);
+    state->Merge();
+  }
   thread_state_manager_.MarkForDeath(state);
 }
 
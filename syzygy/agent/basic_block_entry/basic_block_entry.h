@@ -106,6 +106,10 @@ class BasicBlockEntry {
   template <int S>
   static inline void __fastcall BranchExitHookSlot(uint32_t index);
 
+  // Called from _branch_event_slotX.
+  template <int S>
+  static inline void __fastcall BranchEventHookSlot(uint32_t event);
+
   // Called from _indirect_penter_dllmain.
   static void WINAPI DllMainEntryHook(DllMainEntryFrame* entry_frame);
 
@@ -162,9 +166,17 @@ class BasicBlockEntry {
   // Registered thread local specific slot.
   uint32_t registered_slots_;
 
+  // The width in bytes of the counters of each thread.
+  size_t counter_width_;
+
   // The RPC session we're logging to/through.
   trace::client::RpcSession session_;
 
+  // Global lock to avoid concurrent segment_ update. It also guards the
+  // frequency data, which the ThreadState instances merge their counters into
+  // until they are destroyed, so it must outlive thread_state_manager_.
+  base::Lock lock_;
+
   // A helper to manage the life-cycle of the ThreadState instances allocated
   // by this agent.
   ThreadStateManager thread_state_manager_;
@@ -173,9 +185,6 @@ class BasicBlockEntry {
   // goes to specially allocated segments that we don't explicitly keep track
   // of, but rather that we let live until the client gets torn down.
   trace::client::TraceFileSegment segment_;  // Under lock_.
-
-  // Global lock to avoid concurrent segment_ update.
-  base::Lock lock_;
 };
 
 }  // namespace basic_block_entry
@@ -16,8 +16,11 @@
 
 #include "syzygy/agent/basic_block_entry/basic_block_entry.h"
 
+#include <memory>
+
 #include "base/bind.h"
 #include "base/callback.h"
+#include "base/environment.h"
 #include "base/files/file_enumerator.h"
 #include "base/files/file_util.h"
 #include "base/files/scoped_temp_dir.h"
@@ -34,6 +37,9 @@
 // See http://blogs.msdn.com/b/oldnewthing/archive/2004/10/25/247180.aspx
 EXTERN_C IMAGE_DOS_HEADER __ImageBase;
 
+unsigned long __readfsdword(unsigned long);
+#pragma intrinsic(__readfsdword)
+
 namespace agent {
 namespace basic_block_entry {
 
@@ -87,10 +93,12 @@ class BasicBlockEntryTest : public testing::Test {
  public:
   enum InstrumentationMode {
     kBasicBlockEntryInstrumentation,
+    kBasicBlockEntryWithSlotInstrumentation,
     kBranchInstrumentation,
     kBufferedBranchInstrumentation,
     kBranchWithSlotInstrumentation,
-    kBufferedBranchWithSlotInstrumentation
+    kBufferedBranchWithSlotInstrumentation,
+    kInlineBufferedBranchWithSlotInstrumentation
   };
 
   enum MainMode {
@@ -135,12 +143,17 @@ class BasicBlockEntryTest : public testing::Test {
       case kBasicBlockEntryInstrumentation:
         ConfigureBasicBlockAgent();
         break;
+      case kBasicBlockEntryWithSlotInstrumentation:
+        ConfigureBasicBlockAgent();
+        module_data_.fs_slot = 1;
+        break;
       case kBranchInstrumentation:
       case kBufferedBranchInstrumentation:
         ConfigureBranchAgent();
         break;
       case kBranchWithSlotInstrumentation:
       case kBufferedBranchWithSlotInstrumentation:
+      case kInlineBufferedBranchWithSlotInstrumentation:
         ConfigureBranchAgent();
         module_data_.fs_slot = 1;
         break;
@@ -262,6 +275,10 @@ class BasicBlockEntryTest : public testing::Test {
         ::GetProcAddress(agent_module_, "_function_enter_s1");
     ASSERT_TRUE(basic_block_function_enter_s1_stub_ != NULL);
 
+    basic_block_event_s1_stub_ =
+        ::GetProcAddress(agent_module_, "_branch_event_s1");
+    ASSERT_TRUE(basic_block_event_s1_stub_ != NULL);
+
     basic_block_increment_stub_ =
         ::GetProcAddress(agent_module_, "_increment_indexed_freq_data");
     ASSERT_TRUE(basic_block_increment_stub_ != NULL);
@@ -286,6 +303,7 @@ class BasicBlockEntryTest : public testing::Test {
       basic_block_exit_stub_ = NULL;
       basic_block_exit_s1_stub_ = NULL;
       basic_block_function_enter_s1_stub_ = NULL;
+      basic_block_event_s1_stub_ = NULL;
       basic_block_increment_stub_ = NULL;
       indirect_penter_dllmain_stub_ = NULL;
       indirect_penter_exemain_stub_ = NULL;
@@ -312,6 +330,18 @@ class BasicBlockEntryTest : public testing::Test {
     }
   }
 
+  // Increments a counter through FS-slot 1 the way the inline fast path of
+  // the basic-block entry instrumentation does, calling the agent when the
+  // thread has no counters yet.
+  void SimulateBasicBlockEntrySlot(uint32_t basic_block_id) {
+    uint32_t* counters = reinterpret_cast<uint32_t*>(__readfsdword(0x700));
+    if (counters != NULL) {
+      ++counters[basic_block_id];
+      return;
+    }
+    SimulateBasicBlockEntry(basic_block_id);
+  }
+
   void SimulateBranchEnter(uint32_t basic_block_id) {
     __asm {
       push basic_block_id
@@ -364,10 +394,28 @@ class BasicBlockEntryTest : public testing::Test {
     }
   }
 
+  // Appends an event to the buffer of FS-slot 1 the way the inline branch
+  // instrumentation does, calling the agent when the buffer is full.
+  void SimulateBranchEventSlot(uint32_t event) {
+    ::common::BranchEventBuffer* buffer =
+        reinterpret_cast<::common::BranchEventBuffer*>(__readfsdword(0x700));
+    if (buffer != NULL && buffer->next < buffer->end) {
+      *buffer->next = event;
+      ++buffer->next;
+      return;
+    }
+
+    __asm {
+      push event
+      call basic_block_event_s1_stub_
+    }
+  }
+
   void SimulateThreadFunction(InstrumentationMode mode) {
     switch (mode) {
       case kBranchWithSlotInstrumentation:
       case kBufferedBranchWithSlotInstrumentation:
+      case kInlineBufferedBranchWithSlotInstrumentation:
         SimulateFunctionEnter();
         break;
     }
@@ -378,6 +426,9 @@ class BasicBlockEntryTest : public testing::Test {
       case kBasicBlockEntryInstrumentation:
         SimulateBasicBlockEntry(basic_block_id);
         break;
+      case kBasicBlockEntryWithSlotInstrumentation:
+        SimulateBasicBlockEntrySlot(basic_block_id);
+        break;
       case kBranchInstrumentation:
         SimulateBranchEnter(basic_block_id);
         SimulateBranchExit(basic_block_id);
@@ -394,6 +445,11 @@ class BasicBlockEntryTest : public testing::Test {
         SimulateBranchEnterBufferedSlot(basic_block_id);
         SimulateBranchExit(basic_block_id);
         break;
+      case kInlineBufferedBranchWithSlotInstrumentation:
+        SimulateBranchEventSlot(basic_block_id);
+        SimulateBranchEventSlot(
+            basic_block_id | ::common::kBranchExitEventFlag);
+        break;
       default:
         NOTREACHED();
         break;
@@ -553,6 +609,9 @@ class BasicBlockEntryTest : public testing::Test {
   // The function entrance hook (FS-slot 1).
   static FARPROC basic_block_function_enter_s1_stub_;
 
+  // The hook called by the inline branch instrumentation (FS-slot 1).
+  static FARPROC basic_block_event_s1_stub_;
+
   // The basic-block increment hook.
   static FARPROC basic_block_increment_stub_;
 
@@ -601,6 +660,7 @@ FARPROC BasicBlockEntryTest::basic_block_enter_buffered_s1_stub_ = NULL;
 FARPROC BasicBlockEntryTest::basic_block_exit_stub_ = NULL;
 FARPROC BasicBlockEntryTest::basic_block_exit_s1_stub_ = NULL;
 FARPROC BasicBlockEntryTest::basic_block_function_enter_s1_stub_ = NULL;
+FARPROC BasicBlockEntryTest::basic_block_event_s1_stub_ = NULL;
 FARPROC BasicBlockEntryTest::basic_block_increment_stub_ = NULL;
 FARPROC BasicBlockEntryTest::indirect_penter_dllmain_stub_ = NULL;
 FARPROC BasicBlockEntryTest::indirect_penter_exemain_stub_ = NULL;
@@ -722,6 +782,59 @@ TEST_F(BasicBlockEntryTest, SingleThreadedDllBasicBlockEvents) {
   ASSERT_NO_FATAL_FAILURE(ReplayLogs(1));
 }
 
+TEST_F(BasicBlockEntryTest, NarrowCountersSpill) {
+  // Use 8-bit counters, which fill up before the end of the test.
+  std::unique_ptr<base::Environment> env(base::Environment::Create());
+  ASSERT_TRUE(env.get() != NULL);
+  ASSERT_TRUE(env->SetVar("SYZYGY_BASIC_BLOCK_ENTRY_OPTIONS",
+                          "--counter-width=8"));
+
+  // Configure for BasicBlock mode.
+  ConfigureBasicBlockAgent();
+
+  ASSERT_NO_FATAL_FAILURE(StartService());
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+
+  // Simulate the process attach event.
+  SimulateModuleEvent(DLL_PROCESS_ATTACH);
+
+  // Count past the range of the counters, a few times over.
+  const uint32_t kNumEntries = 1000;
+  for (uint32_t i = 0; i < kNumEntries; ++i)
+    SimulateBasicBlockEntry(0);
+  SimulateBasicBlockEntry(1);
+
+  // Simulate the process detach event.
+  SimulateModuleEvent(DLL_PROCESS_DETACH);
+
+  // Unload the DLL and stop the service.
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+  ASSERT_TRUE(env->UnSetVar("SYZYGY_BASIC_BLOCK_ENTRY_OPTIONS"));
+
+  HMODULE self = ::GetModuleHandle(NULL);
+  DWORD process_id = ::GetCurrentProcessId();
+  DWORD thread_id = ::GetCurrentThreadId();
+
+  static const uint32_t kExpectedFrequencyData[kNumBasicBlocks] = {
+      kNumEntries, 1};
+
+  // Set up expectations for what should be in the trace.
+  EXPECT_CALL(handler_, OnProcessStarted(_, process_id, _));
+  EXPECT_CALL(handler_, OnProcessAttach(_,
+                                        process_id,
+                                        thread_id,
+                                        ModuleAtAddress(self)));
+  EXPECT_CALL(handler_, OnIndexedFrequency(
+      _,
+      process_id,
+      thread_id,
+      FrequencyDataMatches(self, kNumBasicBlocks, kExpectedFrequencyData)));
+  EXPECT_CALL(handler_, OnProcessEnded(_, process_id));
+
+  // Replay the log.
+  ASSERT_NO_FATAL_FAILURE(ReplayLogs(1));
+}
+
 TEST_F(BasicBlockEntryTest, SingleThreadedExeBasicBlockEvents) {
   // Configure for BasicBlock mode.
   ConfigureBasicBlockAgent();
@@ -897,22 +1010,16 @@ TEST_F(BasicBlockEntryTest, BranchWithBufferingEvents) {
     SimulateBranchExit(0);
   }
 
-  // Validate some events are committed.
+  // The flushed events go to the counters of the thread, which are not
+  // merged yet.
+  EXPECT_EQ(0U, frequency_data[0 * kNumBranchColumns]);
+
+  // The counters of the thread are merged when it detaches.
+  SimulateModuleEvent(DLL_THREAD_DETACH);
   EXPECT_NE(0U, frequency_data[0 * kNumBranchColumns]);
   // Entering basic block 1 must be committed.
   EXPECT_EQ(1U, frequency_data[1 * kNumBranchColumns]);
 
-  // Force a flush.
-  uint32_t old_count = frequency_data[0];
-  for (int i = 0; i < kBigEnoughToCauseAFlush; ++i) {
-    SimulateBranchEnterBuffered(0);
-    SimulateBranchExit(0);
-  }
-
-  // Expect to have increasing values.
-  uint32_t new_count = frequency_data[0];
-  EXPECT_LT(old_count, new_count);
-
   ASSERT_NO_FATAL_FAILURE(StopService());
 }
 
@@ -956,6 +1063,16 @@ TEST_F(BasicBlockEntryTest, SingleDllBranchBufferedWithSlotEvents) {
     CheckExecution(kDllMain, kBufferedBranchWithSlotInstrumentation));
 }
 
+TEST_F(BasicBlockEntryTest, SingleExeBranchInlineBufferedWithSlotEvents) {
+  ASSERT_NO_FATAL_FAILURE(
+    CheckExecution(kExeMain, kInlineBufferedBranchWithSlotInstrumentation));
+}
+
+TEST_F(BasicBlockEntryTest, SingleDllBranchInlineBufferedWithSlotEvents) {
+  ASSERT_NO_FATAL_FAILURE(
+    CheckExecution(kDllMain, kInlineBufferedBranchWithSlotInstrumentation));
+}
+
 TEST_F(BasicBlockEntryTest, MultiThreadedDllBasicBlockEvents) {
   ASSERT_NO_FATAL_FAILURE(
       CheckThreadExecution(kDllMain, kBasicBlockEntryInstrumentation));
@@ -966,6 +1083,16 @@ TEST_F(BasicBlockEntryTest, MultiThreadedExeBasicBlockEvents) {
       CheckThreadExecution(kExeMain, kBasicBlockEntryInstrumentation));
 }
 
+TEST_F(BasicBlockEntryTest, MultiThreadedDllBasicBlockWithSlotEvents) {
+  ASSERT_NO_FATAL_FAILURE(
+      CheckThreadExecution(kDllMain, kBasicBlockEntryWithSlotInstrumentation));
+}
+
+TEST_F(BasicBlockEntryTest, MultiThreadedExeBasicBlockWithSlotEvents) {
+  ASSERT_NO_FATAL_FAILURE(
+      CheckThreadExecution(kExeMain, kBasicBlockEntryWithSlotInstrumentation));
+}
+
 TEST_F(BasicBlockEntryTest, MultiThreadedDllBranchEvents) {
   ASSERT_NO_FATAL_FAILURE(
       CheckThreadExecution(kDllMain, kBranchInstrumentation));
@@ -1006,5 +1133,11 @@ TEST_F(BasicBlockEntryTest, MultiThreadedExeBufferedBranchWithSlotEvents) {
       CheckThreadExecution(kExeMain, kBufferedBranchWithSlotInstrumentation));
 }
 
+TEST_F(BasicBlockEntryTest,
+       MultiThreadedDllInlineBufferedBranchWithSlotEvents) {
+  ASSERT_NO_FATAL_FAILURE(CheckThreadExecution(
+      kDllMain, kInlineBufferedBranchWithSlotInstrumentation));
+}
+
 }  // namespace basic_block_entry
 }  // namespace agent
@@ -45,6 +45,29 @@ namespace {
 // All tracing runs through this object.
 base::LazyInstance<Client> static_client_instance = LAZY_INSTANCE_INITIALIZER;
 
+// The number of spare buffers kept at hand, so that the instrumented threads
+// don't wait for the call trace service when they fill their buffers.
+const size_t kSpareBufferCount = 4;
+
+// An upper bound on the size of a compactly encoded function entry: the
+// zigzag LEB128 values of its function and return address deltas.
+const size_t kMaxCompactEnterSize = 2 * 5;
+
+// Appends the zigzag then LEB128 encoded delta from @p previous to @p value
+// to @p cursor.
+void WriteZigzagDelta(uintptr_t previous, uintptr_t value, uint8_t** cursor) {
+  int32_t delta = static_cast<int32_t>(value - previous);
+  uint32_t zigzag = (static_cast<uint32_t>(delta) << 1) ^
+                    static_cast<uint32_t>(delta >> 31);
+  do {
+    uint8_t byte = zigzag & 0x7F;
+    zigzag >>= 7;
+    if (zigzag != 0)
+      byte |= 0x80;
+    *((*cursor)++) = byte;
+  } while (zigzag != 0);
+}
+
 // Copies the arguments under an SEH handler so we don't crash by under-running
 // the stack.
 void CopyArguments(ArgumentWord *dst, const ArgumentWord *src, size_t num) {
@@ -178,6 +201,12 @@ class Client::ThreadLocalData {
   // Allocates a new enter event.
   TraceEnterEventData* AllocateEnterEvent();
 
+  // Records a function entry in the current compact batch record, or in a
+  // new one if it can't be grown.
+  // @param retaddr The return address of the call.
+  // @param function The function that was entered.
+  void LogCompactEnterEvent(RetAddr retaddr, FuncAddr function);
+
   // Flushes the current trace file segment.
   bool FlushSegment();
 
@@ -191,6 +220,12 @@ class Client::ThreadLocalData {
   // The current batch record we're extending, if any.
   // This will point into the associated trace file segment's buffer.
   TraceBatchEnterData* batch;
+
+  // The current compact batch record we're extending, if any, and the values
+  // of its last entry, which the next entry is encoded relative to.
+  TraceCompactBatchEnterData* compact_batch;
+  uintptr_t last_function;
+  uintptr_t last_retaddr;
 };
 
 Client::Client() {
@@ -341,6 +376,7 @@ void Client::LogEvent_FunctionEntry(EntryFrame *entry_frame,
     if (!session_.IsTracing()) {
       if (!trace::client::InitializeRpcSession(&session_, &data->segment))
         return;
+      session_.EnableBufferPrefetch(kSpareBufferCount);
     }
   }
 
@@ -361,6 +397,11 @@ void Client::LogEvent_FunctionEntry(EntryFrame *entry_frame,
   //     the accuracy of the time for batch entry events. Do this before adding
   //     this event to the buffer in order to guarantee precision.
 
+  if ((session_.flags() & TRACE_FLAG_COMPACT_BATCH_ENTER) != 0) {
+    data->LogCompactEnterEvent(entry_frame->retaddr, function);
+    return;
+  }
+
   // Capture the basic call info and timestamp.
   TraceEnterEventData* enter = data->AllocateEnterEvent();
   if (enter != NULL) {
@@ -401,7 +442,12 @@ void Client::FreeThreadData() {
     FreeThreadData(data);
 }
 
-Client::ThreadLocalData::ThreadLocalData(Client* c) : client(c), batch(NULL) {
+Client::ThreadLocalData::ThreadLocalData(Client* c)
+    : client(c),
+      batch(NULL),
+      compact_batch(NULL),
+      last_function(0),
+      last_retaddr(0) {
 }
 
 TraceEnterEventData* Client::ThreadLocalData::AllocateEnterEvent() {
@@ -451,10 +497,73 @@ TraceEnterEventData* Client::ThreadLocalData::AllocateEnterEvent() {
   return &batch->calls[0];
 }
 
+void Client::ThreadLocalData::LogCompactEnterEvent(RetAddr retaddr,
+                                                   FuncAddr function) {
+  uintptr_t function_value = reinterpret_cast<uintptr_t>(function);
+  uintptr_t retaddr_value = reinterpret_cast<uintptr_t>(retaddr);
+
+  // Grow the current batch if it's still the last record of the segment. As
+  // for the other batches, the entry is written before the enclosures are
+  // grown from the outermost inward, so that a thread terminated at any point
+  // leaves a consistent buffer behind.
+  if (compact_batch != NULL &&
+      segment.write_ptr ==
+          compact_batch->call_data + compact_batch->call_data_size &&
+      segment.CanAllocateRaw(kMaxCompactEnterSize)) {
+    uint8_t* cursor = segment.write_ptr;
+    WriteZigzagDelta(last_function, function_value, &cursor);
+    WriteZigzagDelta(last_retaddr, retaddr_value, &cursor);
+    size_t entry_size = cursor - segment.write_ptr;
+
+    segment.write_ptr = cursor;
+    segment.header->segment_length += entry_size;
+    trace::client::GetRecordPrefix(compact_batch)->size += entry_size;
+    compact_batch->call_data_size += entry_size;
+    compact_batch->num_calls += 1;
+
+    last_function = function_value;
+    last_retaddr = retaddr_value;
+    return;
+  }
+
+  // Otherwise start a new batch, in a new buffer if need be.
+  size_t record_size = FIELD_OFFSET(TraceCompactBatchEnterData, call_data) +
+                       kMaxCompactEnterSize;
+  if (compact_batch != NULL || !segment.CanAllocate(record_size)) {
+    compact_batch = NULL;
+    if (!client->session_.ExchangeBuffer(&segment))
+      return;
+  }
+
+  // The record is allocated with no slack after the entry, so that the next
+  // entries can be appended right after it.
+  uint8_t entry[kMaxCompactEnterSize];
+  uint8_t* cursor = entry;
+  WriteZigzagDelta(0, function_value, &cursor);
+  WriteZigzagDelta(0, retaddr_value, &cursor);
+  size_t entry_size = cursor - entry;
+
+  TraceCompactBatchEnterData* data =
+      reinterpret_cast<TraceCompactBatchEnterData*>(
+          segment.AllocateTraceRecordImpl(
+              TRACE_COMPACT_BATCH_ENTER,
+              FIELD_OFFSET(TraceCompactBatchEnterData, call_data) +
+                  entry_size));
+  DCHECK(data != NULL);
+  data->num_calls = 1;
+  data->call_data_size = entry_size;
+  ::memcpy(data->call_data, entry, entry_size);
+
+  compact_batch = data;
+  last_function = function_value;
+  last_retaddr = retaddr_value;
+}
+
 bool Client::ThreadLocalData::FlushSegment() {
   DCHECK(IsInitialized());
 
   batch = NULL;
+  compact_batch = NULL;
   return client->session_.ExchangeBuffer(&segment);
 }
 
@@ -17,42 +17,106 @@
 #include <stdint.h>
 #include <windows.h>
 
+#include <algorithm>
+
 #include "base/logging.h"
+#include "syzygy/common/align.h"
 #include "syzygy/common/com_utils.h"
 
 namespace agent {
 namespace common {
 
-bool HotPatcher::Patch(FunctionPointer function_entry_point,
-                       FunctionPointer new_entry_point) {
-  // The hot patching starts 5 bytes before the entry point of the function.
-  uint8_t* hot_patch_start =
-      reinterpret_cast<uint8_t*>(function_entry_point) - 5;
-  const size_t hot_patch_length = 7U;
-
-  // Change the page protection so that we can write.
-  MEMORY_BASIC_INFORMATION memory_info;
-  DWORD old_page_protection = 0;
+namespace {
+
+// The hot patching starts this many bytes before the entry point of a
+// function.
+const size_t kHotPatchPrefixLength = 5U;
+// The number of bytes that is written by hot patching a function.
+const size_t kHotPatchLength = 7U;
+
+// A range of memory whose protection has been changed.
+struct UnprotectedRange {
+  uint8_t* address;
+  size_t size;
+  DWORD old_page_protection;
+};
+typedef std::vector<UnprotectedRange> UnprotectedRanges;
+
+size_t GetPageSize() {
+  SYSTEM_INFO system_info = {};
+  ::GetSystemInfo(&system_info);
+  return system_info.dwPageSize;
+}
 
-  if (!::VirtualQuery(hot_patch_start, &memory_info, sizeof(memory_info))) {
-    LOG(ERROR) << "Could not execute VirtualQuery(). Error code: "
-               << ::common::LogWe();
-    return false;
+// Makes the pages in a range writable, preserving their executable status.
+// This changes the protection once per region of pages sharing the same
+// attributes.
+// @param begin The beginning of the range.
+// @param end The end of the range.
+// @param unprotected_ranges Receives the ranges whose protection changed.
+// @returns true on success, false otherwise.
+bool UnprotectPages(uint8_t* begin,
+                    uint8_t* end,
+                    UnprotectedRanges* unprotected_ranges) {
+  while (begin < end) {
+    MEMORY_BASIC_INFORMATION memory_info = {};
+    if (!::VirtualQuery(begin, &memory_info, sizeof(memory_info))) {
+      LOG(ERROR) << "Could not execute VirtualQuery(). Error code: "
+                 << ::common::LogWe();
+      return false;
+    }
+    uint8_t* region_end = reinterpret_cast<uint8_t*>(memory_info.BaseAddress) +
+                          memory_info.RegionSize;
+    size_t size = std::min(end, region_end) - begin;
+
+    DWORD is_executable = (PAGE_EXECUTE | PAGE_EXECUTE_READ |
+                           PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY) &
+                          memory_info.Protect;
+
+    DWORD old_page_protection = 0;
+    if (!::VirtualProtect(reinterpret_cast<LPVOID>(begin),
+                          size,
+                          is_executable ? PAGE_EXECUTE_READWRITE :
+                                          PAGE_READWRITE,
+                          &old_page_protection)) {
+      LOG(ERROR) << "Could not grant write privileges to page. Error code: "
+                 << ::common::LogWe();
+      return false;
+    }
+
+    UnprotectedRange range = { begin, size, old_page_protection };
+    unprotected_ranges->push_back(range);
+    begin += size;
   }
 
-  DWORD is_executable = (PAGE_EXECUTE | PAGE_EXECUTE_READ |
-                         PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY) &
-                        memory_info.Protect;
-
-  if (!::VirtualProtect(reinterpret_cast<LPVOID>(hot_patch_start),
-                        hot_patch_length,
-                        is_executable ? PAGE_EXECUTE_READWRITE :
-                                        PAGE_READWRITE,
-                        &old_page_protection)) {
-    LOG(ERROR) << "Could not grant write privileges to page. Error code: "
-               << ::common::LogWe();
-    return false;
+  return true;
+}
+
+// Restores the protection of the ranges changed by UnprotectPages.
+// @param unprotected_ranges The ranges to restore.
+void RestorePages(const UnprotectedRanges& unprotected_ranges) {
+  for (const auto& range : unprotected_ranges) {
+    DWORD old_page_protection = 0;
+    if (!::VirtualProtect(reinterpret_cast<LPVOID>(range.address),
+                          range.size,
+                          range.old_page_protection,
+                          &old_page_protection)) {
+      // This is not an error of the hot patching, which already happened.
+      LOG(ERROR) << "Could not reset old privileges to page. Error code: "
+                 << ::common::LogWe();
+    }
   }
+}
+
+// Writes the hot patch of a function.
+// @param function_entry_point The start address of the function to be hot
+//     patched.
+// @param new_entry_point The function that should be called instead.
+// @pre The bytes to be written must be writable.
+void WriteHotPatch(HotPatcher::FunctionPointer function_entry_point,
+                   HotPatcher::FunctionPointer new_entry_point) {
+  uint8_t* hot_patch_start =
+      reinterpret_cast<uint8_t*>(function_entry_point) - kHotPatchPrefixLength;
 
   // The location where we have to write the PC-relative address of the new
   // entry point.
@@ -84,17 +148,63 @@ bool HotPatcher::Patch(FunctionPointer function_entry_point,
   // We reverse the order of the bytes because of the little endian encoding
   // to get the final value 0xF9EB.
   *jump_hook_place = 0xF9EB;
+}
 
-  // Restore the old page protection.
-  if (!::VirtualProtect(reinterpret_cast<LPVOID>(hot_patch_start),
-                        hot_patch_length,
-                        old_page_protection,
-                        &old_page_protection)) {
-    // We do not return false if this fails as the hot patching already
-    // happened.
-    LOG(ERROR) << "Could not reset old privileges to page. Error code: "
-               << ::common::LogWe();
+}  // namespace
+
+bool HotPatcher::Patch(FunctionPointer function_entry_point,
+                       FunctionPointer new_entry_point) {
+  FunctionPatches patches(1);
+  patches[0].function_entry_point = function_entry_point;
+  patches[0].new_entry_point = new_entry_point;
+  return PatchFunctions(patches);
+}
+
+bool HotPatcher::PatchFunctions(const FunctionPatches& patches) {
+  // Sort the functions by address, so that the pages they span can be merged
+  // in ranges of contiguous pages.
+  std::vector<uint8_t*> hot_patch_starts;
+  hot_patch_starts.reserve(patches.size());
+  for (const auto& patch : patches) {
+    hot_patch_starts.push_back(
+        reinterpret_cast<uint8_t*>(patch.function_entry_point) -
+        kHotPatchPrefixLength);
   }
+  std::sort(hot_patch_starts.begin(), hot_patch_starts.end());
+
+  // Change the page protection so that we can write.
+  const size_t page_size = GetPageSize();
+  UnprotectedRanges unprotected_ranges;
+  uint8_t* range_begin = nullptr;
+  uint8_t* range_end = nullptr;
+  for (uint8_t* hot_patch_start : hot_patch_starts) {
+    uint8_t* pages_begin = ::common::AlignDown(hot_patch_start, page_size);
+    uint8_t* pages_end =
+        ::common::AlignUp(hot_patch_start + kHotPatchLength, page_size);
+    if (range_end != nullptr && pages_begin <= range_end) {
+      range_end = std::max(range_end, pages_end);
+      continue;
+    }
+
+    if (range_end != nullptr &&
+        !UnprotectPages(range_begin, range_end, &unprotected_ranges)) {
+      RestorePages(unprotected_ranges);
+      return false;
+    }
+    range_begin = pages_begin;
+    range_end = pages_end;
+  }
+  if (range_end != nullptr &&
+      !UnprotectPages(range_begin, range_end, &unprotected_ranges)) {
+    RestorePages(unprotected_ranges);
+    return false;
+  }
+
+  for (const auto& patch : patches)
+    WriteHotPatch(patch.function_entry_point, patch.new_entry_point);
+
+  // Restore the old page protection.
+  RestorePages(unprotected_ranges);
 
   return true;
 }
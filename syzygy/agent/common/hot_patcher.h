@@ -32,10 +32,16 @@
 // We also DCHECK that the bytes in the padding that we overwrite are all 0xCC
 // bytes. These are used by the instrumenter in the paddings. These DCHECKs
 // need to be removed to support hot patching a function more than once.
+//
+// Many functions can be hot patched at once. The protection of the pages they
+// span is then changed once per range of contiguous pages, rather than twice
+// per function.
 
 #ifndef SYZYGY_AGENT_COMMON_HOT_PATCHER_H_
 #define SYZYGY_AGENT_COMMON_HOT_PATCHER_H_
 
+#include <vector>
+
 #include <base/macros.h>
 
 namespace agent {
@@ -60,6 +66,24 @@ class HotPatcher {
   bool Patch(FunctionPointer function_entry_point,
              FunctionPointer new_entry_point);
 
+  // Describes a function to be hot patched. See Patch for the meaning of the
+  // fields.
+  struct FunctionPatch {
+    FunctionPointer function_entry_point;
+    FunctionPointer new_entry_point;
+  };
+  typedef std::vector<FunctionPatch> FunctionPatches;
+
+  // Applies hot patching to a set of functions. The pages spanned by the
+  // functions are made writable before any of them is patched, grouped in
+  // ranges of contiguous pages, and their protection is restored once all of
+  // them are patched.
+  // @param patches The functions to be hot patched, in any order.
+  // @returns true on success. On failure, none of the functions is patched.
+  // @pre All the functions must have been prepared for hot patching, see
+  //     Patch.
+  bool PatchFunctions(const FunctionPatches& patches);
+
  private:
   DISALLOW_COPY_AND_ASSIGN(HotPatcher);
 };
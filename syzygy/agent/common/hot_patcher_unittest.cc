@@ -17,6 +17,8 @@
 #include <stdint.h>
 #include <windows.h>
 
+#include <vector>
+
 #include "gtest/gtest.h"
 
 namespace agent {
@@ -132,6 +134,62 @@ class HotPatcherTest : public ::testing::Test {
     ASSERT_EQ(PAGE_EXECUTE_READ, meminfo.Protect);
   }
 
+  // Runs the hot patcher on many functions at once.
+  // @param virtual_memory_size The size of virtual memory that we allocate
+  //     for the test using VirtualAlloc.
+  // @param stride We lay out a copy of |kTestFunction| every |stride| bytes
+  //     in the allocated virtual memory, starting at its end.
+  void RunBatchTest(size_t virtual_memory_size, size_t stride) {
+    ASSERT_LE(sizeof(kTestFunction), stride);
+    ASSERT_EQ(0U, stride % 2);
+
+    LPVOID virtual_memory = ::VirtualAlloc(nullptr,
+                                           virtual_memory_size,
+                                           MEM_COMMIT,
+                                           PAGE_READWRITE);
+    ASSERT_NE(nullptr, virtual_memory);
+
+    // Copy the test functions into the virtual memory, in decreasing order of
+    // address so that the patches are not given sorted.
+    std::vector<TestFunctionPtr> test_functions;
+    HotPatcher::FunctionPatches patches;
+    for (size_t offset = virtual_memory_size - stride; offset >= stride;
+         offset -= stride) {
+      uint8_t* virtual_memory_cursor =
+          static_cast<uint8_t*>(virtual_memory) + offset;
+      ::memcpy(virtual_memory_cursor, kTestFunction, sizeof(kTestFunction));
+      test_functions.push_back(reinterpret_cast<TestFunctionPtr>(
+          virtual_memory_cursor + kNumberOfPaddingBytesInTestFunction));
+
+      HotPatcher::FunctionPatch patch = {test_functions.back(), &NewFunction};
+      patches.push_back(patch);
+    }
+
+    DWORD old_protection;
+    ASSERT_TRUE(::VirtualProtect(virtual_memory,
+                                 virtual_memory_size,
+                                 PAGE_EXECUTE_READ,
+                                 &old_protection));
+
+    for (TestFunctionPtr test_function : test_functions)
+      ASSERT_EQ(1, test_function());
+
+    HotPatcher hot_patcher;
+    ASSERT_TRUE(hot_patcher.PatchFunctions(patches));
+
+    for (TestFunctionPtr test_function : test_functions)
+      ASSERT_EQ(42, test_function());
+
+    // Check that the protection is kept for all the pages.
+    MEMORY_BASIC_INFORMATION meminfo;
+    ASSERT_NE(0U,
+              ::VirtualQuery(virtual_memory, &meminfo, virtual_memory_size));
+    ASSERT_EQ(virtual_memory_size, meminfo.RegionSize);
+    ASSERT_EQ(PAGE_EXECUTE_READ, meminfo.Protect);
+
+    ASSERT_TRUE(::VirtualFree(virtual_memory, 0, MEM_RELEASE));
+  }
+
   size_t page_size_;
 };
 
@@ -147,5 +205,17 @@ TEST_F(HotPatcherTest, TestPageBoundary) {
   ASSERT_NO_FATAL_FAILURE(RunTest(page_size_ * 2, page_size_ - 4));
 }
 
+TEST_F(HotPatcherTest, TestPatchFunctions) {
+  HotPatcher hot_patcher;
+  EXPECT_TRUE(hot_patcher.PatchFunctions(HotPatcher::FunctionPatches()));
+
+  // Several functions per page, on contiguous pages.
+  ASSERT_NO_FATAL_FAILURE(RunBatchTest(page_size_ * 4, 64U));
+  // Functions straddling page boundaries.
+  ASSERT_NO_FATAL_FAILURE(RunBatchTest(page_size_ * 4, page_size_ - 2));
+  // A function every other page.
+  ASSERT_NO_FATAL_FAILURE(RunBatchTest(page_size_ * 8, page_size_ * 2));
+}
+
 }  // namespace common
 }  // namespace agent
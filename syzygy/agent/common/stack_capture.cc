@@ -44,18 +44,55 @@ size_t StackCapture::GetMaxNumFrames(size_t bytes) {
   return bytes;
 }
 
+namespace {
+
+// Atomically replaces |*ref_count| with |new_value| if it is still equal to
+// |old_value|. Returns true on success.
+bool CompareExchangeRefCount(volatile StackCapture::RefCount* ref_count,
+                             StackCapture::RefCount old_value,
+                             StackCapture::RefCount new_value) {
+  static_assert(sizeof(StackCapture::RefCount) == sizeof(SHORT),
+                "RefCount must be 16 bits wide.");
+  SHORT previous = ::InterlockedCompareExchange16(
+      reinterpret_cast<volatile SHORT*>(ref_count),
+      static_cast<SHORT>(new_value),
+      static_cast<SHORT>(old_value));
+  return static_cast<StackCapture::RefCount>(previous) == old_value;
+}
+
+}  // namespace
+
 void StackCapture::AddRef() {
-  if (RefCountIsSaturated())
-    return;
-  DCHECK_GT(kMaxRefCount, ref_count_);
-  ++ref_count_;
+  while (true) {
+    RefCount ref_count = ref_count_;
+    if (ref_count == kMaxRefCount)
+      return;
+    if (CompareExchangeRefCount(&ref_count_, ref_count, ref_count + 1))
+      return;
+  }
+}
+
+bool StackCapture::TryAddRef() {
+  while (true) {
+    RefCount ref_count = ref_count_;
+    if (ref_count == 0)
+      return false;
+    if (ref_count == kMaxRefCount)
+      return true;
+    if (CompareExchangeRefCount(&ref_count_, ref_count, ref_count + 1))
+      return true;
+  }
 }
 
 void StackCapture::RemoveRef() {
-  DCHECK_LT(0u, ref_count_);
-  if (RefCountIsSaturated())
-    return;
-  --ref_count_;
+  while (true) {
+    RefCount ref_count = ref_count_;
+    DCHECK_LT(0u, ref_count);
+    if (ref_count == kMaxRefCount)
+      return;
+    if (CompareExchangeRefCount(&ref_count_, ref_count, ref_count - 1))
+      return;
+  }
 }
 
 StackId StackCapture::relative_stack_id() const {
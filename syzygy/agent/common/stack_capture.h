@@ -83,10 +83,20 @@ class StackCapture {
   // @returns true if this stack trace capture contains valid frame pointers.
   bool IsValid() const { return num_frames_ != 0; }
 
-  // Increments the reference count of this stack capture.
+  // Increments the reference count of this stack capture. This is atomic
+  // with respect to other reference count modifications.
   void AddRef();
 
-  // Decrements the reference count of this stack capture.
+  // Increments the reference count of this stack capture, but only if it is
+  // currently referenced. This is atomic with respect to other reference count
+  // modifications, and allows a stack capture to be safely acquired without
+  // holding the lock protecting its owner.
+  // @returns true if a reference was acquired (or the reference count is
+  //     saturated), false if the stack capture was unreferenced.
+  bool TryAddRef();
+
+  // Decrements the reference count of this stack capture. This is atomic
+  // with respect to other reference count modifications.
   void RemoveRef();
 
   // @returns true if the reference count is saturated, false otherwise. A
@@ -192,8 +202,9 @@ class StackCapture {
 
   // The reference count for this stack capture. We use saturation arithmetic
   // and something that is referenced 2^16 - 1 times will stay at that reference
-  // count and never be removed from the stack cache.
-  RefCount ref_count_;
+  // count and never be removed from the stack cache. This is only ever
+  // modified using interlocked operations.
+  volatile RefCount ref_count_;
 
   // The array or frame pointers comprising this stack trace capture.
   // This is a runtime dynamic array whose actual length is max_num_frames_, but
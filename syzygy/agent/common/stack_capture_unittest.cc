@@ -125,6 +125,32 @@ TEST_F(StackCaptureTest, RestrictedFrameCount) {
   EXPECT_EQ(5u, capture.max_num_frames());
 }
 
+TEST_F(StackCaptureTest, RefCounting) {
+  StackCapture capture;
+  EXPECT_TRUE(capture.HasNoRefs());
+
+  // An unreferenced stack capture can't be acquired via TryAddRef.
+  EXPECT_FALSE(capture.TryAddRef());
+  EXPECT_TRUE(capture.HasNoRefs());
+
+  capture.AddRef();
+  EXPECT_EQ(1u, capture.ref_count());
+  EXPECT_TRUE(capture.TryAddRef());
+  EXPECT_EQ(2u, capture.ref_count());
+
+  capture.RemoveRef();
+  capture.RemoveRef();
+  EXPECT_TRUE(capture.HasNoRefs());
+
+  // Saturate the reference count.
+  for (size_t i = 0; i < StackCapture::kMaxRefCount; ++i)
+    capture.AddRef();
+  EXPECT_TRUE(capture.RefCountIsSaturated());
+  EXPECT_TRUE(capture.TryAddRef());
+  capture.RemoveRef();
+  EXPECT_TRUE(capture.RefCountIsSaturated());
+}
+
 TEST_F(StackCaptureTest, AbsoluteStackId) {
   TestStackCapture stack_capture;
   stack_capture.InitFromStack();
@@ -21,18 +21,17 @@ namespace common {
 
 ThreadStateBase::ThreadStateBase()
     : thread_handle_(
-        ::OpenThread(SYNCHRONIZE, FALSE, ::GetCurrentThreadId())) {
+        ::OpenThread(SYNCHRONIZE, FALSE, ::GetCurrentThreadId())),
+      next_(NULL),
+      state_(kUnregistered) {
   DCHECK(thread_handle_.IsValid());
-  InitializeListHead(&entry_);
 }
 
 ThreadStateBase::~ThreadStateBase() {
-  DCHECK(IsListEmpty(&entry_));
+  DCHECK_EQ(kUnregistered, base::subtle::NoBarrier_Load(&state_));
 }
 
-ThreadStateManager::ThreadStateManager() {
-  InitializeListHead(&active_items_);
-  InitializeListHead(&death_row_items_);
+ThreadStateManager::ThreadStateManager() : items_(0), pending_deaths_(0) {
 }
 
 ThreadStateManager::~ThreadStateManager() {
@@ -43,141 +42,204 @@ ThreadStateManager::~ThreadStateManager() {
   // Attempt an orderly deletion of items of the death row.
   Scavenge();
 
-  // Note that we don't hold lock_ for these operations, as the destructor
-  // has to be the only member of the party at this point.
-  if (!IsListEmpty(&death_row_items_)) {
-    // This will happen if the items have been marked for death, but their
-    // threads are still active.
-    LOG(WARNING) << "Active death row items at manager destruction.";
+  ThreadStateBase* items = NULL;
+  {
+    base::AutoLock auto_lock(reclaim_lock_);
+    items = DetachItemsLocked();
+  }
 
-    DeleteItems(&death_row_items_);
+  bool has_active_items = false;
+  bool has_death_row_items = false;
+  for (ThreadStateBase* item = items; item != NULL; item = item->next_) {
+    if (base::subtle::NoBarrier_Load(&item->state_) ==
+        ThreadStateBase::kDeathRow) {
+      has_death_row_items = true;
+    } else {
+      has_active_items = true;
+    }
   }
 
-  if (!IsListEmpty(&active_items_)) {
-    // This can and will happen if other threads in the process have been
-    // terminated, as that'll orphan their thread states.
+  // This will happen if the items have been marked for death, but their
+  // threads are still active.
+  if (has_death_row_items)
+    LOG(WARNING) << "Active death row items at manager destruction.";
+
+  // This can and will happen if other threads in the process have been
+  // terminated, as that'll orphan their thread states.
+  if (has_active_items)
     LOG(WARNING) << "Active thread states at manager destruction.";
 
-    DeleteItems(&active_items_);
-  }
+  DeleteItems(items);
 
-  // If either of these asserts fire, then there are active threads in the
-  // process that are still interacting with the manager. This is obviously
-  // very bad, as the manager is about to wink out of existence.
-  DCHECK(IsListEmpty(&active_items_));
-  DCHECK(IsListEmpty(&death_row_items_));
+  // If this assert fires, then there are active threads in the process that
+  // are still interacting with the manager. This is obviously very bad, as
+  // the manager is about to wink out of existence.
+  DCHECK(first_item() == NULL);
 }
 
 void ThreadStateManager::Register(ThreadStateBase* item) {
   DCHECK(item != NULL);
-  DCHECK(IsListEmpty(&item->entry_));
-  base::AutoLock auto_lock(lock_);
-  InsertTailList(&active_items_, &item->entry_);
+  DCHECK_EQ(ThreadStateBase::kUnregistered,
+            base::subtle::NoBarrier_Load(&item->state_));
+  base::subtle::NoBarrier_Store(&item->state_, ThreadStateBase::kActive);
+
+  // Push the item on the list. The item is only removed under the reclaim
+  // lock, and pushes are immune to the head being popped and pushed back in
+  // the meantime.
+  base::subtle::AtomicWord head = base::subtle::NoBarrier_Load(&items_);
+  while (true) {
+    item->next_ = reinterpret_cast<ThreadStateBase*>(head);
+    base::subtle::AtomicWord previous = base::subtle::Release_CompareAndSwap(
+        &items_, head, reinterpret_cast<base::subtle::AtomicWord>(item));
+    if (previous == head)
+      break;
+    head = previous;
+  }
 }
 
 void ThreadStateManager::Unregister(ThreadStateBase* item) {
   DCHECK(item != NULL);
-  base::AutoLock auto_lock(lock_);
-  RemoveEntryList(&item->entry_);
-  InitializeListHead(&item->entry_);
+  base::AutoLock auto_lock(reclaim_lock_);
+
+  // Unlink the item from the detached list, then put the other items back.
+  ThreadStateBase* items = DetachItemsLocked();
+  ThreadStateBase** link = &items;
+  while (*link != NULL && *link != item)
+    link = &(*link)->next_;
+  if (*link == item)
+    *link = item->next_;
+  SpliceItemsLocked(items);
+
+  item->next_ = NULL;
+  base::subtle::NoBarrier_Store(&item->state_,
+                                ThreadStateBase::kUnregistered);
 }
 
 void ThreadStateManager::MarkForDeath(ThreadStateBase* item) {
   DCHECK(item != NULL);
 
-  {
-    base::AutoLock auto_lock(lock_);
-
-    // Make sure the item we're marking is on the active or death row lists.
-    DCHECK(IsNodeOnList(&active_items_, &item->entry_) ||
-           IsNodeOnList(&death_row_items_, &item->entry_));
-
-    // Pull it out of the list it's on, this'll preserve it over the scavenge
-    // below, in the unlikely case that the item is being marked from another
-    // thread than it's own.
-    RemoveEntryList(&item->entry_);
+  // Make sure the item we're marking is registered.
+  DCHECK_NE(ThreadStateBase::kUnregistered,
+            base::subtle::NoBarrier_Load(&item->state_));
+
+  // Use this opportunity to reclaim a batch of dead items, unless another
+  // thread is already at it. This happens before the item is marked, which
+  // preserves it over the scavenge, in the unlikely case that the item is
+  // being marked from another thread than its own.
+  if (base::subtle::NoBarrier_AtomicIncrement(&pending_deaths_, 1) >=
+          static_cast<base::subtle::Atomic32>(kScavengeBatchSize) &&
+      reclaim_lock_.Try()) {
+    base::subtle::NoBarrier_Store(&pending_deaths_, 0);
+    ThreadStateBase* dead_items = NULL;
+    GatherDeadItemsLocked(&dead_items);
+    reclaim_lock_.Release();
+
+    // We can delete any dead items we found outside of the lock.
+    DeleteItems(dead_items);
   }
 
-  // Use this opportunity to scavenge existing thread states on death row.
-  Scavenge();
-
   // Mark item for death, for later scavenging.
-  {
-    base::AutoLock auto_lock(lock_);
-
-    InsertHeadList(&death_row_items_, &item->entry_);
-  }
+  base::subtle::Release_Store(&item->state_, ThreadStateBase::kDeathRow);
 }
 
 bool ThreadStateManager::Scavenge() {
   // We'll store the list of scavenged items here.
-  LIST_ENTRY dead_items;
-  InitializeListHead(&dead_items);
+  ThreadStateBase* dead_items = NULL;
   bool has_more_items = false;
 
-  // Acquire the lock when interacting with the internal data.
+  // Acquire the lock when removing items from the list.
   {
-    base::AutoLock auto_lock(lock_);
-
-    // Put all of the death row items belonging
-    // to dead threads into dead_items.
-    GatherDeadItemsUnlocked(&dead_items);
-
-    // Return whether or not the thread state manager is no longer holding
-    // any items.
-    has_more_items =
-        !IsListEmpty(&active_items_) || !IsListEmpty(&death_row_items_);
+    base::AutoLock auto_lock(reclaim_lock_);
+    base::subtle::NoBarrier_Store(&pending_deaths_, 0);
+    has_more_items = GatherDeadItemsLocked(&dead_items);
   }
 
   // We can delete any dead items we found outside of the lock.
-  DeleteItems(&dead_items);
-  DCHECK(IsListEmpty(&dead_items));
+  DeleteItems(dead_items);
 
   return has_more_items;
 }
 
-void ThreadStateManager::GatherDeadItemsUnlocked(LIST_ENTRY* dead_items) {
+bool ThreadStateManager::GatherDeadItemsLocked(ThreadStateBase** dead_items) {
   DCHECK(dead_items != NULL);
-  DCHECK(IsListEmpty(dead_items));
-  lock_.AssertAcquired();
+  DCHECK(*dead_items == NULL);
+  reclaim_lock_.AssertAcquired();
+
+  // Walk the detached list, moving the items on death row owned by dead
+  // threads to dead_items.
+  ThreadStateBase* items = DetachItemsLocked();
+  ThreadStateBase** link = &items;
+  while (*link != NULL) {
+    ThreadStateBase* item = *link;
+    if (base::subtle::Acquire_Load(&item->state_) ==
+            ThreadStateBase::kDeathRow &&
+        IsThreadDead(item)) {
+      *link = item->next_;
+      item->next_ = *dead_items;
+      *dead_items = item;
+    } else {
+      link = &item->next_;
+    }
+  }
 
-  // Return if the death row items list is empty.
-  if (IsListEmpty(&death_row_items_))
-    return;
+  // Threads may have registered items while the list was detached, in which
+  // case there are more items even if none survived the walk.
+  bool has_more_items = items != NULL;
+  SpliceItemsLocked(items);
+  return has_more_items || first_item() != NULL;
+}
 
-  // Walk the death row items list, looking for items owned by dead threads.
-  ThreadStateBase* item =
-      CONTAINING_RECORD(death_row_items_.Flink, ThreadStateBase, entry_);
-  while (item != NULL) {
-    ThreadStateBase* next_item = NULL;
-    if (item->entry_.Flink != &death_row_items_) {
-      next_item =
-          CONTAINING_RECORD(item->entry_.Flink, ThreadStateBase, entry_);
-    }
+ThreadStateBase* ThreadStateManager::DetachItemsLocked() {
+  reclaim_lock_.AssertAcquired();
 
-    // Move the item to the dead_items list if the associated thread is dead.
-    if (IsThreadDead(item)) {
-      RemoveEntryList(&item->entry_);
-      InsertTailList(dead_items, &item->entry_);
-    }
+  // The exchange is a full barrier, which makes the links written by the
+  // pushing threads visible.
+  base::subtle::AtomicWord head =
+      base::subtle::NoBarrier_AtomicExchange(&items_, 0);
+  base::subtle::MemoryBarrier();
+  return reinterpret_cast<ThreadStateBase*>(head);
+}
 
-    item = next_item;
+void ThreadStateManager::SpliceItemsLocked(ThreadStateBase* first) {
+  reclaim_lock_.AssertAcquired();
+  if (first == NULL)
+    return;
+
+  ThreadStateBase* last = first;
+  while (last->next_ != NULL)
+    last = last->next_;
+
+  // Items may have been pushed since the list was detached, so the detached
+  // items go in front of them.
+  base::subtle::AtomicWord head = base::subtle::NoBarrier_Load(&items_);
+  while (true) {
+    last->next_ = reinterpret_cast<ThreadStateBase*>(head);
+    base::subtle::AtomicWord previous = base::subtle::Release_CompareAndSwap(
+        &items_, head, reinterpret_cast<base::subtle::AtomicWord>(first));
+    if (previous == head)
+      break;
+    head = previous;
   }
 }
 
+ThreadStateBase* ThreadStateManager::first_item() const {
+  return reinterpret_cast<ThreadStateBase*>(
+      base::subtle::Acquire_Load(&items_));
+}
+
 bool ThreadStateManager::IsThreadDead(ThreadStateBase* item) {
   DCHECK(item != NULL);
   return ::WaitForSingleObject(item->thread_handle_.Get(), 0) == WAIT_OBJECT_0;
 }
 
-void ThreadStateManager::DeleteItems(LIST_ENTRY* items) {
-  DCHECK(items != NULL);
-  // Let's delete all entries in items.
-  while (!IsListEmpty(items)) {
-    ThreadStateBase* item =
-        CONTAINING_RECORD(items->Flink, ThreadStateBase, entry_);
-    RemoveHeadList(items);
-    InitializeListHead(&item->entry_);
+void ThreadStateManager::DeleteItems(ThreadStateBase* first) {
+  // Let's delete all items of the list.
+  while (first != NULL) {
+    ThreadStateBase* item = first;
+    first = item->next_;
+    item->next_ = NULL;
+    base::subtle::NoBarrier_Store(&item->state_,
+                                  ThreadStateBase::kUnregistered);
     delete item;
   }
 }
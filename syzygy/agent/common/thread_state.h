@@ -19,9 +19,9 @@
 #ifndef SYZYGY_AGENT_COMMON_THREAD_STATE_H_
 #define SYZYGY_AGENT_COMMON_THREAD_STATE_H_
 
+#include "base/atomicops.h"
 #include "base/synchronization/lock.h"
 #include "base/win/scoped_handle.h"
-#include "syzygy/agent/common/dlist.h"
 
 namespace agent {
 namespace common {
@@ -42,64 +42,111 @@ class ThreadStateBase {
  protected:
   friend class ThreadStateManager;
 
+  // The states of an item with respect to its manager.
+  enum ItemState {
+    // The item isn't registered with a manager.
+    kUnregistered,
+    // The item is registered, and its thread is expected to be alive.
+    kActive,
+    // The item is marked for death, and is deleted once its thread is dead.
+    kDeathRow,
+  };
+
   // The handle of the owning thread, used to scavenge thread data.
   base::win::ScopedHandle thread_handle_;
 
-  // The entry linking us into the manager's active_items_ or death_row_ lists.
-  LIST_ENTRY entry_;
+  // The next item of the manager's list of items. This is only modified when
+  // the item is pushed on the list, or under the manager's reclaim lock.
+  ThreadStateBase* next_;
+
+  // The ItemState of this item.
+  base::subtle::Atomic32 state_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(ThreadStateBase);
 };
 
 // A thread-safe class to manage the thread local state used by an agent.
+//
+// Registering an item and marking it for death are lock-free, as they happen
+// on every thread attach and detach. The items are kept on a singly linked
+// list that's only ever pushed to without a lock, and each item records
+// whether it's active or on death row. The items whose threads are dead are
+// reclaimed in batches: once every kScavengeBatchSize items marked for death,
+// the thread marking an item detaches the whole list under a reclaim lock,
+// deletes the dead items it finds and splices the other items back. A thread
+// that can't acquire the reclaim lock leaves the reclamation to its holder
+// rather than waiting for it.
 class ThreadStateManager {
  public:
+  // The number of items marked for death between two reclamations.
+  static const size_t kScavengeBatchSize = 32;
+
   // Initialize a ThreadStateManager instance.
   ThreadStateManager();
 
   // Destroys a ThreadStateManager instance.
   ~ThreadStateManager();
 
-  // Insert @p item into the list of active items.
+  // Insert @p item into the list of active items. This is lock-free.
   void Register(ThreadStateBase* item);
 
-  // Forcibly removes a thread state @p item from the active or death-row list,
-  // as appropriate.
+  // Forcibly removes a thread state @p item from the manager, whether it's
+  // active or on death row. This takes the reclaim lock, and lets the caller
+  // delete @p item on return.
   void Unregister(ThreadStateBase* item);
 
   // Transfer @p item from the list of active items to the death row list. This
   // does not delete @p item immediately if it's called on @p items' own
-  // thread.
+  // thread. This is lock-free, except that it reclaims a batch of dead items
+  // once every kScavengeBatchSize calls.
   void MarkForDeath(ThreadStateBase* item);
 
  protected:
-  // A helper method which gathers up any dead items from the death row list.
+  // A helper method which deletes the items on death row whose owning threads
+  // have terminated.
   // @returns true iff there are any items still being managed by this
   //     ThreadStateManager instance upon this functions return.
   bool Scavenge();
 
-  // Gathers all items which have been marked for death whose owning threads
-  // have terminated into @p dead_items. These items can subsequently be
-  // deleted using the Delete() method.
-  void GatherDeadItemsUnlocked(LIST_ENTRY* dead_items);
+  // Moves the items on death row whose owning threads have terminated from
+  // the list of items to the list at @p dead_items, for the caller to delete
+  // once it releases reclaim_lock_.
+  // @param dead_items receives the first item of the list of dead items.
+  // @returns true iff there are any items still being managed by this
+  //     ThreadStateManager instance.
+  bool GatherDeadItemsLocked(ThreadStateBase** dead_items);
+
+  // Detaches the whole list of items, for the holder of reclaim_lock_ to
+  // modify.
+  // @returns the first item of the list, or NULL if it's empty.
+  ThreadStateBase* DetachItemsLocked();
+
+  // Pushes a detached list of items back on the list of items.
+  // @param first the first item of the list to push, may be NULL.
+  void SpliceItemsLocked(ThreadStateBase* first);
+
+  // @returns the first item of the list of items. Under reclaim_lock_, the
+  //     list may be walked by following the next_ links.
+  ThreadStateBase* first_item() const;
 
-  // Deletes (using the delete operator) each item in @p items.
-  static void DeleteItems(LIST_ENTRY* items);
+  // Deletes (using the delete operator) each item of the list starting at
+  // @p first.
+  static void DeleteItems(ThreadStateBase* first);
 
   // Returns true if the thread which owns @p item has terminated.
   static bool IsThreadDead(ThreadStateBase* item);
 
-  // A lock protecting access to the lists of active and death_row entries.
-  base::Lock lock_;
+  // The first item of the singly linked list of the items of the manager, as
+  // a ThreadStateBase*. Items are pushed on the list without a lock, but
+  // they're only removed under reclaim_lock_.
+  base::subtle::AtomicWord items_;
 
-  // A doubly-linked list of all thread local data items not yet marked for
-  // death. Accessed under lock_.
-  LIST_ENTRY active_items_;
+  // The number of items marked for death since the last reclamation.
+  base::subtle::Atomic32 pending_deaths_;
 
-  // A doubly-linked list of all thread local data items currently marked for
-  // death. Accessed under lock_.
-  LIST_ENTRY death_row_items_;
+  // Serializes the removal of items from the list.
+  base::Lock reclaim_lock_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(ThreadStateManager);
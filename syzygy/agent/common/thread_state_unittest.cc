@@ -17,6 +17,7 @@
 #include "base/atomic_ref_count.h"
 #include "base/bind.h"
 #include "base/synchronization/waitable_event.h"
+#include "base/threading/simple_thread.h"
 #include "base/threading/thread.h"
 #include "gtest/gtest.h"
 
@@ -28,7 +29,11 @@ namespace {
 class TestThreadState : public ThreadStateBase {
  public:
   // Expose protected members for unit-testing.
-  using ThreadStateBase::entry_;
+  using ThreadStateBase::ItemState;
+  using ThreadStateBase::kActive;
+  using ThreadStateBase::kDeathRow;
+  using ThreadStateBase::next_;
+  using ThreadStateBase::state_;
 
   explicit TestThreadState(base::AtomicRefCount* ref) : ref_(ref) {
     base::AtomicRefCountInc(ref_);
@@ -50,39 +55,78 @@ class TestThreadStateManager : public ThreadStateManager {
 
   // Returns true if the there are no active thread state items being managed.
   bool HasActiveItems() {
-    base::AutoLock auto_lock(lock_);
-    return !IsListEmpty(&active_items_);
+    return ListContains(NULL, TestThreadState::kActive);
   }
 
   // Returns true if the there are no death row thread state items being
   // managed. If this returns true, it does not necessarily mean that there
   // are items ready to be scavenged.
   bool HasDeathRowItems() {
-    base::AutoLock auto_lock(lock_);
-    return !IsListEmpty(&death_row_items_);
+    return ListContains(NULL, TestThreadState::kDeathRow);
   }
 
-  // Returns true iff @p item is in the active items list.
+  // Returns true iff @p item is an active item.
   bool IsActive(const TestThreadState* item) {
-    base::AutoLock auto_lock(lock_);
-    return ListContains(&active_items_, item);
+    return ListContains(item, TestThreadState::kActive);
   }
 
-  // Returns true iff @p items is in the death_row list.
+  // Returns true iff @p items is on death row.
   bool IsOnDeathRow(const TestThreadState* item) {
-    base::AutoLock auto_lock(lock_);
-    return ListContains(&death_row_items_, item);
+    return ListContains(item, TestThreadState::kDeathRow);
   }
 
  protected:
-  // A helper function to check if a item is in the given list.
-  static bool ListContains(const LIST_ENTRY* list,
-                           const TestThreadState* item) {
-    return IsNodeOnList(const_cast<LIST_ENTRY*>(list),
-                        const_cast<LIST_ENTRY*>(&item->entry_));
+  // A helper function to check if the list of items contains @p item in
+  // @p state, or any item in @p state if @p item is NULL.
+  bool ListContains(const TestThreadState* item,
+                    TestThreadState::ItemState state) {
+    base::AutoLock auto_lock(reclaim_lock_);
+    // All the items of the tests are TestThreadStates.
+    for (TestThreadState* it = static_cast<TestThreadState*>(first_item());
+         it != NULL; it = static_cast<TestThreadState*>(it->next_)) {
+      if ((item == NULL || it == item) &&
+          base::subtle::NoBarrier_Load(&it->state_) == state) {
+        return true;
+      }
+    }
+    return false;
   }
 };
 
+// Creates, registers and disposes of thread states on its thread. One in
+// every kUnregisterPeriod thread states is unregistered and deleted, the
+// others are marked for death.
+class ThreadStateUser : public base::DelegateSimpleThread::Delegate {
+ public:
+  static const size_t kUnregisterPeriod = 10;
+
+  ThreadStateUser(ThreadStateManager* manager,
+                  base::AtomicRefCount* thread_states,
+                  size_t count)
+      : manager_(manager), thread_states_(thread_states), count_(count) {
+  }
+
+  void Run() override {
+    for (size_t i = 0; i < count_; ++i) {
+      TestThreadState* state = new TestThreadState(thread_states_);
+      manager_->Register(state);
+      if (i % kUnregisterPeriod == kUnregisterPeriod - 1) {
+        manager_->Unregister(state);
+        delete state;
+      } else {
+        manager_->MarkForDeath(state);
+      }
+    }
+  }
+
+ private:
+  ThreadStateManager* manager_;
+  base::AtomicRefCount* thread_states_;
+  size_t count_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadStateUser);
+};
+
 // The test fixture for the thread state related tests.
 class ThreadStateTest : public testing::Test {
  public:
@@ -209,17 +253,13 @@ TEST_F(ThreadStateTest, LifeCycle) {
   EXPECT_TRUE(manager_->HasDeathRowItems());
   EXPECT_TRUE(manager_->IsOnDeathRow(thread_state));
 
-  // A list to which we'll scavenge thread state items.
   bool has_items = false;
-  LIST_ENTRY dead_items;
-  InitializeListHead(&dead_items);
 
   // Scavenge from death row while the thread is still running. Note that we
   // test this using the internal function that usually isn't exposed to
   // callers.
   has_items = manager_->Scavenge();
   EXPECT_TRUE(has_items);
-  EXPECT_TRUE(IsListEmpty(&dead_items));
   EXPECT_FALSE(manager_->HasActiveItems());
   EXPECT_TRUE(manager_->HasDeathRowItems());
   EXPECT_TRUE(manager_->IsOnDeathRow(thread_state));
@@ -249,5 +289,50 @@ TEST_F(ThreadStateTest, DeletesAllThreadStatesOnDestruction) {
   EXPECT_TRUE(base::AtomicRefCountIsZero(&thread_states_));
 }
 
+TEST_F(ThreadStateTest, ReclaimsDeadItemsInBatches) {
+  // Each thread state is marked for death on a thread of its own, which
+  // terminates before the next one starts.
+  ThreadStateUser user(manager_.get(), &thread_states_, 1);
+  for (size_t i = 0; i < ThreadStateManager::kScavengeBatchSize - 1; ++i) {
+    base::DelegateSimpleThread thread(&user, "user");
+    thread.Start();
+    thread.Join();
+  }
+
+  // The dead thread states are left alone until a batch is complete.
+  EXPECT_EQ(static_cast<base::subtle::Atomic32>(
+                ThreadStateManager::kScavengeBatchSize - 1),
+            base::subtle::NoBarrier_Load(&thread_states_));
+  EXPECT_TRUE(manager_->HasDeathRowItems());
+
+  // Marking the last thread state of the batch reclaims the others, but not
+  // itself.
+  base::DelegateSimpleThread thread(&user, "user");
+  thread.Start();
+  thread.Join();
+  EXPECT_TRUE(base::AtomicRefCountIsOne(&thread_states_));
+
+  EXPECT_FALSE(manager_->Scavenge());
+  EXPECT_TRUE(base::AtomicRefCountIsZero(&thread_states_));
+}
+
+TEST_F(ThreadStateTest, ConcurrentRegistration) {
+  const size_t kThreadCount = 8;
+  const size_t kThreadStatesPerThread = 1000;
+
+  ThreadStateUser user(manager_.get(), &thread_states_,
+                       kThreadStatesPerThread);
+  base::DelegateSimpleThreadPool pool("user", kThreadCount);
+  pool.AddWork(&user, kThreadCount);
+  pool.Start();
+  pool.JoinAll();
+
+  // All the threads are dead, so all the thread states they left are
+  // reclaimed.
+  EXPECT_FALSE(manager_->HasActiveItems());
+  EXPECT_FALSE(manager_->Scavenge());
+  EXPECT_TRUE(base::AtomicRefCountIsZero(&thread_states_));
+}
+
 }  // namespace common
 }  // namespace agent
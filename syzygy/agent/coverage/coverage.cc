@@ -70,6 +70,41 @@ extern "C" void __declspec(naked) _indirect_penter_dllmain() {
   }
 }
 
+// This is expected to be called via instrumentation that looks like:
+//    push basic_block_id
+//    push coverage_data
+//    call [_coverage_probe]
+extern "C" void __declspec(naked) _coverage_probe() {
+  __asm {
+    // Stack: ..., basic_block_id, coverage_data, ret_addr.
+
+    // Stash volatile registers.
+    push eax
+    push ecx
+    push edx
+    pushfd
+
+    // Stack: ..., basic_block_id, coverage_data, ret_addr, eax, ecx, edx, fd.
+
+    lea eax, DWORD PTR[esp + 0x10]
+    push eax
+
+    // Stack: ..., basic_block_id, coverage_data, ret_addr, eax, ecx, edx, fd,
+    //        &ret_addr.
+
+    call agent::coverage::Coverage::ProbeHook
+
+    // Restore volatile registers.
+    popfd
+    pop edx
+    pop ecx
+    pop eax
+
+    // Return and pop off the arguments pushed by the call site.
+    ret 8
+  }
+}
+
 BOOL WINAPI DllMain(HMODULE instance, DWORD reason, LPVOID reserved) {
   using agent::coverage::Coverage;
 
@@ -119,6 +154,21 @@ using ::common::kBasicBlockFrequencyDataVersion;
 base::LazyInstance<agent::coverage::Coverage> static_coverage_instance =
     LAZY_INSTANCE_INITIALIZER;
 
+// The instructions of a probe call site:
+//    push imm32 basic_block_id   68 xx xx xx xx
+//    push imm32 coverage_data    68 xx xx xx xx
+//    call [_coverage_probe]      FF 15 xx xx xx xx
+const size_t kProbeSize = 16;
+const uint8_t kPushImm32Opcode = 0x68;
+const uint8_t kCallIndirectOpcode[] = { 0xFF, 0x15 };
+
+// The probe is removed by overwriting its first two bytes with a short jump
+// over the rest of it: jmp +14. The other threads executing the code only
+// see either instruction if the write is naturally aligned, as it then can't
+// straddle an instruction fetch boundary. The instrumenter aligns the probes
+// for this, and the misaligned ones are left in place.
+const uint16_t kJumpOverProbe = 0xEB | ((kProbeSize - 2) << 8);
+
 }  // namespace
 
 Coverage* Coverage::Instance() {
@@ -193,6 +243,74 @@ void WINAPI Coverage::EntryHook(EntryHookFrame* entry_frame) {
   LOG(INFO) << "Coverage client initialized.";
 }
 
+void WINAPI Coverage::ProbeHook(ProbeFrame* probe_frame) {
+  DCHECK(probe_frame != NULL);
+  DCHECK(probe_frame->coverage_data != NULL);
+  DCHECK_LT(probe_frame->basic_block_id,
+            probe_frame->coverage_data->num_entries);
+
+  ScopedLastErrorKeeper scoped_last_error_keeper;
+
+  // This is what the inline instrumentation does, in the coverage results
+  // array or its static fall-back.
+  uint8_t* coverage_results =
+      static_cast<uint8_t*>(probe_frame->coverage_data->frequency_data);
+  coverage_results[probe_frame->basic_block_id] = 1;
+
+  // A probe that can't be removed keeps on working, only more slowly.
+  Coverage::Instance()->RemoveProbe(probe_frame->ret_addr,
+                                    probe_frame->basic_block_id);
+}
+
+bool Coverage::RemoveProbe(const uint8_t* ret_addr, uint32_t basic_block_id) {
+  DCHECK(ret_addr != NULL);
+
+  uint8_t* probe = const_cast<uint8_t*>(ret_addr) - kProbeSize;
+  if (reinterpret_cast<uintptr_t>(probe) % sizeof(kJumpOverProbe) != 0)
+    return false;
+
+  // Another thread may have been through the probe and removed it already.
+  if (*reinterpret_cast<const uint16_t*>(probe) == kJumpOverProbe)
+    return true;
+
+  if (probe[0] != kPushImm32Opcode ||
+      *reinterpret_cast<const uint32_t*>(probe + 1) != basic_block_id ||
+      probe[5] != kPushImm32Opcode ||
+      probe[10] != kCallIndirectOpcode[0] ||
+      probe[11] != kCallIndirectOpcode[1]) {
+    LOG(ERROR) << "Unexpected call site for the coverage probe.";
+    return false;
+  }
+
+  base::AutoLock auto_lock(probe_lock_);
+
+  uint16_t* first_bytes = reinterpret_cast<uint16_t*>(probe);
+  DWORD old_page_protection = 0;
+  if (!::VirtualProtect(first_bytes, sizeof(*first_bytes),
+                        PAGE_EXECUTE_READWRITE, &old_page_protection)) {
+    LOG(ERROR) << "Could not grant write privileges to page. Error code: "
+               << ::common::LogWe();
+    return false;
+  }
+
+  // Another thread may have removed the probe since it was checked above, in
+  // which case this leaves the jump it wrote as is.
+  uint16_t expected = kPushImm32Opcode | (probe[1] << 8);
+  ::InterlockedCompareExchange16(reinterpret_cast<SHORT*>(first_bytes),
+                                 kJumpOverProbe, expected);
+
+  DWORD dummy_protection = 0;
+  if (!::VirtualProtect(first_bytes, sizeof(*first_bytes),
+                        old_page_protection, &dummy_protection)) {
+    // This is not an error of the probe removal, which already happened.
+    LOG(ERROR) << "Could not reset old privileges to page. Error code: "
+               << ::common::LogWe();
+  }
+  ::FlushInstructionCache(::GetCurrentProcess(), probe, kProbeSize);
+
+  return true;
+}
+
 bool Coverage::InitializeCoverageData(void* module_base,
                                       IndexedFrequencyData* coverage_data) {
   DCHECK(coverage_data != NULL);
@@ -26,6 +26,7 @@
 #include <vector>
 
 #include "base/lazy_instance.h"
+#include "base/synchronization/lock.h"
 #include "base/win/pe_image.h"
 #include "syzygy/agent/common/entry_frame.h"
 #include "syzygy/common/indexed_frequency_data.h"
@@ -34,6 +35,10 @@
 // Instrumentation stubs to handle the loading of the library.
 extern "C" void _cdecl _indirect_penter_dllmain();
 
+// The self-removing probe of a basic block, which records its coverage then
+// patches its own call site out.
+extern "C" void _cdecl _coverage_probe();
+
 namespace agent {
 namespace coverage {
 
@@ -51,6 +56,19 @@ class Coverage {
   // here.
   static void WINAPI EntryHook(EntryHookFrame* entry_frame);
 
+  // This is overlaid on the stack frame of _coverage_probe. The call site
+  // pushes the index of the basic block, then the coverage data.
+  struct ProbeFrame {
+    const uint8_t* ret_addr;
+    common::IndexedFrequencyData* coverage_data;
+    uint32_t basic_block_id;
+  };
+
+  // The probes of the basic blocks are redirected here. This marks the basic
+  // block as visited, then patches the probe so that it's jumped over on later
+  // visits.
+  static void WINAPI ProbeHook(ProbeFrame* probe_frame);
+
   // Retrieves the coverage singleton instance.
   static Coverage* Instance();
 
@@ -65,6 +83,13 @@ class Coverage {
   bool InitializeCoverageData(void* module_base,
                               ::common::IndexedFrequencyData* coverage_data);
 
+  // Patches the probe returning to @p ret_addr into a jump over itself.
+  // @param ret_addr the return address of the call to the probe.
+  // @param basic_block_id the basic block index pushed by the probe.
+  // @returns true on success, false if the call site is not a probe, is not
+  //     aligned so it can be patched atomically, or could not be written to.
+  bool RemoveProbe(const uint8_t* ret_addr, uint32_t basic_block_id);
+
   // The RPC session we're logging to/through.
   trace::client::RpcSession session_;
 
@@ -72,6 +97,11 @@ class Coverage {
   // goes to specially allocated segments that we don't explicitly keep track
   // of, but rather that we let live until the client gets torn down.
   trace::client::TraceFileSegment segment_;
+
+  // Serializes the changes to the protection of the code pages done when
+  // removing probes, so that a probe is never removed from a page whose
+  // protection another thread is restoring.
+  base::Lock probe_lock_;
 };
 
 }  // namespace coverage
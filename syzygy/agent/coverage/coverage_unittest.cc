@@ -141,6 +141,9 @@ class CoverageClientTest : public testing::Test {
     _indirect_penter_dllmain_ =
         ::GetProcAddress(module_, "_indirect_penter_dllmain");
     ASSERT_TRUE(_indirect_penter_dllmain_ != NULL);
+
+    coverage_probe_ = ::GetProcAddress(module_, "_coverage_probe");
+    ASSERT_TRUE(coverage_probe_ != NULL);
   }
 
   void UnloadDll() {
@@ -148,6 +151,7 @@ class CoverageClientTest : public testing::Test {
       ASSERT_TRUE(::FreeLibrary(module_));
       module_ = NULL;
       _indirect_penter_dllmain_ = NULL;
+      coverage_probe_ = NULL;
     }
   }
 
@@ -168,12 +172,16 @@ class CoverageClientTest : public testing::Test {
   // Our call trace service process instance.
   testing::CallTraceService service_;
 
+  // The self-removing probe exported by the agent.
+  static FARPROC coverage_probe_;
+
  private:
   HMODULE module_;
   static FARPROC _indirect_penter_dllmain_;
 };
 
 FARPROC CoverageClientTest::_indirect_penter_dllmain_ = NULL;
+FARPROC CoverageClientTest::coverage_probe_ = NULL;
 
 BOOL WINAPI CoverageClientTest::IndirectDllMain(HMODULE module,
                                                 DWORD reason,
@@ -261,5 +269,88 @@ TEST_F(CoverageClientTest, VisitOneBB) {
   ASSERT_NO_FATAL_FAILURE(ReplayLogs(1));
 }
 
+TEST_F(CoverageClientTest, ProbeRemovesItself) {
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+  EXPECT_TRUE(DllMainThunk(::GetModuleHandle(NULL), DLL_PROCESS_ATTACH, NULL));
+
+  // Assemble the call site of a probe, as instrumented, followed by a return.
+  //    push 1
+  //    push offset coverage_data
+  //    call [coverage_probe_]
+  //    ret
+  uint8_t* code = static_cast<uint8_t*>(::VirtualAlloc(
+      NULL, 4096, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE));
+  ASSERT_TRUE(code != NULL);
+  const uint32_t kBasicBlockId = 1;
+  code[0] = 0x68;
+  *reinterpret_cast<uint32_t*>(code + 1) = kBasicBlockId;
+  code[5] = 0x68;
+  *reinterpret_cast<IndexedFrequencyData**>(code + 6) = &coverage_data;
+  code[10] = 0xFF;
+  code[11] = 0x15;
+  *reinterpret_cast<FARPROC**>(code + 12) = &coverage_probe_;
+  code[16] = 0xC3;
+  typedef void (*ProbeSiteFunc)();
+  ProbeSiteFunc probe_site = reinterpret_cast<ProbeSiteFunc>(code);
+
+  // The first visit marks the basic block, and jumps the probe over.
+  probe_site();
+  EXPECT_EQ(0U, bb_seen_array[0]);
+  EXPECT_EQ(1U, bb_seen_array[kBasicBlockId]);
+  EXPECT_EQ(0xEB, code[0]);
+  EXPECT_EQ(14, code[1]);
+
+  // The later visits don't go through the probe anymore.
+  bb_seen_array[kBasicBlockId] = 0;
+  probe_site();
+  EXPECT_EQ(0U, bb_seen_array[kBasicBlockId]);
+
+  EXPECT_TRUE(::VirtualFree(code, 0, MEM_RELEASE));
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+}
+
+TEST_F(CoverageClientTest, MisalignedProbeStaysInPlace) {
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+  EXPECT_TRUE(DllMainThunk(::GetModuleHandle(NULL), DLL_PROCESS_ATTACH, NULL));
+
+  // Assemble the call site of a probe at an odd address, which can't be
+  // patched atomically.
+  //    nop
+  //    push 1
+  //    push offset coverage_data
+  //    call [coverage_probe_]
+  //    ret
+  uint8_t* code = static_cast<uint8_t*>(::VirtualAlloc(
+      NULL, 4096, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE));
+  ASSERT_TRUE(code != NULL);
+  const uint32_t kBasicBlockId = 1;
+  code[0] = 0x90;
+  uint8_t* probe = code + 1;
+  probe[0] = 0x68;
+  *reinterpret_cast<uint32_t*>(probe + 1) = kBasicBlockId;
+  probe[5] = 0x68;
+  *reinterpret_cast<IndexedFrequencyData**>(probe + 6) = &coverage_data;
+  probe[10] = 0xFF;
+  probe[11] = 0x15;
+  *reinterpret_cast<FARPROC**>(probe + 12) = &coverage_probe_;
+  probe[16] = 0xC3;
+  typedef void (*ProbeSiteFunc)();
+  ProbeSiteFunc probe_site = reinterpret_cast<ProbeSiteFunc>(code);
+
+  // The visit marks the basic block, but the probe isn't patched.
+  probe_site();
+  EXPECT_EQ(1U, bb_seen_array[kBasicBlockId]);
+  EXPECT_EQ(0x68, probe[0]);
+  EXPECT_EQ(kBasicBlockId, *reinterpret_cast<uint32_t*>(probe + 1));
+
+  // The later visits still go through the probe.
+  bb_seen_array[kBasicBlockId] = 0;
+  probe_site();
+  EXPECT_EQ(1U, bb_seen_array[kBasicBlockId]);
+
+  EXPECT_TRUE(::VirtualFree(code, 0, MEM_RELEASE));
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+}
+
 }  // namespace coverage
 }  // namespace agent
@@ -19,11 +19,83 @@
 namespace agent {
 namespace memprof {
 
+namespace {
+
+// An upper bound on the size of a compactly encoded call: the LEB128 values
+// of its timestamp delta, function ID, stack trace ID and argument count, and
+// those of the sizes of the arguments plus their data.
+const size_t kMaxCompactCallSize =
+    10 + 4 * 5 + 6 * 5 + FunctionCallLogger::kMaxCompactArgumentsSize + 6;
+
+// Appends @p value to @p cursor, LEB128 encoded.
+template <typename ValueType>
+void WriteLeb128(ValueType value, uint8_t** cursor) {
+  do {
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    if (value != 0)
+      byte |= 0x80;
+    *((*cursor)++) = byte;
+  } while (value != 0);
+}
+
+// Encodes a call in the format of TraceCompactFunctionCalls.
+// @param timestamp_delta The delta from the timestamp of the previous call.
+// @param function_id The ID of the function that was called.
+// @param stack_trace_id The ID of the stack trace of the call.
+// @param args_count The number of arguments.
+// @param arg_sizes The sizes of the arguments.
+// @param arg_data The data of the arguments, one after the other.
+// @param last_argument The previous 4-byte argument, which is updated.
+// @param buffer The buffer receiving the encoded call, of at least
+//     kMaxCompactCallSize bytes.
+// @returns the size of the encoded call.
+size_t EncodeCompactCall(uint64_t timestamp_delta,
+                         uint32_t function_id,
+                         uint32_t stack_trace_id,
+                         size_t args_count,
+                         const size_t* arg_sizes,
+                         const uint8_t* arg_data,
+                         uint32_t* last_argument,
+                         uint8_t* buffer) {
+  uint8_t* cursor = buffer;
+  WriteLeb128(timestamp_delta, &cursor);
+  WriteLeb128(function_id, &cursor);
+  WriteLeb128(stack_trace_id, &cursor);
+  WriteLeb128(static_cast<uint32_t>(args_count), &cursor);
+  for (size_t i = 0; i < args_count; ++i)
+    WriteLeb128(static_cast<uint32_t>(arg_sizes[i]), &cursor);
+
+  for (size_t i = 0; i < args_count; ++i) {
+    if (arg_sizes[i] == sizeof(uint32_t)) {
+      // Successive pointers and sizes tend to be close to one another, so the
+      // zigzag encoded delta is usually a lot smaller than the value.
+      uint32_t argument = 0;
+      ::memcpy(&argument, arg_data, sizeof(argument));
+      int32_t delta = static_cast<int32_t>(argument - *last_argument);
+      uint32_t zigzag = (static_cast<uint32_t>(delta) << 1) ^
+                        static_cast<uint32_t>(delta >> 31);
+      WriteLeb128(zigzag, &cursor);
+      *last_argument = argument;
+    } else {
+      ::memcpy(cursor, arg_data, arg_sizes[i]);
+      cursor += arg_sizes[i];
+    }
+    arg_data += arg_sizes[i];
+  }
+
+  DCHECK_LE(static_cast<size_t>(cursor - buffer), kMaxCompactCallSize);
+  return cursor - buffer;
+}
+
+}  // namespace
+
 FunctionCallLogger::FunctionCallLogger(
     trace::client::RpcSession* session)
     : session_(session),
       stack_trace_tracking_(kTrackingNone),
       serialize_timestamps_(false),
+      compact_function_calls_(false),
       call_counter_(0),
       serial_(0) {
   DCHECK_NE(static_cast<trace::client::RpcSession*>(nullptr), session);
@@ -81,11 +153,14 @@ uint32_t FunctionCallLogger::GetStackTraceId(TraceFileSegment* segment) {
     return stack.absolute_stack_id();
 
   // Insert the stack ID. If it already exists it doesn't need to be emitted
-  // so return early.
+  // so return early. Each stack is emitted once per process, by the first
+  // thread to see it.
   bool inserted = false;
   {
-    base::AutoLock lock(lock_);
-    inserted = emitted_stack_ids_.insert(stack.absolute_stack_id()).second;
+    size_t shard = stack.absolute_stack_id() % kEmittedStackIdsSharding;
+    base::AutoLock lock(emitted_stack_ids_locks_[shard]);
+    inserted =
+        emitted_stack_ids_[shard].insert(stack.absolute_stack_id()).second;
   }
   if (!inserted)
     return stack.absolute_stack_id();
@@ -111,5 +186,96 @@ bool FunctionCallLogger::FlushSegment(TraceFileSegment* segment) {
   return session_->ExchangeBuffer(segment);
 }
 
+uint64_t FunctionCallLogger::GetTimestamp() {
+  if (!serialize_timestamps_)
+    return ::trace::common::GetTsc();
+
+  base::AutoLock lock(lock_);
+  return call_counter_++;
+}
+
+FunctionCallLogger::CallBatch* FunctionCallLogger::GetCallBatch() {
+  CallBatch* batch = call_batch_tls_.Get();
+  if (batch != nullptr)
+    return batch;
+
+  batch = new CallBatch();
+  {
+    base::AutoLock lock(lock_);
+    call_batches_.push_back(std::unique_ptr<CallBatch>(batch));
+  }
+  call_batch_tls_.Set(batch);
+  return batch;
+}
+
+void FunctionCallLogger::EmitCompactFunctionCall(TraceFileSegment* segment,
+                                                 uint32_t function_id,
+                                                 uint32_t stack_trace_id,
+                                                 size_t args_count,
+                                                 const size_t* arg_sizes,
+                                                 const uint8_t* arg_data) {
+  DCHECK_NE(static_cast<TraceFileSegment*>(nullptr), segment);
+  uint64_t timestamp = GetTimestamp();
+  CallBatch* batch = GetCallBatch();
+  DCHECK_NE(static_cast<CallBatch*>(nullptr), batch);
+
+  uint8_t call[kMaxCompactCallSize];
+
+  // Append the call to the batch if nothing was written to the segment since
+  // the last call of the batch, and the call fits. The prefix is checked too,
+  // as the buffer of the segment may have been exchanged for one that reuses
+  // the same memory.
+  if (batch->record != nullptr && batch->segment_header == segment->header &&
+      segment->write_ptr ==
+          batch->record->call_data + batch->record->call_data_size &&
+      trace::client::GetRecordPrefix(batch->record)->type ==
+          TRACE_COMPACT_FUNCTION_CALLS) {
+    uint32_t last_argument = batch->last_argument;
+    size_t call_size = EncodeCompactCall(
+        timestamp - batch->last_timestamp, function_id, stack_trace_id,
+        args_count, arg_sizes, arg_data, &last_argument, call);
+    if (segment->CanAllocateRaw(call_size)) {
+      ::memcpy(segment->write_ptr, call, call_size);
+      segment->write_ptr += call_size;
+      segment->header->segment_length += call_size;
+      trace::client::GetRecordPrefix(batch->record)->size += call_size;
+      batch->record->call_data_size += call_size;
+      ++batch->record->num_calls;
+      batch->last_timestamp = timestamp;
+      batch->last_argument = last_argument;
+      return;
+    }
+  }
+
+  // Otherwise, start a new batch with the call.
+  batch->record = nullptr;
+  uint32_t last_argument = 0;
+  size_t call_size = EncodeCompactCall(0, function_id, stack_trace_id,
+                                       args_count, arg_sizes, arg_data,
+                                       &last_argument, call);
+  size_t data_size =
+      FIELD_OFFSET(TraceCompactFunctionCalls, call_data) + call_size;
+  if (!segment->CanAllocate(data_size) && !FlushSegment(segment))
+    return;
+  DCHECK(segment->CanAllocate(data_size));
+
+  // The record is allocated with no slack after the call, so that the next
+  // calls can be appended right after it.
+  TraceCompactFunctionCalls* data =
+      reinterpret_cast<TraceCompactFunctionCalls*>(
+          segment->AllocateTraceRecordImpl(TRACE_COMPACT_FUNCTION_CALLS,
+                                           data_size));
+  DCHECK_NE(static_cast<TraceCompactFunctionCalls*>(nullptr), data);
+  data->base_timestamp = timestamp;
+  data->num_calls = 1;
+  data->call_data_size = call_size;
+  ::memcpy(data->call_data, call, call_size);
+
+  batch->segment_header = segment->header;
+  batch->record = data;
+  batch->last_timestamp = timestamp;
+  batch->last_argument = last_argument;
+}
+
 }  // namespace memprof
 }  // namespace agent
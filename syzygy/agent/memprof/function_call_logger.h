@@ -18,8 +18,11 @@
 #ifndef SYZYGY_AGENT_MEMPROF_FUNCTION_CALL_LOGGER_H_
 #define SYZYGY_AGENT_MEMPROF_FUNCTION_CALL_LOGGER_H_
 
-#include <set>
+#include <memory>
+#include <unordered_set>
+#include <vector>
 
+#include "base/threading/thread_local.h"
 #include "syzygy/agent/memprof/parameters.h"
 #include "syzygy/trace/client/rpc_session.h"
 
@@ -90,22 +93,71 @@ class FunctionCallLogger {
   void set_serialize_timestamps(bool serialize_timestamps) {
     serialize_timestamps_ = serialize_timestamps;
   }
+  bool compact_function_calls() const {
+    return compact_function_calls_;
+  }
+  void set_compact_function_calls(bool compact_function_calls) {
+    compact_function_calls_ = compact_function_calls;
+  }
   // @}
 
+  // The largest argument data that is emitted in the compact encoding. The
+  // calls with more argument data get a TraceDetailedFunctionCall record.
+  static const size_t kMaxCompactArgumentsSize = 64;
+
   // @returns a unique serial number for this function call logger.
   // @note This is for unittesting purposes.
   uint32_t serial() const { return serial_; }
 
  protected:
+  // The batch of compact function calls that a thread is appending to.
+  struct CallBatch {
+    // The segment and record of the batch, or nullptr if there is none. The
+    // batch can only be appended to as long as it is the last record of the
+    // active segment of the thread.
+    TraceFileSegmentHeader* segment_header;
+    TraceCompactFunctionCalls* record;
+
+    // The timestamp and 4-byte argument of the last call of the batch, which
+    // the next call is encoded relative to.
+    uint64_t last_timestamp;
+    uint32_t last_argument;
+  };
+
   // Flushes the provided segment, and gets a new one.
   bool FlushSegment(TraceFileSegment* segment);
 
+  // @returns the timestamp of a function call being emitted.
+  uint64_t GetTimestamp();
+
+  // @returns the call batch of the current thread.
+  CallBatch* GetCallBatch();
+
+  // Emits a detailed function call in the compact encoding, appending it to
+  // the batch of the current thread.
+  // @param segment The segment to write to.
+  // @param function_id The ID of the function that was called.
+  // @param stack_trace_id The ID of the stack trace where the function was
+  //     called.
+  // @param args_count The number of arguments.
+  // @param arg_sizes The sizes of the arguments.
+  // @param arg_data The data of the arguments, one after the other.
+  void EmitCompactFunctionCall(TraceFileSegment* segment,
+                               uint32_t function_id,
+                               uint32_t stack_trace_id,
+                               size_t args_count,
+                               const size_t* arg_sizes,
+                               const uint8_t* arg_data);
+
   // The stack-trace tracking mode. Default to kTrackingNone.
   StackTraceTracking stack_trace_tracking_;
 
   // Whether or not timestamps are being serialized.
   bool serialize_timestamps_;
 
+  // Whether or not function calls are emitted in the compact encoding.
+  bool compact_function_calls_;
+
   // The RPC session events are being written to.
   trace::client::RpcSession* session_;
 
@@ -121,10 +173,22 @@ class FunctionCallLogger {
   typedef std::map<std::string, uint32_t> FunctionIdMap;
   FunctionIdMap function_id_map_;  // Under lock_.
 
-  // A set of stack traces whose IDs have already been emitted. This is only
-  // maintained if stack_trace_tracking_ is set to 'kTrackingEmit'.
-  typedef std::set<uint32_t> StackIdSet;
-  StackIdSet emitted_stack_ids_;  // Under lock_.
+  // The number of shards of the set of emitted stack IDs. Threads emitting
+  // calls with different stack traces seldom contend on the same shard.
+  static const size_t kEmittedStackIdsSharding = 16;
+
+  // The sets of stack traces whose IDs have already been emitted by any
+  // thread of the process, sharded by stack ID. These are only maintained if
+  // stack_trace_tracking_ is set to 'kTrackingEmit'.
+  typedef std::unordered_set<uint32_t> StackIdSet;
+  base::Lock emitted_stack_ids_locks_[kEmittedStackIdsSharding];
+  // Under emitted_stack_ids_locks_.
+  StackIdSet emitted_stack_ids_[kEmittedStackIdsSharding];
+
+  // The call batches of the threads. They are only accessed by their thread,
+  // through call_batch_tls_, and are owned by call_batches_.
+  base::ThreadLocalPointer<CallBatch> call_batch_tls_;
+  std::vector<std::unique_ptr<CallBatch>> call_batches_;  // Under lock_.
 
   // A unique serial number generated at construction time. For unittesting.
   uint32_t serial_;
@@ -204,6 +268,43 @@ void FunctionCallLogger::EmitDetailedFunctionCall(TraceFileSegment* segment,
   args_count += arg_size5 > 0 ? 1 : 0;
   args_size += arg_size5;
 
+  if (compact_function_calls_ && args_size <= kMaxCompactArgumentsSize) {
+    // Gather the sizes and data of the actual arguments, for them to be
+    // encoded.
+    size_t arg_sizes[6] = {};
+    size_t* arg_size = arg_sizes;
+    if (arg_size0 > 0)
+      *(arg_size++) = arg_size0;
+    if (arg_size1 > 0)
+      *(arg_size++) = arg_size1;
+    if (arg_size2 > 0)
+      *(arg_size++) = arg_size2;
+    if (arg_size3 > 0)
+      *(arg_size++) = arg_size3;
+    if (arg_size4 > 0)
+      *(arg_size++) = arg_size4;
+    if (arg_size5 > 0)
+      *(arg_size++) = arg_size5;
+
+    uint8_t arg_data[kMaxCompactArgumentsSize];
+    uint8_t* arg_cursor = arg_data;
+    ArgumentSerializer<ArgType0>().serialize(arg0, arg_cursor);
+    arg_cursor += arg_size0;
+    ArgumentSerializer<ArgType1>().serialize(arg1, arg_cursor);
+    arg_cursor += arg_size1;
+    ArgumentSerializer<ArgType2>().serialize(arg2, arg_cursor);
+    arg_cursor += arg_size2;
+    ArgumentSerializer<ArgType3>().serialize(arg3, arg_cursor);
+    arg_cursor += arg_size3;
+    ArgumentSerializer<ArgType4>().serialize(arg4, arg_cursor);
+    arg_cursor += arg_size4;
+    ArgumentSerializer<ArgType5>().serialize(arg5, arg_cursor);
+
+    EmitCompactFunctionCall(segment, function_id, stack_trace_id, args_count,
+                            arg_sizes, arg_data);
+    return;
+  }
+
   if (args_size > 0)
     args_size += (args_count + 1) * sizeof(uint32_t);
   size_t data_size = FIELD_OFFSET(TraceDetailedFunctionCall, argument_data) +
@@ -218,14 +319,7 @@ void FunctionCallLogger::EmitDetailedFunctionCall(TraceFileSegment* segment,
   data->function_id = function_id;
   data->stack_trace_id = stack_trace_id;
   data->argument_data_size = args_size;
-
-  if (serialize_timestamps_) {
-    base::AutoLock lock(lock_);
-    data->timestamp = call_counter_;
-    ++call_counter_;
-  } else {
-    data->timestamp = ::trace::common::GetTsc();
-  }
+  data->timestamp = GetTimestamp();
 
   if (args_size == 0)
     return;
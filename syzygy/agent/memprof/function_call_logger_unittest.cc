@@ -110,8 +110,17 @@ class TestFunctionCallLogger : public FunctionCallLogger {
   }
 
   using FunctionCallLogger::function_id_map_;
+  using FunctionCallLogger::kEmittedStackIdsSharding;
   using FunctionCallLogger::emitted_stack_ids_;
 
+  // @returns the number of stack IDs emitted, over all the shards.
+  size_t emitted_stack_id_count() {
+    size_t count = 0;
+    for (size_t i = 0; i < kEmittedStackIdsSharding; ++i)
+      count += emitted_stack_ids_[i].size();
+    return count;
+  }
+
   // The session and segment that are passed to the function call logger.
   TestRpcSession test_session_;
   TraceFileSegment test_segment_;
@@ -173,22 +182,26 @@ TEST(FunctionCallLoggerTest, TraceFunctionNameTableEntry) {
 
 TEST(FunctionCallLoggerTest, TraceStackTrace) {
   TestFunctionCallLogger fcl;
-  EXPECT_EQ(0u, fcl.emitted_stack_ids_.size());
+  EXPECT_EQ(0u, fcl.emitted_stack_id_count());
 
   fcl.set_stack_trace_tracking(kTrackingNone);
   EXPECT_EQ(0u, fcl.GetStackTraceId(&fcl.test_segment_));
-  EXPECT_EQ(0u, fcl.emitted_stack_ids_.size());
+  EXPECT_EQ(0u, fcl.emitted_stack_id_count());
   EXPECT_EQ(0u, fcl.allocation_infos.size());
 
   fcl.set_stack_trace_tracking(kTrackingTrack);
   EXPECT_NE(0u, fcl.GetStackTraceId(&fcl.test_segment_));
-  EXPECT_EQ(0u, fcl.emitted_stack_ids_.size());
+  EXPECT_EQ(0u, fcl.emitted_stack_id_count());
   EXPECT_EQ(0u, fcl.allocation_infos.size());
 
   fcl.set_stack_trace_tracking(kTrackingEmit);
   uint32_t stack_trace_id = fcl.GetStackTraceId(&fcl.test_segment_);
   EXPECT_NE(0u, stack_trace_id);
-  EXPECT_THAT(fcl.emitted_stack_ids_, testing::ElementsAre(stack_trace_id));
+  EXPECT_EQ(1u, fcl.emitted_stack_id_count());
+  size_t shard =
+      stack_trace_id % TestFunctionCallLogger::kEmittedStackIdsSharding;
+  EXPECT_THAT(fcl.emitted_stack_ids_[shard],
+              testing::Contains(stack_trace_id));
   EXPECT_EQ(1u, fcl.allocation_infos.size());
   const auto& info = fcl.allocation_infos[0];
   EXPECT_EQ(TraceStackTrace::kTypeId, info.record_type);
@@ -316,5 +329,52 @@ TEST(FunctionCallLoggerTest, TraceDetailedFunctionCallSerializeTimestamps) {
   }
 }
 
+TEST(FunctionCallLoggerTest, TraceCompactFunctionCalls) {
+  TestFunctionCallLogger fcl;
+  fcl.set_stack_trace_tracking(kTrackingNone);
+  fcl.set_serialize_timestamps(true);
+  fcl.set_compact_function_calls(true);
+
+  for (size_t i = 0; i < 3; ++i)
+    TestEmitDetailedFunctionCall(&fcl);
+  EXPECT_EQ(1u, fcl.function_id_map_.size());
+  // 1 name, and a single batch holding the 3 calls.
+  ASSERT_EQ(2u, fcl.allocation_infos.size());
+
+  const auto& info = fcl.allocation_infos[1];
+  EXPECT_EQ(TraceCompactFunctionCalls::kTypeId, info.record_type);
+  ASSERT_NE(nullptr, info.record);
+  TraceCompactFunctionCalls* data =
+      reinterpret_cast<TraceCompactFunctionCalls*>(info.record);
+  EXPECT_EQ(0u, data->base_timestamp);
+  EXPECT_EQ(3u, data->num_calls);
+
+  // The batch was grown in place, and is the last record of the segment.
+  EXPECT_EQ(fcl.test_segment_.write_ptr,
+            data->call_data + data->call_data_size);
+
+  // The first call holds its argument as a delta from 0, the following ones
+  // hold the same argument as a delta of 0.
+  const uint8_t kExpectedFirstCall[] = {
+      0x00,  // Timestamp delta...
+      0x00,  // ...function ID...
+      0x00,  // ...stack trace ID...
+      0x01,  // ...1 argument...
+      0x04,  // ...of size 4...
+  };
+  const uint8_t kExpectedNextCalls[] = {
+      0x01, 0x00, 0x00, 0x01, 0x04, 0x00,
+      0x01, 0x00, 0x00, 0x01, 0x04, 0x00,
+  };
+  ASSERT_LT(arraysize(kExpectedFirstCall) + arraysize(kExpectedNextCalls),
+            data->call_data_size);
+  EXPECT_EQ(0u, ::memcmp(kExpectedFirstCall, data->call_data,
+                         arraysize(kExpectedFirstCall)));
+  EXPECT_EQ(0u, ::memcmp(kExpectedNextCalls,
+                         data->call_data + data->call_data_size -
+                             arraysize(kExpectedNextCalls),
+                         arraysize(kExpectedNextCalls)));
+}
+
 }  // namespace memprof
 }  // namespace agent
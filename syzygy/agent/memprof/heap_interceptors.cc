@@ -54,6 +54,46 @@ struct ConditionalScopedLock {
 };
 base::Lock ConditionalScopedLock::conditional_lock_;
 
+namespace {
+
+// @returns the heap sampler of the memory profiler.
+agent::memprof::HeapSampler& GetHeapSampler() {
+  DCHECK_NE(static_cast<agent::memprof::MemoryProfiler*>(nullptr),
+            agent::memprof::memory_profiler.get());
+  return agent::memprof::memory_profiler->heap_sampler();
+}
+
+// Determines if an allocation is logged. When sampling, only the sampled
+// allocations are, and their blocks are tracked.
+// @param heap The heap that was allocated from.
+// @param bytes The size of the allocation.
+// @param block The allocated block, or nullptr if the allocation failed.
+// @returns true if the allocation is to be logged.
+bool LogAllocation(HANDLE heap, SIZE_T bytes, const void* block) {
+  agent::memprof::HeapSampler& sampler = GetHeapSampler();
+  if (!sampler.enabled())
+    return true;
+  if (block == nullptr)
+    return false;
+
+  agent::memprof::MemoryProfiler::ThreadState* thread_state =
+      agent::memprof::memory_profiler->GetOrAllocateThreadState();
+  if (!sampler.SampleAllocation(bytes, thread_state->bytes_until_sample()))
+    return false;
+  sampler.AddSampledBlock(heap, block);
+  return true;
+}
+
+// @returns true if a call on @p block is to be logged. When sampling, only
+//     the calls on sampled blocks are, along with those on whole heaps.
+bool LogBlockCall(const void* block) {
+  agent::memprof::HeapSampler& sampler = GetHeapSampler();
+  return !sampler.enabled() || block == nullptr ||
+         sampler.IsSampledBlock(block);
+}
+
+}  // namespace
+
 extern "C" {
 
 HANDLE WINAPI asan_GetProcessHeap() {
@@ -78,6 +118,8 @@ BOOL WINAPI asan_HeapDestroy(HANDLE heap) {
   // is enabled.
   ConditionalScopedLock conditional_scoped_lock;
   BOOL ret = ::HeapDestroy(heap);
+  if (ret && GetHeapSampler().enabled())
+    GetHeapSampler().RemoveSampledHeap(heap);
   EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, ret);
   return ret;
 }
@@ -89,7 +131,9 @@ LPVOID WINAPI asan_HeapAlloc(HANDLE heap,
   // is enabled.
   ConditionalScopedLock conditional_scoped_lock;
   LPVOID ret = ::HeapAlloc(heap, flags, bytes);
-  EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, bytes, ret);
+  if (LogAllocation(heap, bytes, ret)) {
+    EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, bytes, ret);
+  }
   return ret;
 }
 
@@ -100,17 +144,36 @@ LPVOID WINAPI asan_HeapReAlloc(HANDLE heap,
   // This ensures that all heap access is synchronous if 'serialize_timestamps'
   // is enabled.
   ConditionalScopedLock conditional_scoped_lock;
+
+  // When sampling, a reallocation is logged if the original block was
+  // sampled, so that the grinder can follow it, or if the new one is.
+  agent::memprof::HeapSampler& sampler = GetHeapSampler();
+  bool was_sampled = sampler.enabled() && sampler.RemoveSampledBlock(mem);
   LPVOID ret = ::HeapReAlloc(heap, flags, mem, bytes);
-  EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, bytes, ret);
+  bool log = true;
+  if (was_sampled) {
+    sampler.AddSampledBlock(heap, ret != nullptr ? ret : mem);
+  } else {
+    log = LogAllocation(heap, bytes, ret);
+  }
+  if (log) {
+    EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, bytes, ret);
+  }
   return ret;
 }
 
 BOOL WINAPI asan_HeapFree(HANDLE heap,
                           DWORD flags,
                           LPVOID mem) {
+  // When sampling, only the frees of sampled blocks are logged. The block
+  // stops being tracked before it is freed, as its address can be reused as
+  // soon as it is.
+  agent::memprof::HeapSampler& sampler = GetHeapSampler();
+  bool log = !sampler.enabled() || sampler.RemoveSampledBlock(mem);
+
   // Calculate a hash value of the contents if necessary.
   uint32_t hash = 0;
-  if (mem != nullptr &&
+  if (log && mem != nullptr &&
       agent::memprof::memory_profiler->parameters().hash_contents_at_free) {
     size_t size = ::HeapSize(heap, 0, mem);
     hash = base::SuperFastHash(reinterpret_cast<const char*>(mem), size);
@@ -120,7 +183,9 @@ BOOL WINAPI asan_HeapFree(HANDLE heap,
   // is enabled.
   ConditionalScopedLock conditional_scoped_lock;
   BOOL ret = ::HeapFree(heap, flags, mem);
-  EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, ret, hash);
+  if (log) {
+    EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, ret, hash);
+  }
   return ret;
 }
 
@@ -131,7 +196,9 @@ SIZE_T WINAPI asan_HeapSize(HANDLE heap,
   // is enabled.
   ConditionalScopedLock conditional_scoped_lock;
   SIZE_T ret = ::HeapSize(heap, flags, mem);
-  EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, ret);
+  if (LogBlockCall(mem)) {
+    EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, ret);
+  }
   return ret;
 }
 
@@ -142,7 +209,9 @@ BOOL WINAPI asan_HeapValidate(HANDLE heap,
   // is enabled.
   ConditionalScopedLock conditional_scoped_lock;
   BOOL ret = ::HeapValidate(heap, flags, mem);
-  EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, ret);
+  if (LogBlockCall(mem)) {
+    EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, ret);
+  }
   return ret;
 }
 
@@ -0,0 +1,98 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/memprof/heap_sampler.h"
+
+#include <math.h>
+
+#include "base/logging.h"
+#include "base/rand_util.h"
+
+namespace agent {
+namespace memprof {
+
+HeapSampler::HeapSampler() : sampling_interval_(0) {
+}
+
+int64_t HeapSampler::NextSampleDistance() const {
+  if (sampling_interval_ == 0)
+    return 0;
+
+  // RandDouble returns a value in [0, 1), so the logarithm is finite.
+  double distance = -::log(1.0 - base::RandDouble()) * sampling_interval_;
+  if (distance < 1.0)
+    return 1;
+  return static_cast<int64_t>(distance);
+}
+
+bool HeapSampler::SampleAllocation(size_t bytes,
+                                   int64_t* bytes_until_sample) const {
+  DCHECK_NE(static_cast<int64_t*>(nullptr), bytes_until_sample);
+
+  *bytes_until_sample -= bytes;
+  if (*bytes_until_sample > 0)
+    return false;
+
+  // The process is memoryless, so the distance to the next sample starts
+  // over after the sampled allocation, however many bytes it overshot by.
+  *bytes_until_sample = NextSampleDistance();
+  return true;
+}
+
+void HeapSampler::AddSampledBlock(HANDLE heap, const void* block) {
+  DCHECK_NE(static_cast<const void*>(nullptr), block);
+  size_t shard = GetShard(block);
+  base::AutoLock lock(sampled_blocks_locks_[shard]);
+  sampled_blocks_[shard][block] = heap;
+}
+
+bool HeapSampler::RemoveSampledBlock(const void* block) {
+  if (block == nullptr)
+    return false;
+  size_t shard = GetShard(block);
+  base::AutoLock lock(sampled_blocks_locks_[shard]);
+  return sampled_blocks_[shard].erase(block) == 1;
+}
+
+bool HeapSampler::IsSampledBlock(const void* block) {
+  if (block == nullptr)
+    return false;
+  size_t shard = GetShard(block);
+  base::AutoLock lock(sampled_blocks_locks_[shard]);
+  return sampled_blocks_[shard].find(block) != sampled_blocks_[shard].end();
+}
+
+void HeapSampler::RemoveSampledHeap(HANDLE heap) {
+  // This is rare enough that going through all the blocks is fine.
+  for (size_t i = 0; i < kSampledBlocksSharding; ++i) {
+    base::AutoLock lock(sampled_blocks_locks_[i]);
+    auto it = sampled_blocks_[i].begin();
+    while (it != sampled_blocks_[i].end()) {
+      if (it->second == heap)
+        it = sampled_blocks_[i].erase(it);
+      else
+        ++it;
+    }
+  }
+}
+
+// static
+size_t HeapSampler::GetShard(const void* block) {
+  // Heap blocks are at least 8-byte aligned, so the low bits carry no
+  // information.
+  return (reinterpret_cast<uintptr_t>(block) >> 3) % kSampledBlocksSharding;
+}
+
+}  // namespace memprof
+}  // namespace agent
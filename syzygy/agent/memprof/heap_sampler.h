@@ -0,0 +1,104 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the heap sampler, which lets the memory profiler log a sample of
+// the heap allocations rather than all of them.
+
+#ifndef SYZYGY_AGENT_MEMPROF_HEAP_SAMPLER_H_
+#define SYZYGY_AGENT_MEMPROF_HEAP_SAMPLER_H_
+
+#include <windows.h>
+
+#include <unordered_map>
+
+#include "base/macros.h"
+#include "base/synchronization/lock.h"
+
+namespace agent {
+namespace memprof {
+
+// Samples heap allocations as a Poisson process over the allocated bytes:
+// each byte is sampled independently, with a probability of
+// 1 / sampling_interval, and an allocation is sampled if any of its bytes
+// is. An allocation of S bytes is thus sampled with a probability of
+// 1 - exp(-S / sampling_interval), which the grinder uses to estimate the
+// actual allocations from the sampled ones.
+//
+// The distance to the next sampled byte is kept per thread by the caller,
+// so that allocations only touch shared state when they are sampled. The
+// sampled blocks are tracked so that only the calls on them are logged.
+class HeapSampler {
+ public:
+  HeapSampler();
+
+  // @name Accessors.
+  // @{
+  size_t sampling_interval() const { return sampling_interval_; }
+  void set_sampling_interval(size_t sampling_interval) {
+    sampling_interval_ = sampling_interval;
+  }
+  // @}
+
+  // @returns true if the heap allocations are sampled, false if they are all
+  //     logged.
+  bool enabled() const { return sampling_interval_ != 0; }
+
+  // @returns a random distance to the next sampled byte, from an exponential
+  //     distribution with a mean of sampling_interval() bytes.
+  int64_t NextSampleDistance() const;
+
+  // Determines if an allocation is sampled.
+  // @param bytes The size of the allocation.
+  // @param bytes_until_sample The distance to the next sampled byte of the
+  //     calling thread, which is updated.
+  // @returns true if the allocation is sampled.
+  bool SampleAllocation(size_t bytes, int64_t* bytes_until_sample) const;
+
+  // @name Tracking of the sampled blocks.
+  // @{
+  // Tracks a sampled @p block of @p heap.
+  void AddSampledBlock(HANDLE heap, const void* block);
+  // Stops tracking @p block.
+  // @returns true if @p block was sampled.
+  bool RemoveSampledBlock(const void* block);
+  // @returns true if @p block is sampled.
+  bool IsSampledBlock(const void* block);
+  // Stops tracking the blocks of @p heap, which is being destroyed.
+  void RemoveSampledHeap(HANDLE heap);
+  // @}
+
+ protected:
+  // The number of shards of the set of sampled blocks.
+  static const size_t kSampledBlocksSharding = 16;
+
+  // @returns the shard that @p block belongs to.
+  static size_t GetShard(const void* block);
+
+  // The mean distance between sampled bytes, or 0 to log all allocations.
+  size_t sampling_interval_;
+
+  // The sampled blocks, and the heaps they belong to, sharded by address.
+  typedef std::unordered_map<const void*, HANDLE> SampledBlockMap;
+  base::Lock sampled_blocks_locks_[kSampledBlocksSharding];
+  // Under sampled_blocks_locks_.
+  SampledBlockMap sampled_blocks_[kSampledBlocksSharding];
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(HeapSampler);
+};
+
+}  // namespace memprof
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_MEMPROF_HEAP_SAMPLER_H_
@@ -0,0 +1,99 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/memprof/heap_sampler.h"
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace memprof {
+
+namespace {
+
+void* const kBlock0 = reinterpret_cast<void*>(0x10000);
+void* const kBlock1 = reinterpret_cast<void*>(0x10008);
+const HANDLE kHeap0 = reinterpret_cast<HANDLE>(0x1000);
+const HANDLE kHeap1 = reinterpret_cast<HANDLE>(0x2000);
+
+}  // namespace
+
+TEST(HeapSamplerTest, DisabledByDefault) {
+  HeapSampler sampler;
+  EXPECT_FALSE(sampler.enabled());
+  EXPECT_EQ(0u, sampler.sampling_interval());
+  EXPECT_EQ(0, sampler.NextSampleDistance());
+
+  sampler.set_sampling_interval(1024);
+  EXPECT_TRUE(sampler.enabled());
+  EXPECT_EQ(1024u, sampler.sampling_interval());
+}
+
+TEST(HeapSamplerTest, SampleAllocation) {
+  HeapSampler sampler;
+  sampler.set_sampling_interval(1024);
+
+  int64_t bytes_until_sample = 100;
+  EXPECT_FALSE(sampler.SampleAllocation(60, &bytes_until_sample));
+  EXPECT_EQ(40, bytes_until_sample);
+
+  // The allocation covering the sampled byte is sampled, and the distance to
+  // the next one is drawn anew.
+  EXPECT_TRUE(sampler.SampleAllocation(60, &bytes_until_sample));
+  EXPECT_LT(0, bytes_until_sample);
+}
+
+TEST(HeapSamplerTest, MeanSampleDistance) {
+  const size_t kInterval = 1000;
+  const size_t kSampleCount = 10000;
+  HeapSampler sampler;
+  sampler.set_sampling_interval(kInterval);
+
+  int64_t total = 0;
+  for (size_t i = 0; i < kSampleCount; ++i) {
+    int64_t distance = sampler.NextSampleDistance();
+    EXPECT_LT(0, distance);
+    total += distance;
+  }
+
+  // The standard deviation of the mean is 1% of the interval, so this can
+  // only fail by a wide margin of bad luck.
+  double mean = static_cast<double>(total) / kSampleCount;
+  EXPECT_LT(kInterval * 0.9, mean);
+  EXPECT_GT(kInterval * 1.1, mean);
+}
+
+TEST(HeapSamplerTest, SampledBlocks) {
+  HeapSampler sampler;
+  EXPECT_FALSE(sampler.IsSampledBlock(kBlock0));
+  EXPECT_FALSE(sampler.IsSampledBlock(nullptr));
+  EXPECT_FALSE(sampler.RemoveSampledBlock(nullptr));
+
+  sampler.AddSampledBlock(kHeap0, kBlock0);
+  sampler.AddSampledBlock(kHeap1, kBlock1);
+  EXPECT_TRUE(sampler.IsSampledBlock(kBlock0));
+  EXPECT_TRUE(sampler.IsSampledBlock(kBlock1));
+
+  EXPECT_TRUE(sampler.RemoveSampledBlock(kBlock0));
+  EXPECT_FALSE(sampler.IsSampledBlock(kBlock0));
+  EXPECT_FALSE(sampler.RemoveSampledBlock(kBlock0));
+
+  // Destroying a heap forgets about its blocks.
+  sampler.AddSampledBlock(kHeap0, kBlock0);
+  sampler.RemoveSampledHeap(kHeap1);
+  EXPECT_TRUE(sampler.IsSampledBlock(kBlock0));
+  EXPECT_FALSE(sampler.IsSampledBlock(kBlock1));
+}
+
+}  // namespace memprof
+}  // namespace agent
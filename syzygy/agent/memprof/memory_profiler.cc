@@ -97,6 +97,9 @@ void MemoryProfiler::PropagateParameters() {
       parameters_.stack_trace_tracking);
   function_call_logger_.set_serialize_timestamps(
       parameters_.serialize_timestamps);
+  function_call_logger_.set_compact_function_calls(
+      parameters_.compact_function_calls);
+  heap_sampler_.set_sampling_interval(parameters_.sampling_interval);
 }
 
 MemoryProfiler::ThreadState* MemoryProfiler::GetOrAllocateThreadStateImpl() {
@@ -166,7 +169,8 @@ void MemoryProfiler::OnDllEvent(
 }
 
 MemoryProfiler::ThreadState::ThreadState(MemoryProfiler* parent)
-    : parent_(parent) {
+    : parent_(parent),
+      bytes_until_sample_(parent->heap_sampler_.NextSampleDistance()) {
   DCHECK_NE(static_cast<MemoryProfiler*>(nullptr), parent);
 }
 
@@ -25,6 +25,7 @@
 #include "syzygy/agent/common/dll_notifications.h"
 #include "syzygy/agent/common/thread_state.h"
 #include "syzygy/agent/memprof/function_call_logger.h"
+#include "syzygy/agent/memprof/heap_sampler.h"
 #include "syzygy/agent/memprof/parameters.h"
 #include "syzygy/common/logging.h"
 #include "syzygy/trace/client/rpc_session.h"
@@ -57,6 +58,9 @@ class MemoryProfiler {
   //     allocated.
   ThreadState* GetThreadState();
 
+  // @returns the heap sampler.
+  HeapSampler& heap_sampler() { return heap_sampler_; }
+
   // @returns the current parameters.
   const Parameters& parameters() const { return parameters_; }
 
@@ -97,6 +101,9 @@ class MemoryProfiler {
   // events.
   FunctionCallLogger function_call_logger_;
 
+  // The sampler deciding which heap allocations are logged.
+  HeapSampler heap_sampler_;
+
   // The parameters that we use. These are parsed from the environment.
   Parameters parameters_;
 
@@ -131,6 +138,9 @@ class MemoryProfiler::ThreadState : public agent::common::ThreadStateBase {
     return &segment_;
   }
 
+  // @returns the distance to the next heap byte sampled by this thread.
+  int64_t* bytes_until_sample() { return &bytes_until_sample_; }
+
  protected:
   friend class MemoryProfiler;
 
@@ -140,6 +150,9 @@ class MemoryProfiler::ThreadState : public agent::common::ThreadStateBase {
   // The active trace file segment where events are written.
   trace::client::TraceFileSegment segment_;
 
+  // The distance to the next heap byte sampled by this thread.
+  int64_t bytes_until_sample_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(ThreadState);
 };
@@ -41,6 +41,8 @@
         'heap_interceptors.cc',
         'function_call_logger.cc',
         'function_call_logger.h',
+        'heap_sampler.cc',
+        'heap_sampler.h',
         'memory_interceptors.cc',
         'memory_profiler.cc',
         'memory_profiler.h',
@@ -119,6 +121,7 @@
       'type': 'executable',
       'sources': [
         'function_call_logger_unittest.cc',
+        'heap_sampler_unittest.cc',
         'memprof_unittest.cc',
         'parameters_unittest.cc',
         '<(src)/syzygy/testing/run_all_unittests.cc',
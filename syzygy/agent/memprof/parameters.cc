@@ -17,6 +17,7 @@
 #include "base/command_line.h"
 #include "base/environment.h"
 #include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/utf_string_conversions.h"
 
 namespace agent {
@@ -36,17 +37,23 @@ const char kParametersEnvVar[] = "SYZYGY_MEMPROF_OPTIONS";
 StackTraceTracking kDefaultStackTraceTracking = kTrackingNone;
 bool kDefaultSerializeTimestamps = false;
 bool kDefaultHashContentsAtFree = false;
+bool kDefaultCompactFunctionCalls = false;
+size_t kDefaultSamplingInterval = 0;
 
 // Parameter names for parsing.
 const char kParamStackTraceTracking[] = "stack-trace-tracking";
 const char kParamSerializeTimestamps[] = "serialize-timestamps";
 const char kParamHashContentsAtFree[] = "hash-contents-at-free";
+const char kParamCompactFunctionCalls[] = "compact-function-calls";
+const char kParamSamplingInterval[] = "sampling-interval";
 
 void SetDefaultParameters(Parameters* parameters) {
   DCHECK_NE(static_cast<Parameters*>(nullptr), parameters);
   parameters->stack_trace_tracking = kDefaultStackTraceTracking;
   parameters->serialize_timestamps = false;
   parameters->hash_contents_at_free = false;
+  parameters->compact_function_calls = false;
+  parameters->sampling_interval = kDefaultSamplingInterval;
 }
 
 bool ParseParameters(const base::StringPiece& param_string,
@@ -86,6 +93,21 @@ bool ParseParameters(const base::StringPiece& param_string,
   if (cmd_line.HasSwitch(kParamHashContentsAtFree))
     parameters->hash_contents_at_free = true;
 
+  if (cmd_line.HasSwitch(kParamCompactFunctionCalls))
+    parameters->compact_function_calls = true;
+
+  value = cmd_line.GetSwitchValueASCII(kParamSamplingInterval);
+  if (!value.empty()) {
+    size_t sampling_interval = 0;
+    if (base::StringToSizeT(value, &sampling_interval)) {
+      parameters->sampling_interval = sampling_interval;
+    } else {
+      LOG(ERROR) << "Invalid value for --" << kParamSamplingInterval << ": "
+                 << value;
+      success = false;
+    }
+  }
+
   return success;
 }
 
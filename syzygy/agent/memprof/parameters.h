@@ -49,6 +49,13 @@ struct Parameters {
   // the hash value stored as an additional parameter to the heap free
   // function.
   bool hash_contents_at_free;
+  // If this is enabled then the detailed function calls of each thread are
+  // emitted in batches, in a compact encoding.
+  bool compact_function_calls;
+  // If this is non-zero then the heap allocations are sampled, on average
+  // one per this many allocated bytes, and only the calls on the sampled
+  // blocks are logged.
+  size_t sampling_interval;
 };
 
 // The environment variable that is used for extracting parameters.
@@ -61,11 +68,15 @@ extern const char* kStackTraceTrackingValues[];
 extern StackTraceTracking kDefaultStackTraceTracking;
 extern bool kDefaultSerializeTimestamps;
 extern bool kDefaultHashContentsAtFree;
+extern bool kDefaultCompactFunctionCalls;
+extern size_t kDefaultSamplingInterval;
 
 // Parameter names for parsing.
 extern const char kParamStackTraceTracking[];
 extern const char kParamSerializeTimestamps[];
 extern const char kParamHashContentsAtFree[];
+extern const char kParamCompactFunctionCalls[];
+extern const char kParamSamplingInterval[];
 
 // Initializes a Parameters struct with default values.
 // @param parameters The Parameters struct to be initialized.
@@ -26,6 +26,8 @@ TEST(ParametersTest, SetDefaults) {
   EXPECT_EQ(kDefaultStackTraceTracking, p.stack_trace_tracking);
   EXPECT_EQ(kDefaultSerializeTimestamps, p.serialize_timestamps);
   EXPECT_EQ(kDefaultHashContentsAtFree, p.hash_contents_at_free);
+  EXPECT_EQ(kDefaultCompactFunctionCalls, p.compact_function_calls);
+  EXPECT_EQ(kDefaultSamplingInterval, p.sampling_interval);
 }
 
 TEST(ParametersTest, ParseInvalidStackTraceTracking) {
@@ -35,6 +37,13 @@ TEST(ParametersTest, ParseInvalidStackTraceTracking) {
   EXPECT_FALSE(ParseParameters(str, &p));
 }
 
+TEST(ParametersTest, ParseInvalidSamplingInterval) {
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  std::string str("--sampling-interval=foo");
+  EXPECT_FALSE(ParseParameters(str, &p));
+}
+
 TEST(ParametersTest, ParseMinimalCommandLine) {
   Parameters p = {};
   SetDefaultParameters(&p);
@@ -43,6 +52,8 @@ TEST(ParametersTest, ParseMinimalCommandLine) {
   EXPECT_EQ(kDefaultStackTraceTracking, p.stack_trace_tracking);
   EXPECT_EQ(kDefaultSerializeTimestamps, p.serialize_timestamps);
   EXPECT_EQ(kDefaultHashContentsAtFree, p.hash_contents_at_free);
+  EXPECT_EQ(kDefaultCompactFunctionCalls, p.compact_function_calls);
+  EXPECT_EQ(kDefaultSamplingInterval, p.sampling_interval);
 }
 
 TEST(ParametersTest, ParseMaximalCommandLine) {
@@ -50,11 +61,15 @@ TEST(ParametersTest, ParseMaximalCommandLine) {
   SetDefaultParameters(&p);
   std::string str("--stack-trace-tracking=emit "
                   "--serialize-timestamps "
-                  "--hash-contents-at-free");
+                  "--hash-contents-at-free "
+                  "--compact-function-calls "
+                  "--sampling-interval=65536");
   EXPECT_TRUE(ParseParameters(str, &p));
   EXPECT_EQ(kTrackingEmit, p.stack_trace_tracking);
   EXPECT_TRUE(p.serialize_timestamps);
   EXPECT_TRUE(p.hash_contents_at_free);
+  EXPECT_TRUE(p.compact_function_calls);
+  EXPECT_EQ(65536u, p.sampling_interval);
 }
 
 TEST(ParametersTest, ParseNoEnvironment) {
@@ -68,6 +83,8 @@ TEST(ParametersTest, ParseNoEnvironment) {
   EXPECT_EQ(kDefaultStackTraceTracking, p.stack_trace_tracking);
   EXPECT_EQ(kDefaultSerializeTimestamps, p.serialize_timestamps);
   EXPECT_EQ(kDefaultHashContentsAtFree, p.hash_contents_at_free);
+  EXPECT_EQ(kDefaultCompactFunctionCalls, p.compact_function_calls);
+  EXPECT_EQ(kDefaultSamplingInterval, p.sampling_interval);
 }
 
 TEST(ParametersTest, ParseEmptyEnvironment) {
@@ -81,6 +98,8 @@ TEST(ParametersTest, ParseEmptyEnvironment) {
   EXPECT_EQ(kDefaultStackTraceTracking, p.stack_trace_tracking);
   EXPECT_EQ(kDefaultSerializeTimestamps, p.serialize_timestamps);
   EXPECT_EQ(kDefaultHashContentsAtFree, p.hash_contents_at_free);
+  EXPECT_EQ(kDefaultCompactFunctionCalls, p.compact_function_calls);
+  EXPECT_EQ(kDefaultSamplingInterval, p.sampling_interval);
 }
 
 TEST(ParametersTest, ParseInvalidEnvironment) {
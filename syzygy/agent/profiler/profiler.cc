@@ -24,6 +24,7 @@
 #include "base/command_line.h"
 #include "base/environment.h"
 #include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
 #include "base/win/pe_image.h"
@@ -32,7 +33,7 @@
 #include "syzygy/agent/common/dlist.h"
 #include "syzygy/agent/common/process_utils.h"
 #include "syzygy/agent/common/scoped_last_error_keeper.h"
-#include "syzygy/agent/profiler/return_thunk_factory.h"
+#include "syzygy/agent/profiler/shadow_return_stack.h"
 #include "syzygy/common/logging.h"
 #include "syzygy/common/process_utils.h"
 #include "syzygy/trace/client/client_utils.h"
@@ -44,24 +45,42 @@ using agent::common::ScopedLastErrorKeeper;
 
 typedef std::pair<RetAddr, FuncAddr> InvocationKey;
 
-class HashInvocationKey {
- public:
-  static const size_t bucket_size = 4;
-  static const size_t min_buckets = 8;
+using agent::profiler::SymbolMap;
 
-  size_t operator()(const InvocationKey& key) const {
-    return reinterpret_cast<size_t>(key.first) ^
-        reinterpret_cast<size_t>(key.second);
-  }
+// The invocations of each thread are aggregated in a table of
+// 2^kInvocationTableBits entries.
+const size_t kInvocationTableBits = 10;
+const size_t kInvocationTableSize = 1 << kInvocationTableBits;
+
+// The number of entries an invocation is looked up in before the coldest of
+// them is evicted to make room for it.
+const size_t kInvocationTableMaxProbes = 8;
+
+// The aggregated invocations are written to the trace at least this often.
+const DWORD kInvocationFlushIntervalMs = 1000;
+
+// @returns the first entry of the invocation table to probe for @p key.
+size_t HashInvocationKey(const InvocationKey& key) {
+  uint32_t hash = reinterpret_cast<uint32_t>(key.first) ^
+      reinterpret_cast<uint32_t>(key.second);
+  // Mix the bits, as the low bits of code addresses vary little.
+  return (hash * 0x9E3779B1U) >> (32 - kInvocationTableBits);
+}
 
-  bool operator()(const InvocationKey& a, const InvocationKey& b) const {
-    return a < b;
+// An entry of the invocation table of a thread.
+struct InvocationEntry {
+  InvocationEntry() : caller_move_count(0), function_move_count(0),
+                      last_use(0) {
+    ::memset(&info, 0, sizeof(info));
   }
-};
 
-using agent::profiler::SymbolMap;
+  // @returns true if the entry holds invocations.
+  bool in_use() const { return key.second != NULL; }
+
+  // The caller and function of the invocations, or NULLs if the entry is
+  // unused.
+  InvocationKey key;
 
-struct InvocationValue {
   // This invocation entry's caller's dynamic symbol, if any.
   scoped_refptr<SymbolMap::Symbol> caller_symbol;
   // The last observed move count for caller_symbol.
@@ -72,12 +91,14 @@ struct InvocationValue {
   // The last observed move count for function_symbol.
   int32_t function_move_count;
 
-  // Points to the trace buffer entry for the respective function.
-  InvocationInfo* info;
+  // The invocation count of the thread when the entry was last used.
+  uint32_t last_use;
+
+  // The aggregated invocations, as they are written to the trace.
+  InvocationInfo info;
 };
 
-typedef std::unordered_map<InvocationKey, InvocationValue, HashInvocationKey>
-    InvocationMap;
+typedef std::vector<InvocationEntry> InvocationTable;
 
 // The information on how to set the thread name comes from
 // a MSDN article: http://msdn2.microsoft.com/en-us/library/xcb2z8hs.aspx
@@ -90,6 +111,43 @@ typedef struct tagTHREADNAME_INFO {
   DWORD dwFlags;  // Reserved for future use, must be zero.
 } THREADNAME_INFO;
 
+// The environment variable that holds the options of the profiler.
+const char kProfilerOptionsEnvVar[] = "SYZYGY_PROFILER_OPTIONS";
+
+// Records one in every N function calls. The recorded calls are scaled up
+// by the grinder.
+const char kParamSamplingInterval[] = "sampling-interval";
+
+// Reads the sampling interval from the profiler options.
+// @returns the sampling interval, 1 if every call is to be recorded.
+uint32_t GetSamplingIntervalFromEnv() {
+  std::unique_ptr<base::Environment> env(base::Environment::Create());
+  DCHECK(env.get() != NULL);
+
+  std::string options;
+  if (!env->GetVar(kProfilerOptionsEnvVar, &options))
+    return 1;
+
+  // Prepends the options with a dummy executable name to keep the
+  // base::CommandLine parser happy.
+  std::wstring str = base::UTF8ToWide(options);
+  str.insert(0, L"dummy.exe ");
+  base::CommandLine cmd_line = base::CommandLine::FromString(str);
+
+  std::string value = cmd_line.GetSwitchValueASCII(kParamSamplingInterval);
+  if (value.empty())
+    return 1;
+
+  unsigned interval = 0;
+  if (!base::StringToUint(value, &interval) || interval == 0) {
+    LOG(ERROR) << "Invalid value for --" << kParamSamplingInterval << ": "
+               << value << ".";
+    return 1;
+  }
+
+  return interval;
+}
+
 }  // namespace
 
 // See client.cc for a description of the unconventional
@@ -287,7 +345,7 @@ namespace profiler {
 agent::profiler::Profiler Profiler::instance_;
 
 class Profiler::ThreadState
-    : public ReturnThunkFactoryImpl<Profiler::ThreadState>,
+    : public ShadowReturnStackImpl<Profiler::ThreadState>,
       public agent::common::ThreadStateBase {
  public:
   explicit ThreadState(Profiler* profiler);
@@ -316,14 +374,8 @@ class Profiler::ThreadState
                          RetAddr* return_address_location,
                          uint64_t cycles);
 
-  // @name Callback notification implementation.
-  // @{
-  void OnPageAdded(const void* page) override;
-  void OnPageRemoved(const void* page) override;
-  // @}
-
   // Function exit hook.
-  void OnFunctionExit(const ThunkData* data, uint64_t cycles_exit);
+  void OnFunctionExit(const Entry* entry, uint64_t cycles_exit);
 
   trace::client::TraceFileSegment* segment() { return &segment_; }
 
@@ -332,6 +384,31 @@ class Profiler::ThreadState
 
   void RecordInvocation(RetAddr caller, FuncAddr function, uint64_t cycles);
 
+  // Makes room in the invocation table for the invocations of @p key.
+  // @returns the entry to use, which is unused.
+  InvocationEntry* EvictColdInvocation(const InvocationKey& key);
+
+  // Writes the invocations aggregated in @p entry to the trace, and frees the
+  // entry.
+  void EmitInvocation(InvocationEntry* entry);
+
+  // Writes all the invocations aggregated so far to the trace.
+  void EmitAllInvocations();
+
+  // Emits the aggregated invocations and commits them to the trace if they
+  // haven't been for kInvocationFlushIntervalMs.
+  void FlushInvocationsOnTimer();
+
+  // Decides whether the function call being entered is recorded, and logs
+  // the sampling interval of the thread before its first recorded call.
+  // @param cycles the cycle count on entry.
+  // @returns true if the call is to be recorded, false otherwise.
+  bool SampleCall(uint64_t cycles);
+
+  // Logs the sampling interval of the thread into the trace.
+  // @returns true on success, false otherwise.
+  bool LogInvocationSampling();
+
   void UpdateOverhead(uint64_t entry_cycles);
   InvocationInfo* AllocateInvocationInfo();
   void ClearCache();
@@ -346,8 +423,15 @@ class Profiler::ThreadState
   // measures time exclusive of profiling overhead.
   uint64_t cycles_overhead_;
 
-  // The invocations we've recorded in our buffer.
-  InvocationMap invocations_;
+  // The invocations we've recorded since they were last written to the
+  // trace, in an open-addressed table of kInvocationTableSize entries.
+  InvocationTable invocations_;
+
+  // The number of invocations recorded, which dates the use of the entries.
+  uint32_t invocation_count_;
+
+  // The tick count when the invocations were last committed to the trace.
+  DWORD last_flush_ticks_;
 
   // The trace file segment we're recording to.
   trace::client::TraceFileSegment segment_;
@@ -357,22 +441,37 @@ class Profiler::ThreadState
 
   // The set of modules we've logged.
   ModuleSet logged_modules_;
+
+  // The number of calls to skip before the next one that is recorded.
+  uint32_t calls_to_skip_;
+
+  // True once the sampling interval of this thread has been logged.
+  bool sampling_logged_;
 };
 
 Profiler::ThreadState::ThreadState(Profiler* profiler)
     : profiler_(profiler),
       cycles_overhead_(0LL),
-      batch_(NULL) {
+      invocations_(kInvocationTableSize),
+      invocation_count_(0),
+      last_flush_ticks_(::GetTickCount()),
+      batch_(NULL),
+      calls_to_skip_(0),
+      sampling_logged_(false) {
   Initialize();
+  profiler_->OnThreadStateCreated(this);
 }
 
 Profiler::ThreadState::~ThreadState() {
-  ClearCache();
-
-  // If we have an outstanding buffer, let's deallocate it now.
-  if (segment_.write_ptr != NULL)
+  // If we have an outstanding buffer, write the invocations we hold to it and
+  // return it now.
+  if (segment_.write_ptr != NULL) {
+    EmitAllInvocations();
+    ClearCache();
     profiler_->session_.ReturnBuffer(&segment_);
+  }
 
+  profiler_->OnThreadStateDestroyed(this);
   Uninitialize();
 }
 
@@ -460,16 +559,17 @@ void Profiler::ThreadState::OnFunctionEntry(EntryFrame* entry_frame,
   if (profiler_->session_.IsDisabled())
     return;
 
+  if (!SampleCall(cycles))
+    return;
+
   // Record the details of the entry.
   // Note that on tail-recursion and tail-call elimination, the caller recorded
-  // here will be a thunk. We cater for this case on exit as best we can.
-  ThunkData* data = MakeThunk(entry_frame->retaddr);
-  DCHECK(data != NULL);
-  data->caller = entry_frame->retaddr;
-  data->function = function;
-  data->cycles_entry = cycles - cycles_overhead_;
-
-  entry_frame->retaddr = data->thunk;
+  // here will be the trampoline. We cater for this case on exit as best we
+  // can.
+  Entry* entry = Push(&entry_frame->retaddr);
+  DCHECK(entry != NULL);
+  entry->function = function;
+  entry->cycles_entry = cycles - cycles_overhead_;
 
   UpdateOverhead(cycles);
 }
@@ -480,6 +580,9 @@ void Profiler::ThreadState::OnV8FunctionEntry(FuncAddr function,
   if (profiler_->session_.IsDisabled())
     return;
 
+  if (!SampleCall(cycles))
+    return;
+
   // Record the details of the entry.
 
   // TODO(siggi): Note that we want to do different exit processing here,
@@ -487,88 +590,88 @@ void Profiler::ThreadState::OnV8FunctionEntry(FuncAddr function,
   //    record the fact here than to force a lookup on RecordInvocation.
 
   // Note that on tail-recursion and tail-call elimination, the caller recorded
-  // here will be a thunk. We cater for this case on exit as best we can.
-  ThunkData* data = MakeThunk(*return_address_location);
-  DCHECK(data != NULL);
-  data->caller = *return_address_location;
-  data->function = function;
-  data->cycles_entry = cycles - cycles_overhead_;
-
-  *return_address_location = data->thunk;
+  // here will be the trampoline. We cater for this case on exit as best we
+  // can.
+  Entry* entry = Push(return_address_location);
+  DCHECK(entry != NULL);
+  entry->function = function;
+  entry->cycles_entry = cycles - cycles_overhead_;
 
   UpdateOverhead(cycles);
 }
 
-void Profiler::ThreadState::OnFunctionExit(const ThunkData* data,
+void Profiler::ThreadState::OnFunctionExit(const Entry* entry,
                                            uint64_t cycles_exit) {
   // Calculate the number of cycles in the invocation, exclusive our overhead.
   uint64_t cycles_executed =
-      cycles_exit - cycles_overhead_ - data->cycles_entry;
-
-  // See if the return address resolves to a thunk, which indicates
-  // tail recursion or tail call elimination. In that case we record the
-  // calling function as caller, which isn't totally accurate as that'll
-  // attribute the cost to the first line of the calling function. In the
-  // absence of more information, it's the best we can do, however.
-  // TODO(siggi): Move this into RecordInvocation, as we can elide the lookup
-  //     on a cache hit.
-  Thunk* ret_thunk = CastToThunk(data->caller);
-  if (ret_thunk == NULL) {
-    RecordInvocation(data->caller, data->function, cycles_executed);
+      cycles_exit - cycles_overhead_ - entry->cycles_entry;
+
+  // See if the return address is the trampoline, which indicates tail
+  // recursion or tail call elimination. In that case the entry of the calling
+  // function is now at the top of the stack, and we record the calling
+  // function as caller, which isn't totally accurate as that'll attribute the
+  // cost to the first line of the calling function. In the absence of more
+  // information, it's the best we can do, however.
+  if (entry->caller != trampoline()) {
+    RecordInvocation(entry->caller, entry->function, cycles_executed);
   } else {
-    ThunkData* ret_data = DataFromThunk(ret_thunk);
-    RecordInvocation(ret_data->function, data->function, cycles_executed);
+    const Entry* caller_entry = top();
+    DCHECK(caller_entry != NULL);
+    RecordInvocation(caller_entry->function, entry->function,
+                     cycles_executed);
   }
 
   UpdateOverhead(cycles_exit);
 }
 
-void Profiler::ThreadState::OnPageAdded(const void* page) {
-  profiler_->OnPageAdded(page);
-}
-
-void Profiler::ThreadState::OnPageRemoved(const void* page) {
-  profiler_->OnPageRemoved(page);
-}
-
 void Profiler::ThreadState::RecordInvocation(RetAddr caller,
                                              FuncAddr function,
                                              uint64_t duration_cycles) {
+  ++invocation_count_;
+
   // See whether we've already recorded an entry for this function.
   InvocationKey key(caller, function);
-  InvocationMap::iterator it = invocations_.find(key);
-  if (it != invocations_.end()) {
-    // Yup, we already have an entry, validate it.
-    InvocationValue& value = it->second;
+  size_t index = HashInvocationKey(key);
+  for (size_t i = 0; i < kInvocationTableMaxProbes; ++i) {
+    InvocationEntry& entry = invocations_[(index + i) % kInvocationTableSize];
+    if (!entry.in_use())
+      break;
+    if (entry.key != key)
+      continue;
 
-    if ((value.caller_symbol == NULL ||
-         value.caller_symbol->move_count() == value.caller_move_count) &&
-        (value.function_symbol == NULL ||
-         value.function_symbol->move_count() == value.function_move_count)) {
+    // Yup, we already have an entry, validate it.
+    if ((entry.caller_symbol == NULL ||
+         entry.caller_symbol->move_count() == entry.caller_move_count) &&
+        (entry.function_symbol == NULL ||
+         entry.function_symbol->move_count() == entry.function_move_count)) {
       // The entry is still good, tally the new data.
-      ++(value.info->num_calls);
-      value.info->cycles_sum += duration_cycles;
-      if (duration_cycles < value.info->cycles_min) {
-        value.info->cycles_min = duration_cycles;
-      } else if (duration_cycles > value.info->cycles_max) {
-        value.info->cycles_max = duration_cycles;
+      InvocationInfo& info = entry.info;
+      ++info.num_calls;
+      info.cycles_sum += duration_cycles;
+      if (duration_cycles < info.cycles_min) {
+        info.cycles_min = duration_cycles;
+      } else if (duration_cycles > info.cycles_max) {
+        info.cycles_max = duration_cycles;
       }
+      entry.last_use = invocation_count_;
 
       // Early out on success.
+      FlushInvocationsOnTimer();
       return;
-    } else {
-      // The entry is not valid any more, discard it.
-      DCHECK(value.caller_symbol != NULL || value.function_symbol != NULL);
-
-      invocations_.erase(it);
     }
+
+    // The entry is not valid any more, it's replaced below.
+    DCHECK(entry.caller_symbol != NULL || entry.function_symbol != NULL);
+    break;
   }
-  DCHECK(invocations_.find(key) == invocations_.end());
 
-  // We don't have an entry, allocate a new one for this invocation.
+  // We don't have a valid entry, make one for this invocation.
   // The code below may touch last error.
   ScopedLastErrorKeeper keep_last_error;
 
+  InvocationEntry* entry = EvictColdInvocation(key);
+  DCHECK(!entry->in_use());
+
   scoped_refptr<SymbolMap::Symbol> caller_symbol =
       profiler_->symbol_map_.FindSymbol(caller);
 
@@ -591,54 +694,157 @@ void Profiler::ThreadState::RecordInvocation(RetAddr caller,
     LogSymbol(function_symbol.get());
   }
 
-  InvocationInfo* info = AllocateInvocationInfo();
-  if (info != NULL) {
-    InvocationValue& value = invocations_[key];
-    value.info = info;
-    value.caller_symbol = caller_symbol;
-    if (caller_symbol != NULL)
-      value.caller_move_count = caller_symbol->move_count();
-    else
-      value.caller_move_count = 0;
-
-    value.function_symbol = function_symbol;
-    if (function_symbol != NULL)
-      value.function_move_count = function_symbol->move_count();
-    else
-      value.function_move_count = 0;
-
-    if (function_symbol == NULL) {
-      // We're not in a dynamic function, record the (conventional) function.
-      info->function = function;
-      info->flags = 0;
-    } else {
-      // We're in a dynamic function symbol, record the details.
-      DCHECK_NE(function_symbol->id(), 0);
+  entry->key = key;
+  entry->last_use = invocation_count_;
+
+  entry->caller_symbol = caller_symbol;
+  if (caller_symbol != NULL)
+    entry->caller_move_count = caller_symbol->move_count();
+  else
+    entry->caller_move_count = 0;
+
+  entry->function_symbol = function_symbol;
+  if (function_symbol != NULL)
+    entry->function_move_count = function_symbol->move_count();
+  else
+    entry->function_move_count = 0;
+
+  InvocationInfo* info = &entry->info;
+  if (function_symbol == NULL) {
+    // We're not in a dynamic function, record the (conventional) function.
+    info->function = function;
+    info->flags = 0;
+  } else {
+    // We're in a dynamic function symbol, record the details.
+    DCHECK_NE(function_symbol->id(), 0);
 
-      info->function_symbol_id = function_symbol->id();
-      info->flags = kFunctionIsSymbol;
-    }
+    info->function_symbol_id = function_symbol->id();
+    info->flags = kFunctionIsSymbol;
+  }
 
-    if (caller_symbol == NULL) {
-      // We're not in a dynamic caller_symbol, record the (conventional) caller.
-      info->caller = caller;
-      info->caller_offset = 0;
-    } else {
-      // We're in a dynamic caller_symbol, record the details.
-      DCHECK_NE(caller_symbol->id(), 0);
-
-      info->caller_symbol_id = caller_symbol->id();
-      info->flags |= kCallerIsSymbol;
-      info->caller_offset =
-          reinterpret_cast<const uint8_t*>(caller) -
-          reinterpret_cast<const uint8_t*>(caller_symbol->address());
+  if (caller_symbol == NULL) {
+    // We're not in a dynamic caller_symbol, record the (conventional) caller.
+    info->caller = caller;
+    info->caller_offset = 0;
+  } else {
+    // We're in a dynamic caller_symbol, record the details.
+    DCHECK_NE(caller_symbol->id(), 0);
+
+    info->caller_symbol_id = caller_symbol->id();
+    info->flags |= kCallerIsSymbol;
+    info->caller_offset =
+        reinterpret_cast<const uint8_t*>(caller) -
+        reinterpret_cast<const uint8_t*>(caller_symbol->address());
+  }
+
+  info->num_calls = 1;
+  info->cycles_min = info->cycles_max = info->cycles_sum = duration_cycles;
+
+  FlushInvocationsOnTimer();
+}
+
+InvocationEntry* Profiler::ThreadState::EvictColdInvocation(
+    const InvocationKey& key) {
+  // Take the entry of the key, if it's stale, else the first unused entry. If
+  // all the entries probed are in use, take the least recently used one.
+  size_t index = HashInvocationKey(key);
+  InvocationEntry* coldest = NULL;
+  for (size_t i = 0; i < kInvocationTableMaxProbes; ++i) {
+    InvocationEntry* entry =
+        &invocations_[(index + i) % kInvocationTableSize];
+    if (!entry->in_use())
+      return entry;
+    if (entry->key == key) {
+      coldest = entry;
+      break;
+    }
+    if (coldest == NULL ||
+        invocation_count_ - entry->last_use >
+            invocation_count_ - coldest->last_use) {
+      coldest = entry;
     }
+  }
 
-    info->num_calls = 1;
-    info->cycles_min = info->cycles_max = info->cycles_sum = duration_cycles;
+  DCHECK(coldest != NULL);
+  EmitInvocation(coldest);
+  return coldest;
+}
+
+void Profiler::ThreadState::EmitInvocation(InvocationEntry* entry) {
+  DCHECK(entry != NULL);
+  DCHECK(entry->in_use());
+
+  InvocationInfo* info = AllocateInvocationInfo();
+  if (info != NULL)
+    *info = entry->info;
+
+  // Entries are only ever freed to be reused right away, or all at once, so
+  // that the probe sequences stay unbroken.
+  entry->key = InvocationKey();
+  entry->caller_symbol = NULL;
+  entry->function_symbol = NULL;
+}
+
+void Profiler::ThreadState::EmitAllInvocations() {
+  for (size_t i = 0; i < invocations_.size(); ++i) {
+    if (invocations_[i].in_use())
+      EmitInvocation(&invocations_[i]);
   }
 }
 
+void Profiler::ThreadState::FlushInvocationsOnTimer() {
+  DWORD ticks = ::GetTickCount();
+  if (ticks - last_flush_ticks_ < kInvocationFlushIntervalMs)
+    return;
+
+  ScopedLastErrorKeeper keep_last_error;
+
+  last_flush_ticks_ = ticks;
+  EmitAllInvocations();
+  FlushSegment();
+}
+
+bool Profiler::ThreadState::SampleCall(uint64_t cycles) {
+  if (profiler_->sampling_interval_ == 1)
+    return true;
+
+  // The calls that aren't recorded don't get a shadow stack entry, and only
+  // cost the profiler this countdown.
+  if (calls_to_skip_ > 0) {
+    --calls_to_skip_;
+    UpdateOverhead(cycles);
+    return false;
+  }
+  calls_to_skip_ = profiler_->sampling_interval_ - 1;
+
+  // The grinder must know the interval before it sees the recorded calls.
+  if (!sampling_logged_ && !LogInvocationSampling()) {
+    UpdateOverhead(cycles);
+    return false;
+  }
+
+  return true;
+}
+
+bool Profiler::ThreadState::LogInvocationSampling() {
+  if (!segment_.CanAllocate(sizeof(TraceInvocationSampling)) &&
+      !FlushSegment()) {
+    // We failed to allocate a new buffer.
+    return false;
+  }
+
+  DCHECK(segment_.header != NULL);
+  batch_ = NULL;
+
+  TraceInvocationSampling* sampling =
+      segment_.AllocateTraceRecord<TraceInvocationSampling>();
+  DCHECK(sampling != NULL);
+  sampling->sampling_interval = profiler_->sampling_interval_;
+  sampling_logged_ = true;
+
+  return true;
+}
+
 void Profiler::ThreadState::UpdateOverhead(uint64_t entry_cycles) {
   // TODO(siggi): Measure the fixed overhead on setup,
   //     then add it on every update.
@@ -687,7 +893,6 @@ bool Profiler::ThreadState::FlushSegment() {
 
 void Profiler::ThreadState::ClearCache() {
   batch_ = NULL;
-  invocations_.clear();
 }
 
 void Profiler::OnThreadDetach() {
@@ -697,30 +902,28 @@ void Profiler::OnThreadDetach() {
 }
 
 RetAddr* Profiler::ResolveReturnAddressLocation(RetAddr* pc_location) {
-  base::AutoLock lock(lock_);
-
-  // In case of tail-call and tail recursion elimination, we can get chained
-  // thunks, so we loop around here until we resolve to a non-thunk.
-  while (true) {
-    // See whether the return address is one of our thunks.
-    RetAddr ret_addr = *pc_location;
+  // All redirected return addresses refer to the same trampoline.
+  if (*pc_location != ThreadState::trampoline_address())
+    return pc_location;
 
-    // Compute the page this return address lives in.
-    const void* page = reinterpret_cast<const void*>(
-        reinterpret_cast<uintptr_t>(ret_addr) & ~0xFFF);
-    if (!std::binary_search(pages_.begin(), pages_.end(), page))
-      return pc_location;
-
-    // It's one of our own, redirect to the thunk's stash.
-    ThreadState::Thunk* thunk =
-        reinterpret_cast<ThreadState::Thunk*>(const_cast<void*>(ret_addr));
-
-    ThreadState::ThunkData* data = ThreadState::DataFromThunk(thunk);
+  // The frame most likely belongs to the current thread.
+  ThreadState* state = GetThreadState();
+  if (state != NULL) {
+    RetAddr* location = state->FindReturnAddress(pc_location);
+    if (location != NULL)
+      return location;
+  }
 
-    // Update the PC location and go around again, in case this
-    // thunk links to another one.
-    pc_location = &data->caller;
+  // Otherwise this must be the stack of another thread that is walked, e.g.
+  // by V8 during garbage collection, while that thread is stopped.
+  base::AutoLock lock(lock_);
+  for (size_t i = 0; i < thread_states_.size(); ++i) {
+    RetAddr* location = thread_states_[i]->FindReturnAddress(pc_location);
+    if (location != NULL)
+      return location;
   }
+
+  return pc_location;
 }
 
 void Profiler::OnModuleEntry(EntryFrame* entry_frame,
@@ -770,24 +973,22 @@ void Profiler::OnModuleEntry(EntryFrame* entry_frame,
   data->OnFunctionEntry(entry_frame, function, cycles);
 }
 
-void Profiler::OnPageAdded(const void* page) {
+void Profiler::OnThreadStateCreated(ThreadState* state) {
   base::AutoLock lock(lock_);
 
-  PageVector::iterator it =
-      std::lower_bound(pages_.begin(), pages_.end(), page);
-  DCHECK(it == pages_.end() || *it != page);
-  pages_.insert(it, page);
+  DCHECK(std::find(thread_states_.begin(), thread_states_.end(), state) ==
+         thread_states_.end());
+  thread_states_.push_back(state);
 }
 
-void Profiler::OnPageRemoved(const void* page) {
+void Profiler::OnThreadStateDestroyed(ThreadState* state) {
   base::AutoLock lock(lock_);
 
-  PageVector::iterator it =
-      std::lower_bound(pages_.begin(), pages_.end(), page);
-  // The page must be in our list.
-  DCHECK(it != pages_.end());
-  DCHECK_EQ(page, *it);
-  pages_.erase(it);
+  ThreadStateVector::iterator it =
+      std::find(thread_states_.begin(), thread_states_.end(), state);
+  // The state must be in our list.
+  DCHECK(it != thread_states_.end());
+  thread_states_.erase(it);
 }
 
 void Profiler::OnThreadName(const base::StringPiece& thread_name) {
@@ -832,7 +1033,9 @@ void Profiler::OnDllEvent(agent::common::DllNotificationWatcher::EventType type,
   }
 }
 
-Profiler::Profiler() : handler_registration_(NULL) {
+Profiler::Profiler()
+    : handler_registration_(NULL),
+      sampling_interval_(GetSamplingIntervalFromEnv()) {
   // Create our RPC session and allocate our initial trace segment on creation,
   // aka at load time.
   ThreadState* data = CreateFirstThreadStateAndSession();
@@ -21,8 +21,8 @@
       'target_name': 'profile_lib',
       'type': 'static_library',
       'sources': [
-        'return_thunk_factory.cc',
-        'return_thunk_factory.h',
+        'shadow_return_stack.cc',
+        'shadow_return_stack.h',
         'symbol_map.cc',
         'symbol_map.h',
       ],
@@ -52,7 +52,7 @@
       'type': 'executable',
       'sources': [
         'profiler_unittest.cc',
-        'return_thunk_factory_unittest.cc',
+        'shadow_return_stack_unittest.cc',
         'symbol_map_unittest.cc',
         '<(src)/syzygy/testing/run_all_unittests.cc',
       ],
@@ -88,12 +88,13 @@ class Profiler {
   // @param new_address the new start address of the moved symbol.
   void MoveSymbol(const void* old_address, const void* new_address);
 
-  // Resolves a return address location to a thunk's stashed original
-  // location if a thunk is involved.
+  // Resolves a return address location to the location of the original
+  // return address if the return address was redirected to the trampoline.
   // @param pc_location an address on stack where a return address is stored.
   // @returns the address where the profiler stashed the original return address
-  //     if *(@p pc_location) refers to a thunk, otherwise @p pc_location.
-  // @note this function must be able to resolve through thunks that belong
+  //     if *(@p pc_location) refers to the trampoline, otherwise
+  //     @p pc_location.
+  // @note this function must be able to resolve through frames that belong
   //     to other threads, as e.g. V8 will traverse all stacks that are using
   //     V8 during garbage collection.
   RetAddr* ResolveReturnAddressLocation(RetAddr* pc_location);
@@ -108,14 +109,16 @@ class Profiler {
   Profiler();
   ~Profiler();
 
+  class ThreadState;
+
   // Called form DllMainEntryHook.
   void OnModuleEntry(EntryFrame* entry_frame,
                      FuncAddr function,
                      uint64_t cycles);
 
   // Callbacks from ThreadState.
-  void OnPageAdded(const void* page);
-  void OnPageRemoved(const void* page);
+  void OnThreadStateCreated(ThreadState* state);
+  void OnThreadStateDestroyed(ThreadState* state);
 
   // Called on a first chance exception declaring thread name.
   void OnThreadName(const base::StringPiece& thread_name);
@@ -124,8 +127,6 @@ class Profiler {
   // of capturing thread name debug exceptions.
   static LONG CALLBACK ExceptionHandler(EXCEPTION_POINTERS* ex_info);
 
-  class ThreadState;
-
   // Sink for DLL load/unload event notifications.
   void OnDllEvent(agent::common::DllNotificationWatcher::EventType type,
                   HMODULE module,
@@ -142,15 +143,16 @@ class Profiler {
   // The RPC session we're logging to/through.
   trace::client::RpcSession session_;
 
-  // Protects pages_ and logged_modules_.
+  // Protects thread_states_ and logged_modules_.
   base::Lock lock_;
 
   // The dynamic symbol map.
   SymbolMap symbol_map_;
 
-  // Contains the thunk pages in lexical order.
-  typedef std::vector<const void*> PageVector;
-  PageVector pages_;  // Under lock_.
+  // Contains the live thread states, whose shadow return stacks may need to
+  // be searched to resolve return addresses.
+  typedef std::vector<ThreadState*> ThreadStateVector;
+  ThreadStateVector thread_states_;  // Under lock_.
 
   // Contains the set of modules we've seen and logged.
   typedef base::hash_set<HMODULE> ModuleSet;
@@ -166,6 +168,10 @@ class Profiler {
   // To keep track of modules added after initialization.
   agent::common::DllNotificationWatcher dll_watcher_;
 
+  // One in every sampling_interval_ function calls is recorded, as given by
+  // the --sampling-interval option of SYZYGY_PROFILER_OPTIONS.
+  uint32_t sampling_interval_;
+
   // This points to our per-thread state.
   mutable base::ThreadLocalPointer<ThreadState> tls_;
 
@@ -0,0 +1,157 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/profiler/shadow_return_stack.h"
+
+#include "base/lazy_instance.h"
+#include "base/threading/thread_local.h"
+
+namespace agent {
+namespace profiler {
+
+namespace {
+
+// The number of entries reserved up front, which covers all but the deepest
+// call stacks.
+const size_t kInitialCapacity = 1024;
+
+// The most argument bytes a callee-cleanup frame can pop on return, as the
+// operand of ret is 16 bits wide.
+const size_t kMaxCalleeCleanupBytes = 0xFFFF;
+
+// The stack of each thread, for the trampoline to find.
+base::LazyInstance<base::ThreadLocalPointer<ShadowReturnStackBase>>::Leaky
+    g_current_stack = LAZY_INSTANCE_INITIALIZER;
+
+}  // namespace
+
+ShadowReturnStackBase::ShadowReturnStackBase(TrampolineFunc trampoline)
+    : trampoline_(reinterpret_cast<RetAddr>(trampoline)) {
+  DCHECK(trampoline != NULL);
+}
+
+ShadowReturnStackBase::~ShadowReturnStackBase() {
+  DCHECK(entries_.empty()) << "Destroying a stack that was not uninitialized.";
+}
+
+void ShadowReturnStackBase::Initialize() {
+  DCHECK(g_current_stack.Get().Get() == NULL);
+  entries_.reserve(kInitialCapacity);
+  g_current_stack.Get().Set(this);
+}
+
+void ShadowReturnStackBase::Uninitialize() {
+  // The stack may be torn down on behalf of a thread that has died.
+  if (g_current_stack.Get().Get() == this)
+    g_current_stack.Get().Set(NULL);
+  entries_.clear();
+}
+
+// static
+ShadowReturnStackBase* ShadowReturnStackBase::GetCurrent() {
+  return g_current_stack.Get().Get();
+}
+
+ShadowReturnStackBase::Entry* ShadowReturnStackBase::Push(
+    RetAddr* return_address_location) {
+  DCHECK(return_address_location != NULL);
+  RetAddr caller = *return_address_location;
+
+  // Discard the entries of the frames that were unwound without returning.
+  // An entry at the same location is only live if its frame tail-called the
+  // function being entered, in which case the return address is already
+  // redirected.
+  while (!entries_.empty()) {
+    const Entry& top = entries_.back();
+    if (top.return_address_location > return_address_location)
+      break;
+    if (top.return_address_location == return_address_location &&
+        caller == trampoline_) {
+      break;
+    }
+    entries_.pop_back();
+  }
+
+  Entry entry = { return_address_location, caller, NULL, 0 };
+  entries_.push_back(entry);
+  *return_address_location = trampoline_;
+
+  return &entries_.back();
+}
+
+RetAddr* ShadowReturnStackBase::FindReturnAddress(
+    RetAddr* return_address_location) {
+  // The frames higher up the machine stack are further down the entries, so
+  // the search stops once it has gone past the location.
+  for (size_t i = entries_.size(); i > 0; --i) {
+    Entry& entry = entries_[i - 1];
+    if (entry.return_address_location > return_address_location)
+      break;
+
+    // Of the entries of a chain of tail calls, only the first one holds a
+    // real return address.
+    if (entry.return_address_location == return_address_location &&
+        entry.caller != trampoline_) {
+      return &entry.caller;
+    }
+  }
+
+  return NULL;
+}
+
+const ShadowReturnStackBase::Entry* ShadowReturnStackBase::top() const {
+  if (entries_.empty())
+    return NULL;
+  return &entries_.back();
+}
+
+bool ShadowReturnStackBase::Pop(RetAddr* return_address_location,
+                                Entry* entry) {
+  DCHECK(entry != NULL);
+
+  // The location is only exact for frames that return with a plain ret, it is
+  // above the real one by the argument bytes popped by a callee-cleanup frame.
+  // The frame being returned from is the one highest up the machine stack at
+  // or below the location, as the arguments of a frame lie below the return
+  // address of its caller. The entries lower down the machine stack are those
+  // of frames that were unwound without returning.
+  size_t live = entries_.size();
+  while (live > 0 &&
+         entries_[live - 1].return_address_location <=
+             return_address_location) {
+    --live;
+  }
+  if (live == entries_.size())
+    return false;
+
+  RetAddr* live_location = entries_[live].return_address_location;
+  size_t cleanup_bytes =
+      reinterpret_cast<uint8_t*>(return_address_location) -
+      reinterpret_cast<uint8_t*>(live_location);
+  if (cleanup_bytes > kMaxCalleeCleanupBytes)
+    return false;
+
+  // Discard the entries of the frames that were unwound without returning.
+  while (entries_.back().return_address_location < live_location)
+    entries_.pop_back();
+
+  // Of the entries of a chain of tail calls, the last one pushed is that of
+  // the frame being returned from.
+  *entry = entries_.back();
+  entries_.pop_back();
+  return true;
+}
+
+}  // namespace profiler
+}  // namespace agent
@@ -0,0 +1,226 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the shadow return stack used by the profiler to hook function
+// exits.
+
+#ifndef SYZYGY_AGENT_PROFILER_SHADOW_RETURN_STACK_H_
+#define SYZYGY_AGENT_PROFILER_SHADOW_RETURN_STACK_H_
+
+#include <vector>
+
+#include "base/logging.h"
+#include "syzygy/common/assertions.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+
+namespace agent {
+namespace profiler {
+
+// A per-thread stack of the return addresses the profiler has redirected.
+// The return address of each hooked frame is replaced with the address of a
+// single trampoline, shared by all frames and threads, which pops the frame's
+// entry, invokes OnFunctionExit and returns to the real return address.
+//
+// Each entry records where the redirected return address lives on the
+// machine stack. Frames that are unwound without returning, e.g. by an
+// exception, leave stale entries behind, which are discarded as soon as a
+// frame at the same depth or higher up the machine stack is pushed or
+// returned from.
+//
+// This class is currently somewhat specific to profiling, as it calls rdtsc
+// in the trampoline and stores data needed for profiling, but it could be
+// generalized if needed.
+class ShadowReturnStackBase {
+ public:
+  // An entry for a frame whose return address was redirected.
+  struct Entry {
+    // The location on the machine stack of the redirected return address.
+    RetAddr* return_address_location;
+
+    // The real return address and the function invoked.
+    RetAddr caller;
+    FuncAddr function;
+
+    // The time of entry.
+    uint64_t cycles_entry;
+  };
+  COMPILE_ASSERT_IS_POD(Entry);
+
+  // Redirects the return address at @p return_address_location to the
+  // trampoline, and records the real return address in a new entry.
+  // @param return_address_location the location of the return address of the
+  //     frame being entered.
+  // @returns the new entry, which is valid until the next push.
+  Entry* Push(RetAddr* return_address_location);
+
+  // Finds the real return address of a redirected frame of this stack.
+  // @param return_address_location the location of a return address on the
+  //     machine stack of the thread owning this stack.
+  // @returns the location of the real return address of the frame, or NULL
+  //     if this stack has no entry for it.
+  // @note This resolves through chains of entries created by tail calls.
+  RetAddr* FindReturnAddress(RetAddr* return_address_location);
+
+  // @returns the entry at the top of the stack, or NULL if it is empty.
+  const Entry* top() const;
+
+  // @returns the number of entries on the stack.
+  size_t size() const { return entries_.size(); }
+
+  // @returns the address of the trampoline that return addresses are
+  //     redirected to.
+  RetAddr trampoline() const { return trampoline_; }
+
+ protected:
+  // Trampoline function type.
+  typedef void (*TrampolineFunc)();
+
+  explicit ShadowReturnStackBase(TrampolineFunc trampoline);
+  ~ShadowReturnStackBase();
+
+  // Must be called on the thread owning the stack, before any frame is
+  // pushed.
+  void Initialize();
+  // Must be called before the destruction of the stack, on any thread.
+  void Uninitialize();
+
+  // @returns the stack of the current thread, or NULL if it has none.
+  static ShadowReturnStackBase* GetCurrent();
+
+  // Pops the entry of a frame being returned from, along with the stale
+  // entries above it.
+  // @param return_address_location the location just below the stack pointer
+  //     the trampoline was returned to with. For a frame that returns with
+  //     ret N, this is N bytes above the location of its return address.
+  // @param entry receives the entry of the frame.
+  // @returns true on success, false if the stack has no entry for the frame.
+  bool Pop(RetAddr* return_address_location, Entry* entry);
+
+  // The entries, the most recently pushed last. The return address locations
+  // of the entries never increase from one entry to the next.
+  std::vector<Entry> entries_;
+
+  // The trampoline that return addresses are redirected to.
+  RetAddr trampoline_;
+
+  DISALLOW_COPY_AND_ASSIGN(ShadowReturnStackBase);
+};
+
+// The ImplClass must derive from this class, and implement a member function
+// with the following signature:
+// void OnFunctionExit(const Entry* entry, uint64_t cycles);
+// The entry has been popped by the time OnFunctionExit is invoked.
+template <typename ImplClass> class ShadowReturnStackImpl
+    : public ShadowReturnStackBase {
+ public:
+  ShadowReturnStackImpl() : ShadowReturnStackBase(trampoline_asm) {
+  }
+
+  // @returns the address of the trampoline, which is the same for all the
+  //     stacks of this type.
+  static RetAddr trampoline_address() {
+    return reinterpret_cast<RetAddr>(trampoline_asm);
+  }
+
+ protected:
+  // Static assembly function that all redirected frames return to. It ends
+  // up calling to ShadowReturnStackImpl::TrampolineMain, which in turn calls
+  // ImplClass::OnFunctionExit.
+  static void trampoline_asm();
+
+  static RetAddr WINAPI TrampolineMain(RetAddr* return_address_location,
+                                       uint64_t cycles);
+};
+
+template <class ImplClass> void __declspec(naked)
+ShadowReturnStackImpl<ImplClass>::trampoline_asm() {
+  __asm {
+    // The return that got us here popped the redirected return address, and
+    // the arguments of a callee-cleanup frame. Reserve a slot for the real
+    // return address.
+    push eax
+
+    // Stash volatile registers.
+    push eax
+    push edx
+
+    // Get the current cycle time ASAP.
+    rdtsc
+
+    push ecx
+
+    // Save eax, we need the register to grab the flags.
+    mov ecx, eax
+
+    // Save the low byte of the flags into AH.
+    lahf
+    // Save the overflow flag into AL.
+    seto al
+
+    // Stash the flags to stack.
+    push eax
+
+    // Push the cycle time arg for the TrampolineMain function.
+    push edx
+    push ecx
+
+    // Push the location of the reserved slot, which is where the redirected
+    // return address was unless the frame cleaned up its arguments.
+    lea eax, DWORD PTR[esp + 0x18]
+    push eax
+
+    call TrampolineMain
+
+    // Store the real return address in the reserved slot.
+    mov DWORD PTR[esp + 0x10], eax
+
+    pop eax
+
+    // AL is set to 1 if the overflow flag was set before the call to
+    // our hook, 0 otherwise. We add 0x7f to it so it'll restore the
+    // flag.
+    add al, 0x7f
+    // Restore the low byte of the flags.
+    sahf
+
+    // Restore volatile registers.
+    pop ecx
+    pop edx
+    pop eax
+
+    // Return to the real return address.
+    ret
+  }
+}
+
+template <class ImplClass>
+RetAddr WINAPI ShadowReturnStackImpl<ImplClass>::TrampolineMain(
+    RetAddr* return_address_location, uint64_t cycles) {
+  ImplClass* stack = static_cast<ImplClass*>(GetCurrent());
+  CHECK(stack != NULL) << "Returned to the trampoline without a stack.";
+
+  // There is nowhere to return to without the entry of the frame.
+  Entry entry = {};
+  bool popped = stack->Pop(return_address_location, &entry);
+  CHECK(popped) << "Returned to the trampoline from an unknown frame.";
+
+  stack->OnFunctionExit(&entry, cycles);
+
+  return entry.caller;
+}
+
+}  // namespace profiler
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_PROFILER_SHADOW_RETURN_STACK_H_
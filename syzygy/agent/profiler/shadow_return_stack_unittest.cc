@@ -0,0 +1,308 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/profiler/shadow_return_stack.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+using agent::profiler::ShadowReturnStackBase;
+using agent::profiler::ShadowReturnStackImpl;
+using testing::_;
+using testing::Field;
+using testing::Pointee;
+using testing::StrictMock;
+
+typedef ShadowReturnStackBase::Entry Entry;
+
+// A ShadowReturnStackImpl subclass that exposes various private bits for
+// testing.
+class TestStack : public ShadowReturnStackImpl<TestStack> {
+ public:
+  TestStack() {
+    Initialize();
+  }
+  ~TestStack() {
+    Uninitialize();
+  }
+
+  MOCK_METHOD2(OnFunctionExit, void(const Entry*, uint64_t));
+
+  using ShadowReturnStackImpl<TestStack>::TrampolineMain;
+};
+
+class ShadowReturnStackTest : public testing::Test {
+ public:
+  void SetUp() override {
+    ASSERT_EQ(NULL, stack_);
+
+    stack_ = new StrictMock<TestStack>();
+    ASSERT_TRUE(stack_ != NULL);
+
+    // A fake machine stack, which grows down.
+    for (size_t i = 0; i < arraysize(frames_); ++i)
+      frames_[i] = reinterpret_cast<RetAddr>(0x1000 + i);
+  }
+
+  void TearDown() override {
+    delete stack_;
+    stack_ = NULL;
+  }
+
+  static void WINAPI StaticPush(RetAddr* return_address_location) {
+    stack_->Push(return_address_location);
+  }
+
+ protected:
+  RetAddr frames_[4];
+
+  // Valid during tests.
+  static StrictMock<TestStack>* stack_;
+};
+
+StrictMock<TestStack>* ShadowReturnStackTest::stack_ = NULL;
+
+// This assembly function redirects its own return address to the trampoline,
+// then returns through it.
+extern "C" void __declspec(naked) push_and_return_via_trampoline() {
+  __asm {
+    // Push the location of the return address, which redirects it.
+    push esp
+    call ShadowReturnStackTest::StaticPush
+
+    // Return to the trampoline.
+    ret
+  }
+}
+
+// This assembly function redirects its own return address to the trampoline,
+// then returns through it while popping its arguments, like a stdcall
+// function does.
+extern "C" void __declspec(naked) __stdcall
+    push_and_return_via_trampoline_stdcall(int arg1, int arg2) {
+  __asm {
+    push esp
+    call ShadowReturnStackTest::StaticPush
+
+    // Return to the trampoline, cleaning up the arguments.
+    ret 8
+  }
+}
+
+// This assembly function redirects its own return address to the trampoline,
+// calls a stdcall function that does the same, then returns through the
+// trampoline while popping its own argument.
+extern "C" void __declspec(naked) __stdcall
+    push_and_call_stdcall_via_trampoline(int arg) {
+  __asm {
+    push esp
+    call ShadowReturnStackTest::StaticPush
+
+    push 2
+    push 1
+    call push_and_return_via_trampoline_stdcall
+
+    ret 4
+  }
+}
+
+extern "C" void __declspec(naked) capture_contexts(CONTEXT* before,
+                                                   CONTEXT* after) {
+  __asm {
+    // Push a return address to the label below, and redirect it to the
+    // trampoline.
+    mov eax, return_here
+    push eax
+    push esp
+    call ShadowReturnStackTest::StaticPush
+
+    // Capture the CPU context before returning through the trampoline.
+    push DWORD PTR[esp+8]
+    call DWORD PTR[RtlCaptureContext]
+
+    // Restore EAX, which is stomped by RtlCaptureContext.
+    mov eax, DWORD PTR[esp+8]
+    mov eax, DWORD PTR[eax + CONTEXT.Eax]
+    // Return to the trampoline, this'll go to the label below.
+    ret
+
+  return_here:
+
+    // And now after returning through it, capture the context again.
+    push DWORD PTR[esp+8]
+    call DWORD PTR[RtlCaptureContext]
+
+    ret
+  }
+}
+
+}  // namespace
+
+TEST_F(ShadowReturnStackTest, PushRedirectsReturnAddress) {
+  RetAddr caller = frames_[3];
+  Entry* entry = stack_->Push(&frames_[3]);
+  ASSERT_TRUE(entry != NULL);
+  EXPECT_EQ(&frames_[3], entry->return_address_location);
+  EXPECT_EQ(caller, entry->caller);
+  EXPECT_EQ(stack_->trampoline(), frames_[3]);
+  EXPECT_EQ(TestStack::trampoline_address(), frames_[3]);
+
+  stack_->Push(&frames_[2]);
+  EXPECT_EQ(2u, stack_->size());
+  EXPECT_EQ(&frames_[2], stack_->top()->return_address_location);
+}
+
+TEST_F(ShadowReturnStackTest, PushDiscardsUnwoundFrames) {
+  stack_->Push(&frames_[3]);
+  stack_->Push(&frames_[2]);
+  stack_->Push(&frames_[1]);
+  EXPECT_EQ(3u, stack_->size());
+
+  // Simulate the frames at @p frames_[2] and below being unwound by an
+  // exception, and a new frame being entered at the same depth.
+  RetAddr caller = reinterpret_cast<RetAddr>(0x2000);
+  frames_[2] = caller;
+  stack_->Push(&frames_[2]);
+  EXPECT_EQ(2u, stack_->size());
+  EXPECT_EQ(caller, stack_->top()->caller);
+}
+
+TEST_F(ShadowReturnStackTest, FindReturnAddress) {
+  RetAddr caller = frames_[2];
+  stack_->Push(&frames_[2]);
+  stack_->Push(&frames_[1]);
+
+  RetAddr* location = stack_->FindReturnAddress(&frames_[2]);
+  ASSERT_TRUE(location != NULL);
+  EXPECT_EQ(caller, *location);
+
+  EXPECT_EQ(NULL, stack_->FindReturnAddress(&frames_[3]));
+  EXPECT_EQ(NULL, stack_->FindReturnAddress(&frames_[0]));
+}
+
+TEST_F(ShadowReturnStackTest, TailCallsChainEntries) {
+  RetAddr caller = frames_[2];
+  stack_->Push(&frames_[2]);
+
+  // A tail call enters a function with the return address already
+  // redirected.
+  Entry* entry = stack_->Push(&frames_[2]);
+  EXPECT_EQ(2u, stack_->size());
+  EXPECT_EQ(stack_->trampoline(), entry->caller);
+
+  // The real return address is found through the chain.
+  RetAddr* location = stack_->FindReturnAddress(&frames_[2]);
+  ASSERT_TRUE(location != NULL);
+  EXPECT_EQ(caller, *location);
+
+  // Returning from the tail-called function goes to the trampoline again.
+  EXPECT_CALL(*stack_, OnFunctionExit(_, _)).Times(2);
+  EXPECT_EQ(stack_->trampoline(), TestStack::TrampolineMain(&frames_[2], 0));
+  EXPECT_EQ(caller, TestStack::TrampolineMain(&frames_[2], 0));
+  EXPECT_EQ(0u, stack_->size());
+}
+
+TEST_F(ShadowReturnStackTest, ReturnDiscardsUnwoundFrames) {
+  stack_->Push(&frames_[3]);
+  RetAddr caller = frames_[2];
+  stack_->Push(&frames_[2]);
+  stack_->Push(&frames_[1]);
+
+  // Simulate the frame at @p frames_[1] being unwound by an exception, and
+  // the frame above it returning.
+  EXPECT_CALL(*stack_,
+              OnFunctionExit(Pointee(Field(&Entry::caller, caller)), _));
+  EXPECT_EQ(caller, TestStack::TrampolineMain(&frames_[2], 0));
+  EXPECT_EQ(1u, stack_->size());
+  EXPECT_EQ(&frames_[3], stack_->top()->return_address_location);
+}
+
+TEST_F(ShadowReturnStackTest, ReturnCleaningUpArguments) {
+  stack_->Push(&frames_[3]);
+  RetAddr caller = frames_[1];
+  stack_->Push(&frames_[1]);
+
+  // Simulate the frame at @p frames_[1] returning with ret 4, which leaves
+  // the stack pointer above its argument at @p frames_[2].
+  EXPECT_CALL(*stack_,
+              OnFunctionExit(Pointee(Field(&Entry::caller, caller)), _));
+  EXPECT_EQ(caller, TestStack::TrampolineMain(&frames_[2], 0));
+  EXPECT_EQ(1u, stack_->size());
+  EXPECT_EQ(&frames_[3], stack_->top()->return_address_location);
+}
+
+TEST_F(ShadowReturnStackTest, ReturnCleaningUpArgumentsDiscardsUnwoundFrames) {
+  stack_->Push(&frames_[3]);
+  RetAddr caller = frames_[1];
+  stack_->Push(&frames_[1]);
+  stack_->Push(&frames_[0]);
+
+  // Simulate the frame at @p frames_[0] being unwound by an exception, and
+  // the frame above it returning with ret 4.
+  EXPECT_CALL(*stack_,
+              OnFunctionExit(Pointee(Field(&Entry::caller, caller)), _));
+  EXPECT_EQ(caller, TestStack::TrampolineMain(&frames_[2], 0));
+  EXPECT_EQ(1u, stack_->size());
+  EXPECT_EQ(&frames_[3], stack_->top()->return_address_location);
+}
+
+TEST_F(ShadowReturnStackTest, ReturnViaTrampoline) {
+  EXPECT_CALL(*stack_, OnFunctionExit(_, _));
+
+  push_and_return_via_trampoline();
+  EXPECT_EQ(0u, stack_->size());
+}
+
+TEST_F(ShadowReturnStackTest, ReturnViaTrampolineCleaningUpArguments) {
+  EXPECT_CALL(*stack_, OnFunctionExit(_, _));
+
+  push_and_return_via_trampoline_stdcall(1, 2);
+  EXPECT_EQ(0u, stack_->size());
+}
+
+TEST_F(ShadowReturnStackTest, ReturnViaTrampolineFromNestedStdcallFrames) {
+  EXPECT_CALL(*stack_, OnFunctionExit(_, _)).Times(2);
+
+  push_and_call_stdcall_via_trampoline(1);
+  EXPECT_EQ(0u, stack_->size());
+}
+
+TEST_F(ShadowReturnStackTest, ReturnPreservesRegisters) {
+  EXPECT_CALL(*stack_, OnFunctionExit(_, _));
+
+  CONTEXT before = {};
+  CONTEXT after = {};
+  capture_contexts(&before, &after);
+
+  EXPECT_EQ(before.SegGs, after.SegGs);
+  EXPECT_EQ(before.SegFs, after.SegFs);
+  EXPECT_EQ(before.SegEs, after.SegEs);
+  EXPECT_EQ(before.SegDs, after.SegDs);
+
+  EXPECT_EQ(before.Edi, after.Edi);
+  EXPECT_EQ(before.Esi, after.Esi);
+  EXPECT_EQ(before.Ebx, after.Ebx);
+  EXPECT_EQ(before.Edx, after.Edx);
+  EXPECT_EQ(before.Ecx, after.Ecx);
+  EXPECT_EQ(before.Eax, after.Eax);
+
+  EXPECT_EQ(before.Ebp, after.Ebp);
+  EXPECT_EQ(before.Eip, after.Eip);
+  EXPECT_EQ(before.SegCs, after.SegCs);
+  EXPECT_EQ(before.EFlags, after.EFlags);
+  EXPECT_EQ(before.Esp, after.Esp);
+  EXPECT_EQ(before.SegSs, after.SegSs);
+}
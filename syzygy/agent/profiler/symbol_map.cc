@@ -14,15 +14,40 @@
 
 #include "syzygy/agent/profiler/symbol_map.h"
 
+#include <algorithm>
+#include <set>
+
+#include "base/threading/platform_thread.h"
+
 namespace agent {
 namespace profiler {
 
 base::subtle::Atomic32 SymbolMap::Symbol::next_symbol_id_ = 0;
 
-SymbolMap::SymbolMap() {
+namespace {
+
+typedef std::pair<core::AddressRange<const uint8_t*, size_t>,
+                  scoped_refptr<SymbolMap::Symbol>> PageEntry;
+
+// Orders the entries of a page table by their end, so that the first entry
+// ending past an address is the only one that may contain it.
+bool EndsBefore(const PageEntry& entry, const uint8_t* addr) {
+  return entry.first.end() <= addr;
+}
+
+}  // namespace
+
+SymbolMap::SymbolMap() : pages_(new base::subtle::AtomicWord[kPageCount]()),
+                         read_epoch_(0) {
+  readers_[0] = 0;
+  readers_[1] = 0;
 }
 
 SymbolMap::~SymbolMap() {
+  // There can't be any lookups left at this point.
+  for (size_t i = 0; i < kPageCount; ++i)
+    delete reinterpret_cast<PageTable*>(pages_[i]);
+  delete [] pages_;
 }
 
 void SymbolMap::AddSymbol(const void* start_addr,
@@ -36,11 +61,14 @@ void SymbolMap::AddSymbol(const void* start_addr,
     return;
 
   Range range(reinterpret_cast<const uint8_t*>(start_addr), length);
-  RetireRangeUnlocked(range);
+  std::vector<Range> dirty;
+  RetireRangeUnlocked(range, &dirty);
 
-  bool inserted = addr_space_.Insert(
-      Range(reinterpret_cast<const uint8_t*>(start_addr), length), symbol);
+  bool inserted = addr_space_.Insert(range, symbol);
   DCHECK(inserted);
+
+  dirty.push_back(range);
+  PublishUnlocked(dirty);
 }
 
 void SymbolMap::MoveSymbol(const void* old_addr, const void* new_addr) {
@@ -60,41 +88,115 @@ void SymbolMap::MoveSymbol(const void* old_addr, const void* new_addr) {
   // Note the fact that it's been moved.
   symbol->Move(new_addr);
 
+  std::vector<Range> dirty;
+  dirty.push_back(found->first);
   size_t length = found->first.size();
   addr_space_.Remove(found);
 
-  RetireRangeUnlocked(
-      Range(reinterpret_cast<const uint8_t*>(new_addr), length));
+  Range new_range(reinterpret_cast<const uint8_t*>(new_addr), length);
+  RetireRangeUnlocked(new_range, &dirty);
 
-  bool inserted = addr_space_.Insert(
-      Range(reinterpret_cast<const uint8_t*>(new_addr), length), symbol);
+  bool inserted = addr_space_.Insert(new_range, symbol);
   DCHECK(inserted);
+
+  dirty.push_back(new_range);
+  PublishUnlocked(dirty);
 }
 
 scoped_refptr<SymbolMap::Symbol> SymbolMap::FindSymbol(const void* addr) {
-  base::AutoLock hold(lock_);
-
-  SymbolAddressSpace::RangeMapIter found = addr_space_.FindFirstIntersection(
-      Range(reinterpret_cast<const uint8_t*>(addr), 1));
-
-  if (found == addr_space_.end())
-    return NULL;
-
-  return found->second;
+  const uint8_t* ptr = reinterpret_cast<const uint8_t*>(addr);
+
+  // Count ourselves as a reader of the current epoch, so that the table we
+  // look at can't be freed under us.
+  base::subtle::Atomic32 epoch = base::subtle::Acquire_Load(&read_epoch_) & 1;
+  base::subtle::Barrier_AtomicIncrement(&readers_[epoch], 1);
+
+  scoped_refptr<Symbol> symbol;
+  const PageTable* table = reinterpret_cast<const PageTable*>(
+      base::subtle::Acquire_Load(&pages_[PageIndex(ptr)]));
+  if (table != NULL) {
+    PageTable::const_iterator it =
+        std::lower_bound(table->begin(), table->end(), ptr, EndsBefore);
+    if (it != table->end() && it->first.start() <= ptr)
+      symbol = it->second;
+  }
+
+  base::subtle::Barrier_AtomicIncrement(&readers_[epoch], -1);
+
+  return symbol;
 }
 
-void SymbolMap::RetireRangeUnlocked(const Range& range) {
+void SymbolMap::RetireRangeUnlocked(const Range& range,
+                                    std::vector<Range>* dirty) {
   lock_.AssertAcquired();
+  DCHECK(dirty != NULL);
 
   SymbolAddressSpace::RangeMapIterPair found =
       addr_space_.FindIntersecting(range);
   SymbolAddressSpace::iterator it = found.first;
-  for (; it != found.second; ++it)
-    found.first->second->Invalidate();
+  for (; it != found.second; ++it) {
+    it->second->Invalidate();
+    dirty->push_back(it->first);
+  }
 
   addr_space_.Remove(found);
 }
 
+void SymbolMap::PublishUnlocked(const std::vector<Range>& dirty) {
+  lock_.AssertAcquired();
+
+  std::set<size_t> pages;
+  for (size_t i = 0; i < dirty.size(); ++i) {
+    size_t first = PageIndex(dirty[i].start());
+    size_t last = PageIndex(dirty[i].end() - 1);
+    for (size_t page = first; page <= last; ++page)
+      pages.insert(page);
+  }
+
+  // Build and swap in the new tables.
+  std::vector<PageTable*> retired;
+  std::set<size_t>::const_iterator page_it = pages.begin();
+  for (; page_it != pages.end(); ++page_it) {
+    const uint8_t* page_start =
+        reinterpret_cast<const uint8_t*>(*page_it << kPageBits);
+    SymbolAddressSpace::RangeMapIterPair found =
+        addr_space_.FindIntersecting(Range(page_start, 1 << kPageBits));
+
+    PageTable* table = NULL;
+    if (found.first != found.second)
+      table = new PageTable(found.first, found.second);
+
+    PageTable* old_table = reinterpret_cast<PageTable*>(
+        base::subtle::NoBarrier_Load(&pages_[*page_it]));
+    base::subtle::Release_Store(&pages_[*page_it],
+                                reinterpret_cast<base::subtle::AtomicWord>(
+                                    table));
+    if (old_table != NULL)
+      retired.push_back(old_table);
+  }
+
+  if (retired.empty())
+    return;
+
+  WaitForReadersUnlocked();
+  for (size_t i = 0; i < retired.size(); ++i)
+    delete retired[i];
+}
+
+void SymbolMap::WaitForReadersUnlocked() {
+  lock_.AssertAcquired();
+
+  // A lookup may have picked either epoch before the new tables were
+  // published, so both reader counts must drain. Switching epochs before
+  // each wait keeps new lookups from holding up the wait.
+  for (size_t i = 0; i < 2; ++i) {
+    base::subtle::Atomic32 epoch =
+        base::subtle::Barrier_AtomicIncrement(&read_epoch_, 1) - 1;
+    while (base::subtle::Acquire_Load(&readers_[epoch & 1]) != 0)
+      base::PlatformThread::YieldCurrentThread();
+  }
+}
+
 SymbolMap::Symbol::Symbol(const base::StringPiece& name, const void* address)
     : name_(name.begin(), name.end()),
       move_count_(0),
@@ -15,8 +15,9 @@
 #ifndef SYZYGY_AGENT_PROFILER_SYMBOL_MAP_H_
 #define SYZYGY_AGENT_PROFILER_SYMBOL_MAP_H_
 
-#include "base/atomicops.h"
+#include <vector>
 
+#include "base/atomicops.h"
 #include "base/memory/ref_counted.h"
 #include "base/strings/string_piece.h"
 #include "base/synchronization/lock.h"
@@ -29,6 +30,13 @@ namespace profiler {
 // resolving addresses of dynamically generated, garbage collected code, to
 // names in a profiler. This is geared to allow entry/exit processing in a
 // profiler to execute as quickly as possible.
+//
+// Lookups don't lock. The address space is split in pages, each of which has
+// an immutable table of the symbols that intersect it. Updates are serialized,
+// and publish new tables for the pages they touch. The tables they replace
+// are freed once the lookups that may be using them are done, which is
+// tracked in the manner of RCU: each lookup counts itself in one of two
+// reader counts, which updates alternate between and wait to drain.
 class SymbolMap {
  public:
   class Symbol;
@@ -52,6 +60,7 @@ class SymbolMap {
   // Find the symbol covering @p addr, if any.
   // @param addr an address to query.
   // @returns the symbol covering @p addr, if any, or NULL otherwise.
+  // @note This doesn't lock, and may be called concurrently with updates.
   scoped_refptr<Symbol> FindSymbol(const void* addr);
 
  protected:
@@ -59,12 +68,45 @@ class SymbolMap {
       SymbolAddressSpace;
   typedef SymbolAddressSpace::Range Range;
 
+  // The address space is split in pages of 2^kPageBits bytes. This assumes
+  // 32-bit addresses, as do the profiler's hooks.
+  static const size_t kPageBits = 16;
+  static const size_t kPageCount = 1 << (32 - kPageBits);
+
+  // The immutable table of the symbols intersecting a page, in address
+  // order.
+  typedef std::vector<std::pair<Range, scoped_refptr<Symbol>>> PageTable;
+
   // Retire any symbols overlapping @p range.
-  void RetireRangeUnlocked(const Range& range);
+  // @param range the range to clear.
+  // @param dirty has the ranges of the retired symbols appended to it.
+  void RetireRangeUnlocked(const Range& range, std::vector<Range>* dirty);
+
+  // Publishes new tables for the pages intersecting @p dirty, then frees the
+  // tables they replace once no lookup can be using them.
+  // @param dirty the ranges whose symbols changed.
+  void PublishUnlocked(const std::vector<Range>& dirty);
+
+  // Waits for the lookups in progress to be done.
+  void WaitForReadersUnlocked();
+
+  // @returns the index of the page containing @p addr.
+  static size_t PageIndex(const uint8_t* addr) {
+    return reinterpret_cast<uintptr_t>(addr) >> kPageBits;
+  }
 
   base::Lock lock_;
   SymbolAddressSpace addr_space_;  // Under lock_.
 
+  // The published table of each page, or NULL if no symbol intersects it.
+  // These are read without locking, and replaced under lock_.
+  base::subtle::AtomicWord* pages_;
+
+  // The number of lookups in progress in each of the two read epochs, and
+  // the current read epoch. The epoch only changes under lock_.
+  base::subtle::Atomic32 readers_[2];
+  base::subtle::Atomic32 read_epoch_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(SymbolMap);
 };
@@ -175,5 +175,30 @@ TEST_F(SymbolMapTest, SymbolLifeCycle) {
   EXPECT_EQ(ToPtr(NULL), symbol->address());
 }
 
+TEST_F(SymbolMapTest, SymbolsSpanningPages) {
+  // A symbol straddling a page boundary is found from both pages.
+  symbol_map_.AddSymbol(ToPtr(0x1FFF0), 0x20, "straddling");
+  scoped_refptr<SymbolMap::Symbol> symbol =
+      symbol_map_.FindSymbol(ToPtr(0x1FFF0));
+  ASSERT_TRUE(symbol != NULL);
+  EXPECT_EQ(symbol, symbol_map_.FindSymbol(ToPtr(0x20000)));
+  EXPECT_EQ(symbol, symbol_map_.FindSymbol(ToPtr(0x2000F)));
+  EXPECT_TRUE(symbol_map_.FindSymbol(ToPtr(0x20010)) == NULL);
+
+  // A symbol overlapping only the first page retires it from both pages.
+  symbol_map_.AddSymbol(ToPtr(0x1FF00), 0xF8, "overlapping");
+  EXPECT_TRUE(symbol->invalid());
+  EXPECT_TRUE(symbol_map_.FindSymbol(ToPtr(0x20000)) == NULL);
+  scoped_refptr<SymbolMap::Symbol> overlapping =
+      symbol_map_.FindSymbol(ToPtr(0x1FFF0));
+  ASSERT_TRUE(overlapping != NULL);
+  EXPECT_EQ("overlapping", overlapping->name());
+
+  // Moving a symbol to another page updates both pages.
+  symbol_map_.MoveSymbol(ToPtr(0x1FF00), ToPtr(0x50000));
+  EXPECT_TRUE(symbol_map_.FindSymbol(ToPtr(0x1FFF0)) == NULL);
+  EXPECT_EQ(overlapping, symbol_map_.FindSymbol(ToPtr(0x50010)));
+}
+
 }  // namespace profiler
 }  // namespace agent
@@ -20,11 +20,15 @@
 #include "base/files/file_enumerator.h"
 #include "base/files/file_path.h"
 #include "base/files/file_util.h"
+#include "base/sys_info.h"
 
 namespace application {
 
 AppImplBase::AppImplBase(const base::StringPiece& name)
-    : in_(stdin), out_(stdout), err_(stderr) {
+    : in_(stdin),
+      out_(stdout),
+      err_(stderr),
+      jobs_(base::SysInfo::NumberOfProcessors()) {
   name_.assign(name.begin(), name.end());
 }
 
@@ -32,6 +36,23 @@ bool AppImplBase::ParseCommandLine(const base::CommandLine* command_line) {
   return true;
 }
 
+bool AppImplBase::ParseJobsSwitch(const base::CommandLine* command_line) {
+  DCHECK(command_line != NULL);
+
+  static const char kJobs[] = "jobs";
+  if (!command_line->HasSwitch(kJobs))
+    return true;
+
+  std::string value = command_line->GetSwitchValueASCII(kJobs);
+  size_t jobs = 0;
+  if (!base::StringToSizeT(value, &jobs) || jobs == 0) {
+    LOG(ERROR) << "Invalid value for --" << kJobs << ": " << value << ".";
+    return false;
+  }
+  jobs_ = jobs;
+  return true;
+}
+
 bool AppImplBase::SetUp() {
   return true;
 }
@@ -24,6 +24,8 @@
         'application.cc',
         'application.h',
         'application_impl.h',
+        'work_pool.cc',
+        'work_pool.h',
       ],
       'dependencies': [
         '<(src)/base/base.gyp:base',
@@ -40,6 +42,7 @@
       'type': 'executable',
       'sources': [
         'application_unittest.cc',
+        'work_pool_unittest.cc',
         '<(src)/syzygy/testing/run_all_unittests.cc',
       ],
       'dependencies': [
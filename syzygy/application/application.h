@@ -110,6 +110,26 @@ class AppImplBase {
   // Get the application name.
   const std::string& name() const { return name_; }
 
+  // @name Concurrency.
+  // The number of threads the application may use for its parallel work,
+  // which defaults to the number of processors. The framework sets this from
+  // the --jobs=N switch before calling ParseCommandLine, and a WorkPool of
+  // this size runs the work. The output of an application must not depend on
+  // this number.
+  // @{
+  size_t jobs() const { return jobs_; }
+  void set_jobs(size_t jobs) {
+    DCHECK_LT(0u, jobs);
+    jobs_ = jobs;
+  }
+  // @}
+
+  // Parses the --jobs=N switch of @p command_line. The number of jobs is left
+  // unchanged when the switch is absent.
+  // @param command_line the command line to parse.
+  // @returns true on success, false if the number of jobs isn't positive.
+  bool ParseJobsSwitch(const base::CommandLine* command_line);
+
   // @name IO Stream Accessors
   // @{
   FILE* in() const { return in_; }
@@ -180,6 +200,9 @@ class AppImplBase {
   FILE* out_;
   FILE* err_;
   // @}
+
+  // The number of threads the application may use.
+  size_t jobs_;
 };
 
 // Flags controlling the initialization of the logging subsystem.
@@ -52,6 +52,9 @@ int Application<Impl, kInitLogging>::Run() {
   if (!com_initializer.succeeded())
     return 1;
 
+  if (!implementation_.ParseJobsSwitch(command_line_))
+    return 1;
+
   if (!implementation_.ParseCommandLine(command_line_))
     return 1;
 
@@ -138,6 +138,25 @@ TEST_F(ApplicationTest, AppImplBaseVerbosity) {
   ASSERT_EQ(-2, logging::GetMinLogLevel());
 }
 
+TEST_F(ApplicationTest, AppImplBaseJobs) {
+  EXPECT_LT(0u, test_app_.implementation().jobs());
+
+  cmd_line_.AppendSwitchASCII("jobs", "3");
+  test_app_.set_command_line(&cmd_line_);
+  ASSERT_EQ(0, test_app_.Run());
+  EXPECT_EQ(3u, test_app_.implementation().jobs());
+}
+
+TEST_F(ApplicationTest, AppImplBaseInvalidJobsFails) {
+  base::CommandLine cmd_line(base::FilePath(L"test.exe"));
+  cmd_line.AppendSwitchASCII("jobs", "0");
+  EXPECT_FALSE(test_app_.implementation().ParseJobsSwitch(&cmd_line));
+
+  cmd_line_.AppendSwitchASCII("jobs", "many");
+  test_app_.set_command_line(&cmd_line_);
+  EXPECT_NE(0, test_app_.Run());
+}
+
 TEST_F(ApplicationTest, MockAppFailsCommandLineParsing) {
   MockAppImpl& mock_impl = mock_app_.implementation();
 
@@ -0,0 +1,84 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/application/work_pool.h"
+
+#include <algorithm>
+
+#include "base/atomicops.h"
+#include "base/logging.h"
+#include "base/threading/simple_thread.h"
+
+namespace application {
+
+namespace {
+
+// Claims and processes the work items until they're exhausted or one fails.
+class WorkItemRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  WorkItemRunner(size_t item_count,
+                 const WorkPool::WorkItemCallback& callback)
+      : item_count_(item_count), callback_(callback), next_(0), failed_(0) {
+  }
+
+  void Run() override {
+    while (!base::subtle::NoBarrier_Load(&failed_)) {
+      size_t index = static_cast<size_t>(
+          base::subtle::NoBarrier_AtomicIncrement(&next_, 1) - 1);
+      if (index >= item_count_)
+        return;
+      if (!callback_.Run(index))
+        base::subtle::NoBarrier_Store(&failed_, 1);
+    }
+  }
+
+  bool failed() const { return base::subtle::NoBarrier_Load(&failed_) != 0; }
+
+ private:
+  const size_t item_count_;
+  const WorkPool::WorkItemCallback& callback_;
+
+  // The index of the next unclaimed item.
+  base::subtle::Atomic32 next_;
+  // Set when an item fails.
+  base::subtle::Atomic32 failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(WorkItemRunner);
+};
+
+}  // namespace
+
+WorkPool::WorkPool(size_t thread_count) : thread_count_(thread_count) {
+  DCHECK_LT(0u, thread_count_);
+}
+
+bool WorkPool::Run(size_t item_count, const WorkItemCallback& callback) const {
+  DCHECK(!callback.is_null());
+
+  WorkItemRunner runner(item_count, callback);
+  size_t worker_count = std::min(thread_count_, item_count);
+  if (worker_count <= 1) {
+    runner.Run();
+  } else {
+    base::DelegateSimpleThreadPool pool("WorkPool",
+                                        static_cast<int>(worker_count));
+    pool.AddWork(&runner, static_cast<int>(worker_count));
+    pool.Start();
+    pool.JoinAll();
+  }
+
+  return !runner.failed();
+}
+
+}  // namespace application
@@ -0,0 +1,71 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares WorkPool, which processes the independent work items of an
+// operation on several threads.
+
+#ifndef SYZYGY_APPLICATION_WORK_POOL_H_
+#define SYZYGY_APPLICATION_WORK_POOL_H_
+
+#include "base/callback.h"
+#include "base/macros.h"
+
+namespace application {
+
+// Runs the work items of an operation on a pool of threads. The items are
+// identified by their index, and each thread claims the next unclaimed item
+// as soon as it's done with its previous one, so that the threads stay busy
+// when the items vary in cost.
+//
+// The items are processed in no particular order. To produce the same output
+// for any number of threads, each item should store its result in a slot of
+// its own, and the results should be merged in index order once Run returns:
+//
+//     std::vector<Result> results(items.size());
+//     WorkPool pool(app.jobs());
+//     if (!pool.Run(items.size(), base::Bind(&ProcessItem, &items, &results)))
+//       return false;
+//     for (const Result& result : results)
+//       Merge(result);
+class WorkPool {
+ public:
+  // Processes a work item. This is called concurrently from the threads of
+  // the pool.
+  // @param index the index of the work item.
+  // @returns true on success, false on failure.
+  typedef base::Callback<bool(size_t index)> WorkItemCallback;
+
+  // @param thread_count the maximum number of threads the pool runs.
+  explicit WorkPool(size_t thread_count);
+
+  // Processes the work items [0, @p item_count). This uses at most one
+  // thread per item, and runs on the calling thread when there's a single
+  // thread or item. No item is started once an item fails.
+  // @param item_count the number of work items.
+  // @param callback the callback that processes each item.
+  // @returns true if all the items succeeded, false otherwise.
+  bool Run(size_t item_count, const WorkItemCallback& callback) const;
+
+  // @returns the maximum number of threads the pool runs.
+  size_t thread_count() const { return thread_count_; }
+
+ private:
+  size_t thread_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(WorkPool);
+};
+
+}  // namespace application
+
+#endif  // SYZYGY_APPLICATION_WORK_POOL_H_
@@ -0,0 +1,66 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/application/work_pool.h"
+
+#include <vector>
+
+#include "base/bind.h"
+#include "gtest/gtest.h"
+
+namespace application {
+
+namespace {
+
+bool SquareItem(std::vector<size_t>* results, size_t index) {
+  (*results)[index] = index * index;
+  return true;
+}
+
+bool FailItem(size_t failing_index, size_t index) {
+  return index != failing_index;
+}
+
+}  // namespace
+
+TEST(WorkPoolTest, ProcessesAllItems) {
+  const size_t kItemCount = 1000;
+  for (size_t thread_count = 1; thread_count <= 4; ++thread_count) {
+    WorkPool pool(thread_count);
+    EXPECT_EQ(thread_count, pool.thread_count());
+
+    std::vector<size_t> results(kItemCount, 0);
+    EXPECT_TRUE(pool.Run(kItemCount, base::Bind(&SquareItem, &results)));
+    for (size_t i = 0; i < kItemCount; ++i)
+      EXPECT_EQ(i * i, results[i]);
+  }
+}
+
+TEST(WorkPoolTest, NoItems) {
+  WorkPool pool(4);
+  std::vector<size_t> results;
+  EXPECT_TRUE(pool.Run(0, base::Bind(&SquareItem, &results)));
+}
+
+TEST(WorkPoolTest, FailureIsReported) {
+  const size_t kFailingIndex = 42;
+  WorkPool serial_pool(1);
+  EXPECT_FALSE(serial_pool.Run(100, base::Bind(&FailItem, kFailingIndex)));
+
+  WorkPool parallel_pool(4);
+  EXPECT_FALSE(parallel_pool.Run(100, base::Bind(&FailItem, kFailingIndex)));
+  EXPECT_TRUE(parallel_pool.Run(10, base::Bind(&FailItem, kFailingIndex)));
+}
+
+}  // namespace application
@@ -14,11 +14,13 @@
 
 #include "syzygy/ar/ar_transform.h"
 
+#include <vector>
+
 #include "base/bind.h"
 #include "base/logging.h"
 #include "base/files/file_util.h"
-#include "base/memory/scoped_vector.h"
 #include "base/strings/stringprintf.h"
+#include "syzygy/application/work_pool.h"
 #include "syzygy/ar/ar_reader.h"
 #include "syzygy/ar/ar_writer.h"
 
@@ -39,6 +41,32 @@ struct FileDeleter {
   const base::FilePath& path_;
 };
 
+// A file extracted from an archive, and the result of its transform.
+struct ArchivedFile {
+  ArchivedFile() : remove(false), succeeded(false) { }
+
+  ParsedArFileHeader header;
+  DataBuffer contents;
+  bool remove;
+  bool succeeded;
+};
+
+// Applies a transform callback to an extracted file, as the work items of a
+// WorkPool.
+// @param callback the transform callback.
+// @param files the extracted files.
+// @param index the index of the file to transform.
+// @returns true on success, false otherwise.
+bool TransformArchivedFile(const ArTransform::TransformFileCallback* callback,
+                           std::vector<ArchivedFile>* files,
+                           size_t index) {
+  ArchivedFile& file = files->at(index);
+  LOG(INFO) << "Processing file " << (index + 1) << " of "
+            << files->size() << ": " << file.header.name;
+  file.succeeded = callback->Run(&file.header, &file.contents, &file.remove);
+  return file.succeeded;
+}
+
 }  // namespace
 
 bool ArTransform::Transform() {
@@ -51,37 +79,33 @@ bool ArTransform::Transform() {
     return false;
   LOG(INFO) << "Read " << reader.symbols().size() << " symbols.";
 
-  // This collection of buffers must outlive the ArWriter below.
-  ScopedVector<DataBuffer> buffers;
-
-  // Iterate over the files in the archive.
-  ArWriter writer;
-  for (size_t i = 0; i < reader.offsets().size(); ++i) {
-    // Extract the next file.
-    ParsedArFileHeader header;
-    std::unique_ptr<DataBuffer> buffer(new DataBuffer());
-    if (!reader.ExtractNext(&header, buffer.get()))
+  // Extract all of the files in the archive. They must outlive the ArWriter
+  // below.
+  std::vector<ArchivedFile> files(reader.offsets().size());
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (!reader.ExtractNext(&files[i].header, &files[i].contents))
       return false;
+  }
 
-    LOG(INFO) << "Processing file " << (i + 1) << " of "
-              << reader.offsets().size() << ": " << header.name;
+  // Apply the transform to all of the files.
+  application::WorkPool pool(thread_count_);
+  pool.Run(files.size(),
+           base::Bind(&TransformArchivedFile, &callback_, &files));
 
-    // Apply the transform to this file.
-    bool remove = false;
-    if (!callback_.Run(&header, buffer.get(), &remove))
+  // Add the transformed files to the output archive, in their original order.
+  ArWriter writer;
+  for (size_t i = 0; i < files.size(); ++i) {
+    ArchivedFile& file = files[i];
+    if (!file.succeeded)
       return false;
 
-    if (remove)
+    if (file.remove)
       continue;
 
-    // Add the transformed file to the output archive.
-    if (!writer.AddFile(header.name, header.timestamp, header.mode,
-                        buffer.get())) {
+    if (!writer.AddFile(file.header.name, file.header.timestamp,
+                        file.header.mode, &file.contents)) {
       return false;
     }
-
-    // Save the buffer so we keep it around until the writer has finished.
-    buffers.push_back(buffer.release());
   }
 
   if (!writer.Write(output_archive_))
@@ -109,20 +133,25 @@ OnDiskArTransformAdapter::~OnDiskArTransformAdapter() {
 bool OnDiskArTransformAdapter::Transform(ParsedArFileHeader* header,
                                          DataBuffer* contents,
                                          bool* remove) {
-  if (temp_dir_.empty()) {
-    if (!base::CreateNewTempDirectory(L"OnDiskArTransformAdapter",
-                                           &temp_dir_)) {
-      LOG(ERROR) << "Unable to create temporary directory.";
-      return false;
+  base::FilePath input_path;
+  base::FilePath output_path;
+  {
+    base::AutoLock auto_lock(lock_);
+    if (temp_dir_.empty()) {
+      if (!base::CreateNewTempDirectory(L"OnDiskArTransformAdapter",
+                                             &temp_dir_)) {
+        LOG(ERROR) << "Unable to create temporary directory.";
+        return false;
+      }
     }
-  }
 
-  // Create input and output file names.
-  base::FilePath input_path = temp_dir_.Append(
-      base::StringPrintf(L"input-%04d.obj", index_));
-  base::FilePath output_path = temp_dir_.Append(
-      base::StringPrintf(L"output-%04d.obj", index_));
-  ++index_;
+    // Create input and output file names.
+    input_path = temp_dir_.Append(
+        base::StringPrintf(L"input-%04d.obj", index_));
+    output_path = temp_dir_.Append(
+        base::StringPrintf(L"output-%04d.obj", index_));
+    ++index_;
+  }
 
   // Set up deleters for these files.
   FileDeleter input_deleter(input_path);
@@ -22,12 +22,15 @@
 #include "base/callback.h"
 #include "base/logging.h"
 #include "base/files/file_path.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/ar/ar_common.h"
 
 namespace ar {
 
 // A class for transforming all of the object files contained in an
-// archive, and repackaging them into an archive.
+// archive, and repackaging them into an archive. The files are independent,
+// so they can be transformed concurrently; they are repackaged in their
+// original order regardless.
 class ArTransform {
  public:
   // The type of callback that will be invoked for each object file
@@ -44,7 +47,7 @@ class ArTransform {
       TransformFileCallback;
 
   // Constructor.
-  ArTransform() { }
+  ArTransform() : thread_count_(1) { }
 
   // Applies the transform. The transform must already have been configured.
   // @returns true on success, false otherwise.
@@ -72,6 +75,15 @@ class ArTransform {
     DCHECK(!callback.is_null());
     callback_ = callback;
   }
+
+  // Sets the number of threads that transform the files. This defaults to 1.
+  // If more than one thread is used the callback must be thread safe, as it
+  // is invoked concurrently for different files.
+  // @param thread_count The number of threads, which must be at least 1.
+  void set_thread_count(size_t thread_count) {
+    DCHECK_LT(0u, thread_count);
+    thread_count_ = thread_count;
+  }
   // @}
 
   // @name Accessors.
@@ -84,18 +96,23 @@ class ArTransform {
 
   // @returns the callback.
   TransformFileCallback callback() const { return callback_; }
+
+  // @returns the number of threads that transform the files.
+  size_t thread_count() const { return thread_count_; }
   // @}
 
  private:
   base::FilePath input_archive_;
   base::FilePath output_archive_;
   TransformFileCallback callback_;
+  size_t thread_count_;
 
   DISALLOW_COPY_AND_ASSIGN(ArTransform);
 };
 
 // A callback adapter that allows transforms to modify the files
-// on disk rather than in memory. This is not thread safe.
+// on disk rather than in memory. The outer callback is thread safe, provided
+// that the inner callback is.
 class OnDiskArTransformAdapter {
  public:
   typedef ArTransform::TransformFileCallback TransformFileCallback;
@@ -146,6 +163,9 @@ class OnDiskArTransformAdapter {
   // Temporary directory where files are produced.
   base::FilePath temp_dir_;
   size_t index_;
+
+  // Protects temp_dir_ and index_.
+  base::Lock lock_;
 };
 
 }  // namespace ar
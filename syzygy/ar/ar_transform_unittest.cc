@@ -137,6 +137,39 @@ TEST_F(ArTransformTest, TransformIdentityInMemory) {
   EXPECT_EQ(testing::kArchiveFileCount, reader.offsets().size());
 }
 
+TEST_F(ArTransformTest, TransformIdentityOnDiskInParallel) {
+  ArTransform tx;
+  EXPECT_EQ(1u, tx.thread_count());
+  tx.set_thread_count(4);
+  EXPECT_EQ(4u, tx.thread_count());
+  tx.set_input_archive(input_archive_);
+  tx.set_output_archive(output_archive_);
+  tx.set_callback(on_disk_adapter_.outer_callback());
+
+  EXPECT_CALL(*this, OnDiskCallback(_, _, _, _))
+      .Times(testing::kArchiveFileCount)
+      .WillRepeatedly(Invoke(this, &ArTransformTest::OnDiskCallbackCopyFile));
+
+  EXPECT_TRUE(tx.Transform());
+
+  // The files are in their original order in the output archive.
+  ArReader input_reader;
+  ArReader output_reader;
+  ASSERT_TRUE(input_reader.Init(input_archive_));
+  ASSERT_TRUE(output_reader.Init(output_archive_));
+  ASSERT_EQ(testing::kArchiveFileCount, output_reader.offsets().size());
+  for (size_t i = 0; i < testing::kArchiveFileCount; ++i) {
+    ParsedArFileHeader input_header;
+    ParsedArFileHeader output_header;
+    DataBuffer input_contents;
+    DataBuffer output_contents;
+    ASSERT_TRUE(input_reader.ExtractNext(&input_header, &input_contents));
+    ASSERT_TRUE(output_reader.ExtractNext(&output_header, &output_contents));
+    EXPECT_EQ(input_header.name, output_header.name);
+    EXPECT_EQ(input_contents, output_contents);
+  }
+}
+
 TEST_F(ArTransformTest, TransformFailsOnDiskCallbackFails) {
     ArTransform tx;
   tx.set_input_archive(input_archive_);
@@ -155,6 +155,22 @@ class AssemblerBase {
   void popad();
   // @}
 
+  // @name Fixed-shape instructions.
+  // The registers of these instructions are template parameters, so that
+  // their opcode and ModR/M bytes are computed at compile time. They produce
+  // the same bytes as the generic instructions, without going through the
+  // operand encoding logic, and are meant for the instrumentation sequences
+  // that are emitted a great many times.
+  // @{
+  template <RegisterId kReg> void push();
+  template <RegisterId kReg> void pop();
+  // Encodes mov dst, imm32.
+  template <RegisterId kDst> void mov(const Immediate& src);
+  // Encodes lea dst, [base + disp32]. @p disp must be 32-bit.
+  template <RegisterId kDst, RegisterId kBase>
+  void lea(const Displacement& disp);
+  // @}
+
   // @name Flag manipulation.
   // @{
   void pushfd();
@@ -284,6 +300,19 @@ class AssemblerBase {
   // Output the instruction data in @p instr to our delegate.
   void Output(const InstructionBuffer& instr);
 
+  // Output the bytes of a fixed-shape instruction to our delegate.
+  // @param bytes The bytes of the instruction.
+  // @param num_bytes The number of bytes of the instruction.
+  // @param reference The reference of the instruction, if it's valid.
+  // @param reference_offset The offset of the 32-bit value of @p reference.
+  // @param pc_relative True iff @p reference is PC-relative.
+  void OutputFixed(const uint8_t* bytes, size_t num_bytes);
+  void OutputFixed(const uint8_t* bytes,
+                   size_t num_bytes,
+                   const ReferenceType& reference,
+                   size_t reference_offset,
+                   bool pc_relative);
+
   // Finalizes the use of an unbound label.
   bool FinalizeLabel(uint32_t location,
                      uint32_t destination,
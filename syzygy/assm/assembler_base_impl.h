@@ -145,6 +145,22 @@ bool IsValidReference(const ReferenceType& ref) {
   return ref.IsValid();
 }
 
+// The code of a 32-bit register, as a compile-time constant.
+template <RegisterId kReg>
+struct Register32Code {
+  static_assert(kReg >= kRegister32Min && kReg < kRegister32Max,
+                "Fixed-shape instructions take 32-bit registers.");
+  static const uint8_t kValue = static_cast<uint8_t>(kReg & 0x7);
+};
+
+// Stores @p value in little-endian order at @p buf.
+inline void Store32BitValue(uint32_t value, uint8_t* buf) {
+  buf[0] = static_cast<uint8_t>(value);
+  buf[1] = static_cast<uint8_t>(value >> 8);
+  buf[2] = static_cast<uint8_t>(value >> 16);
+  buf[3] = static_cast<uint8_t>(value >> 24);
+}
+
 }  // namespace details
 
 // Returns true if @p operand is a displacement only - e.g.
@@ -646,10 +662,14 @@ void AssemblerBase<ReferenceType>::nop(size_t size) {
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::call(const Immediate& dst) {
-  InstructionBuffer instr(this);
+  DCHECK_EQ(kSize32Bit, dst.size());
 
-  instr.EmitOpCodeByte(0xE8);
-  instr.Emit32BitPCRelative(location_, dst);
+  // The call has a single shape, a fixed opcode followed by a 32-bit value
+  // relative to the end of the instruction.
+  uint8_t bytes[5] = { 0xE8 };
+  details::Store32BitValue(dst.value() - (location_ + sizeof(bytes)),
+                           bytes + 1);
+  OutputFixed(bytes, sizeof(bytes), dst.reference(), 1, true);
 }
 
 template <class ReferenceType>
@@ -981,6 +1001,53 @@ void AssemblerBase<ReferenceType>::popad() {
   instr.EmitOpCodeByte(0x61);
 }
 
+template <class ReferenceType>
+template <RegisterId kReg>
+void AssemblerBase<ReferenceType>::push() {
+  static const uint8_t kBytes[] = {
+      0x50 | details::Register32Code<kReg>::kValue };
+  OutputFixed(kBytes, sizeof(kBytes));
+}
+
+template <class ReferenceType>
+template <RegisterId kReg>
+void AssemblerBase<ReferenceType>::pop() {
+  static const uint8_t kBytes[] = {
+      0x58 | details::Register32Code<kReg>::kValue };
+  OutputFixed(kBytes, sizeof(kBytes));
+}
+
+template <class ReferenceType>
+template <RegisterId kDst>
+void AssemblerBase<ReferenceType>::mov(const Immediate& src) {
+  DCHECK_NE(kSizeNone, src.size());
+
+  uint8_t bytes[5] = { 0xB8 | details::Register32Code<kDst>::kValue };
+  details::Store32BitValue(src.value(), bytes + 1);
+  OutputFixed(bytes, sizeof(bytes), src.reference(), 1, false);
+}
+
+template <class ReferenceType>
+template <RegisterId kDst, RegisterId kBase>
+void AssemblerBase<ReferenceType>::lea(const Displacement& disp) {
+  DCHECK_EQ(kSize32Bit, disp.size());
+
+  // The [ESP + disp32] mode can only be encoded with a SIB byte.
+  static const bool kHasSib = kBase == kRegisterEsp;
+  static const size_t kDispOffset = kHasSib ? 3 : 2;
+
+  // The third byte is the SIB byte for [ESP], which the displacement
+  // overwrites when there's no SIB byte.
+  uint8_t bytes[kDispOffset + 4] = {
+      0x8D,
+      static_cast<uint8_t>((kReg1WordDisp << 6) |
+                           (details::Register32Code<kDst>::kValue << 3) |
+                           details::Register32Code<kBase>::kValue),
+      0x24 };
+  details::Store32BitValue(disp.value(), bytes + kDispOffset);
+  OutputFixed(bytes, sizeof(bytes), disp.reference(), kDispOffset, false);
+}
+
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::pushfd() {
   InstructionBuffer instr(this);
@@ -1463,6 +1530,30 @@ void AssemblerBase<ReferenceType>::Output(const InstructionBuffer& instr) {
   location_ += instr.len();
 }
 
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::OutputFixed(const uint8_t* bytes,
+                                               size_t num_bytes) {
+  serializer_->AppendInstruction(location_, bytes, num_bytes, NULL, 0);
+  location_ += num_bytes;
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::OutputFixed(const uint8_t* bytes,
+                                               size_t num_bytes,
+                                               const ReferenceType& reference,
+                                               size_t reference_offset,
+                                               bool pc_relative) {
+  if (!details::IsValidReference(reference)) {
+    OutputFixed(bytes, num_bytes);
+    return;
+  }
+
+  ReferenceInfo info = { reference_offset, reference, kSize32Bit,
+                         pc_relative };
+  serializer_->AppendInstruction(location_, bytes, num_bytes, &info, 1);
+  location_ += num_bytes;
+}
+
 template <class ReferenceType>
 bool AssemblerBase<ReferenceType>::FinalizeLabel(uint32_t location,
                                                  uint32_t destination,
@@ -815,6 +815,45 @@ TEST_F(AssemblerTest, Flags) {
   EXPECT_BYTES(0x9C, 0x9D, 0x9F, 0x9E);
 }
 
+TEST_F(AssemblerTest, FixedShapeInstructions) {
+  asm_.push<kRegisterEax>();
+  asm_.push<kRegisterEdi>();
+  asm_.pop<kRegisterEbx>();
+  EXPECT_BYTES(0x50, 0x57, 0x5B);
+
+  asm_.mov<kRegisterEcx>(Immediate(0xCAFEBABE, kSize32Bit, NULL));
+  EXPECT_BYTES(0xB9, 0xBE, 0xBA, 0xFE, 0xCA);
+
+  asm_.lea<kRegisterEax, kRegisterEcx>(
+      Displacement(0xCAFEBABE, kSize32Bit, NULL));
+  EXPECT_BYTES(0x8D, 0x81, 0xBE, 0xBA, 0xFE, 0xCA);
+
+  // The [ESP + disp32] mode takes a SIB byte.
+  asm_.lea<kRegisterEdx, kRegisterEsp>(
+      Displacement(0xCAFEBABE, kSize32Bit, NULL));
+  EXPECT_BYTES(0x8D, 0x94, 0x24, 0xBE, 0xBA, 0xFE, 0xCA);
+
+  // The generic instructions produce the same bytes.
+  asm_.lea(edx, Operand(esp, Displacement(0xCAFEBABE, kSize32Bit, NULL)));
+  EXPECT_BYTES(0x8D, 0x94, 0x24, 0xBE, 0xBA, 0xFE, 0xCA);
+  EXPECT_EQ(7U, serializer_.instructions.size());
+  EXPECT_EQ(28U, asm_.location());
+}
+
+TEST_F(AssemblerTest, FixedShapeInstructionsReferences) {
+  int ref1 = 1;
+  int ref2 = 2;
+  asm_.mov<kRegisterEax>(Immediate(0, kSize32Bit, &ref1));
+  asm_.lea<kRegisterEdx, kRegisterEsp>(Displacement(0, kSize32Bit, &ref2));
+  asm_.push<kRegisterEdx>();
+
+  ASSERT_EQ(2U, serializer_.references.size());
+  EXPECT_EQ(1U, serializer_.references[0].location);
+  EXPECT_EQ(&ref1, serializer_.references[0].ref);
+  EXPECT_EQ(8U, serializer_.references[1].location);
+  EXPECT_EQ(&ref2, serializer_.references[1].ref);
+}
+
 TEST_F(AssemblerTest, TestByte) {
   asm_.test(al, bl);
   EXPECT_BYTES(0x84, 0xC3);
@@ -19,7 +19,69 @@
 namespace bard {
 namespace backdrops {
 
-HeapBackdrop::HeapBackdrop() {
+namespace {
+
+const size_t kLatencySubBucketCount =
+    static_cast<size_t>(1) << HeapBackdrop::kLatencySubBucketBits;
+
+}  // namespace
+
+HeapBackdrop::HeapBackdrop() : process_heap_(::GetProcessHeap()) {
+  for (int type = 0; type < EventInterface::kMaxEventType; ++type) {
+    Stats stats = {};
+    total_stats_.insert(std::make_pair(static_cast<EventType>(type), stats));
+  }
+}
+
+// static
+size_t HeapBackdrop::GetLatencyBucket(uint64_t time) {
+  // The times below kLatencySubBucketCount get a bucket each. Above that the
+  // bucket is given by the position of the top bit and the bits that follow.
+  if (time < kLatencySubBucketCount)
+    return static_cast<size_t>(time);
+
+  size_t log = 63;
+  while ((time >> log) == 0)
+    --log;
+  size_t shift = log - kLatencySubBucketBits;
+  size_t sub_bucket =
+      static_cast<size_t>(time >> shift) & (kLatencySubBucketCount - 1);
+  size_t bucket = ((shift + 1) << kLatencySubBucketBits) + sub_bucket;
+  DCHECK_LT(bucket, kLatencyBucketCount);
+  return bucket;
+}
+
+// static
+uint64_t HeapBackdrop::GetLatencyBucketStart(size_t bucket) {
+  DCHECK_LT(bucket, kLatencyBucketCount);
+  if (bucket < kLatencySubBucketCount)
+    return bucket;
+
+  size_t shift = (bucket >> kLatencySubBucketBits) - 1;
+  uint64_t sub_bucket = bucket & (kLatencySubBucketCount - 1);
+  return (kLatencySubBucketCount + sub_bucket) << shift;
+}
+
+// static
+uint64_t HeapBackdrop::GetLatencyPercentile(const Stats& stats,
+                                            double percentile) {
+  DCHECK_LE(0.0, percentile);
+  DCHECK_GE(100.0, percentile);
+  if (stats.calls == 0)
+    return 0;
+
+  // The rank of the call at the given percentile, counting from 1.
+  uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * stats.calls);
+  if (rank == 0)
+    rank = 1;
+
+  uint64_t count = 0;
+  for (size_t i = 0; i < kLatencyBucketCount; ++i) {
+    count += stats.latencies[i];
+    if (count >= rank)
+      return GetLatencyBucketStart(i);
+  }
+  return GetLatencyBucketStart(kLatencyBucketCount - 1);
 }
 
 LPVOID HeapBackdrop::HeapAlloc(HANDLE heap, DWORD flags, SIZE_T bytes) {
@@ -66,11 +128,16 @@ SIZE_T HeapBackdrop::HeapSize(HANDLE heap, DWORD flags, LPCVOID mem) {
 }
 
 void HeapBackdrop::UpdateStats(EventType type, uint64_t time) {
-  base::AutoLock auto_lock(lock_);
-
-  auto stats = total_stats_.insert(std::make_pair(type, struct Stats())).first;
-  stats->second.calls++;
-  stats->second.time += time;
+  auto stats = total_stats_.find(type);
+  DCHECK(stats != total_stats_.end());
+
+  ::InterlockedIncrement64(
+      reinterpret_cast<volatile LONG64*>(&stats->second.calls));
+  ::InterlockedExchangeAdd64(
+      reinterpret_cast<volatile LONG64*>(&stats->second.time),
+      static_cast<LONG64>(time));
+  ::InterlockedIncrement64(reinterpret_cast<volatile LONG64*>(
+      &stats->second.latencies[GetLatencyBucket(time)]));
 }
 
 bool HeapBackdrop::TearDown() {
@@ -79,17 +146,20 @@ bool HeapBackdrop::TearDown() {
     HANDLE trace_heap = nullptr;
     if (!heap_map_.GetTraceFromLive(live_heap, &trace_heap))
       return false;
-    ::HeapDestroy(live_heap);
+    if (heap_destroy_.is_null()) {
+      ::HeapDestroy(live_heap);
+    } else {
+      heap_destroy_.Run(live_heap);
+    }
     // This can only fail under racy use of this class.
     CHECK(heap_map_.RemoveMapping(trace_heap, live_heap));
   }
 
   // Remove the heap created by SetProcessHeap. This can only fail under racy
   // use of this class.
-  HANDLE live_ph = ::GetProcessHeap();
   HANDLE trace_ph = nullptr;
-  if (heap_map_.GetTraceFromLive(live_ph, &trace_ph))
-    CHECK(heap_map_.RemoveMapping(trace_ph, live_ph));
+  if (heap_map_.GetTraceFromLive(process_heap_, &trace_ph))
+    CHECK(heap_map_.RemoveMapping(trace_ph, process_heap_));
 
   // Handle any other heaps that were created via the HeapDestroy callback.
   for (auto heap_pair : heap_map_.live_trace()) {
@@ -107,12 +177,12 @@ bool HeapBackdrop::TearDown() {
 }
 
 bool HeapBackdrop::SetProcessHeap(void* proc_heap) {
-  HANDLE ph = ::GetProcessHeap();
-  return heap_map_.AddMapping(proc_heap, ph);
+  return heap_map_.AddMapping(proc_heap, process_heap_);
 }
 
 bool HeapBackdrop::AddExistingHeap(void* heap) {
-  HANDLE h = ::HeapCreate(0, 0, 0);
+  HANDLE h = heap_create_.is_null() ? ::HeapCreate(0, 0, 0)
+                                    : heap_create_.Run(0, 0, 0);
   if (!h)
     return false;
   existing_heaps_.push_back(h);
@@ -23,7 +23,6 @@
 
 #include "base/bind.h"
 #include "base/callback.h"
-#include "base/synchronization/lock.h"
 #include "syzygy/bard/event.h"
 #include "syzygy/bard/trace_live_map.h"
 
@@ -37,6 +36,8 @@ using base::Callback;
 // addresses. It also stores the total time taken to run all the commands
 // so far.
 // The class is thread safe for simultaneous access across multiple threads.
+// None of the heap calls is serialized: the maps are sharded, and the
+// statistics are updated with atomic operations.
 class HeapBackdrop {
  public:
   using EventType = EventInterface::EventType;
@@ -53,17 +54,44 @@ class HeapBackdrop {
   using HeapSizeCallback = Callback<SIZE_T(HANDLE, DWORD, LPCVOID)>;
   // @}
 
+  // The latencies of the calls are kept in a log-linear histogram: each
+  // power of two is split in 2^kLatencySubBucketBits buckets, which keeps the
+  // percentiles within about 10% of the actual values. This covers all 64-bit
+  // times.
+  static const size_t kLatencySubBucketBits = 3;
+  static const size_t kLatencyBucketCount =
+      (65 - kLatencySubBucketBits) << kLatencySubBucketBits;
+
   // The following struct holds the statistics generated by a specific
-  // function call: the sum of the time it takes to run and the number
-  // of times it was called.
+  // function call: the sum of the time it takes to run, the number
+  // of times it was called and the distribution of the times. These are
+  // updated atomically.
   struct Stats {
     uint64_t time;
     uint64_t calls;
+    uint64_t latencies[kLatencyBucketCount];
   };
   using StatsMap = std::map<EventType, Stats>;
 
   HeapBackdrop();
 
+  // @name Latency histogram helpers.
+  // @{
+  // @param time A time, in cycles.
+  // @returns the index of the latency bucket containing @p time.
+  static size_t GetLatencyBucket(uint64_t time);
+
+  // @param bucket The index of a latency bucket.
+  // @returns the smallest time, in cycles, that falls in @p bucket.
+  static uint64_t GetLatencyBucketStart(size_t bucket);
+
+  // @param stats The statistics of an event type.
+  // @param percentile The percentile to compute, between 0 and 100.
+  // @returns the start of the latency bucket containing the given percentile
+  //     of the calls, or 0 if there were none.
+  static uint64_t GetLatencyPercentile(const Stats& stats, double percentile);
+  // @}
+
   // @name TraceLiveMap accessors.
   // @{
   TraceLiveMap<HANDLE>& heap_map() { return heap_map_; }
@@ -111,6 +139,10 @@ class HeapBackdrop {
   void set_heap_size(const HeapSizeCallback& heap_size) {
     heap_size_ = heap_size;
   }
+
+  // Sets the live heap that the process heap of the trace is mapped to. This
+  // defaults to the process heap, and must be set before SetProcessHeap.
+  void set_process_heap(HANDLE process_heap) { process_heap_ = process_heap; }
   // @}
 
   // Update the total time taken by an event with type @p type.
@@ -119,7 +151,8 @@ class HeapBackdrop {
   //     measured by rdtsc.
   void UpdateStats(EventType type, uint64_t time);
 
-  // @returns the cumulative statistics.
+  // @returns the cumulative statistics. This has an entry for each event
+  //     type, whether or not it was played.
   const StatsMap& total_stats() const { return total_stats_; }
 
   // Destroys any heaps that have been created against this backdrop (and any
@@ -136,7 +169,7 @@ class HeapBackdrop {
   bool SetProcessHeap(void* proc_heap);
 
   // Configures an existing heap. This actually creates a new heap to be
-  // used by the playback
+  // used by the playback, with the HeapCreate callback if there is one.
   // @param heap The trace file heap to be added.
   // @returns true on success, false otherwise.
   bool AddExistingHeap(void* heap);
@@ -158,9 +191,12 @@ class HeapBackdrop {
   // Tracks heaps created by AddExistingHeap.
   std::vector<HANDLE> existing_heaps_;
 
-  StatsMap total_stats_;
+  // The live heap that the process heap of the trace maps to.
+  HANDLE process_heap_;
 
-  base::Lock lock_;
+  // This is populated with all the event types at construction, so that it
+  // isn't modified as the stats are updated.
+  StatsMap total_stats_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(HeapBackdrop);
@@ -14,11 +14,35 @@
 
 #include "syzygy/bard/backdrops/heap_backdrop.h"
 
+#include "base/threading/simple_thread.h"
 #include "gtest/gtest.h"
 
 namespace bard {
 namespace backdrops {
 
+namespace {
+
+using EventType = EventInterface::EventType;
+
+const size_t kUpdateCount = 10000;
+
+class UpdateStatsRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  UpdateStatsRunner(HeapBackdrop* backdrop, EventType type)
+      : backdrop_(backdrop), type_(type) {}
+
+  void Run() override {
+    for (size_t i = 0; i < kUpdateCount; ++i)
+      backdrop_->UpdateStats(type_, 3);
+  }
+
+ private:
+  HeapBackdrop* backdrop_;
+  EventType type_;
+};
+
+}  // namespace
+
 TEST(HeapBackdropTest, StatsTest) {
   using EventType = EventInterface::EventType;
   const EventType kFuncType1 = static_cast<EventType>(0);
@@ -53,6 +77,72 @@ TEST(HeapBackdropTest, StatsTest) {
   EXPECT_EQ(166 + 72, func2->second.time);
 }
 
+TEST(HeapBackdropTest, ConcurrentStats) {
+  const int kThreadCount = 8;
+  const EventType kFuncType = EventInterface::kHeapAllocEvent;
+
+  HeapBackdrop backdrop;
+  EXPECT_EQ(static_cast<size_t>(EventInterface::kMaxEventType),
+            backdrop.total_stats().size());
+
+  UpdateStatsRunner runner(&backdrop, kFuncType);
+  base::DelegateSimpleThreadPool pool("UpdateStats", kThreadCount);
+  pool.AddWork(&runner, kThreadCount);
+  pool.Start();
+  pool.JoinAll();
+
+  auto stats = backdrop.total_stats().find(kFuncType);
+  ASSERT_NE(backdrop.total_stats().end(), stats);
+  EXPECT_EQ(kThreadCount * kUpdateCount, stats->second.calls);
+  EXPECT_EQ(3 * kThreadCount * kUpdateCount, stats->second.time);
+}
+
+TEST(HeapBackdropTest, LatencyBuckets) {
+  // The small times have a bucket each.
+  for (uint64_t time = 0; time < 8; ++time) {
+    EXPECT_EQ(time, HeapBackdrop::GetLatencyBucket(time));
+    EXPECT_EQ(time, HeapBackdrop::GetLatencyBucketStart(
+        HeapBackdrop::GetLatencyBucket(time)));
+  }
+
+  // The larger ones fall in buckets that start within an eighth of them.
+  size_t previous_bucket = 0;
+  for (uint64_t time = 8; time < (1ull << 63); time += time / 7) {
+    size_t bucket = HeapBackdrop::GetLatencyBucket(time);
+    EXPECT_LT(previous_bucket, bucket);
+    EXPECT_GT(HeapBackdrop::kLatencyBucketCount, bucket);
+    uint64_t start = HeapBackdrop::GetLatencyBucketStart(bucket);
+    EXPECT_LE(start, time);
+    EXPECT_GE(start + time / 8, time);
+    previous_bucket = bucket;
+  }
+  EXPECT_GT(HeapBackdrop::kLatencyBucketCount,
+            HeapBackdrop::GetLatencyBucket(~0ull));
+}
+
+TEST(HeapBackdropTest, LatencyPercentiles) {
+  const EventType kFuncType = EventInterface::kHeapFreeEvent;
+
+  HeapBackdrop backdrop;
+  auto stats = backdrop.total_stats().find(kFuncType);
+  ASSERT_NE(backdrop.total_stats().end(), stats);
+  EXPECT_EQ(0u, HeapBackdrop::GetLatencyPercentile(stats->second, 50.0));
+
+  // 90 fast calls, and 10 slow ones.
+  for (size_t i = 0; i < 90; ++i)
+    backdrop.UpdateStats(kFuncType, 5);
+  for (size_t i = 0; i < 10; ++i)
+    backdrop.UpdateStats(kFuncType, 1000);
+
+  EXPECT_EQ(5u, HeapBackdrop::GetLatencyPercentile(stats->second, 0.0));
+  EXPECT_EQ(5u, HeapBackdrop::GetLatencyPercentile(stats->second, 50.0));
+  EXPECT_EQ(5u, HeapBackdrop::GetLatencyPercentile(stats->second, 90.0));
+  uint64_t slow = HeapBackdrop::GetLatencyPercentile(stats->second, 99.0);
+  EXPECT_LE(1000u * 7 / 8, slow);
+  EXPECT_GE(1000u, slow);
+  EXPECT_EQ(slow, HeapBackdrop::GetLatencyPercentile(stats->second, 100.0));
+}
+
 TEST(HeapBackdropTest, SetProcessHeap) {
   HeapBackdrop backdrop;
   EXPECT_TRUE(backdrop.alloc_map().Empty());
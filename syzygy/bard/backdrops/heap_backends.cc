@@ -0,0 +1,195 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/bard/backdrops/heap_backends.h"
+
+#include "base/logging.h"
+#include "base/strings/string_util.h"
+#include "syzygy/agent/asan/rtl_impl.h"
+
+namespace bard {
+namespace backdrops {
+
+namespace {
+
+const char* kHeapBackendNames[] = {
+  "win32",
+  "nolfh",
+  "asan",
+};
+static_assert(arraysize(kHeapBackendNames) == kHeapBackendMax,
+              "Each heap backend must have a name.");
+
+// @name Adapters for the Windows heap, which is __stdcall.
+// @{
+LPVOID Win32HeapAlloc(HANDLE heap, DWORD flags, SIZE_T bytes) {
+  return ::HeapAlloc(heap, flags, bytes);
+}
+HANDLE Win32HeapCreate(DWORD options, SIZE_T initial_size,
+                       SIZE_T maximum_size) {
+  return ::HeapCreate(options, initial_size, maximum_size);
+}
+BOOL Win32HeapDestroy(HANDLE heap) {
+  return ::HeapDestroy(heap);
+}
+BOOL Win32HeapFree(HANDLE heap, DWORD flags, LPVOID mem) {
+  return ::HeapFree(heap, flags, mem);
+}
+LPVOID Win32HeapReAlloc(HANDLE heap, DWORD flags, LPVOID mem, SIZE_T bytes) {
+  return ::HeapReAlloc(heap, flags, mem, bytes);
+}
+BOOL Win32HeapSetInformation(HANDLE heap,
+                             HEAP_INFORMATION_CLASS info_class,
+                             PVOID info,
+                             SIZE_T info_length) {
+  return ::HeapSetInformation(heap, info_class, info, info_length);
+}
+SIZE_T Win32HeapSize(HANDLE heap, DWORD flags, LPCVOID mem) {
+  return ::HeapSize(heap, flags, mem);
+}
+// @}
+
+// @name Adapters for the Windows heap without the LFH.
+// @{
+HANDLE NoLfhHeapCreate(DWORD options, SIZE_T initial_size,
+                       SIZE_T maximum_size) {
+  HANDLE heap = ::HeapCreate(options, initial_size, maximum_size);
+  if (heap == nullptr)
+    return nullptr;
+
+  // A new heap only gets the LFH front end once it has been asked for, or
+  // once the heap heuristics turn it on. Asking for the standard front end
+  // keeps it off, on the versions of Windows that honor this.
+  ULONG compatibility = 0;
+  if (!::HeapSetInformation(heap, HeapCompatibilityInformation,
+                            &compatibility, sizeof(compatibility))) {
+    VLOG(1) << "Unable to turn off the LFH of a heap.";
+  }
+  return heap;
+}
+BOOL NoLfhHeapSetInformation(HANDLE heap,
+                             HEAP_INFORMATION_CLASS info_class,
+                             PVOID info,
+                             SIZE_T info_length) {
+  // The only front end that can be asked for is the LFH. The request is
+  // dropped, and reported as successful like it was in the trace. The info
+  // buffer is an address in the traced process, so it can't be looked at.
+  if (info_class == HeapCompatibilityInformation)
+    return TRUE;
+  return ::HeapSetInformation(heap, info_class, info, info_length);
+}
+// @}
+
+// @name Adapters for the SyzyASan heap.
+// @{
+LPVOID AsanHeapAlloc(HANDLE heap, DWORD flags, SIZE_T bytes) {
+  return asan_HeapAlloc(heap, flags, bytes);
+}
+HANDLE AsanHeapCreate(DWORD options, SIZE_T initial_size,
+                      SIZE_T maximum_size) {
+  return asan_HeapCreate(options, initial_size, maximum_size);
+}
+BOOL AsanHeapDestroy(HANDLE heap) {
+  return asan_HeapDestroy(heap);
+}
+BOOL AsanHeapFree(HANDLE heap, DWORD flags, LPVOID mem) {
+  return asan_HeapFree(heap, flags, mem);
+}
+LPVOID AsanHeapReAlloc(HANDLE heap, DWORD flags, LPVOID mem, SIZE_T bytes) {
+  return asan_HeapReAlloc(heap, flags, mem, bytes);
+}
+BOOL AsanHeapSetInformation(HANDLE heap,
+                            HEAP_INFORMATION_CLASS info_class,
+                            PVOID info,
+                            SIZE_T info_length) {
+  return asan_HeapSetInformation(heap, info_class, info, info_length);
+}
+SIZE_T AsanHeapSize(HANDLE heap, DWORD flags, LPCVOID mem) {
+  return asan_HeapSize(heap, flags, mem);
+}
+// @}
+
+}  // namespace
+
+const char* GetHeapBackendName(HeapBackend backend) {
+  DCHECK_GT(kHeapBackendMax, backend);
+  return kHeapBackendNames[backend];
+}
+
+bool ParseHeapBackend(const std::string& name, HeapBackend* backend) {
+  DCHECK_NE(static_cast<HeapBackend*>(nullptr), backend);
+
+  for (size_t i = 0; i < arraysize(kHeapBackendNames); ++i) {
+    if (base::LowerCaseEqualsASCII(name, kHeapBackendNames[i])) {
+      *backend = static_cast<HeapBackend>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+void SetHeapBackend(HeapBackend backend, HeapBackdrop* backdrop) {
+  DCHECK_NE(static_cast<HeapBackdrop*>(nullptr), backdrop);
+
+  switch (backend) {
+    case kWin32HeapBackend:
+    case kNoLfhHeapBackend: {
+      backdrop->set_heap_alloc(base::Bind(&Win32HeapAlloc));
+      backdrop->set_heap_destroy(base::Bind(&Win32HeapDestroy));
+      backdrop->set_heap_free(base::Bind(&Win32HeapFree));
+      backdrop->set_heap_realloc(base::Bind(&Win32HeapReAlloc));
+      backdrop->set_heap_size(base::Bind(&Win32HeapSize));
+      if (backend == kWin32HeapBackend) {
+        backdrop->set_heap_create(base::Bind(&Win32HeapCreate));
+        backdrop->set_heap_set_information(
+            base::Bind(&Win32HeapSetInformation));
+      } else {
+        backdrop->set_heap_create(base::Bind(&NoLfhHeapCreate));
+        backdrop->set_heap_set_information(
+            base::Bind(&NoLfhHeapSetInformation));
+      }
+      backdrop->set_process_heap(::GetProcessHeap());
+      break;
+    }
+
+    case kAsanHeapBackend: {
+      backdrop->set_heap_alloc(base::Bind(&AsanHeapAlloc));
+      backdrop->set_heap_create(base::Bind(&AsanHeapCreate));
+      backdrop->set_heap_destroy(base::Bind(&AsanHeapDestroy));
+      backdrop->set_heap_free(base::Bind(&AsanHeapFree));
+      backdrop->set_heap_realloc(base::Bind(&AsanHeapReAlloc));
+      backdrop->set_heap_set_information(base::Bind(&AsanHeapSetInformation));
+      backdrop->set_heap_size(base::Bind(&AsanHeapSize));
+      backdrop->set_process_heap(asan_GetProcessHeap());
+      break;
+    }
+
+    default:
+      NOTREACHED();
+      break;
+  }
+}
+
+bool SetProcessHeap(HeapBackend backend,
+                    void* trace_heap,
+                    HeapBackdrop* backdrop) {
+  DCHECK_NE(static_cast<HeapBackdrop*>(nullptr), backdrop);
+
+  if (backend == kNoLfhHeapBackend)
+    return backdrop->AddExistingHeap(trace_heap);
+  return backdrop->SetProcessHeap(trace_heap);
+}
+
+}  // namespace backdrops
+}  // namespace bard
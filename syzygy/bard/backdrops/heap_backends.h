@@ -0,0 +1,75 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the heap implementations that a HeapBackdrop can forward the
+// replayed heap calls to.
+
+#ifndef SYZYGY_BARD_BACKDROPS_HEAP_BACKENDS_H_
+#define SYZYGY_BARD_BACKDROPS_HEAP_BACKENDS_H_
+
+#include <string>
+
+#include "syzygy/bard/backdrops/heap_backdrop.h"
+
+namespace bard {
+namespace backdrops {
+
+// The heap implementations a story can be replayed against.
+enum HeapBackend {
+  // The Windows heap, as used by the traced process.
+  kWin32HeapBackend,
+  // The Windows heap, with the low fragmentation heap front end turned off
+  // on the heaps that are created by the replay. The requests of the trace
+  // to turn it on are ignored.
+  kNoLfhHeapBackend,
+  // The SyzyASan heap. This is configured like any instrumented process, with
+  // the SYZYGY_ASAN_OPTIONS environment variable, which is read when the
+  // runtime is loaded. This is how the quarantine size or the zebra heap are
+  // selected.
+  kAsanHeapBackend,
+  // This must come last.
+  kHeapBackendMax,
+};
+
+// @param backend A heap backend.
+// @returns the name of @p backend, as accepted by ParseHeapBackend.
+const char* GetHeapBackendName(HeapBackend backend);
+
+// Parses the name of a heap backend.
+// @param name The name of the backend, case insensitive.
+// @param backend Receives the backend.
+// @returns true on success, false if @p name isn't the name of a backend.
+bool ParseHeapBackend(const std::string& name, HeapBackend* backend);
+
+// Forwards the heap calls of a backdrop to a heap backend. This must be done
+// before the process heap and the existing heaps of the trace are mapped.
+// @param backend The backend to use.
+// @param backdrop The backdrop to configure.
+void SetHeapBackend(HeapBackend backend, HeapBackdrop* backdrop);
+
+// Maps the process heap of a trace to the process heap of a backend. For the
+// backend without the low fragmentation heap this is a heap of its own, as
+// the process heap of the replay has it turned on.
+// @param backend The backend that @p backdrop forwards to.
+// @param trace_heap The process heap in the trace file.
+// @param backdrop The backdrop to configure.
+// @returns true on success, false otherwise.
+bool SetProcessHeap(HeapBackend backend,
+                    void* trace_heap,
+                    HeapBackdrop* backdrop);
+
+}  // namespace backdrops
+}  // namespace bard
+
+#endif  // SYZYGY_BARD_BACKDROPS_HEAP_BACKENDS_H_
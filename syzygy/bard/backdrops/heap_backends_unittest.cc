@@ -0,0 +1,89 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/bard/backdrops/heap_backends.h"
+
+#include "gtest/gtest.h"
+
+namespace bard {
+namespace backdrops {
+
+namespace {
+
+// Makes a few heap calls through a backdrop.
+void TestBackend(HeapBackend backend) {
+  HeapBackdrop backdrop;
+  SetHeapBackend(backend, &backdrop);
+
+  void* trace_heap = reinterpret_cast<void*>(0xDEADBEEF);
+  ASSERT_TRUE(SetProcessHeap(backend, trace_heap, &backdrop));
+  HANDLE process_heap = nullptr;
+  ASSERT_TRUE(backdrop.heap_map().GetLiveFromTrace(trace_heap, &process_heap));
+
+  HANDLE heap = backdrop.HeapCreate(0, 0, 0);
+  ASSERT_NE(static_cast<HANDLE>(nullptr), heap);
+  for (HANDLE h : { process_heap, heap }) {
+    LPVOID mem = backdrop.HeapAlloc(h, 0, 10);
+    ASSERT_NE(static_cast<LPVOID>(nullptr), mem);
+    EXPECT_EQ(10u, backdrop.HeapSize(h, 0, mem));
+    mem = backdrop.HeapReAlloc(h, 0, mem, 20);
+    ASSERT_NE(static_cast<LPVOID>(nullptr), mem);
+    EXPECT_EQ(20u, backdrop.HeapSize(h, 0, mem));
+    EXPECT_TRUE(backdrop.HeapFree(h, 0, mem));
+  }
+  EXPECT_TRUE(backdrop.HeapDestroy(heap));
+
+  EXPECT_TRUE(backdrop.TearDown());
+}
+
+}  // namespace
+
+TEST(HeapBackendsTest, Names) {
+  for (int i = 0; i < kHeapBackendMax; ++i) {
+    HeapBackend backend = static_cast<HeapBackend>(i);
+    HeapBackend parsed = kHeapBackendMax;
+    EXPECT_TRUE(ParseHeapBackend(GetHeapBackendName(backend), &parsed));
+    EXPECT_EQ(backend, parsed);
+  }
+
+  HeapBackend parsed = kHeapBackendMax;
+  EXPECT_TRUE(ParseHeapBackend("NoLFH", &parsed));
+  EXPECT_EQ(kNoLfhHeapBackend, parsed);
+  EXPECT_FALSE(ParseHeapBackend("tcmalloc", &parsed));
+}
+
+TEST(HeapBackendsTest, Win32Heap) {
+  TestBackend(kWin32HeapBackend);
+}
+
+TEST(HeapBackendsTest, NoLfhHeap) {
+  TestBackend(kNoLfhHeapBackend);
+
+  // The requests for the LFH are dropped.
+  HeapBackdrop backdrop;
+  SetHeapBackend(kNoLfhHeapBackend, &backdrop);
+  HANDLE heap = backdrop.HeapCreate(0, 0, 0);
+  ASSERT_NE(static_cast<HANDLE>(nullptr), heap);
+  EXPECT_TRUE(backdrop.HeapSetInformation(heap, HeapCompatibilityInformation,
+                                          nullptr, sizeof(ULONG)));
+  ULONG compatibility = 0;
+  ASSERT_TRUE(::HeapQueryInformation(heap, HeapCompatibilityInformation,
+                                     &compatibility, sizeof(compatibility),
+                                     nullptr));
+  EXPECT_NE(2u, compatibility);
+  EXPECT_TRUE(backdrop.HeapDestroy(heap));
+}
+
+}  // namespace backdrops
+}  // namespace bard
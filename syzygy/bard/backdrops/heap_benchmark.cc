@@ -0,0 +1,172 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/bard/backdrops/heap_benchmark.h"
+
+#include <windows.h>
+#include <psapi.h>
+
+#include "base/logging.h"
+
+namespace bard {
+namespace backdrops {
+
+namespace {
+
+// Gets the current and peak working sets of the process.
+bool GetWorkingSet(size_t* working_set, size_t* peak_working_set) {
+  DCHECK_NE(static_cast<size_t*>(nullptr), working_set);
+  DCHECK_NE(static_cast<size_t*>(nullptr), peak_working_set);
+
+  PROCESS_MEMORY_COUNTERS counters = {};
+  if (!::GetProcessMemoryInfo(::GetCurrentProcess(), &counters,
+                              sizeof(counters))) {
+    LOG(ERROR) << "Failed to get the memory usage of the process.";
+    return false;
+  }
+  *working_set = counters.WorkingSetSize;
+  *peak_working_set = counters.PeakWorkingSetSize;
+  return true;
+}
+
+}  // namespace
+
+const double HeapBenchmark::kLatencyPercentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+static_assert(arraysize(HeapBenchmark::kLatencyPercentiles) ==
+                  HeapBenchmark::kLatencyPercentileCount,
+              "Unexpected number of latency percentiles.");
+
+// static
+bool HeapBenchmark::Run(HeapBackend backend,
+                        const std::vector<void*>& trace_heaps,
+                        const PlayCallback& play,
+                        Result* result) {
+  DCHECK(!play.is_null());
+  DCHECK_NE(static_cast<Result*>(nullptr), result);
+
+  *result = Result();
+  result->backend = backend;
+
+  HeapBackdrop backdrop;
+  SetHeapBackend(backend, &backdrop);
+  for (size_t i = 0; i < trace_heaps.size(); ++i) {
+    bool mapped = i == 0 ? SetProcessHeap(backend, trace_heaps[i], &backdrop)
+                         : backdrop.AddExistingHeap(trace_heaps[i]);
+    if (!mapped) {
+      LOG(ERROR) << "Failed to map the heaps of the trace.";
+      return false;
+    }
+  }
+
+  size_t peak_working_set = 0;
+  if (!GetWorkingSet(&result->initial_working_set, &peak_working_set))
+    return false;
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  bool played = play.Run(&backdrop);
+  result->duration = base::TimeTicks::Now() - start;
+
+  size_t working_set = 0;
+  if (!GetWorkingSet(&working_set, &result->peak_working_set))
+    return false;
+
+  for (const auto& type_stats : backdrop.total_stats()) {
+    const HeapBackdrop::Stats& stats = type_stats.second;
+    if (stats.calls == 0)
+      continue;
+
+    EventTypeResult type_result = {};
+    type_result.type = type_stats.first;
+    type_result.calls = stats.calls;
+    type_result.time = stats.time;
+    for (size_t i = 0; i < kLatencyPercentileCount; ++i) {
+      type_result.percentiles[i] = HeapBackdrop::GetLatencyPercentile(
+          stats, kLatencyPercentiles[i]);
+    }
+    result->event_types.push_back(type_result);
+    result->event_count += stats.calls;
+  }
+
+  if (!backdrop.TearDown()) {
+    LOG(ERROR) << "Failed to tear down the backdrop.";
+    return false;
+  }
+
+  if (!played) {
+    LOG(ERROR) << "Failed to play the story against the "
+               << GetHeapBackendName(backend) << " heap.";
+    return false;
+  }
+
+  return true;
+}
+
+// static
+bool HeapBenchmark::WriteResult(const Result& result, FILE* file) {
+  DCHECK_NE(static_cast<FILE*>(nullptr), file);
+
+  double seconds = result.duration.InSecondsF();
+  double throughput = seconds > 0 ? result.event_count / seconds : 0;
+  if (::fprintf(file, "Backend: %s\n", GetHeapBackendName(result.backend)) <
+          0 ||
+      ::fprintf(file, "Events: %llu in %.3f s (%.0f events/s)\n",
+                result.event_count, seconds, throughput) < 0 ||
+      ::fprintf(file, "Working set: %u initial, %u peak\n",
+                result.initial_working_set, result.peak_working_set) < 0) {
+    return false;
+  }
+
+  // The latencies are in cycles.
+  if (::fprintf(file, "%-20s %12s %12s", "Function", "Calls", "Mean") < 0)
+    return false;
+  for (double percentile : kLatencyPercentiles) {
+    if (::fprintf(file, " %11.1f%%", percentile) < 0)
+      return false;
+  }
+  if (::fprintf(file, "\n") < 0)
+    return false;
+
+  for (const EventTypeResult& type_result : result.event_types) {
+    if (::fprintf(file, "%-20s %12llu %12llu",
+                  GetEventTypeName(type_result.type), type_result.calls,
+                  type_result.time / type_result.calls) < 0) {
+      return false;
+    }
+    for (uint64_t latency : type_result.percentiles) {
+      if (::fprintf(file, " %12llu", latency) < 0)
+        return false;
+    }
+    if (::fprintf(file, "\n") < 0)
+      return false;
+  }
+
+  return true;
+}
+
+// static
+const char* HeapBenchmark::GetEventTypeName(EventType type) {
+  switch (type) {
+    case EventInterface::kHeapAllocEvent: return "HeapAlloc";
+    case EventInterface::kHeapCreateEvent: return "HeapCreate";
+    case EventInterface::kHeapDestroyEvent: return "HeapDestroy";
+    case EventInterface::kHeapFreeEvent: return "HeapFree";
+    case EventInterface::kHeapReAllocEvent: return "HeapReAlloc";
+    case EventInterface::kHeapSetInformationEvent: return "HeapSetInformation";
+    case EventInterface::kHeapSizeEvent: return "HeapSize";
+    default: return "Unknown";
+  }
+}
+
+}  // namespace backdrops
+}  // namespace bard
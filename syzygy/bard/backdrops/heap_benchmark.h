@@ -0,0 +1,109 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares HeapBenchmark, which replays a heap story against one of the heap
+// backends and measures the throughput, the latency of each type of heap
+// call and the memory usage of the replay.
+
+#ifndef SYZYGY_BARD_BACKDROPS_HEAP_BENCHMARK_H_
+#define SYZYGY_BARD_BACKDROPS_HEAP_BENCHMARK_H_
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "base/callback.h"
+#include "base/time/time.h"
+#include "syzygy/bard/backdrops/heap_backends.h"
+
+namespace bard {
+namespace backdrops {
+
+// Runs heap benchmarks. Each run replays a story on a fresh backdrop.
+//
+// Usage:
+//   HeapBenchmark::Result result;
+//   if (!HeapBenchmark::Run(kAsanHeapBackend, trace_heaps,
+//                           base::Bind(&StoryFile::Play,
+//                                      base::Unretained(&story_file)),
+//                           &result)) ...
+//   HeapBenchmark::WriteResult(result, stdout);
+class HeapBenchmark {
+ public:
+  using EventType = EventInterface::EventType;
+
+  // Plays a story against a backdrop. This is bound to Story::Play or to
+  // StoryFile::Play.
+  using PlayCallback = base::Callback<bool(void*)>;
+
+  // The percentiles of the latencies that are reported.
+  static const double kLatencyPercentiles[];
+  static const size_t kLatencyPercentileCount = 4;
+
+  // The measurements for a type of heap call.
+  struct EventTypeResult {
+    EventType type;
+    uint64_t calls;
+    // The total time of the calls, in cycles.
+    uint64_t time;
+    // The latencies at each of kLatencyPercentiles, in cycles.
+    uint64_t percentiles[kLatencyPercentileCount];
+  };
+
+  // The measurements of a run.
+  struct Result {
+    HeapBackend backend;
+    // The number of heap calls, and the wall time of the replay.
+    uint64_t event_count;
+    base::TimeDelta duration;
+    // The working set of the process before the replay, and its peak. The
+    // peak is that of the lifetime of the process, so runs that are to be
+    // compared should each have a process of their own.
+    size_t initial_working_set;
+    size_t peak_working_set;
+    // The heap call types that were played.
+    std::vector<EventTypeResult> event_types;
+  };
+
+  // Replays a story against a heap backend.
+  // @param backend The heap backend to replay against.
+  // @param trace_heaps The heaps that existed when the trace started, the
+  //     first of which is the process heap. This is how MemReplayGrinder
+  //     saves them.
+  // @param play The callback playing the story.
+  // @param result Receives the measurements.
+  // @returns true on success, false otherwise.
+  static bool Run(HeapBackend backend,
+                  const std::vector<void*>& trace_heaps,
+                  const PlayCallback& play,
+                  Result* result);
+
+  // Writes the measurements of a run in a human readable form.
+  // @param result The measurements.
+  // @param file The file to write to.
+  // @returns true on success, false otherwise.
+  static bool WriteResult(const Result& result, FILE* file);
+
+  // @param type A heap event type.
+  // @returns the name of the heap function played by @p type.
+  static const char* GetEventTypeName(EventType type);
+
+ private:
+  DISALLOW_IMPLICIT_CONSTRUCTORS(HeapBenchmark);
+};
+
+}  // namespace backdrops
+}  // namespace bard
+
+#endif  // SYZYGY_BARD_BACKDROPS_HEAP_BENCHMARK_H_
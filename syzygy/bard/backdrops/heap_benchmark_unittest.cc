@@ -0,0 +1,111 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/bard/backdrops/heap_benchmark.h"
+
+#include "base/bind.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "gtest/gtest.h"
+#include "syzygy/bard/story.h"
+#include "syzygy/bard/events/heap_alloc_event.h"
+#include "syzygy/bard/events/heap_create_event.h"
+#include "syzygy/bard/events/heap_destroy_event.h"
+#include "syzygy/bard/events/heap_free_event.h"
+
+namespace bard {
+namespace backdrops {
+
+namespace {
+
+using events::HeapAllocEvent;
+using events::HeapCreateEvent;
+using events::HeapDestroyEvent;
+using events::HeapFreeEvent;
+
+const HANDLE kTraceProcessHeap = reinterpret_cast<HANDLE>(0x10000000);
+const HANDLE kTraceHeap = reinterpret_cast<HANDLE>(0x20000000);
+const size_t kAllocCount = 100;
+
+// Builds a story that allocates on the process heap and on a heap of its
+// own.
+void BuildStory(Story* story) {
+  Story::PlotLine* plot_line = story->CreatePlotLine();
+  plot_line->push_back(new HeapCreateEvent(0, 0, 0, 0, kTraceHeap));
+  for (size_t i = 0; i < kAllocCount; ++i) {
+    HANDLE heap = i % 2 ? kTraceHeap : kTraceProcessHeap;
+    LPVOID alloc = reinterpret_cast<LPVOID>(0x30000000 + i * 0x100);
+    plot_line->push_back(new HeapAllocEvent(i, heap, 0, 16 + i, alloc));
+    plot_line->push_back(new HeapFreeEvent(i, heap, 0, alloc, TRUE));
+  }
+  plot_line->push_back(new HeapDestroyEvent(0, kTraceHeap, TRUE));
+}
+
+}  // namespace
+
+TEST(HeapBenchmarkTest, Run) {
+  Story story;
+  BuildStory(&story);
+  std::vector<void*> trace_heaps(1, kTraceProcessHeap);
+
+  for (HeapBackend backend : { kWin32HeapBackend, kNoLfhHeapBackend }) {
+    HeapBenchmark::Result result = {};
+    ASSERT_TRUE(HeapBenchmark::Run(
+        backend, trace_heaps,
+        base::Bind(&Story::Play, base::Unretained(&story)), &result));
+
+    EXPECT_EQ(backend, result.backend);
+    EXPECT_EQ(2 + 2 * kAllocCount, result.event_count);
+    EXPECT_LE(result.initial_working_set, result.peak_working_set);
+
+    // One entry per type of call that was made.
+    ASSERT_EQ(4u, result.event_types.size());
+    for (const auto& type_result : result.event_types) {
+      size_t expected_calls = 1;
+      if (type_result.type == EventInterface::kHeapAllocEvent ||
+          type_result.type == EventInterface::kHeapFreeEvent) {
+        expected_calls = kAllocCount;
+      }
+      EXPECT_EQ(expected_calls, type_result.calls);
+      for (size_t i = 1; i < HeapBenchmark::kLatencyPercentileCount; ++i)
+        EXPECT_LE(type_result.percentiles[i - 1], type_result.percentiles[i]);
+    }
+
+    base::ScopedTempDir temp_dir;
+    ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+    base::FilePath path = temp_dir.path().Append(L"result.txt");
+    {
+      base::ScopedFILE file(base::OpenFile(path, "wb"));
+      ASSERT_TRUE(file.get() != nullptr);
+      EXPECT_TRUE(HeapBenchmark::WriteResult(result, file.get()));
+    }
+    std::string text;
+    ASSERT_TRUE(base::ReadFileToString(path, &text));
+    EXPECT_NE(std::string::npos, text.find(GetHeapBackendName(backend)));
+    EXPECT_NE(std::string::npos, text.find("HeapAlloc"));
+  }
+}
+
+TEST(HeapBenchmarkTest, RunFailsForUnknownHeap) {
+  // The story uses a heap that isn't mapped.
+  Story story;
+  BuildStory(&story);
+  HeapBenchmark::Result result = {};
+  EXPECT_FALSE(HeapBenchmark::Run(
+      kWin32HeapBackend, std::vector<void*>(),
+      base::Bind(&Story::Play, base::Unretained(&story)), &result));
+}
+
+}  // namespace backdrops
+}  // namespace bard
@@ -27,10 +27,16 @@
         'raw_argument_converter.h',
         'story.cc',
         'story.h',
+        'story_file.cc',
+        'story_file.h',
         'trace_live_map.h',
         'trace_live_map_impl.h',
         'backdrops/heap_backdrop.cc',
         'backdrops/heap_backdrop.h',
+        'backdrops/heap_backends.cc',
+        'backdrops/heap_backends.h',
+        'backdrops/heap_benchmark.cc',
+        'backdrops/heap_benchmark.h',
         'events/heap_alloc_event.cc',
         'events/heap_alloc_event.h',
         'events/heap_create_event.cc',
@@ -75,9 +81,12 @@
       'sources': [
         'event_unittest.cc',
         'raw_argument_converter_unittest.cc',
+        'story_file_unittest.cc',
         'story_unittest.cc',
         'trace_live_map_unittest.cc',
         'backdrops/heap_backdrop_unittest.cc',
+        'backdrops/heap_backends_unittest.cc',
+        'backdrops/heap_benchmark_unittest.cc',
         'events/heap_alloc_event_unittest.cc',
         'events/heap_create_event_unittest.cc',
         'events/heap_destroy_event_unittest.cc',
@@ -14,10 +14,26 @@
 
 #include "syzygy/bard/events/linked_event.h"
 
+#include <windows.h>
+
+#include "base/threading/platform_thread.h"
+
 namespace bard {
 namespace events {
 
-LinkedEvent::LinkedEvent(std::unique_ptr<EventInterface> event) {
+namespace {
+
+// The number of times a dependency is polled before the waiting thread
+// starts yielding, and then sleeping. Most dependencies are played by another
+// thread within a few heap calls, which this covers. The waits that last
+// longer are dominated by the event waited on anyway.
+const size_t kSpinCount = 4000;
+const size_t kYieldCount = 100;
+
+}  // namespace
+
+LinkedEvent::LinkedEvent(std::unique_ptr<EventInterface> event)
+    : played_(0) {
   DCHECK_NE(static_cast<EventInterface*>(nullptr), event.get());
   event_ = std::move(event);
 }
@@ -25,20 +41,15 @@ LinkedEvent::LinkedEvent(std::unique_ptr<EventInterface> event) {
 bool LinkedEvent::Play(void* backdrop) {
   DCHECK_NE(static_cast<void*>(nullptr), backdrop);
 
-  for (auto& dep : deps_) {
-    DCHECK_NE(static_cast<base::WaitableEvent*>(nullptr),
-              dep->waitable_event_.get());
-    dep->waitable_event_->Wait();
-  }
+  for (auto& dep : deps_)
+    dep->WaitUntilPlayed();
 
   // Play the wrapped event.
   if (!event_->Play(backdrop))
     return false;
 
-  // If this LinkedEvent is itself an input dependency of another
-  // LinkedEvent then fire the signal.
-  if (waitable_event_.get())
-    waitable_event_->Signal();
+  // Release the events that depend on this one.
+  base::subtle::Release_Store(&played_, 1);
 
   return true;
 }
@@ -88,16 +99,22 @@ bool LinkedEvent::AddDep(EventInterface* dep) {
   if (dep->type() != kLinkedEvent)
     return false;
 
-  // Get the underlying LinkedEvent. If this event hasn't yet been used as an
-  // input dependency then allocate a waitable_event_ so that it can work as
-  // one.
   LinkedEvent* e = reinterpret_cast<LinkedEvent*>(dep);
-  if (!e->waitable_event_.get())
-    e->waitable_event_.reset(new base::WaitableEvent(true, false));
-
   deps_.push_back(e);
   return true;
 }
 
+void LinkedEvent::WaitUntilPlayed() const {
+  for (size_t i = 0; !played(); ++i) {
+    if (i < kSpinCount) {
+      YieldProcessor();
+    } else if (i < kSpinCount + kYieldCount) {
+      base::PlatformThread::YieldCurrentThread();
+    } else {
+      base::PlatformThread::Sleep(base::TimeDelta::FromMilliseconds(1));
+    }
+  }
+}
+
 }  // namespace events
 }  // namespace bard
@@ -20,14 +20,17 @@
 #include <memory>
 #include <set>
 
-#include "base/synchronization/waitable_event.h"
+#include "base/atomicops.h"
 #include "syzygy/bard/event.h"
 
 namespace bard {
 namespace events {
 
 // Specialization of EventInterface that allows for cross-event dependencies to
-// be expressed.
+// be expressed. An event that has been played raises an atomic flag, which
+// the events that depend on it spin on. Waiting doesn't go through the
+// kernel, so that the replay preserves the concurrency of the original
+// process as closely as possible.
 class LinkedEvent : public EventInterface {
  public:
   // Constructor.
@@ -64,10 +67,15 @@ class LinkedEvent : public EventInterface {
   const std::vector<LinkedEvent*>& deps() const { return deps_; }
   // @}
 
+  // @returns true if this event has been played successfully.
+  bool played() const { return base::subtle::Acquire_Load(&played_) != 0; }
+
  private:
-  // This is only allocated if this event becomes an output dependency of any
-  // others.
-  std::unique_ptr<base::WaitableEvent> waitable_event_;
+  // Waits for this event to have been played.
+  void WaitUntilPlayed() const;
+
+  // Set to 1 once this event has been played successfully.
+  base::subtle::Atomic32 played_;
 
   // The event that this LinkedEvent refers to.
   std::unique_ptr<EventInterface> event_;
@@ -191,5 +191,17 @@ TEST_F(LinkedEventTest, TestMultipleDependency) {
       reinterpret_cast<const TestEvent*>(linked_event3_.event())->played());
 }
 
+TEST_F(LinkedEventTest, TestPlayed) {
+  EXPECT_FALSE(linked_event1_.played());
+  EXPECT_TRUE(linked_event1_.Play(empty_backdrop_));
+  EXPECT_TRUE(linked_event1_.played());
+
+  // An event whose dependency has already been played doesn't wait.
+  EXPECT_TRUE(linked_event2_.AddDep(&linked_event1_));
+  EXPECT_FALSE(linked_event2_.played());
+  EXPECT_TRUE(linked_event2_.Play(empty_backdrop_));
+  EXPECT_TRUE(linked_event2_.played());
+}
+
 }  // namespace events
 }  // namespace bard
@@ -193,23 +193,14 @@ bool Story::Play(void* backdrop) {
   for (auto runner : runners)
     runner->Start();
 
-  // Wait for all threads to finish successfully, or for one to fail.
-  bool success = true;
-  while (true) {
-    // Wait for at least one runner to complete.
-    base::AutoLock auto_lock(info.lock);
+  // Wait for all threads to finish successfully, or for one to fail. The
+  // state is checked before waiting, as the runners can complete before the
+  // lock is first acquired.
+  base::AutoLock auto_lock(info.lock);
+  while (!info.failed && info.completed_count < runners.size())
     info.cv.Wait();
 
-    if (info.failed) {
-      success = false;
-      break;
-    }
-
-    if (info.completed_count == runners.size())
-      break;
-  }
-
-  return success;
+  return info.failed == nullptr;
 }
 
 bool Story::operator==(const Story& story) const {
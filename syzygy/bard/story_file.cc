@@ -0,0 +1,514 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/bard/story_file.h"
+
+#include <windows.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <map>
+
+#include "base/atomicops.h"
+#include "base/files/file.h"
+#include "base/files/file_util.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/memory/scoped_vector.h"
+#include "base/threading/platform_thread.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/bard/events/linked_event.h"
+
+namespace bard {
+
+namespace {
+
+using events::LinkedEvent;
+
+typedef std::map<const LinkedEvent*, uint32_t> LinkedEventIdMap;
+
+// The size of the fixed part of the header, and of each plot line entry.
+const size_t kHeaderSize = 4 * sizeof(uint32_t);
+const size_t kPlotLineEntrySize = 2 * sizeof(uint64_t) + sizeof(uint32_t);
+
+// The waiting policy of the linked events, see linked_event.cc.
+const size_t kSpinCount = 4000;
+const size_t kYieldCount = 100;
+
+// Writes an event and its input constraints to a plot line.
+bool WriteEvent(const EventInterface* event,
+                const LinkedEventIdMap& linked_event_ids,
+                core::OutArchive* out_archive) {
+  DCHECK_NE(static_cast<EventInterface*>(nullptr), event);
+  DCHECK_NE(static_cast<core::OutArchive*>(nullptr), out_archive);
+
+  if (event->type() != EventInterface::kLinkedEvent) {
+    return out_archive->Save(StoryFile::kNoLinkedEventId) &&
+           out_archive->Save(static_cast<uint32_t>(0)) &&
+           EventInterface::Save(event, out_archive);
+  }
+
+  const LinkedEvent* linked_event =
+      reinterpret_cast<const LinkedEvent*>(event);
+  auto it = linked_event_ids.find(linked_event);
+  DCHECK(it != linked_event_ids.end());
+  if (!out_archive->Save(it->second))
+    return false;
+  if (!out_archive->Save(static_cast<uint32_t>(linked_event->deps().size())))
+    return false;
+  for (const LinkedEvent* dep : linked_event->deps()) {
+    auto dep_it = linked_event_ids.find(dep);
+    if (dep_it == linked_event_ids.end()) {
+      LOG(ERROR) << "Linked event depends on an event outside of the story.";
+      return false;
+    }
+    if (!out_archive->Save(dep_it->second))
+      return false;
+  }
+  return EventInterface::Save(linked_event->event(), out_archive);
+}
+
+// Writes the header of a story file.
+bool WriteHeader(uint32_t linked_event_count,
+                 const std::vector<uint64_t>& offsets,
+                 const std::vector<uint64_t>& sizes,
+                 const Story& story,
+                 core::OutArchive* out_archive) {
+  DCHECK_EQ(story.plot_lines().size(), offsets.size());
+  DCHECK_EQ(story.plot_lines().size(), sizes.size());
+  DCHECK_NE(static_cast<core::OutArchive*>(nullptr), out_archive);
+
+  if (!out_archive->Save(StoryFile::kStoryFileMagic) ||
+      !out_archive->Save(StoryFile::kStoryFileVersion) ||
+      !out_archive->Save(static_cast<uint32_t>(offsets.size())) ||
+      !out_archive->Save(linked_event_count)) {
+    return false;
+  }
+  for (size_t i = 0; i < offsets.size(); ++i) {
+    if (!out_archive->Save(offsets[i]) || !out_archive->Save(sizes[i]) ||
+        !out_archive->Save(
+            static_cast<uint32_t>(story.plot_lines()[i]->size()))) {
+      return false;
+    }
+  }
+  return out_archive->Flush();
+}
+
+}  // namespace
+
+// An input stream over a plot line of a story file. The plot line is mapped
+// one window at a time, each window being unmapped as the next one is
+// mapped.
+class StoryFile::PlotLineStream : public core::InStream {
+ public:
+  PlotLineStream(const base::FilePath& path, uint64_t offset, uint64_t size)
+      : path_(path), position_(offset), end_(offset + size),
+        window_start_(offset), window_end_(offset) {
+  }
+
+ protected:
+  bool ReadImpl(size_t length, core::Byte* bytes, size_t* bytes_read) override;
+
+ private:
+  // Maps the window starting at the current position.
+  bool MapNextWindow();
+
+  base::FilePath path_;
+
+  // The current position in the file, and the end of the plot line.
+  uint64_t position_;
+  uint64_t end_;
+
+  // The currently mapped window, and its extent in the file.
+  std::unique_ptr<base::MemoryMappedFile> window_;
+  uint64_t window_start_;
+  uint64_t window_end_;
+
+  DISALLOW_COPY_AND_ASSIGN(PlotLineStream);
+};
+
+bool StoryFile::PlotLineStream::ReadImpl(size_t length,
+                                         core::Byte* bytes,
+                                         size_t* bytes_read) {
+  DCHECK_NE(static_cast<core::Byte*>(nullptr), bytes);
+  DCHECK_NE(static_cast<size_t*>(nullptr), bytes_read);
+
+  *bytes_read = 0;
+  while (*bytes_read < length) {
+    if (position_ == window_end_) {
+      if (position_ == end_)
+        return true;
+      if (!MapNextWindow())
+        return false;
+    }
+
+    size_t count = static_cast<size_t>(
+        std::min<uint64_t>(length - *bytes_read, window_end_ - position_));
+    ::memcpy(bytes + *bytes_read,
+             window_->data() + static_cast<size_t>(position_ - window_start_),
+             count);
+    position_ += count;
+    *bytes_read += count;
+  }
+
+  return true;
+}
+
+bool StoryFile::PlotLineStream::MapNextWindow() {
+  DCHECK_LT(position_, end_);
+
+  // Release the previous window before mapping the next one.
+  window_.reset();
+
+  base::MemoryMappedFile::Region region;
+  region.offset = static_cast<int64_t>(position_);
+  region.size = static_cast<int64_t>(
+      std::min<uint64_t>(kWindowSize, end_ - position_));
+
+  base::File file(path_, base::File::FLAG_OPEN | base::File::FLAG_READ);
+  std::unique_ptr<base::MemoryMappedFile> window(new base::MemoryMappedFile());
+  if (!file.IsValid() || !window->Initialize(std::move(file), region)) {
+    LOG(ERROR) << "Unable to map story file \"" << path_.value() << "\".";
+    return false;
+  }
+
+  window_ = std::move(window);
+  window_start_ = position_;
+  window_end_ = position_ + region.size;
+  return true;
+}
+
+// The state shared by the plot lines of a playback.
+struct StoryFile::PlaybackState {
+  explicit PlaybackState(uint32_t linked_event_count)
+      : played((linked_event_count + 31) / 32, 0), failed(0) {
+  }
+
+  // @returns true if the linked event @p id has been played.
+  bool IsPlayed(uint32_t id) const {
+    return (base::subtle::Acquire_Load(&played[id / 32]) &
+            (1u << (id % 32))) != 0;
+  }
+
+  // Marks the linked event @p id as played.
+  void SetPlayed(uint32_t id) {
+    ::InterlockedOr(reinterpret_cast<volatile LONG*>(&played[id / 32]),
+                    static_cast<LONG>(1u << (id % 32)));
+  }
+
+  // Waits for the linked event @p id to have been played.
+  // @returns true once it has, false if the playback failed in the meantime.
+  bool WaitUntilPlayed(uint32_t id) const {
+    for (size_t i = 0; !IsPlayed(id); ++i) {
+      if (base::subtle::Acquire_Load(&failed) != 0)
+        return false;
+      if (i < kSpinCount) {
+        YieldProcessor();
+      } else if (i < kSpinCount + kYieldCount) {
+        base::PlatformThread::YieldCurrentThread();
+      } else {
+        base::PlatformThread::Sleep(base::TimeDelta::FromMilliseconds(1));
+      }
+    }
+    return true;
+  }
+
+  // A bit per linked event, set once the event has been played.
+  std::vector<base::subtle::Atomic32> played;
+
+  // Set to 1 once any of the plot lines has failed.
+  base::subtle::Atomic32 failed;
+};
+
+// Decodes and plays the events of a plot line.
+class StoryFile::PlotLineRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  PlotLineRunner(const StoryFile* story_file,
+                 const PlotLineInfo* plot_line,
+                 PlaybackState* state,
+                 void* backdrop)
+      : story_file_(story_file), plot_line_(plot_line), state_(state),
+        backdrop_(backdrop), succeeded_(false) {
+  }
+
+  void Run() override {
+    succeeded_ = RunImpl();
+    if (!succeeded_)
+      base::subtle::Release_Store(&state_->failed, 1);
+  }
+
+  bool succeeded() const { return succeeded_; }
+
+ private:
+  bool RunImpl();
+
+  const StoryFile* story_file_;
+  const PlotLineInfo* plot_line_;
+  PlaybackState* state_;
+  void* backdrop_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(PlotLineRunner);
+};
+
+bool StoryFile::PlotLineRunner::RunImpl() {
+  PlotLineStream in_stream(story_file_->path_, plot_line_->offset,
+                           plot_line_->size);
+  core::NativeBinaryInArchive in_archive(&in_stream);
+
+  std::vector<uint32_t> deps;
+  for (uint32_t i = 0; i < plot_line_->event_count; ++i) {
+    uint32_t linked_event_id = kNoLinkedEventId;
+    std::unique_ptr<EventInterface> event =
+        story_file_->ReadEvent(&in_archive, &linked_event_id, &deps);
+    if (!event.get())
+      return false;
+
+    for (uint32_t dep : deps) {
+      if (!state_->WaitUntilPlayed(dep))
+        return false;
+    }
+
+    if (!event->Play(backdrop_)) {
+      LOG(ERROR) << "Failed to play event " << i << " of plot line "
+                 << (plot_line_ - story_file_->plot_lines_.data()) << ".";
+      return false;
+    }
+
+    if (linked_event_id != kNoLinkedEventId)
+      state_->SetPlayed(linked_event_id);
+  }
+
+  return true;
+}
+
+StoryFile::StoryFile() : linked_event_count_(0) {
+}
+
+StoryFile::~StoryFile() {
+}
+
+bool StoryFile::Write(const Story& story, const base::FilePath& path) {
+  // Number the linked events up front, as they can depend on events of any
+  // plot line.
+  LinkedEventIdMap linked_event_ids;
+  for (const Story::PlotLine* plot_line : story.plot_lines()) {
+    for (const EventInterface* event : *plot_line) {
+      if (event->type() == EventInterface::kLinkedEvent) {
+        const LinkedEvent* linked_event =
+            reinterpret_cast<const LinkedEvent*>(event);
+        uint32_t id = static_cast<uint32_t>(linked_event_ids.size());
+        linked_event_ids.insert(std::make_pair(linked_event, id));
+      }
+    }
+  }
+  uint32_t linked_event_count =
+      static_cast<uint32_t>(linked_event_ids.size());
+
+  base::ScopedFILE file(base::OpenFile(path, "wb"));
+  if (!file.get()) {
+    LOG(ERROR) << "Unable to create story file \"" << path.value() << "\".";
+    return false;
+  }
+  core::FileOutStream out_stream(file.get());
+  core::NativeBinaryOutArchive out_archive(&out_stream);
+
+  // Reserve the header, which is rewritten once the extent of each plot line
+  // is known.
+  size_t plot_line_count = story.plot_lines().size();
+  std::vector<uint64_t> offsets(plot_line_count, 0);
+  std::vector<uint64_t> sizes(plot_line_count, 0);
+  if (!WriteHeader(linked_event_count, offsets, sizes, story, &out_archive))
+    return false;
+
+  uint64_t offset = kHeaderSize + plot_line_count * kPlotLineEntrySize;
+  for (size_t i = 0; i < plot_line_count; ++i) {
+    for (const EventInterface* event : *story.plot_lines()[i]) {
+      if (!WriteEvent(event, linked_event_ids, &out_archive))
+        return false;
+    }
+    if (!out_archive.Flush())
+      return false;
+
+    int64_t end = ::_ftelli64(file.get());
+    if (end < 0)
+      return false;
+    offsets[i] = offset;
+    sizes[i] = static_cast<uint64_t>(end) - offset;
+    offset = static_cast<uint64_t>(end);
+  }
+
+  if (::_fseeki64(file.get(), 0, SEEK_SET) != 0 ||
+      !WriteHeader(linked_event_count, offsets, sizes, story, &out_archive)) {
+    LOG(ERROR) << "Unable to write story file \"" << path.value() << "\".";
+    return false;
+  }
+
+  return true;
+}
+
+bool StoryFile::Open(const base::FilePath& path) {
+  DCHECK(plot_lines_.empty());
+
+  int64_t file_size = 0;
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (!file.get() || !base::GetFileSize(path, &file_size)) {
+    LOG(ERROR) << "Unable to open story file \"" << path.value() << "\".";
+    return false;
+  }
+  core::FileInStream in_stream(file.get());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  uint32_t plot_line_count = 0;
+  uint32_t linked_event_count = 0;
+  if (!in_archive.Load(&magic) || !in_archive.Load(&version) ||
+      !in_archive.Load(&plot_line_count) ||
+      !in_archive.Load(&linked_event_count)) {
+    LOG(ERROR) << "Unable to read the header of \"" << path.value() << "\".";
+    return false;
+  }
+  if (magic != kStoryFileMagic || version != kStoryFileVersion) {
+    LOG(ERROR) << "\"" << path.value() << "\" is not a story file.";
+    return false;
+  }
+
+  std::vector<PlotLineInfo> plot_lines(plot_line_count);
+  for (PlotLineInfo& plot_line : plot_lines) {
+    if (!in_archive.Load(&plot_line.offset) ||
+        !in_archive.Load(&plot_line.size) ||
+        !in_archive.Load(&plot_line.event_count)) {
+      LOG(ERROR) << "Unable to read the header of \"" << path.value() << "\".";
+      return false;
+    }
+    if (plot_line.offset > static_cast<uint64_t>(file_size) ||
+        plot_line.size > static_cast<uint64_t>(file_size) - plot_line.offset) {
+      LOG(ERROR) << "Plot line out of bounds in \"" << path.value() << "\".";
+      return false;
+    }
+  }
+
+  path_ = path;
+  plot_lines_.swap(plot_lines);
+  linked_event_count_ = linked_event_count;
+  return true;
+}
+
+bool StoryFile::Load(Story* story) const {
+  DCHECK_NE(static_cast<Story*>(nullptr), story);
+
+  // The input constraints are only resolved once all the linked events have
+  // been read, as they can refer to events of later plot lines.
+  std::vector<LinkedEvent*> linked_events(linked_event_count_, nullptr);
+  std::vector<std::pair<LinkedEvent*, uint32_t>> edges;
+
+  std::vector<uint32_t> deps;
+  for (const PlotLineInfo& info : plot_lines_) {
+    PlotLineStream in_stream(path_, info.offset, info.size);
+    core::NativeBinaryInArchive in_archive(&in_stream);
+    Story::PlotLine* plot_line = story->CreatePlotLine();
+
+    for (uint32_t i = 0; i < info.event_count; ++i) {
+      uint32_t linked_event_id = kNoLinkedEventId;
+      std::unique_ptr<EventInterface> event =
+          ReadEvent(&in_archive, &linked_event_id, &deps);
+      if (!event.get())
+        return false;
+
+      if (linked_event_id == kNoLinkedEventId) {
+        plot_line->push_back(event.release());
+        continue;
+      }
+
+      if (linked_events[linked_event_id] != nullptr) {
+        LOG(ERROR) << "Duplicate linked event " << linked_event_id << ".";
+        return false;
+      }
+      LinkedEvent* linked_event = new LinkedEvent(std::move(event));
+      plot_line->push_back(linked_event);
+      linked_events[linked_event_id] = linked_event;
+      for (uint32_t dep : deps)
+        edges.push_back(std::make_pair(linked_event, dep));
+    }
+  }
+
+  for (const auto& edge : edges) {
+    LinkedEvent* dep = linked_events[edge.second];
+    if (dep == nullptr) {
+      LOG(ERROR) << "Missing linked event " << edge.second << ".";
+      return false;
+    }
+    edge.first->AddDep(dep);
+  }
+
+  return true;
+}
+
+bool StoryFile::Play(void* backdrop) const {
+  PlaybackState state(linked_event_count_);
+
+  ScopedVector<PlotLineRunner> runners;
+  ScopedVector<base::DelegateSimpleThread> threads;
+  for (const PlotLineInfo& plot_line : plot_lines_) {
+    PlotLineRunner* runner =
+        new PlotLineRunner(this, &plot_line, &state, backdrop);
+    runners.push_back(runner);
+    threads.push_back(new base::DelegateSimpleThread(runner, "PlotLineRunner"));
+  }
+
+  for (base::DelegateSimpleThread* thread : threads)
+    thread->Start();
+
+  // A failing plot line releases the others, so they can all be joined.
+  bool success = true;
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i]->Join();
+    if (!runners[i]->succeeded())
+      success = false;
+  }
+
+  return success;
+}
+
+std::unique_ptr<EventInterface> StoryFile::ReadEvent(
+    core::InArchive* in_archive,
+    uint32_t* linked_event_id,
+    std::vector<uint32_t>* deps) const {
+  DCHECK_NE(static_cast<core::InArchive*>(nullptr), in_archive);
+  DCHECK_NE(static_cast<uint32_t*>(nullptr), linked_event_id);
+  DCHECK_NE(static_cast<std::vector<uint32_t>*>(nullptr), deps);
+
+  uint32_t dep_count = 0;
+  if (!in_archive->Load(linked_event_id) || !in_archive->Load(&dep_count))
+    return nullptr;
+  if (*linked_event_id != kNoLinkedEventId &&
+      *linked_event_id >= linked_event_count_) {
+    LOG(ERROR) << "Invalid linked event id " << *linked_event_id << ".";
+    return nullptr;
+  }
+
+  deps->resize(dep_count);
+  for (uint32_t& dep : *deps) {
+    if (!in_archive->Load(&dep))
+      return nullptr;
+    if (dep >= linked_event_count_) {
+      LOG(ERROR) << "Invalid linked event id " << dep << ".";
+      return nullptr;
+    }
+  }
+
+  return EventInterface::Load(in_archive);
+}
+
+}  // namespace bard
@@ -0,0 +1,139 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares StoryFile, an on-disk representation of a Story that is played
+// back directly from the file. Unlike Story::Load, which materializes every
+// event before playback can start, a StoryFile only reads a small header
+// when it is opened. Each plot line is then streamed by its own thread from
+// a sliding window of a memory mapping of the file, so that the memory used
+// by a replay doesn't grow with the size of the story.
+//
+// The file is organized as follows:
+//
+// - header
+//   - magic and version
+//   - number of plot lines
+//   - number of linked events
+//   - PlotLine0 (offset in file, size in bytes, number of events)
+//   - ... repeated for other plot lines ...
+// - PlotLine0, stored contiguously
+//   - Event0
+//     - linked event id of event 0, or kNoLinkedEventId
+//     - number of input constraints
+//     - (linked event id) of input constraint 0
+//     - ... repeated for other constraints ...
+//     - type of event 0 (of the wrapped event for linked events)
+//     - serialization of event 0
+//   - ... repeated for other events ...
+// - ... repeated for other plot lines ...
+//
+// Linked events are numbered in the order in which they appear in the plot
+// lines, and their input constraints are stored with them. When playing back
+// the state of the linked events is kept in a bitmap, shared by all the plot
+// lines.
+
+#ifndef SYZYGY_BARD_STORY_FILE_H_
+#define SYZYGY_BARD_STORY_FILE_H_
+
+#include <vector>
+
+#include "base/macros.h"
+#include "base/files/file_path.h"
+#include "syzygy/bard/story.h"
+
+namespace bard {
+
+// Writes, reads and plays back story files.
+class StoryFile {
+ public:
+  // Some constants used in serialization.
+  static const uint32_t kStoryFileMagic = 0xBA4D5346;
+  static const uint32_t kStoryFileVersion = 1;
+  static const uint32_t kNoLinkedEventId = 0xFFFFFFFF;
+
+  // The size of the portion of a plot line that is mapped at once. This
+  // bounds the address space used by each thread of a playback.
+  static const size_t kWindowSize = 4 * 1024 * 1024;
+
+  StoryFile();
+  ~StoryFile();
+
+  // Writes a story to a file.
+  // @param story The story to write.
+  // @param path The path of the file to create.
+  // @returns true on success, false otherwise.
+  static bool Write(const Story& story, const base::FilePath& path);
+
+  // Opens a story file, reading its header.
+  // @param path The path of the story file.
+  // @returns true on success, false otherwise.
+  bool Open(const base::FilePath& path);
+
+  // Reads the whole content of the file into a Story.
+  // @param story The story to receive the plot lines of the file.
+  // @returns true on success, false otherwise.
+  bool Load(Story* story) const;
+
+  // Plays the story against the provided backdrop. Spins up a thread per plot
+  // line, each of which decodes and plays its events as fast as possible. If
+  // an event fails the playback of all the plot lines is stopped.
+  // @param backdrop The backdrop to play the events against.
+  // @returns true on success, false otherwise.
+  bool Play(void* backdrop) const;
+
+  // @name Accessors.
+  // @{
+  size_t plot_line_count() const { return plot_lines_.size(); }
+  uint32_t linked_event_count() const { return linked_event_count_; }
+  // @}
+
+ private:
+  // The location of a plot line in the file.
+  struct PlotLineInfo {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t event_count;
+  };
+
+  class PlotLineStream;
+  class PlotLineRunner;
+  struct PlaybackState;
+
+  // Reads the next event of a plot line.
+  // @param in_archive The archive the plot line is read from.
+  // @param linked_event_id Receives the linked event id of the event, or
+  //     kNoLinkedEventId.
+  // @param deps Receives the linked event ids of the input constraints of the
+  //     event.
+  // @returns the event on success, nullptr otherwise. For linked events this
+  //     is the wrapped event.
+  std::unique_ptr<EventInterface> ReadEvent(core::InArchive* in_archive,
+                                            uint32_t* linked_event_id,
+                                            std::vector<uint32_t>* deps) const;
+
+  // The path of the open file.
+  base::FilePath path_;
+
+  // The plot lines of the file.
+  std::vector<PlotLineInfo> plot_lines_;
+
+  // The number of linked events in the file.
+  uint32_t linked_event_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(StoryFile);
+};
+
+}  // namespace bard
+
+#endif  // SYZYGY_BARD_STORY_FILE_H_
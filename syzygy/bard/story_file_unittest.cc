@@ -0,0 +1,217 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/bard/story_file.h"
+
+#include "base/bind.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "gtest/gtest.h"
+#include "syzygy/bard/backdrops/heap_backdrop.h"
+#include "syzygy/bard/events/heap_alloc_event.h"
+#include "syzygy/bard/events/heap_create_event.h"
+#include "syzygy/bard/events/heap_destroy_event.h"
+#include "syzygy/bard/events/heap_free_event.h"
+#include "syzygy/bard/events/heap_size_event.h"
+#include "syzygy/bard/events/linked_event.h"
+
+namespace bard {
+
+namespace {
+
+using backdrops::HeapBackdrop;
+using events::HeapAllocEvent;
+using events::HeapCreateEvent;
+using events::HeapDestroyEvent;
+using events::HeapFreeEvent;
+using events::HeapSizeEvent;
+using events::LinkedEvent;
+
+const HANDLE kLiveHeap = reinterpret_cast<HANDLE>(0x4197FC83);
+const HANDLE kTraceHeap = reinterpret_cast<HANDLE>(0xAB12CD34);
+const LPVOID kLiveAlloc = reinterpret_cast<LPVOID>(0x4820BC7A);
+const LPVOID kTraceAlloc = reinterpret_cast<LPVOID>(0xF1D97AE4);
+const DWORD kFlags = 0;
+const DWORD kOptions = 0;
+const SIZE_T kBytes = 100;
+const SIZE_T kSize = 100;
+const SIZE_T kInitialSize = 1;
+const SIZE_T kMaximumSize = 1000;
+
+class StoryFileTest : public testing::Test {
+ public:
+  StoryFileTest() : live_heap_(kLiveHeap), call_count_(0) {}
+
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    path_ = temp_dir_.path().Append(L"story.bin");
+
+    backdrop_.set_heap_create(
+        base::Bind(&StoryFileTest::HeapCreate, base::Unretained(this)));
+    backdrop_.set_heap_alloc(
+        base::Bind(&StoryFileTest::HeapAlloc, base::Unretained(this)));
+    backdrop_.set_heap_size(
+        base::Bind(&StoryFileTest::HeapSize, base::Unretained(this)));
+    backdrop_.set_heap_free(
+        base::Bind(&StoryFileTest::HeapFree, base::Unretained(this)));
+    backdrop_.set_heap_destroy(
+        base::Bind(&StoryFileTest::HeapDestroy, base::Unretained(this)));
+  }
+
+  // Builds a story where a heap is created and destroyed on a plot line,
+  // and used on another.
+  void BuildStory(Story* story) {
+    std::unique_ptr<LinkedEvent> create(new LinkedEvent(
+        std::unique_ptr<EventInterface>(new HeapCreateEvent(
+            0, kOptions, kInitialSize, kMaximumSize, kTraceHeap))));
+    std::unique_ptr<LinkedEvent> alloc(new LinkedEvent(
+        std::unique_ptr<EventInterface>(new HeapAllocEvent(
+            0, kTraceHeap, kFlags, kBytes, kTraceAlloc))));
+    std::unique_ptr<EventInterface> size(
+        new HeapSizeEvent(0, kTraceHeap, kFlags, kTraceAlloc, kSize));
+    std::unique_ptr<LinkedEvent> free(new LinkedEvent(
+        std::unique_ptr<EventInterface>(new HeapFreeEvent(
+            0, kTraceHeap, kFlags, kTraceAlloc, true))));
+    std::unique_ptr<LinkedEvent> destroy(new LinkedEvent(
+        std::unique_ptr<EventInterface>(
+            new HeapDestroyEvent(0, kTraceHeap, true))));
+
+    alloc->AddDep(create.get());
+    destroy->AddDep(free.get());
+
+    // The plot line that uses the heap comes first, so that some of its
+    // dependencies are on events of a later plot line.
+    Story::PlotLine* user = story->CreatePlotLine();
+    Story::PlotLine* owner = story->CreatePlotLine();
+    owner->push_back(create.release());
+    owner->push_back(destroy.release());
+    user->push_back(alloc.release());
+    user->push_back(size.release());
+    user->push_back(free.release());
+  }
+
+ protected:
+  HANDLE HeapCreate(DWORD options, SIZE_T initial_size, SIZE_T maximum_size) {
+    ++call_count_;
+    return live_heap_;
+  }
+  LPVOID HeapAlloc(HANDLE heap, DWORD flags, SIZE_T bytes) {
+    EXPECT_EQ(kLiveHeap, heap);
+    ++call_count_;
+    return kLiveAlloc;
+  }
+  SIZE_T HeapSize(HANDLE heap, DWORD flags, LPCVOID mem) {
+    EXPECT_EQ(kLiveAlloc, mem);
+    ++call_count_;
+    return kSize;
+  }
+  BOOL HeapFree(HANDLE heap, DWORD flags, LPVOID mem) {
+    EXPECT_EQ(kLiveAlloc, mem);
+    ++call_count_;
+    return TRUE;
+  }
+  BOOL HeapDestroy(HANDLE heap) {
+    EXPECT_EQ(kLiveHeap, heap);
+    ++call_count_;
+    return TRUE;
+  }
+
+  base::ScopedTempDir temp_dir_;
+  base::FilePath path_;
+  HeapBackdrop backdrop_;
+
+  // The heap returned by HeapCreate.
+  HANDLE live_heap_;
+
+  // The number of heap calls made by the playback. These are serialized by
+  // the dependencies of the story.
+  size_t call_count_;
+};
+
+}  // namespace
+
+TEST_F(StoryFileTest, WriteAndLoad) {
+  Story story;
+  BuildStory(&story);
+  ASSERT_TRUE(StoryFile::Write(story, path_));
+
+  StoryFile story_file;
+  ASSERT_TRUE(story_file.Open(path_));
+  EXPECT_EQ(2u, story_file.plot_line_count());
+  EXPECT_EQ(4u, story_file.linked_event_count());
+
+  Story loaded;
+  ASSERT_TRUE(story_file.Load(&loaded));
+  EXPECT_TRUE(story == loaded);
+}
+
+TEST_F(StoryFileTest, LoadSpansWindows) {
+  // Enough events for a plot line to span several windows.
+  Story story;
+  Story::PlotLine* plot_line = story.CreatePlotLine();
+  for (size_t i = 0; i < 500000; ++i) {
+    plot_line->push_back(
+        new HeapSizeEvent(i, kTraceHeap, kFlags, kTraceAlloc, i));
+  }
+  ASSERT_TRUE(StoryFile::Write(story, path_));
+
+  int64_t file_size = 0;
+  ASSERT_TRUE(base::GetFileSize(path_, &file_size));
+  EXPECT_LT(2 * static_cast<int64_t>(StoryFile::kWindowSize), file_size);
+
+  StoryFile story_file;
+  ASSERT_TRUE(story_file.Open(path_));
+  Story loaded;
+  ASSERT_TRUE(story_file.Load(&loaded));
+  EXPECT_TRUE(story == loaded);
+}
+
+TEST_F(StoryFileTest, OpenFailsForInvalidFile) {
+  const char kData[] = "not a story";
+  ASSERT_EQ(static_cast<int>(sizeof(kData)),
+            base::WriteFile(path_, kData, sizeof(kData)));
+
+  StoryFile story_file;
+  EXPECT_FALSE(story_file.Open(path_));
+  EXPECT_FALSE(story_file.Open(temp_dir_.path().Append(L"missing.bin")));
+}
+
+TEST_F(StoryFileTest, PlaySucceeds) {
+  Story story;
+  BuildStory(&story);
+  ASSERT_TRUE(StoryFile::Write(story, path_));
+
+  StoryFile story_file;
+  ASSERT_TRUE(story_file.Open(path_));
+  EXPECT_TRUE(story_file.Play(&backdrop_));
+  EXPECT_EQ(5u, call_count_);
+
+  HANDLE live = nullptr;
+  EXPECT_FALSE(backdrop_.heap_map().GetLiveFromTrace(kTraceHeap, &live));
+}
+
+TEST_F(StoryFileTest, PlayStopsAndFails) {
+  Story story;
+  BuildStory(&story);
+  ASSERT_TRUE(StoryFile::Write(story, path_));
+
+  // The heap creation fails, which releases the plot line waiting on it.
+  live_heap_ = nullptr;
+  StoryFile story_file;
+  ASSERT_TRUE(story_file.Open(path_));
+  EXPECT_FALSE(story_file.Play(&backdrop_));
+  EXPECT_EQ(1u, call_count_);
+}
+
+}  // namespace bard
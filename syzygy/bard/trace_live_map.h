@@ -17,8 +17,11 @@
 #ifndef SYZYGY_BARD_TRACE_LIVE_MAP_H_
 #define SYZYGY_BARD_TRACE_LIVE_MAP_H_
 
+#include <stdint.h>
+
 #include <map>
 
+#include "base/macros.h"
 #include "base/synchronization/lock.h"
 
 namespace bard {
@@ -27,12 +30,21 @@ namespace bard {
 // from trace file pointers to live pointers, since the addresses for the
 // live ones are not the same.
 // This class is thread safe for simultaneous access accross multiple threads.
-// @tparam T The type of object that the class is mapping.
+// Each direction of the map is split in shards, keyed by a hash of the
+// pointer, each with a lock of its own. This keeps the threads of a replay
+// that work on different pointers from contending with each other.
+// @tparam T The type of object that the class is mapping. This must be a
+//     pointer type.
 template <typename T>
 class TraceLiveMap {
  public:
   using Map = std::map<T, T>;
 
+  // The number of shards of each direction of the map.
+  static const size_t kShardCount = 64;
+
+  TraceLiveMap() {}
+
   bool AddMapping(T trace, T live);
   bool RemoveMapping(T trace, T live);
 
@@ -43,19 +55,34 @@ class TraceLiveMap {
   void Clear();
 
   // @returns true iff this map is empty.
-  bool Empty() const { return trace_live_.empty() && live_trace_.empty(); }
+  bool Empty() const;
 
-  // @name Simple accessors.
+  // @name Accessors.
+  // @returns a copy of the mappings in the given direction. This isn't atomic
+  //     with respect to concurrent modifications of the map.
   // @{
-  const Map& trace_live() const { return trace_live_; }
-  const Map& live_trace() const { return live_trace_; }
+  Map trace_live() const { return Merge(trace_live_); }
+  Map live_trace() const { return Merge(live_trace_); }
   // @}
 
  private:
-  Map trace_live_;
-  Map live_trace_;
+  struct Shard {
+    Map map;
+    mutable base::Lock lock;
+  };
+
+  // @returns the index of the shard holding @p key.
+  static size_t GetShardIndex(T key);
+
+  // @returns the mappings of all of @p shards.
+  static Map Merge(const Shard (&shards)[kShardCount]);
+
+  // When a shard of each direction is locked at once, the one of trace_live_
+  // is always locked first.
+  Shard trace_live_[kShardCount];
+  Shard live_trace_[kShardCount];
 
-  base::Lock lock_;
+  DISALLOW_COPY_AND_ASSIGN(TraceLiveMap);
 };
 
 }  // namespace bard
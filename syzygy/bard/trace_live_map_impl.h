@@ -25,20 +25,23 @@ bool TraceLiveMap<T>::AddMapping(T trace, T live) {
   if (trace == nullptr && live == nullptr)
     return true;
 
-  base::AutoLock auto_lock(lock_);
+  Shard& trace_shard = trace_live_[GetShardIndex(trace)];
+  Shard& live_shard = live_trace_[GetShardIndex(live)];
+  base::AutoLock trace_lock(trace_shard.lock);
+  base::AutoLock live_lock(live_shard.lock);
 
-  auto insert_trace_live = trace_live_.insert(std::make_pair(trace, live));
+  auto insert_trace_live = trace_shard.map.insert(std::make_pair(trace, live));
 
   if (!insert_trace_live.second) {
     LOG(ERROR) << "Trace argument was previously added: " << trace;
     return false;
   }
 
-  auto insert_live_trace = live_trace_.insert(std::make_pair(live, trace));
+  auto insert_live_trace = live_shard.map.insert(std::make_pair(live, trace));
 
   if (!insert_live_trace.second) {
     LOG(ERROR) << "Live argument was previously added: " << live;
-    trace_live_.erase(insert_trace_live.first);
+    trace_shard.map.erase(insert_trace_live.first);
     return false;
   }
 
@@ -51,23 +54,26 @@ bool TraceLiveMap<T>::RemoveMapping(T trace, T live) {
   if (trace == nullptr && live == nullptr)
     return true;
 
-  base::AutoLock auto_lock(lock_);
+  Shard& trace_shard = trace_live_[GetShardIndex(trace)];
+  Shard& live_shard = live_trace_[GetShardIndex(live)];
+  base::AutoLock trace_lock(trace_shard.lock);
+  base::AutoLock live_lock(live_shard.lock);
 
-  auto find_trace_live = trace_live_.find(trace);
-  auto find_live_trace = live_trace_.find(live);
+  auto find_trace_live = trace_shard.map.find(trace);
+  auto find_live_trace = live_shard.map.find(live);
 
-  if (find_trace_live == trace_live_.end()) {
+  if (find_trace_live == trace_shard.map.end()) {
     LOG(ERROR) << "Trace was not previously added:" << trace;
     return false;
   }
 
-  if (find_live_trace == live_trace_.end()) {
+  if (find_live_trace == live_shard.map.end()) {
     LOG(ERROR) << "Live was not previously added: " << live;
     return false;
   }
 
-  trace_live_.erase(find_trace_live);
-  live_trace_.erase(find_live_trace);
+  trace_shard.map.erase(find_trace_live);
+  live_shard.map.erase(find_live_trace);
   return true;
 }
 
@@ -79,10 +85,11 @@ bool TraceLiveMap<T>::GetLiveFromTrace(T trace, T* live) {
     return true;
   }
 
-  base::AutoLock auto_lock(lock_);
+  Shard& shard = trace_live_[GetShardIndex(trace)];
+  base::AutoLock auto_lock(shard.lock);
 
-  auto live_it = trace_live_.find(trace);
-  if (live_it == trace_live_.end()) {
+  auto live_it = shard.map.find(trace);
+  if (live_it == shard.map.end()) {
     LOG(ERROR) << "Trace argument was not previously added: " << trace;
     return false;
   }
@@ -99,10 +106,11 @@ bool TraceLiveMap<T>::GetTraceFromLive(T live, T* trace) {
     return true;
   }
 
-  base::AutoLock auto_lock(lock_);
+  Shard& shard = live_trace_[GetShardIndex(live)];
+  base::AutoLock auto_lock(shard.lock);
 
-  auto trace_it = live_trace_.find(live);
-  if (trace_it == live_trace_.end()) {
+  auto trace_it = shard.map.find(live);
+  if (trace_it == shard.map.end()) {
     LOG(ERROR) << "Live argument was not previously added: " << live;
     return false;
   }
@@ -113,8 +121,50 @@ bool TraceLiveMap<T>::GetTraceFromLive(T live, T* trace) {
 
 template <typename T>
 void TraceLiveMap<T>::Clear() {
-  trace_live_.clear();
-  live_trace_.clear();
+  for (size_t i = 0; i < kShardCount; ++i) {
+    base::AutoLock trace_lock(trace_live_[i].lock);
+    trace_live_[i].map.clear();
+  }
+  for (size_t i = 0; i < kShardCount; ++i) {
+    base::AutoLock live_lock(live_trace_[i].lock);
+    live_trace_[i].map.clear();
+  }
+}
+
+template <typename T>
+bool TraceLiveMap<T>::Empty() const {
+  for (size_t i = 0; i < kShardCount; ++i) {
+    base::AutoLock trace_lock(trace_live_[i].lock);
+    if (!trace_live_[i].map.empty())
+      return false;
+  }
+  for (size_t i = 0; i < kShardCount; ++i) {
+    base::AutoLock live_lock(live_trace_[i].lock);
+    if (!live_trace_[i].map.empty())
+      return false;
+  }
+  return true;
+}
+
+// static
+template <typename T>
+size_t TraceLiveMap<T>::GetShardIndex(T key) {
+  // Heap pointers are aligned, so the low bits are mixed with the others by
+  // a multiplicative hash and the high bits of the product are used.
+  uint32_t value = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(key));
+  return static_cast<size_t>((value * 2654435761U) >> 26) % kShardCount;
+}
+
+// static
+template <typename T>
+typename TraceLiveMap<T>::Map TraceLiveMap<T>::Merge(
+    const Shard (&shards)[kShardCount]) {
+  Map map;
+  for (size_t i = 0; i < kShardCount; ++i) {
+    base::AutoLock auto_lock(shards[i].lock);
+    map.insert(shards[i].map.begin(), shards[i].map.end());
+  }
+  return map;
 }
 
 }  // namespace bard
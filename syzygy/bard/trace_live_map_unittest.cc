@@ -45,4 +45,32 @@ TEST(TraceLiveMapTest, TestMapping) {
   testing::CheckTraceLiveMapNotContain(trace_live_map, trace, live);
 }
 
+TEST(TraceLiveMapTest, TestManyMappings) {
+  // Enough mappings to span all of the shards.
+  const uintptr_t kMappingCount = 16 * TraceLiveMap<void*>::kShardCount;
+  TraceLiveMap<void*> trace_live_map;
+  for (uintptr_t i = 1; i <= kMappingCount; ++i) {
+    EXPECT_TRUE(trace_live_map.AddMapping(reinterpret_cast<void*>(i * 16),
+                                          reinterpret_cast<void*>(i * 8)));
+  }
+
+  TraceLiveMap<void*>::Map trace_live = trace_live_map.trace_live();
+  TraceLiveMap<void*>::Map live_trace = trace_live_map.live_trace();
+  EXPECT_EQ(kMappingCount, trace_live.size());
+  EXPECT_EQ(kMappingCount, live_trace.size());
+  for (uintptr_t i = 1; i <= kMappingCount; ++i) {
+    testing::CheckTraceLiveMapContains(trace_live_map,
+                                       reinterpret_cast<void*>(i * 16),
+                                       reinterpret_cast<void*>(i * 8));
+    EXPECT_EQ(reinterpret_cast<void*>(i * 8),
+              trace_live[reinterpret_cast<void*>(i * 16)]);
+  }
+
+  for (uintptr_t i = 1; i <= kMappingCount; ++i) {
+    EXPECT_TRUE(trace_live_map.RemoveMapping(reinterpret_cast<void*>(i * 16),
+                                             reinterpret_cast<void*>(i * 8)));
+  }
+  EXPECT_TRUE(trace_live_map.Empty());
+}
+
 }  // namespace bard
@@ -14,6 +14,7 @@
 
 #include "syzygy/block_graph/analysis/liveness_analysis.h"
 
+#include <deque>
 #include <set>
 #include <stack>
 #include <vector>
@@ -169,33 +170,72 @@ void LivenessAnalysis::Analyze(const BasicBlockSubGraph* subgraph) {
   ControlFlowAnalysis::FlattenBasicBlocksInPostOrder(basic_blocks, &order);
 
   // Initialize liveness information of each basic block (empty set).
-  BasicBlockOrdering::const_iterator fw_iter = order.begin();
-  for (; fw_iter != order.end(); ++fw_iter)
-    StateHelper::Clear(&live_in_[*fw_iter]);
-
-  // Propagate liveness information until stable (fix-point). Each set may only
-  // grow, thus we have a halting condition.
-  bool changed = true;
-  while (changed) {
-    changed = false;
-
-    BasicBlockOrdering::const_iterator  bb_iter = order.begin();
-    for (; bb_iter != order.end(); ++bb_iter) {
-      const BasicCodeBlock* bb = *bb_iter;
-
-      // Merge current liveness information with every successor information.
-      State state;
-      GetStateAtExitOf(bb, &state);
-
-      // Propagate liveness information backward until the basic block entry.
-      const Instructions& instructions = bb->instructions();
-      Instructions::const_reverse_iterator instr_iter = instructions.rbegin();
-      for (; instr_iter != instructions.rend(); ++instr_iter)
-        PropagateBackward(*instr_iter, &state);
-
-      // Commit liveness information to the global state.
-      if (StateHelper::Union(state, &live_in_[bb]))
-        changed = true;
+  std::map<const BasicBlock*, size_t> indices;
+  for (size_t i = 0; i < order.size(); ++i) {
+    StateHelper::Clear(&live_in_[order[i]]);
+    indices[order[i]] = i;
+  }
+
+  // Every instruction maps the registers alive after it to (alive - defs) |
+  // uses, where defs and uses don't depend on what is alive. Thus so does a
+  // whole basic block, and its effect is captured by propagating all and no
+  // registers through it once: it maps the registers alive at its exit to
+  // (alive & live_through) | generated.
+  std::vector<State> live_through(order.size());
+  std::vector<State> generated(order.size());
+  std::vector<std::vector<size_t>> predecessors(order.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    const BasicCodeBlock* bb = order[i];
+    StateHelper::SetAll(&live_through[i]);
+    StateHelper::Clear(&generated[i]);
+    const Instructions& instructions = bb->instructions();
+    Instructions::const_reverse_iterator instr_iter = instructions.rbegin();
+    for (; instr_iter != instructions.rend(); ++instr_iter) {
+      PropagateBackward(*instr_iter, &live_through[i]);
+      PropagateBackward(*instr_iter, &generated[i]);
+    }
+
+    const Successors& successors = bb->successors();
+    Successors::const_iterator succ = successors.begin();
+    for (; succ != successors.end(); ++succ) {
+      std::map<const BasicBlock*, size_t>::const_iterator it =
+          indices.find(succ->reference().basic_block());
+      if (it != indices.end())
+        predecessors[it->second].push_back(i);
+    }
+  }
+
+  // Propagate liveness information until stable (fix-point), only revisiting
+  // the basic blocks whose successors changed. Each set may only grow, thus we
+  // have a halting condition. The basic blocks are first visited in
+  // post-order, so that most successors are visited before their
+  // predecessors.
+  std::deque<size_t> worklist;
+  std::vector<bool> pending(order.size(), true);
+  for (size_t i = 0; i < order.size(); ++i)
+    worklist.push_back(i);
+  while (!worklist.empty()) {
+    size_t i = worklist.front();
+    worklist.pop_front();
+    pending[i] = false;
+    const BasicCodeBlock* bb = order[i];
+
+    // Merge current liveness information with every successor information,
+    // and propagate it backward until the basic block entry.
+    State state;
+    GetStateAtExitOf(bb, &state);
+    StateHelper::Intersect(live_through[i], &state);
+    StateHelper::Union(generated[i], &state);
+
+    // Commit liveness information to the global state, and schedule the
+    // predecessors if it changed.
+    if (!StateHelper::Union(state, &live_in_[bb]))
+      continue;
+    for (size_t predecessor : predecessors[i]) {
+      if (!pending[predecessor]) {
+        pending[predecessor] = true;
+        worklist.push_back(predecessor);
+      }
     }
   }
 }
@@ -336,6 +376,13 @@ void LivenessAnalysis::StateHelper::Subtract(const State& src, State* state) {
   state->registers_ &= ~(src.registers_);
 }
 
+void LivenessAnalysis::StateHelper::Intersect(const State& src,
+                                              State* state) {
+  DCHECK(state != NULL);
+  state->flags_ &= src.flags_;
+  state->registers_ &= src.registers_;
+}
+
 void LivenessAnalysis::StateHelper::StateDefOperand(
     const _Operand& operand, State* state) {
   DCHECK(state != NULL);
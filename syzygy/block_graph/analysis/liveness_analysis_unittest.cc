@@ -322,6 +322,19 @@ TEST(LivenessAnalysisStateTest, StateRegisterMaskOperations) {
     StateHelper::IsPartiallySet(state_merged, StateHelper::REGBITS_AX));
   EXPECT_FALSE(
     StateHelper::IsPartiallySet(state_merged, StateHelper::REGBITS_CX));
+
+  // Test Intersect operation.
+  StateHelper::Union(state_ax, &state_merged);
+  StateHelper::Union(state_cx, &state_merged);
+  StateHelper::Intersect(state_cx, &state_merged);
+  EXPECT_FALSE(
+    StateHelper::IsPartiallySet(state_merged, StateHelper::REGBITS_AX));
+  EXPECT_TRUE(StateHelper::IsSet(state_merged, StateHelper::REGBITS_CX));
+  StateHelper::Intersect(state_full, &state_merged);
+  EXPECT_TRUE(StateHelper::IsSet(state_merged, StateHelper::REGBITS_CX));
+  StateHelper::Intersect(state_empty, &state_merged);
+  EXPECT_FALSE(
+    StateHelper::IsPartiallySet(state_merged, StateHelper::REGBITS_CX));
 }
 
 TEST(LivenessAnalysisStateTest, StateFlagsMaskOperations) {
@@ -30,6 +30,7 @@
 #include "syzygy/block_graph/tags.h"
 #include "syzygy/common/align.h"
 #include "syzygy/core/disassembler_util.h"
+#include "syzygy/core/pool_allocator.h"
 
 #include "distorm.h"  // NOLINT
 
@@ -243,7 +244,12 @@ class Instruction {
   typedef BlockGraph::Offset Offset;
   typedef BlockGraph::Block::SourceRange SourceRange;
   typedef _DInst Representation;
-  typedef std::map<Offset, BasicBlockReference> BasicBlockReferenceMap;
+  // The instructions, successors and basic blocks are short-lived and
+  // numerous, so their containers allocate from pools.
+  typedef std::map<Offset, BasicBlockReference, std::less<Offset>,
+                   core::PoolAllocator<
+                       std::pair<const Offset, BasicBlockReference>>>
+      BasicBlockReferenceMap;
 
   // The maximum size (in bytes) of an x86 instruction, per specs.
   static const uint32_t kMaxSize = assm::kMaxInstructionLength;
@@ -260,6 +266,16 @@ class Instruction {
   // @returns true on success, false otherwise.
   static bool FromBuffer(const uint8_t* buf, uint32_t len, Instruction* inst);
 
+  // Factory to construct an initialized Instruction instance from an already
+  // decoded representation. This saves decoding the instructions one at a
+  // time when a whole sequence was decoded at once.
+  // @param repr the decoded representation of the instruction.
+  // @param buf the data comprising the instruction, of @p repr.size bytes.
+  // @param inst receives the instruction.
+  static void FromRepresentation(const Representation& repr,
+                                 const uint8_t* buf,
+                                 Instruction* inst);
+
   // Accessors.
   // @{
   const Representation& representation() const { return representation_; }
@@ -378,7 +394,7 @@ class Successor {
   typedef BlockGraph::Offset Offset;
   typedef BlockGraph::Size Size;
   typedef BlockGraph::Block::SourceRange SourceRange;
-  typedef std::map<Offset, BasicBlockReference> BasicBlockReferenceMap;
+  typedef Instruction::BasicBlockReferenceMap BasicBlockReferenceMap;
 
   // The op-code of an binary instruction.
   typedef uint16_t OpCode;
@@ -527,9 +543,10 @@ class BasicBlock {
   };
 
   typedef BlockGraph::BlockId BlockId;
-  typedef std::list<Instruction> Instructions;
+  typedef std::list<Instruction, core::PoolAllocator<Instruction>>
+      Instructions;
   typedef BlockGraph::Size Size;
-  typedef std::list<Successor> Successors;
+  typedef std::list<Successor, core::PoolAllocator<Successor>> Successors;
   typedef BlockGraph::Offset Offset;
 
   // The collection of references this basic block makes to other basic
@@ -541,7 +558,8 @@ class BasicBlock {
   // This is keyed on block and source offset (not destination offset),
   // to allow us to easily locate and remove the back-references on change or
   // deletion.
-  typedef std::set<BasicBlockReferrer, BasicBlockReferrer::CompareAsLess>
+  typedef std::set<BasicBlockReferrer, BasicBlockReferrer::CompareAsLess,
+                   core::PoolAllocator<BasicBlockReferrer>>
       BasicBlockReferrerSet;
 
   // This offset is used to denote that an instruction, successor, or
@@ -14,10 +14,16 @@
 //
 #include "syzygy/block_graph/basic_block_assembler.h"
 
+#include "syzygy/core/disassembler_util.h"
+
 namespace block_graph {
 
 namespace {
 
+// The address at which the fragments are decoded. This is the same as for
+// the instructions decoded one at a time.
+const uint32_t kFragmentAddress = 0x10000000;
+
 ValueSize ValueSizeFromConstant(uint32_t input_value) {
   // IA32 assembly may/will sign-extend 8-bit literals, so we attempt to encode
   // in 8 bits only those literals whose value will be unchanged by that
@@ -175,7 +181,7 @@ BasicBlockAssembler::Operand Operand(
 
 BasicBlockAssembler::BasicBlockSerializer::BasicBlockSerializer(
     const Instructions::iterator& where, Instructions* list)
-        : where_(where), list_(list) {
+        : where_(where), list_(list), batching_(false), fragment_size_(0) {
   DCHECK(list != NULL);
 }
 
@@ -185,6 +191,22 @@ void BasicBlockAssembler::BasicBlockSerializer::AppendInstruction(
     uint32_t num_bytes,
     const ReferenceInfo* refs,
     size_t num_refs) {
+  if (batching_) {
+    DCHECK_GE(kMaxFragmentSize, num_bytes);
+    if (fragment_size_ + num_bytes > kMaxFragmentSize)
+      FlushFragment();
+
+    ::memcpy(fragment_ + fragment_size_, bytes, num_bytes);
+    fragment_instructions_.push_back(
+        std::make_pair(static_cast<size_t>(num_bytes), source_range_));
+    for (size_t i = 0; i < num_refs; ++i) {
+      fragment_refs_.push_back(refs[i]);
+      fragment_refs_.back().offset += fragment_size_;
+    }
+    fragment_size_ += num_bytes;
+    return;
+  }
+
   Instruction instruction;
   CHECK(Instruction::FromBuffer(bytes, num_bytes, &instruction));
   instruction.set_source_range(source_range_);
@@ -198,6 +220,66 @@ void BasicBlockAssembler::BasicBlockSerializer::AppendInstruction(
   }
 }
 
+void BasicBlockAssembler::BasicBlockSerializer::BeginBatch() {
+  DCHECK(!batching_);
+  DCHECK_EQ(0U, fragment_size_);
+  batching_ = true;
+}
+
+void BasicBlockAssembler::BasicBlockSerializer::EndBatch() {
+  DCHECK(batching_);
+  FlushFragment();
+  batching_ = false;
+}
+
+void BasicBlockAssembler::BasicBlockSerializer::FlushFragment() {
+  if (fragment_instructions_.empty())
+    return;
+
+  // Decode the whole fragment at once.
+  decoded_.resize(fragment_instructions_.size());
+  size_t num_decoded = core::DecodeInstructions(kFragmentAddress,
+                                                fragment_,
+                                                fragment_size_,
+                                                DF_NONE,
+                                                &decoded_[0],
+                                                decoded_.size());
+  CHECK_EQ(fragment_instructions_.size(), num_decoded);
+
+  // Build the instructions in a list of their own, and insert them together.
+  Instructions instructions;
+  std::vector<ReferenceInfo>::const_iterator ref = fragment_refs_.begin();
+  size_t offset = 0;
+  for (size_t i = 0; i < num_decoded; ++i) {
+    size_t size = fragment_instructions_[i].first;
+    CHECK_EQ(size, decoded_[i].size);
+
+    instructions.push_back(Instruction());
+    Instruction& instruction = instructions.back();
+    Instruction::FromRepresentation(decoded_[i], fragment_ + offset,
+                                    &instruction);
+    instruction.set_source_range(fragment_instructions_[i].second);
+
+    // The references are recorded in the order of the instructions.
+    for (; ref != fragment_refs_.end() && ref->offset < offset + size; ++ref) {
+      DCHECK_LE(offset, ref->offset);
+      BasicBlockReference bbref = CompleteUntypedReference(*ref);
+      DCHECK(bbref.IsValid());
+      instruction.SetReference(ref->offset - offset, bbref);
+    }
+
+    offset += size;
+  }
+  DCHECK(ref == fragment_refs_.end());
+  DCHECK_EQ(fragment_size_, offset);
+
+  list_->splice(where_, instructions);
+
+  fragment_size_ = 0;
+  fragment_instructions_.clear();
+  fragment_refs_.clear();
+}
+
 bool BasicBlockAssembler::BasicBlockSerializer::FinalizeLabel(
     uint32_t location,
     const uint8_t* bytes,
@@ -217,6 +299,11 @@ BasicBlockAssembler::BasicBlockAssembler(uint32_t location,
     : Super(location, &serializer_), serializer_(where, list) {
 }
 
+BasicBlockAssembler::~BasicBlockAssembler() {
+  if (serializer_.batching())
+    serializer_.EndBatch();
+}
+
 void BasicBlockAssembler::call(const Immediate& dst) {
   // In the context of BasicBlockAssembler it only makes sense for calls with
   // immediate parameters to be backed by a 32-bit reference.
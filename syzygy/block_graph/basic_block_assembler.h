@@ -17,6 +17,8 @@
 #ifndef SYZYGY_BLOCK_GRAPH_BASIC_BLOCK_ASSEMBLER_H_
 #define SYZYGY_BLOCK_GRAPH_BASIC_BLOCK_ASSEMBLER_H_
 
+#include <vector>
+
 #include "syzygy/assm/assembler_base.h"
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/block_graph.h"
@@ -140,6 +142,9 @@ class BasicBlockAssembler : public assm::AssemblerBase<UntypedReference> {
                       const Instructions::iterator& where,
                       Instructions* list);
 
+  // Flushes the pending batch, if any.
+  ~BasicBlockAssembler();
+
   // @returns The source range injected into created instructions.
   SourceRange source_range() const { return serializer_.source_range(); }
 
@@ -151,6 +156,19 @@ class BasicBlockAssembler : public assm::AssemblerBase<UntypedReference> {
     serializer_.set_source_range(source_range);
   }
 
+  // @name Batch emission.
+  // The instructions assembled between BeginBatch and EndBatch are encoded
+  // into a single fragment, with their references recorded by their offset
+  // in it. EndBatch then decodes the whole fragment at once and inserts its
+  // instructions in the list together. This is faster for the probe
+  // sequences that are inserted a great many times. The instructions aren't
+  // in the list until the batch ends.
+  // @{
+  void BeginBatch() { serializer_.BeginBatch(); }
+  void EndBatch() { serializer_.EndBatch(); }
+  bool batching() const { return serializer_.batching(); }
+  // @}
+
   // @name Call instructions.
   // @{
   void call(const Immediate& dst);
@@ -197,12 +215,37 @@ class BasicBlockAssembler : public assm::AssemblerBase<UntypedReference> {
     // @param size The size of the reference, as a ValueSize.
     void PushReferenceInfo(ReferenceType type, assm::ValueSize size);
 
+    // @name Batch emission.
+    // @{
+    void BeginBatch();
+    void EndBatch();
+    bool batching() const { return batching_; }
+    // @}
+
    private:
+    // The size of the fragment holding the instructions of a batch. A batch
+    // that outgrows it is flushed in several fragments.
+    static const size_t kMaxFragmentSize = 256;
+
+    // Decodes the fragment and inserts its instructions in the list.
+    void FlushFragment();
+
     Instructions::iterator where_;
     Instructions* list_;
 
     // Source range set to instructions appended by this serializer.
     SourceRange source_range_;
+
+    // The state of the current batch. The vectors keep their capacity from
+    // one batch to the next.
+    bool batching_;
+    uint8_t fragment_[kMaxFragmentSize];
+    size_t fragment_size_;
+    // The size and source range of each instruction of the fragment.
+    std::vector<std::pair<size_t, SourceRange>> fragment_instructions_;
+    // The references of the fragment, with offsets from its start.
+    std::vector<ReferenceInfo> fragment_refs_;
+    std::vector<_DInst> decoded_;
   };
 
   BasicBlockSerializer serializer_;
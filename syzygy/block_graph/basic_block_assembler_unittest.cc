@@ -781,6 +781,67 @@ TEST_F(BasicBlockAssemblerTest, xchg) {
   ASSERT_NO_REFS();
 }
 
+TEST_F(BasicBlockAssemblerTest, BatchMatchesInstructions) {
+  BasicBlock::Instructions expected;
+  BasicBlockAssembler expected_asm(expected.end(), &expected);
+  expected_asm.push(assm::edx);
+  expected_asm.lea(assm::edx, Operand(assm::eax, Displacement(test_block_, 4)));
+  expected_asm.call(Operand(Displacement(test_bb_)));
+
+  asm_.BeginBatch();
+  EXPECT_TRUE(asm_.batching());
+  asm_.push(assm::edx);
+  asm_.lea(assm::edx, Operand(assm::eax, Displacement(test_block_, 4)));
+  asm_.call(Operand(Displacement(test_bb_)));
+
+  // The instructions are inserted when the batch ends.
+  EXPECT_TRUE(instructions_.empty());
+  asm_.EndBatch();
+  EXPECT_FALSE(asm_.batching());
+
+  ASSERT_EQ(expected.size(), instructions_.size());
+  BasicBlock::Instructions::const_iterator expected_it = expected.begin();
+  BasicBlock::Instructions::const_iterator it = instructions_.begin();
+  for (; it != instructions_.end(); ++it, ++expected_it) {
+    ASSERT_EQ(expected_it->size(), it->size());
+    EXPECT_EQ(0, ::memcmp(expected_it->data(), it->data(), it->size()));
+    EXPECT_EQ(expected_it->opcode(), it->opcode());
+    EXPECT_TRUE(expected_it->references() == it->references());
+  }
+}
+
+TEST_F(BasicBlockAssemblerTest, BatchSpansFragments) {
+  // Enough instructions to flush several fragments.
+  asm_.BeginBatch();
+  for (size_t i = 0; i < 200; ++i)
+    asm_.mov(assm::eax, Operand(Displacement(test_block_, 0)));
+  asm_.EndBatch();
+
+  ASSERT_EQ(200U, instructions_.size());
+  BasicBlock::Instructions::const_iterator it = instructions_.begin();
+  for (; it != instructions_.end(); ++it) {
+    EXPECT_EQ(I_MOV, it->opcode());
+    ASSERT_EQ(1U, it->references().size());
+    EXPECT_EQ(test_block_, it->references().begin()->second.block());
+  }
+}
+
+TEST_F(BasicBlockAssemblerTest, BatchKeepsSourceRanges) {
+  SourceRange range1(RelativeAddress(10), 10);
+  SourceRange range2(RelativeAddress(20), 20);
+
+  asm_.BeginBatch();
+  asm_.set_source_range(range1);
+  asm_.push(assm::ebp);
+  asm_.set_source_range(range2);
+  asm_.pop(assm::ebp);
+  asm_.EndBatch();
+
+  ASSERT_EQ(2U, instructions_.size());
+  EXPECT_EQ(range1, instructions_.front().source_range());
+  EXPECT_EQ(range2, instructions_.back().source_range());
+}
+
 TEST_F(BasicBlockAssemblerTest, UndefinedSourceRange) {
   ASSERT_EQ(asm_.source_range(), SourceRange());
   asm_.call(Immediate(test_block_, 0));
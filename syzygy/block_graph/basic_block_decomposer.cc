@@ -25,6 +25,7 @@
 #include "syzygy/block_graph/basic_block_subgraph.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/block_graph/block_util.h"
+#include "syzygy/block_graph/decoded_instruction_cache.h"
 
 #include "mnemonics.h"  // NOLINT
 
@@ -244,6 +245,13 @@ bool BasicBlockDecomposer::DecodeInstruction(Offset offset,
           << " instruction (" << instruction->size()
           << " bytes) at offset " << offset << ".";
 
+  return true;
+}
+
+void BasicBlockDecomposer::InitInstruction(Offset offset,
+                                           Instruction* instruction) const {
+  DCHECK(instruction != NULL);
+
   // Track the source range.
   instruction->set_source_range(
       GetSourceRange(offset, instruction->size()));
@@ -257,8 +265,6 @@ bool BasicBlockDecomposer::DecodeInstruction(Offset offset,
         << block_->name() << ".";
     instruction->set_label(label);
   }
-
-  return true;
 }
 
 BasicBlockDecomposer::SourceRange BasicBlockDecomposer::GetSourceRange(
@@ -568,14 +574,33 @@ bool BasicBlockDecomposer::ParseInstructions() {
   // Initialize jump_targets_ to include un-discoverable targets.
   InitJumpTargets(code_end_offset);
 
+  // The instructions of a block that was decomposed before are taken from
+  // the cache of its block graph rather than decoded again.
+  DecodedInstructionCache* cache = NULL;
+  if (block_->block_graph() != NULL)
+    cache = block_->block_graph()->decoded_instruction_cache();
+  DecodedInstructionCache::Representations cached_instructions;
+  bool is_cached = cache != NULL &&
+      cache->Lookup(block_, code_end_offset, &cached_instructions);
+  DecodedInstructionCache::Representations decoded_instructions;
+
   // Disassemble the instruction stream into rudimentary basic blocks.
   Offset offset = 0;
+  size_t instruction_index = 0;
   current_block_start_ = offset;
   while (offset < code_end_offset) {
     // Decode the next instruction.
     Instruction instruction;
-    if (!DecodeInstruction(offset, code_end_offset, &instruction))
-      return false;
+    if (is_cached) {
+      DCHECK_LT(instruction_index, cached_instructions.size());
+      Instruction::FromRepresentation(cached_instructions[instruction_index++],
+                                      block_->data() + offset, &instruction);
+    } else {
+      if (!DecodeInstruction(offset, code_end_offset, &instruction))
+        return false;
+      decoded_instructions.push_back(instruction.representation());
+    }
+    InitInstruction(offset, &instruction);
 
     // Handle the decoded instruction.
     if (!HandleInstruction(instruction, offset))
@@ -595,6 +620,10 @@ bool BasicBlockDecomposer::ParseInstructions() {
   if (current_block_start_ != code_end_offset)
     EndCurrentBasicBlock(code_end_offset);
 
+  // Record the instructions for the next decomposition of the block.
+  if (cache != NULL && !is_cached)
+    cache->Insert(block_, code_end_offset, decoded_instructions);
+
   return true;
 }
 
@@ -102,7 +102,7 @@ class BasicBlockDecomposer {
   }
 
  protected:
-  typedef std::map<Offset, BasicBlockReference> BasicBlockReferenceMap;
+  typedef Instruction::BasicBlockReferenceMap BasicBlockReferenceMap;
   typedef core::AddressSpace<Offset, size_t, BasicBlock*> BBAddressSpace;
   typedef BlockGraph::Block::SourceRange SourceRange;
   typedef BlockGraph::Size Size;
@@ -162,7 +162,8 @@ class BasicBlockDecomposer {
   void InitJumpTargets(Offset code_end_offset);
 
   // Decode the bytes at @p offset into @p instruction. This function takes
-  // into consideration the range of offsets which denote code.
+  // into consideration the range of offsets which denote code. The source
+  // range and the label of the instruction are set by InitInstruction().
   // @param offset The offset of into block_ at which to start decoding.
   // @param code_end_offset The offset at which the bytes cease to be code.
   // @param instruction this value will be populated on success.
@@ -172,6 +173,14 @@ class BasicBlockDecomposer {
                          Offset code_end_offset,
                          Instruction* instruction) const;
 
+  // Sets the source range and the label of an instruction from the original
+  // block, whether it was decoded or taken from the decoded instruction cache
+  // of the block graph.
+  // @param offset The offset of @p instruction in block_.
+  // @param instruction The instruction to initialize.
+  // @note Used by ParseInstructions().
+  void InitInstruction(Offset offset, Instruction* instruction) const;
+
   // Called for each instruction, this creates the Instruction object
   // corresponding to @p instruction, or terminates the current basic block
   // if @p instruction is a branch point.
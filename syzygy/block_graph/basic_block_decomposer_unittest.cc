@@ -27,6 +27,7 @@
 #include "gtest/gtest.h"
 #include "syzygy/block_graph/basic_block_test_util.h"
 #include "syzygy/block_graph/block_graph_serializer.h"
+#include "syzygy/block_graph/decoded_instruction_cache.h"
 #include "syzygy/core/address.h"
 #include "syzygy/core/serialization.h"
 #include "syzygy/core/unittest_util.h"
@@ -489,6 +490,42 @@ TEST_F(BasicBlockDecomposerTest, FailsForBrokenInlineAssembly) {
   EXPECT_FALSE(bbd.contains_unsupported_instructions());
 }
 
+TEST_F(BasicBlockDecomposerTest, DecomposeReusesDecodedInstructions) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+  ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraph());
+
+  // The first decomposition recorded the instructions of the block.
+  DecodedInstructionCache* cache = block_graph_.decoded_instruction_cache();
+  ASSERT_TRUE(cache != NULL);
+  EXPECT_EQ(1u, cache->size());
+
+  // Decomposing the block again from the recorded instructions yields the
+  // same basic blocks.
+  BasicBlockSubGraph subgraph;
+  BasicBlockDecomposer bbd(assembly_func_, &subgraph);
+  ASSERT_TRUE(bbd.Decompose());
+  ASSERT_TRUE(subgraph.IsValid());
+  EXPECT_EQ(1u, cache->size());
+
+  ASSERT_EQ(1u, subgraph.block_descriptions().size());
+  const BasicBlockSubGraph::BasicBlockOrdering& order =
+      subgraph.block_descriptions().back().basic_block_order;
+  ASSERT_EQ(bbs_.size(), order.size());
+  BasicBlockSubGraph::BasicBlockOrdering::const_iterator it = order.begin();
+  for (size_t i = 0; i < bbs_.size(); ++i, ++it) {
+    EXPECT_EQ(bbs_[i]->type(), (*it)->type());
+    EXPECT_EQ(bbs_[i]->offset(), (*it)->offset());
+    BasicCodeBlock* expected = BasicCodeBlock::Cast(bbs_[i]);
+    BasicCodeBlock* actual = BasicCodeBlock::Cast(*it);
+    if (expected == NULL)
+      continue;
+    ASSERT_TRUE(actual != NULL);
+    EXPECT_EQ(expected->instructions().size(), actual->instructions().size());
+    EXPECT_EQ(expected->successors().size(), actual->successors().size());
+    EXPECT_EQ(expected->GetInstructionSize(), actual->GetInstructionSize());
+  }
+}
+
 TEST_F(BasicBlockDecomposerTest, ContainsJECXZ) {
   ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
   BlockGraph::Block* jecxz = block_graph_.AddBlock(
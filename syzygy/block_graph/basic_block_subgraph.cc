@@ -18,6 +18,7 @@
 
 #include <algorithm>
 #include <memory>
+#include <new>
 
 namespace block_graph {
 
@@ -41,13 +42,11 @@ BasicBlockSubGraph::BasicBlockSubGraph()
 }
 
 BasicBlockSubGraph::~BasicBlockSubGraph() {
-  // Delete all the BB's we've been entrusted with.
-  BBCollection::iterator it = basic_blocks_.begin();
-  for (; it != basic_blocks_.end(); ++it)
-    delete *it;
-
-  // And wipe the collection.
+  // Destroy all the BB's we've been entrusted with, including the removed
+  // ones. Their memory goes away with the arena.
   basic_blocks_.clear();
+  for (BasicBlock* bb : allocated_basic_blocks_)
+    bb->~BasicBlock();
 }
 
 BasicBlockSubGraph::BlockDescription* BasicBlockSubGraph::AddBlockDescription(
@@ -74,12 +73,9 @@ block_graph::BasicCodeBlock* BasicBlockSubGraph::AddBasicCodeBlock(
   DCHECK(!name.empty());
 
   BlockId id = next_block_id_++;
-  std::unique_ptr<BasicCodeBlock> new_code_block(
-      new BasicCodeBlock(this, name, id));
-  bool inserted = basic_blocks_.insert(new_code_block.get()).second;
-  DCHECK(inserted);
-
-  return new_code_block.release();
+  BasicCodeBlock* new_code_block = new(arena_.Allocate(
+      sizeof(BasicCodeBlock))) BasicCodeBlock(this, name, id);
+  return AddBasicBlock(new_code_block);
 }
 
 block_graph::BasicDataBlock* BasicBlockSubGraph::AddBasicDataBlock(
@@ -89,21 +85,25 @@ block_graph::BasicDataBlock* BasicBlockSubGraph::AddBasicDataBlock(
   DCHECK(!name.empty());
 
   BlockId id = next_block_id_++;
-  std::unique_ptr<BasicDataBlock> new_data_block(
-      new BasicDataBlock(this, name, id, data, size));
-  bool inserted = basic_blocks_.insert(new_data_block.get()).second;
-  DCHECK(inserted);
-
-  return new_data_block.release();
+  BasicDataBlock* new_data_block = new(arena_.Allocate(
+      sizeof(BasicDataBlock))) BasicDataBlock(this, name, id, data, size);
+  return AddBasicBlock(new_data_block);
 }
 
 block_graph::BasicEndBlock* BasicBlockSubGraph::AddBasicEndBlock() {
   BlockId id = next_block_id_++;
-  std::unique_ptr<BasicEndBlock> new_end_block(new BasicEndBlock(this, id));
-  bool inserted = basic_blocks_.insert(new_end_block.get()).second;
-  DCHECK(inserted);
+  BasicEndBlock* new_end_block = new(arena_.Allocate(
+      sizeof(BasicEndBlock))) BasicEndBlock(this, id);
+  return AddBasicBlock(new_end_block);
+}
 
-  return new_end_block.release();
+template <typename BasicBlockType>
+BasicBlockType* BasicBlockSubGraph::AddBasicBlock(BasicBlockType* bb) {
+  DCHECK_NE(static_cast<BasicBlockType*>(nullptr), bb);
+  allocated_basic_blocks_.push_back(bb);
+  bool inserted = basic_blocks_.insert(bb).second;
+  DCHECK(inserted);
+  return bb;
 }
 
 void BasicBlockSubGraph::Remove(BasicBlock* bb) {
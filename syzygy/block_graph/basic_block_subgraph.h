@@ -20,10 +20,12 @@
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "base/strings/string_piece.h"
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/block_graph.h"
+#include "syzygy/core/arena.h"
 
 namespace block_graph {
 
@@ -129,7 +131,8 @@ class BasicBlockSubGraph {
   // @returns a pointer to the newly allocated basic end block
   BasicEndBlock* AddBasicEndBlock();
 
-  // Remove a basic block from the subgraph.
+  // Remove a basic block from the subgraph. The basic block remains valid
+  // until the subgraph is destroyed.
   // @param bb The basic block to remove.
   // @pre @p bb must be in the graph.
   void Remove(BasicBlock* bb);
@@ -162,6 +165,20 @@ class BasicBlockSubGraph {
   bool HasValidReferrers() const;
   // @}
 
+  // Records a newly created basic block, and adds it to the sub-graph.
+  // @param bb The basic block, which must have been allocated from arena_.
+  // @returns @p bb.
+  template <typename BasicBlockType>
+  BasicBlockType* AddBasicBlock(BasicBlockType* bb);
+
+  // The basic blocks are allocated from this arena, and all freed at once
+  // when the sub-graph is destroyed. This must outlive the basic blocks.
+  core::Arena arena_;
+
+  // All the basic blocks created by this sub-graph, including the removed
+  // ones, which are destroyed with the sub-graph.
+  std::vector<BasicBlock*> allocated_basic_blocks_;
+
   // The original block corresponding from which this sub-graph derives. This
   // is optional, and may be NULL.
   const Block* original_block_;
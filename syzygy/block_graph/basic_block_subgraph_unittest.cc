@@ -123,6 +123,28 @@ TEST(BasicBlockSubGraphTest, AddBasicBlock) {
   }
 }
 
+TEST(BasicBlockSubGraphTest, RemovedBasicBlockRemainsValid) {
+  BasicBlockSubGraph subgraph;
+  BasicCodeBlock* bb1 = subgraph.AddBasicCodeBlock("bb1");
+  BasicCodeBlock* bb2 = subgraph.AddBasicCodeBlock("bb2");
+  ASSERT_FALSE(bb1 == NULL);
+  ASSERT_FALSE(bb2 == NULL);
+  bb1->instructions().push_back(Instruction());
+
+  subgraph.Remove(bb1);
+  EXPECT_EQ(1U, subgraph.basic_blocks().size());
+  EXPECT_EQ(bb2, *subgraph.basic_blocks().begin());
+
+  // The removed basic block is only destroyed along with the subgraph.
+  EXPECT_EQ("bb1", bb1->name());
+  EXPECT_EQ(1U, bb1->instructions().size());
+
+  // Instructions can be moved between basic blocks.
+  bb2->instructions().splice(bb2->instructions().end(), bb1->instructions());
+  EXPECT_TRUE(bb1->instructions().empty());
+  EXPECT_EQ(1U, bb2->instructions().size());
+}
+
 TEST(BasicBlockSubGraphTest, AddBlockDescription) {
   TestBasicBlockSubGraph subgraph;
   BlockDescription* b1 = subgraph.AddBlockDescription(
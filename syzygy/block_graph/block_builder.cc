@@ -48,6 +48,8 @@ typedef BasicBlockOrdering::const_iterator BasicBlockOrderingConstIter;
 typedef BlockDescriptionList::const_iterator BlockDescriptionConstIter;
 typedef BasicBlock::Instructions::const_iterator InstructionConstIter;
 typedef BasicBlock::Successors::const_iterator SuccessorConstIter;
+typedef SubGraphLayout::BasicBlockInfo BasicBlockLayoutInfo;
+typedef SubGraphLayout::SuccessorInfo SuccessorLayoutInfo;
 
 const size_t kInvalidSize = SIZE_MAX;
 
@@ -68,15 +70,12 @@ void UpdateTagInfoMap(const TagSet& tag_set,
 
 // Checks that any BasicEndBlocks are at the end of their associated
 // basic-block order.
-bool EndBlocksAreWellPlaced(BasicBlockSubGraph* subgraph) {
-  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
-
-  BasicBlockSubGraph::BlockDescriptionList::iterator bd_it =
-      subgraph->block_descriptions().begin();
-  for (; bd_it != subgraph->block_descriptions().end(); ++bd_it) {
-    BasicBlockSubGraph::BasicBlockOrdering& bbs = bd_it->basic_block_order;
-    BasicBlockSubGraph::BasicBlockOrdering::iterator bb_it = bbs.begin();
-    BasicBlockSubGraph::BasicBlockOrdering::iterator bb_it_end = bbs.end();
+bool EndBlocksAreWellPlaced(const BasicBlockSubGraph& subgraph) {
+  BlockDescriptionConstIter bd_it = subgraph.block_descriptions().begin();
+  for (; bd_it != subgraph.block_descriptions().end(); ++bd_it) {
+    const BasicBlockOrdering& bbs = bd_it->basic_block_order;
+    BasicBlockOrderingConstIter bb_it = bbs.begin();
+    BasicBlockOrderingConstIter bb_it_end = bbs.end();
     bool end_block_seen = false;
     for (; bb_it != bb_it_end; ++bb_it) {
       if ((*bb_it)->type() == BasicBlock::BASIC_END_BLOCK) {
@@ -115,12 +114,365 @@ void AddOrMergeLabel(BlockGraph::Offset offset,
   }
 }
 
-// A utility class to package up the context in which new blocks are generated.
+// Returns the minimal successor size for @p condition.
+Size GetShortSuccessorSize(Successor::Condition condition) {
+  switch (condition) {
+    case Successor::kConditionAbove:
+    case Successor::kConditionAboveOrEqual:
+    case Successor::kConditionBelow:
+    case Successor::kConditionBelowOrEqual:
+    case Successor::kConditionEqual:
+    case Successor::kConditionGreater:
+    case Successor::kConditionGreaterOrEqual:
+    case Successor::kConditionLess:
+    case Successor::kConditionLessOrEqual:
+    case Successor::kConditionNotEqual:
+    case Successor::kConditionNotOverflow:
+    case Successor::kConditionNotParity:
+    case Successor::kConditionNotSigned:
+    case Successor::kConditionOverflow:
+    case Successor::kConditionParity:
+    case Successor::kConditionSigned:
+      // Translates to a conditional branch.
+      return assm::kShortBranchSize;
+
+    case Successor::kConditionTrue:
+      // Translates to a jump.
+      return assm::kShortJumpSize;
+
+    default:
+      NOTREACHED() << "Unsupported successor type.";
+      return 0;
+  }
+}
+
+// Returns the maximal successor size for @p condition.
+Size GetLongSuccessorSize(Successor::Condition condition) {
+  switch (condition) {
+    case Successor::kConditionAbove:
+    case Successor::kConditionAboveOrEqual:
+    case Successor::kConditionBelow:
+    case Successor::kConditionBelowOrEqual:
+    case Successor::kConditionEqual:
+    case Successor::kConditionGreater:
+    case Successor::kConditionGreaterOrEqual:
+    case Successor::kConditionLess:
+    case Successor::kConditionLessOrEqual:
+    case Successor::kConditionNotEqual:
+    case Successor::kConditionNotOverflow:
+    case Successor::kConditionNotParity:
+    case Successor::kConditionNotSigned:
+    case Successor::kConditionOverflow:
+    case Successor::kConditionParity:
+    case Successor::kConditionSigned:
+      // Translates to a conditional branch.
+      return assm::kLongBranchSize;
+
+    case Successor::kConditionTrue:
+      // Translates to a jump.
+      return assm::kLongJumpSize;
+
+    default:
+      NOTREACHED() << "Unsupported successor type.";
+      return 0;
+  }
+}
+
+// Computes and returns the required successor size for @p successor.
+// @param layout The layout of the subgraph.
+// @param info The layout info for the basic block.
+// @param start_offset Offset from the start of @p info.basic_block to
+//     the first byte of the successor.
+// @param successor The successor to size.
+Size ComputeRequiredSuccessorSize(const SubGraphLayout& layout,
+                                  const BasicBlockLayoutInfo& info,
+                                  Offset start_offset,
+                                  const SuccessorLayoutInfo& successor) {
+  switch (successor.reference.referred_type()) {
+    case BasicBlockReference::REFERRED_TYPE_BLOCK:
+      return GetLongSuccessorSize(successor.condition);
+
+    case BasicBlockReference::REFERRED_TYPE_BASIC_BLOCK: {
+      Size short_size = GetShortSuccessorSize(successor.condition);
+      const BasicBlock* dest_bb = successor.reference.basic_block();
+      DCHECK_NE(reinterpret_cast<BasicBlock*>(NULL), dest_bb);
+      const BasicBlockLayoutInfo& dest = layout.Find(dest_bb);
+
+      // If the destination is within the same destination block,
+      // let's see if we can use a short reach here.
+      if (info.block_index == dest.block_index) {
+        Offset destination_offset =
+            dest.start_offset - (start_offset + short_size);
+
+        // Are we in-bounds for a short reference?
+        if (destination_offset <= std::numeric_limits<int8_t>::max() &&
+            destination_offset >= std::numeric_limits<int8_t>::min()) {
+          return short_size;
+        }
+      }
+
+      return GetLongSuccessorSize(successor.condition);
+    }
+
+    default:
+      NOTREACHED() << "Impossible Successor reference type.";
+      return 0;
+  }
+}
+
+// Initializes the layout of @p order, which is the basic block ordering of
+// the block description at @p block_index.
+// @param order The basic block ordering to process.
+// @param block_index The index of the block description of @p order.
+// @param layout The layout to initialize.
+bool InitializeBlockLayout(const BasicBlockOrdering& order,
+                           size_t block_index,
+                           SubGraphLayout* layout) {
+  DCHECK_NE(reinterpret_cast<SubGraphLayout*>(NULL), layout);
+  SubGraphLayout::BlockInfo& block_info = layout->blocks()[block_index];
+
+  // Populate the initial layout info.
+  BasicBlockOrderingConstIter it = order.begin();
+  for (; it != order.end(); ++it) {
+    const BasicBlock* bb = *it;
+
+    // Propagate BB alignment to the parent block.
+    if (bb->alignment() > block_info.alignment)
+      block_info.alignment = bb->alignment();
+
+    // Initialize the layout info for this block.
+    DCHECK_GT(layout->basic_blocks().size(), bb->id());
+    BasicBlockLayoutInfo& info = layout->basic_blocks()[bb->id()];
+    DCHECK_EQ(reinterpret_cast<BasicBlock*>(NULL), info.basic_block);
+    info.basic_block = bb;
+    info.block_index = block_index;
+    info.start_offset = 0;
+    info.basic_block_size = kInvalidSize;
+
+    const BasicCodeBlock* code_block = BasicCodeBlock::Cast(bb);
+    if (code_block != NULL)
+      info.basic_block_size = code_block->GetInstructionSize();
+
+    const BasicDataBlock* data_block = BasicDataBlock::Cast(bb);
+    if (data_block != NULL)
+      info.basic_block_size = data_block->size();
+
+    const BasicEndBlock* end_block = BasicEndBlock::Cast(bb);
+    if (end_block != NULL)
+      info.basic_block_size = end_block->size();
+
+    // The size must have been set.
+    DCHECK_NE(kInvalidSize, info.basic_block_size);
+
+    for (size_t i = 0; i < arraysize(info.successors); ++i) {
+      info.successors[i].condition = Successor::kInvalidCondition;
+      info.successors[i].size = 0;
+      info.successors[i].successor = NULL;
+    }
+
+    // Find the next basic block, if any.
+    BasicBlockOrderingConstIter next_it(it);
+    ++next_it;
+    const BasicBlock* next_bb = NULL;
+    if (next_it != order.end())
+      next_bb = *(next_it);
+
+    if (code_block == NULL)
+      continue;
+
+    // Go through and decide how to manifest the successors for the current
+    // basic block. A basic block has zero, one or two successors, and any
+    // successor that refers to the next basic block in sequence is elided, as
+    // it's most efficient for execution to simply fall through. We do this in
+    // two nearly-identical code blocks, as the handling is only near-identical
+    // for each of two possible successors.
+    DCHECK_GE(2U, code_block->successors().size());
+    SuccessorConstIter succ_it = code_block->successors().begin();
+    SuccessorConstIter succ_end = code_block->successors().end();
+
+    // Process the first successor, if any.
+    size_t manifested_successors = 0;
+    size_t elided_successors = 0;
+    if (succ_it != succ_end) {
+      const BasicBlock* destination_bb = succ_it->reference().basic_block();
+
+      // Record the source range of the original successor.
+      if (succ_it->source_range().size() != 0) {
+        DCHECK_EQ(0U, info.successor_source_range.size());
+        info.successor_source_range = succ_it->source_range();
+      }
+      // Record the label of the original successor.
+      if (succ_it->has_label())
+        info.successor_label = succ_it->label();
+
+      // Only manifest this successor if it's not referencing the next block.
+      SuccessorLayoutInfo& successor =
+          info.successors[manifested_successors + elided_successors];
+      successor.successor = &(*succ_it);
+      if (destination_bb == NULL || destination_bb != next_bb) {
+        ++manifested_successors;
+        successor.condition = succ_it->condition();
+        successor.reference = succ_it->reference();
+      } else {
+        ++elided_successors;
+      }
+
+      // Go to the next successor, if any.
+      ++succ_it;
+    }
+
+    // Process the second successor, if any.
+    if (succ_it != succ_end) {
+      const BasicBlock* destination_bb = succ_it->reference().basic_block();
+
+      // Record the source range of the original successor.
+      if (succ_it->source_range().size() != 0) {
+        DCHECK_EQ(0U, info.successor_source_range.size());
+        info.successor_source_range = succ_it->source_range();
+      }
+      // Record the label of the original successor.
+      if (succ_it->has_label()) {
+        DCHECK(!info.successor_label.IsValid());
+        info.successor_label = succ_it->label();
+      }
+
+      // Only manifest this successor if it's not referencing the next block.
+      SuccessorLayoutInfo& successor =
+          info.successors[manifested_successors + elided_successors];
+      successor.successor = &(*succ_it);
+      if (destination_bb == NULL || destination_bb != next_bb) {
+        Successor::Condition condition = succ_it->condition();
+
+        // If we've already manifested a successor above, it'll be for the
+        // complementary condition to ours. While it's correct to manifest it
+        // as a conditional branch, it's more efficient to manifest as an
+        // unconditional jump.
+        if (manifested_successors != 0) {
+          DCHECK_EQ(Successor::InvertCondition(info.successors[0].condition),
+                    succ_it->condition());
+
+          condition = Successor::kConditionTrue;
+        }
+
+        ++manifested_successors;
+
+        successor.condition = condition;
+        successor.reference = succ_it->reference();
+      } else {
+        ++elided_successors;
+      }
+    }
+
+    // A basic-block can have at most 2 successors by definition. Since we emit
+    // a successor layout struct for each one (whether or not its elided), we
+    // expect there to have been as many successors emitted as there are
+    // successors in the basic block itself.
+    DCHECK_GE(arraysize(info.successors),
+              manifested_successors + elided_successors);
+    DCHECK_EQ(code_block->successors().size(),
+              manifested_successors + elided_successors);
+  }
+
+  return true;
+}
+
+// Generates a layout for @p order. This layout will arrange each basic block
+// in the ordering back-to-back with minimal reach encodings on each
+// successor, while respecting basic block alignments.
+// @param order The basic block ordering to process.
+// @param block_index The index of the block description of @p order.
+// @param layout The layout, initialized by InitializeBlockLayout.
+bool GenerateBlockLayout(const BasicBlockOrdering& order,
+                         size_t block_index,
+                         SubGraphLayout* layout) {
+  DCHECK_NE(reinterpret_cast<SubGraphLayout*>(NULL), layout);
+  BasicBlockOrderingConstIter it = order.begin();
+
+  // Loop over the layout, expanding successors until stable.
+  while (true) {
+    bool expanded_successor = false;
+
+    // Update the start offset for each of the BBs, respecting the BB alignment
+    // constraints.
+    it = order.begin();
+    Offset next_block_start = 0;
+    for (; it != order.end(); ++it) {
+      BasicBlockLayoutInfo& info = layout->Find(*it);
+      next_block_start = common::AlignUp(next_block_start,
+                                         info.basic_block->alignment());
+      info.start_offset = next_block_start;
+      DCHECK_EQ(block_index, info.block_index);
+
+      next_block_start += info.basic_block_size +
+                          info.successors[0].size +
+                          info.successors[1].size;
+    }
+
+    // See whether there's a need to expand the successor sizes.
+    it = order.begin();
+    for (; it != order.end(); ++it) {
+      const BasicBlock* bb = *it;
+      BasicBlockLayoutInfo& info = layout->Find(bb);
+
+      // Compute the start offset for this block's first successor.
+      Offset start_offset = info.start_offset + info.basic_block_size;
+      for (size_t i = 0; i < arraysize(info.successors); ++i) {
+        SuccessorLayoutInfo& successor = info.successors[i];
+
+        // Exit the loop if this (and possibly the subsequent) successor
+        // is un-manifested.
+        if (successor.condition == Successor::kInvalidCondition &&
+            successor.successor == NULL) {
+          break;
+        }
+
+        // Skip over elided successors.
+        DCHECK_NE(reinterpret_cast<Successor*>(NULL), successor.successor);
+        if (successor.condition == Successor::kInvalidCondition)
+          continue;
+
+        // Compute the new size and update the start offset for the next
+        // successor (if any).
+        Size new_size =
+            ComputeRequiredSuccessorSize(*layout, info, start_offset,
+                                         successor);
+        start_offset += new_size;
+
+        // Keep the biggest offset used by this jump. A jump may temporarily
+        // appear shorter when the start offset of this basic block has moved
+        // but the offset of the target basic block still needs to be updated
+        // within this iteration.
+        new_size = std::max(successor.size, new_size);
+
+        // Check whether we're expanding this successor.
+        if (new_size != successor.size) {
+          successor.size = new_size;
+          expanded_successor = true;
+        }
+      }
+    }
+
+    if (!expanded_successor) {
+      // We've achieved a stable layout and we know that next_block_start
+      // is the size of the new block.
+      layout->blocks()[block_index].size = next_block_start;
+
+      return true;
+    }
+  }
+}
+
+// A utility class to package up the context in which new blocks are generated
+// from a layout.
 class MergeContext {
  public:
-  // Initialize a MergeContext with the block graph and original block.
-  MergeContext(BlockGraph* bg, const Block* ob, TagInfoMap* tag_info_map)
-      : sub_graph_(NULL), block_graph_(bg), original_block_(ob),
+  // Initialize a MergeContext with the block graph, original block and the
+  // layout of the subgraph.
+  MergeContext(BlockGraph* bg,
+               const Block* ob,
+               const SubGraphLayout& layout,
+               TagInfoMap* tag_info_map)
+      : layout_(layout), block_graph_(bg), original_block_(ob),
         tag_info_map_(tag_info_map) {
     DCHECK_NE(reinterpret_cast<BlockGraph*>(NULL), bg);
     DCHECK_NE(reinterpret_cast<TagInfoMap*>(NULL), tag_info_map);
@@ -149,51 +501,6 @@ class MergeContext {
  private:
   typedef BlockGraph::Block::SourceRange SourceRange;
 
-  // Temporary data structures used during layouting.
-  // This can effectively have 3 states:
-  // condition == Successor::kInvalidCondition && successor == NULL.
-  //   The successor is unused.
-  // condition == Successor::kInvalidCondition && successor != NULL.
-  //   The successor is elided (has no representation in the block).
-  // condition != Successor::kInvalidCondition && successor != NULL.
-  //   The successor will have an explicit representation in the block.
-  struct SuccessorLayoutInfo {
-    // The condition flags for this successor.
-    // Set to Successor::kInvalidCondition if unused or elided.
-    Successor::Condition condition;
-    // The reference this condition refers to.
-    BasicBlockReference reference;
-    // The size of this successor's manifestation.
-    Size size;
-    // A pointer to the original successor. This is used for propagating tags.
-    // This is set to NULL if the successor isn't used at all.
-    const Successor* successor;
-  };
-  struct BasicBlockLayoutInfo {
-    // The basic block this layout info concerns. Useful for debugging.
-    const BasicBlock* basic_block;
-
-    // Stores the block that basic_block will be manifested in.
-    Block* block;
-
-    // Current start offset for basic_block in block.
-    Offset start_offset;
-
-    // Size of basic_block.
-    Size basic_block_size;
-
-    // The label to assign our successor(s), if any.
-    BlockGraph::Label successor_label;
-
-    // The source range this successor originally occupied, if any.
-    SourceRange successor_source_range;
-
-    // Layout info for this block's successors.
-    SuccessorLayoutInfo successors[2];
-  };
-  typedef std::map<const BasicBlock*, BasicBlockLayoutInfo>
-      BasicBlockLayoutInfoMap;
-
   // Update the new block with the source range for the bytes in the
   // range [new_offset, new_offset + new_size).
   // @param source_range The source range (if any) to assign.
@@ -241,27 +548,16 @@ class MergeContext {
                 Offset offset,
                 Block* new_block);
 
-  // Initializes layout information for @p order and stores it in layout_info_.
-  // @param order The basic block ordering to process.
-  // @param block The destination block for this ordering.
-  bool InitializeBlockLayout(const BasicBlockOrdering& order, Block* block);
-
-  // Generates a layout for @p order. This layout will arrange each basic block
-  // in the ordering back-to-back with minimal reach encodings on each
-  // successor, while respecting basic block alignments.
-  // @param order The basic block ordering to process.
-  bool GenerateBlockLayout(const BasicBlockOrdering& order);
-
-  // Generates a layout for @p subgraph and stores it in layout_info_.
+  // Creates the new blocks of @p subgraph, with the sizes of the layout.
   // @param subgraph The subgraph to process.
-  bool GenerateLayout(const BasicBlockSubGraph& subgraph);
+  bool CreateBlocks(const BasicBlockSubGraph& subgraph);
 
   // Populate a new block with data and/or instructions per
   // its corresponding layout.
   // @param order their ordering.
   bool PopulateBlock(const BasicBlockOrdering& order);
 
-  // Populate all new blocks with data and/or instructions per layout_info_.
+  // Populate all new blocks with data and/or instructions per layout_.
   // @param subgraph The subgraph to process.
   bool PopulateBlocks(const BasicBlockSubGraph& subgraph);
 
@@ -270,45 +566,33 @@ class MergeContext {
   // @param bb The basic block.
   void UpdateReferrers(const BasicBlock* bb) const;
 
-  // Returns the minimal successor size for @p condition.
-  static Size GetShortSuccessorSize(Successor::Condition condition);
-  // Returns the maximal successor size for @p condition.
-  static Size GetLongSuccessorSize(Successor::Condition condition);
-
-  // Computes and returns the required successor size for @p successor.
-  // @param info The layout info for the basic block.
-  // @param start_offset Offset from the start of @p info.basic_block to
-  //     the first byte of the successor.
-  // @param successor The successor to size.
-  Size ComputeRequiredSuccessorSize(const BasicBlockLayoutInfo& info,
-                                    Offset start_offset,
-                                    const SuccessorLayoutInfo& successor);
-
-  // Finds the layout info for a given basic block.
-  // @param bb The basic block whose layout info is desired.
-  BasicBlockLayoutInfo& FindLayoutInfo(const BasicBlock* bb);
-  const BasicBlockLayoutInfo& FindLayoutInfo(const BasicBlock* bb) const;
+  // @returns the new block in which the basic block of @p info is manifested.
+  Block* BlockOf(const BasicBlockLayoutInfo& info) const {
+    DCHECK_GT(blocks_.size(), info.block_index);
+    DCHECK_NE(reinterpret_cast<Block*>(NULL), blocks_[info.block_index]);
+    return blocks_[info.block_index];
+  }
 
   // Resolves a basic block reference to a block reference.
   // @param type The desired type of the returned reference.
   // @param size The desired size of the returned reference.
   // @param ref The basic block reference to resolve.
-  // @pre GenerateLayout has succeeded.
+  // @pre CreateBlocks has succeeded.
   BlockGraph::Reference ResolveReference(BlockGraph::ReferenceType type,
                                          Size size,
                                          const BasicBlockReference& ref) const;
 
   // Resolves a basic block reference to a block reference.
   // @param ref The basic block reference to resolve.
-  // @pre GenerateLayout has succeeded.
+  // @pre CreateBlocks has succeeded.
   BlockGraph::Reference ResolveReference(const BasicBlockReference& ref) const;
 
  private:
-  // The subgraph we're layouting.
-  const BasicBlockSubGraph* sub_graph_;
+  // The layout of the subgraph.
+  const SubGraphLayout& layout_;
 
-  // Layout info.
-  BasicBlockLayoutInfoMap layout_info_;
+  // The new block of each block description, NULL for the empty ones.
+  std::vector<Block*> blocks_;
 
   // The block graph in which the new blocks are generated.
   BlockGraph* const block_graph_;
@@ -326,9 +610,9 @@ class MergeContext {
 };
 
 bool MergeContext::GenerateBlocks(const BasicBlockSubGraph& subgraph) {
-  sub_graph_ = &subgraph;
+  DCHECK_EQ(&subgraph, layout_.subgraph());
 
-  if (!GenerateLayout(subgraph) || !PopulateBlocks(subgraph)) {
+  if (!CreateBlocks(subgraph) || !PopulateBlocks(subgraph)) {
     // Remove generated blocks (this is safe as they're all disconnected)
     // and return false.
     BlockVector::iterator it = new_blocks_.begin();
@@ -338,20 +622,20 @@ bool MergeContext::GenerateBlocks(const BasicBlockSubGraph& subgraph) {
       block_graph_->RemoveBlock(*it);
     }
     new_blocks_.clear();
+    blocks_.clear();
 
-    sub_graph_ = NULL;
     return false;
   }
 
-  sub_graph_ = NULL;
   return true;
 }
 
 void MergeContext::TransferReferrers(const BasicBlockSubGraph* subgraph) const {
   // Iterate through the layout info, and update each referenced BB.
-  BasicBlockLayoutInfoMap::const_iterator it = layout_info_.begin();
-  for (; it != layout_info_.end(); ++it)
-    UpdateReferrers(it->second.basic_block);
+  for (const BasicBlockLayoutInfo& info : layout_.basic_blocks()) {
+    if (info.basic_block != NULL)
+      UpdateReferrers(info.basic_block);
+  }
 }
 
 void MergeContext::CopySourceRange(const SourceRange& source_range,
@@ -372,6 +656,7 @@ void MergeContext::CopySourceRange(const SourceRange& source_range,
 }
 
 bool MergeContext::AssembleSuccessors(const BasicBlockLayoutInfo& info) {
+  Block* block = BlockOf(info);
   BasicBlock::Instructions instructions;
   BasicBlockAssembler assm(static_cast<uint32_t>(info.start_offset +
                                                      info.basic_block_size),
@@ -381,7 +666,7 @@ bool MergeContext::AssembleSuccessors(const BasicBlockLayoutInfo& info) {
   if (info.successor_label.IsValid()) {
     AddOrMergeLabel(info.start_offset + info.basic_block_size,
                     info.successor_label,
-                    info.block);
+                    block);
   }
 
   Offset successor_start = info.start_offset + info.basic_block_size;
@@ -402,10 +687,10 @@ bool MergeContext::AssembleSuccessors(const BasicBlockLayoutInfo& info) {
     // and continue.
     if (successor.condition == Successor::kInvalidCondition) {
       // Update the tag-info map for the successor.
-      UpdateTagInfoMap(successor.successor->tags(), kSuccessorTag, info.block,
+      UpdateTagInfoMap(successor.successor->tags(), kSuccessorTag, block,
                        successor_start, 0, tag_info_map_);
       UpdateTagInfoMap(successor.successor->reference().tags(),
-                       kReferenceTag, info.block, successor_start, 0,
+                       kReferenceTag, block, successor_start, 0,
                        tag_info_map_);
       continue;
     }
@@ -426,7 +711,7 @@ bool MergeContext::AssembleSuccessors(const BasicBlockLayoutInfo& info) {
     // Default to the offset immediately following the successor, which
     // will translate to a zero pc-relative offset.
     Offset ref_offset = successor_start + successor.size;
-    if (resolved_ref.referenced() == info.block)
+    if (resolved_ref.referenced() == block)
       ref_offset = resolved_ref.offset();
     auto dest(Immediate(ref_offset, reference_size, untyped_ref));
 
@@ -471,7 +756,7 @@ bool MergeContext::AssembleSuccessors(const BasicBlockLayoutInfo& info) {
         successor.reference.tags();
 
     // Update the tag-info map for the successor.
-    UpdateTagInfoMap(successor.successor->tags(), kSuccessorTag, info.block,
+    UpdateTagInfoMap(successor.successor->tags(), kSuccessorTag, block,
                      successor_start, successor.size, tag_info_map_);
 
     // Walk our start address forwards.
@@ -487,7 +772,7 @@ bool MergeContext::AssembleSuccessors(const BasicBlockLayoutInfo& info) {
 
   if (!instructions.empty()) {
     Offset start_offset = info.start_offset + info.basic_block_size;
-    return CopyInstructions(instructions, start_offset, info.block);
+    return CopyInstructions(instructions, start_offset, block);
   }
 
   return true;
@@ -540,293 +825,69 @@ bool MergeContext::CopyInstructions(
                     new_block);
 
     // Copy references.
-    CopyReferences(instruction.references(), offset, new_block);
-
-    // Update the offset/bytes_written.
-    offset += instruction.size();
-  }
-
-  return true;
-}
-
-void MergeContext::CopyReferences(
-    const BasicBlock::BasicBlockReferenceMap& references,
-    Offset offset, Block* new_block) {
-  BasicBlock::BasicBlockReferenceMap::const_iterator it = references.begin();
-  for (; it != references.end(); ++it) {
-    BlockGraph::Reference resolved = ResolveReference(it->second);
-
-    Offset ref_offset = offset + it->first;
-    CHECK(new_block->SetReference(ref_offset, resolved));
-
-    // Update the tag-info map for this reference.
-    UpdateTagInfoMap(it->second.tags(), kReferenceTag, new_block, ref_offset,
-                     resolved.size(), tag_info_map_);
-  }
-}
-
-bool MergeContext::CopyData(const BasicDataBlock* data_block,
-                            Offset offset,
-                            Block* new_block) {
-  DCHECK_NE(reinterpret_cast<BasicDataBlock*>(NULL), data_block);
-  DCHECK_EQ(BasicBlock::BASIC_DATA_BLOCK, data_block->type());
-
-  // Get the target buffer.
-  uint8_t* buffer = new_block->GetMutableData();
-  DCHECK_NE(reinterpret_cast<uint8_t*>(NULL), buffer);
-
-  // Copy the basic-new_block_'s data bytes.
-  ::memcpy(buffer + offset, data_block->data(), data_block->size());
-
-  // Record the source range.
-  CopySourceRange(data_block->source_range(),
-                  offset, data_block->size(),
-                  new_block);
-
-  CopyReferences(data_block->references(), offset, new_block);
-  return true;
-}
-
-bool MergeContext::InitializeBlockLayout(const BasicBlockOrdering& order,
-                                         Block* new_block) {
-  // Populate the initial layout info.
-  BasicBlockOrderingConstIter it = order.begin();
-  for (; it != order.end(); ++it) {
-    const BasicBlock* bb = *it;
-
-    // Propagate BB alignment to the parent block.
-    if (bb->alignment() > new_block->alignment())
-      new_block->set_alignment(bb->alignment());
-
-    // Create and initialize the layout info for this block.
-    DCHECK(layout_info_.find(bb) == layout_info_.end());
-
-    BasicBlockLayoutInfo& info = layout_info_[bb];
-    info.basic_block = bb;
-    info.block = new_block;
-    info.start_offset = 0;
-    info.basic_block_size = kInvalidSize;
-
-    const BasicCodeBlock* code_block = BasicCodeBlock::Cast(bb);
-    if (code_block != NULL)
-      info.basic_block_size = code_block->GetInstructionSize();
-
-    const BasicDataBlock* data_block = BasicDataBlock::Cast(bb);
-    if (data_block != NULL)
-      info.basic_block_size = data_block->size();
-
-    const BasicEndBlock* end_block = BasicEndBlock::Cast(bb);
-    if (end_block != NULL)
-      info.basic_block_size = end_block->size();
-
-    // The size must have been set.
-    DCHECK_NE(kInvalidSize, info.basic_block_size);
-
-    for (size_t i = 0; i < arraysize(info.successors); ++i) {
-      info.successors[i].condition = Successor::kInvalidCondition;
-      info.successors[i].size = 0;
-      info.successors[i].successor = NULL;
-    }
-
-    // Find the next basic block, if any.
-    BasicBlockOrderingConstIter next_it(it);
-    ++next_it;
-    const BasicBlock* next_bb = NULL;
-    if (next_it != order.end())
-      next_bb = *(next_it);
-
-    if (code_block == NULL)
-      continue;
-
-    // Go through and decide how to manifest the successors for the current
-    // basic block. A basic block has zero, one or two successors, and any
-    // successor that refers to the next basic block in sequence is elided, as
-    // it's most efficient for execution to simply fall through. We do this in
-    // two nearly-identical code blocks, as the handling is only near-identical
-    // for each of two possible successors.
-    DCHECK_GE(2U, code_block->successors().size());
-    SuccessorConstIter succ_it = code_block->successors().begin();
-    SuccessorConstIter succ_end = code_block->successors().end();
-
-    // Process the first successor, if any.
-    size_t manifested_successors = 0;
-    size_t elided_successors = 0;
-    if (succ_it != succ_end) {
-      const BasicBlock* destination_bb = succ_it->reference().basic_block();
-
-      // Record the source range of the original successor.
-      if (succ_it->source_range().size() != 0) {
-        DCHECK_EQ(0U, info.successor_source_range.size());
-        info.successor_source_range = succ_it->source_range();
-      }
-      // Record the label of the original successor.
-      if (succ_it->has_label())
-        info.successor_label = succ_it->label();
-
-      // Only manifest this successor if it's not referencing the next block.
-      SuccessorLayoutInfo& successor =
-          info.successors[manifested_successors + elided_successors];
-      successor.successor = &(*succ_it);
-      if (destination_bb == NULL || destination_bb != next_bb) {
-        ++manifested_successors;
-        successor.condition = succ_it->condition();
-        successor.reference = succ_it->reference();
-      } else {
-        ++elided_successors;
-      }
-
-      // Go to the next successor, if any.
-      ++succ_it;
-    }
-
-    // Process the second successor, if any.
-    if (succ_it != succ_end) {
-      const BasicBlock* destination_bb = succ_it->reference().basic_block();
-
-      // Record the source range of the original successor.
-      if (succ_it->source_range().size() != 0) {
-        DCHECK_EQ(0U, info.successor_source_range.size());
-        info.successor_source_range = succ_it->source_range();
-      }
-      // Record the label of the original successor.
-      if (succ_it->has_label()) {
-        DCHECK(!info.successor_label.IsValid());
-        info.successor_label = succ_it->label();
-      }
-
-      // Only manifest this successor if it's not referencing the next block.
-      SuccessorLayoutInfo& successor =
-          info.successors[manifested_successors + elided_successors];
-      successor.successor = &(*succ_it);
-      if (destination_bb == NULL || destination_bb != next_bb) {
-        Successor::Condition condition = succ_it->condition();
-
-        // If we've already manifested a successor above, it'll be for the
-        // complementary condition to ours. While it's correct to manifest it
-        // as a conditional branch, it's more efficient to manifest as an
-        // unconditional jump.
-        if (manifested_successors != 0) {
-          DCHECK_EQ(Successor::InvertCondition(info.successors[0].condition),
-                    succ_it->condition());
-
-          condition = Successor::kConditionTrue;
-        }
-
-        ++manifested_successors;
-
-        successor.condition = condition;
-        successor.reference = succ_it->reference();
-      } else {
-        ++elided_successors;
-      }
-    }
-
-    // A basic-block can have at most 2 successors by definition. Since we emit
-    // a successor layout struct for each one (whether or not its elided), we
-    // expect there to have been as many successors emitted as there are
-    // successors in the basic block itself.
-    DCHECK_GE(arraysize(info.successors),
-              manifested_successors + elided_successors);
-    DCHECK_EQ(code_block->successors().size(),
-              manifested_successors + elided_successors);
-  }
-
-  return true;
-}
-
-bool MergeContext::GenerateBlockLayout(const BasicBlockOrdering& order) {
-  BasicBlockOrderingConstIter it = order.begin();
-
-  // Loop over the layout, expanding successors until stable.
-  while (true) {
-    bool expanded_successor = false;
-
-    // Update the start offset for each of the BBs, respecting the BB alignment
-    // constraints.
-    it = order.begin();
-    Offset next_block_start = 0;
-    Block* new_block = NULL;
-    for (; it != order.end(); ++it) {
-      BasicBlockLayoutInfo& info = FindLayoutInfo(*it);
-      next_block_start = common::AlignUp(next_block_start,
-                                         info.basic_block->alignment());
-      info.start_offset = next_block_start;
-
-      if (new_block == NULL)
-        new_block = info.block;
-      DCHECK(new_block == info.block);
-
-      next_block_start += info.basic_block_size +
-                          info.successors[0].size +
-                          info.successors[1].size;
-    }
+    CopyReferences(instruction.references(), offset, new_block);
 
-    // See whether there's a need to expand the successor sizes.
-    it = order.begin();
-    for (; it != order.end(); ++it) {
-      const BasicBlock* bb = *it;
-      BasicBlockLayoutInfo& info = FindLayoutInfo(bb);
+    // Update the offset/bytes_written.
+    offset += instruction.size();
+  }
 
-      // Compute the start offset for this block's first successor.
-      Offset start_offset = info.start_offset + info.basic_block_size;
-      for (size_t i = 0; i < arraysize(info.successors); ++i) {
-        SuccessorLayoutInfo& successor = info.successors[i];
+  return true;
+}
 
-        // Exit the loop if this (and possibly the subsequent) successor
-        // is un-manifested.
-        if (successor.condition == Successor::kInvalidCondition &&
-            successor.successor == NULL) {
-          break;
-        }
+void MergeContext::CopyReferences(
+    const BasicBlock::BasicBlockReferenceMap& references,
+    Offset offset, Block* new_block) {
+  BasicBlock::BasicBlockReferenceMap::const_iterator it = references.begin();
+  for (; it != references.end(); ++it) {
+    BlockGraph::Reference resolved = ResolveReference(it->second);
 
-        // Skip over elided successors.
-        DCHECK_NE(reinterpret_cast<Successor*>(NULL), successor.successor);
-        if (successor.condition == Successor::kInvalidCondition)
-          continue;
+    Offset ref_offset = offset + it->first;
+    CHECK(new_block->SetReference(ref_offset, resolved));
 
-        // Compute the new size and update the start offset for the next
-        // successor (if any).
-        Size new_size =
-            ComputeRequiredSuccessorSize(info, start_offset, successor);
-        start_offset += new_size;
+    // Update the tag-info map for this reference.
+    UpdateTagInfoMap(it->second.tags(), kReferenceTag, new_block, ref_offset,
+                     resolved.size(), tag_info_map_);
+  }
+}
 
-        // Keep the biggest offset used by this jump. A jump may temporarily
-        // appear shorter when the start offset of this basic block has moved
-        // but the offset of the target basic block still needs to be updated
-        // within this iteration.
-        new_size = std::max(successor.size, new_size);
+bool MergeContext::CopyData(const BasicDataBlock* data_block,
+                            Offset offset,
+                            Block* new_block) {
+  DCHECK_NE(reinterpret_cast<BasicDataBlock*>(NULL), data_block);
+  DCHECK_EQ(BasicBlock::BASIC_DATA_BLOCK, data_block->type());
 
-        // Check whether we're expanding this successor.
-        if (new_size != successor.size) {
-          successor.size = new_size;
-          expanded_successor = true;
-        }
-      }
-    }
+  // Get the target buffer.
+  uint8_t* buffer = new_block->GetMutableData();
+  DCHECK_NE(reinterpret_cast<uint8_t*>(NULL), buffer);
 
-    if (!expanded_successor) {
-      // We've achieved a stable layout and we know that next_block_start
-      // is the size of the new block, so resize it and allocate the data now.
-      new_block->set_size(next_block_start);
-      new_block->AllocateData(next_block_start);
+  // Copy the basic-new_block_'s data bytes.
+  ::memcpy(buffer + offset, data_block->data(), data_block->size());
 
-      return true;
-    }
-  }
+  // Record the source range.
+  CopySourceRange(data_block->source_range(),
+                  offset, data_block->size(),
+                  new_block);
+
+  CopyReferences(data_block->references(), offset, new_block);
+  return true;
 }
 
-bool MergeContext::GenerateLayout(const BasicBlockSubGraph& subgraph) {
-  // Create each new block and initialize a layout for it.
+bool MergeContext::CreateBlocks(const BasicBlockSubGraph& subgraph) {
+  DCHECK_EQ(subgraph.block_descriptions().size(), layout_.blocks().size());
+  blocks_.assign(layout_.blocks().size(), NULL);
+
+  // Create each new block with the size and alignment of its layout.
   BlockDescriptionConstIter it = subgraph.block_descriptions().begin();
-  for (; it != subgraph.block_descriptions().end(); ++it) {
+  for (size_t i = 0; it != subgraph.block_descriptions().end(); ++it, ++i) {
     const BlockDescription& description = *it;
 
     // Skip the block if it's empty.
     if (description.basic_block_order.empty())
       continue;
 
+    const SubGraphLayout::BlockInfo& block_info = layout_.blocks()[i];
     Block* new_block = block_graph_->AddBlock(
-        description.type, 0, description.name);
+        description.type, block_info.size, description.name);
     if (new_block == NULL) {
       LOG(ERROR) << "Failed to create block '" << description.name << "'.";
       return false;
@@ -835,36 +896,14 @@ bool MergeContext::GenerateLayout(const BasicBlockSubGraph& subgraph) {
     // Save this block in the set of newly generated blocks. On failure, this
     // list will be used by GenerateBlocks() to clean up after itself.
     new_blocks_.push_back(new_block);
+    blocks_[i] = new_block;
 
     // Initialize the new block's properties.
-    new_block->set_alignment(description.alignment);
+    new_block->set_alignment(block_info.alignment);
     new_block->set_padding_before(description.padding_before);
     new_block->set_section(description.section);
     new_block->set_attributes(description.attributes);
-
-    // Initialize the layout for this block.
-    if (!InitializeBlockLayout(description.basic_block_order, new_block)) {
-      LOG(ERROR) << "Failed to initialize layout for basic block '" <<
-          description.name << "'";
-      return false;
-    }
-  }
-
-  // Now generate a layout for each ordering.
-  it = subgraph.block_descriptions().begin();
-  for (; it != subgraph.block_descriptions().end(); ++it) {
-    const BlockDescription& description = *it;
-
-    // Skip the block if it's empty.
-    if (description.basic_block_order.empty())
-      continue;
-
-    // Generate the layout for this block.
-    if (!GenerateBlockLayout(description.basic_block_order)) {
-      LOG(ERROR) << "Failed to generate a layout for basic block '" <<
-          description.name << "'";
-      return false;
-    }
+    new_block->AllocateData(block_info.size);
   }
 
   return true;
@@ -879,7 +918,8 @@ bool MergeContext::PopulateBlock(const BasicBlockOrdering& order) {
 
   for (; bb_iter != bb_end; ++bb_iter) {
     const BasicBlock* bb = *bb_iter;
-    const BasicBlockLayoutInfo& info = FindLayoutInfo(bb);
+    const BasicBlockLayoutInfo& info = layout_.Find(bb);
+    Block* block = BlockOf(info);
 
     // Determine the tag type and size associated with this basic block.
     TaggedObjectType tag_type = kBasicDataBlockTag;
@@ -894,13 +934,13 @@ bool MergeContext::PopulateBlock(const BasicBlockOrdering& order) {
     }
 
     // Update the tag-info map for the basic block.
-    UpdateTagInfoMap(bb->tags(), tag_type, info.block, info.start_offset,
+    UpdateTagInfoMap(bb->tags(), tag_type, block, info.start_offset,
                      tag_size, tag_info_map_);
 
     // Handle any padding for alignment.
     if (info.start_offset > prev_offset) {
       if (!InsertNops(prev_offset, info.start_offset - prev_offset,
-                      info.block)) {
+                      block)) {
         LOG(ERROR) << "Failed to insert NOPs for '" << bb->name() << "'.";
         return false;
       }
@@ -913,10 +953,10 @@ bool MergeContext::PopulateBlock(const BasicBlockOrdering& order) {
     if (data_block != NULL) {
       // If the basic-block is labeled, copy the label.
       if (data_block->has_label())
-        AddOrMergeLabel(info.start_offset, data_block->label(), info.block);
+        AddOrMergeLabel(info.start_offset, data_block->label(), block);
 
       // Copy its data.
-      if (!CopyData(data_block, info.start_offset, info.block)) {
+      if (!CopyData(data_block, info.start_offset, block)) {
         LOG(ERROR) << "Failed to copy data for '" << bb->name() << "'.";
         return false;
       }
@@ -928,7 +968,7 @@ bool MergeContext::PopulateBlock(const BasicBlockOrdering& order) {
       // Copy the instructions.
       if (!CopyInstructions(code_block->instructions(),
                             info.start_offset,
-                            info.block)) {
+                            block)) {
         LOG(ERROR) << "Failed to copy instructions for '" << bb->name() << "'.";
         return false;
       }
@@ -944,7 +984,7 @@ bool MergeContext::PopulateBlock(const BasicBlockOrdering& order) {
     if (end_block != NULL) {
       // If the end block is labeled, copy the label.
       if (end_block->has_label())
-        AddOrMergeLabel(info.start_offset, end_block->label(), info.block);
+        AddOrMergeLabel(info.start_offset, end_block->label(), block);
     }
 
     // We must have handled the basic block as at least one of the fundamental
@@ -976,10 +1016,7 @@ void MergeContext::UpdateReferrers(const BasicBlock* bb) const {
   DCHECK_NE(reinterpret_cast<BasicBlock*>(NULL), bb);
 
   // Find the current location of this basic block.
-  BasicBlockLayoutInfoMap::const_iterator layout_it = layout_info_.find(bb);
-  DCHECK(layout_it != layout_info_.end());
-  const BasicBlockLayoutInfo& info = layout_it->second;
-  DCHECK_EQ(bb, info.basic_block);
+  const BasicBlockLayoutInfo& info = layout_.Find(bb);
 
   // Update all external referrers to point to the new location.
   const BasicBlock::BasicBlockReferrerSet& referrers = bb->referrers();
@@ -997,7 +1034,7 @@ void MergeContext::UpdateReferrers(const BasicBlock* bb) const {
     // start address in the new block.
     BlockGraph::Reference new_ref(old_ref.type(),
                                   old_ref.size(),
-                                  info.block,
+                                  BlockOf(info),
                                   info.start_offset,
                                   info.start_offset);
 
@@ -1026,133 +1063,17 @@ void MergeContext::RemoveOriginalBlock(BasicBlockSubGraph* subgraph) {
   original_block_ = NULL;
 }
 
-Size MergeContext::GetShortSuccessorSize(Successor::Condition condition) {
-  switch (condition) {
-    case Successor::kConditionAbove:
-    case Successor::kConditionAboveOrEqual:
-    case Successor::kConditionBelow:
-    case Successor::kConditionBelowOrEqual:
-    case Successor::kConditionEqual:
-    case Successor::kConditionGreater:
-    case Successor::kConditionGreaterOrEqual:
-    case Successor::kConditionLess:
-    case Successor::kConditionLessOrEqual:
-    case Successor::kConditionNotEqual:
-    case Successor::kConditionNotOverflow:
-    case Successor::kConditionNotParity:
-    case Successor::kConditionNotSigned:
-    case Successor::kConditionOverflow:
-    case Successor::kConditionParity:
-    case Successor::kConditionSigned:
-      // Translates to a conditional branch.
-      return assm::kShortBranchSize;
-
-    case Successor::kConditionTrue:
-      // Translates to a jump.
-      return assm::kShortJumpSize;
-
-    default:
-      NOTREACHED() << "Unsupported successor type.";
-      return 0;
-  }
-}
-
-Size MergeContext::GetLongSuccessorSize(Successor::Condition condition) {
-  switch (condition) {
-    case Successor::kConditionAbove:
-    case Successor::kConditionAboveOrEqual:
-    case Successor::kConditionBelow:
-    case Successor::kConditionBelowOrEqual:
-    case Successor::kConditionEqual:
-    case Successor::kConditionGreater:
-    case Successor::kConditionGreaterOrEqual:
-    case Successor::kConditionLess:
-    case Successor::kConditionLessOrEqual:
-    case Successor::kConditionNotEqual:
-    case Successor::kConditionNotOverflow:
-    case Successor::kConditionNotParity:
-    case Successor::kConditionNotSigned:
-    case Successor::kConditionOverflow:
-    case Successor::kConditionParity:
-    case Successor::kConditionSigned:
-      // Translates to a conditional branch.
-      return assm::kLongBranchSize;
-
-    case Successor::kConditionTrue:
-      // Translates to a jump.
-      return assm::kLongJumpSize;
-
-    default:
-      NOTREACHED() << "Unsupported successor type.";
-      return 0;
-  }
-}
-
-Size MergeContext::ComputeRequiredSuccessorSize(
-    const BasicBlockLayoutInfo& info,
-    Offset start_offset,
-    const SuccessorLayoutInfo& successor) {
-  switch (successor.reference.referred_type()) {
-    case BasicBlockReference::REFERRED_TYPE_BLOCK:
-      return GetLongSuccessorSize(successor.condition);
-
-    case BasicBlockReference::REFERRED_TYPE_BASIC_BLOCK: {
-      Size short_size = GetShortSuccessorSize(successor.condition);
-      const BasicBlock* dest_bb = successor.reference.basic_block();
-      DCHECK_NE(reinterpret_cast<BasicBlock*>(NULL), dest_bb);
-      const BasicBlockLayoutInfo& dest = FindLayoutInfo(dest_bb);
-
-      // If the destination is within the same destination block,
-      // let's see if we can use a short reach here.
-      if (info.block == dest.block) {
-        Offset destination_offset =
-            dest.start_offset - (start_offset + short_size);
-
-        // Are we in-bounds for a short reference?
-        if (destination_offset <= std::numeric_limits<int8_t>::max() &&
-            destination_offset >= std::numeric_limits<int8_t>::min()) {
-          return short_size;
-        }
-      }
-
-      return GetLongSuccessorSize(successor.condition);
-    }
-
-    default:
-      NOTREACHED() << "Impossible Successor reference type.";
-      return 0;
-  }
-}
-
-MergeContext::BasicBlockLayoutInfo& MergeContext::FindLayoutInfo(
-    const BasicBlock* bb) {
-  BasicBlockLayoutInfoMap::iterator it = layout_info_.find(bb);
-  DCHECK(it != layout_info_.end());
-  DCHECK_EQ(bb, it->second.basic_block);
-
-  return it->second;
-}
-
-const MergeContext::BasicBlockLayoutInfo& MergeContext::FindLayoutInfo(
-    const BasicBlock* bb) const {
-  BasicBlockLayoutInfoMap::const_iterator it = layout_info_.find(bb);
-  DCHECK(it != layout_info_.end());
-  DCHECK_EQ(bb, it->second.basic_block);
-
-  return it->second;
-}
-
 BlockGraph::Reference MergeContext::ResolveReference(
     BlockGraph::ReferenceType type, Size size,
     const BasicBlockReference& ref) const {
   if (ref.referred_type() == BasicBlockReference::REFERRED_TYPE_BASIC_BLOCK) {
     // It's a basic block reference, we need to resolve it to a
     // block reference.
-    const BasicBlockLayoutInfo& info = FindLayoutInfo(ref.basic_block());
+    const BasicBlockLayoutInfo& info = layout_.Find(ref.basic_block());
 
     return BlockGraph::Reference(type,
                                  size,
-                                 info.block,
+                                 BlockOf(info),
                                  info.start_offset,
                                  info.start_offset);
   } else {
@@ -1174,19 +1095,67 @@ BlockGraph::Reference MergeContext::ResolveReference(
 
 }  // namespace
 
+SubGraphLayout::SubGraphLayout() : subgraph_(NULL) {
+}
+
+void SubGraphLayout::Reset(const BasicBlockSubGraph* subgraph) {
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+  subgraph_ = subgraph;
+
+  // The basic blocks are indexed by their id, and the collection is sorted
+  // by id.
+  size_t num_ids = 0;
+  if (!subgraph->basic_blocks().empty())
+    num_ids = (*subgraph->basic_blocks().rbegin())->id() + 1;
+  basic_blocks_.assign(num_ids, BasicBlockInfo());
+
+  blocks_.clear();
+  BlockDescriptionConstIter it = subgraph->block_descriptions().begin();
+  for (; it != subgraph->block_descriptions().end(); ++it) {
+    BlockInfo info = { 0, it->alignment };
+    blocks_.push_back(info);
+  }
+}
+
+SubGraphLayout::BasicBlockInfo& SubGraphLayout::Find(const BasicBlock* bb) {
+  DCHECK_NE(reinterpret_cast<BasicBlock*>(NULL), bb);
+  DCHECK_GT(basic_blocks_.size(), bb->id());
+  BasicBlockInfo& info = basic_blocks_[bb->id()];
+  DCHECK_EQ(bb, info.basic_block);
+
+  return info;
+}
+
+const SubGraphLayout::BasicBlockInfo& SubGraphLayout::Find(
+    const BasicBlock* bb) const {
+  DCHECK_NE(reinterpret_cast<BasicBlock*>(NULL), bb);
+  DCHECK_GT(basic_blocks_.size(), bb->id());
+  const BasicBlockInfo& info = basic_blocks_[bb->id()];
+  DCHECK_EQ(bb, info.basic_block);
+
+  return info;
+}
+
 BlockBuilder::BlockBuilder(BlockGraph* bg) : block_graph_(bg) {
 }
 
 bool BlockBuilder::Merge(BasicBlockSubGraph* subgraph) {
   DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
 
-  // Before starting the layout ensure any BasicEndBlocks are at the end of/
-  // their respective basic-block orderings.
-  if (!EndBlocksAreWellPlaced(subgraph))
+  if (!ComputeLayout(*subgraph, &layout_))
     return false;
 
+  return Merge(subgraph, layout_);
+}
+
+bool BlockBuilder::Merge(BasicBlockSubGraph* subgraph,
+                         const SubGraphLayout& layout) {
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+  DCHECK_EQ(subgraph, layout.subgraph());
+
   MergeContext context(block_graph_,
                        subgraph->original_block(),
+                       layout,
                        &tag_info_map_);
 
   if (!context.GenerateBlocks(*subgraph))
@@ -1205,4 +1174,51 @@ bool BlockBuilder::Merge(BasicBlockSubGraph* subgraph) {
   return true;
 }
 
+bool BlockBuilder::ComputeLayout(const BasicBlockSubGraph& subgraph,
+                                 SubGraphLayout* layout) {
+  DCHECK_NE(reinterpret_cast<SubGraphLayout*>(NULL), layout);
+
+  // Before starting the layout ensure any BasicEndBlocks are at the end of
+  // their respective basic-block orderings.
+  if (!EndBlocksAreWellPlaced(subgraph))
+    return false;
+
+  layout->Reset(&subgraph);
+
+  // Initialize a layout for each block.
+  BlockDescriptionConstIter it = subgraph.block_descriptions().begin();
+  for (size_t i = 0; it != subgraph.block_descriptions().end(); ++it, ++i) {
+    const BlockDescription& description = *it;
+
+    // Skip the block if it's empty.
+    if (description.basic_block_order.empty())
+      continue;
+
+    if (!InitializeBlockLayout(description.basic_block_order, i, layout)) {
+      LOG(ERROR) << "Failed to initialize layout for basic block '" <<
+          description.name << "'";
+      return false;
+    }
+  }
+
+  // Now generate a layout for each ordering.
+  it = subgraph.block_descriptions().begin();
+  for (size_t i = 0; it != subgraph.block_descriptions().end(); ++it, ++i) {
+    const BlockDescription& description = *it;
+
+    // Skip the block if it's empty.
+    if (description.basic_block_order.empty())
+      continue;
+
+    // Generate the layout for this block.
+    if (!GenerateBlockLayout(description.basic_block_order, i, layout)) {
+      LOG(ERROR) << "Failed to generate a layout for basic block '" <<
+          description.name << "'";
+      return false;
+    }
+  }
+
+  return true;
+}
+
 }  // namespace block_graph
@@ -17,12 +17,111 @@
 #ifndef SYZYGY_BLOCK_GRAPH_BLOCK_BUILDER_H_
 #define SYZYGY_BLOCK_GRAPH_BLOCK_BUILDER_H_
 
+#include <vector>
+
 #include "syzygy/block_graph/basic_block_subgraph.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/block_graph/tags.h"
 
 namespace block_graph {
 
+// The layout of a subgraph: the offset of each basic block in the block of
+// its description, and the manifestation of its successors. This is computed
+// from the subgraph alone, without touching the block graph, so that the
+// layouts of several subgraphs can be computed on worker threads. The buffers
+// keep their capacity from one subgraph to the next.
+class SubGraphLayout {
+ public:
+  typedef BlockGraph::Offset Offset;
+  typedef BlockGraph::Size Size;
+  typedef BlockGraph::Block::SourceRange SourceRange;
+
+  // The layout of a successor. This can effectively have 3 states:
+  // condition == Successor::kInvalidCondition && successor == NULL.
+  //   The successor is unused.
+  // condition == Successor::kInvalidCondition && successor != NULL.
+  //   The successor is elided (has no representation in the block).
+  // condition != Successor::kInvalidCondition && successor != NULL.
+  //   The successor will have an explicit representation in the block.
+  struct SuccessorInfo {
+    // The condition flags for this successor.
+    // Set to Successor::kInvalidCondition if unused or elided.
+    Successor::Condition condition;
+    // The reference this condition refers to.
+    BasicBlockReference reference;
+    // The size of this successor's manifestation.
+    Size size;
+    // A pointer to the original successor. This is used for propagating tags.
+    // This is set to NULL if the successor isn't used at all.
+    const Successor* successor;
+  };
+
+  // The layout of a basic block.
+  struct BasicBlockInfo {
+    // The basic block this layout info concerns. This is NULL for the ids
+    // of the subgraph that aren't laid out.
+    const BasicBlock* basic_block;
+
+    // The index of the block description that basic_block is manifested in.
+    size_t block_index;
+
+    // Current start offset for basic_block in its block.
+    Offset start_offset;
+
+    // Size of basic_block.
+    Size basic_block_size;
+
+    // The label to assign our successor(s), if any.
+    BlockGraph::Label successor_label;
+
+    // The source range this successor originally occupied, if any.
+    SourceRange successor_source_range;
+
+    // Layout info for this block's successors.
+    SuccessorInfo successors[2];
+  };
+
+  // The layout of a block description.
+  struct BlockInfo {
+    // The size of the block, 0 if its description is empty.
+    Size size;
+    // The alignment of the block, which is at least that of its basic blocks.
+    uint32_t alignment;
+  };
+
+  SubGraphLayout();
+
+  // Resets the layout for @p subgraph, keeping the capacity of the buffers.
+  // @param subgraph The subgraph to be laid out.
+  void Reset(const BasicBlockSubGraph* subgraph);
+
+  // @name Accessors.
+  // @{
+  const BasicBlockSubGraph* subgraph() const { return subgraph_; }
+  // Indexed by basic block id.
+  std::vector<BasicBlockInfo>& basic_blocks() { return basic_blocks_; }
+  const std::vector<BasicBlockInfo>& basic_blocks() const {
+    return basic_blocks_;
+  }
+  // Indexed like the block descriptions of the subgraph.
+  std::vector<BlockInfo>& blocks() { return blocks_; }
+  const std::vector<BlockInfo>& blocks() const { return blocks_; }
+  // @}
+
+  // Finds the layout of a basic block.
+  // @param bb The basic block, which must be laid out.
+  // @returns its layout.
+  BasicBlockInfo& Find(const BasicBlock* bb);
+  const BasicBlockInfo& Find(const BasicBlock* bb) const;
+
+ private:
+  const BasicBlockSubGraph* subgraph_;
+  std::vector<BasicBlockInfo> basic_blocks_;
+  std::vector<BlockInfo> blocks_;
+
+  DISALLOW_COPY_AND_ASSIGN(SubGraphLayout);
+};
+
 // This class incorporates a BasicBlockSubGraph into a BlockGraph.
 class BlockBuilder {
  public:
@@ -35,6 +134,24 @@ class BlockBuilder {
   // @returns true on success, false otherwise.
   bool Merge(BasicBlockSubGraph* subgraph);
 
+  // Merge the @p subgraph into the block graph, using a layout computed by
+  // ComputeLayout. Only this needs to be serialized with the other changes
+  // to the block graph.
+  // @param subgraph The subgraph to be merged. It must not have changed
+  //     since @p layout was computed.
+  // @param layout The layout of @p subgraph.
+  // @returns true on success, false otherwise.
+  bool Merge(BasicBlockSubGraph* subgraph, const SubGraphLayout& layout);
+
+  // Computes the layout of @p subgraph, iterating on the sizes of its
+  // successors until they're stable. This only reads the subgraph, so it
+  // may run on any thread.
+  // @param subgraph The subgraph to lay out.
+  // @param layout Receives the layout.
+  // @returns true on success, false otherwise.
+  static bool ComputeLayout(const BasicBlockSubGraph& subgraph,
+                            SubGraphLayout* layout);
+
   // @returns the set of new blocks created upon merging in one or more
   //     subgraphs.
   const BlockVector& new_blocks() const { return new_blocks_; }
@@ -52,6 +169,9 @@ class BlockBuilder {
   // The tag info map tracking all user data in the subgraph.
   TagInfoMap tag_info_map_;
 
+  // The layout used by Merge, which is reused from one subgraph to the next.
+  SubGraphLayout layout_;
+
   DISALLOW_COPY_AND_ASSIGN(BlockBuilder);
 };
 
@@ -485,6 +485,76 @@ TEST_F(BlockBuilderTest, FailsForInvalidEndBlockPlacement) {
   EXPECT_FALSE(builder.Merge(&subgraph_));
 }
 
+TEST_F(BlockBuilderTest, ComputeLayoutFailsForInvalidEndBlockPlacement) {
+  BasicCodeBlock* bb1 = CreateCodeBB("bb1", 10);
+  BasicEndBlock* bb2 = subgraph_.AddBasicEndBlock();
+
+  BasicBlockSubGraph::BlockDescription* d1 = subgraph_.AddBlockDescription(
+      "new_block", "new_compiland", BlockGraph::CODE_BLOCK, 0, 1, 0);
+  d1->basic_block_order.push_back(bb2);
+  d1->basic_block_order.push_back(bb1);
+
+  SubGraphLayout layout;
+  EXPECT_FALSE(BlockBuilder::ComputeLayout(subgraph_, &layout));
+}
+
+TEST_F(BlockBuilderTest, MergeWithComputedLayout) {
+  // Two blocks, one of which jumps to the other.
+  BasicCodeBlock* bb1 = CreateCodeBB("bb1", 10);
+  BasicCodeBlock* bb2 = CreateCodeBB("bb2", 20);
+  bb1->set_alignment(16);
+  bb1->successors().push_back(
+      Successor(Successor::kConditionTrue,
+                BasicBlockReference(BlockGraph::RELATIVE_REF, 4, bb2),
+                0));
+
+  BasicBlockSubGraph::BlockDescription* d1 = subgraph_.AddBlockDescription(
+      "block1", "compiland", BlockGraph::CODE_BLOCK, 0, 1, 0);
+  d1->basic_block_order.push_back(bb1);
+  BasicBlockSubGraph::BlockDescription* d2 = subgraph_.AddBlockDescription(
+      "block2", "compiland", BlockGraph::CODE_BLOCK, 0, 1, 0);
+  d2->basic_block_order.push_back(bb2);
+
+  // The layout doesn't touch the block graph.
+  SubGraphLayout layout;
+  ASSERT_TRUE(BlockBuilder::ComputeLayout(subgraph_, &layout));
+  EXPECT_EQ(&subgraph_, layout.subgraph());
+  EXPECT_TRUE(block_graph_.blocks().empty());
+  ASSERT_EQ(2U, layout.blocks().size());
+  EXPECT_EQ(10U + assm::kLongJumpSize, layout.blocks()[0].size);
+  EXPECT_EQ(16U, layout.blocks()[0].alignment);
+  EXPECT_EQ(20U, layout.blocks()[1].size);
+  EXPECT_EQ(1U, layout.Find(bb2).block_index);
+
+  BlockBuilder builder(&block_graph_);
+  ASSERT_TRUE(builder.Merge(&subgraph_, layout));
+  ASSERT_EQ(2U, builder.new_blocks().size());
+  Block* block1 = builder.new_blocks()[0];
+  Block* block2 = builder.new_blocks()[1];
+  EXPECT_EQ(10U + assm::kLongJumpSize, block1->size());
+  EXPECT_EQ(16U, block1->alignment());
+  EXPECT_EQ(20U, block2->size());
+
+  Block::ReferenceMap expected_refs;
+  expected_refs.insert(
+      std::make_pair(11,
+                     Reference(BlockGraph::PC_RELATIVE_REF, 4, block2, 0, 0)));
+  EXPECT_EQ(expected_refs, block1->references());
+
+  // The layout is reused for another subgraph.
+  BasicBlockSubGraph other_subgraph;
+  BasicCodeBlock* other_bb = other_subgraph.AddBasicCodeBlock("other");
+  other_bb->instructions().push_back(Instruction());
+  BasicBlockSubGraph::BlockDescription* d3 =
+      other_subgraph.AddBlockDescription(
+          "block3", "compiland", BlockGraph::CODE_BLOCK, 0, 1, 0);
+  d3->basic_block_order.push_back(other_bb);
+  ASSERT_TRUE(BlockBuilder::ComputeLayout(other_subgraph, &layout));
+  ASSERT_EQ(1U, layout.blocks().size());
+  EXPECT_EQ(1U, layout.blocks()[0].size);
+  EXPECT_EQ(0, layout.Find(other_bb).start_offset);
+}
+
 TEST_F(BlockBuilderTest, ShortLayout) {
   // This is the block structure we construct. If either of BB1 or BB2's
   // successors is manifested too long, they will both have to grow.
@@ -15,9 +15,12 @@
 #include "syzygy/block_graph/block_graph.h"
 
 #include <limits>
+#include <unordered_map>
+#include <vector>
 
 #include "base/logging.h"
 #include "base/strings/stringprintf.h"
+#include "syzygy/block_graph/decoded_instruction_cache.h"
 
 // Pretty prints a BlockInfo to an ostream. This has to be outside of any
 // namespaces so that operator<< is found properly.
@@ -253,10 +256,58 @@ std::string BlockGraph::LabelAttributesToString(
 
 const BlockGraph::SectionId BlockGraph::kInvalidSectionId = SIZE_MAX;
 
+struct BlockGraph::Snapshot {
+  // A reference of a saved block. The referenced block is identified by its
+  // id, as it may be removed and recreated before the snapshot is restored.
+  struct SavedReference {
+    Offset offset;
+    ReferenceType type;
+    Size size;
+    BlockId referenced;
+    Offset referenced_offset;
+    Offset base;
+  };
+
+  // The state of a block when it was first modified. The referrers aren't
+  // saved, as they are rebuilt from the references of the saved blocks.
+  struct SavedBlock {
+    BlockType type;
+    Size size;
+    Size alignment;
+    Offset alignment_offset;
+    Size padding_before;
+    const std::string* name;
+    const std::string* compiland_name;
+    RelativeAddress addr;
+    SectionId section;
+    BlockAttributes attributes;
+    std::vector<SavedReference> references;
+    Block::SourceRanges source_ranges;
+    Block::LabelMap labels;
+
+    // Data that isn't owned by the block outlives it and is never written,
+    // so only a pointer to it is saved. Owned data is copied.
+    bool owns_data;
+    const uint8_t* data;
+    std::vector<uint8_t> owned_data;
+    size_t data_size;
+  };
+
+  typedef std::unordered_map<BlockId, SavedBlock> SavedBlockMap;
+
+  SectionMap sections;
+  SectionId next_section_id;
+  // The blocks with greater ids were added after the snapshot was taken.
+  BlockId next_block_id;
+  ImageFormat image_format;
+  SavedBlockMap blocks;
+};
+
 BlockGraph::BlockGraph()
     : next_section_id_(0),
       next_block_id_(0),
-      image_format_(UNKNOWN_IMAGE_FORMAT) {
+      image_format_(UNKNOWN_IMAGE_FORMAT),
+      decoded_instruction_cache_(new DecodedInstructionCache()) {
 }
 
 BlockGraph::~BlockGraph() {
@@ -442,11 +493,168 @@ bool BlockGraph::RemoveBlockByIterator(BlockMap::iterator it) {
   if (it->second.referrers().size() > 0 || it->second.references().size() > 0)
     return false;
 
+  if (snapshot_.get() != NULL)
+    SaveBlockToSnapshot(&it->second);
+  decoded_instruction_cache_->Remove(it->first);
   blocks_.erase(it);
 
   return true;
 }
 
+void BlockGraph::TakeSnapshot() {
+  DCHECK(snapshot_.get() == NULL);
+
+  snapshot_.reset(new Snapshot());
+  snapshot_->sections = sections_;
+  snapshot_->next_section_id = next_section_id_;
+  snapshot_->next_block_id = next_block_id_;
+  snapshot_->image_format = image_format_;
+}
+
+bool BlockGraph::RestoreSnapshot() {
+  if (snapshot_.get() == NULL) {
+    LOG(ERROR) << "There is no snapshot to restore.";
+    return false;
+  }
+
+  // Releasing the snapshot stops the blocks from being saved again as they
+  // are restored.
+  std::unique_ptr<Snapshot> snapshot(std::move(snapshot_));
+
+  // Disconnect the blocks that were added or modified. The references of the
+  // other blocks are unchanged, so this leaves the added blocks without
+  // referrers.
+  BlockMap::iterator it = blocks_.begin();
+  for (; it != blocks_.end(); ++it) {
+    if (it->first > snapshot->next_block_id ||
+        snapshot->blocks.count(it->first) != 0) {
+      it->second.RemoveAllReferences();
+    }
+  }
+
+  // Remove the added blocks, which have the greatest ids.
+  BlockMap::iterator added_it = blocks_.upper_bound(snapshot->next_block_id);
+  for (it = added_it; it != blocks_.end(); ++it) {
+    DCHECK(it->second.referrers().empty());
+    decoded_instruction_cache_->Remove(it->first);
+  }
+  blocks_.erase(added_it, blocks_.end());
+
+  // Recreate the removed blocks, and restore the properties of the saved
+  // blocks.
+  Snapshot::SavedBlockMap::const_iterator saved_it = snapshot->blocks.begin();
+  for (; saved_it != snapshot->blocks.end(); ++saved_it) {
+    const Snapshot::SavedBlock& saved = saved_it->second;
+    it = blocks_.find(saved_it->first);
+    if (it == blocks_.end()) {
+      it = blocks_.insert(std::make_pair(
+          saved_it->first,
+          Block(saved_it->first, saved.type, saved.size, "", this))).first;
+    }
+
+    Block& block = it->second;
+    block.type_ = saved.type;
+    block.size_ = saved.size;
+    block.alignment_ = saved.alignment;
+    block.alignment_offset_ = saved.alignment_offset;
+    block.padding_before_ = saved.padding_before;
+    block.name_ = saved.name;
+    block.compiland_name_ = saved.compiland_name;
+    block.addr_ = saved.addr;
+    block.section_ = saved.section;
+    block.attributes_ = saved.attributes;
+    block.source_ranges_ = saved.source_ranges;
+    block.labels_ = saved.labels;
+
+    if (block.owns_data_)
+      delete [] block.data_;
+    block.owns_data_ = saved.owns_data;
+    block.data_ = saved.data;
+    block.data_size_ = saved.data_size;
+    if (saved.owns_data && saved.data_size > 0) {
+      uint8_t* data = new uint8_t[saved.data_size];
+      ::memcpy(data, saved.owned_data.data(), saved.data_size);
+      block.data_ = data;
+    }
+  }
+
+  // Now that all the saved blocks exist, restore their references. This
+  // rebuilds the referrers of the blocks they refer to.
+  for (saved_it = snapshot->blocks.begin();
+       saved_it != snapshot->blocks.end(); ++saved_it) {
+    Block* block = GetBlockById(saved_it->first);
+    DCHECK(block != NULL);
+    for (size_t i = 0; i < saved_it->second.references.size(); ++i) {
+      const Snapshot::SavedReference& ref = saved_it->second.references[i];
+      Block* referenced = GetBlockById(ref.referenced);
+      DCHECK(referenced != NULL);
+      block->SetReference(ref.offset, Reference(ref.type, ref.size, referenced,
+                                                ref.referenced_offset,
+                                                ref.base));
+    }
+  }
+
+  sections_.swap(snapshot->sections);
+  next_section_id_ = snapshot->next_section_id;
+  image_format_ = snapshot->image_format;
+
+  return true;
+}
+
+void BlockGraph::DiscardSnapshot() {
+  DCHECK(snapshot_.get() != NULL);
+  snapshot_.reset();
+}
+
+void BlockGraph::SaveBlockToSnapshot(const Block* block) {
+  DCHECK(snapshot_.get() != NULL);
+  DCHECK(block != NULL);
+  DCHECK_EQ(this, block->block_graph());
+
+  // The blocks added since the snapshot was taken are simply removed when
+  // it's restored.
+  if (block->id() > snapshot_->next_block_id)
+    return;
+
+  std::pair<Snapshot::SavedBlockMap::iterator, bool> result =
+      snapshot_->blocks.insert(
+          std::make_pair(block->id(), Snapshot::SavedBlock()));
+  if (!result.second)
+    return;
+
+  Snapshot::SavedBlock& saved = result.first->second;
+  saved.type = block->type_;
+  saved.size = block->size_;
+  saved.alignment = block->alignment_;
+  saved.alignment_offset = block->alignment_offset_;
+  saved.padding_before = block->padding_before_;
+  saved.name = block->name_;
+  saved.compiland_name = block->compiland_name_;
+  saved.addr = block->addr_;
+  saved.section = block->section_;
+  saved.attributes = block->attributes_;
+  saved.source_ranges = block->source_ranges_;
+  saved.labels = block->labels_;
+
+  saved.references.reserve(block->references_.size());
+  Block::ReferenceMap::const_iterator ref_it = block->references_.begin();
+  for (; ref_it != block->references_.end(); ++ref_it) {
+    const Reference& ref = ref_it->second;
+    Snapshot::SavedReference saved_ref = { ref_it->first, ref.type(),
+                                           ref.size(), ref.referenced()->id(),
+                                           ref.offset(), ref.base() };
+    saved.references.push_back(saved_ref);
+  }
+
+  saved.owns_data = block->owns_data_;
+  saved.data = NULL;
+  saved.data_size = block->data_size_;
+  if (!block->owns_data_)
+    saved.data = block->data_;
+  else if (block->data_size_ > 0)
+    saved.owned_data.assign(block->data_, block->data_ + block->data_size_);
+}
+
 BlockGraph::AddressSpace::AddressSpace(BlockGraph* graph)
     : graph_(graph) {
   DCHECK(graph != NULL);
@@ -917,6 +1125,7 @@ BlockGraph::Block::~Block() {
 
 void BlockGraph::Block::set_name(const base::StringPiece& name) {
   DCHECK(block_graph_ != NULL);
+  WillModify();
   const std::string& interned_name =
       block_graph_->string_table().InternString(name);
   name_ = &interned_name;
@@ -931,6 +1140,7 @@ const std::string& BlockGraph::Block::compiland_name() const {
 
 void BlockGraph::Block::set_compiland_name(const base::StringPiece& name) {
   DCHECK(block_graph_ != NULL);
+  WillModify();
   const std::string& interned_name =
       block_graph_->string_table().InternString(name);
   compiland_name_ = &interned_name;
@@ -939,6 +1149,7 @@ void BlockGraph::Block::set_compiland_name(const base::StringPiece& name) {
 uint8_t* BlockGraph::Block::AllocateRawData(size_t data_size) {
   DCHECK_GT(data_size, 0u);
   DCHECK_LE(data_size, size_);
+  WillModify();
 
   uint8_t* new_data = new uint8_t[data_size];
   if (!new_data)
@@ -964,6 +1175,7 @@ void BlockGraph::Block::InsertData(Offset offset,
 
   if (size > 0) {
     // Patch up the block.
+    WillModify();
     size_ += size;
     ShiftOffsetItemMap(offset, size, &labels_);
     ShiftReferences(this, offset, size);
@@ -995,6 +1207,8 @@ bool BlockGraph::Block::RemoveData(Offset offset, Size size) {
   if (size == 0)
     return true;
 
+  WillModify();
+
   // Ensure there are no labels in this range.
   if (labels_.lower_bound(offset) != labels_.lower_bound(offset + size))
     return false;
@@ -1085,6 +1299,7 @@ void BlockGraph::Block::SetData(const uint8_t* data, size_t data_size) {
   DCHECK((data_size == 0 && data == NULL) ||
          (data_size != 0 && data != NULL));
   DCHECK(data_size <= size_);
+  WillModify();
 
   if (owns_data_)
     delete [] data_;
@@ -1116,6 +1331,8 @@ const uint8_t* BlockGraph::Block::ResizeData(size_t new_size) {
   if (new_size == data_size_)
     return data_;
 
+  WillModify();
+
   if (!owns_data() && new_size < data_size_) {
     // Not in our ownership and shrinking. We only need to adjust our length.
     data_size_ = new_size;
@@ -1151,6 +1368,9 @@ uint8_t* BlockGraph::Block::GetMutableData() {
   DCHECK_NE(0U, data_size_);
   DCHECK(data_ != NULL);
 
+  // The caller may write through the returned pointer.
+  WillModify();
+
   // Make a copy if we don't already own the data.
   if (!owns_data()) {
     uint8_t* new_data = new uint8_t[data_size_];
@@ -1176,6 +1396,7 @@ bool BlockGraph::Block::HasExternalReferrers() const {
 
 bool BlockGraph::Block::SetReference(Offset offset, const Reference& ref) {
   DCHECK(ref.referenced() != NULL);
+  WillModify();
 
   // Non-code blocks can be referred to by pointers that lie outside of their
   // extent (due to loop induction, arrays indexed with an implicit offset,
@@ -1261,6 +1482,7 @@ bool BlockGraph::Block::RemoveReference(Offset offset) {
   if (it == references_.end())
     return false;
 
+  WillModify();
   BlockGraph::Block* referenced = it->second.referenced();
   Referrer referrer(this, offset);
   size_t removed = referenced->referrers_.erase(referrer);
@@ -1271,6 +1493,9 @@ bool BlockGraph::Block::RemoveReference(Offset offset) {
 }
 
 bool BlockGraph::Block::RemoveAllReferences() {
+  if (!references_.empty())
+    WillModify();
+
   ReferenceMap::iterator it = references_.begin();
   while (it != references_.end()) {
     ReferenceMap::iterator to_remove = it;
@@ -1296,6 +1521,7 @@ bool BlockGraph::Block::RemoveAllReferences() {
 bool BlockGraph::Block::SetLabel(Offset offset, const Label& label) {
   DCHECK_LE(0, offset);
   DCHECK_LE(static_cast<size_t>(offset), size_);
+  WillModify();
 
   VLOG(2) << name() << ": adding "
           << LabelAttributesToString(label.attributes()) << " label '"
@@ -1326,6 +1552,7 @@ bool BlockGraph::Block::GetLabel(Offset offset, Label* label) const {
 
 bool BlockGraph::Block::RemoveLabel(Offset offset) {
   DCHECK(offset >= 0 && static_cast<size_t>(offset) <= size_);
+  WillModify();
 
   return labels_.erase(offset) == 1;
 }
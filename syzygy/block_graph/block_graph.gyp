@@ -39,11 +39,15 @@
         'block_hash.h',
         'block_util.cc',
         'block_util.h',
+        'decoded_instruction_cache.cc',
+        'decoded_instruction_cache.h',
         'filter_util.cc',
         'filter_util.h',
         'filterable.cc',
         'filterable.h',
         'hot_patching_metadata.h',
+        'indexed_block_graph.cc',
+        'indexed_block_graph.h',
         'iterate.cc',
         'iterate.h',
         'ordered_block_graph.cc',
@@ -60,6 +64,7 @@
       ],
       'dependencies': [
         '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/application/application.gyp:application_lib',
         '<(src)/syzygy/common/common.gyp:common_lib',
         '<(src)/syzygy/core/core.gyp:core_lib',
       ],
@@ -96,8 +101,10 @@
         'block_graph_unittest.cc',
         'block_hash_unittest.cc',
         'block_util_unittest.cc',
+        'decoded_instruction_cache_unittest.cc',
         'filter_util_unittest.cc',
         'filterable_unittest.cc',
+        'indexed_block_graph_unittest.cc',
         'iterate_unittest.cc',
         'ordered_block_graph_unittest.cc',
         'orderer_unittest.cc',
@@ -25,6 +25,7 @@
 #define SYZYGY_BLOCK_GRAPH_BLOCK_GRAPH_H_
 
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <unordered_map>
@@ -35,12 +36,15 @@
 #include "syzygy/common/align.h"
 #include "syzygy/core/address.h"
 #include "syzygy/core/address_space.h"
+#include "syzygy/core/pool_allocator.h"
 #include "syzygy/core/string_table.h"
 
 namespace block_graph {
 
-// Forward declaration.
+// Forward declarations.
 class BlockGraphSerializer;
+class DecodedInstructionCache;
+class IndexedBlockGraphReader;
 
 // NOTE: When adding attributes be sure to update any uses of them in
 //       block_graph.cc, for example in MergeIntersectingBlocks.
@@ -354,13 +358,60 @@ class BlockGraph {
   // @returns the image format.
   ImageFormat image_format() const { return image_format_; }
 
+  // Get the cache of the instructions decoded in the code blocks. This lets
+  // the blocks that are decomposed to basic blocks more than once be decoded
+  // only once.
+  // @returns the decoded instruction cache of this BlockGraph.
+  DecodedInstructionCache* decoded_instruction_cache() const {
+    return decoded_instruction_cache_.get();
+  }
+
+  // @name Snapshots.
+  // A snapshot records the state of the block graph so that a transform can
+  // be tried and rolled back. The blocks are saved the first time they're
+  // modified after the snapshot is taken, so taking a snapshot is cheap and
+  // restoring it costs in proportion to the blocks that were touched. Only
+  // one snapshot may be active at a time, and the block graph must not be
+  // modified concurrently while it is.
+  // @note Only the changes made through the Block and BlockGraph mutators are
+  //     tracked; blocks erased directly from blocks_mutable() aren't saved.
+  // @note Restoring a snapshot updates the modified blocks in place, but
+  //     recreates the removed blocks as new objects: pointers to them must be
+  //     looked up again by id. Block ids are never reused.
+  // @{
+  // Takes a snapshot of the block graph. There must be no active snapshot.
+  void TakeSnapshot();
+
+  // Restores the block graph to the state of the active snapshot, and
+  // discards the snapshot.
+  // @returns true on success, false if there is no active snapshot.
+  bool RestoreSnapshot();
+
+  // Discards the active snapshot, keeping the changes made since it was
+  // taken.
+  void DiscardSnapshot();
+
+  // @returns true if a snapshot is active.
+  bool has_snapshot() const { return snapshot_.get() != NULL; }
+  // @}
+
  private:
   // Give BlockGraphSerializer access to our innards for serialization.
   friend BlockGraphSerializer;
+  // The indexed reader materializes the blocks one at a time.
+  friend class IndexedBlockGraphReader;
+
+  // The state saved by a snapshot, which is defined in the implementation.
+  struct Snapshot;
 
   // Removes a block by the iterator to it. The iterator must be valid.
   bool RemoveBlockByIterator(BlockMap::iterator it);
 
+  // Saves @p block to the active snapshot, unless it was already saved or it
+  // was added after the snapshot was taken.
+  // @param block The block that is about to be modified.
+  void SaveBlockToSnapshot(const Block* block);
+
   // All sections we contain.
   SectionMap sections_;
 
@@ -380,6 +431,13 @@ class BlockGraph {
   // UNKNOWN_IMAGE_FORMAT. Usually initialized by the appropriate decomposer.
   ImageFormat image_format_;
 
+  // The instructions decoded in the code blocks, which are recorded the first
+  // time the blocks are decomposed to basic blocks.
+  std::unique_ptr<DecodedInstructionCache> decoded_instruction_cache_;
+
+  // The active snapshot, if any.
+  std::unique_ptr<Snapshot> snapshot_;
+
   DISALLOW_COPY_AND_ASSIGN(BlockGraph);
 };
 
@@ -558,11 +616,16 @@ class BlockGraph::Block {
   // This is keyed on block and source offset (not destination offset),
   // to allow one to easily locate and remove the backreferences on change or
   // deletion.
+  // The referrers, references and labels are by far the most numerous nodes
+  // of a block-graph, so they're allocated from pools.
   typedef std::pair<Block*, Offset> Referrer;
-  typedef std::set<Referrer> ReferrerSet;
+  typedef std::set<Referrer, std::less<Referrer>,
+                   core::PoolAllocator<Referrer>> ReferrerSet;
 
   // Map of references that this block makes to other blocks.
-  typedef std::map<Offset, Reference> ReferenceMap;
+  typedef std::map<Offset, Reference, std::less<Offset>,
+                   core::PoolAllocator<std::pair<const Offset, Reference>>>
+      ReferenceMap;
 
   // Represents a range of data in this block.
   typedef core::AddressRange<Offset, Size> DataRange;
@@ -585,14 +648,22 @@ class BlockGraph::Block {
   // within the block. Note that, while possible, it is NOT guaranteed that
   // all basic blocks are marked with a label. Basic block decomposition should
   // disassemble from the code labels to discover all basic blocks.
-  typedef std::map<Offset, Label> LabelMap;
+  typedef std::map<Offset, Label, std::less<Offset>,
+                   core::PoolAllocator<std::pair<const Offset, Label>>>
+      LabelMap;
 
   ~Block();
 
   // Accessors.
   BlockId id() const { return id_; }
   BlockType type() const { return type_; }
-  void set_type(BlockType type) { type_ = type; }
+  void set_type(BlockType type) {
+    WillModify();
+    type_ = type;
+  }
+
+  // @returns the block graph to which this block belongs.
+  BlockGraph* block_graph() const { return block_graph_; }
 
   Size size() const { return size_; }
 
@@ -600,6 +671,7 @@ class BlockGraph::Block {
   // always be less than or equal to the total size.
   void set_size(Size size) {
     DCHECK_LE(data_size_, size);
+    WillModify();
     size_ = size;
   }
 
@@ -624,6 +696,7 @@ class BlockGraph::Block {
   void set_alignment(Size alignment) {
     // Ensure that alignment is a non-zero power of two.
     DCHECK(common::IsPowerOfTwo(alignment));
+    WillModify();
     alignment_ = alignment;
   }
 
@@ -635,6 +708,7 @@ class BlockGraph::Block {
   // means that the first byte of the block should be aligned.
   // @param alignment_offset The new offset of the alignment.
   void set_alignment_offset(Offset alignment_offset) {
+    WillModify();
     alignment_offset_ = alignment_offset;
   }
 
@@ -647,27 +721,41 @@ class BlockGraph::Block {
   // @param padding_before At least this amount of bytes are inserted before
   //     the block when building the layout.
   void set_padding_before(Size padding_before) {
+    WillModify();
     padding_before_ = padding_before;
   }
 
   // The address of the block is set any time the block is assigned
   // an address in an address space.
   RelativeAddress addr() const { return addr_; }
-  void set_addr(RelativeAddress addr) { addr_ = addr; }
+  void set_addr(RelativeAddress addr) {
+    WillModify();
+    addr_ = addr;
+  }
 
   // The section ID for the block. These IDs are wrt to the SectionMap in the
   // parent BlockGraph.
   SectionId section() const { return section_; }
-  void set_section(SectionId section) { section_ = section; }
+  void set_section(SectionId section) {
+    WillModify();
+    section_ = section;
+  }
 
   // The block attributes are a bitmask. You can set them wholesale,
   // or set and clear them individually by bitmasking.
   BlockAttributes attributes() const { return attributes_; }
-  void set_attributes(BlockAttributes attributes) { attributes_ = attributes; }
+  void set_attributes(BlockAttributes attributes) {
+    WillModify();
+    attributes_ = attributes;
+  }
 
   // Set or clear one or more attributes.
-  void set_attribute(BlockAttributes attribute) { attributes_ |= attribute; }
+  void set_attribute(BlockAttributes attribute) {
+    WillModify();
+    attributes_ |= attribute;
+  }
   void clear_attribute(BlockAttributes attribute) {
+    WillModify();
     attributes_ &= ~attribute;
   }
 
@@ -755,7 +843,10 @@ class BlockGraph::Block {
   const ReferenceMap& references() const { return references_; }
   const ReferrerSet& referrers() const { return referrers_; }
   const SourceRanges& source_ranges() const { return source_ranges_; }
-  SourceRanges& source_ranges() { return source_ranges_; }
+  SourceRanges& source_ranges() {
+    WillModify();
+    return source_ranges_;
+  }
   const LabelMap& labels() const { return labels_; }
 
   // Returns true if there are any other blocks holding a reference to this one.
@@ -838,6 +929,7 @@ class BlockGraph::Block {
   friend class BlockGraph;
   // Give BlockGraphSerializer access to our innards for serialization.
   friend class BlockGraphSerializer;
+  friend class IndexedBlockGraphReader;
 
   // Full constructor.
   // @note This is protected so that blocks may only be created via the
@@ -855,6 +947,13 @@ class BlockGraph::Block {
   // data buffer will not have been initialized in any way.
   uint8_t* AllocateRawData(size_t size);
 
+  // Saves this block to the active snapshot of its block graph, if there is
+  // one, before it's modified.
+  void WillModify() {
+    if (block_graph_->snapshot_.get() != NULL)
+      block_graph_->SaveBlockToSnapshot(this);
+  }
+
   BlockId id_;
   BlockType type_;
   Size size_;
@@ -172,6 +172,10 @@ bool BlockGraphSerializer::Load(BlockGraph* block_graph,
   return true;
 }
 
+uint32_t BlockGraphSerializer::version() {
+  return kSerializedBlockGraphVersion;
+}
+
 bool BlockGraphSerializer::SaveBlockGraphProperties(
     const BlockGraph& block_graph,
     OutArchive* out_archive) const {
@@ -201,6 +201,9 @@ class BlockGraphSerializer {
   // @returns true on success, false otherwise.
   bool Load(BlockGraph* block_graph, core::InArchive* in_archive);
 
+  // @returns the version of the serialization written by Save.
+  static uint32_t version();
+
  protected:
   // @{
   // The block-graph is serialized by breaking it down into its constituent
@@ -1257,6 +1257,98 @@ TEST(BlockGraphTest, StringTable) {
   EXPECT_NE(&interned_str3, &interned_str4);
 }
 
+TEST(BlockGraphTest, RestoreSnapshot) {
+  static const uint8_t kData[] = { 0xCC, 0xCC, 0xCC, 0xCC };
+
+  BlockGraph image;
+  EXPECT_FALSE(image.has_snapshot());
+  EXPECT_FALSE(image.RestoreSnapshot());
+
+  BlockGraph::Section* text = image.AddSection(".text", 0);
+  BlockGraph::Block* b1 = image.AddBlock(BlockGraph::CODE_BLOCK, 0x20, "b1");
+  BlockGraph::Block* b2 = image.AddBlock(BlockGraph::DATA_BLOCK, 0x20, "b2");
+  BlockGraph::Block* b3 = image.AddBlock(BlockGraph::DATA_BLOCK, 0x10, "b3");
+  BlockGraph::BlockId b3_id = b3->id();
+  b1->set_section(text->id());
+  b1->SetData(kData, sizeof(kData));
+  b2->AllocateData(0x10);
+  b2->SetLabel(0, "label", BlockGraph::DATA_LABEL);
+  BlockGraph::Reference b1_to_b2(BlockGraph::ABSOLUTE_REF, 4, b2, 0, 0);
+  BlockGraph::Reference b2_to_b3(BlockGraph::ABSOLUTE_REF, 4, b3, 4, 4);
+  ASSERT_TRUE(b1->SetReference(0, b1_to_b2));
+  ASSERT_TRUE(b2->SetReference(0, b2_to_b3));
+
+  image.TakeSnapshot();
+  EXPECT_TRUE(image.has_snapshot());
+
+  // Modify, add and remove blocks and sections.
+  b1->set_name("renamed");
+  b1->GetMutableData()[0] = 0x90;
+  b1->InsertData(0, 4, false);
+  b2->RemoveLabel(0);
+  b2->GetMutableData()[1] = 0xAB;
+  ASSERT_TRUE(b2->RemoveReference(0));
+  ASSERT_TRUE(image.RemoveBlock(b3));
+  BlockGraph::Block* b4 = image.AddBlock(BlockGraph::DATA_BLOCK, 0x10, "b4");
+  BlockGraph::BlockId b4_id = b4->id();
+  ASSERT_TRUE(b1->SetReference(8, BlockGraph::Reference(
+      BlockGraph::ABSOLUTE_REF, 4, b4, 0, 0)));
+  image.AddSection(".data", 0);
+  ASSERT_TRUE(image.RemoveSection(text));
+
+  ASSERT_TRUE(image.RestoreSnapshot());
+  EXPECT_FALSE(image.has_snapshot());
+
+  // The modified blocks are restored in place.
+  EXPECT_EQ("b1", b1->name());
+  EXPECT_EQ(0x20u, b1->size());
+  EXPECT_FALSE(b1->owns_data());
+  EXPECT_EQ(&kData[0], b1->data());
+  EXPECT_EQ(1u, b1->references().size());
+  BlockGraph::Reference ref;
+  ASSERT_TRUE(b1->GetReference(0, &ref));
+  EXPECT_EQ(b1_to_b2, ref);
+  EXPECT_TRUE(b2->HasLabel(0));
+  EXPECT_EQ(0, b2->data()[1]);
+  EXPECT_EQ(1u, b2->referrers().size());
+
+  // The removed block is recreated, and the added block is removed.
+  EXPECT_TRUE(image.GetBlockById(b4_id) == NULL);
+  b3 = image.GetBlockById(b3_id);
+  ASSERT_TRUE(b3 != NULL);
+  EXPECT_EQ("b3", b3->name());
+  EXPECT_EQ(0x10u, b3->size());
+  ASSERT_TRUE(b2->GetReference(0, &ref));
+  EXPECT_EQ(b3, ref.referenced());
+  EXPECT_EQ(4, ref.offset());
+  EXPECT_EQ(1u, b3->referrers().size());
+  EXPECT_EQ(3u, image.blocks().size());
+
+  EXPECT_EQ(1u, image.sections().size());
+  EXPECT_TRUE(image.GetSectionById(b1->section()) != NULL);
+
+  // Block ids aren't reused.
+  EXPECT_LT(b4_id, image.AddBlock(BlockGraph::DATA_BLOCK, 4, "b5")->id());
+}
+
+TEST(BlockGraphTest, DiscardSnapshot) {
+  BlockGraph image;
+  BlockGraph::Block* b1 = image.AddBlock(BlockGraph::CODE_BLOCK, 0x20, "b1");
+
+  image.TakeSnapshot();
+  b1->set_name("renamed");
+  BlockGraph::Block* b2 = image.AddBlock(BlockGraph::DATA_BLOCK, 0x10, "b2");
+  BlockGraph::BlockId b2_id = b2->id();
+  image.DiscardSnapshot();
+  EXPECT_FALSE(image.has_snapshot());
+
+  // The changes are kept.
+  EXPECT_EQ("renamed", b1->name());
+  EXPECT_EQ(b2, image.GetBlockById(b2_id));
+  EXPECT_FALSE(image.RestoreSnapshot());
+  EXPECT_EQ("renamed", b1->name());
+}
+
 namespace {
 
 class BlockGraphSerializationTest : public testing::Test {
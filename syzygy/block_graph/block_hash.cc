@@ -14,6 +14,11 @@
 
 #include "syzygy/block_graph/block_hash.h"
 
+#include <algorithm>
+
+#include "base/bind.h"
+#include "syzygy/application/work_pool.h"
+
 namespace block_graph {
 
 using base::MD5Context;
@@ -22,6 +27,29 @@ using base::MD5Init;
 using base::MD5Update;
 using base::StringPiece;
 
+namespace {
+
+// The number of blocks that a thread claims at once. Most blocks are small,
+// so claiming them one at a time would make the threads contend.
+const size_t kBlocksPerWorkUnit = 64;
+
+// Hashes the blocks of a work unit.
+// @param blocks the blocks to hash.
+// @param unit the index of the work unit.
+// @param hashes the hashes of @p blocks.
+// @returns true.
+bool HashWorkUnit(const ConstBlockVector* blocks,
+                  std::vector<BlockHash>* hashes,
+                  size_t unit) {
+  size_t begin = unit * kBlocksPerWorkUnit;
+  size_t end = std::min(begin + kBlocksPerWorkUnit, blocks->size());
+  for (size_t i = begin; i < end; ++i)
+    (*hashes)[i].Hash((*blocks)[i]);
+  return true;
+}
+
+}  // namespace
+
 void BlockHash::Hash(const BlockGraph::Block* block) {
   DCHECK(block != NULL);
 
@@ -109,4 +137,17 @@ void BlockHash::Hash(const BlockGraph::Block* block) {
   MD5Final(&md5_digest, &md5_context);
 }
 
+void BlockHash::HashBlocks(const ConstBlockVector& blocks,
+                           size_t thread_count,
+                           std::vector<BlockHash>* hashes) {
+  DCHECK_LE(1u, thread_count);
+  DCHECK_NE(static_cast<std::vector<BlockHash>*>(nullptr), hashes);
+
+  hashes->resize(blocks.size());
+  size_t unit_count =
+      (blocks.size() + kBlocksPerWorkUnit - 1) / kBlocksPerWorkUnit;
+  application::WorkPool pool(thread_count);
+  pool.Run(unit_count, base::Bind(&HashWorkUnit, &blocks, hashes));
+}
+
 }  // namespace block_graph
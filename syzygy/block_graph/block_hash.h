@@ -15,6 +15,8 @@
 #ifndef SYZYGY_BLOCK_GRAPH_BLOCK_HASH_H_
 #define SYZYGY_BLOCK_GRAPH_BLOCK_HASH_H_
 
+#include <vector>
+
 #include "base/md5.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/common/comparable.h"
@@ -48,6 +50,16 @@ struct BlockHash : public common::Comparable<BlockHash> {
   //     Data (skipping references)
   void Hash(const BlockGraph::Block* block);
 
+  // Hashes a batch of blocks, spreading the work over several threads. The
+  // blocks must not be modified while they're being hashed.
+  // @param blocks the blocks to hash.
+  // @param thread_count the maximum number of threads to use. The blocks are
+  //     hashed on the calling thread if this is 1.
+  // @param hashes receives the hashes of @p blocks, in the same order.
+  static void HashBlocks(const ConstBlockVector& blocks,
+                         size_t thread_count,
+                         std::vector<BlockHash>* hashes);
+
   base::MD5Digest md5_digest;
 };
 
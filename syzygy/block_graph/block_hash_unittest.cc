@@ -100,4 +100,32 @@ TEST(BlockHash, HashAndCompare) {
   EXPECT_NE(0, code_block_1_hash.Compare(BlockHash(test_block)));
 }
 
+TEST(BlockHash, HashBlocks) {
+  BlockGraph block_graph;
+  ConstBlockVector blocks;
+  for (size_t i = 0; i < 1000; ++i) {
+    BlockGraph::Block* block = block_graph.AddBlock(
+        BlockGraph::CODE_BLOCK, 0x10, "block");
+    size_t data_size = 1 + i % 0x10;
+    block->AllocateData(data_size);
+    ::memset(block->GetMutableData(), static_cast<uint8_t>(i), data_size);
+    blocks.push_back(block);
+  }
+
+  // Hashing the blocks in parallel gives the same hashes as hashing them one
+  // by one.
+  std::vector<BlockHash> hashes;
+  BlockHash::HashBlocks(blocks, 8, &hashes);
+  ASSERT_EQ(blocks.size(), hashes.size());
+  std::vector<BlockHash> serial_hashes;
+  BlockHash::HashBlocks(blocks, 1, &serial_hashes);
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    EXPECT_EQ(0, BlockHash(blocks[i]).Compare(hashes[i]));
+    EXPECT_EQ(0, hashes[i].Compare(serial_hashes[i]));
+  }
+
+  BlockHash::HashBlocks(ConstBlockVector(), 8, &hashes);
+  EXPECT_TRUE(hashes.empty());
+}
+
 }  // namespace block_graph
@@ -0,0 +1,91 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/block_graph/decoded_instruction_cache.h"
+
+namespace block_graph {
+
+DecodedInstructionCache::DecodedInstructionCache() {
+}
+
+DecodedInstructionCache::~DecodedInstructionCache() {
+}
+
+bool DecodedInstructionCache::Lookup(const Block* block,
+                                     size_t code_length,
+                                     Representations* instructions) const {
+  DCHECK(block != NULL);
+  DCHECK(instructions != NULL);
+
+  if (block->data_size() < code_length)
+    return false;
+
+  base::AutoLock auto_lock(lock_);
+  EntryMap::const_iterator it = entries_.find(block->id());
+  if (it == entries_.end())
+    return false;
+
+  // The instructions are stale if the code was modified since they were
+  // decoded. Comparing the bytes is far cheaper than decoding them again.
+  const Entry& entry = it->second;
+  if (entry.code.size() != code_length ||
+      (code_length != 0 &&
+       ::memcmp(entry.code.data(), block->data(), code_length) != 0)) {
+    return false;
+  }
+
+  *instructions = entry.instructions;
+  return true;
+}
+
+void DecodedInstructionCache::Insert(const Block* block,
+                                     size_t code_length,
+                                     const Representations& instructions) {
+  DCHECK(block != NULL);
+
+  // The blocks whose code isn't all explicitly stored aren't recorded.
+  if (block->data_size() < code_length)
+    return;
+
+#ifndef NDEBUG
+  size_t instructions_length = 0;
+  for (const _DInst& instruction : instructions)
+    instructions_length += instruction.size;
+  DCHECK_EQ(code_length, instructions_length);
+#endif
+
+  Entry entry;
+  entry.code.assign(block->data(), block->data() + code_length);
+  entry.instructions = instructions;
+
+  base::AutoLock auto_lock(lock_);
+  entries_[block->id()] = std::move(entry);
+}
+
+void DecodedInstructionCache::Remove(BlockId id) {
+  base::AutoLock auto_lock(lock_);
+  entries_.erase(id);
+}
+
+void DecodedInstructionCache::Clear() {
+  base::AutoLock auto_lock(lock_);
+  entries_.clear();
+}
+
+size_t DecodedInstructionCache::size() const {
+  base::AutoLock auto_lock(lock_);
+  return entries_.size();
+}
+
+}  // namespace block_graph
@@ -0,0 +1,98 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the DecodedInstructionCache, a side table of a block graph that
+// records the instructions decoded in its code blocks.
+
+#ifndef SYZYGY_BLOCK_GRAPH_DECODED_INSTRUCTION_CACHE_H_
+#define SYZYGY_BLOCK_GRAPH_DECODED_INSTRUCTION_CACHE_H_
+
+#include <map>
+#include <vector>
+
+#include "base/synchronization/lock.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "distorm.h"  // NOLINT
+
+namespace block_graph {
+
+// Records the instructions decoded in the code blocks of a block graph, so
+// that a block that is decomposed to basic blocks several times, by a chain
+// of transforms or by a policy check ahead of a transform, is only decoded
+// once. Each entry holds the decoded representations of the instructions of
+// the code range of a block, in order, which gives both their boundaries and
+// their control flow. An entry is only used while the code bytes of its block
+// are unchanged, so the blocks that are modified in place simply get decoded
+// again.
+//
+// This class is thread-safe, as blocks may be decomposed in parallel.
+class DecodedInstructionCache {
+ public:
+  typedef BlockGraph::Block Block;
+  typedef BlockGraph::BlockId BlockId;
+  typedef std::vector<_DInst> Representations;
+
+  DecodedInstructionCache();
+  ~DecodedInstructionCache();
+
+  // Looks up the instructions decoded in the code range of a block.
+  // @param block The block.
+  // @param code_length The length of the code range, which starts the block.
+  // @param instructions Receives the instructions, in order.
+  // @returns true if the instructions were recorded and the code of the block
+  //     hasn't changed since, false otherwise.
+  bool Lookup(const Block* block,
+              size_t code_length,
+              Representations* instructions) const;
+
+  // Records the instructions decoded in the code range of a block. This
+  // replaces any instructions recorded for the block.
+  // @param block The block.
+  // @param code_length The length of the code range, which starts the block.
+  // @param instructions The instructions, in order. These must cover code
+  //     range exactly.
+  void Insert(const Block* block,
+              size_t code_length,
+              const Representations& instructions);
+
+  // Forgets the instructions of a block.
+  // @param id The ID of the block.
+  void Remove(BlockId id);
+
+  // Forgets the instructions of all the blocks.
+  void Clear();
+
+  // @returns the number of blocks whose instructions are recorded.
+  size_t size() const;
+
+ protected:
+  // The instructions of a block, with the code bytes they were decoded from.
+  struct Entry {
+    std::vector<uint8_t> code;
+    Representations instructions;
+  };
+  typedef std::map<BlockId, Entry> EntryMap;
+
+  // The entries, by block ID. Protected by lock_.
+  EntryMap entries_;
+
+  mutable base::Lock lock_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(DecodedInstructionCache);
+};
+
+}  // namespace block_graph
+
+#endif  // SYZYGY_BLOCK_GRAPH_DECODED_INSTRUCTION_CACHE_H_
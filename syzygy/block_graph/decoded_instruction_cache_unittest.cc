@@ -0,0 +1,98 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/block_graph/decoded_instruction_cache.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/core/disassembler_util.h"
+
+#include "mnemonics.h"  // NOLINT
+
+namespace block_graph {
+
+namespace {
+
+typedef DecodedInstructionCache::Representations Representations;
+
+class DecodedInstructionCacheTest : public testing::Test {
+ public:
+  void SetUp() override {
+    // NOP; RET.
+    const uint8_t kCode[] = {0x90, 0xC3};
+    block_ = block_graph_.AddBlock(BlockGraph::CODE_BLOCK, sizeof(kCode),
+                                   "code");
+    ASSERT_TRUE(block_ != NULL);
+    block_->CopyData(sizeof(kCode), kCode);
+
+    for (size_t offset = 0; offset < sizeof(kCode); ++offset) {
+      _DInst instruction = {};
+      ASSERT_TRUE(core::DecodeOneInstruction(block_->data() + offset,
+                                             sizeof(kCode) - offset,
+                                             &instruction));
+      instructions_.push_back(instruction);
+    }
+  }
+
+ protected:
+  BlockGraph block_graph_;
+  BlockGraph::Block* block_;
+  Representations instructions_;
+};
+
+}  // namespace
+
+TEST_F(DecodedInstructionCacheTest, InsertAndLookup) {
+  DecodedInstructionCache cache;
+  Representations instructions;
+  EXPECT_FALSE(cache.Lookup(block_, block_->size(), &instructions));
+
+  cache.Insert(block_, block_->size(), instructions_);
+  EXPECT_EQ(1u, cache.size());
+  ASSERT_TRUE(cache.Lookup(block_, block_->size(), &instructions));
+  ASSERT_EQ(instructions_.size(), instructions.size());
+  EXPECT_EQ(I_NOP, instructions[0].opcode);
+  EXPECT_EQ(I_RET, instructions[1].opcode);
+
+  // The instructions only describe the code range they were decoded from.
+  EXPECT_FALSE(cache.Lookup(block_, 1, &instructions));
+
+  cache.Remove(block_->id());
+  EXPECT_EQ(0u, cache.size());
+  EXPECT_FALSE(cache.Lookup(block_, block_->size(), &instructions));
+}
+
+TEST_F(DecodedInstructionCacheTest, ModifiedCodeIsStale) {
+  DecodedInstructionCache cache;
+  cache.Insert(block_, block_->size(), instructions_);
+
+  // The NOP becomes an INT3.
+  block_->GetMutableData()[0] = 0xCC;
+  Representations instructions;
+  EXPECT_FALSE(cache.Lookup(block_, block_->size(), &instructions));
+
+  cache.Clear();
+  EXPECT_EQ(0u, cache.size());
+}
+
+TEST_F(DecodedInstructionCacheTest, RemoveBlockForgetsInstructions) {
+  DecodedInstructionCache* cache = block_graph_.decoded_instruction_cache();
+  ASSERT_TRUE(cache != NULL);
+  cache->Insert(block_, block_->size(), instructions_);
+  EXPECT_EQ(1u, cache->size());
+
+  ASSERT_TRUE(block_graph_.RemoveBlock(block_));
+  EXPECT_EQ(0u, cache->size());
+}
+
+}  // namespace block_graph
@@ -0,0 +1,410 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/block_graph/indexed_block_graph.h"
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <set>
+
+#include "base/files/file_util.h"
+#include "syzygy/core/serialization.h"
+
+namespace block_graph {
+
+namespace {
+
+typedef internal::IndexedBlockGraphHeader Header;
+typedef internal::IndexedBlockGraphEntry Entry;
+
+// 'SZBG', when read as little-endian.
+const uint32_t kIndexedBlockGraphMagic = 0x47425A53;
+
+// The version of the indexed format. This must be incremented whenever the
+// layout of the file changes.
+const uint32_t kIndexedBlockGraphVersion = 1;
+
+// The records are all aligned to this many bytes.
+const size_t kIndexAlignment = 4;
+
+// Pads a buffer so that its size is a multiple of kIndexAlignment.
+void AlignBuffer(std::vector<uint8_t>* buffer) {
+  DCHECK_NE(static_cast<std::vector<uint8_t>*>(nullptr), buffer);
+  size_t size = (buffer->size() + kIndexAlignment - 1) & ~(kIndexAlignment - 1);
+  buffer->resize(size, 0);
+}
+
+// Appends raw objects to a buffer.
+template <typename T>
+void AppendObjects(const std::vector<T>& objects,
+                   std::vector<uint8_t>* buffer) {
+  DCHECK_NE(static_cast<std::vector<uint8_t>*>(nullptr), buffer);
+  if (objects.empty())
+    return;
+  const uint8_t* begin = reinterpret_cast<const uint8_t*>(objects.data());
+  buffer->insert(buffer->end(), begin, begin + objects.size() * sizeof(T));
+}
+
+// Determines if a range fits in a buffer, without overflowing.
+bool RangeIsValid(size_t offset, size_t size, size_t length) {
+  return offset <= length && size <= length - offset;
+}
+
+bool EntryIdLess(const Entry& entry, BlockGraph::BlockId id) {
+  return entry.id < id;
+}
+
+}  // namespace
+
+bool IndexedBlockGraphWriter::SaveToFile(const BlockGraph& block_graph,
+                                         const base::FilePath& path) const {
+  std::vector<uint8_t> buffer;
+  if (!SaveToBuffer(block_graph, &buffer))
+    return false;
+
+  int size = static_cast<int>(buffer.size());
+  if (base::WriteFile(path, reinterpret_cast<const char*>(buffer.data()),
+                      size) != size) {
+    LOG(ERROR) << "Unable to write indexed block-graph \"" << path.value()
+               << "\".";
+    return false;
+  }
+
+  return true;
+}
+
+bool IndexedBlockGraphWriter::SaveToBuffer(const BlockGraph& block_graph,
+                                           std::vector<uint8_t>* buffer) const {
+  DCHECK_NE(static_cast<std::vector<uint8_t>*>(nullptr), buffer);
+
+  // The header is filled in once the rest of the file has been laid out.
+  buffer->assign(sizeof(Header), 0);
+  Header header = {};
+  header.magic = kIndexedBlockGraphMagic;
+  header.version = kIndexedBlockGraphVersion;
+  header.serializer_version = BlockGraphSerializer::version();
+  header.data_mode = static_cast<uint32_t>(data_mode_);
+  header.attributes = attributes_;
+  header.block_count = static_cast<uint32_t>(block_graph.blocks().size());
+
+  core::ScopedOutStreamPtr out_stream(
+      core::CreateByteOutStream(std::back_inserter(*buffer)));
+  core::OutArchive out_archive(out_stream.get());
+
+  header.properties_offset = static_cast<uint32_t>(buffer->size());
+  if (!SaveBlockGraphProperties(block_graph, &out_archive))
+    return false;
+  header.properties_size =
+      static_cast<uint32_t>(buffer->size() - header.properties_offset);
+
+  // The blocks are sorted by ID in the block-graph, so the index is too.
+  std::vector<Entry> entries;
+  entries.reserve(block_graph.blocks().size());
+  for (const auto& it : block_graph.blocks()) {
+    const BlockGraph::Block& block = it.second;
+
+    Entry entry = {};
+    entry.id = static_cast<uint32_t>(block.id());
+    entry.address = block.addr().value();
+    entry.size = static_cast<uint32_t>(block.size());
+    entry.record_offset = static_cast<uint32_t>(buffer->size());
+    if (!SaveBlockProperties(block, &out_archive) ||
+        !SaveBlockLabels(block, &out_archive) ||
+        !SaveBlockData(block, &out_archive)) {
+      LOG(ERROR) << "Unable to save block with id " << block.id() << ".";
+      return false;
+    }
+
+    // The referenced blocks are listed ahead of the references, so that the
+    // reader can load them before wiring up the references.
+    entry.references_offset = static_cast<uint32_t>(buffer->size());
+    std::set<BlockGraph::BlockId> referenced_ids;
+    for (const auto& ref : block.references())
+      referenced_ids.insert(ref.second.referenced()->id());
+    std::vector<BlockGraph::BlockId> referenced(referenced_ids.begin(),
+                                                referenced_ids.end());
+    if (!out_archive.Save(referenced) ||
+        !SaveBlockReferences(block, &out_archive)) {
+      LOG(ERROR) << "Unable to save references for block with id "
+                 << block.id() << ".";
+      return false;
+    }
+    entry.record_end = static_cast<uint32_t>(buffer->size());
+
+    entries.push_back(entry);
+  }
+
+  // The address index only covers the blocks that have an address.
+  std::vector<uint32_t> address_index;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (entries[i].address != core::RelativeAddress::kInvalidAddress.value())
+      address_index.push_back(static_cast<uint32_t>(i));
+  }
+  std::stable_sort(address_index.begin(), address_index.end(),
+                   [&entries](uint32_t pos1, uint32_t pos2) {
+                     return entries[pos1].address < entries[pos2].address;
+                   });
+
+  AlignBuffer(buffer);
+  header.index_offset = static_cast<uint32_t>(buffer->size());
+  AppendObjects(entries, buffer);
+  header.address_index_offset = static_cast<uint32_t>(buffer->size());
+  header.address_index_count = static_cast<uint32_t>(address_index.size());
+  AppendObjects(address_index, buffer);
+
+  // All the offsets are 32-bit.
+  if (buffer->size() > std::numeric_limits<uint32_t>::max()) {
+    LOG(ERROR) << "The block-graph is too large for the indexed format.";
+    return false;
+  }
+
+  ::memcpy(buffer->data(), &header, sizeof(header));
+
+  return true;
+}
+
+IndexedBlockGraphReader::IndexedBlockGraphReader()
+    : data_(nullptr),
+      length_(0),
+      serializer_version_(0),
+      block_graph_(nullptr),
+      entries_(nullptr),
+      entry_count_(0),
+      address_index_(nullptr),
+      address_index_count_(0) {
+}
+
+bool IndexedBlockGraphReader::Open(const base::FilePath& path,
+                                   BlockGraph* block_graph) {
+  DCHECK_NE(static_cast<BlockGraph*>(nullptr), block_graph);
+  DCHECK_EQ(0u, block_graph->blocks().size());
+  DCHECK_EQ(static_cast<BlockGraph*>(nullptr), block_graph_);
+
+  if (!file_.Initialize(path)) {
+    LOG(ERROR) << "Unable to map indexed block-graph \"" << path.value()
+               << "\".";
+    return false;
+  }
+
+  block_graph_ = block_graph;
+  if (!Init(file_.data(), file_.length())) {
+    LOG(ERROR) << "Invalid indexed block-graph \"" << path.value() << "\".";
+    return false;
+  }
+
+  return true;
+}
+
+size_t IndexedBlockGraphReader::block_count() const {
+  return entry_count_;
+}
+
+BlockGraph::Block* IndexedBlockGraphReader::GetBlockById(
+    BlockGraph::BlockId id) {
+  const Entry* entry = FindEntry(id);
+  if (entry == nullptr)
+    return nullptr;
+  return Materialize(*entry);
+}
+
+BlockGraph::Block* IndexedBlockGraphReader::GetBlockByAddress(
+    core::RelativeAddress address) {
+  // Find the last block that starts at or before the address.
+  const uint32_t* end = address_index_ + address_index_count_;
+  const uint32_t* it = std::upper_bound(
+      address_index_, end, address.value(),
+      [this](uint32_t value, uint32_t pos) {
+        return value < entries_[pos].address;
+      });
+  if (it == address_index_)
+    return nullptr;
+  const Entry& entry = entries_[*(it - 1)];
+
+  uint64_t block_end = static_cast<uint64_t>(entry.address) + entry.size;
+  if (address.value() >= block_end)
+    return nullptr;
+
+  return Materialize(entry);
+}
+
+bool IndexedBlockGraphReader::MaterializeAll() {
+  for (size_t i = 0; i < entry_count_; ++i) {
+    if (Materialize(entries_[i]) == nullptr)
+      return false;
+  }
+  return true;
+}
+
+bool IndexedBlockGraphReader::IsMaterialized(BlockGraph::BlockId id) const {
+  const Entry* entry = FindEntry(id);
+  return entry != nullptr && states_[entry - entries_] == kBlockMaterialized;
+}
+
+bool IndexedBlockGraphReader::Init(const uint8_t* data, size_t length) {
+  DCHECK_NE(static_cast<BlockGraph*>(nullptr), block_graph_);
+
+  if (data == nullptr || length < sizeof(Header)) {
+    LOG(ERROR) << "Indexed block-graph is too short.";
+    return false;
+  }
+
+  Header header = {};
+  ::memcpy(&header, data, sizeof(header));
+  if (header.magic != kIndexedBlockGraphMagic ||
+      header.version != kIndexedBlockGraphVersion) {
+    LOG(ERROR) << "Unsupported indexed block-graph version.";
+    return false;
+  }
+  if (header.serializer_version > BlockGraphSerializer::version() ||
+      header.data_mode >= DATA_MODE_MAX ||
+      (header.attributes & ~(ATTRIBUTES_MAX - 1)) != 0) {
+    LOG(ERROR) << "Invalid indexed block-graph properties.";
+    return false;
+  }
+
+  size_t index_size = static_cast<size_t>(header.block_count) * sizeof(Entry);
+  size_t address_index_size =
+      static_cast<size_t>(header.address_index_count) * sizeof(uint32_t);
+  if (!RangeIsValid(header.properties_offset, header.properties_size,
+                    length) ||
+      header.index_offset % kIndexAlignment != 0 ||
+      !RangeIsValid(header.index_offset, index_size, length) ||
+      header.address_index_offset % kIndexAlignment != 0 ||
+      !RangeIsValid(header.address_index_offset, address_index_size, length) ||
+      header.address_index_count > header.block_count) {
+    LOG(ERROR) << "Invalid indexed block-graph layout.";
+    return false;
+  }
+
+  data_ = data;
+  length_ = length;
+  serializer_version_ = header.serializer_version;
+  data_mode_ = static_cast<DataMode>(header.data_mode);
+  attributes_ = header.attributes;
+  entries_ = reinterpret_cast<const Entry*>(data + header.index_offset);
+  entry_count_ = header.block_count;
+  address_index_ =
+      reinterpret_cast<const uint32_t*>(data + header.address_index_offset);
+  address_index_count_ = header.address_index_count;
+
+  // The lookups by address trust the address index.
+  for (size_t i = 0; i < address_index_count_; ++i) {
+    if (address_index_[i] >= entry_count_) {
+      LOG(ERROR) << "Invalid indexed block-graph address index.";
+      return false;
+    }
+  }
+
+  const uint8_t* properties = data + header.properties_offset;
+  core::ScopedInStreamPtr in_stream(core::CreateByteInStream(
+      properties, properties + header.properties_size));
+  core::InArchive in_archive(in_stream.get());
+  if (!LoadBlockGraphProperties(serializer_version_, block_graph_,
+                                &in_archive)) {
+    return false;
+  }
+
+  states_.assign(entry_count_, kBlockAbsent);
+
+  return true;
+}
+
+const IndexedBlockGraphReader::Entry* IndexedBlockGraphReader::FindEntry(
+    BlockGraph::BlockId id) const {
+  const Entry* end = entries_ + entry_count_;
+  const Entry* entry = std::lower_bound(entries_, end, id, &EntryIdLess);
+  if (entry == end || entry->id != id)
+    return nullptr;
+  return entry;
+}
+
+BlockGraph::Block* IndexedBlockGraphReader::LoadShell(const Entry& entry) {
+  size_t pos = &entry - entries_;
+  DCHECK_LT(pos, entry_count_);
+  if (states_[pos] != kBlockAbsent)
+    return block_graph_->GetBlockById(entry.id);
+
+  if (entry.record_offset > entry.references_offset ||
+      entry.references_offset > entry.record_end ||
+      entry.record_end > length_) {
+    LOG(ERROR) << "Invalid record for block with id " << entry.id << ".";
+    return nullptr;
+  }
+
+  std::pair<BlockGraph::BlockMap::iterator, bool> result =
+      block_graph_->blocks_.insert(
+          std::make_pair(entry.id, BlockGraph::Block(block_graph_)));
+  if (!result.second) {
+    LOG(ERROR) << "Unable to insert block with id " << entry.id << ".";
+    return nullptr;
+  }
+  BlockGraph::Block* block = &result.first->second;
+  block->id_ = entry.id;
+
+  core::ScopedInStreamPtr in_stream(core::CreateByteInStream(
+      data_ + entry.record_offset, data_ + entry.references_offset));
+  core::InArchive in_archive(in_stream.get());
+  if (!LoadBlockProperties(serializer_version_, block, &in_archive) ||
+      !LoadBlockLabels(block, &in_archive) ||
+      !LoadBlockData(block, &in_archive)) {
+    LOG(ERROR) << "Unable to load block with id " << entry.id << ".";
+    block_graph_->blocks_.erase(result.first);
+    return nullptr;
+  }
+
+  states_[pos] = kBlockShell;
+  return block;
+}
+
+BlockGraph::Block* IndexedBlockGraphReader::Materialize(const Entry& entry) {
+  BlockGraph::Block* block = LoadShell(entry);
+  if (block == nullptr)
+    return nullptr;
+  size_t pos = &entry - entries_;
+  if (states_[pos] == kBlockMaterialized)
+    return block;
+
+  core::ScopedInStreamPtr in_stream(core::CreateByteInStream(
+      data_ + entry.references_offset, data_ + entry.record_end));
+  core::InArchive in_archive(in_stream.get());
+
+  // The referenced blocks must exist before the references can be loaded.
+  std::vector<BlockGraph::BlockId> referenced;
+  if (!in_archive.Load(&referenced)) {
+    LOG(ERROR) << "Unable to load referenced blocks for block with id "
+               << entry.id << ".";
+    return nullptr;
+  }
+  for (BlockGraph::BlockId id : referenced) {
+    const Entry* referenced_entry = FindEntry(id);
+    if (referenced_entry == nullptr ||
+        LoadShell(*referenced_entry) == nullptr) {
+      LOG(ERROR) << "Unable to load block with id " << id << " referenced by "
+                 << "block with id " << entry.id << ".";
+      return nullptr;
+    }
+  }
+
+  if (!LoadBlockReferences(block_graph_, block, &in_archive)) {
+    // Leave the block in a state from which loading can be retried.
+    block->RemoveAllReferences();
+    return nullptr;
+  }
+
+  states_[pos] = kBlockMaterialized;
+  return block;
+}
+
+}  // namespace block_graph
@@ -0,0 +1,192 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares an indexed serialization of block-graphs, which can be memory
+// mapped and from which the blocks are deserialized lazily. This is meant for
+// the tools that only look at a few blocks of a big block-graph, and that
+// don't want to pay for loading all of it.
+//
+// The file is laid out as follows:
+//   - A header, which describes the rest of the file.
+//   - The block-graph properties.
+//   - One record per block. The first part of a record holds the properties,
+//     labels and data of the block, as saved by BlockGraphSerializer. The
+//     second part holds the IDs of the blocks that the block refers to,
+//     followed by its references.
+//   - An index of the records, sorted by block ID.
+//   - The positions in that index of the blocks that have an address, sorted
+//     by address.
+
+#ifndef SYZYGY_BLOCK_GRAPH_INDEXED_BLOCK_GRAPH_H_
+#define SYZYGY_BLOCK_GRAPH_INDEXED_BLOCK_GRAPH_H_
+
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/files/memory_mapped_file.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/block_graph/block_graph_serializer.h"
+
+namespace block_graph {
+
+namespace internal {
+
+// The header of an indexed block-graph file. All the offsets are from the
+// start of the file.
+struct IndexedBlockGraphHeader {
+  uint32_t magic;
+  uint32_t version;
+  // The version of the BlockGraphSerializer records.
+  uint32_t serializer_version;
+  uint32_t data_mode;
+  uint32_t attributes;
+  uint32_t block_count;
+  uint32_t properties_offset;
+  uint32_t properties_size;
+  uint32_t index_offset;
+  uint32_t address_index_offset;
+  uint32_t address_index_count;
+};
+
+// An entry of the block index.
+struct IndexedBlockGraphEntry {
+  uint32_t id;
+  uint32_t address;
+  uint32_t size;
+  uint32_t record_offset;
+  uint32_t references_offset;
+  uint32_t record_end;
+};
+
+}  // namespace internal
+
+// Writes block-graphs in the indexed format.
+class IndexedBlockGraphWriter : public BlockGraphSerializer {
+ public:
+  // Saves a block-graph to a file. The data mode, attributes and save
+  // callback of the serializer are honored.
+  // @param block_graph The block-graph to save.
+  // @param path The path of the file to write.
+  // @returns true on success, false otherwise.
+  bool SaveToFile(const BlockGraph& block_graph,
+                  const base::FilePath& path) const;
+
+  // Saves a block-graph to a buffer.
+  // @param block_graph The block-graph to save.
+  // @param buffer Receives the serialized block-graph.
+  // @returns true on success, false otherwise.
+  bool SaveToBuffer(const BlockGraph& block_graph,
+                    std::vector<uint8_t>* buffer) const;
+};
+
+// Reads block-graphs written by IndexedBlockGraphWriter. Opening a file only
+// maps it and loads the block-graph properties, the blocks are loaded when
+// they are first looked up. A looked up block gets all its properties, data
+// and references, and the blocks it refers to are loaded without their own
+// references so that they can be referred to.
+//
+// As a consequence, the referrers of a block only include the blocks that
+// have been looked up. MaterializeAll must be called before relying on them.
+//
+// The file must stay mapped as long as the reader is used, and the load
+// callback must be set before any block is looked up if the blocks' data
+// wasn't saved in the file.
+class IndexedBlockGraphReader : public BlockGraphSerializer {
+ public:
+  IndexedBlockGraphReader();
+
+  // Opens an indexed block-graph file.
+  // @param path The path of the file to open.
+  // @param block_graph The block-graph to load to. This must be empty, and
+  //     must outlive the reader.
+  // @returns true on success, false otherwise.
+  bool Open(const base::FilePath& path, BlockGraph* block_graph);
+
+  // @returns the number of blocks in the file.
+  size_t block_count() const;
+
+  // Looks up a block by ID, loading it if needed.
+  // @param id The ID of the block.
+  // @returns the block, or nullptr if there is no such block or if it can't
+  //     be loaded.
+  BlockGraph::Block* GetBlockById(BlockGraph::BlockId id);
+
+  // Looks up the block that contains an address, loading it if needed. If
+  // blocks overlap, the one that starts last is returned.
+  // @param address The address to look up.
+  // @returns the block, or nullptr if there is no such block or if it can't
+  //     be loaded.
+  BlockGraph::Block* GetBlockByAddress(core::RelativeAddress address);
+
+  // Loads all the blocks that haven't been loaded yet.
+  // @returns true on success, false otherwise.
+  bool MaterializeAll();
+
+  // @param id The ID of a block.
+  // @returns true if the block has been loaded with its references.
+  bool IsMaterialized(BlockGraph::BlockId id) const;
+
+ protected:
+  typedef internal::IndexedBlockGraphEntry Entry;
+
+  // The loading states of the blocks.
+  enum BlockState : uint8_t {
+    kBlockAbsent,
+    // The block is loaded, but not its references.
+    kBlockShell,
+    kBlockMaterialized,
+  };
+
+  // Initializes the reader from the contents of a file.
+  // @param data The contents of the file.
+  // @param length The length of the contents.
+  // @returns true on success, false otherwise.
+  bool Init(const uint8_t* data, size_t length);
+
+  // @param id The ID of a block.
+  // @returns the index entry of the block, or nullptr if there is none.
+  const Entry* FindEntry(BlockGraph::BlockId id) const;
+
+  // Loads a block, without its references, if it isn't loaded yet.
+  // @param entry The index entry of the block.
+  // @returns the block, or nullptr on failure.
+  BlockGraph::Block* LoadShell(const Entry& entry);
+
+  // Loads a block with its references if it isn't loaded yet.
+  // @param entry The index entry of the block.
+  // @returns the block, or nullptr on failure.
+  BlockGraph::Block* Materialize(const Entry& entry);
+
+  base::MemoryMappedFile file_;
+  const uint8_t* data_;
+  size_t length_;
+  uint32_t serializer_version_;
+  BlockGraph* block_graph_;
+
+  // The index and the address index, in the mapped file.
+  const Entry* entries_;
+  size_t entry_count_;
+  const uint32_t* address_index_;
+  size_t address_index_count_;
+
+  // The states of the blocks, by index entry.
+  std::vector<BlockState> states_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(IndexedBlockGraphReader);
+};
+
+}  // namespace block_graph
+
+#endif  // SYZYGY_BLOCK_GRAPH_INDEXED_BLOCK_GRAPH_H_
@@ -0,0 +1,188 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/block_graph/indexed_block_graph.h"
+
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/unittest_util.h"
+
+namespace block_graph {
+
+namespace {
+
+const uint8_t kCodeData[] = { 0x90, 0x90, 0xE8, 0x00, 0x00, 0x00, 0x00, 0xC3 };
+
+class IndexedBlockGraphTest : public ::testing::Test {
+ public:
+  IndexedBlockGraphTest() : code_(nullptr), data_(nullptr), rdata_(nullptr) { }
+
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    path_ = temp_dir_.path().Append(L"block_graph.bin");
+
+    BlockGraph::Section* text = block_graph_.AddSection(".text", 1);
+    BlockGraph::Section* data = block_graph_.AddSection(".data", 2);
+    code_ = block_graph_.AddBlock(BlockGraph::CODE_BLOCK, 8, "code");
+    data_ = block_graph_.AddBlock(BlockGraph::DATA_BLOCK, 8, "data");
+    rdata_ = block_graph_.AddBlock(BlockGraph::DATA_BLOCK, 4, "rdata");
+    BlockGraph::Block* no_address =
+        block_graph_.AddBlock(BlockGraph::DATA_BLOCK, 4, "no_address");
+
+    code_->set_section(text->id());
+    data_->set_section(data->id());
+    rdata_->set_section(data->id());
+    no_address->set_section(data->id());
+    code_->set_addr(core::RelativeAddress(0x1000));
+    data_->set_addr(core::RelativeAddress(0x2000));
+    rdata_->set_addr(core::RelativeAddress(0x2008));
+
+    code_->CopyData(sizeof(kCodeData), kCodeData);
+    code_->SetLabel(0, BlockGraph::Label("code", BlockGraph::CODE_LABEL));
+    data_->AllocateData(data_->size());
+
+    code_->SetReference(3, BlockGraph::Reference(
+        BlockGraph::PC_RELATIVE_REF, 4, code_, 0, 0));
+    data_->SetReference(0, BlockGraph::Reference(
+        BlockGraph::ABSOLUTE_REF, 4, code_, 0, 0));
+    data_->SetReference(4, BlockGraph::Reference(
+        BlockGraph::ABSOLUTE_REF, 4, rdata_, 0, 0));
+    no_address->SetReference(0, BlockGraph::Reference(
+        BlockGraph::ABSOLUTE_REF, 4, data_, 0, 0));
+
+    writer_.set_data_mode(BlockGraphSerializer::OUTPUT_ALL_DATA);
+  }
+
+ protected:
+  base::ScopedTempDir temp_dir_;
+  base::FilePath path_;
+
+  BlockGraph block_graph_;
+  BlockGraph::Block* code_;
+  BlockGraph::Block* data_;
+  BlockGraph::Block* rdata_;
+
+  IndexedBlockGraphWriter writer_;
+};
+
+}  // namespace
+
+TEST_F(IndexedBlockGraphTest, OpenLoadsNoBlock) {
+  ASSERT_TRUE(writer_.SaveToFile(block_graph_, path_));
+
+  BlockGraph loaded;
+  IndexedBlockGraphReader reader;
+  ASSERT_TRUE(reader.Open(path_, &loaded));
+  EXPECT_EQ(block_graph_.blocks().size(), reader.block_count());
+  EXPECT_EQ(BlockGraphSerializer::OUTPUT_ALL_DATA, reader.data_mode());
+
+  EXPECT_EQ(0u, loaded.blocks().size());
+  EXPECT_EQ(block_graph_.sections().size(), loaded.sections().size());
+  EXPECT_EQ(block_graph_.next_block_id(), loaded.next_block_id());
+  EXPECT_FALSE(reader.IsMaterialized(code_->id()));
+}
+
+TEST_F(IndexedBlockGraphTest, GetBlockByAddress) {
+  ASSERT_TRUE(writer_.SaveToFile(block_graph_, path_));
+
+  BlockGraph loaded;
+  IndexedBlockGraphReader reader;
+  ASSERT_TRUE(reader.Open(path_, &loaded));
+
+  EXPECT_EQ(static_cast<BlockGraph::Block*>(nullptr),
+            reader.GetBlockByAddress(core::RelativeAddress(0xFFF)));
+  EXPECT_EQ(static_cast<BlockGraph::Block*>(nullptr),
+            reader.GetBlockByAddress(core::RelativeAddress(0x1008)));
+  EXPECT_EQ(static_cast<BlockGraph::Block*>(nullptr),
+            reader.GetBlockByAddress(core::RelativeAddress(0x200C)));
+  EXPECT_EQ(0u, loaded.blocks().size());
+
+  // Looking up the data block also loads the blocks it refers to, without
+  // their references.
+  BlockGraph::Block* data =
+      reader.GetBlockByAddress(core::RelativeAddress(0x2004));
+  ASSERT_NE(static_cast<BlockGraph::Block*>(nullptr), data);
+  EXPECT_EQ(data_->id(), data->id());
+  EXPECT_TRUE(reader.IsMaterialized(data_->id()));
+  EXPECT_EQ(3u, loaded.blocks().size());
+  EXPECT_EQ(2u, data->references().size());
+
+  BlockGraph::Block* code = loaded.GetBlockById(code_->id());
+  ASSERT_NE(static_cast<BlockGraph::Block*>(nullptr), code);
+  EXPECT_FALSE(reader.IsMaterialized(code_->id()));
+  EXPECT_EQ(0u, code->references().size());
+  EXPECT_EQ(sizeof(kCodeData), code->data_size());
+  EXPECT_EQ(0, ::memcmp(kCodeData, code->data(), sizeof(kCodeData)));
+
+  // Looking up the code block again loads its references.
+  EXPECT_EQ(code, reader.GetBlockByAddress(core::RelativeAddress(0x1000)));
+  EXPECT_TRUE(reader.IsMaterialized(code_->id()));
+  EXPECT_EQ(1u, code->references().size());
+  EXPECT_EQ(1u, code->labels().size());
+}
+
+TEST_F(IndexedBlockGraphTest, GetBlockById) {
+  ASSERT_TRUE(writer_.SaveToFile(block_graph_, path_));
+
+  BlockGraph loaded;
+  IndexedBlockGraphReader reader;
+  ASSERT_TRUE(reader.Open(path_, &loaded));
+
+  EXPECT_EQ(static_cast<BlockGraph::Block*>(nullptr),
+            reader.GetBlockById(block_graph_.next_block_id()));
+  BlockGraph::Block* rdata = reader.GetBlockById(rdata_->id());
+  ASSERT_NE(static_cast<BlockGraph::Block*>(nullptr), rdata);
+  EXPECT_EQ(rdata_->addr(), rdata->addr());
+  EXPECT_EQ(rdata_->name(), rdata->name());
+  EXPECT_EQ(1u, loaded.blocks().size());
+}
+
+TEST_F(IndexedBlockGraphTest, MaterializeAll) {
+  ASSERT_TRUE(writer_.SaveToFile(block_graph_, path_));
+
+  BlockGraph loaded;
+  IndexedBlockGraphReader reader;
+  ASSERT_TRUE(reader.Open(path_, &loaded));
+  ASSERT_NE(static_cast<BlockGraph::Block*>(nullptr),
+            reader.GetBlockById(data_->id()));
+  ASSERT_TRUE(reader.MaterializeAll());
+
+  EXPECT_TRUE(testing::BlockGraphsEqual(block_graph_, loaded, writer_));
+}
+
+TEST_F(IndexedBlockGraphTest, FailsOnInvalidFile) {
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE(writer_.SaveToBuffer(block_graph_, &buffer));
+
+  // A truncated file can't be opened.
+  buffer.resize(buffer.size() - 1);
+  int size = static_cast<int>(buffer.size());
+  ASSERT_EQ(size, base::WriteFile(
+      path_, reinterpret_cast<const char*>(buffer.data()), size));
+
+  BlockGraph loaded;
+  IndexedBlockGraphReader reader;
+  EXPECT_FALSE(reader.Open(path_, &loaded));
+
+  // Neither can a file that isn't in the indexed format be opened.
+  buffer[0] ^= 0xFF;
+  ASSERT_EQ(size, base::WriteFile(
+      path_, reinterpret_cast<const char*>(buffer.data()), size));
+  BlockGraph other_loaded;
+  IndexedBlockGraphReader other_reader;
+  EXPECT_FALSE(other_reader.Open(path_, &other_loaded));
+}
+
+}  // namespace block_graph
@@ -36,19 +36,6 @@ struct OrderedBlockGraph::CompareSectionInfo {
   }
 };
 
-// This is used for sorting and searching through the block index.
-struct OrderedBlockGraph::CompareBlockInfo {
-  bool operator()(const BlockInfo& b1, const BlockInfo& b2) const {
-    return *b1.it < *b2.it;
-  }
-  bool operator()(const BlockInfo& b1, const Block* b2) const {
-    return *b1.it < b2;
-  }
-  bool operator()(const Block* b1, const BlockInfo& b2) const {
-    return b1 < *b2.it;
-  }
-};
-
 OrderedBlockGraph::OrderedBlockGraph(BlockGraph* block_graph)
     : block_graph_(block_graph) {
   DCHECK(block_graph != NULL);
@@ -57,6 +44,10 @@ OrderedBlockGraph::OrderedBlockGraph(BlockGraph* block_graph)
   // not belonging to an explicit section. This ensures that all blocks belong
   // to exactly one BlockList (and OrderedSection) at all times.
   section_infos_.resize(block_graph_->sections().size() + 1);
+  for (size_t i = 0; i < section_infos_.size(); ++i) {
+    section_infos_[i].ordered_section.owner_ = this;
+    section_infos_[i].ordered_section.materialized_ = false;
+  }
   // We don't add this special section to the list of ordered sections.
   section_infos_[0].ordered_section.section_ = NULL;
   BlockGraph::SectionMap::iterator section_it =
@@ -83,32 +74,7 @@ OrderedBlockGraph::OrderedBlockGraph(BlockGraph* block_graph)
   }
   DCHECK_EQ(ordered_sections_.size(), block_graph_->sections().size());
 
-  // Iterate through the blocks and place them into the appropriate BlockLists.
-  // Each sections BlockList will contain the blocks in the order of their
-  // block graph ID.
-  block_infos_.resize(block_graph_->blocks().size());
-  BlockGraph::BlockMap::iterator block_it =
-      block_graph_->blocks_mutable().begin();
-  BlockGraph::BlockMap::iterator block_end =
-      block_graph_->blocks_mutable().end();
-  for (size_t i = 0; block_it != block_end; ++block_it, ++i) {
-    DCHECK_LT(i, block_infos_.size());
-    // Get the SectionInfo for the section containing the block.
-    BlockGraph::SectionId section_id = block_it->second.section();
-    const Section* section = block_graph_->GetSectionById(section_id);
-    SectionInfo* section_info = GetSectionInfo(section);
-    DCHECK(section_info != NULL);
-
-    Block* block = &block_it->second;
-
-    OrderedSection* ordered_section = &section_info->ordered_section;
-    block_infos_[i].ordered_section = ordered_section;
-    block_infos_[i].it = ordered_section->ordered_blocks_.insert(
-        ordered_section->ordered_blocks_.end(), block);
-  }
-
-  // Sort the BlockInfos so that we can use GetBlockInfo.
-  std::sort(block_infos_.begin(), block_infos_.end(), CompareBlockInfo());
+  // The BlockLists are built lazily by MaterializeSection.
 }
 
 const OrderedBlockGraph::OrderedSection& OrderedBlockGraph::ordered_section(
@@ -226,6 +192,7 @@ void OrderedBlockGraph::PlaceAtHead(const Section* section,
   DCHECK(section_info != NULL);
   DCHECK(block_info != NULL);
 
+  MaterializeSection(&section_info->ordered_section);
   BlockList& blocks(section_info->ordered_section.ordered_blocks_);
 
   // Already there? Do nothing!
@@ -252,6 +219,7 @@ void OrderedBlockGraph::PlaceAtTail(const Section* section,
   DCHECK(section_info != NULL);
   DCHECK(block_info != NULL);
 
+  MaterializeSection(&section_info->ordered_section);
   BlockList& blocks(section_info->ordered_section.ordered_blocks_);
 
   // Already there? Do nothing!
@@ -352,14 +320,17 @@ OrderedBlockGraph::SectionInfo* OrderedBlockGraph::GetSectionInfo(
 
 const OrderedBlockGraph::BlockInfo* OrderedBlockGraph::GetBlockInfo(
     const Block* block) const {
-  std::vector<BlockInfo>::const_iterator it =
-      std::lower_bound(block_infos_.begin(),
-                       block_infos_.end(),
-                       block,
-                       CompareBlockInfo());
+  DCHECK(block != NULL);
+
+  // The block only has an entry once the list of its section has been built.
+  const Section* section = block_graph_->GetSectionById(block->section());
+  MaterializeSection(&GetSectionInfo(section)->ordered_section);
+
+  std::unordered_map<const Block*, BlockInfo>::const_iterator it =
+      block_infos_.find(block);
   DCHECK(it != block_infos_.end());
-  DCHECK_EQ(block, *(it->it));
-  return &(*it);
+  DCHECK_EQ(block, *(it->second.it));
+  return &it->second;
 }
 
 OrderedBlockGraph::BlockInfo* OrderedBlockGraph::GetBlockInfo(
@@ -378,10 +349,52 @@ void OrderedBlockGraph::RebuildSectionIndex() {
   }
 }
 
+void OrderedBlockGraph::MaterializeSection(
+    const OrderedSection* ordered_section) const {
+  DCHECK(ordered_section != NULL);
+  DCHECK_EQ(this, ordered_section->owner_);
+  if (ordered_section->materialized_)
+    return;
+  ordered_section->materialized_ = true;
+
+  // Iterate through the blocks and place those belonging to this section into
+  // its BlockList, in the order of their block graph ID. Moving a block always
+  // materializes both of the sections involved, so none of these blocks can
+  // have been listed already.
+  OrderedSection* section = const_cast<OrderedSection*>(ordered_section);
+  BlockGraph::SectionId section_id = section->id();
+  BlockGraph::BlockMap::iterator block_it =
+      block_graph_->blocks_mutable().begin();
+  BlockGraph::BlockMap::iterator block_end =
+      block_graph_->blocks_mutable().end();
+  for (; block_it != block_end; ++block_it) {
+    Block* block = &block_it->second;
+    if (section->section_ == NULL) {
+      // The catch all section gets the blocks whose section doesn't exist.
+      if (block_graph_->GetSectionById(block->section()) != NULL)
+        continue;
+    } else if (block->section() != section_id) {
+      continue;
+    }
+
+    BlockInfo& block_info = block_infos_[block];
+    DCHECK(block_info.ordered_section == NULL);
+    block_info.ordered_section = section;
+    block_info.it = section->ordered_blocks_.insert(
+        section->ordered_blocks_.end(), block);
+  }
+}
+
 BlockGraph::SectionId OrderedBlockGraph::OrderedSection::id() const {
   if (section_ == NULL)
     return BlockGraph::kInvalidSectionId;
   return section_->id();
 }
 
+const OrderedBlockGraph::BlockList&
+OrderedBlockGraph::OrderedSection::ordered_blocks() const {
+  owner_->MaterializeSection(this);
+  return ordered_blocks_;
+}
+
 }  // namespace block_graph
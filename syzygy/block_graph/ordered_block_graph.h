@@ -57,6 +57,7 @@
 #define SYZYGY_BLOCK_GRAPH_ORDERED_BLOCK_GRAPH_H_
 
 #include <list>
+#include <unordered_map>
 #include <vector>
 
 #include "syzygy/block_graph/block_graph.h"
@@ -71,6 +72,10 @@ namespace block_graph {
 //   ensure consistency.
 // - It is invalid to add or delete blocks from a BlockGraph while it is being
 //   referenced by an OrderedBlockGraph. This can cause NULL dereferences.
+// - The block list of a section is only built when it is first accessed, or
+//   when one of its blocks is first moved. Building it walks the blocks of the
+//   BlockGraph once, but only allocates for the blocks of that section. Thus
+//   ordering a single section of a large BlockGraph is cheap.
 class OrderedBlockGraph {
  public:
   class OrderedSection;
@@ -216,7 +221,6 @@ class OrderedBlockGraph {
   struct SectionInfo;
   struct BlockInfo;
   struct CompareSectionInfo;
-  struct CompareBlockInfo;
 
   // @{
   // @returns the SectionInfo representing the given Section*.
@@ -233,6 +237,10 @@ class OrderedBlockGraph {
   // Rebuilds the section iterator index.
   void RebuildSectionIndex();
 
+  // Builds the block list of a section if it hasn't been built yet.
+  // @param ordered_section the section whose blocks are to be listed.
+  void MaterializeSection(const OrderedSection* ordered_section) const;
+
   // The block graph on which we impose an order.
   BlockGraph* block_graph_;
 
@@ -242,12 +250,10 @@ class OrderedBlockGraph {
   // underlying Section* so that we can quickly map from a Section* to the
   // OrderedSection and its entry in the SectionList.
   std::vector<SectionInfo> section_infos_;
-  // Stores a full set of iterators pointing to all of the blocks in the various
-  // OrderedSection BlockLists. This is allocated once and reused. The entries
-  // are sorted based on the block pointers referred to by the iterators. In
-  // this way we can do a fast lookup from Block* to the BlockList containing
-  // it, as well as the iterator to it.
-  std::vector<BlockInfo> block_infos_;
+  // Stores iterators pointing to all of the blocks in the OrderedSection
+  // BlockLists that have been built so far. In this way we can do a fast lookup
+  // from Block* to the BlockList containing it, as well as the iterator to it.
+  mutable std::unordered_map<const Block*, BlockInfo> block_infos_;
 
   DISALLOW_COPY_AND_ASSIGN(OrderedBlockGraph);
 };
@@ -265,15 +271,19 @@ class OrderedBlockGraph::OrderedSection {
   BlockGraph::SectionId id() const;
 
   // @returns the ordered list of blocks belonging to this section.
-  const BlockList& ordered_blocks() const { return ordered_blocks_; }
+  const BlockList& ordered_blocks() const;
 
  private:
   friend OrderedBlockGraph;
 
+  // The ordered block graph owning this section.
+  const OrderedBlockGraph* owner_;
   // The section itself.
   Section* section_;
+  // True once the blocks belonging to this section have been listed.
+  mutable bool materialized_;
   // The blocks belonging to this section, in order.
-  BlockList ordered_blocks_;
+  mutable BlockList ordered_blocks_;
 };
 
 }  // namespace block_graph
@@ -18,7 +18,6 @@
 #ifndef SYZYGY_BLOCK_GRAPH_ORDERED_BLOCK_GRAPH_INTERNAL_H_
 #define SYZYGY_BLOCK_GRAPH_ORDERED_BLOCK_GRAPH_INTERNAL_H_
 
-#include <utility>
 #include <vector>
 
 namespace block_graph {
@@ -40,6 +39,8 @@ struct OrderedBlockGraph::BlockInfo {
   BlockList::iterator it;
   // The ordered section owning the list to which the iterator belongs.
   OrderedSection* ordered_section;
+
+  BlockInfo() : ordered_section(NULL) { }
 };
 
 namespace internal {
@@ -121,44 +122,23 @@ void OrderedBlockGraph::Sort(const Section* section,
   SectionInfo* section_info = GetSectionInfo(section);
   DCHECK(section_info != NULL);
 
-  // Build an index which can be used to find the BlockInfo index from a
-  // Block*.
-  typedef std::vector<std::pair<Block*, size_t>> ReverseIndex;
-  ReverseIndex rindex;
+  MaterializeSection(&section_info->ordered_section);
   BlockList& blocks(section_info->ordered_section.ordered_blocks_);
-  rindex.reserve(blocks.size());
-  BlockList::iterator it = blocks.begin();
-  for (; it != blocks.end(); ++it) {
-    Block* block = *it;
-    DCHECK(block != NULL);
-
-    BlockInfo* block_info = GetBlockInfo(block);
-    DCHECK(block_info != NULL);
-
-    size_t index = block_info - &block_infos_[0];
-    rindex.push_back(std::make_pair(block, index));
-  }
-  // Sort this based on Block*, which std::pair does for us by default.
-  std::sort(rindex.begin(), rindex.end());
 
   typedef internal::BlockListSortAdapter<BlockCompareFunctor> Adapter;
   internal::SortList(Adapter(block_compare_functor),
-                     rindex.size(),
+                     blocks.size(),
                      &blocks);
 
-  // Rebuild the block index using the index to find the affected BlockInfo
-  // entries.
-  for (it = blocks.begin(); it != blocks.end(); ++it) {
+  // Rebuild the block index of the affected BlockInfo entries.
+  BlockList::iterator it = blocks.begin();
+  for (; it != blocks.end(); ++it) {
     Block* block = *it;
     DCHECK(block != NULL);
 
-    ReverseIndex::const_iterator rindex_it = std::lower_bound(
-        rindex.begin(), rindex.end(),
-        std::make_pair(block, static_cast<size_t>(0)));
-    DCHECK(rindex_it != rindex.end());
-    DCHECK_EQ(rindex_it->first, block);
-
-    block_infos_[rindex_it->second].it = it;
+    BlockInfo* block_info = GetBlockInfo(block);
+    DCHECK(block_info != NULL);
+    block_info->it = it;
   }
 }
 
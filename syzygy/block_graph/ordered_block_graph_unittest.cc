@@ -91,6 +91,8 @@ class TestOrderedBlockGraph : public OrderedBlockGraph {
 
     return true;
   }
+
+  size_t listed_block_count() const { return block_infos_.size(); }
 };
 
 class OrderedBlockGraphTest : public testing::Test {
@@ -156,6 +158,25 @@ TEST_F(OrderedBlockGraphTest, CreateNonEmpty) {
   EXPECT_TRUE(ordered.IndicesAreValid());
 }
 
+TEST_F(OrderedBlockGraphTest, ListsBlocksLazily) {
+  InitBlockGraph(3, 3, 3);
+  TestOrderedBlockGraph ordered(&block_graph_);
+  EXPECT_EQ(0u, ordered.listed_block_count());
+
+  // Only the sections that are looked at get their blocks listed.
+  EXPECT_SECTION_CONTAINS(ordered, 1, 4, 5, 6);
+  EXPECT_EQ(3u, ordered.listed_block_count());
+
+  // Moving a block lists both of its sections.
+  BlockGraph::Section* section2 = block_graph_.GetSectionById(2);
+  ordered.PlaceAtTail(section2, block_graph_.GetBlockById(1));
+  EXPECT_EQ(9u, ordered.listed_block_count());
+  EXPECT_SECTION_CONTAINS(ordered, 0, 2, 3);
+  EXPECT_SECTION_CONTAINS(ordered, 2, 7, 8, 9, 1);
+  EXPECT_EQ(9u, ordered.listed_block_count());
+  EXPECT_TRUE(ordered.IndicesAreValid());
+}
+
 TEST_F(OrderedBlockGraphTest, SectionPlaceAtHead) {
   InitBlockGraph(3, 0, 0);
   TestOrderedBlockGraph ordered(&block_graph_);
@@ -14,12 +14,92 @@
 
 #include "syzygy/block_graph/transform.h"
 
+#include <algorithm>
+
+#include "base/bind.h"
+#include "syzygy/application/work_pool.h"
 #include "syzygy/block_graph/basic_block_decomposer.h"
 #include "syzygy/block_graph/block_builder.h"
 #include "syzygy/block_graph/block_util.h"
 
 namespace block_graph {
 
+namespace {
+
+// The number of blocks per thread in a batch of a parallel transform.
+const size_t kBlocksPerThreadPerBatch = 64;
+
+// The result of decomposing and transforming a block on a worker thread.
+struct ParallelTransformResult {
+  enum Status {
+    kFailed,
+    kUnsupportedInstructions,
+    kTransformed,
+  };
+
+  ParallelTransformResult() : status(kFailed) { }
+
+  Status status;
+  std::unique_ptr<BasicBlockSubGraph> subgraph;
+};
+
+// Decomposes and transforms the blocks of a batch, as the work items of a
+// WorkPool.
+class ParallelTransformWorker {
+ public:
+  ParallelTransformWorker(
+      BasicBlockSubGraphTransformFactoryInterface* factory,
+      const TransformPolicyInterface* policy,
+      BlockGraph* block_graph,
+      BlockVector::const_iterator blocks,
+      std::vector<ParallelTransformResult>* results)
+      : factory_(factory), policy_(policy), block_graph_(block_graph),
+        blocks_(blocks), results_(results) {
+  }
+
+  // Decomposes and transforms a block. The failures are recorded in the
+  // result of the block, so this always succeeds.
+  // @param index the index of the block in the batch.
+  // @returns true.
+  bool TransformBlock(size_t index) {
+    BlockGraph::Block* block = blocks_[index];
+    ParallelTransformResult* result = &results_->at(index);
+    DCHECK_NE(static_cast<BlockGraph::Block*>(nullptr), block);
+
+    result->subgraph.reset(new BasicBlockSubGraph());
+    BasicBlockDecomposer bb_decomposer(block, result->subgraph.get());
+    if (!bb_decomposer.Decompose()) {
+      result->subgraph.reset();
+      if (bb_decomposer.contains_unsupported_instructions())
+        result->status = ParallelTransformResult::kUnsupportedInstructions;
+      return true;
+    }
+
+    std::unique_ptr<BasicBlockSubGraphTransformInterface> transform(
+        factory_->CreateTransform(block));
+    if (transform.get() == nullptr ||
+        !transform->TransformBasicBlockSubGraph(policy_, block_graph_,
+                                                result->subgraph.get())) {
+      result->subgraph.reset();
+      return true;
+    }
+
+    result->status = ParallelTransformResult::kTransformed;
+    return true;
+  }
+
+ private:
+  BasicBlockSubGraphTransformFactoryInterface* factory_;
+  const TransformPolicyInterface* policy_;
+  BlockGraph* block_graph_;
+  BlockVector::const_iterator blocks_;
+  std::vector<ParallelTransformResult>* results_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParallelTransformWorker);
+};
+
+}  // namespace
+
 bool ApplyImageLayoutTransform(
     ImageLayoutTransformInterface* transform,
     const TransformPolicyInterface* policy,
@@ -191,6 +271,64 @@ bool ApplyBasicBlockSubGraphTransform(
   return true;
 }
 
+bool ApplyBasicBlockSubGraphTransformInParallel(
+    BasicBlockSubGraphTransformFactoryInterface* factory,
+    const TransformPolicyInterface* policy,
+    size_t thread_count,
+    BlockGraph* block_graph,
+    const BlockVector& blocks) {
+  DCHECK_NE(static_cast<BasicBlockSubGraphTransformFactoryInterface*>(nullptr),
+            factory);
+  DCHECK_NE(static_cast<TransformPolicyInterface*>(nullptr), policy);
+  DCHECK_LT(0u, thread_count);
+  DCHECK_NE(static_cast<BlockGraph*>(nullptr), block_graph);
+
+  size_t batch_size = thread_count * kBlocksPerThreadPerBatch;
+  for (size_t begin = 0; begin < blocks.size(); begin += batch_size) {
+    size_t end = std::min(begin + batch_size, blocks.size());
+    std::vector<ParallelTransformResult> results(end - begin);
+
+    // Decompose and transform the blocks of the batch on the workers. The
+    // block-graph is only read while they run.
+    ParallelTransformWorker worker(factory, policy, block_graph,
+                                   blocks.begin() + begin, &results);
+    application::WorkPool pool(thread_count);
+    if (!pool.Run(results.size(),
+                  base::Bind(&ParallelTransformWorker::TransformBlock,
+                             base::Unretained(&worker)))) {
+      LOG(ERROR) << "Failed to run the parallel transform workers.";
+      return false;
+    }
+
+    // Merge the subgraphs back in order, this modifies the block-graph.
+    for (size_t i = 0; i < results.size(); ++i) {
+      BlockGraph::Block* block = blocks[begin + i];
+      switch (results[i].status) {
+        case ParallelTransformResult::kFailed:
+          LOG(ERROR) << "Failed to transform block: " << BlockInfo(block);
+          return false;
+
+        case ParallelTransformResult::kUnsupportedInstructions:
+          VLOG(1) << "Block contains unsupported instruction(s): "
+                  << BlockInfo(block);
+          block->set_attribute(BlockGraph::UNSUPPORTED_INSTRUCTIONS);
+          break;
+
+        case ParallelTransformResult::kTransformed: {
+          BlockBuilder builder(block_graph);
+          if (!builder.Merge(results[i].subgraph.get()))
+            return false;
+          // Release the subgraph as soon as possible to bound memory usage.
+          results[i].subgraph.reset();
+          break;
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
 bool ApplyBasicBlockSubGraphTransforms(
     const std::vector<BasicBlockSubGraphTransformInterface*>& transforms,
     const TransformPolicyInterface* policy,
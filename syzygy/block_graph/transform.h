@@ -17,6 +17,9 @@
 #ifndef SYZYGY_BLOCK_GRAPH_TRANSFORM_H_
 #define SYZYGY_BLOCK_GRAPH_TRANSFORM_H_
 
+#include <memory>
+#include <vector>
+
 #include "syzygy/block_graph/basic_block_subgraph.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/block_graph/ordered_block_graph.h"
@@ -140,6 +143,47 @@ bool ApplyBasicBlockSubGraphTransforms(
     BlockGraph::Block* block,
     BlockVector* new_blocks);
 
+// Creates the basic-block transforms used by
+// ApplyBasicBlockSubGraphTransformInParallel. Each block gets a transform of
+// its own, so the transforms don't need to be thread-safe. The factory does.
+class BasicBlockSubGraphTransformFactoryInterface {
+ public:
+  virtual ~BasicBlockSubGraphTransformFactoryInterface() { }
+
+  // Creates the transform to apply to a block. This is called concurrently
+  // from the worker threads.
+  //
+  // @param block the block to be transformed.
+  // @returns the transform.
+  virtual std::unique_ptr<BasicBlockSubGraphTransformInterface>
+      CreateTransform(const BlockGraph::Block* block) = 0;
+};
+
+// Applies a BasicBlockSubGraphTransform to a set of blocks, using a pool of
+// worker threads. The blocks are basic-block decomposed and transformed on
+// the workers, which only read the block-graph. The resulting subgraphs are
+// then merged back one at a time on the calling thread, in the order of
+// @p blocks, so that the block-graph ends up the same as if the blocks had
+// been transformed in sequence.
+//
+// The blocks are processed in batches, so that only a bounded number of
+// subgraphs are alive at once.
+//
+// @param factory the factory of the transforms to apply.
+// @param policy The policy object restricting how the transform is applied.
+// @param thread_count the number of worker threads to use.
+// @param block_graph the block-graph containing the blocks to transform.
+// @param blocks the blocks to transform.
+// @pre The blocks must be distinct code blocks that are safe to basic-block
+//     decompose. The transforms must not modify the block-graph.
+// @returns true on success, false otherwise.
+bool ApplyBasicBlockSubGraphTransformInParallel(
+    BasicBlockSubGraphTransformFactoryInterface* factory,
+    const TransformPolicyInterface* policy,
+    size_t thread_count,
+    BlockGraph* block_graph,
+    const BlockVector& blocks);
+
 // An ImageLayoutTransformInterface is a pure virtual base class defining the
 // PE image layout transform API
 class ImageLayoutTransformInterface {
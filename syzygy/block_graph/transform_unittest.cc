@@ -161,8 +161,45 @@ class MockBasicBlockSubGraphTransform :
                     BasicBlockSubGraph*));
 };
 
+// A transform that does nothing and returns a fixed result.
+class FixedResultBasicBlockSubGraphTransform :
+    public BasicBlockSubGraphTransformInterface {
+ public:
+  explicit FixedResultBasicBlockSubGraphTransform(bool result)
+      : result_(result) {
+  }
+
+  virtual const char* name() const {
+    return "FixedResultBasicBlockSubGraphTransform";
+  }
+
+  virtual bool TransformBasicBlockSubGraph(const TransformPolicyInterface*,
+                                           BlockGraph*,
+                                           BasicBlockSubGraph*) {
+    return result_;
+  }
+
+ private:
+  bool result_;
+};
 
-class ApplyImageLayoutTransformTest : public testing::Test {
+class FixedResultBasicBlockSubGraphTransformFactory :
+    public BasicBlockSubGraphTransformFactoryInterface {
+ public:
+  explicit FixedResultBasicBlockSubGraphTransformFactory(bool result)
+      : result_(result) {
+  }
+
+  virtual std::unique_ptr<BasicBlockSubGraphTransformInterface>
+      CreateTransform(const BlockGraph::Block* block) {
+    return std::unique_ptr<BasicBlockSubGraphTransformInterface>(
+        new FixedResultBasicBlockSubGraphTransform(result_));
+  }
+
+ private:
+  bool result_;
+};
+ : public testing::Test {
 public:
   virtual void SetUp() {
     BlockGraph block_graph_;
@@ -335,6 +372,58 @@ TEST_F(ApplyBasicBlockSubGraphTransformTest, VectorTransformSucceeds) {
                                                 &new_blocks));
 }
 
+TEST_F(ApplyBasicBlockSubGraphTransformTest, ParallelTransformFails) {
+  BlockGraph::BlockId code_block_id = code_block_->id();
+
+  FixedResultBasicBlockSubGraphTransformFactory factory(false);
+  BlockVector blocks(1, code_block_);
+  EXPECT_FALSE(ApplyBasicBlockSubGraphTransformInParallel(
+      &factory, &policy_, 4, &block_graph_, blocks));
+
+  // The original block graph should be unchanged.
+  EXPECT_EQ(2U, block_graph_.blocks().size());
+  EXPECT_EQ(code_block_, block_graph_.GetBlockById(code_block_id));
+}
+
+TEST_F(ApplyBasicBlockSubGraphTransformTest, ParallelTransformSucceeds) {
+  // Add more code blocks, so that there's something to spread over the
+  // threads.
+  BlockVector blocks(1, code_block_);
+  for (size_t i = 0; i < 15; ++i) {
+    BlockGraph::Block* block = block_graph_.AddBlock(
+        BlockGraph::CODE_BLOCK, sizeof(kCodeBytes), "Code");
+    ASSERT_NE(static_cast<BlockGraph::Block*>(nullptr), block);
+    ASSERT_TRUE(block->SetLabel(
+        kOffsetOfCode, BlockGraph::Label("Code", BlockGraph::CODE_LABEL)));
+    block->SetData(kCodeBytes, sizeof(kCodeBytes));
+    ASSERT_TRUE(block->SetReference(kOffsetOfReferenceToData,
+                                    MakeReference(data_block_,
+                                                  kOffsetOfData)));
+    blocks.push_back(block);
+  }
+  std::vector<BlockGraph::BlockId> block_ids;
+  for (auto block : blocks)
+    block_ids.push_back(block->id());
+
+  FixedResultBasicBlockSubGraphTransformFactory factory(true);
+  EXPECT_TRUE(ApplyBasicBlockSubGraphTransformInParallel(
+      &factory, &policy_, 4, &block_graph_, blocks));
+  code_block_ = NULL;
+
+  // All the code blocks should have been replaced with equivalent ones.
+  EXPECT_EQ(blocks.size() + 1, block_graph_.blocks().size());
+  for (auto block_id : block_ids)
+    EXPECT_EQ(NULL, block_graph_.GetBlockById(block_id));
+
+  // The data block should refer to the block replacing the original code
+  // block.
+  BlockGraph::Reference ref;
+  ASSERT_TRUE(data_block_->GetReference(kOffsetOfReferenceToCode, &ref));
+  EXPECT_EQ(BlockGraph::CODE_BLOCK, ref.referenced()->type());
+  EXPECT_TRUE(ref.referenced()->GetReference(kOffsetOfReferenceToData, &ref));
+  EXPECT_EQ(data_block_, ref.referenced());
+}
+
 TEST_F(ApplyImageLayoutTransformTest, NormalTransformSucceeds) {
   MockImageLayoutTransform transform;
   EXPECT_CALL(transform, TransformImageLayout(_, _, _)).Times(1).
@@ -93,16 +93,16 @@ struct FloatParser {
 };
 typedef UpdateValueFromCommandLine<FloatParser> UpdateFloatFromCommandLine;
 
-// Try to update the value of an array of ignored stack ids from a command-line.
+// Try to update the value of an array of stack ids from a command-line.
 // We expect the values to be in hexadecimal format and separated by a
 // semi-colon.
 // @param cmd_line The command line to parse.
 // @param param_name The parameter that we want to read.
 // @param values Will receive the set of parsed values.
 // @returns true on success, false otherwise.
-bool ReadIgnoredStackIdsFromCommandLine(const base::CommandLine& cmd_line,
-                                        const std::string& param_name,
-                                        std::set<AsanStackId>* values) {
+bool ReadStackIdsFromCommandLine(const base::CommandLine& cmd_line,
+                                 const std::string& param_name,
+                                 std::set<AsanStackId>* values) {
   DCHECK(values != NULL);
   if (!cmd_line.HasSwitch(param_name))
     return true;
@@ -141,6 +141,7 @@ const float kDefaultAllocationGuardRate = 1.0;
 // Default values of StackCaptureCache parameters.
 const uint32_t kDefaultReportingPeriod = 0;
 const uint32_t kDefaultBottomFramesToSkip = 0;
+const bool kDefaultCompressStackCaptures = false;
 
 // Default values of StackCapture parameters.
 // From http://msdn.microsoft.com/en-us/library/bb204633.aspx,
@@ -154,6 +155,13 @@ const bool kDefaultCheckHeapOnFailure = true;
 const bool kDefaultDisableBreakpadReporting = false;
 const bool kDefaultFeatureRandomization = false;
 const bool kDefaultReportInvalidAccesses = false;
+const bool kDefaultSparseShadow = false;
+const bool kDefaultSampleLargeBlockChecksums = false;
+const bool kDefaultDeduplicateErrorReports = false;
+const bool kDefaultUseLogBuffer = false;
+const bool kDefaultDeferredStartup = false;
+const float kDefaultHotPatchingActivationRate = 1.0f;
+const uint32_t kDefaultMaxHotPatchedBlocks = 0;
 
 // Default values of AsanLogger parameters.
 const bool kDefaultMiniDumpOnFailure = false;
@@ -162,6 +170,7 @@ const bool kDefaultLogAsText = true;
 // Default values of ZebraBlockHeap parameters.
 const uint32_t kDefaultZebraBlockHeapSize = 16 * 1024 * 1024;
 const float kDefaultZebraBlockHeapQuarantineRatio = 0.25f;
+const bool kDefaultZebraBlockHeapMultiStripe = false;
 
 // Default values of the BlockHeapManager parameters.
 const bool kDefaultEnableRateTargetedHeaps = true;
@@ -169,6 +178,14 @@ const bool kDefaultEnableZebraBlockHeap = false;
 const bool kDefaultEnableAllocationFilter = false;
 const float kDefaultQuarantineFloodFillRate = 0.5f;
 const bool kDefaultPreventDuplicateCorruptionCrashes = false;
+const bool kDefaultThreadBlockCache = false;
+const bool kDefaultDecommitQuarantinedPages = false;
+const bool kDefaultDeferQuarantineFloodFill = false;
+const uint32_t kDefaultHeapProfileSamplingInterval = 0;
+const uint32_t kDefaultAllocStackCapturePeriod = 1;
+const uint32_t kDefaultHeapPartitionCount = 0;
+const uint32_t kDefaultAllocationGuardSiteThreshold = 0;
+const uint32_t kDefaultAllocationGuardSeed = 0;
 
 // Default values of LargeBlockHeap parameters.
 extern const bool kDefaultEnableLargeBlockHeap = true;
@@ -176,6 +193,7 @@ extern const bool kDefaultEnableLargeBlockHeap = true;
 // our historic average for Chrome. Overhead in this heap is 2 pages, so want
 // 2 / 0.45 = 4.44 < 5 page minimum.
 extern const size_t kDefaultLargeAllocationThreshold = 5 * 4096;
+const bool kDefaultLargeBlockHeapPooling = false;
 
 const char kSyzyAsanOptionsEnvVar[] = "SYZYGY_ASAN_OPTIONS";
 
@@ -188,6 +206,7 @@ extern const char kParamAllocationGuardRate[] = "allocation_guard_rate";
 // String names of StackCaptureCache parameters.
 const char kParamReportingPeriod[] = "compression_reporting_period";
 const char kParamBottomFramesToSkip[] = "bottom_frames_to_skip";
+const char kParamCompressStackCaptures[] = "compress_stack_captures";
 
 // String names of StackCapture parameters.
 const char kParamMaxNumFrames[] = "max_num_frames";
@@ -199,6 +218,13 @@ const char kParamNoCheckHeapOnFailure[] = "no_check_heap_on_failure";
 const char kParamDisableBreakpadReporting[]  = "disable_breakpad";
 const char kParamFeatureRandomization[] = "feature_randomization";
 const char kParamReportInvalidAccesses[] = "report_invalid_accesses";
+const char kParamSparseShadow[] = "sparse_shadow";
+const char kParamSampleLargeBlockChecksums[] = "sample_large_block_checksums";
+const char kParamDeduplicateErrorReports[] = "deduplicate_error_reports";
+const char kParamUseLogBuffer[] = "use_log_buffer";
+const char kParamDeferredStartup[] = "deferred_startup";
+const char kParamHotPatchingActivationRate[] = "hot_patching_activation_rate";
+const char kParamMaxHotPatchedBlocks[] = "max_hot_patched_blocks";
 
 // String names of AsanLogger parameters.
 const char kParamMiniDumpOnFailure[] = "minidump_on_failure";
@@ -208,18 +234,31 @@ const char kParamNoLogAsText[] = "no_log_as_text";
 const char kParamZebraBlockHeapSize[] = "zebra_block_heap_size";
 const char kParamZebraBlockHeapQuarantineRatio[] =
     "zebra_block_heap_quarantine_ratio";
+const char kParamZebraBlockHeapMultiStripe[] = "zebra_block_heap_multi_stripe";
 
 // String names of BlockHeapManager parameters.
 const char kParamDisableCtMalloc[] = "disable_ctmalloc";
 const char kParamEnableZebraBlockHeap[] = "enable_zebra_block_heap";
 const char kParamEnableAllocationFilter[] = "enable_allocation_filter";
+const char kParamAllocationFilterStackIds[] = "allocation_filter_stack_ids";
 const char kParamQuarantineFloodFillRate[] = "quarantine_flood_fill_rate";
 const char kParamPreventDuplicateCorruptionCrashes[] =
     "prevent_duplicate_corruption_crashes";
+const char kParamThreadBlockCache[] = "thread_block_cache";
+const char kParamDecommitQuarantinedPages[] = "decommit_quarantined_pages";
+const char kParamDeferQuarantineFloodFill[] = "defer_quarantine_flood_fill";
+const char kParamHeapProfileSamplingInterval[] =
+    "heap_profile_sampling_interval";
+const char kParamAllocStackCapturePeriod[] = "alloc_stack_capture_period";
+const char kParamHeapPartitionCount[] = "heap_partition_count";
+const char kParamAllocationGuardSiteThreshold[] =
+    "allocation_guard_site_threshold";
+const char kParamAllocationGuardSeed[] = "allocation_guard_seed";
 
 // String names of LargeBlockHeap parameters.
 const char kParamDisableLargeBlockHeap[] = "disable_large_block_heap";
 const char kParamLargeAllocationThreshold[] = "large_allocation_threshold";
+const char kParamLargeBlockHeapPooling[] = "large_block_heap_pooling";
 
 InflatedAsanParameters::InflatedAsanParameters() {
   // Clear the AsanParameters portion of ourselves.
@@ -228,6 +267,11 @@ InflatedAsanParameters::InflatedAsanParameters() {
 
 FlatAsanParameters::FlatAsanParameters(
     const InflatedAsanParameters& asan_parameters) {
+  if (!asan_parameters.allocation_filter_stack_ids_set.empty()) {
+    LOG(WARNING) << "Ignoring " << kParamAllocationFilterStackIds
+                 << ", it can only be specified at runtime.";
+  }
+
   bool have_ignored_stack_ids = !asan_parameters.ignored_stack_ids_set.empty();
 
   size_t struct_size = sizeof(AsanParameters);
@@ -300,16 +344,43 @@ void SetDefaultAsanParameters(AsanParameters* asan_parameters) {
   asan_parameters->feature_randomization = kDefaultFeatureRandomization;
   asan_parameters->quarantine_flood_fill_rate =
       kDefaultQuarantineFloodFillRate;
+  asan_parameters->heap_profile_sampling_interval =
+      kDefaultHeapProfileSamplingInterval;
+  asan_parameters->alloc_stack_capture_period =
+      kDefaultAllocStackCapturePeriod;
+  asan_parameters->heap_partition_count = kDefaultHeapPartitionCount;
+  asan_parameters->allocation_guard_site_threshold =
+      kDefaultAllocationGuardSiteThreshold;
+  asan_parameters->allocation_guard_seed = kDefaultAllocationGuardSeed;
   asan_parameters->prevent_duplicate_corruption_crashes =
       kDefaultPreventDuplicateCorruptionCrashes;
   asan_parameters->report_invalid_accesses = kDefaultReportInvalidAccesses;
+  asan_parameters->compress_stack_captures = kDefaultCompressStackCaptures;
+  asan_parameters->sparse_shadow = kDefaultSparseShadow;
+  asan_parameters->thread_block_cache = kDefaultThreadBlockCache;
+  asan_parameters->zebra_block_heap_multi_stripe =
+      kDefaultZebraBlockHeapMultiStripe;
+  asan_parameters->large_block_heap_pooling = kDefaultLargeBlockHeapPooling;
+  asan_parameters->sample_large_block_checksums =
+      kDefaultSampleLargeBlockChecksums;
+  asan_parameters->deduplicate_error_reports = kDefaultDeduplicateErrorReports;
+  asan_parameters->use_log_buffer = kDefaultUseLogBuffer;
+  asan_parameters->deferred_startup = kDefaultDeferredStartup;
+  asan_parameters->decommit_quarantined_pages =
+      kDefaultDecommitQuarantinedPages;
+  asan_parameters->defer_quarantine_flood_fill =
+      kDefaultDeferQuarantineFloodFill;
+  asan_parameters->hot_patching_activation_rate =
+      kDefaultHotPatchingActivationRate;
+  asan_parameters->max_hot_patched_blocks = kDefaultMaxHotPatchedBlocks;
 }
 
 bool InflateAsanParameters(const AsanParameters* pod_params,
                            InflatedAsanParameters* inflated_params) {
   // This must be kept up to date with AsanParameters as it evolves.
   static const size_t kSizeOfAsanParametersByVersion[] = {
-      40, 44, 48, 52, 52, 52, 56, 56, 56, 56, 60, 60, 60, 60, 60};
+      40, 44, 48, 52, 52, 52, 56, 56, 56, 56, 60, 60, 60, 60, 60, 60, 60, 60,
+      60, 60, 60, 64, 68, 68, 68, 76, 76, 80, 80, 80, 88};
   static_assert(
       arraysize(kSizeOfAsanParametersByVersion) == kAsanParametersVersion + 1,
       "Size of parameters version out of date.");
@@ -438,6 +509,15 @@ bool ParseAsanParameters(const base::StringPiece16& param_string,
     return false;
   }
 
+  // Parse the per-site allocation guard parameters.
+  if (UpdateUint32FromCommandLine::Do(cmd_line,
+          kParamAllocationGuardSiteThreshold,
+          &asan_parameters->allocation_guard_site_threshold) == kFlagError ||
+      UpdateUint32FromCommandLine::Do(cmd_line, kParamAllocationGuardSeed,
+          &asan_parameters->allocation_guard_seed) == kFlagError) {
+    return false;
+  }
+
   // Parse the reporting period flag.
   if (UpdateUint32FromCommandLine::Do(cmd_line, kParamReportingPeriod,
           &asan_parameters->reporting_period) == kFlagError) {
@@ -457,11 +537,17 @@ bool ParseAsanParameters(const base::StringPiece16& param_string,
   }
 
   // Parse the ignored stack ids.
-  if (!ReadIgnoredStackIdsFromCommandLine(cmd_line, kParamIgnoredStackIds,
+  if (!ReadStackIdsFromCommandLine(cmd_line, kParamIgnoredStackIds,
            &asan_parameters->ignored_stack_ids_set)) {
     return false;
   }
 
+  // Parse the stack ids that get through the allocation filter.
+  if (!ReadStackIdsFromCommandLine(cmd_line, kParamAllocationFilterStackIds,
+           &asan_parameters->allocation_filter_stack_ids_set)) {
+    return false;
+  }
+
   // Parse the zebra block heap size flag.
   if (UpdateUint32FromCommandLine::Do(cmd_line, kParamZebraBlockHeapSize,
           &asan_parameters->zebra_block_heap_size) == kFlagError) {
@@ -489,6 +575,37 @@ bool ParseAsanParameters(const base::StringPiece16& param_string,
     return false;
   }
 
+  // Parse the heap profile sampling interval.
+  if (UpdateUint32FromCommandLine::Do(cmd_line,
+          kParamHeapProfileSamplingInterval,
+          &asan_parameters->heap_profile_sampling_interval) == kFlagError) {
+    return false;
+  }
+
+  // Parse the allocation stack capture period.
+  if (UpdateUint32FromCommandLine::Do(cmd_line, kParamAllocStackCapturePeriod,
+          &asan_parameters->alloc_stack_capture_period) == kFlagError) {
+    return false;
+  }
+
+  // Parse the number of heap partitions.
+  if (UpdateUint32FromCommandLine::Do(cmd_line, kParamHeapPartitionCount,
+          &asan_parameters->heap_partition_count) == kFlagError) {
+    return false;
+  }
+
+  // Parse the hot patching activation rate.
+  if (UpdateFloatFromCommandLine::Do(cmd_line, kParamHotPatchingActivationRate,
+          &asan_parameters->hot_patching_activation_rate) == kFlagError) {
+    return false;
+  }
+
+  // Parse the maximum number of hot patched blocks.
+  if (UpdateUint32FromCommandLine::Do(cmd_line, kParamMaxHotPatchedBlocks,
+          &asan_parameters->max_hot_patched_blocks) == kFlagError) {
+    return false;
+  }
+
   // Parse the other (boolean) flags.
   // TODO(chrisha): Transition these all to new style flags.
   if (cmd_line.HasSwitch(kParamMiniDumpOnFailure))
@@ -520,6 +637,28 @@ bool ParseAsanParameters(const base::StringPiece16& param_string,
   bool value = false;
   if (ParseBooleanFlag(kParamFeatureRandomization, cmd_line, &value))
     asan_parameters->feature_randomization = value;
+  if (ParseBooleanFlag(kParamCompressStackCaptures, cmd_line, &value))
+    asan_parameters->compress_stack_captures = value;
+  if (ParseBooleanFlag(kParamSparseShadow, cmd_line, &value))
+    asan_parameters->sparse_shadow = value;
+  if (ParseBooleanFlag(kParamThreadBlockCache, cmd_line, &value))
+    asan_parameters->thread_block_cache = value;
+  if (ParseBooleanFlag(kParamZebraBlockHeapMultiStripe, cmd_line, &value))
+    asan_parameters->zebra_block_heap_multi_stripe = value;
+  if (ParseBooleanFlag(kParamLargeBlockHeapPooling, cmd_line, &value))
+    asan_parameters->large_block_heap_pooling = value;
+  if (ParseBooleanFlag(kParamSampleLargeBlockChecksums, cmd_line, &value))
+    asan_parameters->sample_large_block_checksums = value;
+  if (ParseBooleanFlag(kParamDeduplicateErrorReports, cmd_line, &value))
+    asan_parameters->deduplicate_error_reports = value;
+  if (ParseBooleanFlag(kParamUseLogBuffer, cmd_line, &value))
+    asan_parameters->use_log_buffer = value;
+  if (ParseBooleanFlag(kParamDecommitQuarantinedPages, cmd_line, &value))
+    asan_parameters->decommit_quarantined_pages = value;
+  if (ParseBooleanFlag(kParamDeferredStartup, cmd_line, &value))
+    asan_parameters->deferred_startup = value;
+  if (ParseBooleanFlag(kParamDeferQuarantineFloodFill, cmd_line, &value))
+    asan_parameters->defer_quarantine_flood_fill = value;
 
   return true;
 }
@@ -36,7 +36,7 @@ namespace common {
 // the StackCaptureCache.
 typedef uint32_t AsanStackId;
 
-static const size_t kAsanParametersReserved1Bits = 20;
+static const size_t kAsanParametersReserved1Bits = 9;
 
 // This data structure is injected into an instrumented image in a read-only
 // section. It is initialized by the instrumenter, and will be looked up at
@@ -116,6 +116,45 @@ struct AsanParameters {
       unsigned prevent_duplicate_corruption_crashes : 1;
       // Runtime: Indicates if the invalid accesses should be reported.
       unsigned report_invalid_accesses : 1;
+      // StackCaptureCache: If true then saved stack traces are stored in a
+      // compressed form, and are only decompressed when reporting an error.
+      unsigned compress_stack_captures : 1;
+      // Runtime: If true then the dynamically allocated shadow memory is only
+      // reserved up front, and is committed lazily as it is used.
+      unsigned sparse_shadow : 1;
+      // BlockHeapManager: If true then blocks leaving the quarantine are kept
+      // in per-thread caches, and are used to serve small allocations.
+      unsigned thread_block_cache : 1;
+      // ZebraBlockHeap: If true the ZebraBlockHeap also uses 4 and 8-page
+      // slabs, so that allocations of up to 7 pages can be served by it.
+      unsigned zebra_block_heap_multi_stripe : 1;
+      // LargeBlockHeap: If true then the reservations released by the
+      // LargeBlockHeap are decommitted and kept in a pool, and are reused for
+      // allocations of the same size.
+      unsigned large_block_heap_pooling : 1;
+      // If true then only a sample of the body of large quarantined blocks is
+      // checksummed, bounding the cost of freeing them at the expense of
+      // missing some corruptions.
+      unsigned sample_large_block_checksums : 1;
+      // AsanRuntime: If true then each distinct error is only reported once.
+      // Its repeats are queued without blocking the faulting threads, and are
+      // logged in batches by a background thread.
+      unsigned deduplicate_error_reports : 1;
+      // If true, the runtime sends its log messages through a buffer shared
+      // with the logger rather than making an RPC for each of them.
+      unsigned use_log_buffer : 1;
+      // BlockHeapManager: If true then the pages spanned by the bodies of
+      // quarantined blocks are decommitted and replaced by demand-zero pages,
+      // so that they no longer use physical memory.
+      unsigned decommit_quarantined_pages : 1;
+      // AsanRuntime: If true then the crash reporter and the registry cache
+      // are set up by a background thread, rather than while the runtime is
+      // loaded. The errors reported in the meantime wait for it.
+      unsigned deferred_startup : 1;
+      // BlockHeapManager: If true then the flood fills of the blocks entering
+      // the quarantine are applied by the deferred free thread, when it is
+      // running, rather than on the freeing thread.
+      unsigned defer_quarantine_flood_fill : 1;
 
       // Add new flags here!
 
@@ -145,27 +184,66 @@ struct AsanParameters {
   // 0.0 corresponds to this being disabled entirely.
   float quarantine_flood_fill_rate;
 
+  // BlockHeapManager: The average number of bytes allocated between two
+  // allocations sampled by the heap profiler. A value of zero disables the
+  // heap profiler.
+  uint32_t heap_profile_sampling_interval;
+
+  // BlockHeapManager: The number of allocations made by a thread for every
+  // allocation whose stack gets captured. The other allocations are
+  // attributed the stack that was last captured by the same thread. A value
+  // of 1 captures the stack of every allocation.
+  uint32_t alloc_stack_capture_period;
+
+  // HotPatchingAsanRuntime: The fraction of the hot patchable blocks that
+  // may get activated in a process, once they are reported as executed.
+  // The blocks are drawn at random in each process, so that a population
+  // of processes covers all of them.
+  float hot_patching_activation_rate;
+
+  // HotPatchingAsanRuntime: The maximum number of blocks that get
+  // activated in a process. A value of 0 means no limit.
+  uint32_t max_hot_patched_blocks;
+
+  // BlockHeapManager: The number of heaps that the allocations made on the
+  // process heap are spread over, according to their allocation stack. A
+  // value of 0 disables the partitioning.
+  uint32_t heap_partition_count;
+
+  // BlockHeapManager: The number of allocations of each allocation site
+  // that are always guarded. The later allocations of a site are guarded at
+  // a rate that decreases as the site keeps allocating, down to
+  // allocation_guard_rate. The sites are identified by their allocation
+  // stack. A value of 0 disables the per-site rates, in which case every
+  // allocation is guarded at allocation_guard_rate.
+  uint32_t allocation_guard_site_threshold;
+
+  // BlockHeapManager: The seed of the per-site guard sampling. The sampled
+  // allocations of a site only depend on the seed and on the order of the
+  // allocations of the site.
+  uint32_t allocation_guard_seed;
+
   // Add new parameters here!
 
   // When laid out in memory the ignored_stack_ids are present here as a NULL
   // terminated vector.
 };
 #ifndef _WIN64
-COMPILE_ASSERT_IS_POD_OF_SIZE(AsanParameters, 60);
+COMPILE_ASSERT_IS_POD_OF_SIZE(AsanParameters, 88);
 #else
-COMPILE_ASSERT_IS_POD_OF_SIZE(AsanParameters, 64);
+COMPILE_ASSERT_IS_POD_OF_SIZE(AsanParameters, 96);
 #endif
 
 // The current version of the Asan parameters structure. This must be updated
 // if any changes are made to the above structure! This is defined in the header
 // file to allow compile time assertions against this version number.
-const uint32_t kAsanParametersVersion = 14;
+const uint32_t kAsanParametersVersion = 30;
 
 // If the number of free bits in the parameters struct changes, then the
 // version has to change as well. This is simply here to make sure that
 // everything changes in lockstep.
-static_assert(kAsanParametersReserved1Bits == 20 &&
-                  kAsanParametersVersion == 14,
+static_assert(kAsanParametersReserved1Bits == 9 &&
+                  kAsanParametersVersion == 30,
               "Version must change if reserved bits changes.");
 
 // The name of the section that will be injected into an instrumented image,
@@ -189,6 +267,12 @@ struct InflatedAsanParameters : public AsanParameters {
 
   std::set<AsanStackId> ignored_stack_ids_set;
 
+  // The relative IDs of the allocation stacks that get through the allocation
+  // filter, in addition to the allocations made while the allocation filter
+  // flag is set. Unlike the ignored stack IDs this isn't part of the flat
+  // representation, so it can only be specified at runtime.
+  std::set<AsanStackId> allocation_filter_stack_ids_set;
+
  protected:
   // Deprecate use of this field in favour of the STL set version.
   using AsanParameters::ignored_stack_ids;
@@ -229,6 +313,7 @@ extern const float kDefaultAllocationGuardRate;
 // Default values of StackCaptureCache parameters.
 extern const uint32_t kDefaultReportingPeriod;
 extern const uint32_t kDefaultMaxNumFrames;
+extern const bool kDefaultCompressStackCaptures;
 // Default values of StackCapture parameters.
 extern const uint32_t kDefaultBottomFramesToSkip;
 // Default values of AsanRuntime parameters.
@@ -237,21 +322,38 @@ extern const bool kDefaultCheckHeapOnFailure;
 extern const bool kDefaultDisableBreakpadReporting;
 extern const bool kDefaultFeatureRandomization;
 extern const bool kDefaultReportInvalidAccesses;
+extern const bool kDefaultSparseShadow;
+extern const bool kDefaultSampleLargeBlockChecksums;
+extern const bool kDefaultDeduplicateErrorReports;
+extern const bool kDefaultUseLogBuffer;
+extern const bool kDefaultDeferredStartup;
+extern const float kDefaultHotPatchingActivationRate;
+extern const uint32_t kDefaultMaxHotPatchedBlocks;
 // Default values of AsanLogger parameters.
 extern const bool kDefaultMiniDumpOnFailure;
 extern const bool kDefaultLogAsText;
 // Default values of ZebraBlockHeap parameters.
 extern const uint32_t kDefaultZebraBlockHeapSize;
 extern const float kDefaultZebraBlockHeapQuarantineRatio;
+extern const bool kDefaultZebraBlockHeapMultiStripe;
 // Default values of the BlockHeapManager parameters.
 extern const bool kDefaultEnableZebraBlockHeap;
 extern const bool kDefaultEnableAllocationFilter;
 extern const float kDefaultQuarantineFloodFillRate;
 extern const bool kDefaultPreventDuplicateCorruptionCrashes;
+extern const bool kDefaultThreadBlockCache;
+extern const bool kDefaultDecommitQuarantinedPages;
+extern const bool kDefaultDeferQuarantineFloodFill;
+extern const uint32_t kDefaultHeapProfileSamplingInterval;
+extern const uint32_t kDefaultAllocStackCapturePeriod;
+extern const uint32_t kDefaultHeapPartitionCount;
+extern const uint32_t kDefaultAllocationGuardSiteThreshold;
+extern const uint32_t kDefaultAllocationGuardSeed;
 // Default values of LargeBlockHeap parameters.
 extern const bool kDefaultEnableLargeBlockHeap;
 extern const size_t kDefaultLargeAllocationThreshold;
 extern const bool kDefaultEnableRateTargetedHeaps;
+extern const bool kDefaultLargeBlockHeapPooling;
 
 // The name of the environment variable containing the SyzyAsan command-line.
 extern const char kSyzyAsanOptionsEnvVar[];
@@ -264,6 +366,7 @@ extern const char kParamAllocationGuardRate[];
 // String names of StackCaptureCache parameters.
 extern const char kParamReportingPeriod[];
 extern const char kParamBottomFramesToSkip[];
+extern const char kParamCompressStackCaptures[];
 // String names of StackCapture parameters.
 extern const char kParamMaxNumFrames[];
 // String names of AsanRuntime parameters.
@@ -272,21 +375,39 @@ extern const char kParamExitOnFailure[];
 extern const char kParamDisableBreakpadReporting[];
 extern const char kParamFeatureRandomization[];
 extern const char kParamReportInvalidAccesses[];
+extern const char kParamSparseShadow[];
+extern const char kParamSampleLargeBlockChecksums[];
+extern const char kParamDeduplicateErrorReports[];
+extern const char kParamUseLogBuffer[];
+extern const char kParamDeferredStartup[];
+extern const char kParamHotPatchingActivationRate[];
+extern const char kParamMaxHotPatchedBlocks[];
 // String names of AsanLogger parameters.
 extern const char kParamMiniDumpOnFailure[];
 extern const char kParamLogAsText[];
 // String names of ZebraBlockHeap parameters.
 extern const char kParamZebraBlockHeapSize[];
 extern const char kParamZebraBlockHeapQuarantineRatio[];
+extern const char kParamZebraBlockHeapMultiStripe[];
 // String names of BlockHeapManager parameters.
 extern const char kParamDisableSizeTargetedHeaps[];
 extern const char kParamEnableZebraBlockHeap[];
 extern const char kParamEnableAllocationFilter[];
+extern const char kParamAllocationFilterStackIds[];
 extern const char kParamQuarantineFloodFillRate[];
 extern const char kParamPreventDuplicateCorruptionCrashes[];
+extern const char kParamThreadBlockCache[];
+extern const char kParamDecommitQuarantinedPages[];
+extern const char kParamDeferQuarantineFloodFill[];
+extern const char kParamHeapProfileSamplingInterval[];
+extern const char kParamAllocStackCapturePeriod[];
+extern const char kParamHeapPartitionCount[];
+extern const char kParamAllocationGuardSiteThreshold[];
+extern const char kParamAllocationGuardSeed[];
 // String names of LargeBlockHeap parameters.
 extern const char kParamDisableLargeBlockHeap[];
 extern const char kParamLargeAllocationThreshold[];
+extern const char kParamLargeBlockHeapPooling[];
 
 // Initializes an AsanParameters struct with default values.
 // @param asan_parameters The AsanParameters struct to be initialized.
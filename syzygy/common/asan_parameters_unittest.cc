@@ -90,12 +90,43 @@ TEST(AsanParametersTest, SetDefaultAsanParameters) {
             aparams.large_allocation_threshold);
   EXPECT_EQ(kDefaultQuarantineFloodFillRate,
             aparams.quarantine_flood_fill_rate);
+  EXPECT_EQ(kDefaultHeapProfileSamplingInterval,
+            aparams.heap_profile_sampling_interval);
+  EXPECT_EQ(kDefaultAllocStackCapturePeriod,
+            aparams.alloc_stack_capture_period);
+  EXPECT_EQ(kDefaultHotPatchingActivationRate,
+            aparams.hot_patching_activation_rate);
+  EXPECT_EQ(kDefaultMaxHotPatchedBlocks, aparams.max_hot_patched_blocks);
+  EXPECT_EQ(kDefaultHeapPartitionCount, aparams.heap_partition_count);
+  EXPECT_EQ(kDefaultAllocationGuardSiteThreshold,
+            aparams.allocation_guard_site_threshold);
+  EXPECT_EQ(kDefaultAllocationGuardSeed, aparams.allocation_guard_seed);
   EXPECT_EQ(kDefaultFeatureRandomization,
             static_cast<bool>(aparams.feature_randomization));
   EXPECT_EQ(kDefaultPreventDuplicateCorruptionCrashes,
             static_cast<bool>(aparams.prevent_duplicate_corruption_crashes));
   EXPECT_EQ(kDefaultReportInvalidAccesses,
             static_cast<bool>(aparams.report_invalid_accesses));
+  EXPECT_EQ(kDefaultCompressStackCaptures,
+            static_cast<bool>(aparams.compress_stack_captures));
+  EXPECT_EQ(kDefaultSparseShadow, static_cast<bool>(aparams.sparse_shadow));
+  EXPECT_EQ(kDefaultThreadBlockCache,
+            static_cast<bool>(aparams.thread_block_cache));
+  EXPECT_EQ(kDefaultZebraBlockHeapMultiStripe,
+            static_cast<bool>(aparams.zebra_block_heap_multi_stripe));
+  EXPECT_EQ(kDefaultLargeBlockHeapPooling,
+            static_cast<bool>(aparams.large_block_heap_pooling));
+  EXPECT_EQ(kDefaultSampleLargeBlockChecksums,
+            static_cast<bool>(aparams.sample_large_block_checksums));
+  EXPECT_EQ(kDefaultDeduplicateErrorReports,
+            static_cast<bool>(aparams.deduplicate_error_reports));
+  EXPECT_EQ(kDefaultUseLogBuffer, static_cast<bool>(aparams.use_log_buffer));
+  EXPECT_EQ(kDefaultDecommitQuarantinedPages,
+            static_cast<bool>(aparams.decommit_quarantined_pages));
+  EXPECT_EQ(kDefaultDeferredStartup,
+            static_cast<bool>(aparams.deferred_startup));
+  EXPECT_EQ(kDefaultDeferQuarantineFloodFill,
+            static_cast<bool>(aparams.defer_quarantine_flood_fill));
 }
 
 TEST(AsanParametersTest, InflateAsanParametersStackIdsPastEnd) {
@@ -231,6 +262,7 @@ TEST(AsanParametersTest, ParseAsanParametersMinimal) {
             static_cast<bool>(iparams.check_heap_on_failure));
   EXPECT_EQ(0u, iparams.reserved1);
   EXPECT_TRUE(iparams.ignored_stack_ids_set.empty());
+  EXPECT_TRUE(iparams.allocation_filter_stack_ids_set.empty());
   EXPECT_EQ(kDefaultZebraBlockHeapSize, iparams.zebra_block_heap_size);
   EXPECT_EQ(kDefaultZebraBlockHeapQuarantineRatio,
       iparams.zebra_block_heap_quarantine_ratio);
@@ -245,12 +277,43 @@ TEST(AsanParametersTest, ParseAsanParametersMinimal) {
             iparams.large_allocation_threshold);
   EXPECT_EQ(kDefaultQuarantineFloodFillRate,
             iparams.quarantine_flood_fill_rate);
+  EXPECT_EQ(kDefaultHeapProfileSamplingInterval,
+            iparams.heap_profile_sampling_interval);
+  EXPECT_EQ(kDefaultAllocStackCapturePeriod,
+            iparams.alloc_stack_capture_period);
+  EXPECT_EQ(kDefaultHotPatchingActivationRate,
+            iparams.hot_patching_activation_rate);
+  EXPECT_EQ(kDefaultMaxHotPatchedBlocks, iparams.max_hot_patched_blocks);
+  EXPECT_EQ(kDefaultHeapPartitionCount, iparams.heap_partition_count);
+  EXPECT_EQ(kDefaultAllocationGuardSiteThreshold,
+            iparams.allocation_guard_site_threshold);
+  EXPECT_EQ(kDefaultAllocationGuardSeed, iparams.allocation_guard_seed);
   EXPECT_EQ(kDefaultFeatureRandomization,
             static_cast<bool>(iparams.feature_randomization));
   EXPECT_EQ(kDefaultPreventDuplicateCorruptionCrashes,
             static_cast<bool>(iparams.prevent_duplicate_corruption_crashes));
   EXPECT_EQ(kDefaultReportInvalidAccesses,
             static_cast<bool>(iparams.report_invalid_accesses));
+  EXPECT_EQ(kDefaultCompressStackCaptures,
+            static_cast<bool>(iparams.compress_stack_captures));
+  EXPECT_EQ(kDefaultSparseShadow, static_cast<bool>(iparams.sparse_shadow));
+  EXPECT_EQ(kDefaultThreadBlockCache,
+            static_cast<bool>(iparams.thread_block_cache));
+  EXPECT_EQ(kDefaultZebraBlockHeapMultiStripe,
+            static_cast<bool>(iparams.zebra_block_heap_multi_stripe));
+  EXPECT_EQ(kDefaultLargeBlockHeapPooling,
+            static_cast<bool>(iparams.large_block_heap_pooling));
+  EXPECT_EQ(kDefaultSampleLargeBlockChecksums,
+            static_cast<bool>(iparams.sample_large_block_checksums));
+  EXPECT_EQ(kDefaultDeduplicateErrorReports,
+            static_cast<bool>(iparams.deduplicate_error_reports));
+  EXPECT_EQ(kDefaultUseLogBuffer, static_cast<bool>(iparams.use_log_buffer));
+  EXPECT_EQ(kDefaultDecommitQuarantinedPages,
+            static_cast<bool>(iparams.decommit_quarantined_pages));
+  EXPECT_EQ(kDefaultDeferredStartup,
+            static_cast<bool>(iparams.deferred_startup));
+  EXPECT_EQ(kDefaultDeferQuarantineFloodFill,
+            static_cast<bool>(iparams.defer_quarantine_flood_fill));
 }
 
 TEST(AsanParametersTest, ParseAsanParametersMaximal) {
@@ -274,11 +337,30 @@ TEST(AsanParametersTest, ParseAsanParametersMaximal) {
       L"--enable_zebra_block_heap "
       L"--disable_large_block_heap "
       L"--enable_allocation_filter "
+      L"--allocation_filter_stack_ids=0x2;0xC0FFEE "
       L"--large_allocation_threshold=4096 "
       L"--quarantine_flood_fill_rate=0.25 "
+      L"--heap_profile_sampling_interval=65536 "
+      L"--alloc_stack_capture_period=4 "
+      L"--hot_patching_activation_rate=0.125 "
+      L"--max_hot_patched_blocks=100 "
+      L"--heap_partition_count=8 "
+      L"--allocation_guard_site_threshold=16 "
+      L"--allocation_guard_seed=1234 "
       L"--enable_feature_randomization "
       L"--prevent_duplicate_corruption_crashes "
-      L"--report_invalid_accesses";
+      L"--report_invalid_accesses "
+      L"--compress_stack_captures "
+      L"--sparse_shadow "
+      L"--thread_block_cache "
+      L"--zebra_block_heap_multi_stripe "
+      L"--large_block_heap_pooling "
+      L"--sample_large_block_checksums "
+      L"--deduplicate_error_reports "
+      L"--use_log_buffer "
+      L"--decommit_quarantined_pages "
+      L"--deferred_startup "
+      L"--defer_quarantine_flood_fill";
 
   InflatedAsanParameters iparams;
   SetDefaultAsanParameters(&iparams);
@@ -301,6 +383,8 @@ TEST(AsanParametersTest, ParseAsanParametersMaximal) {
   EXPECT_EQ(0.6f, iparams.allocation_guard_rate);
   EXPECT_THAT(iparams.ignored_stack_ids_set,
               testing::ElementsAre(0x1, 0xBAADF00D, 0xCAFEBABE, 0xDEADBEEF));
+  EXPECT_THAT(iparams.allocation_filter_stack_ids_set,
+              testing::ElementsAre(0x2, 0xC0FFEE));
   EXPECT_EQ(8388608, iparams.zebra_block_heap_size);
   EXPECT_EQ(0.5f, iparams.zebra_block_heap_quarantine_ratio);
   EXPECT_FALSE(static_cast<bool>(iparams.deprecated_enable_ctmalloc));
@@ -309,10 +393,28 @@ TEST(AsanParametersTest, ParseAsanParametersMaximal) {
   EXPECT_TRUE(static_cast<bool>(iparams.enable_allocation_filter));
   EXPECT_EQ(4096, iparams.large_allocation_threshold);
   EXPECT_EQ(0.25f, iparams.quarantine_flood_fill_rate);
+  EXPECT_EQ(65536, iparams.heap_profile_sampling_interval);
+  EXPECT_EQ(4, iparams.alloc_stack_capture_period);
+  EXPECT_EQ(0.125f, iparams.hot_patching_activation_rate);
+  EXPECT_EQ(100, iparams.max_hot_patched_blocks);
+  EXPECT_EQ(8, iparams.heap_partition_count);
+  EXPECT_EQ(16, iparams.allocation_guard_site_threshold);
+  EXPECT_EQ(1234, iparams.allocation_guard_seed);
   EXPECT_EQ(true, static_cast<bool>(iparams.feature_randomization));
   EXPECT_EQ(true, static_cast<bool>(
       iparams.prevent_duplicate_corruption_crashes));
   EXPECT_EQ(true, static_cast<bool>(iparams.report_invalid_accesses));
+  EXPECT_EQ(true, static_cast<bool>(iparams.compress_stack_captures));
+  EXPECT_EQ(true, static_cast<bool>(iparams.sparse_shadow));
+  EXPECT_EQ(true, static_cast<bool>(iparams.thread_block_cache));
+  EXPECT_EQ(true, static_cast<bool>(iparams.zebra_block_heap_multi_stripe));
+  EXPECT_EQ(true, static_cast<bool>(iparams.large_block_heap_pooling));
+  EXPECT_EQ(true, static_cast<bool>(iparams.sample_large_block_checksums));
+  EXPECT_EQ(true, static_cast<bool>(iparams.deduplicate_error_reports));
+  EXPECT_EQ(true, static_cast<bool>(iparams.use_log_buffer));
+  EXPECT_EQ(true, static_cast<bool>(iparams.decommit_quarantined_pages));
+  EXPECT_EQ(true, static_cast<bool>(iparams.deferred_startup));
+  EXPECT_EQ(true, static_cast<bool>(iparams.defer_quarantine_flood_fill));
 }
 
 }  // namespace common
@@ -25,7 +25,7 @@ const uint32_t kJumpTableCountAgentId = 0x07AB1E0C;
 // This should be incremented when incompatible changes are made to a tracing
 // client.
 const uint32_t kBasicBlockFrequencyDataVersion = 1;
-const uint32_t kBranchFrequencyDataVersion = 1;
+const uint32_t kBranchFrequencyDataVersion = 2;
 const uint32_t kJumpTableFrequencyDataVersion = 1;
 
 const char kBasicBlockRangesStreamName[] = "/Syzygy/BasicBlockRanges";
@@ -109,8 +109,28 @@ struct ThreadLocalIndexedFrequencyData {
   DWORD fs_slot;
 };
 
+// The per-thread buffer of branch events of a module whose thread state is
+// kept in an FS slot. The slot points to this structure, so that the branch
+// instrumentation can append events to the buffer inline and only call into
+// the agent when the buffer is full.
+struct BranchEventBuffer {
+  // The next free entry of the buffer, and the end of the buffer. Each entry
+  // is a basic block id, which has kBranchExitEventFlag set for an exit from
+  // the basic block.
+  uint32_t* next;
+  uint32_t* end;
+
+  // The agent thread state that owns this buffer.
+  void* thread_state;
+};
+COMPILE_ASSERT_IS_POD(BranchEventBuffer);
+
 #pragma pack(pop)
 
+// The flag that distinguishes basic block exit events from entry events in a
+// BranchEventBuffer.
+const uint32_t kBranchExitEventFlag = 0x80000000U;
+
 // The basic-block coverage agent ID.
 extern const uint32_t kBasicBlockCoverageAgentId;
 
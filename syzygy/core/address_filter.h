@@ -18,6 +18,10 @@
 #ifndef SYZYGY_CORE_ADDRESS_FILTER_H_
 #define SYZYGY_CORE_ADDRESS_FILTER_H_
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
 #include "syzygy/core/address_range.h"
 
 namespace core {
@@ -46,7 +50,8 @@ class AddressFilter {
   // expose the copy constructor facilitates this.
   // @param rhs The AddressFilter to copy.
   AddressFilter(const AddressFilter& rhs)
-      : extent_(rhs.extent_), marked_ranges_(rhs.marked_ranges_) {
+      : extent_(rhs.extent_), marked_ranges_(rhs.marked_ranges_),
+        page_index_(rhs.page_index_) {
   }
 
   // Assignment operator. We explicitly want to support arithmetic-like set
@@ -56,11 +61,15 @@ class AddressFilter {
   AddressFilter& operator=(const AddressFilter& rhs) {
     extent_ = rhs.extent_;
     marked_ranges_ = rhs.marked_ranges_;
+    page_index_ = rhs.page_index_;
     return *this;
   }
 
   // Clears this AddressFilter.
-  void Clear() { marked_ranges_.clear(); }
+  void Clear() {
+    marked_ranges_.clear();
+    page_index_.reset();
+  }
 
   // Marks the given address range.
   // @param range The range to mark.
@@ -82,6 +91,15 @@ class AddressFilter {
   //     they are all unmarked.
   bool IsUnmarked(const Range& range) const;
 
+  // Builds an index of the marked locations by page of the extent. IsMarked
+  // and IsUnmarked then only look at the pages spanned by the query, instead
+  // of searching the marked ranges. Any modification of the filter drops the
+  // index, so this is meant to be called once the filter is complete.
+  void BuildPageIndex();
+
+  // @returns true if this filter currently has a page index.
+  bool has_page_index() const { return page_index_.get() != nullptr; }
+
   // @name Accessors.
   // @{
   const Range& extent() const { return extent_; }
@@ -128,11 +146,24 @@ class AddressFilter {
   // @}
 
  protected:
+  struct PageIndex;
+
+  // Looks up a range in the page index.
+  // @param range The range to look up. This must lie within the extent.
+  // @param marked The state to look for.
+  // @returns true if all the locations in @p range are marked if @p marked is
+  //     true, or unmarked if @p marked is false.
+  bool PageIndexIsUniform(const Range& range, bool marked) const;
+
   // The extents of this filter.
   Range extent_;
 
   // The set of disjoint marked ranges.
   RangeSet marked_ranges_;
+
+  // The page index of the marked ranges, if it has been built. This is
+  // immutable once built, so copies of the filter share it.
+  std::shared_ptr<const PageIndex> page_index_;
 };
 
 }  // namespace core
@@ -67,8 +67,34 @@ struct AddressRangeLessThan {
   }
 };
 
+// The page index of an AddressFilter. Each page of the extent is either
+// entirely unmarked, entirely marked, or has a bitmap of its marked locations.
+template<typename AddressType, typename SizeType>
+struct AddressFilter<AddressType, SizeType>::PageIndex {
+  enum : size_t {
+    kPageSize = 4096,
+    kBitsPerWord = 64,
+    kWordsPerPage = kPageSize / kBitsPerWord,
+  };
+
+  enum : uint32_t {
+    kPageUnmarked = 0,
+    kPageMarked = 1,
+    // The bitmap of a partially marked page with this state or greater is at
+    // (state - kFirstBitmap) * kWordsPerPage in |bitmaps|.
+    kFirstBitmap = 2,
+  };
+
+  // The state of each page.
+  std::vector<uint32_t> pages;
+  // The bitmaps of the partially marked pages.
+  std::vector<uint64_t> bitmaps;
+};
+
 template<typename AddressType, typename SizeType>
 void AddressFilter<AddressType, SizeType>::Mark(const Range& range) {
+  page_index_.reset();
+
   Range r;
   if (!internal::Intersect(extent_, range, &r))
     return;
@@ -127,6 +153,8 @@ void AddressFilter<AddressType, SizeType>::Mark(const Range& range) {
 
 template<typename AddressType, typename SizeType>
 void AddressFilter<AddressType, SizeType>::Unmark(const Range& range) {
+  page_index_.reset();
+
   Range r;
   if (!internal::Intersect(extent_, range, &r))
     return;
@@ -191,6 +219,9 @@ bool AddressFilter<AddressType, SizeType>::IsMarked(const Range& range) const {
   if (!internal::Intersect(extent_, range, &r))
     return false;
 
+  if (page_index_.get() != nullptr)
+    return PageIndexIsUniform(r, true);
+
   // Get the first r that is *not* less than the beginning of the range
   // to be inserted. Which means either it contains us, or it is past us.
   RangeSet::iterator it = marked_ranges_.lower_bound(Range(r.start(), 1));
@@ -215,6 +246,9 @@ bool AddressFilter<AddressType, SizeType>::IsUnmarked(
   if (!internal::Intersect(extent_, range, &r))
     return true;
 
+  if (page_index_.get() != nullptr)
+    return PageIndexIsUniform(r, false);
+
   // Get the first range that is *not* less than the beginning of the range
   // to be inserted. Which means either it contains us, or it is past us.
   RangeSet::iterator it = marked_ranges_.lower_bound(
@@ -229,9 +263,93 @@ bool AddressFilter<AddressType, SizeType>::IsUnmarked(
   return !r.Intersects(*it);
 }
 
+template<typename AddressType, typename SizeType>
+void AddressFilter<AddressType, SizeType>::BuildPageIndex() {
+  std::shared_ptr<PageIndex> index(new PageIndex());
+  size_t extent_size = extent_.size();
+  index->pages.resize(
+      (extent_size + PageIndex::kPageSize - 1) / PageIndex::kPageSize,
+      PageIndex::kPageUnmarked);
+
+  RangeSet::const_iterator it = marked_ranges_.begin();
+  for (; it != marked_ranges_.end(); ++it) {
+    size_t begin = static_cast<size_t>(it->start() - extent_.start());
+    size_t end = begin + it->size();
+    while (begin < end) {
+      size_t page = begin / PageIndex::kPageSize;
+      size_t page_start = page * PageIndex::kPageSize;
+      size_t page_end = std::min(page_start + PageIndex::kPageSize,
+                                 extent_size);
+      size_t range_end = std::min(page_end, end);
+
+      // The marked ranges are disjoint and contiguous ones are merged, so a
+      // page that is entirely marked is covered by a single range.
+      if (begin == page_start && range_end == page_end) {
+        index->pages[page] = PageIndex::kPageMarked;
+      } else {
+        uint32_t& state = index->pages[page];
+        DCHECK_NE(static_cast<uint32_t>(PageIndex::kPageMarked), state);
+        if (state == PageIndex::kPageUnmarked) {
+          state = static_cast<uint32_t>(PageIndex::kFirstBitmap +
+              index->bitmaps.size() / PageIndex::kWordsPerPage);
+          index->bitmaps.resize(
+              index->bitmaps.size() + PageIndex::kWordsPerPage, 0);
+        }
+        uint64_t* bitmap = &index->bitmaps[
+            (state - PageIndex::kFirstBitmap) * PageIndex::kWordsPerPage];
+        for (size_t i = begin - page_start; i < range_end - page_start; ++i) {
+          bitmap[i / PageIndex::kBitsPerWord] |=
+              static_cast<uint64_t>(1) << (i % PageIndex::kBitsPerWord);
+        }
+      }
+
+      begin = range_end;
+    }
+  }
+
+  page_index_ = index;
+}
+
+template<typename AddressType, typename SizeType>
+bool AddressFilter<AddressType, SizeType>::PageIndexIsUniform(
+    const Range& range, bool marked) const {
+  DCHECK(page_index_.get() != nullptr);
+  DCHECK(extent_.Contains(range));
+
+  const PageIndex& index = *page_index_;
+  uint32_t opposite = marked ? PageIndex::kPageUnmarked :
+                               PageIndex::kPageMarked;
+  size_t begin = static_cast<size_t>(range.start() - extent_.start());
+  size_t end = begin + range.size();
+  while (begin < end) {
+    size_t page = begin / PageIndex::kPageSize;
+    size_t page_start = page * PageIndex::kPageSize;
+    size_t range_end = std::min(page_start + PageIndex::kPageSize, end);
+
+    uint32_t state = index.pages[page];
+    if (state == opposite)
+      return false;
+    if (state >= PageIndex::kFirstBitmap) {
+      const uint64_t* bitmap = &index.bitmaps[
+          (state - PageIndex::kFirstBitmap) * PageIndex::kWordsPerPage];
+      for (size_t i = begin - page_start; i < range_end - page_start; ++i) {
+        bool bit = ((bitmap[i / PageIndex::kBitsPerWord] >>
+            (i % PageIndex::kBitsPerWord)) & 1) != 0;
+        if (bit != marked)
+          return false;
+      }
+    }
+
+    begin = range_end;
+  }
+
+  return true;
+}
+
 template<typename AddressType, typename SizeType>
 void AddressFilter<AddressType, SizeType>::Invert(AddressFilter* filter) const {
   DCHECK(filter != NULL);
+  filter->page_index_.reset();
 
   // We work with a temporary RangeSet and swap its contents later, handling
   // the case when 'filter == this'.
@@ -271,6 +389,7 @@ template<typename AddressType, typename SizeType>
 void AddressFilter<AddressType, SizeType>::Intersect(
     const AddressFilter& other, AddressFilter* filter) const {
   DCHECK(filter != NULL);
+  filter->page_index_.reset();
 
   // By our definition the result has the same extent as |this|. This is
   // somewhat arbitrary.
@@ -347,6 +466,7 @@ template<typename AddressType, typename SizeType>
 void AddressFilter<AddressType, SizeType>::Union(
     const AddressFilter& other, AddressFilter* filter) const {
   DCHECK(filter != NULL);
+  filter->page_index_.reset();
 
   // We work with a temporary AddressFilter and swap its contents later,
   // handling the case when 'filter == this'.
@@ -372,6 +492,7 @@ template<typename AddressType, typename SizeType>
 void AddressFilter<AddressType, SizeType>::Subtract(
     const AddressFilter& other, AddressFilter* filter) const {
   DCHECK(filter != NULL);
+  filter->page_index_.reset();
 
   // We work with a temporary AddressFilter and swap its contents later,
   // handling the case when 'filter == this'.
@@ -945,4 +945,38 @@ TEST(AddressFilterTest, Difference) {
   }
 }
 
+TEST(AddressFilterTest, PageIndex) {
+  // Mark a whole page, parts of other pages, and the end of the last page,
+  // which is shorter than the others.
+  TestAddressFilter f(MakeRange(0x1000, 0x3100));
+  f.Mark(MakeRange(0x1000, 0x1000));
+  f.Mark(MakeRange(0x2100, 0x10));
+  f.Mark(MakeRange(0x2FF0, 0x20));
+  f.Mark(MakeRange(0x40F0, 0x10));
+  TestAddressFilter reference(f);
+
+  f.BuildPageIndex();
+  EXPECT_TRUE(f.has_page_index());
+  EXPECT_FALSE(reference.has_page_index());
+  EXPECT_EQ(reference, f);
+
+  // The indexed filter answers like the reference one.
+  for (size_t start = 0xF00; start < 0x4200; start += 0x8) {
+    for (size_t size = 1; size < 0x1100; size += 0x7F) {
+      Range range(MakeRange(start, size));
+      EXPECT_EQ(reference.IsMarked(range), f.IsMarked(range));
+      EXPECT_EQ(reference.IsUnmarked(range), f.IsUnmarked(range));
+    }
+  }
+
+  // Copies share the index, and modifications drop it.
+  TestAddressFilter copy(f);
+  EXPECT_TRUE(copy.has_page_index());
+  copy.Mark(MakeRange(0x3000, 0x10));
+  EXPECT_FALSE(copy.has_page_index());
+  EXPECT_TRUE(copy.IsMarked(MakeRange(0x3000, 0x10)));
+  f.Invert(&f);
+  EXPECT_FALSE(f.has_page_index());
+}
+
 }  // namespace core
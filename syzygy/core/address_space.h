@@ -32,20 +32,31 @@
 #include "base/logging.h"
 #include "syzygy/core/address_range.h"
 #include "syzygy/core/address_space_internal.h"
+#include "syzygy/core/flat_map.h"
 #include "syzygy/core/serialization.h"
 
 namespace core {
 
 // An address space is a mapping from a set of non-overlapping address ranges
 // (AddressSpace::Range), each of non-zero size, to an ItemType.
-template <typename AddressType, typename SizeType, typename ItemType>
+//
+// The ranges are stored in a @p RangeMapType, which is a std::map by default.
+// This suits address spaces that keep being modified. Address spaces that are
+// built once and then queried many times are better off stored in a FlatMap,
+// see FlatAddressSpace below; note that all of their iterators are
+// invalidated by any insertion or removal.
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType =
+              std::map<AddressRange<AddressType, SizeType>, ItemType>>
 class AddressSpace {
  public:
   // Typedef we use for convenience throughout.
   typedef AddressRange<AddressType, SizeType> Range;
-  typedef std::map<Range, ItemType> RangeMap;
-  typedef typename std::map<Range, ItemType>::iterator RangeMapIter;
-  typedef typename std::map<Range, ItemType>::const_iterator RangeMapConstIter;
+  typedef RangeMapType RangeMap;
+  typedef typename RangeMap::iterator RangeMapIter;
+  typedef typename RangeMap::const_iterator RangeMapConstIter;
   typedef std::pair<RangeMapConstIter, RangeMapConstIter> RangeMapConstIterPair;
   typedef std::pair<RangeMapIter, RangeMapIter> RangeMapIterPair;
 
@@ -191,6 +202,13 @@ class AddressSpace {
   RangeMap ranges_;
 };
 
+// An address space that is stored in a sorted vector, for address spaces that
+// are built once and then queried many times.
+template <typename AddressType, typename SizeType, typename ItemType>
+using FlatAddressSpace = AddressSpace<
+    AddressType, SizeType, ItemType,
+    FlatMap<AddressRange<AddressType, SizeType>, ItemType>>;
+
 // An AddressRangeMap is used for keeping track of data in one address space
 // that has some relationship with data in another address space. Mappings are
 // stored as pairs of addresses, one from the 'source' address-space and one
@@ -385,12 +403,18 @@ class AddressRangeMap {
   RangePairs range_pairs_;
 };
 
-template <typename AddressType, typename SizeType, typename ItemType>
-AddressSpace<AddressType, SizeType, ItemType>::AddressSpace() {
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::AddressSpace() {
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Insert(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::Insert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -412,8 +436,11 @@ bool AddressSpace<AddressType, SizeType, ItemType>::Insert(
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::FindOrInsert(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindOrInsert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -439,8 +466,11 @@ bool AddressSpace<AddressType, SizeType, ItemType>::FindOrInsert(
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::SubsumeInsert(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::SubsumeInsert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -495,8 +525,11 @@ bool AddressSpace<AddressType, SizeType, ItemType>::SubsumeInsert(
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-void AddressSpace<AddressType, SizeType, ItemType>::MergeInsert(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+void AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::MergeInsert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -540,8 +573,12 @@ void AddressSpace<AddressType, SizeType, ItemType>::MergeInsert(
   return;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Remove(const Range& range) {
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType,
+                  RangeMapType>::Remove(const Range& range) {
   // We can't remove empty ranges.
   if (range.IsEmpty())
     return false;
@@ -554,16 +591,26 @@ bool AddressSpace<AddressType, SizeType, ItemType>::Remove(const Range& range) {
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::const_iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindFirstIntersection(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMap::const_iterator
+AddressSpace<AddressType, SizeType, ItemType,
+             RangeMapType>::FindFirstIntersection(
     const Range& range) const {
   return const_cast<AddressSpace*>(this)->FindFirstIntersection(range);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindFirstIntersection(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMap::iterator
+AddressSpace<AddressType, SizeType, ItemType,
+             RangeMapType>::FindFirstIntersection(
     const Range& range) {
   // Empty items do not exist in the address-space.
   if (range.IsEmpty())
@@ -593,16 +640,24 @@ AddressSpace<AddressType, SizeType, ItemType>::FindFirstIntersection(
   return ranges_.end();
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMapConstIterPair
-AddressSpace<AddressType, SizeType, ItemType>::FindIntersecting(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMapConstIterPair
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindIntersecting(
     const Range& range) const {
   return const_cast<AddressSpace*>(this)->FindIntersecting(range);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMapIterPair
-AddressSpace<AddressType, SizeType, ItemType>::FindIntersecting(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMapIterPair
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindIntersecting(
     const Range& range) {
   // Empty ranges find nothing.
   if (range.IsEmpty())
@@ -630,15 +685,22 @@ AddressSpace<AddressType, SizeType, ItemType>::FindIntersecting(
   return std::make_pair(begin, end);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Intersects(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::Intersects(
     const Range& range) const {
   RangeMapConstIterPair its = FindIntersecting(range);
   return (its.first != its.second);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::ContainsExactly(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType,
+                  RangeMapType>::ContainsExactly(
     const Range& range) const {
   RangeMapConstIterPair its = FindIntersecting(range);
   if (its.first == its.second)
@@ -646,8 +708,11 @@ bool AddressSpace<AddressType, SizeType, ItemType>::ContainsExactly(
   return its.first->first == range;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Contains(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::Contains(
     const Range& range) const {
   RangeMapConstIterPair its = FindIntersecting(range);
   if (its.first == its.second)
@@ -655,9 +720,13 @@ bool AddressSpace<AddressType, SizeType, ItemType>::Contains(
   return its.first->first.Contains(range);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::const_iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindContaining(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMap::const_iterator
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindContaining(
     const Range& range) const {
   // If there is a containing range, it must be the first intersection.
   RangeMap::const_iterator it(FindFirstIntersection(range));
@@ -667,9 +736,13 @@ AddressSpace<AddressType, SizeType, ItemType>::FindContaining(
   return ranges_.end();
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindContaining(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMap::iterator
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindContaining(
     const Range& range) {
   // If there is a containing range, it must be the first intersection.
   RangeMap::iterator it(FindFirstIntersection(range));
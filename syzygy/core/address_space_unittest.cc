@@ -396,6 +396,52 @@ TEST(AddressSpaceTest, FindIntersecting) {
   EXPECT_TRUE(it_pair.first == address_space.ranges().end());
 }
 
+TEST(AddressSpaceTest, FlatAddressSpace) {
+  typedef FlatAddressSpace<size_t, size_t, void*> FlatIntegerAddressSpace;
+  FlatIntegerAddressSpace address_space;
+  IntegerAddressSpace reference_space;
+  void* item = "Something to point at";
+
+  // Insert out of order, subsume and remove some ranges, and check that the
+  // flat address space behaves exactly like the tree-based one.
+  const size_t kStarts[] = { 120, 100, 110, 140, 90 };
+  for (size_t start : kStarts) {
+    EXPECT_TRUE(address_space.Insert(
+        FlatIntegerAddressSpace::Range(start, 5), item));
+    EXPECT_TRUE(reference_space.Insert(
+        IntegerAddressSpace::Range(start, 5), item));
+  }
+  EXPECT_FALSE(address_space.Insert(
+      FlatIntegerAddressSpace::Range(102, 5), item));
+  EXPECT_TRUE(address_space.SubsumeInsert(
+      FlatIntegerAddressSpace::Range(108, 14), item));
+  EXPECT_TRUE(reference_space.SubsumeInsert(
+      IntegerAddressSpace::Range(108, 14), item));
+  EXPECT_TRUE(address_space.Remove(FlatIntegerAddressSpace::Range(90, 5)));
+  EXPECT_TRUE(reference_space.Remove(IntegerAddressSpace::Range(90, 5)));
+
+  ASSERT_EQ(reference_space.ranges().size(), address_space.ranges().size());
+  IntegerAddressSpace::RangeMap::const_iterator reference_it =
+      reference_space.ranges().begin();
+  FlatIntegerAddressSpace::RangeMap::const_iterator it =
+      address_space.ranges().begin();
+  for (; it != address_space.ranges().end(); ++it, ++reference_it) {
+    EXPECT_EQ(reference_it->first.start(), it->first.start());
+    EXPECT_EQ(reference_it->first.size(), it->first.size());
+  }
+
+  it = address_space.FindContaining(FlatIntegerAddressSpace::Range(110, 2));
+  ASSERT_TRUE(it != address_space.ranges().end());
+  EXPECT_EQ(108, it->first.start());
+  EXPECT_TRUE(address_space.FindContaining(
+      FlatIntegerAddressSpace::Range(106, 1)) == address_space.end());
+
+  FlatIntegerAddressSpace::RangeMapIterPair it_pair =
+      address_space.FindIntersecting(FlatIntegerAddressSpace::Range(0, 130));
+  EXPECT_TRUE(it_pair.first == address_space.begin());
+  EXPECT_EQ(2, it_pair.second - it_pair.first);
+}
+
 TEST(AddressRangeMapTest, IsSimple) {
   IntegerRangeMap map;
   EXPECT_FALSE(map.IsSimple());
@@ -0,0 +1,63 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/arena.h"
+
+#include <malloc.h>
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "syzygy/common/align.h"
+
+namespace core {
+
+Arena::Arena(size_t slab_size)
+    : slab_size_(slab_size), cursor_(nullptr), end_(nullptr) {
+  DCHECK_LE(kAlignment, slab_size);
+}
+
+Arena::~Arena() {
+  for (uint8_t* slab : slabs_)
+    ::_aligned_free(slab);
+}
+
+void* Arena::Allocate(size_t size) {
+  // Zero-sized allocations still get distinct addresses.
+  size = common::AlignUp(std::max(size, static_cast<size_t>(1)), kAlignment);
+
+  // The large allocations get slabs of their own, so as not to waste the end
+  // of the current slab.
+  if (size > slab_size_ / 4) {
+    uint8_t* slab = reinterpret_cast<uint8_t*>(
+        ::_aligned_malloc(size, kAlignment));
+    CHECK_NE(static_cast<uint8_t*>(nullptr), slab);
+    slabs_.push_back(slab);
+    return slab;
+  }
+
+  if (static_cast<size_t>(end_ - cursor_) < size) {
+    cursor_ = reinterpret_cast<uint8_t*>(
+        ::_aligned_malloc(slab_size_, kAlignment));
+    CHECK_NE(static_cast<uint8_t*>(nullptr), cursor_);
+    slabs_.push_back(cursor_);
+    end_ = cursor_ + slab_size_;
+  }
+
+  void* allocation = cursor_;
+  cursor_ += size;
+  return allocation;
+}
+
+}  // namespace core
@@ -0,0 +1,75 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a monotonic arena, for allocating objects that die together.
+
+#ifndef SYZYGY_CORE_ARENA_H_
+#define SYZYGY_CORE_ARENA_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "base/macros.h"
+
+namespace core {
+
+// A monotonic arena. The allocations are carved out of slabs, one after the
+// other, and are only freed when the arena is destroyed. This makes
+// allocating cheap, and freeing everything at once costs one heap free per
+// slab. This doesn't run any destructor, which is up to the user of the
+// arena to do.
+//
+// This isn't thread-safe.
+class Arena {
+ public:
+  // The alignment of the allocations.
+  static const size_t kAlignment = 16;
+
+  // The default size of the slabs.
+  static const size_t kDefaultSlabSize = 16 * 1024;
+
+  // @param slab_size The size of the slabs. The allocations larger than a
+  //     quarter of it get slabs of their own.
+  explicit Arena(size_t slab_size = kDefaultSlabSize);
+
+  // Frees all the allocations.
+  ~Arena();
+
+  // Allocates memory from the arena.
+  // @param size The number of bytes to allocate.
+  // @returns the allocation, aligned to kAlignment.
+  void* Allocate(size_t size);
+
+  // @returns the number of slabs the arena is made of.
+  size_t slab_count() const { return slabs_.size(); }
+
+ protected:
+  // The size of the slabs.
+  const size_t slab_size_;
+
+  // The slabs, which are freed on destruction.
+  std::vector<uint8_t*> slabs_;
+
+  // The unallocated part of the current slab.
+  uint8_t* cursor_;
+  uint8_t* end_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Arena);
+};
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_ARENA_H_
@@ -0,0 +1,57 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/arena.h"
+
+#include <string.h>
+
+#include "gtest/gtest.h"
+
+namespace core {
+
+TEST(ArenaTest, Allocate) {
+  Arena arena(1024);
+  EXPECT_EQ(0u, arena.slab_count());
+
+  // The allocations are aligned, distinct, and made from the same slab.
+  uint8_t* first = reinterpret_cast<uint8_t*>(arena.Allocate(1));
+  uint8_t* second = reinterpret_cast<uint8_t*>(arena.Allocate(0));
+  uint8_t* third = reinterpret_cast<uint8_t*>(arena.Allocate(17));
+  EXPECT_EQ(1u, arena.slab_count());
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(first) % Arena::kAlignment);
+  EXPECT_EQ(first + Arena::kAlignment, second);
+  EXPECT_EQ(second + Arena::kAlignment, third);
+  ::memset(third, 0xAB, 17);
+
+  // Filling the slab starts a new one.
+  for (size_t i = 0; i < 1024 / Arena::kAlignment; ++i)
+    arena.Allocate(1);
+  EXPECT_EQ(2u, arena.slab_count());
+}
+
+TEST(ArenaTest, LargeAllocations) {
+  Arena arena(1024);
+  arena.Allocate(1);
+  EXPECT_EQ(1u, arena.slab_count());
+
+  // A large allocation gets a slab of its own, and doesn't replace the
+  // current one.
+  uint8_t* large = reinterpret_cast<uint8_t*>(arena.Allocate(4096));
+  ::memset(large, 0xAB, 4096);
+  EXPECT_EQ(2u, arena.slab_count());
+  arena.Allocate(1);
+  EXPECT_EQ(2u, arena.slab_count());
+}
+
+}  // namespace core
@@ -30,14 +30,23 @@
         'address_space.cc',
         'address_space.h',
         'address_space_internal.h',
+        'arena.cc',
+        'arena.h',
         'disassembler.cc',
         'disassembler.h',
         'disassembler_util.cc',
         'disassembler_util.h',
         'file_util.cc',
         'file_util.h',
+        'flat_map.h',
+        'json_file_reader.cc',
+        'json_file_reader.h',
         'json_file_writer.cc',
         'json_file_writer.h',
+        'perf_report.cc',
+        'perf_report.h',
+        'pool_allocator.cc',
+        'pool_allocator.h',
         'random_number_generator.cc',
         'random_number_generator.h',
         'section_offset_address.cc',
@@ -80,11 +89,16 @@
         'address_filter_unittest.cc',
         'address_space_unittest.cc',
         'address_range_unittest.cc',
+        'arena_unittest.cc',
         'disassembler_test_code.asm',
         'disassembler_unittest.cc',
         'disassembler_util_unittest.cc',
         'file_util_unittest.cc',
+        'flat_map_unittest.cc',
+        'json_file_reader_unittest.cc',
         'json_file_writer_unittest.cc',
+        'perf_report_unittest.cc',
+        'pool_allocator_unittest.cc',
         'section_offset_address_unittest.cc',
         'serialization_unittest.cc',
         'string_table_unittest.cc',
@@ -21,6 +21,13 @@
 
 namespace core {
 
+namespace {
+
+// The maximum number of instructions that are decoded at once during a walk.
+const size_t kInstructionBatchSize = 32;
+
+}  // namespace
+
 Disassembler::Disassembler(const uint8_t* code,
                            size_t code_size,
                            AbsoluteAddress code_addr,
@@ -75,10 +82,12 @@ Disassembler::CallbackDirective Disassembler::OnDisassemblyComplete() {
 }
 
 Disassembler::WalkResult Disassembler::Walk() {
-  // Initialize our disassembly state.
-  _CodeInfo code = {};
-  code.dt = Decode32Bits;
-  code.features = DF_NONE;
+  // The instructions are decoded in batches, which saves a call into distorm
+  // per instruction. A batch never goes past a control flow instruction, as
+  // the instruction run is likely to end there.
+  _DInst instructions[kInstructionBatchSize];
+  size_t decoded_count = 0;
+  size_t next_instruction = 0;
 
   // This is to keep track of whether we cover the entire function.
   bool incomplete_branches = false;
@@ -105,37 +114,43 @@ Disassembler::WalkResult Disassembler::Walk() {
     bool terminate = false;
     ControlFlowFlag control_flow = kControlFlowTerminates;
     _DInst inst = {};
+    decoded_count = 0;
+    next_instruction = 0;
     for (; addr != AbsoluteAddress(0) && !terminate; addr += inst.size) {
-      code.codeOffset = addr.value();
-      code.codeLen = static_cast<int>(code_size_) - (addr - code_addr_);
-      code.code = code_ + (addr - code_addr_);
-      if (code.codeLen == 0)
+      const uint8_t* code = code_ + (addr - code_addr_);
+      size_t code_length = code_size_ - (addr - code_addr_);
+      if (code_length == 0)
         break;
 
       bool conditional_branch_handled = false;
 
-      unsigned int decoded = 0;
-      _DecodeResult result = DistormDecompose(&code, &inst, 1, &decoded);
+      if (next_instruction == decoded_count) {
+        decoded_count = DecodeInstructions(addr.value(), code, code_length,
+                                           DF_STOP_ON_FLOW_CONTROL,
+                                           instructions,
+                                           arraysize(instructions));
+        next_instruction = 0;
+      }
 
-      if (decoded == 0) {
+      if (decoded_count == 0) {
         LOG(ERROR) << "Unable to decode instruction at " << addr << ".";
 
         // Dump the next few bytes. The longest X86 instruction possible is 15
         // bytes according to distorm.
-        int max_bytes = code.codeLen;
+        size_t max_bytes = code_length;
         if (max_bytes > 15)
           max_bytes = 15;
         std::string dump;
-        for (int i = 0; i < max_bytes; ++i) {
-          dump += base::StringPrintf(" 0x%02X", code.code[i]);
+        for (size_t i = 0; i < max_bytes; ++i) {
+          dump += base::StringPrintf(" 0x%02X", code[i]);
         }
         LOG(ERROR) << ".text =" << dump
-                   << (max_bytes < code.codeLen ? " ..." : ".");
+                   << (max_bytes < code_length ? " ..." : ".");
         return kWalkError;
       }
 
-      CHECK_EQ(1U, decoded);
-      CHECK(result == DECRES_MEMORYERR || result == DECRES_SUCCESS);
+      inst = instructions[next_instruction++];
+      DCHECK_EQ(addr.value(), inst.addr);
 
       // Try to visit this instruction.
       VisitedSpace::Range range(addr, inst.size);
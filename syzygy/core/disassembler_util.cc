@@ -14,6 +14,8 @@
 
 #include "syzygy/core/disassembler_util.h"
 
+#include <algorithm>
+
 #include "base/logging.h"
 #include "base/strings/stringprintf.h"
 #include "mnemonics.h"  // NOLINT
@@ -123,6 +125,57 @@ bool HandleBadDecode(_CodeInfo* ci,
   return true;
 }
 
+// The number of instructions that are decoded at once to build records.
+const size_t kRecordBatchSize = 64;
+
+// Implementation of DecodeInstructionRecords and FindControlFlowInstructions.
+size_t DecodeRecords(uint32_t address,
+                     const uint8_t* buffer,
+                     size_t length,
+                     bool control_flow_only,
+                     InstructionRecord* records,
+                     size_t max_records,
+                     size_t* decoded_length) {
+  DCHECK_NE(static_cast<const uint8_t*>(nullptr), buffer);
+  DCHECK_NE(static_cast<InstructionRecord*>(nullptr), records);
+  DCHECK_NE(static_cast<size_t*>(nullptr), decoded_length);
+
+  _DInst instructions[kRecordBatchSize];
+  size_t record_count = 0;
+  size_t offset = 0;
+  while (record_count < max_records && offset < length) {
+    // Don't decode instructions that can't be recorded, unless most of them
+    // are going to be filtered out.
+    size_t batch_size = kRecordBatchSize;
+    if (!control_flow_only)
+      batch_size = std::min(batch_size, max_records - record_count);
+
+    size_t decoded = DecodeInstructions(
+        address + static_cast<uint32_t>(offset), buffer + offset,
+        length - offset, DF_NONE, instructions, batch_size);
+    for (size_t i = 0; i < decoded && record_count < max_records; ++i) {
+      const _DInst& instruction = instructions[i];
+      uint8_t flow_control = META_GET_FC(instruction.meta);
+      if (!control_flow_only || flow_control != FC_NONE) {
+        InstructionRecord& record = records[record_count++];
+        record.offset = static_cast<uint32_t>(offset);
+        record.opcode = instruction.opcode;
+        record.size = instruction.size;
+        record.flow_control = flow_control;
+      }
+      offset += instruction.size;
+    }
+
+    // A short batch means that the end of the buffer or an instruction that
+    // can't be decoded was reached.
+    if (decoded < batch_size)
+      break;
+  }
+
+  *decoded_length = offset;
+  return record_count;
+}
+
 }  // namespace
 
 _DecodeResult DistormDecompose(_CodeInfo* ci,
@@ -209,6 +262,74 @@ bool DecodeOneInstruction(const uint8_t* buffer,
   return true;
 }
 
+size_t DecodeInstructions(uint32_t address,
+                          const uint8_t* buffer,
+                          size_t length,
+                          unsigned int features,
+                          _DInst* instructions,
+                          size_t max_instructions) {
+  DCHECK_NE(static_cast<const uint8_t*>(nullptr), buffer);
+  DCHECK_NE(static_cast<_DInst*>(nullptr), instructions);
+
+  _CodeInfo code = {};
+  code.dt = Decode32Bits;
+  code.features = features;
+
+  size_t count = 0;
+  size_t offset = 0;
+  while (count < max_instructions && offset < length) {
+    code.codeOffset = address + static_cast<uint32_t>(offset);
+    code.codeLen = static_cast<int>(length - offset);
+    code.code = buffer + offset;
+
+    unsigned int decoded = 0;
+    _DecodeResult result = DistormDecompose(
+        &code, instructions + count,
+        static_cast<unsigned int>(max_instructions - count), &decoded);
+    if (result != DECRES_MEMORYERR && result != DECRES_SUCCESS)
+      break;
+
+    for (unsigned int i = 0; i < decoded; ++i)
+      offset += instructions[count + i].size;
+    count += decoded;
+
+    if (decoded == 0)
+      break;
+
+    // Distorm stops short of the end of the buffer when it reaches one of the
+    // control flow instructions it was asked to stop on, or an instruction
+    // that it can't decode. The latter is decoded on its own by the next
+    // call, so that DistormDecompose gets a chance to work around it.
+    if (result == DECRES_SUCCESS &&
+        (features & DF_STOP_ON_FLOW_CONTROL) != 0 &&
+        META_GET_FC(instructions[count - 1].meta) != FC_NONE) {
+      break;
+    }
+  }
+
+  return count;
+}
+
+size_t DecodeInstructionRecords(uint32_t address,
+                                const uint8_t* buffer,
+                                size_t length,
+                                InstructionRecord* records,
+                                size_t max_records,
+                                size_t* decoded_length) {
+  return DecodeRecords(address, buffer, length, false, records, max_records,
+                       decoded_length);
+}
+
+size_t FindControlFlowInstructions(uint32_t address,
+                                   const uint8_t* buffer,
+                                   size_t length,
+                                   InstructionRecord* records,
+                                   size_t max_records,
+                                   size_t* decoded_length) {
+  return DecodeRecords(address, buffer, length, true, records, max_records,
+                       decoded_length);
+}
+
 bool InstructionToString(
     const _DInst& instruction,
     const uint8_t* data,
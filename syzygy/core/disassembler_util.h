@@ -29,6 +29,20 @@ namespace core {
 using assm::Register;
 using assm::RegisterId;
 
+// A compact record of a decoded instruction. This is meant for the callers
+// that decode a lot of code, and that only care about the layout and the
+// control flow of the instructions.
+struct InstructionRecord {
+  // The offset of the instruction from the start of the decoded buffer.
+  uint32_t offset;
+  // The distorm opcode of the instruction, one of the I_* values.
+  uint16_t opcode;
+  // The size of the instruction, in bytes.
+  uint8_t size;
+  // The flow control type of the instruction, one of the FC_* values.
+  uint8_t flow_control;
+};
+
 // Wrapper for the distorm_decompose function to patch a bug in distorm.
 // @param ci Structure containing some information about the code to decompose
 //     (code origin, code data, code length, decoding mode and features).
@@ -62,6 +76,63 @@ bool DecodeOneInstruction(const uint8_t* buffer,
                           int length,
                           _DInst* instruction);
 
+// Decodes consecutive instructions from the given buffer, handing as many of
+// them as possible to distorm at once. Decoding stops at the end of the
+// buffer, at the first instruction that can't be decoded, or when
+// @p max_instructions have been decoded.
+// @param address the address of the first instruction.
+// @param buffer the buffer containing the data to decode.
+// @param length the length of the buffer.
+// @param features the distorm features to decode with. For instance,
+//     DF_STOP_ON_FLOW_CONTROL stops decoding after the first control flow
+//     instruction. Features that filter the decoded instructions aren't
+//     supported.
+// @param instructions receives the decoded instructions.
+// @param max_instructions the number of entries in @p instructions.
+// @returns the number of instructions that were decoded.
+size_t DecodeInstructions(uint32_t address,
+                          const uint8_t* buffer,
+                          size_t length,
+                          unsigned int features,
+                          _DInst* instructions,
+                          size_t max_instructions);
+
+// Decodes consecutive instructions from the given buffer to compact records.
+// Decoding stops at the end of the buffer, at the first instruction that
+// can't be decoded, or when @p max_records have been decoded.
+// @param address the address of the first instruction.
+// @param buffer the buffer containing the data to decode.
+// @param length the length of the buffer.
+// @param records receives the decoded instructions.
+// @param max_records the number of entries in @p records.
+// @param decoded_length receives the number of bytes that were decoded.
+// @returns the number of records that were decoded.
+size_t DecodeInstructionRecords(uint32_t address,
+                                const uint8_t* buffer,
+                                size_t length,
+                                InstructionRecord* records,
+                                size_t max_records,
+                                size_t* decoded_length);
+
+// Finds the control flow instructions of the given buffer. This is a pre-pass
+// for the callers that only care about the control flow, and it only records
+// the instructions that have a flow control type other than FC_NONE. It stops
+// like DecodeInstructionRecords, and @p decoded_length ends right after the
+// last recorded instruction when @p records is filled.
+// @param address the address of the first instruction.
+// @param buffer the buffer containing the data to decode.
+// @param length the length of the buffer.
+// @param records receives the control flow instructions.
+// @param max_records the number of entries in @p records.
+// @param decoded_length receives the number of bytes that were decoded.
+// @returns the number of records that were found.
+size_t FindControlFlowInstructions(uint32_t address,
+                                   const uint8_t* buffer,
+                                   size_t length,
+                                   InstructionRecord* records,
+                                   size_t max_records,
+                                   size_t* decoded_length);
+
 // Dump text representation of exactly one instruction to a std::string.
 // @param instruction the instruction to dump.
 // @param data points to the raw byte sequences.
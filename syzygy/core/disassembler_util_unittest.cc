@@ -14,6 +14,8 @@
 
 #include "syzygy/core/disassembler_util.h"
 
+#include <vector>
+
 #include "base/logging.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -148,6 +150,77 @@ TEST(DisassemblerUtilTest, DistormWrapperVxorpsPasses) {
   EXPECT_TRUE(DecodeOneInstruction(kVxorps, sizeof(kVxorps), &inst));
 }
 
+TEST(DisassemblerUtilTest, DecodeInstructions) {
+  // A bit of code that contains an instruction that distorm can't decode on
+  // its own, between calls, a branch and a return.
+  const uint8_t kCode[] = {
+      0x8B, 0xFF,                          // mov edi, edi
+      0xE8, 0xCA, 0xFE, 0xBA, 0xBE,        // call
+      0xC4, 0xE2, 0x4D, 0x36, 0xC0,        // vpermd ymm0, ymm6, ymm0
+      0xE8, 0xCA, 0xFE, 0xBA, 0xBE,        // call
+      0x74, 0xCA,                          // je
+      0xC3,                                // ret
+  };
+  std::vector<uint8_t> code(kCode, kCode + sizeof(kCode));
+  const uint32_t kAddress = 0x10000000;
+
+  _DInst instructions[10] = {};
+  EXPECT_EQ(6u, DecodeInstructions(kAddress, code.data(), code.size(),
+                                   DF_NONE, instructions,
+                                   arraysize(instructions)));
+  uint32_t offset = 0;
+  for (size_t i = 0; i < 6; ++i) {
+    EXPECT_EQ(kAddress + offset, instructions[i].addr);
+    offset += instructions[i].size;
+  }
+  EXPECT_EQ(code.size(), offset);
+  EXPECT_EQ(sizeof(kVpermd), instructions[2].size);
+  EXPECT_TRUE(IsReturn(instructions[5]));
+
+  // Decoding stops when the output is full, or at control flow if asked to.
+  EXPECT_EQ(3u, DecodeInstructions(kAddress, code.data(), code.size(),
+                                   DF_NONE, instructions, 3));
+  EXPECT_EQ(2u, DecodeInstructions(kAddress, code.data(), code.size(),
+                                   DF_STOP_ON_FLOW_CONTROL, instructions,
+                                   arraysize(instructions)));
+  EXPECT_TRUE(IsCall(instructions[1]));
+
+  // And at the first instruction that can't be decoded.
+  EXPECT_EQ(0u, DecodeInstructions(kAddress, kCall, sizeof(kCall) - 1,
+                                   DF_NONE, instructions,
+                                   arraysize(instructions)));
+
+  InstructionRecord records[10] = {};
+  size_t decoded_length = 0;
+  EXPECT_EQ(6u, DecodeInstructionRecords(kAddress, code.data(), code.size(),
+                                         records, arraysize(records),
+                                         &decoded_length));
+  EXPECT_EQ(code.size(), decoded_length);
+  for (size_t i = 0; i < 6; ++i) {
+    EXPECT_EQ(instructions[i].addr - kAddress, records[i].offset);
+    EXPECT_EQ(instructions[i].size, records[i].size);
+    EXPECT_EQ(instructions[i].opcode, records[i].opcode);
+    EXPECT_EQ(META_GET_FC(instructions[i].meta), records[i].flow_control);
+  }
+
+  // The control flow pre-pass skips the other instructions.
+  EXPECT_EQ(4u, FindControlFlowInstructions(kAddress, code.data(),
+                                            code.size(), records,
+                                            arraysize(records),
+                                            &decoded_length));
+  EXPECT_EQ(code.size(), decoded_length);
+  EXPECT_EQ(FC_CALL, records[0].flow_control);
+  EXPECT_EQ(sizeof(kNop2Mov), records[0].offset);
+  EXPECT_EQ(FC_CALL, records[1].flow_control);
+  EXPECT_EQ(FC_CND_BRANCH, records[2].flow_control);
+  EXPECT_EQ(FC_RET, records[3].flow_control);
+
+  EXPECT_EQ(1u, FindControlFlowInstructions(kAddress, code.data(),
+                                            code.size(), records, 1,
+                                            &decoded_length));
+  EXPECT_EQ(sizeof(kNop2Mov) + sizeof(kCall), decoded_length);
+}
+
 TEST(DisassemblerUtilTest, InstructionToString) {
   _DInst inst = {};
   inst = DecodeBuffer(kNop1, sizeof(kNop1));
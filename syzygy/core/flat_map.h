@@ -0,0 +1,201 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares FlatMap, a sorted associative container stored in a contiguous
+// vector. It implements the subset of the std::map interface that is used by
+// core::AddressSpace, so that it can be used as its backing store.
+//
+// Lookups are binary searches over contiguous memory, which are a lot more
+// cache friendly than walking the nodes of a tree. Insertions and removals
+// are linear in the size of the map, except for insertions at the end, which
+// are amortized constant. This makes it suited to maps that are built once,
+// in order, and then queried many times.
+
+#ifndef SYZYGY_CORE_FLAT_MAP_H_
+#define SYZYGY_CORE_FLAT_MAP_H_
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace core {
+
+// A map that keeps its values in a vector sorted by key. Unlike std::map,
+// the keys of the values aren't const, and must not be modified through the
+// iterators. Any insertion or removal invalidates all the iterators.
+//
+// @tparam Key The type of the keys.
+// @tparam T The type of the mapped values.
+// @tparam Compare The strict weak ordering of the keys.
+template <typename Key, typename T, typename Compare = std::less<Key>>
+class FlatMap {
+ public:
+  typedef Key key_type;
+  typedef T mapped_type;
+  typedef std::pair<Key, T> value_type;
+  typedef Compare key_compare;
+  typedef std::vector<value_type> Values;
+  typedef typename Values::size_type size_type;
+  typedef typename Values::iterator iterator;
+  typedef typename Values::const_iterator const_iterator;
+  typedef typename Values::reverse_iterator reverse_iterator;
+  typedef typename Values::const_reverse_iterator const_reverse_iterator;
+
+  FlatMap() { }
+
+  // @name Iteration.
+  // @{
+  iterator begin() { return values_.begin(); }
+  const_iterator begin() const { return values_.begin(); }
+  iterator end() { return values_.end(); }
+  const_iterator end() const { return values_.end(); }
+  reverse_iterator rbegin() { return values_.rbegin(); }
+  const_reverse_iterator rbegin() const { return values_.rbegin(); }
+  reverse_iterator rend() { return values_.rend(); }
+  const_reverse_iterator rend() const { return values_.rend(); }
+  // @}
+
+  // @name Capacity.
+  // @{
+  bool empty() const { return values_.empty(); }
+  size_type size() const { return values_.size(); }
+  // Reserves room for @p count values, to avoid reallocations when the size
+  // of the map is known in advance.
+  void reserve(size_type count) { values_.reserve(count); }
+  // @}
+
+  // Inserts a value unless its key is already in the map.
+  // @param value The value to insert.
+  // @returns an iterator to the value with the key of @p value, and true if
+  //     @p value was inserted.
+  std::pair<iterator, bool> insert(const value_type& value);
+
+  // @name Removal.
+  // @{
+  iterator erase(const_iterator it) {
+    return values_.erase(values_.begin() + (it - values_.cbegin()));
+  }
+  iterator erase(const_iterator first, const_iterator last) {
+    return values_.erase(values_.begin() + (first - values_.cbegin()),
+                         values_.begin() + (last - values_.cbegin()));
+  }
+  size_type erase(const key_type& key);
+  void clear() { values_.clear(); }
+  // @}
+
+  // @name Lookup.
+  // @{
+  iterator find(const key_type& key);
+  const_iterator find(const key_type& key) const;
+  size_type count(const key_type& key) const {
+    return find(key) == end() ? 0 : 1;
+  }
+  iterator lower_bound(const key_type& key);
+  const_iterator lower_bound(const key_type& key) const;
+  iterator upper_bound(const key_type& key);
+  const_iterator upper_bound(const key_type& key) const;
+  // @}
+
+  bool operator==(const FlatMap& other) const {
+    return values_ == other.values_;
+  }
+  bool operator!=(const FlatMap& other) const {
+    return values_ != other.values_;
+  }
+
+ private:
+  // Compares values with keys, for the binary searches.
+  struct ValueCompare {
+    bool operator()(const value_type& value, const key_type& key) const {
+      return Compare()(value.first, key);
+    }
+    bool operator()(const key_type& key, const value_type& value) const {
+      return Compare()(key, value.first);
+    }
+  };
+
+  Values values_;
+};
+
+template <typename Key, typename T, typename Compare>
+std::pair<typename FlatMap<Key, T, Compare>::iterator, bool>
+FlatMap<Key, T, Compare>::insert(const value_type& value) {
+  // Values that are inserted in order go at the end, which is cheap.
+  if (values_.empty() || Compare()(values_.back().first, value.first)) {
+    values_.push_back(value);
+    return std::make_pair(values_.end() - 1, true);
+  }
+
+  iterator it = lower_bound(value.first);
+  if (it != values_.end() && !Compare()(value.first, it->first))
+    return std::make_pair(it, false);
+  return std::make_pair(values_.insert(it, value), true);
+}
+
+template <typename Key, typename T, typename Compare>
+typename FlatMap<Key, T, Compare>::size_type FlatMap<Key, T, Compare>::erase(
+    const key_type& key) {
+  iterator it = find(key);
+  if (it == values_.end())
+    return 0;
+  values_.erase(it);
+  return 1;
+}
+
+template <typename Key, typename T, typename Compare>
+typename FlatMap<Key, T, Compare>::iterator FlatMap<Key, T, Compare>::find(
+    const key_type& key) {
+  iterator it = lower_bound(key);
+  if (it != values_.end() && !Compare()(key, it->first))
+    return it;
+  return values_.end();
+}
+
+template <typename Key, typename T, typename Compare>
+typename FlatMap<Key, T, Compare>::const_iterator
+FlatMap<Key, T, Compare>::find(const key_type& key) const {
+  const_iterator it = lower_bound(key);
+  if (it != values_.end() && !Compare()(key, it->first))
+    return it;
+  return values_.end();
+}
+
+template <typename Key, typename T, typename Compare>
+typename FlatMap<Key, T, Compare>::iterator
+FlatMap<Key, T, Compare>::lower_bound(const key_type& key) {
+  return std::lower_bound(values_.begin(), values_.end(), key, ValueCompare());
+}
+
+template <typename Key, typename T, typename Compare>
+typename FlatMap<Key, T, Compare>::const_iterator
+FlatMap<Key, T, Compare>::lower_bound(const key_type& key) const {
+  return std::lower_bound(values_.begin(), values_.end(), key, ValueCompare());
+}
+
+template <typename Key, typename T, typename Compare>
+typename FlatMap<Key, T, Compare>::iterator
+FlatMap<Key, T, Compare>::upper_bound(const key_type& key) {
+  return std::upper_bound(values_.begin(), values_.end(), key, ValueCompare());
+}
+
+template <typename Key, typename T, typename Compare>
+typename FlatMap<Key, T, Compare>::const_iterator
+FlatMap<Key, T, Compare>::upper_bound(const key_type& key) const {
+  return std::upper_bound(values_.begin(), values_.end(), key, ValueCompare());
+}
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_FLAT_MAP_H_
@@ -0,0 +1,95 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/flat_map.h"
+
+#include "gtest/gtest.h"
+
+namespace core {
+
+namespace {
+
+typedef FlatMap<int, int> IntegerFlatMap;
+
+}  // namespace
+
+TEST(FlatMapTest, Insert) {
+  IntegerFlatMap map;
+  EXPECT_TRUE(map.empty());
+
+  // Values are kept sorted whatever the insertion order.
+  EXPECT_TRUE(map.insert(std::make_pair(2, 20)).second);
+  EXPECT_TRUE(map.insert(std::make_pair(3, 30)).second);
+  EXPECT_TRUE(map.insert(std::make_pair(1, 10)).second);
+  EXPECT_EQ(3u, map.size());
+
+  int expected_key = 1;
+  for (const auto& value : map) {
+    EXPECT_EQ(expected_key, value.first);
+    EXPECT_EQ(expected_key * 10, value.second);
+    ++expected_key;
+  }
+
+  // Duplicate keys are rejected, and the existing value is returned.
+  std::pair<IntegerFlatMap::iterator, bool> inserted =
+      map.insert(std::make_pair(2, 0));
+  EXPECT_FALSE(inserted.second);
+  ASSERT_TRUE(inserted.first != map.end());
+  EXPECT_EQ(20, inserted.first->second);
+  EXPECT_EQ(3u, map.size());
+}
+
+TEST(FlatMapTest, Lookup) {
+  IntegerFlatMap map;
+  map.reserve(3);
+  map.insert(std::make_pair(10, 1));
+  map.insert(std::make_pair(20, 2));
+  map.insert(std::make_pair(30, 3));
+
+  ASSERT_TRUE(map.find(20) != map.end());
+  EXPECT_EQ(2, map.find(20)->second);
+  EXPECT_TRUE(map.find(15) == map.end());
+  EXPECT_EQ(1u, map.count(30));
+  EXPECT_EQ(0u, map.count(31));
+
+  EXPECT_EQ(20, map.lower_bound(20)->first);
+  EXPECT_EQ(30, map.upper_bound(20)->first);
+  EXPECT_EQ(20, map.lower_bound(11)->first);
+  EXPECT_TRUE(map.lower_bound(31) == map.end());
+  EXPECT_EQ(30, map.rbegin()->first);
+}
+
+TEST(FlatMapTest, Erase) {
+  IntegerFlatMap map;
+  for (int i = 0; i < 10; ++i)
+    map.insert(std::make_pair(i, i));
+
+  EXPECT_EQ(1u, map.erase(5));
+  EXPECT_EQ(0u, map.erase(5));
+  EXPECT_EQ(9u, map.size());
+
+  IntegerFlatMap::iterator it = map.erase(map.find(0));
+  EXPECT_EQ(1, it->first);
+  map.erase(map.lower_bound(6), map.end());
+  EXPECT_EQ(4u, map.size());
+  EXPECT_EQ(4, map.rbegin()->first);
+
+  IntegerFlatMap copy(map);
+  EXPECT_TRUE(copy == map);
+  map.clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(copy != map);
+}
+
+}  // namespace core
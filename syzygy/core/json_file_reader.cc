@@ -0,0 +1,368 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/json_file_reader.h"
+
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+
+namespace core {
+
+namespace {
+
+// Appends the UTF-8 encoding of @p code_point to @p str.
+void AppendUTF8(uint32_t code_point, std::string* str) {
+  DCHECK(str != NULL);
+  if (code_point < 0x80) {
+    str->push_back(static_cast<char>(code_point));
+  } else if (code_point < 0x800) {
+    str->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+    str->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else if (code_point < 0x10000) {
+    str->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+    str->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    str->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else {
+    str->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+    str->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+    str->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    str->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+}
+
+}  // namespace
+
+JSONFileReader::JSONFileReader(FILE* file)
+    : file_(file),
+      buffer_(kBufferSize),
+      position_(0),
+      size_(0),
+      offset_(0),
+      finished_(false),
+      integer_value_(0),
+      double_value_(0.0),
+      boolean_value_(false) {
+  DCHECK(file != NULL);
+}
+
+JSONFileReader::~JSONFileReader() {
+}
+
+bool JSONFileReader::Read(TokenType* type) {
+  DCHECK(type != NULL);
+
+  if (!SkipWhitespace())
+    return false;
+
+  // Once the value has been read, only whitespace may follow it.
+  if (finished_) {
+    if (Peek() != EOF)
+      return Error("Unexpected data after the end of the value.");
+    *type = kEnd;
+    return true;
+  }
+
+  if (stack_.empty())
+    return ReadValue(type);
+
+  StackElement& top = stack_.back();
+  if (top.awaiting_value) {
+    top.awaiting_value = false;
+    return ReadValue(type);
+  }
+
+  // Close the structure, or move on to its next entry.
+  if (Consume(top.is_dict ? '}' : ']')) {
+    *type = top.is_dict ? kDictEnd : kListEnd;
+    stack_.pop_back();
+    if (stack_.empty())
+      finished_ = true;
+    return true;
+  }
+  if (top.has_entries) {
+    if (!Consume(','))
+      return Error("Expected a comma.");
+    if (!SkipWhitespace())
+      return false;
+  }
+  top.has_entries = true;
+
+  if (!top.is_dict)
+    return ReadValue(type);
+
+  if (Peek() != '"')
+    return Error("Expected a dictionary key.");
+  if (!ReadString() || !SkipWhitespace())
+    return false;
+  if (!Consume(':'))
+    return Error("Expected a colon after a dictionary key.");
+  top.awaiting_value = true;
+  *type = kKey;
+  return true;
+}
+
+bool JSONFileReader::SkipValue() {
+  TokenType type = kEnd;
+  if (!Read(&type))
+    return false;
+  if (type == kKey || type == kListEnd || type == kDictEnd || type == kEnd)
+    return Error("Expected a value.");
+
+  size_t depth = 0;
+  if (type == kListStart || type == kDictStart)
+    depth = 1;
+  while (depth > 0) {
+    if (!Read(&type))
+      return false;
+    if (type == kListStart || type == kDictStart)
+      ++depth;
+    else if (type == kListEnd || type == kDictEnd)
+      --depth;
+  }
+
+  return true;
+}
+
+int JSONFileReader::Peek() {
+  if (position_ == size_) {
+    size_ = fread(&buffer_[0], 1, buffer_.size(), file_);
+    position_ = 0;
+    if (size_ == 0)
+      return EOF;
+  }
+  return static_cast<unsigned char>(buffer_[position_]);
+}
+
+bool JSONFileReader::Consume(char c) {
+  if (Peek() != static_cast<unsigned char>(c))
+    return false;
+  Advance();
+  return true;
+}
+
+bool JSONFileReader::SkipWhitespace() {
+  while (true) {
+    int c = Peek();
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+      Advance();
+      continue;
+    }
+    if (c != '/')
+      return true;
+
+    // A comment, which runs to the end of the line, or to its terminator.
+    Advance();
+    if (Consume('/')) {
+      while ((c = Peek()) != EOF && c != '\n')
+        Advance();
+    } else if (Consume('*')) {
+      bool star = false;
+      while (true) {
+        c = Peek();
+        if (c == EOF)
+          return Error("Unterminated comment.");
+        Advance();
+        if (star && c == '/')
+          break;
+        star = c == '*';
+      }
+    } else {
+      return Error("Malformed comment.");
+    }
+  }
+}
+
+bool JSONFileReader::ReadValue(TokenType* type) {
+  DCHECK(type != NULL);
+
+  // A scalar at the top level is the whole value.
+  bool top_level = stack_.empty();
+
+  switch (Peek()) {
+    case '[':
+    case '{': {
+      bool is_dict = Peek() == '{';
+      Advance();
+      stack_.push_back(StackElement(is_dict));
+      *type = is_dict ? kDictStart : kListStart;
+      return true;
+    }
+
+    case '"': {
+      if (!ReadString())
+        return false;
+      *type = kString;
+      break;
+    }
+
+    case 't':
+    case 'f': {
+      boolean_value_ = Peek() == 't';
+      if (!ReadLiteral(boolean_value_ ? "true" : "false"))
+        return false;
+      *type = kBoolean;
+      break;
+    }
+
+    case 'n': {
+      if (!ReadLiteral("null"))
+        return false;
+      *type = kNull;
+      break;
+    }
+
+    case EOF:
+      return Error("Unexpected end of file.");
+
+    default: {
+      if (!ReadNumber(type))
+        return false;
+      break;
+    }
+  }
+
+  if (top_level)
+    finished_ = true;
+  return true;
+}
+
+bool JSONFileReader::ReadString() {
+  DCHECK_EQ('"', Peek());
+  Advance();
+
+  string_value_.clear();
+  while (true) {
+    int c = Peek();
+    if (c == EOF)
+      return Error("Unterminated string.");
+    if (c < 0x20)
+      return Error("Control character in a string.");
+    Advance();
+
+    if (c == '"')
+      return true;
+    if (c != '\\') {
+      string_value_.push_back(static_cast<char>(c));
+      continue;
+    }
+
+    c = Peek();
+    if (c == EOF)
+      return Error("Unterminated string.");
+    Advance();
+    switch (c) {
+      case '"': string_value_.push_back('"'); break;
+      case '\\': string_value_.push_back('\\'); break;
+      case '/': string_value_.push_back('/'); break;
+      case 'b': string_value_.push_back('\b'); break;
+      case 'f': string_value_.push_back('\f'); break;
+      case 'n': string_value_.push_back('\n'); break;
+      case 'r': string_value_.push_back('\r'); break;
+      case 't': string_value_.push_back('\t'); break;
+
+      case 'u': {
+        uint32_t code_point = 0;
+        if (!ReadHex4(&code_point))
+          return false;
+
+        // A high surrogate must be followed by the escape sequence of a low
+        // surrogate.
+        if (code_point >= 0xD800 && code_point < 0xDC00) {
+          uint32_t low = 0;
+          if (!Consume('\\') || !Consume('u') || !ReadHex4(&low) ||
+              low < 0xDC00 || low >= 0xE000) {
+            return Error("Invalid surrogate pair.");
+          }
+          code_point = 0x10000 + ((code_point - 0xD800) << 10) +
+              (low - 0xDC00);
+        } else if (code_point >= 0xDC00 && code_point < 0xE000) {
+          return Error("Invalid surrogate pair.");
+        }
+        AppendUTF8(code_point, &string_value_);
+        break;
+      }
+
+      default:
+        return Error("Invalid escape sequence.");
+    }
+  }
+}
+
+bool JSONFileReader::ReadNumber(TokenType* type) {
+  DCHECK(type != NULL);
+
+  number_.clear();
+  bool integral = true;
+  while (true) {
+    int c = Peek();
+    if (c == '.' || c == 'e' || c == 'E') {
+      integral = false;
+    } else if (!(c >= '0' && c <= '9') && c != '-' && c != '+') {
+      break;
+    }
+    number_.push_back(static_cast<char>(c));
+    Advance();
+  }
+
+  if (number_.empty())
+    return Error("Unexpected character.");
+
+  // Integers that overflow an int64_t are read as doubles.
+  if (integral && base::StringToInt64(number_, &integer_value_)) {
+    double_value_ = static_cast<double>(integer_value_);
+    *type = kInteger;
+    return true;
+  }
+  if (!base::StringToDouble(number_, &double_value_))
+    return Error("Invalid number.");
+  *type = kDouble;
+  return true;
+}
+
+bool JSONFileReader::ReadLiteral(const char* literal) {
+  DCHECK(literal != NULL);
+  for (; *literal != '\0'; ++literal) {
+    if (!Consume(*literal))
+      return Error("Invalid literal.");
+  }
+  return true;
+}
+
+bool JSONFileReader::ReadHex4(uint32_t* value) {
+  DCHECK(value != NULL);
+  *value = 0;
+  for (size_t i = 0; i < 4; ++i) {
+    int c = Peek();
+    uint32_t digit = 0;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else {
+      return Error("Invalid unicode escape sequence.");
+    }
+    Advance();
+    *value = (*value << 4) | digit;
+  }
+  return true;
+}
+
+bool JSONFileReader::Error(const char* message) {
+  LOG(ERROR) << message << " (at offset " << offset_ << ")";
+  return false;
+}
+
+}  // namespace core
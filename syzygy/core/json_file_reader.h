@@ -0,0 +1,170 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// JSONFileReader is the counterpart of JSONFileWriter: it reads JSON
+// formatted input directly from a file, a token at a time, rather than
+// parsing it to a base::Value tree first. This lets the large files written
+// by the toolchain be loaded without holding their whole representation in
+// memory.
+#ifndef SYZYGY_CORE_JSON_FILE_READER_H_
+#define SYZYGY_CORE_JSON_FILE_READER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+
+namespace core {
+
+// Reads a single JSON value from a file, as a stream of tokens. Both the
+// pretty printed and the compact outputs of JSONFileWriter are accepted,
+// including their comments. Sample usage:
+//
+// JSONFileReader reader(file);
+// JSONFileReader::TokenType type = JSONFileReader::kEnd;
+// while (reader.Read(&type) && type != JSONFileReader::kEnd) {
+//   if (type == JSONFileReader::kInteger)
+//     Process(reader.integer_value());
+// }
+//
+// The reader validates the structure of the input: the tokens it returns
+// always form a valid JSON value, and it fails as soon as they can't.
+class JSONFileReader {
+ public:
+  // The types of the tokens.
+  enum TokenType {
+    kListStart,
+    kListEnd,
+    kDictStart,
+    kDictEnd,
+    // A dictionary key. Its name is the string value.
+    kKey,
+    kString,
+    // An integral number that fits in an int64_t. Its value is also
+    // available as a double.
+    kInteger,
+    kDouble,
+    kBoolean,
+    kNull,
+    // Returned once the value of the file has been read in full.
+    kEnd,
+  };
+
+  // The size of the input buffer.
+  static const size_t kBufferSize = 64 * 1024;
+
+  // Creates a reader for the given file, starting at its current position.
+  // @param file the file to read from.
+  explicit JSONFileReader(FILE* file);
+  ~JSONFileReader();
+
+  // Reads the next token.
+  // @param type receives the type of the token.
+  // @returns true on success, false if the input can't be read or is not
+  //     valid JSON.
+  bool Read(TokenType* type);
+
+  // Reads the next value in full and discards it. This must be called where
+  // a value is expected, such as after a key.
+  // @returns true on success, false otherwise.
+  bool SkipValue();
+
+  // @name Accessors for the value of the last token.
+  // @{
+  // The name of a key, or the value of a string.
+  const std::string& string_value() const { return string_value_; }
+  int64_t integer_value() const { return integer_value_; }
+  // The value of a double, or of an integer.
+  double double_value() const { return double_value_; }
+  bool boolean_value() const { return boolean_value_; }
+  // @}
+
+ protected:
+  // An open structure.
+  struct StackElement {
+    explicit StackElement(bool is_dict)
+        : is_dict(is_dict), has_entries(false), awaiting_value(false) {
+    }
+
+    bool is_dict;
+    // True once the first entry of the structure has been read.
+    bool has_entries;
+    // True if a key was read, and its value is next.
+    bool awaiting_value;
+  };
+
+  // @returns the next character without consuming it, or EOF at the end of
+  //     the file.
+  int Peek();
+  // Consumes the next character.
+  void Advance() {
+    ++position_;
+    ++offset_;
+  }
+  // Consumes the next character if it's @p c.
+  // @returns true if @p c was consumed.
+  bool Consume(char c);
+
+  // Skips any whitespace and comments.
+  // @returns true on success, false if a comment is malformed.
+  bool SkipWhitespace();
+
+  // Reads a value, or the start of a structure.
+  bool ReadValue(TokenType* type);
+  // Reads a quoted string to string_value_.
+  bool ReadString();
+  // Reads a number to integer_value_ and double_value_.
+  bool ReadNumber(TokenType* type);
+  // Reads the rest of a literal once its first character was seen.
+  bool ReadLiteral(const char* literal);
+  // Reads 4 hexadecimal digits of a unicode escape sequence.
+  bool ReadHex4(uint32_t* value);
+
+  // Logs an error at the current offset.
+  // @returns false.
+  bool Error(const char* message);
+
+  // The file being read.
+  FILE* file_;
+  // The input buffer, the position of the next character in it, and the
+  // number of characters it holds.
+  std::vector<char> buffer_;
+  size_t position_;
+  size_t size_;
+  // The offset of the next character in the input.
+  size_t offset_;
+
+  // The currently open structures.
+  std::vector<StackElement> stack_;
+  // True once the value of the file has been read in full.
+  bool finished_;
+
+  // The value of the last token.
+  std::string string_value_;
+  int64_t integer_value_;
+  double double_value_;
+  bool boolean_value_;
+
+  // The characters of the last number, reused across numbers.
+  std::string number_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(JSONFileReader);
+};
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_JSON_FILE_READER_H_
@@ -0,0 +1,238 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/json_file_reader.h"
+
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/json_file_writer.h"
+
+namespace core {
+
+namespace {
+
+class JSONFileReaderTest : public testing::Test {
+ public:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+  }
+
+  // Creates a file holding @p contents, positioned at its start.
+  void CreateFile(const base::StringPiece& contents) {
+    base::FilePath path;
+    file_.reset(base::CreateAndOpenTemporaryFileInDir(temp_dir_.path(),
+                                                      &path));
+    ASSERT_TRUE(file_.get() != NULL);
+    ASSERT_EQ(contents.size(),
+              fwrite(contents.data(), 1, contents.size(), file_.get()));
+    ASSERT_EQ(0, fseek(file_.get(), 0, SEEK_SET));
+  }
+
+  // Writes a sample file with JSONFileWriter, positioned at its start.
+  void WriteSampleFile(bool pretty_print) {
+    base::FilePath path;
+    file_.reset(base::CreateAndOpenTemporaryFileInDir(temp_dir_.path(),
+                                                      &path));
+    ASSERT_TRUE(file_.get() != NULL);
+
+    JSONFileWriter writer(file_.get(), pretty_print);
+    ASSERT_TRUE(writer.OutputComment("A sample file."));
+    ASSERT_TRUE(writer.OpenDict());
+    ASSERT_TRUE(writer.OutputKey("name"));
+    ASSERT_TRUE(writer.OutputString("sample \"value\"\n"));
+    ASSERT_TRUE(writer.OutputKey("values"));
+    ASSERT_TRUE(writer.OpenList());
+    ASSERT_TRUE(writer.OutputInteger(-42));
+    ASSERT_TRUE(writer.OutputTrailingComment("The answer."));
+    ASSERT_TRUE(writer.OutputDouble(2.5));
+    ASSERT_TRUE(writer.OutputBoolean(true));
+    ASSERT_TRUE(writer.OutputNull());
+    ASSERT_TRUE(writer.CloseList());
+    ASSERT_TRUE(writer.OutputKey("empty"));
+    ASSERT_TRUE(writer.OpenDict());
+    ASSERT_TRUE(writer.CloseDict());
+    ASSERT_TRUE(writer.CloseDict());
+    ASSERT_TRUE(writer.Finished());
+    ASSERT_EQ(0, fseek(file_.get(), 0, SEEK_SET));
+  }
+
+  // Reads the sample file, and checks its tokens.
+  void ReadSampleFile() {
+    JSONFileReader reader(file_.get());
+    JSONFileReader::TokenType type = JSONFileReader::kEnd;
+
+    ASSERT_TRUE(reader.Read(&type));
+    EXPECT_EQ(JSONFileReader::kDictStart, type);
+    ASSERT_TRUE(reader.Read(&type));
+    EXPECT_EQ(JSONFileReader::kKey, type);
+    EXPECT_EQ("name", reader.string_value());
+    ASSERT_TRUE(reader.Read(&type));
+    EXPECT_EQ(JSONFileReader::kString, type);
+    EXPECT_EQ("sample \"value\"\n", reader.string_value());
+
+    ASSERT_TRUE(reader.Read(&type));
+    EXPECT_EQ(JSONFileReader::kKey, type);
+    EXPECT_EQ("values", reader.string_value());
+    ASSERT_TRUE(reader.Read(&type));
+    EXPECT_EQ(JSONFileReader::kListStart, type);
+    ASSERT_TRUE(reader.Read(&type));
+    EXPECT_EQ(JSONFileReader::kInteger, type);
+    EXPECT_EQ(-42, reader.integer_value());
+    EXPECT_EQ(-42.0, reader.double_value());
+    ASSERT_TRUE(reader.Read(&type));
+    EXPECT_EQ(JSONFileReader::kDouble, type);
+    EXPECT_EQ(2.5, reader.double_value());
+    ASSERT_TRUE(reader.Read(&type));
+    EXPECT_EQ(JSONFileReader::kBoolean, type);
+    EXPECT_TRUE(reader.boolean_value());
+    ASSERT_TRUE(reader.Read(&type));
+    EXPECT_EQ(JSONFileReader::kNull, type);
+    ASSERT_TRUE(reader.Read(&type));
+    EXPECT_EQ(JSONFileReader::kListEnd, type);
+
+    ASSERT_TRUE(reader.Read(&type));
+    EXPECT_EQ(JSONFileReader::kKey, type);
+    EXPECT_EQ("empty", reader.string_value());
+    ASSERT_TRUE(reader.Read(&type));
+    EXPECT_EQ(JSONFileReader::kDictStart, type);
+    ASSERT_TRUE(reader.Read(&type));
+    EXPECT_EQ(JSONFileReader::kDictEnd, type);
+
+    ASSERT_TRUE(reader.Read(&type));
+    EXPECT_EQ(JSONFileReader::kDictEnd, type);
+    ASSERT_TRUE(reader.Read(&type));
+    EXPECT_EQ(JSONFileReader::kEnd, type);
+  }
+
+  // @returns true if the whole of @p contents can be read.
+  bool CanRead(const base::StringPiece& contents) {
+    CreateFile(contents);
+    JSONFileReader reader(file_.get());
+    JSONFileReader::TokenType type = JSONFileReader::kEnd;
+    do {
+      if (!reader.Read(&type))
+        return false;
+    } while (type != JSONFileReader::kEnd);
+    return true;
+  }
+
+ protected:
+  base::ScopedTempDir temp_dir_;
+  base::ScopedFILE file_;
+};
+
+}  // namespace
+
+TEST_F(JSONFileReaderTest, ReadsCompactOutput) {
+  ASSERT_NO_FATAL_FAILURE(WriteSampleFile(false));
+  ASSERT_NO_FATAL_FAILURE(ReadSampleFile());
+}
+
+TEST_F(JSONFileReaderTest, ReadsPrettyPrintedOutput) {
+  ASSERT_NO_FATAL_FAILURE(WriteSampleFile(true));
+  ASSERT_NO_FATAL_FAILURE(ReadSampleFile());
+}
+
+TEST_F(JSONFileReaderTest, ReadsScalar) {
+  ASSERT_NO_FATAL_FAILURE(CreateFile(" 12345678901234 "));
+  JSONFileReader reader(file_.get());
+  JSONFileReader::TokenType type = JSONFileReader::kEnd;
+  ASSERT_TRUE(reader.Read(&type));
+  EXPECT_EQ(JSONFileReader::kInteger, type);
+  EXPECT_EQ(12345678901234LL, reader.integer_value());
+  ASSERT_TRUE(reader.Read(&type));
+  EXPECT_EQ(JSONFileReader::kEnd, type);
+}
+
+TEST_F(JSONFileReaderTest, ReadsEscapeSequences) {
+  ASSERT_NO_FATAL_FAILURE(
+      CreateFile("[\"\\u0041\\u00E9\\uD83D\\uDE00\\/\\t\"]"));
+  JSONFileReader reader(file_.get());
+  JSONFileReader::TokenType type = JSONFileReader::kEnd;
+  ASSERT_TRUE(reader.Read(&type));
+  ASSERT_TRUE(reader.Read(&type));
+  EXPECT_EQ(JSONFileReader::kString, type);
+  EXPECT_EQ("A\xC3\xA9\xF0\x9F\x98\x80/\t", reader.string_value());
+}
+
+TEST_F(JSONFileReaderTest, SkipValue) {
+  ASSERT_NO_FATAL_FAILURE(
+      CreateFile("{\"skipped\": [1, {\"a\": [2]}], \"kept\": 3}"));
+  JSONFileReader reader(file_.get());
+  JSONFileReader::TokenType type = JSONFileReader::kEnd;
+  ASSERT_TRUE(reader.Read(&type));
+  ASSERT_TRUE(reader.Read(&type));
+  EXPECT_EQ("skipped", reader.string_value());
+  ASSERT_TRUE(reader.SkipValue());
+
+  ASSERT_TRUE(reader.Read(&type));
+  EXPECT_EQ(JSONFileReader::kKey, type);
+  EXPECT_EQ("kept", reader.string_value());
+  ASSERT_TRUE(reader.Read(&type));
+  EXPECT_EQ(3, reader.integer_value());
+
+  // There is no value to skip at the end of the dictionary.
+  EXPECT_FALSE(reader.SkipValue());
+}
+
+TEST_F(JSONFileReaderTest, ReadsLargeFile) {
+  // Enough values to span several input buffers.
+  base::FilePath path;
+  file_.reset(base::CreateAndOpenTemporaryFileInDir(temp_dir_.path(), &path));
+  ASSERT_TRUE(file_.get() != NULL);
+  const int kValueCount = 100000;
+  {
+    JSONFileWriter writer(file_.get(), true);
+    ASSERT_TRUE(writer.OpenList());
+    for (int i = 0; i < kValueCount; ++i)
+      ASSERT_TRUE(writer.OutputInteger(i));
+    ASSERT_TRUE(writer.CloseList());
+  }
+  ASSERT_EQ(0, fseek(file_.get(), 0, SEEK_SET));
+
+  JSONFileReader reader(file_.get());
+  JSONFileReader::TokenType type = JSONFileReader::kEnd;
+  ASSERT_TRUE(reader.Read(&type));
+  for (int i = 0; i < kValueCount; ++i) {
+    ASSERT_TRUE(reader.Read(&type));
+    ASSERT_EQ(JSONFileReader::kInteger, type);
+    ASSERT_EQ(i, reader.integer_value());
+  }
+  ASSERT_TRUE(reader.Read(&type));
+  EXPECT_EQ(JSONFileReader::kListEnd, type);
+  ASSERT_TRUE(reader.Read(&type));
+  EXPECT_EQ(JSONFileReader::kEnd, type);
+}
+
+TEST_F(JSONFileReaderTest, FailsOnInvalidInput) {
+  EXPECT_TRUE(CanRead("/* comment */ [1, 2] // comment"));
+
+  EXPECT_FALSE(CanRead(""));
+  EXPECT_FALSE(CanRead("[1, 2"));
+  EXPECT_FALSE(CanRead("[1, 2,]"));
+  EXPECT_FALSE(CanRead("[1 2]"));
+  EXPECT_FALSE(CanRead("[1, 2}"));
+  EXPECT_FALSE(CanRead("{\"a\" 1}"));
+  EXPECT_FALSE(CanRead("{\"a\": }"));
+  EXPECT_FALSE(CanRead("{1: 2}"));
+  EXPECT_FALSE(CanRead("[\"unterminated]"));
+  EXPECT_FALSE(CanRead("[\"\\q\"]"));
+  EXPECT_FALSE(CanRead("[\"\\uD83D\"]"));
+  EXPECT_FALSE(CanRead("[tru]"));
+  EXPECT_FALSE(CanRead("[1] 2"));
+  EXPECT_FALSE(CanRead("/* unterminated"));
+}
+
+}  // namespace core
@@ -25,6 +25,7 @@
 #include "base/values.h"
 #include "base/json/json_writer.h"
 #include "base/json/string_escape.h"
+#include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 
 namespace core {
@@ -39,10 +40,38 @@ static const char kNull[] = "null";
 static const char kTrue[] = "true";
 static const char kFalse[] = "false";
 static const char kCommentPrefix[] = "//";
+static const char kHexDigits[] = "0123456789ABCDEF";
 
 static const char* kStructureOpenings[] = { "[", "{", NULL };
 static const char* kStructureClosings[] = { "]", "}", NULL };
 
+// Returns true if @p str can be output as a JSON string by simply quoting it.
+// This is conservative: the characters that base::GetQuotedJSONString escapes
+// and the non-ASCII characters, which it may have to sanitize, all take the
+// slow path.
+bool NeedsNoEscaping(const base::StringPiece& str) {
+  for (size_t i = 0; i < str.size(); ++i) {
+    unsigned char c = static_cast<unsigned char>(str[i]);
+    if (c < 0x20 || c >= 0x7F || c == '"' || c == '\\' || c == '<')
+      return false;
+  }
+  return true;
+}
+
+// Formats @p magnitude, preceded by a minus sign if @p negative, so that it
+// ends at @p end. The buffer must hold at least 21 characters.
+// @returns the start of the formatted number.
+char* FormatInteger(uint64_t magnitude, bool negative, char* end) {
+  char* start = end;
+  do {
+    *--start = static_cast<char>('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0);
+  if (negative)
+    *--start = '-';
+  return start;
+}
+
 }  // namespace
 
 struct JSONFileWriter::Helper {
@@ -56,9 +85,10 @@ struct JSONFileWriter::Helper {
     if (!json_file_writer->AlignForValueOrKey())
       return false;
 
-    std::string formatted_key = base::GetQuotedJSONString(key.as_string());
-    if (!json_file_writer->Printf("%s:", formatted_key.c_str()))
+    if (!json_file_writer->PrintQuotedString(key) ||
+        !json_file_writer->PutChar(':')) {
       return false;
+    }
 
     // If we're pretty printing, then also output a space between the key and
     // the value.
@@ -84,6 +114,8 @@ struct JSONFileWriter::Helper {
     if (!(json_file_writer->*print_function)(value))
       return false;
     json_file_writer->FlushValue(true);
+    if (json_file_writer->finished_)
+      return json_file_writer->FlushBuffer();
     return true;
   }
 };
@@ -95,10 +127,13 @@ JSONFileWriter::JSONFileWriter(FILE* file, bool pretty_print)
       at_col_zero_(true),
       indent_depth_(0) {
   DCHECK(file != NULL);
+  buffer_.reserve(kBufferSize);
 }
 
 JSONFileWriter::~JSONFileWriter() {
-  Flush();
+  // Write the buffered output even if the stream can't be closed off.
+  if (!Flush())
+    FlushBuffer();
 }
 
 bool JSONFileWriter::OutputComment(const base::StringPiece& comment) {
@@ -181,24 +216,61 @@ bool JSONFileWriter::OutputTrailingComment(const base::StringPiece16& comment) {
 }
 
 bool JSONFileWriter::PrintBoolean(bool value) {
-  return Printf("%s", value ? kTrue : kFalse);
+  return Write(value ? kTrue : kFalse);
 }
 
 bool JSONFileWriter::PrintInteger(int value) {
-  return Printf("%d", value);
+  // The magnitude is computed unsigned so that INT_MIN doesn't overflow.
+  char digits[24];
+  char* end = digits + sizeof(digits);
+  uint32_t magnitude = value < 0 ? 0u - static_cast<uint32_t>(value) :
+                                   static_cast<uint32_t>(value);
+  char* start = FormatInteger(magnitude, value < 0, end);
+  return Write(base::StringPiece(start, end - start));
 }
 
 bool JSONFileWriter::PrintDouble(double value) {
+  // The doubles that are exact integers, such as counts, are formatted like
+  // base::JSONWriter does, with a ".0" suffix, but without going through it.
+  static const double kMaxExactInteger = 9007199254740992.0;  // 2^53.
+  if (value > -kMaxExactInteger && value < kMaxExactInteger &&
+      value == static_cast<double>(static_cast<int64_t>(value))) {
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* suffix = end - 2;
+    suffix[0] = '.';
+    suffix[1] = '0';
+    int64_t integer = static_cast<int64_t>(value);
+    uint64_t magnitude = integer < 0 ? 0u - static_cast<uint64_t>(integer) :
+                                       static_cast<uint64_t>(integer);
+    char* start = FormatInteger(magnitude, integer < 0, suffix);
+    return Write(base::StringPiece(start, end - start));
+  }
+
   base::FundamentalValue fundamental_value(value);
   return PrintValue(&fundamental_value);
 }
 
 bool JSONFileWriter::PrintString(const base::StringPiece& value) {
-  return Printf("%s", base::GetQuotedJSONString(value.as_string()).c_str());
+  return PrintQuotedString(value);
 }
 
 bool JSONFileWriter::PrintNull(int value_unused) {
-  return Printf("%s", kNull);
+  return Write(kNull);
+}
+
+bool JSONFileWriter::PrintHexString(uint32_t value) {
+  char str[] = "\"0x00000000\"";
+  for (size_t i = 0; i < 8; ++i)
+    str[10 - i] = kHexDigits[(value >> (4 * i)) & 0xF];
+  return Write(base::StringPiece(str, sizeof(str) - 1));
+}
+
+bool JSONFileWriter::PrintQuotedString(const base::StringPiece& value) {
+  if (!NeedsNoEscaping(value))
+    return Write(base::GetQuotedJSONString(value.as_string()));
+
+  return PutChar('"') && Write(value) && PutChar('"');
 }
 
 bool JSONFileWriter::PrintValue(const Value* value) {
@@ -221,7 +293,7 @@ bool JSONFileWriter::PrintValue(const Value* value) {
     case Value::TYPE_BINARY: {
       std::string str;
       base::JSONWriter::Write(*value, &str);
-      return Printf("%s", str.c_str());
+      return Write(str);
     }
 
     default: {
@@ -232,22 +304,46 @@ bool JSONFileWriter::PrintValue(const Value* value) {
 }
 
 bool JSONFileWriter::Printf(const char* format, ...) {
+  size_t old_size = buffer_.size();
   va_list args;
   va_start(args, format);
-  int chars_written = vfprintf(file_, format, args);
+  base::StringAppendV(&buffer_, format, args);
   va_end(args);
-  if (chars_written > 0)
+  if (buffer_.size() > old_size)
     at_col_zero_ = false;
-  return chars_written >= 0;
+  if (buffer_.size() >= kBufferSize || finished_)
+    return FlushBuffer();
+  return true;
 }
 
 bool JSONFileWriter::PutChar(char c) {
-  if (fputc(c, file_) != c)
-    return false;
+  buffer_.push_back(c);
+  at_col_zero_ = false;
+  if (buffer_.size() >= kBufferSize)
+    return FlushBuffer();
+  return true;
+}
+
+bool JSONFileWriter::Write(const base::StringPiece& str) {
+  if (str.empty())
+    return true;
+  buffer_.append(str.data(), str.size());
   at_col_zero_ = false;
+  if (buffer_.size() >= kBufferSize || finished_)
+    return FlushBuffer();
   return true;
 }
 
+bool JSONFileWriter::FlushBuffer() {
+  if (buffer_.empty())
+    return true;
+
+  size_t bytes_written = fwrite(buffer_.data(), 1, buffer_.size(), file_);
+  bool succeeded = bytes_written == buffer_.size();
+  buffer_.clear();
+  return succeeded;
+}
+
 bool JSONFileWriter::OpenList() {
   return OpenStructure(kList);
 }
@@ -269,7 +365,10 @@ bool JSONFileWriter::OutputKey(const base::StringPiece& key) {
 }
 
 bool JSONFileWriter::OutputKey(const base::StringPiece16& key) {
-  return Helper::OutputKey(key, this);
+  std::string utf8;
+  if (!base::WideToUTF8(key.data(), key.length(), &utf8))
+    return false;
+  return Helper::OutputKey(base::StringPiece(utf8), this);
 }
 
 bool JSONFileWriter::Flush() {
@@ -287,7 +386,7 @@ bool JSONFileWriter::Flush() {
       return false;
   }
 
-  return true;
+  return FlushBuffer();
 }
 
 bool JSONFileWriter::OutputBoolean(bool value) {
@@ -317,6 +416,11 @@ bool JSONFileWriter::OutputString(const base::StringPiece16& value) {
   return OutputString(utf8);
 }
 
+bool JSONFileWriter::OutputHexString(uint32_t value) {
+  return Helper::OutputValue(
+      value, &JSONFileWriter::PrintHexString, this);
+}
+
 bool JSONFileWriter::OutputNull() {
   int unused = 0;
   return Helper::OutputValue(
@@ -335,10 +439,10 @@ bool JSONFileWriter::OutputIndent() {
   // We bypass Printf and manually update at_col_zero_ here for efficiency.
   if (indent_depth_ > 0)
     at_col_zero_ = false;
-  for (size_t i = 0; i < indent_depth_; ++i) {
-    if (fprintf(file_, "%s", kIndent) < 0)
-      return false;
-  }
+  for (size_t i = 0; i < indent_depth_; ++i)
+    buffer_.append(kIndent, sizeof(kIndent) - 1);
+  if (buffer_.size() >= kBufferSize)
+    return FlushBuffer();
   return true;
 }
 
@@ -347,9 +451,10 @@ bool JSONFileWriter::OutputNewline() {
     return true;
 
   // Bypass Printf and manually at_col_zero_ for efficiency.
-  if (fprintf(file_, "%s", kNewline) < 0)
-    return false;
+  buffer_.append(kNewline, sizeof(kNewline) - 1);
   at_col_zero_ = true;
+  if (buffer_.size() >= kBufferSize)
+    return FlushBuffer();
 
   return true;
 }
@@ -473,7 +578,7 @@ bool JSONFileWriter::OpenStructure(StructureType type) {
 
   if (!ReadyForValue() ||
       !AlignForValueOrKey() ||
-      !Printf("%s", kStructureOpenings[type])) {
+      !Write(kStructureOpenings[type])) {
     return false;
   }
 
@@ -503,13 +608,15 @@ bool JSONFileWriter::CloseStructure(StructureType type) {
   if (pretty_print_ && !OutputIndent())
     return false;
 
-  if (!Printf("%s", kStructureClosings[type])) {
+  if (!Write(kStructureClosings[type])) {
     return false;
   }
 
   // If this closed the last open structure, then the JSON file is finished.
-  if (stack_.empty())
+  if (stack_.empty()) {
     finished_ = true;
+    return FlushBuffer();
+  }
 
   return true;
 }
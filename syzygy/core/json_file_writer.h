@@ -14,11 +14,14 @@
 //
 // JSONFileWriter is a lightweight class for writing JSON formatted output
 // directly to file rather than via a base::Value intermediate and then
-// std::string intermediate representation.
+// std::string intermediate representation. The output is buffered, and
+// written to the file when the buffer fills up, when the stream is finished
+// or when it's flushed.
 #ifndef SYZYGY_CORE_JSON_FILE_WRITER_H_
 #define SYZYGY_CORE_JSON_FILE_WRITER_H_
 
 #include <stdint.h>
+#include <string>
 #include <vector>
 
 #include "base/strings/string_piece.h"
@@ -32,9 +35,13 @@ namespace core {
 
 // Class allowing std::ostream like output for formatted JSON serialization.
 // Doesn't force use of Value or std::string intermediaries like JSONWriter
-// does.
+// does. When not pretty printing, no whitespace at all is output.
 class JSONFileWriter {
  public:
+  // The size of the output buffer. Output is written to the file in chunks
+  // of at least this size, until the stream is finished.
+  static const size_t kBufferSize = 64 * 1024;
+
   explicit JSONFileWriter(FILE* file, bool pretty_print);
 
   ~JSONFileWriter();
@@ -71,8 +78,9 @@ class JSONFileWriter {
   bool OutputKey(const base::StringPiece& key);
   bool OutputKey(const base::StringPiece16& key);
 
-  // Closes off the JSON stream, terminating any open data structures.
-  // Returns true on success, false on failure.
+  // Closes off the JSON stream, terminating any open data structures, and
+  // writes the buffered output to the file. Returns true on success, false on
+  // failure.
   bool Flush();
 
   // For outputting simple values.
@@ -83,6 +91,10 @@ class JSONFileWriter {
   bool OutputString(const base::StringPiece16& value);
   bool OutputNull();
 
+  // Outputs an unsigned integer as a string of the form "0x0000ABCD", as JSON
+  // has no hexadecimal numbers.
+  bool OutputHexString(uint32_t value);
+
   // For compatibility with base::Value and base::JSONWriter.
   bool OutputValue(const base::Value* value);
 
@@ -123,13 +135,24 @@ class JSONFileWriter {
   bool PrintDouble(double value);
   bool PrintString(const base::StringPiece& value);
   bool PrintNull(int value_unused);
+  bool PrintHexString(uint32_t value);
   bool PrintValue(const base::Value* value);
 
-  // The following group of functions act as pass-through for fprintf and fputc,
-  // but update internal state. No newline characters should be written using
-  // this mechanism. All newlines should be written using OutputNewline.
+  // Prints a string as a quoted JSON string. Strings that need no escaping
+  // are copied to the output directly.
+  bool PrintQuotedString(const base::StringPiece& value);
+
+  // The following group of functions append to the output buffer, and update
+  // internal state. No newline characters should be written using this
+  // mechanism. All newlines should be written using OutputNewline.
   bool Printf(const char* format, ...);
   bool PutChar(char c);
+  bool Write(const base::StringPiece& str);
+
+  // Writes the buffered output to the file. This is done whenever the buffer
+  // fills up, and whenever output is produced once the stream is finished so
+  // that the file is complete as soon as the stream is.
+  bool FlushBuffer();
 
   // Some state determination functions.
   bool FirstEntry() const;
@@ -149,6 +172,8 @@ class JSONFileWriter {
 
   // The file that is being written to.
   FILE* file_;
+  // The output that has yet to be written to the file.
+  std::string buffer_;
   // Indicates whether or not we are pretty printing.
   bool pretty_print_;
   // This is set when the stream writer is finished. That is, a single value
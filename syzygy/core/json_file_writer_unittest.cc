@@ -14,6 +14,8 @@
 
 #include "syzygy/core/json_file_writer.h"
 
+#include <limits>
+
 #include "base/logging.h"
 #include "base/files/file_util.h"
 #include "base/files/scoped_temp_dir.h"
@@ -402,6 +404,69 @@ TEST_F(JSONFileWriterTest, OutputNull) {
   ASSERT_EQ("null", s);
 }
 
+TEST_F(JSONFileWriterTest, OutputHexString) {
+  TestJSONFileWriter json_file(file(), false);
+  EXPECT_TRUE(json_file.OutputHexString(0x00C0FFEE));
+  ASSERT_TRUE(json_file.Finished());
+
+  std::string s;
+  ASSERT_TRUE(FileContents(&s));
+  ASSERT_EQ("\"0x00C0FFEE\"", s);
+}
+
+TEST_F(JSONFileWriterTest, OutputNumbers) {
+  TestJSONFileWriter json_file(file(), false);
+  EXPECT_TRUE(json_file.OpenList());
+  EXPECT_TRUE(json_file.OutputInteger(0));
+  EXPECT_TRUE(json_file.OutputInteger(-17));
+  EXPECT_TRUE(json_file.OutputInteger(std::numeric_limits<int>::max()));
+  EXPECT_TRUE(json_file.OutputInteger(std::numeric_limits<int>::min()));
+  EXPECT_TRUE(json_file.OutputDouble(12345678901.0));
+  EXPECT_TRUE(json_file.OutputDouble(-3.0));
+  EXPECT_TRUE(json_file.OutputDouble(0.25));
+  EXPECT_TRUE(json_file.CloseList());
+  ASSERT_TRUE(json_file.Finished());
+
+  std::string s;
+  ASSERT_TRUE(FileContents(&s));
+  ASSERT_EQ("[0,-17,2147483647,-2147483648,12345678901.0,-3.0,0.25]", s);
+}
+
+TEST_F(JSONFileWriterTest, OutputEscapedStrings) {
+  TestJSONFileWriter json_file(file(), false);
+  EXPECT_TRUE(json_file.OpenDict());
+  EXPECT_TRUE(json_file.OutputKey("a\"b"));
+  EXPECT_TRUE(json_file.OutputString("c\\d\n"));
+  EXPECT_TRUE(json_file.CloseDict());
+  ASSERT_TRUE(json_file.Finished());
+
+  std::string s;
+  ASSERT_TRUE(FileContents(&s));
+  ASSERT_EQ("{\"a\\\"b\":\"c\\\\d\\n\"}", s);
+}
+
+TEST_F(JSONFileWriterTest, OutputIsBuffered) {
+  TestJSONFileWriter json_file(file(), false);
+  EXPECT_TRUE(json_file.OpenList());
+  EXPECT_TRUE(json_file.OutputInteger(1));
+
+  // Nothing is written until the buffer fills up.
+  std::string s;
+  ASSERT_TRUE(FileContents(&s));
+  EXPECT_TRUE(s.empty());
+
+  for (size_t i = 0; i < JSONFileWriter::kBufferSize; ++i)
+    EXPECT_TRUE(json_file.OutputInteger(1));
+  ASSERT_TRUE(FileContents(&s));
+  EXPECT_LE(JSONFileWriter::kBufferSize, s.size());
+
+  // Flushing writes the rest of the output.
+  EXPECT_TRUE(json_file.Flush());
+  ASSERT_TRUE(FileContents(&s));
+  EXPECT_EQ(2 * JSONFileWriter::kBufferSize + 3, s.size());
+  EXPECT_EQ(']', s.back());
+}
+
 TEST_F(JSONFileWriterTest, DestructorAutoFlushes) {
   {
     TestJSONFileWriter json_file(file(), false);
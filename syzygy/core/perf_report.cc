@@ -0,0 +1,156 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/perf_report.h"
+
+#include <windows.h>  // NOLINT
+#include <psapi.h>
+
+#include <algorithm>
+
+#include "base/files/file_util.h"
+#include "syzygy/core/json_file_writer.h"
+
+namespace core {
+
+PerfReport::Phase::Phase()
+    : depth(0), working_set(0), peak_working_set(0) {
+}
+
+PerfReport::PerfReport() : start_(base::TimeTicks::Now()) {
+}
+
+PerfReport::~PerfReport() {
+}
+
+size_t PerfReport::BeginPhase(const base::StringPiece& name) {
+  Phase phase;
+  name.CopyToString(&phase.name);
+  phase.depth = open_phases_.size();
+  phases_.push_back(phase);
+  phase_starts_.push_back(base::TimeTicks::Now());
+  open_phases_.push_back(phases_.size() - 1);
+  return phases_.size() - 1;
+}
+
+void PerfReport::EndPhase(size_t index) {
+  DCHECK(!open_phases_.empty());
+  DCHECK_EQ(open_phases_.back(), index);
+
+  Phase& phase = phases_[index];
+  phase.duration = base::TimeTicks::Now() - phase_starts_[index];
+  GetWorkingSet(&phase.working_set, &phase.peak_working_set);
+  open_phases_.pop_back();
+}
+
+bool PerfReport::SaveToJSON(FILE* output, bool pretty_print) const {
+  DCHECK(output != NULL);
+
+  base::TimeTicks now = base::TimeTicks::Now();
+  uint64_t working_set = 0;
+  uint64_t peak_working_set = 0;
+  GetWorkingSet(&working_set, &peak_working_set);
+
+  // The memory sizes are output as doubles, which hold them exactly, as they
+  // can exceed the range of an int.
+  JSONFileWriter json_file(output, pretty_print);
+  if (!json_file.OpenDict() ||
+      !json_file.OutputKey("duration") ||
+      !json_file.OutputDouble((now - start_).InSecondsF()) ||
+      !json_file.OutputKey("peak_working_set") ||
+      !json_file.OutputDouble(static_cast<double>(peak_working_set)) ||
+      !json_file.OutputKey("phases") ||
+      !json_file.OpenList()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < phases_.size(); ++i) {
+    // A phase that hasn't ended is reported as if it ended now.
+    Phase phase = phases_[i];
+    if (std::find(open_phases_.begin(), open_phases_.end(), i) !=
+            open_phases_.end()) {
+      phase.duration = now - phase_starts_[i];
+      phase.working_set = working_set;
+      phase.peak_working_set = peak_working_set;
+    }
+
+    if (!json_file.OpenDict() ||
+        !json_file.OutputKey("name") ||
+        !json_file.OutputString(phase.name) ||
+        !json_file.OutputKey("depth") ||
+        !json_file.OutputInteger(static_cast<int>(phase.depth)) ||
+        !json_file.OutputKey("duration") ||
+        !json_file.OutputDouble(phase.duration.InSecondsF()) ||
+        !json_file.OutputKey("working_set") ||
+        !json_file.OutputDouble(static_cast<double>(phase.working_set)) ||
+        !json_file.OutputKey("peak_working_set") ||
+        !json_file.OutputDouble(static_cast<double>(phase.peak_working_set)) ||
+        !json_file.CloseDict()) {
+      return false;
+    }
+  }
+
+  if (!json_file.CloseList() || !json_file.CloseDict())
+    return false;
+
+  DCHECK(json_file.Finished());
+  return true;
+}
+
+bool PerfReport::Save(const base::FilePath& path) const {
+  base::ScopedFILE output(base::OpenFile(path, "wb"));
+  if (output.get() == NULL) {
+    LOG(ERROR) << "Unable to open \"" << path.value() << "\" for writing.";
+    return false;
+  }
+
+  if (!SaveToJSON(output.get(), true)) {
+    LOG(ERROR) << "Unable to write the performance report to \""
+               << path.value() << "\".";
+    return false;
+  }
+
+  return true;
+}
+
+// static
+void PerfReport::GetWorkingSet(uint64_t* working_set,
+                               uint64_t* peak_working_set) {
+  DCHECK(working_set != NULL);
+  DCHECK(peak_working_set != NULL);
+
+  PROCESS_MEMORY_COUNTERS counters = {};
+  if (!::GetProcessMemoryInfo(::GetCurrentProcess(), &counters,
+                              sizeof(counters))) {
+    *working_set = 0;
+    *peak_working_set = 0;
+    return;
+  }
+  *working_set = counters.WorkingSetSize;
+  *peak_working_set = counters.PeakWorkingSetSize;
+}
+
+PerfReport::ScopedPhase::ScopedPhase(PerfReport* report,
+                                     const base::StringPiece& name)
+    : report_(report), index_(0) {
+  if (report_ != NULL)
+    index_ = report_->BeginPhase(name);
+}
+
+PerfReport::ScopedPhase::~ScopedPhase() {
+  if (report_ != NULL)
+    report_->EndPhase(index_);
+}
+
+}  // namespace core
@@ -0,0 +1,137 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares PerfReport, which measures the time and the memory taken by the
+// phases of a tool, and writes them to a JSON report.
+
+#ifndef SYZYGY_CORE_PERF_REPORT_H_
+#define SYZYGY_CORE_PERF_REPORT_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/files/file_path.h"
+#include "base/strings/string_piece.h"
+#include "base/time/time.h"
+
+namespace core {
+
+// Collects the durations and the memory usage of the phases of a tool.
+// Phases may nest, e.g., each transform is a phase of the relinking phase.
+// Sample usage:
+//
+//   PerfReport report;
+//   {
+//     PerfReport::ScopedPhase phase(&report, "decompose");
+//     ...
+//   }
+//   report.Save(path);
+//
+// This class isn't thread safe: the phases must be measured on one thread.
+class PerfReport {
+ public:
+  class ScopedPhase;
+
+  // A measured phase.
+  struct Phase {
+    Phase();
+
+    // The name of the phase.
+    std::string name;
+    // The number of phases enclosing this one.
+    size_t depth;
+    // The wall clock time taken by the phase.
+    base::TimeDelta duration;
+    // The working set of the process at the end of the phase, in bytes.
+    uint64_t working_set;
+    // The peak working set of the process at the end of the phase, in bytes.
+    // This is the peak since the start of the process, so a phase whose peak
+    // is higher than the one of the previous phase raised it.
+    uint64_t peak_working_set;
+  };
+
+  PerfReport();
+  ~PerfReport();
+
+  // Starts measuring a phase. Prefer ScopedPhase.
+  // @param name The name of the phase.
+  // @returns the index of the phase, to be passed to EndPhase.
+  size_t BeginPhase(const base::StringPiece& name);
+
+  // Stops measuring a phase. The phases must end in the reverse order of
+  // their beginning.
+  // @param index The index of the phase, as returned by BeginPhase.
+  void EndPhase(size_t index);
+
+  // @returns the phases, in the order in which they began.
+  const std::vector<Phase>& phases() const { return phases_; }
+
+  // Writes the report as a JSON dictionary, holding the total duration, the
+  // peak working set of the process and the list of the phases. The phases
+  // that haven't ended yet are reported as if they ended now. The durations
+  // are in seconds, and the memory sizes are in bytes.
+  // @param output The file to which the report is written.
+  // @param pretty_print True to pretty print the report.
+  // @returns true on success, false otherwise.
+  bool SaveToJSON(FILE* output, bool pretty_print) const;
+
+  // Writes the report to a file, pretty printed.
+  // @param path The path of the file to write.
+  // @returns true on success, false otherwise.
+  bool Save(const base::FilePath& path) const;
+
+ private:
+  // Gets the working set and the peak working set of the current process.
+  static void GetWorkingSet(uint64_t* working_set, uint64_t* peak_working_set);
+
+  // When the report was created.
+  base::TimeTicks start_;
+
+  // The phases, and when they began.
+  std::vector<Phase> phases_;
+  std::vector<base::TimeTicks> phase_starts_;
+
+  // The indices of the phases that have begun but haven't ended yet, from
+  // the outermost to the innermost.
+  std::vector<size_t> open_phases_;
+
+  DISALLOW_COPY_AND_ASSIGN(PerfReport);
+};
+
+// Measures a phase for the lifetime of an instance. This does nothing if the
+// report is null, so that the measurements are optional.
+class PerfReport::ScopedPhase {
+ public:
+  // Begins a phase.
+  // @param report The report to which the phase is added. May be null.
+  // @param name The name of the phase.
+  ScopedPhase(PerfReport* report, const base::StringPiece& name);
+
+  // Ends the phase.
+  ~ScopedPhase();
+
+ private:
+  PerfReport* report_;
+  size_t index_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedPhase);
+};
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_PERF_REPORT_H_
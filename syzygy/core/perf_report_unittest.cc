@@ -0,0 +1,99 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/perf_report.h"
+
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/json/json_reader.h"
+#include "base/values.h"
+#include "gtest/gtest.h"
+
+namespace core {
+
+TEST(PerfReportTest, PhasesNest) {
+  PerfReport report;
+  {
+    PerfReport::ScopedPhase outer(&report, "outer");
+    { PerfReport::ScopedPhase inner(&report, "inner"); }
+    { PerfReport::ScopedPhase other(&report, "other"); }
+  }
+  { PerfReport::ScopedPhase last(&report, "last"); }
+
+  const std::vector<PerfReport::Phase>& phases = report.phases();
+  ASSERT_EQ(4u, phases.size());
+  EXPECT_EQ("outer", phases[0].name);
+  EXPECT_EQ(0u, phases[0].depth);
+  EXPECT_EQ("inner", phases[1].name);
+  EXPECT_EQ(1u, phases[1].depth);
+  EXPECT_EQ("other", phases[2].name);
+  EXPECT_EQ(1u, phases[2].depth);
+  EXPECT_EQ("last", phases[3].name);
+  EXPECT_EQ(0u, phases[3].depth);
+
+  for (const auto& phase : phases) {
+    EXPECT_LT(0u, phase.working_set);
+    EXPECT_LE(phase.working_set, phase.peak_working_set);
+  }
+  EXPECT_GE(phases[0].duration, phases[1].duration + phases[2].duration);
+}
+
+TEST(PerfReportTest, NullReportIsIgnored) {
+  PerfReport::ScopedPhase phase(NULL, "ignored");
+}
+
+TEST(PerfReportTest, SaveSucceeds) {
+  PerfReport report;
+  { PerfReport::ScopedPhase phase(&report, "done"); }
+  PerfReport::ScopedPhase open_phase(&report, "open");
+
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath path = temp_dir.path().Append(L"report.json");
+  ASSERT_TRUE(report.Save(path));
+
+  std::string json;
+  ASSERT_TRUE(base::ReadFileToString(path, &json));
+  std::unique_ptr<base::Value> value = base::JSONReader::Read(json);
+  ASSERT_TRUE(value.get() != NULL);
+  base::DictionaryValue* dict = NULL;
+  ASSERT_TRUE(value->GetAsDictionary(&dict));
+
+  double duration = 0;
+  double peak_working_set = 0;
+  EXPECT_TRUE(dict->GetDouble("duration", &duration));
+  EXPECT_TRUE(dict->GetDouble("peak_working_set", &peak_working_set));
+  EXPECT_LT(0.0, peak_working_set);
+
+  base::ListValue* phases = NULL;
+  ASSERT_TRUE(dict->GetList("phases", &phases));
+  ASSERT_EQ(2u, phases->GetSize());
+  base::DictionaryValue* phase = NULL;
+  ASSERT_TRUE(phases->GetDictionary(1, &phase));
+  std::string name;
+  EXPECT_TRUE(phase->GetString("name", &name));
+  EXPECT_EQ("open", name);
+  double working_set = 0;
+  EXPECT_TRUE(phase->GetDouble("working_set", &working_set));
+  EXPECT_LT(0.0, working_set);
+}
+
+TEST(PerfReportTest, SaveFailsForInvalidPath) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  PerfReport report;
+  EXPECT_FALSE(report.Save(temp_dir.path().Append(L"missing\\report.json")));
+}
+
+}  // namespace core
@@ -0,0 +1,134 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/pool_allocator.h"
+
+#include <stdint.h>
+#include <windows.h>
+
+#include "base/lazy_instance.h"
+#include "base/logging.h"
+#include "base/macros.h"
+#include "base/synchronization/lock.h"
+
+namespace core {
+namespace internal {
+
+namespace {
+
+// The size of the slabs the chunks are carved out of.
+const size_t kSlabSize = 64 * 1024;
+
+// The number of size classes.
+const size_t kSizeClassCount = kMaxPooledSize / kPoolSizeClassGranularity;
+
+// A pool of fixed-size chunks. Allocating and freeing a chunk is lock-free,
+// the lock is only taken to add a slab to the pool.
+class FixedSizePool {
+ public:
+  // @param chunk_size The size of the chunks of this pool.
+  explicit FixedSizePool(size_t chunk_size) : chunk_size_(chunk_size) {
+    DCHECK_EQ(0u, chunk_size % kPoolSizeClassGranularity);
+    DCHECK_GE(chunk_size, sizeof(SLIST_ENTRY));
+    ::InitializeSListHead(&free_chunks_);
+  }
+
+  void* Allocate() {
+    while (true) {
+      SLIST_ENTRY* chunk = ::InterlockedPopEntrySList(&free_chunks_);
+      if (chunk != nullptr)
+        return chunk;
+      Grow();
+    }
+  }
+
+  void Free(void* chunk) {
+    DCHECK_NE(static_cast<void*>(nullptr), chunk);
+    ::InterlockedPushEntrySList(&free_chunks_,
+                                reinterpret_cast<SLIST_ENTRY*>(chunk));
+  }
+
+ private:
+  // Adds a slab to the pool.
+  void Grow() {
+    base::AutoLock auto_lock(grow_lock_);
+
+    // Another thread may have grown the pool while this one was waiting.
+    if (::QueryDepthSList(&free_chunks_) != 0)
+      return;
+
+    // The heap returns memory with the alignment the list entries require,
+    // and the chunk size preserves it.
+    uint8_t* slab = reinterpret_cast<uint8_t*>(::operator new(kSlabSize));
+    DCHECK_EQ(0u, reinterpret_cast<uintptr_t>(slab) %
+                      MEMORY_ALLOCATION_ALIGNMENT);
+
+    // Push the chunks in reverse order, so that they get allocated in address
+    // order.
+    size_t chunk_count = kSlabSize / chunk_size_;
+    for (size_t i = chunk_count; i > 0; --i)
+      Free(slab + (i - 1) * chunk_size_);
+  }
+
+  // The free chunks. The declaration of SLIST_HEADER takes care of its
+  // alignment.
+  SLIST_HEADER free_chunks_;
+
+  // The size of the chunks.
+  const size_t chunk_size_;
+
+  // Serializes the growth of the pool.
+  base::Lock grow_lock_;
+
+  DISALLOW_COPY_AND_ASSIGN(FixedSizePool);
+};
+
+// The pools of all the size classes. These are leaked, as their chunks may
+// be in use until the process exits.
+class FixedSizePools {
+ public:
+  FixedSizePools() {
+    for (size_t i = 0; i < kSizeClassCount; ++i)
+      pools_[i] = new FixedSizePool((i + 1) * kPoolSizeClassGranularity);
+  }
+
+  // @param size The size of the objects to allocate.
+  // @returns the pool of the size class of @p size.
+  FixedSizePool* Get(size_t size) {
+    DCHECK_LT(0u, size);
+    DCHECK_GE(kMaxPooledSize, size);
+    return pools_[(size - 1) / kPoolSizeClassGranularity];
+  }
+
+ private:
+  FixedSizePool* pools_[kSizeClassCount];
+
+  DISALLOW_COPY_AND_ASSIGN(FixedSizePools);
+};
+
+base::LazyInstance<FixedSizePools>::Leaky g_fixed_size_pools =
+    LAZY_INSTANCE_INITIALIZER;
+
+}  // namespace
+
+void* AllocateFromPool(size_t size) {
+  return g_fixed_size_pools.Get().Get(size)->Allocate();
+}
+
+void FreeToPool(void* chunk, size_t size) {
+  g_fixed_size_pools.Get().Get(size)->Free(chunk);
+}
+
+}  // namespace internal
+}  // namespace core
@@ -0,0 +1,130 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares an STL allocator that carves the nodes of node-based containers
+// (std::map, std::set, std::list) out of large slabs. This avoids paying for
+// a heap allocation and its header per node, and keeps the nodes allocated
+// together close to each other in memory.
+//
+// The slabs are shared by all the allocators, and are split in chunks of a
+// few size classes. The freed chunks are kept on lock-free lists, from which
+// the next allocations of their size class are made. The slabs are never
+// returned to the system.
+
+#ifndef SYZYGY_CORE_POOL_ALLOCATOR_H_
+#define SYZYGY_CORE_POOL_ALLOCATOR_H_
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace core {
+
+namespace internal {
+
+// The granularity of the size classes of the pools.
+const size_t kPoolSizeClassGranularity = 16;
+
+// The largest object size that is pooled.
+const size_t kMaxPooledSize = 256;
+
+// Allocates a chunk from the pool of the size class of @p size. This is
+// lock-free, except for when the pool needs to grow.
+// @param size The size of the object to allocate, in the range
+//     [1, kMaxPooledSize].
+// @returns the chunk.
+void* AllocateFromPool(size_t size);
+
+// Returns a chunk to the pool it was allocated from.
+// @param chunk The chunk to free.
+// @param size The size that was passed to AllocateFromPool.
+void FreeToPool(void* chunk, size_t size);
+
+}  // namespace internal
+
+// An STL allocator that pools the single object allocations of up to
+// kMaxPooledSize bytes, which are the node allocations of the node-based
+// containers. Larger and array allocations go to the heap. Any allocator can
+// free what another one allocated.
+//
+// This is only worth using for containers that make lots of small
+// allocations, as the memory of the pools is never returned to the system.
+template <typename T>
+class PoolAllocator {
+ public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template <typename U>
+  struct rebind {
+    typedef PoolAllocator<U> other;
+  };
+
+  PoolAllocator() { }
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>& other) { }  // NOLINT
+
+  // @param count The number of objects to allocate.
+  // @returns storage for @p count objects.
+  T* allocate(size_t count) {
+    if (count == 1 && sizeof(T) <= internal::kMaxPooledSize)
+      return reinterpret_cast<T*>(internal::AllocateFromPool(sizeof(T)));
+    return reinterpret_cast<T*>(::operator new(count * sizeof(T)));
+  }
+
+  // Frees storage returned by allocate.
+  // @param objects The storage to free.
+  // @param count The number of objects that were allocated.
+  void deallocate(T* objects, size_t count) {
+    if (count == 1 && sizeof(T) <= internal::kMaxPooledSize) {
+      internal::FreeToPool(objects, sizeof(T));
+      return;
+    }
+    ::operator delete(objects);
+  }
+
+  // @returns the maximum number of objects that can be allocated at once.
+  size_t max_size() const { return static_cast<size_t>(-1) / sizeof(T); }
+
+  // @name Object construction and destruction.
+  // @{
+  template <typename U, typename... Args>
+  void construct(U* object, Args&&... args) {
+    ::new(static_cast<void*>(object)) U(std::forward<Args>(args)...);
+  }
+  template <typename U>
+  void destroy(U* object) {
+    object->~U();
+  }
+  // @}
+};
+
+// All the pool allocators are interchangeable.
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+  return true;
+}
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+  return false;
+}
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_POOL_ALLOCATOR_H_
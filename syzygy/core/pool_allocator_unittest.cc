@@ -0,0 +1,143 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/pool_allocator.h"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "base/threading/simple_thread.h"
+#include "gtest/gtest.h"
+
+namespace core {
+
+namespace {
+
+typedef std::map<int, int, std::less<int>,
+                 PoolAllocator<std::pair<const int, int>>> PooledMap;
+
+const size_t kThreadCount = 8;
+const int kInsertionsPerThread = 10000;
+
+class PooledMapRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  PooledMapRunner() : succeeded_(false) { }
+
+  void Run() override {
+    PooledMap map;
+    for (int i = 0; i < kInsertionsPerThread; ++i)
+      map[i] = i * 2;
+    succeeded_ = map.size() == static_cast<size_t>(kInsertionsPerThread);
+    for (int i = 0; i < kInsertionsPerThread; i += 2)
+      map.erase(i);
+    for (const auto& entry : map)
+      succeeded_ = succeeded_ && entry.second == entry.first * 2;
+  }
+
+  bool succeeded() const { return succeeded_; }
+
+ private:
+  bool succeeded_;
+};
+
+}  // namespace
+
+TEST(PoolAllocatorTest, SizeClasses) {
+  // The objects of a same size class share their chunks.
+  struct Small {
+    char data[internal::kPoolSizeClassGranularity - 1];
+  };
+  struct Medium {
+    char data[internal::kPoolSizeClassGranularity];
+  };
+  PoolAllocator<Small> small_allocator;
+  PoolAllocator<Medium> medium_allocator;
+
+  Small* small = small_allocator.allocate(1);
+  ASSERT_NE(static_cast<Small*>(nullptr), small);
+  small_allocator.deallocate(small, 1);
+  Medium* medium = medium_allocator.allocate(1);
+  EXPECT_EQ(reinterpret_cast<void*>(small), reinterpret_cast<void*>(medium));
+  medium_allocator.deallocate(medium, 1);
+
+  // Objects that are too large aren't pooled, and still work.
+  struct Large {
+    char data[internal::kMaxPooledSize + 1];
+  };
+  PoolAllocator<Large> large_allocator;
+  Large* large = large_allocator.allocate(1);
+  ASSERT_NE(static_cast<Large*>(nullptr), large);
+  large->data[internal::kMaxPooledSize] = 0;
+  large_allocator.deallocate(large, 1);
+}
+
+TEST(PoolAllocatorTest, AllocateAndFree) {
+  PoolAllocator<double> allocator;
+
+  double* value = allocator.allocate(1);
+  ASSERT_NE(static_cast<double*>(nullptr), value);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(value) % sizeof(double));
+  *value = 1.0;
+  allocator.deallocate(value, 1);
+
+  // The freed chunk is reused by the next allocation of its size class.
+  double* other_value = allocator.allocate(1);
+  EXPECT_EQ(value, other_value);
+  allocator.deallocate(other_value, 1);
+
+  // Arrays aren't pooled.
+  double* values = allocator.allocate(1000);
+  ASSERT_NE(static_cast<double*>(nullptr), values);
+  values[999] = 1.0;
+  allocator.deallocate(values, 1000);
+}
+
+TEST(PoolAllocatorTest, Containers) {
+  PooledMap map;
+  for (int i = 0; i < 100000; ++i)
+    map[i] = -i;
+  EXPECT_EQ(100000u, map.size());
+  EXPECT_EQ(-42, map[42]);
+
+  // The copies of a pooled container share the pools.
+  PooledMap copy(map);
+  EXPECT_EQ(map, copy);
+  map.clear();
+  EXPECT_EQ(-42, copy[42]);
+
+  std::set<int, std::less<int>, PoolAllocator<int>> set;
+  set.insert(3);
+  set.insert(1);
+  EXPECT_EQ(1, *set.begin());
+}
+
+TEST(PoolAllocatorTest, ConcurrentUse) {
+  std::vector<std::unique_ptr<PooledMapRunner>> runners;
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> threads;
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    runners.push_back(std::unique_ptr<PooledMapRunner>(new PooledMapRunner()));
+    threads.push_back(std::unique_ptr<base::DelegateSimpleThread>(
+        new base::DelegateSimpleThread(runners.back().get(), "pooled_map")));
+    threads.back()->Start();
+  }
+  for (auto& thread : threads)
+    thread->Join();
+
+  for (const auto& runner : runners)
+    EXPECT_TRUE(runner->succeeded());
+}
+
+}  // namespace core
@@ -56,6 +56,109 @@ bool FileInStream::ReadImpl(size_t length, Byte* bytes, size_t* bytes_read) {
   return true;
 }
 
+BufferedOutStream::BufferedOutStream(OutStream* out_stream)
+    : out_stream_(out_stream), buffer_(kDefaultBufferSize), buffered_(0) {
+  DCHECK(out_stream != NULL);
+}
+
+BufferedOutStream::BufferedOutStream(OutStream* out_stream,
+                                     size_t buffer_size)
+    : out_stream_(out_stream), buffer_(buffer_size), buffered_(0) {
+  DCHECK(out_stream != NULL);
+  DCHECK_LT(0u, buffer_size);
+}
+
+BufferedOutStream::~BufferedOutStream() {
+  if (!FlushBuffer())
+    LOG(ERROR) << "Failed to write the buffered data.";
+}
+
+bool BufferedOutStream::Write(size_t length, const Byte* bytes) {
+  DCHECK(bytes != NULL || length == 0);
+
+  // Append to the buffer if there is room.
+  if (buffered_ + length <= buffer_.size()) {
+    ::memcpy(buffer_.data() + buffered_, bytes, length);
+    buffered_ += length;
+    return true;
+  }
+
+  if (!FlushBuffer())
+    return false;
+
+  // Writes that don't fit in the buffer go straight to the chained stream.
+  if (length >= buffer_.size())
+    return out_stream_->Write(length, bytes);
+
+  ::memcpy(buffer_.data(), bytes, length);
+  buffered_ = length;
+  return true;
+}
+
+bool BufferedOutStream::Flush() {
+  return FlushBuffer() && out_stream_->Flush();
+}
+
+bool BufferedOutStream::FlushBuffer() {
+  if (buffered_ == 0)
+    return true;
+  size_t length = buffered_;
+  buffered_ = 0;
+  return out_stream_->Write(length, buffer_.data());
+}
+
+BufferedInStream::BufferedInStream(InStream* in_stream)
+    : in_stream_(in_stream), buffer_(kDefaultBufferSize), position_(0),
+      buffered_(0) {
+  DCHECK(in_stream != NULL);
+}
+
+BufferedInStream::BufferedInStream(InStream* in_stream, size_t buffer_size)
+    : in_stream_(in_stream), buffer_(buffer_size), position_(0),
+      buffered_(0) {
+  DCHECK(in_stream != NULL);
+  DCHECK_LT(0u, buffer_size);
+}
+
+bool BufferedInStream::ReadImpl(size_t length,
+                                Byte* bytes,
+                                size_t* bytes_read) {
+  DCHECK(bytes != NULL || length == 0);
+  DCHECK(bytes_read != NULL);
+
+  *bytes_read = 0;
+  while (*bytes_read < length) {
+    // Copy what is left in the buffer.
+    if (position_ < buffered_) {
+      size_t count = std::min(length - *bytes_read, buffered_ - position_);
+      ::memcpy(bytes + *bytes_read, buffer_.data() + position_, count);
+      position_ += count;
+      *bytes_read += count;
+      continue;
+    }
+
+    // Large reads go straight to the chained stream.
+    size_t remaining = length - *bytes_read;
+    if (remaining >= buffer_.size()) {
+      size_t count = 0;
+      if (!in_stream_->Read(remaining, bytes + *bytes_read, &count))
+        return false;
+      *bytes_read += count;
+      return true;
+    }
+
+    // Refill the buffer, and stop at the end of the chained stream.
+    position_ = 0;
+    buffered_ = 0;
+    if (!in_stream_->Read(buffer_.size(), buffer_.data(), &buffered_))
+      return false;
+    if (buffered_ == 0)
+      break;
+  }
+
+  return true;
+}
+
 // Serialization of base::Time.
 // We serialize to 'number of seconds since epoch' (represented as a double)
 // as this is consistent regardless of the underlying representation used in
@@ -46,7 +46,12 @@
 // There are currently two stream types defined: File*Stream, which uses a
 // FILE* under the hood; and Byte*Stream, which uses iterators to containers
 // of Bytes. Adding further stream types is trivial. Refer to to the comments/
-// declarations of File*Stream and Byte*Stream for details.
+// declarations of File*Stream and Byte*Stream for details. Buffered*Stream
+// can be chained in front of any of them to batch their reads and writes.
+//
+// Vectors and strings of arithmetic types other than bool are saved and
+// loaded with a single write or read of their contents, rather than one per
+// element. The format is the same either way.
 //
 // There is currently a single archive type defined, NativeBinary, which is a
 // non-portable binary format. Additional archive formats may be easily added
@@ -108,6 +113,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -303,6 +309,77 @@ ByteInStream<InputIterator>* CreateByteInStream(InputIterator iter,
   return new ByteInStream<InputIterator>(iter, end);
 }
 
+// An OutStream adapter that buffers the data written to it, and writes it to
+// the chained stream in large chunks. This avoids a virtual call to the
+// chained stream per primitive value that is saved.
+class BufferedOutStream : public OutStream {
+ public:
+  // The default size of the buffer.
+  static const size_t kDefaultBufferSize = 64 * 1024;
+
+  // @{
+  // Constructor.
+  // @param out_stream the stream to receive the data. It must outlive this
+  //     stream.
+  // @param buffer_size the size of the buffer. Defaults to
+  //     kDefaultBufferSize.
+  explicit BufferedOutStream(OutStream* out_stream);
+  BufferedOutStream(OutStream* out_stream, size_t buffer_size);
+  // @}
+
+  // Writes the data that is still buffered. This doesn't flush the chained
+  // stream.
+  virtual ~BufferedOutStream();
+
+  // @name OutStream implementation.
+  // @{
+  virtual bool Write(size_t length, const Byte* bytes) override;
+  // Writes the buffered data, and flushes the chained stream.
+  virtual bool Flush() override;
+  // @}
+
+ private:
+  // Writes the buffered data to the chained stream.
+  // @returns true on success, false otherwise.
+  bool FlushBuffer();
+
+  OutStream* out_stream_;
+  std::vector<Byte> buffer_;
+  size_t buffered_;
+};
+
+// An InStream adapter that reads the data from the chained stream in large
+// chunks. Note that this may read past the data that is asked of it, so the
+// chained stream shouldn't be read from directly afterwards.
+class BufferedInStream : public InStream {
+ public:
+  // The default size of the buffer.
+  static const size_t kDefaultBufferSize = 64 * 1024;
+
+  // @{
+  // Constructor.
+  // @param in_stream the stream to read the data from. It must outlive this
+  //     stream.
+  // @param buffer_size the size of the buffer. Defaults to
+  //     kDefaultBufferSize.
+  explicit BufferedInStream(InStream* in_stream);
+  BufferedInStream(InStream* in_stream, size_t buffer_size);
+  // @}
+  virtual ~BufferedInStream() { }
+
+ protected:
+  virtual bool ReadImpl(size_t length,
+                        Byte* bytes,
+                        size_t* bytes_read) override;
+
+ private:
+  InStream* in_stream_;
+  std::vector<Byte> buffer_;
+  // The range of the buffer that holds data that hasn't been read yet.
+  size_t position_;
+  size_t buffered_;
+};
+
 // This class defines a non-portable native binary serialization format.
 class NativeBinaryOutArchive {
  public:
@@ -344,6 +421,16 @@ class NativeBinaryOutArchive {
   NATIVE_BINARY_OUT_ARCHIVE_SAVE(unsigned long);
 #undef NATIVE_BINARY_OUT_ARCHIVE_SAVE
 
+  // Saves raw bytes. This is used to save contiguous arrays of primitive
+  // values at once.
+  // @param length the number of bytes to save.
+  // @param bytes the bytes to save.
+  // @returns true on success, false otherwise.
+  bool SaveBytes(size_t length, const Byte* bytes) {
+    DCHECK(out_stream_ != NULL);
+    return out_stream_->Write(length, bytes);
+  }
+
   bool Flush() { return out_stream_->Flush(); }
 
   OutStream* out_stream() { return out_stream_; }
@@ -393,6 +480,16 @@ class NativeBinaryInArchive {
   NATIVE_BINARY_IN_ARCHIVE_LOAD(unsigned long);
 #undef NATIVE_BINARY_IN_ARCHIVE_LOAD
 
+  // Loads raw bytes. This is used to load contiguous arrays of primitive
+  // values at once.
+  // @param length the number of bytes to load.
+  // @param bytes the buffer to receive the bytes.
+  // @returns true if all the bytes were loaded, false otherwise.
+  bool LoadBytes(size_t length, Byte* bytes) {
+    DCHECK(in_stream_ != NULL);
+    return in_stream_->Read(length, bytes);
+  }
+
   InStream* in_stream() { return in_stream_; }
 
  private:
@@ -20,6 +20,7 @@
 #define SYZYGY_CORE_SERIALIZATION_IMPL_H_
 
 #include <iterator>
+#include <type_traits>
 
 // Forward declare base::Time, defined in "base/time/time.h".
 namespace base {
@@ -51,6 +52,15 @@ template<typename T> struct IsByteLike {
   };
 };
 
+// This tests whether the values of a given type can be saved and loaded as
+// raw bytes, which is the case of the primitive types other than bool. The
+// native binary archives save these as their in-memory representation.
+template<typename T> struct IsBulkSerializable {
+  enum {
+    Value = std::is_arithmetic<T>::value && !TypesAreEqual<T, bool>::Value
+  };
+};
+
 // This compares two iterators. It only does so if the iterator type is
 // not an output iterator.
 template<typename IteratorTag> struct IteratorsAreEqualFunctor {
@@ -150,6 +160,64 @@ bool LoadContainer(Container* container,
   return true;
 }
 
+// Serialization for vectors and strings, whose values are contiguous. The
+// values are saved all at once if they're bulk serializable, and one by one
+// like by SaveContainer otherwise. The format is the same in both cases.
+template<class Container, class OutArchive> bool SaveContiguousContainer(
+    const Container& container, OutArchive* out_archive, std::false_type) {
+  return SaveContainer(container, out_archive);
+}
+template<class Container, class OutArchive> bool SaveContiguousContainer(
+    const Container& container, OutArchive* out_archive, std::true_type) {
+  DCHECK(out_archive != NULL);
+
+  if (!out_archive->Save(container.size()))
+    return false;
+  if (container.empty())
+    return true;
+  return out_archive->SaveBytes(
+      container.size() * sizeof(typename Container::value_type),
+      reinterpret_cast<const Byte*>(&container[0]));
+}
+template<class Container, class OutArchive> bool SaveContiguousContainer(
+    const Container& container, OutArchive* out_archive) {
+  typedef typename Container::value_type ValueType;
+  return SaveContiguousContainer(
+      container, out_archive,
+      std::integral_constant<bool, IsBulkSerializable<ValueType>::Value>());
+}
+
+// Loads values that were saved by SaveContiguousContainer, appending them to
+// a vector or a string.
+template<class Container, class InArchive> bool LoadContiguousContainer(
+    Container* container, InArchive* in_archive, std::false_type) {
+  return LoadContainer(container, std::back_inserter(*container), in_archive);
+}
+template<class Container, class InArchive> bool LoadContiguousContainer(
+    Container* container, InArchive* in_archive, std::true_type) {
+  DCHECK(container != NULL);
+  DCHECK(in_archive != NULL);
+
+  typename Container::size_type size = 0;
+  if (!in_archive->Load(&size))
+    return false;
+  if (size == 0)
+    return true;
+
+  typename Container::size_type offset = container->size();
+  container->resize(offset + size);
+  return in_archive->LoadBytes(
+      size * sizeof(typename Container::value_type),
+      reinterpret_cast<Byte*>(&(*container)[offset]));
+}
+template<class Container, class InArchive> bool LoadContiguousContainer(
+    Container* container, InArchive* in_archive) {
+  typedef typename Container::value_type ValueType;
+  return LoadContiguousContainer(
+      container, in_archive,
+      std::integral_constant<bool, IsBulkSerializable<ValueType>::Value>());
+}
+
 }  // namespace internal
 
 template<typename OutputIterator> bool ByteOutStream<OutputIterator>::Write(
@@ -205,7 +273,7 @@ template<typename Char, typename Traits, typename Alloc, class OutArchive>
 bool Save(const std::basic_string<Char, Traits, Alloc>& string,
           OutArchive* out_archive) {
   DCHECK(out_archive != NULL);
-  return internal::SaveContainer(string, out_archive);
+  return internal::SaveContiguousContainer(string, out_archive);
 }
 
 template<typename Key, typename Data, typename Compare, typename Alloc,
@@ -234,7 +302,7 @@ template<typename Type, typename Alloc, class OutArchive>
 bool Save(const std::vector<Type, Alloc>& vector,
           OutArchive* out_archive) {
   DCHECK(out_archive != NULL);
-  return internal::SaveContainer(vector, out_archive);
+  return internal::SaveContiguousContainer(vector, out_archive);
 }
 
 // Implementation of STL Load specializations.
@@ -245,9 +313,7 @@ bool Load(std::basic_string<Char, Traits, Alloc>* string,
   DCHECK(string != NULL);
   DCHECK(in_archive != NULL);
   string->clear();
-  return internal::LoadContainer(string,
-                                 std::back_inserter(*string),
-                                 in_archive);
+  return internal::LoadContiguousContainer(string, in_archive);
 }
 
 template<typename Key, typename Data, typename Compare, typename Alloc,
@@ -286,9 +352,7 @@ bool Load(std::vector<Type, Alloc>* vector,
           InArchive* in_archive) {
   DCHECK(vector != NULL);
   DCHECK(in_archive != NULL);
-  return internal::LoadContainer(vector,
-                                 std::back_inserter(*vector),
-                                 in_archive);
+  return internal::LoadContiguousContainer(vector, in_archive);
 }
 
 // Implementation of serialization for C-style arrays.
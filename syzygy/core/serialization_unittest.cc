@@ -13,6 +13,9 @@
 // limitations under the License.
 
 #include "syzygy/core/serialization.h"
+
+#include <algorithm>
+
 #include "base/files/file_util.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
@@ -153,6 +156,110 @@ TEST_F(SerializationTest, FileInStream) {
   EXPECT_FALSE(in_stream.Read(sizeof(kTestData), buffer));
 }
 
+TEST_F(SerializationTest, BufferedOutStream) {
+  ByteVector bytes;
+  ScopedOutStreamPtr byte_stream;
+  byte_stream.reset(CreateByteOutStream(std::back_inserter(bytes)));
+
+  {
+    BufferedOutStream out_stream(byte_stream.get(), 4);
+
+    // Small writes are buffered.
+    EXPECT_TRUE(out_stream.Write(2, kTestData));
+    EXPECT_TRUE(out_stream.Write(1, kTestData + 2));
+    EXPECT_TRUE(bytes.empty());
+
+    // Writes that don't fit in the buffer flush it, and large writes go
+    // through.
+    EXPECT_TRUE(out_stream.Write(2, kTestData + 3));
+    EXPECT_EQ(3u, bytes.size());
+    EXPECT_TRUE(out_stream.Write(8, kTestData + 5));
+    EXPECT_EQ(13u, bytes.size());
+    EXPECT_TRUE(out_stream.Write(1, kTestData + 13));
+    EXPECT_TRUE(out_stream.Flush());
+    EXPECT_EQ(14u, bytes.size());
+
+    // The data that is left is written on destruction.
+    EXPECT_TRUE(out_stream.Write(3, kTestData + 14));
+    EXPECT_TRUE(out_stream.Write(sizeof(kTestData) - 17, kTestData + 17));
+    EXPECT_EQ(17u, bytes.size());
+  }
+
+  EXPECT_EQ(sizeof(kTestData), bytes.size());
+  EXPECT_EQ(0, memcmp(&bytes[0], kTestData, sizeof(kTestData)));
+}
+
+TEST_F(SerializationTest, BufferedInStream) {
+  ByteVector bytes(kTestData, kTestData + sizeof(kTestData));
+  ScopedInStreamPtr byte_stream;
+  byte_stream.reset(CreateByteInStream(bytes.begin(), bytes.end()));
+  BufferedInStream in_stream(byte_stream.get(), 4);
+
+  // Small reads are served from the buffer, and large ones go through.
+  Byte buffer[sizeof(kTestData)];
+  EXPECT_TRUE(in_stream.Read(1, buffer));
+  EXPECT_TRUE(in_stream.Read(2, buffer + 1));
+  EXPECT_TRUE(in_stream.Read(3, buffer + 3));
+  EXPECT_TRUE(in_stream.Read(9, buffer + 6));
+  EXPECT_TRUE(in_stream.Read(sizeof(kTestData) - 15, buffer + 15));
+  EXPECT_EQ(0, memcmp(buffer, kTestData, sizeof(kTestData)));
+
+  // We should not be able to read past the end of the chained stream.
+  size_t bytes_read = 1;
+  EXPECT_TRUE(in_stream.Read(1, buffer, &bytes_read));
+  EXPECT_EQ(0u, bytes_read);
+  EXPECT_FALSE(in_stream.Read(1, buffer));
+}
+
+TEST_F(SerializationTest, BulkContainers) {
+  std::vector<uint32_t> vector;
+  for (uint32_t i = 0; i < 1000; ++i)
+    vector.push_back(i * 3);
+
+  // Vectors of primitive values are saved in the same format as if their
+  // values were saved one by one.
+  ByteVector bytes;
+  ScopedOutStreamPtr out_stream;
+  out_stream.reset(CreateByteOutStream(std::back_inserter(bytes)));
+  NativeBinaryOutArchive out_archive(out_stream.get());
+  EXPECT_TRUE(out_archive.Save(vector));
+
+  ByteVector expected_bytes;
+  ScopedOutStreamPtr expected_stream;
+  expected_stream.reset(
+      CreateByteOutStream(std::back_inserter(expected_bytes)));
+  NativeBinaryOutArchive expected_archive(expected_stream.get());
+  EXPECT_TRUE(expected_archive.Save(vector.size()));
+  for (uint32_t value : vector)
+    EXPECT_TRUE(expected_archive.Save(value));
+  EXPECT_EQ(expected_bytes, bytes);
+
+  // Loading appends to the vector, like for other values.
+  std::vector<uint32_t> loaded(1, 42);
+  ScopedInStreamPtr in_stream;
+  in_stream.reset(CreateByteInStream(bytes.begin(), bytes.end()));
+  NativeBinaryInArchive in_archive(in_stream.get());
+  EXPECT_TRUE(in_archive.Load(&loaded));
+  ASSERT_EQ(vector.size() + 1, loaded.size());
+  EXPECT_EQ(42u, loaded[0]);
+  EXPECT_TRUE(std::equal(vector.begin(), vector.end(), loaded.begin() + 1));
+
+  // Truncated data fails to load.
+  bytes.pop_back();
+  loaded.clear();
+  in_stream.reset(CreateByteInStream(bytes.begin(), bytes.end()));
+  NativeBinaryInArchive truncated_archive(in_stream.get());
+  EXPECT_FALSE(truncated_archive.Load(&loaded));
+
+  // The containers of other types are still saved value by value.
+  std::vector<bool> bools;
+  bools.push_back(true);
+  bools.push_back(false);
+  EXPECT_TRUE(TestRoundTrip(bools));
+  std::vector<uint8_t> empty;
+  EXPECT_TRUE(TestRoundTrip(empty));
+}
+
 TEST_F(SerializationTest, PlainOldDataTypesRoundTrip) {
   EXPECT_TRUE(TestRoundTrip<bool>(true));
   EXPECT_TRUE(TestRoundTrip<char>('c'));
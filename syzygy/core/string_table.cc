@@ -15,11 +15,60 @@
 
 #include "syzygy/core/string_table.h"
 
+#include "base/hash.h"
+#include "base/logging.h"
+
 namespace core {
 
+namespace {
+
+// The initial number of slots of the hash table.
+const size_t kInitialSlotCount = 64;
+
+}  // namespace
+
 const std::string& StringTable::InternString(const base::StringPiece& str) {
-  std::string value(str.data(), str.size());
-  return *(string_table_.insert(value).first);
+  // Keep the table at most three quarters full, so that the probe sequences
+  // stay short.
+  if ((string_table_.size() + 1) * 4 > slots_.size() * 3)
+    Grow();
+
+  uint32_t hash = base::SuperFastHash(str.data(), static_cast<int>(str.size()));
+  size_t mask = slots_.size() - 1;
+  size_t i = hash & mask;
+  while (slots_[i].index != kEmptySlot) {
+    if (slots_[i].hash == hash) {
+      const std::string& value = string_table_[slots_[i].index];
+      if (str == value)
+        return value;
+    }
+    i = (i + 1) & mask;
+  }
+
+  slots_[i].hash = hash;
+  slots_[i].index = static_cast<uint32_t>(string_table_.size());
+  string_table_.push_back(str.as_string());
+  return string_table_.back();
+}
+
+void StringTable::Grow() {
+  size_t slot_count = slots_.empty() ? kInitialSlotCount : 2 * slots_.size();
+  Slot empty_slot = { 0, kEmptySlot };
+  std::vector<Slot> slots(slot_count, empty_slot);
+
+  // The hashes are kept in the slots, so the strings don't need to be hashed
+  // again.
+  size_t mask = slot_count - 1;
+  for (size_t j = 0; j < slots_.size(); ++j) {
+    if (slots_[j].index == kEmptySlot)
+      continue;
+    size_t i = slots_[j].hash & mask;
+    while (slots[i].index != kEmptySlot)
+      i = (i + 1) & mask;
+    slots[i] = slots_[j];
+  }
+
+  slots_.swap(slots);
 }
 
 }  // namespace core
@@ -23,14 +23,22 @@
 // const std::string& str2 = strtab.InternString("dummy");
 //
 // str1 and str2 are the same instance of a string holding the value "dummy".
+//
+// The strings are looked up in an open-addressed hash table, which holds
+// their hashes so that most mismatches are rejected without comparing the
+// strings. The strings themselves are kept in a deque, which never moves
+// them, so the references and the string pieces that are handed out remain
+// valid as the table grows.
 
 #ifndef SYZYGY_CORE_STRING_TABLE_H_
 #define SYZYGY_CORE_STRING_TABLE_H_
 
 #include <stdint.h>
-#include <set>
+#include <deque>
 #include <string>
+#include <vector>
 
+#include "base/macros.h"
 #include "base/strings/string_piece.h"
 
 namespace core {
@@ -48,8 +56,39 @@ class StringTable {
   // @returns a canonical representation for this string.
   const std::string& InternString(const base::StringPiece& str);
 
+  // Same as InternString, for the callers that only need a view of the
+  // string.
+  // @param str The string to internalized.
+  // @returns a view of the canonical representation for this string. It
+  //     remains valid until the destruction of the table.
+  base::StringPiece Intern(const base::StringPiece& str) {
+    return base::StringPiece(InternString(str));
+  }
+
+  // @returns the number of strings in the pool.
+  size_t size() const { return string_table_.size(); }
+
  protected:
-  std::set<std::string> string_table_;
+  // A slot of the hash table.
+  struct Slot {
+    // The hash of the string in the slot.
+    uint32_t hash;
+    // The index of the string in string_table_, or kEmptySlot.
+    uint32_t index;
+  };
+
+  static const uint32_t kEmptySlot = static_cast<uint32_t>(-1);
+
+  // Reallocates the hash table with twice as many slots, or with an initial
+  // set of slots if it's empty.
+  void Grow();
+
+  // The interned strings, in the order in which they were added.
+  std::deque<std::string> string_table_;
+
+  // The hash table of the strings, with linear probing. Its size is a power
+  // of two.
+  std::vector<Slot> slots_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(StringTable);
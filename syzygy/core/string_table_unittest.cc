@@ -14,6 +14,9 @@
 
 #include "syzygy/core/string_table.h"
 
+#include <vector>
+
+#include "base/strings/string_number_conversions.h"
 #include "gtest/gtest.h"
 
 namespace core {
@@ -52,6 +55,33 @@ TEST(StringTableTest, InternString) {
   EXPECT_TRUE(str1.c_str() == str3.c_str());
   EXPECT_TRUE(str1.c_str() == str4.c_str());
   EXPECT_FALSE(str1.c_str() == str5.c_str());
+  EXPECT_EQ(3U, strtab.size());
+}
+
+TEST(StringTableTest, InternManyStrings) {
+  TestStringTable strtab;
+
+  // Intern enough strings for the hash table to grow several times, and keep
+  // the views of the first ones to check that they remain valid.
+  const size_t kStringCount = 10000;
+  std::vector<base::StringPiece> views;
+  for (size_t i = 0; i < kStringCount; ++i)
+    views.push_back(strtab.Intern(base::SizeTToString(i)));
+  EXPECT_EQ(kStringCount, strtab.size());
+
+  for (size_t i = 0; i < kStringCount; ++i) {
+    std::string value = base::SizeTToString(i);
+    EXPECT_EQ(value, views[i]);
+    base::StringPiece view = strtab.Intern(value);
+    EXPECT_EQ(views[i].data(), view.data());
+  }
+  EXPECT_EQ(kStringCount, strtab.size());
+
+  // The empty string can be interned as well.
+  base::StringPiece empty = strtab.Intern(base::StringPiece());
+  EXPECT_TRUE(empty.empty());
+  EXPECT_EQ(empty.data(), strtab.Intern("").data());
+  EXPECT_EQ(kStringCount + 1, strtab.size());
 }
 
 }  // namespace core
@@ -19,6 +19,7 @@
 #include <assert.h>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <sstream>
 
 namespace crashdata {
@@ -27,6 +28,12 @@ namespace {
 
 const size_t kIndentSize = 2;
 
+const char kHexDigits[] = "0123456789ABCDEF";
+
+// The number of bytes of a blob's data emitted per element: the quotes, the
+// 0x prefix, the two digits, the comma and a space when pretty-printing.
+const size_t kBlobElementSize = 8;
+
 void IncreaseIndent(std::string* indent) {
   if (!indent)
     return;
@@ -46,32 +53,59 @@ void EmitIndent(std::string* indent, std::string* output) {
   output->append(*indent);
 }
 
+// These are emitted for each byte of the blobs, which can hold whole shadow
+// memory dumps, so they format without going through a stream.
 void EmitHexValue8(unsigned char value, std::string* output) {
   assert(output != nullptr);
-  output->push_back('"');
-  std::ostringstream oss;
-  oss << "0x" << std::hex << std::setfill('0') << std::setw(2)
-      << std::uppercase << static_cast<unsigned int>(value);
-  output->append(oss.str());
-  output->push_back('"');
+  const char kValue[] = {
+      '"', '0', 'x', kHexDigits[value >> 4], kHexDigits[value & 0xF], '"'};
+  output->append(kValue, sizeof(kValue));
 }
 
+// Emits at least 8 digits, and more for the values that don't fit in 32 bits.
 void EmitHexValue32(google::protobuf::uint64 value, std::string* output) {
   assert(output != nullptr);
-  output->push_back('"');
-  std::ostringstream oss;
-  oss << "0x" << std::hex << std::setfill('0') << std::setw(8)
-      << std::uppercase << value;
-  output->append(oss.str());
-  output->push_back('"');
+  char buffer[20];
+  char* end = buffer + sizeof(buffer);
+  char* begin = end;
+  *--begin = '"';
+  for (size_t i = 0; i < 8 || value != 0; ++i) {
+    *--begin = kHexDigits[value & 0xF];
+    value >>= 4;
+  }
+  *--begin = 'x';
+  *--begin = '0';
+  *--begin = '"';
+  output->append(begin, end);
 }
 
-template <typename IntType>
-void EmitDecValue(IntType value, std::string* output) {
+void EmitDecValue(bool negative,
+                  google::protobuf::uint64 magnitude,
+                  std::string* output) {
   assert(output != nullptr);
-  std::ostringstream oss;
-  oss << std::dec << std::setw(0) << value;
-  output->append(oss.str());
+  char buffer[24];
+  char* end = buffer + sizeof(buffer);
+  char* begin = end;
+  do {
+    *--begin = static_cast<char>('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0);
+  if (negative)
+    *--begin = '-';
+  output->append(begin, end);
+}
+
+void EmitDecValue(google::protobuf::uint64 value, std::string* output) {
+  EmitDecValue(false, value, output);
+}
+
+void EmitDecValue(google::protobuf::int64 value, std::string* output) {
+  // Negate through the unsigned type, which is defined for the minimum value.
+  google::protobuf::uint64 magnitude =
+      static_cast<google::protobuf::uint64>(value);
+  if (value < 0)
+    magnitude = 0 - magnitude;
+  EmitDecValue(value < 0, magnitude, output);
 }
 
 void EmitDouble(double value, std::string* output) {
@@ -88,17 +122,19 @@ void EmitNull(std::string* output) {
 
 void EmitString(const std::string& s, std::string* output) {
   assert(output != nullptr);
-  output->reserve(output->size() + 2 + s.size());
   output->push_back('"');
+
+  // Append the runs of characters that need no escaping in one go.
+  size_t run_begin = 0;
   for (size_t i = 0; i < s.size(); ++i) {
-    if (s[i] == '"') {
-      output->append("\\\"");
-    } else if (s[i] == '\\') {
-      output->append("\\\\");
-    } else {
-      output->push_back(s[i]);
-    }
+    if (s[i] != '"' && s[i] != '\\')
+      continue;
+    output->append(s, run_begin, i - run_begin);
+    output->push_back('\\');
+    output->push_back(s[i]);
+    run_begin = i + 1;
   }
+  output->append(s, run_begin, std::string::npos);
   output->push_back('"');
 }
 
@@ -247,7 +283,8 @@ struct BlobYieldFunctor {
       case 2: {
         EmitDictKey("size", indent, output);
         if (blob_->has_size()) {
-          EmitDecValue(blob_->size(), output);
+          EmitDecValue(static_cast<google::protobuf::uint64>(blob_->size()),
+                       output);
         } else {
           EmitNull(output);
         }
@@ -256,6 +293,10 @@ struct BlobYieldFunctor {
       case 3: {
         EmitDictKey("data", indent, output);
         if (blob_->has_data()) {
+          // The data dominates the size of the blob, so make room for it
+          // up front.
+          output->reserve(output->size() +
+                          blob_->data().size() * kBlobElementSize);
           BlobDataYieldFunctor yield(blob_);
           if (!EmitJsonList('[', ']', 8, blob_->data().size(), yield,
                             indent, output)) {
@@ -473,17 +514,13 @@ bool ToJson(bool pretty_print, const Value* value, std::string* output) {
     indent = &indent_content;
   }
 
-  // Produce the output to a temp variable, as partial output may be produced
-  // in case of error.
-  std::string temp;
-  if (!ToJson(value, indent, &temp))
+  // Produce the output directly in the destination buffer, so that a caller
+  // reusing it doesn't pay for an allocation and a copy. Partial output is
+  // produced in case of error, so it's discarded.
+  size_t initial_size = output->size();
+  if (!ToJson(value, indent, output)) {
+    output->resize(initial_size);
     return false;
-
-  // Place the output in the desired string as efficiently as possible.
-  if (output->empty()) {
-    output->swap(temp);
-  } else {
-    output->append(temp);
   }
 
   return true;
@@ -23,10 +23,12 @@
 namespace crashdata {
 
 // Converts the provided crashdata protobuf to an equivalent JSON
-// representation.
-// @param pretty_print If true the resulting JSON will be pretty-printed.
+// representation. The JSON is appended to @p output, which can be reused
+// across calls to avoid reallocating it.
+// @param pretty_print If true the resulting JSON will be pretty-printed,
+//     otherwise it's emitted without any whitespace.
 // @param value A value object containing crash metadata.
-// @param output The destination buffer.
+// @param output The destination buffer. It's left unchanged on failure.
 // @returns true on success, false otherwise.
 bool ToJson(bool pretty_print, const Value* value, std::string* output);
 
@@ -14,6 +14,8 @@
 
 #include "syzygy/crashdata/json.h"
 
+#include <limits>
+
 #include "gtest/gtest.h"
 
 namespace crashdata {
@@ -88,6 +90,20 @@ TEST(CrashDataJsonTest, ValueLeafInteger) {
   TestConversion(false, value, kExpected);;
 }
 
+TEST(CrashDataJsonTest, ValueLeafIntegerLimits) {
+  Value value;
+  LeafSetInt(std::numeric_limits<google::protobuf::int64>::min(),
+             ValueGetLeaf(&value));
+  TestConversion(false, value, "-9223372036854775808");
+
+  LeafSetInt(0, ValueGetLeaf(&value));
+  TestConversion(false, value, "0");
+
+  LeafSetUInt(std::numeric_limits<google::protobuf::uint64>::max(),
+              ValueGetLeaf(&value));
+  TestConversion(false, value, "18446744073709551615");
+}
+
 TEST(CrashDataJsonTest, ValueLeafUnsignedInteger) {
   Value value;
   LeafSetUInt(653, ValueGetLeaf(&value));
@@ -124,6 +140,13 @@ TEST(CrashDataJsonTest, ValueLeafAddress) {
   TestConversion(false, value, kExpected);;
 }
 
+TEST(CrashDataJsonTest, ValueLeafWideAddress) {
+  Value value;
+  LeafGetAddress(ValueGetLeaf(&value))->set_address(0x123456789ABCULL);
+
+  TestConversion(false, value, "\"0x123456789ABC\"");
+}
+
 TEST(CrashDataJsonTest, ValueLeafStackTrace) {
   Value value;
   StackTrace* stack = LeafGetStackTrace(ValueGetLeaf(&value));
@@ -291,4 +314,22 @@ TEST(CrashDataJsonTest, AllTypes) {
   TestConversion(false, value, kExpectedCompact);
 }
 
+TEST(CrashDataJsonTest, OutputIsAppended) {
+  Value value;
+  LeafSetUInt(653, ValueGetLeaf(&value));
+
+  std::string json("[");
+  EXPECT_TRUE(ToJson(false, &value, &json));
+  EXPECT_EQ("[653", json);
+
+  // A failed conversion leaves the buffer as it was, even when the list's
+  // first element was converted.
+  Value bad_value;
+  ValueList* list = ValueGetValueList(&bad_value);
+  list->add_values()->CopyFrom(value);
+  list->add_values();
+  EXPECT_FALSE(ToJson(true, &bad_value, &json));
+  EXPECT_EQ("[653", json);
+}
+
 }  // namespace crashdata
@@ -71,9 +71,11 @@
 #include "syzygy/experimental/compare/compare.h"
 
 #include <algorithm>
+#include <unordered_map>
 
 #include "base/logging.h"
 #include "base/md5.h"
+#include "base/sys_info.h"
 #include "syzygy/block_graph/block_hash.h"
 #include "syzygy/common/comparable.h"
 #include "syzygy/experimental/compare/block_compare.h"
@@ -137,8 +139,9 @@ class BlockFeature {
     DCHECK_GT(static_cast<size_t>(kFeatureCount), id);
   }
 
-  // Initializes the metadata for this feature and the given @p block.
-  virtual bool InitMetadata(BlockMetadata* metadata) const = 0;
+  // Initializes the metadata for this feature and the given blocks.
+  virtual bool InitMetadata(
+      const std::vector<BlockMetadata*>& metadata) const = 0;
 
   // Compares two blocks, returning their relative sort order (-1, 0, 1).
   virtual int Compare(const BlockMetadata& metadata0,
@@ -295,7 +298,7 @@ class FeatureIndex {
 
   // Populates block_infos_ and block_metadata_ with the blocks from the
   // given BlockGraph.
-  bool AddBlocks(const BlockFeature& block_feature,
+  void AddBlocks(const BlockFeature& block_feature,
                  size_t block_graph_index,
                  const BlockGraph& block_graph) {
     DCHECK(block_graph_index == 0 || block_graph_index == 1);
@@ -317,18 +320,12 @@ class FeatureIndex {
             std::make_pair(block, metadata)).first;
       }
 
-      // Initialize any metadata for this feature.
-      if (!block_feature.InitMetadata(&metadata_it->second))
-        return false;
-
       // Add this block to block_infos_.
       BlockInfo block_info(&metadata_it->second,
                            block_graph_index,
                            block_feature.id());
       block_infos_.push_back(block_info);
     }
-
-    return true;
   }
 
   // Maps the given block, returning its feature bucket.
@@ -421,8 +418,11 @@ class FeatureIndex {
   std::vector<FeatureInfo> feature_infos_;
 
   // There is a sinlge instance of block metadata shared across all
-  // FeatureIndex objects.
-  typedef std::map<const BlockGraph::Block*, BlockMetadata> BlockMetadataMap;
+  // FeatureIndex objects. This is looked up for every block that is mapped,
+  // so it's hashed. Its values are referred to by block_infos_, which is fine
+  // as rehashing doesn't move them.
+  typedef std::unordered_map<const BlockGraph::Block*, BlockMetadata>
+      BlockMetadataMap;
   static BlockMetadataMap block_metadata_;
 
   // This is copied from the BlockFeature provided in the constructor.
@@ -444,9 +444,16 @@ FeatureIndex::FeatureIndex(const BlockFeature& block_feature,
   // Add the blocks to block_infos_, and initialize metadata.
   block_infos_.reserve(block_graph0.blocks().size() +
       block_graph1.blocks().size());
-  if (!AddBlocks(block_feature, 0, block_graph0))
-    return;
-  if (!AddBlocks(block_feature, 1, block_graph1))
+  AddBlocks(block_feature, 0, block_graph0);
+  AddBlocks(block_feature, 1, block_graph1);
+
+  // Initialize the metadata for this feature, all at once so that the feature
+  // can spread the work over several threads.
+  std::vector<BlockMetadata*> metadata;
+  metadata.reserve(block_infos_.size());
+  for (const BlockInfo& block_info : block_infos_)
+    metadata.push_back(block_info.metadata);
+  if (!block_feature.InitMetadata(metadata))
     return;
 
   // Sort block_infos_.
@@ -506,9 +513,21 @@ class BlockHashFeature : public BlockFeature {
   BlockHashFeature() : BlockFeature(kHashFeature) {
   }
 
-  virtual bool InitMetadata(BlockMetadata* metadata) const {
-    DCHECK(metadata != NULL);
-    metadata->block_hash.Hash(metadata->block);
+  virtual bool InitMetadata(
+      const std::vector<BlockMetadata*>& metadata) const {
+    // Hashing is the most expensive part of building the index, so the blocks
+    // are hashed in parallel.
+    ConstBlockVector blocks;
+    blocks.reserve(metadata.size());
+    for (const BlockMetadata* block_metadata : metadata)
+      blocks.push_back(block_metadata->block);
+
+    std::vector<block_graph::BlockHash> hashes;
+    block_graph::BlockHash::HashBlocks(
+        blocks, static_cast<size_t>(base::SysInfo::NumberOfProcessors()),
+        &hashes);
+    for (size_t i = 0; i < metadata.size(); ++i)
+      metadata[i]->block_hash = hashes[i];
     return true;
   }
 
@@ -527,7 +546,8 @@ class BlockNameFeature : public BlockFeature {
   BlockNameFeature() : BlockFeature(kNameFeature) {
   }
 
-  virtual bool InitMetadata(BlockMetadata* metadata) const {
+  virtual bool InitMetadata(
+      const std::vector<BlockMetadata*>& metadata) const {
     // TODO(chrisha): Look for occurrences of 0x[a-fA-F0-9]{8}. If found,
     //     replace them with 0xXXXXXXXX.
     return true;
@@ -0,0 +1,53 @@
+# Copyright 2016 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+{
+  'variables': {
+    'chromium_code': 1,
+  },
+  'targets': [
+    {
+      'target_name': 'pdb_benchmarks_lib',
+      'type': 'static_library',
+      'sources': [
+        'pdb_benchmarks_app.cc',
+        'pdb_benchmarks_app.h',
+      ],
+      'dependencies': [
+        '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/application/application.gyp:application_lib',
+        '<(src)/syzygy/core/core.gyp:core_lib',
+        '<(src)/syzygy/pdb/pdb.gyp:pdb_lib',
+      ],
+    },
+    {
+      'target_name': 'pdb_benchmarks',
+      'type': 'executable',
+      'sources': [
+        'pdb_benchmarks_main.cc',
+      ],
+      'dependencies': [
+        'pdb_benchmarks_lib',
+      ],
+      'run_as': {
+        'action': [
+          '$(TargetPath)',
+          '--iterations=5',
+          '--output=$(OutDir)\\pdb_benchmarks_for_test_dll.json',
+          '$(OutDir)\\test_dll.dll.pdb',
+        ],
+      },
+    },
+  ],
+}
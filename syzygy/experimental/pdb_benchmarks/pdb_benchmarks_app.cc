@@ -0,0 +1,555 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/experimental/pdb_benchmarks/pdb_benchmarks_app.h"
+
+#include <windows.h>  // NOLINT
+#include <psapi.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <memory>
+
+#include "base/bind.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/json/json_reader.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/time/time.h"
+#include "base/values.h"
+#include "syzygy/common/binary_stream.h"
+#include "syzygy/pdb/omap.h"
+#include "syzygy/pdb/pdb_constants.h"
+#include "syzygy/pdb/pdb_dbi_stream.h"
+#include "syzygy/pdb/pdb_file.h"
+#include "syzygy/pdb/pdb_reader.h"
+#include "syzygy/pdb/pdb_symbol_record.h"
+#include "syzygy/pdb/pdb_type_info_stream_enum.h"
+#include "syzygy/pdb/pdb_writer.h"
+
+namespace experimental {
+
+namespace {
+
+const char kUsageFormatStr[] =
+    "Usage: %ls [options] PDB_FILE [PDB_FILE ...]\n"
+    "\n"
+    "  A tool that times the PDB readers and writers on a set of PDB files,\n"
+    "  and reports the throughput and the peak memory usage as JSON. The\n"
+    "  benchmarks open the PDB, enumerate its type info stream, parse its\n"
+    "  module symbol streams, translate addresses through its OMAP and\n"
+    "  rewrite it.\n"
+    "\n"
+    "Optional parameters:\n"
+    "  --iterations=NUM     The number of times to run each benchmark. The\n"
+    "                       shortest time is reported. Defaults to 5.\n"
+    "  --jobs=NUM           The number of threads used to parse the module\n"
+    "                       symbol streams. Defaults to the number of\n"
+    "                       processors.\n"
+    "  --output=PATH        The path to which the JSON results are written.\n"
+    "                       Defaults to the standard output.\n"
+    "  --pretty-print       Pretty prints the JSON results.\n"
+    "  --baseline=PATH      The results of a previous run. The tool fails if\n"
+    "                       a benchmark is slower than in these results by\n"
+    "                       more than the tolerance.\n"
+    "  --tolerance=PERCENT  The tolerance of the comparison to the baseline.\n"
+    "                       Defaults to 10.\n";
+
+const int kDefaultIterations = 5;
+const int kDefaultTolerancePercent = 10;
+
+// Keeps the shortest duration of the iterations of a benchmark.
+void RecordSample(const base::TimeTicks& start, double* seconds) {
+  DCHECK(seconds != NULL);
+  double sample = (base::TimeTicks::Now() - start).InSecondsF();
+  *seconds = std::min(*seconds, sample);
+}
+
+// Counts the symbols of a module. The modules are visited concurrently, but
+// each count is only updated by the thread that visits its module.
+bool CountModuleSymbol(std::vector<size_t>* counts,
+                       size_t module_index,
+                       uint16_t symbol_length,
+                       uint16_t symbol_type,
+                       common::BinaryStreamReader* symbol_reader) {
+  DCHECK(counts != NULL);
+  DCHECK_LT(module_index, counts->size());
+  ++(*counts)[module_index];
+  return true;
+}
+
+// Opens a PDB file.
+bool ReadPdb(const base::FilePath& pdb_path, pdb::PdbFile* pdb_file) {
+  DCHECK(pdb_file != NULL);
+  pdb::PdbReader reader;
+  if (!reader.Read(pdb_path, pdb_file)) {
+    LOG(ERROR) << "Failed to read PDB \"" << pdb_path.value() << "\".";
+    return false;
+  }
+  return true;
+}
+
+// Reads the DBI stream of a PDB file.
+bool ReadDbiStream(const pdb::PdbFile& pdb_file, pdb::DbiStream* dbi_stream) {
+  DCHECK(dbi_stream != NULL);
+  scoped_refptr<pdb::PdbStream> stream = pdb_file.GetStream(pdb::kDbiStream);
+  if (stream.get() == NULL || !dbi_stream->Read(stream.get())) {
+    LOG(ERROR) << "Failed to read the DBI stream.";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+PdbBenchmarksApp::PdbBenchmarksApp()
+    : application::AppImplBase("PDB Benchmarks"),
+      num_iterations_(kDefaultIterations),
+      tolerance_percent_(kDefaultTolerancePercent),
+      pretty_print_(false) {
+}
+
+void PdbBenchmarksApp::PrintUsage(const base::FilePath& program,
+                                  const base::StringPiece& message) {
+  if (!message.empty()) {
+    ::fwrite(message.data(), 1, message.length(), out());
+    ::fprintf(out(), "\n\n");
+  }
+
+  ::fprintf(out(), kUsageFormatStr, program.BaseName().value().c_str());
+}
+
+bool PdbBenchmarksApp::ParseCommandLine(const base::CommandLine* cmd_line) {
+  DCHECK(cmd_line != NULL);
+
+  if (cmd_line->HasSwitch("help")) {
+    PrintUsage(cmd_line->GetProgram(), "");
+    return false;
+  }
+
+  const base::CommandLine::StringVector& args = cmd_line->GetArgs();
+  if (args.empty()) {
+    PrintUsage(cmd_line->GetProgram(), "Must specify at least one PDB file!");
+    return false;
+  }
+  for (size_t i = 0; i < args.size(); ++i)
+    pdb_paths_.push_back(base::FilePath(args[i]));
+
+  if (cmd_line->HasSwitch("iterations") &&
+      (!base::StringToInt(cmd_line->GetSwitchValueNative("iterations"),
+                          &num_iterations_) ||
+       num_iterations_ <= 0)) {
+    PrintUsage(cmd_line->GetProgram(), "Must specify '--iterations' >= 1!");
+    return false;
+  }
+
+  if (cmd_line->HasSwitch("tolerance") &&
+      (!base::StringToInt(cmd_line->GetSwitchValueNative("tolerance"),
+                          &tolerance_percent_) ||
+       tolerance_percent_ < 0)) {
+    PrintUsage(cmd_line->GetProgram(), "Must specify '--tolerance' >= 0!");
+    return false;
+  }
+
+  output_path_ = cmd_line->GetSwitchValuePath("output");
+  baseline_path_ = cmd_line->GetSwitchValuePath("baseline");
+  pretty_print_ = cmd_line->HasSwitch("pretty-print");
+
+  return true;
+}
+
+int PdbBenchmarksApp::Run() {
+  DCHECK(!pdb_paths_.empty());
+  DCHECK_LT(0, num_iterations_);
+
+  base::ScopedTempDir temp_dir;
+  if (!temp_dir.CreateUniqueTempDir()) {
+    LOG(ERROR) << "Failed to create a temporary directory.";
+    return 1;
+  }
+  temp_dir_ = temp_dir.path();
+
+  std::vector<PdbResults> results(pdb_paths_.size());
+  for (size_t i = 0; i < pdb_paths_.size(); ++i) {
+    LOG(INFO) << "Benchmarking \"" << pdb_paths_[i].value() << "\".";
+    if (!BenchmarkPdb(pdb_paths_[i], &results[i]))
+      return 1;
+  }
+
+  base::ScopedFILE output_file;
+  FILE* output = out();
+  if (!output_path_.empty()) {
+    output_file.reset(base::OpenFile(output_path_, "wb"));
+    if (output_file.get() == NULL) {
+      LOG(ERROR) << "Failed to open \"" << output_path_.value()
+                 << "\" for writing.";
+      return 1;
+    }
+    output = output_file.get();
+  }
+
+  core::JSONFileWriter json(output, pretty_print_);
+  if (!WriteResults(results, &json))
+    return 1;
+  ::fprintf(output, "\n");
+
+  if (!baseline_path_.empty() && !CompareToBaseline(results))
+    return 1;
+
+  return 0;
+}
+
+bool PdbBenchmarksApp::BenchmarkPdb(const base::FilePath& pdb_path,
+                                    PdbResults* results) {
+  DCHECK(results != NULL);
+
+  int64_t size = 0;
+  if (!base::GetFileSize(pdb_path, &size)) {
+    LOG(ERROR) << "Failed to get the size of \"" << pdb_path.value() << "\".";
+    return false;
+  }
+  results->path = pdb_path;
+  results->size = static_cast<double>(size);
+
+  BenchmarkResult result;
+  if (!BenchmarkOpen(pdb_path, &result))
+    return false;
+  results->benchmarks.push_back(result);
+
+  result = BenchmarkResult();
+  if (!BenchmarkTypeInfo(pdb_path, &result))
+    return false;
+  results->benchmarks.push_back(result);
+
+  result = BenchmarkResult();
+  if (!BenchmarkModuleSymbols(pdb_path, &result))
+    return false;
+  results->benchmarks.push_back(result);
+
+  result = BenchmarkResult();
+  if (!BenchmarkOmap(pdb_path, &result))
+    return false;
+  if (!result.name.empty())
+    results->benchmarks.push_back(result);
+
+  result = BenchmarkResult();
+  if (!BenchmarkRewrite(pdb_path, &result))
+    return false;
+  results->benchmarks.push_back(result);
+
+  PROCESS_MEMORY_COUNTERS counters = {};
+  if (!::GetProcessMemoryInfo(::GetCurrentProcess(), &counters,
+                              sizeof(counters))) {
+    LOG(ERROR) << "Failed to get the memory usage of the process.";
+    return false;
+  }
+  results->peak_working_set = static_cast<double>(counters.PeakWorkingSetSize);
+  results->peak_pagefile_usage =
+      static_cast<double>(counters.PeakPagefileUsage);
+
+  return true;
+}
+
+bool PdbBenchmarksApp::BenchmarkOpen(const base::FilePath& pdb_path,
+                                     BenchmarkResult* result) {
+  DCHECK(result != NULL);
+
+  int64_t size = 0;
+  if (!base::GetFileSize(pdb_path, &size))
+    return false;
+
+  result->name = "open";
+  result->seconds = std::numeric_limits<double>::max();
+  for (int i = 0; i < num_iterations_; ++i) {
+    pdb::PdbFile pdb_file;
+    base::TimeTicks start = base::TimeTicks::Now();
+    if (!ReadPdb(pdb_path, &pdb_file))
+      return false;
+    RecordSample(start, &result->seconds);
+    result->items = static_cast<double>(pdb_file.StreamCount());
+  }
+  result->bytes = static_cast<double>(size);
+
+  return true;
+}
+
+bool PdbBenchmarksApp::BenchmarkTypeInfo(const base::FilePath& pdb_path,
+                                         BenchmarkResult* result) {
+  DCHECK(result != NULL);
+
+  pdb::PdbFile pdb_file;
+  if (!ReadPdb(pdb_path, &pdb_file))
+    return false;
+  scoped_refptr<pdb::PdbStream> stream = pdb_file.GetStream(pdb::kTpiStream);
+  if (stream.get() == NULL) {
+    LOG(ERROR) << "The PDB has no type info stream.";
+    return false;
+  }
+  scoped_refptr<pdb::PdbStream> hash_stream =
+      pdb::GetTypeInfoHashStream(pdb_file, stream.get());
+
+  result->name = "type_info";
+  result->seconds = std::numeric_limits<double>::max();
+  for (int i = 0; i < num_iterations_; ++i) {
+    size_t type_count = 0;
+    base::TimeTicks start = base::TimeTicks::Now();
+    pdb::TypeInfoEnumerator enumerator(stream.get(), hash_stream.get());
+    if (!enumerator.Init()) {
+      LOG(ERROR) << "Failed to read the type info stream header.";
+      return false;
+    }
+    while (!enumerator.EndOfStream()) {
+      if (!enumerator.NextTypeInfoRecord()) {
+        LOG(ERROR) << "Failed to read a type info record.";
+        return false;
+      }
+      ++type_count;
+    }
+    RecordSample(start, &result->seconds);
+    result->items = static_cast<double>(type_count);
+  }
+  result->bytes = static_cast<double>(stream->length());
+
+  return true;
+}
+
+bool PdbBenchmarksApp::BenchmarkModuleSymbols(const base::FilePath& pdb_path,
+                                              BenchmarkResult* result) {
+  DCHECK(result != NULL);
+
+  pdb::PdbFile pdb_file;
+  pdb::DbiStream dbi_stream;
+  if (!ReadPdb(pdb_path, &pdb_file) || !ReadDbiStream(pdb_file, &dbi_stream))
+    return false;
+
+  size_t symbol_bytes = 0;
+  for (const auto& module : dbi_stream.modules())
+    symbol_bytes += module.module_info_base().symbol_bytes;
+
+  result->name = "module_symbols";
+  result->seconds = std::numeric_limits<double>::max();
+  for (int i = 0; i < num_iterations_; ++i) {
+    std::vector<size_t> counts(dbi_stream.modules().size());
+    pdb::VisitModuleSymbolsCallback callback =
+        base::Bind(&CountModuleSymbol, base::Unretained(&counts));
+    base::TimeTicks start = base::TimeTicks::Now();
+    if (!pdb::VisitModuleSymbols(callback, dbi_stream, pdb_file,
+                                 jobs())) {
+      LOG(ERROR) << "Failed to parse the module symbol streams.";
+      return false;
+    }
+    RecordSample(start, &result->seconds);
+
+    size_t symbol_count = 0;
+    for (size_t count : counts)
+      symbol_count += count;
+    result->items = static_cast<double>(symbol_count);
+  }
+  result->bytes = static_cast<double>(symbol_bytes);
+
+  return true;
+}
+
+bool PdbBenchmarksApp::BenchmarkOmap(const base::FilePath& pdb_path,
+                                     BenchmarkResult* result) {
+  DCHECK(result != NULL);
+
+  pdb::PdbFile pdb_file;
+  if (!ReadPdb(pdb_path, &pdb_file))
+    return false;
+  std::vector<OMAP> omap_from;
+  if (!pdb::ReadOmapsFromPdbFile(pdb_file, NULL, &omap_from) ||
+      omap_from.empty()) {
+    LOG(INFO) << "The PDB has no OMAP, skipping the OMAP benchmark.";
+    return true;
+  }
+
+  // Translate an address in each of the ranges of the original image.
+  std::vector<core::RelativeAddress> addresses;
+  addresses.reserve(omap_from.size());
+  for (const OMAP& omap : omap_from)
+    addresses.push_back(core::RelativeAddress(omap.rva + 1));
+
+  result->name = "omap";
+  result->seconds = std::numeric_limits<double>::max();
+  for (int i = 0; i < num_iterations_; ++i) {
+    base::TimeTicks start = base::TimeTicks::Now();
+    pdb::OmapTranslator translator(omap_from);
+    uint32_t checksum = 0;
+    for (const core::RelativeAddress& address : addresses)
+      checksum += translator.Translate(address).value();
+    RecordSample(start, &result->seconds);
+
+    // Use the translated addresses, so that the translation isn't optimized
+    // away.
+    if (checksum == 0)
+      LOG(INFO) << "All the addresses translate to zero.";
+  }
+  result->items = static_cast<double>(addresses.size());
+  result->bytes = static_cast<double>(omap_from.size() * sizeof(OMAP));
+
+  return true;
+}
+
+bool PdbBenchmarksApp::BenchmarkRewrite(const base::FilePath& pdb_path,
+                                        BenchmarkResult* result) {
+  DCHECK(result != NULL);
+
+  pdb::PdbFile pdb_file;
+  if (!ReadPdb(pdb_path, &pdb_file))
+    return false;
+  base::FilePath output_path = temp_dir_.Append(L"rewritten.pdb");
+
+  result->name = "rewrite";
+  result->seconds = std::numeric_limits<double>::max();
+  for (int i = 0; i < num_iterations_; ++i) {
+    pdb::PdbWriter writer;
+    base::TimeTicks start = base::TimeTicks::Now();
+    if (!writer.Write(output_path, pdb_file)) {
+      LOG(ERROR) << "Failed to write PDB \"" << output_path.value() << "\".";
+      return false;
+    }
+    RecordSample(start, &result->seconds);
+  }
+
+  int64_t size = 0;
+  if (!base::GetFileSize(output_path, &size))
+    return false;
+  result->items = static_cast<double>(pdb_file.StreamCount());
+  result->bytes = static_cast<double>(size);
+
+  return true;
+}
+
+bool PdbBenchmarksApp::WriteResults(const std::vector<PdbResults>& results,
+                                    core::JSONFileWriter* json) {
+  DCHECK(json != NULL);
+
+  if (!json->OpenDict() ||
+      !json->OutputKey("iterations") ||
+      !json->OutputInteger(num_iterations_) ||
+      !json->OutputKey("threads") ||
+      !json->OutputInteger(static_cast<int>(jobs())) ||
+      !json->OutputKey("pdbs") ||
+      !json->OpenList()) {
+    return false;
+  }
+
+  for (const PdbResults& pdb_results : results) {
+    if (!json->OpenDict() ||
+        !json->OutputKey("path") ||
+        !json->OutputString(pdb_results.path.value()) ||
+        !json->OutputKey("size") ||
+        !json->OutputDouble(pdb_results.size) ||
+        !json->OutputKey("peak_working_set") ||
+        !json->OutputDouble(pdb_results.peak_working_set) ||
+        !json->OutputKey("peak_pagefile_usage") ||
+        !json->OutputDouble(pdb_results.peak_pagefile_usage) ||
+        !json->OutputKey("benchmarks") ||
+        !json->OpenList()) {
+      return false;
+    }
+
+    for (const BenchmarkResult& result : pdb_results.benchmarks) {
+      double seconds = std::max(result.seconds,
+                                std::numeric_limits<double>::min());
+      if (!json->OpenDict() ||
+          !json->OutputKey("name") ||
+          !json->OutputString(result.name) ||
+          !json->OutputKey("seconds") ||
+          !json->OutputDouble(result.seconds) ||
+          !json->OutputKey("bytes") ||
+          !json->OutputDouble(result.bytes) ||
+          !json->OutputKey("bytes_per_second") ||
+          !json->OutputDouble(result.bytes / seconds) ||
+          !json->OutputKey("items") ||
+          !json->OutputDouble(result.items) ||
+          !json->OutputKey("items_per_second") ||
+          !json->OutputDouble(result.items / seconds) ||
+          !json->CloseDict()) {
+        return false;
+      }
+    }
+
+    if (!json->CloseList() || !json->CloseDict())
+      return false;
+  }
+
+  return json->CloseList() && json->CloseDict() && json->Flush();
+}
+
+bool PdbBenchmarksApp::CompareToBaseline(
+    const std::vector<PdbResults>& results) {
+  std::string contents;
+  if (!base::ReadFileToString(baseline_path_, &contents)) {
+    LOG(ERROR) << "Failed to read \"" << baseline_path_.value() << "\".";
+    return false;
+  }
+  std::unique_ptr<base::Value> value(base::JSONReader::Read(contents));
+  base::DictionaryValue* dict = NULL;
+  base::ListValue* pdbs = NULL;
+  if (value.get() == NULL || !value->GetAsDictionary(&dict) ||
+      !dict->GetList("pdbs", &pdbs)) {
+    LOG(ERROR) << "Invalid baseline \"" << baseline_path_.value() << "\".";
+    return false;
+  }
+
+  // Index the baseline times by PDB path and benchmark name.
+  typedef std::pair<base::FilePath::StringType, std::string> BenchmarkKey;
+  std::map<BenchmarkKey, double> baseline;
+  for (size_t i = 0; i < pdbs->GetSize(); ++i) {
+    base::DictionaryValue* pdb = NULL;
+    base::string16 path;
+    base::ListValue* benchmarks = NULL;
+    if (!pdbs->GetDictionary(i, &pdb) || !pdb->GetString("path", &path) ||
+        !pdb->GetList("benchmarks", &benchmarks)) {
+      LOG(ERROR) << "Invalid baseline \"" << baseline_path_.value() << "\".";
+      return false;
+    }
+    for (size_t j = 0; j < benchmarks->GetSize(); ++j) {
+      base::DictionaryValue* benchmark = NULL;
+      std::string name;
+      double seconds = 0.0;
+      if (!benchmarks->GetDictionary(j, &benchmark) ||
+          !benchmark->GetString("name", &name) ||
+          !benchmark->GetDouble("seconds", &seconds)) {
+        LOG(ERROR) << "Invalid baseline \"" << baseline_path_.value() << "\".";
+        return false;
+      }
+      baseline[BenchmarkKey(path, name)] = seconds;
+    }
+  }
+
+  bool regressed = false;
+  double max_ratio = 1.0 + tolerance_percent_ / 100.0;
+  for (const PdbResults& pdb_results : results) {
+    for (const BenchmarkResult& result : pdb_results.benchmarks) {
+      auto it = baseline.find(BenchmarkKey(pdb_results.path.value(),
+                                           result.name));
+      if (it == baseline.end())
+        continue;
+      if (result.seconds > it->second * max_ratio) {
+        LOG(ERROR) << "Benchmark \"" << result.name << "\" of \""
+                   << pdb_results.path.value() << "\" regressed from "
+                   << it->second << " to " << result.seconds << " seconds.";
+        regressed = true;
+      }
+    }
+  }
+
+  return !regressed;
+}
+
+}  // namespace experimental
@@ -0,0 +1,133 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the PdbBenchmarksApp class, which times the PDB readers and
+// writers on a set of PDB files and reports the results as JSON. The results
+// can be compared to those of a previous run, to catch regressions.
+
+#ifndef SYZYGY_EXPERIMENTAL_PDB_BENCHMARKS_PDB_BENCHMARKS_APP_H_
+#define SYZYGY_EXPERIMENTAL_PDB_BENCHMARKS_PDB_BENCHMARKS_APP_H_
+
+#include <string>
+#include <vector>
+
+#include "base/command_line.h"
+#include "base/files/file_path.h"
+#include "syzygy/application/application.h"
+#include "syzygy/core/json_file_writer.h"
+
+namespace experimental {
+
+class PdbBenchmarksApp : public application::AppImplBase {
+ public:
+  PdbBenchmarksApp();
+
+  // @name Implementation of the AppImplBase interface.
+  // @{
+  bool ParseCommandLine(const base::CommandLine* command_line);
+
+  int Run();
+  // @}
+
+ protected:
+  // The result of a benchmark on a PDB file.
+  struct BenchmarkResult {
+    BenchmarkResult() : seconds(0.0), bytes(0.0), items(0.0) {}
+
+    // The name of the benchmark.
+    std::string name;
+    // The shortest time taken by an iteration of the benchmark.
+    double seconds;
+    // The number of bytes processed by an iteration.
+    double bytes;
+    // The number of items (types, symbols, addresses...) processed by an
+    // iteration.
+    double items;
+  };
+  typedef std::vector<BenchmarkResult> BenchmarkResults;
+
+  // The results of the benchmarks on a PDB file.
+  struct PdbResults {
+    PdbResults() : size(0.0), peak_working_set(0.0), peak_pagefile_usage(0.0) {}
+
+    base::FilePath path;
+    double size;
+    BenchmarkResults benchmarks;
+    // The peak memory usage of the process once the benchmarks of the file
+    // have run. These are high-water marks of the whole process, so they
+    // include the files benchmarked before this one.
+    double peak_working_set;
+    double peak_pagefile_usage;
+  };
+
+  // Print the app's usage information.
+  void PrintUsage(const base::FilePath& program,
+                  const base::StringPiece& message);
+
+  // Runs the benchmarks on a PDB file.
+  // @param pdb_path the PDB file to benchmark.
+  // @param results receives the results of the benchmarks.
+  // @returns true on success, false otherwise.
+  bool BenchmarkPdb(const base::FilePath& pdb_path, PdbResults* results);
+
+  // @name The benchmarks. Each of them runs the number of iterations given on
+  //     the command line.
+  // @param pdb_path the PDB file to benchmark.
+  // @param result receives the result of the benchmark.
+  // @returns true on success, false otherwise.
+  // @{
+  bool BenchmarkOpen(const base::FilePath& pdb_path, BenchmarkResult* result);
+  bool BenchmarkTypeInfo(const base::FilePath& pdb_path,
+                         BenchmarkResult* result);
+  bool BenchmarkModuleSymbols(const base::FilePath& pdb_path,
+                              BenchmarkResult* result);
+  // This returns true and leaves @p result empty if the PDB has no OMAP.
+  bool BenchmarkOmap(const base::FilePath& pdb_path, BenchmarkResult* result);
+  bool BenchmarkRewrite(const base::FilePath& pdb_path,
+                        BenchmarkResult* result);
+  // @}
+
+  // Writes the results as JSON.
+  // @param results the results to write.
+  // @param json the writer to which to write.
+  // @returns true on success, false otherwise.
+  bool WriteResults(const std::vector<PdbResults>& results,
+                    core::JSONFileWriter* json);
+
+  // Compares the results with those of the baseline file.
+  // @param results the results to compare.
+  // @returns true if no benchmark is slower than in the baseline by more than
+  //     the tolerance, false otherwise.
+  bool CompareToBaseline(const std::vector<PdbResults>& results);
+
+  // @name Command-line options.
+  // @{
+  std::vector<base::FilePath> pdb_paths_;
+  base::FilePath output_path_;
+  base::FilePath baseline_path_;
+  int num_iterations_;
+  int tolerance_percent_;
+  bool pretty_print_;
+  // @}
+
+  // The directory in which the rewritten PDBs are written.
+  base::FilePath temp_dir_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PdbBenchmarksApp);
+};
+
+}  // namespace experimental
+
+#endif  // SYZYGY_EXPERIMENTAL_PDB_BENCHMARKS_PDB_BENCHMARKS_APP_H_
@@ -16,6 +16,8 @@
 
 #include <algorithm>
 
+#include "base/bind.h"
+#include "syzygy/application/work_pool.h"
 #include "syzygy/core/section_offset_address.h"
 #include "syzygy/experimental/pdb_writer/symbols/image_symbol.h"
 #include "syzygy/pdb/pdb_constants.h"
@@ -57,16 +59,61 @@ struct SymbolWithRecordOffset {
   }
 };
 
+// The bucket of the symbols that aren't public.
+const uint16_t kNoBucket = UINT16_MAX;
+
+// The number of symbols that are hashed at once by a thread.
+const size_t kHashChunkSize = 4096;
+
 bool SymbolIsPublic(const Symbol& symbol) {
   return symbol.GetType() == Microsoft_Cci_Pdb::S_PUB32;
 }
 
+// Computes the hash table buckets of a chunk of the public symbols. This is
+// invoked concurrently for different chunks.
+// @param symbols the symbols to hash.
+// @param buckets receives the bucket of each symbol, or kNoBucket for the
+//     symbols that aren't public. It must be as large as @p symbols.
+// @param chunk the index of the chunk of symbols to hash.
+// @returns true.
+bool HashSymbolChunk(const SymbolVector* symbols,
+                     std::vector<uint16_t>* buckets,
+                     size_t chunk) {
+  DCHECK_NE(static_cast<const SymbolVector*>(NULL), symbols);
+  DCHECK_NE(static_cast<std::vector<uint16_t>*>(NULL), buckets);
+  DCHECK_EQ(symbols->size(), buckets->size());
+
+  size_t first = kHashChunkSize * chunk;
+  size_t last = std::min(first + kHashChunkSize, symbols->size());
+  for (size_t i = first; i < last; ++i) {
+    const Symbol& symbol = *(*symbols)[i];
+    if (!SymbolIsPublic(symbol)) {
+      (*buckets)[i] = kNoBucket;
+      continue;
+    }
+    const symbols::ImageSymbol& public_symbol =
+        reinterpret_cast<const symbols::ImageSymbol&>(symbol);
+    (*buckets)[i] = static_cast<uint16_t>(
+        HashString(public_symbol.name()) % kPublicStreamHashTableBitSetSize);
+  }
+  return true;
+}
+
 bool WritePublicStreamHashTable(const SymbolVector& symbols,
                                 const SymbolOffsets& symbol_offsets,
+                                size_t thread_count,
                                 WritablePdbStream* stream) {
   DCHECK_EQ(symbols.size(), symbol_offsets.size());
+  DCHECK_LT(0u, thread_count);
   DCHECK_NE(static_cast<WritablePdbStream*>(NULL), stream);
 
+  // Hash the names of the public symbols. This is the costly part of building
+  // the hash table, and the symbols are independent.
+  std::vector<uint16_t> buckets(symbols.size());
+  size_t chunk_count = (symbols.size() + kHashChunkSize - 1) / kHashChunkSize;
+  application::WorkPool pool(thread_count);
+  pool.Run(chunk_count, base::Bind(&HashSymbolChunk, &symbols, &buckets));
+
   // A vector that contains the indexes of symbols that were first in their
   // buckets.
   std::vector<uint32_t> hash_table_representatives;
@@ -77,15 +124,10 @@ bool WritePublicStreamHashTable(const SymbolVector& symbols,
   bits.Resize(kPublicStreamHashTableBitSetSize);
 
   for (size_t i = 0; i < symbols.size(); ++i) {
-    if (!SymbolIsPublic(*symbols[i]))
+    uint16_t bucket = buckets[i];
+    if (bucket == kNoBucket)
       continue;
 
-    symbols::ImageSymbol* public_symbol =
-        reinterpret_cast<symbols::ImageSymbol*>(symbols[i].get());
-
-    uint16_t bucket =
-        HashString(public_symbol->name()) % kPublicStreamHashTableBitSetSize;
-
     if (!bits.IsSet(bucket)) {
       hash_table_representatives.push_back(i);
       bits.Set(bucket);
@@ -118,7 +160,15 @@ bool WritePublicStreamHashTable(const SymbolVector& symbols,
 bool WritePublicStream(const SymbolVector& symbols,
                        const SymbolOffsets& symbol_offsets,
                        WritablePdbStream* stream) {
+  return WritePublicStream(symbols, symbol_offsets, 1, stream);
+}
+
+bool WritePublicStream(const SymbolVector& symbols,
+                       const SymbolOffsets& symbol_offsets,
+                       size_t thread_count,
+                       WritablePdbStream* stream) {
   DCHECK_EQ(symbols.size(), symbol_offsets.size());
+  DCHECK_LT(0u, thread_count);
   DCHECK_NE(static_cast<WritablePdbStream*>(NULL), stream);
 
   // Reserve space for the public stream header.
@@ -145,7 +195,8 @@ bool WritePublicStream(const SymbolVector& symbols,
   // Write a hash table in which keys are symbol names.
   size_t hash_table_offset = stream->pos();
   if (num_public_symbols > 0 &&
-      !WritePublicStreamHashTable(symbols, symbol_offsets, stream)) {
+      !WritePublicStreamHashTable(symbols, symbol_offsets, thread_count,
+                                  stream)) {
     return false;
   }
 
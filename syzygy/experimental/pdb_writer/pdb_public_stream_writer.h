@@ -35,6 +35,21 @@ bool WritePublicStream(const SymbolVector& symbols,
                        const SymbolOffsets& symbol_offsets,
                        WritablePdbStream* stream);
 
+// Writes a PDB public stream, hashing the names of the public symbols with
+// several threads. The stream is the same as the one written by
+// WritePublicStream.
+// @param symbols the symbols defined in the PDB symbol record stream.
+// @param symbol_offsets the offsets at which the symbols from |symbols| have
+//     been written in the symbol record stream.
+// @param thread_count the number of threads used to hash the names of the
+//     symbols. Must be at least 1.
+// @param stream the stream in which to write.
+// @returns true in case of success, false otherwise.
+bool WritePublicStream(const SymbolVector& symbols,
+                       const SymbolOffsets& symbol_offsets,
+                       size_t thread_count,
+                       WritablePdbStream* stream);
+
 }  // namespace pdb
 
 #endif  // SYZYGY_EXPERIMENTAL_PDB_WRITER_PDB_PUBLIC_STREAM_WRITER_H_
@@ -16,6 +16,7 @@
 
 #include "syzygy/experimental/pdb_writer/pdb_public_stream_writer.h"
 
+#include "base/strings/stringprintf.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/experimental/pdb_writer/symbols/image_symbol.h"
@@ -116,4 +117,29 @@ TEST(PdbPublicStreamWriterTest, WritePublicStream) {
   ASSERT_THAT(public_stream, testing::ElementsAreArray(kExpectedPublicStream));
 }
 
+TEST(PdbPublicStreamWriterTest, WritePublicStreamWithThreads) {
+  SymbolVector symbols;
+  SymbolOffsets symbol_offsets;
+  for (uint32_t i = 0; i < 10000; ++i) {
+    Microsoft_Cci_Pdb::SYM type = (i % 7 == 0) ? Microsoft_Cci_Pdb::S_LDATA32 :
+                                                 Microsoft_Cci_Pdb::S_PUB32;
+    symbols.push_back(std::unique_ptr<Symbol>(new symbols::ImageSymbol(
+        type, core::SectionOffsetAddress(1, 16 * i),
+        Microsoft_Cci_Pdb::T_SEGMENT, base::StringPrintf("symbol_%u", i))));
+    symbol_offsets.push_back(32 * i);
+  }
+
+  scoped_refptr<PdbByteStream> expected(new PdbByteStream());
+  ASSERT_TRUE(WritePublicStream(symbols, symbol_offsets,
+                                expected->GetWritableStream().get()));
+
+  // Hashing the symbols with several threads writes the same stream.
+  scoped_refptr<PdbByteStream> actual(new PdbByteStream());
+  ASSERT_TRUE(WritePublicStream(symbols, symbol_offsets, 4,
+                                actual->GetWritableStream().get()));
+
+  ASSERT_EQ(expected->length(), actual->length());
+  EXPECT_EQ(0, ::memcmp(expected->data(), actual->data(), expected->length()));
+}
+
 }  // namespace pdb
@@ -0,0 +1,153 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/experimental/pdb_writer/pdb_spooled_stream_writer.h"
+
+#include "base/logging.h"
+#include "syzygy/msf/msf_mapped_stream.h"
+#include "syzygy/pdb/pdb_byte_stream.h"
+
+namespace pdb {
+
+namespace {
+
+typedef msf::detail::MsfMappedStreamImpl<msf::kPdbMsfFileType>
+    PdbMappedStream;
+
+}  // namespace
+
+// The scratch stream of a record. Its buffer is reused from one record to the
+// next, so that writing a record doesn't allocate once the buffer is large
+// enough.
+class SpooledPdbStreamWriter::RecordWriter : public WritablePdbStream {
+ public:
+  RecordWriter() {}
+
+  // @returns the data of the record.
+  const uint8_t* data() const { return data_.data(); }
+
+  // Empties the record, keeping the memory of its buffer.
+  void Reset() {
+    set_pos(0);
+    SetBuffer(NULL, 0);
+    data_.clear();
+  }
+
+ protected:
+  ~RecordWriter() override {}
+
+  // WritablePdbStream implementation.
+  uint8_t* GrowBuffer(size_t size) override {
+    DCHECK_GT(size, data_.size());
+    data_.resize(size);
+    return data_.data();
+  }
+
+ private:
+  std::vector<uint8_t> data_;
+
+  DISALLOW_COPY_AND_ASSIGN(RecordWriter);
+};
+
+SpooledPdbStreamWriter::SpooledPdbStreamWriter(size_t buffer_size)
+    : buffer_size_(buffer_size), length_(0), record_(new RecordWriter()) {
+  DCHECK_LT(0u, buffer_size);
+}
+
+SpooledPdbStreamWriter::~SpooledPdbStreamWriter() {
+}
+
+bool SpooledPdbStreamWriter::Init(const base::FilePath& path) {
+  DCHECK(!file_.IsValid());
+
+  file_.Initialize(path, base::File::FLAG_CREATE_ALWAYS |
+                             base::File::FLAG_WRITE);
+  if (!file_.IsValid()) {
+    LOG(ERROR) << "Failed to create spool file \"" << path.value() << "\".";
+    return false;
+  }
+
+  path_ = path;
+  buffer_.reserve(buffer_size_);
+  return true;
+}
+
+bool SpooledPdbStreamWriter::CommitRecord() {
+  DCHECK(file_.IsValid());
+
+  // The extent of the record is the largest position it has been written to.
+  size_t record_length = record_->length();
+  if (buffer_.size() + record_length > buffer_size_ && !Flush())
+    return false;
+
+  const uint8_t* data = record_->data();
+  if (record_length >= buffer_size_) {
+    // Records that don't fit in the buffer go straight to the file.
+    int size = static_cast<int>(record_length);
+    if (file_.WriteAtCurrentPos(reinterpret_cast<const char*>(data), size) !=
+        size) {
+      LOG(ERROR) << "Failed to write to spool file \"" << path_.value()
+                 << "\".";
+      return false;
+    }
+  } else {
+    buffer_.insert(buffer_.end(), data, data + record_length);
+  }
+
+  length_ += record_length;
+  record_->Reset();
+  return true;
+}
+
+scoped_refptr<PdbStream> SpooledPdbStreamWriter::Finish() {
+  DCHECK(file_.IsValid());
+  DCHECK_EQ(0u, record_->length());
+
+  if (!Flush())
+    return NULL;
+  file_.Close();
+
+  // Empty files can't be mapped.
+  if (length_ == 0)
+    return new PdbByteStream();
+
+  scoped_refptr<msf::RefCountedMappedFile> mapped_file(
+      new msf::RefCountedMappedFile());
+  if (!mapped_file->Initialize(path_)) {
+    LOG(ERROR) << "Failed to map spool file \"" << path_.value() << "\".";
+    return NULL;
+  }
+  DCHECK_EQ(length_, mapped_file->length());
+
+  // The whole stream is a single page of the spool file.
+  const uint32_t kPages[] = { 0 };
+  return new PdbMappedStream(mapped_file.get(), length_, kPages, length_);
+}
+
+bool SpooledPdbStreamWriter::Flush() {
+  if (buffer_.empty())
+    return true;
+
+  int size = static_cast<int>(buffer_.size());
+  if (file_.WriteAtCurrentPos(reinterpret_cast<const char*>(buffer_.data()),
+                              size) != size) {
+    LOG(ERROR) << "Failed to write to spool file \"" << path_.value() << "\".";
+    return false;
+  }
+
+  buffer_.clear();
+  return true;
+}
+
+}  // namespace pdb
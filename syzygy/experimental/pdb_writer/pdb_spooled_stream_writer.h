@@ -0,0 +1,107 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a writer that builds a PDB stream record by record in a spool
+// file, so that the memory used to build a large stream is bounded by the
+// size of its buffer rather than by the size of the stream. The finished
+// stream is read back from a mapping of the spool file.
+
+#ifndef SYZYGY_EXPERIMENTAL_PDB_WRITER_PDB_SPOOLED_STREAM_WRITER_H_
+#define SYZYGY_EXPERIMENTAL_PDB_WRITER_PDB_SPOOLED_STREAM_WRITER_H_
+
+#include <vector>
+
+#include "base/macros.h"
+#include "base/files/file.h"
+#include "base/files/file_path.h"
+#include "base/memory/ref_counted.h"
+#include "syzygy/pdb/pdb_decl.h"
+#include "syzygy/pdb/pdb_stream.h"
+
+namespace pdb {
+
+// Builds a PDB stream in a spool file. Each record is written in a scratch
+// stream, which may seek back in the record to patch it, and is then
+// committed to the buffer of the spooler. The buffer is appended to the
+// spool file whenever it is full.
+//
+// Usage:
+//   SpooledPdbStreamWriter writer(SpooledPdbStreamWriter::kDefaultBufferSize);
+//   if (!writer.Init(spool_path)) ...
+//   for (...) {
+//     size_t offset = writer.pos();
+//     WriteMyRecord(writer.record());
+//     if (!writer.CommitRecord()) ...
+//   }
+//   scoped_refptr<PdbStream> stream = writer.Finish();
+class SpooledPdbStreamWriter {
+ public:
+  // The default size of the buffer, in bytes.
+  static const size_t kDefaultBufferSize = 1 << 20;
+
+  // Constructor.
+  // @param buffer_size the number of bytes that are accumulated before being
+  //     written to the spool file.
+  explicit SpooledPdbStreamWriter(size_t buffer_size);
+  ~SpooledPdbStreamWriter();
+
+  // Creates the spool file, overwriting it if it exists. The file must remain
+  // as long as the stream returned by Finish is used.
+  // @param path the path of the spool file.
+  // @returns true on success, false otherwise.
+  bool Init(const base::FilePath& path);
+
+  // @returns the stream in which to write the current record. It is empty at
+  //     the start of each record.
+  WritablePdbStream* record() { return record_.get(); }
+
+  // Appends the current record to the stream and starts a new one.
+  // @returns true on success, false otherwise.
+  bool CommitRecord();
+
+  // @returns the offset in the stream at which the current record will be
+  //     committed.
+  size_t pos() const { return length_; }
+
+  // Writes what remains in the buffer to the spool file, closes it and maps
+  // it. The writer can't be used afterwards.
+  // @returns the stream that has been written, or NULL on failure.
+  scoped_refptr<PdbStream> Finish();
+
+ private:
+  class RecordWriter;
+
+  // Writes the buffer to the spool file.
+  // @returns true on success, false otherwise.
+  bool Flush();
+
+  base::FilePath path_;
+  base::File file_;
+
+  // The committed records that haven't been written to the file yet.
+  std::vector<uint8_t> buffer_;
+  size_t buffer_size_;
+
+  // The length of the stream, including the buffered records.
+  size_t length_;
+
+  // The scratch stream of the current record.
+  scoped_refptr<RecordWriter> record_;
+
+  DISALLOW_COPY_AND_ASSIGN(SpooledPdbStreamWriter);
+};
+
+}  // namespace pdb
+
+#endif  // SYZYGY_EXPERIMENTAL_PDB_WRITER_PDB_SPOOLED_STREAM_WRITER_H_
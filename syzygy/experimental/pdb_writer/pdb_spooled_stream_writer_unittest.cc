@@ -0,0 +1,116 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Unit tests for the SpooledPdbStreamWriter class.
+
+#include "syzygy/experimental/pdb_writer/pdb_spooled_stream_writer.h"
+
+#include "base/files/scoped_temp_dir.h"
+#include "gtest/gtest.h"
+#include "syzygy/experimental/pdb_writer/pdb_symbol_record_writer.h"
+#include "syzygy/experimental/pdb_writer/symbols/image_symbol.h"
+#include "syzygy/pdb/pdb_byte_stream.h"
+
+namespace pdb {
+
+namespace {
+
+class SpooledPdbStreamWriterTest : public ::testing::Test {
+ public:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    spool_path_ = temp_dir_.path().Append(L"stream.spool");
+  }
+
+ protected:
+  base::ScopedTempDir temp_dir_;
+  base::FilePath spool_path_;
+};
+
+}  // namespace
+
+TEST_F(SpooledPdbStreamWriterTest, WriteRecords) {
+  // A small buffer, so that the records are flushed several times and some
+  // of them are larger than the buffer.
+  SpooledPdbStreamWriter writer(8);
+  ASSERT_TRUE(writer.Init(spool_path_));
+
+  std::vector<uint8_t> expected;
+  for (uint32_t i = 0; i < 10; ++i) {
+    EXPECT_EQ(expected.size(), writer.pos());
+
+    // Write a placeholder that is patched once the record is written.
+    WritablePdbStream* record = writer.record();
+    EXPECT_EQ(0u, record->length());
+    ASSERT_TRUE(record->Write(static_cast<uint32_t>(0)));
+    for (uint32_t j = 0; j < i; ++j)
+      ASSERT_TRUE(record->Write(static_cast<uint8_t>(j)));
+    record->set_pos(0);
+    ASSERT_TRUE(record->Write(i));
+    ASSERT_TRUE(writer.CommitRecord());
+
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&i);
+    expected.insert(expected.end(), bytes, bytes + sizeof(i));
+    for (uint32_t j = 0; j < i; ++j)
+      expected.push_back(static_cast<uint8_t>(j));
+  }
+
+  scoped_refptr<PdbStream> stream = writer.Finish();
+  ASSERT_TRUE(stream.get() != NULL);
+  ASSERT_EQ(expected.size(), stream->length());
+
+  std::vector<uint8_t> actual(stream->length());
+  ASSERT_TRUE(stream->ReadBytesAt(0, actual.size(), actual.data()));
+  EXPECT_EQ(expected, actual);
+}
+
+TEST_F(SpooledPdbStreamWriterTest, WriteNoRecord) {
+  SpooledPdbStreamWriter writer(SpooledPdbStreamWriter::kDefaultBufferSize);
+  ASSERT_TRUE(writer.Init(spool_path_));
+
+  scoped_refptr<PdbStream> stream = writer.Finish();
+  ASSERT_TRUE(stream.get() != NULL);
+  EXPECT_EQ(0u, stream->length());
+}
+
+TEST_F(SpooledPdbStreamWriterTest, WriteSymbolRecords) {
+  SymbolVector symbols;
+  symbols.push_back(std::unique_ptr<Symbol>(new symbols::ImageSymbol(
+      Microsoft_Cci_Pdb::S_PUB32, core::SectionOffsetAddress(5, 184),
+      Microsoft_Cci_Pdb::T_SEGMENT, "__imp____crtTerminateProcess")));
+  symbols.push_back(std::unique_ptr<Symbol>(new symbols::ImageSymbol(
+      Microsoft_Cci_Pdb::S_LDATA32, core::SectionOffsetAddress(5, 320),
+      Microsoft_Cci_Pdb::T_SEGMENT, "__imp___NotPublic")));
+
+  scoped_refptr<PdbByteStream> expected(new PdbByteStream());
+  SymbolOffsets expected_offsets;
+  ASSERT_TRUE(WriteSymbolRecords(symbols, &expected_offsets,
+                                 expected->GetWritableStream().get()));
+
+  // Spooling the records writes the same stream.
+  SpooledPdbStreamWriter writer(16);
+  ASSERT_TRUE(writer.Init(spool_path_));
+  SymbolOffsets offsets;
+  ASSERT_TRUE(WriteSymbolRecords(symbols, &offsets, &writer));
+  scoped_refptr<PdbStream> stream = writer.Finish();
+  ASSERT_TRUE(stream.get() != NULL);
+
+  EXPECT_EQ(expected_offsets, offsets);
+  ASSERT_EQ(expected->length(), stream->length());
+  std::vector<uint8_t> actual(stream->length());
+  ASSERT_TRUE(stream->ReadBytesAt(0, actual.size(), actual.data()));
+  EXPECT_EQ(0, ::memcmp(expected->data(), actual.data(), actual.size()));
+}
+
+}  // namespace pdb
@@ -15,6 +15,7 @@
 #include "syzygy/experimental/pdb_writer/pdb_symbol_record_writer.h"
 
 #include "base/logging.h"
+#include "syzygy/experimental/pdb_writer/pdb_spooled_stream_writer.h"
 #include "syzygy/pdb/pdb_stream.h"
 
 namespace pdb {
@@ -37,4 +38,23 @@ bool WriteSymbolRecords(const SymbolVector& symbols,
   return true;
 }
 
+bool WriteSymbolRecords(const SymbolVector& symbols,
+                        SymbolOffsets* symbol_offsets,
+                        SpooledPdbStreamWriter* writer) {
+  DCHECK_NE(static_cast<SymbolOffsets*>(NULL), symbol_offsets);
+  DCHECK(symbol_offsets->empty());
+  DCHECK_NE(static_cast<SpooledPdbStreamWriter*>(NULL), writer);
+
+  symbol_offsets->reserve(symbols.size());
+  for (SymbolVector::const_iterator it = symbols.begin();
+       it != symbols.end();
+       ++it) {
+    symbol_offsets->push_back(writer->pos());
+    if (!(*it)->Write(writer->record()) || !writer->CommitRecord())
+      return false;
+  }
+
+  return true;
+}
+
 }  // namespace pdb
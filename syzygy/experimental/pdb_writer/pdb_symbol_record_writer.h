@@ -24,6 +24,8 @@
 
 namespace pdb {
 
+class SpooledPdbStreamWriter;
+
 typedef std::vector<uint32_t> SymbolOffsets;
 
 // Writes a PDB symbol record stream.
@@ -36,6 +38,17 @@ bool WriteSymbolRecords(const SymbolVector& symbols,
                         SymbolOffsets* symbol_offsets,
                         WritablePdbStream* stream);
 
+// Writes a PDB symbol record stream one record at a time through a spooled
+// writer, so that the records don't all have to be held in memory.
+// @param symbols the symbols to write.
+// @param symbol_offsets the offsets at which the symbols have been written
+//     in the stream.
+// @param writer the spooled writer of the stream.
+// @returns true in case of success, false otherwise.
+bool WriteSymbolRecords(const SymbolVector& symbols,
+                        SymbolOffsets* symbol_offsets,
+                        SpooledPdbStreamWriter* writer);
+
 }  // namespace pdb
 
 #endif  // SYZYGY_EXPERIMENTAL_PDB_WRITER_PDB_SYMBOL_RECORD_WRITER_H_
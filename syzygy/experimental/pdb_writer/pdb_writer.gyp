@@ -29,6 +29,8 @@
         'pdb_public_stream_writer.h',
         'pdb_section_header_stream_writer.cc',
         'pdb_section_header_stream_writer.h',
+        'pdb_spooled_stream_writer.cc',
+        'pdb_spooled_stream_writer.h',
         'pdb_string_table_writer.cc',
         'pdb_string_table_writer.h',
         'pdb_symbol_record_writer.cc',
@@ -44,7 +46,9 @@
       ],
       'dependencies': [
         '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/application/application.gyp:application_lib',
         '<(src)/syzygy/common/common.gyp:common_lib',
+        '<(src)/syzygy/msf/msf.gyp:msf_lib',
         '<(src)/syzygy/pdb/pdb.gyp:pdb_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
       ],
@@ -54,6 +58,7 @@
       'type': 'executable',
       'sources': [
         'pdb_public_stream_writer_unittest.cc',
+        'pdb_spooled_stream_writer_unittest.cc',
         'pdb_string_table_writer_unittest.cc',
         '<(src)/syzygy/testing/run_all_unittests.cc',
       ],
@@ -19,6 +19,7 @@
 #include "syzygy/experimental/pdb_writer/pdb_header_stream_writer.h"
 #include "syzygy/experimental/pdb_writer/pdb_public_stream_writer.h"
 #include "syzygy/experimental/pdb_writer/pdb_section_header_stream_writer.h"
+#include "syzygy/experimental/pdb_writer/pdb_spooled_stream_writer.h"
 #include "syzygy/experimental/pdb_writer/pdb_string_table_writer.h"
 #include "syzygy/experimental/pdb_writer/pdb_symbol_record_writer.h"
 #include "syzygy/experimental/pdb_writer/pdb_type_info_stream_writer.h"
@@ -41,11 +42,14 @@ const size_t kSectionHeaderStreamIndex = kNamesStreamIndex + 1;
 const size_t kSymbolRecordStreamIndex = kSectionHeaderStreamIndex + 1;
 const size_t kPublicStreamIndex = kSymbolRecordStreamIndex + 1;
 
-}  // namespace
-
-bool BuildSimplePdb(const pe::PEFile& pe_file,
-                    const SymbolVector& symbols,
-                    PdbFile* pdb_file) {
+// Builds a PDB file from a list of symbols. The symbol record stream is
+// spooled to |spool_path| unless it is empty.
+bool BuildSimplePdbImpl(const pe::PEFile& pe_file,
+                        const SymbolVector& symbols,
+                        const base::FilePath& spool_path,
+                        size_t thread_count,
+                        PdbFile* pdb_file) {
+  DCHECK_LT(0u, thread_count);
   DCHECK_NE(static_cast<PdbFile*>(NULL), pdb_file);
 
   // Build the old directory stream.
@@ -93,17 +97,30 @@ bool BuildSimplePdb(const pe::PEFile& pe_file,
   pdb_file->SetStream(kSectionHeaderStreamIndex, section_header_stream.get());
 
   // Build the Symbol Record stream.
-  scoped_refptr<PdbStream> symbol_record_stream(new PdbByteStream);
+  scoped_refptr<PdbStream> symbol_record_stream;
   SymbolOffsets symbol_offsets;
-  if (!WriteSymbolRecords(symbols, &symbol_offsets,
-                          symbol_record_stream->GetWritableStream().get())) {
-    return false;
+  if (spool_path.empty()) {
+    symbol_record_stream = new PdbByteStream;
+    if (!WriteSymbolRecords(symbols, &symbol_offsets,
+                            symbol_record_stream->GetWritableStream().get())) {
+      return false;
+    }
+  } else {
+    SpooledPdbStreamWriter spooled_writer(
+        SpooledPdbStreamWriter::kDefaultBufferSize);
+    if (!spooled_writer.Init(spool_path) ||
+        !WriteSymbolRecords(symbols, &symbol_offsets, &spooled_writer)) {
+      return false;
+    }
+    symbol_record_stream = spooled_writer.Finish();
+    if (symbol_record_stream.get() == NULL)
+      return false;
   }
   pdb_file->SetStream(kSymbolRecordStreamIndex, symbol_record_stream.get());
 
   // Build the Public stream.
   scoped_refptr<PdbStream> public_stream(new PdbByteStream);
-  if (!WritePublicStream(symbols, symbol_offsets,
+  if (!WritePublicStream(symbols, symbol_offsets, thread_count,
                          public_stream->GetWritableStream().get())) {
     return false;
   }
@@ -112,4 +129,22 @@ bool BuildSimplePdb(const pe::PEFile& pe_file,
   return true;
 }
 
+}  // namespace
+
+bool BuildSimplePdb(const pe::PEFile& pe_file,
+                    const SymbolVector& symbols,
+                    PdbFile* pdb_file) {
+  return BuildSimplePdbImpl(pe_file, symbols, base::FilePath(), 1, pdb_file);
+}
+
+bool BuildSimplePdb(const pe::PEFile& pe_file,
+                    const SymbolVector& symbols,
+                    const base::FilePath& spool_path,
+                    size_t thread_count,
+                    PdbFile* pdb_file) {
+  DCHECK(!spool_path.empty());
+  return BuildSimplePdbImpl(pe_file, symbols, spool_path, thread_count,
+                            pdb_file);
+}
+
 }  // namespace pdb
@@ -17,6 +17,7 @@
 #ifndef SYZYGY_EXPERIMENTAL_PDB_WRITER_SIMPLE_PDB_BUILDER_H_
 #define SYZYGY_EXPERIMENTAL_PDB_WRITER_SIMPLE_PDB_BUILDER_H_
 
+#include "base/files/file_path.h"
 #include "syzygy/experimental/pdb_writer/symbol.h"
 #include "syzygy/pdb/pdb_decl.h"
 #include "syzygy/pe/pe_file.h"
@@ -32,6 +33,24 @@ bool BuildSimplePdb(const pe::PEFile& pe_file,
                     const SymbolVector& symbols,
                     PdbFile* pdb_file);
 
+// Builds a PDB file from a list of symbols, bounding the memory used to write
+// the symbol record stream by spooling it to a file, and hashing the public
+// symbols with several threads. This builds the same PDB as the above
+// function.
+// @param pe_path the PE file for which a PDB is being generated.
+// @param symbols the symbols to include in the PDB.
+// @param spool_path the file in which the symbol record stream is spooled.
+//     It must remain as long as the generated PDB is used.
+// @param thread_count the number of threads used to build the public stream.
+//     Must be at least 1.
+// @param pdb_file the generated PDB.
+// @returns true in case of success, false otherwise.
+bool BuildSimplePdb(const pe::PEFile& pe_file,
+                    const SymbolVector& symbols,
+                    const base::FilePath& spool_path,
+                    size_t thread_count,
+                    PdbFile* pdb_file);
+
 }  // namespace pdb
 
 #endif  // SYZYGY_EXPERIMENTAL_PDB_WRITER_SIMPLE_PDB_BUILDER_H_
@@ -16,13 +16,17 @@
 
 #include <stdio.h>
 
+#include <algorithm>
+
 #include "base/bind.h"
+#include "base/sys_info.h"
 #include "base/files/file_util.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 #include "base/win/scoped_bstr.h"
 #include "base/win/scoped_com_initializer.h"
+#include "syzygy/application/work_pool.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/pe/dia_util.h"
 #include "syzygy/pe/find.h"
@@ -72,6 +76,68 @@ void TrimComment(std::string* s) {
 
 }  // namespace
 
+// Matches symbols against rules on several threads. The symbols are handed
+// out to the threads in chunks, and the matches of each chunk are kept apart
+// so that they can be recorded on the calling thread. The rules' regexes are
+// only read while matching, which lets the threads share them.
+class FilterCompiler::RuleMatcher {
+ public:
+  // A match of the symbol at a given index by the rule at a given index.
+  typedef std::pair<size_t, size_t> Match;
+  typedef std::vector<Match> Matches;
+
+  // The number of consecutive symbols handed out to a thread at a time.
+  static const size_t kSymbolsPerChunk = 1024;
+
+  // @param rules the rules to match.
+  // @param symbols the symbols to match against @p rules.
+  RuleMatcher(const RulePointers* rules, const Symbols* symbols)
+      : rules_(rules), symbols_(symbols) {
+    DCHECK(rules != NULL);
+    DCHECK(symbols != NULL);
+    chunk_matches_.resize(
+        (symbols->size() + kSymbolsPerChunk - 1) / kSymbolsPerChunk);
+  }
+
+  // Matches the rules against a chunk of symbols. Distinct chunks may be
+  // matched concurrently.
+  // @param chunk the index of the chunk of symbols to match.
+  // @returns true.
+  bool MatchChunk(size_t chunk) {
+    DCHECK_LT(chunk, chunk_matches_.size());
+    size_t begin = chunk * kSymbolsPerChunk;
+    size_t end = std::min(begin + kSymbolsPerChunk, symbols_->size());
+    Matches* matches = &chunk_matches_[chunk];
+    for (size_t i = begin; i < end; ++i) {
+      const std::string& name = (*symbols_)[i].name;
+      for (size_t j = 0; j < rules_->size(); ++j) {
+        if ((*rules_)[j]->regex.FullMatch(name))
+          matches->push_back(std::make_pair(j, i));
+      }
+    }
+    return true;
+  }
+
+  // @returns the number of chunks the symbols are split into.
+  size_t chunk_count() const { return chunk_matches_.size(); }
+
+  // @returns the matches, per chunk of symbols.
+  const std::vector<Matches>& chunk_matches() const { return chunk_matches_; }
+
+ private:
+  const RulePointers* rules_;
+  const Symbols* symbols_;
+  std::vector<Matches> chunk_matches_;
+
+  DISALLOW_COPY_AND_ASSIGN(RuleMatcher);
+};
+
+FilterCompiler::FilterCompiler()
+    : thread_count_(base::SysInfo::NumberOfProcessors()) {
+  for (size_t i = 0; i < kRuleTypeCount; ++i)
+    symbols_crawled_[i] = false;
+}
+
 bool FilterCompiler::Init(const base::FilePath& image_path) {
   return Init(image_path, base::FilePath());
 }
@@ -81,6 +147,12 @@ bool FilterCompiler::Init(const base::FilePath& image_path,
   image_path_ = image_path;
   pdb_path_ = pdb_path;
 
+  // Symbols read from another image can't be reused.
+  for (size_t i = 0; i < kRuleTypeCount; ++i) {
+    symbols_by_type_[i].clear();
+    symbols_crawled_[i] = false;
+  }
+
   // Get the PDB path if none was provided.
   if (pdb_path_.empty()) {
     // This logs verbosely for us on failure.
@@ -102,6 +174,7 @@ bool FilterCompiler::Init(const base::FilePath& image_path,
 
   // Get the module signature.
   pe::PEFile pe_file;
+  pe_file.set_use_file_mapping(true);
   if (!pe_file.Init(image_path)) {
     LOG(ERROR) << "Unable to read module: " << image_path_.value();
     return false;
@@ -211,6 +284,8 @@ bool FilterCompiler::Compile(ImageFilter* filter) {
   if (!CrawlSymbols())
     return false;
 
+  MatchSymbols();
+
   if (!FillFilter(filter))
     return false;
 
@@ -247,7 +322,11 @@ bool FilterCompiler::AddRule(ModificationType modification_type,
 
 bool FilterCompiler::CrawlSymbols() {
   // We can bail early if there's no work to do.
-  if (rule_map_.empty())
+  bool need_functions = !rules_by_type_[kFunctionRule].empty() &&
+      !symbols_crawled_[kFunctionRule];
+  bool need_public_symbols = !rules_by_type_[kPublicSymbolRule].empty() &&
+      !symbols_crawled_[kPublicSymbolRule];
+  if (!need_functions && !need_public_symbols)
     return true;
 
   base::win::ScopedComPtr<IDiaDataSource> data_source;
@@ -259,17 +338,18 @@ bool FilterCompiler::CrawlSymbols() {
     return false;
 
   // Visit all compilands looking for symbols if we need to.
-  if (!rules_by_type_[kFunctionRule].empty()) {
+  if (need_functions) {
     pe::CompilandVisitor compiland_visitor(session.get());
     if (!compiland_visitor.VisitAllCompilands(
             base::Bind(&FilterCompiler::OnCompiland,
                        base::Unretained(this)))) {
       return false;
     }
+    symbols_crawled_[kFunctionRule] = true;
   }
 
   // Visit public symbols if necessary.
-  if (!rules_by_type_[kPublicSymbolRule].empty()) {
+  if (need_public_symbols) {
     // Grab the global scope
     base::win::ScopedComPtr<IDiaSymbol> global;
     HRESULT hr = session->get_globalScope(global.Receive());
@@ -285,11 +365,40 @@ bool FilterCompiler::CrawlSymbols() {
                        base::Unretained(this)))) {
       return false;
     }
+    symbols_crawled_[kPublicSymbolRule] = true;
   }
 
   return true;
 }
 
+void FilterCompiler::MatchSymbols() {
+  for (size_t type = 0; type < kRuleTypeCount; ++type) {
+    const RulePointers& rules = rules_by_type_[type];
+    if (rules.empty())
+      continue;
+
+    // Start from empty ranges, so that compiling again after adding rules
+    // matches every rule against the symbols exactly once.
+    for (size_t i = 0; i < rules.size(); ++i)
+      rules[i]->ranges.Clear();
+
+    const Symbols& symbols = symbols_by_type_[type];
+    RuleMatcher matcher(&rules, &symbols);
+    application::WorkPool pool(thread_count_);
+    pool.Run(matcher.chunk_count(),
+             base::Bind(&RuleMatcher::MatchChunk, base::Unretained(&matcher)));
+
+    // Update the image ranges of the matching rules.
+    for (size_t i = 0; i < matcher.chunk_matches().size(); ++i) {
+      const RuleMatcher::Matches& matches = matcher.chunk_matches()[i];
+      for (size_t j = 0; j < matches.size(); ++j) {
+        rules[matches[j].first]->ranges.Mark(
+            symbols[matches[j].second].range);
+      }
+    }
+  }
+}
+
 bool FilterCompiler::FillFilter(ImageFilter* filter) {
   DCHECK(filter != NULL);
 
@@ -335,21 +444,21 @@ bool FilterCompiler::OnCompiland(IDiaSymbol* compiland) {
 
 bool FilterCompiler::OnFunction(IDiaSymbol* function) {
   DCHECK(function != NULL);
-  if (!MatchRulesBySymbolName(rules_by_type_[kFunctionRule], function))
+  if (!AddSymbol(function, &symbols_by_type_[kFunctionRule]))
     return false;
   return true;
 }
 
 bool FilterCompiler::OnPublicSymbol(IDiaSymbol* public_symbol) {
   DCHECK(public_symbol != NULL);
-  if (!MatchRulesBySymbolName(rules_by_type_[kPublicSymbolRule], public_symbol))
+  if (!AddSymbol(public_symbol, &symbols_by_type_[kPublicSymbolRule]))
     return false;
   return true;
 }
 
-bool FilterCompiler::MatchRulesBySymbolName(const RulePointers& rules,
-                                            IDiaSymbol* symbol) {
+bool FilterCompiler::AddSymbol(IDiaSymbol* symbol, Symbols* symbols) {
   DCHECK(symbol != NULL);
+  DCHECK(symbols != NULL);
 
   // Get the symbol properties.
   base::win::ScopedBstr name_bstr;
@@ -365,20 +474,15 @@ bool FilterCompiler::MatchRulesBySymbolName(const RulePointers& rules,
   }
 
   // Convert the name to ASCII.
-  std::string name;
-  if (!base::WideToUTF8(name_bstr, name_bstr.Length(), &name)) {
+  symbols->push_back(Symbol());
+  Symbol& new_symbol = symbols->back();
+  if (!base::WideToUTF8(name_bstr, name_bstr.Length(), &new_symbol.name)) {
     LOG(ERROR) << "Failed to convert symbol name to UTF8: "
                << common::ToString(name_bstr);
+    symbols->pop_back();
     return false;
   }
-
-  // Look for any matching rules and update the associated image ranges.
-  RulePointers::const_iterator it = rules.begin();
-  for (; it != rules.end(); ++it) {
-    Rule* rule = *it;
-    if (rule->regex.FullMatch(name))
-      rule->ranges.Mark(Range(RelativeAddress(rva), length));
-  }
+  new_symbol.range = Range(RelativeAddress(rva), length);
 
   return true;
 }
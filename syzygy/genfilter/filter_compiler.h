@@ -40,6 +40,8 @@
 
 #include <dia2.h>
 #include <map>
+#include <string>
+#include <vector>
 
 #include "pcrecpp.h"  // NOLINT
 #include "syzygy/pe/image_filter.h"
@@ -71,14 +73,23 @@ class FilterCompiler {
   };
 
   // Constructor.
-  FilterCompiler() { }
+  FilterCompiler();
 
   // @name Accessors.
   // @{
   const base::FilePath& image_path() const { return image_path_; }
   const base::FilePath& pdb_path() const { return pdb_path_; }
+  size_t thread_count() const { return thread_count_; }
   // @}
 
+  // Sets the number of threads used to match the symbols against the rules.
+  // This defaults to the number of processors.
+  // @param thread_count the number of threads, which must be at least 1.
+  void set_thread_count(size_t thread_count) {
+    DCHECK_LT(0u, thread_count);
+    thread_count_ = thread_count;
+  }
+
   // Initializes this filter generator. Logs verbosely on failure.
   // @param image_path The path to the image for which a filter is being
   //     generated.
@@ -107,18 +118,28 @@ class FilterCompiler {
   bool ParseFilterDescriptionFile(const base::FilePath& path);
 
   // Compiles a filter using the current rules. This logs a warning for any
-  // filter rules that were not successfully matched.
+  // filter rules that were not successfully matched. The symbols of the
+  // image are read from its PDB the first time they're needed, and are
+  // reused by later compilations.
   // @param filter The filter to be populated.
   // @returns true on success, false otherwise.
   bool Compile(ImageFilter* filter);
 
  protected:
-  // Forward declaration.
+  // Forward declarations.
   struct Rule;
+  class RuleMatcher;
+
+  // A symbol read from the PDB, which the rules are matched against.
+  struct Symbol {
+    std::string name;
+    Range range;
+  };
 
   typedef pcrecpp::RE RE;
   typedef std::map<size_t, Rule> RuleMap;
   typedef std::vector<Rule*> RulePointers;
+  typedef std::vector<Symbol> Symbols;
 
   // Adds a rule with explicit source information to this filter compiler.
   // @param modification_type The way the filter is modified upon successful
@@ -134,11 +155,15 @@ class FilterCompiler {
                const base::StringPiece& description,
                const base::StringPiece& source_info);
 
-  // Crawls the symbols matching rules. Delegates to the various symbol
-  // visitors.
+  // Reads the symbols of the types that have rules, unless they were read
+  // already. Delegates to the various symbol visitors.
   // @returns true on success, false otherwise.
   bool CrawlSymbols();
 
+  // Matches the symbols against the rules of their type, on several threads,
+  // and records the ranges of the matching symbols in the rules.
+  void MatchSymbols();
+
   // Fills in the filter using cached symbol match data in the rules.
   // @param filter The filter to be filled in.
   bool FillFilter(ImageFilter* filter);
@@ -150,11 +175,13 @@ class FilterCompiler {
   bool OnPublicSymbol(IDiaSymbol* public_symbol);
   // @}
 
-  // Matches a symbol by name against rules in the given vector. Called by
-  // OnPublicSymbol and OnFunction.
-  // @param rules The vector of rules to be inspected for a symbol match.
-  // @param symbol The symbol to inspect.
-  bool MatchRulesBySymbolName(const RulePointers& rules, IDiaSymbol* symbol);
+  // Adds a symbol to the given vector. Called by OnPublicSymbol and
+  // OnFunction.
+  // @param symbol The symbol to add.
+  // @param symbols The vector of symbols to be matched against the rules of
+  //     the type of @p symbol.
+  // @returns true on success, false otherwise.
+  bool AddSymbol(IDiaSymbol* symbol, Symbols* symbols);
 
   base::FilePath image_path_;
   base::FilePath pdb_path_;
@@ -164,10 +191,18 @@ class FilterCompiler {
   // that pointers are stable.
   RuleMap rule_map_;
 
-  // Rule pointers stored by type. This allows efficient access while crawling
+  // Rule pointers stored by type. This allows efficient access while matching
   // symbols
   RulePointers rules_by_type_[kRuleTypeCount];
 
+  // The symbols of the image, by the type of the rule they're matched
+  // against, and whether they have been read from the PDB yet.
+  Symbols symbols_by_type_[kRuleTypeCount];
+  bool symbols_crawled_[kRuleTypeCount];
+
+  // The number of threads used to match the symbols.
+  size_t thread_count_;
+
   DISALLOW_COPY_AND_ASSIGN(FilterCompiler);
 };
 
@@ -32,6 +32,7 @@ class TestFilterCompiler : public FilterCompiler {
 
   using FilterCompiler::rule_map_;
   using FilterCompiler::rules_by_type_;
+  using FilterCompiler::symbols_by_type_;
 
   TestFilterCompiler() { }
 
@@ -252,4 +253,56 @@ TEST_F(FilterCompilerTest, Compile) {
   EXPECT_LT(0u, filter.filter.size());
 }
 
+TEST_F(FilterCompilerTest, CompileDoesNotDependOnThreadCount) {
+  ASSERT_NO_FATAL_FAILURE(CreateFilterDescriptionFile());
+
+  TestFilterCompiler fc1;
+  fc1.set_thread_count(1);
+  ASSERT_TRUE(fc1.Init(test_dll_, test_dll_pdb_));
+  ASSERT_TRUE(fc1.ParseFilterDescriptionFile(filter_txt_));
+  ASSERT_TRUE(fc1.AddRule(FilterCompiler::kAddToFilter,
+                          FilterCompiler::kFunctionRule, ".*"));
+  pe::ImageFilter filter1;
+  ASSERT_TRUE(fc1.Compile(&filter1));
+
+  TestFilterCompiler fc4;
+  fc4.set_thread_count(4);
+  EXPECT_EQ(4u, fc4.thread_count());
+  ASSERT_TRUE(fc4.Init(test_dll_, test_dll_pdb_));
+  ASSERT_TRUE(fc4.ParseFilterDescriptionFile(filter_txt_));
+  ASSERT_TRUE(fc4.AddRule(FilterCompiler::kAddToFilter,
+                          FilterCompiler::kFunctionRule, ".*"));
+  pe::ImageFilter filter4;
+  ASSERT_TRUE(fc4.Compile(&filter4));
+
+  EXPECT_LT(0u, fc4.symbols_by_type_[FilterCompiler::kFunctionRule].size());
+  for (size_t i = 0; i < fc1.rule_map_.size(); ++i)
+    EXPECT_EQ(fc1.rule(i).ranges, fc4.rule(i).ranges);
+  EXPECT_EQ(filter1.filter, filter4.filter);
+}
+
+TEST_F(FilterCompilerTest, CompileReusesSymbols) {
+  TestFilterCompiler fc;
+  ASSERT_TRUE(fc.Init(test_dll_, test_dll_pdb_));
+  ASSERT_TRUE(fc.AddRule(FilterCompiler::kAddToFilter,
+                         FilterCompiler::kFunctionRule, "DllMain"));
+  pe::ImageFilter filter;
+  ASSERT_TRUE(fc.Compile(&filter));
+  EXPECT_EQ(1u, fc.rule(0).ranges.size());
+  size_t symbol_count =
+      fc.symbols_by_type_[FilterCompiler::kFunctionRule].size();
+  EXPECT_LT(0u, symbol_count);
+
+  // Compiling again matches the rules against the symbols that were read
+  // already.
+  ASSERT_TRUE(fc.AddRule(FilterCompiler::kSubtractFromFilter,
+                         FilterCompiler::kFunctionRule, "DllMain"));
+  ASSERT_TRUE(fc.Compile(&filter));
+  EXPECT_EQ(symbol_count,
+            fc.symbols_by_type_[FilterCompiler::kFunctionRule].size());
+  EXPECT_EQ(1u, fc.rule(0).ranges.size());
+  EXPECT_EQ(1u, fc.rule(1).ranges.size());
+  EXPECT_TRUE(filter.filter.empty());
+}
+
 }  // namespace genfilter
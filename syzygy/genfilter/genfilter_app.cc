@@ -230,6 +230,7 @@ void GenFilterApp::PrintUsage(const base::CommandLine* command_line,
 
 bool GenFilterApp::RunCompileAction() {
   FilterCompiler filter_compiler;
+  filter_compiler.set_thread_count(jobs());
 
   if (!filter_compiler.Init(input_image_, input_pdb_))
     return false;
@@ -93,10 +93,10 @@ bool LoadBranchStatisticsFromFile(const base::FilePath& file,
   DCHECK(!file.empty());
   DCHECK_NE(reinterpret_cast<IndexedFrequencyMap*>(NULL), frequencies);
 
-  // Load profile information from JSON file.
+  // Load profile information from a JSON or binary file.
   ModuleIndexedFrequencyMap module_entry_count_map;
   IndexedFrequencyDataSerializer serializer;
-  if (!serializer.LoadFromJson(file, &module_entry_count_map)) {
+  if (!serializer.Load(file, &module_entry_count_map)) {
     LOG(ERROR) << "Failed to load profile information.";
     return false;
   }
@@ -16,9 +16,22 @@
 
 #include "base/files/file_util.h"
 #include "base/strings/string_util.h"
+#include "base/strings/stringprintf.h"
 
 namespace grinder {
 
+std::string CacheGrindNameCompressor::Compress(NameKind kind,
+                                               const std::string& name) {
+  DCHECK_GT(kNameKindMax, kind);
+
+  NameIdMap& ids = ids_[kind];
+  std::pair<NameIdMap::iterator, bool> result =
+      ids.insert(std::make_pair(name, ids.size() + 1));
+  if (!result.second)
+    return base::StringPrintf("(%d)", result.first->second);
+  return base::StringPrintf("(%d) %s", result.first->second, name.c_str());
+}
+
 bool WriteCacheGrindCoverageFile(const CoverageData& coverage,
                                  const base::FilePath& path) {
   base::ScopedFILE file(base::OpenFile(path, "wb"));
@@ -45,6 +58,7 @@ bool WriteCacheGrindCoverageFile(const CoverageData& coverage, FILE* file) {
     return false;
 
   // Iterate over the source files.
+  CacheGrindNameCompressor names;
   CoverageData::SourceFileCoverageDataMap::const_iterator source_it =
       coverage.source_file_coverage_data_map().begin();
   CoverageData::SourceFileCoverageDataMap::const_iterator source_it_end =
@@ -55,12 +69,15 @@ bool WriteCacheGrindCoverageFile(const CoverageData& coverage, FILE* file) {
     std::string path = source_it->first;
     if (!base::ReplaceChars(path, "\\", "/", &path))
       return false;
-    if (::fprintf(file, "fl=%s\n", path.c_str()) < 0)
+    std::string fl = names.Compress(CacheGrindNameCompressor::kFileName, path);
+    if (::fprintf(file, "fl=%s\n", fl.c_str()) < 0)
       return false;
 
     // We need to output a dummy function name for cache-grind aggregation to
     // work appropriately.
-    if (::fprintf(file, "fn=all\n") < 0)
+    std::string fn = names.Compress(CacheGrindNameCompressor::kFunctionName,
+                                    "all");
+    if (::fprintf(file, "fn=%s\n", fn.c_str()) < 0)
       return false;
 
     // Iterate over the instrumented lines. We output deltas to save space so
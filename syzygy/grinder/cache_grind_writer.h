@@ -22,11 +22,45 @@
 #ifndef SYZYGY_GRINDER_CACHE_GRIND_WRITER_H_
 #define SYZYGY_GRINDER_CACHE_GRIND_WRITER_H_
 
+#include <map>
+#include <string>
+
 #include "base/files/file_path.h"
+#include "base/macros.h"
 #include "syzygy/grinder/coverage_data.h"
 
 namespace grinder {
 
+// Compresses the names of the files and functions of a CacheGrind file. The
+// first time a name is output it is given an ID, which is then output in its
+// stead. This keeps the files of large profiles, which repeat the same names
+// for each call, down to size. Files and functions have IDs of their own.
+class CacheGrindNameCompressor {
+ public:
+  // The kinds of names, each of which has its own IDs.
+  enum NameKind {
+    kFileName,      // For fl=, fi=, fe= and cfl=.
+    kFunctionName,  // For fn= and cfn=.
+    kNameKindMax,   // Must be last.
+  };
+
+  CacheGrindNameCompressor() {}
+
+  // Gets the compressed form of a name, to be output after the = of a
+  // specification line.
+  // @param kind The kind of the name.
+  // @param name The name.
+  // @returns "(id) name" the first time @p name is compressed, and "(id)"
+  //     afterwards.
+  std::string Compress(NameKind kind, const std::string& name);
+
+ private:
+  typedef std::map<std::string, size_t> NameIdMap;
+  NameIdMap ids_[kNameKindMax];
+
+  DISALLOW_COPY_AND_ASSIGN(CacheGrindNameCompressor);
+};
+
 // Dumps the provided @p coverage information to an CacheGrind file.
 // @param coverage the summarized coverage info to be written.
 // @param path the path to the file to be created or overwritten.
@@ -55,8 +55,8 @@ TEST(CacheGrindWriterTest, Write) {
   std::string expected_contents =
       "positions: line\n"
       "events: Instrumented Executed\n"
-      "fl=C:/src/foo.cc\n"
-      "fn=all\n"
+      "fl=(1) C:/src/foo.cc\n"
+      "fn=(1) all\n"
       "1 1 1\n"
       "+1 1 1\n"
       "+1 1 0\n";
@@ -64,4 +64,24 @@ TEST(CacheGrindWriterTest, Write) {
   EXPECT_EQ(expected_contents, actual_contents);
 }
 
+TEST(CacheGrindWriterTest, NameCompressor) {
+  CacheGrindNameCompressor names;
+  EXPECT_EQ("(1) foo.cc",
+            names.Compress(CacheGrindNameCompressor::kFileName, "foo.cc"));
+  EXPECT_EQ("(2) bar.cc",
+            names.Compress(CacheGrindNameCompressor::kFileName, "bar.cc"));
+  EXPECT_EQ("(1)",
+            names.Compress(CacheGrindNameCompressor::kFileName, "foo.cc"));
+
+  // Functions have IDs of their own.
+  EXPECT_EQ("(1) foo.cc",
+            names.Compress(CacheGrindNameCompressor::kFunctionName,
+                           "foo.cc"));
+  EXPECT_EQ("(1)",
+            names.Compress(CacheGrindNameCompressor::kFunctionName,
+                           "foo.cc"));
+  EXPECT_EQ("(2)",
+            names.Compress(CacheGrindNameCompressor::kFileName, "bar.cc"));
+}
+
 }  // namespace grinder
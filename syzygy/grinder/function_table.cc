@@ -0,0 +1,226 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/grinder/function_table.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "syzygy/application/work_pool.h"
+#include "syzygy/common/binary_stream.h"
+#include "syzygy/pdb/pdb_byte_stream.h"
+#include "syzygy/pdb/pdb_constants.h"
+#include "syzygy/pdb/pdb_dbi_stream.h"
+#include "syzygy/pdb/pdb_reader.h"
+#include "syzygy/pdb/pdb_symbol_record.h"
+#include "syzygy/pe/cvinfo_ext.h"
+#include "syzygy/pe/find.h"
+#include "syzygy/pe/pe_file.h"
+
+namespace grinder {
+
+namespace {
+
+typedef FunctionTable::Function Function;
+typedef FunctionTable::Functions Functions;
+
+// The number of consecutive addresses handed to a thread of FindAll at a time.
+const size_t kAddressesPerChunk = 1024;
+
+bool FunctionAddressLess(const Function& function,
+                         core::RelativeAddress address) {
+  return function.address < address;
+}
+
+// Collects the function symbols of a module symbol stream. This is invoked
+// concurrently for different modules, each of which has its own vector.
+bool CollectFunctionSymbol(const pe::PEFile* image,
+                           std::vector<Functions>* module_functions,
+                           size_t module_index,
+                           uint16_t symbol_length,
+                           uint16_t symbol_type,
+                           common::BinaryStreamReader* symbol_reader) {
+  DCHECK(image != NULL);
+  DCHECK(module_functions != NULL);
+  DCHECK_LT(module_index, module_functions->size());
+  DCHECK(symbol_reader != NULL);
+
+  if (symbol_type != cci::S_GPROC32 && symbol_type != cci::S_LPROC32)
+    return true;
+
+  // The name is the trailing field of the symbol.
+  common::BinaryStreamParser parser(symbol_reader);
+  cci::ProcSym32 symbol = {};
+  std::string name;
+  if (!parser.ReadBytes(offsetof(cci::ProcSym32, name), &symbol) ||
+      !parser.ReadString(&name)) {
+    LOG(ERROR) << "Unable to read function symbol.";
+    return false;
+  }
+
+  // The PDB numbers sections from 1 to n, while we do 0 to n - 1.
+  const IMAGE_SECTION_HEADER* header = NULL;
+  if (symbol.seg > 0)
+    header = image->section_header(symbol.seg - 1);
+  if (header == NULL) {
+    LOG(ERROR) << "Invalid section for function \"" << name << "\".";
+    return false;
+  }
+
+  (*module_functions)[module_index].push_back(Function(
+      core::RelativeAddress(header->VirtualAddress + symbol.off), symbol.len,
+      name));
+  return true;
+}
+
+// Looks up a chunk of the addresses of FindAll. This is invoked concurrently
+// for different chunks.
+bool FindChunk(const FunctionTable* table,
+               const std::vector<core::RelativeAddress>* addresses,
+               std::vector<const Function*>* functions,
+               size_t chunk) {
+  DCHECK(table != NULL);
+  DCHECK(addresses != NULL);
+  DCHECK(functions != NULL);
+  DCHECK_EQ(addresses->size(), functions->size());
+
+  size_t begin = chunk * kAddressesPerChunk;
+  size_t end = std::min(begin + kAddressesPerChunk, addresses->size());
+  for (size_t i = begin; i < end; ++i)
+    (*functions)[i] = table->Find((*addresses)[i]);
+  return true;
+}
+
+}  // namespace
+
+FunctionTable::FunctionTable() {
+}
+
+bool FunctionTable::Init(const base::FilePath& image_path,
+                         size_t thread_count) {
+  DCHECK_LT(0u, thread_count);
+  DCHECK(functions_.empty());
+
+  pe::PEFile image;
+  if (!image.Init(image_path)) {
+    LOG(ERROR) << "Failed to read image \"" << image_path.value() << "\".";
+    return false;
+  }
+
+  base::FilePath pdb_path;
+  if (!pe::FindPdbForModule(image_path, &pdb_path) || pdb_path.empty()) {
+    LOG(ERROR) << "Unable to find PDB for image \"" << image_path.value()
+               << "\".";
+    return false;
+  }
+
+  pdb::PdbFile pdb_file;
+  pdb::PdbReader pdb_reader;
+  if (!pdb_reader.Read(pdb_path, &pdb_file)) {
+    LOG(ERROR) << "Failed to read PDB \"" << pdb_path.value() << "\".";
+    return false;
+  }
+
+  scoped_refptr<pdb::PdbStream> stream = pdb_file.GetStream(pdb::kDbiStream);
+  scoped_refptr<pdb::PdbByteStream> dbi_byte_stream(new pdb::PdbByteStream());
+  pdb::DbiStream dbi_stream;
+  if (stream.get() == NULL || !dbi_byte_stream->Init(stream.get()) ||
+      !dbi_stream.Read(dbi_byte_stream.get())) {
+    LOG(ERROR) << "Unable to parse the DBI stream of \"" << pdb_path.value()
+               << "\".";
+    return false;
+  }
+
+  // The native symbols are in the address space of the original image, and
+  // would need to be mapped through the OMAP information.
+  const pdb::DbiDbgHeader& dbg_header = dbi_stream.dbg_header();
+  if (dbg_header.omap_from_src >= 0) {
+    scoped_refptr<pdb::PdbStream> omap_from =
+        pdb_file.GetStream(dbg_header.omap_from_src);
+    if (omap_from.get() != NULL && omap_from->length() > 0) {
+      VLOG(1) << "PDB \"" << pdb_path.value() << "\" has OMAP information.";
+      return false;
+    }
+  }
+
+  std::vector<Functions> module_functions(dbi_stream.modules().size());
+  pdb::VisitModuleSymbolsCallback callback = base::Bind(
+      &CollectFunctionSymbol, base::Unretained(&image),
+      base::Unretained(&module_functions));
+  if (!pdb::VisitModuleSymbols(callback, dbi_stream, pdb_file,
+                               thread_count)) {
+    LOG(ERROR) << "Failed to read the module symbols of \""
+               << pdb_path.value() << "\".";
+    return false;
+  }
+
+  size_t function_count = 0;
+  for (const Functions& functions : module_functions)
+    function_count += functions.size();
+  functions_.reserve(function_count);
+  for (Functions& functions : module_functions) {
+    std::move(functions.begin(), functions.end(),
+              std::back_inserter(functions_));
+  }
+
+  std::stable_sort(functions_.begin(), functions_.end(),
+                   [](const Function& f1, const Function& f2) {
+                     return f1.address < f2.address;
+                   });
+
+  // Functions that are folded together by the linker appear once per module
+  // they come from. Only the first of those is kept.
+  functions_.erase(
+      std::unique(functions_.begin(), functions_.end(),
+                  [](const Function& f1, const Function& f2) {
+                    return f1.address == f2.address;
+                  }),
+      functions_.end());
+
+  return true;
+}
+
+const FunctionTable::Function* FunctionTable::Find(
+    core::RelativeAddress address) const {
+  // Find the last function that starts at or before the address.
+  Functions::const_iterator it = std::lower_bound(
+      functions_.begin(), functions_.end(), address + 1, FunctionAddressLess);
+  if (it == functions_.begin())
+    return NULL;
+  --it;
+
+  if (address >= it->address + it->size)
+    return NULL;
+  return &(*it);
+}
+
+void FunctionTable::FindAll(const std::vector<core::RelativeAddress>& addresses,
+                            size_t thread_count,
+                            std::vector<const Function*>* functions) const {
+  DCHECK_LT(0u, thread_count);
+  DCHECK(functions != NULL);
+
+  functions->assign(addresses.size(), NULL);
+
+  // Each thread takes chunks of addresses until there are none left, so that
+  // the threads finish at about the same time.
+  size_t chunk_count =
+      (addresses.size() + kAddressesPerChunk - 1) / kAddressesPerChunk;
+  application::WorkPool pool(thread_count);
+  pool.Run(chunk_count, base::Bind(&FindChunk, this, &addresses, functions));
+}
+
+}  // namespace grinder
@@ -0,0 +1,96 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a table of the functions of an image, read from the native symbol
+// streams of its PDB, for resolving many addresses to functions at once.
+
+#ifndef SYZYGY_GRINDER_FUNCTION_TABLE_H_
+#define SYZYGY_GRINDER_FUNCTION_TABLE_H_
+
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/macros.h"
+#include "syzygy/core/address.h"
+
+namespace grinder {
+
+// Holds the functions of an image, sorted by address. The table is read once
+// from the module symbol streams of the PDB of the image, with several
+// threads, after which it is immutable and can be looked up concurrently.
+//
+// Only the functions that have private symbols are listed. Addresses that
+// aren't in any of them, such as those of the functions of libraries that
+// only come with public symbols, need to be resolved by other means.
+class FunctionTable {
+ public:
+  struct Function;
+  typedef std::vector<Function> Functions;
+
+  FunctionTable();
+
+  // Reads the functions of an image from its PDB.
+  // @param image_path The path to the image.
+  // @param thread_count The number of threads to read the symbol streams of
+  //     the PDB with, which must be at least 1.
+  // @returns true on success, false otherwise. This fails for images whose
+  //     PDB has OMAP information, as the native symbols of those describe the
+  //     original image.
+  bool Init(const base::FilePath& image_path, size_t thread_count);
+
+  // Finds the function containing an address.
+  // @param address The address to look up.
+  // @returns the function, or NULL if no function contains @p address.
+  const Function* Find(core::RelativeAddress address) const;
+
+  // Finds the functions containing each of a set of addresses, with several
+  // threads.
+  // @param addresses The addresses to look up.
+  // @param thread_count The number of threads to use, which must be at least
+  //     1.
+  // @param functions Receives the function containing each address, or NULL
+  //     for those not contained by any function, in the same order.
+  void FindAll(const std::vector<core::RelativeAddress>& addresses,
+               size_t thread_count,
+               std::vector<const Function*>* functions) const;
+
+  // @name Accessors.
+  // @{
+  const Functions& functions() const { return functions_; }
+  // @}
+
+ protected:
+  // The functions, sorted by address. They don't overlap.
+  Functions functions_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FunctionTable);
+};
+
+// Describes a function of an image.
+struct FunctionTable::Function {
+  Function() : size(0) {}
+  Function(core::RelativeAddress address, size_t size, const std::string& name)
+      : address(address), size(size), name(name) {
+  }
+
+  core::RelativeAddress address;
+  size_t size;
+  std::string name;
+};
+
+}  // namespace grinder
+
+#endif  // SYZYGY_GRINDER_FUNCTION_TABLE_H_
@@ -0,0 +1,107 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/grinder/function_table.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pe/unittest_util.h"
+
+namespace grinder {
+
+namespace {
+
+typedef FunctionTable::Function Function;
+
+class FunctionTableTest : public testing::Test {
+ public:
+  void SetUp() override {
+    testing::Test::SetUp();
+    image_path_ = testing::GetExeTestDataRelativePath(testing::kTestDllName);
+  }
+
+ protected:
+  base::FilePath image_path_;
+};
+
+}  // namespace
+
+TEST_F(FunctionTableTest, InitFailsForMissingImage) {
+  FunctionTable table;
+  EXPECT_FALSE(table.Init(base::FilePath(L"C:\\nonexistent.dll"), 1));
+}
+
+TEST_F(FunctionTableTest, Init) {
+  FunctionTable table;
+  ASSERT_TRUE(table.Init(image_path_, 4));
+  ASSERT_FALSE(table.functions().empty());
+
+  // The functions are sorted and distinct, and DllMain is one of them.
+  const Function* dll_main = NULL;
+  for (size_t i = 0; i < table.functions().size(); ++i) {
+    const Function& function = table.functions()[i];
+    if (i > 0)
+      EXPECT_LT(table.functions()[i - 1].address, function.address);
+    if (function.name == "DllMain")
+      dll_main = &function;
+  }
+  ASSERT_TRUE(dll_main != NULL);
+  EXPECT_LT(0u, dll_main->size);
+
+  // The same table is read with a single thread.
+  FunctionTable serial_table;
+  ASSERT_TRUE(serial_table.Init(image_path_, 1));
+  ASSERT_EQ(table.functions().size(), serial_table.functions().size());
+  for (size_t i = 0; i < table.functions().size(); ++i) {
+    EXPECT_EQ(table.functions()[i].address,
+              serial_table.functions()[i].address);
+    EXPECT_EQ(table.functions()[i].name, serial_table.functions()[i].name);
+  }
+}
+
+TEST_F(FunctionTableTest, Find) {
+  FunctionTable table;
+  ASSERT_TRUE(table.Init(image_path_, 1));
+
+  const Function& first = table.functions().front();
+  EXPECT_EQ(NULL, table.Find(first.address - 1));
+  EXPECT_EQ(&first, table.Find(first.address));
+  EXPECT_EQ(&first, table.Find(first.address + first.size - 1));
+
+  const Function& last = table.functions().back();
+  EXPECT_EQ(&last, table.Find(last.address));
+  EXPECT_EQ(NULL, table.Find(last.address + last.size));
+}
+
+TEST_F(FunctionTableTest, FindAll) {
+  FunctionTable table;
+  ASSERT_TRUE(table.Init(image_path_, 1));
+
+  // Enough addresses for several threads, including some between functions.
+  std::vector<core::RelativeAddress> addresses;
+  while (addresses.size() < 10000) {
+    for (const Function& function : table.functions()) {
+      addresses.push_back(function.address);
+      addresses.push_back(function.address + function.size);
+    }
+  }
+
+  std::vector<const Function*> functions;
+  table.FindAll(addresses, 4, &functions);
+  ASSERT_EQ(addresses.size(), functions.size());
+  for (size_t i = 0; i < addresses.size(); ++i)
+    EXPECT_EQ(table.Find(addresses[i]), functions[i]);
+}
+
+}  // namespace grinder
@@ -29,6 +29,8 @@
         'coverage_data.h',
         'find.cc',
         'find.h',
+        'function_table.cc',
+        'function_table.h',
         'grinder_app.cc',
         'grinder_app.h',
         'grinder_util.cc',
@@ -56,6 +58,7 @@
         '<(src)/syzygy/bard/bard.gyp:bard_lib',
         '<(src)/syzygy/common/common.gyp:common_lib',
         '<(src)/syzygy/pe/pe.gyp:dia_sdk',
+        '<(src)/syzygy/pdb/pdb.gyp:pdb_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/trace/parse/parse.gyp:parse_lib',
       ],
@@ -68,6 +71,7 @@
         'cache_grind_writer_unittest.cc',
         'coverage_data_unittest.cc',
         'find_unittest.cc',
+        'function_table_unittest.cc',
         'grinder_app_unittest.cc',
         'grinder_util_unittest.cc',
         'indexed_frequency_data_serializer_unittest.cc',
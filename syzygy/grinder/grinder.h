@@ -30,6 +30,12 @@ class GrinderInterface : public trace::parser::ParseEventHandlerImpl {
 
   virtual ~GrinderInterface() { }
 
+  // Sets the number of threads the grinder may use for its own work. This is
+  // called prior to ParseCommandLine. Grinders that only use the calling
+  // thread ignore it.
+  // @param thread_count the number of threads, which must be at least 1.
+  virtual void set_thread_count(size_t thread_count) { }
+
   // Parses any required and/or optional arguments from the command-line.
   // @param command_line the command-line to be parsed.
   // @returns true on success, false otherwise.
@@ -56,6 +62,13 @@ class GrinderInterface : public trace::parser::ParseEventHandlerImpl {
   // @returns true on success, false otherwise.
   // @note The implementation should log on failure.
   virtual bool OutputData(FILE* file) = 0;
+
+  // @returns the interface through which the parser may dispatch the events
+  //     to clones of the grinder on several threads, or NULL if the grinder
+  //     only handles its events sequentially.
+  virtual trace::parser::ParallelParseEventHandler* parallel_event_handler() {
+    return NULL;
+  }
 };
 
 }  // namespace grinder
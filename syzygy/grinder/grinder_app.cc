@@ -16,6 +16,7 @@
 
 #include "base/logging.h"
 #include "base/files/file_util.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
 #include "syzygy/grinder/grinders/coverage_grinder.h"
@@ -60,10 +61,30 @@ const char kUsageFormatStr[] =
     "Optional parameters\n"
     "  --output-file=<output file>\n"
     "    The location of output file. If not specified, output is to stdout.\n"
+    "  --jobs=<count>\n"
+    "    The number of threads that parse the trace files. Only 'coverage'\n"
+    "    mode parses on several threads, and 'profile' mode resolves\n"
+    "    symbols on several threads. Defaults to the number of processors.\n"
+    "  --stream=<pipe>\n"
+    "    Also parses the traces that the call trace service streams to the\n"
+    "    named pipe <pipe> when run with --stream-to. The trace files need\n"
+    "    not be given when this is.\n"
+    "  --stream-sessions=<count>\n"
+    "    The number of sessions whose streams are parsed. Defaults to 1.\n"
+    "bbentry and branch mode optional parameters\n"
+    "  --output-format=<output format>\n"
+    "    Output format must be one of 'json' or 'binary'. The binary format\n"
+    "    is much faster to load for large images. Defaults to 'json'.\n"
+    "  --pretty-print\n"
+    "    Pretty prints the JSON output.\n"
     "coverage mode optional parameters\n"
     "  --output-format=<output format>\n"
     "    Output format must be one of 'lcov' or 'cachegrind'. Defaults to\n"
     "    'lcov' if not explicitly specified.\n"
+    "memreplay mode optional parameters\n"
+    "  --sampling-interval=<bytes>\n"
+    "    The sampling interval the memory profiler was run with, if any.\n"
+    "    The actual allocations are then estimated from the sampled ones.\n"
     "profile mode optional parameters\n"
     "  --thread-parts\n"
     "    Aggregate and output separate parts for each thread seen in the\n"
@@ -85,7 +106,9 @@ const char kUsageFormatStr[] =
 }  // namespace
 
 GrinderApp::GrinderApp()
-    : application::AppImplBase("Grinder"), mode_() {
+    : application::AppImplBase("Grinder"),
+      mode_(),
+      stream_session_count_(1) {
 }
 
 void GrinderApp::PrintUsage(const base::FilePath& program,
@@ -102,7 +125,8 @@ bool GrinderApp::ParseCommandLine(const base::CommandLine* command_line) {
   DCHECK(command_line != NULL);
 
   base::CommandLine::StringVector args = command_line->GetArgs();
-  if (args.empty()) {
+  stream_pipe_path_ = command_line->GetSwitchValuePath("stream");
+  if (args.empty() && stream_pipe_path_.empty()) {
     PrintUsage(command_line->GetProgram(),
                "You must provide at least one trace file.");
     return false;
@@ -150,6 +174,7 @@ bool GrinderApp::ParseCommandLine(const base::CommandLine* command_line) {
   DCHECK(grinder_.get() != NULL);
 
   // Parse the command-line for the grinder.
+  grinder_->set_thread_count(jobs());
   if (!grinder_->ParseCommandLine(command_line)) {
     PrintUsage(command_line->GetProgram(),
                base::StringPrintf("Failed to parse %s parameters.",
@@ -159,6 +184,19 @@ bool GrinderApp::ParseCommandLine(const base::CommandLine* command_line) {
 
   output_file_ = command_line->GetSwitchValuePath("output-file");
 
+  if (command_line->HasSwitch("stream-sessions")) {
+    std::string sessions = command_line->GetSwitchValueASCII("stream-sessions");
+    int session_count = 0;
+    if (stream_pipe_path_.empty() ||
+        !base::StringToInt(sessions, &session_count) || session_count <= 0) {
+      PrintUsage(command_line->GetProgram(),
+                 base::StringPrintf("Invalid stream session count: %s.",
+                                    sessions.c_str()));
+      return false;
+    }
+    stream_session_count_ = session_count;
+  }
+
   return true;
 }
 
@@ -170,6 +208,16 @@ int GrinderApp::Run() {
   if (!parser.Init(grinder_.get()))
     return 1;
 
+  if (jobs() > 1) {
+    trace::parser::ParallelParseEventHandler* parallel_event_handler =
+        grinder_->parallel_event_handler();
+    if (parallel_event_handler != NULL) {
+      parser.EnableParallelParse(parallel_event_handler, jobs());
+    } else {
+      LOG(WARNING) << "This mode parses the trace files on a single thread.";
+    }
+  }
+
   // Open the input files.
   for (size_t i = 0; i < trace_files_.size(); ++i) {
     if (!parser.OpenTraceFile(trace_files_[i])) {
@@ -179,6 +227,18 @@ int GrinderApp::Run() {
     }
   }
 
+  // Each session streams to its own instance of the pipe, which are
+  // connected to once the trace files have been parsed.
+  if (!stream_pipe_path_.empty()) {
+    for (size_t i = 0; i < stream_session_count_; ++i) {
+      if (!parser.OpenTraceStream(stream_pipe_path_)) {
+        LOG(ERROR) << "Unable to stream from \'"
+                   << stream_pipe_path_.value() << "'";
+        return 1;
+      }
+    }
+  }
+
   // Open the output file. We do this early so as to fail before processing
   // the logs if the output is not able to be opened.
   FILE* output = out();
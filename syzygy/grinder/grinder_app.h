@@ -53,6 +53,8 @@ class GrinderApp : public application::AppImplBase {
   std::vector<base::FilePath> trace_files_;
   base::FilePath output_file_;
   Mode mode_;
+  base::FilePath stream_pipe_path_;
+  size_t stream_session_count_;
   std::unique_ptr<GrinderInterface> grinder_;
 };
 
@@ -14,6 +14,9 @@
 
 #include "syzygy/grinder/grinders/coverage_grinder.h"
 
+#include <algorithm>
+#include <limits>
+
 #include "base/files/file_path.h"
 #include "base/strings/string_util.h"
 #include "syzygy/common/indexed_frequency_data.h"
@@ -79,20 +82,58 @@ bool CoverageGrinder::Grind() {
                  << "coverage results will be partial.";
   }
 
-  if (pdb_info_cache_.empty()) {
+  if (module_counts_.empty()) {
     LOG(ERROR) << "No coverage data was encountered.";
     return false;
   }
 
-  PdbInfoMap::const_iterator it = pdb_info_cache_.begin();
-  for (; it != pdb_info_cache_.end(); ++it) {
-    if (!coverage_data_.Add(it->second.line_info)) {
+  // Resolve the basic blocks of each module to lines, now that the counts of
+  // all the traces have been added together.
+  ModuleBasicBlockCountsMap::const_iterator counts_it = module_counts_.begin();
+  for (; counts_it != module_counts_.end(); ++counts_it) {
+    const BasicBlockCounts& counts = counts_it->second;
+
+    // Get the PDB info. This loads the line information and the basic-block
+    // ranges of the module.
+    PdbInfo* pdb_info = NULL;
+    if (!LoadPdbInfo(&pdb_info_cache_, counts_it->first, &pdb_info)) {
+      LOG(WARNING) << "Skipping coverage data of module: "
+                   << counts_it->first.path;
+      continue;
+    }
+    DCHECK(pdb_info != NULL);
+
+    // Sanity check the contents.
+    if (counts.size() != pdb_info->bb_ranges.size()) {
+      LOG(ERROR) << "Mismatch between trace data BB count and PDB BB count.";
+      return false;
+    }
+
+    // Mark the visited basic blocks as such.
+    for (size_t bb_index = 0; bb_index < counts.size(); ++bb_index) {
+      if (counts[bb_index] == 0)
+        continue;
+
+      const RelativeAddressRange& bb_range = pdb_info->bb_ranges[bb_index];
+      if (!pdb_info->line_info.Visit(bb_range.start(),
+                                     bb_range.size(),
+                                     counts[bb_index])) {
+        LOG(ERROR) << "Failed to visit BB at " << bb_range << ".";
+        return false;
+      }
+    }
+
+    if (!coverage_data_.Add(pdb_info->line_info)) {
       LOG(ERROR) << "Failed to aggregate line information from PDB: "
-                 << it->first.path;
+                 << counts_it->first.path;
       return false;
     }
   }
-  DCHECK(!coverage_data_.source_file_coverage_data_map().empty());
+
+  if (coverage_data_.source_file_coverage_data_map().empty()) {
+    LOG(ERROR) << "No line information was found for the coverage data.";
+    return false;
+  }
 
   return true;
 }
@@ -121,6 +162,62 @@ bool CoverageGrinder::OutputData(FILE* file) {
   return true;
 }
 
+trace::parser::ParallelParseEventHandler*
+CoverageGrinder::parallel_event_handler() {
+  return this;
+}
+
+std::unique_ptr<trace::parser::ParseEventHandler>
+CoverageGrinder::CreateClone() {
+  DCHECK(parser_ != NULL);
+
+  // The clones only count the visits of the basic blocks, the PDBs are read
+  // once by Grind.
+  CoverageGrinder* clone = new CoverageGrinder();
+  clone->parser_ = parser_;
+  clone->output_format_ = output_format_;
+  return std::unique_ptr<trace::parser::ParseEventHandler>(clone);
+}
+
+bool CoverageGrinder::MergeClone(trace::parser::ParseEventHandler* clone) {
+  DCHECK(clone != NULL);
+
+  const CoverageGrinder* coverage_clone =
+      static_cast<const CoverageGrinder*>(clone);
+  if (coverage_clone->event_handler_errored_)
+    event_handler_errored_ = true;
+
+  ModuleBasicBlockCountsMap::const_iterator it =
+      coverage_clone->module_counts_.begin();
+  for (; it != coverage_clone->module_counts_.end(); ++it) {
+    std::pair<ModuleBasicBlockCountsMap::iterator, bool> result =
+        module_counts_.insert(*it);
+    if (result.second)
+      continue;
+
+    if (result.first->second.size() != it->second.size()) {
+      LOG(ERROR) << "Mismatch between the BB counts of the traces of module: "
+                 << it->first.path;
+      return false;
+    }
+    AddBasicBlockCounts(it->second, &result.first->second);
+  }
+
+  return true;
+}
+
+void CoverageGrinder::AddBasicBlockCounts(const BasicBlockCounts& counts,
+                                          BasicBlockCounts* total) {
+  DCHECK(total != NULL);
+  DCHECK_EQ(counts.size(), total->size());
+
+  // We use saturation arithmetic here as overflow is a real possibility when
+  // aggregating many trace files.
+  const uint32_t kMaxCount = std::numeric_limits<uint32_t>::max();
+  for (size_t i = 0; i < counts.size(); ++i)
+    (*total)[i] = std::min((*total)[i], kMaxCount - counts[i]) + counts[i];
+}
+
 void CoverageGrinder::OnIndexedFrequency(
     base::Time time,
     DWORD process_id,
@@ -160,40 +257,24 @@ void CoverageGrinder::OnIndexedFrequency(
   //     expected? This isn't strictly necessary but would add another level of
   //     safety checking.
 
-  // Get the PDB info. This loads the line information and the basic-block
-  // ranges if not already done, otherwise it returns the cached version.
-  PdbInfo* pdb_info = NULL;
-  if (!LoadPdbInfo(&pdb_info_cache_, *module_info, &pdb_info)) {
+  // The counts are checked against the basic-block ranges of the PDB by
+  // Grind. Until then, all the traces of a module must agree on its size.
+  BasicBlockCounts& total = module_counts_[*module_info];
+  if (total.empty()) {
+    total.resize(data->num_entries, 0);
+  } else if (total.size() != data->num_entries) {
+    LOG(ERROR) << "Mismatch between the BB counts of the traces of module: "
+               << module_info->path;
     event_handler_errored_ = true;
     return;
   }
 
-  DCHECK(pdb_info != NULL);
-
-  // Sanity check the contents.
-  if (data->num_entries != pdb_info->bb_ranges.size()) {
-    LOG(ERROR) << "Mismatch between trace data BB count and PDB BB count.";
-    event_handler_errored_ = true;
-    return;
-  }
-
-  // Run over the BB frequency data and mark non-zero frequency BBs as having
-  // been visited.
+  // Run over the BB frequency data and count the visits of each BB, using
+  // saturation arithmetic.
+  const uint32_t kMaxCount = std::numeric_limits<uint32_t>::max();
   for (size_t bb_index = 0; bb_index < data->num_entries; ++bb_index) {
     uint32_t bb_freq = GetFrequency(data, bb_index, 0);
-
-    if (bb_freq == 0)
-      continue;
-
-    // Mark this basic-block as visited.
-    const RelativeAddressRange& bb_range = pdb_info->bb_ranges[bb_index];
-    if (!pdb_info->line_info.Visit(bb_range.start(),
-                                   bb_range.size(),
-                                   bb_freq)) {
-      LOG(ERROR) << "Failed to visit BB at " << bb_range << ".";
-      event_handler_errored_ = true;
-      return;
-    }
+    total[bb_index] = std::min(total[bb_index], kMaxCount - bb_freq) + bb_freq;
   }
 }
 
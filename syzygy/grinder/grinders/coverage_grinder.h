@@ -17,6 +17,9 @@
 #ifndef SYZYGY_GRINDER_GRINDERS_COVERAGE_GRINDER_H_
 #define SYZYGY_GRINDER_GRINDERS_COVERAGE_GRINDER_H_
 
+#include <map>
+#include <vector>
+
 #include "syzygy/grinder/basic_block_util.h"
 #include "syzygy/grinder/coverage_data.h"
 #include "syzygy/grinder/grinder.h"
@@ -26,7 +29,8 @@ namespace grinders {
 
 // This class processes trace files containing basic-block frequency data and
 // produces LCOV output.
-class CoverageGrinder : public GrinderInterface {
+class CoverageGrinder : public GrinderInterface,
+                        public trace::parser::ParallelParseEventHandler {
  public:
   CoverageGrinder();
   ~CoverageGrinder();
@@ -37,6 +41,13 @@ class CoverageGrinder : public GrinderInterface {
   virtual void SetParser(Parser* parser) override;
   virtual bool Grind() override;
   virtual bool OutputData(FILE* file) override;
+  trace::parser::ParallelParseEventHandler* parallel_event_handler() override;
+  // @}
+
+  // @name ParallelParseEventHandler implementation.
+  // @{
+  std::unique_ptr<trace::parser::ParseEventHandler> CreateClone() override;
+  bool MergeClone(trace::parser::ParseEventHandler* clone) override;
   // @}
 
   // @name IndexedFrequencyGrinder implementation.
@@ -61,8 +72,27 @@ class CoverageGrinder : public GrinderInterface {
   const CoverageData& coverage_data() { return coverage_data_; }
 
  protected:
-  // Stores per-module coverage data, populated during calls to
-  // OnIndexedFrequency.
+  // The number of times each basic block of a module was visited, in the
+  // order of the frequency data of the traces.
+  typedef std::vector<uint32_t> BasicBlockCounts;
+  typedef std::map<basic_block_util::ModuleInformation,
+                   BasicBlockCounts,
+                   basic_block_util::ModuleIdentityComparator>
+      ModuleBasicBlockCountsMap;
+
+  // Adds @p counts to @p total, using saturation arithmetic.
+  // @param counts The counts to add.
+  // @param total The counts to accumulate to, of the same size as @p counts.
+  static void AddBasicBlockCounts(const BasicBlockCounts& counts,
+                                  BasicBlockCounts* total);
+
+  // Stores the basic-block visit counts of each module, populated during calls
+  // to OnIndexedFrequency. When parsing in parallel, the counts of the clones
+  // are added to it as they are merged. These are only resolved to lines by
+  // Grind, so that the PDB of each module is read once.
+  ModuleBasicBlockCountsMap module_counts_;
+
+  // Stores per-module PDB information, populated by Grind.
   basic_block_util::PdbInfoMap pdb_info_cache_;
 
   // Stores the final coverage data, populated by Grind. Contains an aggregate
@@ -26,6 +26,9 @@ namespace {
 
 class TestCoverageGrinder : public CoverageGrinder {
  public:
+  using CoverageGrinder::AddBasicBlockCounts;
+  using CoverageGrinder::BasicBlockCounts;
+  using CoverageGrinder::module_counts_;
   using CoverageGrinder::parser_;
 };
 
@@ -116,6 +119,23 @@ TEST_F(CoverageGrinderTest, GrindFailsOnNoCoverageEvents) {
   EXPECT_FALSE(grinder.Grind());
 }
 
+TEST_F(CoverageGrinderTest, AddBasicBlockCounts) {
+  TestCoverageGrinder::BasicBlockCounts total;
+  total.push_back(0);
+  total.push_back(1);
+  total.push_back(0xFFFFFFF0);
+
+  TestCoverageGrinder::BasicBlockCounts counts;
+  counts.push_back(0);
+  counts.push_back(2);
+  counts.push_back(0x20);
+
+  TestCoverageGrinder::AddBasicBlockCounts(counts, &total);
+  EXPECT_EQ(0u, total[0]);
+  EXPECT_EQ(3u, total[1]);
+  EXPECT_EQ(0xFFFFFFFF, total[2]);
+}
+
 TEST_F(CoverageGrinderTest, GrindAndOutputLcovDataSucceeds) {
   cmd_line_.AppendSwitchASCII("output-format", "lcov");
   ASSERT_NO_FATAL_FAILURE(GrindAndOutputSucceeds(CoverageGrinder::kLcovFormat));
@@ -129,5 +149,42 @@ TEST_F(CoverageGrinderTest, GrindAndOutputCacheGrindDataSucceeds) {
   // TODO(chrisha): Validate the output is a valid CacheGrind file.
 }
 
+TEST_F(CoverageGrinderTest, ParallelGrindMatchesSequentialGrind) {
+  TestCoverageGrinder grinder;
+  ASSERT_TRUE(grinder.ParseCommandLine(&cmd_line_));
+  ASSERT_NO_FATAL_FAILURE(InitParser(&grinder));
+  grinder.SetParser(&parser_);
+  ASSERT_TRUE(parser_.Consume());
+  ASSERT_TRUE(grinder.Grind());
+  EXPECT_FALSE(grinder.module_counts_.empty());
+
+  TestCoverageGrinder parallel_grinder;
+  ASSERT_TRUE(parallel_grinder.ParseCommandLine(&cmd_line_));
+  ASSERT_EQ(&parallel_grinder, parallel_grinder.parallel_event_handler());
+  trace::parser::Parser parallel_parser;
+  ASSERT_TRUE(parallel_parser.Init(&parallel_grinder));
+  parallel_parser.EnableParallelParse(&parallel_grinder, 4);
+  ASSERT_TRUE(parallel_parser.OpenTraceFile(
+      testing::GetExeTestDataRelativePath(testing::kCoverageTraceFiles[0])));
+  parallel_grinder.SetParser(&parallel_parser);
+  ASSERT_TRUE(parallel_parser.Consume());
+  ASSERT_TRUE(parallel_grinder.Grind());
+
+  const CoverageData::SourceFileCoverageDataMap& expected =
+      grinder.coverage_data().source_file_coverage_data_map();
+  const CoverageData::SourceFileCoverageDataMap& actual =
+      parallel_grinder.coverage_data().source_file_coverage_data_map();
+  ASSERT_EQ(expected.size(), actual.size());
+  CoverageData::SourceFileCoverageDataMap::const_iterator expected_it =
+      expected.begin();
+  CoverageData::SourceFileCoverageDataMap::const_iterator actual_it =
+      actual.begin();
+  for (; expected_it != expected.end(); ++expected_it, ++actual_it) {
+    EXPECT_EQ(expected_it->first, actual_it->first);
+    EXPECT_EQ(expected_it->second.line_execution_count_map,
+              actual_it->second.line_execution_count_map);
+  }
+}
+
 }  // namespace grinders
 }  // namespace grinder
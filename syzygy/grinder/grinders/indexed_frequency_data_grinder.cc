@@ -14,10 +14,12 @@
 
 #include "syzygy/grinder/grinders/indexed_frequency_data_grinder.h"
 
+#include <algorithm>
 #include <limits>
 
 #include "base/files/file_path.h"
 #include "base/json/json_reader.h"
+#include "base/strings/string_util.h"
 #include "syzygy/common/indexed_frequency_data.h"
 #include "syzygy/core/json_file_writer.h"
 #include "syzygy/pdb/pdb_reader.h"
@@ -32,12 +34,27 @@ namespace grinders {
 
 IndexedFrequencyDataGrinder::IndexedFrequencyDataGrinder()
     : parser_(NULL),
-      event_handler_errored_(false) {
+      event_handler_errored_(false),
+      output_format_(kJsonFormat) {
 }
 
 bool IndexedFrequencyDataGrinder::ParseCommandLine(
     const base::CommandLine* command_line) {
   serializer_.set_pretty_print(command_line->HasSwitch("pretty-print"));
+
+  const char kOutputFormat[] = "output-format";
+  if (!command_line->HasSwitch(kOutputFormat))
+    return true;
+
+  std::string format = command_line->GetSwitchValueASCII(kOutputFormat);
+  if (base::LowerCaseEqualsASCII(format, "json")) {
+    output_format_ = kJsonFormat;
+  } else if (base::LowerCaseEqualsASCII(format, "binary")) {
+    output_format_ = kBinaryFormat;
+  } else {
+    LOG(ERROR) << "Unknown output format: " << format << ".";
+    return false;
+  }
   return true;
 }
 
@@ -47,18 +64,62 @@ void IndexedFrequencyDataGrinder::SetParser(Parser* parser) {
 }
 
 bool IndexedFrequencyDataGrinder::Grind() {
-  if (frequency_data_map_.empty()) {
+  using basic_block_util::EntryCountType;
+  using basic_block_util::IndexedFrequencyInformation;
+  using basic_block_util::IndexedFrequencyMap;
+
+  if (module_frequencies_.empty()) {
     LOG(ERROR) << "No basic-block frequency data was encountered.";
     return false;
   }
 
+  // Resolve the rows of the dense arrays to the addresses of their basic
+  // blocks, skipping the frequencies that are zero.
+  frequency_data_map_.clear();
+  ModuleFrequenciesMap::const_iterator it = module_frequencies_.begin();
+  for (; it != module_frequencies_.end(); ++it) {
+    const ModuleFrequencies& frequencies = it->second;
+    IndexedFrequencyInformation& info = frequency_data_map_[it->first];
+    info = frequencies.info;
+
+    IndexedFrequencyMap& bb_entries = info.frequency_map;
+    for (size_t bb_id = 0; bb_id < info.num_entries; ++bb_id) {
+      for (size_t column = 0; column < info.num_columns; ++column) {
+        EntryCountType amount =
+            frequencies.values[bb_id * info.num_columns + column];
+        if (amount == 0)
+          continue;
+
+        EntryCountType& value = bb_entries[std::make_pair(
+            frequencies.block_ranges[bb_id].start(), column)];
+        value += std::min(
+            amount, std::numeric_limits<EntryCountType>::max() - value);
+      }
+    }
+  }
+
   return true;
 }
 
 bool IndexedFrequencyDataGrinder::OutputData(FILE* file) {
   DCHECK(file != NULL);
-  if (!serializer_.SaveAsJson(frequency_data_map_, file))
-    return false;
+
+  switch (output_format_) {
+    case kJsonFormat: {
+      if (!serializer_.SaveAsJson(frequency_data_map_, file))
+        return false;
+      break;
+    }
+
+    case kBinaryFormat: {
+      if (!serializer_.SaveAsBinary(frequency_data_map_, file))
+        return false;
+      break;
+    }
+
+    default: NOTREACHED() << "Unknown OutputFormat.";
+  }
+
   return true;
 }
 
@@ -116,36 +177,32 @@ void IndexedFrequencyDataGrinder::OnIndexedFrequency(
 void IndexedFrequencyDataGrinder::UpdateBasicBlockFrequencyData(
     const InstrumentedModuleInformation& instrumented_module,
     const TraceIndexedFrequencyData* data) {
-  using basic_block_util::BasicBlockOffset;
-  using basic_block_util::EntryCountType;
-  using basic_block_util::GetFrequency;
-  using basic_block_util::IndexedFrequencyInformation;
-  using basic_block_util::IndexedFrequencyMap;
-  using basic_block_util::RelativeAddress;
-
   DCHECK(data != NULL);
   DCHECK_NE(0U, data->num_entries);
   DCHECK_NE(0U, data->num_columns);
 
   // Find the entry for this module.
-  ModuleIndexedFrequencyMap::iterator look =
-      frequency_data_map_.find(instrumented_module.original_module);
-
-  if (look == frequency_data_map_.end()) {
-    IndexedFrequencyInformation info = {};
-    info.num_entries = data->num_entries;
-    info.num_columns = data->num_columns;
-    info.frequency_size = data->frequency_size;
-    info.data_type =
-        static_cast<common::IndexedFrequencyData::DataType>(data->data_type);
+  ModuleFrequenciesMap::iterator look =
+      module_frequencies_.find(instrumented_module.original_module);
 
-    look = frequency_data_map_.insert(
+  if (look == module_frequencies_.end()) {
+    look = module_frequencies_.insert(
         std::make_pair(instrumented_module.original_module,
-                       info)).first;
+                       ModuleFrequencies())).first;
+
+    ModuleFrequencies& frequencies = look->second;
+    frequencies.info.num_entries = data->num_entries;
+    frequencies.info.num_columns = data->num_columns;
+    frequencies.info.frequency_size = data->frequency_size;
+    frequencies.info.data_type =
+        static_cast<common::IndexedFrequencyData::DataType>(data->data_type);
+    frequencies.block_ranges = instrumented_module.block_ranges;
+    frequencies.values.resize(data->num_entries * data->num_columns, 0);
   }
 
   // Validate fields are compatible to be grinded together.
-  IndexedFrequencyInformation& info = look->second;
+  ModuleFrequencies& frequencies = look->second;
+  const basic_block_util::IndexedFrequencyInformation& info = frequencies.info;
   if (info.num_entries != data->num_entries ||
       info.num_columns != data->num_columns ||
       info.frequency_size != data->frequency_size ||
@@ -153,30 +210,48 @@ void IndexedFrequencyDataGrinder::UpdateBasicBlockFrequencyData(
     event_handler_errored_ = true;
     return;
   }
+  DCHECK_EQ(info.num_entries, frequencies.block_ranges.size());
+
+  // The trace data has the same layout as the values, so it is added with a
+  // single pass over both.
+  size_t count = frequencies.values.size();
+  switch (data->frequency_size) {
+    case 1:
+      AddFrequencies(data->frequency_data, count, &frequencies.values[0]);
+      break;
+    case 2:
+      AddFrequencies(reinterpret_cast<const uint16_t*>(data->frequency_data),
+                     count, &frequencies.values[0]);
+      break;
+    case 4:
+      AddFrequencies(reinterpret_cast<const uint32_t*>(data->frequency_data),
+                     count, &frequencies.values[0]);
+      break;
+    default:
+      NOTREACHED() << "Invalid frequency size.";
+  }
+}
 
-  // Run over the BB frequency data and increment values for each basic block
-  // using saturation arithmetic.
-  IndexedFrequencyMap& bb_entries = info.frequency_map;
-  for (size_t bb_id = 0; bb_id < data->num_entries; ++bb_id) {
-    for (size_t column = 0; column < data->num_columns; ++column) {
-      EntryCountType amount = GetFrequency(data, bb_id, column);
-      if (amount != 0) {
-        BasicBlockOffset offs =
-            instrumented_module.block_ranges[bb_id].start().value();
-
-        EntryCountType& value = bb_entries[
-            std::make_pair(RelativeAddress(offs), column)];
-        if (amount < 0) {
-          // We need to detect uint32_t to int32_t overflow because JSON file
-          // output
-          // int32_t and basic block agent use an uint32_t counter.
-          value = std::numeric_limits<EntryCountType>::max();
-        } else {
-          value += std::min(
-              amount, std::numeric_limits<EntryCountType>::max() - value);
-        }
-      }
-    }
+template <typename FrequencyType>
+void IndexedFrequencyDataGrinder::AddFrequencies(
+    const FrequencyType* frequencies,
+    size_t count,
+    basic_block_util::EntryCountType* values) {
+  using basic_block_util::EntryCountType;
+
+  DCHECK(frequencies != NULL);
+  DCHECK(values != NULL);
+
+  // This is kept free of branches so that the compiler can vectorize it. The
+  // agent counts in uint32_t, so the frequencies that don't fit in the
+  // int32_t of the JSON output saturate.
+  const uint32_t kMaxValue = std::numeric_limits<EntryCountType>::max();
+  for (size_t i = 0; i < count; ++i) {
+    uint32_t amount = std::min(static_cast<uint32_t>(frequencies[i]),
+                               kMaxValue);
+    uint32_t value = static_cast<uint32_t>(values[i]);
+    values[i] = static_cast<EntryCountType>(
+        std::min(value, kMaxValue - amount) + amount);
   }
 }
 
@@ -36,11 +36,21 @@ namespace grinders {
 // See indexed_frequency_data_serializer.h for the resulting JSON structure.
 //
 // The JSON output will be pretty printed if --pretty-print is included in the
-// command line passed to ParseCommandLine().
+// command line passed to ParseCommandLine(). The output is in the binary format
+// of the serializer instead if --output-format=binary is.
+//
+// The frequencies are summed into a dense array per module, indexed by
+// basic-block ID, as the traces are parsed. They're only resolved to the
+// addresses of the basic blocks by Grind().
 class IndexedFrequencyDataGrinder : public GrinderInterface {
  public:
   typedef basic_block_util::ModuleIndexedFrequencyMap ModuleIndexedFrequencyMap;
 
+  enum OutputFormat {
+    kJsonFormat,
+    kBinaryFormat,
+  };
+
   IndexedFrequencyDataGrinder();
 
   // @name GrinderInterface implementation.
@@ -64,10 +74,13 @@ class IndexedFrequencyDataGrinder : public GrinderInterface {
   // @}
 
   // @returns a map from ModuleInformation records to basic block frequencies.
+  //     This is populated by Grind().
   const ModuleIndexedFrequencyMap& frequency_data_map() const {
     return frequency_data_map_;
   }
 
+  OutputFormat output_format() const { return output_format_; }
+
  protected:
   typedef basic_block_util::RelativeAddressRangeVector
       RelativeAddressRangeVector;
@@ -89,6 +102,34 @@ class IndexedFrequencyDataGrinder : public GrinderInterface {
                    InstrumentedModuleInformation,
                    ModuleIdentityComparator> InstrumentedModuleMap;
 
+  // The frequencies of a module as they are summed, in a dense array of
+  // num_entries rows of num_columns each, in the order of the trace data.
+  struct ModuleFrequencies {
+    // The description of the data. The frequency map is left empty.
+    basic_block_util::IndexedFrequencyInformation info;
+
+    // The basic block ranges of the module, to resolve the rows with.
+    RelativeAddressRangeVector block_ranges;
+
+    std::vector<basic_block_util::EntryCountType> values;
+  };
+
+  typedef std::map<ModuleInformation,
+                   ModuleFrequencies,
+                   ModuleIdentityComparator> ModuleFrequenciesMap;
+
+  // Adds frequencies to the values of a module, using saturation arithmetic.
+  // The sums saturate at the largest EntryCountType, as does any frequency
+  // that doesn't fit it.
+  // @tparam FrequencyType The type of the frequencies.
+  // @param frequencies The frequencies to add.
+  // @param count The number of frequencies.
+  // @param values The values to add to, of at least @p count elements.
+  template <typename FrequencyType>
+  static void AddFrequencies(const FrequencyType* frequencies,
+                             size_t count,
+                             basic_block_util::EntryCountType* values);
+
   // This method does the actual updating of the frequencies on receipt
   // of basic-block frequency data. It is implemented separately from the
   // main hook for unit-testing purposes.
@@ -107,6 +148,10 @@ class IndexedFrequencyDataGrinder : public GrinderInterface {
   const InstrumentedModuleInformation* FindOrCreateInstrumentedModule(
       const ModuleInformation* module_info);
 
+  // Stores the summed basic-block frequencies of each module encountered,
+  // keyed by the original module.
+  ModuleFrequenciesMap module_frequencies_;
+
   // Stores the summarized basic-block frequencies for each module encountered.
   ModuleIndexedFrequencyMap frequency_data_map_;
 
@@ -125,6 +170,9 @@ class IndexedFrequencyDataGrinder : public GrinderInterface {
   // continue with a warning that results may be partial.
   bool event_handler_errored_;
 
+  // The output format to use.
+  OutputFormat output_format_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(IndexedFrequencyDataGrinder);
 };
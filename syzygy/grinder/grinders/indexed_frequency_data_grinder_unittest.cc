@@ -14,6 +14,8 @@
 
 #include "syzygy/grinder/grinders/indexed_frequency_data_grinder.h"
 
+#include <limits>
+
 #include "base/values.h"
 #include "base/files/file_util.h"
 #include "base/files/scoped_temp_dir.h"
@@ -63,6 +65,7 @@ class TestIndexedFrequencyDataGrinder : public IndexedFrequencyDataGrinder {
  public:
   using IndexedFrequencyDataGrinder::UpdateBasicBlockFrequencyData;
   using IndexedFrequencyDataGrinder::InstrumentedModuleInformation;
+  using IndexedFrequencyDataGrinder::output_format_;
   using IndexedFrequencyDataGrinder::parser_;
 };
 
@@ -224,10 +227,24 @@ class IndexedFrequencyDataGrinderTest : public testing::PELibUnitTest {
 TEST_F(IndexedFrequencyDataGrinderTest, ParseCommandLineSucceeds) {
   TestIndexedFrequencyDataGrinder grinder1;
   EXPECT_TRUE(grinder1.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(IndexedFrequencyDataGrinder::kJsonFormat,
+            grinder1.output_format());
 
   TestIndexedFrequencyDataGrinder grinder2;
   cmd_line_.AppendSwitch("pretty-print");
   EXPECT_TRUE(grinder2.ParseCommandLine(&cmd_line_));
+
+  TestIndexedFrequencyDataGrinder grinder3;
+  cmd_line_.AppendSwitchASCII("output-format", "binary");
+  EXPECT_TRUE(grinder3.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(IndexedFrequencyDataGrinder::kBinaryFormat,
+            grinder3.output_format());
+}
+
+TEST_F(IndexedFrequencyDataGrinderTest, ParseInvalidOutputFormatFails) {
+  TestIndexedFrequencyDataGrinder grinder;
+  cmd_line_.AppendSwitchASCII("output-format", "foobar");
+  EXPECT_FALSE(grinder.ParseCommandLine(&cmd_line_));
 }
 
 TEST_F(IndexedFrequencyDataGrinderTest, SetParserSucceeds) {
@@ -271,20 +288,24 @@ TEST_F(IndexedFrequencyDataGrinderTest, UpdateBasicBlockFrequencyData) {
                                              &data));
     ASSERT_EQ(common::IndexedFrequencyData::BRANCH, data->data_type);
     ASSERT_EQ(frequency_size, data->frequency_size);
+    ASSERT_FALSE(grinder.Grind());
 
     grinder.UpdateBasicBlockFrequencyData(module_info, data.get());
+    ASSERT_TRUE(grinder.Grind());
     EXPECT_EQ(1U, grinder.frequency_data_map().size());
     CreateExpectedCounts(1, &expected_counts);
     EXPECT_THAT(grinder.frequency_data_map().begin()->second.frequency_map,
                 testing::ContainerEq(expected_counts));
 
     grinder.UpdateBasicBlockFrequencyData(module_info, data.get());
+    ASSERT_TRUE(grinder.Grind());
     EXPECT_EQ(1U, grinder.frequency_data_map().size());
     CreateExpectedCounts(2, &expected_counts);
     EXPECT_THAT(grinder.frequency_data_map().begin()->second.frequency_map,
                 testing::ContainerEq(expected_counts));
 
     grinder.UpdateBasicBlockFrequencyData(module_info, data.get());
+    ASSERT_TRUE(grinder.Grind());
     EXPECT_EQ(1U, grinder.frequency_data_map().size());
     CreateExpectedCounts(3, &expected_counts);
     EXPECT_THAT(grinder.frequency_data_map().begin()->second.frequency_map,
@@ -299,6 +320,70 @@ TEST_F(IndexedFrequencyDataGrinderTest, GrindBranchEntryDataSucceeds) {
   // TODO(rogerm): Inspect value for bb-entry specific expected data.
 }
 
+TEST_F(IndexedFrequencyDataGrinderTest, FrequenciesSaturate) {
+  InstrumentedModuleInformation module_info;
+  ASSERT_NO_FATAL_FAILURE(InitModuleInfo(&module_info));
+
+  TestIndexedFrequencyDataGrinder grinder;
+  ScopedFrequencyData data;
+  ASSERT_NO_FATAL_FAILURE(GetFrequencyData(module_info.original_module, 4,
+                                           &data));
+
+  // The first frequency doesn't fit an EntryCountType, and the second one
+  // overflows once added twice.
+  uint32_t* frequencies = reinterpret_cast<uint32_t*>(data->frequency_data);
+  frequencies[0] = 0x80000000;
+  frequencies[1] = 0x40000000;
+  grinder.UpdateBasicBlockFrequencyData(module_info, data.get());
+  grinder.UpdateBasicBlockFrequencyData(module_info, data.get());
+  ASSERT_TRUE(grinder.Grind());
+
+  IndexedFrequencyMap expected_counts;
+  CreateExpectedCounts(2, &expected_counts);
+  using grinder::basic_block_util::RelativeAddress;
+  expected_counts[std::make_pair(RelativeAddress(0), 0)] =
+      std::numeric_limits<EntryCountType>::max();
+  expected_counts[std::make_pair(RelativeAddress(0), 1)] =
+      std::numeric_limits<EntryCountType>::max();
+  ASSERT_EQ(1U, grinder.frequency_data_map().size());
+  EXPECT_THAT(grinder.frequency_data_map().begin()->second.frequency_map,
+              testing::ContainerEq(expected_counts));
+}
+
+TEST_F(IndexedFrequencyDataGrinderTest, BinaryOutputMatchesJsonOutput) {
+  TestIndexedFrequencyDataGrinder grinder;
+  ASSERT_TRUE(grinder.ParseCommandLine(&cmd_line_));
+  ASSERT_NO_FATAL_FAILURE(InitParser(&grinder, testing::kBranchTraceFiles[0]));
+  grinder.SetParser(&parser_);
+  ASSERT_TRUE(parser_.Consume());
+  ASSERT_TRUE(grinder.Grind());
+
+  // Output the same data in both formats.
+  base::FilePath json_path;
+  base::FilePath binary_path;
+  {
+    base::ScopedFILE json_file(
+        CreateAndOpenTemporaryFileInDir(temp_dir_.path(), &json_path));
+    ASSERT_TRUE(json_file.get() != NULL);
+    grinder.output_format_ = IndexedFrequencyDataGrinder::kJsonFormat;
+    ASSERT_TRUE(grinder.OutputData(json_file.get()));
+
+    base::ScopedFILE binary_file(
+        CreateAndOpenTemporaryFileInDir(temp_dir_.path(), &binary_path));
+    ASSERT_TRUE(binary_file.get() != NULL);
+    grinder.output_format_ = IndexedFrequencyDataGrinder::kBinaryFormat;
+    ASSERT_TRUE(grinder.OutputData(binary_file.get()));
+  }
+
+  ModuleIndexedFrequencyMap json_counts;
+  ModuleIndexedFrequencyMap binary_counts;
+  IndexedFrequencyDataSerializer serializer;
+  ASSERT_TRUE(serializer.LoadFromJson(json_path, &json_counts));
+  ASSERT_TRUE(serializer.LoadFromBinary(binary_path, &binary_counts));
+  EXPECT_FALSE(binary_counts.empty());
+  EXPECT_THAT(binary_counts, testing::ContainerEq(json_counts));
+}
+
 
 }  // namespace grinders
 }  // namespace grinder
@@ -14,8 +14,10 @@
 
 #include "syzygy/grinder/grinders/mem_replay_grinder.h"
 
+#include <cmath>
 #include <cstring>
 
+#include "base/strings/string_number_conversions.h"
 #include "syzygy/bard/raw_argument_converter.h"
 #include "syzygy/bard/events/heap_alloc_event.h"
 #include "syzygy/bard/events/heap_create_event.h"
@@ -192,7 +194,8 @@ class ArgumentParser {
 
 }  // namespace
 
-MemReplayGrinder::MemReplayGrinder() : parse_error_(false) {
+MemReplayGrinder::MemReplayGrinder()
+    : sampling_interval_(0), parse_error_(false) {
 }
 
 bool MemReplayGrinder::ParseCommandLine(
@@ -200,6 +203,15 @@ bool MemReplayGrinder::ParseCommandLine(
   DCHECK_NE(static_cast<base::CommandLine*>(nullptr), command_line);
   LoadAsanFunctionNames();
 
+  const char kSamplingInterval[] = "sampling-interval";
+  if (command_line->HasSwitch(kSamplingInterval)) {
+    std::string value = command_line->GetSwitchValueASCII(kSamplingInterval);
+    if (!base::StringToSizeT(value, &sampling_interval_)) {
+      LOG(ERROR) << "Invalid sampling interval: " << value << ".";
+      return false;
+    }
+  }
+
   return true;
 }
 
@@ -222,6 +234,35 @@ bool MemReplayGrinder::Grind() {
                  << "all detailed function call records could be parsed.";
       return false;
     }
+
+    // Stack trace IDs are only resolvable if the stack traces were emitted,
+    // which is not the case when they are only tracked.
+    if (proc_data.stack_traces.empty())
+      continue;
+    size_t unresolved_stack_trace_ids = 0;
+    for (uint32_t stack_trace_id : proc_data.stack_trace_ids) {
+      if (proc_data.stack_traces.find(stack_trace_id) ==
+          proc_data.stack_traces.end()) {
+        ++unresolved_stack_trace_ids;
+      }
+    }
+    if (unresolved_stack_trace_ids > 0) {
+      LOG(WARNING) << "Process " << proc_data.process_id << " refers to "
+                   << unresolved_stack_trace_ids << " stack traces that are "
+                   << "not in the trace file.";
+    }
+  }
+
+  if (sampling_interval_ != 0) {
+    for (const auto& proc_id_data_pair : process_data_map_) {
+      const auto& proc_data = proc_id_data_pair.second;
+      uint64_t count =
+          static_cast<uint64_t>(proc_data.estimated_allocation_count);
+      uint64_t bytes =
+          static_cast<uint64_t>(proc_data.estimated_allocated_bytes);
+      LOG(INFO) << "Process " << proc_data.process_id << " made an estimated "
+                << count << " allocations of " << bytes << " bytes.";
+    }
   }
 
   if (missing_events_.size()) {
@@ -291,6 +332,11 @@ bool MemReplayGrinder::Grind() {
         std::push_heap(heap.begin(), heap.end());
       }
     }
+
+    // The timestamps are only needed to order the events, so they are
+    // released as soon as the dependencies of the process are known.
+    for (auto& thread : proc.second.thread_data_map)
+      std::vector<uint64_t>().swap(thread.second.timestamps);
   }
 
   return true;
@@ -355,34 +401,50 @@ void MemReplayGrinder::OnFunctionNameTableEntry(
 
   std::string name(data->name);
   auto it = function_enum_map_.find(name);
+  ProcessData* proc_data = nullptr;
   if (it == function_enum_map_.end()) {
     missing_events_.insert(name);
-    return;
+    ignored_function_ids_[process_id].insert(data->function_id);
+
+    // Calls to this function may already be waiting on its name.
+    auto proc_it = process_data_map_.find(process_id);
+    if (proc_it == process_data_map_.end())
+      return;
+    proc_data = &proc_it->second;
+  } else {
+    proc_data = FindOrCreateProcessData(process_id);
+    auto result = proc_data->function_id_map.insert(
+        std::make_pair(data->function_id, it->second));
+    DCHECK(result.second);
   }
 
-  ProcessData* proc_data = FindOrCreateProcessData(process_id);
-  auto result = proc_data->function_id_map.insert(
-      std::make_pair(data->function_id, it->second));
-  DCHECK(result.second);
-
   // If the pending function ID set is now empty then the pending detailed
   // function call records can be drained.
   if (proc_data->pending_function_ids.erase(data->function_id) == 1 &&
       proc_data->pending_function_ids.empty() &&
-      !proc_data->pending_calls.empty()) {
-    while (!proc_data->pending_calls.empty()) {
-      const PendingDetailedFunctionCall& pending_call =
-          proc_data->pending_calls.front();
-      if (!ParseDetailedFunctionCall(pending_call.time(),
-                                     pending_call.thread_id(),
-                                     pending_call.data(), proc_data)) {
-        return SetParseError();
-      }
-      proc_data->pending_calls.pop_front();
-    }
+      !ParsePendingCalls(proc_data)) {
+    return SetParseError();
   }
 }
 
+void MemReplayGrinder::OnStackTrace(base::Time time,
+                                    DWORD process_id,
+                                    const TraceStackTrace* data) {
+  DCHECK_NE(static_cast<TraceStackTrace*>(nullptr), data);
+
+  if (parse_error_)
+    return;
+
+  // The stack traces may arrive after the calls referring to them, as they
+  // are emitted by whichever thread first sees them. They are only resolved
+  // once the whole trace has been parsed.
+  ProcessData* proc_data = FindOrCreateProcessData(process_id);
+  proc_data->stack_traces.insert(std::make_pair(
+      data->stack_trace_id,
+      std::vector<const void*>(data->frames,
+                               data->frames + data->num_frames)));
+}
+
 void MemReplayGrinder::OnDetailedFunctionCall(
     base::Time time,
     DWORD process_id,
@@ -395,9 +457,16 @@ void MemReplayGrinder::OnDetailedFunctionCall(
   if (parse_error_)
     return;
 
+  // Calls to unsupported functions are dropped right away.
+  if (IsIgnoredFunction(process_id, data->function_id))
+    return;
+
   ProcessData* proc_data = FindOrCreateProcessData(process_id);
   DCHECK_NE(static_cast<ProcessData*>(nullptr), proc_data);
 
+  if (data->stack_trace_id != 0)
+    proc_data->stack_trace_ids.insert(data->stack_trace_id);
+
   // If function calls are already pending then all new calls must continue to
   // be added to the pending list.
   bool push_pending = !proc_data->pending_calls.empty();
@@ -442,6 +511,23 @@ void MemReplayGrinder::OnProcessHeap(base::Time time,
       reinterpret_cast<const void*>(data->process_heap));
 }
 
+void MemReplayGrinder::EstimateAllocation(size_t bytes,
+                                          ProcessData* proc_data) {
+  DCHECK_NE(static_cast<ProcessData*>(nullptr), proc_data);
+
+  // An allocation of S bytes is sampled with a probability of
+  // 1 - exp(-S / interval), so weighting each sampled allocation by the
+  // inverse of that probability gives unbiased estimates.
+  double weight = 1.0;
+  if (sampling_interval_ != 0 && bytes != 0) {
+    double probability =
+        -std::expm1(-static_cast<double>(bytes) / sampling_interval_);
+    weight = 1.0 / probability;
+  }
+  proc_data->estimated_allocation_count += weight;
+  proc_data->estimated_allocated_bytes += weight * bytes;
+}
+
 void MemReplayGrinder::LoadAsanFunctionNames() {
   function_enum_map_.clear();
   for (size_t i = 0; i < arraysize(kAsanHeapFunctionNames); ++i) {
@@ -450,6 +536,36 @@ void MemReplayGrinder::LoadAsanFunctionNames() {
   }
 }
 
+bool MemReplayGrinder::ParsePendingCalls(ProcessData* proc_data) {
+  DCHECK_NE(static_cast<ProcessData*>(nullptr), proc_data);
+  DCHECK(proc_data->pending_function_ids.empty());
+
+  while (!proc_data->pending_calls.empty()) {
+    const PendingDetailedFunctionCall& pending_call =
+        proc_data->pending_calls.front();
+    if (!IsIgnoredFunction(proc_data->process_id,
+                           pending_call.data()->function_id) &&
+        !ParseDetailedFunctionCall(pending_call.time(),
+                                   pending_call.thread_id(),
+                                   pending_call.data(), proc_data)) {
+      return false;
+    }
+    proc_data->pending_calls.pop_front();
+  }
+
+  // Release the storage of the calls.
+  PendingDetailedFunctionCalls().swap(proc_data->pending_calls);
+  return true;
+}
+
+bool MemReplayGrinder::IsIgnoredFunction(DWORD process_id,
+                                         uint32_t function_id) const {
+  auto it = ignored_function_ids_.find(process_id);
+  if (it == ignored_function_ids_.end())
+    return false;
+  return it->second.count(function_id) != 0;
+}
+
 bool MemReplayGrinder::ParseDetailedFunctionCall(
     base::Time time,
     DWORD thread_id,
@@ -483,6 +599,8 @@ bool MemReplayGrinder::ParseDetailedFunctionCall(
       evt.reset(new bard::events::HeapAllocEvent(data->stack_trace_id,
                                                  parser.arg0(), parser.arg1(),
                                                  parser.arg2(), parser.arg3()));
+      if (parser.arg3() != nullptr)
+        EstimateAllocation(parser.arg2(), proc_data);
       break;
     }
 
@@ -887,14 +1005,23 @@ void MemReplayGrinder::ObjectInfo::SetCreated(const ThreadDataIterator& iter) {
 }
 
 void MemReplayGrinder::ObjectInfo::SetLastUse(const ThreadDataIterator& iter) {
-  last_use_[iter.thread_data] = iter.index;
+  for (auto& thread_index_pair : last_use_) {
+    if (thread_index_pair.first == iter.thread_data) {
+      thread_index_pair.second = iter.index;
+      return;
+    }
+  }
+  last_use_.push_back(std::make_pair(iter.thread_data, iter.index));
 }
 
 void MemReplayGrinder::ObjectInfo::SetDestroyed(
     const ThreadDataIterator& iter) {
   alive_ = false;
   destroyed_ = iter;
-  SetLastUse(iter);
+
+  // The uses of a dead object are never looked at again. A new object at the
+  // same address only depends on the destruction of this one.
+  LastUseMap().swap(last_use_);
 }
 
 }  // namespace grinders
@@ -58,6 +58,9 @@ class MemReplayGrinder : public GrinderInterface {
       base::Time time,
       DWORD process_id,
       const TraceFunctionNameTableEntry* data) override;
+  void OnStackTrace(base::Time time,
+                    DWORD process_id,
+                    const TraceStackTrace* data) override;
   void OnDetailedFunctionCall(base::Time time,
                               DWORD process_id,
                               DWORD thread_id,
@@ -96,8 +99,22 @@ class MemReplayGrinder : public GrinderInterface {
       std::pair<const bard::Story::PlotLine*, const bard::Story::PlotLine*>;
   using WaitedMap = std::map<PlotLinePair, ThreadDataIterator>;
 
+  // Accounts for a logged allocation in the estimates of its process.
+  // @param bytes The size of the allocation.
+  // @param proc_data The data of the process.
+  void EstimateAllocation(size_t bytes, ProcessData* proc_data);
   // Loads the function_enum_map_ with SyzyASan function names.
   void LoadAsanFunctionNames();
+  // Parses the pending detailed function call records of a process, once the
+  // names of all their functions have been seen. The calls to unsupported
+  // functions are dropped.
+  // @param proc_data The data of the process.
+  // @returns true on success, false otherwise.
+  bool ParsePendingCalls(ProcessData* proc_data);
+  // @param process_id The ID of a process.
+  // @param function_id The ID of a function of the process.
+  // @returns true if the function isn't supported by this grinder.
+  bool IsIgnoredFunction(DWORD process_id, uint32_t function_id) const;
   // Parses a detailed function call record.
   bool ParseDetailedFunctionCall(base::Time time,
                                  DWORD thread_id,
@@ -173,6 +190,10 @@ class MemReplayGrinder : public GrinderInterface {
   // but not found in |function_enum_map_| will be recorded here for logging
   // purposes.
   std::set<std::string> missing_events_;
+  // The IDs of the unsupported functions of each process. The calls to these
+  // are dropped as they are seen, rather than being kept pending.
+  std::unordered_map<DWORD, std::unordered_set<uint32_t>>
+      ignored_function_ids_;
 
   // Storage for stories and plotlines. Stories are kept separate from the
   // ProcessData that indexes them so that the ProcessData can remain easily
@@ -180,6 +201,10 @@ class MemReplayGrinder : public GrinderInterface {
   ScopedVector<bard::Story> stories_;
   std::map<DWORD, ProcessData> process_data_map_;
 
+  // The sampling interval of the memory profiler, in bytes, or 0 if all the
+  // allocations were logged.
+  size_t sampling_interval_;
+
   // Set to true if a parse error occurs.
   bool parse_error_;
 
@@ -224,7 +249,11 @@ struct MemReplayGrinder::ThreadData {
 // Houses all data associated with a single process during grinding. This is
 // indexed in a map by |process_id|.
 struct MemReplayGrinder::ProcessData {
-  ProcessData() : process_id(0), story(nullptr) {}
+  ProcessData()
+      : process_id(0),
+        estimated_allocation_count(0),
+        estimated_allocated_bytes(0),
+        story(nullptr) {}
 
   // The process ID.
   DWORD process_id;
@@ -237,6 +266,15 @@ struct MemReplayGrinder::ProcessData {
   std::unordered_set<uint32_t> pending_function_ids;
   // The list of detailed function calls that is pending processing.
   PendingDetailedFunctionCalls pending_calls;
+  // The estimated number and size of the allocations of the process. These
+  // are the actual ones unless the allocations were sampled.
+  double estimated_allocation_count;
+  double estimated_allocated_bytes;
+  // The stack traces emitted by the process, by ID. Each is emitted once per
+  // process, and the calls refer to it by ID afterwards.
+  std::unordered_map<uint32_t, std::vector<const void*>> stack_traces;
+  // The IDs of the stack traces referred to by the calls of the process.
+  std::unordered_set<uint32_t> stack_trace_ids;
   // The story holding events for this process. Ownership is external
   // to this object.
   bard::Story* story;
@@ -292,10 +330,14 @@ struct MemReplayGrinder::ThreadDataIteratorHashFunctor {
 };
 
 // A small structure for housing information about an object during
-// grinding.
+// grinding. There is one per address ever seen, so this is kept compact: the
+// uses of an object are only tracked while it is alive, and dead objects only
+// remember the event that destroyed them.
 class MemReplayGrinder::ObjectInfo {
  public:
-  using LastUseMap = std::unordered_map<ThreadData*, size_t>;
+  // The most recent use of the object on each thread that used it. Most
+  // objects are only used by one or two threads, so this is a flat list.
+  using LastUseMap = std::vector<std::pair<ThreadData*, size_t>>;
 
   explicit ObjectInfo(const ThreadDataIterator& iter);
 
@@ -320,8 +362,8 @@ class MemReplayGrinder::ObjectInfo {
   ThreadDataIterator created_;
   ThreadDataIterator destroyed_;
 
-  // Per thread, the most recent use of this object. This map uses an exploded
-  // ThreadDataIterator as key and value.
+  // Per thread, the most recent use of this object. This uses an exploded
+  // ThreadDataIterator as key and value. This is empty for dead objects.
   LastUseMap last_use_;
 
   // Copy and assignment is allowed in order to keep this object compatible
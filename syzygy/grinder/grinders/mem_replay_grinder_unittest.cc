@@ -14,6 +14,8 @@
 
 #include "syzygy/grinder/grinders/mem_replay_grinder.h"
 
+#include <cmath>
+
 #include "base/command_line.h"
 #include "base/files/file.h"
 #include "base/files/scoped_temp_dir.h"
@@ -41,6 +43,7 @@ class TestMemReplayGrinder : public MemReplayGrinder {
   using MemReplayGrinder::missing_events_;
   using MemReplayGrinder::parse_error_;
   using MemReplayGrinder::process_data_map_;
+  using MemReplayGrinder::sampling_interval_;
 
   // Member functions.
   using MemReplayGrinder::FindOrCreateProcessData;
@@ -62,6 +65,20 @@ class TestMemReplayGrinder : public MemReplayGrinder {
     OnFunctionNameTableEntry(base::Time::Now(), process_id, data);
   }
 
+  // Creates and dispatches a TraceStackTrace event.
+  void PlayStackTrace(uint32_t process_id,
+                      uint32_t stack_trace_id,
+                      const std::vector<void*>& frames) {
+    size_t buffer_size =
+        offsetof(TraceStackTrace, frames) + frames.size() * sizeof(void*);
+    std::vector<uint8_t> buffer(buffer_size, 0);
+    auto data = reinterpret_cast<TraceStackTrace*>(buffer.data());
+    data->stack_trace_id = stack_trace_id;
+    data->num_frames = frames.size();
+    ::memcpy(data->frames, frames.data(), frames.size() * sizeof(void*));
+    OnStackTrace(base::Time::Now(), process_id, data);
+  }
+
   // Creates and dispatches a heap alloc function call.
   void PlayHeapAllocCall(uint32_t process_id,
                          uint32_t thread_id,
@@ -220,6 +237,98 @@ TEST_F(MemReplayGrinderTest, CallBeforeName) {
   EXPECT_EQ(kRet, ha->trace_alloc());
 }
 
+TEST_F(MemReplayGrinderTest, UnrecognizedFunctionCallsAreDropped) {
+  static const char kDummyFunction[] = "DummyFunction";
+  TestMemReplayGrinder grinder;
+  ASSERT_TRUE(grinder.ParseCommandLine(&cmd_line_));
+
+  const HANDLE kHandle = reinterpret_cast<HANDLE>(0xDEADBEEF);
+  const LPVOID kRet = reinterpret_cast<LPVOID>(0xBAADF00D);
+
+  // Calls to a function whose name isn't known yet are pending, whether or
+  // not the function is supported.
+  grinder.PlayHeapAllocCall(1, 1, 0, 2, 0, kHandle, 0, 10, kRet);
+  grinder.PlayHeapAllocCall(1, 1, 1, 1, 0, kHandle, 0, 10, kRet);
+  auto proc_data = grinder.FindOrCreateProcessData(1);
+  EXPECT_EQ(2u, proc_data->pending_function_ids.size());
+  EXPECT_EQ(2u, proc_data->pending_calls.size());
+
+  // Once the names are known the calls to the unsupported function are
+  // dropped, and the others are parsed.
+  grinder.PlayFunctionNameTableEntry(1, 2, kDummyFunction);
+  EXPECT_EQ(1u, proc_data->pending_function_ids.size());
+  EXPECT_EQ(2u, proc_data->pending_calls.size());
+  grinder.PlayFunctionNameTableEntry(1, 1, kHeapAlloc);
+  EXPECT_TRUE(proc_data->pending_function_ids.empty());
+  EXPECT_TRUE(proc_data->pending_calls.empty());
+  EXPECT_FALSE(grinder.parse_error_);
+  auto thread_data = grinder.FindOrCreateThreadData(proc_data, 1);
+  EXPECT_EQ(1u, thread_data->plot_line->size());
+
+  // Later calls to the unsupported function don't become pending.
+  grinder.PlayHeapAllocCall(1, 1, 2, 2, 0, kHandle, 0, 10, kRet);
+  EXPECT_TRUE(proc_data->pending_calls.empty());
+  EXPECT_EQ(1u, thread_data->plot_line->size());
+  EXPECT_FALSE(grinder.parse_error_);
+}
+
+TEST_F(MemReplayGrinderTest, StackTraceAfterCall) {
+  TestMemReplayGrinder grinder;
+  ASSERT_TRUE(grinder.ParseCommandLine(&cmd_line_));
+
+  const HANDLE kHandle = reinterpret_cast<HANDLE>(0xDEADBEEF);
+  const uint32_t kStackTraceId = 0x1234;
+  grinder.PlayFunctionNameTableEntry(1, 1, kHeapAlloc);
+
+  // The call can refer to a stack trace that another thread has yet to emit.
+  grinder.PlayHeapAllocCall(1, 1, 0, 1, kStackTraceId, kHandle, 0, 8,
+                            nullptr);
+  auto proc_data = grinder.FindOrCreateProcessData(1);
+  EXPECT_EQ(1u, proc_data->stack_trace_ids.count(kStackTraceId));
+  EXPECT_TRUE(proc_data->stack_traces.empty());
+
+  std::vector<void*> frames;
+  frames.push_back(reinterpret_cast<void*>(0x1000));
+  frames.push_back(reinterpret_cast<void*>(0x2000));
+  grinder.PlayStackTrace(1, kStackTraceId, frames);
+  ASSERT_EQ(1u, proc_data->stack_traces.size());
+  const auto& stack_trace = proc_data->stack_traces[kStackTraceId];
+  ASSERT_EQ(2u, stack_trace.size());
+  EXPECT_EQ(frames[0], stack_trace[0]);
+  EXPECT_EQ(frames[1], stack_trace[1]);
+  EXPECT_FALSE(grinder.parse_error_);
+}
+
+TEST_F(MemReplayGrinderTest, SampledAllocationEstimates) {
+  TestMemReplayGrinder grinder;
+  cmd_line_.AppendSwitchASCII("sampling-interval", "1024");
+  ASSERT_TRUE(grinder.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(1024u, grinder.sampling_interval_);
+
+  const HANDLE kHandle = reinterpret_cast<HANDLE>(0xDEADBEEF);
+  const LPVOID kRet = reinterpret_cast<LPVOID>(0xBAADF00D);
+  grinder.PlayFunctionNameTableEntry(1, 1, kHeapAlloc);
+
+  // An allocation much larger than the interval is almost surely sampled,
+  // whereas a small one stands for many others.
+  grinder.PlayHeapAllocCall(1, 1, 0, 1, 0, kHandle, 0, 1024 * 1024, kRet);
+  auto proc_data = grinder.FindOrCreateProcessData(1);
+  EXPECT_DOUBLE_EQ(1.0, proc_data->estimated_allocation_count);
+  EXPECT_DOUBLE_EQ(1024.0 * 1024.0, proc_data->estimated_allocated_bytes);
+
+  grinder.PlayHeapAllocCall(1, 1, 1, 1, 0, kHandle, 0, 16, kRet);
+  double weight = 1.0 / (1.0 - std::exp(-16.0 / 1024.0));
+  EXPECT_NEAR(1.0 + weight, proc_data->estimated_allocation_count, 1e-6);
+  EXPECT_NEAR(1024.0 * 1024.0 + 16.0 * weight,
+              proc_data->estimated_allocated_bytes, 1e-6);
+}
+
+TEST_F(MemReplayGrinderTest, InvalidSamplingInterval) {
+  TestMemReplayGrinder grinder;
+  cmd_line_.AppendSwitchASCII("sampling-interval", "foo");
+  EXPECT_FALSE(grinder.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(MemReplayGrinderTest, GrindHarnessTrace) {
   TestMemReplayGrinder grinder;
   EXPECT_TRUE(grinder.ParseCommandLine(&cmd_line_));
@@ -14,6 +14,8 @@
 
 #include "syzygy/grinder/grinders/profile_grinder.h"
 
+#include <algorithm>
+
 #include "base/at_exit.h"
 #include "base/command_line.h"
 #include "base/strings/string_util.h"
@@ -58,6 +60,23 @@ bool ModuleInformationKeyLess(const ModuleInformation& a,
   return a.path < b.path;
 }
 
+// Finds the line containing @p address, which is the last line starting at or
+// before it.
+// @returns the line, or NULL if there is none.
+const LineInfo::SourceLine* FindLine(const LineInfo& line_info,
+                                     RVA address) {
+  const LineInfo::SourceLines& lines = line_info.source_lines();
+  LineInfo::SourceLines::const_iterator it = std::upper_bound(
+      lines.begin(), lines.end(), core::RelativeAddress(address),
+      [](core::RelativeAddress address, const LineInfo::SourceLine& line) {
+        return address < line.address;
+      });
+  if (it == lines.begin())
+    return NULL;
+  --it;
+  return &(*it);
+}
+
 }  // namespace
 
 ProfileGrinder::CodeLocation::CodeLocation()
@@ -136,12 +155,18 @@ ProfileGrinder::PartData::PartData()
 ProfileGrinder::ProfileGrinder()
     : parser_(NULL),
       modules_(ModuleInformationKeyLess),
+      thread_count_(1),
       thread_parts_(true) {
 }
 
 ProfileGrinder::~ProfileGrinder() {
 }
 
+void ProfileGrinder::set_thread_count(size_t thread_count) {
+  DCHECK_LT(0u, thread_count);
+  thread_count_ = thread_count;
+}
+
 bool ProfileGrinder::ParseCommandLine(const base::CommandLine* command_line) {
   thread_parts_ = command_line->HasSwitch("thread-parts");
   return true;
@@ -240,6 +265,34 @@ bool ProfileGrinder::GetSessionForModule(const ModuleInformation* module,
   return true;
 }
 
+const ProfileGrinder::ModuleSymbols* ProfileGrinder::GetSymbolsForModule(
+    const ModuleInformation* module) {
+  DCHECK(module != NULL);
+
+  ModuleSymbolsMap::const_iterator it = module_symbols_.find(module);
+  if (it != module_symbols_.end())
+    return it->second.get();
+
+  // As for the DIA sessions, failures are cached so that each module is only
+  // attempted once.
+  std::unique_ptr<ModuleSymbols> symbols(new ModuleSymbols());
+  base::FilePath module_path;
+  base::FilePath pdb_path;
+  if (!pe::FindModuleBySignature(*module, &module_path) ||
+      module_path.empty() ||
+      !symbols->functions.Init(module_path, thread_count_) ||
+      !pe::FindPdbForModule(module_path, &pdb_path) || pdb_path.empty() ||
+      !symbols->lines.Init(pdb_path)) {
+    LOG(INFO) << "Unable to read the function table of module \""
+              << module->path << "\", falling back to DIA.";
+    symbols.reset();
+  }
+
+  const ModuleSymbols* raw_symbols = symbols.get();
+  module_symbols_[module] = std::move(symbols);
+  return raw_symbols;
+}
+
 ProfileGrinder::PartData* ProfileGrinder::FindOrCreatePart(DWORD process_id,
                                                            DWORD thread_id) {
   if (!thread_parts_) {
@@ -416,6 +469,26 @@ bool ProfileGrinder::GetInfoForFunction(const FunctionLocation& function,
     return true;
   }
 
+  const ModuleSymbols* symbols = GetSymbolsForModule(function.module());
+  if (symbols != NULL) {
+    const FunctionTable::Function* function_info =
+        symbols->functions.Find(core::RelativeAddress(function.rva()));
+    if (function_info != NULL &&
+        function_info->address == core::RelativeAddress(function.rva())) {
+      *function_name = base::UTF8ToWide(function_info->name);
+      file_name->clear();
+      *line = 0;
+      const LineInfo::SourceLine* source_line =
+          FindLine(symbols->lines, function.rva());
+      if (source_line != NULL &&
+          source_line->address >= function_info->address) {
+        *file_name = base::UTF8ToWide(*source_line->source_file_name);
+        *line = source_line->line_number;
+      }
+      return true;
+    }
+  }
+
   ScopedComPtr<IDiaSession> session;
   if (!GetSessionForModule(function.module(), session.Receive()))
     return false;
@@ -501,7 +574,56 @@ bool ProfileGrinder::ResolveCallers() {
   return true;
 }
 
+void ProfileGrinder::ResolveCallersWithFunctionTables(
+    const PartData& part,
+    ResolvedCallerMap* callers) {
+  DCHECK(callers != NULL);
+
+  // Gather the callers by module.
+  typedef std::vector<const InvocationEdge*> Edges;
+  std::map<const ModuleInformation*, Edges> module_edges;
+  InvocationEdgeMap::const_iterator edge_it(part.edges_.begin());
+  for (; edge_it != part.edges_.end(); ++edge_it) {
+    const CallerLocation& caller = edge_it->second.caller;
+    if (caller.is_symbol() || caller.module() == NULL)
+      continue;
+    module_edges[caller.module()].push_back(&edge_it->second);
+  }
+
+  std::vector<core::RelativeAddress> addresses;
+  std::vector<const FunctionTable::Function*> functions;
+  for (const auto& module_edges_pair : module_edges) {
+    const ModuleSymbols* symbols =
+        GetSymbolsForModule(module_edges_pair.first);
+    if (symbols == NULL)
+      continue;
+
+    const Edges& edges = module_edges_pair.second;
+    addresses.clear();
+    for (const InvocationEdge* edge : edges)
+      addresses.push_back(core::RelativeAddress(edge->caller.rva()));
+    symbols->functions.FindAll(addresses, thread_count_, &functions);
+
+    for (size_t i = 0; i < edges.size(); ++i) {
+      if (functions[i] == NULL)
+        continue;
+
+      ResolvedCaller& resolved = (*callers)[edges[i]];
+      resolved.function.Set(module_edges_pair.first,
+                            functions[i]->address.value());
+      resolved.line = 0;
+      const LineInfo::SourceLine* line =
+          FindLine(symbols->lines, edges[i]->caller.rva());
+      if (line != NULL && line->address >= functions[i]->address)
+        resolved.line = line->line_number;
+    }
+  }
+}
+
 bool ProfileGrinder::ResolveCallersForPart(PartData* part) {
+  ResolvedCallerMap resolved_callers;
+  ResolveCallersWithFunctionTables(*part, &resolved_callers);
+
   // We start by iterating all the edges, connecting them up to their caller,
   // and subtracting the edge metric(s) to compute the inclusive metrics for
   // each function.
@@ -509,7 +631,18 @@ bool ProfileGrinder::ResolveCallersForPart(PartData* part) {
   for (; edge_it != part->edges_.end(); ++edge_it) {
     InvocationEdge& edge = edge_it->second;
     FunctionLocation function;
-    if (GetFunctionForCaller(edge.caller, &function, &edge.line)) {
+    bool resolved = false;
+    ResolvedCallerMap::const_iterator resolved_it =
+        resolved_callers.find(&edge);
+    if (resolved_it != resolved_callers.end()) {
+      function = resolved_it->second.function;
+      edge.line = resolved_it->second.line;
+      resolved = true;
+    } else {
+      resolved = GetFunctionForCaller(edge.caller, &function, &edge.line);
+    }
+
+    if (resolved) {
       InvocationNodeMap::iterator node_it(part->nodes_.find(function));
       if (node_it == part->nodes_.end()) {
         // This is a fringe node - e.g. this is a non-instrumented caller
@@ -549,22 +682,57 @@ bool ProfileGrinder::ResolveCallersForPart(PartData* part) {
   return true;
 }
 
+const ProfileGrinder::FunctionInfo* ProfileGrinder::GetCachedInfoForFunction(
+    const FunctionLocation& function, FunctionInfoMap* infos) {
+  DCHECK(infos != NULL);
+
+  FunctionInfoMap::const_iterator it = infos->find(function);
+  if (it != infos->end())
+    return &it->second;
+
+  std::wstring function_name;
+  std::wstring file_name;
+  size_t line = 0;
+  if (!GetInfoForFunction(function, &function_name, &file_name, &line))
+    return NULL;
+
+  // Rewrite file path to use forward slashes instead of back slashes.
+  base::ReplaceChars(file_name, L"\\", L"/", &file_name);
+
+  FunctionInfo& info = (*infos)[function];
+  info.function_name = base::WideToUTF8(function_name);
+  info.file_name = base::WideToUTF8(file_name);
+  info.line = line;
+  return &info;
+}
+
 bool ProfileGrinder::OutputData(FILE* file) {
-  // Output the file header.
+  // The names are compressed across the parts, as are the functions resolved.
+  CacheGrindNameCompressor names;
+  FunctionInfoMap infos;
 
+  // Each part is released once it's output, so that the memory held by the
+  // aggregated data shrinks as the file is written.
   bool succeeded = true;
   PartDataMap::iterator it = parts_.begin();
-  for (; it != parts_.end(); ++it) {
-    if (!OutputDataForPart(it->second, file)) {
+  while (it != parts_.end()) {
+    if (!OutputDataForPart(it->second, &names, &infos, file)) {
       // Keep going despite problems in output
       succeeded = false;
     }
+    parts_.erase(it++);
   }
 
   return succeeded;
 }
 
-bool ProfileGrinder::OutputDataForPart(const PartData& part, FILE* file) {
+bool ProfileGrinder::OutputDataForPart(const PartData& part,
+                                       CacheGrindNameCompressor* names,
+                                       FunctionInfoMap* infos,
+                                       FILE* file) {
+  DCHECK(names != NULL);
+  DCHECK(infos != NULL);
+
   // TODO(siggi): Output command line here.
   ::fprintf(file, "pid: %d\n", part.process_id_);
   if (part.thread_id_ != 0)
@@ -578,34 +746,33 @@ bool ProfileGrinder::OutputDataForPart(const PartData& part, FILE* file) {
   InvocationNodeMap::const_iterator node_it(part.nodes_.begin());
   for (; node_it != part.nodes_.end(); ++node_it) {
     const InvocationNode& node = node_it->second;
-    std::wstring function_name;
-    std::wstring file_name;
-    size_t line = 0;
-    if (GetInfoForFunction(node.function, &function_name, &file_name, &line)) {
-      // Rewrite file path to use forward slashes instead of back slashes.
-      base::ReplaceChars(file_name, L"\\", L"/", &file_name);
-
+    const FunctionInfo* info = GetCachedInfoForFunction(node.function, infos);
+    if (info != NULL) {
       // Output the function information.
-      ::fprintf(file, "fl=%ws\n", file_name.c_str());
-      ::fprintf(file, "fn=%ws\n", function_name.c_str());
-      ::fprintf(file, "%d %I64d %I64d %I64d %I64d\n", line,
+      std::string fl = names->Compress(CacheGrindNameCompressor::kFileName,
+                                       info->file_name);
+      std::string fn = names->Compress(CacheGrindNameCompressor::kFunctionName,
+                                       info->function_name);
+      ::fprintf(file, "fl=%s\n", fl.c_str());
+      ::fprintf(file, "fn=%s\n", fn.c_str());
+      ::fprintf(file, "%d %I64d %I64d %I64d %I64d\n", info->line,
                 node.metrics.num_calls, node.metrics.cycles_sum,
                 node.metrics.cycles_min, node.metrics.cycles_max);
 
       // Output the call information from this function.
       const InvocationEdge* call = node.first_call;
       for (; call != NULL; call = call->next_call) {
-        if (GetInfoForFunction(call->function,
-                               &function_name,
-                               &file_name,
-                               &line)) {
-
-          // Rewrite file path to use forward slashes instead of back slashes.
-          base::ReplaceChars(file_name, L"\\", L"/", &file_name);
-
-          ::fprintf(file, "cfl=%ws\n", file_name.c_str());
-          ::fprintf(file, "cfn=%ws\n", function_name.c_str());
-          ::fprintf(file, "calls=%lld %d\n", call->metrics.num_calls, line);
+        const FunctionInfo* callee =
+            GetCachedInfoForFunction(call->function, infos);
+        if (callee != NULL) {
+          std::string cfl = names->Compress(
+              CacheGrindNameCompressor::kFileName, callee->file_name);
+          std::string cfn = names->Compress(
+              CacheGrindNameCompressor::kFunctionName, callee->function_name);
+          ::fprintf(file, "cfl=%s\n", cfl.c_str());
+          ::fprintf(file, "cfn=%s\n", cfn.c_str());
+          ::fprintf(file, "calls=%lld %d\n", call->metrics.num_calls,
+                    callee->line);
           ::fprintf(file, "%d %I64d %I64d %I64d %I64d\n", call->line,
                     call->metrics.num_calls, call->metrics.cycles_sum,
                     call->metrics.cycles_min, call->metrics.cycles_max);
@@ -628,9 +795,17 @@ void ProfileGrinder::OnInvocationBatch(base::Time time,
   PartData* part = FindOrCreatePart(process_id, thread_id);
   DCHECK(data != NULL);
 
+  // The invocations of a sampled thread stand for sampling_interval times as
+  // many calls each.
+  uint32_t sampling_interval = 1;
+  auto sampling_it =
+      sampling_intervals_.find(PartKey(process_id, thread_id));
+  if (sampling_it != sampling_intervals_.end())
+    sampling_interval = sampling_it->second;
+
   // Process and aggregate the individual invocation entries.
   for (size_t i = 0; i < num_invocations; ++i) {
-    const InvocationInfo& info = data->invocations[i];
+    InvocationInfo info = data->invocations[i];
     if (info.caller == NULL || info.function == NULL) {
       // This may happen due to a termination race when the traces are captured.
       LOG(WARNING) << "Empty invocation record. Record " << i << " of " <<
@@ -661,6 +836,10 @@ void ProfileGrinder::OnInvocationBatch(base::Time time,
       ConvertToModuleRVA(process_id, caller_addr, &caller);
     }
 
+    // The extremes of the sampled calls are the best estimates there are.
+    info.num_calls *= sampling_interval;
+    info.cycles_sum *= sampling_interval;
+
     AggregateEntryToPart(function, caller, info, part);
   }
 }
@@ -684,6 +863,19 @@ void ProfileGrinder::OnDynamicSymbol(DWORD process_id,
   dynamic_symbols_[key].assign(symbol_name.begin(), symbol_name.end());
 }
 
+void ProfileGrinder::OnInvocationSampling(base::Time time,
+                                          DWORD process_id,
+                                          DWORD thread_id,
+                                          const TraceInvocationSampling* data) {
+  DCHECK(data != NULL);
+
+  PartKey key(process_id, thread_id);
+  if (data->sampling_interval > 1)
+    sampling_intervals_[key] = data->sampling_interval;
+  else
+    sampling_intervals_.erase(key);
+}
+
 void ProfileGrinder::AggregateEntryToPart(const FunctionLocation& function,
                                           const CallerLocation& caller,
                                           const InvocationInfo& info,
@@ -17,10 +17,15 @@
 #include <dia2.h>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <string>
 
 #include "base/files/file_path.h"
 #include "base/win/scoped_comptr.h"
+#include "syzygy/grinder/cache_grind_writer.h"
+#include "syzygy/grinder/function_table.h"
 #include "syzygy/grinder/grinder.h"
+#include "syzygy/grinder/line_info.h"
 
 namespace grinder {
 namespace grinders {
@@ -56,6 +61,12 @@ typedef uint32_t RVA;
 // summing up the cost of the incoming edges, and subtracting the cost of the
 // outgoing edges.
 //
+// Functions and lines are resolved from a table of the functions of each
+// module, read from the native symbol streams of its PDB, with the lines of the
+// module. The callers are looked up in those tables in batches. DIA is only
+// used for the modules whose tables can't be built, and for the addresses that
+// aren't in any function of the tables.
+//
 // For information on the KCacheGrind file format, see:
 // http://kcachegrind.sourceforge.net/cgi-bin/show.cgi/KcacheGrindCalltreeFormat
 class ProfileGrinder : public GrinderInterface {
@@ -69,10 +80,13 @@ class ProfileGrinder : public GrinderInterface {
   // separate parts for each thread seen in the trace file(s).
   bool thread_parts() const { return thread_parts_; }
   void set_thread_parts(bool thread_parts) { thread_parts_ = thread_parts; }
+  // The number of threads the function tables are read and looked up with.
+  size_t thread_count() const { return thread_count_; }
   // @}
 
   // @name GrinderInterface implementation.
   // @{
+  void set_thread_count(size_t thread_count) override;
   bool ParseCommandLine(const base::CommandLine* command_line) override;
   void SetParser(Parser* parser) override;
   bool Grind() override;
@@ -93,6 +107,10 @@ class ProfileGrinder : public GrinderInterface {
   void OnDynamicSymbol(DWORD process_id,
                        uint32_t symbol_id,
                        const base::StringPiece& symbol_name) override;
+  void OnInvocationSampling(base::Time time,
+                            DWORD process_id,
+                            DWORD thread_id,
+                            const TraceInvocationSampling* data) override;
   // @}
 
  protected:
@@ -113,6 +131,9 @@ class ProfileGrinder : public GrinderInterface {
   struct InvocationNode;
   struct InvocationEdge;
 
+  // The function and line tables of a module.
+  struct ModuleSymbols;
+
   // The key to the dynamic symbol map i
   typedef std::pair<uint32_t, uint32_t> DynamicSymbolKey;
   typedef std::map<DynamicSymbolKey, std::string> DynamicSymbolMap;
@@ -125,10 +146,43 @@ class ProfileGrinder : public GrinderInterface {
 
   typedef base::win::ScopedComPtr<IDiaSession> SessionPtr;
   typedef std::map<const ModuleInformation*, SessionPtr> ModuleSessionMap;
+  typedef std::map<const ModuleInformation*, std::unique_ptr<ModuleSymbols>>
+      ModuleSymbolsMap;
+
+  // The functions and lines of the callers resolved with the function tables.
+  struct ResolvedCaller;
+  typedef std::map<const InvocationEdge*, ResolvedCaller> ResolvedCallerMap;
+
+  // The names and line of a function, as they're output. These are cached
+  // while a part is output, as the same few functions are called from many
+  // places.
+  struct FunctionInfo {
+    FunctionInfo() : line(0) {}
+
+    std::string function_name;
+    std::string file_name;
+    size_t line;
+  };
+  typedef std::map<FunctionLocation, FunctionInfo> FunctionInfoMap;
 
   bool GetSessionForModule(const ModuleInformation* module,
                            IDiaSession** session_out);
 
+  // Gets the function and line tables of a module, reading them the first
+  // time.
+  // @param module The module whose tables are to be returned.
+  // @returns the tables, or NULL if they couldn't be read. The failure is
+  //     cached, so that it is only reported once.
+  const ModuleSymbols* GetSymbolsForModule(const ModuleInformation* module);
+
+  // Resolves the callers of the edges of @p part that have a function table,
+  // in a batch per module.
+  // @param part The part whose callers are to be resolved.
+  // @param callers Receives the callers that were resolved. The others have
+  //     to be resolved with DIA.
+  void ResolveCallersWithFunctionTables(const PartData& part,
+                                        ResolvedCallerMap* callers);
+
   // Finds or creates the part data for the given @p thread_id.
   PartData* FindOrCreatePart(DWORD process_id, DWORD thread_id);
 
@@ -153,6 +207,13 @@ class ProfileGrinder : public GrinderInterface {
                           std::wstring* file_name,
                           size_t* line);
 
+  // Gets the information of a function, resolving it the first time.
+  // @param function The function whose information is to be returned.
+  // @param infos The information of the functions resolved so far.
+  // @returns the information, or NULL if the function can't be resolved.
+  const FunctionInfo* GetCachedInfoForFunction(const FunctionLocation& function,
+                                               FunctionInfoMap* infos);
+
   // Converts an absolute address to an RVA.
   void ConvertToModuleRVA(uint32_t process_id,
                           trace::parser::AbsoluteAddress64 addr,
@@ -173,7 +234,15 @@ class ProfileGrinder : public GrinderInterface {
   bool ResolveCallersForPart(PartData* part);
 
   // Outputs data for @p part to @p file.
-  bool OutputDataForPart(const PartData& part, FILE* file);
+  // @param part The part to output.
+  // @param names The compressor of the names output so far.
+  // @param infos The information of the functions resolved so far.
+  // @param file The file to output to.
+  // @returns true on success, false otherwise.
+  bool OutputDataForPart(const PartData& part,
+                         CacheGrindNameCompressor* names,
+                         FunctionInfoMap* infos,
+                         FILE* file);
 
   // Keeps track of the dynamic symbols seen.
   DynamicSymbolMap dynamic_symbols_;
@@ -184,6 +253,13 @@ class ProfileGrinder : public GrinderInterface {
   // Stores the DIA session objects we have going for each module.
   ModuleSessionMap module_sessions_;
 
+  // Stores the function and line tables of each module, or NULL for the
+  // modules whose tables couldn't be read.
+  ModuleSymbolsMap module_symbols_;
+
+  // The number of threads the function tables are read and looked up with.
+  size_t thread_count_;
+
   // The parts we store. If thread_parts_ is false, we store only a single
   // part with id 0. The parts are keyed on process id/thread id.
   typedef std::pair<uint32_t, uint32_t> PartKey;
@@ -192,6 +268,16 @@ class ProfileGrinder : public GrinderInterface {
 
   // If true, data is aggregated and output per-thread.
   bool thread_parts_;
+
+  // The sampling intervals of the threads whose invocations are sampled,
+  // keyed on process id/thread id. The invocations of the other threads
+  // are all recorded.
+  std::map<PartKey, uint32_t> sampling_intervals_;
+};
+
+struct ProfileGrinder::ModuleSymbols {
+  FunctionTable functions;
+  LineInfo lines;
 };
 
 // The data we store for each part.
@@ -291,6 +377,11 @@ struct ProfileGrinder::FunctionLocation : public ProfileGrinder::CodeLocation {
 struct ProfileGrinder::CallerLocation : public ProfileGrinder::CodeLocation {
 };
 
+struct ProfileGrinder::ResolvedCaller {
+  FunctionLocation function;
+  size_t line;
+};
+
 // The metrics we capture per function and per caller.
 struct ProfileGrinder::Metrics {
   Metrics() : num_calls(0), cycles_min(0), cycles_max(0), cycles_sum(0) {
@@ -33,6 +33,8 @@ class TestProfileGrinder : public ProfileGrinder {
   using ProfileGrinder::FunctionLocation;
   using ProfileGrinder::PartData;
   using ProfileGrinder::FindOrCreatePart;
+  using ProfileGrinder::GetSymbolsForModule;
+  using ProfileGrinder::ModuleSymbols;
 
   typedef ProfileGrinder::InvocationNodeMap InvocationNodeMap;
 
@@ -80,6 +82,9 @@ class ProfileGrinderTest : public testing::PELibUnitTest {
     EXPECT_TRUE(grinder.OutputData(output_file.get()));
     output_file.reset();
 
+    // The parts are released as they're output.
+    EXPECT_TRUE(grinder.parts_.empty());
+
     int64_t cache_grind_file_size = 0;
     ASSERT_TRUE(base::GetFileSize(output_path.path(),
                                   &cache_grind_file_size));
@@ -206,6 +211,32 @@ TEST_F(ProfileGrinderTest, GrindSymbolTestData) {
   EXPECT_EQ(kCallerSymbolId, it->first.symbol_id());
 }
 
+TEST_F(ProfileGrinderTest, GrindSampledInvocations) {
+  TestProfileGrinder grinder;
+  IssueSetupEvents(&grinder);
+
+  // The invocations of a sampled thread are scaled by the sampling interval.
+  TraceInvocationSampling sampling = {16};
+  grinder.OnInvocationSampling(base::Time::Now(),
+                               ::GetCurrentProcessId(),
+                               ::GetCurrentThreadId(),
+                               &sampling);
+  IssueSymbolInvocationEvent(&grinder);
+  ASSERT_TRUE(grinder.Grind());
+
+  TestProfileGrinder::PartData* part =
+      grinder.FindOrCreatePart(::GetCurrentProcessId(),
+                               ::GetCurrentThreadId());
+  ASSERT_TRUE(part != NULL);
+  TestProfileGrinder::InvocationNodeMap::iterator it = part->nodes_.begin();
+  ASSERT_TRUE(it != part->nodes_.end());
+  EXPECT_EQ(kFunctionSymbolId, it->first.symbol_id());
+  EXPECT_EQ(16 * 1000u, it->second.metrics.num_calls);
+  EXPECT_EQ(16 * 1000 * 100u, it->second.metrics.cycles_sum);
+  EXPECT_EQ(10u, it->second.metrics.cycles_min);
+  EXPECT_EQ(1000u, it->second.metrics.cycles_max);
+}
+
 TEST_F(ProfileGrinderTest, ParseEmptyCommandLineSucceeds) {
   TestProfileGrinder grinder;
   EXPECT_TRUE(grinder.ParseCommandLine(&cmd_line_));
@@ -218,6 +249,32 @@ TEST_F(ProfileGrinderTest, ParseThreadPartsSwitchOnCommandLine) {
   EXPECT_TRUE(grinder.ParseCommandLine(&cmd_line_));
 }
 
+TEST_F(ProfileGrinderTest, SetThreadCount) {
+  TestProfileGrinder grinder;
+  EXPECT_EQ(1u, grinder.thread_count());
+  grinder.set_thread_count(4);
+  EXPECT_TRUE(grinder.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(4u, grinder.thread_count());
+}
+
+TEST_F(ProfileGrinderTest, GetSymbolsForModule) {
+  pe::PEFile image;
+  ASSERT_TRUE(image.Init(
+      testing::GetExeTestDataRelativePath(testing::kTestDllName)));
+  pe::ModuleInformation module;
+  image.GetSignature(&module);
+
+  TestProfileGrinder grinder;
+  const TestProfileGrinder::ModuleSymbols* symbols =
+      grinder.GetSymbolsForModule(&module);
+  ASSERT_TRUE(symbols != NULL);
+  EXPECT_FALSE(symbols->functions.functions().empty());
+  EXPECT_FALSE(symbols->lines.source_lines().empty());
+
+  // The tables are only read once.
+  EXPECT_EQ(symbols, grinder.GetSymbolsForModule(&module));
+}
+
 TEST_F(ProfileGrinderTest, SetParserSucceeds) {
   TestProfileGrinder grinder;
   grinder.ParseCommandLine(&cmd_line_);
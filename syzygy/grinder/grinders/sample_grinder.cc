@@ -14,6 +14,8 @@
 
 #include "syzygy/grinder/grinders/sample_grinder.h"
 
+#include <set>
+
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
 #include "syzygy/block_graph/basic_block_decomposer.h"
@@ -57,6 +59,86 @@ size_t IntersectionSize(const Range& range,
   return right - left;
 }
 
+// Distributes the samples in @p buckets, which start at @p bucket_start and
+// each span @p bucket_size bytes, to the intersecting ranges of a
+// @p heat_map. Returns the total weight of the orphaned samples, and the
+// total weight of all the samples in @p total_samples.
+double IncrementHeatMapFromBuckets(const core::RelativeAddress& bucket_start,
+                                   size_t bucket_size,
+                                   const std::vector<double>& buckets,
+                                   HeatMap* heat_map,
+                                   double* total_samples) {
+  DCHECK(heat_map != NULL);
+  DCHECK(total_samples != NULL);
+
+  double orphaned_samples = 0.0;
+  double temp_total_samples = 0.0;
+
+  // We walk through the sample buckets, and for each one we find the range of
+  // heat map entries that intersect with it. We then divide up the heat to
+  // each of these ranges in proportion to the size of their intersection.
+  core::RelativeAddress rva_bucket(bucket_start);
+  HeatMap::iterator it = heat_map->begin();
+  size_t i = 0;
+  for (; i < buckets.size(); ++i) {
+    // Advance the current heat map range as long as it's strictly to the left
+    // of the current bucket.
+    while (it != heat_map->end() && it->first.end() <= rva_bucket)
+      ++it;
+    if (it == heat_map->end())
+      break;
+
+    // If the current heat map range is strictly to the right of the current
+    // bucket then those samples have nowhere to be distributed.
+    if (rva_bucket + bucket_size <= it->first.start()) {
+      // Tally them up as orphaned samples.
+      orphaned_samples += buckets[i];
+    } else {
+      // Otherwise we heat map ranges that overlap the current bucket.
+
+      // Advance the current heat map range until we're strictly to the right
+      // of the current bucket.
+      HeatMap::iterator it_end = it;
+      ++it_end;
+      while (it_end != heat_map->end() &&
+          it_end->first.start() < rva_bucket + bucket_size) {
+        ++it_end;
+      }
+
+      // Find the total size of the intersections, to be used as a scaling
+      // value for distributing the samples. This is done so that *all* of the
+      // samples are distributed, as the bucket may span space that is not
+      // covered by any heat map ranges.
+      size_t total_intersection = 0;
+      for (HeatMap::iterator it2 = it; it2 != it_end; ++it2) {
+        total_intersection += IntersectionSize(it2->first,
+            rva_bucket, bucket_size);
+      }
+
+      // Now distribute the samples to the various ranges.
+      for (HeatMap::iterator it2 = it; it2 != it_end; ++it2) {
+        size_t intersection = IntersectionSize(it2->first,
+            rva_bucket, bucket_size);
+        it2->second.heat += intersection * buckets[i] / total_intersection;
+      }
+    }
+
+    // Advance past the current bucket.
+    temp_total_samples += buckets[i];
+    rva_bucket += bucket_size;
+  }
+
+  // Pick up any trailing orphaned buckets.
+  for (; i < buckets.size(); ++i) {
+    orphaned_samples += buckets[i];
+    temp_total_samples += buckets[i];
+  }
+
+  *total_samples = temp_total_samples;
+
+  return orphaned_samples;
+}
+
 bool BuildHeatMapForCodeBlock(const pe::PETransformPolicy& policy,
                               const Range& block_range,
                               const BlockGraph::Block* block,
@@ -300,16 +382,23 @@ struct HeatNamePairComparator {
 
 // Output the given @p name_heat_map to the given @p file in CSV format.
 // The column header that is output will depend on the @p aggregation_level.
-bool OutputNameHeatMap(SampleGrinder::AggregationLevel aggregation_level,
-                       const SampleGrinder::NameHeatMap& name_heat_map,
-                       FILE* file) {
+// If @p inclusive_name_heat_map is not empty its heat is output in a second
+// column.
+bool OutputNameHeatMap(
+    SampleGrinder::AggregationLevel aggregation_level,
+    const SampleGrinder::NameHeatMap& name_heat_map,
+    const SampleGrinder::NameHeatMap& inclusive_name_heat_map,
+    FILE* file) {
   DCHECK(aggregation_level == SampleGrinder::kCompiland ||
          aggregation_level == SampleGrinder::kFunction);
   const char* name = "Compiland";
   if (aggregation_level == SampleGrinder::kFunction)
     name = "Function";
-  if (::fprintf(file, "%s, Heat\n", name) <= 0)
+  bool inclusive = !inclusive_name_heat_map.empty();
+  if (::fprintf(file, "%s, Heat%s\n", name,
+                inclusive ? ", InclusiveHeat" : "") <= 0) {
     return false;
+  }
 
   std::vector<HeatNamePair> heat_name_pairs;
   heat_name_pairs.reserve(name_heat_map.size());
@@ -319,14 +408,33 @@ bool OutputNameHeatMap(SampleGrinder::AggregationLevel aggregation_level,
     heat_name_pairs.push_back(HeatNamePair(it->second, it->first));
   }
 
+  // Names that were only ever seen as callers have no heat of their own.
+  it = inclusive_name_heat_map.begin();
+  for (; it != inclusive_name_heat_map.end(); ++it) {
+    if (name_heat_map.find(it->first) == name_heat_map.end())
+      heat_name_pairs.push_back(HeatNamePair(0.0, it->first));
+  }
+
   std::sort(heat_name_pairs.begin(),
             heat_name_pairs.end(),
             HeatNamePairComparator());
 
   for (size_t i = 0; i < heat_name_pairs.size(); ++i) {
     const HeatNamePair& hnp = heat_name_pairs[i];
-    if (::fprintf(file, "%s, %.10e\n", hnp.second->c_str(), hnp.first) <= 0)
+    if (!inclusive) {
+      if (::fprintf(file, "%s, %.10e\n", hnp.second->c_str(), hnp.first) <= 0)
+        return false;
+      continue;
+    }
+
+    double inclusive_heat = 0.0;
+    it = inclusive_name_heat_map.find(hnp.second);
+    if (it != inclusive_name_heat_map.end())
+      inclusive_heat = it->second;
+    if (::fprintf(file, "%s, %.10e, %.10e\n", hnp.second->c_str(), hnp.first,
+                  inclusive_heat) <= 0) {
       return false;
+    }
   }
 
   return true;
@@ -417,11 +525,14 @@ bool SampleGrinder::Grind() {
   }
 
   // Process each module.
-  ModuleDataMap::const_iterator mod_it = module_data_.begin();
+  ModuleDataMap::iterator mod_it = module_data_.begin();
   for (; mod_it != module_data_.end(); ++mod_it) {
     LOG(INFO) << "Processing aggregate samples for module \""
               << mod_it->second.module_path.value() << "\".";
 
+    // Use the hot code profiled at a finer resolution, if any.
+    ApplyRefinements(&mod_it->second);
+
     // Build an empty heat map. How exactly we do this depends on the
     // aggregation mode.
     bool empty_heat_map_built = false;
@@ -460,6 +571,8 @@ bool SampleGrinder::Grind() {
       LOG(INFO) << "Rolling up basic-block heat to \""
                 << kAggregationLevelNames[aggregation_level_] << "\" level.";
       RollUpByName(aggregation_level_, heat_map_, &name_heat_map_);
+      RollUpStacksByName(aggregation_level_, heat_map_, mod_it->second.stacks,
+                         &inclusive_name_heat_map_);
       // We can clear the heat map as it was only needed as an intermediate.
       heat_map_.Clear();
     } else if (aggregation_level_ == kLine) {
@@ -486,7 +599,8 @@ bool SampleGrinder::OutputData(FILE* file) {
              aggregation_level_ == kCompiland) {
     // If we've aggregated by function or compiland then output the data in
     // the NameHeatMap.
-    success = OutputNameHeatMap(aggregation_level_, name_heat_map_, file);
+    success = OutputNameHeatMap(aggregation_level_, name_heat_map_,
+                                inclusive_name_heat_map_, file);
   } else {
     // Otherwise, we're aggregating to lines and we output cache-grind formatted
     // line-info data.
@@ -550,6 +664,14 @@ void SampleGrinder::OnSampleData(base::Time Time,
   ModuleData* module_data = GetModuleData(
       base::FilePath(module_info->path), data);
 
+  // Refinements only tell how the samples of the module are distributed over
+  // the hot code, so they are kept apart from the running totals.
+  if (IsRefinement(data, *module_data)) {
+    if (!IncrementRefinementData(clock_rate_, data, module_data))
+      LOG(WARNING) << "Skipping inconsistent refinement sample data.";
+    return;
+  }
+
   LOG(INFO) << "Aggregating sample info for module \""
             << module_data->module_path.value() << "\".";
 
@@ -564,6 +686,55 @@ void SampleGrinder::OnSampleData(base::Time Time,
   return;
 }
 
+void SampleGrinder::OnSampleStack(base::Time time,
+                                  DWORD process_id,
+                                  const TraceSampleStack* data) {
+  DCHECK(data != NULL);
+
+  if (clock_rate_ <= 0.0) {
+    LOG(ERROR) << "Encountered a TraceSampleStack record without a clock rate.";
+    event_handler_errored_ = true;
+    return;
+  }
+  double seconds = data->sample_count * data->sampling_interval / clock_rate_;
+
+  // Split the stack by module. Only the modules the sample data was written
+  // for are of interest, which are those that passed the image filter.
+  std::map<ModuleData*, StackAddresses> module_stacks;
+  for (size_t i = 0; i < data->num_frames; ++i) {
+    uint32_t address = reinterpret_cast<uint32_t>(data->frames[i]);
+
+    // All frames but the innermost are return addresses, which point past the
+    // call instruction and possibly into the next function.
+    if (i > 0)
+      --address;
+
+    const ModuleInformation* module_info = parser_->GetModuleInformation(
+        process_id, AbsoluteAddress64(address));
+    if (module_info == NULL)
+      continue;
+
+    ModuleKey key = { module_info->module_size,
+                      module_info->module_checksum,
+                      module_info->module_time_date_stamp };
+    ModuleDataMap::iterator it = module_data_.find(key);
+    if (it == module_data_.end())
+      continue;
+
+    module_stacks[&it->second].push_back(core::RelativeAddress(
+        address - static_cast<uint32_t>(module_info->base_address.value())));
+  }
+
+  // A recursive function only counts once per stack.
+  for (auto& module_stack : module_stacks) {
+    StackAddresses& addresses = module_stack.second;
+    std::sort(addresses.begin(), addresses.end());
+    addresses.erase(std::unique(addresses.begin(), addresses.end()),
+                    addresses.end());
+    module_stack.first->stacks[addresses] += seconds;
+  }
+}
+
 SampleGrinder::ModuleData* SampleGrinder::GetModuleData(
     const base::FilePath& module_path,
     const TraceSampleData* sample_data) {
@@ -627,6 +798,111 @@ void SampleGrinder::UpsampleModuleData(
   return;
 }
 
+bool SampleGrinder::IsRefinement(const TraceSampleData* sample_data,
+                                 const SampleGrinder::ModuleData& module_data) {
+  DCHECK(sample_data != NULL);
+
+  // The first sample data of a module always covers all of it.
+  if (module_data.bucket_size == 0)
+    return false;
+
+  // Sample data of the whole module spans the same range as the aggregate
+  // buckets, modulo the rounding of the ends to the bucket sizes. Refinements
+  // never span a whole module.
+  uint32_t start = GetBucketStart(sample_data).value();
+  uint32_t end = start + sample_data->bucket_size * sample_data->bucket_count;
+  uint32_t module_start = module_data.bucket_start.value();
+  uint32_t module_end = module_start +
+      module_data.bucket_size * module_data.buckets.size();
+  uint32_t rounding = std::max(sample_data->bucket_size,
+                               module_data.bucket_size);
+  return start != module_start || end + rounding <= module_end;
+}
+
+bool SampleGrinder::IncrementRefinementData(
+    double clock_rate,
+    const TraceSampleData* sample_data,
+    SampleGrinder::ModuleData* module_data) {
+  DCHECK_LT(0.0, clock_rate);
+  DCHECK(sample_data != NULL);
+  DCHECK(module_data != NULL);
+  DCHECK(common::IsPowerOfTwo(sample_data->bucket_size));
+
+  Range range(GetBucketStart(sample_data),
+              sample_data->bucket_size * sample_data->bucket_count);
+  RefinementData& refinement = module_data->refinements[range];
+  if (refinement.bucket_size == 0) {
+    refinement.bucket_size = sample_data->bucket_size;
+    refinement.buckets.resize(sample_data->bucket_count);
+  }
+
+  // Refinements of the same range are only merged at the same resolution.
+  if (refinement.bucket_size != sample_data->bucket_size) {
+    LOG(ERROR) << "TraceSampleData has an inconsistent refinement bucket size.";
+    return false;
+  }
+  DCHECK_EQ(refinement.buckets.size(), sample_data->bucket_count);
+
+  double seconds = static_cast<double>(sample_data->sampling_interval) /
+      clock_rate;
+  for (size_t i = 0; i < sample_data->bucket_count; ++i)
+    refinement.buckets[i] += sample_data->buckets[i] * seconds;
+
+  return true;
+}
+
+void SampleGrinder::ApplyRefinements(SampleGrinder::ModuleData* module_data) {
+  DCHECK(module_data != NULL);
+
+  uint32_t module_start = module_data->bucket_start.value();
+  uint32_t module_bucket_size = module_data->bucket_size;
+  std::vector<double>& module_buckets = module_data->buckets;
+
+  ModuleData::RefinementMap::iterator ref_it =
+      module_data->refinements.begin();
+  for (; ref_it != module_data->refinements.end(); ++ref_it) {
+    const Range& range = ref_it->first;
+    RefinementData& refinement = ref_it->second;
+    std::vector<double> weights(refinement.buckets.size(), 0.0);
+
+    // The refinement has nothing to add if it is no finer than the aggregate
+    // buckets, which may have been upsampled since it was recorded.
+    if (refinement.bucket_size < module_bucket_size &&
+        range.start().value() >= module_start) {
+      size_t factor = module_bucket_size / refinement.bucket_size;
+      uint32_t offset = range.start().value() - module_start;
+
+      // Only the aggregate buckets that are fully covered by the refinement
+      // can be redistributed.
+      size_t first = (offset + module_bucket_size - 1) / module_bucket_size;
+      size_t last = std::min<size_t>(
+          (offset + range.size()) / module_bucket_size, module_buckets.size());
+      for (size_t i = first; i < last; ++i) {
+        size_t j = (i * module_bucket_size - offset) / refinement.bucket_size;
+        DCHECK_LE(j + factor, refinement.buckets.size());
+
+        double total = 0.0;
+        for (size_t k = 0; k < factor; ++k)
+          total += refinement.buckets[j + k];
+
+        // Without refined samples there is nothing to go by, so the samples
+        // stay where they are.
+        if (total == 0.0)
+          continue;
+
+        double scale = module_buckets[i] / total;
+        for (size_t k = 0; k < factor; ++k)
+          weights[j + k] = refinement.buckets[j + k] * scale;
+        module_buckets[i] = 0.0;
+      }
+    }
+
+    // Overlapping refinements do not see the samples already moved by those
+    // before them, so no sample is counted twice.
+    refinement.buckets.swap(weights);
+  }
+}
+
 // Increments the module data with the given sample data. Returns false and
 // logs if this is not possible due to invalid data.
 bool SampleGrinder::IncrementModuleData(
@@ -694,68 +970,21 @@ double SampleGrinder::IncrementHeatMapFromModuleData(
     double* total_samples) {
   DCHECK(heat_map != NULL);
 
-  double orphaned_samples = 0.0;
   double temp_total_samples = 0.0;
-
-  // We walk through the sample buckets, and for each one we find the range of
-  // heat map entries that intersect with it. We then divide up the heat to
-  // each of these ranges in proportion to the size of their intersection.
-  core::RelativeAddress rva_bucket(module_data.bucket_start);
-  HeatMap::iterator it = heat_map->begin();
-  size_t i = 0;
-  for (; i < module_data.buckets.size(); ++i) {
-    // Advance the current heat map range as long as it's strictly to the left
-    // of the current bucket.
-    while (it != heat_map->end() && it->first.end() <= rva_bucket)
-      ++it;
-    if (it == heat_map->end())
-      break;
-
-    // If the current heat map range is strictly to the right of the current
-    // bucket then those samples have nowhere to be distributed.
-    if (rva_bucket + module_data.bucket_size <= it->first.start()) {
-      // Tally them up as orphaned samples.
-      orphaned_samples += module_data.buckets[i];
-    } else {
-      // Otherwise we heat map ranges that overlap the current bucket.
-
-      // Advance the current heat map range until we're strictly to the right
-      // of the current bucket.
-      HeatMap::iterator it_end = it;
-      ++it_end;
-      while (it_end != heat_map->end() &&
-          it_end->first.start() < rva_bucket + module_data.bucket_size) {
-        ++it_end;
-      }
-
-      // Find the total size of the intersections, to be used as a scaling
-      // value for distributing the samples. This is done so that *all* of the
-      // samples are distributed, as the bucket may span space that is not
-      // covered by any heat map ranges.
-      size_t total_intersection = 0;
-      for (HeatMap::iterator it2 = it; it2 != it_end; ++it2) {
-        total_intersection += IntersectionSize(it2->first,
-            rva_bucket, module_data.bucket_size);
-      }
-
-      // Now distribute the samples to the various ranges.
-      for (HeatMap::iterator it2 = it; it2 != it_end; ++it2) {
-        size_t intersection = IntersectionSize(it2->first,
-            rva_bucket, module_data.bucket_size);
-        it2->second.heat += intersection * module_data.buckets[i] /
-            total_intersection;
-      }
-    }
-
-    // Advance past the current bucket.
-    temp_total_samples += module_data.buckets[i];
-    rva_bucket += module_data.bucket_size;
-  }
-
-  // Pick up any trailing orphaned buckets.
-  for (; i < module_data.buckets.size(); ++i) {
-    orphaned_samples += module_data.buckets[i];
-    temp_total_samples += module_data.buckets[i];
+  double orphaned_samples = IncrementHeatMapFromBuckets(
+      module_data.bucket_start, module_data.bucket_size, module_data.buckets,
+      heat_map, &temp_total_samples);
+
+  // The samples that were moved to refinements are distributed at their finer
+  // resolution.
+  ModuleData::RefinementMap::const_iterator ref_it =
+      module_data.refinements.begin();
+  for (; ref_it != module_data.refinements.end(); ++ref_it) {
+    double refinement_samples = 0.0;
+    orphaned_samples += IncrementHeatMapFromBuckets(
+        ref_it->first.start(), ref_it->second.bucket_size,
+        ref_it->second.buckets, heat_map, &refinement_samples);
+    temp_total_samples += refinement_samples;
   }
 
   if (total_samples != NULL)
@@ -782,6 +1011,36 @@ void SampleGrinder::RollUpByName(AggregationLevel aggregation_level,
   }
 }
 
+void SampleGrinder::RollUpStacksByName(AggregationLevel aggregation_level,
+                                       const HeatMap& heat_map,
+                                       const StackHeatMap& stack_heat_map,
+                                       NameHeatMap* name_heat_map) {
+  DCHECK(aggregation_level == kFunction || aggregation_level == kCompiland);
+  DCHECK(name_heat_map != NULL);
+
+  std::set<const std::string*> names;
+  StackHeatMap::const_iterator stack_it = stack_heat_map.begin();
+  for (; stack_it != stack_heat_map.end(); ++stack_it) {
+    names.clear();
+    const StackAddresses& addresses = stack_it->first;
+    for (size_t i = 0; i < addresses.size(); ++i) {
+      HeatMap::const_iterator it =
+          heat_map.FindContaining(Range(addresses[i], 1));
+      if (it == heat_map.end())
+        continue;
+
+      const std::string* name = it->second.function;
+      if (aggregation_level == kCompiland)
+        name = it->second.compiland;
+      names.insert(name);
+    }
+
+    std::set<const std::string*>::const_iterator name_it = names.begin();
+    for (; name_it != names.end(); ++name_it)
+      (*name_heat_map)[*name_it] += stack_it->second;
+  }
+}
+
 bool SampleGrinder::ModuleKey::operator<(
     const ModuleKey& rhs) const {
   if (module_size < rhs.module_size)
@@ -68,6 +68,10 @@ class SampleGrinder : public GrinderInterface {
   virtual void OnSampleData(base::Time Time,
                             DWORD process_id,
                             const TraceSampleData* data) override;
+  // Override of the OnSampleStack callback.
+  virtual void OnSampleStack(base::Time time,
+                             DWORD process_id,
+                             const TraceSampleStack* data) override;
   // @}
 
   // @name Parameter names.
@@ -80,6 +84,7 @@ class SampleGrinder : public GrinderInterface {
   // anonymous helper functions.
   struct ModuleKey;
   struct ModuleData;
+  struct RefinementData;
 
   // Some type definitions. There are public so that they are accessible by
   // anonymous helper functions.
@@ -100,6 +105,14 @@ class SampleGrinder : public GrinderInterface {
   // named objects (compilands or functions).
   typedef std::map<const std::string*, double> NameHeatMap;
 
+  // The distinct addresses of the frames of a sampled stack that fall in a
+  // given module, in increasing order.
+  typedef std::vector<core::RelativeAddress> StackAddresses;
+
+  // The time spent on each distinct stack, in seconds, keyed by the addresses
+  // of its frames in a module.
+  typedef std::map<StackAddresses, double> StackHeatMap;
+
  protected:
   // Finds or creates the sample data associated with the given module.
   ModuleData* GetModuleData(
@@ -129,10 +142,40 @@ class SampleGrinder : public GrinderInterface {
       const TraceSampleData* sample_data,
       SampleGrinder::ModuleData* module_data);
 
+  // Determines whether the @p sample_data only covers part of the range of
+  // the @p module_data, in which case it refines the distribution of the
+  // samples over that part rather than adding samples to the module.
+  // @param sample_data The sample data to be added.
+  // @param module_data The module data it is to be added to.
+  // @returns true if the @p sample_data is a refinement.
+  static bool IsRefinement(const TraceSampleData* sample_data,
+                           const SampleGrinder::ModuleData& module_data);
+
+  // Updates the refinement of @p module_data over the range of the refinement
+  // @p sample_data. This can fail if the @p sample_data is not consistent
+  // with the data previously gathered over the same range.
+  // @param clock_rate The clock rate to be used in scaling the sample data.
+  // @param sample_data The refinement sample data to be added.
+  // @param module_data The module data to be refined.
+  // @returns True on success, false otherwise.
+  static bool IncrementRefinementData(
+      double clock_rate,
+      const TraceSampleData* sample_data,
+      SampleGrinder::ModuleData* module_data);
+
+  // Redistributes the samples of each bucket of @p module_data that is fully
+  // covered by a finer refinement over the buckets of the refinement, in
+  // proportion to their samples. The samples are moved to the refinements,
+  // which leaves the total unchanged. Refinements that do not add anything
+  // to the resolution of the module data are zeroed.
+  // @param module_data The module data whose refinements are to be applied.
+  static void ApplyRefinements(SampleGrinder::ModuleData* module_data);
+
   // Given a populated @p heat_map and aggregate @p module_data, estimates heat
   // for each range in the @p heat_map. The values represent an estimate of
   // amount of time spent in the range, in seconds.
-  // @param module_data Aggregate module data.
+  // @param module_data Aggregate module data. Its refinements, if any, must
+  //     have been applied.
   // @param heat A pre-populated address space representing the basic blocks of
   //     the module in question.
   // @param total_samples The total number of samples processed will be returned
@@ -154,6 +197,20 @@ class SampleGrinder : public GrinderInterface {
                            const HeatMap& heat_map,
                            NameHeatMap* name_heat_map);
 
+  // Given a populated @p heat_map, attributes the time spent on each stack of
+  // @p stack_heat_map to every function or compiland that appears on it,
+  // once per stack. This yields the time spent in each of them including
+  // their callees.
+  // @param aggregation_level The aggregation level. Must be one of
+  //     kFunction or kCompiland.
+  // @param heat_map The BB heat map of the module of the stacks.
+  // @param stack_heat_map The stacks sampled in the module.
+  // @param name_heat_map The named heat map to be populated.
+  static void RollUpStacksByName(AggregationLevel aggregation_level,
+                                 const HeatMap& heat_map,
+                                 const StackHeatMap& stack_heat_map,
+                                 NameHeatMap* name_heat_map);
+
   // The aggregation level to be used in processing samples.
   AggregationLevel aggregation_level_;
 
@@ -186,6 +243,10 @@ class SampleGrinder : public GrinderInterface {
   HeatMap heat_map_;
   NameHeatMap name_heat_map_;
 
+  // The inclusive heat of each function or compiland. This is only populated
+  // if the trace files contain sampled stacks.
+  NameHeatMap inclusive_name_heat_map_;
+
   // Used only in 'line' aggregation mode. Populated by Grind().
   LineInfo line_info_;
 
@@ -201,13 +262,29 @@ struct SampleGrinder::ModuleKey {
   bool operator<(const ModuleKey& rhs) const;
 };
 
+// The samples gathered at a finer resolution over a hot part of a module, by
+// sampling profilers whose coarse profile of the whole module is also present
+// in the trace files.
+struct SampleGrinder::RefinementData {
+  RefinementData::RefinementData() : bucket_size(0) {}
+
+  uint32_t bucket_size;
+  std::vector<double> buckets;
+};
+
 struct SampleGrinder::ModuleData {
   ModuleData::ModuleData() : bucket_size(0) {}
 
+  // The refinements, keyed by the range they cover.
+  typedef std::map<core::AddressRange<core::RelativeAddress, size_t>,
+                   RefinementData> RefinementMap;
+
   base::FilePath module_path;
   uint32_t bucket_size;
   core::RelativeAddress bucket_start;
   std::vector<double> buckets;
+  RefinementMap refinements;
+  StackHeatMap stacks;
 };
 
 }  // namespace grinders
@@ -41,8 +41,12 @@ class TestSampleGrinder : public SampleGrinder {
   // Functions.
   using SampleGrinder::UpsampleModuleData;
   using SampleGrinder::IncrementModuleData;
+  using SampleGrinder::IsRefinement;
+  using SampleGrinder::IncrementRefinementData;
+  using SampleGrinder::ApplyRefinements;
   using SampleGrinder::IncrementHeatMapFromModuleData;
   using SampleGrinder::RollUpByName;
+  using SampleGrinder::RollUpStacksByName;
 
   // Members.
   using SampleGrinder::aggregation_level_;
@@ -367,6 +371,95 @@ TEST_F(SampleGrinderTest, IncrementModuleData) {
   EXPECT_DOUBLE_EQ(1.2, BucketSum(module_data));
 }
 
+TEST_F(SampleGrinderTest, ApplyRefinements) {
+  ASSERT_NO_FATAL_FAILURE(PrepareDummySampleDataBuffer(4));
+  ASSERT_TRUE(sample_data_ != NULL);
+
+  // Each sample is worth 0.1 'seconds'.
+  uint64_t sampling_interval = clock_info_.tsc_info.frequency / 10;
+  uint32_t module_base = 0x00100000;
+  uint32_t bucket_start = 0x00011000;
+
+  // The aggregate data spans 4 buckets of 8 bytes.
+  SampleGrinder::ModuleData module_data;
+  module_data.bucket_size = 8;
+  module_data.bucket_start.set_value(bucket_start);
+  module_data.buckets.push_back(0.1);
+  module_data.buckets.push_back(0.4);
+  module_data.buckets.push_back(0.0);
+  module_data.buckets.push_back(0.2);
+
+  // Sample data over all of the module isn't a refinement.
+  sample_data_->module_base_addr = reinterpret_cast<ModuleAddr>(module_base);
+  sample_data_->bucket_size = 8;
+  sample_data_->bucket_start =
+      reinterpret_cast<ModuleAddr>(module_base + bucket_start);
+  sample_data_->bucket_count = 4;
+  sample_data_->sampling_interval = sampling_interval;
+  EXPECT_FALSE(TestSampleGrinder::IsRefinement(sample_data_, module_data));
+
+  // Sample data over buckets 1 and 2 at a resolution of 4 bytes is.
+  sample_data_->bucket_size = 4;
+  sample_data_->bucket_start =
+      reinterpret_cast<ModuleAddr>(module_base + bucket_start + 8);
+  sample_data_->bucket_count = 4;
+  sample_data_->buckets[0] = 1;
+  sample_data_->buckets[1] = 3;
+  sample_data_->buckets[2] = 0;
+  sample_data_->buckets[3] = 0;
+  EXPECT_TRUE(TestSampleGrinder::IsRefinement(sample_data_, module_data));
+  EXPECT_TRUE(TestSampleGrinder::IncrementRefinementData(
+      clock_info_.tsc_info.frequency, sample_data_, &module_data));
+  ASSERT_EQ(1u, module_data.refinements.size());
+  const SampleGrinder::RefinementData& refinement =
+      module_data.refinements.begin()->second;
+  EXPECT_EQ(4u, refinement.bucket_size);
+  ASSERT_EQ(4u, refinement.buckets.size());
+  EXPECT_DOUBLE_EQ(0.1, refinement.buckets[0]);
+  EXPECT_DOUBLE_EQ(0.3, refinement.buckets[1]);
+
+  // A refinement of the same range at another resolution is rejected.
+  sample_data_->bucket_size = 2;
+  sample_data_->bucket_count = 8;
+  EXPECT_FALSE(TestSampleGrinder::IncrementRefinementData(
+      clock_info_.tsc_info.frequency, sample_data_, &module_data));
+
+  // The samples of bucket 1 are moved to the refinement, in proportion to
+  // the refined samples. Bucket 2 has no refined samples and stays as is.
+  TestSampleGrinder::ApplyRefinements(&module_data);
+  EXPECT_DOUBLE_EQ(0.1, module_data.buckets[0]);
+  EXPECT_DOUBLE_EQ(0.0, module_data.buckets[1]);
+  EXPECT_DOUBLE_EQ(0.0, module_data.buckets[2]);
+  EXPECT_DOUBLE_EQ(0.2, module_data.buckets[3]);
+  EXPECT_DOUBLE_EQ(0.1, refinement.buckets[0]);
+  EXPECT_DOUBLE_EQ(0.3, refinement.buckets[1]);
+  EXPECT_DOUBLE_EQ(0.0, refinement.buckets[2]);
+  EXPECT_DOUBLE_EQ(0.0, refinement.buckets[3]);
+
+  // The refined samples are distributed at their finer resolution.
+  typedef SampleGrinder::BasicBlockData BasicBlockData;
+  typedef SampleGrinder::HeatMap HeatMap;
+  typedef SampleGrinder::HeatMap::AddressSpace::Range Range;
+  typedef SampleGrinder::HeatMap::AddressSpace::Range::Address RVA;
+
+  HeatMap heat_map;
+  const BasicBlockData kData = {};
+  ASSERT_TRUE(heat_map.Insert(Range(RVA(bucket_start), 12), kData));
+  ASSERT_TRUE(heat_map.Insert(Range(RVA(bucket_start + 12), 20), kData));
+
+  double total_samples = 0;
+  double orphaned_samples = TestSampleGrinder::IncrementHeatMapFromModuleData(
+      module_data, &heat_map, &total_samples);
+  EXPECT_DOUBLE_EQ(0.0, orphaned_samples);
+  EXPECT_DOUBLE_EQ(0.7, total_samples);
+
+  ASSERT_EQ(2u, heat_map.size());
+  HeatMap::const_iterator it = heat_map.begin();
+  EXPECT_DOUBLE_EQ(0.2, it->second.heat);
+  ++it;
+  EXPECT_DOUBLE_EQ(0.5, it->second.heat);
+}
+
 TEST_F(SampleGrinderTest, IncrementHeatMapFromModuleData) {
   // Make 9 buckets, each with 1 second of samples in them.
   SampleGrinder::ModuleData module_data;
@@ -447,6 +540,56 @@ TEST_F(SampleGrinderTest, RollUpByName) {
   EXPECT_THAT(nhm, testing::ContainerEq(expected_nhm));
 }
 
+TEST_F(SampleGrinderTest, RollUpStacksByName) {
+  const std::string kFoo = "foo";
+  const std::string kBar = "bar";
+  const std::string kBaz = "baz";
+
+  typedef TestSampleGrinder::HeatMap::AddressSpace::Range Range;
+  typedef TestSampleGrinder::HeatMap::AddressSpace::Range::Address RVA;
+
+  // Functions foo and bar are in compiland baz, and function baz in bar.
+  TestSampleGrinder::HeatMap heat_map;
+  TestSampleGrinder::BasicBlockData bbd0 = { &kBaz, &kFoo, 0.0 };
+  TestSampleGrinder::BasicBlockData bbd1 = { &kBaz, &kBar, 0.0 };
+  TestSampleGrinder::BasicBlockData bbd2 = { &kBar, &kBaz, 0.0 };
+  ASSERT_TRUE(heat_map.Insert(Range(RVA(0), 4), bbd0));
+  ASSERT_TRUE(heat_map.Insert(Range(RVA(4), 4), bbd1));
+  ASSERT_TRUE(heat_map.Insert(Range(RVA(8), 4), bbd2));
+
+  // Two stacks, one of which has two frames in foo and one outside of any
+  // function.
+  TestSampleGrinder::StackHeatMap stacks;
+  TestSampleGrinder::StackAddresses stack0;
+  stack0.push_back(RVA(1));
+  stack0.push_back(RVA(2));
+  stack0.push_back(RVA(5));
+  stack0.push_back(RVA(16));
+  stacks[stack0] = 1.0;
+  TestSampleGrinder::StackAddresses stack1;
+  stack1.push_back(RVA(6));
+  stack1.push_back(RVA(9));
+  stacks[stack1] = 2.0;
+
+  TestSampleGrinder::NameHeatMap nhm;
+  TestSampleGrinder::NameHeatMap expected_nhm;
+
+  expected_nhm[&kFoo] = 1.0;
+  expected_nhm[&kBar] = 3.0;
+  expected_nhm[&kBaz] = 2.0;
+  TestSampleGrinder::RollUpStacksByName(SampleGrinder::kFunction, heat_map,
+                                        stacks, &nhm);
+  EXPECT_THAT(nhm, testing::ContainerEq(expected_nhm));
+
+  nhm.clear();
+  expected_nhm.clear();
+  expected_nhm[&kBaz] = 3.0;
+  expected_nhm[&kBar] = 2.0;
+  TestSampleGrinder::RollUpStacksByName(SampleGrinder::kCompiland, heat_map,
+                                        stacks, &nhm);
+  EXPECT_THAT(nhm, testing::ContainerEq(expected_nhm));
+}
+
 TEST_F(SampleGrinderTest, ParseEmptyCommandLineFails) {
   TestSampleGrinder g;
   EXPECT_FALSE(g.ParseCommandLine(&cmd_line_));
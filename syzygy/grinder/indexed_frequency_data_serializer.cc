@@ -14,14 +14,18 @@
 
 #include "syzygy/grinder/indexed_frequency_data_serializer.h"
 
+#include <set>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "base/files/file_path.h"
+#include "base/files/file_util.h"
 #include "base/json/json_reader.h"
 #include "base/strings/stringprintf.h"
 #include "syzygy/common/indexed_frequency_data.h"
 #include "syzygy/core/json_file_writer.h"
+#include "syzygy/core/serialization.h"
 #include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_util.h"
 #include "syzygy/pe/find.h"
@@ -48,6 +52,28 @@ const char kNumColumnsKey[] = "num_columns";
 const char kDataTypeKey[] = "data_type";
 const char kFrequencySizeKey[] = "frequency_size";
 
+// Gets the basic blocks that have at least one non-zero frequency, and the
+// number of columns up to the last non-zero one. These are the rows and
+// columns that are output.
+void GetFrequencyRows(const IndexedFrequencyMap& frequencies,
+                      std::set<RelativeAddress>* keys,
+                      size_t* num_columns) {
+  DCHECK(keys != NULL);
+  DCHECK(num_columns != NULL);
+
+  keys->clear();
+  *num_columns = 0;
+  IndexedFrequencyMap::const_iterator it = frequencies.begin();
+  for (; it != frequencies.end(); ++it) {
+    RelativeAddress addr = it->first.first;
+    size_t column = it->first.second;
+    if (it->second != 0) {
+      keys->insert(addr);
+      *num_columns = std::max(*num_columns, column + 1);
+    }
+  }
+}
+
 bool OutputFrequencyData(
     JSONFileWriter* writer,
     const ModuleInformation& module_information,
@@ -101,15 +127,7 @@ bool OutputFrequencyData(
   // Build a set of keys to output.
   size_t num_columns = 0;
   std::set<RelativeAddress> keys;
-  IndexedFrequencyMap::const_iterator it = frequencies.begin();
-  for (; it != frequencies.end(); ++it) {
-    RelativeAddress addr = it->first.first;
-    size_t column = it->first.second;
-    if (it->second != 0) {
-      keys.insert(addr);
-      num_columns = std::max(num_columns, column + 1);
-    }
-  }
+  GetFrequencyRows(frequencies, &keys, &num_columns);
 
   // For each key with at least one non-zero column, output a block with each
   // column.
@@ -250,8 +268,112 @@ bool ReadFrequencyData(const base::DictionaryValue* dict_value,
   return true;
 }
 
+bool SaveFrequencyDataAsBinary(
+    const ModuleInformation& module_information,
+    const IndexedFrequencyInformation& frequency_info,
+    core::OutArchive* out_archive) {
+  DCHECK(out_archive != NULL);
+
+  if (!module_information.Save(out_archive) ||
+      !out_archive->Save(frequency_info.num_entries) ||
+      !out_archive->Save(frequency_info.num_columns) ||
+      !out_archive->Save(static_cast<uint32_t>(frequency_info.data_type)) ||
+      !out_archive->Save(frequency_info.frequency_size)) {
+    return false;
+  }
+
+  // Output the same rows and columns as the JSON format, as flat arrays.
+  const IndexedFrequencyMap& frequencies = frequency_info.frequency_map;
+  size_t num_columns = 0;
+  std::set<RelativeAddress> keys;
+  GetFrequencyRows(frequencies, &keys, &num_columns);
+
+  std::vector<uint32_t> addresses;
+  std::vector<EntryCountType> values;
+  addresses.reserve(keys.size());
+  values.reserve(keys.size() * num_columns);
+  std::set<RelativeAddress>::const_iterator key = keys.begin();
+  for (; key != keys.end(); ++key) {
+    addresses.push_back(key->value());
+    for (size_t column = 0; column < num_columns; ++column) {
+      IndexedFrequencyMap::const_iterator data =
+          frequencies.find(std::make_pair(*key, column));
+      values.push_back(data != frequencies.end() ? data->second : 0);
+    }
+  }
+
+  return out_archive->Save(static_cast<uint32_t>(num_columns)) &&
+      out_archive->Save(addresses) && out_archive->Save(values);
+}
+
+bool LoadFrequencyDataFromBinary(
+    core::InArchive* in_archive,
+    ModuleIndexedFrequencyMap* module_frequency_map) {
+  DCHECK(in_archive != NULL);
+  DCHECK(module_frequency_map != NULL);
+
+  ModuleInformation module_information;
+  IndexedFrequencyInformation frequency_info = {};
+  uint32_t data_type = 0;
+  uint32_t num_columns = 0;
+  std::vector<uint32_t> addresses;
+  std::vector<EntryCountType> values;
+  if (!module_information.Load(in_archive) ||
+      !in_archive->Load(&frequency_info.num_entries) ||
+      !in_archive->Load(&frequency_info.num_columns) ||
+      !in_archive->Load(&data_type) ||
+      !in_archive->Load(&frequency_info.frequency_size) ||
+      !in_archive->Load(&num_columns) ||
+      !in_archive->Load(&addresses) ||
+      !in_archive->Load(&values)) {
+    LOG(ERROR) << "Failed to read binary frequency data.";
+    return false;
+  }
+
+  if (data_type >= common::IndexedFrequencyData::MAX_DATA_TYPE ||
+      values.size() != addresses.size() * num_columns) {
+    LOG(ERROR) << "Invalid binary frequency data for "
+               << module_information.path << ".";
+    return false;
+  }
+  frequency_info.data_type =
+      static_cast<common::IndexedFrequencyData::DataType>(data_type);
+
+  // Insert a new IndexedFrequencyMap record for this module.
+  std::pair<ModuleIndexedFrequencyMap::iterator, bool> result =
+      module_frequency_map->insert(std::make_pair(
+          module_information, frequency_info));
+  if (!result.second) {
+    LOG(ERROR) << "Found duplicate entries for " << module_information.path
+               << ".";
+    return false;
+  }
+
+  IndexedFrequencyMap& frequencies = result.first->second.frequency_map;
+  for (size_t i = 0; i < addresses.size(); ++i) {
+    for (size_t column = 0; column < num_columns; ++column) {
+      EntryCountType entry_count = values[i * num_columns + column];
+      if (entry_count < 0) {
+        LOG(ERROR) << "Invalid value in frequency list.";
+        return false;
+      }
+      if (!frequencies.insert(std::make_pair(std::make_pair(
+          RelativeAddress(addresses[i]), column), entry_count)).second) {
+        LOG(ERROR) << "Duplicate basic block address in frequency list.";
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
 }  // namespace
 
+// "SZIF", for Syzygy indexed frequencies.
+const uint32_t IndexedFrequencyDataSerializer::kBinaryMagic = 0x46495A53;
+const uint32_t IndexedFrequencyDataSerializer::kBinaryVersion = 1;
+
 IndexedFrequencyDataSerializer::IndexedFrequencyDataSerializer()
     : pretty_print_(false) {
 }
@@ -327,6 +449,82 @@ bool IndexedFrequencyDataSerializer::LoadFromJson(
   return true;
 }
 
+bool IndexedFrequencyDataSerializer::SaveAsBinary(
+    const ModuleIndexedFrequencyMap& frequency_map, FILE* file) {
+  DCHECK(file != NULL);
+  core::FileOutStream out_stream(file);
+  core::NativeBinaryOutArchive out_archive(&out_stream);
+
+  if (!out_archive.Save(kBinaryMagic) || !out_archive.Save(kBinaryVersion) ||
+      !out_archive.Save(frequency_map.size())) {
+    return false;
+  }
+
+  ModuleIndexedFrequencyMap::const_iterator it = frequency_map.begin();
+  for (; it != frequency_map.end(); ++it) {
+    if (!SaveFrequencyDataAsBinary(it->first, it->second, &out_archive))
+      return false;
+  }
+
+  return out_archive.Flush();
+}
+
+bool IndexedFrequencyDataSerializer::LoadFromBinary(
+    const base::FilePath& path,
+    ModuleIndexedFrequencyMap* module_frequency_map) {
+  DCHECK(module_frequency_map != NULL);
+  DCHECK(!path.empty());
+
+  module_frequency_map->clear();
+
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Failed to open '" << path.value() << "' for reading.";
+    return false;
+  }
+
+  core::FileInStream in_stream(file.get());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  size_t num_modules = 0;
+  if (!in_archive.Load(&magic) || !in_archive.Load(&version) ||
+      !in_archive.Load(&num_modules)) {
+    LOG(ERROR) << "Failed to read the header of '" << path.value() << "'.";
+    return false;
+  }
+  if (magic != kBinaryMagic || version != kBinaryVersion) {
+    LOG(ERROR) << "'" << path.value() << "' is not a binary frequency file "
+               << "of a supported version.";
+    return false;
+  }
+
+  for (size_t i = 0; i < num_modules; ++i) {
+    if (!LoadFrequencyDataFromBinary(&in_archive, module_frequency_map)) {
+      LOG(ERROR) << "Failed to read module " << i << " of '" << path.value()
+                 << "'.";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool IndexedFrequencyDataSerializer::Load(
+    const base::FilePath& path,
+    ModuleIndexedFrequencyMap* module_frequency_map) {
+  DCHECK(module_frequency_map != NULL);
+  DCHECK(!path.empty());
+
+  // Binary files start with the magic number, which isn't valid JSON.
+  uint32_t magic = 0;
+  int bytes_read = base::ReadFile(path, reinterpret_cast<char*>(&magic),
+                                  sizeof(magic));
+  if (bytes_read == sizeof(magic) && magic == kBinaryMagic)
+    return LoadFromBinary(path, module_frequency_map);
+  return LoadFromJson(path, module_frequency_map);
+}
+
 bool IndexedFrequencyDataSerializer::PopulateFromJsonValue(
     const base::Value* json_value,
     ModuleIndexedFrequencyMap* module_frequency_map) {
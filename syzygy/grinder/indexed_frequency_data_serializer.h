@@ -73,10 +73,21 @@ namespace grinder {
 //       // Basic-block frequencies list for module 2.
 //       ...
 //     ]
+//
+// The same information can also be saved in a compact binary format, which
+// is much faster to load for large images. It holds a magic number and a
+// version, followed by the number of modules. Each module is saved as its
+// signature, its description, and its frequencies as two arrays: the RVAs of
+// the basic blocks, and their frequencies, row by row. Unlike the JSON
+// format, the binary one doesn't hold the metadata of the toolchain.
 class IndexedFrequencyDataSerializer {
  public:
   typedef basic_block_util::ModuleIndexedFrequencyMap ModuleIndexedFrequencyMap;
 
+  // The magic number and version of the binary format.
+  static const uint32_t kBinaryMagic;
+  static const uint32_t kBinaryVersion;
+
   IndexedFrequencyDataSerializer();
 
   // Sets the pretty-printing status.
@@ -94,6 +105,20 @@ class IndexedFrequencyDataSerializer {
   bool LoadFromJson(const base::FilePath& file_path,
                     ModuleIndexedFrequencyMap* frequency_map);
 
+  // Saves the given frequency map in the binary format to a file previously
+  // opened for writing.
+  bool SaveAsBinary(const ModuleIndexedFrequencyMap& frequency_map,
+                    FILE* file);
+
+  // Populates a frequency map from a binary file, given by @p file_path.
+  bool LoadFromBinary(const base::FilePath& file_path,
+                      ModuleIndexedFrequencyMap* frequency_map);
+
+  // Populates a frequency map from a file in either format, given by
+  // @p file_path. The format is determined by the contents of the file.
+  bool Load(const base::FilePath& file_path,
+            ModuleIndexedFrequencyMap* frequency_map);
+
  protected:
   // Populates a frequency map from JSON data. Exposed for unit-testing
   // purposes.
@@ -245,4 +245,49 @@ TEST_F(IndexedFrequencyDataSerializerTest, RoundTrip) {
   EXPECT_THAT(new_frequency_map, ContainerEq(frequency_map));
 }
 
+TEST_F(IndexedFrequencyDataSerializerTest, BinaryRoundTrip) {
+  ModuleInformation module_info;
+  ASSERT_NO_FATAL_FAILURE(InitModuleInfo(&module_info));
+
+  size_t num_basic_blocks = 100;
+  size_t num_columns = 3;
+
+  ModuleIndexedFrequencyMap frequency_map;
+  IndexedFrequencyInformation& frequency_info = frequency_map[module_info];
+  frequency_info.num_entries = num_basic_blocks;
+  frequency_info.num_columns = num_columns;
+  frequency_info.data_type = common::IndexedFrequencyData::BRANCH;
+  frequency_info.frequency_size = 4;
+
+  IndexedFrequencyMap& counters = frequency_info.frequency_map;
+  for (size_t i = 0; i < num_basic_blocks; ++i) {
+    for (size_t c = 0; c < num_columns; ++c)
+      counters[std::make_pair(core::RelativeAddress(i * i), c)] = i + c + 1;
+  }
+
+  base::FilePath binary_path(temp_dir_.path().AppendASCII("test.bin"));
+  TestIndexedFrequencyDataSerializer serializer;
+  {
+    base::ScopedFILE file(base::OpenFile(binary_path, "wb"));
+    ASSERT_TRUE(file.get() != NULL);
+    ASSERT_TRUE(serializer.SaveAsBinary(frequency_map, file.get()));
+  }
+
+  ModuleIndexedFrequencyMap new_frequency_map;
+  ASSERT_TRUE(serializer.LoadFromBinary(binary_path, &new_frequency_map));
+  EXPECT_THAT(new_frequency_map, ContainerEq(frequency_map));
+
+  // The binary file isn't JSON, but is recognized as binary by Load.
+  EXPECT_FALSE(serializer.LoadFromJson(binary_path, &new_frequency_map));
+  ASSERT_TRUE(serializer.Load(binary_path, &new_frequency_map));
+  EXPECT_THAT(new_frequency_map, ContainerEq(frequency_map));
+
+  // And the other way around.
+  base::FilePath json_path(temp_dir_.path().AppendASCII("test.json"));
+  ASSERT_TRUE(serializer.SaveAsJson(frequency_map, json_path));
+  EXPECT_FALSE(serializer.LoadFromBinary(json_path, &new_frequency_map));
+  ASSERT_TRUE(serializer.Load(json_path, &new_frequency_map));
+  EXPECT_THAT(new_frequency_map, ContainerEq(frequency_map));
+}
+
 }  // namespace grinder
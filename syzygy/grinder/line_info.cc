@@ -14,232 +14,447 @@
 
 #include "syzygy/grinder/line_info.h"
 
-#include <dia2.h>
+#include <windows.h>
 #include <algorithm>
 #include <limits>
+#include <map>
 
-#include "base/strings/utf_string_conversions.h"
-#include "base/win/scoped_bstr.h"
-#include "base/win/scoped_comptr.h"
-#include "syzygy/common/com_utils.h"
+#include "base/bind.h"
+#include "base/sys_info.h"
+#include "syzygy/application/work_pool.h"
+#include "syzygy/common/binary_stream.h"
 #include "syzygy/core/address_range.h"
-#include "syzygy/pe/dia_util.h"
+#include "syzygy/pdb/pdb_dbi_stream.h"
+#include "syzygy/pdb/pdb_file.h"
+#include "syzygy/pdb/pdb_reader.h"
+#include "syzygy/pdb/pdb_stream_reader.h"
+#include "syzygy/pdb/pdb_util.h"
+#include "syzygy/pe/cvinfo_ext.h"
 
 namespace grinder {
 
 namespace {
 
-using base::win::ScopedBstr;
-using base::win::ScopedComPtr;
+namespace cci = Microsoft_Cci_Pdb;
 
 typedef core::AddressRange<core::RelativeAddress, size_t> RelativeAddressRange;
-typedef std::map<DWORD, const std::string*> SourceFileMap;
+typedef std::vector<IMAGE_SECTION_HEADER> SectionHeaders;
+
+// Maps the offsets of the records of a file checksum subsection to the
+// offsets of the names of their files in the name table of the PDB.
+typedef std::map<uint32_t, uint32_t> FileChecksumMap;
+
+// A line as read from a module stream. Its file is identified by the offset
+// of its name in the name table, which is shared by all the modules.
+struct RawLine {
+  uint32_t address;
+  uint32_t size;
+  uint32_t line_number;
+  uint32_t file_name;
+};
+typedef std::vector<RawLine> RawLines;
+
+// Orders lines by address. Lines sharing an address are ordered by size, so
+// that the zero-length ones come first.
+struct RawLineAddressComparator {
+  bool operator()(const RawLine& l1, const RawLine& l2) const {
+    if (l1.address != l2.address)
+      return l1.address < l2.address;
+    return l1.size < l2.size;
+  }
+};
 
-bool GetDiaSessionForPdb(const base::FilePath& pdb_path,
-                         IDiaDataSource* source,
-                         IDiaSession** session) {
-  DCHECK(source != NULL);
-  DCHECK(session != NULL);
+// Used for comparing the ranges covered by two source lines.
+struct SourceLineAddressComparator {
+  bool operator()(const LineInfo::SourceLine& sl1,
+                  const LineInfo::SourceLine& sl2) const {
+    return sl1.address + sl1.size <= sl2.address;
+  }
+};
 
-  HRESULT hr = source->loadDataFromPdb(pdb_path.value().c_str());
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in loadDataFromPdb: " << common::LogHr(hr) << ".";
+// Reads the section headers of the image described by a PDB. The line
+// information refers to the sections of the original image, so these are
+// preferred over those of an image that was modified after it was linked.
+bool ReadSectionHeaders(const pdb::PdbFile& pdb_file,
+                        const pdb::DbiStream& dbi_stream,
+                        SectionHeaders* sections) {
+  DCHECK(sections != NULL);
+
+  int16_t stream_id = dbi_stream.dbg_header().section_header_origin;
+  if (stream_id < 0)
+    stream_id = dbi_stream.dbg_header().section_header;
+  pdb::PdbStream* stream = NULL;
+  if (stream_id >= 0)
+    stream = pdb_file.GetStream(stream_id).get();
+  if (stream == NULL) {
+    LOG(ERROR) << "No section header stream.";
     return false;
   }
 
-  hr = source->openSession(session);
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in openSession: " << common::LogHr(hr) << ".";
+  sections->resize(stream->length() / sizeof(IMAGE_SECTION_HEADER));
+  if (!sections->empty() &&
+      !stream->ReadBytesAt(0, sections->size() * sizeof(sections->at(0)),
+                           &sections->at(0))) {
+    LOG(ERROR) << "Unable to read the section headers.";
     return false;
   }
 
   return true;
 }
 
+// Reads a file checksum subsection of a module stream.
+// @param reader the reader, positioned at the start of the subsection.
+// @param length the length of the subsection.
+// @param file_names receives the names of the files of the subsection.
+// @returns true on success, false otherwise.
+bool ReadFileChecksums(pdb::PdbStreamReaderWithPosition* reader,
+                       size_t length,
+                       FileChecksumMap* file_names) {
+  DCHECK(reader != NULL);
+  DCHECK(file_names != NULL);
+
+  size_t base = reader->Position();
+  size_t end = base + length;
+  common::BinaryStreamParser parser(reader);
+  while (reader->Position() < end) {
+    cci::CV_FileCheckSum checksum = {};
+    uint32_t offset = static_cast<uint32_t>(reader->Position() - base);
+    if (!parser.Read(&checksum)) {
+      LOG(ERROR) << "Unable to read file checksum.";
+      return false;
+    }
+    (*file_names)[offset] = checksum.name;
+
+    // Skip the checksum and align.
+    if (!reader->Consume(checksum.len) || !parser.AlignTo(4)) {
+      LOG(ERROR) << "Unable to seek past file checksum.";
+      return false;
+    }
+  }
 
-bool DisableOmapTranslation(IDiaSession* session) {
-  DCHECK(session != NULL);
+  return true;
+}
 
-  ScopedComPtr<IDiaAddressMap> addr_map;
-  HRESULT hr = session->QueryInterface(IID_IDiaAddressMap,
-                                       addr_map.ReceiveVoid());
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in QueryInterface: " << common::LogHr(hr) << ".";
+// Reads a line subsection of a module stream. The lines have no explicit
+// size: each one spans the code up to the next line of its block, and the
+// last one spans the code up to the end of the block.
+// @param sections the section headers of the image.
+// @param reader the reader, positioned at the start of the subsection.
+// @param length the length of the subsection.
+// @param lines receives the lines, with their files identified by the offset
+//     of their record in the file checksum subsection.
+// @returns true on success, false otherwise.
+bool ReadLines(const SectionHeaders& sections,
+               pdb::PdbStreamReaderWithPosition* reader,
+               size_t length,
+               RawLines* lines) {
+  DCHECK(reader != NULL);
+  DCHECK(lines != NULL);
+
+  size_t end = reader->Position() + length;
+  common::BinaryStreamParser parser(reader);
+  cci::CV_LineSection line_section = {};
+  if (!parser.Read(&line_section)) {
+    LOG(ERROR) << "Unable to read line section.";
     return false;
   }
-  hr = addr_map->put_addressMapEnabled(FALSE);
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in put_addressMapEnabled: " << common::LogHr(hr)
-               << ".";
+  if (line_section.sec == 0 || line_section.sec > sections.size()) {
+    LOG(ERROR) << "Line section refers to invalid section "
+               << line_section.sec << ".";
     return false;
   }
+  uint32_t block_address =
+      sections[line_section.sec - 1].VirtualAddress + line_section.off;
+
+  size_t first_line = lines->size();
+  while (reader->Position() < end) {
+    cci::CV_SourceFile source_file = {};
+    if (!parser.Read(&source_file)) {
+      LOG(ERROR) << "Unable to read source info.";
+      return false;
+    }
+
+    std::vector<cci::CV_Line> cv_lines;
+    if (!parser.ReadMultiple(source_file.count, &cv_lines)) {
+      LOG(ERROR) << "Unable to read line records.";
+      return false;
+    }
+
+    if ((line_section.flags & cci::CV_LINES_HAVE_COLUMNS) != 0 &&
+        !reader->Consume(source_file.count * sizeof(cci::CV_Column))) {
+      LOG(ERROR) << "Unable to read column records.";
+      return false;
+    }
+
+    for (size_t i = 0; i < cv_lines.size(); ++i) {
+      RawLine line = { block_address + cv_lines[i].offset, 0,
+                       cv_lines[i].flags & cci::linenumStart,
+                       source_file.index };
+      lines->push_back(line);
+    }
+  }
+
+  // The lines of a block may be split among several files, so they're sorted
+  // before their sizes are computed.
+  RawLines::iterator block_begin = lines->begin() + first_line;
+  std::stable_sort(block_begin, lines->end(), RawLineAddressComparator());
+  uint32_t block_end = block_address + line_section.cod;
+  for (RawLines::iterator it = block_begin; it != lines->end(); ++it) {
+    RawLines::iterator next = it + 1;
+    uint32_t line_end = next != lines->end() ? next->address : block_end;
+    if (line_end < it->address) {
+      LOG(ERROR) << "Line at " << it->address << " is out of its block.";
+      return false;
+    }
+    it->size = line_end - it->address;
+  }
 
   return true;
 }
 
-const std::string* GetSourceFileName(DWORD source_file_id,
-                                     IDiaLineNumber* line_number,
-                                     LineInfo::SourceFileSet* source_files,
-                                     SourceFileMap* source_file_map) {
-  DCHECK(line_number != NULL);
-  DCHECK(source_files != NULL);
-  DCHECK(source_file_map != NULL);
+// Reads the lines of a module from its stream.
+// @param module the module whose lines are read.
+// @param stream the symbol stream of the module.
+// @param sections the section headers of the image.
+// @param lines receives the lines, with their files identified by the offset
+//     of their name in the name table of the PDB.
+// @returns true on success, false otherwise.
+bool ReadModuleLines(const pdb::DbiModuleInfo& module,
+                     pdb::PdbStream* stream,
+                     const SectionHeaders& sections,
+                     RawLines* lines) {
+  DCHECK(stream != NULL);
+  DCHECK(lines != NULL);
+
+  const pdb::DbiModuleInfoBase& module_info = module.module_info_base();
+  if (module_info.lines_bytes == 0)
+    return true;
 
-  SourceFileMap::const_iterator map_it = source_file_map->find(source_file_id);
+  uint32_t signature = 0;
+  if (!stream->ReadBytesAt(0, sizeof(signature), &signature) ||
+      signature != cci::C13) {
+    LOG(ERROR) << "Unexpected symbol stream type " << signature
+               << " for module " << module.module_name() << ".";
+    return false;
+  }
 
-  if (map_it != source_file_map->end())
-    return map_it->second;
+  // The line information is arranged as a back-to-back run of {type, len}
+  // prefixed subsections. The lines refer to their files by the offset of
+  // their record in the file checksum subsection, which is resolved once all
+  // the subsections have been read.
+  pdb::PdbStreamReaderWithPosition reader(
+      module_info.symbol_bytes, module_info.lines_bytes, stream);
+  common::BinaryStreamParser parser(&reader);
+  FileChecksumMap file_names;
+  size_t first_line = lines->size();
+  while (!reader.AtEnd()) {
+    uint32_t type = 0;
+    uint32_t length = 0;
+    if (!parser.Read(&type) || !parser.Read(&length)) {
+      LOG(ERROR) << "Unable to read line info signature.";
+      return false;
+    }
 
-  ScopedComPtr<IDiaSourceFile> source_file;
-  HRESULT hr = line_number->get_sourceFile(source_file.Receive());
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in get_sourceFile: " << common::LogHr(hr) << ".";
-    return NULL;
-  }
+    size_t end = reader.Position() + length;
+    switch (type) {
+      case cci::DEBUG_S_FILECHKSMS:
+        if (!ReadFileChecksums(&reader, length, &file_names))
+          return false;
+        break;
+      case cci::DEBUG_S_LINES:
+        if (!ReadLines(sections, &reader, length, lines))
+          return false;
+        break;
+      default:
+        break;
+    }
 
-  ScopedBstr source_file_path_bstr;
-  hr = source_file->get_fileName(source_file_path_bstr.Receive());
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in get_fileName: " << common::LogHr(hr) << ".";
-    return NULL;
+    // Skip whatever is left of the subsection, which is everything for the
+    // subsection types that don't hold lines.
+    if (reader.Position() > end || !reader.Consume(end - reader.Position())) {
+      LOG(ERROR) << "Invalid line info subsection of type " << type << ".";
+      return false;
+    }
   }
 
-  std::string source_file_path;
-  if (!base::WideToUTF8(common::ToString(source_file_path_bstr),
-                        source_file_path_bstr.Length(),
-                        &source_file_path)) {
-    LOG(ERROR) << "base::WideToUTF8 failed for path \""
-               << common::ToString(source_file_path_bstr) << "\".";
-    return NULL;
+  for (size_t i = first_line; i < lines->size(); ++i) {
+    FileChecksumMap::const_iterator it =
+        file_names.find((*lines)[i].file_name);
+    if (it == file_names.end()) {
+      LOG(ERROR) << "Line refers to a file that is not used by module "
+                 << module.module_name() << ".";
+      return false;
+    }
+    (*lines)[i].file_name = it->second;
   }
 
-  LineInfo::SourceFileSet::const_iterator source_file_it =
-      source_files->insert(source_file_path).first;
-  const std::string* source_file_name = &(*source_file_it);
-  source_file_map->insert(std::make_pair(source_file_id,
-                                         source_file_name));
-
-  return source_file_name;
+  return true;
 }
 
-// Used for comparing the ranges covered by two source lines.
-struct SourceLineAddressComparator {
-  bool operator()(const LineInfo::SourceLine& sl1,
-                  const LineInfo::SourceLine& sl2) const {
-    return sl1.address + sl1.size <= sl2.address;
-  }
-};
+// Reads the lines of a module of a PDB. This is invoked concurrently for
+// different modules, and the lines of each module are kept apart so that they
+// can be merged in module order on the calling thread. The streams are only
+// read, and the reads of mapped streams don't share any state, which lets the
+// threads share the PDB file.
+// @param modules the modules whose lines are read.
+// @param streams the symbol streams of @p modules, or NULL for the modules
+//     that have no stream.
+// @param sections the section headers of the image.
+// @param module_lines receives the lines, per module.
+// @param index the index of the module to read.
+// @returns true on success, false otherwise.
+bool ReadModuleLinesAt(const pdb::DbiStream::DbiModuleVector* modules,
+                       const std::vector<pdb::PdbStream*>* streams,
+                       const SectionHeaders* sections,
+                       std::vector<RawLines>* module_lines,
+                       size_t index) {
+  DCHECK(modules != NULL);
+  DCHECK(streams != NULL);
+  DCHECK(sections != NULL);
+  DCHECK(module_lines != NULL);
+  DCHECK_EQ(modules->size(), streams->size());
+  DCHECK_EQ(modules->size(), module_lines->size());
+
+  pdb::PdbStream* stream = (*streams)[index];
+  if (stream == NULL)
+    return true;
+  return ReadModuleLines((*modules)[index], stream, *sections,
+                         &(*module_lines)[index]);
+}
 
 }  // namespace
 
+LineInfo::LineInfo() : thread_count_(base::SysInfo::NumberOfProcessors()) {
+}
+
 bool LineInfo::Init(const base::FilePath& pdb_path) {
-  ScopedComPtr<IDiaDataSource> source;
-  if (!pe::CreateDiaSource(source.Receive()))
+  pdb::PdbReader pdb_reader;
+  pdb::PdbFile pdb_file;
+  if (!pdb_reader.Read(pdb_path, &pdb_file)) {
+    LOG(ERROR) << "Unable to read PDB file: " << pdb_path.value();
     return false;
+  }
 
-  ScopedComPtr<IDiaSession> session;
-  if (!GetDiaSessionForPdb(pdb_path, source.get(), session.Receive()))
+  pdb::PdbInfoHeader70 pdb_header = {};
+  pdb::NameStreamMap name_streams;
+  if (!pdb::ReadHeaderInfoStream(pdb_file, &pdb_header, &name_streams))
     return false;
 
-  // We want original module addresses so we disable OMAP translation.
-  if (!DisableOmapTranslation(session.get()))
+  // Read the name table, which holds the names of the source files.
+  pdb::NameStreamMap::const_iterator names_it = name_streams.find("/names");
+  pdb::PdbStream* names_stream = NULL;
+  if (names_it != name_streams.end())
+    names_stream = pdb_file.GetStream(names_it->second).get();
+  if (names_stream == NULL) {
+    LOG(ERROR) << "No name table.";
     return false;
+  }
+  pdb::OffsetStringMap names;
+  if (!pdb::ReadStringTable(names_stream, "Name table", 0,
+                            names_stream->length(), &names)) {
+    return false;
+  }
 
-  // Get the line number enumeration.
-  ScopedComPtr<IDiaEnumLineNumbers> line_number_enum;
-  HRESULT hr = session->findLinesByRVA(0, 0xFFFFFF, line_number_enum.Receive());
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in findLinesByRVA: " << common::LogHr(hr) << ".";
+  pdb::DbiStream dbi_stream;
+  pdb::PdbStream* stream = pdb_file.GetStream(pdb::kDbiStream).get();
+  if (stream == NULL || !dbi_stream.Read(stream)) {
+    LOG(ERROR) << "Unable to read the Dbi stream.";
     return false;
   }
 
-  // A map of source file IDs we've already seen, mapping back to the source
-  // file path. We use this as a cache so we're not constantly doing source-file
-  // lookups while iterating.
-  SourceFileMap source_file_map;
+  SectionHeaders sections;
+  if (!ReadSectionHeaders(pdb_file, dbi_stream, &sections))
+    return false;
 
-  // Get the line info count and reserve space.
-  LONG line_number_count = 0;
-  hr = line_number_enum->get_Count(&line_number_count);
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in get_Count: " << common::LogHr(hr) << ".";
+  // The streams are looked up here, as their references can't be taken on
+  // several threads. The PDB file keeps them alive.
+  const pdb::DbiStream::DbiModuleVector& modules = dbi_stream.modules();
+  std::vector<pdb::PdbStream*> module_streams(modules.size(), NULL);
+  for (size_t i = 0; i < modules.size(); ++i) {
+    int16_t stream_id = modules[i].module_info_base().stream;
+    if (stream_id >= 0)
+      module_streams[i] = pdb_file.GetStream(stream_id).get();
+  }
+
+  std::vector<RawLines> module_lines(modules.size());
+  application::WorkPool pool(thread_count_);
+  if (!pool.Run(modules.size(),
+                base::Bind(&ReadModuleLinesAt, &modules, &module_streams,
+                           &sections, &module_lines))) {
     return false;
   }
-  source_lines_.reserve(line_number_count);
 
-  // Iterate over the source line information.
-  DWORD old_source_file_id = SIZE_MAX;
-  DWORD old_rva = 0;
-  const std::string* source_file_name = NULL;
-  while (true) {
-    ScopedComPtr<IDiaLineNumber> line_number;
-    ULONG fetched = 0;
-    hr = line_number_enum->Next(1, line_number.Receive(), &fetched);
-    if (hr != S_OK || fetched != 1)
-      break;
-
-    DWORD source_file_id = 0;
-    hr = line_number->get_sourceFileId(&source_file_id);
-    if (FAILED(hr)) {
-      LOG(ERROR) << "Failure in get_sourceFileId: " << common::LogHr(hr) << ".";
-      return false;
-    }
+  // Merge the lines of the modules, in module order so that the result
+  // doesn't depend on the number of threads.
+  size_t line_count = 0;
+  for (const RawLines& lines : module_lines)
+    line_count += lines.size();
+  RawLines lines;
+  lines.reserve(line_count);
+  for (const RawLines& lines_of_module : module_lines)
+    lines.insert(lines.end(), lines_of_module.begin(), lines_of_module.end());
+  std::stable_sort(lines.begin(), lines.end(), RawLineAddressComparator());
+
+  // A map of the name offsets we've already seen to the source file names.
+  // We use this as a cache so we're not constantly doing source file lookups
+  // while iterating.
+  typedef std::map<uint32_t, const std::string*> SourceFileMap;
+  SourceFileMap source_file_map;
 
-    // Look for the source file by ID. Since we most often see successive
-    // lines from the same file we have a shortcut to avoid extra processing in
-    // this case.
-    if (source_file_id != old_source_file_id) {
-      source_file_name = GetSourceFileName(source_file_id,
-                                           line_number.get(),
-                                           &source_files_,
-                                           &source_file_map);
+  source_lines_.clear();
+  source_lines_.reserve(lines.size());
+  uint32_t old_file_name = std::numeric_limits<uint32_t>::max();
+  const std::string* source_file_name = NULL;
+  for (const RawLine& line : lines) {
+    // Since we most often see successive lines from the same file we have a
+    // shortcut to avoid extra processing in this case.
+    if (line.file_name != old_file_name || source_file_name == NULL) {
+      SourceFileMap::const_iterator map_it =
+          source_file_map.find(line.file_name);
+      if (map_it != source_file_map.end()) {
+        source_file_name = map_it->second;
+      } else {
+        pdb::OffsetStringMap::const_iterator name_it =
+            names.find(line.file_name);
+        if (name_it == names.end()) {
+          LOG(ERROR) << "There is a line in a file that is not in the name "
+                     << "table.";
+          return false;
+        }
+        source_file_name = &(*source_files_.insert(name_it->second).first);
+        source_file_map.insert(
+            std::make_pair(line.file_name, source_file_name));
+      }
+      old_file_name = line.file_name;
     }
-    old_source_file_id = source_file_id;
     DCHECK(source_file_name != NULL);
 
-    DWORD line = 0;
-    DWORD rva = 0;
-    DWORD length = 0;
-    if (FAILED(line_number->get_lineNumber(&line)) ||
-        FAILED(line_number->get_relativeVirtualAddress(&rva)) ||
-        FAILED(line_number->get_length(&length))) {
-      LOG(ERROR) << "Failed to get line number properties.";
-      return false;
-    }
-
-    // We rely on the enumeration returning us lines in order of increasing
-    // address, as they are stored originally in the PDB. This is required for
-    // the following zero-length fixing mechanism to work as intended.
-    DCHECK_LE(old_rva, rva);
-    old_rva = rva;
-
     // Is this a non-zero length? Back up and make any zero-length ranges
     // with the same start address the same length as us. This makes them
     // simply look like repeated entries in the array and makes searching for
     // them with lower_bound/upper_bound work as expected.
-    if (length != 0) {
+    if (line.size != 0) {
       SourceLines::reverse_iterator it = source_lines_.rbegin();
       for (; it != source_lines_.rend(); ++it) {
         if (it->size != 0)
           break;
-        if (it->address.value() != rva) {
+        if (it->address.value() != line.address) {
           LOG(ERROR) << "Encountered zero-length line number with "
                      << "inconsistent address.";
           return false;
         }
-        it->size = length;
+        it->size = line.size;
       }
     }
 
     source_lines_.push_back(SourceLine(source_file_name,
-                                       line,
-                                       core::RelativeAddress(rva),
-                                       length));
+                                       line.line_number,
+                                       core::RelativeAddress(line.address),
+                                       line.size));
   }
 
   return true;
 }
-
 bool LineInfo::Visit(
     core::RelativeAddress address, size_t size, size_t count) {
   // Visiting a range of size zero is a nop.
@@ -18,6 +18,10 @@
 #ifndef SYZYGY_GRINDER_LINE_INFO_H_
 #define SYZYGY_GRINDER_LINE_INFO_H_
 
+#include <set>
+#include <string>
+#include <vector>
+
 #include "base/files/file_path.h"
 #include "syzygy/core/address.h"
 #include "syzygy/core/address_space.h"
@@ -43,7 +47,11 @@ class LineInfo {
   typedef std::set<std::string> SourceFileSet;
   typedef std::vector<SourceLine> SourceLines;
 
+  LineInfo();
+
   // Initializes this LineInfo object with data read from the provided PDB.
+  // The line information is read from the C13 line subsections of the
+  // module streams, with the modules parsed on several threads.
   // @param pdb_path the PDB whose line information is to be read.
   // @returns true on success, false otherwise.
   bool Init(const base::FilePath& pdb_path);
@@ -59,18 +67,29 @@ class LineInfo {
   // @{
   const SourceFileSet& source_files() const { return source_files_; }
   const SourceLines& source_lines() const { return source_lines_; }
+  size_t thread_count() const { return thread_count_; }
   // @}
 
+  // Sets the number of threads on which the modules are parsed. This
+  // defaults to the number of processors.
+  // @param thread_count the number of threads.
+  void set_thread_count(size_t thread_count) {
+    DCHECK_LT(0u, thread_count);
+    thread_count_ = thread_count;
+  }
+
  protected:
   // Used to store unique file names in a manner such that we can draw stable
   // pointers to them. The SourceLine objects will point to the strings in this
   // set.
   SourceFileSet source_files_;
 
-  // Source line information is stored here sorted by order of address, which is
-  // the order in which we retrieve it from the PDB. This lets us do efficient
-  // binary search lookups in Visit.
+  // Source line information is stored here sorted by order of address. This
+  // lets us do efficient binary search lookups in Visit.
   SourceLines source_lines_;
+
+  // The number of threads on which the modules are parsed.
+  size_t thread_count_;
 };
 
 // Describes a single line of source code from some file.
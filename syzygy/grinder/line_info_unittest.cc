@@ -117,6 +117,34 @@ TEST_F(LineInfoTest, InitStaticPdb) {
   EXPECT_EQ(8379u, line_info.source_lines().size());
 }
 
+TEST_F(LineInfoTest, InitIsIndependentOfThreadCount) {
+  TestLineInfo serial_line_info;
+  serial_line_info.set_thread_count(1);
+  ASSERT_TRUE(serial_line_info.Init(static_pdb_path_));
+
+  TestLineInfo parallel_line_info;
+  parallel_line_info.set_thread_count(4);
+  ASSERT_TRUE(parallel_line_info.Init(static_pdb_path_));
+
+  EXPECT_THAT(serial_line_info.source_files(),
+              ::testing::ContainerEq(parallel_line_info.source_files()));
+  const LineInfo::SourceLines& serial_lines = serial_line_info.source_lines();
+  const LineInfo::SourceLines& parallel_lines =
+      parallel_line_info.source_lines();
+  ASSERT_EQ(serial_lines.size(), parallel_lines.size());
+  for (size_t i = 0; i < serial_lines.size(); ++i) {
+    EXPECT_EQ(*serial_lines[i].source_file_name,
+              *parallel_lines[i].source_file_name);
+    EXPECT_EQ(serial_lines[i].line_number, parallel_lines[i].line_number);
+    EXPECT_EQ(serial_lines[i].address, parallel_lines[i].address);
+    EXPECT_EQ(serial_lines[i].size, parallel_lines[i].size);
+
+    // The lines are sorted by address.
+    if (i > 0)
+      EXPECT_LE(serial_lines[i - 1].address, serial_lines[i].address);
+  }
+}
+
 TEST_F(LineInfoTest, Visit) {
   TestLineInfo line_info;
 
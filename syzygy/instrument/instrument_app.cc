@@ -19,10 +19,18 @@
 
 #include <algorithm>
 #include <iostream>
+#include <set>
 #include <string>
+#include <utility>
 
+#include "base/bind.h"
+#include "base/files/file_util.h"
+#include "base/strings/string_split.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
+#include "base/strings/utf_string_conversions.h"
+#include "syzygy/application/application.h"
+#include "syzygy/application/work_pool.h"
 #include "syzygy/instrument/instrumenters/archive_instrumenter.h"
 #include "syzygy/instrument/instrumenters/asan_instrumenter.h"
 #include "syzygy/instrument/instrumenters/bbentry_instrumenter.h"
@@ -73,6 +81,15 @@ static const char kUsageFormatStr[] =
     "    --filter=<path>         The path of the filter to be used in\n"
     "                            applying the instrumentation. Ranges marked\n"
     "                            in the filter will not be instrumented.\n"
+    "    --flavours=<path>       Instrument several flavours of the input\n"
+    "                            image in one invocation. Each line of the\n"
+    "                            file holds the switches of a flavour, such\n"
+    "                            as --mode and --output-image, which are\n"
+    "                            combined with the other switches. The image\n"
+    "                            is decomposed once, and the flavours are\n"
+    "                            instrumented in parallel. Lines starting\n"
+    "                            with '#' are ignored. Only PE images are\n"
+    "                            supported.\n"
     "    --no-augment-pdb        Indicates that the relinker should not\n"
     "                            augment the output PDB with additional.\n"
     "                            metadata.\n"
@@ -83,6 +100,9 @@ static const char kUsageFormatStr[] =
     "    --output-pdb=<path>     The PDB for the instrumented DLL. If not\n"
     "                            provided will attempt to generate one.\n"
     "    --overwrite             Allow output files to be overwritten.\n"
+    "    --perf-report=<path>    Write the durations and the memory usage of\n"
+    "                            the phases of the instrumentation to a JSON\n"
+    "                            file.\n"
     "  asan mode options:\n"
     "    --asan-rtl-options=OPTIONS\n"
     "                            Allows specification of options that will\n"
@@ -91,11 +111,31 @@ static const char kUsageFormatStr[] =
     "                            these options see common/asan_parameters. If\n"
     "                            not specified then the defaults of the RTL\n"
     "                            will be used.\n"
+    "    --basic-block-entry-counts=PATH\n"
+    "                            The basic-block entry counts of the input\n"
+    "                            image, as produced by the bbentry grinder.\n"
+    "                            The hottest basic blocks are instrumented\n"
+    "                            more sparsely to stay within the\n"
+    "                            instrumentation budget.\n"
+    "    --hoist-loop-checks     Hoists the checks of the loop-invariant\n"
+    "                            accesses of simple loops out of them.\n"
     "    --hot-patching          Use hot patching Asan instrumentation.\n"
+    "    --instrumentation-budget=DOUBLE\n"
+    "                            Specifies the fraction of the profiled basic\n"
+    "                            block executions that remain instrumented,\n"
+    "                            as a value in the range 0..1, inclusive.\n"
+    "                            Requires --basic-block-entry-counts.\n"
+    "                            Defaults to 1.\n"
     "    --instrumentation-rate=DOUBLE\n"
     "                            Specifies the fraction of instructions to\n"
     "                            be instrumented, as a value in the range\n"
     "                            0..1, inclusive. Defaults to 1.\n"
+    "    --jobs=N                The number of threads on which the blocks\n"
+    "                            are decomposed and transformed. Defaults to\n"
+    "                            the number of processors. Ignored with\n"
+    "                            --hot-patching.\n"
+    "    --no-check-coalescing   Disables the coalescing of the checks of\n"
+    "                            nearby memory accesses.\n"
     "    --no-interceptors       Disable the interception of the functions\n"
     "                            like memset, memcpy, stcpy, ReadFile... to\n"
     "                            check their parameters.\n"
@@ -103,11 +143,25 @@ static const char kUsageFormatStr[] =
     "                            analysis.\n"
     "    --no-redundancy-analysis\n"
     "                            Disables redundant memory access analysis.\n"
+    "  bbentry mode options:\n"
+    "    --fs-slot=<slot>        Specify which FS slot holds the counters of\n"
+    "                            the threads for the inline fast path.\n"
+    "                            Defaults to 1.\n"
     "  branch mode options:\n"
     "    --buffering             Enable per-thread buffering of events.\n"
     "    --fs-slot=<slot>        Specify which FS slot to use for thread\n"
     "                            local storage.\n"
+    "    --inline-buffering      Append the events to the per-thread buffer\n"
+    "                            inline, only calling the agent when it's\n"
+    "                            full. Requires --fs-slot.\n"
+    "  coverage mode options:\n"
+    "    --self-removing-probes  Instrument each basic block with a call to\n"
+    "                            the agent that patches itself out on the\n"
+    "                            first visit, rather than with an inline\n"
+    "                            store executed on every visit.\n"
     "  calltrace mode options:\n"
+    "    --direct-call-stubs     Hook direct calls with a stub prepended to\n"
+    "                            the callee rather than with a thunk.\n"
     "    --instrument-imports    Also instrument calls to imports.\n"
     "    --module-entry-only     If specified then the per-function entry\n"
     "                            hook will not be used and only module entry\n"
@@ -116,6 +170,8 @@ static const char kUsageFormatStr[] =
     "                            between code blocks that contain anything\n"
     "                            but C/C++.\n"
     "  profile mode options:\n"
+    "    --direct-call-stubs     Hook direct calls with a stub prepended to\n"
+    "                            the callee rather than with a thunk.\n"
     "    --instrument-imports    Also instrument calls to imports.\n"
     "\n";
 
@@ -126,6 +182,42 @@ InstrumenterInterface* AsanInstrumenterFactory() {
   return new instrumenters::AsanInstrumenter();
 }
 
+// Creates the instrumenter of a PE instrumentation mode.
+// @param mode The name of the mode.
+// @returns the instrumenter, or NULL if the mode is unknown.
+instrumenters::InstrumenterWithRelinker* CreateInstrumenter(
+    const std::string& mode) {
+  if (base::LowerCaseEqualsASCII(mode, "asan"))
+    return new instrumenters::AsanInstrumenter();
+  if (base::LowerCaseEqualsASCII(mode, "bbentry"))
+    return new instrumenters::BasicBlockEntryInstrumenter();
+  if (base::LowerCaseEqualsASCII(mode, "branch"))
+    return new instrumenters::BranchInstrumenter();
+  if (base::LowerCaseEqualsASCII(mode, "calltrace")) {
+    return new instrumenters::EntryThunkInstrumenter(
+        instrumenters::EntryThunkInstrumenter::CALL_TRACE);
+  }
+  if (base::LowerCaseEqualsASCII(mode, "coverage"))
+    return new instrumenters::CoverageInstrumenter();
+  if (base::LowerCaseEqualsASCII(mode, "flummox"))
+    return new instrumenters::FlummoxInstrumenter();
+  if (base::LowerCaseEqualsASCII(mode, "profile"))
+    return new instrumenters::EntryCallInstrumenter();
+  return NULL;
+}
+
+// Instruments a flavour, as the work items of a WorkPool. The flavours are
+// independent, so they can be instrumented on any number of threads.
+// @param flavours the flavours.
+// @param index the index of the flavour to instrument.
+// @returns true on success, false otherwise.
+bool InstrumentFlavour(
+    const std::vector<std::unique_ptr<instrumenters::InstrumenterWithRelinker>>*
+        flavours,
+    size_t index) {
+  return flavours->at(index)->Instrument();
+}
+
 }  // namespace
 
 void InstrumentApp::ParseDeprecatedMode(const base::CommandLine* cmd_line) {
@@ -161,6 +253,9 @@ bool InstrumentApp::ParseCommandLine(const base::CommandLine* cmd_line) {
   if (cmd_line->HasSwitch("help"))
     return Usage(cmd_line, "");
 
+  if (cmd_line->HasSwitch("flavours"))
+    return ParseFlavours(cmd_line);
+
   // Get the mode and the default client DLL.
   if (!cmd_line->HasSwitch("mode")) {
     // TODO(chrisha): Remove this once build scripts and profiling tools have
@@ -173,31 +268,117 @@ bool InstrumentApp::ParseCommandLine(const base::CommandLine* cmd_line) {
       // that it can transparently handle .lib files.
       instrumenter_.reset(new instrumenters::ArchiveInstrumenter(
           &AsanInstrumenterFactory));
-    } else if (base::LowerCaseEqualsASCII(mode, "bbentry")) {
-      instrumenter_.reset(new instrumenters::BasicBlockEntryInstrumenter());
-    } else if (base::LowerCaseEqualsASCII(mode, "branch")) {
-      instrumenter_.reset(new instrumenters::BranchInstrumenter());
-    } else if (base::LowerCaseEqualsASCII(mode, "calltrace")) {
-      instrumenter_.reset(new instrumenters::EntryThunkInstrumenter(
-          instrumenters::EntryThunkInstrumenter::CALL_TRACE));
-    } else if (base::LowerCaseEqualsASCII(mode, "coverage")) {
-      instrumenter_.reset(new instrumenters::CoverageInstrumenter());
-    } else if (base::LowerCaseEqualsASCII(mode, "flummox")) {
-      instrumenter_.reset(new instrumenters::FlummoxInstrumenter());
-    } else if (base::LowerCaseEqualsASCII(mode, "profile")) {
-      instrumenter_.reset(new instrumenters::EntryCallInstrumenter());
     } else {
-      return Usage(cmd_line,
-                   base::StringPrintf("Unknown instrumentation mode: %s.",
-                                      mode.c_str()).c_str());
+      instrumenter_.reset(CreateInstrumenter(mode));
+      if (instrumenter_.get() == NULL) {
+        return Usage(cmd_line,
+                     base::StringPrintf("Unknown instrumentation mode: %s.",
+                                        mode.c_str()).c_str());
+      }
     }
   }
   DCHECK(instrumenter_.get() != NULL);
 
+  instrumenter_->set_thread_count(jobs());
   return instrumenter_->ParseCommandLine(cmd_line);
 }
 
+bool InstrumentApp::ParseFlavours(const base::CommandLine* cmd_line) {
+  DCHECK(cmd_line != NULL);
+  DCHECK(flavours_.empty());
+
+  base::FilePath flavours_path = application::AppImplBase::AbsolutePath(
+      cmd_line->GetSwitchValuePath("flavours"));
+  std::string flavours;
+  if (!base::ReadFileToString(flavours_path, &flavours)) {
+    LOG(ERROR) << "Unable to read flavours file ""
+               << flavours_path.value() << "".";
+    return false;
+  }
+
+  std::vector<std::string> lines = base::SplitString(
+      flavours, "\n", base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY);
+  std::set<base::FilePath> output_image_paths;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    if (lines[i][0] == '#')
+      continue;
+
+    // The switches of the line override those of the command-line.
+    base::CommandLine flavour_cmd_line(cmd_line->GetProgram());
+    base::CommandLine::SwitchMap::const_iterator it =
+        cmd_line->GetSwitches().begin();
+    for (; it != cmd_line->GetSwitches().end(); ++it) {
+      if (it->first != "flavours")
+        flavour_cmd_line.AppendSwitchNative(it->first, it->second);
+    }
+    base::CommandLine line_cmd_line = base::CommandLine::FromString(
+        L"instrument.exe " + base::UTF8ToWide(lines[i]));
+    it = line_cmd_line.GetSwitches().begin();
+    for (; it != line_cmd_line.GetSwitches().end(); ++it)
+      flavour_cmd_line.AppendSwitchNative(it->first, it->second);
+
+    std::string mode = flavour_cmd_line.GetSwitchValueASCII("mode");
+    std::unique_ptr<instrumenters::InstrumenterWithRelinker> flavour(
+        CreateInstrumenter(mode));
+    if (flavour.get() == NULL) {
+      return Usage(cmd_line,
+                   base::StringPrintf("Unknown instrumentation mode of "
+                                      "flavour: \"%s\".",
+                                      lines[i].c_str()).c_str());
+    }
+    if (!flavour->ParseCommandLine(&flavour_cmd_line))
+      return false;
+
+    // The flavours share the decomposition of their input image, and must
+    // not write to the same output image.
+    if (!flavours_.empty() &&
+        (flavour->input_image_path() != flavours_[0]->input_image_path() ||
+         flavour->input_pdb_path() != flavours_[0]->input_pdb_path())) {
+      LOG(ERROR) << "All the flavours must have the same input image.";
+      return false;
+    }
+    if (!output_image_paths.insert(flavour->output_image_path()).second) {
+      LOG(ERROR) << "Several flavours have the output image \""
+                 << flavour->output_image_path().value() << "\".";
+      return false;
+    }
+
+    flavours_.push_back(std::move(flavour));
+  }
+
+  if (flavours_.empty()) {
+    LOG(ERROR) << "The flavours file \"" << flavours_path.value()
+               << "\" has no flavour.";
+    return false;
+  }
+
+  return true;
+}
+
+bool InstrumentApp::RunFlavours() {
+  DCHECK(!flavours_.empty());
+
+  std::vector<uint8_t> decomposition;
+  if (!pe::PERelinker::DecomposeToBuffer(flavours_[0]->input_image_path(),
+                                         flavours_[0]->input_pdb_path(),
+                                         &decomposition)) {
+    return false;
+  }
+  for (size_t i = 0; i < flavours_.size(); ++i)
+    flavours_[i]->set_decomposition(&decomposition);
+
+  // The jobs are shared between the flavours. A flavour that fails logs why.
+  size_t flavour_jobs = std::max<size_t>(1, jobs() / flavours_.size());
+  for (size_t i = 0; i < flavours_.size(); ++i)
+    flavours_[i]->set_thread_count(flavour_jobs);
+  application::WorkPool pool(jobs());
+  return pool.Run(flavours_.size(), base::Bind(&InstrumentFlavour, &flavours_));
+}
+
 int InstrumentApp::Run() {
+  if (!flavours_.empty())
+    return RunFlavours() ? 0 : 1;
+
   DCHECK(instrumenter_.get() != NULL);
 
   return instrumenter_->Instrument() ? 0 : 1;
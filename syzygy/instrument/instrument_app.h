@@ -18,12 +18,16 @@
 #ifndef SYZYGY_INSTRUMENT_INSTRUMENT_APP_H_
 #define SYZYGY_INSTRUMENT_INSTRUMENT_APP_H_
 
+#include <memory>
+#include <vector>
+
 #include "base/command_line.h"
 #include "base/files/file_path.h"
 #include "base/strings/string_piece.h"
 #include "base/time/time.h"
 #include "syzygy/application/application.h"
 #include "syzygy/instrument/instrumenter.h"
+#include "syzygy/instrument/instrumenters/instrumenter_with_relinker.h"
 
 namespace instrument {
 
@@ -55,8 +59,25 @@ class InstrumentApp : public application::AppImplBase {
   //     been updated.
   void ParseDeprecatedMode(const base::CommandLine* command_line);
 
-  // The instrumenter we delegate to.
+  // Parses the flavours of a multi-output invocation. Each line of the
+  // flavours file holds the switches of a flavour, which are combined with
+  // the switches of the command-line.
+  // @param command_line The command-line, with a --flavours switch.
+  // @returns true on success, false otherwise.
+  bool ParseFlavours(const base::CommandLine* command_line);
+
+  // Decomposes the input image once, then instruments all the flavours in
+  // parallel from the shared decomposition.
+  // @returns true on success, false otherwise.
+  bool RunFlavours();
+
+  // The instrumenter we delegate to. This is empty if there are flavours.
   std::unique_ptr<InstrumenterInterface> instrumenter_;
+
+  // The instrumenters of the flavours of a multi-output invocation, which
+  // all share the same input image.
+  std::vector<std::unique_ptr<instrumenters::InstrumenterWithRelinker>>
+      flavours_;
 };
 
 }  // namespace instrument
@@ -15,6 +15,7 @@
 #include "syzygy/instrument/instrument_app.h"
 
 #include "base/environment.h"
+#include "base/files/file_util.h"
 #include "base/strings/stringprintf.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -33,6 +34,7 @@ namespace {
 
 class TestInstrumentApp : public InstrumentApp {
  public:
+  using InstrumentApp::flavours_;
   using InstrumentApp::instrumenter_;
 };
 
@@ -72,6 +74,15 @@ class InstrumentAppTest : public testing::PELibUnitTest {
     ASSERT_NO_FATAL_FAILURE(ConfigureTestApp(&test_app_));
   }
 
+  // Writes a flavours file and points the command-line at it.
+  void WriteFlavours(const std::string& flavours) {
+    base::FilePath flavours_path = temp_dir_.Append(L"flavours.txt");
+    ASSERT_EQ(static_cast<int>(flavours.size()),
+              base::WriteFile(flavours_path, flavours.data(),
+                              static_cast<int>(flavours.size())));
+    cmd_line_.AppendSwitchPath("flavours", flavours_path);
+  }
+
   // Points the application at the fixture's command-line and IO streams.
   template<typename TestAppType>
   void ConfigureTestApp(TestAppType* test_app) {
@@ -181,4 +192,64 @@ TEST_F(InstrumentAppTest, Run) {
   ASSERT_EQ(0, test_impl_.Run());
 }
 
+TEST_F(InstrumentAppTest, ParseFlavours) {
+  cmd_line_.AppendSwitchPath("input-image", input_dll_path_);
+  ASSERT_NO_FATAL_FAILURE(WriteFlavours(base::StringPrintf(
+      "# The flavours of the test DLL.\n"
+      "--mode=calltrace --output-image=%ls\n"
+      "\n"
+      "--mode=profile --output-image=%ls\n",
+      temp_dir_.Append(L"calltrace.dll").value().c_str(),
+      temp_dir_.Append(L"profile.dll").value().c_str())));
+
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(test_impl_.instrumenter_.get() == NULL);
+  ASSERT_EQ(2u, test_impl_.flavours_.size());
+  EXPECT_EQ(abs_input_dll_path_,
+            test_impl_.flavours_[0]->input_image_path());
+  EXPECT_EQ(abs_input_dll_path_,
+            test_impl_.flavours_[1]->input_image_path());
+  EXPECT_EQ(temp_dir_.Append(L"profile.dll"),
+            test_impl_.flavours_[1]->output_image_path());
+}
+
+TEST_F(InstrumentAppTest, ParseFlavoursFails) {
+  cmd_line_.AppendSwitchPath("input-image", input_dll_path_);
+
+  // The flavours of an invalid file aren't parsed.
+  base::CommandLine cmd_line(cmd_line_);
+  cmd_line.AppendSwitchPath("flavours", temp_dir_.Append(L"missing.txt"));
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line));
+
+  // Two flavours can't have the same output image.
+  ASSERT_NO_FATAL_FAILURE(WriteFlavours(base::StringPrintf(
+      "--mode=calltrace --output-image=%ls\n"
+      "--mode=profile --output-image=%ls\n",
+      output_dll_path_.value().c_str(),
+      output_dll_path_.value().c_str())));
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(InstrumentAppTest, ParseFlavoursWithUnknownModeFails) {
+  cmd_line_.AppendSwitchPath("input-image", input_dll_path_);
+  ASSERT_NO_FATAL_FAILURE(WriteFlavours(base::StringPrintf(
+      "--mode=foo --output-image=%ls\n", output_dll_path_.value().c_str())));
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(InstrumentAppTest, RunFlavours) {
+  base::FilePath calltrace_path = temp_dir_.Append(L"calltrace.dll");
+  base::FilePath profile_path = temp_dir_.Append(L"profile.dll");
+  cmd_line_.AppendSwitchPath("input-image", input_dll_path_);
+  ASSERT_NO_FATAL_FAILURE(WriteFlavours(base::StringPrintf(
+      "--mode=calltrace --output-image=%ls\n"
+      "--mode=profile --output-image=%ls\n",
+      calltrace_path.value().c_str(), profile_path.value().c_str())));
+
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  ASSERT_EQ(0, test_impl_.Run());
+  EXPECT_TRUE(base::PathExists(calltrace_path));
+  EXPECT_TRUE(base::PathExists(profile_path));
+}
+
 }  // namespace instrument
@@ -30,6 +30,10 @@ class InstrumenterInterface {
   // @returns true on success, false otherwise.
   virtual bool ParseCommandLine(const base::CommandLine* command_line) = 0;
 
+  // Sets the number of threads the instrumentation may run on.
+  // @param thread_count the number of threads, which must be at least 1.
+  virtual void set_thread_count(size_t thread_count) = 0;
+
   // Do the instrumentation.
   virtual bool Instrument() = 0;
 };
@@ -20,6 +20,7 @@
 #include "syzygy/instrument/instrumenters/archive_instrumenter.h"
 
 #include "base/bind.h"
+#include "base/sys_info.h"
 #include "base/files/file_util.h"
 #include "syzygy/ar/ar_transform.h"
 #include "syzygy/core/file_util.h"
@@ -35,11 +36,15 @@ const char kOutputImage[] = "output-image";
 }  // namespace
 
 ArchiveInstrumenter::ArchiveInstrumenter()
-    : factory_(NULL), overwrite_(false) {
+    : factory_(NULL),
+      thread_count_(base::SysInfo::NumberOfProcessors()),
+      overwrite_(false) {
 }
 
 ArchiveInstrumenter::ArchiveInstrumenter(InstrumenterFactoryFunction factory)
-    : factory_(factory), overwrite_(false) {
+    : factory_(factory),
+      thread_count_(base::SysInfo::NumberOfProcessors()),
+      overwrite_(false) {
   DCHECK_NE(reinterpret_cast<InstrumenterFactoryFunction>(NULL), factory);
 }
 
@@ -96,6 +101,7 @@ bool ArchiveInstrumenter::InstrumentPassthrough() {
   DCHECK_NE(reinterpret_cast<InstrumenterInterface*>(NULL),
             instrumenter.get());
 
+  instrumenter->set_thread_count(thread_count_);
   if (!instrumenter->ParseCommandLine(command_line_.get()))
     return false;
 
@@ -114,7 +120,9 @@ bool ArchiveInstrumenter::InstrumentArchive() {
 
   LOG(INFO) << "Instrumenting archive: " << input_image_.value();
 
-  // Configure and run an archive transform.
+  // Configure and run an archive transform. The files of the archive are
+  // independent, and each is instrumented by its own instrumenter, so they
+  // are instrumented concurrently.
   ar::OnDiskArTransformAdapter::TransformFileOnDiskCallback callback =
       base::Bind(&ArchiveInstrumenter::InstrumentFile, base::Unretained(this));
   ar::OnDiskArTransformAdapter on_disk_adapter(callback);
@@ -122,6 +130,7 @@ bool ArchiveInstrumenter::InstrumentArchive() {
   ar_transform.set_callback(on_disk_adapter.outer_callback());
   ar_transform.set_input_archive(input_image_);
   ar_transform.set_output_archive(output_image_);
+  ar_transform.set_thread_count(thread_count_);
   if (!ar_transform.Transform())
     return false;
 
@@ -46,6 +46,8 @@ class ArchiveInstrumenter : public InstrumenterInterface {
   // @returns the factory function being used by this instrumenter
   //     adapter.
   InstrumenterFactoryFunction factory() const { return factory_; }
+  // @returns the number of archive files that are instrumented concurrently.
+  size_t thread_count() const { return thread_count_; }
   // @}
 
   // @name Mutators.
@@ -59,6 +61,15 @@ class ArchiveInstrumenter : public InstrumenterInterface {
   // @name InstrumenterInterface implementation.
   virtual bool ParseCommandLine(const base::CommandLine* command_line) override;
   virtual bool Instrument() override;
+  // Sets the number of archive files that are instrumented concurrently, or
+  // the number of threads of the underlying instrumenter when the input isn't
+  // an archive. This defaults to the number of processors. The instrumenters
+  // produced by the factory must not share any state if this is more than 1.
+  // @param thread_count the number of threads, which must be at least 1.
+  virtual void set_thread_count(size_t thread_count) override {
+    DCHECK_LT(0u, thread_count);
+    thread_count_ = thread_count;
+  }
   // @}
 
  private:
@@ -78,6 +89,9 @@ class ArchiveInstrumenter : public InstrumenterInterface {
   // The factory function that is used to produce instrumenter instances.
   InstrumenterFactoryFunction factory_;
 
+  // The number of archive files that are instrumented concurrently.
+  size_t thread_count_;
+
   // A copy of the command-line that we originally parsed.
   std::unique_ptr<base::CommandLine> command_line_;
 
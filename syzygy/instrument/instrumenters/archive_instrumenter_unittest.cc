@@ -53,6 +53,9 @@ class IdentityInstrumenter : public InstrumenterInterface {
     return true;
   }
 
+  virtual void set_thread_count(size_t thread_count) override {
+  }
+
   virtual bool Instrument() override {
     ++instrument_count;
     base::CopyFile(input_image_, output_image_);
@@ -122,8 +125,18 @@ TEST_F(ArchiveInstrumenterTest, PassthroughForNonArchive) {
   EXPECT_TRUE(base::PathExists(output_image_));
 }
 
+TEST_F(ArchiveInstrumenterTest, Accessors) {
+  ArchiveInstrumenter inst(&IdentityInstrumenterFactory);
+  EXPECT_EQ(&IdentityInstrumenterFactory, inst.factory());
+  EXPECT_LT(0u, inst.thread_count());
+  inst.set_thread_count(3);
+  EXPECT_EQ(3u, inst.thread_count());
+}
+
 TEST_F(ArchiveInstrumenterTest, IteratesOverArchiveFiles) {
   ArchiveInstrumenter inst(&IdentityInstrumenterFactory);
+  // The identity instrumenter updates global state.
+  inst.set_thread_count(1);
   command_line_->AppendSwitchPath("input-image", zlib_lib_);
 
   EXPECT_TRUE(inst.ParseCommandLine(command_line_.get()));
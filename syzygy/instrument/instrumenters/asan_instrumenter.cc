@@ -18,10 +18,17 @@
 
 #include "base/logging.h"
 #include "base/files/file_util.h"
+#include "base/strings/string_number_conversions.h"
 #include "syzygy/application/application.h"
+#include "syzygy/grinder/basic_block_util.h"
+#include "syzygy/grinder/indexed_frequency_data_serializer.h"
 #include "syzygy/instrument/transforms/allocation_filter_transform.h"
+#include "syzygy/pe/pe_file.h"
 
 namespace {
+  using grinder::basic_block_util::FindIndexedFrequencyInfo;
+  using grinder::basic_block_util::IndexedFrequencyInformation;
+  using grinder::basic_block_util::ModuleIndexedFrequencyMap;
   using instrument::transforms::AllocationFilterTransform;
 }
 
@@ -31,8 +38,11 @@ namespace instrumenters {
 AsanInstrumenter::AsanInstrumenter()
     : use_interceptors_(true),
       remove_redundant_checks_(true),
+      coalesce_checks_(true),
+      hoist_loop_invariant_checks_(false),
       use_liveness_analysis_(true),
       instrumentation_rate_(1.0),
+      instrumentation_budget_(1.0),
       asan_rtl_options_(false),
       hot_patching_(false) {
 }
@@ -66,13 +76,63 @@ bool AsanInstrumenter::InstrumentImpl() {
     }
   }
 
+  // Load the basic-block entry counts if they were provided.
+  if (!entry_counts_path_.empty()) {
+    if (image_format_ != BlockGraph::PE_IMAGE) {
+      LOG(ERROR) << "Basic-block entry counts are only supported for PE "
+                 << "images.";
+      return false;
+    }
+
+    pe::PEFile pe_file;
+    if (!pe_file.Init(input_image_path_)) {
+      LOG(ERROR) << "Failed to read PE file: " << input_image_path_.value();
+      return false;
+    }
+    pe::PEFile::Signature signature;
+    pe_file.GetSignature(&signature);
+
+    ModuleIndexedFrequencyMap module_entry_counts;
+    grinder::IndexedFrequencyDataSerializer serializer;
+    if (!serializer.Load(entry_counts_path_, &module_entry_counts)) {
+      LOG(ERROR) << "Failed to load basic-block entry counts: "
+                 << entry_counts_path_.value();
+      return false;
+    }
+
+    const IndexedFrequencyInformation* information = nullptr;
+    if (!FindIndexedFrequencyInfo(signature, module_entry_counts,
+                                  &information)) {
+      LOG(ERROR) << "Failed to find basic-block entry counts for '"
+                 << signature.path << "'.";
+      return false;
+    }
+    DCHECK_NE(static_cast<const IndexedFrequencyInformation*>(nullptr),
+              information);
+    if (information->data_type !=
+            common::IndexedFrequencyData::BASIC_BLOCK_ENTRY) {
+      LOG(ERROR) << "The file " << entry_counts_path_.value()
+                 << " doesn't contain basic-block entry counts.";
+      return false;
+    }
+    entry_counts_ = information->frequency_map;
+  }
+
   asan_transform_.reset(new instrument::transforms::AsanTransform());
   asan_transform_->set_instrument_dll_name(agent_dll_);
   asan_transform_->set_use_interceptors(use_interceptors_);
   asan_transform_->set_use_liveness_analysis(use_liveness_analysis_);
   asan_transform_->set_remove_redundant_checks(remove_redundant_checks_);
+  asan_transform_->set_coalesce_checks(coalesce_checks_);
+  asan_transform_->set_hoist_loop_invariant_checks(
+      hoist_loop_invariant_checks_);
   asan_transform_->set_instrumentation_rate(instrumentation_rate_);
+  if (!entry_counts_path_.empty()) {
+    asan_transform_->set_entry_counts(&entry_counts_);
+    asan_transform_->set_instrumentation_budget(instrumentation_budget_);
+  }
   asan_transform_->set_hot_patching(hot_patching_);
+  asan_transform_->set_thread_count(thread_count_);
 
   // Set up the filter if one was provided.
   if (filter.get()) {
@@ -110,6 +170,8 @@ bool AsanInstrumenter::DoCommandLineParse(
   filter_path_ = command_line->GetSwitchValuePath("filter");
   use_liveness_analysis_ = !command_line->HasSwitch("no-liveness-analysis");
   remove_redundant_checks_ = !command_line->HasSwitch("no-redundancy-analysis");
+  coalesce_checks_ = !command_line->HasSwitch("no-check-coalescing");
+  hoist_loop_invariant_checks_ = command_line->HasSwitch("hoist-loop-checks");
   use_interceptors_ = !command_line->HasSwitch("no-interceptors");
   hot_patching_ = command_line->HasSwitch("hot-patching");
 
@@ -126,6 +188,26 @@ bool AsanInstrumenter::DoCommandLineParse(
     instrumentation_rate_ = std::max(0.0, std::min(1.0, d));
   }
 
+  // Parse the profile guided instrumentation density options.
+  entry_counts_path_ = command_line->GetSwitchValuePath(
+      "basic-block-entry-counts");
+  static const char kInstrumentationBudget[] = "instrumentation-budget";
+  if (command_line->HasSwitch(kInstrumentationBudget)) {
+    if (entry_counts_path_.empty()) {
+      LOG(ERROR) << "--" << kInstrumentationBudget << " requires "
+                 << "--basic-block-entry-counts.";
+      return false;
+    }
+    std::string s = command_line->GetSwitchValueASCII(kInstrumentationBudget);
+    double d = 0;
+    if (!base::StringToDouble(s, &d)) {
+      LOG(ERROR) << "Failed to parse floating point value: " << s;
+      return false;
+    }
+    // Cap the budget to the range of valid values [0, 1].
+    instrumentation_budget_ = std::max(0.0, std::min(1.0, d));
+  }
+
   // Parse Asan RTL options if present.
   static const char kAsanRtlOptions[] = "asan-rtl-options";
   asan_rtl_options_ = command_line->HasSwitch(kAsanRtlOptions);
@@ -55,8 +55,12 @@ class AsanInstrumenter : public InstrumenterWithAgent {
   base::FilePath filter_path_;
   bool use_interceptors_;
   bool remove_redundant_checks_;
+  bool coalesce_checks_;
+  bool hoist_loop_invariant_checks_;
   bool use_liveness_analysis_;
   double instrumentation_rate_;
+  base::FilePath entry_counts_path_;
+  double instrumentation_budget_;
   bool asan_rtl_options_;
   bool hot_patching_;
   // @}
@@ -64,6 +68,11 @@ class AsanInstrumenter : public InstrumenterWithAgent {
   // Valid if asan_rtl_options_ is true.
   common::InflatedAsanParameters asan_params_;
 
+  // The basic-block entry counts of the input image. Valid if
+  // entry_counts_path_ isn't empty.
+  instrument::transforms::AsanBasicBlockTransform::IndexedFrequencyMap
+      entry_counts_;
+
   // The transform for this agent.
   std::unique_ptr<instrument::transforms::AsanTransform> asan_transform_;
 
@@ -38,17 +38,22 @@ class TestAsanInstrumenter : public AsanInstrumenter {
   using AsanInstrumenter::allow_overwrite_;
   using AsanInstrumenter::asan_params_;
   using AsanInstrumenter::asan_rtl_options_;
+  using AsanInstrumenter::coalesce_checks_;
+  using AsanInstrumenter::hoist_loop_invariant_checks_;
   using AsanInstrumenter::debug_friendly_;
+  using AsanInstrumenter::entry_counts_path_;
   using AsanInstrumenter::filter_path_;
   using AsanInstrumenter::hot_patching_;
   using AsanInstrumenter::input_image_path_;
   using AsanInstrumenter::input_pdb_path_;
+  using AsanInstrumenter::instrumentation_budget_;
   using AsanInstrumenter::instrumentation_rate_;
   using AsanInstrumenter::no_augment_pdb_;
   using AsanInstrumenter::no_strip_strings_;
   using AsanInstrumenter::output_image_path_;
   using AsanInstrumenter::output_pdb_path_;
   using AsanInstrumenter::remove_redundant_checks_;
+  using AsanInstrumenter::thread_count_;
   using AsanInstrumenter::use_interceptors_;
   using AsanInstrumenter::use_liveness_analysis_;
   using InstrumenterWithAgent::CreateRelinker;
@@ -157,9 +162,14 @@ TEST_F(AsanInstrumenterTest, ParseMinimalAsan) {
   EXPECT_TRUE(instrumenter_.use_interceptors_);
   EXPECT_TRUE(instrumenter_.use_liveness_analysis_);
   EXPECT_TRUE(instrumenter_.remove_redundant_checks_);
+  EXPECT_TRUE(instrumenter_.coalesce_checks_);
+  EXPECT_FALSE(instrumenter_.hoist_loop_invariant_checks_);
   EXPECT_EQ(1.0, instrumenter_.instrumentation_rate_);
+  EXPECT_TRUE(instrumenter_.entry_counts_path_.empty());
+  EXPECT_EQ(1.0, instrumenter_.instrumentation_budget_);
   EXPECT_FALSE(instrumenter_.asan_rtl_options_);
   EXPECT_FALSE(instrumenter_.hot_patching_);
+  EXPECT_EQ(1u, instrumenter_.thread_count_);
 }
 
 TEST_F(AsanInstrumenterTest, ParseFullAsan) {
@@ -167,6 +177,7 @@ TEST_F(AsanInstrumenterTest, ParseFullAsan) {
   cmd_line_.AppendSwitchPath("filter", test_dll_filter_path_);
   cmd_line_.AppendSwitchASCII("agent", "foo.dll");
   cmd_line_.AppendSwitch("debug-friendly");
+  cmd_line_.AppendSwitch("hoist-loop-checks");
   cmd_line_.AppendSwitch("hot-patching");
   cmd_line_.AppendSwitchPath("input-pdb", input_pdb_path_);
   cmd_line_.AppendSwitch("no-augment-pdb");
@@ -176,7 +187,11 @@ TEST_F(AsanInstrumenterTest, ParseFullAsan) {
   cmd_line_.AppendSwitch("overwrite");
   cmd_line_.AppendSwitch("no-liveness-analysis");
   cmd_line_.AppendSwitch("no-redundancy-analysis");
+  cmd_line_.AppendSwitch("no-check-coalescing");
   cmd_line_.AppendSwitchASCII("instrumentation-rate", "0.5");
+  cmd_line_.AppendSwitchPath("basic-block-entry-counts",
+                             temp_dir_.Append(L"entry_counts.json"));
+  cmd_line_.AppendSwitchASCII("instrumentation-budget", "0.25");
   cmd_line_.AppendSwitchASCII("asan-rtl-options",
       "\"--quarantine_size=1024 --quarantine_block_size=512 --ignored\"");
 
@@ -195,7 +210,12 @@ TEST_F(AsanInstrumenterTest, ParseFullAsan) {
   EXPECT_FALSE(instrumenter_.use_interceptors_);
   EXPECT_FALSE(instrumenter_.use_liveness_analysis_);
   EXPECT_FALSE(instrumenter_.remove_redundant_checks_);
+  EXPECT_FALSE(instrumenter_.coalesce_checks_);
+  EXPECT_TRUE(instrumenter_.hoist_loop_invariant_checks_);
   EXPECT_EQ(0.5, instrumenter_.instrumentation_rate_);
+  EXPECT_EQ(temp_dir_.Append(L"entry_counts.json"),
+            instrumenter_.entry_counts_path_);
+  EXPECT_EQ(0.25, instrumenter_.instrumentation_budget_);
   EXPECT_TRUE(instrumenter_.asan_rtl_options_);
   EXPECT_TRUE(instrumenter_.hot_patching_);
 
@@ -252,6 +272,25 @@ TEST_F(AsanInstrumenterTest, FailsWithInvalidInstrumentationRate) {
   EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
 }
 
+TEST_F(AsanInstrumenterTest, InstrumentImplInParallel) {
+  SetUpValidCommandLine();
+  instrumenter_.set_thread_count(4);
+  EXPECT_EQ(4u, instrumenter_.thread_count());
+
+  EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(instrumenter_.InstrumentPrepare());
+  EXPECT_TRUE(instrumenter_.CreateRelinker());
+  EXPECT_TRUE(instrumenter_.InstrumentImpl());
+}
+
+TEST_F(AsanInstrumenterTest, FailsWithInstrumentationBudgetWithoutProfile) {
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitchASCII("instrumentation-budget", "0.5");
+
+  EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(AsanInstrumenterTest, FailsWithInvalidAsanRtlOptions) {
   cmd_line_.AppendSwitchPath("input-image", input_image_path_);
   cmd_line_.AppendSwitchPath("output-image", output_image_path_);
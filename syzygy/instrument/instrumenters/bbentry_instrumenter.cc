@@ -16,6 +16,7 @@
 
 #include "base/logging.h"
 #include "base/files/file_util.h"
+#include "base/strings/string_number_conversions.h"
 #include "syzygy/application/application.h"
 #include "syzygy/pe/image_filter.h"
 
@@ -24,9 +25,10 @@ namespace instrumenters {
 
 const char BasicBlockEntryInstrumenter::kAgentDllBasicBlockEntry[] =
     "basic_block_entry_client.dll";
+const uint32_t kNumSlots = 4U;
 
 BasicBlockEntryInstrumenter::BasicBlockEntryInstrumenter()
-    : inline_fast_path_(false) {
+    : inline_fast_path_(false), fs_slot_(0U) {
   agent_dll_ = kAgentDllBasicBlockEntry;
 }
 
@@ -39,6 +41,7 @@ bool BasicBlockEntryInstrumenter::InstrumentImpl() {
       new instrument::transforms::BasicBlockEntryHookTransform());
   bbentry_transform_->set_instrument_dll_name(agent_dll_);
   bbentry_transform_->set_inline_fast_path(inline_fast_path_);
+  bbentry_transform_->set_fs_slot(fs_slot_);
   bbentry_transform_->set_src_ranges_for_thunks(debug_friendly_);
   if (!relinker_->AppendTransform(bbentry_transform_.get()))
     return false;
@@ -61,6 +64,22 @@ bool BasicBlockEntryInstrumenter::DoCommandLineParse(
   // Parse the additional command line arguments.
   inline_fast_path_ = command_line->HasSwitch("inline-fast-path");
 
+  if (command_line->HasSwitch("fs-slot")) {
+    std::string fs_slot_str = command_line->GetSwitchValueASCII("fs-slot");
+    if (!base::StringToUint(fs_slot_str, &fs_slot_)) {
+      LOG(ERROR) << "Unrecognized FS-slot: not a valid number.";
+      return false;
+    }
+    if (fs_slot_ == 0 || fs_slot_ > kNumSlots) {
+      LOG(ERROR) << "fs-slot must be from 1 to " << kNumSlots << ".";
+      return false;
+    }
+  }
+
+  // The inline fast path reads the counters of the threads from a FS slot.
+  if (inline_fast_path_ && fs_slot_ == 0)
+    fs_slot_ = 1U;
+
   return true;
 }
 
@@ -35,6 +35,7 @@ class TestBasicBlockEntryInstrumenter : public BasicBlockEntryInstrumenter {
   using BasicBlockEntryInstrumenter::no_augment_pdb_;
   using BasicBlockEntryInstrumenter::no_strip_strings_;
   using BasicBlockEntryInstrumenter::inline_fast_path_;
+  using BasicBlockEntryInstrumenter::fs_slot_;
   using BasicBlockEntryInstrumenter::debug_friendly_;
   using BasicBlockEntryInstrumenter::kAgentDllBasicBlockEntry;
   using BasicBlockEntryInstrumenter::InstrumentPrepare;
@@ -124,6 +125,7 @@ TEST_F(BasicBlockEntryInstrumenterTest, ParseMinimalBasicBlockEntry) {
   EXPECT_FALSE(instrumenter_.no_strip_strings_);
   EXPECT_FALSE(instrumenter_.debug_friendly_);
   EXPECT_FALSE(instrumenter_.inline_fast_path_);
+  EXPECT_EQ(0U, instrumenter_.fs_slot_);
 }
 
 TEST_F(BasicBlockEntryInstrumenterTest, ParseFullBasicBlockEntry) {
@@ -146,11 +148,30 @@ TEST_F(BasicBlockEntryInstrumenterTest, ParseFullBasicBlockEntry) {
   EXPECT_EQ(std::string("foo.dll"), instrumenter_.agent_dll_);
   EXPECT_TRUE(instrumenter_.allow_overwrite_);
   EXPECT_TRUE(instrumenter_.inline_fast_path_);
+  EXPECT_EQ(1U, instrumenter_.fs_slot_);
   EXPECT_TRUE(instrumenter_.no_augment_pdb_);
   EXPECT_TRUE(instrumenter_.no_strip_strings_);
   EXPECT_TRUE(instrumenter_.debug_friendly_);
 }
 
+TEST_F(BasicBlockEntryInstrumenterTest, ParseFsSlot) {
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitch("inline-fast-path");
+  cmd_line_.AppendSwitchASCII("fs-slot", "3");
+
+  EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(instrumenter_.inline_fast_path_);
+  EXPECT_EQ(3U, instrumenter_.fs_slot_);
+}
+
+TEST_F(BasicBlockEntryInstrumenterTest, ParseInvalidFsSlotFail) {
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitch("inline-fast-path");
+  cmd_line_.AppendSwitchASCII("fs-slot", "5");
+
+  EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(BasicBlockEntryInstrumenterTest, InstrumentImpl) {
   SetUpValidCommandLine();
 
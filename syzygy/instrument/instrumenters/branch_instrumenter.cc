@@ -28,7 +28,7 @@ const char BranchInstrumenter::kAgentDllBasicBlockEntry[] =
 const uint32_t kNumSlots = 4U;
 
 BranchInstrumenter::BranchInstrumenter()
-    : buffering_(false), fs_slot_(0U) {
+    : buffering_(false), inline_buffering_(false), fs_slot_(0U) {
   agent_dll_ = kAgentDllBasicBlockEntry;
 }
 
@@ -41,6 +41,7 @@ bool BranchInstrumenter::InstrumentImpl() {
       new instrument::transforms::BranchHookTransform());
   branch_transform_->set_instrument_dll_name(agent_dll_);
   branch_transform_->set_buffering(buffering_);
+  branch_transform_->set_inline_buffering(inline_buffering_);
   branch_transform_->set_fs_slot(fs_slot_);
   if (!relinker_->AppendTransform(branch_transform_.get()))
     return false;
@@ -62,6 +63,7 @@ bool BranchInstrumenter::DoCommandLineParse(
 
   // Parse the additional command line arguments.
   buffering_ = command_line->HasSwitch("buffering");
+  inline_buffering_ = command_line->HasSwitch("inline-buffering");
 
   if (command_line->HasSwitch("fs-slot")) {
     std::string fs_slot_str = command_line->GetSwitchValueASCII("fs-slot");
@@ -74,6 +76,11 @@ bool BranchInstrumenter::DoCommandLineParse(
       return false;
     }
   }
+
+  if (inline_buffering_ && fs_slot_ == 0) {
+    LOG(ERROR) << "inline-buffering requires a fs-slot.";
+    return false;
+  }
   return true;
 }
 
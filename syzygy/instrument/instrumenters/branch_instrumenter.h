@@ -60,6 +60,7 @@ class BranchInstrumenter : public InstrumenterWithAgent {
   // @name Command-line parameters.
   // @{
   bool buffering_;
+  bool inline_buffering_;
   uint32_t fs_slot_;
   // @}
 };
@@ -38,6 +38,7 @@ class TestBranchInstrumenter : public BranchInstrumenter {
   using BranchInstrumenter::no_strip_strings_;
   using BranchInstrumenter::debug_friendly_;
   using BranchInstrumenter::buffering_;
+  using BranchInstrumenter::inline_buffering_;
   using BranchInstrumenter::fs_slot_;
   using BranchInstrumenter::kAgentDllBasicBlockEntry;
   using BranchInstrumenter::InstrumentPrepare;
@@ -128,6 +129,7 @@ TEST_F(BranchInstrumenterTest, ParseMinimalBranch) {
   EXPECT_FALSE(instrumenter_.no_strip_strings_);
   EXPECT_FALSE(instrumenter_.debug_friendly_);
   EXPECT_FALSE(instrumenter_.buffering_);
+  EXPECT_FALSE(instrumenter_.inline_buffering_);
   EXPECT_EQ(0U, instrumenter_.fs_slot_);
 }
 
@@ -143,6 +145,7 @@ TEST_F(BranchInstrumenterTest, ParseFullBranch) {
   cmd_line_.AppendSwitchPath("output-pdb", output_pdb_path_);
   cmd_line_.AppendSwitch("overwrite");
   cmd_line_.AppendSwitch("buffering");
+  cmd_line_.AppendSwitch("inline-buffering");
   cmd_line_.AppendSwitchASCII("fs-slot", "2");
 
   EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
@@ -157,9 +160,16 @@ TEST_F(BranchInstrumenterTest, ParseFullBranch) {
   EXPECT_TRUE(instrumenter_.no_strip_strings_);
   EXPECT_TRUE(instrumenter_.debug_friendly_);
   EXPECT_TRUE(instrumenter_.buffering_);
+  EXPECT_TRUE(instrumenter_.inline_buffering_);
   EXPECT_EQ(2U, instrumenter_.fs_slot_);
 }
 
+TEST_F(BranchInstrumenterTest, ParseInlineBufferingWithoutSlotFail) {
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitch("inline-buffering");
+  EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(BranchInstrumenterTest, ParseHugeSlotFail) {
   SetUpValidCommandLine();
   cmd_line_.AppendSwitchASCII("fs-slot", "8");
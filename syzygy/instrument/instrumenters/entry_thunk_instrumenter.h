@@ -66,6 +66,7 @@ class EntryThunkInstrumenter : public InstrumenterWithAgent {
   bool instrument_unsafe_references_;
   bool module_entry_only_;
   bool thunk_imports_;
+  bool direct_call_stubs_;
   // @}
 
   // The instrumentation mode.
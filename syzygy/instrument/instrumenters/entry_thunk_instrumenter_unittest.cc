@@ -37,6 +37,7 @@ class TestEntryThunkInstrumenter : public EntryThunkInstrumenter {
   using EntryThunkInstrumenter::instrument_unsafe_references_;
   using EntryThunkInstrumenter::module_entry_only_;
   using EntryThunkInstrumenter::thunk_imports_;
+  using EntryThunkInstrumenter::direct_call_stubs_;
   using EntryThunkInstrumenter::debug_friendly_;
   using EntryThunkInstrumenter::instrumentation_mode_;
   using EntryThunkInstrumenter::kAgentDllProfile;
@@ -135,6 +136,7 @@ TEST_F(EntryThunkInstrumenterTest, ParseMinimalCallTrace) {
   EXPECT_FALSE(instrumenter_->no_strip_strings_);
   EXPECT_FALSE(instrumenter_->debug_friendly_);
   EXPECT_FALSE(instrumenter_->thunk_imports_);
+  EXPECT_FALSE(instrumenter_->direct_call_stubs_);
   EXPECT_TRUE(instrumenter_->instrument_unsafe_references_);
   EXPECT_FALSE(instrumenter_->module_entry_only_);
 }
@@ -152,6 +154,7 @@ TEST_F(EntryThunkInstrumenterTest, ParseFullCallTrace) {
   cmd_line_.AppendSwitchPath("output-pdb", output_pdb_path_);
   cmd_line_.AppendSwitch("overwrite");
   cmd_line_.AppendSwitch("instrument-imports");
+  cmd_line_.AppendSwitch("direct-call-stubs");
   cmd_line_.AppendSwitch("module-entry-only");
   cmd_line_.AppendSwitch("no-unsafe-refs");
 
@@ -169,6 +172,7 @@ TEST_F(EntryThunkInstrumenterTest, ParseFullCallTrace) {
   EXPECT_TRUE(instrumenter_->no_strip_strings_);
   EXPECT_TRUE(instrumenter_->debug_friendly_);
   EXPECT_TRUE(instrumenter_->thunk_imports_);
+  EXPECT_TRUE(instrumenter_->direct_call_stubs_);
   EXPECT_FALSE(instrumenter_->instrument_unsafe_references_);
   EXPECT_TRUE(instrumenter_->module_entry_only_);
 }
@@ -193,6 +197,7 @@ TEST_F(EntryThunkInstrumenterTest, ParseMinimalProfile) {
   EXPECT_FALSE(instrumenter_->no_strip_strings_);
   EXPECT_FALSE(instrumenter_->debug_friendly_);
   EXPECT_FALSE(instrumenter_->thunk_imports_);
+  EXPECT_FALSE(instrumenter_->direct_call_stubs_);
   EXPECT_FALSE(instrumenter_->instrument_unsafe_references_);
   EXPECT_FALSE(instrumenter_->module_entry_only_);
 }
@@ -209,6 +214,7 @@ TEST_F(EntryThunkInstrumenterTest, ParseFullProfile) {
   cmd_line_.AppendSwitchPath("output-pdb", output_pdb_path_);
   cmd_line_.AppendSwitch("overwrite");
   cmd_line_.AppendSwitch("instrument-imports");
+  cmd_line_.AppendSwitch("direct-call-stubs");
 
   EXPECT_TRUE(instrumenter_->ParseCommandLine(&cmd_line_));
 
@@ -224,6 +230,7 @@ TEST_F(EntryThunkInstrumenterTest, ParseFullProfile) {
   EXPECT_TRUE(instrumenter_->no_strip_strings_);
   EXPECT_TRUE(instrumenter_->debug_friendly_);
   EXPECT_TRUE(instrumenter_->thunk_imports_);
+  EXPECT_TRUE(instrumenter_->direct_call_stubs_);
 }
 
 TEST_F(EntryThunkInstrumenterTest, InstrumentImplCallTrace) {
@@ -99,6 +99,8 @@ bool InstrumenterWithRelinker::DoCommandLineParse(
       command_line->GetSwitchValuePath("input-pdb"));
   output_pdb_path_ = application::AppImplBase::AbsolutePath(
       command_line->GetSwitchValuePath("output-pdb"));
+  perf_report_path_ = application::AppImplBase::AbsolutePath(
+      command_line->GetSwitchValuePath("perf-report"));
   allow_overwrite_ = command_line->HasSwitch("overwrite");
   debug_friendly_ = command_line->HasSwitch("debug-friendly");
   no_augment_pdb_ = command_line->HasSwitch("no-augment-pdb");
@@ -113,8 +115,14 @@ bool InstrumenterWithRelinker::CheckCommandLineParse(
 }
 
 bool InstrumenterWithRelinker::Instrument() {
-  if (!InstrumentPrepare())
-    return false;
+  core::PerfReport* report =
+      perf_report_path_.empty() ? nullptr : &perf_report_;
+
+  {
+    core::PerfReport::ScopedPhase phase(report, "prepare");
+    if (!InstrumentPrepare())
+      return false;
+  }
 
   if (!CreateRelinker())
     return false;
@@ -127,8 +135,11 @@ bool InstrumenterWithRelinker::Instrument() {
 
   // Let the instrumenter implementation set up the relinker and anything else
   // that is required.
-  if (!InstrumentImpl())
-    return false;
+  {
+    core::PerfReport::ScopedPhase phase(report, "instrument");
+    if (!InstrumentImpl())
+      return false;
+  }
 
   // Do the actual instrumentation by running the relinker.
   if (!relinker_->Relink()) {
@@ -136,6 +147,9 @@ bool InstrumenterWithRelinker::Instrument() {
     return false;
   }
 
+  if (report != nullptr && !report->Save(perf_report_path_))
+    return false;
+
   return true;
 }
 
@@ -195,6 +209,8 @@ bool InstrumenterWithRelinker::CreateRelinker() {
     relinker->set_input_path(input_image_path_);
     relinker->set_output_path(output_image_path_);
     relinker->set_allow_overwrite(allow_overwrite_);
+    if (!perf_report_path_.empty())
+      relinker->set_perf_report(&perf_report_);
   } else {
     pe::PERelinker* relinker = GetPERelinker();
     DCHECK_NE(reinterpret_cast<pe::PERelinker*>(nullptr), relinker);
@@ -206,6 +222,9 @@ bool InstrumenterWithRelinker::CreateRelinker() {
     relinker->set_allow_overwrite(allow_overwrite_);
     relinker->set_augment_pdb(!no_augment_pdb_);
     relinker->set_strip_strings(!no_strip_strings_);
+    relinker->set_decomposition(decomposition_);
+    if (!perf_report_path_.empty())
+      relinker->set_perf_report(&perf_report_);
   }
 
   DCHECK_EQ(image_format_, relinker_->image_format());
@@ -22,9 +22,12 @@
 #define  SYZYGY_INSTRUMENT_INSTRUMENTERS_INSTRUMENTER_WITH_RELINKER_H_
 
 #include <string>
+#include <vector>
 
 #include "base/command_line.h"
+#include "base/logging.h"
 #include "base/files/file_path.h"
+#include "syzygy/core/perf_report.h"
 #include "syzygy/instrument/instrumenter.h"
 #include "syzygy/pe/coff_relinker.h"
 #include "syzygy/pe/pe_relinker.h"
@@ -42,7 +45,9 @@ class InstrumenterWithRelinker : public InstrumenterInterface {
         allow_overwrite_(false),
         debug_friendly_(false),
         no_augment_pdb_(false),
-        no_strip_strings_(false) { }
+        no_strip_strings_(false),
+        thread_count_(1),
+        decomposition_(nullptr) { }
 
   ~InstrumenterWithRelinker() { }
 
@@ -50,8 +55,30 @@ class InstrumenterWithRelinker : public InstrumenterInterface {
   // @{
   bool ParseCommandLine(const base::CommandLine* command_line) final;
   bool Instrument() override;
+  void set_thread_count(size_t thread_count) final {
+    DCHECK_LT(0u, thread_count);
+    thread_count_ = thread_count;
+  }
   // @}
 
+  // @name Accessors.
+  // @{
+  const base::FilePath& input_image_path() const { return input_image_path_; }
+  const base::FilePath& input_pdb_path() const { return input_pdb_path_; }
+  const base::FilePath& output_image_path() const {
+    return output_image_path_;
+  }
+  size_t thread_count() const { return thread_count_; }
+  // @}
+
+  // Sets a decomposition of the input image shared with other instrumenters,
+  // as produced by pe::PERelinker::DecomposeToBuffer. This is only used for
+  // PE images. The buffer is not owned, and must outlive the call to
+  // Instrument.
+  void set_decomposition(const std::vector<uint8_t>* decomposition) {
+    decomposition_ = decomposition;
+  }
+
  protected:
   // Virtual method that determines whether or not the input object file
   // format is supported by the instrumenter. The default implementation
@@ -104,17 +131,28 @@ class InstrumenterWithRelinker : public InstrumenterInterface {
   base::FilePath input_pdb_path_;
   base::FilePath output_image_path_;
   base::FilePath output_pdb_path_;
+  base::FilePath perf_report_path_;
   bool allow_overwrite_;
   bool debug_friendly_;
   bool no_augment_pdb_;
   bool no_strip_strings_;
   // @}
 
+  // The number of threads the instrumentation may run on.
+  size_t thread_count_;
+
+  // The shared decomposition of the input image, if any.
+  const std::vector<uint8_t>* decomposition_;
+
   // This is used to save a pointer to the object returned by the call to
   // Get(PE|Coff)Relinker. Ownership of the object is internal in the default
   // case, but may be external during tests.
   pe::RelinkerInterface* relinker_;
 
+  // The durations and the memory usage of the phases of the instrumentation.
+  // This is only filled in and saved if a report path is given.
+  core::PerfReport perf_report_;
+
  private:
   // They are used as containers for holding policy and relinker objects that
   // are allocated by our default Get* implementations above.
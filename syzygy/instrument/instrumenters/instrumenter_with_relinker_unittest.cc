@@ -16,6 +16,7 @@
 
 #include "base/command_line.h"
 #include "base/files/file_path.h"
+#include "base/files/file_util.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
@@ -60,6 +61,7 @@ class TestInstrumenterWithRelinker : public InstrumenterWithRelinker {
   using InstrumenterWithRelinker::input_pdb_path_;
   using InstrumenterWithRelinker::output_image_path_;
   using InstrumenterWithRelinker::output_pdb_path_;
+  using InstrumenterWithRelinker::perf_report_path_;
   using InstrumenterWithRelinker::allow_overwrite_;
   using InstrumenterWithRelinker::no_augment_pdb_;
   using InstrumenterWithRelinker::no_strip_strings_;
@@ -195,6 +197,7 @@ TEST_F(InstrumenterWithRelinkerTest, ParseInputImages) {
   EXPECT_FALSE(instrumenter.allow_overwrite_);
   EXPECT_FALSE(instrumenter.no_augment_pdb_);
   EXPECT_FALSE(instrumenter.no_strip_strings_);
+  EXPECT_TRUE(instrumenter.perf_report_path_.empty());
 }
 
 TEST_F(InstrumenterWithRelinkerTest, InstrumentPE) {
@@ -210,6 +213,23 @@ TEST_F(InstrumenterWithRelinkerTest, InstrumentPE) {
   EXPECT_TRUE(instrumenter.Instrument());
 }
 
+TEST_F(InstrumenterWithRelinkerTest, InstrumentPEWithPerfReport) {
+  SetUpValidCommandLinePE();
+  base::FilePath perf_report_path(temp_dir_.Append(L"perf.json"));
+  cmd_line_.AppendSwitchPath("perf-report", perf_report_path);
+
+  TestInstrumenterWithRelinker instrumenter;
+  EXPECT_TRUE(instrumenter.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(perf_report_path, instrumenter.perf_report_path_);
+  EXPECT_CALL(instrumenter.mock_pe_relinker_, Init()).WillOnce(Return(true));
+  EXPECT_CALL(instrumenter.mock_pe_relinker_, Relink()).WillOnce(Return(true));
+  EXPECT_CALL(instrumenter, InstrumentPrepare()).WillOnce(Return(true));
+  EXPECT_CALL(instrumenter, InstrumentImpl()).WillOnce(Return(true));
+
+  EXPECT_TRUE(instrumenter.Instrument());
+  EXPECT_TRUE(base::PathExists(perf_report_path));
+}
+
 TEST_F(InstrumenterWithRelinkerTest, InstrumentCoff) {
   SetUpValidCommandLineCoff();
 
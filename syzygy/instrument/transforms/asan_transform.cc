@@ -15,7 +15,9 @@
 #include "syzygy/instrument/transforms/asan_transform.h"
 
 #include <algorithm>
+#include <functional>
 #include <list>
+#include <memory>
 #include <vector>
 
 #include "base/logging.h"
@@ -29,6 +31,9 @@
 #include "syzygy/block_graph/block_builder.h"
 #include "syzygy/block_graph/block_util.h"
 #include "syzygy/block_graph/typed_block.h"
+#include "syzygy/block_graph/analysis/control_flow_analysis.h"
+#include "syzygy/agent/asan/constants.h"
+#include "syzygy/block_graph/analysis/liveness_analysis_internal.h"
 #include "syzygy/common/defs.h"
 #include "syzygy/instrument/transforms/asan_intercepts.h"
 #include "syzygy/instrument/transforms/entry_thunk_transform.h"
@@ -46,6 +51,7 @@ namespace {
 
 using block_graph::BasicBlock;
 using block_graph::BasicCodeBlock;
+using block_graph::BasicDataBlock;
 using block_graph::BasicBlockAssembler;
 using block_graph::BasicBlockSubGraph;
 using block_graph::BasicBlockReference;
@@ -55,8 +61,10 @@ using block_graph::Displacement;
 using block_graph::Immediate;
 using block_graph::Instruction;
 using block_graph::Operand;
+using block_graph::Successor;
 using block_graph::TransformPolicyInterface;
 using block_graph::TypedBlock;
+using block_graph::analysis::ControlFlowAnalysis;
 using block_graph::analysis::LivenessAnalysis;
 using block_graph::analysis::MemoryAccessAnalysis;
 using assm::Register32;
@@ -295,7 +303,7 @@ void InjectAsanHook(BasicBlockAssembler* bb_asm,
   if (info.mode == AsanBasicBlockTransform::kReadAccess ||
       info.mode == AsanBasicBlockTransform::kWriteAccess) {
     // Load/store probe.
-    bb_asm->push(assm::edx);
+    bb_asm->push<assm::kRegisterEdx>();
     bb_asm->lea(assm::edx, op);
   }
 
@@ -353,6 +361,336 @@ std::string GetAsanCheckAccessFunctionName(
   return function_name;
 }
 
+// The maximum distance between the addresses checked by a group of coalesced
+// memory access checks. See agent::asan::kMaxSmallRangeSize.
+const int32_t kMaxCoalescedCheckSpan =
+    static_cast<int32_t>(agent::asan::kMaxSmallRangeSize);
+
+// A memory access check to be injected in a basic block.
+struct MemoryAccessCheck {
+  MemoryAccessCheck(BasicBlock::Instructions::iterator instr,
+                    const BasicBlockAssembler::Operand& operand,
+                    const AsanBasicBlockTransform::MemoryAccessInfo& info,
+                    const LivenessAnalysis::State& state)
+      : where(instr), instr(instr), operand(operand), info(info),
+        state(state), coalesced(false), hoisted(false) {
+  }
+
+  // The instruction before which the check is injected.
+  BasicBlock::Instructions::iterator where;
+  // The instruction performing the access.
+  BasicBlock::Instructions::iterator instr;
+  // The address being checked.
+  BasicBlockAssembler::Operand operand;
+  // The kind of access being checked.
+  AsanBasicBlockTransform::MemoryAccessInfo info;
+  // The liveness information at |where|.
+  LivenessAnalysis::State state;
+  // Set to true if the check is subsumed by the other checks of its group.
+  bool coalesced;
+  // Set to true if the check is hoisted to the pre-header of the loop, in
+  // which case |where| is an iterator into the pre-header's instructions.
+  bool hoisted;
+};
+
+// Returns the displacement of the address checked by @p check.
+int32_t GetCheckDisplacement(const MemoryAccessCheck& check) {
+  return static_cast<int32_t>(check.operand.displacement().value());
+}
+
+// Returns true if the check @p check may be coalesced with others, i.e. if
+// it's a standard load/store through a base register with a constant
+// displacement.
+bool IsCoalescableCheck(const MemoryAccessCheck& check) {
+  if (check.info.mode != AsanBasicBlockTransform::kReadAccess &&
+      check.info.mode != AsanBasicBlockTransform::kWriteAccess) {
+    return false;
+  }
+  return check.operand.base() != assm::kRegisterNone &&
+      check.operand.index() == assm::kRegisterNone &&
+      !check.operand.displacement().reference().IsValid();
+}
+
+// Returns true if the instructions in [@p begin, @p end) neither modify the
+// register @p reg nor transfer control elsewhere.
+bool InstructionsPreserveRegister(
+    BasicBlock::Instructions::const_iterator begin,
+    BasicBlock::Instructions::const_iterator end,
+    assm::RegisterId reg) {
+  for (; begin != end; ++begin) {
+    if (begin->IsCall() || begin->IsControlFlow())
+      return false;
+
+    LivenessAnalysis::State defs;
+    LivenessAnalysis::StateHelper::Clear(&defs);
+    if (!LivenessAnalysis::StateHelper::GetDefsOf(*begin, &defs))
+      return false;
+    if (defs.IsLive(assm::Register::Get(reg)))
+      return false;
+  }
+  return true;
+}
+
+// Coalesces the checks of accesses made through the same base register with
+// nearby constant displacements, like the accesses to the fields of a
+// structure. Only the checks of the lowest and highest addresses of each group
+// are kept, and they are hoisted before the first access of the group. Groups
+// of fewer than three checks are left alone as nothing would be saved.
+// @param checks The checks of a basic block, in instruction order.
+void CoalesceMemoryAccessChecks(std::vector<MemoryAccessCheck>* checks) {
+  DCHECK_NE(static_cast<std::vector<MemoryAccessCheck>*>(nullptr), checks);
+
+  std::vector<bool> grouped(checks->size(), false);
+  for (size_t i = 0; i < checks->size(); ++i) {
+    MemoryAccessCheck& first = (*checks)[i];
+    if (grouped[i] || !IsCoalescableCheck(first))
+      continue;
+
+    assm::RegisterId base = first.operand.base();
+    int32_t lowest = GetCheckDisplacement(first);
+    int32_t highest = lowest;
+    size_t lowest_index = i;
+    size_t highest_index = i;
+    std::vector<size_t> group(1, i);
+
+    for (size_t j = i + 1; j < checks->size(); ++j) {
+      const MemoryAccessCheck& check = (*checks)[j];
+      if (grouped[j] || !IsCoalescableCheck(check) ||
+          check.operand.base() != base) {
+        continue;
+      }
+
+      // The checks can only be hoisted if the base register doesn't change in
+      // the meantime.
+      if (!InstructionsPreserveRegister(first.instr, check.instr, base))
+        break;
+
+      int32_t displ = GetCheckDisplacement(check);
+      if (std::max(highest, displ) - std::min(lowest, displ) >=
+              kMaxCoalescedCheckSpan) {
+        break;
+      }
+      if (displ < lowest) {
+        lowest = displ;
+        lowest_index = j;
+      }
+      if (displ > highest) {
+        highest = displ;
+        highest_index = j;
+      }
+      group.push_back(j);
+    }
+
+    if (group.size() < 3)
+      continue;
+
+    for (size_t index : group) {
+      MemoryAccessCheck& check = (*checks)[index];
+      grouped[index] = true;
+      if (index != lowest_index && index != highest_index) {
+        check.coalesced = true;
+        continue;
+      }
+
+      // Hoist the check before the first access of the group. The flags must
+      // be preserved there rather than at the original access.
+      check.where = first.where;
+      check.state = first.state;
+      check.info.save_flags = first.info.save_flags;
+    }
+  }
+}
+
+// Returns the rate at which the memory accesses of @p basic_block should be
+// instrumented, relative to the base instrumentation rate, given the
+// basic-block entry counts @p entry_counts.
+// @param entry_counts The basic-block entry counts, may be NULL.
+// @param hot_entry_count_threshold The entry count above which the rate is
+//     lowered.
+// @param basic_block The basic block being instrumented.
+double GetEntryCountInstrumentationRate(
+    const AsanBasicBlockTransform::IndexedFrequencyMap* entry_counts,
+    double hot_entry_count_threshold,
+    const BasicCodeBlock* basic_block) {
+  if (entry_counts == nullptr)
+    return 1.0;
+
+  // Basic blocks that weren't part of the original image can't be in the
+  // profile.
+  const BlockGraph::Block* block = basic_block->subgraph()->original_block();
+  if (block == nullptr || basic_block->offset() == BasicBlock::kNoOffset)
+    return 1.0;
+
+  auto count = entry_counts->find(
+      std::make_pair(block->addr() + basic_block->offset(), 0));
+  if (count == entry_counts->end() ||
+      count->second <= hot_entry_count_threshold) {
+    return 1.0;
+  }
+  return hot_entry_count_threshold / count->second;
+}
+
+// Collects the loops of the structural tree @p tree whose body is a single
+// basic block, i.e. the basic blocks with a back edge to themselves.
+// @param tree The structural tree to walk.
+// @param loops Receives the body of each of these loops.
+void FindSingleBasicBlockLoops(
+    const ControlFlowAnalysis::StructuralNode* tree,
+    std::set<const BasicCodeBlock*>* loops) {
+  typedef ControlFlowAnalysis::StructuralNode StructuralNode;
+  DCHECK_NE(static_cast<const StructuralNode*>(nullptr), tree);
+  DCHECK_NE(static_cast<std::set<const BasicCodeBlock*>*>(nullptr), loops);
+
+  switch (tree->kind()) {
+    case StructuralNode::kBaseNode:
+      break;
+    case StructuralNode::kSequenceNode:
+      FindSingleBasicBlockLoops(tree->entry_node(), loops);
+      FindSingleBasicBlockLoops(tree->sequence_node(), loops);
+      break;
+    case StructuralNode::kIfThenNode:
+      FindSingleBasicBlockLoops(tree->entry_node(), loops);
+      FindSingleBasicBlockLoops(tree->then_node(), loops);
+      break;
+    case StructuralNode::kIfThenElseNode:
+      FindSingleBasicBlockLoops(tree->entry_node(), loops);
+      FindSingleBasicBlockLoops(tree->then_node(), loops);
+      FindSingleBasicBlockLoops(tree->else_node(), loops);
+      break;
+    case StructuralNode::kRepeatNode:
+      if (tree->entry_node()->kind() == StructuralNode::kBaseNode)
+        loops->insert(tree->root());
+      else
+        FindSingleBasicBlockLoops(tree->entry_node(), loops);
+      break;
+    case StructuralNode::kWhileNode:
+      FindSingleBasicBlockLoops(tree->entry_node(), loops);
+      FindSingleBasicBlockLoops(tree->body_node(), loops);
+      break;
+    case StructuralNode::kLoopNode:
+      FindSingleBasicBlockLoops(tree->entry_node(), loops);
+      break;
+    default:
+      NOTREACHED() << "Invalid structural node.";
+  }
+}
+
+// Returns true if @p references contains a reference to @p bb.
+bool ReferencesBasicBlock(
+    const BasicBlock::BasicBlockReferenceMap& references,
+    const BasicBlock* bb) {
+  for (const auto& ref : references) {
+    if (ref.second.basic_block() == bb)
+      return true;
+  }
+  return false;
+}
+
+// Creates a pre-header for the single basic block loop @p loop: an empty basic
+// block laid out right before the loop, through which all of the edges
+// entering the loop from elsewhere are redirected.
+// @param subgraph The subgraph containing @p loop.
+// @param loop The body of the loop.
+// @returns the pre-header, or nullptr if the loop is also entered in a way
+//     that can't be redirected.
+BasicCodeBlock* CreateLoopPreheader(BasicBlockSubGraph* subgraph,
+                                    BasicCodeBlock* loop) {
+  DCHECK_NE(static_cast<BasicBlockSubGraph*>(nullptr), subgraph);
+  DCHECK_NE(static_cast<BasicCodeBlock*>(nullptr), loop);
+
+  // References from other blocks, from instructions and from jump tables
+  // can't be told apart from the back edge, so only the successors of the
+  // other basic blocks may enter the loop.
+  if (!loop->referrers().empty())
+    return nullptr;
+
+  std::vector<Successor*> entries;
+  for (BasicBlock* bb : subgraph->basic_blocks()) {
+    BasicDataBlock* data_bb = BasicDataBlock::Cast(bb);
+    if (data_bb != nullptr) {
+      if (ReferencesBasicBlock(data_bb->references(), loop))
+        return nullptr;
+      continue;
+    }
+
+    BasicCodeBlock* code_bb = BasicCodeBlock::Cast(bb);
+    if (code_bb == nullptr)
+      continue;
+    for (const Instruction& instr : code_bb->instructions()) {
+      if (ReferencesBasicBlock(instr.references(), loop))
+        return nullptr;
+    }
+    if (code_bb == loop)
+      continue;
+    for (Successor& succ : code_bb->successors()) {
+      if (succ.reference().basic_block() == loop)
+        entries.push_back(&succ);
+    }
+  }
+  if (entries.empty())
+    return nullptr;
+
+  // The pre-header is laid out right before the loop so that it falls through
+  // into it. The loop mustn't be the entry point of its block.
+  BasicBlockSubGraph::BasicBlockOrdering* order = nullptr;
+  BasicBlockSubGraph::BasicBlockOrdering::iterator position;
+  for (auto& description : subgraph->block_descriptions()) {
+    position = std::find(description.basic_block_order.begin(),
+                         description.basic_block_order.end(),
+                         loop);
+    if (position != description.basic_block_order.end()) {
+      order = &description.basic_block_order;
+      break;
+    }
+  }
+  if (order == nullptr || position == order->begin())
+    return nullptr;
+
+  BasicCodeBlock* preheader = subgraph->AddBasicCodeBlock("preheader");
+  DCHECK_NE(static_cast<BasicCodeBlock*>(nullptr), preheader);
+  preheader->successors().push_back(
+      Successor(Successor::kConditionTrue,
+                BasicBlockReference(BlockGraph::PC_RELATIVE_REF, 4, loop),
+                0));
+  for (Successor* succ : entries) {
+    BasicBlockReference ref(succ->reference());
+    succ->SetReference(BasicBlockReference(ref.reference_type(), ref.size(),
+                                           preheader));
+  }
+  order->insert(position, preheader);
+
+  return preheader;
+}
+
+// Returns true if the address checked by @p check is the same on every
+// iteration of the single basic block loop @p loop, and if the memory it
+// refers to can't be freed by the loop.
+bool IsLoopInvariantCheck(const MemoryAccessCheck& check,
+                          const BasicCodeBlock* loop) {
+  if (check.info.mode != AsanBasicBlockTransform::kReadAccess &&
+      check.info.mode != AsanBasicBlockTransform::kWriteAccess) {
+    return false;
+  }
+
+  // A call could free the memory being accessed.
+  const BasicBlock::Instructions& instructions = loop->instructions();
+  for (const Instruction& instr : instructions) {
+    if (instr.IsCall())
+      return false;
+  }
+
+  assm::RegisterId regs[] = { check.operand.base(), check.operand.index() };
+  for (assm::RegisterId reg : regs) {
+    if (reg == assm::kRegisterNone)
+      continue;
+    if (!InstructionsPreserveRegister(instructions.begin(), instructions.end(),
+                                      reg)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 // Add imports from the specified module to the block graph, altering the
 // contents of its header/special blocks.
 // @param policy the policy object restricting how the transform is applied.
@@ -1070,6 +1408,12 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
   if (instrumentation_rate_ == 0.0)
     return true;
 
+  // The hot basic blocks are sampled more sparsely.
+  double instrumentation_rate = instrumentation_rate_ *
+      GetEntryCountInstrumentationRate(entry_counts_,
+                                       hot_entry_count_threshold_,
+                                       basic_block);
+
   // Pre-compute liveness information for each instruction.
   std::list<LivenessAnalysis::State> states;
   LivenessAnalysis::State state;
@@ -1094,8 +1438,9 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
   if (remove_redundant_checks_)
     memory_accesses_.GetStateAtEntryOf(basic_block, &memory_state);
 
-  // Process each instruction and inject a call to Asan when we find an
-  // instrumentable memory access.
+  // Process each instruction and collect the checks for the instrumentable
+  // memory accesses. These are injected once they've all been found.
+  std::vector<MemoryAccessCheck> checks;
   BasicBlock::Instructions::iterator iter_inst =
       basic_block->instructions().begin();
   std::list<LivenessAnalysis::State>::iterator iter_state = states.begin();
@@ -1178,26 +1523,63 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
       continue;
 
     // Randomly sample to effect partial instrumentation.
-    if (instrumentation_rate_ < 1.0 &&
-        base::RandDouble() >= instrumentation_rate_) {
+    if (instrumentation_rate < 1.0 &&
+        base::RandDouble() >= instrumentation_rate) {
       continue;
     }
 
+    if (use_liveness_analysis_ &&
+        (info.mode == kReadAccess || info.mode == kWriteAccess)) {
+      // Use the liveness information to skip saving the flags if possible.
+      info.save_flags = state.AreArithmeticFlagsLive();
+    }
+
+    checks.push_back(MemoryAccessCheck(iter_inst, operand, info, state));
+  }
+
+  DCHECK(iter_state == states.end());
+
+  if (coalesce_checks_)
+    CoalesceMemoryAccessChecks(&checks);
+
+  // If this basic block is a loop with a pre-header, the checks of the
+  // loop-invariant addresses are moved there so that they're only performed
+  // once. The loop body is executed at least once after the pre-header, so
+  // these accesses are bound to happen.
+  BasicCodeBlock* preheader = nullptr;
+  auto preheader_it = loop_preheaders_.find(basic_block);
+  if (preheader_it != loop_preheaders_.end()) {
+    preheader = preheader_it->second;
+    LivenessAnalysis::State preheader_state;
+    if (use_liveness_analysis_)
+      liveness_.GetStateAtExitOf(preheader, &preheader_state);
+
+    for (MemoryAccessCheck& check : checks) {
+      if (check.coalesced || !IsLoopInvariantCheck(check, basic_block))
+        continue;
+      check.hoisted = true;
+      check.where = preheader->instructions().end();
+      check.state = preheader_state;
+      check.info.save_flags = !use_liveness_analysis_ ||
+          preheader_state.AreArithmeticFlagsLive();
+    }
+  }
+
+  for (const MemoryAccessCheck& check : checks) {
+    if (check.coalesced)
+      continue;
+
     // Create a BasicBlockAssembler to insert new instruction.
-    BasicBlockAssembler bb_asm(iter_inst, &basic_block->instructions());
+    BasicBlock::Instructions* instructions = check.hoisted ?
+        &preheader->instructions() : &basic_block->instructions();
+    BasicBlockAssembler bb_asm(check.where, instructions);
 
     // Configure the assembler to copy the SourceRange information of the
     // current instrumented instruction into newly created instructions. This is
     // a hack to allow valid stack walking and better error reporting, but
     // breaks the 1:1 OMAP mapping and may confuse some debuggers.
     if (debug_friendly_)
-      bb_asm.set_source_range(instr.source_range());
-
-    if (use_liveness_analysis_ &&
-        (info.mode == kReadAccess || info.mode == kWriteAccess)) {
-      // Use the liveness information to skip saving the flags if possible.
-      info.save_flags = state.AreArithmeticFlagsLive();
-    }
+      bb_asm.set_source_range(check.instr->source_range());
 
     // Mark that an instrumentation will happen. Do this before selecting a
     // hook so we can call a dry run without hooks present.
@@ -1205,21 +1587,21 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
 
     if (!dry_run_) {
       // Insert hook for standard instructions.
-      AsanHookMap::iterator hook = check_access_hooks_->find(info);
+      AsanHookMap::iterator hook = check_access_hooks_->find(check.info);
       if (hook == check_access_hooks_->end()) {
         LOG(ERROR) << "Invalid access : "
-                   << GetAsanCheckAccessFunctionName(info, image_format);
+                   << GetAsanCheckAccessFunctionName(check.info, image_format);
         return false;
       }
 
-      // Instrument this instruction.
-      InjectAsanHook(
-          &bb_asm, info, operand, &hook->second, state, image_format);
+      // Instrument this instruction. The probe is emitted as a single batch.
+      bb_asm.BeginBatch();
+      InjectAsanHook(&bb_asm, check.info, check.operand, &hook->second,
+                     check.state, image_format);
+      bb_asm.EndBatch();
     }
   }
 
-  DCHECK(iter_state == states.end());
-
   return true;
 }
 
@@ -1237,6 +1619,26 @@ bool AsanBasicBlockTransform::TransformBasicBlockSubGraph(
   DCHECK(block_graph != NULL);
   DCHECK(subgraph != NULL);
 
+  // Give a pre-header to the single basic block loops, to which the checks of
+  // their loop-invariant accesses can be hoisted. This is done first so that
+  // the analyses below take the pre-headers into account. The subgraph is
+  // left untouched in dry run mode.
+  loop_preheaders_.clear();
+  ControlFlowAnalysis::StructuralTree tree;
+  if (hoist_loop_invariant_checks_ && !dry_run_ &&
+      instrumentation_rate_ != 0.0 &&
+      ControlFlowAnalysis::BuildStructuralTree(subgraph, &tree)) {
+    std::set<const BasicCodeBlock*> loops;
+    FindSingleBasicBlockLoops(tree.get(), &loops);
+
+    for (const BasicCodeBlock* loop : loops) {
+      BasicCodeBlock* preheader =
+          CreateLoopPreheader(subgraph, const_cast<BasicCodeBlock*>(loop));
+      if (preheader != nullptr)
+        loop_preheaders_[loop] = preheader;
+    }
+  }
+
   // Perform a global liveness analysis.
   if (use_liveness_analysis_)
     liveness_.Analyze(subgraph);
@@ -1251,16 +1653,24 @@ bool AsanBasicBlockTransform::TransformBasicBlockSubGraph(
   if (!block_graph::HasUnexpectedStackFrameManipulation(subgraph))
     stack_mode = kSafeStackAccess;
 
+  // Collect the pre-headers, which only receive the checks hoisted from their
+  // loops and aren't instrumented themselves.
+  std::set<const BasicCodeBlock*> preheaders;
+  for (const auto& loop_preheader : loop_preheaders_)
+    preheaders.insert(loop_preheader.second);
+
   // Iterates through each basic block and instruments it.
   BasicBlockSubGraph::BBCollection::iterator it =
       subgraph->basic_blocks().begin();
   for (; it != subgraph->basic_blocks().end(); ++it) {
     BasicCodeBlock* bb = BasicCodeBlock::Cast(*it);
-    if (bb != NULL &&
+    if (bb != NULL && preheaders.count(bb) == 0 &&
         !InstrumentBasicBlock(bb, stack_mode, block_graph->image_format())) {
+      loop_preheaders_.clear();
       return false;
     }
   }
+  loop_preheaders_.clear();
   return true;
 }
 
@@ -1312,21 +1722,93 @@ AsanTransform::AsanTransform()
     : debug_friendly_(false),
       use_liveness_analysis_(false),
       remove_redundant_checks_(false),
+      coalesce_checks_(false),
+      hoist_loop_invariant_checks_(false),
       use_interceptors_(false),
       instrumentation_rate_(1.0),
+      entry_counts_(nullptr),
+      instrumentation_budget_(1.0),
+      hot_entry_count_threshold_(0.0),
       asan_parameters_(nullptr),
       check_access_hooks_ref_(),
       asan_parameters_block_(nullptr),
-      hot_patching_(false) {
+      hot_patching_(false),
+      thread_count_(1) {
 }
 
 AsanTransform::~AsanTransform() { }
 
+class AsanTransform::AsanBasicBlockTransformFactory
+    : public block_graph::BasicBlockSubGraphTransformFactoryInterface {
+ public:
+  // @param transform The transform whose settings are used. The hook map is
+  //     shared by the basic-block transforms, which only read it.
+  explicit AsanBasicBlockTransformFactory(AsanTransform* transform)
+      : transform_(transform) {
+    DCHECK_NE(static_cast<AsanTransform*>(nullptr), transform);
+  }
+
+  std::unique_ptr<block_graph::BasicBlockSubGraphTransformInterface>
+      CreateTransform(const BlockGraph::Block* block) override {
+    std::unique_ptr<AsanBasicBlockTransform> transform(
+        new AsanBasicBlockTransform(&transform_->check_access_hooks_ref_));
+    transform_->ConfigureBasicBlockTransform(transform.get());
+    return std::move(transform);
+  }
+
+ private:
+  AsanTransform* transform_;
+
+  DISALLOW_COPY_AND_ASSIGN(AsanBasicBlockTransformFactory);
+};
+
 void AsanTransform::set_instrumentation_rate(double instrumentation_rate) {
   // Set the instrumentation rate, capping it between 0 and 1.
   instrumentation_rate_ = std::max(0.0, std::min(1.0, instrumentation_rate));
 }
 
+void AsanTransform::set_instrumentation_budget(double instrumentation_budget) {
+  // Set the instrumentation budget, capping it between 0 and 1.
+  instrumentation_budget_ =
+      std::max(0.0, std::min(1.0, instrumentation_budget));
+}
+
+double AsanTransform::ComputeHotEntryCountThreshold(
+    const AsanBasicBlockTransform::IndexedFrequencyMap& entry_counts,
+    double budget) {
+  // Only the first column holds the basic-block entry counts.
+  std::vector<double> counts;
+  double total = 0.0;
+  for (const auto& entry : entry_counts) {
+    if (entry.first.second != 0 || entry.second <= 0)
+      continue;
+    counts.push_back(entry.second);
+    total += entry.second;
+  }
+  if (counts.empty())
+    return 0.0;
+
+  std::sort(counts.begin(), counts.end(), std::greater<double>());
+  if (budget >= 1.0)
+    return counts.front();
+
+  // Cap the hottest blocks one at a time until the threshold they're capped to
+  // is no lower than the entry count of the next one. |remaining| is the sum
+  // of the entry counts of the blocks that aren't capped.
+  double target = std::max(0.0, budget) * total;
+  double remaining = total;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    remaining -= counts[i];
+    double threshold = (target - remaining) / (i + 1);
+    double next = i + 1 < counts.size() ? counts[i + 1] : 0.0;
+    if (threshold >= next)
+      return threshold;
+  }
+
+  NOTREACHED();
+  return 0.0;
+}
+
 bool AsanTransform::PreBlockGraphIteration(
     const TransformPolicyInterface* policy,
     BlockGraph* block_graph,
@@ -1343,6 +1825,12 @@ bool AsanTransform::PreBlockGraphIteration(
     return false;
   }
 
+  // Determine which basic blocks are hot enough to be sampled.
+  if (entry_counts_ != nullptr) {
+    hot_entry_count_threshold_ = ComputeHotEntryCountThreshold(
+        *entry_counts_, instrumentation_budget_);
+  }
+
   // Initialize heap initialization blocks.
   FindHeapInitAndCrtHeapBlocks(block_graph);
 
@@ -1385,6 +1873,22 @@ bool AsanTransform::PreBlockGraphIteration(
   return true;
 }
 
+void AsanTransform::ConfigureBasicBlockTransform(
+    AsanBasicBlockTransform* transform) const {
+  DCHECK_NE(static_cast<AsanBasicBlockTransform*>(nullptr), transform);
+
+  // Use the filter that was passed to us for our child transform.
+  transform->set_debug_friendly(debug_friendly());
+  transform->set_use_liveness_analysis(use_liveness_analysis());
+  transform->set_remove_redundant_checks(remove_redundant_checks());
+  transform->set_coalesce_checks(coalesce_checks());
+  transform->set_hoist_loop_invariant_checks(hoist_loop_invariant_checks());
+  transform->set_filter(filter());
+  transform->set_instrumentation_rate(instrumentation_rate_);
+  transform->set_entry_counts(entry_counts_);
+  transform->set_hot_entry_count_threshold(hot_entry_count_threshold_);
+}
+
 bool AsanTransform::OnBlock(const TransformPolicyInterface* policy,
                             BlockGraph* block_graph,
                             BlockGraph::Block* block) {
@@ -1395,13 +1899,14 @@ bool AsanTransform::OnBlock(const TransformPolicyInterface* policy,
   if (ShouldSkipBlock(policy, block))
     return true;
 
-  // Use the filter that was passed to us for our child transform.
+  // The blocks are transformed all at once when using several threads.
+  if (!hot_patching_ && thread_count_ > 1) {
+    parallel_blocks_.push_back(block);
+    return true;
+  }
+
   AsanBasicBlockTransform transform(&check_access_hooks_ref_);
-  transform.set_debug_friendly(debug_friendly());
-  transform.set_use_liveness_analysis(use_liveness_analysis());
-  transform.set_remove_redundant_checks(remove_redundant_checks());
-  transform.set_filter(filter());
-  transform.set_instrumentation_rate(instrumentation_rate_);
+  ConfigureBasicBlockTransform(&transform);
 
   if (!hot_patching_) {
     if (!ApplyBasicBlockSubGraphTransform(
@@ -1439,6 +1944,15 @@ bool AsanTransform::PostBlockGraphIteration(
   DCHECK(block_graph != NULL);
   DCHECK(header_block != NULL);
 
+  if (!parallel_blocks_.empty()) {
+    AsanBasicBlockTransformFactory factory(this);
+    if (!ApplyBasicBlockSubGraphTransformInParallel(
+            &factory, policy, thread_count_, block_graph, parallel_blocks_)) {
+      return false;
+    }
+    parallel_blocks_.clear();
+  }
+
   if (block_graph->image_format() == BlockGraph::PE_IMAGE) {
     if (!PeInterceptFunctions(kAsanIntercepts, policy, block_graph,
                               header_block)) {
@@ -1677,7 +2191,7 @@ bool AsanTransform::PeInjectAsanParameters(
   params_block->CopyData(fparams.data().size(), fparams.data().data());
 
   // Wire up any references that are required.
-  static_assert(14 == common::kAsanParametersVersion,
+  static_assert(30 == common::kAsanParametersVersion,
                 "Pointers in the params must be linked up here.");
   block_graph::TypedBlock<common::AsanParameters> params;
   CHECK(params.Init(0, params_block));
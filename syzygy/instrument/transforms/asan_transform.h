@@ -31,6 +31,7 @@
 #include "syzygy/block_graph/transforms/iterative_transform.h"
 #include "syzygy/block_graph/transforms/named_transform.h"
 #include "syzygy/common/asan_parameters.h"
+#include "syzygy/grinder/basic_block_util.h"
 #include "syzygy/instrument/transforms/asan_interceptor_filter.h"
 #include "syzygy/instrument/transforms/asan_intercepts.h"
 #include "syzygy/pe/transforms/pe_add_imports_transform.h"
@@ -75,6 +76,7 @@ class AsanBasicBlockTransform
   // Map of hooks to Asan check access functions.
   typedef std::map<AsanHookMapEntryKey, BlockGraph::Reference> AsanHookMap;
   typedef std::map<MemoryAccessMode, BlockGraph::Reference> AsanDefaultHookMap;
+  typedef grinder::basic_block_util::IndexedFrequencyMap IndexedFrequencyMap;
 
   // Constructor.
   // @param check_access_hooks References to the various check access functions.
@@ -86,7 +88,11 @@ class AsanBasicBlockTransform
       dry_run_(false),
       instrumentation_happened_(false),
       instrumentation_rate_(1.0),
+      entry_counts_(nullptr),
+      hot_entry_count_threshold_(0.0),
       remove_redundant_checks_(false),
+      coalesce_checks_(false),
+      hoist_loop_invariant_checks_(false),
       use_liveness_analysis_(false) {
     DCHECK(check_access_hooks != NULL);
   }
@@ -106,10 +112,39 @@ class AsanBasicBlockTransform
     remove_redundant_checks_ = remove_redundant_checks;
   }
 
+  bool coalesce_checks() const { return coalesce_checks_; }
+  void set_coalesce_checks(bool coalesce_checks) {
+    coalesce_checks_ = coalesce_checks;
+  }
+
+  bool hoist_loop_invariant_checks() const {
+    return hoist_loop_invariant_checks_;
+  }
+  void set_hoist_loop_invariant_checks(bool hoist_loop_invariant_checks) {
+    hoist_loop_invariant_checks_ = hoist_loop_invariant_checks;
+  }
+
   // The instrumentation rate must be in the range [0, 1], inclusive.
   double instrumentation_rate() const { return instrumentation_rate_; }
   void set_instrumentation_rate(double instrumentation_rate);
 
+  // The basic-block entry counts of the image being instrumented, keyed by
+  // the address of the basic blocks in the original image. The memory
+  // accesses of the basic blocks entered more than the hot entry count
+  // threshold are instrumented at a rate lowered in proportion, so that they
+  // are expected to run instrumented as many times as a block entered that
+  // many times. The entry counts are ignored if NULL.
+  const IndexedFrequencyMap* entry_counts() const { return entry_counts_; }
+  void set_entry_counts(const IndexedFrequencyMap* entry_counts) {
+    entry_counts_ = entry_counts;
+  }
+  double hot_entry_count_threshold() const {
+    return hot_entry_count_threshold_;
+  }
+  void set_hot_entry_count_threshold(double hot_entry_count_threshold) {
+    hot_entry_count_threshold_ = hot_entry_count_threshold;
+  }
+
   // Instead of instrumenting the basic blocks, in dry run mode the instrumenter
   // only signals if any instrumentation would have happened on the block.
   // @returns true iff the instrumenter is in dry run mode.
@@ -157,6 +192,11 @@ class AsanBasicBlockTransform
   // Memory accesses value numbering.
   block_graph::analysis::MemoryAccessAnalysis memory_accesses_;
 
+  // The pre-headers created for the single basic block loops of the subgraph
+  // being transformed, keyed by loop.
+  std::map<const block_graph::BasicCodeBlock*, block_graph::BasicCodeBlock*>
+      loop_preheaders_;
+
   // The references to the Asan access check import entries.
   AsanHookMap* check_access_hooks_;
 
@@ -171,6 +211,11 @@ class AsanBasicBlockTransform
   // implemented using random sampling.
   double instrumentation_rate_;
 
+  // The basic-block entry counts used to lower the instrumentation rate of
+  // the hot basic blocks, and the entry count above which a block is hot.
+  const IndexedFrequencyMap* entry_counts_;
+  double hot_entry_count_threshold_;
+
   // If any instrumentation happened during a transform, or would have happened
   // during a dry run transform, this member is set to true.
   bool instrumentation_happened_;
@@ -179,6 +224,14 @@ class AsanBasicBlockTransform
   // memory checks added by this transform.
   bool remove_redundant_checks_;
 
+  // When activated, the checks of nearby accesses made through the same base
+  // register are coalesced into a check of the span they cover.
+  bool coalesce_checks_;
+
+  // When activated, the checks of the accesses to loop-invariant addresses
+  // made in single basic block loops are hoisted to a pre-header.
+  bool hoist_loop_invariant_checks_;
+
   // Set iff we should use the liveness analysis to do smarter instrumentation.
   bool use_liveness_analysis_;
 
@@ -283,10 +336,51 @@ class AsanTransform
     remove_redundant_checks_ = remove_redundant_checks;
   }
 
+  bool coalesce_checks() const { return coalesce_checks_; }
+  void set_coalesce_checks(bool coalesce_checks) {
+    coalesce_checks_ = coalesce_checks;
+  }
+
+  bool hoist_loop_invariant_checks() const {
+    return hoist_loop_invariant_checks_;
+  }
+  void set_hoist_loop_invariant_checks(bool hoist_loop_invariant_checks) {
+    hoist_loop_invariant_checks_ = hoist_loop_invariant_checks;
+  }
+
   // The instrumentation rate must be in the range [0, 1], inclusive.
   double instrumentation_rate() const { return instrumentation_rate_; }
   void set_instrumentation_rate(double instrumentation_rate);
 
+  // The basic-block entry counts of the image being instrumented, as produced
+  // by the bbentry grinder. When provided, the instrumentation rate of the
+  // hottest basic blocks is lowered so that only a fraction of the profiled
+  // basic block executions, given by the instrumentation budget, run
+  // instrumented. The colder basic blocks are fully instrumented.
+  const AsanBasicBlockTransform::IndexedFrequencyMap* entry_counts() const {
+    return entry_counts_;
+  }
+  void set_entry_counts(
+      const AsanBasicBlockTransform::IndexedFrequencyMap* entry_counts) {
+    entry_counts_ = entry_counts;
+  }
+
+  // The instrumentation budget must be in the range [0, 1], inclusive.
+  double instrumentation_budget() const { return instrumentation_budget_; }
+  void set_instrumentation_budget(double instrumentation_budget);
+
+  // Computes the entry count above which a basic block is considered hot,
+  // such that capping the entry count of the hot blocks to it leaves
+  // @p budget of the total entry count.
+  // @param entry_counts The basic-block entry counts.
+  // @param budget The fraction of the basic block executions to keep
+  //     instrumented, in the range [0, 1].
+  // @returns the threshold, which is the largest entry count if no block
+  //     needs to be sampled.
+  static double ComputeHotEntryCountThreshold(
+      const AsanBasicBlockTransform::IndexedFrequencyMap& entry_counts,
+      double budget);
+
   // Asan RTL parameters.
   const common::InflatedAsanParameters* asan_parameters() const {
     return asan_parameters_;
@@ -309,6 +403,16 @@ class AsanTransform
     hot_patching_ = hot_patching;
   }
 
+  // The number of threads on which the blocks are decomposed and transformed.
+  // With more than one thread, the blocks are collected in OnBlock and
+  // transformed in parallel in PostBlockGraphIteration. This isn't supported
+  // in hot patching mode, where the blocks are always transformed serially.
+  size_t thread_count() const { return thread_count_; }
+  void set_thread_count(size_t thread_count) {
+    DCHECK_LT(0u, thread_count);
+    thread_count_ = thread_count;
+  }
+
   // The name of the DLL that is imported by default if hot patching mode is
   // inactive.
   static const char kSyzyAsanDll[];
@@ -323,6 +427,13 @@ class AsanTransform
   static const char kAsanHookStubName[];
 
  protected:
+  // Creates the basic-block transforms of the parallel transformation.
+  class AsanBasicBlockTransformFactory;
+
+  // Configures a basic-block transform from the settings of this transform.
+  // @param transform The transform to configure.
+  void ConfigureBasicBlockTransform(AsanBasicBlockTransform* transform) const;
+
   // PreBlockGraphIteration uses this to find the block of the _heap_init
   // function and the data block of _crtheap. This information is used by
   // PatchCRTHeapInitialization. Also, the block of _heap_init is skipped by
@@ -397,6 +508,14 @@ class AsanTransform
   // memory checks added by this transform.
   bool remove_redundant_checks_;
 
+  // When activated, the checks of nearby accesses made through the same base
+  // register are coalesced into a check of the span they cover.
+  bool coalesce_checks_;
+
+  // When activated, the checks of the accesses to loop-invariant addresses
+  // made in single basic block loops are hoisted to a pre-header.
+  bool hoist_loop_invariant_checks_;
+
   // Set iff we should use the functions interceptors.
   bool use_interceptors_;
 
@@ -404,6 +523,13 @@ class AsanTransform
   // implemented using random sampling.
   double instrumentation_rate_;
 
+  // The basic-block entry counts, the fraction of the basic block executions
+  // to keep instrumented and the resulting hot entry count threshold. The
+  // threshold is computed in PreBlockGraphIteration.
+  const AsanBasicBlockTransform::IndexedFrequencyMap* entry_counts_;
+  double instrumentation_budget_;
+  double hot_entry_count_threshold_;
+
   // Asan RTL parameters that will be injected into the instrumented image.
   // These will be found by the RTL and used to control its behaviour. Allows
   // for setting parameters at instrumentation time that vary from the defaults.
@@ -439,6 +565,13 @@ class AsanTransform
   // metadata stream in the PostBlockGraphIteration.
   std::vector<BlockGraph::Block*> hot_patched_blocks_;
 
+  // The number of threads used to transform the blocks.
+  size_t thread_count_;
+
+  // When transforming on several threads, the blocks collected in OnBlock to
+  // be transformed in PostBlockGraphIteration.
+  block_graph::BlockVector parallel_blocks_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(AsanTransform);
 };
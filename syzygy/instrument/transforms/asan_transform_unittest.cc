@@ -82,6 +82,7 @@ class TestAsanTransform : public AsanTransform {
   using AsanTransform::asan_parameters_block_;
   using AsanTransform::heap_init_blocks_;
   using AsanTransform::hot_patched_blocks_;
+  using AsanTransform::parallel_blocks_;
   using AsanTransform::static_intercepted_blocks_;
   using AsanTransform::use_interceptors_;
   using AsanTransform::use_liveness_analysis_;
@@ -340,6 +341,120 @@ TEST_F(AsanTransformTest, SetRemoveRedundantChecksFlag) {
   EXPECT_FALSE(bb_transform.remove_redundant_checks());
 }
 
+TEST_F(AsanTransformTest, SetInstrumentationBudget) {
+  EXPECT_EQ(1.0, asan_transform_.instrumentation_budget());
+  asan_transform_.set_instrumentation_budget(1.2);
+  EXPECT_EQ(1.0, asan_transform_.instrumentation_budget());
+  asan_transform_.set_instrumentation_budget(-0.2);
+  EXPECT_EQ(0.0, asan_transform_.instrumentation_budget());
+  asan_transform_.set_instrumentation_budget(0.5);
+  EXPECT_EQ(0.5, asan_transform_.instrumentation_budget());
+
+  typedef AsanBasicBlockTransform::IndexedFrequencyMap IndexedFrequencyMap;
+  EXPECT_EQ(static_cast<const IndexedFrequencyMap*>(nullptr),
+            asan_transform_.entry_counts());
+  IndexedFrequencyMap entry_counts;
+  asan_transform_.set_entry_counts(&entry_counts);
+  EXPECT_EQ(&entry_counts, asan_transform_.entry_counts());
+}
+
+TEST_F(AsanTransformTest, ComputeHotEntryCountThreshold) {
+  AsanBasicBlockTransform::IndexedFrequencyMap entry_counts;
+  EXPECT_EQ(0.0,
+            AsanTransform::ComputeHotEntryCountThreshold(entry_counts, 0.5));
+
+  // A total of 1000 entries, 900 of them in the two hottest blocks. Only the
+  // first column holds the entry counts.
+  entry_counts[std::make_pair(RelativeAddress(0x1000), 0)] = 600;
+  entry_counts[std::make_pair(RelativeAddress(0x1010), 0)] = 300;
+  entry_counts[std::make_pair(RelativeAddress(0x1020), 0)] = 60;
+  entry_counts[std::make_pair(RelativeAddress(0x1030), 0)] = 40;
+  entry_counts[std::make_pair(RelativeAddress(0x1030), 1)] = 100000;
+  entry_counts[std::make_pair(RelativeAddress(0x1040), 0)] = 0;
+
+  // Nothing needs to be sampled with the full budget.
+  EXPECT_EQ(600.0,
+            AsanTransform::ComputeHotEntryCountThreshold(entry_counts, 1.0));
+  // Capping the hottest block to 500 entries leaves 900 of them.
+  EXPECT_EQ(500.0,
+            AsanTransform::ComputeHotEntryCountThreshold(entry_counts, 0.9));
+  // Capping the two hottest blocks to 200 entries leaves 500 of them.
+  EXPECT_EQ(200.0,
+            AsanTransform::ComputeHotEntryCountThreshold(entry_counts, 0.5));
+  // Capping all the blocks to 25 entries leaves 100 of them.
+  EXPECT_EQ(25.0,
+            AsanTransform::ComputeHotEntryCountThreshold(entry_counts, 0.1));
+  EXPECT_EQ(0.0,
+            AsanTransform::ComputeHotEntryCountThreshold(entry_counts, 0.0));
+}
+
+TEST_F(AsanTransformTest, InstrumentHotBasicBlocksMoreSparsely) {
+  BlockGraph::Block* block =
+      block_graph_.AddBlock(BlockGraph::CODE_BLOCK, 16, "hot");
+  ASSERT_NE(static_cast<BlockGraph::Block*>(nullptr), block);
+  block->set_addr(RelativeAddress(0x1000));
+  subgraph_.set_original_block(block);
+  basic_block_->set_offset(0);
+
+  bb_asm_->mov(assm::eax, block_graph::Operand(assm::ecx));
+  bb_asm_->mov(assm::eax, block_graph::Operand(assm::edx));
+  size_t instructions_count = basic_block_->instructions().size();
+
+  AsanBasicBlockTransform::IndexedFrequencyMap entry_counts;
+  entry_counts[std::make_pair(RelativeAddress(0x1000), 0)] = 100;
+
+  // The basic block is so hot that it isn't instrumented at all.
+  InitHooksRefs();
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_entry_counts(&entry_counts);
+  bb_transform.set_hot_entry_count_threshold(0.0);
+  ASSERT_TRUE(bb_transform.InstrumentBasicBlock(
+      basic_block_,
+      AsanBasicBlockTransform::kSafeStackAccess,
+      BlockGraph::PE_IMAGE));
+  EXPECT_FALSE(bb_transform.instrumentation_happened());
+  EXPECT_EQ(instructions_count, basic_block_->instructions().size());
+
+  // The basic block isn't hot, so it's fully instrumented.
+  bb_transform.set_hot_entry_count_threshold(100.0);
+  ASSERT_TRUE(bb_transform.InstrumentBasicBlock(
+      basic_block_,
+      AsanBasicBlockTransform::kSafeStackAccess,
+      BlockGraph::PE_IMAGE));
+  EXPECT_TRUE(bb_transform.instrumentation_happened());
+  EXPECT_EQ(instructions_count + 2 * 3, basic_block_->instructions().size());
+}
+
+TEST_F(AsanTransformTest, SetCoalesceChecksFlag) {
+  EXPECT_FALSE(asan_transform_.coalesce_checks());
+  asan_transform_.set_coalesce_checks(true);
+  EXPECT_TRUE(asan_transform_.coalesce_checks());
+  asan_transform_.set_coalesce_checks(false);
+  EXPECT_FALSE(asan_transform_.coalesce_checks());
+
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  EXPECT_FALSE(bb_transform.coalesce_checks());
+  bb_transform.set_coalesce_checks(true);
+  EXPECT_TRUE(bb_transform.coalesce_checks());
+  bb_transform.set_coalesce_checks(false);
+  EXPECT_FALSE(bb_transform.coalesce_checks());
+}
+
+TEST_F(AsanTransformTest, SetHoistLoopInvariantChecksFlag) {
+  EXPECT_FALSE(asan_transform_.hoist_loop_invariant_checks());
+  asan_transform_.set_hoist_loop_invariant_checks(true);
+  EXPECT_TRUE(asan_transform_.hoist_loop_invariant_checks());
+  asan_transform_.set_hoist_loop_invariant_checks(false);
+  EXPECT_FALSE(asan_transform_.hoist_loop_invariant_checks());
+
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  EXPECT_FALSE(bb_transform.hoist_loop_invariant_checks());
+  bb_transform.set_hoist_loop_invariant_checks(true);
+  EXPECT_TRUE(bb_transform.hoist_loop_invariant_checks());
+  bb_transform.set_hoist_loop_invariant_checks(false);
+  EXPECT_FALSE(bb_transform.hoist_loop_invariant_checks());
+}
+
 TEST_F(AsanTransformTest, SetUseLivenessFlag) {
   EXPECT_FALSE(asan_transform_.use_liveness_analysis());
   asan_transform_.set_use_liveness_analysis(true);
@@ -371,6 +486,21 @@ TEST_F(AsanTransformTest, ApplyAsanTransformCoff) {
       &asan_transform_, policy_, &block_graph_, header_block_));
 }
 
+TEST_F(AsanTransformTest, ApplyAsanTransformInParallel) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+
+  EXPECT_EQ(1u, asan_transform_.thread_count());
+  asan_transform_.set_thread_count(4);
+  EXPECT_EQ(4u, asan_transform_.thread_count());
+
+  asan_transform_.use_interceptors_ = true;
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &asan_transform_, policy_, &block_graph_, header_block_));
+
+  // The collected blocks should all have been transformed.
+  EXPECT_TRUE(asan_transform_.parallel_blocks_.empty());
+}
+
 TEST_F(AsanTransformTest, NopsNotInstrumented) {
   // Add all of the nops to the block.
   static const size_t kMaxNopSize =
@@ -634,6 +764,134 @@ TEST_F(AsanTransformTest, InstrumentAndRemoveRedundantChecks) {
   ASSERT_EQ(basic_block_->instructions().size(), expected_instructions_count);
 }
 
+TEST_F(AsanTransformTest, InstrumentAndCoalesceChecks) {
+  // Four accesses to the fields of a structure pointed to by ECX, interleaved
+  // with accesses through EDX. Only the checks of [ECX] and [ECX + 12] are
+  // needed to cover the ECX accesses.
+  bb_asm_->mov(assm::eax, block_graph::Operand(assm::ecx));
+  bb_asm_->mov(block_graph::Operand(assm::edx), assm::eax);
+  bb_asm_->mov(assm::eax,
+               block_graph::Operand(assm::ecx, block_graph::Displacement(4)));
+  bb_asm_->mov(assm::eax,
+               block_graph::Operand(assm::ecx, block_graph::Displacement(8)));
+  bb_asm_->mov(assm::eax,
+               block_graph::Operand(assm::ecx, block_graph::Displacement(12)));
+  // Far from the others, so this isn't coalesced.
+  bb_asm_->mov(assm::eax,
+               block_graph::Operand(assm::ecx, block_graph::Displacement(64)));
+  // ECX changes, so this one isn't coalesced either.
+  bb_asm_->mov(assm::ecx, assm::eax);
+  bb_asm_->mov(assm::eax,
+               block_graph::Operand(assm::ecx, block_graph::Displacement(4)));
+  uint32_t instrumentable_instructions = 5;
+
+  uint32_t expected_instructions_count =
+      basic_block_->instructions().size() + 3 * instrumentable_instructions;
+  // Instrument this basic block.
+  InitHooksRefs();
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_coalesce_checks(true);
+  ASSERT_TRUE(bb_transform.InstrumentBasicBlock(
+      basic_block_,
+      AsanBasicBlockTransform::kSafeStackAccess,
+      BlockGraph::PE_IMAGE));
+  EXPECT_TRUE(bb_transform.instrumentation_happened());
+  ASSERT_EQ(expected_instructions_count, basic_block_->instructions().size());
+
+  // The two remaining checks of the ECX accesses are hoisted before the
+  // first of them: push, lea, call for each.
+  auto inst = basic_block_->instructions().begin();
+  for (size_t i = 0; i < 2; ++i) {
+    EXPECT_EQ(I_PUSH, inst->representation().opcode);
+    ++inst;
+    EXPECT_EQ(I_LEA, inst->representation().opcode);
+    ++inst;
+    EXPECT_EQ(I_CALL, inst->representation().opcode);
+    ++inst;
+  }
+  EXPECT_EQ(I_MOV, inst->representation().opcode);
+}
+
+TEST_F(AsanTransformTest, HoistLoopInvariantChecks) {
+  using block_graph::BasicBlockReference;
+  using block_graph::Successor;
+
+  // A loop reading from [ECX], which doesn't change, and from [ESI], which
+  // moves forward on every iteration. The entry basic block falls through to
+  // the loop, which runs until it falls through to the exit basic block.
+  BasicCodeBlock* loop = subgraph_.AddBasicCodeBlock("loop");
+  BasicCodeBlock* exit_bb = subgraph_.AddBasicCodeBlock("exit");
+  BasicBlockSubGraph::BlockDescription& description =
+      subgraph_.block_descriptions().front();
+  description.basic_block_order.push_back(loop);
+  description.basic_block_order.push_back(exit_bb);
+
+  bb_asm_->mov(assm::esi, assm::edx);
+  basic_block_->successors().push_back(
+      Successor(Successor::kConditionTrue,
+                BasicBlockReference(BlockGraph::PC_RELATIVE_REF, 4, loop),
+                0));
+
+  block_graph::BasicBlockAssembler loop_asm(loop->instructions().begin(),
+                                            &loop->instructions());
+  loop_asm.mov(assm::eax, block_graph::Operand(assm::ecx));
+  loop_asm.mov(assm::ebx, block_graph::Operand(assm::esi));
+  loop_asm.lea(assm::esi,
+               block_graph::Operand(assm::esi, block_graph::Displacement(4)));
+  loop_asm.cmp(assm::esi, assm::edi);
+  loop->successors().push_back(
+      Successor(Successor::kConditionNotEqual,
+                BasicBlockReference(BlockGraph::PC_RELATIVE_REF, 4, loop),
+                0));
+  loop->successors().push_back(
+      Successor(Successor::kConditionEqual,
+                BasicBlockReference(BlockGraph::PC_RELATIVE_REF, 4, exit_bb),
+                0));
+
+  block_graph::BasicBlockAssembler exit_asm(exit_bb->instructions().begin(),
+                                            &exit_bb->instructions());
+  exit_asm.ret();
+
+  size_t loop_instructions_count = loop->instructions().size();
+
+  InitHooksRefs();
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_hoist_loop_invariant_checks(true);
+  ASSERT_TRUE(bb_transform.TransformBasicBlockSubGraph(
+      &pe_policy_, &block_graph_, &subgraph_));
+  EXPECT_TRUE(bb_transform.instrumentation_happened());
+
+  // A pre-header was inserted between the entry basic block and the loop.
+  ASSERT_EQ(4U, subgraph_.basic_blocks().size());
+  ASSERT_EQ(4U, description.basic_block_order.size());
+  auto order_it = description.basic_block_order.begin();
+  ++order_it;
+  BasicCodeBlock* preheader = BasicCodeBlock::Cast(*order_it);
+  ASSERT_NE(static_cast<BasicCodeBlock*>(nullptr), preheader);
+  EXPECT_NE(loop, preheader);
+  ASSERT_EQ(1U, basic_block_->successors().size());
+  EXPECT_EQ(preheader,
+            basic_block_->successors().front().reference().basic_block());
+  ASSERT_EQ(1U, preheader->successors().size());
+  EXPECT_EQ(loop, preheader->successors().front().reference().basic_block());
+
+  // The check of [ECX] is done once in the pre-header: push, lea, call.
+  ASSERT_EQ(3U, preheader->instructions().size());
+  auto inst = preheader->instructions().begin();
+  EXPECT_EQ(I_PUSH, inst->representation().opcode);
+  ++inst;
+  EXPECT_EQ(I_LEA, inst->representation().opcode);
+  ++inst;
+  EXPECT_EQ(I_CALL, inst->representation().opcode);
+
+  // The check of [ESI] stays in the loop, before the second access.
+  ASSERT_EQ(loop_instructions_count + 3, loop->instructions().size());
+  inst = loop->instructions().begin();
+  EXPECT_EQ(I_MOV, inst->representation().opcode);
+  ++inst;
+  EXPECT_EQ(I_PUSH, inst->representation().opcode);
+}
+
 TEST_F(AsanTransformTest, NonInstrumentableStackBasedInstructions) {
   // DEC DWORD [EBP - 0x2830]
   static const uint8_t kDec1[6] = {0xff, 0x8d, 0xd0, 0xd7, 0xff, 0xff};
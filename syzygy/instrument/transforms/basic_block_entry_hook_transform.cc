@@ -16,6 +16,9 @@
 
 #include "syzygy/instrument/transforms/basic_block_entry_hook_transform.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "base/logging.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
@@ -53,6 +56,12 @@ typedef pe::transforms::ImportedModule ImportedModule;
 const char kDefaultModuleName[] = "basic_block_entry_client.dll";
 const char kBasicBlockEnter[] = "_increment_indexed_freq_data";
 
+// The offset of the TLS slots reserved for the user application in the TEB.
+const uint32_t kUserApplicationSlot = 0x700;
+
+// The number of FS slots that the agent supports.
+const uint32_t kNumSlots = 4U;
+
 // Compares two relative address ranges to see if they overlap. Assumes they
 // are already sorted. This is used to validate basic-block ranges.
 struct RelativeAddressRangesOverlapFunctor {
@@ -128,7 +137,8 @@ BasicBlockEntryHookTransform::BasicBlockEntryHookTransform()
     thunk_section_(NULL),
     instrument_dll_name_(kDefaultModuleName),
     set_src_ranges_for_thunks_(false),
-    set_inline_fast_path_(false) {
+    set_inline_fast_path_(false),
+    fs_slot_(0U) {
 }
 
 bool BasicBlockEntryHookTransform::PreBlockGraphIteration(
@@ -140,6 +150,12 @@ bool BasicBlockEntryHookTransform::PreBlockGraphIteration(
   DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), header_block);
   DCHECK_EQ(BlockGraph::PE_IMAGE, block_graph->image_format());
 
+  if (set_inline_fast_path_ && (fs_slot_ == 0 || fs_slot_ > kNumSlots)) {
+    LOG(ERROR) << "The inline fast path requires a FS slot from 1 to "
+               << kNumSlots << ".";
+    return false;
+  }
+
   // Setup basic block entry and the frequency data hooks.
   if (!SetupEntryHooks(policy,
                        block_graph,
@@ -206,15 +222,25 @@ bool BasicBlockEntryHookTransform::TransformBasicBlockSubGraph(
   DCHECK(bb_entry_hook_ref_.IsValid());
   DCHECK(add_frequency_data_.frequency_data_block() != NULL);
 
-  // Insert a call to the basic-block entry hook at the top of each code
-  // basic-block.
+  // The inline fast path only preserves the live registers and flags.
+  LivenessAnalysis liveness;
+  if (set_inline_fast_path_)
+    liveness.Analyze(subgraph);
+
+  // Collect the code basic-blocks first, as the inline fast path adds basic
+  // blocks to the subgraph.
+  std::vector<BasicCodeBlock*> code_bbs;
   BasicBlockSubGraph::BBCollection::iterator it =
       subgraph->basic_blocks().begin();
   for (; it != subgraph->basic_blocks().end(); ++it) {
     BasicCodeBlock* bb = BasicCodeBlock::Cast(*it);
-    if (bb == NULL || bb->is_padding())
-      continue;
+    if (bb != NULL && !bb->is_padding())
+      code_bbs.push_back(bb);
+  }
 
+  // Insert a call to the basic-block entry hook at the top of each code
+  // basic-block.
+  for (BasicCodeBlock* bb : code_bbs) {
     // Find the source range associated with this basic-block.
     BlockGraph::Block::SourceRange source_range;
     if (!GetBasicBlockSourceRange(*bb, &source_range)) {
@@ -223,6 +249,15 @@ bool BasicBlockEntryHookTransform::TransformBasicBlockSubGraph(
       return false;
     }
 
+    if (set_inline_fast_path_) {
+      LivenessAnalysis::State state;
+      liveness.GetStateAtEntryOf(bb, &state);
+      if (!InsertInlineFastPath(subgraph, bb, bb_ranges_.size(), state))
+        return false;
+      bb_ranges_.push_back(source_range);
+      continue;
+    }
+
     // We use the location/index in the bb_ranges vector of the current
     // basic-block range as the basic_block_id, and we pass a pointer to
     // the frequency data block as the module_data parameter. We then make
@@ -268,7 +303,7 @@ bool BasicBlockEntryHookTransform::PostBlockGraphIteration(
   // Initialized BasicBlock agent specific fields
   block_graph::TypedBlock<ThreadLocalIndexedFrequencyData> frequency_data;
   CHECK(frequency_data.Init(0, add_frequency_data_.frequency_data_block()));
-  frequency_data->fs_slot = 0;
+  frequency_data->fs_slot = set_inline_fast_path_ ? fs_slot_ : 0;
   frequency_data->tls_index = TLS_OUT_OF_INDEXES;
 
   // Add the module entry thunks.
@@ -306,6 +341,101 @@ bool BasicBlockEntryHookTransform::PostBlockGraphIteration(
   return true;
 }
 
+bool BasicBlockEntryHookTransform::InsertInlineFastPath(
+    BasicBlockSubGraph* subgraph,
+    BasicCodeBlock* bb,
+    uint32_t basic_block_id,
+    const LivenessAnalysis::State& state) {
+  DCHECK(subgraph != NULL);
+  DCHECK(bb != NULL);
+  DCHECK_NE(0U, fs_slot_);
+
+  // Find the ordering containing the basic block.
+  BasicBlockSubGraph::BasicBlockOrdering* order = NULL;
+  BasicBlockSubGraph::BasicBlockOrdering::iterator position;
+  BasicBlockSubGraph::BlockDescriptionList::iterator description =
+      subgraph->block_descriptions().begin();
+  for (; description != subgraph->block_descriptions().end(); ++description) {
+    position = std::find(description->basic_block_order.begin(),
+                         description->basic_block_order.end(),
+                         bb);
+    if (position != description->basic_block_order.end()) {
+      order = &description->basic_block_order;
+      break;
+    }
+  }
+  if (order == NULL) {
+    LOG(ERROR) << "Unable to find basic block '" << bb->name() << "'.";
+    return false;
+  }
+
+  bool save_eax = state.IsLive(assm::eax);
+  bool save_flags = state.AreArithmeticFlagsLive();
+
+  // Move the original instructions and successors to the tail.
+  BasicCodeBlock* tail = subgraph->AddBasicCodeBlock(bb->name());
+  BasicCodeBlock* increment = subgraph->AddBasicCodeBlock("bb_entry_increment");
+  BasicCodeBlock* slow = subgraph->AddBasicCodeBlock("bb_entry_slow_path");
+  DCHECK(tail != NULL);
+  DCHECK(increment != NULL);
+  DCHECK(slow != NULL);
+  tail->instructions().splice(tail->instructions().begin(),
+                              bb->instructions());
+  tail->successors().splice(tail->successors().begin(), bb->successors());
+
+  //   push eax                     (if eax is live)
+  //   pushfd                       (if the flags are live)
+  //   mov eax, fs:[slot]
+  //   test eax, eax
+  //   jz slow
+  BasicBlockAssembler head_asm(bb->instructions().end(), &bb->instructions());
+  if (save_eax)
+    head_asm.push(assm::eax);
+  if (save_flags)
+    head_asm.pushfd();
+  head_asm.mov_fs(assm::eax, Operand(Displacement(
+      kUserApplicationSlot + 4 * (fs_slot_ - 1))));
+  head_asm.test(assm::eax, assm::eax);
+  AddSuccessorBetween(Successor::kConditionEqual, bb, slow);
+  AddSuccessorBetween(Successor::kConditionNotEqual, bb, increment);
+
+  //   add dword ptr[eax + basic_block_id * 4], 1
+  BasicBlockAssembler increment_asm(increment->instructions().end(),
+                                    &increment->instructions());
+  increment_asm.add(
+      Operand(assm::eax, Displacement(basic_block_id * sizeof(uint32_t))),
+      Immediate(1));
+  AddSuccessorBetween(Successor::kConditionTrue, increment, tail);
+
+  //   push basic_block_id
+  //   push module_data
+  //   call [bb_entry_hook]
+  BasicBlockAssembler slow_asm(slow->instructions().end(),
+                               &slow->instructions());
+  slow_asm.push(Immediate(basic_block_id, assm::kSize32Bit));
+  slow_asm.push(Immediate(add_frequency_data_.frequency_data_block(), 0));
+  slow_asm.call(Operand(Displacement(bb_entry_hook_ref_.referenced(),
+                                     bb_entry_hook_ref_.offset())));
+  AddSuccessorBetween(Successor::kConditionTrue, slow, tail);
+
+  //   popfd                        (if the flags are live)
+  //   pop eax                      (if eax is live)
+  BasicBlockAssembler tail_asm(tail->instructions().begin(),
+                               &tail->instructions());
+  if (save_flags)
+    tail_asm.popfd();
+  if (save_eax)
+    tail_asm.pop(assm::eax);
+
+  // The fast path falls through to the tail, the slow path is out of line.
+  ++position;
+  order->insert(position, increment);
+  order->insert(position, tail);
+  order->push_back(slow);
+
+  return true;
+}
+
 bool BasicBlockEntryHookTransform::ThunkNonDecomposableCodeBlock(
     BlockGraph* block_graph, BlockGraph::Block* code_block) {
   DCHECK(block_graph != NULL);
@@ -23,6 +23,7 @@
 #include "base/strings/string_piece.h"
 #include "syzygy/block_graph/basic_block_assembler.h"
 #include "syzygy/block_graph/iterate.h"
+#include "syzygy/block_graph/analysis/liveness_analysis.h"
 #include "syzygy/block_graph/transforms/iterative_transform.h"
 #include "syzygy/block_graph/transforms/named_transform.h"
 #include "syzygy/instrument/transforms/add_indexed_frequency_data_transform.h"
@@ -43,8 +44,10 @@ class BasicBlockEntryHookTransform
           BasicBlockEntryHookTransform> {
  public:
   typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
+  typedef block_graph::BasicCodeBlock BasicCodeBlock;
   typedef block_graph::BlockGraph BlockGraph;
   typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
+  typedef block_graph::analysis::LivenessAnalysis LivenessAnalysis;
   typedef core::RelativeAddress RelativeAddress;
   typedef core::AddressRange<RelativeAddress, size_t> RelativeAddressRange;
   typedef std::vector<RelativeAddressRange> RelativeAddressRangeVector;
@@ -76,11 +79,20 @@ class BasicBlockEntryHookTransform
   bool inline_fast_path() { return set_inline_fast_path_; }
 
   // Set a flag denoting whether or not the instrumented application should
-  // call the fast-path hook.
+  // call the fast-path hook. The inline fast path increments the counters of
+  // the current thread through a FS slot, which must be set, and only calls
+  // the hook when the thread has no counters yet.
   void set_inline_fast_path(bool value) {
     set_inline_fast_path_ = value;
   }
 
+  // @name Accessors and mutators for the FS slot used by the inline fast
+  //     path. This must be from 1 to 4.
+  // @{
+  uint32_t fs_slot() const { return fs_slot_; }
+  void set_fs_slot(uint32_t slot) { fs_slot_ = slot; }
+  // @}
+
  protected:
   typedef std::map<BlockGraph::Offset, BlockGraph::Block*> ThunkBlockMap;
 
@@ -154,6 +166,21 @@ class BasicBlockEntryHookTransform
   bool CreateBasicBlockEntryThunk(BlockGraph* block_graph,
                                   BlockGraph::Block** fast_path_block);
 
+  // Inserts the inline fast path at the top of a basic block. The basic block
+  // is split in a check of the counters of the current thread, an increment
+  // and a call to the hook for when there are no counters, which is laid out
+  // at the end of the block. They all join a tail holding the original
+  // instructions.
+  // @param subgraph The subgraph containing @p bb.
+  // @param bb The basic block to instrument.
+  // @param basic_block_id The id of @p bb.
+  // @param state The liveness state at the top of @p bb.
+  // @returns true on success; false otherwise.
+  bool InsertInlineFastPath(BasicBlockSubGraph* subgraph,
+                            BasicCodeBlock* bb,
+                            uint32_t basic_block_id,
+                            const LivenessAnalysis::State& state);
+
   // Adds the basic-block frequency data referenced by the coverage agent.
   AddIndexedFrequencyDataTransform add_frequency_data_;
 
@@ -179,6 +206,10 @@ class BasicBlockEntryHookTransform
   // falling back to the hook in the agent.
   bool set_inline_fast_path_;
 
+  // The FS slot through which the inline fast path finds the counters of the
+  // current thread.
+  uint32_t fs_slot_;
+
   // The name of this transform.
   static const char kTransformName[];
 
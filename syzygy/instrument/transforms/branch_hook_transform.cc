@@ -16,11 +16,14 @@
 
 #include "syzygy/instrument/transforms/branch_hook_transform.h"
 
+#include <vector>
+
 #include "base/logging.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
 #include "syzygy/block_graph/block_builder.h"
 #include "syzygy/block_graph/block_util.h"
+#include "syzygy/block_graph/analysis/liveness_analysis.h"
 #include "syzygy/common/defs.h"
 #include "syzygy/common/indexed_frequency_data.h"
 #include "syzygy/instrument/transforms/entry_thunk_transform.h"
@@ -44,12 +47,15 @@ using block_graph::Immediate;
 using block_graph::Operand;
 using block_graph::Successor;
 using block_graph::TransformPolicyInterface;
+using block_graph::analysis::LivenessAnalysis;
+using common::BranchEventBuffer;
 using common::kBasicBlockEntryAgentId;
 using common::ThreadLocalIndexedFrequencyData;
 using pe::transforms::PEAddImportsTransform;
 
 typedef BasicBlockSubGraph::BlockDescriptionList
     BlockDescriptionList;
+typedef BasicBlockSubGraph::BasicBlockOrdering BasicBlockOrdering;
 typedef pe::transforms::ImportedModule ImportedModule;
 
 const char kDefaultModuleName[] = "basic_block_entry_client.dll";
@@ -57,14 +63,168 @@ const char kBranchFunctionEnter[] = "_function_enter";
 const char kBranchEnter[] = "_branch_enter";
 const char kBranchEnterBuffered[] = "_branch_enter_buffered";
 const char kBranchExit[] = "_branch_exit";
+const char kBranchEvent[] = "_branch_event";
 const size_t kNumBranchSlot = 4;
 
+// The offset of the TLS slots reserved for the user application in the TEB.
+const uint32_t kUserApplicationSlot = 0x700;
+
+// Adds an empty code basic block to @p subgraph that jumps to @p target.
+BasicCodeBlock* AddBasicCodeBlockTo(BasicBlockSubGraph* subgraph,
+                                    const base::StringPiece& name,
+                                    BasicBlock* target) {
+  BasicCodeBlock* bb = subgraph->AddBasicCodeBlock(name);
+  DCHECK(bb != NULL);
+  bb->successors().push_back(
+      Successor(Successor::kConditionTrue,
+                BasicBlockReference(BlockGraph::PC_RELATIVE_REF, 4, target),
+                0));
+  return bb;
+}
+
+// Adds a pair of successors to @p bb, branching to @p taken on @p condition
+// and to @p not_taken otherwise.
+void AddConditionalSuccessors(BasicCodeBlock* bb,
+                              Successor::Condition condition,
+                              BasicBlock* taken,
+                              BasicBlock* not_taken) {
+  DCHECK(bb->successors().empty());
+  bb->successors().push_back(
+      Successor(condition,
+                BasicBlockReference(BlockGraph::PC_RELATIVE_REF, 4, taken),
+                0));
+  bb->successors().push_back(
+      Successor(Successor::InvertCondition(condition),
+                BasicBlockReference(BlockGraph::PC_RELATIVE_REF, 4, not_taken),
+                0));
+}
+
+// Appends @p event to the event buffer of the current thread at @p where in
+// @p bb. The basic block is split at this point: @p bb checks whether the
+// buffer has room left, a store basic block appends the event and a slow path
+// basic block calls the hook when the buffer is full or missing. The
+// instructions following @p where and the successors of @p bb are moved to a
+// tail basic block that they all join.
+// @param subgraph The subgraph containing @p bb.
+// @param order The ordering containing @p bb.
+// @param position The position of @p bb in @p order. On return, this is the
+//     position of the tail basic block.
+// @param slow_paths The slow path basic block is appended to this. These
+//     are meant to be laid out at the end of the block.
+// @param bb The basic block to instrument.
+// @param where The position of the event in the instructions of @p bb.
+// @param state The liveness state at @p where.
+// @param fs_slot The FS slot holding the event buffer.
+// @param event The event to append.
+// @param hook_ref The hook called by the slow path.
+// @returns the tail basic block.
+BasicCodeBlock* InsertBufferedEvent(BasicBlockSubGraph* subgraph,
+                                    BasicBlockOrdering* order,
+                                    BasicBlockOrdering::iterator* position,
+                                    BasicBlockOrdering* slow_paths,
+                                    BasicCodeBlock* bb,
+                                    BasicBlock::Instructions::iterator where,
+                                    const LivenessAnalysis::State& state,
+                                    uint32_t fs_slot,
+                                    uint32_t event,
+                                    const BlockGraph::Reference& hook_ref) {
+  DCHECK(subgraph != NULL);
+  DCHECK(order != NULL);
+  DCHECK(position != NULL);
+  DCHECK(slow_paths != NULL);
+  DCHECK(bb != NULL);
+  DCHECK_NE(0U, fs_slot);
+  DCHECK(**position == bb);
+
+  bool save_eax = state.IsLive(assm::eax);
+  bool save_ecx = state.IsLive(assm::ecx);
+  bool save_flags = state.AreArithmeticFlagsLive();
+
+  // Move the end of the basic block to the tail.
+  BasicCodeBlock* tail = subgraph->AddBasicCodeBlock(bb->name());
+  DCHECK(tail != NULL);
+  tail->instructions().splice(tail->instructions().begin(),
+                              bb->instructions(),
+                              where,
+                              bb->instructions().end());
+  tail->successors().splice(tail->successors().begin(), bb->successors());
+
+  BasicCodeBlock* check = subgraph->AddBasicCodeBlock("branch_event_check");
+  BasicCodeBlock* store =
+      AddBasicCodeBlockTo(subgraph, "branch_event_store", tail);
+  BasicCodeBlock* slow =
+      AddBasicCodeBlockTo(subgraph, "branch_event_slow", tail);
+  DCHECK(check != NULL);
+
+  // Load the event buffer of the current thread.
+  BasicBlockAssembler head_asm(bb->instructions().end(), &bb->instructions());
+  if (save_eax)
+    head_asm.push(assm::eax);
+  if (save_ecx)
+    head_asm.push(assm::ecx);
+  if (save_flags)
+    head_asm.pushfd();
+  auto slot(Operand(Displacement(kUserApplicationSlot + 4 * (fs_slot - 1))));
+  head_asm.mov_fs(assm::eax, slot);
+  head_asm.test(assm::eax, assm::eax);
+  AddConditionalSuccessors(bb, Successor::kConditionEqual, slow, check);
+
+  // Check whether the buffer has room left.
+  BasicBlockAssembler check_asm(check->instructions().end(),
+                                &check->instructions());
+  check_asm.mov(assm::ecx,
+                Operand(assm::eax,
+                        Displacement(offsetof(BranchEventBuffer, next))));
+  check_asm.cmp(assm::ecx,
+                Operand(assm::eax,
+                        Displacement(offsetof(BranchEventBuffer, end))));
+  AddConditionalSuccessors(check, Successor::kConditionAboveOrEqual, slow,
+                           store);
+
+  // Append the event.
+  BasicBlockAssembler store_asm(store->instructions().end(),
+                                &store->instructions());
+  store_asm.mov(Operand(assm::ecx), Immediate(event, assm::kSize32Bit));
+  store_asm.add(assm::ecx, Immediate(sizeof(uint32_t)));
+  store_asm.mov(Operand(assm::eax,
+                        Displacement(offsetof(BranchEventBuffer, next))),
+                assm::ecx);
+
+  // Hand the event to the agent.
+  BasicBlockAssembler slow_asm(slow->instructions().end(),
+                               &slow->instructions());
+  slow_asm.push(Immediate(event, assm::kSize32Bit));
+  slow_asm.call(Operand(Displacement(hook_ref.referenced(),
+                                     hook_ref.offset())));
+
+  // Restore the registers and the flags.
+  BasicBlockAssembler tail_asm(tail->instructions().begin(),
+                               &tail->instructions());
+  if (save_flags)
+    tail_asm.popfd();
+  if (save_ecx)
+    tail_asm.pop(assm::ecx);
+  if (save_eax)
+    tail_asm.pop(assm::eax);
+
+  // The fast path falls through to the tail.
+  BasicBlockOrdering::iterator next = *position;
+  ++next;
+  order->insert(next, check);
+  order->insert(next, store);
+  *position = order->insert(next, tail);
+  slow_paths->push_back(slow);
+
+  return tail;
+}
+
 // Sets up the entry and the exit hooks import.
 bool SetupEntryHooks(const TransformPolicyInterface* policy,
                      BlockGraph* block_graph,
                      BlockGraph::Block* header_block,
                      const std::string& module_name,
                      bool buffering,
+                     bool inline_buffering,
                      uint32_t fs_slot,
                      BlockGraph::Reference* function_enter,
                      BlockGraph::Reference* branch_enter,
@@ -80,7 +240,11 @@ bool SetupEntryHooks(const TransformPolicyInterface* policy,
   std::string branch_enter_name;
   std::string branch_exit_name;
 
-  if (buffering) {
+  if (inline_buffering) {
+    // The same hook receives the entry and the exit events.
+    branch_enter_name = kBranchEvent;
+    branch_exit_name = kBranchEvent;
+  } else if (buffering) {
     branch_enter_name = kBranchEnterBuffered;
     branch_exit_name = kBranchExit;
   } else {
@@ -159,6 +323,7 @@ BranchHookTransform::BranchHookTransform()
     thunk_section_(NULL),
     instrument_dll_name_(kDefaultModuleName),
     buffering_(false),
+    inline_buffering_(false),
     fs_slot_(0U) {
 }
 
@@ -171,12 +336,18 @@ bool BranchHookTransform::PreBlockGraphIteration(
   DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), header_block);
   DCHECK_EQ(BlockGraph::PE_IMAGE, block_graph->image_format());
 
+  if (inline_buffering_ && fs_slot_ == 0) {
+    LOG(ERROR) << "Inline buffering requires a FS slot.";
+    return false;
+  }
+
   // Setup instrumentation functions hooks.
   if (!SetupEntryHooks(policy,
                        block_graph,
                        header_block,
                        instrument_dll_name_,
                        buffering_,
+                       inline_buffering_,
                        fs_slot_,
                        &function_enter_hook_ref_,
                        &enter_hook_ref_,
@@ -226,6 +397,11 @@ bool BranchHookTransform::TransformBasicBlockSubGraph(
   if (fs_slot_ != 0)
     need_module_data = false;
 
+  // The inline instrumentation only preserves the live registers and flags.
+  LivenessAnalysis liveness;
+  if (inline_buffering_)
+    liveness.Analyze(subgraph);
+
   BlockDescriptionList& descriptions = subgraph->block_descriptions();
   BlockDescriptionList::iterator description = descriptions.begin();
   for (; description != descriptions.end(); ++description) {
@@ -239,8 +415,8 @@ bool BranchHookTransform::TransformBasicBlockSubGraph(
 
     // Insert a call to the basic-block entry hook at the beginning and the end
     // of each code basic-block.
-    BasicBlockSubGraph::BasicBlockOrdering::const_iterator it =
-      original_order.begin();
+    BasicBlockOrdering slow_paths;
+    BasicBlockOrdering::iterator it = original_order.begin();
     for (; it != original_order.end(); ++it) {
       BasicCodeBlock* bb = BasicCodeBlock::Cast(*it);
       if (bb == NULL || bb->is_padding())
@@ -258,10 +434,55 @@ bool BranchHookTransform::TransformBasicBlockSubGraph(
       // range as the basic_block_id, and we pass a pointer to the frequency
       // data block as the module_data parameter. We then make a memory indirect
       // call to the bb_entry_hook.
-      auto basic_block_id(Immediate(bb_ranges_.size(), assm::kSize32Bit));
+      uint32_t id = static_cast<uint32_t>(bb_ranges_.size());
+      auto basic_block_id(Immediate(id, assm::kSize32Bit));
       auto module_data(
           Immediate(add_frequency_data_.frequency_data_block(), 0));
 
+      // Find the last non jumping instruction in the basic block.
+      BasicBlock::Instructions::iterator last = bb->instructions().begin();
+      BasicBlock::Instructions::iterator last_instruction = last;
+      for (; last != bb->instructions().end(); ++last) {
+        if (!last->IsReturn() && !last->IsBranch()) {
+          last_instruction = last;
+          ++last_instruction;
+        }
+      }
+      bool instrument_exit = last == bb->instructions().end() ||
+          !last->CallsNonReturningFunction();
+
+      if (inline_buffering_) {
+        // Get the liveness states at both events before modifying the basic
+        // block.
+        LivenessAnalysis::State enter_state;
+        liveness.GetStateAtEntryOf(bb, &enter_state);
+        LivenessAnalysis::State exit_state;
+        liveness.GetStateAtExitOf(bb, &exit_state);
+        BasicBlock::Instructions::iterator instr = bb->instructions().end();
+        while (instr != last_instruction) {
+          --instr;
+          liveness.PropagateBackward(*instr, &exit_state);
+        }
+        bool exit_at_end = last_instruction == bb->instructions().end();
+
+        // The instructions are moved to the tail, along with the exit point.
+        BasicCodeBlock* tail = InsertBufferedEvent(
+            subgraph, &original_order, &it, &slow_paths, bb,
+            bb->instructions().begin(), enter_state, fs_slot_, id,
+            enter_hook_ref_);
+        if (exit_at_end)
+          last_instruction = tail->instructions().end();
+        if (instrument_exit) {
+          InsertBufferedEvent(subgraph, &original_order, &it, &slow_paths,
+                              tail, last_instruction, exit_state, fs_slot_,
+                              id | common::kBranchExitEventFlag,
+                              exit_hook_ref_);
+        }
+
+        bb_ranges_.push_back(source_range);
+        continue;
+      }
+
       // Assemble entry hook instrumentation into the instruction stream.
       BlockGraph::Reference* enter_hook_ref = &enter_hook_ref_;
       auto enter_hook(Operand(Displacement(enter_hook_ref->referenced(),
@@ -273,18 +494,7 @@ bool BranchHookTransform::TransformBasicBlockSubGraph(
         bb_asm_enter.push(module_data);
       bb_asm_enter.call(enter_hook);
 
-      // Find the last non jumping instruction in the basic block.
-      BasicBlock::Instructions::iterator last = bb->instructions().begin();
-      BasicBlock::Instructions::iterator last_instruction = last;
-      for (; last != bb->instructions().end(); ++last) {
-        if (!last->IsReturn() && !last->IsBranch()) {
-          last_instruction = last;
-          ++last_instruction;
-        }
-      }
-
-      if (last == bb->instructions().end() ||
-          !last->CallsNonReturningFunction()) {
+      if (instrument_exit) {
         // Assemble exit hook instrumentation into the instruction stream.
         auto exit_hook(Operand(Displacement(exit_hook_ref_.referenced(),
                                             exit_hook_ref_.offset())));
@@ -300,6 +510,10 @@ bool BranchHookTransform::TransformBasicBlockSubGraph(
       bb_ranges_.push_back(source_range);
     }
 
+    // The slow paths of the inline instrumentation are laid out at the end
+    // of the block.
+    original_order.splice(original_order.end(), slow_paths);
+
     // Insert a call to the function entry hook at the beginning of the
     // function.
     if (function_enter_hook_ref_.IsValid()) {
@@ -35,6 +35,11 @@ namespace transforms {
 // are responsible for being non-disruptive to the calling environment.
 // I.e., they must preserve all volatile registers, any registers they use, and
 // the processor flags.
+//
+// When inline buffering is enabled, the events are appended directly to the
+// buffer of the current thread, which is found through the FS slot. The hook
+// is only called when the buffer is full or missing. Only the registers and
+// flags that are live across the instrumentation are preserved.
 class BranchHookTransform
     : public block_graph::transforms::IterativeTransformImpl<
           BranchHookTransform>,
@@ -68,6 +73,10 @@ class BranchHookTransform
   // @{
   bool buffering() const { return buffering_; }
   void set_buffering(bool buffering) { buffering_ = buffering; }
+  bool inline_buffering() const { return inline_buffering_; }
+  void set_inline_buffering(bool inline_buffering) {
+    inline_buffering_ = inline_buffering;
+  }
   void set_fs_slot(uint32_t slot) { fs_slot_ = slot; }
   // @}
 
@@ -126,6 +135,10 @@ class BranchHookTransform
   // Flag indicating if event buffering is activated.
   bool buffering_;
 
+  // Flag indicating if the events are appended inline to the buffer of the
+  // current thread. This requires a FS slot.
+  bool inline_buffering_;
+
   // If not zero, use a FS slot to keep thread local storage instead of the
   // standard API.
   uint32_t fs_slot_;
@@ -53,6 +53,7 @@ class TestBranchHookTransform : public BranchHookTransform {
   using BranchHookTransform::exit_hook_ref_;
   using BranchHookTransform::thunk_section_;
   using BranchHookTransform::buffering_;
+  using BranchHookTransform::inline_buffering_;
   using BranchHookTransform::fs_slot_;
 
   BlockGraph::Block* frequency_data_block() {
@@ -306,5 +307,48 @@ TEST_F(BranchHookTransformTest, ApplySlotBufferedAgentInstrumentation) {
   ASSERT_NO_FATAL_FAILURE(CheckBasicBlockInstrumentation());
 }
 
+TEST_F(BranchHookTransformTest, InlineBufferingRequiresSlot) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+
+  tx_.set_inline_buffering(true);
+  ASSERT_TRUE(tx_.inline_buffering_);
+  EXPECT_FALSE(block_graph::ApplyBlockGraphTransform(
+      &tx_, policy_, &block_graph_, header_block_));
+}
+
+TEST_F(BranchHookTransformTest, ApplyInlineBufferedAgentInstrumentation) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+
+  // Activate inline buffering and fs-slot.
+  tx_.set_inline_buffering(true);
+  tx_.set_fs_slot(1);
+
+  // Apply the transform.
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &tx_, policy_, &block_graph_, header_block_));
+  ASSERT_TRUE(tx_.function_enter_hook_ref_.IsValid());
+  ASSERT_TRUE(tx_.enter_hook_ref_.IsValid());
+  ASSERT_LT(0u, tx_.bb_ranges().size());
+
+  // The entry and the exit events are directed to the same hook.
+  EXPECT_EQ(tx_.enter_hook_ref_.referenced(),
+            tx_.exit_hook_ref_.referenced());
+  EXPECT_EQ(tx_.enter_hook_ref_.offset(), tx_.exit_hook_ref_.offset());
+
+  // Each instrumented basic block has a slow path calling the hook on entry,
+  // and most of them another one on exit.
+  size_t hook_calls = 0;
+  for (const auto& referrer : tx_.enter_hook_ref_.referenced()->referrers()) {
+    BlockGraph::Reference ref;
+    ASSERT_TRUE(referrer.first->GetReference(referrer.second, &ref));
+    if (referrer.first->type() == BlockGraph::CODE_BLOCK &&
+        ref.offset() == tx_.enter_hook_ref_.offset()) {
+      ++hook_calls;
+    }
+  }
+  EXPECT_LT(tx_.bb_ranges().size(), hook_calls);
+  EXPECT_GE(2 * tx_.bb_ranges().size(), hook_calls);
+}
+
 }  // namespace transforms
 }  // namespace instrument
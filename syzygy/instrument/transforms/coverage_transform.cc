@@ -19,6 +19,7 @@
 #include "syzygy/common/indexed_frequency_data.h"
 #include "syzygy/core/disassembler_util.h"
 #include "syzygy/pe/pe_utils.h"
+#include "syzygy/pe/transforms/pe_add_imports_transform.h"
 
 namespace instrument {
 namespace transforms {
@@ -39,9 +40,19 @@ using block_graph::Displacement;
 using block_graph::Immediate;
 using block_graph::Operand;
 using block_graph::TransformPolicyInterface;
+using pe::transforms::PEAddImportsTransform;
 
 typedef CoverageInstrumentationTransform::RelativeAddressRange
     RelativeAddressRange;
+typedef pe::transforms::ImportedModule ImportedModule;
+
+// The self-removing probe exported by the run-time library.
+const char kCoverageProbe[] = "_coverage_probe";
+
+// The alignment of the self-removing probes. The run-time library patches the
+// first two bytes of a probe in a single write, which only executing threads
+// are guaranteed to see atomically if the write is naturally aligned.
+const size_t kProbeAlignment = 2;
 
 const BlockGraph::Offset kFrequencyDataOffset =
     offsetof(IndexedFrequencyData, frequency_data);
@@ -70,7 +81,8 @@ CoverageInstrumentationTransform::CoverageInstrumentationTransform()
                            "Basic-Block Frequency Data",
                            common::kBasicBlockFrequencyDataVersion,
                            common::IndexedFrequencyData::COVERAGE,
-                           sizeof(common::IndexedFrequencyData)) {
+                           sizeof(common::IndexedFrequencyData)),
+      self_removing_probes_(false) {
   // Initialize the EntryThunkTransform.
   entry_thunk_tx_.set_instrument_unsafe_references(false);
   entry_thunk_tx_.set_only_instrument_module_entry(true);
@@ -105,18 +117,33 @@ bool CoverageInstrumentationTransform::TransformBasicBlockSubGraph(
       return false;
     }
 
-    // We prepend each basic code block with the following instructions:
-    //   0. push eax
-    //   1. mov eax, dword ptr[data.frequency_data]
-    //   2. mov byte ptr[eax + basic_block_index], 1
-    //   3. pop eax
     BasicBlockAssembler assm(bb->instructions().begin(), &bb->instructions());
 
-    // Prepend the instrumentation instructions.
-    assm.push(eax);
-    assm.mov(eax, Operand(Displacement(data_block, kFrequencyDataOffset)));
-    assm.mov_b(Operand(eax, Displacement(bb_ranges_.size())), Immediate(1));
-    assm.pop(eax);
+    if (self_removing_probes_) {
+      // We prepend each basic code block with the following instructions,
+      // whose layout the run-time library relies on to patch them out, and
+      // align the basic block so that it can do so atomically:
+      //   0. push basic_block_index (imm32)
+      //   1. push data (imm32)
+      //   2. call [_coverage_probe]
+      DCHECK(probe_ref_.IsValid());
+      if (bb->alignment() < kProbeAlignment)
+        bb->set_alignment(kProbeAlignment);
+      assm.push(Immediate(bb_ranges_.size(), assm::kSize32Bit));
+      assm.push(Immediate(data_block, 0));
+      assm.call(Operand(Displacement(probe_ref_.referenced(),
+                                     probe_ref_.offset())));
+    } else {
+      // We prepend each basic code block with the following instructions:
+      //   0. push eax
+      //   1. mov eax, dword ptr[data.frequency_data]
+      //   2. mov byte ptr[eax + basic_block_index], 1
+      //   3. pop eax
+      assm.push(eax);
+      assm.mov(eax, Operand(Displacement(data_block, kFrequencyDataOffset)));
+      assm.mov_b(Operand(eax, Displacement(bb_ranges_.size())), Immediate(1));
+      assm.pop(eax);
+    }
 
     bb_ranges_.push_back(source_range);
   }
@@ -139,6 +166,27 @@ bool CoverageInstrumentationTransform::PreBlockGraphIteration(
     return false;
   }
 
+  if (self_removing_probes_) {
+    // Import the probe from the run-time library.
+    ImportedModule module(entry_thunk_tx_.instrument_dll_name());
+    size_t probe_index = module.AddSymbol(kCoverageProbe,
+                                          ImportedModule::kAlwaysImport);
+
+    PEAddImportsTransform add_imports;
+    add_imports.AddModule(&module);
+    if (!ApplyBlockGraphTransform(
+            &add_imports, policy, block_graph, header_block)) {
+      LOG(ERROR) << "Unable to add import for the coverage probe.";
+      return false;
+    }
+
+    if (!module.GetSymbolReference(probe_index, &probe_ref_)) {
+      LOG(ERROR) << "Unable to get " << kCoverageProbe << ".";
+      return false;
+    }
+    DCHECK(probe_ref_.IsValid());
+  }
+
   return true;
 }
 
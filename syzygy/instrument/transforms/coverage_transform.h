@@ -19,6 +19,11 @@
 // (2) Grabs an entry hook and wires it up the run-time library.
 // (3) Adds a read/write data section containing code coverage information.
 // (4) Instruments each basic block to gather basic block visit information.
+//
+// By default, each basic block stores to its entry of the coverage array on
+// every visit. With self-removing probes, each basic block instead calls into
+// the run-time library through a probe that the library patches into a jump
+// over itself on the first visit, so that later visits cost next to nothing.
 
 #ifndef SYZYGY_INSTRUMENT_TRANSFORMS_COVERAGE_TRANSFORM_H_
 #define SYZYGY_INSTRUMENT_TRANSFORMS_COVERAGE_TRANSFORM_H_
@@ -67,6 +72,15 @@ class CoverageInstrumentationTransform
   //      as its unique ID.
   const RelativeAddressRangeVector& bb_ranges() const { return bb_ranges_; }
 
+  // @returns true if the basic blocks are instrumented with self-removing
+  //     probes.
+  bool self_removing_probes() const { return self_removing_probes_; }
+
+  // @}
+
+  // @name Mutators.
+  // @{
+  void set_self_removing_probes(bool value) { self_removing_probes_ = value; }
   // @}
 
   // @name Pass-throughs to EntryThunkTransform.
@@ -127,6 +141,11 @@ class CoverageInstrumentationTransform
   // Stores the RVAs in the original image for each instrumented basic block.
   RelativeAddressRangeVector bb_ranges_;
 
+  // If true, the basic blocks call the self-removing probe of the run-time
+  // library, imported through probe_ref_.
+  bool self_removing_probes_;
+  BlockGraph::Reference probe_ref_;
+
   DISALLOW_COPY_AND_ASSIGN(CoverageInstrumentationTransform);
 };
 
@@ -65,5 +65,45 @@ TEST_F(CoverageInstrumentationTransformTest, Apply) {
       coverage_data.OffsetOf(coverage_data->frequency_data)));
 }
 
+TEST_F(CoverageInstrumentationTransformTest, ApplySelfRemovingProbes) {
+  CoverageInstrumentationTransform tx;
+  tx.set_self_removing_probes(true);
+  EXPECT_TRUE(tx.self_removing_probes());
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &tx, policy_, &block_graph_, header_block_));
+  EXPECT_FALSE(tx.bb_ranges().empty());
+
+  // The code blocks start with the probe of their first basic block:
+  //   push basic_block_index
+  //   push data
+  //   call [_coverage_probe]
+  size_t num_probes = 0;
+  for (const auto& entry : block_graph_.blocks()) {
+    const BlockGraph::Block& block = entry.second;
+    if (block.type() != BlockGraph::CODE_BLOCK || block.data_size() < 16)
+      continue;
+
+    BlockGraph::Reference data_ref;
+    if (!block.GetReference(6, &data_ref) ||
+        data_ref.referenced() != tx.frequency_data_block()) {
+      continue;
+    }
+
+    EXPECT_LE(2U, block.alignment());
+    const uint8_t* data = block.data();
+    EXPECT_EQ(0x68, data[0]);
+    EXPECT_GT(tx.bb_ranges().size(),
+              *reinterpret_cast<const uint32_t*>(data + 1));
+    EXPECT_EQ(0x68, data[5]);
+    EXPECT_EQ(0xFF, data[10]);
+    EXPECT_EQ(0x15, data[11]);
+
+    BlockGraph::Reference probe_ref;
+    EXPECT_TRUE(block.GetReference(12, &probe_ref));
+    ++num_probes;
+  }
+  EXPECT_LT(0U, num_probes);
+}
+
 }  // namespace transforms
 }  // namespace instrument
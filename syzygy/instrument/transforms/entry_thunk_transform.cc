@@ -35,10 +35,51 @@ using block_graph::BlockGraph;
 using block_graph::Displacement;
 using block_graph::Operand;
 using block_graph::TransformPolicyInterface;
+using block_graph::UntypedReference;
 using pe::transforms::PEAddImportsTransform;
 
 typedef pe::transforms::ImportedModule ImportedModule;
 
+namespace {
+
+// The opcodes of the instructions of a direct call stub.
+const uint8_t kPushImm32 = 0x68;
+const uint8_t kJmpIndirect[] = { 0xFF, 0x25 };
+
+// @returns true if @p ref is a direct call or jump from @p referrer.
+bool IsDirectCallReference(const BlockGraph::Block* referrer,
+                           const BlockGraph::Reference& ref) {
+  return referrer->type() == BlockGraph::CODE_BLOCK &&
+      ref.type() == BlockGraph::PC_RELATIVE_REF &&
+      ref.size() == sizeof(core::AbsoluteAddress);
+}
+
+// Writes a push of a 32-bit immediate at @p offset in @p block.
+// @returns the offset following the instruction.
+BlockGraph::Offset WritePush(const BasicBlockAssembler::Immediate& immediate,
+                             BlockGraph::Offset offset,
+                             BlockGraph::Block* block) {
+  DCHECK_EQ(assm::kSize32Bit, immediate.size());
+  uint8_t* data = block->GetMutableData();
+  data[offset++] = kPushImm32;
+  const UntypedReference& ref = immediate.reference();
+  if (ref.IsValid()) {
+    DCHECK_EQ(BasicBlockReference::REFERRED_TYPE_BLOCK, ref.referred_type());
+    block->SetReference(offset,
+                        BlockGraph::Reference(BlockGraph::ABSOLUTE_REF,
+                                              sizeof(core::AbsoluteAddress),
+                                              ref.block(),
+                                              ref.offset(),
+                                              ref.base()));
+  } else {
+    uint32_t value = immediate.value();
+    ::memcpy(data + offset, &value, sizeof(value));
+  }
+  return offset + sizeof(core::AbsoluteAddress);
+}
+
+}  // namespace
+
 const char EntryThunkTransform::kTransformName[] =
     "EntryThunkTransform";
 
@@ -55,6 +96,7 @@ EntryThunkTransform::EntryThunkTransform()
       instrument_unsafe_references_(true),
       src_ranges_for_thunks_(false),
       only_instrument_module_entry_(false),
+      direct_call_stubs_(false),
       instrument_dll_name_(kDefaultInstrumentDll) {
 }
 
@@ -172,11 +214,22 @@ bool EntryThunkTransform::OnBlock(const TransformPolicyInterface* policy,
   if (block->type() != BlockGraph::CODE_BLOCK)
     return true;
 
-  return InstrumentCodeBlock(block_graph, block);
+  // Direct call stubs only apply to the per-function hook, and need the block
+  // to be safe to modify.
+  BlockGraph::Offset body_offset = 0;
+  if (direct_call_stubs_ && !only_instrument_module_entry_ &&
+      policy->BlockIsSafeToBasicBlockDecompose(block)) {
+    if (!AddDirectCallStub(block, &body_offset))
+      return false;
+  }
+
+  return InstrumentCodeBlock(block_graph, block, body_offset);
 }
 
 bool EntryThunkTransform::InstrumentCodeBlock(
-    BlockGraph* block_graph, BlockGraph::Block* block) {
+    BlockGraph* block_graph,
+    BlockGraph::Block* block,
+    BlockGraph::Offset body_offset) {
   DCHECK(block_graph != NULL);
   DCHECK(block != NULL);
 
@@ -193,7 +246,7 @@ bool EntryThunkTransform::InstrumentCodeBlock(
   for (; referrer_it != referrers.end(); ++referrer_it) {
     const BlockGraph::Block::Referrer& referrer = *referrer_it;
     if (!InstrumentCodeBlockReferrer(
-        referrer, block_graph, block, &thunk_block_map)) {
+        referrer, block_graph, block, body_offset, &thunk_block_map)) {
       return false;
     }
   }
@@ -205,11 +258,16 @@ bool EntryThunkTransform::InstrumentCodeBlockReferrer(
     const BlockGraph::Block::Referrer& referrer,
     BlockGraph* block_graph,
     BlockGraph::Block* block,
+    BlockGraph::Offset body_offset,
     ThunkBlockMap* thunk_block_map) {
   DCHECK(block_graph != NULL);
   DCHECK(block != NULL);
   DCHECK(thunk_block_map != NULL);
 
+  // Skip the references made by the direct call stub itself.
+  if (referrer.first == block && referrer.second < body_offset)
+    return true;
+
   // Get the reference.
   BlockGraph::Reference ref;
   if (!referrer.first->GetReference(referrer.second, &ref)) {
@@ -217,6 +275,10 @@ bool EntryThunkTransform::InstrumentCodeBlockReferrer(
     return false;
   }
 
+  // Skip the references that were redirected to the direct call stub.
+  if (ref.offset() < body_offset)
+    return true;
+
   // Skip self-references, except long references to the start of the block.
   // TODO(siggi): This needs refining, as it may currently miss important
   //     cases. Notably if a block contains more than one function, and the
@@ -233,7 +295,7 @@ bool EntryThunkTransform::InstrumentCodeBlockReferrer(
     // references will tend to be switch tables, and we don't need the
     // overhead of instrumenting and recording all switch statement executions
     // for now.
-    if (ref.offset() != 0)
+    if (ref.offset() != body_offset)
       return true;
   }
 
@@ -303,6 +365,96 @@ bool EntryThunkTransform::InstrumentCodeBlockReferrer(
   return true;
 }
 
+bool EntryThunkTransform::AddDirectCallStub(BlockGraph::Block* block,
+                                            BlockGraph::Offset* body_offset) {
+  DCHECK(block != NULL);
+  DCHECK(body_offset != NULL);
+
+  *body_offset = 0;
+
+  // Module entry points are called by the loader, and use their own hooks.
+  pe::EntryPoint entry(block, 0);
+  if (dllmain_entrypoints_.count(entry) != 0 || entry == exe_entry_point_)
+    return true;
+
+  // Only add a stub if something calls the function directly.
+  bool has_direct_calls = false;
+  BlockGraph::Block::ReferrerSet::const_iterator referrer_it =
+      block->referrers().begin();
+  for (; referrer_it != block->referrers().end(); ++referrer_it) {
+    BlockGraph::Reference ref;
+    if (!referrer_it->first->GetReference(referrer_it->second, &ref)) {
+      LOG(ERROR) << "Unable to get reference from referrer.";
+      return false;
+    }
+    if (ref.offset() == 0 &&
+        IsDirectCallReference(referrer_it->first, ref)) {
+      has_direct_calls = true;
+      break;
+    }
+  }
+  if (!has_direct_calls)
+    return true;
+
+  // Make room for the stub, which shifts the body and all of the references
+  // to it.
+  const ImmediateType* param = NULL;
+  if (FunctionThunkIsParameterized())
+    param = &function_thunk_parameter_;
+  BlockGraph::Offset stub_size = 1 + sizeof(core::AbsoluteAddress) +
+      sizeof(kJmpIndirect) + sizeof(core::AbsoluteAddress);
+  if (param != NULL)
+    stub_size += 1 + sizeof(core::AbsoluteAddress);
+  block->InsertData(0, stub_size, true);
+
+  // Set up the stub:
+  // 1. push parameter
+  // 2. push body_addr
+  // 3. jmp [hook_addr]
+  BlockGraph::Offset offset = 0;
+  if (param != NULL)
+    offset = WritePush(*param, offset, block);
+  offset = WritePush(Immediate(block, stub_size), offset, block);
+  uint8_t* data = block->GetMutableData();
+  ::memcpy(data + offset, kJmpIndirect, sizeof(kJmpIndirect));
+  offset += sizeof(kJmpIndirect);
+  block->SetReference(offset,
+                      BlockGraph::Reference(BlockGraph::ABSOLUTE_REF,
+                                            sizeof(core::AbsoluteAddress),
+                                            hook_ref_.referenced(),
+                                            hook_ref_.offset(),
+                                            hook_ref_.offset()));
+  offset += sizeof(core::AbsoluteAddress);
+  DCHECK_EQ(stub_size, offset);
+
+  // Point the direct calls and jumps at the stub. We copy the referrer set
+  // as it is mutated in the loop.
+  BlockGraph::Block::ReferrerSet referrers = block->referrers();
+  for (referrer_it = referrers.begin(); referrer_it != referrers.end();
+       ++referrer_it) {
+    const BlockGraph::Block::Referrer& referrer = *referrer_it;
+    BlockGraph::Reference ref;
+    if (!referrer.first->GetReference(referrer.second, &ref)) {
+      LOG(ERROR) << "Unable to get reference from referrer.";
+      return false;
+    }
+    if (ref.offset() != stub_size ||
+        !IsDirectCallReference(referrer.first, ref)) {
+      continue;
+    }
+    if (!instrument_unsafe_references_ &&
+        block_graph::IsUnsafeReference(referrer.first, ref)) {
+      continue;
+    }
+    referrer.first->SetReference(
+        referrer.second,
+        BlockGraph::Reference(ref.type(), ref.size(), block, 0, 0));
+  }
+
+  *body_offset = stub_size;
+  return true;
+}
+
 BlockGraph::Block* EntryThunkTransform::CreateOneThunk(
     BlockGraph* block_graph,
     const BlockGraph::Reference& destination,
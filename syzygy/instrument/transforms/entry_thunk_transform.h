@@ -43,6 +43,14 @@
 //
 // Prior to executing the thunk the stack is set up as if the call was going to
 // be directly to the original function.
+//
+// When direct call stubs are enabled, the same instruction sequence is instead
+// prepended to each function that is the target of direct calls, with the
+// pushed address pointing just past it at the original body. The direct call
+// and jump sites are pointed at the stub, while the references that take the
+// address of the function keep going through a thunk to the original body.
+// This keeps the instrumentation of the hot calls next to the code of their
+// callee, rather than in a separate section.
 
 #ifndef SYZYGY_INSTRUMENT_TRANSFORMS_ENTRY_THUNK_TRANSFORM_H_
 #define SYZYGY_INSTRUMENT_TRANSFORMS_ENTRY_THUNK_TRANSFORM_H_
@@ -93,6 +101,11 @@ class EntryThunkTransform
     return only_instrument_module_entry_;
   }
 
+  void set_direct_call_stubs(bool direct_call_stubs) {
+    direct_call_stubs_ = direct_call_stubs;
+  }
+  bool direct_call_stubs() const { return direct_call_stubs_; }
+
   void set_instrument_dll_name(const base::StringPiece& instrument_dll_name) {
     instrument_dll_name.CopyToString(&instrument_dll_name_);
   }
@@ -150,14 +163,30 @@ class EntryThunkTransform
   // @}
 
   // Instrument a single block.
-  bool InstrumentCodeBlock(BlockGraph* block_graph, BlockGraph::Block* block);
+  // @param block_graph the block-graph being instrumented.
+  // @param block the code block to instrument.
+  // @param body_offset the offset of the original body of the block, which is
+  //     non-zero if a direct call stub was prepended to it.
+  bool InstrumentCodeBlock(BlockGraph* block_graph,
+                           BlockGraph::Block* block,
+                           BlockGraph::Offset body_offset);
 
   // Instruments a single referrer to a code block.
   bool InstrumentCodeBlockReferrer(const BlockGraph::Block::Referrer& referrer,
                                    BlockGraph* block_graph,
                                    BlockGraph::Block* block,
+                                   BlockGraph::Offset body_offset,
                                    ThunkBlockMap* thunk_block_map);
 
+  // Prepends a direct call stub to a code block if it is the target of direct
+  // calls or jumps, and redirects those to the stub.
+  // @param block the code block to instrument.
+  // @param body_offset receives the offset of the original body of the block,
+  //     or zero if no stub was prepended.
+  // @returns true on success, false otherwise.
+  bool AddDirectCallStub(BlockGraph::Block* block,
+                         BlockGraph::Offset* body_offset);
+
   // Create a single thunk to destination.
   // @param block_graph the block-graph being instrumented.
   // @param destination the destination reference.
@@ -200,6 +229,10 @@ class EntryThunkTransform
   // If true, only instrument DLL entry points.
   bool only_instrument_module_entry_;
 
+  // If true, direct calls to functions go through a stub prepended to the
+  // function instead of through a thunk.
+  bool direct_call_stubs_;
+
   // If has a size of 32 bits, then entry thunks will be set up with an extra
   // parameter on the stack prior to the address of the original function.
   ImmediateType entry_thunk_parameter_;
@@ -383,14 +383,17 @@ TEST_F(EntryThunkTransformTest, AccessorsAndMutators) {
   EXPECT_TRUE(tx.instrument_unsafe_references());
   EXPECT_FALSE(tx.src_ranges_for_thunks());
   EXPECT_FALSE(tx.only_instrument_module_entry());
+  EXPECT_FALSE(tx.direct_call_stubs());
 
   tx.set_instrument_unsafe_references(false);
   tx.set_src_ranges_for_thunks(true);
   tx.set_only_instrument_module_entry(true);
+  tx.set_direct_call_stubs(true);
 
   EXPECT_FALSE(tx.instrument_unsafe_references());
   EXPECT_TRUE(tx.src_ranges_for_thunks());
   EXPECT_TRUE(tx.only_instrument_module_entry());
+  EXPECT_TRUE(tx.direct_call_stubs());
 }
 
 TEST_F(EntryThunkTransformTest, ParameterizedThunks) {
@@ -587,6 +590,53 @@ TEST_F(EntryThunkTransformTest, InstrumentNoUnsafe) {
   EXPECT_EQ(num_sections_pre_transform_ + 1, bg_.sections().size());
 }
 
+TEST_F(EntryThunkTransformTest, InstrumentDirectCallStubs) {
+  EntryThunkTransform transform;
+  ASSERT_NO_FATAL_FAILURE(SetEmptyDllEntryPoint());
+  transform.set_direct_call_stubs(true);
+
+  ASSERT_TRUE(ApplyBlockGraphTransform(
+      &transform, &policy_, &bg_, dos_header_block_));
+
+  // Both functions are called directly, so they both get a stub with the
+  // same layout as a thunk.
+  const BlockGraph::Offset kBodyOffset = sizeof(Thunk);
+  EXPECT_EQ(20u + sizeof(Thunk), foo_->size());
+  EXPECT_EQ(20u + sizeof(Thunk), bar_->size());
+  ASSERT_TRUE(foo_->data() != NULL);
+  EXPECT_EQ(0x68, foo_->data()[offsetof(Thunk, push)]);
+
+  // The stubs push the address of the original bodies.
+  BlockGraph::Reference ref;
+  ASSERT_TRUE(foo_->GetReference(offsetof(Thunk, func_addr), &ref));
+  EXPECT_EQ(BlockGraph::ABSOLUTE_REF, ref.type());
+  EXPECT_EQ(foo_, ref.referenced());
+  EXPECT_EQ(kBodyOffset, ref.offset());
+  ASSERT_TRUE(foo_->GetReference(offsetof(Thunk, hook_addr), &ref));
+  EXPECT_EQ(BlockGraph::ABSOLUTE_REF, ref.type());
+
+  // The direct calls go to the stubs.
+  ASSERT_TRUE(foo_->GetReference(kBodyOffset + 5, &ref));
+  EXPECT_EQ(bar_, ref.referenced());
+  EXPECT_EQ(0, ref.offset());
+  ASSERT_TRUE(foo_->GetReference(kBodyOffset + 10, &ref));
+  EXPECT_EQ(foo_, ref.referenced());
+  EXPECT_EQ(0, ref.offset());
+
+  // The call into the middle of foo() and the references from the array
+  // still go through thunks to the original bodies.
+  ASSERT_NO_FATAL_FAILURE(VerifyThunks(3, 0, 3, 1));
+  ASSERT_TRUE(array_->GetReference(0, &ref));
+  ASSERT_NE(foo_, ref.referenced());
+  BlockGraph::Reference thunk_ref;
+  ASSERT_TRUE(ref.referenced()->GetReference(offsetof(Thunk, func_addr),
+                                             &thunk_ref));
+  EXPECT_EQ(foo_, thunk_ref.referenced());
+  EXPECT_EQ(kBodyOffset, thunk_ref.offset());
+  ASSERT_TRUE(bar_->GetReference(kBodyOffset + 5, &ref));
+  ASSERT_NE(foo_, ref.referenced());
+}
+
 TEST_F(EntryThunkTransformTest, InstrumentDllEntrypoint) {
   EntryThunkTransform transform;
   ASSERT_NO_FATAL_FAILURE(SetEntryPoint(foo_, DLL_IMAGE));
@@ -84,9 +84,31 @@ bool FillerBasicBlockTransform::TransformBasicBlockSubGraph(
   return true;
 }
 
+class FillerTransform::FillerBasicBlockTransformFactory
+    : public block_graph::BasicBlockSubGraphTransformFactoryInterface {
+ public:
+  explicit FillerBasicBlockTransformFactory(bool debug_friendly)
+      : debug_friendly_(debug_friendly) {
+  }
+
+  std::unique_ptr<block_graph::BasicBlockSubGraphTransformInterface>
+      CreateTransform(const BlockGraph::Block* block) override {
+    std::unique_ptr<FillerBasicBlockTransform> transform(
+        new FillerBasicBlockTransform());
+    transform->set_debug_friendly(debug_friendly_);
+    return std::move(transform);
+  }
+
+ private:
+  bool debug_friendly_;
+
+  DISALLOW_COPY_AND_ASSIGN(FillerBasicBlockTransformFactory);
+};
+
 FillerTransform::FillerTransform(const std::set<std::string>& target_set,
                                  bool add_copy)
     : debug_friendly_(false),
+      thread_count_(1),
       num_blocks_(0),
       num_code_blocks_(0),
       num_targets_updated_(0),
@@ -149,6 +171,13 @@ bool FillerTransform::OnBlock(const TransformPolicyInterface* policy,
     return true;
 
   ++num_targets_updated_;
+  // The basic block transform only touches the block itself, so it can be
+  // deferred and applied to all the targets in parallel.
+  if (thread_count_ > 1) {
+    parallel_blocks_.push_back(block);
+    return true;
+  }
+
   // Apply the basic block transform.
   FillerBasicBlockTransform basic_block_transform;
   basic_block_transform.set_debug_friendly(debug_friendly());
@@ -160,6 +189,15 @@ bool FillerTransform::PostBlockGraphIteration(
     const TransformPolicyInterface* policy,
     BlockGraph* block_graph,
     Block* header_block) {
+  if (!parallel_blocks_.empty()) {
+    FillerBasicBlockTransformFactory factory(debug_friendly_);
+    if (!ApplyBasicBlockSubGraphTransformInParallel(
+            &factory, policy, thread_count_, block_graph, parallel_blocks_)) {
+      return false;
+    }
+    parallel_blocks_.clear();
+  }
+
   LOG(INFO) << "Found " << num_blocks_ << " block(s).";
   LOG(INFO) << "Found " << num_code_blocks_ << " code block(s).";
   LOG(INFO) << "Updated " << num_targets_updated_ << " blocks(s).";
@@ -130,6 +130,14 @@ class FillerTransform
   // @{
   bool debug_friendly() const { return debug_friendly_; }
   void set_debug_friendly(bool flag) { debug_friendly_ = flag; }
+  // The number of threads the targets are decomposed and transformed on. When
+  // this is more than 1 the targets are transformed after the iteration, and
+  // merged back in block order.
+  size_t thread_count() const { return thread_count_; }
+  void set_thread_count(size_t thread_count) {
+    DCHECK_LT(0u, thread_count);
+    thread_count_ = thread_count;
+  }
   const std::map<std::string, bool>& target_visited() const {
     return target_visited_;
   }
@@ -159,9 +167,17 @@ class FillerTransform
   friend NamedBlockGraphTransformImpl<FillerTransform>;
   friend IterativeTransformImpl<FillerTransform>;
 
+  class FillerBasicBlockTransformFactory;
+
   // Activate the overwriting of source range for created instructions.
   bool debug_friendly_;
 
+  // The number of threads used to transform the targets.
+  size_t thread_count_;
+
+  // The targets to transform in parallel once the iteration is done.
+  block_graph::BlockVector parallel_blocks_;
+
   // Whether to add a dummy copy of each target.
   bool add_copy_;
 
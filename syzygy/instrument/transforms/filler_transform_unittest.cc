@@ -159,12 +159,14 @@ class FillerTransformTest : public testing::TestDllTransformTest {
   // Applies the Filler Transform to specified @p target_set, and adds copy iff
   // @p add_copy is true. Verifies that the transform is successful.
   void ApplyFillerTransform(const std::set<std::string> target_set,
-                            bool add_copy) {
+                            bool add_copy,
+                            size_t thread_count) {
     ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
 
     // Apply the Filler Transform.
     TestFillerTransform tx(target_set, add_copy);
     tx.set_debug_friendly(true);  // Copy source ranges to injected NOPs.
+    tx.set_thread_count(thread_count);
     ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
         &tx, policy_, &block_graph_, header_block_));
 
@@ -196,13 +198,14 @@ class FillerTransformTest : public testing::TestDllTransformTest {
     }
   }
 
-  void ApplyFillerTransformTest(bool add_copy) {
+  void ApplyFillerTransformTest(bool add_copy, size_t thread_count) {
     std::set<std::string> targets = {
       "Used::M",
       "TestUnusedFuncs"
     };
 
-    ASSERT_NO_FATAL_FAILURE(ApplyFillerTransform(targets, add_copy));
+    ASSERT_NO_FATAL_FAILURE(
+        ApplyFillerTransform(targets, add_copy, thread_count));
 
     // Expect original targets to remain, and with copies if |add_copy|.
     std::set<std::string> targets_with_copies(targets);
@@ -365,11 +368,15 @@ TEST_F(FillerBasicBlockTransformTest, InjectAlternate) {
 }
 
 TEST_F(FillerTransformTest, Apply) {
-  ASSERT_NO_FATAL_FAILURE(ApplyFillerTransformTest(true));
+  ASSERT_NO_FATAL_FAILURE(ApplyFillerTransformTest(true, 1));
 }
 
 TEST_F(FillerTransformTest, ApplyNoAddCopy) {
-  ASSERT_NO_FATAL_FAILURE(ApplyFillerTransformTest(false));
+  ASSERT_NO_FATAL_FAILURE(ApplyFillerTransformTest(false, 1));
+}
+
+TEST_F(FillerTransformTest, ApplyInParallel) {
+  ASSERT_NO_FATAL_FAILURE(ApplyFillerTransformTest(true, 4));
 }
 
 }  // namespace transforms
@@ -17,17 +17,23 @@
 #include "syzygy/instrument/transforms/jump_table_count_transform.h"
 
 #include <limits>
+#include <map>
+#include <vector>
 
 #include "base/logging.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
+#include "syzygy/block_graph/basic_block_decomposer.h"
 #include "syzygy/block_graph/block_builder.h"
 #include "syzygy/block_graph/block_util.h"
+#include "syzygy/block_graph/analysis/liveness_analysis.h"
 #include "syzygy/common/defs.h"
 #include "syzygy/common/indexed_frequency_data.h"
 #include "syzygy/instrument/transforms/entry_thunk_transform.h"
 #include "syzygy/pe/pe_utils.h"
 #include "syzygy/pe/transforms/pe_add_imports_transform.h"
+#include "third_party/distorm/files/include/mnemonics.h"
+#include "third_party/distorm/files/src/x86defs.h"
 
 namespace instrument {
 namespace transforms {
@@ -35,6 +41,7 @@ namespace transforms {
 namespace {
 
 using block_graph::BasicBlock;
+using block_graph::BasicBlockDecomposer;
 using block_graph::BasicBlockSubGraph;
 using block_graph::BasicCodeBlock;
 using block_graph::BasicDataBlock;
@@ -47,6 +54,7 @@ using block_graph::Immediate;
 using block_graph::Instruction;
 using block_graph::Operand;
 using block_graph::TransformPolicyInterface;
+using block_graph::analysis::LivenessAnalysis;
 using pe::transforms::PEAddImportsTransform;
 using pe::transforms::ImportedModule;
 
@@ -54,6 +62,57 @@ const char kDefaultModuleName[] = "basic_block_entry_client.dll";
 const char kJumpTableCaseCounter[] = "_increment_indexed_freq_data";
 const char kThunkSuffix[] = "_jump_table_thunk";
 
+const BlockGraph::Offset kFrequencyDataOffset =
+    offsetof(common::IndexedFrequencyData, frequency_data);
+
+// The registers that may hold the counter array of the inline increments, in
+// order of preference.
+const assm::Register32* const kScratchRegisters[] = {
+    &assm::eax, &assm::ecx, &assm::edx, &assm::ebx, &assm::esi, &assm::edi };
+
+// A jump through a jump table, with the liveness state before it.
+struct JumpTableJump {
+  BasicCodeBlock* bb;
+  BasicBlock::Instructions::iterator instr;
+  const BasicDataBlock* table;
+  LivenessAnalysis::State state;
+};
+
+// Determines if @p bb is a jump table.
+bool IsJumpTable(const BasicBlock* bb) {
+  const BasicDataBlock* data_bb = BasicDataBlock::Cast(bb);
+  return data_bb != NULL &&
+      data_bb->label().has_attributes(BlockGraph::JUMP_TABLE_LABEL);
+}
+
+// Gets the jump table and the index register of a jump through a jump table.
+// @param instr The instruction to inspect.
+// @param table will be set to the jump table.
+// @param index will be set to the index register of the jump table.
+// @returns true if @p instr is a jmp [index * 4 + table], false otherwise.
+bool GetJumpTableJump(const Instruction& instr,
+                      const BasicDataBlock** table,
+                      const assm::Register32** index) {
+  DCHECK(table != NULL);
+  DCHECK(index != NULL);
+
+  const _DInst& repr = instr.representation();
+  if (repr.opcode != I_JMP || repr.ops[0].type != O_MEM ||
+      repr.base != R_NONE || repr.scale != 4 ||
+      instr.references().size() != 1) {
+    return false;
+  }
+
+  const BasicBlock* referenced =
+      instr.references().begin()->second.basic_block();
+  if (!IsJumpTable(referenced))
+    return false;
+
+  *table = BasicDataBlock::Cast(referenced);
+  *index = &assm::CastAsRegister32(core::GetRegister(repr.ops[0].index));
+  return true;
+}
+
 // Sets up the jump table counter hook import.
 // @param policy The policy object restricting how the transform is applied.
 // @param block_graph The block-graph to populate.
@@ -109,7 +168,8 @@ JumpTableCaseCountTransform::JumpTableCaseCountTransform()
                           common::IndexedFrequencyData::JUMP_TABLE,
                           sizeof(common::IndexedFrequencyData)),
       instrument_dll_name_(kDefaultModuleName),
-      jump_table_case_count_(0) {
+      jump_table_case_count_(0),
+      compact_counters_(false) {
 }
 
 bool JumpTableCaseCountTransform::PreBlockGraphIteration(
@@ -158,6 +218,14 @@ bool JumpTableCaseCountTransform::OnBlock(
   if (block->type() != BlockGraph::CODE_BLOCK)
     return true;
 
+  if (compact_counters_ && policy->BlockIsSafeToBasicBlockDecompose(block)) {
+    bool instrumented = false;
+    if (!InstrumentJumpTablesInline(policy, block_graph, block, &instrumented))
+      return false;
+    if (instrumented)
+      return true;
+  }
+
   // Iterate over the labels of the block to find the jump tables.
   for (BlockGraph::Block::LabelMap::const_iterator iter_label(
            block->labels().begin());
@@ -238,6 +306,147 @@ bool JumpTableCaseCountTransform::PostBlockGraphIteration(
   return true;
 }
 
+bool JumpTableCaseCountTransform::InstrumentJumpTablesInline(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* block,
+    bool* instrumented) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(block != NULL);
+  DCHECK(instrumented != NULL);
+
+  *instrumented = false;
+
+  // Only the blocks containing jump tables are decomposed.
+  bool has_jump_table = false;
+  BlockGraph::Block::LabelMap::const_iterator iter_label(
+      block->labels().begin());
+  for (; iter_label != block->labels().end(); ++iter_label) {
+    if (iter_label->second.has_attributes(BlockGraph::JUMP_TABLE_LABEL)) {
+      has_jump_table = true;
+      break;
+    }
+  }
+  if (!has_jump_table)
+    return true;
+
+  BasicBlockSubGraph subgraph;
+  BasicBlockDecomposer bb_decomposer(block, &subgraph);
+  if (!bb_decomposer.Decompose())
+    return true;
+
+  LivenessAnalysis liveness;
+  liveness.Analyze(&subgraph);
+
+  // Find the jumps through the jump tables. Every reference to a jump table
+  // must come from such a jump, otherwise the block is thunked. The liveness
+  // states are computed before any instruction is added.
+  std::vector<JumpTableJump> jumps;
+  std::map<const BasicDataBlock*, size_t> table_ids;
+  size_t table_count = 0;
+  BasicBlockSubGraph::BBCollection::iterator it =
+      subgraph.basic_blocks().begin();
+  for (; it != subgraph.basic_blocks().end(); ++it) {
+    if (IsJumpTable(*it)) {
+      ++table_count;
+      continue;
+    }
+
+    BasicCodeBlock* bb = BasicCodeBlock::Cast(*it);
+    if (bb == NULL)
+      continue;
+
+    LivenessAnalysis::State state;
+    liveness.GetStateAtExitOf(bb, &state);
+    BasicBlock::Instructions::iterator instr = bb->instructions().end();
+    while (instr != bb->instructions().begin()) {
+      --instr;
+      liveness.PropagateBackward(*instr, &state);
+
+      JumpTableJump jump = { bb, instr, NULL, state };
+      const assm::Register32* index = NULL;
+      if (GetJumpTableJump(*instr, &jump.table, &index)) {
+        jumps.push_back(jump);
+        table_ids[jump.table] = 0;
+        continue;
+      }
+
+      Instruction::BasicBlockReferenceMap::const_iterator ref =
+          instr->references().begin();
+      for (; ref != instr->references().end(); ++ref) {
+        if (IsJumpTable(ref->second.basic_block()))
+          return true;
+      }
+    }
+  }
+  if (jumps.empty() || table_ids.size() != table_count)
+    return true;
+
+  // Allocate the counters of each table contiguously.
+  std::map<const BasicDataBlock*, size_t>::iterator table = table_ids.begin();
+  for (; table != table_ids.end(); ++table) {
+    size_t table_size = table->first->references().size();
+    table->second = jump_table_case_count_;
+    jump_table_infos_.push_back(
+        std::make_pair(block->addr() + table->first->offset(), table_size));
+    jump_table_case_count_ += table_size;
+  }
+
+  BlockGraph::Block* data_block = add_frequency_data_.frequency_data_block();
+  DCHECK(data_block != NULL);
+
+  std::vector<JumpTableJump>::iterator jump = jumps.begin();
+  for (; jump != jumps.end(); ++jump) {
+    const assm::Register32* index = NULL;
+    const BasicDataBlock* table = NULL;
+    CHECK(GetJumpTableJump(*jump->instr, &table, &index));
+
+    // Prefer a dead register to hold the counter array.
+    const assm::Register32* scratch = NULL;
+    bool save_scratch = false;
+    for (size_t i = 0; i < arraysize(kScratchRegisters); ++i) {
+      if (*kScratchRegisters[i] == *index ||
+          jump->state.IsLive(*kScratchRegisters[i])) {
+        continue;
+      }
+      scratch = kScratchRegisters[i];
+      break;
+    }
+    if (scratch == NULL) {
+      scratch = *index == assm::eax ? &assm::ecx : &assm::eax;
+      save_scratch = true;
+    }
+    bool save_flags = jump->state.AreArithmeticFlagsLive();
+
+    uint32_t first_id = static_cast<uint32_t>(table_ids[table]);
+    BasicBlockAssembler jump_asm(jump->instr, &jump->bb->instructions());
+    if (save_scratch)
+      jump_asm.push(*scratch);
+    jump_asm.mov(*scratch,
+                 Operand(Displacement(data_block, kFrequencyDataOffset)));
+    if (save_flags)
+      jump_asm.pushfd();
+    jump_asm.add(Operand(*scratch, *index, assm::kTimes4,
+                         Displacement(first_id * sizeof(uint32_t))),
+                 Immediate(1));
+    if (save_flags)
+      jump_asm.popfd();
+    if (save_scratch)
+      jump_asm.pop(*scratch);
+  }
+
+  // Update the block-graph.
+  BlockBuilder block_builder(block_graph);
+  if (!block_builder.Merge(&subgraph)) {
+    LOG(ERROR) << "Failed to rebuild block with jump table counters.";
+    return false;
+  }
+
+  *instrumented = true;
+  return true;
+}
+
 BlockGraph::Block* JumpTableCaseCountTransform::CreateOneThunk(
     BlockGraph* block_graph,
     const BlockGraph::Reference& destination) {
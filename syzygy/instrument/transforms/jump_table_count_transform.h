@@ -20,6 +20,15 @@
 //     push unique_id_for_this_case
 //     call jump_table_count.dll!_jump_table_case_counter
 //     jmp original_reference
+//
+// With compact counters, the jumps through the jump tables are instead
+// preceded by an increment of the counter indexed by their index register:
+//     mov scratch, dword ptr[data.frequency_data]
+//     add dword ptr[scratch + index * 4 + first_id_of_this_table * 4], 1
+// The counters of each jump table are contiguous in the frequency data, so
+// the same data is gathered without a thunk per case. The scratch register
+// and the flags are only saved when they're live. The blocks that can't be
+// decomposed, or whose jump tables aren't all reached this way, are thunked.
 
 #ifndef SYZYGY_INSTRUMENT_TRANSFORMS_JUMP_TABLE_COUNT_TRANSFORM_H_
 #define SYZYGY_INSTRUMENT_TRANSFORMS_JUMP_TABLE_COUNT_TRANSFORM_H_
@@ -46,6 +55,14 @@ class JumpTableCaseCountTransform
   // module and function names.
   JumpTableCaseCountTransform();
 
+  // @name Accessors and mutators.
+  // @{
+  bool compact_counters() const { return compact_counters_; }
+  void set_compact_counters(bool compact_counters) {
+    compact_counters_ = compact_counters;
+  }
+  // @}
+
  protected:
   typedef block_graph::BlockGraph BlockGraph;
   typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
@@ -93,6 +110,19 @@ class JumpTableCaseCountTransform
   BlockGraph::Block* CreateOneThunk(BlockGraph* block_graph,
                                     const BlockGraph::Reference& destination);
 
+  // Increments the counters of the jump tables of a block inline, before the
+  // jumps through them.
+  // @param policy The policy object restricting how the transform is applied.
+  // @param block_graph the block-graph being instrumented.
+  // @param block the block containing the jump tables.
+  // @param instrumented will be set to true if the jump tables of @p block
+  //     were instrumented, false if they must be thunked instead.
+  // @returns true on success, false otherwise.
+  bool InstrumentJumpTablesInline(const TransformPolicyInterface* policy,
+                                  BlockGraph* block_graph,
+                                  BlockGraph::Block* block,
+                                  bool* instrumented);
+
   // The section we put our thunks in.
   BlockGraph::Section* thunk_section_;
 
@@ -112,6 +142,9 @@ class JumpTableCaseCountTransform
   // The different jump tables encountered; we store their addresses and sizes.
   JumpTableVector jump_table_infos_;
 
+  // Indicates if the counters are incremented inline rather than by thunks.
+  bool compact_counters_;
+
   DISALLOW_COPY_AND_ASSIGN(JumpTableCaseCountTransform);
 };
 
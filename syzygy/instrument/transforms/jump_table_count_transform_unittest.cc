@@ -167,5 +167,66 @@ TEST_F(JumpTableCaseCountTransformTest, Apply) {
   DCHECK_EQ(frequency_data->num_entries, jump_table_entries);
 }
 
+TEST_F(JumpTableCaseCountTransformTest, ApplyCompactCounters) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+
+  // Apply the transform.
+  TestJumpTableCaseCountTransform tx;
+  tx.set_compact_counters(true);
+  EXPECT_TRUE(tx.compact_counters());
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &tx, policy_, &block_graph_, header_block_));
+  ASSERT_TRUE(tx.frequency_data_block() != NULL);
+
+  block_graph::ConstTypedBlock<IndexedFrequencyData> frequency_data;
+  ASSERT_TRUE(frequency_data.Init(0, tx.frequency_data_block()));
+  EXPECT_EQ(sizeof(uint32_t), frequency_data->frequency_size);
+  EXPECT_EQ(frequency_data->num_entries * frequency_data->frequency_size,
+            tx.frequency_data_buffer_block()->size());
+
+  // Each jump table either still refers to its own block, in which case its
+  // counters are inline, or is thunked. Either way, its cases are counted.
+  size_t jump_table_entries = 0;
+  size_t inline_jump_tables = 0;
+  for (BlockGraph::BlockMap::const_iterator block_iter(
+           block_graph_.blocks().begin());
+      block_iter != block_graph_.blocks().end();
+      ++block_iter) {
+    const BlockGraph::Block& block = block_iter->second;
+    if (block.type() != BlockGraph::CODE_BLOCK)
+      continue;
+    if (block.section() == tx.thunk_section()->id())
+      continue;
+
+    for (BlockGraph::Block::LabelMap::const_iterator iter_label(
+             block.labels().begin());
+        iter_label != block.labels().end();
+        ++iter_label) {
+      if (!iter_label->second.has_attributes(BlockGraph::JUMP_TABLE_LABEL))
+        continue;
+
+      size_t table_size = 0;
+      ASSERT_TRUE(
+          block_graph::GetJumpTableSize(&block, iter_label, &table_size));
+
+      BlockGraph::Block::ReferenceMap::const_iterator iter_ref =
+          block.references().find(iter_label->first);
+      ASSERT_TRUE(iter_ref != block.references().end());
+      if (iter_ref->second.referenced() == &block) {
+        ++inline_jump_tables;
+      } else {
+        for (size_t i = 0; i < table_size; ++i) {
+          CheckBlockIsAThunk(iter_ref->second.referenced());
+          ++iter_ref;
+        }
+      }
+
+      jump_table_entries += table_size;
+    }
+  }
+  EXPECT_LT(0u, inline_jump_tables);
+  EXPECT_EQ(frequency_data->num_entries, jump_table_entries);
+}
+
 }  // namespace transforms
 }  // namespace instrument
@@ -0,0 +1,170 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/integration_tests/benchmark_kernels.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace testing {
+
+namespace {
+
+// A linear congruential generator, so that the kernels do the same work on
+// every run.
+class Random {
+ public:
+  Random() : state_(12345) {}
+  unsigned int Next() {
+    state_ = state_ * 1103515245 + 12345;
+    return state_ >> 8;
+  }
+
+ private:
+  unsigned int state_;
+};
+
+// The functions of the call chain mustn't be inlined for the calls to be
+// made.
+__declspec(noinline) unsigned int CallChainLeaf(unsigned int value) {
+  return value * 31 + 7;
+}
+
+__declspec(noinline) unsigned int CallChain(unsigned int depth,
+                                            unsigned int value) {
+  if (depth == 0)
+    return CallChainLeaf(value);
+  return CallChain(depth - 1, value ^ depth) + depth;
+}
+
+}  // namespace
+
+unsigned int BenchmarkAllocationChurn() {
+  const size_t kLiveBlocks = 64;
+  const size_t kAllocations = 10000;
+  const size_t kMaxSize = 512;
+
+  Random random;
+  char* blocks[kLiveBlocks] = {};
+  unsigned int sum = 0;
+  for (size_t i = 0; i < kAllocations; ++i) {
+    size_t slot = i % kLiveBlocks;
+    delete[] blocks[slot];
+
+    size_t size = random.Next() % kMaxSize + 1;
+    blocks[slot] = new char[size];
+    ::memset(blocks[slot], static_cast<int>(i), size);
+    sum += blocks[slot][size / 2] + size;
+  }
+
+  for (size_t i = 0; i < kLiveBlocks; ++i)
+    delete[] blocks[i];
+  return sum;
+}
+
+unsigned int BenchmarkStringOps() {
+  const size_t kRounds = 2000;
+  const size_t kBufferSize = 256;
+  static const char kWords[] = "the quick brown fox jumps over the lazy dog";
+
+  char source[kBufferSize];
+  char buffer[2 * kBufferSize];
+  ::strncpy(source, kWords, kBufferSize);
+  source[kBufferSize - 1] = 0;
+
+  unsigned int sum = 0;
+  for (size_t i = 0; i < kRounds; ++i) {
+    ::strcpy(buffer, source);
+    ::strcat(buffer, source + i % (sizeof(kWords) - 1));
+    sum += ::strlen(buffer);
+
+    const char* c = ::strchr(buffer, 'a' + i % 26);
+    if (c != NULL)
+      sum += c - buffer;
+    const char* word = ::strstr(buffer, "lazy");
+    if (word != NULL)
+      sum += word - buffer;
+    sum += ::strcspn(buffer, "xyz");
+    sum += ::strcmp(buffer, source) > 0 ? 1 : 0;
+
+    ::memmove(buffer + 1, buffer, kBufferSize);
+    ::memset(buffer, 'a' + i % 26, i % kBufferSize);
+    buffer[kBufferSize] = 0;
+    sum += ::memcmp(buffer, source, kBufferSize / 2) > 0 ? 1 : 0;
+  }
+  return sum;
+}
+
+unsigned int BenchmarkStlContainers() {
+  const size_t kElements = 2000;
+
+  Random random;
+  std::vector<unsigned int> values;
+  std::map<unsigned int, size_t> positions;
+  std::string text;
+  for (size_t i = 0; i < kElements; ++i) {
+    unsigned int value = random.Next() % (4 * kElements);
+    values.push_back(value);
+    positions[value] = i;
+    text += static_cast<char>('a' + value % 26);
+  }
+  std::sort(values.begin(), values.end());
+
+  unsigned int sum = 0;
+  for (size_t i = 0; i < kElements; ++i) {
+    auto it = positions.find(static_cast<unsigned int>(i));
+    if (it != positions.end())
+      sum += it->second;
+    if (std::binary_search(values.begin(), values.end(), i))
+      sum += 1;
+  }
+  sum += values[kElements / 2];
+  sum += text.find("abc") != std::string::npos ? 1 : 0;
+  sum += positions.size();
+  return sum;
+}
+
+unsigned int BenchmarkTightLoop() {
+  const size_t kBufferLength = 4096;
+  const size_t kRounds = 32;
+
+  unsigned int values[kBufferLength];
+  for (size_t i = 0; i < kBufferLength; ++i)
+    values[i] = i;
+
+  unsigned int sum = 0;
+  for (size_t round = 0; round < kRounds; ++round) {
+    for (size_t i = 1; i < kBufferLength; ++i) {
+      values[i] = values[i] * 3 + (values[i - 1] >> 2) + round;
+      sum ^= values[i];
+    }
+  }
+  return sum;
+}
+
+unsigned int BenchmarkDeepCallChain() {
+  const unsigned int kDepth = 64;
+  const unsigned int kChains = 500;
+
+  unsigned int sum = 0;
+  for (unsigned int i = 0; i < kChains; ++i)
+    sum += CallChain(kDepth, i);
+  return sum;
+}
+
+}  // namespace testing
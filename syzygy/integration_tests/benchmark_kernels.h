@@ -0,0 +1,42 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file declares the kernels used to measure the overhead of the
+// instrumentation modes. Each kernel does a fixed amount of work that is
+// representative of a common kind of code, and returns a checksum of its
+// results so that the work can't be optimized away and so that the results
+// of the instrumented versions can be checked.
+#ifndef SYZYGY_INTEGRATION_TESTS_BENCHMARK_KERNELS_H_
+#define SYZYGY_INTEGRATION_TESTS_BENCHMARK_KERNELS_H_
+
+namespace testing {
+
+// Allocates and frees blocks of varying sizes, keeping a window of them live.
+unsigned int BenchmarkAllocationChurn();
+
+// Copies, concatenates, searches and compares C strings.
+unsigned int BenchmarkStringOps();
+
+// Fills, sorts and looks up standard containers.
+unsigned int BenchmarkStlContainers();
+
+// Runs arithmetic over an array in a tight loop.
+unsigned int BenchmarkTightLoop();
+
+// Makes deep chains of calls to small functions.
+unsigned int BenchmarkDeepCallChain();
+
+}  // namespace testing
+
+#endif  // SYZYGY_INTEGRATION_TESTS_BENCHMARK_KERNELS_H_
@@ -0,0 +1,651 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Measures the overhead of the instrumentation modes on the benchmark kernels
+// of integration_tests_dll. The DLL is instrumented in each mode, and each
+// kernel is run in a process of its own so that its memory usage can be
+// measured. The results are written as JSON, with the slowdown and the memory
+// overhead of each mode relative to the uninstrumented DLL:
+//
+//   {
+//     "iterations": 20,
+//     "repetitions": 5,
+//     "benchmarks": [
+//       {
+//         "kernel": "allocation_churn",
+//         "runs": [
+//           {
+//             "mode": "none",
+//             "seconds_per_call": 0.00042,
+//             "peak_working_set": 3076096.0,
+//             "peak_pagefile_usage": 1212416.0,
+//             "slowdown": 1.0,
+//             "memory_overhead": 1.0
+//           },
+//           ...
+//         ]
+//       },
+//       ...
+//     ]
+//   }
+
+#include <windows.h>
+#include <psapi.h>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/at_exit.h"
+#include "base/command_line.h"
+#include "base/environment.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_file.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/json/json_reader.h"
+#include "base/logging.h"
+#include "base/macros.h"
+#include "base/path_service.h"
+#include "base/process/launch.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
+#include "base/strings/stringprintf.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/time/time.h"
+#include "base/values.h"
+#include "base/win/scoped_handle.h"
+#include "syzygy/application/application.h"
+#include "syzygy/core/json_file_writer.h"
+#include "syzygy/instrument/instrument_app.h"
+#include "syzygy/integration_tests/integration_tests_dll.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+
+namespace {
+
+typedef unsigned int (__stdcall* EndToEndTestFunction)(unsigned int);
+
+const char kUsage[] =
+    "Usage: instrumentation_benchmarks [options]\n"
+    "\n"
+    "  Instruments integration_tests_dll.dll in each mode, runs its benchmark\n"
+    "  kernels and writes their slowdown and memory overhead relative to the\n"
+    "  uninstrumented DLL as JSON.\n"
+    "\n"
+    "Options:\n"
+    "  --output-file=<path>  The file receiving the results. Defaults to\n"
+    "                        the standard output.\n"
+    "  --modes=<list>        A comma separated list of the instrumentation\n"
+    "                        modes to measure. Defaults to all of asan,\n"
+    "                        bbentry, branch, calltrace, coverage and\n"
+    "                        profile. The uninstrumented DLL is always\n"
+    "                        measured.\n"
+    "  --filter=<string>     Only runs the kernels whose name contains this\n"
+    "                        string.\n"
+    "  --iterations=<n>      The number of calls to a kernel in each\n"
+    "                        measurement. Defaults to 20.\n"
+    "  --repetitions=<n>     The number of times each measurement is made.\n"
+    "                        Defaults to 5.\n"
+    "  --pretty-print        Pretty prints the JSON output.\n"
+    "\n";
+
+const char kOutputFile[] = "output-file";
+const char kModes[] = "modes";
+const char kFilter[] = "filter";
+const char kIterations[] = "iterations";
+const char kRepetitions[] = "repetitions";
+const char kPrettyPrint[] = "pretty-print";
+
+// The switches of the child processes that run the kernels.
+const char kRunKernel[] = "run-kernel";
+const char kDll[] = "dll";
+const char kKernelOutput[] = "kernel-output";
+
+const size_t kDefaultIterations = 20;
+const size_t kDefaultRepetitions = 5;
+
+const wchar_t kTestDllName[] = L"integration_tests_dll.dll";
+const wchar_t kCallTraceServiceName[] = L"call_trace_service.exe";
+
+// The mode of the uninstrumented DLL, which the other modes are compared to.
+const char kBaselineMode[] = "none";
+
+struct InstrumentationMode {
+  const char* name;
+  // Whether the agent of the mode sends its traces to the call trace
+  // service.
+  bool uses_call_trace_service;
+};
+
+const InstrumentationMode kInstrumentationModes[] = {
+    { "asan", false },
+    { "bbentry", true },
+    { "branch", true },
+    { "calltrace", true },
+    { "coverage", true },
+    { "profile", true },
+};
+
+struct Kernel {
+  const char* name;
+  testing::EndToEndTestId id;
+};
+
+const Kernel kKernels[] = {
+    { "allocation_churn", testing::kBenchmarkAllocationChurn },
+    { "string_ops", testing::kBenchmarkStringOps },
+    { "stl_containers", testing::kBenchmarkStlContainers },
+    { "tight_loop", testing::kBenchmarkTightLoop },
+    { "deep_call_chain", testing::kBenchmarkDeepCallChain },
+};
+
+// The measurements of a kernel in a mode.
+struct KernelResult {
+  KernelResult()
+      : checksum(0),
+        seconds_per_call(0),
+        peak_working_set(0),
+        peak_pagefile_usage(0) {
+  }
+
+  // The value returned by the kernel, which doesn't depend on the mode.
+  double checksum;
+  // The shortest average time of a call over the repetitions.
+  double seconds_per_call;
+  // The peak memory usage of the process that ran the kernel, in bytes.
+  double peak_working_set;
+  double peak_pagefile_usage;
+};
+
+// Parses a strictly positive number from the command-line.
+// @param cmd_line The command-line.
+// @param switch_name The name of the switch holding the number.
+// @param value Receives the number. This is left unchanged if the switch is
+//     not present.
+// @returns true on success, false if the value of the switch is invalid.
+bool ParseCount(const base::CommandLine& cmd_line,
+                const char* switch_name,
+                size_t* value) {
+  DCHECK_NE(static_cast<size_t*>(nullptr), value);
+  if (!cmd_line.HasSwitch(switch_name))
+    return true;
+  std::string str = cmd_line.GetSwitchValueASCII(switch_name);
+  unsigned int count = 0;
+  if (!base::StringToUint(str, &count) || count == 0) {
+    LOG(ERROR) << "Invalid value for --" << switch_name << ": " << str << ".";
+    return false;
+  }
+  *value = count;
+  return true;
+}
+
+const Kernel* FindKernel(const std::string& name) {
+  for (const Kernel& kernel : kKernels) {
+    if (name == kernel.name)
+      return &kernel;
+  }
+  return nullptr;
+}
+
+// Runs a kernel in this process, and writes its measurements as JSON. This is
+// the body of the child processes.
+// @param cmd_line The command-line of the child process.
+// @returns the exit code of the child process.
+int RunKernel(const base::CommandLine& cmd_line) {
+  const Kernel* kernel = FindKernel(cmd_line.GetSwitchValueASCII(kRunKernel));
+  base::FilePath dll = cmd_line.GetSwitchValuePath(kDll);
+  base::FilePath output_path = cmd_line.GetSwitchValuePath(kKernelOutput);
+  size_t iterations = kDefaultIterations;
+  size_t repetitions = kDefaultRepetitions;
+  if (kernel == nullptr || dll.empty() || output_path.empty() ||
+      !ParseCount(cmd_line, kIterations, &iterations) ||
+      !ParseCount(cmd_line, kRepetitions, &repetitions)) {
+    LOG(ERROR) << "Invalid kernel command-line.";
+    return 1;
+  }
+
+  HMODULE module = ::LoadLibrary(dll.value().c_str());
+  if (module == nullptr) {
+    LOG(ERROR) << "Unable to load " << dll.value() << ".";
+    return 1;
+  }
+  EndToEndTestFunction function = reinterpret_cast<EndToEndTestFunction>(
+      ::GetProcAddress(module, "EndToEndTest"));
+  if (function == nullptr) {
+    LOG(ERROR) << "Unable to find the EndToEndTest function.";
+    return 1;
+  }
+
+  // The first call warms up the caches, and the lazily initialized state of
+  // the agent.
+  unsigned int checksum = function(kernel->id);
+
+  KernelResult result;
+  result.checksum = checksum;
+  result.seconds_per_call = std::numeric_limits<double>::max();
+  for (size_t i = 0; i < repetitions; ++i) {
+    base::TimeTicks start = base::TimeTicks::Now();
+    for (size_t j = 0; j < iterations; ++j) {
+      if (function(kernel->id) != checksum) {
+        LOG(ERROR) << "The kernel " << kernel->name << " isn't deterministic.";
+        return 1;
+      }
+    }
+    base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+    result.seconds_per_call =
+        std::min(result.seconds_per_call, elapsed.InSecondsF() / iterations);
+  }
+
+  PROCESS_MEMORY_COUNTERS counters = {};
+  if (!::GetProcessMemoryInfo(::GetCurrentProcess(), &counters,
+                              sizeof(counters))) {
+    LOG(ERROR) << "Failed to get the memory usage of the process.";
+    return 1;
+  }
+  result.peak_working_set = static_cast<double>(counters.PeakWorkingSetSize);
+  result.peak_pagefile_usage =
+      static_cast<double>(counters.PeakPagefileUsage);
+
+  base::ScopedFILE output(base::OpenFile(output_path, "wb"));
+  if (output.get() == nullptr) {
+    LOG(ERROR) << "Unable to open " << output_path.value() << ".";
+    return 1;
+  }
+  core::JSONFileWriter json_file(output.get(), false);
+  if (!json_file.OpenDict() ||
+      !json_file.OutputKey("checksum") ||
+      !json_file.OutputDouble(result.checksum) ||
+      !json_file.OutputKey("seconds_per_call") ||
+      !json_file.OutputDouble(result.seconds_per_call) ||
+      !json_file.OutputKey("peak_working_set") ||
+      !json_file.OutputDouble(result.peak_working_set) ||
+      !json_file.OutputKey("peak_pagefile_usage") ||
+      !json_file.OutputDouble(result.peak_pagefile_usage) ||
+      !json_file.CloseDict() ||
+      !json_file.Flush()) {
+    LOG(ERROR) << "Failed to write the kernel results.";
+    return 1;
+  }
+
+  return 0;
+}
+
+// Runs a kernel in a child process.
+// @param kernel The kernel to run.
+// @param dll The version of the test DLL to run it from.
+// @param iterations The number of calls in each measurement.
+// @param repetitions The number of measurements.
+// @param output_path The file receiving the measurements of the child.
+// @param result Receives the measurements.
+// @returns true on success, false otherwise.
+bool RunKernelInChildProcess(const Kernel& kernel,
+                             const base::FilePath& dll,
+                             size_t iterations,
+                             size_t repetitions,
+                             const base::FilePath& output_path,
+                             KernelResult* result) {
+  DCHECK_NE(static_cast<KernelResult*>(nullptr), result);
+
+  base::CommandLine child_cmd(
+      base::CommandLine::ForCurrentProcess()->GetProgram());
+  child_cmd.AppendSwitchASCII(kRunKernel, kernel.name);
+  child_cmd.AppendSwitchPath(kDll, dll);
+  child_cmd.AppendSwitchPath(kKernelOutput, output_path);
+  child_cmd.AppendSwitchASCII(
+      kIterations, base::UintToString(static_cast<unsigned int>(iterations)));
+  child_cmd.AppendSwitchASCII(
+      kRepetitions,
+      base::UintToString(static_cast<unsigned int>(repetitions)));
+
+  base::LaunchOptions options;
+  options.start_hidden = true;
+  base::Process child = base::LaunchProcess(child_cmd, options);
+  int exit_code = 0;
+  if (!child.IsValid() || !child.WaitForExit(&exit_code) || exit_code != 0) {
+    LOG(ERROR) << "Failed to run " << kernel.name << " from "
+               << dll.value() << ".";
+    return false;
+  }
+
+  std::string json;
+  if (!base::ReadFileToString(output_path, &json)) {
+    LOG(ERROR) << "Unable to read " << output_path.value() << ".";
+    return false;
+  }
+  std::unique_ptr<base::Value> value = base::JSONReader::Read(json);
+  base::DictionaryValue* dict = nullptr;
+  if (value.get() == nullptr || !value->GetAsDictionary(&dict) ||
+      !dict->GetDouble("checksum", &result->checksum) ||
+      !dict->GetDouble("seconds_per_call", &result->seconds_per_call) ||
+      !dict->GetDouble("peak_working_set", &result->peak_working_set) ||
+      !dict->GetDouble("peak_pagefile_usage",
+                       &result->peak_pagefile_usage)) {
+    LOG(ERROR) << "Invalid kernel results in " << output_path.value() << ".";
+    return false;
+  }
+
+  return true;
+}
+
+// Instruments the test DLL.
+// @param input_dll The uninstrumented DLL.
+// @param mode The instrumentation mode.
+// @param output_dll The instrumented DLL.
+// @returns true on success, false otherwise.
+bool InstrumentDll(const base::FilePath& input_dll,
+                   const std::string& mode,
+                   const base::FilePath& output_dll) {
+  LOG(INFO) << "Instrumenting " << input_dll.value() << " in " << mode
+            << " mode.";
+
+  base::CommandLine cmd_line(base::FilePath(L"instrument.exe"));
+  cmd_line.AppendSwitchPath("input-image", input_dll);
+  cmd_line.AppendSwitchPath("output-image", output_dll);
+  cmd_line.AppendSwitchASCII("mode", mode);
+
+  application::Application<instrument::InstrumentApp,
+                           application::INIT_LOGGING_NO> app;
+  app.set_command_line(&cmd_line);
+  if (app.Run() != 0) {
+    LOG(ERROR) << "Failed to instrument " << input_dll.value() << " in "
+               << mode << " mode.";
+    return false;
+  }
+  return true;
+}
+
+// Controls a call trace service instance that receives the traces of the
+// agents, so that their cost is included in the measurements.
+class CallTraceService {
+ public:
+  CallTraceService()
+      : instance_id_(base::StringPrintf("benchmarks-%d",
+                                        ::GetCurrentProcessId())) {
+  }
+
+  ~CallTraceService() { Stop(); }
+
+  // Starts the service, and publishes its instance ID to the environment of
+  // the child processes.
+  // @param trace_dir The directory receiving the trace files.
+  // @returns true on success, false otherwise.
+  bool Start(const base::FilePath& trace_dir) {
+    DCHECK(!process_.IsValid());
+
+    std::unique_ptr<base::Environment> env(base::Environment::Create());
+    if (!env->SetVar(::kSyzygyRpcInstanceIdEnvVar, instance_id_)) {
+      LOG(ERROR) << "Unable to set the call trace service instance ID.";
+      return false;
+    }
+
+    base::CommandLine service_cmd(GetServicePath());
+    service_cmd.AppendArg("start");
+    service_cmd.AppendSwitchPath("trace-dir", trace_dir);
+    service_cmd.AppendSwitchASCII("instance-id", instance_id_);
+
+    std::wstring event_name;
+    ::GetSyzygyCallTraceRpcEventName(base::UTF8ToUTF16(instance_id_),
+                                     &event_name);
+    base::win::ScopedHandle event(
+        ::CreateEvent(NULL, TRUE, FALSE, event_name.c_str()));
+    if (!event.IsValid()) {
+      LOG(ERROR) << "Unable to create the call trace service event.";
+      return false;
+    }
+
+    base::LaunchOptions options;
+    options.start_hidden = true;
+    process_ = base::LaunchProcess(service_cmd, options);
+    if (!process_.IsValid()) {
+      LOG(ERROR) << "Unable to start the call trace service.";
+      return false;
+    }
+
+    // The process handle is signaled if the service fails to start.
+    HANDLE handles[] = { event.Get(), process_.Handle() };
+    if (::WaitForMultipleObjects(arraysize(handles), handles, FALSE,
+                                 INFINITE) != WAIT_OBJECT_0) {
+      LOG(ERROR) << "The call trace service failed to start.";
+      process_.Close();
+      return false;
+    }
+
+    return true;
+  }
+
+  // Stops the service if it's running.
+  void Stop() {
+    if (!process_.IsValid())
+      return;
+
+    base::CommandLine service_cmd(GetServicePath());
+    service_cmd.AppendArg("stop");
+    service_cmd.AppendSwitchASCII("instance-id", instance_id_);
+
+    base::LaunchOptions options;
+    options.start_hidden = true;
+    options.wait = true;
+    base::LaunchProcess(service_cmd, options);
+
+    int exit_code = 0;
+    process_.WaitForExit(&exit_code);
+    process_.Close();
+  }
+
+ private:
+  static base::FilePath GetServicePath() {
+    base::FilePath exe_dir;
+    PathService::Get(base::DIR_EXE, &exe_dir);
+    return exe_dir.Append(kCallTraceServiceName);
+  }
+
+  std::string instance_id_;
+  base::Process process_;
+
+  DISALLOW_COPY_AND_ASSIGN(CallTraceService);
+};
+
+// Parses the list of the modes to measure.
+// @param cmd_line The command-line.
+// @param modes Receives the modes.
+// @returns true on success, false if a mode is unknown.
+bool ParseModes(const base::CommandLine& cmd_line,
+                std::vector<const InstrumentationMode*>* modes) {
+  DCHECK_NE(static_cast<std::vector<const InstrumentationMode*>*>(nullptr),
+            modes);
+
+  if (!cmd_line.HasSwitch(kModes)) {
+    for (const InstrumentationMode& mode : kInstrumentationModes)
+      modes->push_back(&mode);
+    return true;
+  }
+
+  for (const std::string& name : base::SplitString(
+           cmd_line.GetSwitchValueASCII(kModes), ",", base::TRIM_WHITESPACE,
+           base::SPLIT_WANT_NONEMPTY)) {
+    const InstrumentationMode* found = nullptr;
+    for (const InstrumentationMode& mode : kInstrumentationModes) {
+      if (name == mode.name)
+        found = &mode;
+    }
+    if (found == nullptr) {
+      LOG(ERROR) << "Unknown instrumentation mode: " << name << ".";
+      return false;
+    }
+    modes->push_back(found);
+  }
+  return true;
+}
+
+// Writes the results of a kernel.
+// @param kernel The kernel.
+// @param mode_names The names of the modes, starting with the baseline.
+// @param results The results of the kernel in each mode.
+// @param json_file The JSON file receiving the results.
+// @returns true on success, false otherwise.
+bool OutputKernelResults(const Kernel& kernel,
+                         const std::vector<std::string>& mode_names,
+                         const std::vector<KernelResult>& results,
+                         core::JSONFileWriter* json_file) {
+  DCHECK_EQ(mode_names.size(), results.size());
+  DCHECK(!results.empty());
+  DCHECK_NE(static_cast<core::JSONFileWriter*>(nullptr), json_file);
+
+  const KernelResult& baseline = results.front();
+  bool success = json_file->OpenDict() &&
+                 json_file->OutputKey("kernel") &&
+                 json_file->OutputString(kernel.name) &&
+                 json_file->OutputKey("runs") &&
+                 json_file->OpenList();
+  for (size_t i = 0; success && i < results.size(); ++i) {
+    const KernelResult& result = results[i];
+    double slowdown = 0;
+    if (baseline.seconds_per_call > 0)
+      slowdown = result.seconds_per_call / baseline.seconds_per_call;
+    double memory_overhead = 0;
+    if (baseline.peak_pagefile_usage > 0) {
+      memory_overhead =
+          result.peak_pagefile_usage / baseline.peak_pagefile_usage;
+    }
+
+    success = json_file->OpenDict() &&
+              json_file->OutputKey("mode") &&
+              json_file->OutputString(mode_names[i]) &&
+              json_file->OutputKey("seconds_per_call") &&
+              json_file->OutputDouble(result.seconds_per_call) &&
+              json_file->OutputKey("peak_working_set") &&
+              json_file->OutputDouble(result.peak_working_set) &&
+              json_file->OutputKey("peak_pagefile_usage") &&
+              json_file->OutputDouble(result.peak_pagefile_usage) &&
+              json_file->OutputKey("slowdown") &&
+              json_file->OutputDouble(slowdown) &&
+              json_file->OutputKey("memory_overhead") &&
+              json_file->OutputDouble(memory_overhead) &&
+              json_file->CloseDict();
+  }
+
+  return success && json_file->CloseList() && json_file->CloseDict();
+}
+
+}  // namespace
+
+int main(int argc, const char* const* argv) {
+  base::AtExitManager at_exit;
+  base::CommandLine::Init(argc, argv);
+  const base::CommandLine* cmd_line = base::CommandLine::ForCurrentProcess();
+
+  if (cmd_line->HasSwitch(kRunKernel))
+    return RunKernel(*cmd_line);
+
+  size_t iterations = kDefaultIterations;
+  size_t repetitions = kDefaultRepetitions;
+  std::vector<const InstrumentationMode*> modes;
+  if (!ParseCount(*cmd_line, kIterations, &iterations) ||
+      !ParseCount(*cmd_line, kRepetitions, &repetitions) ||
+      !ParseModes(*cmd_line, &modes) ||
+      !cmd_line->GetArgs().empty()) {
+    ::fprintf(stderr, "%s", kUsage);
+    return 1;
+  }
+  std::string filter = cmd_line->GetSwitchValueASCII(kFilter);
+
+  base::FilePath exe_dir;
+  base::ScopedTempDir temp_dir;
+  if (!PathService::Get(base::DIR_EXE, &exe_dir) ||
+      !temp_dir.CreateUniqueTempDir()) {
+    LOG(ERROR) << "Unable to set up the benchmarks.";
+    return 1;
+  }
+  base::FilePath input_dll = exe_dir.Append(kTestDllName);
+
+  // The uninstrumented DLL comes first, as the other modes are compared to it.
+  std::vector<std::string> mode_names(1, kBaselineMode);
+  std::vector<base::FilePath> dlls(1, input_dll);
+  bool uses_call_trace_service = false;
+  for (const InstrumentationMode* mode : modes) {
+    base::FilePath mode_dir = temp_dir.path().AppendASCII(mode->name);
+    base::FilePath output_dll = mode_dir.Append(kTestDllName);
+    if (!base::CreateDirectory(mode_dir) ||
+        !InstrumentDll(input_dll, mode->name, output_dll)) {
+      return 1;
+    }
+    mode_names.push_back(mode->name);
+    dlls.push_back(output_dll);
+    uses_call_trace_service |= mode->uses_call_trace_service;
+  }
+
+  CallTraceService service;
+  if (uses_call_trace_service) {
+    base::FilePath trace_dir = temp_dir.path().Append(L"traces");
+    if (!base::CreateDirectory(trace_dir) || !service.Start(trace_dir))
+      return 1;
+  }
+
+  base::ScopedFILE output_file;
+  FILE* output = stdout;
+  base::FilePath output_path = cmd_line->GetSwitchValuePath(kOutputFile);
+  if (!output_path.empty()) {
+    output_file.reset(base::OpenFile(output_path, "wb"));
+    if (output_file.get() == nullptr) {
+      LOG(ERROR) << "Unable to open " << output_path.value() << ".";
+      return 1;
+    }
+    output = output_file.get();
+  }
+
+  core::JSONFileWriter json_file(output, cmd_line->HasSwitch(kPrettyPrint));
+  bool success = json_file.OpenDict() &&
+                 json_file.OutputKey("iterations") &&
+                 json_file.OutputInteger(static_cast<int>(iterations)) &&
+                 json_file.OutputKey("repetitions") &&
+                 json_file.OutputInteger(static_cast<int>(repetitions)) &&
+                 json_file.OutputKey("benchmarks") &&
+                 json_file.OpenList();
+  for (const Kernel& kernel : kKernels) {
+    if (!success)
+      break;
+    if (std::string(kernel.name).find(filter) == std::string::npos)
+      continue;
+
+    LOG(INFO) << "Running " << kernel.name << ".";
+    std::vector<KernelResult> results(dlls.size());
+    for (size_t i = 0; success && i < dlls.size(); ++i) {
+      base::FilePath kernel_output = temp_dir.path().AppendASCII(
+          base::StringPrintf("%s-%s.json", mode_names[i].c_str(),
+                             kernel.name));
+      success = RunKernelInChildProcess(kernel, dlls[i], iterations,
+                                        repetitions, kernel_output,
+                                        &results[i]);
+
+      // The instrumentation must not change the results of the kernels.
+      if (success && results[i].checksum != results[0].checksum) {
+        LOG(ERROR) << "The " << mode_names[i] << " version of "
+                   << kernel.name << " returned a different result.";
+        success = false;
+      }
+    }
+
+    success = success &&
+              OutputKernelResults(kernel, mode_names, results, &json_file);
+  }
+  if (!success || !json_file.CloseList() || !json_file.CloseDict() ||
+      !json_file.Flush()) {
+    LOG(ERROR) << "Failed to run the benchmarks.";
+    return 1;
+  }
+
+  return 0;
+}
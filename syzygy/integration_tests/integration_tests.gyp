@@ -94,6 +94,8 @@
         'asan_page_protection_tests.h',
         'bb_entry_tests.cc',
         'bb_entry_tests.h',
+        'benchmark_kernels.cc',
+        'benchmark_kernels.h',
         'behavior_tests.cc',
         'behavior_tests.h',
         'coverage_tests.cc',
@@ -171,6 +173,36 @@
         },
       },
     },
+    {
+      'target_name': 'instrumentation_benchmarks',
+      'type': 'executable',
+      'sources': [
+        'instrumentation_benchmarks.cc',
+      ],
+      'dependencies': [
+        'integration_tests_dll',
+        '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/agent/asan/asan.gyp:syzyasan_rtl',
+        '<(src)/syzygy/agent/basic_block_entry/basic_block_entry.gyp:'
+            'basic_block_entry_client',
+        '<(src)/syzygy/agent/call_trace/call_trace.gyp:call_trace_client',
+        '<(src)/syzygy/agent/coverage/coverage.gyp:coverage_client',
+        '<(src)/syzygy/agent/profiler/profiler.gyp:profile_client',
+        '<(src)/syzygy/application/application.gyp:application_lib',
+        '<(src)/syzygy/core/core.gyp:core_lib',
+        '<(src)/syzygy/instrument/instrument.gyp:instrument_lib',
+        '<(src)/syzygy/trace/protocol/protocol.gyp:protocol_lib',
+        '<(src)/syzygy/trace/service/service.gyp:call_trace_service_exe',
+      ],
+      'msvs_settings': {
+        'VCLinkerTool': {
+          # The kernels are run in child processes of this executable, which
+          # load the Asan agent. Disable support for large address spaces, as
+          # the agent is compiled without it.
+          'LargeAddressAware': 1,
+        },
+      },
+    },
     {
       'target_name': 'integration_tests_harness',
       'type': 'executable',
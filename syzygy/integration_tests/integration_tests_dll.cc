@@ -21,6 +21,7 @@
 #include "syzygy/integration_tests/asan_interceptors_tests.h"
 #include "syzygy/integration_tests/asan_page_protection_tests.h"
 #include "syzygy/integration_tests/bb_entry_tests.h"
+#include "syzygy/integration_tests/benchmark_kernels.h"
 #include "syzygy/integration_tests/behavior_tests.h"
 #include "syzygy/integration_tests/coverage_tests.h"
 #include "syzygy/integration_tests/profile_tests.h"
@@ -184,7 +184,12 @@ namespace testing {
     decl(kAsanNearNullptrAccessNoHeapCorruptionUninstrumented, \
          testing::AsanNearNullptrAccessNoHeapCorruptionUninstrumented) \
     decl(kAsanNullptrAccessNoHeapCorruptionUninstrumented, \
-         testing::AsanNullptrAccessNoHeapCorruptionUninstrumented)
+         testing::AsanNullptrAccessNoHeapCorruptionUninstrumented) \
+    decl(kBenchmarkAllocationChurn, testing::BenchmarkAllocationChurn) \
+    decl(kBenchmarkStringOps, testing::BenchmarkStringOps) \
+    decl(kBenchmarkStlContainers, testing::BenchmarkStlContainers) \
+    decl(kBenchmarkTightLoop, testing::BenchmarkTightLoop) \
+    decl(kBenchmarkDeepCallChain, testing::BenchmarkDeepCallChain)
 
 // This enumeration contains an unique id for each end to end test. It is used
 // to perform an indirect call through the DLL entry point 'EndToEndTest'.
@@ -25,6 +25,24 @@ namespace kasko {
 
 class HttpResponse;
 
+// Provides the body of an HTTP request in chunks, so that it needn't be held
+// in memory as a whole.
+class HttpRequestBody {
+ public:
+  virtual ~HttpRequestBody() {}
+
+  // @returns the total size of the body, in bytes.
+  virtual size_t GetSize() = 0;
+
+  // Reads the next chunk of the body.
+  // @param buffer The location into which data will be read.
+  // @param count On invocation, the maximum length to read into buffer. Upon
+  //     successful return, the number of bytes read, which is 0 once the
+  //     whole body has been read.
+  // @returns true if successful.
+  virtual bool Read(char* buffer, size_t* count) = 0;
+};
+
 // Defines an interface for issuing HTTP requests.
 class HttpAgent {
  public:
@@ -47,6 +65,19 @@ class HttpAgent {
       bool secure,
       const base::string16& extra_headers,
       const std::string& body) = 0;
+
+  // Issues an HTTP POST request whose body is sent as it's read from
+  // @p body. See Post for a description of the other parameters.
+  // @param body The request body.
+  // @returns NULL if the request fails for any reason. Otherwise, returns an
+  //     HttpResponse that may be used to access the HTTP response.
+  virtual std::unique_ptr<HttpResponse> PostStream(
+      const base::string16& host,
+      uint16_t port,
+      const base::string16& path,
+      bool secure,
+      const base::string16& extra_headers,
+      HttpRequestBody* body) = 0;
 };
 
 }  // namespace kasko
@@ -17,6 +17,7 @@
 #include <windows.h>
 #include <winhttp.h>
 
+#include <algorithm>
 #include <memory>
 #include <string>
 
@@ -36,6 +37,33 @@ namespace kasko {
 
 namespace {
 
+// The size of the chunks in which request bodies are sent.
+const size_t kRequestChunkSize = 64 * 1024;
+
+// Provides a request body held in memory.
+class StringRequestBody : public HttpRequestBody {
+ public:
+  explicit StringRequestBody(const std::string& body)
+      : body_(body), offset_(0) {}
+
+  // HttpRequestBody implementation.
+  size_t GetSize() override { return body_.size(); }
+  bool Read(char* buffer, size_t* count) override {
+    DCHECK(buffer);
+    DCHECK(count);
+    *count = std::min(*count, body_.size() - offset_);
+    ::memcpy(buffer, body_.data() + offset_, *count);
+    offset_ += *count;
+    return true;
+  }
+
+ private:
+  const std::string& body_;
+  size_t offset_;
+
+  DISALLOW_COPY_AND_ASSIGN(StringRequestBody);
+};
+
 class WinHttpHandleTraits {
  public:
   typedef HINTERNET Handle;
@@ -210,8 +238,8 @@ class HttpResponseImpl : public HttpResponse {
   ~HttpResponseImpl() override;
 
   // Issues the request defined by its parameters and, if successful, returns an
-  // HttpResponse that may be used to access the response. See HttpAgent::Post
-  // for a description of the parameters.
+  // HttpResponse that may be used to access the response. See
+  // HttpAgent::PostStream for a description of the parameters.
   static std::unique_ptr<HttpResponse> Create(
       const base::string16& user_agent,
       const base::string16& host,
@@ -219,7 +247,7 @@ class HttpResponseImpl : public HttpResponse {
       const base::string16& path,
       bool secure,
       const base::string16& extra_headers,
-      const std::string& body);
+      HttpRequestBody* body);
 
   // HttpResponse implementation.
   bool GetStatusCode(uint16_t* status_code) override;
@@ -260,7 +288,9 @@ std::unique_ptr<HttpResponse> HttpResponseImpl::Create(
     const base::string16& path,
     bool secure,
     const base::string16& extra_headers,
-    const std::string& body) {
+    HttpRequestBody* body) {
+  DCHECK(body);
+
   // Retrieve the user's proxy configuration.
   AutoWinHttpProxyConfig proxy_config;
   if (!proxy_config.Load())
@@ -330,17 +360,39 @@ std::unique_ptr<HttpResponse> HttpResponseImpl::Create(
     }
   }
 
-  // Send the request.
+  // Send the request headers, then the body one chunk at a time.
+  size_t body_size = body->GetSize();
   if (!::WinHttpSendRequest(instance->request_.Get(), extra_headers.c_str(),
-                            static_cast<DWORD>(-1),
-                            const_cast<char*>(body.data()),
-                            static_cast<DWORD>(body.size()),
-                            static_cast<DWORD>(body.size()), NULL)) {
+                            static_cast<DWORD>(-1), WINHTTP_NO_REQUEST_DATA, 0,
+                            static_cast<DWORD>(body_size), NULL)) {
     LOG(ERROR) << "Failed to send HTTP request to host " << host << " and port "
                << port << ": " << ::common::LogWe();
     return std::unique_ptr<HttpResponse>();
   }
 
+  std::unique_ptr<char[]> chunk(new char[kRequestChunkSize]);
+  size_t size_sent = 0;
+  while (size_sent < body_size) {
+    size_t chunk_size = std::min(kRequestChunkSize, body_size - size_sent);
+    if (!body->Read(chunk.get(), &chunk_size))
+      return std::unique_ptr<HttpResponse>();
+    if (chunk_size == 0) {
+      LOG(ERROR) << "The request body ended after " << size_sent << " of "
+                 << body_size << " bytes.";
+      return std::unique_ptr<HttpResponse>();
+    }
+
+    DWORD size_written = 0;
+    if (!::WinHttpWriteData(instance->request_.Get(), chunk.get(),
+                            static_cast<DWORD>(chunk_size), &size_written) ||
+        size_written != chunk_size) {
+      LOG(ERROR) << "Failed to send HTTP request body to host " << host
+                 << " and port " << port << ": " << ::common::LogWe();
+      return std::unique_ptr<HttpResponse>();
+    }
+    size_sent += chunk_size;
+  }
+
   // This seems to read at least all headers from the response. The remainder of
   // the body, if any, may be read during subsequent calls to WinHttpReadData().
   if (!::WinHttpReceiveResponse(instance->request_.Get(), 0)) {
@@ -510,6 +562,18 @@ std::unique_ptr<HttpResponse> HttpAgentImpl::Post(
     bool secure,
     const base::string16& extra_headers,
     const std::string& body) {
+  StringRequestBody string_body(body);
+  return HttpResponseImpl::Create(user_agent_, host, port, path, secure,
+                                  extra_headers, &string_body);
+}
+
+std::unique_ptr<HttpResponse> HttpAgentImpl::PostStream(
+    const base::string16& host,
+    uint16_t port,
+    const base::string16& path,
+    bool secure,
+    const base::string16& extra_headers,
+    HttpRequestBody* body) {
   return HttpResponseImpl::Create(user_agent_, host, port, path, secure,
                                   extra_headers, body);
 }
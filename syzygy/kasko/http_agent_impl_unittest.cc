@@ -17,6 +17,8 @@
 #include <map>
 #include <string>
 
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
 #include "base/strings/string_number_conversions.h"
 #include "gtest/gtest.h"
 #include "syzygy/kasko/upload.h"
@@ -41,4 +43,29 @@ TEST(HttpAgentImplTest, SimpleUpload) {
   EXPECT_EQ(200, response_code);
 }
 
+TEST(HttpAgentImplTest, StreamedFileUpload) {
+  testing::TestServer server;
+  ASSERT_TRUE(server.Start());
+
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath file_path = temp_dir.path().Append(L"file.dmp");
+  const char kFileContents[] = "file_contents";
+  ASSERT_EQ(static_cast<int>(sizeof(kFileContents) - 1),
+            base::WriteFile(file_path, kFileContents,
+                            sizeof(kFileContents) - 1));
+
+  base::string16 url =
+      L"http://localhost:" + base::UintToString16(server.port()) + L"/path";
+  HttpAgentImpl agent_impl(L"test", L"0.0");
+  base::string16 response_body;
+  uint16_t response_code = 0;
+  ASSERT_TRUE(SendHttpFileUpload(
+      &agent_impl, url, std::map<base::string16, base::string16>(),
+      file_path, L"file_name", false, &response_body, &response_code));
+
+  EXPECT_EQ(L"file_name=file_contents\r\n", response_body);
+  EXPECT_EQ(200, response_code);
+}
+
 }  // namespace kasko
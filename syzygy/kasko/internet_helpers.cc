@@ -239,34 +239,49 @@ std::string GenerateMultipartHttpRequestBody(
     const std::string& upload_file,
     const base::string16& file_part_name,
     const base::string16& boundary) {
+  std::string request_body;
+  std::string suffix;
+  GenerateMultipartHttpRequestBodyParts(parameters, file_part_name, boundary,
+                                        &request_body, &suffix);
+  request_body.reserve(request_body.size() + upload_file.size() +
+                       suffix.size());
+  request_body.append(upload_file);
+  request_body.append(suffix);
+  return request_body;
+}
+
+void GenerateMultipartHttpRequestBodyParts(
+    const std::map<base::string16, base::string16>& parameters,
+    const base::string16& file_part_name,
+    const base::string16& boundary,
+    std::string* prefix,
+    std::string* suffix) {
   DCHECK(!boundary.empty());
   DCHECK(!file_part_name.empty());
+  DCHECK(prefix);
+  DCHECK(suffix);
   std::string boundary_utf8 = base::WideToUTF8(boundary);
 
-  std::string request_body;
+  prefix->clear();
 
   // Append each of the parameter pairs as a form-data part.
   for (const auto& entry : parameters) {
-    request_body.append("--" + boundary_utf8 + "\r\n");
-    request_body.append("Content-Disposition: form-data; name=\"" +
-                        base::WideToUTF8(entry.first) + "\"\r\n\r\n" +
-                        base::WideToUTF8(entry.second) + "\r\n");
+    prefix->append("--" + boundary_utf8 + "\r\n");
+    prefix->append("Content-Disposition: form-data; name=\"" +
+                   base::WideToUTF8(entry.first) + "\"\r\n\r\n" +
+                   base::WideToUTF8(entry.second) + "\r\n");
   }
 
   std::string file_part_name_utf8 = base::WideToUTF8(file_part_name);
 
-  request_body.append("--" + boundary_utf8 + "\r\n");
-  request_body.append("Content-Disposition: form-data; "
-                      "name=\"" + file_part_name_utf8 + "\"; "
-                      "filename=\"" + file_part_name_utf8 + "\"\r\n");
-  request_body.append("Content-Type: application/octet-stream\r\n");
-  request_body.append("\r\n");
+  prefix->append("--" + boundary_utf8 + "\r\n");
+  prefix->append("Content-Disposition: form-data; "
+                 "name=\"" + file_part_name_utf8 + "\"; "
+                 "filename=\"" + file_part_name_utf8 + "\"\r\n");
+  prefix->append("Content-Type: application/octet-stream\r\n");
+  prefix->append("\r\n");
 
-  request_body.append(upload_file);
-  request_body.append("\r\n");
-  request_body.append("--" + boundary_utf8 + "--\r\n");
-
-  return request_body;
+  *suffix = "\r\n--" + boundary_utf8 + "--\r\n";
 }
 
 }  // namespace kasko
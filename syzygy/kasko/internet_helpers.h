@@ -86,6 +86,22 @@ std::string GenerateMultipartHttpRequestBody(
     const base::string16& file_part_name,
     const base::string16& boundary);
 
+// Generates the parts of a multipart HTTP message body that precede and
+// follow the file contents, so that the file can be streamed between them.
+// The body generated by GenerateMultipartHttpRequestBody is the
+// concatenation of @p prefix, the file contents and @p suffix.
+// @param parameters HTTP request parameters to be encoded in the body.
+// @param file_part_name The parameter name to be assigned to the file part.
+// @param boundary The MIME boundary to use.
+// @param prefix Receives the part of the body preceding the file contents.
+// @param suffix Receives the part of the body following the file contents.
+void GenerateMultipartHttpRequestBodyParts(
+    const std::map<base::string16, base::string16>& parameters,
+    const base::string16& file_part_name,
+    const base::string16& boundary,
+    std::string* prefix,
+    std::string* suffix);
+
 }  // namespace kasko
 
 #endif  // SYZYGY_KASKO_INTERNET_HELPERS_H_
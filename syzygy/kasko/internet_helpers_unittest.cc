@@ -225,4 +225,19 @@ TEST(InternetHelpersTest, GenerateMultipartHttpRequestBody) {
                                         base::WideToUTF8(file_part_name), body);
 }
 
+TEST(InternetHelpersTest, GenerateMultipartHttpRequestBodyParts) {
+  std::map<base::string16, base::string16> parameters;
+  parameters[L"param"] = L"value";
+  base::string16 boundary = GenerateMultipartHttpRequestBoundary();
+  std::string file = "file contents";
+  base::string16 file_part_name = L"file_name";
+
+  std::string prefix, suffix;
+  GenerateMultipartHttpRequestBodyParts(parameters, file_part_name, boundary,
+                                        &prefix, &suffix);
+  EXPECT_EQ(GenerateMultipartHttpRequestBody(parameters, file, file_part_name,
+                                             boundary),
+            prefix + file + suffix);
+}
+
 }  // namespace kasko
@@ -145,6 +145,7 @@
         '<(src)/syzygy/common/common.gyp:common_lib',
         '<(src)/syzygy/common/rpc/rpc.gyp:common_rpc_lib',
         '<(src)/syzygy/minidump/minidump.gyp:minidump_lib',
+        '<(src)/third_party/zlib/zlib.gyp:zlib',
         'kasko_version',
         'kasko_rpc',
       ],
@@ -268,6 +269,7 @@
         '<(src)/syzygy/core/core.gyp:core_unittest_utils',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/testing/gtest.gyp:gtest',
+        '<(src)/third_party/zlib/zlib.gyp:zlib',
       ],
       'msvs_settings': {
         'VCLinkerTool': {
@@ -19,6 +19,8 @@
 #include <Psapi.h>
 #include <winternl.h>
 
+#include <algorithm>
+
 #include "base/files/file.h"
 #include "base/process/process_handle.h"
 #include "base/win/pe_image.h"
@@ -187,6 +189,7 @@ std::vector<kasko::MinidumpRequest::MemoryRange> AugmentMemoryRanges(
       *memory_ranges);
 
   AppendLoaderLockMemoryRanges(&augmented_memory_ranges);
+  MergeMemoryRanges(&augmented_memory_ranges);
 
   return augmented_memory_ranges;
 }
@@ -213,6 +216,36 @@ DWORD GetRequiredAccessForMinidumpType(api::MinidumpType type) {
   return GetRequiredAccessForMinidumpTypeImpl(type == api::FULL_DUMP_TYPE);
 }
 
+void MergeMemoryRanges(
+    std::vector<MinidumpRequest::MemoryRange>* memory_ranges) {
+  DCHECK(memory_ranges);
+
+  std::sort(memory_ranges->begin(), memory_ranges->end());
+
+  // Each range either extends the last merged range or follows it.
+  size_t merged_count = 0;
+  for (size_t i = 0; i < memory_ranges->size(); ++i) {
+    const MinidumpRequest::MemoryRange range = (*memory_ranges)[i];
+    if (range.size() == 0)
+      continue;
+
+    if (merged_count != 0) {
+      MinidumpRequest::MemoryRange& last = (*memory_ranges)[merged_count - 1];
+      if (range.start() <= last.end()) {
+        if (range.end() > last.end()) {
+          last = MinidumpRequest::MemoryRange(last.start(),
+                                              range.end() - last.start());
+        }
+        continue;
+      }
+    }
+
+    (*memory_ranges)[merged_count] = range;
+    ++merged_count;
+  }
+  memory_ranges->resize(merged_count);
+}
+
 bool GenerateMinidump(const base::FilePath& destination,
                       base::ProcessHandle target_process,
                       base::PlatformThreadId thread_id,
@@ -34,6 +34,14 @@ namespace kasko {
 DWORD GetRequiredAccessForMinidumpType(MinidumpRequest::Type type);
 DWORD GetRequiredAccessForMinidumpType(api::MinidumpType type);
 
+// Sorts memory ranges and merges the ones that overlap or are adjacent. Empty
+// ranges are removed. This lets MiniDumpWriteDump read each byte of the target
+// process once, even when the requested ranges overlap (e.g., an ASan block
+// and the ranges surrounding it).
+// @param memory_ranges The memory ranges to merge, in place.
+void MergeMemoryRanges(
+    std::vector<MinidumpRequest::MemoryRange>* memory_ranges);
+
 // Generates a minidump.
 // @param destination The path where the dump should be generated.
 // @param target_process The handle of the process whose dump should be
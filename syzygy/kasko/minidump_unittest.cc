@@ -241,6 +241,44 @@ TEST_F(MinidumpTest, MemoryRanges) {
   ASSERT_NE(std::string::npos, dump_with_memory_range.find(kGlobalString));
 }
 
+TEST(MergeMemoryRangesTest, MergesOverlappingRanges) {
+  using MemoryRange = MinidumpRequest::MemoryRange;
+  std::vector<MemoryRange> ranges;
+  ranges.push_back(MemoryRange(0x3000, 0x100));
+  ranges.push_back(MemoryRange(0x1000, 0x100));
+  ranges.push_back(MemoryRange(0x2000, 0));
+  ranges.push_back(MemoryRange(0x1080, 0x100));
+  ranges.push_back(MemoryRange(0x1180, 0x80));
+  ranges.push_back(MemoryRange(0x1010, 0x10));
+  ranges.push_back(MemoryRange(0x3000, 0x100));
+
+  MergeMemoryRanges(&ranges);
+
+  ASSERT_EQ(2u, ranges.size());
+  EXPECT_EQ(MemoryRange(0x1000, 0x200), ranges[0]);
+  EXPECT_EQ(MemoryRange(0x3000, 0x100), ranges[1]);
+}
+
+TEST_F(MinidumpTest, OverlappingMemoryRanges) {
+  base::FilePath dump_file_path = temp_dir().Append(L"overlapping.dump");
+
+  // The string is covered by two overlapping ranges.
+  MinidumpRequest::MemoryRange head(reinterpret_cast<uint32_t>(kGlobalString),
+                                    sizeof(kGlobalString) / 2 + 1);
+  MinidumpRequest::MemoryRange whole(reinterpret_cast<uint32_t>(kGlobalString),
+                                     sizeof(kGlobalString));
+  request().user_selected_memory_ranges.push_back(whole);
+  request().user_selected_memory_ranges.push_back(head);
+
+  bool result = false;
+  ASSERT_NO_FATAL_FAILURE(CallGenerateMinidump(dump_file_path, &result));
+  ASSERT_TRUE(result);
+
+  std::string dump;
+  ASSERT_TRUE(base::ReadFileToString(dump_file_path, &dump));
+  ASSERT_NE(std::string::npos, dump.find(kGlobalString));
+}
+
 TEST_F(MinidumpTest, OverwriteExistingFile) {
   base::ScopedTempDir temp_dir;
   ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
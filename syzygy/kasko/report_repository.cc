@@ -48,12 +48,23 @@
 // immediately upon detection. An orphaned crash keys file may occur normally in
 // the interval before the minidump file is moved. These files are only deleted
 // when their timestamp is more than a day in the past.
+//
+// Uploading a backlog of reports with UploadPendingReports scans the
+// subdirectories once, and then uploads the eligible reports in waves of
+// concurrent uploads. The files of a report are only moved once its wave is
+// complete, on the calling thread.
 
 #include "syzygy/kasko/report_repository.h"
 
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <vector>
+
 #include "base/logging.h"
 #include "base/files/file_enumerator.h"
 #include "base/files/file_util.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/kasko/crash_keys_serialization.h"
 
 namespace kasko {
@@ -154,20 +165,36 @@ base::FilePath GetDumpFileForCrashKeysFile(
   return crash_keys_path.ReplaceExtension(kDumpFileExtension);
 }
 
-// Returns a minidump that is eligible for upload from the given directory, if
-// any are.
+// A report that is eligible for upload.
+struct PendingReport {
+  // The path to the minidump file.
+  base::FilePath minidump_path;
+  // The directory where the report is moved if its upload fails, or empty if
+  // the next failure is permanent.
+  base::FilePath failure_destination;
+};
+
+// Collects the minidumps that are eligible for upload from the given
+// directory, if any are.
 // @param directory The directory to scan.
 // @param maximum_timestamp_for_retries The cutoff for the most most recent
 //     upload attempt of eligible minidumps. If null, there is no cutoff.
-// @returns The path to a minidump that is eligible for upload, if any.
-base::FilePath GetPendingReportFromDirectory(
+// @param failure_destination The failure destination of the minidumps.
+// @param max_count The maximum number of reports to collect.
+// @param reports Receives the eligible reports.
+void GetPendingReportsFromDirectory(
     const base::FilePath& directory,
-    const base::Time& maximum_timestamp_for_retries) {
+    const base::Time& maximum_timestamp_for_retries,
+    const base::FilePath& failure_destination,
+    size_t max_count,
+    std::vector<PendingReport>* reports) {
+  DCHECK(reports);
   base::FileEnumerator file_enumerator(
       directory, false, base::FileEnumerator::FILES,
       base::string16(L"*") + kDumpFileExtension);
-  // Visit all files in this directory until we find an eligible one.
-  for (base::FilePath candidate = file_enumerator.Next(); !candidate.empty();
+  // Visit all files in this directory until we have enough eligible ones.
+  for (base::FilePath candidate = file_enumerator.Next();
+       !candidate.empty() && reports->size() < max_count;
        candidate = file_enumerator.Next()) {
     // Skip dumps with missing crash keys.
     if (!base::PathExists(GetCrashKeysFileForDumpFile(candidate))) {
@@ -176,15 +203,17 @@ base::FilePath GetPendingReportFromDirectory(
       LoggedDeleteFile(candidate);
       continue;
     }
-    if (maximum_timestamp_for_retries.is_null())
-      return candidate;
 
     // Check if this file is eligible for retry.
-    base::FileEnumerator::FileInfo file_info = file_enumerator.GetInfo();
-    if (file_info.GetLastModifiedTime() <= maximum_timestamp_for_retries)
-      return candidate;
+    if (!maximum_timestamp_for_retries.is_null()) {
+      base::FileEnumerator::FileInfo file_info = file_enumerator.GetInfo();
+      if (file_info.GetLastModifiedTime() > maximum_timestamp_for_retries)
+        continue;
+    }
+
+    PendingReport report = {candidate, failure_destination};
+    reports->push_back(report);
   }
-  return base::FilePath();
 }
 
 void CleanOrphanedCrashKeysFiles(
@@ -216,17 +245,20 @@ void CleanOrphanedCrashKeysFiles(
   }
 }
 
-// Returns a minidump that is eligible for upload, if any are.
+// Collects the minidumps that are eligible for upload, if any are. New
+// reports come first, followed by the reports that failed once, then twice.
 // @param repository_path The directory where this repository stores reports.
 // @param now The current time.
 // @param retry_interval The minimum interval between upload attempts for a
 //     given report.
-// @returns A pair of mindump path (empty if none) and failure destination
-//     (empty if the next failure is permanent).
-std::pair<base::FilePath, base::FilePath> GetPendingReport(
-    const base::FilePath& repository_path,
-    const base::Time& now,
-    const base::TimeDelta& retry_interval) {
+// @param max_count The maximum number of reports to collect.
+// @param reports Receives the eligible reports.
+void GetPendingReports(const base::FilePath& repository_path,
+                       const base::Time& now,
+                       const base::TimeDelta& retry_interval,
+                       size_t max_count,
+                       std::vector<PendingReport>* reports) {
+  DCHECK(reports);
   struct {
     const base::char16* subdir;
     const base::char16* failure_subdir;
@@ -237,19 +269,85 @@ std::pair<base::FilePath, base::FilePath> GetPendingReport(
       {kFailedTwiceSubdir, nullptr, now - retry_interval}};
 
   for (size_t i = 0; i < arraysize(directories); ++i) {
-    base::FilePath result = GetPendingReportFromDirectory(
+    base::FilePath failure_destination;
+    if (directories[i].failure_subdir)
+      failure_destination =
+          repository_path.Append(directories[i].failure_subdir);
+    GetPendingReportsFromDirectory(
         repository_path.Append(directories[i].subdir),
-        directories[i].retry_cutoff);
-    if (!result.empty()) {
-      if (!directories[i].failure_subdir)
-        return std::make_pair(result, base::FilePath());
-      return std::make_pair(
-          result, repository_path.Append(directories[i].failure_subdir));
-    }
+        directories[i].retry_cutoff, failure_destination, max_count, reports);
   }
-  return std::pair<base::FilePath, base::FilePath>();
 }
 
+// The outcome of an upload attempt.
+enum UploadResult {
+  // The report was uploaded.
+  UPLOAD_SUCCEEDED,
+  // The upload of the report failed.
+  UPLOAD_FAILED,
+  // The timestamps of the report couldn't be renewed, so no upload was
+  // attempted.
+  UPLOAD_NOT_ATTEMPTED,
+};
+
+// Attempts to upload a report. Doesn't move or delete its files.
+// @param minidump_path The path to the minidump file.
+// @param now The current time.
+// @param uploader Used to upload the report.
+// @returns the outcome of the attempt.
+UploadResult AttemptUpload(const base::FilePath& minidump_path,
+                           const base::Time& now,
+                           const ReportRepository::Uploader& uploader) {
+  base::FilePath crash_keys_path = GetCrashKeysFileForDumpFile(minidump_path);
+
+  // Renew the file timestamps before attempting upload. If we are unable to do
+  // this, make no upload attempt (since that would potentially lead to a hot
+  // loop of upload attempts).
+  if (!base::TouchFile(minidump_path, now, now)) {
+    LOG(ERROR) << "Failed to update timestamp for " << minidump_path.value();
+    return UPLOAD_NOT_ATTEMPTED;
+  }
+  if (!base::TouchFile(crash_keys_path, now, now)) {
+    LOG(ERROR) << "Failed to update timestamp for " << crash_keys_path.value();
+    return UPLOAD_NOT_ATTEMPTED;
+  }
+
+  // Attempt the upload.
+  std::map<base::string16, base::string16> crash_keys;
+  if (!ReadCrashKeysFromFile(crash_keys_path, &crash_keys))
+    return UPLOAD_FAILED;
+  if (!uploader.Run(minidump_path, crash_keys))
+    return UPLOAD_FAILED;
+  return UPLOAD_SUCCEEDED;
+}
+
+// Attempts the upload of a report on a thread of a pool.
+class UploadWork : public base::DelegateSimpleThread::Delegate {
+ public:
+  UploadWork(const PendingReport& report,
+             const base::Time& now,
+             const ReportRepository::Uploader& uploader)
+      : report_(report),
+        now_(now),
+        uploader_(uploader),
+        result_(UPLOAD_NOT_ATTEMPTED) {}
+
+  void Run() override {
+    result_ = AttemptUpload(report_.minidump_path, now_, uploader_);
+  }
+
+  // @returns the outcome of the attempt, once it has run.
+  UploadResult result() const { return result_; }
+
+ private:
+  const PendingReport& report_;
+  base::Time now_;
+  const ReportRepository::Uploader& uploader_;
+  UploadResult result_;
+
+  DISALLOW_COPY_AND_ASSIGN(UploadWork);
+};
+
 // Handles a non-permanent failure by moving the report files to a new queue.
 // @param minidump_file The minidump file. This method calls Take() on success.
 // @param crash_keys_file The crash keys file. This method calls Take() on
@@ -292,6 +390,32 @@ void HandlePermanentFailure(const base::FilePath& minidump_path,
     LoggedDeleteFile(crash_keys_path);
 }
 
+// Disposes of the files of a report after an upload attempt. The files of
+// uploaded reports, and of those whose upload couldn't be attempted, are
+// deleted. The reports whose upload failed move on to their failure
+// destination.
+// @param report The report.
+// @param result The outcome of the upload attempt.
+// @param permanent_failure_handler The PermanentFailureHandler to invoke.
+void FinishUpload(const PendingReport& report,
+                  UploadResult result,
+                  const ReportRepository::PermanentFailureHandler&
+                      permanent_failure_handler) {
+  ScopedReportFile minidump_file(report.minidump_path);
+  ScopedReportFile crash_keys_file(
+      GetCrashKeysFileForDumpFile(report.minidump_path));
+  if (result != UPLOAD_FAILED)
+    return;
+
+  if (!report.failure_destination.empty()) {
+    HandleNonpermanentFailure(&minidump_file, &crash_keys_file,
+                              report.failure_destination);
+  } else {
+    HandlePermanentFailure(minidump_file.Take(), crash_keys_file.Take(),
+                           permanent_failure_handler);
+  }
+}
+
 }  // namespace
 
 ReportRepository::ReportRepository(
@@ -350,46 +474,73 @@ bool ReportRepository::UploadPendingReport() {
   // Do a bit of opportunistic cleanup.
   CleanOrphanedCrashKeysFiles(repository_path_, now);
 
-  std::pair<base::FilePath, base::FilePath> entry =
-      GetPendingReport(repository_path_, now, retry_interval_);
-  ScopedReportFile minidump_file(entry.first);
-  base::FilePath failure_destination = entry.second;
-
-  if (minidump_file.Get().empty())
+  std::vector<PendingReport> reports;
+  GetPendingReports(repository_path_, now, retry_interval_, 1, &reports);
+  if (reports.empty())
     return true;  // Successful no-op.
 
-  ScopedReportFile crash_keys_file(
-      GetCrashKeysFileForDumpFile(minidump_file.Get()));
+  UploadResult result = AttemptUpload(reports[0].minidump_path, now, uploader_);
+  FinishUpload(reports[0], result, permanent_failure_handler_);
+  return result == UPLOAD_SUCCEEDED;
+}
 
-  // Renew the file timestamps before attempting upload. If we are unable to do
-  // this, make no upload attempt (since that would potentially lead to a hot
-  // loop of upload attempts).
-  if (minidump_file.UpdateTimestamp(now)) {
-    if (crash_keys_file.UpdateTimestamp(now)) {
-      // Attempt the upload.
-      std::map<base::string16, base::string16> crash_keys;
-      if (ReadCrashKeysFromFile(crash_keys_file.Get(), &crash_keys)) {
-        if (uploader_.Run(minidump_file.Get(), crash_keys))
-          return true;
-      }
+bool ReportRepository::UploadPendingReports(size_t max_concurrent_uploads) {
+  DCHECK_LT(0u, max_concurrent_uploads);
+  base::Time now = time_source_.Run();
 
-      // We failed.
-      if (!failure_destination.empty()) {
-        HandleNonpermanentFailure(&minidump_file, &crash_keys_file,
-                                  failure_destination);
-      } else {
-        HandlePermanentFailure(minidump_file.Take(), crash_keys_file.Take(),
-                               permanent_failure_handler_);
-      }
+  // Do a bit of opportunistic cleanup.
+  CleanOrphanedCrashKeysFiles(repository_path_, now);
+
+  // A single scan gathers all the eligible reports.
+  std::vector<PendingReport> reports;
+  GetPendingReports(repository_path_, now, retry_interval_,
+                    std::numeric_limits<size_t>::max(), &reports);
+
+  for (size_t begin = 0; begin < reports.size();
+       begin += max_concurrent_uploads) {
+    size_t end = std::min(begin + max_concurrent_uploads, reports.size());
+
+    std::vector<std::unique_ptr<UploadWork>> wave;
+    for (size_t i = begin; i < end; ++i) {
+      wave.push_back(std::unique_ptr<UploadWork>(
+          new UploadWork(reports[i], now, uploader_)));
+    }
+
+    // There is no need for a thread when the uploads aren't concurrent.
+    if (wave.size() == 1) {
+      wave[0]->Run();
+    } else {
+      base::DelegateSimpleThreadPool pool("kasko_uploads",
+                                          static_cast<int>(wave.size()));
+      for (const auto& work : wave)
+        pool.AddWork(work.get());
+      pool.Start();
+      pool.JoinAll();
     }
+
+    bool wave_succeeded = true;
+    for (size_t i = begin; i < end; ++i) {
+      UploadResult result = wave[i - begin]->result();
+      FinishUpload(reports[i], result, permanent_failure_handler_);
+      if (result != UPLOAD_SUCCEEDED)
+        wave_succeeded = false;
+    }
+
+    // A failure suggests that the server is unavailable. The remaining
+    // reports keep their attempts until the next call, rather than all
+    // failing in turn.
+    if (!wave_succeeded)
+      return false;
   }
 
-  return false;
+  return true;
 }
 
 bool ReportRepository::HasPendingReports() {
-  return !GetPendingReport(repository_path_, time_source_.Run(),
-                           retry_interval_).first.empty();
+  std::vector<PendingReport> reports;
+  GetPendingReports(repository_path_, time_source_.Run(), retry_interval_, 1,
+                    &reports);
+  return !reports.empty();
 }
 
 }  // namespace kasko
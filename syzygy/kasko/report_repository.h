@@ -81,6 +81,18 @@ class ReportRepository {
   //     uploaded.
   bool UploadPendingReport();
 
+  // Attempts to upload all the pending reports, with up to
+  // @p max_concurrent_uploads uploads in flight at once. The repository is
+  // scanned once for the whole backlog. The uploads stop after the first
+  // group of concurrent uploads where one fails, so that the retry attempts
+  // of the other reports aren't spent while the server is unavailable.
+  // @param max_concurrent_uploads The maximum number of concurrent
+  //     invocations of the uploader. If greater than 1 the uploader is
+  //     invoked from several threads, and must be thread-safe.
+  // @returns true if there are no pending reports or they were all
+  //     successfully uploaded.
+  bool UploadPendingReports(size_t max_concurrent_uploads);
+
   // @returns true if UploadPendingReport would attempt to upload a report.
   bool HasPendingReports();
 
@@ -29,6 +29,7 @@
 #include "base/strings/string16.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/synchronization/lock.h"
 #include "base/time/time.h"
 #include "gtest/gtest.h"
 #include "syzygy/kasko/crash_keys_serialization.h"
@@ -184,9 +185,11 @@ class ReportRepositoryTest : public testing::Test {
     return report;
   }
 
-  // Implements the UploadHandler.
+  // Implements the UploadHandler. This may be invoked concurrently by
+  // UploadPendingReports.
   bool Upload(const base::FilePath& minidump_path,
               const std::map<base::string16, base::string16>& crash_keys) {
+    base::AutoLock auto_lock(lock_);
     Report report;
     bool success = base::ReadFileToString(minidump_path, &report.first);
     EXPECT_TRUE(success);
@@ -270,6 +273,9 @@ class ReportRepositoryTest : public testing::Test {
   // The mock time.
   base::Time time_;
 
+  // Serializes the uploads.
+  base::Lock lock_;
+
   // The instance under test.
   std::unique_ptr<ReportRepository> repository_;
 
@@ -508,4 +514,49 @@ TEST_F(ReportRepositoryTest, CorruptionTest) {
   }
 }
 
+TEST_F(ReportRepositoryTest, UploadPendingReportsTest) {
+  for (size_t i = 0; i < 5; ++i)
+    InjectForSuccessAfterRetries(0);
+  EXPECT_TRUE(repository()->HasPendingReports());
+
+  // A single call drains the repository.
+  EXPECT_TRUE(repository()->UploadPendingReports(2));
+  EXPECT_FALSE(repository()->HasPendingReports());
+  EXPECT_TRUE(repository()->UploadPendingReports(2));  // No-op
+}
+
+TEST_F(ReportRepositoryTest, UploadPendingReportsStopsAtFailure) {
+  InjectForSuccessAfterRetries(1);
+  InjectForSuccessAfterRetries(1);
+
+  // The first failure leaves the other report in Incoming.
+  EXPECT_FALSE(repository()->UploadPendingReports(1));
+  EXPECT_TRUE(repository()->HasPendingReports());
+  EXPECT_FALSE(repository()->UploadPendingReports(1));
+  EXPECT_FALSE(repository()->HasPendingReports());
+
+  IncrementTime(base::TimeDelta::FromSeconds(kRetryIntervalInSeconds));
+  EXPECT_TRUE(repository()->UploadPendingReports(1));  // Succeeds
+  EXPECT_FALSE(repository()->HasPendingReports());
+}
+
+TEST_F(ReportRepositoryTest, UploadPendingReportsWithFailures) {
+  for (size_t i = 0; i < 3; ++i) {
+    InjectForSuccessAfterRetries(0);
+    InjectForSuccessAfterRetries(2);
+    InjectForFailure();
+  }
+
+  // Each round retries every eligible report, as they all fit in a wave.
+  // The reports move on to their next attempt whatever the outcome of the
+  // others.
+  EXPECT_FALSE(repository()->UploadPendingReports(16));
+  for (size_t i = 0; i < 2; ++i) {
+    EXPECT_FALSE(repository()->HasPendingReports());
+    IncrementTime(base::TimeDelta::FromSeconds(kRetryIntervalInSeconds));
+    EXPECT_FALSE(repository()->UploadPendingReports(16));
+  }
+  EXPECT_TRUE(repository()->UploadPendingReports(16));  // No-op
+}
+
 }  // namespace kasko
@@ -50,6 +50,10 @@ const base::char16* const kRpcProtocol = L"ncalrpc";
 // The subdirectory where minidumps are generated.
 const base::char16* const kTemporarySubdir = L"Temporary";
 
+// The maximum number of reports uploaded concurrently when draining the
+// repository.
+const size_t kMaxConcurrentUploads = 4;
+
 // Moves |minidump_path| and |crash_keys_path| to |permanent_failure_directory|.
 // The destination filenames have the filename from |minidump_path| and the
 // extensions Reporter::kPermanentFailureMinidumpExtension and
@@ -187,8 +191,9 @@ std::unique_ptr<Reporter> Reporter::Create(
   // |report_repository|.
   std::unique_ptr<UploadThread> upload_thread = UploadThread::Create(
       data_directory, std::move(waitable_timer),
-      base::Bind(base::IgnoreResult(&ReportRepository::UploadPendingReport),
-                 base::Unretained(report_repository.get())));
+      base::Bind(base::IgnoreResult(&ReportRepository::UploadPendingReports),
+                 base::Unretained(report_repository.get()),
+                 kMaxConcurrentUploads));
 
   if (!upload_thread) {
     LOG(ERROR) << "Failed to initialize background upload process.";
@@ -232,13 +237,6 @@ bool Reporter::UploadCrashReport(
     const base::string16& upload_url,
     const base::FilePath& minidump_path,
     const std::map<base::string16, base::string16>& crash_keys) {
-  std::string dump_contents;
-  if (!base::ReadFileToString(minidump_path, &dump_contents)) {
-    LOG(ERROR) << "Failed to read the minidump file at "
-               << minidump_path.value();
-    return false;
-  }
-
   HttpAgentImpl http_agent(
       L"Kasko", base::ASCIIToUTF16(KASKO_VERSION_STRING));
   base::string16 remote_dump_id;
@@ -246,9 +244,10 @@ bool Reporter::UploadCrashReport(
   std::map<base::string16, base::string16> augmented_crash_keys(crash_keys);
   augmented_crash_keys[Reporter::kKaskoUploadedByVersion] =
       base::ASCIIToUTF16(KASKO_VERSION_STRING);
-  if (!SendHttpUpload(&http_agent, upload_url, augmented_crash_keys,
-                      dump_contents, Reporter::kMinidumpUploadFilePart,
-                      &remote_dump_id, &response_code)) {
+  // The minidump is streamed from disk rather than read in memory.
+  if (!SendHttpFileUpload(&http_agent, upload_url, augmented_crash_keys,
+                          minidump_path, Reporter::kMinidumpUploadFilePart,
+                          false, &remote_dump_id, &response_code)) {
     LOG(ERROR) << "Failed to upload the minidump file to " << upload_url;
     return false;
   } else if (!on_upload_callback.is_null()) {
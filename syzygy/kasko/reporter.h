@@ -65,6 +65,8 @@ class Reporter {
   // @param minidump_path The local path to the report file. This path is no
   //     longer valid after the callback returns.
   // @param crash_keys The crash keys included with the report.
+  // As reports are uploaded concurrently, this may be invoked from several
+  // threads at once.
   using OnUploadCallback = base::Callback<void(
       const base::string16& report_id,
       const base::FilePath& minidump_path,
@@ -79,6 +81,8 @@ class Reporter {
   // @param permanent_failure_directory The directory where crash reports that
   //     have exceeded retry limits will be moved to.
   // @param upload_interval The minimum interval between two upload operations.
+  //     Each operation uploads all the pending reports, a few at a time,
+  //     until one of them fails.
   // @param retry_interval The minimum interval between upload attempts for a
   //     single crash report.
   // @param on_upload_callback The callback to notify when an upload completes.
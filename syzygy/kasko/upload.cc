@@ -12,7 +12,15 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "syzygy/kasko/upload.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
 #include "base/logging.h"
+#include "base/files/file.h"
+#include "base/files/file_path.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
 
@@ -20,11 +28,136 @@
 #include "syzygy/kasko/http_agent.h"
 #include "syzygy/kasko/http_response.h"
 #include "syzygy/kasko/internet_helpers.h"
+#include "third_party/zlib/zlib.h"
 
 namespace kasko {
 
 namespace {
 
+// The size of the chunks in which files are read and compressed.
+const size_t kChunkSize = 64 * 1024;
+
+// The header announcing a gzip compressed request body.
+const base::char16 kGzipContentEncodingHeader[] = L"Content-Encoding: gzip";
+
+// Provides a multipart message body whose file part is read from disk as the
+// body is read.
+class MultipartFileRequestBody : public HttpRequestBody {
+ public:
+  // @param prefix The part of the body preceding the file contents.
+  // @param file The file, opened for reading.
+  // @param file_size The size of the file.
+  // @param suffix The part of the body following the file contents.
+  MultipartFileRequestBody(const std::string& prefix,
+                           base::File file,
+                           size_t file_size,
+                           const std::string& suffix)
+      : prefix_(prefix),
+        file_(std::move(file)),
+        file_size_(file_size),
+        suffix_(suffix),
+        offset_(0) {}
+
+  // HttpRequestBody implementation.
+  size_t GetSize() override {
+    return prefix_.size() + file_size_ + suffix_.size();
+  }
+  bool Read(char* buffer, size_t* count) override;
+
+ private:
+  std::string prefix_;
+  base::File file_;
+  size_t file_size_;
+  std::string suffix_;
+
+  // The offset in the body of the next byte to read.
+  size_t offset_;
+
+  DISALLOW_COPY_AND_ASSIGN(MultipartFileRequestBody);
+};
+
+bool MultipartFileRequestBody::Read(char* buffer, size_t* count) {
+  DCHECK(buffer);
+  DCHECK(count);
+
+  size_t buffer_size = *count;
+  *count = 0;
+  size_t file_end = prefix_.size() + file_size_;
+  while (*count < buffer_size && offset_ < GetSize()) {
+    size_t available = buffer_size - *count;
+    size_t read_size = 0;
+    if (offset_ < prefix_.size()) {
+      read_size = std::min(available, prefix_.size() - offset_);
+      ::memcpy(buffer + *count, prefix_.data() + offset_, read_size);
+    } else if (offset_ < file_end) {
+      size_t file_offset = offset_ - prefix_.size();
+      read_size = std::min(available, file_size_ - file_offset);
+      int result = file_.Read(static_cast<int64_t>(file_offset),
+                              buffer + *count, static_cast<int>(read_size));
+      if (result <= 0) {
+        LOG(ERROR) << "Failed to read the upload file at offset "
+                   << file_offset << ".";
+        return false;
+      }
+      read_size = static_cast<size_t>(result);
+    } else {
+      read_size = std::min(available, GetSize() - offset_);
+      ::memcpy(buffer + *count, suffix_.data() + offset_ - file_end,
+               read_size);
+    }
+    *count += read_size;
+    offset_ += read_size;
+  }
+  return true;
+}
+
+// Compresses a request body with the gzip format.
+// @param body The body to compress.
+// @param compressed_body Receives the compressed body.
+// @returns true if successful.
+bool GzipRequestBody(HttpRequestBody* body, std::string* compressed_body) {
+  DCHECK(body);
+  DCHECK(compressed_body);
+
+  // Adding 16 to the window bits selects the gzip header and trailer.
+  z_stream zstream = {};
+  if (deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16,
+                   8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    LOG(ERROR) << "Failed to initialize the compression of the request body.";
+    return false;
+  }
+
+  compressed_body->clear();
+  std::unique_ptr<char[]> input(new char[kChunkSize]);
+  std::unique_ptr<char[]> output(new char[kChunkSize]);
+  int flush = Z_NO_FLUSH;
+  do {
+    size_t input_size = kChunkSize;
+    if (!body->Read(input.get(), &input_size)) {
+      deflateEnd(&zstream);
+      return false;
+    }
+    if (input_size == 0)
+      flush = Z_FINISH;
+
+    zstream.next_in = reinterpret_cast<Bytef*>(input.get());
+    zstream.avail_in = static_cast<uInt>(input_size);
+    do {
+      zstream.next_out = reinterpret_cast<Bytef*>(output.get());
+      zstream.avail_out = static_cast<uInt>(kChunkSize);
+      if (deflate(&zstream, flush) == Z_STREAM_ERROR) {
+        LOG(ERROR) << "Failed to compress the request body.";
+        deflateEnd(&zstream);
+        return false;
+      }
+      compressed_body->append(output.get(), kChunkSize - zstream.avail_out);
+    } while (zstream.avail_out == 0);
+  } while (flush != Z_FINISH);
+
+  deflateEnd(&zstream);
+  return true;
+}
+
 // Reads up to |count| bytes of raw response body into |buffer|. Returns true if
 // the entire response body is successfully read. Regardless of success or
 // failure, |*count| will be assigned the number of bytes read (between 0 and
@@ -151,42 +284,44 @@ bool ReadResponse(HttpResponse* response, base::string16 *response_body) {
   return true;
 }
 
-}  // namespace
-
-bool SendHttpUpload(HttpAgent* agent,
-                    const base::string16& url,
-                    const std::map<base::string16, base::string16>& parameters,
-                    const std::string& upload_file,
-                    const base::string16& file_part_name,
-                    base::string16* response_body,
-                    uint16_t* response_code) {
-  DCHECK(response_body);
-  DCHECK(response_code);
-
-  base::string16 scheme, host, path;
-  uint16_t port = 0;
-  if (!DecomposeUrl(url, &scheme, &host, &port, &path)) {
+// Decomposes an upload URL.
+// @param url The URL.
+// @param host Receives the URL host component.
+// @param port Receives the URL port component.
+// @param path Receives the URL path component.
+// @param secure Is set to true if the URL uses HTTPS.
+// @returns true if the URL is a valid HTTP(S) URL.
+bool DecomposeUploadUrl(const base::string16& url,
+                        base::string16* host,
+                        uint16_t* port,
+                        base::string16* path,
+                        bool* secure) {
+  base::string16 scheme;
+  if (!DecomposeUrl(url, &scheme, host, port, path)) {
     LOG(ERROR) << "Failed to decompose URL: " << url;
     return false;
   }
 
-  bool secure = false;
+  *secure = false;
   if (scheme == L"https") {
-    secure = true;
+    *secure = true;
   } else if (scheme != L"http") {
     LOG(ERROR) << "Invalid scheme in URL: " << url;
     return false;
   }
+  return true;
+}
 
-  base::string16 boundary = GenerateMultipartHttpRequestBoundary();
-  base::string16 content_type_header =
-      GenerateMultipartHttpRequestContentTypeHeader(boundary);
-
-  std::string request_body = GenerateMultipartHttpRequestBody(
-      parameters, upload_file, file_part_name, boundary);
-
-  std::unique_ptr<HttpResponse> response =
-      agent->Post(host, port, path, secure, content_type_header, request_body);
+// Checks the status of the response to an upload and reads its body.
+// @param url The resource to which the upload was POSTed.
+// @param response The response, or null if the request failed.
+// @param response_body Receives the HTTP response body.
+// @param response_code Receives the HTTP response status code.
+// @returns true if the upload was successful.
+bool HandleUploadResponse(const base::string16& url,
+                          HttpResponse* response,
+                          base::string16* response_body,
+                          uint16_t* response_code) {
   if (!response) {
     LOG(ERROR) << "Request to " << url << " failed.";
     return false;
@@ -204,7 +339,7 @@ bool SendHttpUpload(HttpAgent* agent,
     return false;
   }
 
-  if (!ReadResponse(response.get(), response_body)) {
+  if (!ReadResponse(response, response_body)) {
     if (response_body->length()) {
       LOG(ERROR) << "Failure while reading response body. Possibly truncated "
                     "response body: " << *response_body;
@@ -217,4 +352,92 @@ bool SendHttpUpload(HttpAgent* agent,
   return true;
 }
 
+}  // namespace
+
+bool SendHttpUpload(HttpAgent* agent,
+                    const base::string16& url,
+                    const std::map<base::string16, base::string16>& parameters,
+                    const std::string& upload_file,
+                    const base::string16& file_part_name,
+                    base::string16* response_body,
+                    uint16_t* response_code) {
+  DCHECK(response_body);
+  DCHECK(response_code);
+
+  base::string16 host, path;
+  uint16_t port = 0;
+  bool secure = false;
+  if (!DecomposeUploadUrl(url, &host, &port, &path, &secure))
+    return false;
+
+  base::string16 boundary = GenerateMultipartHttpRequestBoundary();
+  base::string16 content_type_header =
+      GenerateMultipartHttpRequestContentTypeHeader(boundary);
+
+  std::string request_body = GenerateMultipartHttpRequestBody(
+      parameters, upload_file, file_part_name, boundary);
+
+  std::unique_ptr<HttpResponse> response =
+      agent->Post(host, port, path, secure, content_type_header, request_body);
+  return HandleUploadResponse(url, response.get(), response_body,
+                              response_code);
+}
+
+bool SendHttpFileUpload(
+    HttpAgent* agent,
+    const base::string16& url,
+    const std::map<base::string16, base::string16>& parameters,
+    const base::FilePath& upload_file_path,
+    const base::string16& file_part_name,
+    bool compress,
+    base::string16* response_body,
+    uint16_t* response_code) {
+  DCHECK(response_body);
+  DCHECK(response_code);
+
+  base::string16 host, path;
+  uint16_t port = 0;
+  bool secure = false;
+  if (!DecomposeUploadUrl(url, &host, &port, &path, &secure))
+    return false;
+
+  base::File file(upload_file_path,
+                  base::File::FLAG_OPEN | base::File::FLAG_READ);
+  if (!file.IsValid()) {
+    LOG(ERROR) << "Failed to open the file at " << upload_file_path.value();
+    return false;
+  }
+  int64_t file_size = file.GetLength();
+  if (file_size < 0) {
+    LOG(ERROR) << "Failed to get the size of " << upload_file_path.value();
+    return false;
+  }
+
+  base::string16 boundary = GenerateMultipartHttpRequestBoundary();
+  base::string16 headers =
+      GenerateMultipartHttpRequestContentTypeHeader(boundary);
+
+  std::string prefix, suffix;
+  GenerateMultipartHttpRequestBodyParts(parameters, file_part_name, boundary,
+                                        &prefix, &suffix);
+  MultipartFileRequestBody request_body(prefix, std::move(file),
+                                        static_cast<size_t>(file_size),
+                                        suffix);
+
+  std::unique_ptr<HttpResponse> response;
+  if (compress) {
+    std::string compressed_body;
+    if (!GzipRequestBody(&request_body, &compressed_body))
+      return false;
+    headers += L"\r\n";
+    headers += kGzipContentEncodingHeader;
+    response = agent->Post(host, port, path, secure, headers, compressed_body);
+  } else {
+    response = agent->PostStream(host, port, path, secure, headers,
+                                 &request_body);
+  }
+  return HandleUploadResponse(url, response.get(), response_body,
+                              response_code);
+}
+
 }  // namespace kasko
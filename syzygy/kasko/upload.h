@@ -21,6 +21,10 @@
 
 #include "base/strings/string16.h"
 
+namespace base {
+class FilePath;
+}  // namespace base
+
 namespace kasko {
 
 class HttpAgent;
@@ -42,6 +46,28 @@ bool SendHttpUpload(HttpAgent* agent,
                     base::string16* response_body,
                     uint16_t* response_code);
 
+// POSTs a multipart MIME message via HTTP(S), reading the file part from disk
+// in chunks rather than holding it in memory.
+// @param agent The HTTP implementation to use.
+// @param url The resource to which to POST.
+// @param parameters HTTP request parameters to be encoded in the body.
+// @param upload_file_path The file whose contents are encoded in the body.
+// @param file_part_name The parameter name to be assigned to the file part.
+// @param compress If true, the body is sent with the gzip content encoding.
+//     Only the compressed body is then held in memory.
+// @param response_body Receives the HTTP response body.
+// @param response_code Receives the HTTP response status code.
+// @returns true if successful.
+bool SendHttpFileUpload(
+    HttpAgent* agent,
+    const base::string16& url,
+    const std::map<base::string16, base::string16>& parameters,
+    const base::FilePath& upload_file_path,
+    const base::string16& file_part_name,
+    bool compress,
+    base::string16* response_body,
+    uint16_t* response_code);
+
 }  // namespace kasko
 
 #endif  // SYZYGY_KASKO_UPLOAD_H_
@@ -23,6 +23,9 @@
 #include <vector>
 
 #include "base/macros.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
 #include "base/strings/string16.h"
 #include "base/strings/string_tokenizer.h"
 #include "base/strings/string_util.h"
@@ -32,11 +35,36 @@
 #include "syzygy/kasko/http_response.h"
 #include "syzygy/kasko/internet_helpers.h"
 #include "syzygy/kasko/internet_unittest_helpers.h"
+#include "third_party/zlib/zlib.h"
 
 namespace kasko {
 
 namespace {
 
+const base::char16 kGzipContentEncodingHeader[] =
+    L"\r\nContent-Encoding: gzip";
+
+// Decompresses a gzip compressed body.
+bool Gunzip(const std::string& compressed, std::string* decompressed) {
+  z_stream zstream = {};
+  if (inflateInit2(&zstream, MAX_WBITS + 16) != Z_OK)
+    return false;
+
+  zstream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+  zstream.avail_in = static_cast<uInt>(compressed.size());
+  char buffer[1024];
+  int result = Z_OK;
+  while (result == Z_OK) {
+    zstream.next_out = reinterpret_cast<Bytef*>(buffer);
+    zstream.avail_out = sizeof(buffer);
+    result = inflate(&zstream, Z_NO_FLUSH);
+    decompressed->append(buffer, sizeof(buffer) - zstream.avail_out);
+  }
+  inflateEnd(&zstream);
+  return result == Z_STREAM_END && zstream.avail_in == 0;
+}
+
 // An implementation of HttpAgent that performs a sanity check on the request
 // parameters before returning a fixed HttpResponse.
 class MockHttpAgent : public HttpAgent {
@@ -50,6 +78,7 @@ class MockHttpAgent : public HttpAgent {
     std::map<base::string16, base::string16> parameters;
     std::string file;
     base::string16 file_name;
+    bool compressed;
   };
 
   MockHttpAgent();
@@ -68,6 +97,13 @@ class MockHttpAgent : public HttpAgent {
                                      bool secure,
                                      const base::string16& extra_headers,
                                      const std::string& body) override;
+  std::unique_ptr<HttpResponse> PostStream(
+      const base::string16& host,
+      uint16_t port,
+      const base::string16& path,
+      bool secure,
+      const base::string16& extra_headers,
+      HttpRequestBody* body) override;
 
  private:
   Expectations expectations_;
@@ -78,6 +114,7 @@ class MockHttpAgent : public HttpAgent {
 };
 
 MockHttpAgent::MockHttpAgent() : invoked_(false) {
+  expectations_.compressed = false;
 }
 
 MockHttpAgent::~MockHttpAgent() {
@@ -106,25 +143,39 @@ std::unique_ptr<HttpResponse> MockHttpAgent::Post(
   EXPECT_EQ(expectations_.path, path);
   EXPECT_EQ(expectations_.secure, secure);
 
+  // Undo the compression of the body, and remove the header announcing it.
+  base::string16 content_type_header = extra_headers;
+  std::string decompressed_body = body;
+  if (expectations_.compressed) {
+    size_t header_position =
+        content_type_header.find(kGzipContentEncodingHeader);
+    EXPECT_NE(base::string16::npos, header_position);
+    if (header_position != base::string16::npos)
+      content_type_header.resize(header_position);
+    decompressed_body.clear();
+    EXPECT_TRUE(Gunzip(body, &decompressed_body));
+    EXPECT_GT(decompressed_body.size(), body.size());
+  }
+
   base::string16 boundary;
 
   base::StringTokenizerT<base::string16, base::string16::const_iterator>
-      tokenizer(extra_headers.begin(), extra_headers.end(), L":");
+      tokenizer(content_type_header.begin(), content_type_header.end(), L":");
   if (!tokenizer.GetNext()) {
     ADD_FAILURE() << "Failed to parse Content-Type from extra headers: "
-                  << extra_headers;
+                  << content_type_header;
   } else {
     EXPECT_EQ(L"content-type", base::ToLowerASCII(tokenizer.token()));
     if (!tokenizer.GetNext()) {
       ADD_FAILURE() << "Failed to parse Content-Type value from extra headers: "
-                    << extra_headers;
+                    << content_type_header;
     } else {
       base::string16 mime_type, charset;
       bool had_charset = false;
-      // Use extra_headers.end() since we don't want to choke on a theoretical :
-      // embedded in the value.
+      // Use content_type_header.end() since we don't want to choke on a
+      // theoretical : embedded in the value.
       ParseContentType(
-          base::string16(tokenizer.token_begin(), extra_headers.end()),
+          base::string16(tokenizer.token_begin(), content_type_header.end()),
           &mime_type, &charset, &had_charset, &boundary);
     }
   }
@@ -133,13 +184,34 @@ std::unique_ptr<HttpResponse> MockHttpAgent::Post(
 
   ExpectMultipartMimeMessageIsPlausible(
       boundary, expectations_.parameters, expectations_.file,
-      base::WideToUTF8(expectations_.file_name), body);
+      base::WideToUTF8(expectations_.file_name), decompressed_body);
 
   EXPECT_EQ(expectations_.host, host);
 
   return std::move(response_);
 }
 
+std::unique_ptr<HttpResponse> MockHttpAgent::PostStream(
+    const base::string16& host,
+    uint16_t port,
+    const base::string16& path,
+    bool secure,
+    const base::string16& extra_headers,
+    HttpRequestBody* body) {
+  // Read the body in small chunks, which span its parts.
+  std::string body_contents;
+  char buffer[5];
+  size_t count = 0;
+  do {
+    count = sizeof(buffer);
+    EXPECT_TRUE(body->Read(buffer, &count));
+    body_contents.append(buffer, count);
+  } while (count != 0);
+  EXPECT_EQ(body->GetSize(), body_contents.size());
+
+  return Post(host, port, path, secure, extra_headers, body_contents);
+}
+
 // An implementation of HttpResponse that may be configured to fail at any point
 // and to serve a response in a configurable series of packets.
 class MockHttpResponse : public HttpResponse {
@@ -301,8 +373,14 @@ class UploadTest : public testing::Test {
 
   bool SendUpload(base::string16* response_body, uint16_t* response_code);
 
+  // Sends the expected file from disk.
+  bool SendFileUpload(bool compress,
+                      base::string16* response_body,
+                      uint16_t* response_code);
+
  private:
   MockHttpAgent agent_;
+  base::ScopedTempDir temp_dir_;
 };
 
 bool UploadTest::SendUpload(base::string16* response_body,
@@ -314,6 +392,27 @@ bool UploadTest::SendUpload(base::string16* response_body,
       agent().expectations().file_name, response_body, response_code);
 }
 
+bool UploadTest::SendFileUpload(bool compress,
+                                base::string16* response_body,
+                                uint16_t* response_code) {
+  if (!temp_dir_.IsValid()) {
+    EXPECT_TRUE(temp_dir_.CreateUniqueTempDir());
+  }
+  base::FilePath file_path = temp_dir_.path().Append(L"upload.dmp");
+  const std::string& file = agent().expectations().file;
+  EXPECT_EQ(static_cast<int>(file.size()),
+            base::WriteFile(file_path, file.data(),
+                            static_cast<int>(file.size())));
+
+  agent().expectations().compressed = compress;
+  return SendHttpFileUpload(
+      &agent(), (agent().expectations().secure ? L"https://" : L"http://") +
+                    agent().expectations().host + agent().expectations().path,
+      agent().expectations().parameters, file_path,
+      agent().expectations().file_name, compress, response_body,
+      response_code);
+}
+
 TEST_F(UploadTest, PostFails) {
   base::string16 response_body;
   uint16_t response_code = 0;
@@ -356,6 +455,60 @@ TEST_F(UploadTest, PostSucceedsSecure) {
   EXPECT_EQ(base::UTF8ToWide(kResponse), response_body);
 }
 
+TEST_F(UploadTest, FilePostSucceeds) {
+  const std::string kResponse = "hello world";
+
+  std::unique_ptr<MockHttpResponse> mock_response(new MockHttpResponse);
+  std::vector<std::string> data;
+  data.push_back(kResponse);
+  data.push_back(std::string());
+  mock_response->set_data(data);
+  agent().set_response(std::move(mock_response));
+
+  base::string16 response_body;
+  uint16_t response_code = 0;
+  EXPECT_TRUE(SendFileUpload(false, &response_body, &response_code));
+  EXPECT_EQ(200, response_code);
+  EXPECT_EQ(base::UTF8ToWide(kResponse), response_body);
+}
+
+TEST_F(UploadTest, CompressedFilePostSucceeds) {
+  const std::string kResponse = "hello world";
+
+  std::unique_ptr<MockHttpResponse> mock_response(new MockHttpResponse);
+  std::vector<std::string> data;
+  data.push_back(kResponse);
+  data.push_back(std::string());
+  mock_response->set_data(data);
+  agent().set_response(std::move(mock_response));
+
+  // A file larger than the compression chunks, which compresses well.
+  agent().expectations().file.clear();
+  for (size_t i = 0; i < 100000; ++i)
+    agent().expectations().file.push_back(static_cast<char>(i % 7));
+
+  base::string16 response_body;
+  uint16_t response_code = 0;
+  EXPECT_TRUE(SendFileUpload(true, &response_body, &response_code));
+  EXPECT_EQ(200, response_code);
+  EXPECT_EQ(base::UTF8ToWide(kResponse), response_body);
+}
+
+TEST_F(UploadTest, MissingFileFails) {
+  agent().set_expect_invocation(false);
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::string16 response_body;
+  uint16_t response_code = 0;
+  EXPECT_FALSE(SendHttpFileUpload(
+      &agent(), L"http://" + agent().expectations().host +
+                    agent().expectations().path,
+      agent().expectations().parameters,
+      temp_dir.path().Append(L"missing.dmp"),
+      agent().expectations().file_name, false, &response_body,
+      &response_code));
+}
+
 TEST_F(UploadTest, InvalidURL) {
   agent().set_expect_invocation(false);
   base::string16 response_body;
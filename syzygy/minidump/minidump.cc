@@ -61,6 +61,10 @@ Minidump::TypedThreadExList Minidump::GetThreadExList() const {
   return TypedThreadExList(*this, ThreadExListStream);
 }
 
+const uint8_t* Minidump::GetBytes(size_t offset, size_t data_size) const {
+  return nullptr;
+}
+
 bool Minidump::ReadDirectory() {
   // Read the header and validate the signature.
   MINIDUMP_HEADER header = {};
@@ -119,6 +123,7 @@ bool FileMinidump::ReadBytes(size_t offset,
                              size_t data_size,
                              void* data) const {
   DCHECK_LE(offset, static_cast<size_t>(std::numeric_limits<long>::max()));
+  base::AutoLock auto_lock(lock_);
   if (fseek(file_.get(), static_cast<long>(offset), SEEK_SET) != 0)
     return false;
 
@@ -143,14 +148,42 @@ bool BufferMinidump::Initialize(const uint8_t* buf, size_t buf_len) {
 bool BufferMinidump::ReadBytes(size_t offset,
                                size_t data_size,
                                void* data) const {
+  const uint8_t* bytes = GetBytes(offset, data_size);
+  if (bytes == nullptr)
+    return false;
+
+  ::memcpy(data, bytes, data_size);
+  return true;
+}
+
+const uint8_t* BufferMinidump::GetBytes(size_t offset,
+                                        size_t data_size) const {
   // Bounds check the request.
   if (offset >= buf_len_ || offset + data_size > buf_len_ ||
       offset + data_size < offset) {  // Test for overflow.
-    return false;
+    return nullptr;
   }
 
-  ::memcpy(data, buf_ + offset, data_size);
-  return true;
+  return buf_ + offset;
+}
+
+bool MappedMinidump::Open(const base::FilePath& path) {
+  if (!file_.Initialize(path))
+    return false;
+
+  return Initialize(file_.data(), file_.length());
+}
+
+std::unique_ptr<Minidump> OpenMinidump(const base::FilePath& path) {
+  std::unique_ptr<MappedMinidump> mapped_minidump(new MappedMinidump());
+  if (mapped_minidump->Open(path))
+    return std::move(mapped_minidump);
+
+  std::unique_ptr<FileMinidump> file_minidump(new FileMinidump());
+  if (file_minidump->Open(path))
+    return std::move(file_minidump);
+
+  return nullptr;
 }
 
 Minidump::Stream::Stream()
@@ -222,6 +255,15 @@ bool Minidump::Stream::ReadBytes(size_t data_len, void* data) {
   return true;
 }
 
+const uint8_t* Minidump::Stream::GetBytes(size_t data_len) const {
+  DCHECK(minidump_ != nullptr);
+
+  if (data_len > remaining_length_)
+    return nullptr;
+
+  return minidump_->GetBytes(current_offset_, data_len);
+}
+
 bool Minidump::Stream::AdvanceBytes(size_t data_len) {
   if (data_len > remaining_length_)
     return false;
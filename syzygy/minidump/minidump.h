@@ -21,12 +21,15 @@
 #include <dbghelp.h>
 
 #include <stdint.h>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "base/macros.h"
 #include "base/files/file_path.h"
+#include "base/files/memory_mapped_file.h"
 #include "base/files/scoped_file.h"
+#include "base/synchronization/lock.h"
 
 namespace minidump {
 
@@ -112,6 +115,14 @@ class Minidump {
   // @returns true on success, false on failure, including a short read.
   virtual bool ReadBytes(size_t offset, size_t data_size, void* data) const = 0;
 
+  // Retrieves a pointer to the file contents, for the minidumps that are held
+  // in memory.
+  // @param offset the file offset of the contents.
+  // @param data_size the size of the contents.
+  // @returns a pointer to the contents, or nullptr if they're out of bounds
+  //     or the minidump isn't held in memory.
+  virtual const uint8_t* GetBytes(size_t offset, size_t data_size) const;
+
   bool ReadDirectory();
 
   std::vector<MINIDUMP_DIRECTORY> directory_;
@@ -133,9 +144,14 @@ class FileMinidump : public Minidump {
 
  private:
   base::ScopedFILE file_;
+
+  // Serializes the seek and read of each ReadBytes, so that the minidump can
+  // be read by several threads at once.
+  mutable base::Lock lock_;
 };
 
-// Allows parsing a minidump from an in-memory buffer.
+// Allows parsing a minidump from an in-memory buffer. The streams of the
+// minidump can be accessed in place, without copying them.
 class BufferMinidump : public Minidump {
  public:
   BufferMinidump();
@@ -150,6 +166,7 @@ class BufferMinidump : public Minidump {
 
  protected:
   bool ReadBytes(size_t offset, size_t data_size, void* data) const override;
+  const uint8_t* GetBytes(size_t offset, size_t data_size) const override;
 
  private:
   // Not owned.
@@ -157,6 +174,27 @@ class BufferMinidump : public Minidump {
   size_t buf_len_;
 };
 
+// Allows parsing a minidump from a file that's mapped in memory. Opening the
+// file doesn't read it, and the streams of the minidump can be accessed in
+// place, which saves copying the memory of large minidumps.
+class MappedMinidump : public BufferMinidump {
+ public:
+  // Maps the minidump file at @p path and verifies its header structure.
+  // @param path the minidump file to open.
+  // @return true on success, false on failure.
+  bool Open(const base::FilePath& path);
+
+ private:
+  base::MemoryMappedFile file_;
+};
+
+// Opens the minidump file at @p path. The file is mapped in memory if
+// possible, and read through file reads otherwise, as a large minidump may not
+// fit in the address space.
+// @param path the minidump file to open.
+// @returns the minidump on success, nullptr on failure.
+std::unique_ptr<Minidump> OpenMinidump(const base::FilePath& path);
+
 // A forward-only reading class that bounds reads to streams that make it safe
 // and easy to parse minidump streams. Streams are lightweight objects that
 // can be freely copied.
@@ -187,6 +225,13 @@ class Minidump::Stream {
   bool AdvanceBytes(size_t data_len);
   // @}
 
+  // Retrieves a pointer to the next bytes of the stream, without copying them.
+  // This only succeeds for the minidumps that are held in memory.
+  // @param data_len the number of bytes to retrieve.
+  // @returns a pointer to the bytes, which is valid as long as the minidump,
+  //     or nullptr on failure.
+  const uint8_t* GetBytes(size_t data_len) const;
+
   // Accessors.
   size_t current_offset() const { return current_offset_; }
   size_t remaining_length() const { return remaining_length_; }
@@ -196,6 +196,54 @@ TEST_F(FileMinidumpTest, GetThreadExList) {
 }
 #endif
 
+TEST_F(FileMinidumpTest, MappedMinidumpReadsInPlace) {
+  FileMinidump file_minidump;
+  ASSERT_TRUE(file_minidump.Open(testing::TestMinidumps::GetNotepad32Dump()));
+  MappedMinidump mapped_minidump;
+  ASSERT_TRUE(
+      mapped_minidump.Open(testing::TestMinidumps::GetNotepad32Dump()));
+  ASSERT_EQ(file_minidump.directory().size(),
+            mapped_minidump.directory().size());
+
+  // The memory ranges are accessed in place, and match the file contents.
+  auto memory = mapped_minidump.GetMemoryList();
+  ASSERT_TRUE(memory.IsValid());
+  size_t memory_count = 0;
+  for (const auto& element : memory) {
+    Minidump::Stream mapped_stream =
+        mapped_minidump.GetStreamFor(element.Memory);
+    const uint8_t* bytes = mapped_stream.GetBytes(element.Memory.DataSize);
+    ASSERT_TRUE(bytes != nullptr);
+
+    std::string file_bytes;
+    Minidump::Stream file_stream = file_minidump.GetStreamFor(element.Memory);
+    if (element.Memory.DataSize != 0) {
+      ASSERT_TRUE(
+          file_stream.ReadAndAdvanceBytes(element.Memory.DataSize,
+                                          &file_bytes));
+      EXPECT_EQ(0, ::memcmp(file_bytes.data(), bytes, file_bytes.size()));
+    }
+
+    // The file minidump doesn't hold its contents in memory.
+    EXPECT_EQ(nullptr, file_minidump.GetStreamFor(element.Memory).GetBytes(
+                           element.Memory.DataSize));
+    ++memory_count;
+  }
+  EXPECT_EQ(memory.header().NumberOfMemoryRanges, memory_count);
+
+  MappedMinidump missing_minidump;
+  EXPECT_FALSE(missing_minidump.Open(dump_file()));
+}
+
+TEST_F(FileMinidumpTest, OpenMinidump) {
+  std::unique_ptr<Minidump> minidump =
+      OpenMinidump(testing::TestMinidumps::GetNotepad32Dump());
+  ASSERT_TRUE(minidump);
+  EXPECT_LE(1U, minidump->directory().size());
+
+  EXPECT_FALSE(OpenMinidump(dump_file()));
+}
+
 TEST(BufferMinidumpTest, InitFailsForInvalidFile) {
   // Opening an empty buffer should fail.
   {
@@ -295,6 +343,12 @@ TEST(BufferMinidumpTest, StreamTest) {
 
   // No moar data.
   EXPECT_FALSE(test.ReadBytes(1, &bytes));
+  EXPECT_EQ(nullptr, test.GetBytes(1));
+
+  // The bytes of a stream can be accessed in place, within its bounds.
+  test = minidump.GetStreamFor(loc);
+  EXPECT_EQ(buf.data() + sizeof(MINIDUMP_HEADER), test.GetBytes(7));
+  EXPECT_EQ(nullptr, test.GetBytes(8));
 
   // Reset the stream to test reading via a string.
   test = minidump.GetStreamFor(loc);
@@ -41,6 +41,7 @@ class MsfByteStreamImpl : public MsfStreamImpl<T> {
   // @name MsfStreamImpl implementation.
   // @{
   bool ReadBytesAt(size_t pos, size_t count, void* dest) override;
+  const uint8_t* GetDataAt(size_t pos, size_t* count) const override;
   scoped_refptr<WritableMsfStreamImpl<T>> GetWritableStream() override;
   // @}
 
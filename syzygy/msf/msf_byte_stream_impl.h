@@ -114,6 +114,18 @@ bool MsfByteStreamImpl<T>::ReadBytesAt(size_t pos, size_t count, void* dest) {
   return true;
 }
 
+template <MsfFileType T>
+const uint8_t* MsfByteStreamImpl<T>::GetDataAt(size_t pos,
+                                               size_t* count) const {
+  DCHECK(count != NULL);
+
+  if (pos >= length())
+    return NULL;
+
+  *count = length() - pos;
+  return data_.data() + pos;
+}
+
 template <MsfFileType T>
 scoped_refptr<WritableMsfStreamImpl<T>>
 MsfByteStreamImpl<T>::GetWritableStream() {
@@ -113,6 +113,18 @@ TEST(MsfByteStreamTest, ReadBytesAt) {
   }
 }
 
+TEST(MsfByteStreamTest, GetDataAt) {
+  uint8_t data[] = {0, 1, 2, 3, 4, 5, 6, 7};
+  scoped_refptr<MsfByteStream> stream(new MsfByteStream());
+  EXPECT_TRUE(stream->Init(data, arraysize(data)));
+
+  size_t count = 0;
+  EXPECT_EQ(stream->data() + 3, stream->GetDataAt(3, &count));
+  EXPECT_EQ(5U, count);
+  EXPECT_EQ(static_cast<const uint8_t*>(NULL),
+            stream->GetDataAt(arraysize(data), &count));
+}
+
 TEST(MsfByteStreamTest, GetWritableStream) {
   scoped_refptr<MsfStream> stream(new MsfByteStream());
   scoped_refptr<WritableMsfStream> writer1 = stream->GetWritableStream();
@@ -0,0 +1,128 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares an MSF stream that reads its pages from a memory mapped MSF file.
+// Reading from such a stream is a copy out of the mapping, without any seek
+// or system call, and the streams whose pages are adjacent in the file can be
+// read in a single copy or accessed in place.
+
+#ifndef SYZYGY_MSF_MSF_MAPPED_STREAM_H_
+#define SYZYGY_MSF_MSF_MAPPED_STREAM_H_
+
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/memory/ref_counted.h"
+#include "syzygy/msf/msf_decl.h"
+#include "syzygy/msf/msf_stream.h"
+
+namespace msf {
+
+// A reference counted read-only mapping of a file. The mapping isn't modified
+// once it is initialized, so it can be read from several threads at once.
+class RefCountedMappedFile
+    : public base::RefCountedThreadSafe<RefCountedMappedFile> {
+ public:
+  RefCountedMappedFile() {}
+
+  // Maps a file.
+  // @param path the path of the file to map.
+  // @returns true on success, false otherwise.
+  bool Initialize(const base::FilePath& path) {
+    return file_.Initialize(path);
+  }
+
+  // @returns a pointer to the contents of the file.
+  const uint8_t* data() const { return file_.data(); }
+
+  // @returns the length of the file, in bytes.
+  size_t length() const { return file_.length(); }
+
+ private:
+  friend base::RefCountedThreadSafe<RefCountedMappedFile>;
+
+  // We disallow access to the destructor to enforce the use of reference
+  // counting pointers.
+  ~RefCountedMappedFile() {}
+
+  base::MemoryMappedFile file_;
+
+  DISALLOW_COPY_AND_ASSIGN(RefCountedMappedFile);
+};
+
+namespace detail {
+
+// This class represents an MSF stream in a memory mapped file. The stream
+// holds no cursor, so ReadBytesAt can be called from several threads at once.
+template <MsfFileType T>
+class MsfMappedStreamImpl : public MsfStreamImpl<T> {
+ public:
+  // Constructor.
+  // @param file the mapped file housing this stream.
+  // @param length the length of this stream.
+  // @param pages the indices of the pages that make up this stream in the file.
+  //     A copy is made of the data so the pointer need not remain valid
+  //     beyond the constructor. The length of this array is implicit in the
+  //     stream length and the page size.
+  // @param page_size the size of the pages, in bytes.
+  MsfMappedStreamImpl(RefCountedMappedFile* file,
+                      size_t length,
+                      const uint32_t* pages,
+                      size_t page_size);
+
+  // @name MsfStreamImpl implementation.
+  // @{
+  bool ReadBytesAt(size_t pos, size_t count, void* dest) override;
+  // The views extend from @p pos to the end of the run of adjacent pages
+  // holding it. NULL is also returned if that page is past the end of the
+  // file.
+  const uint8_t* GetDataAt(size_t pos, size_t* count) const override;
+  // @}
+
+  // @returns a pointer to the data of the stream if its pages are adjacent in
+  //     the file, NULL otherwise. The data remains valid as long as the
+  //     stream does.
+  const uint8_t* GetContiguousData() const { return contiguous_data_; }
+
+ protected:
+  // Protected to enforce reference counted pointers at compile time.
+  virtual ~MsfMappedStreamImpl();
+
+ private:
+  // The mapping of the MSF file. This is reference counted so that streams can
+  // outlive the MsfReaderImpl that created them.
+  scoped_refptr<RefCountedMappedFile> file_;
+
+  // The list of pages in the MSF file that make up this stream.
+  std::vector<uint32_t> pages_;
+
+  // The size of pages within the stream.
+  size_t page_size_;
+
+  // The data of the stream, when its pages are adjacent in the file.
+  const uint8_t* contiguous_data_;
+
+  DISALLOW_COPY_AND_ASSIGN(MsfMappedStreamImpl);
+};
+
+}  // namespace detail
+
+using MsfMappedStream = detail::MsfMappedStreamImpl<kGenericMsfFileType>;
+
+}  // namespace msf
+
+#include "syzygy/msf/msf_mapped_stream_impl.h"
+
+#endif  // SYZYGY_MSF_MSF_MAPPED_STREAM_H_
@@ -0,0 +1,130 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Internal implementation details for msf_mapped_stream.h. Not meant to be
+// included directly.
+
+#ifndef SYZYGY_MSF_MSF_MAPPED_STREAM_IMPL_H_
+#define SYZYGY_MSF_MSF_MAPPED_STREAM_IMPL_H_
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.h"
+#include "syzygy/msf/msf_decl.h"
+
+namespace msf {
+namespace detail {
+
+template <MsfFileType T>
+MsfMappedStreamImpl<T>::MsfMappedStreamImpl(RefCountedMappedFile* file,
+                                            size_t length,
+                                            const uint32_t* pages,
+                                            size_t page_size)
+    : MsfStreamImpl(length),
+      file_(file),
+      page_size_(page_size),
+      contiguous_data_(NULL) {
+  DCHECK(file != NULL);
+  DCHECK_LT(0U, page_size);
+
+  // Streams of invalid length have no pages.
+  size_t num_pages = (this->length() + page_size - 1) / page_size;
+  pages_.assign(pages, pages + num_pages);
+
+  // The streams laid out in a single run of pages can be accessed in place.
+  if (pages_.empty())
+    return;
+  for (size_t i = 1; i < pages_.size(); ++i) {
+    if (pages_[i] != pages_[i - 1] + 1)
+      return;
+  }
+  size_t offset = page_size_ * pages_.front();
+  if (offset <= file_->length() && this->length() <= file_->length() - offset)
+    contiguous_data_ = file_->data() + offset;
+}
+
+template <MsfFileType T>
+MsfMappedStreamImpl<T>::~MsfMappedStreamImpl() {
+}
+
+template <MsfFileType T>
+bool MsfMappedStreamImpl<T>::ReadBytesAt(size_t pos,
+                                         size_t count,
+                                         void* dest) {
+  DCHECK(dest != NULL);
+
+  // Don't read beyond the end of the known stream length.
+  if (pos > length() || count > length() - pos)
+    return false;
+
+  if (contiguous_data_ != NULL) {
+    ::memcpy(dest, contiguous_data_ + pos, count);
+    return true;
+  }
+
+  // Copy the stream one run of adjacent pages at a time.
+  while (count > 0) {
+    size_t chunk_size = 0;
+    const uint8_t* data = GetDataAt(pos, &chunk_size);
+    if (data == NULL) {
+      LOG(ERROR) << "Page read failed";
+      return false;
+    }
+    chunk_size = std::min(count, chunk_size);
+    ::memcpy(dest, data, chunk_size);
+
+    count -= chunk_size;
+    pos += chunk_size;
+    dest = reinterpret_cast<uint8_t*>(dest) + chunk_size;
+  }
+
+  return true;
+}
+
+template <MsfFileType T>
+const uint8_t* MsfMappedStreamImpl<T>::GetDataAt(size_t pos,
+                                                 size_t* count) const {
+  DCHECK(count != NULL);
+
+  if (pos >= length())
+    return NULL;
+
+  if (contiguous_data_ != NULL) {
+    *count = length() - pos;
+    return contiguous_data_ + pos;
+  }
+
+  // Find the end of the run of adjacent pages holding pos.
+  size_t first_page = pos / page_size_;
+  size_t last_page = first_page;
+  while (last_page + 1 < pages_.size() &&
+         pages_[last_page + 1] == pages_[last_page] + 1) {
+    ++last_page;
+  }
+
+  size_t offset = page_size_ * pages_[first_page] + pos % page_size_;
+  size_t run_end = std::min(length(), (last_page + 1) * page_size_);
+  size_t run_size = run_end - pos;
+  if (offset > file_->length() || run_size > file_->length() - offset)
+    return NULL;
+
+  *count = run_size;
+  return file_->data() + offset;
+}
+
+}  // namespace detail
+}  // namespace msf
+
+#endif  // SYZYGY_MSF_MSF_MAPPED_STREAM_IMPL_H_
@@ -0,0 +1,125 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/msf/msf_mapped_stream.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/msf/msf_data.h"
+#include "syzygy/msf/unittest_util.h"
+
+namespace msf {
+
+namespace {
+
+class MsfMappedStreamTest : public testing::Test {
+ public:
+  virtual void SetUp() {
+    file_ = new RefCountedMappedFile();
+    ASSERT_TRUE(file_->Initialize(
+        testing::GetSrcRelativePath(testing::kTestPdbFilePath)));
+  }
+
+ protected:
+  scoped_refptr<RefCountedMappedFile> file_;
+};
+
+}  // namespace
+
+TEST_F(MsfMappedStreamTest, Constructor) {
+  uint32_t pages[] = {1, 2, 3};
+  scoped_refptr<MsfMappedStream> stream(
+      new MsfMappedStream(file_.get(), 10, pages, 8));
+  EXPECT_EQ(10, stream->length());
+}
+
+TEST_F(MsfMappedStreamTest, ReadBytesAt) {
+  // Different sections of the MSF header magic string.
+  char* test_cases[] = {"Mic", "roso", "ft", " C/C+", "+ MS", "F 7.00"};
+
+  // Test that we can read varying sizes of bytes from the header of the
+  // file with varying page sizes.
+  char buffer[8] = {0};
+  for (size_t page_size = 4; page_size <= 32; page_size *= 2) {
+    uint32_t pages[] = {0, 1, 2, 3, 4, 5, 6, 7};
+    scoped_refptr<MsfMappedStream> stream(new MsfMappedStream(
+        file_.get(), sizeof(MsfHeader), pages, page_size));
+
+    size_t pos = 0;
+    for (uint32_t j = 0; j < arraysize(test_cases); ++j) {
+      char* test_case = test_cases[j];
+      size_t len = strlen(test_case);
+      EXPECT_TRUE(stream->ReadBytesAt(pos, len, &buffer));
+      EXPECT_EQ(0U, ::memcmp(buffer, test_case, len));
+      pos += len;
+    }
+
+    // Try a read past the end of the stream.
+    EXPECT_FALSE(stream->ReadBytesAt(sizeof(MsfHeader) - 1, 2, buffer));
+  }
+}
+
+TEST_F(MsfMappedStreamTest, ReadScatteredPages) {
+  // The pages aren't adjacent, so the stream is read one run at a time.
+  uint32_t pages[] = {2, 0, 1};
+  scoped_refptr<MsfMappedStream> stream(
+      new MsfMappedStream(file_.get(), 12, pages, 4));
+  EXPECT_EQ(static_cast<const uint8_t*>(NULL), stream->GetContiguousData());
+
+  char buffer[12] = {0};
+  EXPECT_TRUE(stream->ReadBytesAt(0, sizeof(buffer), buffer));
+  EXPECT_EQ(0, ::memcmp(buffer, "t C/Microsof", sizeof(buffer)));
+  EXPECT_TRUE(stream->ReadBytesAt(3, 3, buffer));
+  EXPECT_EQ(0, ::memcmp(buffer, "/Mi", 3));
+}
+
+TEST_F(MsfMappedStreamTest, GetDataAt) {
+  uint32_t pages[] = {2, 0, 1};
+  scoped_refptr<MsfMappedStream> stream(
+      new MsfMappedStream(file_.get(), 10, pages, 4));
+
+  // The views extend to the end of the runs of adjacent pages, and no further
+  // than the end of the stream.
+  size_t count = 0;
+  const uint8_t* data = stream->GetDataAt(1, &count);
+  EXPECT_EQ(file_->data() + 9, data);
+  EXPECT_EQ(3U, count);
+  data = stream->GetDataAt(5, &count);
+  EXPECT_EQ(file_->data() + 1, data);
+  EXPECT_EQ(5U, count);
+  EXPECT_EQ(static_cast<const uint8_t*>(NULL), stream->GetDataAt(10, &count));
+}
+
+TEST_F(MsfMappedStreamTest, GetContiguousData) {
+  uint32_t pages[] = {1, 2, 3};
+  scoped_refptr<MsfMappedStream> stream(
+      new MsfMappedStream(file_.get(), 10, pages, 4));
+  EXPECT_EQ(file_->data() + 4, stream->GetContiguousData());
+
+  size_t count = 0;
+  EXPECT_EQ(file_->data() + 6, stream->GetDataAt(2, &count));
+  EXPECT_EQ(8U, count);
+}
+
+TEST_F(MsfMappedStreamTest, ReadPastEndOfFileFails) {
+  uint32_t pages[] = {0, 0x7FFFFFFF};
+  scoped_refptr<MsfMappedStream> stream(
+      new MsfMappedStream(file_.get(), 8, pages, 4));
+
+  char buffer[8] = {0};
+  EXPECT_TRUE(stream->ReadBytesAt(0, 4, buffer));
+  EXPECT_FALSE(stream->ReadBytesAt(0, 8, buffer));
+}
+
+}  // namespace msf
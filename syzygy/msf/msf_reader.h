@@ -15,6 +15,8 @@
 #ifndef SYZYGY_MSF_MSF_READER_H_
 #define SYZYGY_MSF_MSF_READER_H_
 
+#include <vector>
+
 #include "base/files/file_path.h"
 #include "base/files/file_util.h"
 #include "syzygy/msf/msf_constants.h"
@@ -22,6 +24,7 @@
 #include "syzygy/msf/msf_decl.h"
 #include "syzygy/msf/msf_file.h"
 #include "syzygy/msf/msf_file_stream.h"
+#include "syzygy/msf/msf_mapped_stream.h"
 #include "syzygy/msf/msf_stream.h"
 
 namespace msf {
@@ -46,7 +49,27 @@ class MsfReaderImpl {
   // @returns true on success, false otherwise.
   bool Read(const base::FilePath& msf_path, MsfFileImpl<T>* msf_file);
 
+  // Reads the header and the directory of an MSF file, without creating its
+  // streams.
+  // @param msf_path the MSF file to read.
+  // @param header receives the header of the file.
+  // @param directory receives the directory of the file: the stream count,
+  //     followed by the stream lengths, followed by the pages of each stream.
+  // @returns true on success, false otherwise.
+  bool ReadDirectory(const base::FilePath& msf_path,
+                     MsfHeader* header,
+                     std::vector<uint32_t>* directory);
+
  private:
+  // Reads the header and the directory of a mapped MSF file.
+  // @param file the mapped MSF file.
+  // @param header receives the header of the file.
+  // @param directory receives the directory of the file.
+  // @returns true on success, false otherwise.
+  bool ReadDirectory(RefCountedMappedFile* file,
+                     MsfHeader* header,
+                     std::vector<uint32_t>* directory);
+
   DISALLOW_COPY_AND_ASSIGN(MsfReaderImpl);
 };
 
@@ -18,7 +18,6 @@
 #ifndef SYZYGY_MSF_MSF_READER_IMPL_H_
 #define SYZYGY_MSF_MSF_READER_IMPL_H_
 
-#include <cstdio>
 #include <cstring>
 #include <memory>
 #include <vector>
@@ -27,33 +26,13 @@
 #include "base/memory/ref_counted.h"
 #include "base/strings/string_util.h"
 #include "syzygy/msf/msf_data.h"
-#include "syzygy/msf/msf_file_stream.h"
+#include "syzygy/msf/msf_mapped_stream.h"
 
 namespace msf {
 namespace detail {
 
 namespace {
 
-bool GetFileSize(FILE* file, uint32_t* size) {
-  DCHECK(file != NULL);
-  DCHECK(size != NULL);
-
-  if (fseek(file, 0, SEEK_END) != 0) {
-    LOG(ERROR) << "Failed seeking to end of file.";
-    return false;
-  }
-
-  long temp = ftell(file);
-  if (temp == -1L) {
-    LOG(ERROR) << "Failed to read stream position.";
-    return false;
-  }
-  DCHECK_GT(temp, 0);
-
-  (*size) = static_cast<uint32_t>(temp);
-  return true;
-}
-
 uint32_t GetNumPages(const MsfHeader& header, uint32_t num_bytes) {
   return (num_bytes + header.page_size - 1) / header.page_size;
 }
@@ -67,40 +46,75 @@ bool MsfReaderImpl<T>::Read(const base::FilePath& msf_path,
 
   msf_file->Clear();
 
-  scoped_refptr<RefCountedFILE> file(
-      new RefCountedFILE(base::OpenFile(msf_path, "rb")));
-  if (!file->file()) {
-    LOG(ERROR) << "Unable to open '" << msf_path.value() << "'.";
+  // Map the whole file. The streams read their pages straight out of the
+  // mapping, which they keep alive.
+  scoped_refptr<RefCountedMappedFile> file(new RefCountedMappedFile());
+  if (!file->Initialize(msf_path)) {
+    LOG(ERROR) << "Unable to map '" << msf_path.value() << "'.";
     return false;
   }
 
-  // Get the file size.
-  uint32_t file_size = 0;
-  if (!GetFileSize(file->file(), &file_size)) {
-    LOG(ERROR) << "Unable to determine size of '" << msf_path.value() << "'.";
+  MsfHeader header = {0};
+  std::vector<uint32_t> directory;
+  if (!ReadDirectory(file.get(), &header, &directory))
     return false;
+
+  // Iterate through the streams and construct MsfStreams.
+  const uint32_t& num_streams = directory[0];
+  const uint32_t* stream_lengths = &(directory[1]);
+  const uint32_t* stream_pages = &(directory[1 + num_streams]);
+
+  uint32_t page_index = 0;
+  for (uint32_t stream_index = 0; stream_index < num_streams; ++stream_index) {
+    msf_file->AppendStream(new MsfMappedStreamImpl<T>(
+        file.get(), stream_lengths[stream_index], stream_pages + page_index,
+        header.page_size));
+    page_index += GetNumPages(header, stream_lengths[stream_index]);
   }
 
-  MsfHeader header = {0};
+  return true;
+}
+
+template <MsfFileType T>
+bool MsfReaderImpl<T>::ReadDirectory(const base::FilePath& msf_path,
+                                     MsfHeader* header,
+                                     std::vector<uint32_t>* directory) {
+  DCHECK(header != NULL);
+  DCHECK(directory != NULL);
+
+  scoped_refptr<RefCountedMappedFile> file(new RefCountedMappedFile());
+  if (!file->Initialize(msf_path)) {
+    LOG(ERROR) << "Unable to map '" << msf_path.value() << "'.";
+    return false;
+  }
+
+  return ReadDirectory(file.get(), header, directory);
+}
+
+template <MsfFileType T>
+bool MsfReaderImpl<T>::ReadDirectory(RefCountedMappedFile* file,
+                                     MsfHeader* header,
+                                     std::vector<uint32_t>* directory) {
+  DCHECK(file != NULL);
+  DCHECK(header != NULL);
+  DCHECK(directory != NULL);
 
-  // Read the header from the first page in the file. The page size we use here
-  // is irrelevant as after reading the header we get the actual page size in
-  // use by the MSF and from then on use that.
-  uint32_t header_page = 0;
-  scoped_refptr<MsfFileStreamImpl<T>> header_stream(new MsfFileStreamImpl<T>(
-      file.get(), sizeof(header), &header_page, kMsfPageSize));
-  if (!header_stream->ReadBytesAt(0, sizeof(header), &header)) {
+  size_t file_size = file->length();
+
+  // Read the header from the start of the file.
+  if (file_size < sizeof(*header)) {
     LOG(ERROR) << "Failed to read MSF file header.";
     return false;
   }
+  ::memcpy(header, file->data(), sizeof(*header));
 
   // Sanity checks.
-  if (header.num_pages * header.page_size != file_size) {
+  if (header->num_pages * header->page_size != file_size) {
     LOG(ERROR) << "Invalid MSF file size.";
     return false;
   }
 
-  if (memcmp(header.magic_string, kMsfHeaderMagicString,
+  if (memcmp(header->magic_string, kMsfHeaderMagicString,
              sizeof(kMsfHeaderMagicString)) != 0) {
     LOG(ERROR) << "Invalid MSF magic string.";
     return false;
@@ -111,10 +125,10 @@ bool MsfReaderImpl<T>::Read(const base::FilePath& msf_path,
   // many pages are required to represent the directory, then we load a stream
   // containing that many page pointers from the root pages array.
   int num_dir_pages =
-      static_cast<int>(GetNumPages(header, header.directory_size));
-  scoped_refptr<MsfFileStreamImpl<T>> dir_page_stream(
-      new MsfFileStreamImpl<T>(file.get(), num_dir_pages * sizeof(uint32_t),
-                               header.root_pages, header.page_size));
+      static_cast<int>(GetNumPages(*header, header->directory_size));
+  scoped_refptr<MsfMappedStreamImpl<T>> dir_page_stream(
+      new MsfMappedStreamImpl<T>(file, num_dir_pages * sizeof(uint32_t),
+                                 header->root_pages, header->page_size));
   std::unique_ptr<uint32_t[]> dir_pages(new uint32_t[num_dir_pages]);
   if (dir_pages.get() == NULL) {
     LOG(ERROR) << "Failed to allocate directory pages.";
@@ -128,28 +142,17 @@ bool MsfReaderImpl<T>::Read(const base::FilePath& msf_path,
 
   // Load the actual directory.
   size_t dir_size =
-      static_cast<size_t>(header.directory_size / sizeof(uint32_t));
-  scoped_refptr<MsfFileStreamImpl<T>> dir_stream(new MsfFileStreamImpl<T>(
-      file.get(), header.directory_size, dir_pages.get(), header.page_size));
-  std::vector<uint32_t> directory(dir_size);
-  if (!dir_stream->ReadBytesAt(0, dir_size * sizeof(uint32_t), &directory[0])) {
+      static_cast<size_t>(header->directory_size / sizeof(uint32_t));
+  scoped_refptr<MsfMappedStreamImpl<T>> dir_stream(new MsfMappedStreamImpl<T>(
+      file, header->directory_size, dir_pages.get(), header->page_size));
+  directory->resize(dir_size);
+  if (dir_size == 0 ||
+      !dir_stream->ReadBytesAt(0, dir_size * sizeof(uint32_t),
+                               directory->data())) {
     LOG(ERROR) << "Failed to read directory stream.";
     return false;
   }
 
-  // Iterate through the streams and construct MsfStreams.
-  const uint32_t& num_streams = directory[0];
-  const uint32_t* stream_lengths = &(directory[1]);
-  const uint32_t* stream_pages = &(directory[1 + num_streams]);
-
-  uint32_t page_index = 0;
-  for (uint32_t stream_index = 0; stream_index < num_streams; ++stream_index) {
-    msf_file->AppendStream(
-        new MsfFileStreamImpl<T>(file.get(), stream_lengths[stream_index],
-                                 stream_pages + page_index, header.page_size));
-    page_index += GetNumPages(header, stream_lengths[stream_index]);
-  }
-
   return true;
 }
 
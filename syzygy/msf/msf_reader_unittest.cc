@@ -14,6 +14,8 @@
 
 #include "syzygy/msf/msf_reader.h"
 
+#include <vector>
+
 #include "base/path_service.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
@@ -32,4 +34,35 @@ TEST(MsfReaderTest, Read) {
   EXPECT_EQ(msf_file.StreamCount(), 168u);
 }
 
+TEST(MsfReaderTest, StreamsOutliveReader) {
+  base::FilePath test_dll_msf =
+      testing::GetSrcRelativePath(testing::kTestPdbFilePath);
+
+  scoped_refptr<MsfStream> stream;
+  {
+    MsfReader reader;
+    MsfFile msf_file;
+    ASSERT_TRUE(reader.Read(test_dll_msf, &msf_file));
+    for (uint32_t i = 0; i < msf_file.StreamCount(); ++i) {
+      stream = msf_file.GetStream(i);
+      if (stream.get() != NULL && stream->length() > 0)
+        break;
+    }
+  }
+
+  // The stream keeps the mapping of the file alive.
+  ASSERT_TRUE(stream.get() != NULL);
+  std::vector<uint8_t> data(stream->length());
+  EXPECT_TRUE(stream->ReadBytesAt(0, data.size(), data.data()));
+}
+
+TEST(MsfReaderTest, ReadMissingFileFails) {
+  base::FilePath missing_msf =
+      testing::GetSrcRelativePath(L"syzygy\\msf\\missing.pdb");
+
+  MsfReader reader;
+  MsfFile msf_file;
+  EXPECT_FALSE(reader.Read(missing_msf, &msf_file));
+}
+
 }  // namespace msf
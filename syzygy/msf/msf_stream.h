@@ -44,6 +44,18 @@ class MsfStreamImpl : public base::RefCounted<MsfStreamImpl<T>> {
   // @returns true if all @p count bytes are read, false otherwise.
   virtual bool ReadBytesAt(size_t pos, size_t count, void* dest) = 0;
 
+  // Gets a view of the data of the stream, for the streams that hold it in
+  // memory. This allows the data to be used without being copied.
+  //
+  // @param pos the position in the stream of the first byte of the view.
+  // @param count receives the number of bytes in the view, which may be fewer
+  //     than the bytes left in the stream.
+  // @returns a pointer to the data, or NULL if the stream doesn't provide
+  //     views or if @p pos is past the end of the stream.
+  virtual const uint8_t* GetDataAt(size_t pos, size_t* count) const {
+    return NULL;
+  }
+
   // Returns a pointer to a WritableMsfStreamImpl if the underlying object
   // supports this interface. If this returns non-NULL, it is up to the user to
   // ensure thread safety; each writer should be used exclusively of any other
@@ -18,8 +18,12 @@
 #ifndef SYZYGY_MSF_MSF_WRITER_H_
 #define SYZYGY_MSF_MSF_WRITER_H_
 
+#include <vector>
+
+#include "base/files/file.h"
 #include "base/files/file_path.h"
 #include "base/files/file_util.h"
+#include "base/logging.h"
 #include "syzygy/msf/msf_decl.h"
 #include "syzygy/msf/msf_file.h"
 #include "syzygy/msf/msf_stream.h"
@@ -30,6 +34,11 @@ namespace detail {
 // This class is used to write an MSF file to disk given a list of MsfStreams.
 // It will create a header and directory inside the MSF file that describe
 // the page layout of the streams in the file.
+//
+// The pages of the streams are allocated up front, and the streams are then
+// written to their pages concurrently. The streams that provide views of their
+// data, such as those read from an existing MSF file, are written straight
+// from their views one run of adjacent pages at a time.
 template <MsfFileType T>
 class MsfWriterImpl {
  public:
@@ -42,6 +51,35 @@ class MsfWriterImpl {
   // @returns true on success, false otherwise.
   bool Write(const base::FilePath& msf_path, const MsfFileImpl<T>& msf_file);
 
+  // Updates an MSF file in place. The streams that are shared with the
+  // original file keep their pages and aren't written, the other streams are
+  // appended to the file, and the directory, header and free page map are
+  // rewritten. The pages that are no longer used are left in the file and
+  // marked as free.
+  // @param msf_path the path of the MSF file to update. It must be the file
+  //     that @p original_msf_file was read from, and it must not have been
+  //     modified since.
+  // @param original_msf_file the MSF file as it was read from @p msf_path.
+  // @param msf_file the MSF file to be written. Its streams that are the same
+  //     objects as the streams of @p original_msf_file at the same index are
+  //     left in place.
+  // @returns true on success, false otherwise. On failure the file may be left
+  //     unreadable.
+  bool Update(const base::FilePath& msf_path,
+              const MsfFileImpl<T>& original_msf_file,
+              const MsfFileImpl<T>& msf_file);
+
+  // Sets the number of threads used to write the streams. This defaults to
+  // the number of processors.
+  // @param thread_count the number of threads, which must be at least 1.
+  void set_thread_count(size_t thread_count) {
+    DCHECK_LT(0u, thread_count);
+    thread_count_ = thread_count;
+  }
+
+  // @returns the number of threads used to write the streams.
+  size_t thread_count() const { return thread_count_; }
+
  protected:
   // Append the contents of the stream onto the file handle at the offset. The
   // contents of the file are padded to reach the next page boundary in the
@@ -52,6 +90,31 @@ class MsfWriterImpl {
                     std::vector<uint32_t>* pages_written,
                     uint32_t* page_count);
 
+  // Writes the streams to the pages allocated to them, concurrently.
+  // @param msf_file the MSF file whose streams are written.
+  // @param directory the directory of the file being written.
+  // @param first_pages the index in @p directory of the first page of each
+  //     stream, or an invalid index for the streams that aren't written.
+  // @param file the file to write to.
+  // @returns true on success, false otherwise.
+  bool WriteStreams(const MsfFileImpl<T>& msf_file,
+                    const std::vector<uint32_t>& directory,
+                    const std::vector<size_t>& first_pages,
+                    base::File* file);
+
+  // Appends the directory and the root directory after the streams, and
+  // writes the header. This leaves file_ open for the free page map.
+  // @param msf_path the path of the file being written.
+  // @param directory the directory of the file.
+  // @param directory_pages receives the pages of the directory and of the
+  //     root directory.
+  // @param page_count the number of pages allocated so far, which is updated.
+  // @returns true on success, false otherwise.
+  bool AppendDirectory(const base::FilePath& msf_path,
+                       const std::vector<uint32_t>& directory,
+                       std::vector<uint32_t>* directory_pages,
+                       uint32_t* page_count);
+
   // Writes the MSF header after the directory has been written.
   bool WriteHeader(const std::vector<uint32_t>& root_directory_pages,
                    uint32_t directory_size,
@@ -60,6 +123,9 @@ class MsfWriterImpl {
   // The current file handle open for writing.
   base::ScopedFILE file_;
 
+  // The number of threads used to write the streams.
+  size_t thread_count_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(MsfWriterImpl);
 };
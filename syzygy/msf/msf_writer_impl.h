@@ -15,13 +15,19 @@
 #ifndef SYZYGY_MSF_MSF_WRITER_IMPL_H_
 #define SYZYGY_MSF_MSF_WRITER_IMPL_H_
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <vector>
 
+#include "base/bind.h"
 #include "base/logging.h"
+#include "base/sys_info.h"
+#include "base/files/file.h"
+#include "syzygy/application/work_pool.h"
 #include "syzygy/msf/msf_constants.h"
 #include "syzygy/msf/msf_data.h"
+#include "syzygy/msf/msf_reader.h"
 
 namespace msf {
 namespace detail {
@@ -30,6 +36,10 @@ namespace {
 
 const uint32_t kZeroBuffer[kMsfPageSize] = {0};
 
+// The first page index of the streams that are left in place when updating an
+// MSF file, and that aren't written.
+const size_t kInPlaceStream = static_cast<size_t>(-1);
+
 // A byte-based bitmap for keeping track of free pages in an MSF file.
 // TODO(chrisha): Promote this to its own file and unittest it when we make
 //     a library for MSF-specific stuff.
@@ -108,6 +118,35 @@ class ReadOnlyMsfStream : public MsfStreamImpl<T> {
   const void* data_;
 };
 
+// Allocates the next page of an MSF file, skipping over the pages of the free
+// page map. The writer reserves the two free page map pages at every page
+// index that is 1 modulo kMsfPageSize.
+// @param page_count the number of pages allocated so far, which is updated to
+//     include the free page map pages and the allocated page.
+// @returns the index of the allocated page.
+uint32_t AllocatePage(uint32_t* page_count) {
+  DCHECK(page_count != NULL);
+
+  if (((*page_count) % kMsfPageSize) == 1)
+    *page_count += 2;
+  return (*page_count)++;
+}
+
+// Allocates the pages of a stream, as AppendStream would write them.
+// @param length the length of the stream.
+// @param pages receives the indices of the pages of the stream.
+// @param page_count the number of pages allocated so far, which is updated.
+void AllocateStreamPages(size_t length,
+                         std::vector<uint32_t>* pages,
+                         uint32_t* page_count) {
+  DCHECK(pages != NULL);
+  DCHECK(page_count != NULL);
+
+  size_t num_pages = (length + kMsfPageSize - 1) / kMsfPageSize;
+  for (size_t i = 0; i < num_pages; ++i)
+    pages->push_back(AllocatePage(page_count));
+}
+
 // Appends a page to the provided file, adding the written page ID to the vector
 // of @p pages_written, and incrementing the total @P page_count. This will
 // occasionally cause more than one single page to be written to the output,
@@ -134,13 +173,13 @@ bool AppendPage(const void* data,
             static_cast<uint32_t>(::ftell(file)));
 
   // If we're due to allocate pages for the free page map, then do so.
-  if (((*page_count) % kMsfPageSize) == 1) {
+  uint32_t page = AllocatePage(&local_page_count);
+  if (page != *page_count) {
     if (::fwrite(kZeroBuffer, 1, kMsfPageSize, file) != kMsfPageSize ||
         ::fwrite(kZeroBuffer, 1, kMsfPageSize, file) != kMsfPageSize) {
       LOG(ERROR) << "Failed to allocate free page map pages.";
       return false;
     }
-    local_page_count += 2;
   }
 
   // Write the page itself.
@@ -148,8 +187,7 @@ bool AppendPage(const void* data,
     LOG(ERROR) << "Failed to write page " << *page_count << ".";
     return false;
   }
-  pages_written->push_back(local_page_count);
-  ++local_page_count;
+  pages_written->push_back(page);
 
   DCHECK_EQ(local_page_count * kMsfPageSize,
             static_cast<uint32_t>(::ftell(file)));
@@ -158,6 +196,117 @@ bool AppendPage(const void* data,
   return true;
 }
 
+// Writes the contents of a stream to the pages allocated to it. The data the
+// stream provides views of is written without being copied, one run of
+// adjacent pages at a time, and the rest is read one page at a time. The
+// padding at the end of the last page is left as it is in the file.
+// @param stream the stream to write.
+// @param pages the pages allocated to the stream.
+// @param file the file to write to.
+// @returns true on success, false otherwise.
+template <MsfFileType T>
+bool WriteStreamPages(MsfStreamImpl<T>* stream,
+                      const uint32_t* pages,
+                      base::File* file) {
+  DCHECK(stream != NULL);
+  DCHECK(pages != NULL);
+  DCHECK(file != NULL);
+
+  uint8_t buffer[kMsfPageSize];
+  size_t length = stream->length();
+  size_t num_pages = (length + kMsfPageSize - 1) / kMsfPageSize;
+  size_t pos = 0;
+  while (pos < length) {
+    size_t page_index = pos / kMsfPageSize;
+    size_t chunk_size =
+        std::min(length, (page_index + 1) * kMsfPageSize) - pos;
+
+    size_t view_size = 0;
+    const uint8_t* data = stream->GetDataAt(pos, &view_size);
+    if (data != NULL) {
+      // Extend the chunk over the adjacent pages that the view covers.
+      size_t last_page = page_index;
+      while (chunk_size < view_size && last_page + 1 < num_pages &&
+             pages[last_page + 1] == pages[last_page] + 1) {
+        ++last_page;
+        chunk_size = std::min(length, (last_page + 1) * kMsfPageSize) - pos;
+      }
+      chunk_size = std::min(chunk_size, view_size);
+    } else {
+      if (!stream->ReadBytesAt(pos, chunk_size, buffer)) {
+        LOG(ERROR) << "Failed to read " << chunk_size << " bytes at offset "
+                   << pos << " of MSF stream.";
+        return false;
+      }
+      data = buffer;
+    }
+
+    int64_t offset = static_cast<int64_t>(pages[page_index]) * kMsfPageSize +
+                     pos % kMsfPageSize;
+    int size = static_cast<int>(chunk_size);
+    if (file->Write(offset, reinterpret_cast<const char*>(data), size) !=
+        size) {
+      LOG(ERROR) << "Failed to write page " << pages[page_index] << ".";
+      return false;
+    }
+    pos += chunk_size;
+  }
+
+  return true;
+}
+
+// Writes the streams of an MSF file to their pages, as the work items of a
+// WorkPool. Each stream only spans its own pages, so they can be written
+// concurrently.
+template <MsfFileType T>
+class StreamWriter {
+ public:
+  // @param msf_file the MSF file whose streams are written.
+  // @param directory the MSF directory, which holds the pages of the streams.
+  // @param first_pages the index in @p directory of the first page of each
+  //     stream, or kInPlaceStream for the streams that aren't written.
+  // @param file the file to write to.
+  StreamWriter(const MsfFileImpl<T>* msf_file,
+               const std::vector<uint32_t>* directory,
+               const std::vector<size_t>* first_pages,
+               base::File* file)
+      : msf_file_(msf_file), directory_(directory), first_pages_(first_pages),
+        file_(file) {
+    DCHECK(msf_file != NULL);
+    DCHECK(directory != NULL);
+    DCHECK(first_pages != NULL);
+    DCHECK(file != NULL);
+  }
+
+  // Writes a stream.
+  // @param index the index of the stream.
+  // @returns true on success, false otherwise.
+  bool Write(size_t index) {
+    // Null streams are treated as empty streams.
+    scoped_refptr<MsfStreamImpl<T>> stream =
+        msf_file_->GetStream(static_cast<uint32_t>(index));
+    if (stream.get() == NULL || stream->length() == 0 ||
+        first_pages_->at(index) == kInPlaceStream) {
+      return true;
+    }
+
+    const uint32_t* pages = &directory_->at(first_pages_->at(index));
+    if (!WriteStreamPages(stream.get(), pages, file_)) {
+      LOG(ERROR) << "Failed to write stream " << index << ".";
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  const MsfFileImpl<T>* msf_file_;
+  const std::vector<uint32_t>* directory_;
+  const std::vector<size_t>* first_pages_;
+  base::File* file_;
+
+  DISALLOW_COPY_AND_ASSIGN(StreamWriter);
+};
+
 bool WriteFreePageBitMap(const FreePageBitMap& free, FILE* file) {
   DCHECK(file != NULL);
 
@@ -208,7 +357,8 @@ bool WriteFreePageBitMap(const FreePageBitMap& free, FILE* file) {
 }  // namespace
 
 template <MsfFileType T>
-MsfWriterImpl<T>::MsfWriterImpl() {
+MsfWriterImpl<T>::MsfWriterImpl()
+    : thread_count_(base::SysInfo::NumberOfProcessors()) {
 }
 
 template <MsfFileType T>
@@ -218,12 +368,6 @@ MsfWriterImpl<T>::~MsfWriterImpl() {
 template <MsfFileType T>
 bool MsfWriterImpl<T>::Write(const base::FilePath& msf_path,
                              const MsfFileImpl<T>& msf_file) {
-  file_.reset(base::OpenFile(msf_path, "wb"));
-  if (!file_.get()) {
-    LOG(ERROR) << "Failed to create '" << msf_path.value() << "'.";
-    return false;
-  }
-
   // Initialize the directory with stream count and lengths.
   std::vector<uint32_t> directory;
   directory.push_back(static_cast<uint32_t>(msf_file.StreamCount()));
@@ -240,41 +384,227 @@ bool MsfWriterImpl<T>::Write(const base::FilePath& msf_path,
   // fourth empty page. The fourth empty page doesn't appear to be strictly
   // necessary but MSF files produced by MS tools always contain it.
   uint32_t page_count = 4;
-  for (uint32_t i = 0; i < page_count; ++i) {
-    if (::fwrite(kZeroBuffer, 1, kMsfPageSize, file_.get()) != kMsfPageSize) {
-      LOG(ERROR) << "Failed to allocate preamble page.";
+
+  // Allocate the pages of all the streams after the preamble and build the
+  // directory while we're at it. We keep track of which pages host stream 0
+  // for some free page map bookkeeping later on.
+  size_t stream0_start = directory.size();
+  size_t stream0_end = 0;
+  std::vector<size_t> first_pages(msf_file.StreamCount());
+  for (uint32_t i = 0; i < msf_file.StreamCount(); ++i) {
+    if (i == 1)
+      stream0_end = directory.size();
+    first_pages[i] = directory.size();
+
+    // The lengths of null streams have been set to zero.
+    AllocateStreamPages(directory[1 + i], &directory, &page_count);
+  }
+  DCHECK_LE(stream0_start, stream0_end);
+
+  // Write the streams to their pages. The file is created at the size of the
+  // streams, so the pages that aren't written are zeros.
+  {
+    base::File file(msf_path,
+                    base::File::FLAG_CREATE_ALWAYS | base::File::FLAG_WRITE);
+    if (!file.IsValid()) {
+      LOG(ERROR) << "Failed to create '" << msf_path.value() << "'.";
+      return false;
+    }
+    if (!file.SetLength(static_cast<int64_t>(page_count) * kMsfPageSize)) {
+      LOG(ERROR) << "Failed to allocate the pages of the streams.";
       return false;
     }
+    if (!WriteStreams(msf_file, directory, first_pages, &file))
+      return false;
   }
 
-  // Append all the streams after the preamble and build the directory while
-  // we're at it. We keep track of which pages host stream 0 for some free page
-  // map bookkeeping later on.
+  std::vector<uint32_t> directory_pages;
+  if (!AppendDirectory(msf_path, directory, &directory_pages, &page_count))
+    return false;
+
+  // Initialize the free page bit map. The pages corresponding to stream 0 are
+  // always marked as free, as well as page 3 which we allocated in the
+  // preamble.
+  FreePageBitMap free_page;
+  free_page.SetPageCount(page_count);
+  free_page.SetFree(3);
+  for (size_t i = stream0_start; i < stream0_end; ++i)
+    free_page.SetFree(directory[i]);
+  free_page.Finalize();
+
+  if (!WriteFreePageBitMap(free_page, file_.get())) {
+    LOG(ERROR) << "Failed to write free page bitmap.";
+    return false;
+  }
+
+  // On success we want the file to be closed right away.
+  file_.reset();
+
+  return true;
+}
+
+template <MsfFileType T>
+bool MsfWriterImpl<T>::Update(const base::FilePath& msf_path,
+                              const MsfFileImpl<T>& original_msf_file,
+                              const MsfFileImpl<T>& msf_file) {
+  MsfHeader header = {0};
+  std::vector<uint32_t> original_directory;
+  MsfReaderImpl<T> reader;
+  if (!reader.ReadDirectory(msf_path, &header, &original_directory))
+    return false;
+  if (header.page_size != kMsfPageSize) {
+    LOG(ERROR) << "Unsupported MSF page size: " << header.page_size << ".";
+    return false;
+  }
+
+  // Find the pages of the original streams in the original directory.
+  uint32_t original_count = original_directory[0];
+  if (original_count != original_msf_file.StreamCount() ||
+      original_directory.size() < 1 + original_count) {
+    LOG(ERROR) << "The streams don't match the directory of '"
+               << msf_path.value() << "'.";
+    return false;
+  }
+  std::vector<size_t> original_first_pages(original_count);
+  size_t page_index = 1 + original_count;
+  for (uint32_t i = 0; i < original_count; ++i) {
+    MsfStreamImpl<T>* stream = original_msf_file.GetStream(i).get();
+    size_t length = stream == NULL ? 0 : stream->length();
+    size_t num_pages = (length + kMsfPageSize - 1) / kMsfPageSize;
+    if (page_index + num_pages > original_directory.size()) {
+      LOG(ERROR) << "The streams don't match the directory of '"
+                 << msf_path.value() << "'.";
+      return false;
+    }
+    original_first_pages[i] = page_index;
+    page_index += num_pages;
+  }
+
+  // Initialize the directory with stream count and lengths.
+  std::vector<uint32_t> directory;
+  directory.push_back(static_cast<uint32_t>(msf_file.StreamCount()));
+  for (uint32_t i = 0; i < msf_file.StreamCount(); ++i) {
+    MsfStreamImpl<T>* stream = msf_file.GetStream(i).get();
+    if (stream == NULL)
+      directory.push_back(0);
+    else
+      directory.push_back(static_cast<uint32_t>(stream->length()));
+  }
+
+  // The streams that are shared with the original file keep their pages, and
+  // the others are appended to the file.
+  uint32_t page_count = header.num_pages;
   size_t stream0_start = directory.size();
   size_t stream0_end = 0;
+  std::vector<size_t> first_pages(msf_file.StreamCount());
   for (uint32_t i = 0; i < msf_file.StreamCount(); ++i) {
     if (i == 1)
       stream0_end = directory.size();
 
-    // Null streams are treated as empty streams.
     MsfStreamImpl<T>* stream = msf_file.GetStream(i).get();
-    if (stream == NULL || stream->length() == 0)
+    if (stream != NULL && i < original_count &&
+        stream == original_msf_file.GetStream(i).get()) {
+      first_pages[i] = kInPlaceStream;
+      const uint32_t* pages = &original_directory[original_first_pages[i]];
+      directory.insert(directory.end(), pages,
+                       pages + (stream->length() + kMsfPageSize - 1) /
+                           kMsfPageSize);
       continue;
+    }
+
+    first_pages[i] = directory.size();
+    AllocateStreamPages(directory[1 + i], &directory, &page_count);
+  }
+  DCHECK_LE(stream0_start, stream0_end);
 
-    // Write the stream, updating the directory and page index. This routine
-    // takes care of making room for the free page map pages.
-    if (!AppendStream(stream, &directory, &page_count)) {
-      LOG(ERROR) << "Failed to write stream " << i << ".";
+  // Write the modified streams past the end of the file. The file isn't
+  // resized beforehand, as its original streams may still be mapped.
+  {
+    base::File file(msf_path, base::File::FLAG_OPEN | base::File::FLAG_WRITE);
+    if (!file.IsValid()) {
+      LOG(ERROR) << "Failed to open '" << msf_path.value() << "'.";
       return false;
     }
+    if (!WriteStreams(msf_file, directory, first_pages, &file))
+      return false;
   }
-  DCHECK_LE(stream0_start, stream0_end);
 
-  // Write the directory, and keep track of the pages it is written to.
   std::vector<uint32_t> directory_pages;
+  if (!AppendDirectory(msf_path, directory, &directory_pages, &page_count))
+    return false;
+
+  // Only the header, the free page map, the streams other than stream 0 and
+  // the new directory are in use. The pages of the replaced streams and of
+  // the original directory are free.
+  FreePageBitMap free_page;
+  free_page.SetPageCount(page_count);
+  for (uint32_t page = 0; page < page_count; ++page)
+    free_page.SetFree(page);
+  free_page.SetUsed(0);
+  for (uint32_t page = 1; page < page_count; page += kMsfPageSize) {
+    free_page.SetUsed(page);
+    if (page + 1 < page_count)
+      free_page.SetUsed(page + 1);
+  }
+  for (size_t i = 1 + msf_file.StreamCount(); i < directory.size(); ++i) {
+    if (i < stream0_start || i >= stream0_end)
+      free_page.SetUsed(directory[i]);
+  }
+  for (size_t i = 0; i < directory_pages.size(); ++i)
+    free_page.SetUsed(directory_pages[i]);
+  free_page.Finalize();
+
+  if (!WriteFreePageBitMap(free_page, file_.get())) {
+    LOG(ERROR) << "Failed to write free page bitmap.";
+    return false;
+  }
+
+  // On success we want the file to be closed right away.
+  file_.reset();
+
+  return true;
+}
+
+template <MsfFileType T>
+bool MsfWriterImpl<T>::WriteStreams(const MsfFileImpl<T>& msf_file,
+                                    const std::vector<uint32_t>& directory,
+                                    const std::vector<size_t>& first_pages,
+                                    base::File* file) {
+  DCHECK(file != NULL);
+
+  StreamWriter<T> stream_writer(&msf_file, &directory, &first_pages, file);
+  application::WorkPool pool(thread_count_);
+  return pool.Run(first_pages.size(),
+                  base::Bind(&StreamWriter<T>::Write,
+                             base::Unretained(&stream_writer)));
+}
+
+template <MsfFileType T>
+bool MsfWriterImpl<T>::AppendDirectory(
+    const base::FilePath& msf_path,
+    const std::vector<uint32_t>& directory,
+    std::vector<uint32_t>* directory_pages,
+    uint32_t* page_count) {
+  DCHECK(directory_pages != NULL);
+  DCHECK(page_count != NULL);
+
+  // The directory is appended after the streams.
+  file_.reset(base::OpenFile(msf_path, "r+b"));
+  if (!file_.get()) {
+    LOG(ERROR) << "Failed to open '" << msf_path.value() << "'.";
+    return false;
+  }
+  if (::fseek(file_.get(), static_cast<long>(*page_count * kMsfPageSize),
+              SEEK_SET) != 0) {
+    LOG(ERROR) << "Failed to seek past the streams.";
+    return false;
+  }
+
+  // Write the directory, and keep track of the pages it is written to.
+  std::vector<uint32_t> dir_pages;
   scoped_refptr<MsfStreamImpl<T>> directory_stream(new ReadOnlyMsfStream<T>(
       directory.data(), sizeof(directory[0]) * directory.size()));
-  if (!AppendStream(directory_stream.get(), &directory_pages, &page_count)) {
+  if (!AppendStream(directory_stream.get(), &dir_pages, page_count)) {
     LOG(ERROR) << "Failed to write directory.";
     return false;
   }
@@ -284,10 +614,9 @@ bool MsfWriterImpl<T>::Write(const base::FilePath& msf_path,
   std::vector<uint32_t> root_directory_pages;
   scoped_refptr<MsfStreamImpl<T>> root_directory_stream(
       new ReadOnlyMsfStream<T>(
-          directory_pages.data(),
-          sizeof(directory_pages[0]) * directory_pages.size()));
+          dir_pages.data(), sizeof(dir_pages[0]) * dir_pages.size()));
   if (!AppendStream(root_directory_stream.get(), &root_directory_pages,
-                    &page_count)) {
+                    page_count)) {
     LOG(ERROR) << "Failed to write root directory.";
     return false;
   }
@@ -296,29 +625,15 @@ bool MsfWriterImpl<T>::Write(const base::FilePath& msf_path,
   if (!WriteHeader(root_directory_pages,
                    static_cast<uint32_t>(
                        sizeof(directory[0]) * directory.size()),
-                   page_count)) {
+                   *page_count)) {
     LOG(ERROR) << "Failed to write MSF header.";
     return false;
   }
 
-  // Initialize the free page bit map. The pages corresponding to stream 0 are
-  // always marked as free, as well as page 3 which we allocated in the
-  // preamble.
-  FreePageBitMap free_page;
-  free_page.SetPageCount(page_count);
-  free_page.SetFree(3);
-  for (size_t i = stream0_start; i < stream0_end; ++i)
-    free_page.SetFree(directory[i]);
-  free_page.Finalize();
-
-  if (!WriteFreePageBitMap(free_page, file_.get())) {
-    LOG(ERROR) << "Failed to write free page bitmap.";
-    return false;
-  }
-
-  // On success we want the file to be closed right away.
-  file_.reset();
-
+  directory_pages->swap(dir_pages);
+  directory_pages->insert(directory_pages->end(),
+                          root_directory_pages.begin(),
+                          root_directory_pages.end());
   return true;
 }
 
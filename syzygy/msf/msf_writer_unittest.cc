@@ -15,8 +15,10 @@
 #include "syzygy/msf/msf_writer.h"
 
 #include <algorithm>
+#include <string>
 #include <vector>
 
+#include "base/files/file_util.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
@@ -216,4 +218,109 @@ TEST(MsfWriterTest, WriteMsfFile) {
       testing::EnsureMsfContentsAreIdentical(msf_file, msf_file_read));
 }
 
+TEST(MsfWriterTest, WriteMsfFileConcurrently) {
+  // The streams span the second set of free page map pages.
+  MsfFile msf_file;
+  for (uint32_t i = 0; i < 3; ++i) {
+    msf_file.AppendStream(
+        new TestMsfStream(2 * kMsfPageSize * kMsfPageSize / 5 + i, i << 24));
+  }
+
+  testing::ScopedTempFile file;
+  testing::ScopedTempFile serial_file;
+  {
+    TestMsfWriter writer;
+    writer.set_thread_count(4);
+    EXPECT_TRUE(writer.Write(file.path(), msf_file));
+    writer.set_thread_count(1);
+    EXPECT_TRUE(writer.Write(serial_file.path(), msf_file));
+  }
+
+  // The files are the same whatever the number of threads.
+  std::string contents;
+  std::string serial_contents;
+  ASSERT_TRUE(base::ReadFileToString(file.path(), &contents));
+  ASSERT_TRUE(base::ReadFileToString(serial_file.path(), &serial_contents));
+  EXPECT_TRUE(contents == serial_contents);
+
+  MsfFile msf_file_read;
+  MsfReader reader;
+  EXPECT_TRUE(reader.Read(file.path(), &msf_file_read));
+  ASSERT_NO_FATAL_FAILURE(
+      testing::EnsureMsfContentsAreIdentical(msf_file, msf_file_read));
+}
+
+TEST(MsfWriterTest, RewriteMsfFile) {
+  // The streams read from an MSF file are written from their mapping.
+  MsfFile msf_file;
+  MsfReader reader;
+  ASSERT_TRUE(reader.Read(
+      testing::GetSrcRelativePath(testing::kTestPdbFilePath), &msf_file));
+
+  testing::ScopedTempFile file;
+  {
+    TestMsfWriter writer;
+    EXPECT_TRUE(writer.Write(file.path(), msf_file));
+  }
+
+  MsfFile msf_file_read;
+  EXPECT_TRUE(reader.Read(file.path(), &msf_file_read));
+  ASSERT_NO_FATAL_FAILURE(
+      testing::EnsureMsfContentsAreIdentical(msf_file, msf_file_read));
+}
+
+TEST(MsfWriterTest, UpdateMsfFile) {
+  MsfFile msf_file;
+  for (uint32_t i = 0; i < 4; ++i)
+    msf_file.AppendStream(new TestMsfStream(3 * kMsfPageSize + i, i << 24));
+
+  testing::ScopedTempFile file;
+  {
+    TestMsfWriter writer;
+    EXPECT_TRUE(writer.Write(file.path(), msf_file));
+  }
+
+  MsfReader reader;
+  MsfHeader header = {};
+  std::vector<uint32_t> directory;
+  ASSERT_TRUE(reader.ReadDirectory(file.path(), &header, &directory));
+
+  // Replace a stream and append another one to the streams that were read.
+  MsfFile original_msf_file;
+  ASSERT_TRUE(reader.Read(file.path(), &original_msf_file));
+  MsfFile updated_msf_file;
+  for (uint32_t i = 0; i < original_msf_file.StreamCount(); ++i)
+    updated_msf_file.AppendStream(original_msf_file.GetStream(i).get());
+  updated_msf_file.ReplaceStream(2, new TestMsfStream(kMsfPageSize, 5 << 24));
+  updated_msf_file.AppendStream(new TestMsfStream(100, 6 << 24));
+
+  {
+    TestMsfWriter writer;
+    EXPECT_TRUE(
+        writer.Update(file.path(), original_msf_file, updated_msf_file));
+  }
+
+  MsfFile msf_file_read;
+  EXPECT_TRUE(reader.Read(file.path(), &msf_file_read));
+  ASSERT_NO_FATAL_FAILURE(
+      testing::EnsureMsfContentsAreIdentical(updated_msf_file, msf_file_read));
+
+  // The streams that were kept still have their original pages, and the new
+  // streams are past the original end of the file.
+  MsfHeader updated_header = {};
+  std::vector<uint32_t> updated_directory;
+  ASSERT_TRUE(reader.ReadDirectory(
+      file.path(), &updated_header, &updated_directory));
+  ASSERT_EQ(5u, updated_directory[0]);
+  EXPECT_LT(header.num_pages, updated_header.num_pages);
+
+  // Each of the original streams spans 4 pages.
+  const uint32_t* pages = &directory[1 + 4];
+  const uint32_t* updated_pages = &updated_directory[1 + 5];
+  EXPECT_TRUE(std::equal(pages, pages + 8, updated_pages));
+  EXPECT_LE(header.num_pages, updated_pages[8]);
+  EXPECT_TRUE(std::equal(pages + 12, pages + 16, updated_pages + 9));
+  EXPECT_LE(header.num_pages, updated_pages[13]);
+}
+
 }  // namespace msf
@@ -18,11 +18,13 @@
 #include "syzygy/block_graph/transforms/fuzzing_transform.h"
 #include "syzygy/block_graph/transforms/named_transform.h"
 #include "syzygy/common/indexed_frequency_data.h"
+#include "syzygy/core/perf_report.h"
 #include "syzygy/grinder/basic_block_util.h"
 #include "syzygy/optimize/application_profile.h"
 #include "syzygy/optimize/transforms/basic_block_reordering_transform.h"
 #include "syzygy/optimize/transforms/block_alignment_transform.h"
 #include "syzygy/optimize/transforms/chained_subgraph_transforms.h"
+#include "syzygy/optimize/transforms/hot_cold_splitting_transform.h"
 #include "syzygy/optimize/transforms/inlining_transform.h"
 #include "syzygy/optimize/transforms/peephole_transform.h"
 #include "syzygy/optimize/transforms/unreachable_block_transform.h"
@@ -40,6 +42,7 @@ using grinder::basic_block_util::LoadBranchStatisticsFromFile;
 using optimize::transforms::BasicBlockReorderingTransform;
 using optimize::transforms::BlockAlignmentTransform;
 using optimize::transforms::ChainedSubgraphTransforms;
+using optimize::transforms::HotColdSplittingTransform;
 using optimize::transforms::InliningTransform;
 using optimize::transforms::PeepholeTransform;
 using optimize::transforms::UnreachableBlockTransform;
@@ -57,6 +60,8 @@ const char kUsageFormatStr[] =
     "    --output-pdb=<path>   Output path for the rewritten PDB file.\n"
     "                          Default is inferred from output-image.\n"
     "    --overwrite           Allow output files to be overwritten.\n"
+    "    --perf-report=<path>  Write the durations and the memory usage of\n"
+    "                          the phases of the relinker to a JSON file.\n"
     "\n"
     "  Optimization Options:\n"
     "    --all                 Enable all optimizations.\n"
@@ -65,6 +70,8 @@ const char kUsageFormatStr[] =
     "                          blocks.\n"
     "    --basic-block-reorder Enable basic block reodering.\n"
     "    --block-alignment     Enable block realignment.\n"
+    "    --hot-cold-splitting  Enable the splitting of the never executed\n"
+    "                          basic blocks to a .cold section.\n"
     "    --inlining            Enable function inlining.\n"
     "    --peephole            Enable peephole optimization.\n"
     "    --unreachable-block   Enable unreachable block optimization.\n"
@@ -88,9 +95,12 @@ bool OptimizeApp::ParseCommandLine(const base::CommandLine* cmd_line) {
   input_pdb_path_ = AbsolutePath(cmd_line->GetSwitchValuePath("input-pdb"));
   output_pdb_path_ = cmd_line->GetSwitchValuePath("output-pdb");
   branch_file_path_ = AbsolutePath(cmd_line->GetSwitchValuePath("branch-file"));
+  perf_report_path_ =
+      AbsolutePath(cmd_line->GetSwitchValuePath("perf-report"));
 
   basic_block_reorder_ = cmd_line->HasSwitch("basic-block-reorder");
   block_alignment_ = cmd_line->HasSwitch("block-alignment");
+  hot_cold_splitting_ = cmd_line->HasSwitch("hot-cold-splitting");
   fuzz_ = cmd_line->HasSwitch("fuzz");
   inlining_ = cmd_line->HasSwitch("inlining");
   allow_inline_assembly_ = cmd_line->HasSwitch("allow-inline-assembly");
@@ -137,6 +147,11 @@ int OptimizeApp::Run() {
   relinker.set_output_pdb_path(output_pdb_path_);
   relinker.set_allow_overwrite(overwrite_);
 
+  // The phases are only measured if a report is requested.
+  core::PerfReport perf_report;
+  if (!perf_report_path_.empty())
+    relinker.set_perf_report(&perf_report);
+
   // Initialize the relinker. This does the decomposition, etc.
   if (!relinker.Init()) {
     LOG(ERROR) << "Failed to initialize relinker.";
@@ -151,6 +166,8 @@ int OptimizeApp::Run() {
   // Load profile information from file.
   ApplicationProfile profile(&image_layout);
   if (!branch_file_path_.empty()) {
+    core::PerfReport::ScopedPhase phase(relinker.perf_report(),
+                                        "load profile");
     IndexedFrequencyMap frequencies;
     if (!LoadBranchStatisticsFromFile(branch_file_path_,
                                       signature,
@@ -179,8 +196,10 @@ int OptimizeApp::Run() {
       basic_block_reordering_transform;
   std::unique_ptr<BlockAlignmentTransform> block_alignment_transform;
   std::unique_ptr<FuzzingTransform> fuzzing_transform;
+  std::unique_ptr<HotColdSplittingTransform> hot_cold_splitting_transform;
   std::unique_ptr<InliningTransform> inlining_transform;
   std::unique_ptr<PeepholeTransform> peephole_transform;
+  std::unique_ptr<PeepholeTransform> post_inlining_peephole_transform;
   std::unique_ptr<UnreachableBlockTransform> unreachable_block_transform;
 
   // If block block reordering is enabled, add it to the chain.
@@ -193,6 +212,12 @@ int OptimizeApp::Run() {
   if (inlining_) {
     inlining_transform.reset(new InliningTransform());
     chains.AppendTransform(inlining_transform.get());
+
+    // Run the peephole optimizations again on the inlined bodies.
+    if (peephole_) {
+      post_inlining_peephole_transform.reset(new PeepholeTransform());
+      chains.AppendTransform(post_inlining_peephole_transform.get());
+    }
   }
 
   // If block block reordering is enabled, add it to the chain.
@@ -207,6 +232,13 @@ int OptimizeApp::Run() {
     chains.AppendTransform(block_alignment_transform.get());
   }
 
+  // If hot/cold splitting is enabled, add it to the chain. This comes after
+  // the reordering so that the hot basic blocks are already laid out.
+  if (hot_cold_splitting_) {
+    hot_cold_splitting_transform.reset(new HotColdSplittingTransform());
+    chains.AppendTransform(hot_cold_splitting_transform.get());
+  }
+
   // Append the chain to the relinker.
   if (!relinker.AppendTransform(&chains))
     return false;
@@ -231,6 +263,9 @@ int OptimizeApp::Run() {
     return 1;
   }
 
+  if (!perf_report_path_.empty() && !perf_report.Save(perf_report_path_))
+    return 1;
+
   return 0;
 }
 
@@ -34,6 +34,7 @@ class OptimizeApp : public application::AppImplBase {
         basic_block_reorder_(false),
         block_alignment_(false),
         fuzz_(false),
+        hot_cold_splitting_(false),
         inlining_(false),
         allow_inline_assembly_(false),
         overwrite_(false),
@@ -63,9 +64,11 @@ class OptimizeApp : public application::AppImplBase {
   base::FilePath output_pdb_path_;
   base::FilePath branch_file_path_;
   base::FilePath unreachable_graph_path_;
+  base::FilePath perf_report_path_;
   bool block_alignment_;
   bool basic_block_reorder_;
   bool fuzz_;
+  bool hot_cold_splitting_;
   bool inlining_;
   bool allow_inline_assembly_;
   bool peephole_;
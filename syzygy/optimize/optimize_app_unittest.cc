@@ -37,8 +37,10 @@ class TestOptimizeApp : public OptimizeApp {
   using OptimizeApp::output_pdb_path_;
   using OptimizeApp::branch_file_path_;
   using OptimizeApp::unreachable_graph_path_;
+  using OptimizeApp::perf_report_path_;
   using OptimizeApp::basic_block_reorder_;
   using OptimizeApp::block_alignment_;
+  using OptimizeApp::hot_cold_splitting_;
   using OptimizeApp::fuzz_;
   using OptimizeApp::inlining_;
   using OptimizeApp::allow_inline_assembly_;
@@ -160,6 +162,7 @@ TEST_F(OptimizeAppTest, ParseMinimalCommandLineWithBranchFile) {
   EXPECT_FALSE(test_impl_.allow_inline_assembly_);
   EXPECT_FALSE(test_impl_.block_alignment_);
   EXPECT_FALSE(test_impl_.basic_block_reorder_);
+  EXPECT_FALSE(test_impl_.hot_cold_splitting_);
   EXPECT_FALSE(test_impl_.peephole_);
   EXPECT_FALSE(test_impl_.fuzz_);
 
@@ -172,6 +175,7 @@ TEST_F(OptimizeAppTest, ParseFullCommandLineWithBranchFile) {
   cmd_line_.AppendSwitchPath("output-image", output_image_path_);
   cmd_line_.AppendSwitchPath("output-pdb", output_pdb_path_);
   cmd_line_.AppendSwitchPath("branch-file", branch_file_path_);
+  cmd_line_.AppendSwitchPath("perf-report", temp_dir_.Append(L"perf.json"));
   cmd_line_.AppendSwitch("overwrite");
 
   EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
@@ -180,6 +184,7 @@ TEST_F(OptimizeAppTest, ParseFullCommandLineWithBranchFile) {
   EXPECT_EQ(output_image_path_, test_impl_.output_image_path_);
   EXPECT_EQ(output_pdb_path_, test_impl_.output_pdb_path_);
   EXPECT_EQ(branch_file_path_, test_impl_.branch_file_path_);
+  EXPECT_EQ(temp_dir_.Append(L"perf.json"), test_impl_.perf_report_path_);
   EXPECT_TRUE(test_impl_.overwrite_);
 
   EXPECT_TRUE(test_impl_.SetUp());
@@ -195,6 +200,7 @@ TEST_F(OptimizeAppTest, ParseFullCommandLineWithInputAndOutputPdb) {
   cmd_line_.AppendSwitch("allow-inline-assembly");
   cmd_line_.AppendSwitch("block-alignment");
   cmd_line_.AppendSwitch("basic-block-reorder");
+  cmd_line_.AppendSwitch("hot-cold-splitting");
   cmd_line_.AppendSwitch("peephole");
   cmd_line_.AppendSwitch("fuzz");
 
@@ -208,6 +214,7 @@ TEST_F(OptimizeAppTest, ParseFullCommandLineWithInputAndOutputPdb) {
   EXPECT_TRUE(test_impl_.allow_inline_assembly_);
   EXPECT_TRUE(test_impl_.block_alignment_);
   EXPECT_TRUE(test_impl_.basic_block_reorder_);
+  EXPECT_TRUE(test_impl_.hot_cold_splitting_);
   EXPECT_TRUE(test_impl_.peephole_);
   EXPECT_TRUE(test_impl_.fuzz_);
 
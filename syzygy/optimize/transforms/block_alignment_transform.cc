@@ -14,16 +14,108 @@
 
 #include "syzygy/optimize/transforms/block_alignment_transform.h"
 
+#include <map>
+#include <set>
+
 #include "syzygy/block_graph/block_graph.h"
+#include "syzygy/block_graph/analysis/control_flow_analysis.h"
 
 namespace optimize {
 namespace transforms {
 
 namespace {
-using block_graph::BasicBlock;
+
 using block_graph::BasicCodeBlock;
+using block_graph::analysis::ControlFlowAnalysis;
+
+typedef std::set<const BasicCodeBlock*> BasicCodeBlockSet;
+typedef BasicCodeBlock::Successors Successors;
+
+// Find the loop headers of a subgraph, which are the targets of the back edges
+// of a depth first traversal.
+// @param subgraph the subgraph to analyze.
+// @param headers receives the loop headers.
+void FindLoopHeaders(const block_graph::BasicBlockSubGraph* subgraph,
+                     BasicCodeBlockSet* headers) {
+  DCHECK_NE(reinterpret_cast<BasicCodeBlockSet*>(NULL), headers);
+
+  ControlFlowAnalysis::BasicBlockOrdering order;
+  ControlFlowAnalysis::FlattenBasicBlocksInPostOrder(subgraph->basic_blocks(),
+                                                     &order);
+
+  // A successor that is pushed in post-order after its source is one of its
+  // ancestors in the traversal, so the edge closes a loop.
+  std::map<const BasicCodeBlock*, size_t> post_order;
+  for (size_t i = 0; i < order.size(); ++i)
+    post_order[order[i]] = i;
+
+  for (size_t i = 0; i < order.size(); ++i) {
+    const Successors& successors = order[i]->successors();
+    Successors::const_iterator succ = successors.begin();
+    for (; succ != successors.end(); ++succ) {
+      const BasicCodeBlock* target =
+          BasicCodeBlock::Cast(succ->reference().basic_block());
+      if (target == NULL)
+        continue;
+      std::map<const BasicCodeBlock*, size_t>::const_iterator target_order =
+          post_order.find(target);
+      if (target_order != post_order.end() && target_order->second >= i)
+        headers->insert(target);
+    }
+  }
+}
+
 }  // namespace
 
+void BlockAlignmentTransform::AlignHotLoopHeaders(
+    BasicBlockSubGraph* subgraph,
+    const SubGraphProfile* subgraph_profile) {
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+  DCHECK_NE(reinterpret_cast<const SubGraphProfile*>(NULL), subgraph_profile);
+
+  BasicCodeBlockSet headers;
+  FindLoopHeaders(subgraph, &headers);
+  if (headers.empty())
+    return;
+
+  BasicBlockSubGraph::BlockDescriptionList::iterator description =
+      subgraph->block_descriptions().begin();
+  for (; description != subgraph->block_descriptions().end(); ++description) {
+    // The first basic block gets the alignment of the block, and the padding
+    // of the others is executed by the basic block laid out before them.
+    BasicBlockSubGraph::BasicBlockOrdering& order =
+        description->basic_block_order;
+    BasicBlockSubGraph::BasicBlockOrdering::iterator bb_iter = order.begin();
+    BasicBlock* previous = NULL;
+    for (; bb_iter != order.end(); previous = *bb_iter, ++bb_iter) {
+      BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_iter);
+      if (bb == NULL || previous == NULL || headers.count(bb) == 0)
+        continue;
+
+      SubGraphProfile::EntryCountType header_count =
+          subgraph_profile->GetBasicBlockProfile(bb)->count();
+      if (header_count == 0)
+        continue;
+
+      // A data basic block is never executed, so its padding is free.
+      SubGraphProfile::EntryCountType padding_count = 0;
+      const BasicCodeBlock* previous_bb = BasicCodeBlock::Cast(previous);
+      if (previous_bb != NULL) {
+        padding_count =
+            subgraph_profile->GetBasicBlockProfile(previous_bb)->count();
+      }
+      if (padding_count * kMinLoopHeaderRatio > header_count)
+        continue;
+
+      size_t alignment = kLoopHeaderAlignment;
+      if (bb->GetInstructionSize() <= kSmallLoopHeaderAlignment)
+        alignment = kSmallLoopHeaderAlignment;
+      if (bb->alignment() < alignment)
+        bb->set_alignment(alignment);
+    }
+  }
+}
+
 bool BlockAlignmentTransform::TransformBasicBlockSubGraph(
       const TransformPolicyInterface* policy,
       BlockGraph* block_graph,
@@ -36,15 +128,8 @@ bool BlockAlignmentTransform::TransformBasicBlockSubGraph(
   DCHECK_NE(reinterpret_cast<ApplicationProfile*>(NULL), profile);
   DCHECK_NE(reinterpret_cast<SubGraphProfile*>(NULL), subgraph_profile);
 
-  // Iterates through each basic block.
-  BasicBlockSubGraph::BBCollection::iterator bb_iter =
-      subgraph->basic_blocks().begin();
-  for (; bb_iter != subgraph->basic_blocks().end(); ++bb_iter) {
-    BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_iter);
-    if (bb == NULL)
-      continue;
-    // TODO(etienneb): Basic block alignment based on frequencies (PGO).
-  }
+  // Apply loop header alignment.
+  AlignHotLoopHeaders(subgraph, subgraph_profile);
 
   // Apply function alignment.
   if (!subgraph->block_descriptions().empty()) {
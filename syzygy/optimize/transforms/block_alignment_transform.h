@@ -12,7 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 //
-// This class implements the functions alignment transformation.
+// This class implements the functions alignment transformation. The headers of
+// the hot loops are aligned too, when the padding lands on a cold path.
 
 #ifndef SYZYGY_OPTIMIZE_TRANSFORMS_BLOCK_ALIGNMENT_TRANSFORM_H_
 #define SYZYGY_OPTIMIZE_TRANSFORMS_BLOCK_ALIGNMENT_TRANSFORM_H_
@@ -27,6 +28,7 @@ namespace transforms {
 
 class BlockAlignmentTransform : public SubGraphTransformInterface {
  public:
+  typedef block_graph::BasicBlock BasicBlock;
   typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
   typedef block_graph::BlockGraph BlockGraph;
   typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
@@ -34,6 +36,16 @@ class BlockAlignmentTransform : public SubGraphTransformInterface {
   // Constructor.
   BlockAlignmentTransform() { }
 
+  // The alignment of the loop headers that fit in a single fetch window, and
+  // of the bigger ones.
+  static const size_t kSmallLoopHeaderAlignment = 16;
+  static const size_t kLoopHeaderAlignment = 32;
+
+  // A loop header is aligned only when it is entered at least this many times
+  // for each time the basic block laid out before it is executed, as the
+  // padding executes along with that basic block when it falls through.
+  static const size_t kMinLoopHeaderRatio = 4;
+
   // @name SubGraphTransformInterface implementation.
   // @{
   virtual bool TransformBasicBlockSubGraph(
@@ -44,6 +56,13 @@ class BlockAlignmentTransform : public SubGraphTransformInterface {
       SubGraphProfile* subgraph_profile) override;
   // @}
 
+ protected:
+  // Aligns the headers of the hot loops of a subgraph.
+  // @param subgraph the subgraph to align.
+  // @param subgraph_profile the profile of @p subgraph.
+  static void AlignHotLoopHeaders(BasicBlockSubGraph* subgraph,
+                                  const SubGraphProfile* subgraph_profile);
+
  private:
   DISALLOW_COPY_AND_ASSIGN(BlockAlignmentTransform);
 };
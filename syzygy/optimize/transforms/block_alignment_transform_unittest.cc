@@ -27,6 +27,7 @@ namespace transforms {
 namespace {
 
 using block_graph::BasicBlockDecomposer;
+using block_graph::BasicCodeBlock;
 using block_graph::BlockBuilder;
 using block_graph::BlockGraph;
 using block_graph::BasicBlockSubGraph;
@@ -38,6 +39,28 @@ using pe::ImageLayout;
 const uint8_t kCodeBody1[] = {0x74, 0x02, 0x33, 0xC0, 0xC3};
 const uint8_t kCodeBody2[] = {0x0B, 0xC0, 0x75, 0xFC, 0xC3};
 
+// _asm xor eax, eax
+// loop:
+// _asm inc eax
+// _asm cmp eax, ecx
+// _asm jnz loop
+// _asm ret
+const uint8_t kCodeLoop[] = {0x33, 0xC0, 0x40, 0x3B, 0xC1, 0x75, 0xFB, 0xC3};
+
+typedef SubGraphProfile::EntryCountType EntryCountType;
+
+class TestSubGraphProfile : public SubGraphProfile {
+ public:
+  using SubGraphProfile::basic_blocks_;
+};
+
+class TestBasicBlockProfile : public SubGraphProfile::BasicBlockProfile {
+ public:
+  explicit TestBasicBlockProfile(EntryCountType count) {
+    count_ = count;
+  }
+};
+
 class BlockAlignmentTransformTest : public testing::Test {
  public:
   BlockAlignmentTransformTest()
@@ -60,6 +83,14 @@ class BlockAlignmentTransformTest : public testing::Test {
 
   void ApplyTransform(BlockGraph::Block** block);
 
+  // Applies the transform to kCodeLoop with the given entry counts.
+  // @param entry_count the entry count of the code before the loop.
+  // @param header_count the entry count of the loop header.
+  // @param alignment receives the alignment of the loop header.
+  void ApplyLoopTransform(EntryCountType entry_count,
+                          EntryCountType header_count,
+                          size_t* alignment);
+
  protected:
   pe::PETransformPolicy policy_;
   BlockGraph block_graph_;
@@ -89,6 +120,48 @@ void BlockAlignmentTransformTest::ApplyTransform(BlockGraph::Block** block) {
   *block = *builder.new_blocks().begin();
 }
 
+void BlockAlignmentTransformTest::ApplyLoopTransform(
+    EntryCountType entry_count,
+    EntryCountType header_count,
+    size_t* alignment) {
+  BlockGraph::Block* block = block_graph_.AddBlock(BlockGraph::CODE_BLOCK,
+                                                   sizeof(kCodeLoop),
+                                                   "loop");
+  ASSERT_NE(reinterpret_cast<BlockGraph::Block*>(NULL), block);
+  block->SetData(kCodeLoop, block->size());
+
+  BasicBlockSubGraph subgraph;
+  BasicBlockDecomposer decomposer(block, &subgraph);
+  ASSERT_TRUE(decomposer.Decompose());
+
+  // The loop header is the basic block that jumps to itself.
+  TestSubGraphProfile subgraph_profile;
+  BasicCodeBlock* header = NULL;
+  BasicBlockSubGraph::BBCollection::iterator it =
+      subgraph.basic_blocks().begin();
+  for (; it != subgraph.basic_blocks().end(); ++it) {
+    BasicCodeBlock* bb = BasicCodeBlock::Cast(*it);
+    ASSERT_NE(reinterpret_cast<BasicCodeBlock*>(NULL), bb);
+    EntryCountType count = entry_count;
+    BasicCodeBlock::Successors::const_iterator succ =
+        bb->successors().begin();
+    for (; succ != bb->successors().end(); ++succ) {
+      if (succ->reference().basic_block() == bb) {
+        header = bb;
+        count = header_count;
+      }
+    }
+    subgraph_profile.basic_blocks_.insert(
+        std::make_pair(bb, TestBasicBlockProfile(count)));
+  }
+  ASSERT_NE(reinterpret_cast<BasicCodeBlock*>(NULL), header);
+
+  ASSERT_TRUE(
+      tx_.TransformBasicBlockSubGraph(&policy_, &block_graph_, &subgraph,
+                                      &profile_, &subgraph_profile));
+  *alignment = header->alignment();
+}
+
 }  // namespace
 
 TEST_F(BlockAlignmentTransformTest, AlignmentTest) {
@@ -103,5 +176,23 @@ TEST_F(BlockAlignmentTransformTest, AlignmentTest) {
   EXPECT_EQ(2U, code2_->alignment());
 }
 
+TEST_F(BlockAlignmentTransformTest, AlignHotLoopHeader) {
+  size_t alignment = 0;
+  ASSERT_NO_FATAL_FAILURE(ApplyLoopTransform(1, 100, &alignment));
+  EXPECT_EQ(16U, alignment);
+}
+
+TEST_F(BlockAlignmentTransformTest, DontAlignLoopHeaderWithHotPadding) {
+  size_t alignment = 0;
+  ASSERT_NO_FATAL_FAILURE(ApplyLoopTransform(50, 100, &alignment));
+  EXPECT_EQ(1U, alignment);
+}
+
+TEST_F(BlockAlignmentTransformTest, DontAlignColdLoopHeader) {
+  size_t alignment = 0;
+  ASSERT_NO_FATAL_FAILURE(ApplyLoopTransform(0, 0, &alignment));
+  EXPECT_EQ(1U, alignment);
+}
+
 }  // namespace transforms
 }  // namespace optimize
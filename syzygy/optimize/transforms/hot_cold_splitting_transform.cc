@@ -0,0 +1,115 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/transforms/hot_cold_splitting_transform.h"
+
+#include "syzygy/block_graph/block_graph.h"
+
+namespace optimize {
+namespace transforms {
+
+namespace {
+
+using block_graph::BasicBlock;
+using block_graph::BasicCodeBlock;
+
+}  // namespace
+
+const char HotColdSplittingTransform::kColdSectionName[] = ".cold";
+
+bool HotColdSplittingTransform::TransformBasicBlockSubGraph(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BasicBlockSubGraph* subgraph,
+    ApplicationProfile* profile,
+    SubGraphProfile* subgraph_profile) {
+  DCHECK_NE(reinterpret_cast<TransformPolicyInterface*>(NULL), policy);
+  DCHECK_NE(reinterpret_cast<BlockGraph*>(NULL), block_graph);
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+  DCHECK_NE(reinterpret_cast<ApplicationProfile*>(NULL), profile);
+  DCHECK_NE(reinterpret_cast<SubGraphProfile*>(NULL), subgraph_profile);
+
+  // Functions that were never executed are cold as a whole, and are left to
+  // the block ordering.
+  const BlockGraph::Block* block = subgraph->original_block();
+  DCHECK_NE(reinterpret_cast<const BlockGraph::Block*>(NULL), block);
+  const ApplicationProfile::BlockProfile* block_profile =
+      profile->GetBlockProfile(block);
+  if (block_profile->count() == 0)
+    return true;
+
+  // The cold section gets the characteristics of the section of the function.
+  const BlockGraph::Section* section =
+      block_graph->GetSectionById(block->section());
+  if (section == NULL)
+    return true;
+
+  // Avoid splitting a block with a jump table or data block.
+  BasicBlockSubGraph::BBCollection::iterator bb_iter =
+      subgraph->basic_blocks().begin();
+  for (; bb_iter != subgraph->basic_blocks().end(); ++bb_iter) {
+    if ((*bb_iter)->type() == BasicBlock::BASIC_DATA_BLOCK)
+      return true;
+  }
+
+  BasicBlockSubGraph::BlockDescriptionList& descriptions =
+      subgraph->block_descriptions();
+  if (descriptions.size() != 1)
+    return true;
+  BasicBlockSubGraph::BlockDescription& description = descriptions.front();
+
+  // Move the basic blocks that were never executed to the cold ordering. The
+  // first basic block is the entry of the function and always stays in place,
+  // as does the end block.
+  BasicBlockSubGraph::BasicBlockOrdering& order =
+      description.basic_block_order;
+  BasicBlockSubGraph::BasicBlockOrdering cold_order;
+  BasicBlockSubGraph::BasicBlockOrdering::iterator order_it = order.begin();
+  if (order_it != order.end())
+    ++order_it;
+  while (order_it != order.end()) {
+    BasicCodeBlock* bb = BasicCodeBlock::Cast(*order_it);
+    if (bb == NULL ||
+        subgraph_profile->GetBasicBlockProfile(bb)->count() != 0) {
+      ++order_it;
+      continue;
+    }
+    cold_order.push_back(bb);
+    order_it = order.erase(order_it);
+  }
+
+  if (cold_order.empty())
+    return true;
+
+  BlockGraph::Section* cold_section = block_graph->FindOrAddSection(
+      kColdSectionName, section->characteristics());
+  DCHECK_NE(reinterpret_cast<BlockGraph::Section*>(NULL), cold_section);
+
+  // The block builder takes care of the control flow between the two blocks.
+  BasicBlockSubGraph::BlockDescription* cold_description =
+      subgraph->AddBlockDescription(description.name + ".cold",
+                                    description.compiland_name,
+                                    description.type,
+                                    cold_section->id(),
+                                    1,
+                                    description.attributes);
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph::BlockDescription*>(NULL),
+            cold_description);
+  cold_description->basic_block_order.swap(cold_order);
+
+  return true;
+}
+
+}  // namespace transforms
+}  // namespace optimize
@@ -0,0 +1,63 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This class implements the hot/cold splitting transformation.
+//
+// The transformation moves the basic blocks of a function that were never
+// executed to a separate block, which lives in a dedicated section laid out
+// after the code sections. This shrinks the hot code of the function, which
+// then occupies fewer cache lines and pages.
+
+#ifndef SYZYGY_OPTIMIZE_TRANSFORMS_HOT_COLD_SPLITTING_TRANSFORM_H_
+#define SYZYGY_OPTIMIZE_TRANSFORMS_HOT_COLD_SPLITTING_TRANSFORM_H_
+
+#include "syzygy/block_graph/transform_policy.h"
+#include "syzygy/optimize/application_profile.h"
+#include "syzygy/optimize/transforms/subgraph_transform.h"
+
+namespace optimize {
+namespace transforms {
+
+// This transformation splits the cold basic blocks of the executed functions
+// into separate blocks.
+class HotColdSplittingTransform : public SubGraphTransformInterface {
+ public:
+  typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
+  typedef block_graph::BlockGraph BlockGraph;
+  typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
+
+  // The name of the section receiving the cold blocks.
+  static const char kColdSectionName[];
+
+  // Constructor.
+  HotColdSplittingTransform() { }
+
+  // @name SubGraphTransformInterface implementation.
+  // @{
+  virtual bool TransformBasicBlockSubGraph(
+      const TransformPolicyInterface* policy,
+      BlockGraph* block_graph,
+      BasicBlockSubGraph* basic_block_subgraph,
+      ApplicationProfile* profile,
+      SubGraphProfile* subgraph_profile) override;
+  // @}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(HotColdSplittingTransform);
+};
+
+}  // namespace transforms
+}  // namespace optimize
+
+#endif  // SYZYGY_OPTIMIZE_TRANSFORMS_HOT_COLD_SPLITTING_TRANSFORM_H_
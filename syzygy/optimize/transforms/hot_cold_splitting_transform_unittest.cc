@@ -0,0 +1,196 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/transforms/hot_cold_splitting_transform.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/basic_block_decomposer.h"
+#include "syzygy/block_graph/block_builder.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/pe/pe_transform_policy.h"
+
+namespace optimize {
+namespace transforms {
+
+namespace {
+
+using block_graph::BasicBlockDecomposer;
+using block_graph::BasicBlockSubGraph;
+using block_graph::BasicCodeBlock;
+using block_graph::BlockBuilder;
+using block_graph::BlockGraph;
+using block_graph::BlockVector;
+using pe::ImageLayout;
+using testing::ElementsAreArray;
+
+typedef grinder::basic_block_util::EntryCountType EntryCountType;
+
+// _asm je  here
+// _asm xor eax, eax
+// here:
+// _asm ret
+const uint8_t kCodeJump[] = {0x74, 0x02, 0x33, 0xC0, 0xC3};
+
+const EntryCountType kHot = 100;
+
+class TestApplicationProfile : public ApplicationProfile {
+ public:
+  explicit TestApplicationProfile(const ImageLayout* image_layout)
+      : ApplicationProfile(image_layout) {
+  }
+
+  using ApplicationProfile::profiles_;
+};
+
+class TestSubGraphProfile : public SubGraphProfile {
+ public:
+  using SubGraphProfile::basic_blocks_;
+};
+
+class TestBasicBlockProfile : public SubGraphProfile::BasicBlockProfile {
+ public:
+  explicit TestBasicBlockProfile(EntryCountType count) {
+    count_ = count;
+  }
+};
+
+class HotColdSplittingTransformTest : public testing::Test {
+ public:
+  HotColdSplittingTransformTest()
+      : block_(NULL), text_(NULL), image_(&block_graph_), profile_(&image_) {
+  }
+
+  virtual void SetUp() {
+    text_ = block_graph_.AddSection(".text", 0x60000020);
+    DCHECK_NE(reinterpret_cast<BlockGraph::Section*>(NULL), text_);
+
+    block_ = block_graph_.AddBlock(BlockGraph::CODE_BLOCK,
+                                   sizeof(kCodeJump),
+                                   "jump");
+    DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), block_);
+    block_->SetData(kCodeJump, sizeof(kCodeJump));
+    block_->set_section(text_->id());
+  }
+
+  // Applies the transform to |block_|, with the given entry counts for its
+  // basic code blocks, in their original order.
+  // @param counts The entry counts of the basic code blocks, or NULL to leave
+  //     the subgraph without profile.
+  // @param new_blocks Receives the blocks built from the subgraph.
+  void ApplyTransform(const EntryCountType* counts,
+                      BlockVector* new_blocks);
+
+ protected:
+  pe::PETransformPolicy policy_;
+  BlockGraph block_graph_;
+  BlockGraph::Block* block_;
+  BlockGraph::Section* text_;
+  HotColdSplittingTransform tx_;
+  ImageLayout image_;
+  TestApplicationProfile profile_;
+  TestSubGraphProfile subgraph_profile_;
+};
+
+void HotColdSplittingTransformTest::ApplyTransform(
+    const EntryCountType* counts,
+    BlockVector* new_blocks) {
+  DCHECK_NE(reinterpret_cast<BlockVector*>(NULL), new_blocks);
+
+  // Decompose to subgraph.
+  BasicBlockSubGraph subgraph;
+  BasicBlockDecomposer decomposer(block_, &subgraph);
+  ASSERT_TRUE(decomposer.Decompose());
+
+  // Commit the basic block profiles in the subgraph profile.
+  if (counts != NULL) {
+    ApplicationProfile::BlockProfile block_profile(counts[0], kHot);
+    profile_.profiles_.insert(std::make_pair(block_->id(), block_profile));
+
+    const BasicBlockSubGraph::BasicBlockOrdering& order =
+        subgraph.block_descriptions().front().basic_block_order;
+    BasicBlockSubGraph::BasicBlockOrdering::const_iterator bb = order.begin();
+    for (size_t i = 0; bb != order.end(); ++bb) {
+      BasicCodeBlock* code = BasicCodeBlock::Cast(*bb);
+      if (code != NULL)
+        subgraph_profile_.basic_blocks_[code] =
+            TestBasicBlockProfile(counts[i++]);
+    }
+  }
+
+  // Apply the hot/cold splitting transform.
+  ASSERT_TRUE(
+      tx_.TransformBasicBlockSubGraph(&policy_, &block_graph_, &subgraph,
+                                      &profile_, &subgraph_profile_));
+
+  // Rebuild the blocks.
+  BlockBuilder builder(&block_graph_);
+  ASSERT_TRUE(builder.Merge(&subgraph));
+  *new_blocks = builder.new_blocks();
+}
+
+}  // namespace
+
+TEST_F(HotColdSplittingTransformTest, ApplyTransformWithoutProfile) {
+  BlockVector new_blocks;
+  ASSERT_NO_FATAL_FAILURE(ApplyTransform(NULL, &new_blocks));
+
+  // This block has never been run, thus it must be unchanged.
+  ASSERT_EQ(1U, new_blocks.size());
+  BlockGraph::Block* block = new_blocks.front();
+  EXPECT_THAT(kCodeJump, ElementsAreArray(block->data(), block->size()));
+  EXPECT_EQ(reinterpret_cast<BlockGraph::Section*>(NULL),
+            block_graph_.FindSection(
+                HotColdSplittingTransform::kColdSectionName));
+}
+
+TEST_F(HotColdSplittingTransformTest, ApplyTransformWithHotBlocks) {
+  const EntryCountType kCounts[] = { kHot, kHot, kHot };
+  BlockVector new_blocks;
+  ASSERT_NO_FATAL_FAILURE(ApplyTransform(kCounts, &new_blocks));
+
+  // All the basic blocks were executed, thus the block must be unchanged.
+  ASSERT_EQ(1U, new_blocks.size());
+  BlockGraph::Block* block = new_blocks.front();
+  EXPECT_THAT(kCodeJump, ElementsAreArray(block->data(), block->size()));
+}
+
+TEST_F(HotColdSplittingTransformTest, ApplyTransformWithColdBlock) {
+  // The xor instruction was never executed.
+  const EntryCountType kCounts[] = { kHot, 0, kHot };
+  BlockVector new_blocks;
+  ASSERT_NO_FATAL_FAILURE(ApplyTransform(kCounts, &new_blocks));
+
+  const BlockGraph::Section* cold_section = block_graph_.FindSection(
+      HotColdSplittingTransform::kColdSectionName);
+  ASSERT_NE(reinterpret_cast<const BlockGraph::Section*>(NULL), cold_section);
+  EXPECT_EQ(text_->characteristics(), cold_section->characteristics());
+
+  // The cold basic block went to a block of its own.
+  ASSERT_EQ(2U, new_blocks.size());
+  BlockGraph::Block* hot = new_blocks.front();
+  BlockGraph::Block* cold = new_blocks.back();
+  EXPECT_EQ(text_->id(), hot->section());
+  EXPECT_EQ(cold_section->id(), cold->section());
+  EXPECT_EQ("jump.cold", cold->name());
+
+  // The two blocks jump to each other.
+  ASSERT_EQ(1U, hot->references().size());
+  EXPECT_EQ(cold, hot->references().begin()->second.referenced());
+  ASSERT_EQ(1U, cold->references().size());
+  EXPECT_EQ(hot, cold->references().begin()->second.referenced());
+}
+
+}  // namespace transforms
+}  // namespace optimize
@@ -94,6 +94,10 @@ const size_t kHotCodeSizeThreshold = 15;
 // Threshold in bytes to inline a callee in a cold block.
 const size_t kColdCodeSizeThreshold = 1;
 
+// Blocks whose percentile is below this threshold are hot. The percentile of a
+// block is the fraction of the execution spent in hotter blocks.
+const double kHotBlockPercentile = 0.80;
+
 // A size huge enough to never be an inlining candidate.
 const size_t kHugeBlockSize = 0xFFFFFFFF;
 
@@ -544,6 +548,12 @@ bool InliningTransform::TransformBasicBlockSubGraph(
   // dangling pointers, the block is removed from the decomposed cache.
   subgraph_cache_.erase(caller->id());
 
+  // The executed call-sites of a hot caller may grow the code.
+  const BlockProfile* caller_profile = profile->GetBlockProfile(caller);
+  DCHECK_NE(reinterpret_cast<const BlockProfile*>(NULL), caller_profile);
+  bool hot_caller = caller_profile->count() != 0 &&
+      caller_profile->percentile() < kHotBlockPercentile;
+
   // Iterates through each basic block.
   BasicBlockSubGraph::BBCollection::iterator bb_iter =
       subgraph->basic_blocks().begin();
@@ -552,6 +562,9 @@ bool InliningTransform::TransformBasicBlockSubGraph(
     if (bb == NULL)
       continue;
 
+    bool hot_call_site = hot_caller &&
+        subgraph_profile->GetBasicBlockProfile(bb)->count() != 0;
+
     // Iterates through each instruction.
     BasicBlock::Instructions::iterator inst_iter = bb->instructions().begin();
     while (inst_iter != bb->instructions().end()) {
@@ -614,14 +627,21 @@ bool InliningTransform::TransformBasicBlockSubGraph(
 
       // Heuristic to determine whether to inline or not the callee subgraph.
       bool candidate_for_inlining = false;
+      size_t code_growth = 0;
 
       // For a small callee, try to replace callee instructions in-place.
       // This kind of inlining is always a win.
       size_t callsite_size = instr.size();
-      if (subgraph_size <= callsite_size + kColdCodeSizeThreshold)
+      if (subgraph_size <= callsite_size + kColdCodeSizeThreshold) {
         candidate_for_inlining = true;
-
-      // TODO(etienneb): Add more rules based on profile data.
+      } else if (hot_call_site &&
+                 subgraph_size <= callsite_size + kHotCodeSizeThreshold &&
+                 subgraph_size - callsite_size <= code_growth_budget_) {
+        // A bigger callee is worth inlining at a call-site that is executed
+        // often, within the code growth budget.
+        candidate_for_inlining = true;
+        code_growth = subgraph_size - callsite_size;
+      }
 
       if (!candidate_for_inlining)
         continue;
@@ -637,6 +657,7 @@ bool InliningTransform::TransformBasicBlockSubGraph(
                             call_iter, &bb->instructions())) {
         // Inlining successful, remove call-site.
         bb->instructions().erase(call_iter);
+        code_growth_budget_ -= code_growth;
       } else {
         // Inlining was unsuccessful, avoid any further inlining of this block.
         subgraph_cache_[callee->id()] = kHugeBlockSize;
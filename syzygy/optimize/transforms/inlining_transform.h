@@ -17,6 +17,11 @@
 // The inlining expansion replaces a function call site with the body of the
 // callee. It is used to eliminate the time overhead when a function is called.
 //
+// Callees that are no bigger than the call-site are always inlined. When
+// profile data is available, the executed call-sites of the hot blocks also
+// inline slightly bigger callees, as long as the total code growth stays
+// within a global budget.
+//
 // TODO(etienneb): The actual implementation does not inline a sequence of
 //    calls like Foo -> Bar -> Bat. This may be addressed by iterating this
 //    function until no changes occurred or by changing the ordering the
@@ -41,8 +46,21 @@ class InliningTransform : public SubGraphTransformInterface {
   typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
   typedef std::map<BlockId, size_t> SubGraphCache;
 
+  // The default number of bytes by which the inlining may grow the code.
+  static const size_t kDefaultCodeGrowthBudget = 64 * 1024;
+
   // Constructor.
-  InliningTransform() { }
+  InliningTransform() : code_growth_budget_(kDefaultCodeGrowthBudget) { }
+
+  // @name Accessors and mutators.
+  // @{
+  // The code growth budget is the number of bytes that the inlining at the hot
+  // call-sites may still add to the code.
+  size_t code_growth_budget() const { return code_growth_budget_; }
+  void set_code_growth_budget(size_t code_growth_budget) {
+    code_growth_budget_ = code_growth_budget;
+  }
+  // @}
 
   // @name SubGraphTransformInterface implementation.
   // @{
@@ -58,6 +76,9 @@ class InliningTransform : public SubGraphTransformInterface {
   // A cache of decomposed subgraph sizes.
   SubGraphCache subgraph_cache_;
 
+  // The remaining code growth budget, in bytes.
+  size_t code_growth_budget_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(InliningTransform);
 };
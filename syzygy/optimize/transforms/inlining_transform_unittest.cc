@@ -47,6 +47,7 @@ using testing::ElementsAreArray;
 
 typedef BasicBlockSubGraph::BasicCodeBlock BasicCodeBlock;
 typedef BlockGraph::Offset Offset;
+typedef grinder::basic_block_util::EntryCountType EntryCountType;
 
 // This enum is used to drive the contents of the callee.
 enum CalleeKind {
@@ -148,11 +149,35 @@ const uint8_t kCodeIndirectCall[] = {0xFF, 0x55, 0xF8, 0xC3};
 // _asm ret
 const uint8_t kStackCst[] = {0x6A, 0x02, 0x58, 0xC3};
 
+// The entry count of the hot blocks.
+const EntryCountType kHotCount = 100;
+
 class TestInliningTransform : public InliningTransform {
  public:
   using InliningTransform::subgraph_cache_;
 };
 
+class TestApplicationProfile : public ApplicationProfile {
+ public:
+  explicit TestApplicationProfile(const ImageLayout* image_layout)
+      : ApplicationProfile(image_layout) {
+  }
+
+  using ApplicationProfile::profiles_;
+};
+
+class TestSubGraphProfile : public SubGraphProfile {
+ public:
+  using SubGraphProfile::basic_blocks_;
+};
+
+class TestBasicBlockProfile : public SubGraphProfile::BasicBlockProfile {
+ public:
+  explicit TestBasicBlockProfile(EntryCountType count) {
+    count_ = count;
+  }
+};
+
 class InliningTransformTest : public testing::Test {
  public:
   InliningTransformTest()
@@ -184,6 +209,7 @@ class InliningTransformTest : public testing::Test {
                          BlockGraph::Block** callee);
   void CreateCallSiteToBlock(BlockGraph::Block* callee);
   void ApplyTransformOnCaller();
+  void ApplyTransformOnHotCaller(InliningTransform* tx);
   void SaveCaller();
 
   pe::PETransformPolicy policy_;
@@ -194,8 +220,8 @@ class InliningTransformTest : public testing::Test {
   std::vector<uint8_t> original_;
   BasicBlockSubGraph callee_subgraph_;
   ImageLayout image_;
-  ApplicationProfile profile_;
-  SubGraphProfile subgraph_profile_;
+  TestApplicationProfile profile_;
+  TestSubGraphProfile subgraph_profile_;
 };
 
 void InliningTransformTest::AddBlockFromBuffer(const uint8_t* data,
@@ -329,6 +355,41 @@ void InliningTransformTest::ApplyTransformOnCaller() {
   caller_ = *builder.new_blocks().begin();
 }
 
+// Applies the inlining transform to the caller, with a profile in which the
+// caller is the hottest block and all its basic blocks are executed.
+void InliningTransformTest::ApplyTransformOnHotCaller(InliningTransform* tx) {
+  DCHECK_NE(reinterpret_cast<InliningTransform*>(NULL), tx);
+
+  // Decompose to subgraph.
+  BasicBlockSubGraph subgraph;
+  BasicBlockDecomposer decomposer(caller_, &subgraph);
+  ASSERT_TRUE(decomposer.Decompose());
+
+  // Insert the block profile into the profile map.
+  ApplicationProfile::BlockProfile block_profile(kHotCount, kHotCount);
+  block_profile.set_percentile(0);
+  profile_.profiles_.insert(std::make_pair(caller_->id(), block_profile));
+
+  BasicBlockSubGraph::BBCollection::iterator bb =
+      subgraph.basic_blocks().begin();
+  for (; bb != subgraph.basic_blocks().end(); ++bb) {
+    BasicCodeBlock* code = BasicCodeBlock::Cast(*bb);
+    if (code != NULL)
+      subgraph_profile_.basic_blocks_[code] = TestBasicBlockProfile(kHotCount);
+  }
+
+  // Apply inlining transform.
+  ASSERT_TRUE(
+      tx->TransformBasicBlockSubGraph(&policy_, &block_graph_, &subgraph,
+                                      &profile_, &subgraph_profile_));
+
+  // Rebuild block.
+  BlockBuilder builder(&block_graph_);
+  ASSERT_TRUE(builder.Merge(&subgraph));
+  CHECK_EQ(1u, builder.new_blocks().size());
+  caller_ = *builder.new_blocks().begin();
+}
+
 }  // namespace
 
 TEST_F(InliningTransformTest, SubgraphCache) {
@@ -426,6 +487,44 @@ TEST_F(InliningTransformTest, InlineTrivialTwoCalls) {
               ElementsAreArray(caller_->data(), caller_->size()));
 }
 
+TEST_F(InliningTransformTest, DontInlineBiggerBodyInColdCaller) {
+  ASSERT_NO_FATAL_FAILURE(
+      AddBlockFromBuffer(kCodeRetBoth, sizeof(kCodeRetBoth), &callee_));
+  ASSERT_NO_FATAL_FAILURE(CreateCallSiteToBlock(callee_));
+  ASSERT_NO_FATAL_FAILURE(ApplyTransformOnCaller());
+
+  // The callee is bigger than the call-site, and the caller wasn't executed.
+  EXPECT_THAT(original_, ElementsAreArray(caller_->data(), caller_->size()));
+}
+
+TEST_F(InliningTransformTest, InlineBiggerBodyInHotCaller) {
+  ASSERT_NO_FATAL_FAILURE(
+      AddBlockFromBuffer(kCodeRetBoth, sizeof(kCodeRetBoth), &callee_));
+  ASSERT_NO_FATAL_FAILURE(CreateCallSiteToBlock(callee_));
+
+  InliningTransform tx;
+  size_t budget = tx.code_growth_budget();
+  ASSERT_NO_FATAL_FAILURE(ApplyTransformOnHotCaller(&tx));
+
+  // The call-site is hot, so the code is allowed to grow.
+  EXPECT_THAT(kCodeRetBoth, ElementsAreArray(caller_->data(), caller_->size()));
+  EXPECT_GT(budget, tx.code_growth_budget());
+}
+
+TEST_F(InliningTransformTest, DontInlineBiggerBodyOverBudget) {
+  ASSERT_NO_FATAL_FAILURE(
+      AddBlockFromBuffer(kCodeRetBoth, sizeof(kCodeRetBoth), &callee_));
+  ASSERT_NO_FATAL_FAILURE(CreateCallSiteToBlock(callee_));
+
+  InliningTransform tx;
+  tx.set_code_growth_budget(0);
+  ASSERT_NO_FATAL_FAILURE(ApplyTransformOnHotCaller(&tx));
+
+  // The code growth budget is exhausted.
+  EXPECT_THAT(original_, ElementsAreArray(caller_->data(), caller_->size()));
+  EXPECT_EQ(0U, tx.code_growth_budget());
+}
+
 TEST_F(InliningTransformTest, InlineReturnWithOffset) {
   ASSERT_NO_FATAL_FAILURE(
       AddBlockFromBuffer(kCodeRetWithOffset,
@@ -14,6 +14,10 @@
 
 #include "syzygy/optimize/transforms/peephole_transform.h"
 
+#include <set>
+#include <vector>
+
+#include "syzygy/block_graph/basic_block_assembler.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/block_graph/analysis/liveness_analysis.h"
 #include "syzygy/block_graph/analysis/liveness_analysis_internal.h"
@@ -24,13 +28,56 @@ namespace transforms {
 namespace {
 
 using block_graph::BasicBlock;
+using block_graph::BasicBlockAssembler;
+using block_graph::BasicBlockReference;
 using block_graph::BasicBlockSubGraph;
 using block_graph::BasicCodeBlock;
+using block_graph::Immediate;
 using block_graph::Instruction;
+using block_graph::Successor;
 using block_graph::analysis::LivenessAnalysis;
 
 typedef BasicBlockSubGraph::BBCollection BBCollection;
 typedef BasicBlock::Instructions Instructions;
+typedef BasicBlock::Successors Successors;
+
+// A rule matches a pattern of instructions starting at |*where|. On a match,
+// the rule rewrites the pattern and leaves |*where| on the first instruction
+// that hasn't been rewritten.
+// @param instructions the instructions of the basic block.
+// @param where the position to match at.
+// @returns true if the pattern has been rewritten, false otherwise.
+typedef bool (*PeepholeRule)(Instructions* instructions,
+                             Instructions::iterator* where);
+
+// A rule that also needs the liveness information after the instruction at
+// |*where| to match it. On a match, the rule rewrites the instruction and
+// leaves |*where| on the instruction that follows it.
+// @param state the liveness information after the instruction.
+// @param instructions the instructions of the basic block.
+// @param where the position of the instruction to match.
+// @returns true if the instruction has been rewritten, false otherwise.
+typedef bool (*LivenessRule)(const LivenessAnalysis::State& state,
+                             Instructions* instructions,
+                             Instructions::iterator* where);
+
+// Match a sequence of two instructions and return them into |instr1| and
+// |instr2|.
+bool MatchTwoInstructions(const Instructions& instructions,
+                          Instructions::iterator where,
+                          Instruction** instr1,
+                          Instruction** instr2) {
+  if (where == instructions.end())
+    return false;
+  *instr1 = &*where;
+  where++;
+
+  if (where == instructions.end())
+    return false;
+  *instr2 = &*where;
+
+  return true;
+}
 
 // Match a sequence of three instructions and return them into |instr1|,
 // |instr2| and |instr3|.
@@ -153,6 +200,115 @@ bool SimplifyIdentityMov(Instructions* instructions,
   return false;
 }
 
+// Remove the second move of patterns like: mov eax, ecx; mov ecx, eax. The
+// second move doesn't change anything, as does the repetition of a move
+// between two registers.
+bool SimplifyRedundantMov(Instructions* instructions,
+                          Instructions::iterator* where) {
+  DCHECK_NE(reinterpret_cast<Instructions*>(NULL), instructions);
+  DCHECK_NE(reinterpret_cast<Instructions::iterator*>(NULL), where);
+
+  Instruction* instr1 = NULL;
+  Instruction* instr2 = NULL;
+  _RegisterType dst = _RegisterType();
+  _RegisterType src = _RegisterType();
+  if (MatchTwoInstructions(*instructions, *where, &instr1, &instr2) &&
+      MatchInstructionRegReg(*instr1, I_MOV, &dst, &src) &&
+      (MatchInstructionRegReg(*instr2, I_MOV, src, dst) ||
+       MatchInstructionRegReg(*instr2, I_MOV, dst, src))) {
+    // Remove the second instruction, and rematch from the first one.
+    Instructions::iterator second = *where;
+    ++second;
+    instructions->erase(second);
+    return true;
+  }
+
+  return false;
+}
+
+// Remove compare instructions whose result is never used, like:
+// cmp eax, 0 followed by an instruction that sets the flags.
+bool SimplifyFlagDeadCompare(const LivenessAnalysis::State& state,
+                             Instructions* instructions,
+                             Instructions::iterator* where) {
+  DCHECK_NE(reinterpret_cast<Instructions*>(NULL), instructions);
+  DCHECK_NE(reinterpret_cast<Instructions::iterator*>(NULL), where);
+
+  if (state.AreArithmeticFlagsLive())
+    return false;
+
+  // Only consider the compares of a register with a register or a constant,
+  // so that no memory access is removed.
+  const _DInst& repr = (*where)->representation();
+  if ((repr.opcode != I_CMP && repr.opcode != I_TEST) ||
+      repr.ops[0].type != O_REG ||
+      (repr.ops[1].type != O_REG && repr.ops[1].type != O_IMM)) {
+    return false;
+  }
+
+  // Remove the matched instruction.
+  *where = instructions->erase(*where);
+  return true;
+}
+
+// Replace the multiplications of a register by a power of two, like:
+// imul eax, eax, 8 by the equivalent shift: shl eax, 3. The shift sets the
+// arithmetic flags differently, so they must be dead.
+bool SimplifyMultiplyByPowerOfTwo(const LivenessAnalysis::State& state,
+                                  Instructions* instructions,
+                                  Instructions::iterator* where) {
+  DCHECK_NE(reinterpret_cast<Instructions*>(NULL), instructions);
+  DCHECK_NE(reinterpret_cast<Instructions::iterator*>(NULL), where);
+
+  if (state.AreArithmeticFlagsLive())
+    return false;
+
+  const Instruction& instr = **where;
+  const _DInst& repr = instr.representation();
+  if (repr.opcode != I_IMUL ||
+      repr.ops[0].type != O_REG ||
+      repr.ops[0].index < R_EAX ||
+      repr.ops[0].index > R_EDI ||
+      repr.ops[1].type != O_REG ||
+      repr.ops[1].index != repr.ops[0].index ||
+      repr.ops[2].type != O_IMM ||
+      !instr.references().empty()) {
+    return false;
+  }
+
+  int32_t factor = repr.imm.sdword;
+  if (repr.ops[2].size == 8)
+    factor = repr.imm.sbyte;
+  if (factor < 2 || (factor & (factor - 1)) != 0)
+    return false;
+  uint32_t shift = 0;
+  while ((1 << shift) != factor)
+    ++shift;
+
+  // Insert the shift before the multiplication, and remove the latter.
+  const assm::Register32& reg =
+      assm::CastAsRegister32(core::GetRegister(repr.ops[0].index));
+  BasicBlockAssembler assembler(*where, instructions);
+  assembler.set_source_range(instr.source_range());
+  assembler.shl(reg, Immediate(shift, assm::kSize8Bit));
+  *where = instructions->erase(*where);
+  return true;
+}
+
+// The rules applied by SimplifyBasicBlock. New patterns go here.
+const PeepholeRule kPeepholeRules[] = {
+  SimplifyEmptyPrologEpilog,
+  SimplifyIdentityMov,
+  SimplifyRedundantMov,
+};
+
+// The rules applied by SimplifyBasicBlockWithLiveness. New patterns that
+// depend on the liveness information go here.
+const LivenessRule kLivenessRules[] = {
+  SimplifyFlagDeadCompare,
+  SimplifyMultiplyByPowerOfTwo,
+};
+
 // Simplify a given basic block.
 bool SimplifyBasicBlock(BasicBlock* basic_block) {
   DCHECK_NE(reinterpret_cast<BasicBlock*>(NULL), basic_block);
@@ -166,8 +322,59 @@ bool SimplifyBasicBlock(BasicBlock* basic_block) {
   // Match and rewrite based on patterns.
   BasicBlock::Instructions::iterator inst_iter = bb->instructions().begin();
   while (inst_iter != bb->instructions().end()) {
-    if (SimplifyEmptyPrologEpilog(&bb->instructions(), &inst_iter) ||
-        SimplifyIdentityMov(&bb->instructions(), &inst_iter)) {
+    bool matched = false;
+    for (size_t i = 0; i < arraysize(kPeepholeRules); ++i) {
+      if (kPeepholeRules[i](&bb->instructions(), &inst_iter)) {
+        matched = true;
+        break;
+      }
+    }
+
+    if (matched) {
+      changed = true;
+      continue;
+    }
+
+    // Move to the next instruction.
+    ++inst_iter;
+  }
+
+  return changed;
+}
+
+// Simplify a given basic block with the rules that depend on the liveness
+// information.
+bool SimplifyBasicBlockWithLiveness(const LivenessAnalysis& liveness,
+                                    BasicCodeBlock* bb) {
+  DCHECK_NE(reinterpret_cast<BasicCodeBlock*>(NULL), bb);
+
+  Instructions& instructions = bb->instructions();
+
+  // Compute the liveness information after each instruction. The states of
+  // the instructions that follow a rewrite stay valid, as the rules preserve
+  // the live values.
+  std::vector<LivenessAnalysis::State> states(instructions.size());
+  LivenessAnalysis::State state;
+  liveness.GetStateAtExitOf(bb, &state);
+  Instructions::reverse_iterator rev_iter_inst = instructions.rbegin();
+  for (size_t i = states.size(); rev_iter_inst != instructions.rend();
+       ++rev_iter_inst) {
+    states[--i] = state;
+    liveness.PropagateBackward(*rev_iter_inst, &state);
+  }
+
+  bool changed = false;
+  Instructions::iterator inst_iter = instructions.begin();
+  for (size_t i = 0; inst_iter != instructions.end(); ++i) {
+    bool matched = false;
+    for (size_t j = 0; j < arraysize(kLivenessRules); ++j) {
+      if (kLivenessRules[j](states[i], &instructions, &inst_iter)) {
+        matched = true;
+        break;
+      }
+    }
+
+    if (matched) {
       changed = true;
       continue;
     }
@@ -179,6 +386,38 @@ bool SimplifyBasicBlock(BasicBlock* basic_block) {
   return changed;
 }
 
+// @returns true if |bb| holds nothing but an unconditional jump to another
+//     basic block.
+bool IsJumpTrampoline(const BasicBlock* bb) {
+  const BasicCodeBlock* code_bb = BasicCodeBlock::Cast(bb);
+  if (code_bb == NULL ||
+      !code_bb->instructions().empty() ||
+      code_bb->successors().size() != 1) {
+    return false;
+  }
+
+  const Successor& successor = code_bb->successors().front();
+  return successor.condition() == Successor::kConditionTrue &&
+      successor.reference().basic_block() != NULL;
+}
+
+// Follow a chain of jump trampolines starting at |bb|.
+// @returns the first basic block of the chain that isn't a trampoline, or
+//     NULL if the chain loops.
+BasicBlock* FindJumpTarget(BasicBlock* bb) {
+  DCHECK_NE(reinterpret_cast<BasicBlock*>(NULL), bb);
+
+  std::set<BasicBlock*> visited;
+  while (IsJumpTrampoline(bb)) {
+    if (!visited.insert(bb).second)
+      return NULL;
+    bb = BasicCodeBlock::Cast(bb)->successors().front().reference()
+        .basic_block();
+  }
+
+  return bb;
+}
+
 }  // namespace
 
 // Simplify a given subgraph.
@@ -314,6 +553,60 @@ bool PeepholeTransform::RemoveDeadCodeSubgraph(BasicBlockSubGraph* subgraph) {
   return changed;
 }
 
+bool PeepholeTransform::SimplifyWithLivenessSubgraph(
+    BasicBlockSubGraph* subgraph) {
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+
+  // Perform a global liveness analysis.
+  LivenessAnalysis liveness;
+  liveness.Analyze(subgraph);
+
+  bool changed = false;
+  BBCollection& basic_blocks = subgraph->basic_blocks();
+  BBCollection::iterator it = basic_blocks.begin();
+  for (; it != basic_blocks.end(); ++it) {
+    BasicCodeBlock* bb = BasicCodeBlock::Cast(*it);
+    if (bb != NULL && SimplifyBasicBlockWithLiveness(liveness, bb))
+      changed = true;
+  }
+
+  return changed;
+}
+
+bool PeepholeTransform::ThreadJumpsSubgraph(BasicBlockSubGraph* subgraph) {
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+
+  bool changed = false;
+  BBCollection& basic_blocks = subgraph->basic_blocks();
+  BBCollection::iterator it = basic_blocks.begin();
+  for (; it != basic_blocks.end(); ++it) {
+    BasicCodeBlock* bb = BasicCodeBlock::Cast(*it);
+    if (bb == NULL)
+      continue;
+
+    // Retarget the successors that jump to a trampoline. The trampolines are
+    // left in place, as other basic blocks may still refer to them.
+    Successors::iterator succ = bb->successors().begin();
+    for (; succ != bb->successors().end(); ++succ) {
+      BasicBlockReference reference = succ->reference();
+      BasicBlock* target = reference.basic_block();
+      if (target == NULL || !IsJumpTrampoline(target))
+        continue;
+
+      BasicBlock* final_target = FindJumpTarget(target);
+      if (final_target == NULL || final_target == target)
+        continue;
+
+      succ->set_reference(BasicBlockReference(reference.reference_type(),
+                                              reference.size(),
+                                              final_target));
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
 bool PeepholeTransform::TransformBasicBlockSubGraph(
     const TransformPolicyInterface* policy,
     BlockGraph* block_graph,
@@ -332,6 +625,10 @@ bool PeepholeTransform::TransformBasicBlockSubGraph(
 
     if (SimplifySubgraph(subgraph))
       changed = true;
+    if (SimplifyWithLivenessSubgraph(subgraph))
+      changed = true;
+    if (ThreadJumpsSubgraph(subgraph))
+      changed = true;
     if (RemoveDeadCodeSubgraph(subgraph))
       changed = true;
   } while (changed);
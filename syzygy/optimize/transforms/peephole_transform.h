@@ -16,6 +16,9 @@
 // set of instructions  called a "peephole". It works by recognizing patterns
 // of instructions that can be replaced by shorter or faster sets of
 // instructions.
+//
+// The patterns are kept in tables of rules, so that new patterns can be added
+// without changing the code that applies them.
 
 #ifndef SYZYGY_OPTIMIZE_TRANSFORMS_PEEPHOLE_TRANSFORM_H_
 #define SYZYGY_OPTIMIZE_TRANSFORMS_PEEPHOLE_TRANSFORM_H_
@@ -63,6 +66,19 @@ class PeepholeTransform : public SubGraphTransformInterface {
   // @returns true if the subgraph has been simplified, false otherwise.
   static bool RemoveDeadCodeSubgraph(BasicBlockSubGraph* subgraph);
 
+  // Apply the sequence of patterns that depend on the liveness information to
+  // simplify the contents of a subgraph. The sequence of patterns is applied
+  // once.
+  // @param subgraph the subgraph to simplify.
+  // @returns true if the subgraph has been simplified, false otherwise.
+  static bool SimplifyWithLivenessSubgraph(BasicBlockSubGraph* subgraph);
+
+  // Retarget the jumps to basic blocks that only jump to another basic block,
+  // so that they go directly to the final destination.
+  // @param subgraph the subgraph to simplify.
+  // @returns true if the subgraph has been simplified, false otherwise.
+  static bool ThreadJumpsSubgraph(BasicBlockSubGraph* subgraph);
+
  private:
   DISALLOW_COPY_AND_ASSIGN(PeepholeTransform);
 };
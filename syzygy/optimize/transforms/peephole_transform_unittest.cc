@@ -153,6 +153,105 @@ TEST_F(PeepholeTransformTest, SimplifyIdentityMov) {
   EXPECT_THAT(kRet, ElementsAreArray(block_->data(), block_->size()));
 }
 
+TEST_F(PeepholeTransformTest, SimplifyRedundantMov) {
+  // _asm mov eax, ecx
+  // _asm mov ecx, eax
+  // _asm mov eax, ecx
+  // _asm ret
+  const uint8_t kSource[] = {0x8B, 0xC1, 0x8B, 0xC8, 0x8B, 0xC1, 0xC3};
+
+  // _asm mov eax, ecx
+  // _asm ret
+  const uint8_t kResult[] = {0x8B, 0xC1, 0xC3};
+
+  ASSERT_NO_FATAL_FAILURE(
+      TransformBlock(ktransformSubgraph, kSource, sizeof(kSource)));
+  EXPECT_THAT(kResult, ElementsAreArray(block_->data(), block_->size()));
+}
+
+TEST_F(PeepholeTransformTest, SimplifyFlagDeadCompare) {
+  // _asm test eax, eax
+  // _asm cmp cl, 1
+  // _asm xor ecx, ecx
+  // _asm ret
+  const uint8_t kSource[] = {0x85, 0xC0, 0x80, 0xF9, 0x01, 0x33, 0xC9, 0xC3};
+
+  // _asm xor ecx, ecx
+  // _asm ret
+  const uint8_t kResult[] = {0x33, 0xC9, 0xC3};
+
+  ASSERT_NO_FATAL_FAILURE(
+      TransformBlock(ktransformBlock, kSource, sizeof(kSource)));
+  EXPECT_THAT(kResult, ElementsAreArray(block_->data(), block_->size()));
+}
+
+TEST_F(PeepholeTransformTest, SimplifyMultiplyByPowerOfTwo) {
+  // _asm imul eax, eax, 8
+  // _asm xor ecx, ecx
+  // _asm ret
+  const uint8_t kSource[] = {0x6B, 0xC0, 0x08, 0x33, 0xC9, 0xC3};
+
+  // _asm shl eax, 3
+  // _asm xor ecx, ecx
+  // _asm ret
+  const uint8_t kResult[] = {0xC1, 0xE0, 0x03, 0x33, 0xC9, 0xC3};
+
+  ASSERT_NO_FATAL_FAILURE(
+      TransformBlock(ktransformBlock, kSource, sizeof(kSource)));
+  EXPECT_THAT(kResult, ElementsAreArray(block_->data(), block_->size()));
+}
+
+TEST_F(PeepholeTransformTest, DontSimplifyMultiplyWithLiveFlags) {
+  // _asm imul eax, eax, 8
+  // _asm ret
+  const uint8_t kSource[] = {0x6B, 0xC0, 0x08, 0xC3};
+
+  ASSERT_NO_FATAL_FAILURE(
+      TransformBlock(ktransformBlock, kSource, sizeof(kSource)));
+  EXPECT_THAT(kSource, ElementsAreArray(block_->data(), block_->size()));
+}
+
+TEST_F(PeepholeTransformTest, ThreadJumpsSubgraph) {
+  // _asm test eax, eax
+  // _asm jz trampoline
+  // target:
+  // _asm xor eax, eax
+  // _asm ret
+  // trampoline:
+  // _asm jmp target
+  const uint8_t kSource[] = {0x85, 0xC0, 0x74, 0x03, 0x33, 0xC0, 0xC3, 0xEB,
+                             0xFB};
+
+  block_ = block_graph_.AddBlock(BlockGraph::CODE_BLOCK, sizeof(kSource),
+                                 "test");
+  ASSERT_NE(reinterpret_cast<BlockGraph::Block*>(NULL), block_);
+  block_->SetData(kSource, sizeof(kSource));
+  block_->SetLabel(0, "code", BlockGraph::CODE_LABEL);
+
+  BasicBlockSubGraph subgraph;
+  BasicBlockDecomposer decomposer(block_, &subgraph);
+  ASSERT_TRUE(decomposer.Decompose());
+
+  EXPECT_TRUE(PeepholeTransform::ThreadJumpsSubgraph(&subgraph));
+  EXPECT_FALSE(PeepholeTransform::ThreadJumpsSubgraph(&subgraph));
+
+  // No successor jumps to the trampoline anymore.
+  BasicBlockSubGraph::BBCollection::iterator it =
+      subgraph.basic_blocks().begin();
+  for (; it != subgraph.basic_blocks().end(); ++it) {
+    BasicCodeBlock* bb = BasicCodeBlock::Cast(*it);
+    if (bb == NULL)
+      continue;
+    BasicBlock::Successors::iterator succ = bb->successors().begin();
+    for (; succ != bb->successors().end(); ++succ) {
+      BasicCodeBlock* target =
+          BasicCodeBlock::Cast(succ->reference().basic_block());
+      ASSERT_NE(reinterpret_cast<BasicCodeBlock*>(NULL), target);
+      EXPECT_FALSE(target->instructions().empty());
+    }
+  }
+}
+
 TEST_F(PeepholeTransformTest, RemoveDeadCodeSubgraph) {
   // _asm mov eax, 4
   // _asm cmp eax, edx
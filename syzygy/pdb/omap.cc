@@ -58,6 +58,88 @@ core::RelativeAddress TranslateAddressViaOmap(const std::vector<OMAP>& omaps,
       (address - core::RelativeAddress(it->rva));
 }
 
+void TranslateAddressesViaOmap(
+    const std::vector<OMAP>& omaps,
+    const std::vector<core::RelativeAddress>& addresses,
+    std::vector<core::RelativeAddress>* mapped_addresses) {
+  DCHECK(mapped_addresses != NULL);
+
+  // Visit the addresses in increasing order.
+  std::vector<uint32_t> order(addresses.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = static_cast<uint32_t>(i);
+  std::sort(order.begin(), order.end(),
+            [&addresses](uint32_t index1, uint32_t index2) {
+              return addresses[index1] < addresses[index2];
+            });
+
+  // Walk the OMAP entries along with the sorted addresses, keeping track of
+  // the first entry that is greater than the current address.
+  mapped_addresses->resize(addresses.size());
+  size_t next = 0;
+  for (size_t i = 0; i < order.size(); ++i) {
+    core::RelativeAddress address = addresses[order[i]];
+    while (next < omaps.size() && omaps[next].rva <= address.value())
+      ++next;
+
+    if (next == 0) {
+      (*mapped_addresses)[order[i]] = address;
+    } else {
+      const OMAP& omap = omaps[next - 1];
+      (*mapped_addresses)[order[i]] = core::RelativeAddress(omap.rvaTo) +
+          (address - core::RelativeAddress(omap.rva));
+    }
+  }
+}
+
+void OmapTranslator::Init(const std::vector<OMAP>& omaps) {
+  DCHECK(OmapVectorIsValid(omaps));
+
+  omaps_ = omaps;
+  page_starts_.clear();
+  if (omaps_.empty())
+    return;
+
+  size_t page_count = (omaps_.back().rva >> kPageBits) + 1;
+  page_starts_.resize(page_count + 1);
+  size_t index = 0;
+  for (size_t page = 0; page < page_count; ++page) {
+    while (index < omaps_.size() && (omaps_[index].rva >> kPageBits) < page)
+      ++index;
+    page_starts_[page] = static_cast<uint32_t>(index);
+  }
+  page_starts_[page_count] = static_cast<uint32_t>(omaps_.size());
+}
+
+core::RelativeAddress OmapTranslator::Translate(
+    core::RelativeAddress address) const {
+  if (omaps_.empty())
+    return address;
+
+  // The entries before the page of the address are all lower than it, and the
+  // entries after its page are all greater, so the first entry that is
+  // greater than the address is found among the entries of its page.
+  std::vector<OMAP>::const_iterator first = omaps_.end();
+  std::vector<OMAP>::const_iterator last = omaps_.end();
+  size_t page = address.value() >> kPageBits;
+  if (page + 1 < page_starts_.size()) {
+    first = omaps_.begin() + page_starts_[page];
+    last = omaps_.begin() + page_starts_[page + 1];
+  }
+  OMAP omap_address = CreateOmap(address.value(), 0);
+  std::vector<OMAP>::const_iterator it =
+      std::upper_bound(first, last, omap_address, OmapLess);
+
+  // If we are at the first OMAP entry, the address is before any addresses
+  // that are OMAPped. Thus, we return the same address.
+  if (it == omaps_.begin())
+    return address;
+
+  --it;
+  return core::RelativeAddress(it->rvaTo) +
+      (address - core::RelativeAddress(it->rva));
+}
+
 bool ReadOmapsFromPdbFile(const PdbFile& pdb_file,
                           std::vector<OMAP>* omap_to,
                           std::vector<OMAP>* omap_from) {
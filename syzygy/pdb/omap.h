@@ -19,6 +19,7 @@
 #include <dbghelp.h>
 #include <vector>
 
+#include "base/macros.h"
 #include "syzygy/core/address.h"
 #include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_reader.h"
@@ -54,6 +55,61 @@ bool OmapVectorIsValid(const std::vector<OMAP>& omaps);
 core::RelativeAddress TranslateAddressViaOmap(const std::vector<OMAP>& omaps,
                                               core::RelativeAddress address);
 
+// Maps a batch of addresses through the given OMAP information. The
+// addresses are sorted and resolved in a single pass over the OMAPs, which is
+// faster than translating them one by one when there are many of them.
+//
+// @param omaps the vector of OMAPs to apply.
+// @param addresses the addresses to map.
+// @param mapped_addresses receives the mapped addresses, in the order of
+//     @p addresses.
+// @pre OmapIsValid(omaps) is true.
+void TranslateAddressesViaOmap(
+    const std::vector<OMAP>& omaps,
+    const std::vector<core::RelativeAddress>& addresses,
+    std::vector<core::RelativeAddress>* mapped_addresses);
+
+// Maps addresses through OMAP information, with a table indexed by page that
+// narrows the lookup of each address to the OMAP entries of its page. This is
+// meant for the clients that translate a lot of addresses through the same
+// OMAP information.
+class OmapTranslator {
+ public:
+  // The log2 of the size of the pages of the lookup table.
+  static const size_t kPageBits = 12;
+
+  // Creates a translator that leaves the addresses unchanged.
+  OmapTranslator() { }
+
+  // Creates a translator for the given OMAP information.
+  // @param omaps the vector of OMAPs to apply.
+  // @pre OmapIsValid(omaps) is true.
+  explicit OmapTranslator(const std::vector<OMAP>& omaps) { Init(omaps); }
+
+  // Initializes the translator with the given OMAP information.
+  // @param omaps the vector of OMAPs to apply. It is copied.
+  // @pre OmapIsValid(omaps) is true.
+  void Init(const std::vector<OMAP>& omaps);
+
+  // Maps an address. This returns the same address as
+  // TranslateAddressViaOmap.
+  // @param address the address to map.
+  // @returns the mapped address.
+  core::RelativeAddress Translate(core::RelativeAddress address) const;
+
+  // @returns the OMAP information of the translator.
+  const std::vector<OMAP>& omaps() const { return omaps_; }
+
+ private:
+  std::vector<OMAP> omaps_;
+
+  // The index of the first OMAP entry at or after the start of each page, up
+  // to the page of the last entry, plus the number of entries.
+  std::vector<uint32_t> page_starts_;
+
+  DISALLOW_COPY_AND_ASSIGN(OmapTranslator);
+};
+
 // Reads OMAP tables from a PdbFile. The destination vectors may be NULL if
 // they are not required to be read. Even if neither stream is read they will be
 // checked for existence.
@@ -82,6 +82,60 @@ TEST(OmapTest, Translate) {
             TranslateAddressViaOmap(omaps, RelativeAddress(3500)));
 }
 
+TEST(OmapTest, TranslateAddresses) {
+  std::vector<OMAP> omaps;
+  omaps.push_back(CreateOmap(1000, 2000));
+  omaps.push_back(CreateOmap(2000, 1000));
+  omaps.push_back(CreateOmap(3000, 3000));
+
+  std::vector<RelativeAddress> addresses;
+  addresses.push_back(RelativeAddress(3500));
+  addresses.push_back(RelativeAddress(500));
+  addresses.push_back(RelativeAddress(2500));
+  addresses.push_back(RelativeAddress(1500));
+  addresses.push_back(RelativeAddress(500));
+
+  // The addresses are mapped in their original order.
+  std::vector<RelativeAddress> mapped_addresses;
+  TranslateAddressesViaOmap(omaps, addresses, &mapped_addresses);
+  ASSERT_EQ(addresses.size(), mapped_addresses.size());
+  for (size_t i = 0; i < addresses.size(); ++i) {
+    EXPECT_EQ(TranslateAddressViaOmap(omaps, addresses[i]),
+              mapped_addresses[i]);
+  }
+
+  // Without OMAP entries the addresses are unchanged.
+  TranslateAddressesViaOmap(std::vector<OMAP>(), addresses, &mapped_addresses);
+  EXPECT_EQ(addresses, mapped_addresses);
+}
+
+TEST(OmapTest, OmapTranslator) {
+  // Entries on several pages, with some pages without entries.
+  std::vector<OMAP> omaps;
+  omaps.push_back(CreateOmap(0x1000, 0x9000));
+  omaps.push_back(CreateOmap(0x1010, 0x1010));
+  omaps.push_back(CreateOmap(0x1FFF, 0xA000));
+  omaps.push_back(CreateOmap(0x5000, 0x2000));
+  omaps.push_back(CreateOmap(0x5800, 0x5800));
+  ASSERT_TRUE(OmapVectorIsValid(omaps));
+
+  OmapTranslator translator(omaps);
+  EXPECT_EQ(omaps.size(), translator.omaps().size());
+  for (uint32_t rva = 0; rva < 0x7000; rva += 7) {
+    EXPECT_EQ(TranslateAddressViaOmap(omaps, RelativeAddress(rva)),
+              translator.Translate(RelativeAddress(rva)));
+  }
+  for (size_t i = 0; i < omaps.size(); ++i) {
+    EXPECT_EQ(RelativeAddress(omaps[i].rvaTo),
+              translator.Translate(RelativeAddress(omaps[i].rva)));
+  }
+
+  // An empty translator leaves the addresses unchanged.
+  OmapTranslator empty_translator;
+  EXPECT_EQ(RelativeAddress(0x1234),
+            empty_translator.Translate(RelativeAddress(0x1234)));
+}
+
 TEST(OmapTest, ReadOmapsFromPdbFile) {
   std::vector<OMAP> omap_to, omap_from;
 
@@ -16,7 +16,9 @@
 
 #include <string>
 
+#include "base/bind.h"
 #include "base/strings/stringprintf.h"
+#include "syzygy/application/work_pool.h"
 #include "syzygy/common/align.h"
 #include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_stream_reader.h"
@@ -27,6 +29,44 @@ namespace cci = Microsoft_Cci_Pdb;
 
 namespace pdb {
 
+namespace {
+
+// Forwards the symbols of a module to a module symbol visitor.
+bool VisitModuleSymbol(const VisitModuleSymbolsCallback& callback,
+                       size_t module_index,
+                       uint16_t symbol_length,
+                       uint16_t symbol_type,
+                       common::BinaryStreamReader* symbol_reader) {
+  return callback.Run(module_index, symbol_length, symbol_type, symbol_reader);
+}
+
+// Visits the symbols of a module, as the work items of a WorkPool.
+// @param callback the callback to be invoked for each symbol.
+// @param modules the modules of the DBI stream.
+// @param streams the symbol stream of each module, or NULL for the modules
+//     that don't have one.
+// @param index the index of the module.
+// @returns true on success, false otherwise.
+bool VisitSymbolsOfModule(const VisitModuleSymbolsCallback* callback,
+                          const DbiStream::DbiModuleVector* modules,
+                          const std::vector<PdbStream*>* streams,
+                          size_t index) {
+  PdbStream* stream = streams->at(index);
+  size_t symbol_bytes = modules->at(index).module_info_base().symbol_bytes;
+  if (stream == NULL || symbol_bytes == 0)
+    return true;
+
+  VisitSymbolsCallback symbol_callback = base::Bind(
+      &VisitModuleSymbol, base::ConstRef(*callback), index);
+  if (!VisitSymbols(symbol_callback, 0, symbol_bytes, true, stream)) {
+    LOG(ERROR) << "Failed to visit the symbols of module " << index << ".";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
 bool ReadSymbolRecord(PdbStream* stream,
                       size_t symbol_table_offset,
                       size_t symbol_table_size,
@@ -160,4 +200,37 @@ bool VisitSymbols(VisitSymbolsCallback callback,
   return true;
 }
 
+bool VisitModuleSymbols(VisitModuleSymbolsCallback callback,
+                        const DbiStream& dbi_stream,
+                        const PdbFile& pdb_file,
+                        size_t thread_count) {
+  DCHECK_LT(0u, thread_count);
+
+  // The streams are looked up here, as the PDB file isn't thread-safe. The
+  // PDB file holds them while they are visited, and each of them is only
+  // referred to by the thread that visits its module.
+  const DbiStream::DbiModuleVector& modules = dbi_stream.modules();
+  std::vector<PdbStream*> streams(modules.size(), NULL);
+  for (size_t i = 0; i < modules.size(); ++i) {
+    int16_t stream_index = modules[i].module_info_base().stream;
+    if (stream_index < 0)
+      continue;
+    if (static_cast<size_t>(stream_index) >= pdb_file.StreamCount()) {
+      LOG(ERROR) << "Invalid symbol stream index for module " << i << ".";
+      return false;
+    }
+    PdbStream* stream = pdb_file.GetStream(stream_index).get();
+    if (stream != NULL &&
+        modules[i].module_info_base().symbol_bytes > stream->length()) {
+      LOG(ERROR) << "The symbols of module " << i << " exceed their stream.";
+      return false;
+    }
+    streams[i] = stream;
+  }
+
+  application::WorkPool pool(thread_count);
+  return pool.Run(modules.size(), base::Bind(&VisitSymbolsOfModule, &callback,
+                                             &modules, &streams));
+}
+
 }  // namespace pdb
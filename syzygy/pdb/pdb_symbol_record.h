@@ -23,6 +23,8 @@
 #include "base/callback.h"
 #include "syzygy/common/binary_stream.h"
 #include "syzygy/pdb/pdb_data_types.h"
+#include "syzygy/pdb/pdb_dbi_stream.h"
+#include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_stream.h"
 
 namespace pdb {
@@ -65,6 +67,31 @@ bool VisitSymbols(VisitSymbolsCallback callback,
                   bool has_header,
                   PdbStream* symbols);
 
+// Defines a module symbol visitor callback. This is the same as a
+// VisitSymbolsCallback, with the index in the DBI stream of the module whose
+// symbol is visited. The symbols of a module are visited in order, on a
+// single thread, but the symbols of different modules are visited
+// concurrently, so the callback must be thread-safe.
+typedef base::Callback<bool(size_t /* module_index */,
+                            uint16_t /* symbol_length */,
+                            uint16_t /* symbol_type */,
+                            common::BinaryStreamReader* /* symbol_reader */)>
+    VisitModuleSymbolsCallback;
+
+// Visits the symbols of all the module symbol streams of a PDB file, with
+// several threads. The module streams are independent, and the streams of
+// a PDB file that was read by PdbReader can be read concurrently.
+// @param callback The callback to be invoked for each symbol.
+// @param dbi_stream The DBI stream of @p pdb_file, which lists the modules.
+// @param pdb_file The PDB file containing the module symbol streams.
+// @param thread_count The number of threads to use, which must be at least 1.
+// @returns true on success, false otherwise. On failure the remaining
+//     modules may not be visited.
+bool VisitModuleSymbols(VisitModuleSymbolsCallback callback,
+                        const DbiStream& dbi_stream,
+                        const PdbFile& pdb_file,
+                        size_t thread_count);
+
 }  // namespace pdb
 
 #endif  // SYZYGY_PDB_PDB_SYMBOL_RECORD_H_
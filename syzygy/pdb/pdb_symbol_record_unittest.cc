@@ -14,6 +14,8 @@
 
 #include "syzygy/pdb/pdb_symbol_record.h"
 
+#include <vector>
+
 #include "base/bind.h"
 #include "base/files/file_util.h"
 #include "gmock/gmock.h"
@@ -21,6 +23,8 @@
 #include "syzygy/common/binary_stream.h"
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
+#include "syzygy/pdb/pdb_constants.h"
+#include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/unittest_util.h"
 #include "third_party/cci/Files/CvInfo.h"
 
@@ -50,6 +54,32 @@ class MockVisitorImpl {
 };
 typedef testing::StrictMock<MockVisitorImpl> MockVisitor;
 
+// Counts the symbols of each module. Each module is visited by a single
+// thread, so the counts don't need to be synchronized.
+bool CountModuleSymbol(std::vector<size_t>* counts,
+                       size_t module_index,
+                       uint16_t symbol_length,
+                       uint16_t symbol_type,
+                       common::BinaryStreamReader* symbol_reader) {
+  ++counts->at(module_index);
+  return true;
+}
+
+bool CountSymbol(size_t* count,
+                 uint16_t symbol_length,
+                 uint16_t symbol_type,
+                 common::BinaryStreamReader* symbol_reader) {
+  ++(*count);
+  return true;
+}
+
+bool FailModuleSymbol(size_t module_index,
+                      uint16_t symbol_length,
+                      uint16_t symbol_type,
+                      common::BinaryStreamReader* symbol_reader) {
+  return false;
+}
+
 }  // namespace
 
 #if 0
@@ -215,4 +245,53 @@ TEST_F(PdbVisitSymbolsTest, AllSymbolsVisitedNoHeader) {
   EXPECT_TRUE(VisitSymbols(callback, 0, reader->length(), false, reader.get()));
 }
 
+TEST(PdbVisitModuleSymbolsTest, VisitsAllModulesConcurrently) {
+  PdbReader reader;
+  PdbFile pdb_file;
+  ASSERT_TRUE(reader.Read(
+      testing::GetSrcRelativePath(testing::kTestPdbFilePath), &pdb_file));
+  DbiStream dbi_stream;
+  ASSERT_TRUE(dbi_stream.Read(pdb_file.GetStream(kDbiStream).get()));
+  const DbiStream::DbiModuleVector& modules = dbi_stream.modules();
+  ASSERT_LT(1u, modules.size());
+
+  // Count the symbols of each module sequentially.
+  std::vector<size_t> expected_counts(modules.size(), 0);
+  for (size_t i = 0; i < modules.size(); ++i) {
+    const DbiModuleInfoBase& module_info = modules[i].module_info_base();
+    if (module_info.stream < 0 || module_info.symbol_bytes == 0)
+      continue;
+    scoped_refptr<PdbStream> stream = pdb_file.GetStream(module_info.stream);
+    ASSERT_TRUE(stream.get() != nullptr);
+    VisitSymbolsCallback callback =
+        base::Bind(&CountSymbol, base::Unretained(&expected_counts[i]));
+    ASSERT_TRUE(VisitSymbols(callback, 0, module_info.symbol_bytes, true,
+                             stream.get()));
+  }
+
+  std::vector<size_t> counts(modules.size(), 0);
+  VisitModuleSymbolsCallback callback =
+      base::Bind(&CountModuleSymbol, base::Unretained(&counts));
+  EXPECT_TRUE(VisitModuleSymbols(callback, dbi_stream, pdb_file, 4));
+  EXPECT_EQ(expected_counts, counts);
+
+  // A single thread visits the same symbols.
+  std::vector<size_t> serial_counts(modules.size(), 0);
+  callback = base::Bind(&CountModuleSymbol, base::Unretained(&serial_counts));
+  EXPECT_TRUE(VisitModuleSymbols(callback, dbi_stream, pdb_file, 1));
+  EXPECT_EQ(expected_counts, serial_counts);
+}
+
+TEST(PdbVisitModuleSymbolsTest, FailsWhenCallbackFails) {
+  PdbReader reader;
+  PdbFile pdb_file;
+  ASSERT_TRUE(reader.Read(
+      testing::GetSrcRelativePath(testing::kTestPdbFilePath), &pdb_file));
+  DbiStream dbi_stream;
+  ASSERT_TRUE(dbi_stream.Read(pdb_file.GetStream(kDbiStream).get()));
+
+  VisitModuleSymbolsCallback callback = base::Bind(&FailModuleSymbol);
+  EXPECT_FALSE(VisitModuleSymbols(callback, dbi_stream, pdb_file, 4));
+}
+
 }  // namespace pdb
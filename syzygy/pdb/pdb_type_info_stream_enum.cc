@@ -14,14 +14,28 @@
 
 #include "syzygy/pdb/pdb_type_info_stream_enum.h"
 
+#include <algorithm>
+
 #include "base/strings/stringprintf.h"
-#include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_util.h"
 
 namespace pdb {
 
+namespace {
+
+// The stream number of a missing hash stream.
+const uint16_t kNoHashStream = 0xFFFF;
+
+}  // namespace
+
 TypeInfoEnumerator::TypeInfoEnumerator(PdbStream* stream)
+    : TypeInfoEnumerator(stream, nullptr) {
+}
+
+TypeInfoEnumerator::TypeInfoEnumerator(PdbStream* stream,
+                                       PdbStream* hash_stream)
     : stream_(stream),
+      hash_stream_(hash_stream),
       reader_(stream),
       data_end_(0),
       current_record_{},
@@ -68,7 +82,15 @@ bool TypeInfoEnumerator::Init() {
   type_id_ = type_info_header_.type_min - 1;
   type_id_min_ = type_info_header_.type_min;
   type_id_max_ = type_info_header_.type_max;
+  if (type_id_max_ < type_id_min_) {
+    LOG(ERROR) << "The type info stream has an invalid type ID range.";
+    return false;
+  }
+
+  if (!ReadTypeIndexOffsets())
+    return false;
 
+  located_records_.assign(type_id_max_ - type_id_min_, TypeRecordInfo());
   largest_located_id_ = type_id_min_ - 1;
   // Locate the first type info record - note that this may fail if the
   // stream is invalid or empty.
@@ -114,61 +136,129 @@ TypeInfoEnumerator::CreateRecordReader() {
   return BinaryTypeRecordReader(start_position(), len(), stream_.get());
 }
 
-bool TypeInfoEnumerator::EnsureTypeLocated(uint32_t type_id) {
-  DCHECK(stream_ != nullptr);
+bool TypeInfoEnumerator::ReadTypeIndexOffsets() {
+  type_index_offsets_.clear();
+  if (hash_stream_ == nullptr)
+    return true;
 
-  if (type_id >= type_id_max_ || type_id < type_id_min_)
+  const OffsetCb& offsets =
+      type_info_header_.type_info_hash.offset_cb_type_info_offset;
+  if (offsets.cb % sizeof(TypeIndexOffset) != 0 ||
+      offsets.offset > hash_stream_->length() ||
+      offsets.cb > hash_stream_->length() - offsets.offset) {
+    LOG(ERROR) << "The type index offsets of the hash stream are not valid.";
     return false;
-  if (type_id <= largest_located_id_)
+  }
+  if (offsets.cb == 0)
     return true;
 
-#ifndef NDEBUG
-  if (type_id > type_id_min_) {
-    TypeRecordInfo info = {};
-    bool found = FindRecordInfo(largest_located_id_, &info);
-    DCHECK(found);
-    DCHECK_EQ(info.start + info.length + sizeof(info.length),
-              reader_.Position());
+  type_index_offsets_.resize(offsets.cb / sizeof(TypeIndexOffset));
+  if (!hash_stream_->ReadBytesAt(offsets.offset, offsets.cb,
+                                 &type_index_offsets_.at(0))) {
+    LOG(ERROR) << "Unable to read the type index offsets.";
+    return false;
   }
-#endif
 
-  uint32_t current_type_id = largest_located_id_;
-  common::BinaryStreamParser parser(&reader_);
-  while (current_type_id < type_id) {
-    TypeRecordInfo next_info = {};
-    next_info.start = reader_.Position();
-    if (!parser.Read(&next_info.length)) {
-      LOG(ERROR) << "Unable to read a type info record length.";
-      return false;
-    }
-    if (!parser.Read(&next_info.type)) {
-      LOG(ERROR) << "Unable to read a type info record type.";
-      return false;
+  // The entries must be sorted, and refer to records of the stream.
+  for (size_t i = 0; i < type_index_offsets_.size(); ++i) {
+    const TypeIndexOffset& entry = type_index_offsets_[i];
+    bool valid = entry.type_id >= type_id_min_ &&
+                 entry.type_id < type_id_max_ &&
+                 entry.offset < type_info_header_.type_info_data_size;
+    if (valid && i > 0) {
+      const TypeIndexOffset& previous = type_index_offsets_[i - 1];
+      valid = previous.type_id < entry.type_id &&
+              previous.offset < entry.offset;
     }
-    if (!reader_.Consume(next_info.length - sizeof(next_info.type))) {
-      LOG(ERROR) << "Unable to consume type body.";
+    if (!valid) {
+      LOG(ERROR) << "Invalid type index offset for type " << entry.type_id
+                 << ".";
       return false;
     }
-
-    ++current_type_id;
-    bool added = AddRecordInfo(current_type_id, next_info);
-    DCHECK(added);
   }
 
-  return type_id == current_type_id;
+  return true;
 }
 
-bool TypeInfoEnumerator::AddRecordInfo(uint32_t type_id,
-                                       const TypeRecordInfo& info) {
+bool TypeInfoEnumerator::EnsureTypeLocated(uint32_t type_id) {
+  DCHECK(stream_ != nullptr);
+
   if (type_id >= type_id_max_ || type_id < type_id_min_)
     return false;
+  if (type_id <= largest_located_id_ ||
+      located_records_[type_id - type_id_min_].start != 0) {
+    return true;
+  }
+
+  // Start from the closest preceding record whose position is known. This is
+  // either the one that follows all the located records, or one from the
+  // index of the record offsets.
+  uint32_t current_type_id = type_id_min_;
+  size_t position = type_info_header_.len;
+  if (largest_located_id_ >= type_id_min_) {
+    const TypeRecordInfo& last =
+        located_records_[largest_located_id_ - type_id_min_];
+    current_type_id = largest_located_id_ + 1;
+    position = last.start + sizeof(last.length) + last.length;
+  }
+  auto entry = std::upper_bound(
+      type_index_offsets_.begin(), type_index_offsets_.end(), type_id,
+      [](uint32_t id, const TypeIndexOffset& entry) {
+        return id < entry.type_id;
+      });
+  if (entry != type_index_offsets_.begin()) {
+    --entry;
+    if (entry->type_id > current_type_id) {
+      current_type_id = entry->type_id;
+      position = type_info_header_.len + entry->offset;
+    }
+  }
+
+  // Crawl through the records up to the desired one, reusing the records
+  // that have already been located.
+  while (true) {
+    TypeRecordInfo& info = located_records_[current_type_id - type_id_min_];
+    if (info.start == 0) {
+      if (!ReadRecordInfo(position, &info))
+        return false;
+    }
+    DCHECK_EQ(position, info.start);
+    if (current_type_id == type_id)
+      break;
+    position = info.start + sizeof(info.length) + info.length;
+    ++current_type_id;
+  }
+
+  // Extend the run of located records.
+  while (largest_located_id_ + 1 < type_id_max_ &&
+         located_records_[largest_located_id_ + 1 - type_id_min_].start != 0) {
+    ++largest_located_id_;
+  }
+
+  return true;
+}
 
-  DCHECK_EQ(largest_located_id_ + 1, type_id);
-  DCHECK_EQ(located_records_.size(), largest_located_id_ - type_id_min_ + 1);
+bool TypeInfoEnumerator::ReadRecordInfo(size_t position,
+                                        TypeRecordInfo* info) {
+  DCHECK(info);
 
-  located_records_.push_back(info);
-  largest_located_id_ = type_id;
+  TypeRecordInfo record = {};
+  record.start = position;
+  if (position + sizeof(record.length) > data_end_ ||
+      !stream_->ReadBytesAt(position, sizeof(record.length),
+                            &record.length)) {
+    LOG(ERROR) << "Unable to read a type info record length.";
+    return false;
+  }
+  if (record.length < sizeof(record.type) ||
+      record.length > data_end_ - position - sizeof(record.length) ||
+      !stream_->ReadBytesAt(position + sizeof(record.length),
+                            sizeof(record.type), &record.type)) {
+    LOG(ERROR) << "Unable to read a type info record type.";
+    return false;
+  }
 
+  *info = record;
   return true;
 }
 
@@ -190,4 +280,17 @@ TypeInfoEnumerator::BinaryTypeRecordReader::BinaryTypeRecordReader(
     : PdbStreamReaderWithPosition(start_offset, len, stream) {
 }
 
+scoped_refptr<PdbStream> GetTypeInfoHashStream(const PdbFile& pdb_file,
+                                               PdbStream* stream) {
+  DCHECK(stream != nullptr);
+
+  TypeInfoHeader header = {};
+  if (!stream->ReadBytesAt(0, sizeof(header), &header))
+    return nullptr;
+  uint16_t hash_stream = header.type_info_hash.stream_number;
+  if (hash_stream == kNoHashStream || hash_stream >= pdb_file.StreamCount())
+    return nullptr;
+  return pdb_file.GetStream(hash_stream);
+}
+
 }  // namespace pdb
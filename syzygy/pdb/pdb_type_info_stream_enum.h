@@ -20,18 +20,24 @@
 #include <stdint.h>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include "base/callback.h"
 #include "base/memory/ref_counted.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
 #include "syzygy/pdb/pdb_data.h"
 #include "syzygy/pdb/pdb_data_types.h"
+#include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_stream.h"
 #include "syzygy/pdb/pdb_stream_reader.h"
 
 namespace pdb {
 
 // Simple type info stream enumerator which crawls through a type info stream.
+// The records are located lazily, and their positions are cached. When the
+// hash stream of the type info stream is provided, its index of the record
+// offsets is used to seek to any record without crawling through all the
+// records that precede it.
 class TypeInfoEnumerator {
  public:
   class BinaryTypeRecordReader;
@@ -40,6 +46,12 @@ class TypeInfoEnumerator {
   // @param stream the stream to parse.
   explicit TypeInfoEnumerator(PdbStream* stream);
 
+  // Creates an uninitialized enumerator for type info stream, which uses the
+  // index of the record offsets of a hash stream to seek to the records.
+  // @param stream the stream to parse.
+  // @param hash_stream the hash stream of @p stream. May be nullptr.
+  TypeInfoEnumerator(PdbStream* stream, PdbStream* hash_stream);
+
   // Initializes the enumerator with given stream. Needs to be called before
   // any further work.
   // @returns true on success, false means bad header format.
@@ -50,7 +62,9 @@ class TypeInfoEnumerator {
   // @returns true on success, false on failure.
   bool NextTypeInfoRecord();
 
-  // Moves position to the desired type id.
+  // Moves position to the desired type id. This is logarithmic in the number
+  // of records when the hash stream is provided, plus a scan of at most the
+  // records between two entries of its offset index.
   // @param type index of the desired record.
   // @returns true on success, false on failure.
   bool SeekRecord(uint32_t type_id);
@@ -107,27 +121,47 @@ class TypeInfoEnumerator {
     uint16_t length;
   };
 
+  // An entry of the index of the record offsets in the hash stream.
+  struct TypeIndexOffset {
+    // The type ID of the record.
+    uint32_t type_id;
+    // The offset of the record from the start of the type info data.
+    uint32_t offset;
+  };
+
+  // Reads and validates the index of the record offsets from the hash
+  // stream, if there is one.
+  // @returns true on success, false on failure.
+  bool ReadTypeIndexOffsets();
   // Ensure that the type with ID @p type_id has been located and stored
   // in @p located_records_.
   bool EnsureTypeLocated(uint32_t type_id);
-  // Adds the start position @p position for @p type_id, which must be a valid
-  // type id, and must be one larger than the last added start position.
-  bool AddRecordInfo(uint32_t type_id, const TypeRecordInfo& record);
+  // Reads the length and type of the record at @p position.
+  bool ReadRecordInfo(size_t position, TypeRecordInfo* record);
   bool FindRecordInfo(uint32_t type_id, TypeRecordInfo* record);
 
   // Pointer to the PDB type info stream.
   scoped_refptr<PdbStream> stream_;
 
+  // Pointer to the hash stream of the type info stream. May be nullptr.
+  scoped_refptr<PdbStream> hash_stream_;
+
+  // The index of the record offsets, sorted by type ID. This is empty if
+  // there's no hash stream.
+  std::vector<TypeIndexOffset> type_index_offsets_;
+
   // The reader used to parse out the locations of type records.
   PdbStreamReaderWithPosition reader_;
 
   // Header of the type info stream.
   TypeInfoHeader type_info_header_;
 
-  // A vector with the positions of located records.
+  // A vector with the positions of the records, by type ID. The records that
+  // haven't been located yet have a start position of zero.
   std::vector<TypeRecordInfo> located_records_;
 
-  // The largest type index we already saved in @p located_records_.
+  // The largest type index such that it and all the type indices below it
+  // have been located.
   uint32_t largest_located_id_;
 
   // Position of the end of data in the stream.
@@ -156,6 +190,13 @@ class TypeInfoEnumerator::BinaryTypeRecordReader
   BinaryTypeRecordReader(size_t start_offset, size_t len, PdbStream* stream);
 };
 
+// Gets the hash stream of a type info stream.
+// @param pdb_file the PDB file that contains @p stream.
+// @param stream the type info stream.
+// @returns the hash stream, or nullptr if there's none.
+scoped_refptr<PdbStream> GetTypeInfoHashStream(const PdbFile& pdb_file,
+                                               PdbStream* stream);
+
 }  // namespace pdb
 
 #endif  // SYZYGY_PDB_PDB_TYPE_INFO_STREAM_ENUM_H_
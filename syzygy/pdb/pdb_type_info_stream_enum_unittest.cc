@@ -17,6 +17,8 @@
 #include "base/files/file_util.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
+#include "syzygy/pdb/pdb_constants.h"
+#include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/unittest_util.h"
 
 namespace pdb {
@@ -163,6 +165,51 @@ TEST(PdbTypeInfoStreamEnumTest, ReadValidTypeInfoStreamWithReader) {
   EXPECT_EQ(kTestRecord + kOffset, enumerator.type_id());
 }
 
+TEST(PdbTypeInfoStreamEnumTest, SeekRecordWithHashStream) {
+  PdbReader reader;
+  PdbFile pdb_file;
+  ASSERT_TRUE(reader.Read(
+      testing::GetSrcRelativePath(testing::kTestPdbFilePath), &pdb_file));
+  scoped_refptr<PdbStream> stream = pdb_file.GetStream(kTpiStream);
+  ASSERT_TRUE(stream.get() != nullptr);
+  scoped_refptr<PdbStream> hash_stream =
+      GetTypeInfoHashStream(pdb_file, stream.get());
+  ASSERT_TRUE(hash_stream.get() != nullptr);
+
+  // The enumerator that uses the hash stream seeks to the same records as
+  // the one that crawls through the stream.
+  TypeInfoEnumerator enumerator(stream.get());
+  TypeInfoEnumerator hash_enumerator(stream.get(), hash_stream.get());
+  ASSERT_TRUE(enumerator.Init());
+  ASSERT_TRUE(hash_enumerator.Init());
+
+  const uint32_t kMinIndex = enumerator.type_info_header().type_min;
+  const uint32_t kMaxIndex = enumerator.type_info_header().type_max;
+  EXPECT_FALSE(hash_enumerator.SeekRecord(kMaxIndex));
+  EXPECT_FALSE(hash_enumerator.SeekRecord(kMinIndex - 1));
+
+  // Jump backwards through the stream, and then enumerate it from the start.
+  for (uint32_t type_id = kMaxIndex - 1; type_id >= kMinIndex;
+       type_id -= 97) {
+    ASSERT_TRUE(hash_enumerator.SeekRecord(type_id));
+    ASSERT_TRUE(enumerator.SeekRecord(type_id));
+    EXPECT_EQ(type_id, hash_enumerator.type_id());
+    EXPECT_EQ(enumerator.start_position(), hash_enumerator.start_position());
+    EXPECT_EQ(enumerator.len(), hash_enumerator.len());
+    EXPECT_EQ(enumerator.type(), hash_enumerator.type());
+  }
+
+  ASSERT_TRUE(enumerator.ResetStream());
+  ASSERT_TRUE(hash_enumerator.ResetStream());
+  while (!enumerator.EndOfStream()) {
+    ASSERT_TRUE(enumerator.NextTypeInfoRecord());
+    ASSERT_TRUE(hash_enumerator.NextTypeInfoRecord());
+    EXPECT_EQ(enumerator.type_id(), hash_enumerator.type_id());
+    EXPECT_EQ(enumerator.start_position(), hash_enumerator.start_position());
+  }
+  EXPECT_TRUE(hash_enumerator.EndOfStream());
+}
+
 TEST(PdbTypeInfoStreamEnumTest, EnumInvalidDataTypeInfoStream) {
   base::FilePath invalid_type_info_path =
       testing::GetSrcRelativePath(testing::kInvalidDataPdbTypeInfoStreamPath);
@@ -72,6 +72,10 @@ typedef std::map<std::pair<BlockGraph::Block*, BlockGraph::Offset>, size_t>
 // A map from section IDs to their (new) position in the resulting layout.
 typedef std::map<BlockGraph::SectionId, size_t> SectionIndexMap;
 
+// A map from the original addresses of the relocation blocks created by the
+// decomposer to the blocks.
+typedef std::map<core::RelativeAddress, BlockGraph::Block*> RelocBlockMap;
+
 // Microsoft specifications recommend 4-byte alignment for object files.
 const size_t kFileAlignment = 4;
 
@@ -189,13 +193,154 @@ bool AddRelocs(const BlockGraph::Block& block,
   return true;
 }
 
+// Check that a reference value would be written back unchanged by
+// WriteReferenceValue.
+//
+// @tparam ValueType the type of data to check.
+// @param ref the reference to check.
+// @param block_offset the offset of the reference within @p block.
+// @param block the block holding the reference.
+// @returns true if the value at @p block_offset is the one that would be
+//     written for @p ref.
+template <typename ValueType>
+bool HasReferenceValue(BlockGraph::Reference ref,
+                       BlockGraph::Offset block_offset,
+                       const BlockGraph::Block& block) {
+  DCHECK_EQ(sizeof(ValueType), ref.size());
+  ConstTypedBlock<ValueType> value;
+  if (!value.Init(block_offset, &block))
+    return false;
+  if ((ref.type() & BlockGraph::RELOC_REF_BIT) != 0)
+    return *value == static_cast<ValueType>(ref.offset() - ref.base());
+  return *value == static_cast<ValueType>(ref.offset());
+}
+
+// Determine whether a section block and its relocations are unchanged since
+// the decomposition of @p original_file, in which case both can be laid out
+// as they are. This is the case when the block still holds the original data
+// of its section, and when its references would be written back with the
+// same values and translated to the same relocations.
+//
+// @param original_file the decomposed object file.
+// @param section the section of @p block.
+// @param block the single block of @p section.
+// @param reloc_blocks the relocation blocks created by the decomposer.
+// @param symbol_map the symbol map to use to match references with symbols.
+// @param relocs_block receives the original relocation block of the section,
+//     or NULL if it has no relocations.
+// @returns true if @p block and its relocations can be kept verbatim.
+bool IsSectionUnchanged(const CoffFile& original_file,
+                        const BlockGraph::Section& section,
+                        const BlockGraph::Block& block,
+                        const RelocBlockMap& reloc_blocks,
+                        const SymbolMap& symbol_map,
+                        BlockGraph::Block** relocs_block) {
+  DCHECK(relocs_block != NULL);
+
+  // Section IDs match the indexes of the sections in the original file.
+  if (section.id() >= original_file.file_header()->NumberOfSections)
+    return false;
+  size_t section_index = section.id();
+  const IMAGE_SECTION_HEADER* header =
+      original_file.section_header(section_index);
+  DCHECK(header != NULL);
+  if (header->Characteristics != section.characteristics() ||
+      (header->Characteristics & IMAGE_SCN_LNK_NRELOC_OVFL) != 0 ||
+      header->VirtualAddress != 0 ||
+      !original_file.IsSectionMapped(section_index)) {
+    return false;
+  }
+
+  // The block must still point to the data of the original file; blocks
+  // whose data was modified own a copy.
+  FileOffsetAddress data_addr;
+  if (block.owns_data() || block.size() != header->SizeOfRawData ||
+      block.data_size() != header->SizeOfRawData ||
+      !original_file.SectionOffsetToFileOffset(section_index, 0, &data_addr) ||
+      block.data() != original_file.GetImageData(data_addr,
+                                                 header->SizeOfRawData)) {
+    return false;
+  }
+
+  // The same goes for the original relocation table.
+  const IMAGE_RELOCATION* relocs = NULL;
+  size_t num_relocs = header->NumberOfRelocations;
+  *relocs_block = NULL;
+  if (num_relocs != 0) {
+    RelocBlockMap::const_iterator reloc_it = reloc_blocks.find(
+        core::RelativeAddress(header->PointerToRelocations));
+    if (reloc_it == reloc_blocks.end())
+      return false;
+    size_t relocs_size = num_relocs * sizeof(IMAGE_RELOCATION);
+    const BlockGraph::Block* reloc_block = reloc_it->second;
+    if (reloc_block->owns_data() || reloc_block->data_size() != relocs_size ||
+        reloc_block->data() != original_file.GetImageData(
+            FileOffsetAddress(header->PointerToRelocations), relocs_size)) {
+      return false;
+    }
+    relocs = reinterpret_cast<const IMAGE_RELOCATION*>(reloc_block->data());
+    *relocs_block = reloc_it->second;
+  }
+
+  // Check the references in order of increasing offset against the
+  // relocations, which AddRelocs would emit in the same order.
+  size_t reloc_index = 0;
+  BlockGraph::Block::ReferenceMap::const_iterator it =
+      block.references().begin();
+  for (; it != block.references().end(); ++it) {
+    const BlockGraph::Reference& ref = it->second;
+    if ((ref.type() & BlockGraph::RELOC_REF_BIT) == 0 &&
+        ref.type() != BlockGraph::SECTION_OFFSET_REF) {
+      return false;
+    }
+
+    switch (ref.size()) {
+      case sizeof(uint32_t):
+        if (!HasReferenceValue<uint32_t>(ref, it->first, block))
+          return false;
+        break;
+      case sizeof(uint16_t):
+        if (!HasReferenceValue<uint16_t>(ref, it->first, block))
+          return false;
+        break;
+      case sizeof(uint8_t):
+        break;
+      default:
+        return false;
+    }
+
+    if ((ref.type() & BlockGraph::RELOC_REF_BIT) == 0)
+      continue;
+
+    if (reloc_index == num_relocs)
+      return false;
+    const IMAGE_RELOCATION& reloc = relocs[reloc_index++];
+    uint16_t reloc_type = 0;
+    if (reloc.VirtualAddress != static_cast<DWORD>(it->first) ||
+        !GetCoffRelocationType(ref.type(), ref.size(), &reloc_type) ||
+        reloc.Type != reloc_type) {
+      return false;
+    }
+    SymbolMap::const_iterator symbol_it = symbol_map.find(
+        std::make_pair(ref.referenced(), ref.base()));
+    if (symbol_it == symbol_map.end() ||
+        reloc.SymbolTableIndex != symbol_it->second) {
+      return false;
+    }
+  }
+
+  return reloc_index == num_relocs;
+}
+
 }  // namespace
 
 CoffImageLayoutBuilder::CoffImageLayoutBuilder(ImageLayout* image_layout)
     : PECoffImageLayoutBuilder(image_layout),
       headers_block_(NULL),
       symbols_block_(NULL),
-      strings_block_(NULL) {
+      strings_block_(NULL),
+      original_file_(NULL),
+      verbatim_section_count_(0) {
   PECoffImageLayoutBuilder::Init(kFileAlignment, kFileAlignment);
 }
 
@@ -333,6 +478,23 @@ bool CoffImageLayoutBuilder::LayoutSectionBlocks(
   }
   DCHECK(it == symbols_block_->references().end());
 
+  // Collect the relocation blocks created by the decomposer, which are
+  // reused for the sections that are kept verbatim.
+  RelocBlockMap reloc_blocks;
+  if (original_file_ != NULL) {
+    BlockGraph::BlockMap::iterator block_it =
+        image_layout_->blocks.graph()->blocks_mutable().begin();
+    for (; block_it != image_layout_->blocks.graph()->blocks().end();
+         ++block_it) {
+      BlockGraph::Block* block = &block_it->second;
+      if ((block->attributes() & BlockGraph::COFF_RELOC_DATA) != 0 &&
+          block->addr() != core::RelativeAddress::kInvalidAddress) {
+        reloc_blocks.insert(std::make_pair(block->addr(), block));
+      }
+    }
+  }
+  verbatim_section_count_ = 0;
+
   // Lay out section and relocation blocks.
   OrderedBlockGraph::SectionList::const_iterator section_it =
       ordered_graph.ordered_sections().begin();
@@ -364,6 +526,18 @@ bool CoffImageLayoutBuilder::LayoutSectionBlocks(
     FileOffsetAddress section_start(cursor_.value());
     RelocVector relocs;
 
+    // Sections whose single block is unchanged are laid out along with their
+    // original relocations, without rewriting their references.
+    BlockGraph::Block* verbatim_relocs_block = NULL;
+    bool verbatim = false;
+    if (original_file_ != NULL &&
+        (*section_it)->ordered_blocks().size() == 1) {
+      verbatim = IsSectionUnchanged(*original_file_, *section,
+                                    *(*section_it)->ordered_blocks().front(),
+                                    reloc_blocks, symbol_map,
+                                    &verbatim_relocs_block);
+    }
+
     // Lay out section blocks and collect relocations.
     OrderedBlockGraph::BlockList::const_iterator block_it =
         (*section_it)->ordered_blocks().begin();
@@ -376,6 +550,12 @@ bool CoffImageLayoutBuilder::LayoutSectionBlocks(
              (block->attributes() &
               (BlockGraph::SECTION_CONTRIB | BlockGraph::COFF_BSS)) != 0);
 
+      if (verbatim) {
+        if (!LayoutBlock(block))
+          return false;
+        continue;
+      }
+
       // Fix references.
       BlockGraph::Block::ReferenceMap::const_iterator ref_it =
           block->references().begin();
@@ -437,6 +617,18 @@ bool CoffImageLayoutBuilder::LayoutSectionBlocks(
     }
     DCHECK_EQ(header->Characteristics, info.characteristics);
 
+    // Lay out the original relocations of a verbatim section, if any.
+    if (verbatim) {
+      ++verbatim_section_count_;
+      if (verbatim_relocs_block != NULL) {
+        header->PointerToRelocations = cursor_.value();
+        header->NumberOfRelocations = static_cast<WORD>(
+            verbatim_relocs_block->data_size() / sizeof(IMAGE_RELOCATION));
+        if (!LayoutBlockImpl(verbatim_relocs_block))
+          return false;
+      }
+    }
+
     // Lay out relocations, if necessary.
     if (relocs.size() != 0) {
       size_t relocs_size = relocs.size() * sizeof(relocs[0]);
@@ -23,6 +23,7 @@
 
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/block_graph/ordered_block_graph.h"
+#include "syzygy/pe/coff_file.h"
 #include "syzygy/pe/image_layout.h"
 #include "syzygy/pe/pe_coff_image_layout_builder.h"
 
@@ -39,6 +40,26 @@ class CoffImageLayoutBuilder : public PECoffImageLayoutBuilder {
   // @param image_layout The image layout object to populate.
   explicit CoffImageLayoutBuilder(ImageLayout* image_layout);
 
+  // Sets the object file the block graph was decomposed from. When set, the
+  // section blocks that still hold their original data, and whose references
+  // would be written back unchanged, are laid out as they are along with
+  // their original relocation tables, rather than having their references
+  // rewritten and their relocations rebuilt. This is typically the case for
+  // the .debug$S and .debug$T sections of the functions that weren't
+  // transformed. The output is the same either way.
+  // @param original_file the decomposed object file, or NULL to rebuild all
+  //     the sections. It must outlive the builder.
+  void set_original_file(const CoffFile* original_file) {
+    original_file_ = original_file;
+  }
+
+  // @returns the decomposed object file, or NULL if there is none.
+  const CoffFile* original_file() const { return original_file_; }
+
+  // @returns the number of sections whose block and relocations were laid
+  //     out as they were in the original file by the last LayoutImage.
+  size_t verbatim_section_count() const { return verbatim_section_count_; }
+
   // Lay out the image according to the specified ordering.
   //
   // @param ordered_graph the ordered block graph; the underlying block
@@ -88,6 +109,12 @@ class CoffImageLayoutBuilder : public PECoffImageLayoutBuilder {
   // The block containing the string table.
   BlockGraph::Block* strings_block_;
 
+  // The object file the block graph was decomposed from, if any.
+  const CoffFile* original_file_;
+
+  // The number of sections laid out verbatim.
+  size_t verbatim_section_count_;
+
   DISALLOW_COPY_AND_ASSIGN(CoffImageLayoutBuilder);
 };
 
@@ -17,6 +17,7 @@
 #include <cstring>
 
 #include "base/command_line.h"
+#include "base/files/file_util.h"
 #include "base/process/launch.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -95,7 +96,8 @@ void MakeCommandLineString(const base::CommandLine::StringVector& args,
 
 class CoffImageLayoutBuilderTest : public testing::PELibUnitTest {
  public:
-  CoffImageLayoutBuilderTest() : image_layout_(&block_graph_) {
+  CoffImageLayoutBuilderTest()
+      : image_layout_(&block_graph_), verbatim_section_count_(0) {
   }
 
   virtual void SetUp() override {
@@ -119,17 +121,32 @@ class CoffImageLayoutBuilderTest : public testing::PELibUnitTest {
   // Reorder and lay out test_dll.coff_obj into a new object file, located
   // at new_test_dll_obj_path_.
   void LayoutAndWriteNew(block_graph::BlockGraphOrdererInterface* orderer) {
+    ASSERT_NO_FATAL_FAILURE(LayoutAndWrite(orderer, NULL, image_layout_,
+                                           new_test_dll_obj_path_));
+  }
+
+  // Reorder and lay out a decomposed object file into a new object file.
+  // @param orderer the orderer to apply.
+  // @param original_file the decomposed object file, whose unchanged sections
+  //     are kept verbatim, or NULL to rebuild all the sections.
+  // @param image_layout the layout of the decomposed object file.
+  // @param path the path of the new object file.
+  void LayoutAndWrite(block_graph::BlockGraphOrdererInterface* orderer,
+                      const CoffFile* original_file,
+                      const ImageLayout& image_layout,
+                      const base::FilePath& path) {
     DCHECK(orderer != NULL);
+    BlockGraph* block_graph = image_layout.blocks.graph();
 
     // Fetch headers block.
     ConstTypedBlock<IMAGE_FILE_HEADER> file_header;
     BlockGraph::Block* headers_block =
-        image_layout_.blocks.GetBlockByAddress(RelativeAddress(0));
+        image_layout.blocks.GetBlockByAddress(RelativeAddress(0));
     ASSERT_TRUE(headers_block != NULL);
     ASSERT_TRUE(file_header.Init(0, headers_block));
 
     // Reorder using the specified ordering.
-    OrderedBlockGraph ordered_graph(&block_graph_);
+    OrderedBlockGraph ordered_graph(block_graph);
     ASSERT_TRUE(orderer->OrderBlockGraph(&ordered_graph, headers_block));
 
     // Wipe references from headers, so we can remove relocation blocks
@@ -137,13 +154,15 @@ class CoffImageLayoutBuilderTest : public testing::PELibUnitTest {
     ASSERT_TRUE(headers_block->RemoveAllReferences());
 
     // Lay out new image.
-    ImageLayout new_image_layout(&block_graph_);
+    ImageLayout new_image_layout(block_graph);
     CoffImageLayoutBuilder layout_builder(&new_image_layout);
+    layout_builder.set_original_file(original_file);
     ASSERT_TRUE(layout_builder.LayoutImage(ordered_graph));
+    verbatim_section_count_ = layout_builder.verbatim_section_count();
 
     // Write temporary image file.
     CoffFileWriter writer(&new_image_layout);
-    ASSERT_TRUE(writer.WriteImage(new_test_dll_obj_path_));
+    ASSERT_TRUE(writer.WriteImage(path));
   }
 
   // Decompose, reorder, and lay out test_dll.coff_obj.
@@ -214,6 +233,9 @@ class CoffImageLayoutBuilderTest : public testing::PELibUnitTest {
   CoffFile image_file_;
   BlockGraph block_graph_;
   ImageLayout image_layout_;
+
+  // The number of sections kept verbatim by the last layout.
+  size_t verbatim_section_count_;
 };
 
 bool IsDebugBlock(const BlockGraph::Block& block, const BlockGraph& graph) {
@@ -402,6 +424,63 @@ TEST_F(CoffImageLayoutBuilderTest, ShiftedCode) {
   }
 }
 
+TEST_F(CoffImageLayoutBuilderTest, VerbatimSectionsMatchRebuiltSections) {
+  block_graph::orderers::OriginalOrderer orig_orderer;
+  ASSERT_NO_FATAL_FAILURE(RewriteTestDllObj(&orig_orderer));
+  EXPECT_EQ(0u, verbatim_section_count_);
+
+  // Decompose the object file again and keep its unchanged sections, which
+  // are all of them.
+  CoffFile image_file;
+  ASSERT_TRUE(image_file.Init(test_dll_obj_path_));
+  CoffDecomposer decomposer(image_file);
+  BlockGraph block_graph;
+  ImageLayout image_layout(&block_graph);
+  ASSERT_TRUE(decomposer.Decompose(&image_layout));
+  base::FilePath verbatim_path = temp_dir_path_.Append(L"verbatim.obj");
+  ASSERT_NO_FATAL_FAILURE(LayoutAndWrite(&orig_orderer, &image_file,
+                                         image_layout, verbatim_path));
+  EXPECT_LT(0u, verbatim_section_count_);
+
+  // The output is the same as when the sections are rebuilt.
+  std::string rebuilt_data;
+  std::string verbatim_data;
+  ASSERT_TRUE(base::ReadFileToString(new_test_dll_obj_path_, &rebuilt_data));
+  ASSERT_TRUE(base::ReadFileToString(verbatim_path, &verbatim_data));
+  EXPECT_EQ(rebuilt_data, verbatim_data);
+}
+
+TEST_F(CoffImageLayoutBuilderTest, VerbatimSectionsSkipShiftedCode) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeOriginal());
+
+  // Shift the first code block. Its section and the debug section that
+  // refers to it can't be kept verbatim anymore.
+  BlockGraph::BlockMap& blocks = block_graph_.blocks_mutable();
+  BlockGraph::BlockMap::iterator it = blocks.begin();
+  for (; it != blocks.end(); ++it) {
+    if (it->second.type() == BlockGraph::CODE_BLOCK)
+      break;
+  }
+  ASSERT_TRUE(it != blocks.end());
+  it->second.InsertData(0, 1, false);
+  it->second.GetMutableData()[0] = testing::kNop1[0];
+
+  block_graph::orderers::OriginalOrderer orig_orderer;
+  ASSERT_NO_FATAL_FAILURE(LayoutAndWrite(&orig_orderer, &image_file_,
+                                         image_layout_,
+                                         new_test_dll_obj_path_));
+  EXPECT_LT(0u, verbatim_section_count_);
+  EXPECT_GT(image_layout_.sections.size(), verbatim_section_count_);
+
+  // The new object file still decomposes.
+  CoffFile image_file;
+  ASSERT_TRUE(image_file.Init(new_test_dll_obj_path_));
+  CoffDecomposer decomposer(image_file);
+  BlockGraph block_graph;
+  ImageLayout image_layout(&block_graph);
+  EXPECT_TRUE(decomposer.Decompose(&image_layout));
+}
+
 TEST_F(CoffImageLayoutBuilderTest, RedecomposePE) {
   block_graph::orderers::OriginalOrderer orig_orderer;
   ASSERT_NO_FATAL_FAILURE(RewriteTestDllObj(&orig_orderer));
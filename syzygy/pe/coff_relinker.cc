@@ -70,10 +70,13 @@ bool Decompose(const CoffFile& image_file,
 //
 // @param ordered_graph the ordered block graph to lay out.
 // @param headers_block the headers block in @p ordered_graph.
+// @param original_file the COFF file the block graph was decomposed from.
+//     Its unchanged sections are copied verbatim.
 // @param image_layout the image layout to fill with the results.
 // @returns true on success, or false on failure.
 bool BuildImageLayout(const OrderedBlockGraph& ordered_graph,
                       BlockGraph::Block* headers_block,
+                      const CoffFile& original_file,
                       ImageLayout* image_layout) {
   DCHECK(headers_block != NULL);
   DCHECK(image_layout != NULL);
@@ -81,10 +84,13 @@ bool BuildImageLayout(const OrderedBlockGraph& ordered_graph,
   LOG(INFO) << "Building image layout.";
 
   CoffImageLayoutBuilder builder(image_layout);
+  builder.set_original_file(&original_file);
   if (!builder.LayoutImage(ordered_graph)) {
     LOG(ERROR) << "Image layout failed.";
     return false;
   }
+  LOG(INFO) << "Copied " << builder.verbatim_section_count()
+            << " unchanged sections verbatim.";
 
   return true;
 }
@@ -130,8 +136,11 @@ bool CoffRelinker::Init() {
   }
 
   // Decompose the image.
-  if (!Decompose(input_image_file_, &input_image_layout_, &headers_block_))
-    return false;
+  {
+    core::PerfReport::ScopedPhase phase(perf_report_, "decompose");
+    if (!Decompose(input_image_file_, &input_image_layout_, &headers_block_))
+      return false;
+  }
 
   inited_ = true;
 
@@ -158,9 +167,14 @@ bool CoffRelinker::Relink() {
   std::vector<Transform*> post_transforms;
   post_transforms.push_back(&fix_refs_tx);
   post_transforms.push_back(&prep_headers_tx);
-  if (!block_graph::ApplyBlockGraphTransforms(
-           post_transforms, transform_policy_, &block_graph_, headers_block_)) {
-    return false;
+  {
+    core::PerfReport::ScopedPhase phase(perf_report_, "finalize block graph");
+    if (!block_graph::ApplyBlockGraphTransforms(post_transforms,
+                                                transform_policy_,
+                                                &block_graph_,
+                                                headers_block_)) {
+      return false;
+    }
   }
 
   OrderedBlockGraph ordered_graph(&block_graph_);
@@ -169,14 +183,20 @@ bool CoffRelinker::Relink() {
 
   // Lay it out.
   ImageLayout output_image_layout(&block_graph_);
-  if (!BuildImageLayout(ordered_graph, headers_block_,
-                        &output_image_layout)) {
-    return false;
+  {
+    core::PerfReport::ScopedPhase phase(perf_report_, "layout");
+    if (!BuildImageLayout(ordered_graph, headers_block_, input_image_file_,
+                          &output_image_layout)) {
+      return false;
+    }
   }
 
   // Write the image.
-  if (!WriteImage(output_image_layout, output_path_))
-    return false;
+  {
+    core::PerfReport::ScopedPhase phase(perf_report_, "write image");
+    if (!WriteImage(output_image_layout, output_path_))
+      return false;
+  }
 
   return true;
 }
@@ -14,13 +14,20 @@
 
 #include "syzygy/pe/decomposer.h"
 
+#include <algorithm>
+#include <iterator>
+
 #include "pcrecpp.h"  // NOLINT
 #include "base/bind.h"
+#include "base/environment.h"
+#include "base/files/file_util.h"
 #include "base/strings/string_split.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/sys_info.h"
 #include "base/win/scoped_bstr.h"
 #include "base/win/scoped_comptr.h"
+#include "syzygy/application/work_pool.h"
 #include "syzygy/core/zstream.h"
 #include "syzygy/pdb/omap.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
@@ -32,6 +39,7 @@
 #include "syzygy/pdb/pdb_util.h"
 #include "syzygy/pe/dia_util.h"
 #include "syzygy/pe/find.h"
+#include "syzygy/pe/pdb_info.h"
 #include "syzygy/pe/pe_file_parser.h"
 #include "syzygy/pe/pe_utils.h"
 #include "syzygy/pe/serialization.h"
@@ -222,6 +230,94 @@ bool IsBuiltBySupportedCompiler(IDiaSymbol* compiland) {
   return false;
 }
 
+// The compiland details symbols, which hold the name of the compiler as a
+// zero-terminated string at these offsets. S_COMPILE3 is declared in
+// cvinfo_ext.h, which doesn't mix with the CCI headers used here.
+const uint16_t kCompile3SymbolType = 0x113C;
+const size_t kCompile2CompilerNameOffset = 18;
+const size_t kCompile3CompilerNameOffset = 22;
+
+// The number of symbols at the start of a module's symbol stream in which the
+// compiland details are searched for.
+const size_t kMaxCompilandDetailsSymbolIndex = 8;
+
+// Gets the name of the compiler that built a module of a PDB from the
+// compiland details symbol of the module.
+bool GetModuleCompilerName(const pdb::PdbFile& pdb_file,
+                           const pdb::DbiModuleInfo& module,
+                           std::string* compiler_name) {
+  DCHECK_NE(static_cast<std::string*>(nullptr), compiler_name);
+
+  const pdb::DbiModuleInfoBase& module_info = module.module_info_base();
+  if (module_info.stream < 0)
+    return false;
+  scoped_refptr<pdb::PdbStream> stream =
+      pdb_file.GetStream(module_info.stream);
+  if (stream.get() == NULL)
+    return false;
+  size_t symbols_end = std::min<size_t>(module_info.symbol_bytes,
+                                        stream->length());
+
+  // The symbols follow the signature of the stream. Each has a length and a
+  // type, the length not counting itself.
+  size_t offset = sizeof(uint32_t);
+  for (size_t i = 0; i < kMaxCompilandDetailsSymbolIndex; ++i) {
+    uint16_t header[2] = {};
+    if (offset + sizeof(header) > symbols_end ||
+        !stream->ReadBytesAt(offset, sizeof(header), header)) {
+      return false;
+    }
+    size_t symbol_end = offset + sizeof(header[0]) + header[0];
+    if (header[0] < sizeof(header[1]) || symbol_end > symbols_end)
+      return false;
+
+    size_t name_offset = 0;
+    if (header[1] == kCompile3SymbolType) {
+      name_offset = kCompile3CompilerNameOffset;
+    } else if (header[1] == cci::S_COMPILE2) {
+      name_offset = kCompile2CompilerNameOffset;
+    } else {
+      offset = symbol_end;
+      continue;
+    }
+
+    size_t name_begin = offset + sizeof(header) + name_offset;
+    if (name_begin >= symbol_end)
+      return false;
+    std::vector<char> name(symbol_end - name_begin);
+    if (!stream->ReadBytesAt(name_begin, name.size(), name.data()))
+      return false;
+    compiler_name->assign(name.data(), ::strnlen(name.data(), name.size()));
+    return true;
+  }
+
+  return false;
+}
+
+// Same as IsBuiltBySupportedCompiler, for a module read with the native PDB
+// readers.
+bool IsModuleBuiltBySupportedCompiler(const pdb::PdbFile& pdb_file,
+                                      const pdb::DbiModuleInfo& module) {
+  std::string compiler_name;
+  if (!GetModuleCompilerName(pdb_file, module, &compiler_name)) {
+    // If the module has no compiland details we assume the compiler is not
+    // supported.
+    VLOG(1) << "Compiland has no compiland details: " << module.module_name();
+    return false;
+  }
+
+  // Check the compiler name against the list of known compilers.
+  std::wstring wide_compiler_name = base::UTF8ToWide(compiler_name);
+  for (size_t i = 0; i < arraysize(kKnownCompilerInfos); ++i) {
+    if (wide_compiler_name == kKnownCompilerInfos[i].compiler_name)
+      return kKnownCompilerInfos[i].supported;
+  }
+
+  // Anything we don't explicitly know about is not supported.
+  VLOG(1) << "Encountered unknown compiler: " << compiler_name;
+  return false;
+}
+
 // Adds an intermediate reference to the provided vector. The vector is
 // specified as the first parameter (in slight violation of our coding
 // standards) because this function is intended to be used by Bind.
@@ -236,46 +332,61 @@ bool AddIntermediateReference(IntermediateReferences* references,
   return true;
 }
 
-// Create a reference as specified. Ignores existing references if they are of
-// the exact same type.
-bool CreateReference(RelativeAddress src_addr,
-                     BlockGraph::Size ref_size,
-                     ReferenceType ref_type,
-                     RelativeAddress base_addr,
-                     RelativeAddress dst_addr,
-                     BlockGraph::AddressSpace* image) {
-  DCHECK_NE(reinterpret_cast<BlockGraph::AddressSpace*>(NULL), image);
+// Resolves a reference as specified to its source and destination blocks,
+// without creating it. This only reads the address space.
+bool ResolveReference(RelativeAddress src_addr,
+                      BlockGraph::Size ref_size,
+                      ReferenceType ref_type,
+                      RelativeAddress base_addr,
+                      RelativeAddress dst_addr,
+                      const BlockGraph::AddressSpace& image,
+                      Block** src_block,
+                      Offset* src_block_offset,
+                      Reference* ref) {
+  DCHECK_NE(reinterpret_cast<Block**>(NULL), src_block);
+  DCHECK_NE(reinterpret_cast<Offset*>(NULL), src_block_offset);
+  DCHECK_NE(reinterpret_cast<Reference*>(NULL), ref);
 
   // Get the source block and offset, and ensure that the reference fits
   // within it.
-  Block* src_block = image->GetBlockByAddress(src_addr);
-  if (src_block == NULL) {
+  *src_block = image.GetBlockByAddress(src_addr);
+  if (*src_block == NULL) {
     LOG(ERROR) << "Unable to find block for reference originating at "
                << src_addr << ".";
     return false;
   }
   RelativeAddress src_block_addr;
-  CHECK(image->GetAddressOf(src_block, &src_block_addr));
-  Offset src_block_offset = src_addr - src_block_addr;
-  if (src_block_offset + ref_size > src_block->size()) {
+  CHECK(image.GetAddressOf(*src_block, &src_block_addr));
+  *src_block_offset = src_addr - src_block_addr;
+  if (*src_block_offset + ref_size > (*src_block)->size()) {
     LOG(ERROR) << "Reference originating at " << src_addr
-               << " extends beyond block \"" << src_block->name() << "\".";
+               << " extends beyond block \"" << (*src_block)->name() << "\".";
     return false;
   }
 
   // Get the destination block and offset.
-  Block* dst_block = image->GetBlockByAddress(base_addr);
+  Block* dst_block = image.GetBlockByAddress(base_addr);
   if (dst_block == NULL) {
     LOG(ERROR) << "Unable to find block for reference pointing at "
                << base_addr << ".";
     return false;
   }
   RelativeAddress dst_block_addr;
-  CHECK(image->GetAddressOf(dst_block, &dst_block_addr));
+  CHECK(image.GetAddressOf(dst_block, &dst_block_addr));
   Offset base = base_addr - dst_block_addr;
   Offset offset = dst_addr - dst_block_addr;
 
-  Reference ref(ref_type, ref_size, dst_block, offset, base);
+  *ref = Reference(ref_type, ref_size, dst_block, offset, base);
+
+  return true;
+}
+
+// Adds a resolved reference to its source block. Ignores existing references
+// if they are of the exact same type.
+bool AddResolvedReference(Block* src_block,
+                          Offset src_block_offset,
+                          const Reference& ref) {
+  DCHECK_NE(reinterpret_cast<Block*>(NULL), src_block);
 
   // Check if a reference already exists at this offset.
   Block::ReferenceMap::const_iterator ref_it =
@@ -294,6 +405,24 @@ bool CreateReference(RelativeAddress src_addr,
   return true;
 }
 
+// Create a reference as specified. Ignores existing references if they are of
+// the exact same type.
+bool CreateReference(RelativeAddress src_addr,
+                     BlockGraph::Size ref_size,
+                     ReferenceType ref_type,
+                     RelativeAddress base_addr,
+                     RelativeAddress dst_addr,
+                     BlockGraph::AddressSpace* image) {
+  DCHECK_NE(reinterpret_cast<BlockGraph::AddressSpace*>(NULL), image);
+
+  Block* src_block = NULL;
+  Offset src_block_offset = 0;
+  Reference ref;
+  return ResolveReference(src_addr, ref_size, ref_type, base_addr, dst_addr,
+                          *image, &src_block, &src_block_offset, &ref) &&
+      AddResolvedReference(src_block, src_block_offset, ref);
+}
+
 // Loads FIXUP and OMAP_FROM debug streams.
 bool LoadDebugStreams(IDiaSession* dia_session,
                       PdbFixups* pdb_fixups,
@@ -325,6 +454,52 @@ bool LoadDebugStreams(IDiaSession* dia_session,
   return true;
 }
 
+// Same as LoadDebugStreams, with the native PDB readers.
+bool LoadNativeDebugStreams(const pdb::PdbFile& pdb_file,
+                            const pdb::DbiStream& dbi_stream,
+                            PdbFixups* pdb_fixups,
+                            OMAPs* omap_from) {
+  DCHECK_NE(reinterpret_cast<PdbFixups*>(NULL), pdb_fixups);
+  DCHECK_NE(reinterpret_cast<OMAPs*>(NULL), omap_from);
+
+  // Load the fixups. These must exist.
+  const pdb::DbiDbgHeader& dbg_header = dbi_stream.dbg_header();
+  scoped_refptr<pdb::PdbStream> fixup_stream;
+  if (dbg_header.fixup >= 0)
+    fixup_stream = pdb_file.GetStream(dbg_header.fixup);
+  if (fixup_stream.get() == NULL) {
+    LOG(ERROR) << "PDB file does not contain a FIXUP stream. Module must be "
+                  "linked with '/PROFILE' or '/DEBUGINFO:FIXUP' flag.";
+    return false;
+  }
+  pdb_fixups->resize(fixup_stream->length() / sizeof(pdb::PdbFixup));
+  if (!pdb_fixups->empty() &&
+      !fixup_stream->ReadBytesAt(0,
+                                 pdb_fixups->size() * sizeof(pdb::PdbFixup),
+                                 pdb_fixups->data())) {
+    LOG(ERROR) << "Unable to read the FIXUP stream.";
+    return false;
+  }
+
+  // Load the omap_from table. It is not necessary that one exist.
+  omap_from->clear();
+  scoped_refptr<pdb::PdbStream> omap_from_stream;
+  if (dbg_header.omap_from_src >= 0)
+    omap_from_stream = pdb_file.GetStream(dbg_header.omap_from_src);
+  if (omap_from_stream.get() != NULL) {
+    omap_from->resize(omap_from_stream->length() / sizeof(OMAP));
+    if (!omap_from->empty() &&
+        !omap_from_stream->ReadBytesAt(0, omap_from->size() * sizeof(OMAP),
+                                       omap_from->data())) {
+      LOG(ERROR) << "Error trying to read " << kOmapFromDiaDebugStreamName
+                 << " stream.";
+      return false;
+    }
+  }
+
+  return true;
+}
+
 bool GetFixupDestinationAndType(const PEFile& image_file,
                                 const pdb::PdbFixup& fixup,
                                 RelativeAddress* dst_addr,
@@ -372,109 +547,211 @@ bool GetFixupDestinationAndType(const PEFile& image_file,
   return true;
 }
 
-// Creates references from the @p pdb_fixups (translating them via the
-// provided @p omap_from information if it is not empty), all while removing the
-// corresponding entries from @p reloc_set. If @p reloc_set is not empty after
-// this then the PDB fixups are out of sync with the image and we are unable to
-// safely decompose.
-//
-// @note This function deliberately ignores fixup information for the resource
-//     section. This is because chrome.dll gets modified by a manifest tool
-//     which doesn't update the FIXUPs in the corresponding PDB. They are thus
-//     out of sync. Even if they were in sync this doesn't harm us as we have no
-//     need to reach in and modify resource data.
-bool CreateReferencesFromFixupsImpl(
-    const PEFile& image_file,
-    const PdbFixups& pdb_fixups,
-    const OMAPs& omap_from,
-    PEFile::RelocSet* reloc_set,
-    BlockGraph::AddressSpace* image) {
-  DCHECK_NE(reinterpret_cast<PEFile::RelocSet*>(NULL), reloc_set);
-  DCHECK_NE(reinterpret_cast<BlockGraph::AddressSpace*>(NULL), image);
+// The number of fixups resolved per thread in a batch. The fixups are
+// resolved in batches to bound the memory used by the resolved fixups.
+const size_t kFixupBatchSizePerThread = 16384;
 
-  bool have_omap = !omap_from.empty();
-  size_t fixups_used = 0;
-
-  // The resource section in Chrome is modified post-link by a tool that adds a
-  // manifest to it. This causes all of the fixups in the resource section (and
-  // anything beyond it) to be invalid. As long as the resource section is the
-  // last section in the image, this is not a problem (we can safely ignore the
-  // .rsrc fixups, which we know how to parse without them). However, if there
-  // is a section after the resource section, things will have been shifted
-  // and potentially crucial fixups will be invalid.
-  const IMAGE_SECTION_HEADER* rsrc_header = image_file.GetSectionHeader(
-      kResourceSectionName);
-  RelativeAddress rsrc_start(0xffffffff);
-  RelativeAddress rsrc_end(0xffffffff);
-  if (rsrc_header != NULL) {
-    rsrc_start = RelativeAddress(rsrc_header->VirtualAddress);
-    rsrc_end = rsrc_start + rsrc_header->Misc.VirtualSize;
-  }
-
-  // Ensure the fixups are all valid.
-  for (size_t i = 0; i < pdb_fixups.size(); ++i) {
-    if (!pdb_fixups[i].ValidHeader()) {
+// A fixup, resolved to the reference that it describes.
+struct ResolvedFixup {
+  enum Status {
+    kFailed,
+    // The fixup is deliberately ignored.
+    kSkipped,
+    kResolved,
+  };
+
+  ResolvedFixup() : status(kFailed), src_block(NULL), src_block_offset(0) {
+  }
+
+  Status status;
+  RelativeAddress src_addr;
+  Block* src_block;
+  Offset src_block_offset;
+  Reference ref;
+};
+
+// Resolves the fixups of a batch, as the work items of a WorkPool. This only
+// reads the image and the address space, so that the threads don't need to
+// synchronize with each other.
+class FixupResolver {
+ public:
+  FixupResolver(const PEFile& image_file,
+                const OMAPs& omap_from,
+                const BlockGraph::AddressSpace& image,
+                PdbFixups::const_iterator fixups,
+                std::vector<ResolvedFixup>* resolved_fixups)
+      : image_file_(image_file), omap_from_(omap_from), image_(image),
+        fixups_(fixups), resolved_fixups_(resolved_fixups),
+        rsrc_start_(0xffffffff), rsrc_end_(0xffffffff) {
+    DCHECK_NE(reinterpret_cast<std::vector<ResolvedFixup>*>(NULL),
+              resolved_fixups);
+
+    // The resource section in Chrome is modified post-link by a tool that
+    // adds a manifest to it. This causes all of the fixups in the resource
+    // section (and anything beyond it) to be invalid. As long as the
+    // resource section is the last section in the image, this is not a
+    // problem (we can safely ignore the .rsrc fixups, which we know how to
+    // parse without them). However, if there is a section after the resource
+    // section, things will have been shifted and potentially crucial fixups
+    // will be invalid.
+    const IMAGE_SECTION_HEADER* rsrc_header = image_file.GetSectionHeader(
+        kResourceSectionName);
+    if (rsrc_header != NULL) {
+      rsrc_start_ = RelativeAddress(rsrc_header->VirtualAddress);
+      rsrc_end_ = rsrc_start_ + rsrc_header->Misc.VirtualSize;
+    }
+  }
+
+  // Resolves a fixup. The failures are recorded in the resolved fixup, so
+  // this always succeeds.
+  // @param index the index of the fixup in the batch.
+  // @returns true.
+  bool Resolve(size_t index) {
+    ResolveFixup(fixups_[index], &resolved_fixups_->at(index));
+    return true;
+  }
+
+ private:
+  void ResolveFixup(const pdb::PdbFixup& fixup, ResolvedFixup* resolved) {
+    DCHECK_NE(reinterpret_cast<ResolvedFixup*>(NULL), resolved);
+
+    // Ensure the fixup is valid.
+    if (!fixup.ValidHeader()) {
       LOG(ERROR) << "Unknown fixup header: "
-                 << base::StringPrintf("0x%08X.", pdb_fixups[i].header);
-      return false;
+                 << base::StringPrintf("0x%08X.", fixup.header);
+      return;
     }
 
-    // For now, we skip any offset fixups. We've only seen this in the context
-    // of TLS data access, and we don't mess with TLS structures.
-    if (pdb_fixups[i].is_offset())
-      continue;
+    // For now, we skip any offset fixups. We've only seen this in the
+    // context of TLS data access, and we don't mess with TLS structures.
+    if (fixup.is_offset()) {
+      resolved->status = ResolvedFixup::kSkipped;
+      return;
+    }
 
     // All fixups we handle should be full size pointers.
-    DCHECK_EQ(Reference::kMaximumSize, pdb_fixups[i].size());
+    DCHECK_EQ(Reference::kMaximumSize, fixup.size());
 
     // Get the original addresses, and map them through OMAP information.
     // Normally DIA takes care of this for us, but there is no API for
     // getting DIA to give us FIXUP information, so we have to do it manually.
-    RelativeAddress src_addr(pdb_fixups[i].rva_location);
-    RelativeAddress base_addr(pdb_fixups[i].rva_base);
-    if (have_omap) {
-      src_addr = pdb::TranslateAddressViaOmap(omap_from, src_addr);
-      base_addr = pdb::TranslateAddressViaOmap(omap_from, base_addr);
+    RelativeAddress src_addr(fixup.rva_location);
+    RelativeAddress base_addr(fixup.rva_base);
+    if (!omap_from_.empty()) {
+      src_addr = pdb::TranslateAddressViaOmap(omap_from_, src_addr);
+      base_addr = pdb::TranslateAddressViaOmap(omap_from_, base_addr);
     }
 
     // If the reference originates beyond the .rsrc section then we can't
     // trust it.
-    if (src_addr >= rsrc_end) {
+    if (src_addr >= rsrc_end_) {
       LOG(ERROR) << "Found fixup originating beyond .rsrc section.";
-      return false;
+      return;
     }
 
-    // If the reference originates from a part of the .rsrc section, ignore it.
-    if (src_addr >= rsrc_start)
-      continue;
+    // If the reference originates from a part of the .rsrc section, ignore
+    // it.
+    if (src_addr >= rsrc_start_) {
+      resolved->status = ResolvedFixup::kSkipped;
+      return;
+    }
 
-    // Get the relative address/displacement of the fixup. This logs on failure.
+    // Get the relative address/displacement of the fixup. This logs on
+    // failure.
     RelativeAddress dst_addr;
     ReferenceType type = BlockGraph::RELATIVE_REF;
-    if (!GetFixupDestinationAndType(image_file, pdb_fixups[i], &dst_addr,
-                                    &type)) {
-      return false;
+    if (!GetFixupDestinationAndType(image_file_, fixup, &dst_addr, &type))
+      return;
+
+    // This logs verbosely for us on failure.
+    if (!ResolveReference(src_addr, Reference::kMaximumSize, type, base_addr,
+                          dst_addr, image_, &resolved->src_block,
+                          &resolved->src_block_offset, &resolved->ref)) {
+      return;
     }
 
-    // Finally, create the reference. This logs verbosely for us on failure.
-    if (!CreateReference(src_addr, Reference::kMaximumSize, type, base_addr,
-                         dst_addr, image)) {
-      return false;
-    }
+    resolved->src_addr = src_addr;
+    resolved->status = ResolvedFixup::kResolved;
+  }
 
-    // Remove this reference from the relocs.
-    PEFile::RelocSet::iterator reloc_it = reloc_set->find(src_addr);
-    if (reloc_it != reloc_set->end()) {
-      // We should only find a reloc if the fixup was of absolute type.
-      if (type != BlockGraph::ABSOLUTE_REF) {
-        LOG(ERROR) << "Found a reloc corresponding to a non-absolute fixup.";
+  const PEFile& image_file_;
+  const OMAPs& omap_from_;
+  const BlockGraph::AddressSpace& image_;
+  PdbFixups::const_iterator fixups_;
+  std::vector<ResolvedFixup>* resolved_fixups_;
+  RelativeAddress rsrc_start_;
+  RelativeAddress rsrc_end_;
+
+  DISALLOW_COPY_AND_ASSIGN(FixupResolver);
+};
+
+// Creates references from the @p pdb_fixups (translating them via the
+// provided @p omap_from information if it is not empty), all while removing the
+// corresponding entries from @p reloc_set. If @p reloc_set is not empty after
+// this then the PDB fixups are out of sync with the image and we are unable to
+// safely decompose.
+//
+// The fixups are resolved on @p thread_count threads, and the references are
+// then created in the order of the fixups on the calling thread. The result
+// doesn't depend on the number of threads.
+//
+// @note This function deliberately ignores fixup information for the resource
+//     section. This is because chrome.dll gets modified by a manifest tool
+//     which doesn't update the FIXUPs in the corresponding PDB. They are thus
+//     out of sync. Even if they were in sync this doesn't harm us as we have no
+//     need to reach in and modify resource data.
+bool CreateReferencesFromFixupsImpl(
+    const PEFile& image_file,
+    const PdbFixups& pdb_fixups,
+    const OMAPs& omap_from,
+    size_t thread_count,
+    PEFile::RelocSet* reloc_set,
+    BlockGraph::AddressSpace* image) {
+  DCHECK_LT(0u, thread_count);
+  DCHECK_NE(reinterpret_cast<PEFile::RelocSet*>(NULL), reloc_set);
+  DCHECK_NE(reinterpret_cast<BlockGraph::AddressSpace*>(NULL), image);
+
+  size_t batch_size = kFixupBatchSizePerThread * thread_count;
+  for (size_t begin = 0; begin < pdb_fixups.size(); begin += batch_size) {
+    size_t end = std::min(begin + batch_size, pdb_fixups.size());
+    std::vector<ResolvedFixup> resolved_fixups(end - begin);
+
+    // Resolve the fixups of the batch. The address space is only read while
+    // this runs.
+    FixupResolver resolver(image_file, omap_from, *image,
+                           pdb_fixups.begin() + begin, &resolved_fixups);
+    size_t worker_count = std::min(
+        thread_count, (resolved_fixups.size() + kFixupBatchSizePerThread - 1) /
+            kFixupBatchSizePerThread);
+    application::WorkPool pool(worker_count);
+    pool.Run(resolved_fixups.size(),
+             base::Bind(&FixupResolver::Resolve, base::Unretained(&resolver)));
+
+    // Create the references in order.
+    for (const ResolvedFixup& resolved : resolved_fixups) {
+      if (resolved.status == ResolvedFixup::kFailed)
+        return false;
+      if (resolved.status == ResolvedFixup::kSkipped)
+        continue;
+
+      // This logs verbosely for us on failure.
+      if (!AddResolvedReference(resolved.src_block, resolved.src_block_offset,
+                                resolved.ref)) {
         return false;
       }
 
-      reloc_set->erase(reloc_it);
-    }
+      // Remove this reference from the relocs.
+      PEFile::RelocSet::iterator reloc_it = reloc_set->find(resolved.src_addr);
+      if (reloc_it != reloc_set->end()) {
+        // We should only find a reloc if the fixup was of absolute type.
+        if (resolved.ref.type() != BlockGraph::ABSOLUTE_REF) {
+          LOG(ERROR) << "Found a reloc corresponding to a non-absolute fixup.";
+          return false;
+        }
 
-    ++fixups_used;
+        reloc_set->erase(reloc_it);
+      }
+    }
   }
 
   return true;
@@ -777,6 +1054,14 @@ void GuessDataBlockAlignments(const PEFile& pe_file,
   }
 }
 
+// The version of the decomposition cache entries. This must be incremented
+// whenever the decomposer changes in a way that affects its output, so that
+// the stale entries get ignored.
+const uint32_t kDecompositionCacheVersion = 1;
+
+// The extension of the decomposition cache entries.
+const wchar_t kDecompositionCacheExtension[] = L".bgcache";
+
 }  // namespace
 
 // We use ", " as a separator between symbol names. We sometimes see commas
@@ -784,6 +1069,8 @@ void GuessDataBlockAlignments(const PEFile& pe_file,
 // separator that is also human friendly to read.
 const char Decomposer::kLabelNameSep[] = ", ";
 
+const char Decomposer::kCacheDirEnvVar[] = "SYZYGY_DECOMPOSITION_CACHE_DIR";
+
 // This is by CreateBlocksFromCoffGroups to communicate shared state to
 // VisitLinkerSymbol via the VisitSymbols helper function.
 struct Decomposer::VisitLinkerSymbolContext {
@@ -812,8 +1099,17 @@ struct Decomposer::VisitLinkerSymbolContext {
 };
 
 Decomposer::Decomposer(const PEFile& image_file)
-    : image_file_(image_file), image_layout_(NULL), image_(NULL),
-      current_block_(NULL), current_scope_count_(0) {
+    : image_file_(image_file),
+      thread_count_(base::SysInfo::NumberOfProcessors()),
+      use_native_pdb_readers_(false),
+      image_layout_(NULL),
+      image_(NULL),
+      current_block_(NULL),
+      current_scope_count_(0) {
+  std::unique_ptr<base::Environment> env(base::Environment::Create());
+  std::string cache_dir;
+  if (env->GetVar(kCacheDirEnvVar, &cache_dir) && !cache_dir.empty())
+    cache_dir_ = base::FilePath(base::UTF8ToWide(cache_dir));
 }
 
 bool Decomposer::Decompose(ImageLayout* image_layout) {
@@ -843,12 +1139,40 @@ bool Decomposer::Decompose(ImageLayout* image_layout) {
     return false;
   }
 
+  // Look for the decomposition in the cache. A corrupt entry is only
+  // recoverable if it failed to load before anything got added to the
+  // block-graph.
+  base::FilePath cache_path;
+  if (!cache_dir_.empty() &&
+      GetCachePath(image_file_, cache_dir_, &cache_path) &&
+      base::PathExists(cache_path)) {
+    if (LoadBlockGraphFromCache(cache_path, image_file_, image_layout))
+      return true;
+    LOG(WARNING) << "Ignoring invalid decomposition cache entry: "
+                 << cache_path.value();
+    base::DeleteFile(cache_path, false);
+    if (!image_layout->blocks.graph()->blocks().empty() ||
+        !image_layout->sections.empty()) {
+      LOG(ERROR) << "Unable to recover from the invalid cache entry.";
+      return false;
+    }
+  }
+
   // At this point a full decomposition needs to be performed.
   image_layout_ = image_layout;
   image_ = &(image_layout->blocks);
   bool success = DecomposeImpl();
   image_layout_ = NULL;
   image_ = NULL;
+  native_pdb_file_.reset();
+  native_dbi_stream_.reset();
+
+  // Add the decomposition to the cache. A failure to do so isn't fatal.
+  if (success && !cache_path.empty() &&
+      !SaveBlockGraphToCache(cache_path, image_file_, *image_layout)) {
+    LOG(WARNING) << "Failed to add the decomposition to the cache: "
+                 << cache_path.value();
+  }
 
   return success;
 }
@@ -897,35 +1221,48 @@ bool Decomposer::LoadBlockGraphFromPdbStream(
   pdb_in_stream.reset(core::CreateByteInStream(
       byte_stream->data(), byte_stream->data() + byte_stream->length()));
 
+  return LoadBlockGraphFromStream(image_file, pdb_in_stream.get(),
+                                  image_layout);
+}
+
+bool Decomposer::LoadBlockGraphFromStream(const PEFile& image_file,
+                                          core::InStream* in_stream,
+                                          ImageLayout* image_layout) {
+  DCHECK_NE(static_cast<core::InStream*>(nullptr), in_stream);
+  DCHECK_NE(static_cast<ImageLayout*>(nullptr), image_layout);
+
   // Read the header.
   uint32_t stream_version = 0;
   unsigned char compressed = 0;
-  if (!pdb_in_stream->Read(sizeof(stream_version),
-                           reinterpret_cast<core::Byte*>(&stream_version)) ||
-      !pdb_in_stream->Read(sizeof(compressed),
-                           reinterpret_cast<core::Byte*>(&compressed))) {
+  if (!in_stream->Read(sizeof(stream_version),
+                       reinterpret_cast<core::Byte*>(&stream_version)) ||
+      !in_stream->Read(sizeof(compressed),
+                       reinterpret_cast<core::Byte*>(&compressed))) {
     LOG(ERROR) << "Failed to read existing Syzygy block-graph stream header.";
     return false;
   }
 
   // Check the stream version.
   if (stream_version != pdb::kSyzygyBlockGraphStreamVersion) {
-    LOG(ERROR) << "PDB contains an unsupported Syzygy block-graph stream"
-               << " version (got " << stream_version << ", expected "
+    LOG(ERROR) << "Unsupported Syzygy block-graph stream version (got "
+               << stream_version << ", expected "
                << pdb::kSyzygyBlockGraphStreamVersion << ").";
     return false;
   }
 
   // If the stream is compressed insert the decompression filter.
-  core::InStream* in_stream = pdb_in_stream.get();
+  // Every primitive value is loaded by a separate read, which is costly for
+  // the decompressor, so it's read from in large chunks.
   std::unique_ptr<core::ZInStream> zip_in_stream;
+  std::unique_ptr<core::BufferedInStream> buffered_in_stream;
   if (compressed != 0) {
     zip_in_stream.reset(new core::ZInStream(in_stream));
     if (!zip_in_stream->Init()) {
       LOG(ERROR) << "Unable to initialize ZInStream.";
       return false;
     }
-    in_stream = zip_in_stream.get();
+    buffered_in_stream.reset(new core::BufferedInStream(zip_in_stream.get()));
+    in_stream = buffered_in_stream.get();
   }
 
   // Deserialize the image-layout.
@@ -981,6 +1318,109 @@ bool Decomposer::LoadBlockGraphFromPdb(const base::FilePath& pdb_path,
   return true;
 }
 
+bool Decomposer::GetCachePath(const PEFile& image_file,
+                              const base::FilePath& cache_dir,
+                              base::FilePath* cache_path) {
+  DCHECK_NE(static_cast<base::FilePath*>(nullptr), cache_path);
+
+  PdbInfo pdb_info;
+  if (!pdb_info.Init(image_file))
+    return false;
+
+  // The entries are grouped by module, and named after the image signature
+  // and the PDB signature and age, like on a symbol server.
+  const IMAGE_NT_HEADERS* nt_headers = image_file.nt_headers();
+  const GUID& guid = pdb_info.signature();
+  std::wstring name = base::StringPrintf(
+      L"%08X%X-%08X%04X%04X%02X%02X%02X%02X%02X%02X%02X%02X%X",
+      nt_headers->FileHeader.TimeDateStamp,
+      nt_headers->OptionalHeader.SizeOfImage,
+      guid.Data1, guid.Data2, guid.Data3,
+      guid.Data4[0], guid.Data4[1], guid.Data4[2], guid.Data4[3],
+      guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7],
+      pdb_info.pdb_age());
+  *cache_path = cache_dir.Append(image_file.path().BaseName())
+                    .Append(name + kDecompositionCacheExtension);
+  return true;
+}
+
+bool Decomposer::LoadBlockGraphFromCache(const base::FilePath& cache_path,
+                                         const PEFile& image_file,
+                                         ImageLayout* image_layout) {
+  DCHECK_NE(static_cast<ImageLayout*>(nullptr), image_layout);
+  LOG(INFO) << "Reading block-graph and image layout from the cache.";
+
+  std::string contents;
+  if (!base::ReadFileToString(cache_path, &contents)) {
+    LOG(ERROR) << "Failed to read " << cache_path.value() << ".";
+    return false;
+  }
+
+  core::ScopedInStreamPtr in_stream;
+  in_stream.reset(core::CreateByteInStream(contents.begin(), contents.end()));
+
+  uint32_t cache_version = 0;
+  if (!in_stream->Read(sizeof(cache_version),
+                       reinterpret_cast<core::Byte*>(&cache_version)) ||
+      cache_version != kDecompositionCacheVersion) {
+    LOG(ERROR) << "Unsupported decomposition cache entry version.";
+    return false;
+  }
+
+  return LoadBlockGraphFromStream(image_file, in_stream.get(), image_layout);
+}
+
+bool Decomposer::SaveBlockGraphToCache(const base::FilePath& cache_path,
+                                       const PEFile& image_file,
+                                       const ImageLayout& image_layout) {
+  // Serialize the decomposition in the format of the block-graph stream,
+  // preceded by the cache version. Unlike in the PDB, the strings are kept
+  // so that the decomposition from the cache is identical.
+  std::vector<uint8_t> contents;
+  core::ScopedOutStreamPtr out_stream;
+  out_stream.reset(core::CreateByteOutStream(std::back_inserter(contents)));
+  unsigned char compressed = 1;
+  if (!out_stream->Write(sizeof(kDecompositionCacheVersion),
+          reinterpret_cast<const core::Byte*>(&kDecompositionCacheVersion)) ||
+      !out_stream->Write(sizeof(pdb::kSyzygyBlockGraphStreamVersion),
+          reinterpret_cast<const core::Byte*>(
+              &pdb::kSyzygyBlockGraphStreamVersion)) ||
+      !out_stream->Write(sizeof(compressed),
+                         reinterpret_cast<const core::Byte*>(&compressed))) {
+    return false;
+  }
+
+  // The cache favors speed over size, so the fastest compression is used.
+  core::ZOutStream zip_stream(out_stream.get());
+  if (!zip_stream.Init(core::ZOutStream::kZBestSpeed))
+    return false;
+  core::BufferedOutStream buffered_stream(&zip_stream);
+  core::OutArchive out_archive(&buffered_stream);
+  if (!SaveBlockGraphAndImageLayout(image_file, 0, image_layout,
+                                    &out_archive) ||
+      !buffered_stream.Flush()) {
+    return false;
+  }
+
+  // Write to a temporary file and move it in place, so that the concurrent
+  // readers never see an incomplete entry.
+  base::FilePath dir = cache_path.DirName();
+  base::FilePath temp_path;
+  if (!base::CreateDirectory(dir) ||
+      !base::CreateTemporaryFileInDir(dir, &temp_path)) {
+    return false;
+  }
+  int size = static_cast<int>(contents.size());
+  if (base::WriteFile(temp_path, reinterpret_cast<const char*>(
+          contents.data()), size) != size ||
+      !base::ReplaceFile(temp_path, cache_path, nullptr)) {
+    base::DeleteFile(temp_path, false);
+    return false;
+  }
+
+  return true;
+}
+
 bool Decomposer::DecomposeImpl() {
   // Instantiate and initialize our Debug Interface Access session. This logs
   // verbosely for us.
@@ -1002,6 +1442,9 @@ bool Decomposer::DecomposeImpl() {
   if (!CopySectionInfoToBlockGraph(image_file_, image_->graph()))
     return false;
 
+  if (use_native_pdb_readers_ && !ReadNativePdb())
+    return false;
+
   // We scope the first few operations so that we don't keep the intermediate
   // references around any longer than we have to.
   {
@@ -1023,8 +1466,12 @@ bool Decomposer::DecomposeImpl() {
     // existing PE parsed blocks, but when they do we expect them to be exact
     // collisions.
     VLOG(1) << "Parsing section contributions.";
-    if (!CreateBlocksFromSectionContribs(dia_session.get()))
+    if (native_pdb_file_.get() != NULL) {
+      if (!CreateBlocksFromNativeSectionContribs())
+        return false;
+    } else if (!CreateBlocksFromSectionContribs(dia_session.get())) {
       return false;
+    }
 
     VLOG(1) << "Finding cold blocks.";
     if (!FindColdBlocksFromCompilands(dia_session.get()))
@@ -1072,6 +1519,40 @@ bool Decomposer::DecomposeImpl() {
   return true;
 }
 
+bool Decomposer::ReadNativePdb() {
+  std::unique_ptr<pdb::PdbFile> pdb_file(new pdb::PdbFile());
+  pdb::PdbReader pdb_reader;
+  if (!pdb_reader.Read(pdb_path_, pdb_file.get())) {
+    LOG(ERROR) << "Failed to load PDB: " << pdb_path_.value();
+    return false;
+  }
+
+  scoped_refptr<pdb::PdbStream> stream = pdb_file->GetStream(pdb::kDbiStream);
+  scoped_refptr<pdb::PdbByteStream> dbi_byte_stream(new pdb::PdbByteStream());
+  std::unique_ptr<pdb::DbiStream> dbi_stream(new pdb::DbiStream());
+  if (stream.get() == NULL || !dbi_byte_stream->Init(stream.get()) ||
+      !dbi_stream->Read(dbi_byte_stream.get())) {
+    LOG(ERROR) << "Unable to parse DBI stream.";
+    return false;
+  }
+
+  // The native records are in the address space of the original image, and
+  // would need to be mapped through the OMAP information.
+  const pdb::DbiDbgHeader& dbg_header = dbi_stream->dbg_header();
+  if (dbg_header.omap_from_src >= 0) {
+    scoped_refptr<pdb::PdbStream> omap_from =
+        pdb_file->GetStream(dbg_header.omap_from_src);
+    if (omap_from.get() != NULL && omap_from->length() > 0) {
+      VLOG(1) << "PDB has OMAP information, using DIA.";
+      return true;
+    }
+  }
+
+  native_pdb_file_.swap(pdb_file);
+  native_dbi_stream_.swap(dbi_stream);
+  return true;
+}
+
 bool Decomposer::CreatePEImageBlocksAndReferences(
     IntermediateReferences* references) {
   DCHECK_NE(reinterpret_cast<IntermediateReferences*>(NULL), references);
@@ -1089,14 +1570,19 @@ bool Decomposer::CreatePEImageBlocksAndReferences(
 }
 
 bool Decomposer::CreateBlocksFromCoffGroups() {
-  pdb::PdbFile pdb_file;
-  pdb::PdbReader pdb_reader;
-  if (!pdb_reader.Read(pdb_path_, &pdb_file)) {
-    LOG(ERROR) << "Failed to load PDB: " << pdb_path_.value();
-    return false;
+  // Reuse the PDB of the native readers if it has already been read.
+  pdb::PdbFile local_pdb_file;
+  const pdb::PdbFile* pdb_file = native_pdb_file_.get();
+  if (pdb_file == NULL) {
+    pdb::PdbReader pdb_reader;
+    if (!pdb_reader.Read(pdb_path_, &local_pdb_file)) {
+      LOG(ERROR) << "Failed to load PDB: " << pdb_path_.value();
+      return false;
+    }
+    pdb_file = &local_pdb_file;
   }
 
-  scoped_refptr<pdb::PdbStream> symbols = GetLinkerSymbolStream(pdb_file);
+  scoped_refptr<pdb::PdbStream> symbols = GetLinkerSymbolStream(*pdb_file);
 
   // Process the symbols in the linker module symbol stream.
   VisitLinkerSymbolContext context;
@@ -1191,50 +1677,120 @@ bool Decomposer::CreateBlocksFromSectionContribs(IDiaSession* session) {
       return false;
     }
 
-    // Give a name to the block based on the basename of the object file. This
-    // will eventually be replaced by the full symbol name, if one exists for
-    // the block.
-    size_t last_component = compiland_name.find_last_of('\\');
-    size_t extension = compiland_name.find_last_of('.');
-    if (last_component == std::string::npos) {
-      last_component = 0;
-    } else {
-      // We don't want to include the last slash.
-      ++last_component;
+    if (!CreateSectionContribBlock(RelativeAddress(rva), length, code != FALSE,
+                                   compiland_name,
+                                   is_built_by_supported_compiler)) {
+      return false;
     }
-    if (extension < last_component)
-      extension = compiland_name.size();
-    std::string name = compiland_name.substr(last_component,
-                                             extension - last_component);
-
-    // TODO(chrisha): We see special section contributions with the name
-    //     "* CIL *". These are concatenations of data symbols and can very
-    //     likely be chunked using symbols directly. A cursory visual inspection
-    //     of symbol names hints that these might be related to WPO.
-
-    // Create the block.
-    BlockType block_type =
-        code ? BlockGraph::CODE_BLOCK : BlockGraph::DATA_BLOCK;
-    Block* block = CreateBlockOrFindCoveringPeBlock(
-        block_type, RelativeAddress(rva), length, name);
-    if (block == NULL) {
-      LOG(ERROR) << "Unable to create block for compiland \""
-                 << compiland_name << "\".";
+  }
+
+  return true;
+}
+
+bool Decomposer::CreateBlocksFromNativeSectionContribs() {
+  DCHECK_NE(static_cast<pdb::PdbFile*>(nullptr), native_pdb_file_.get());
+  DCHECK_NE(static_cast<pdb::DbiStream*>(nullptr), native_dbi_stream_.get());
+
+  size_t rsrc_id = image_file_.GetSectionIndex(kResourceSectionName);
+  const pdb::DbiStream::DbiModuleVector& modules =
+      native_dbi_stream_->modules();
+
+  // Whether the modules were built by a supported compiler, determined on
+  // first use.
+  enum CompilerSupport : int8_t {
+    kCompilerSupportUnknown,
+    kCompilerSupported,
+    kCompilerUnsupported,
+  };
+  std::vector<CompilerSupport> compiler_support(modules.size(),
+                                                kCompilerSupportUnknown);
+
+  for (const pdb::DbiSectionContrib& section_contrib :
+           native_dbi_stream_->section_contribs()) {
+    // The PDB numbers sections from 1 to n, while we do 0 to n - 1.
+    if (section_contrib.section <= 0 ||
+        static_cast<size_t>(section_contrib.section) >
+            image_layout_->sections.size() ||
+        section_contrib.module < 0 ||
+        static_cast<size_t>(section_contrib.module) >= modules.size()) {
+      LOG(ERROR) << "Invalid section contribution.";
       return false;
     }
+    size_t section_id = section_contrib.section - 1;
+
+    // We don't parse the resource section, as it is parsed by the PEFileParser.
+    if (section_id == rsrc_id)
+      continue;
 
-    // Set the block compiland name.
-    block->set_compiland_name(compiland_name);
+    const pdb::DbiModuleInfo& module = modules[section_contrib.module];
+    CompilerSupport& support = compiler_support[section_contrib.module];
+    if (support == kCompilerSupportUnknown) {
+      support = IsModuleBuiltBySupportedCompiler(*native_pdb_file_, module) ?
+          kCompilerSupported : kCompilerUnsupported;
+    }
 
-    // Set the block attributes.
-    block->set_attribute(BlockGraph::SECTION_CONTRIB);
-    if (!is_built_by_supported_compiler)
-      block->set_attribute(BlockGraph::BUILT_BY_UNSUPPORTED_COMPILER);
+    RelativeAddress rva(image_layout_->sections[section_id].addr +
+        section_contrib.offset);
+    bool code = (section_contrib.flags & IMAGE_SCN_CNT_CODE) != 0;
+    if (!CreateSectionContribBlock(rva, section_contrib.size, code,
+                                   module.module_name(),
+                                   support == kCompilerSupported)) {
+      return false;
+    }
   }
 
   return true;
 }
 
+bool Decomposer::CreateSectionContribBlock(
+    RelativeAddress rva,
+    BlockGraph::Size length,
+    bool code,
+    const std::string& compiland_name,
+    bool is_built_by_supported_compiler) {
+  // Give a name to the block based on the basename of the object file. This
+  // will eventually be replaced by the full symbol name, if one exists for
+  // the block.
+  size_t last_component = compiland_name.find_last_of('\\');
+  size_t extension = compiland_name.find_last_of('.');
+  if (last_component == std::string::npos) {
+    last_component = 0;
+  } else {
+    // We don't want to include the last slash.
+    ++last_component;
+  }
+  if (extension < last_component)
+    extension = compiland_name.size();
+  std::string name = compiland_name.substr(last_component,
+                                           extension - last_component);
+
+  // TODO(chrisha): We see special section contributions with the name
+  //     "* CIL *". These are concatenations of data symbols and can very
+  //     likely be chunked using symbols directly. A cursory visual inspection
+  //     of symbol names hints that these might be related to WPO.
+
+  // Create the block.
+  BlockType block_type =
+      code ? BlockGraph::CODE_BLOCK : BlockGraph::DATA_BLOCK;
+  Block* block = CreateBlockOrFindCoveringPeBlock(block_type, rva, length,
+                                                  name);
+  if (block == NULL) {
+    LOG(ERROR) << "Unable to create block for compiland \""
+               << compiland_name << "\".";
+    return false;
+  }
+
+  // Set the block compiland name.
+  block->set_compiland_name(compiland_name);
+
+  // Set the block attributes.
+  block->set_attribute(BlockGraph::SECTION_CONTRIB);
+  if (!is_built_by_supported_compiler)
+    block->set_attribute(BlockGraph::BUILT_BY_UNSUPPORTED_COMPILER);
+
+  return true;
+}
+
 bool Decomposer::FindColdBlocksFromCompilands(IDiaSession* session) {
   // Detect hot/cold code separation. Some blocks are outside the function
   // address range and must be handled as separate blocks. When building
@@ -1416,14 +1972,20 @@ bool Decomposer::CreateReferencesFromFixups(IDiaSession* session) {
 
   OMAPs omap_from;
   PdbFixups fixups;
-  if (!LoadDebugStreams(session, &fixups, &omap_from))
+  if (native_pdb_file_.get() != NULL) {
+    if (!LoadNativeDebugStreams(*native_pdb_file_, *native_dbi_stream_,
+                                &fixups, &omap_from)) {
+      return false;
+    }
+  } else if (!LoadDebugStreams(session, &fixups, &omap_from)) {
     return false;
+  }
 
   // While creating references from the fixups this removes the
   // corresponding reference data from the relocs. We use this as a kind of
   // double-entry bookkeeping to ensure all is well and right in the world.
   if (!CreateReferencesFromFixupsImpl(image_file_, fixups, omap_from,
-                                      &reloc_set, image_)) {
+                                      thread_count_, &reloc_set, image_)) {
     return false;
   }
 
@@ -20,9 +20,12 @@
 
 #include <windows.h>  // NOLINT
 #include <dia2.h>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "syzygy/common/binary_stream.h"
+#include "syzygy/pdb/pdb_dbi_stream.h"
 #include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_stream.h"
 #include "syzygy/pe/dia_browser.h"
@@ -44,6 +47,11 @@ class Decomposer {
   // associated with a single label.
   static const char kLabelNameSep[];
 
+  // The environment variable that holds the directory of the decomposition
+  // cache. When set, the decompositions are looked up in and added to this
+  // cache, which is keyed by the signatures of the image and of its PDB.
+  static const char kCacheDirEnvVar[];
+
   // Initialize the decomposer for a given image file.
   // @param image_file the image file to decompose. This must outlive the
   //     instance of the decomposer.
@@ -64,6 +72,28 @@ class Decomposer {
   // @param pdb_path the path to the PDB file to be used in decomposing the
   //     image.
   void set_pdb_path(const base::FilePath& pdb_path) { pdb_path_ = pdb_path; }
+  // Sets the directory of the decomposition cache. This defaults to the
+  // value of kCacheDirEnvVar, and an empty path disables the cache.
+  // @param cache_dir the directory of the cache.
+  void set_cache_dir(const base::FilePath& cache_dir) {
+    cache_dir_ = cache_dir;
+  }
+  // Sets the number of threads on which the fixups are resolved. This
+  // defaults to the number of processors. The decomposition doesn't depend
+  // on it.
+  // @param thread_count the number of threads, which must be at least 1.
+  void set_thread_count(size_t thread_count) {
+    DCHECK_LT(0u, thread_count);
+    thread_count_ = thread_count;
+  }
+  // Sets whether the section contributions and the debug streams are read
+  // with the native PDB readers instead of through DIA. The symbols are still
+  // read through DIA. This is ignored for PDBs with OMAP information, as the
+  // native records are in the address space of the original image.
+  // @param use_native_pdb_readers true to use the native readers.
+  void set_use_native_pdb_readers(bool use_native_pdb_readers) {
+    use_native_pdb_readers_ = use_native_pdb_readers;
+  }
   // @}
 
   // @name Accessors
@@ -73,6 +103,13 @@ class Decomposer {
   // decomposition.
   // @returns the PDB path.
   const base::FilePath& pdb_path() const { return pdb_path_; }
+  // @returns the directory of the decomposition cache, or an empty path if
+  //     the cache is disabled.
+  const base::FilePath& cache_dir() const { return cache_dir_; }
+  // @returns the number of threads on which the fixups are resolved.
+  size_t thread_count() const { return thread_count_; }
+  // @returns true if the native PDB readers are used where possible.
+  bool use_native_pdb_readers() const { return use_native_pdb_readers_; }
   // @}
 
  protected:
@@ -93,6 +130,40 @@ class Decomposer {
                                     const PEFile& image_file,
                                     ImageLayout* image_layout,
                                     bool* stream_exists);
+  // Reads a serialized block-graph in the format of the block-graph stream,
+  // header included.
+  static bool LoadBlockGraphFromStream(const PEFile& image_file,
+                                       core::InStream* in_stream,
+                                       ImageLayout* image_layout);
+  // @}
+
+  // @name Used for the decomposition cache. Exposed here for unittesting.
+  // @{
+  // Gets the path of the cache entry of an image.
+  // @param image_file the image.
+  // @param cache_dir the directory of the cache.
+  // @param cache_path receives the path of the cache entry.
+  // @returns true on success, false if the image has no PDB signature.
+  static bool GetCachePath(const PEFile& image_file,
+                           const base::FilePath& cache_dir,
+                           base::FilePath* cache_path);
+  // Loads a decomposition from the cache.
+  // @param cache_path the path of the cache entry.
+  // @param image_file the decomposed image.
+  // @param image_layout receives the decomposition.
+  // @returns true on success, false otherwise.
+  static bool LoadBlockGraphFromCache(const base::FilePath& cache_path,
+                                      const PEFile& image_file,
+                                      ImageLayout* image_layout);
+  // Adds a decomposition to the cache. The entry is written to a temporary
+  // file first, so that the concurrent readers only see complete entries.
+  // @param cache_path the path of the cache entry.
+  // @param image_file the decomposed image.
+  // @param image_layout the decomposition.
+  // @returns true on success, false otherwise.
+  static bool SaveBlockGraphToCache(const base::FilePath& cache_path,
+                                    const PEFile& image_file,
+                                    const ImageLayout& image_layout);
   // @}
 
   // @name Decomposition steps, in order.
@@ -103,8 +174,13 @@ class Decomposer {
   bool CreatePEImageBlocksAndReferences(IntermediateReferences* references);
   // Creates blocks from the COFF group symbols in the linker symbol stream.
   bool CreateBlocksFromCoffGroups();
+  // Reads the PDB and its DBI stream for the native readers. This leaves
+  // native_pdb_file_ empty if they can't be used for this PDB.
+  bool ReadNativePdb();
   // Processes the SectionContribution table, creating code/data blocks from it.
   bool CreateBlocksFromSectionContribs(IDiaSession* session);
+  // Same as CreateBlocksFromSectionContribs, with the native readers.
+  bool CreateBlocksFromNativeSectionContribs();
  // Processes the Compiland table and finds cold blocks.
   bool FindColdBlocksFromCompilands(IDiaSession* session);
   // Creates gap blocks to flesh out the image. After this has been run all
@@ -121,6 +197,21 @@ class Decomposer {
   bool ProcessSymbols(IDiaSymbol* root);
   // @}
 
+  // @{
+  // Creates the block of a section contribution.
+  // @param rva the address of the section contribution.
+  // @param length the length of the section contribution.
+  // @param code true if the section contribution holds code.
+  // @param compiland_name the name of the compiland that contributed it.
+  // @param is_built_by_supported_compiler true if the compiland was built by
+  //     a supported compiler.
+  // @returns true on success, false otherwise.
+  bool CreateSectionContribBlock(RelativeAddress rva,
+                                 BlockGraph::Size length,
+                                 bool code,
+                                 const std::string& compiland_name,
+                                 bool is_built_by_supported_compiler);
+
   // @{
   // @name Callbacks and context structures used by the COFF group parsing
   //     mechanism.
@@ -198,6 +289,12 @@ class Decomposer {
   const PEFile& image_file_;
   // The path to corresponding PDB file.
   base::FilePath pdb_path_;
+  // The directory of the decomposition cache, empty if there's none.
+  base::FilePath cache_dir_;
+  // The number of threads on which the fixups are resolved.
+  size_t thread_count_;
+  // Whether the native PDB readers are used where possible.
+  bool use_native_pdb_readers_;
 
   // @name Temporaries that are only valid while inside DecomposeImpl.
   //     Prevents us from having to pass these around everywhere.
@@ -206,6 +303,9 @@ class Decomposer {
   ImageLayout* image_layout_;
   // The image address space we're decomposing to.
   BlockGraph::AddressSpace* image_;
+  // The PDB and its DBI stream, when the native readers are used.
+  std::unique_ptr<pdb::PdbFile> native_pdb_file_;
+  std::unique_ptr<pdb::DbiStream> native_dbi_stream_;
   // @}
 
   // Data structures holding the relation between functions and their cold
@@ -14,6 +14,7 @@
 
 #include "syzygy/pe/decomposer.h"
 
+#include "base/files/file_util.h"
 #include "base/strings/string_split.h"
 #include "base/strings/string_util.h"
 #include "gmock/gmock.h"
@@ -52,6 +53,7 @@ class TestDecomposer : public Decomposer {
   // Expose as public for testing.
   using Decomposer::LoadBlockGraphFromPdbStream;
   using Decomposer::LoadBlockGraphFromPdb;
+  using Decomposer::GetCachePath;
 };
 
 class DecomposerTest : public testing::PELibUnitTest {
@@ -82,6 +84,17 @@ TEST_F(DecomposerTest, MutatorsAndAccessors) {
 
   decomposer.set_pdb_path(pdb_path);
   EXPECT_EQ(pdb_path, decomposer.pdb_path());
+
+  decomposer.set_cache_dir(base::FilePath(L"cache"));
+  EXPECT_EQ(base::FilePath(L"cache"), decomposer.cache_dir());
+
+  EXPECT_FALSE(decomposer.use_native_pdb_readers());
+  decomposer.set_use_native_pdb_readers(true);
+  EXPECT_TRUE(decomposer.use_native_pdb_readers());
+
+  EXPECT_LT(0u, decomposer.thread_count());
+  decomposer.set_thread_count(3);
+  EXPECT_EQ(3u, decomposer.thread_count());
 }
 
 TEST_F(DecomposerTest, Decompose) {
@@ -348,6 +361,120 @@ TEST_F(DecomposerTest, Decompose) {
   EXPECT_EQ(8u, coff_group_blocks);
 }
 
+TEST_F(DecomposerTest, DecomposeInParallel) {
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  PEFile image_file;
+  ASSERT_TRUE(image_file.Init(image_path));
+
+  BlockGraph block_graph;
+  ImageLayout image_layout(&block_graph);
+  {
+    Decomposer decomposer(image_file);
+    decomposer.set_cache_dir(base::FilePath());
+    decomposer.set_thread_count(1);
+    ASSERT_TRUE(decomposer.Decompose(&image_layout));
+  }
+
+  // The decomposition doesn't depend on the number of threads.
+  BlockGraph parallel_block_graph;
+  ImageLayout parallel_image_layout(&parallel_block_graph);
+  {
+    Decomposer decomposer(image_file);
+    decomposer.set_cache_dir(base::FilePath());
+    decomposer.set_thread_count(8);
+    ASSERT_TRUE(decomposer.Decompose(&parallel_image_layout));
+  }
+  block_graph::BlockGraphSerializer serializer;
+  EXPECT_TRUE(testing::BlockGraphsEqual(block_graph, parallel_block_graph,
+                                        serializer));
+}
+
+TEST_F(DecomposerTest, DecomposeWithNativePdbReaders) {
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  PEFile image_file;
+  ASSERT_TRUE(image_file.Init(image_path));
+
+  BlockGraph block_graph;
+  ImageLayout image_layout(&block_graph);
+  {
+    Decomposer decomposer(image_file);
+    decomposer.set_cache_dir(base::FilePath());
+    ASSERT_TRUE(decomposer.Decompose(&image_layout));
+  }
+
+  BlockGraph native_block_graph;
+  ImageLayout native_image_layout(&native_block_graph);
+  {
+    Decomposer decomposer(image_file);
+    decomposer.set_cache_dir(base::FilePath());
+    decomposer.set_use_native_pdb_readers(true);
+    ASSERT_TRUE(decomposer.Decompose(&native_image_layout));
+  }
+
+  // The blocks may be created in a different order, so they are compared by
+  // address.
+  ASSERT_EQ(image_layout.blocks.size(), native_image_layout.blocks.size());
+  for (const auto& entry : image_layout.blocks) {
+    const BlockGraph::Block* block = entry.second;
+    const BlockGraph::Block* native_block =
+        native_image_layout.blocks.GetBlockByAddress(entry.first.start());
+    ASSERT_NE(static_cast<const BlockGraph::Block*>(nullptr), native_block);
+    EXPECT_EQ(block->type(), native_block->type());
+    EXPECT_EQ(block->size(), native_block->size());
+    EXPECT_EQ(block->attributes(), native_block->attributes());
+    EXPECT_EQ(block->name(), native_block->name());
+    EXPECT_EQ(block->compiland_name(), native_block->compiland_name());
+    EXPECT_EQ(block->references().size(), native_block->references().size());
+    EXPECT_EQ(block->labels().size(), native_block->labels().size());
+  }
+}
+
+TEST_F(DecomposerTest, DecomposeUsesCache) {
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  PEFile image_file;
+  ASSERT_TRUE(image_file.Init(image_path));
+
+  base::FilePath cache_dir = temp_dir_.Append(L"cache");
+  base::FilePath cache_path;
+  ASSERT_TRUE(TestDecomposer::GetCachePath(image_file, cache_dir,
+                                           &cache_path));
+  EXPECT_TRUE(cache_dir.IsParent(cache_path));
+  EXPECT_FALSE(base::PathExists(cache_path));
+
+  // The first decomposition populates the cache.
+  BlockGraph block_graph;
+  ImageLayout image_layout(&block_graph);
+  {
+    Decomposer decomposer(image_file);
+    decomposer.set_cache_dir(cache_dir);
+    ASSERT_TRUE(decomposer.Decompose(&image_layout));
+  }
+  EXPECT_TRUE(base::PathExists(cache_path));
+
+  // The second one comes from the cache, and is the same.
+  BlockGraph cached_block_graph;
+  ImageLayout cached_image_layout(&cached_block_graph);
+  {
+    Decomposer decomposer(image_file);
+    decomposer.set_cache_dir(cache_dir);
+    ASSERT_TRUE(decomposer.Decompose(&cached_image_layout));
+  }
+  EXPECT_EQ(block_graph.blocks().size(), cached_block_graph.blocks().size());
+  EXPECT_EQ(image_layout.sections.size(), cached_image_layout.sections.size());
+  EXPECT_EQ(image_layout.blocks.size(), cached_image_layout.blocks.size());
+
+  // An invalid entry is discarded, and the image gets decomposed again.
+  ASSERT_EQ(4, base::WriteFile(cache_path, "junk", 4));
+  BlockGraph other_block_graph;
+  ImageLayout other_image_layout(&other_block_graph);
+  {
+    Decomposer decomposer(image_file);
+    decomposer.set_cache_dir(cache_dir);
+    ASSERT_TRUE(decomposer.Decompose(&other_image_layout));
+  }
+  EXPECT_EQ(block_graph.blocks().size(), other_block_graph.blocks().size());
+}
+
 TEST_F(DecomposerTest, DecomposeFailsWithNonexistentPdb) {
   base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
   PEFile image_file;
@@ -339,6 +339,9 @@ bool ImageFilter::LoadFromJSON(const DictionaryValue& dict) {
   if (!LoadFilterFromJSON(*filter, this))
     return false;
 
+  // A loaded filter is typically queried for every instruction of the image.
+  this->filter.BuildPageIndex();
+
   return true;
 }
 
@@ -68,7 +68,8 @@ struct ImageFilter {
   bool SaveToJSON(bool pretty_print, FILE* file) const;
   bool SaveToJSON(bool pretty_print, const base::FilePath& path) const;
 
-  // Loads an image filter from a file in JSON format.
+  // Loads an image filter from a file in JSON format. The loaded filter has a
+  // page index, see core::AddressFilter::BuildPageIndex.
   // @param dict The JSON dictionary to be loaded from.
   // @param file The file to be read from.
   // @param path The path of the file to be read.
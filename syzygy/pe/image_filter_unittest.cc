@@ -122,6 +122,7 @@ TEST_F(ImageFilterTest, SaveToAndLoadFromJSON) {
   EXPECT_TRUE(f3.LoadFromJSON(ugly_json_path));
   EXPECT_EQ(f1.signature, f3.signature);
   EXPECT_EQ(f1.filter, f3.filter);
+  EXPECT_TRUE(f3.filter.has_page_index());
 }
 
 }  // namespace pe
@@ -25,6 +25,7 @@
 #include <vector>
 
 #include "base/files/file_path.h"
+#include "base/win/scoped_handle.h"
 #include "syzygy/common/buffer_parser.h"
 #include "syzygy/core/address.h"
 #include "syzygy/core/address_space.h"
@@ -105,6 +106,21 @@ class PECoffFile {
   // @returns the path of the input file read, if any.
   const base::FilePath& path() const { return path_; }
 
+  // Sets whether Init maps the input file rather than reading all of it to
+  // memory. When mapped, the headers and sections are views into the mapping
+  // and their pages are only read from disk as they are accessed, which is
+  // cheaper for the tools that only look at a few parts of a big file. The
+  // mapping is copy-on-write, so the mutable accessors never modify the file.
+  // The file stays open, and can't be truncated, as long as this object
+  // lives. This must be set before Init.
+  // @param use_file_mapping true to map the file.
+  void set_use_file_mapping(bool use_file_mapping) {
+    use_file_mapping_ = use_file_mapping;
+  }
+
+  // @returns true if Init maps the input file.
+  bool use_file_mapping() const { return use_file_mapping_; }
+
   // Copy mapped data to buffer. The specified range to read must be
   // contained within the image, and cannot cross data ranges from the
   // original file; in particular, sections with no gaps between them
@@ -236,16 +252,22 @@ class PECoffFile {
     common::BinaryBufferParser parser;
   };
 
-  typedef core::AddressSpace<AddressType, SizeType, SectionInfo>
+  // The sections are only inserted on initialization, and looked up for every
+  // translation and read, so they are kept in a flat address space.
+  typedef core::FlatAddressSpace<AddressType, SizeType, SectionInfo>
       ImageAddressSpace;
 
   // Protected constructor, for derived classes only.
   PECoffFile()
       : file_header_(NULL),
-        section_headers_(NULL) {
+        section_headers_(NULL),
+        use_file_mapping_(false),
+        mapped_data_(NULL) {
   }
 
   ~PECoffFile() {
+    if (mapped_data_ != NULL)
+      ::UnmapViewOfFile(mapped_data_);
   }
 
   // Set the file path and read all of its data.
@@ -254,6 +276,12 @@ class PECoffFile {
   // @returns true on success, false on failure.
   bool Init(const base::FilePath& path);
 
+  // Maps the input file, copy-on-write.
+  //
+  // @param path the absolute path to the input file.
+  // @returns true on success, false on failure.
+  bool MapFile(const base::FilePath& path);
+
   // Read headers common to both PE and COFF. Insert a range covering
   // all headers, including unread headers; the range spans from the
   // beginning of the file to the end of the known fixed headers (the
@@ -294,15 +322,24 @@ class PECoffFile {
   const IMAGE_SECTION_HEADER* section_headers_;
 
   // Contains all of the data in the image, as a single contiguous buffer.
+  // This is empty when the file is mapped.
   std::string image_data_;
 
+  // If true, Init maps the file rather than reading it to image_data_.
+  bool use_file_mapping_;
+
+  // The input file and its mapping, when the file is mapped.
+  base::win::ScopedHandle file_;
+  base::win::ScopedHandle file_mapping_;
+  void* mapped_data_;
+
   // A parser for the image data. This takes care of bounds and alignment
   // checking.
   common::BinaryBufferParser parser_;
 
   // Contains all addressable data in the image. The address space has a range
   // defined for the header and each section in the image, backed by data in
-  // |image_data_|.
+  // |image_data_| or in the mapping.
   ImageAddressSpace address_space_;
 
  private:
@@ -18,9 +18,11 @@
 #ifndef SYZYGY_PE_PE_COFF_FILE_IMPL_H_
 #define SYZYGY_PE_PE_COFF_FILE_IMPL_H_
 
+#include "base/logging.h"
 #include "base/files/file_util.h"
 
 #include "syzygy/block_graph/block_graph.h"
+#include "syzygy/common/com_utils.h"
 
 namespace pe {
 
@@ -28,12 +30,66 @@ template <typename AddressSpaceTraits>
 bool PECoffFile<AddressSpaceTraits>::Init(const base::FilePath& path) {
   path_ = path;
   // ReadFileToString doesn't like relative paths.
-  if (!base::ReadFileToString(base::MakeAbsoluteFilePath(path), &image_data_))
+  base::FilePath absolute_path = base::MakeAbsoluteFilePath(path);
+  if (use_file_mapping_)
+    return MapFile(absolute_path);
+  if (!base::ReadFileToString(absolute_path, &image_data_))
     return false;
   parser_.SetData(image_data_.c_str(), image_data_.size());
   return true;
 }
 
+template <typename AddressSpaceTraits>
+bool PECoffFile<AddressSpaceTraits>::MapFile(const base::FilePath& path) {
+  DCHECK(mapped_data_ == NULL);
+
+  // Let others read and write the file, so that a tool can update it in place
+  // while it's mapped.
+  file_.Set(::CreateFile(path.value().c_str(), GENERIC_READ,
+                         FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+  if (!file_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to open \"" << path.value() << "\": "
+               << common::LogWe(error);
+    return false;
+  }
+
+  LARGE_INTEGER file_size = {};
+  if (!::GetFileSizeEx(file_.Get(), &file_size)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to get the size of \"" << path.value() << "\": "
+               << common::LogWe(error);
+    return false;
+  }
+
+  // Empty files can't be mapped, and are rejected when parsing the headers.
+  if (file_size.QuadPart == 0) {
+    parser_.SetData(image_data_.c_str(), 0);
+    return true;
+  }
+
+  file_mapping_.Set(::CreateFileMapping(file_.Get(), NULL, PAGE_WRITECOPY,
+                                        0, 0, NULL));
+  if (!file_mapping_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to create a mapping of \"" << path.value()
+               << "\": " << common::LogWe(error);
+    return false;
+  }
+
+  mapped_data_ = ::MapViewOfFile(file_mapping_.Get(), FILE_MAP_COPY, 0, 0, 0);
+  if (mapped_data_ == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to map \"" << path.value() << "\": "
+               << common::LogWe(error);
+    return false;
+  }
+
+  parser_.SetData(mapped_data_, static_cast<size_t>(file_size.QuadPart));
+  return true;
+}
+
 template <typename AddressSpaceTraits>
 bool PECoffFile<AddressSpaceTraits>::Contains(AddressType addr,
                                               SizeType len) const {
@@ -33,6 +33,7 @@ using core::RelativeAddress;
 PECoffRelinker::PECoffRelinker(const TransformPolicyInterface* transform_policy)
     : transform_policy_(transform_policy),
       allow_overwrite_(false),
+      perf_report_(NULL),
       inited_(false),
       input_image_layout_(&block_graph_),
       headers_block_(NULL) {
@@ -78,9 +79,16 @@ bool PECoffRelinker::AppendOrderers(const std::vector<Orderer*>& orderers) {
 
 bool PECoffRelinker::ApplyUserTransforms() {
   LOG(INFO) << "Transforming block graph.";
-  if (!block_graph::ApplyBlockGraphTransforms(
-           transforms_, transform_policy_, &block_graph_, headers_block_)) {
-    return false;
+  core::PerfReport::ScopedPhase phase(perf_report_, "transform");
+
+  // The transforms are applied one at a time so that each one is measured.
+  for (size_t i = 0; i < transforms_.size(); ++i) {
+    core::PerfReport::ScopedPhase transform_phase(
+        perf_report_, std::string("transform: ") + transforms_[i]->name());
+    if (!ApplyBlockGraphTransform(transforms_[i], transform_policy_,
+                                  &block_graph_, headers_block_)) {
+      return false;
+    }
   }
   return true;
 }
@@ -89,6 +97,7 @@ bool PECoffRelinker::ApplyUserLayoutTransforms(
     pe::ImageLayout* image_layout,
     OrderedBlockGraph* ordered_graph) {
   LOG(INFO) << "Transforming layout.";
+  core::PerfReport::ScopedPhase phase(perf_report_, "layout transforms");
   if (!block_graph::ApplyImageLayoutTransforms(
       layout_transforms_, transform_policy_, image_layout, ordered_graph)) {
     return false;
@@ -98,6 +107,7 @@ bool PECoffRelinker::ApplyUserLayoutTransforms(
 
 bool PECoffRelinker::ApplyUserOrderers(OrderedBlockGraph* ordered_graph) {
   LOG(INFO) << "Ordering block graph.";
+  core::PerfReport::ScopedPhase phase(perf_report_, "order");
 
   if (orderers_.empty()) {
     // Default orderer.
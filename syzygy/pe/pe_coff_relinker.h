@@ -22,6 +22,7 @@
 
 #include "base/files/file_path.h"
 #include "syzygy/block_graph/transform_policy.h"
+#include "syzygy/core/perf_report.h"
 #include "syzygy/pe/image_layout.h"
 #include "syzygy/pe/relinker.h"
 
@@ -62,6 +63,15 @@ class PECoffRelinker : public RelinkerInterface {
     allow_overwrite_ = allow_overwrite;
   }
 
+  // Specify the report in which the durations and the memory usage of the
+  // phases of the relinker are recorded. By default, it is null and nothing
+  // is recorded.
+  //
+  // @param perf_report the report, which must outlive the relinker.
+  void set_perf_report(core::PerfReport* perf_report) {
+    perf_report_ = perf_report;
+  }
+
   // @returns the path to the main input file.
   const base::FilePath& input_path() const { return input_path_; }
 
@@ -71,6 +81,9 @@ class PECoffRelinker : public RelinkerInterface {
   // @returns whether output files may be overwritten.
   bool allow_overwrite() const { return allow_overwrite_; }
 
+  // @returns the report in which the phases are recorded, if any.
+  core::PerfReport* perf_report() const { return perf_report_; }
+
   // @see RelinkerInterface::AppendTransform()
   virtual bool AppendTransform(BlockGraphTransform* transform) override;
 
@@ -155,6 +168,9 @@ class PECoffRelinker : public RelinkerInterface {
   // Whether we may overwrite output files.
   bool allow_overwrite_;
 
+  // The report in which the phases are recorded. May be null.
+  core::PerfReport* perf_report_;
+
   // Transforms to be applied, in order.
   std::vector<BlockGraphTransform*> transforms_;
 
@@ -14,6 +14,8 @@
 
 #include "syzygy/pe/pe_file.h"
 
+#include <algorithm>
+
 #include "base/native_library.h"
 #include "base/path_service.h"
 #include "base/files/file_path.h"
@@ -126,6 +128,52 @@ TEST_F(PEFileTest, Init) {
   EXPECT_TRUE(image_file_.section_headers() != NULL);
 }
 
+TEST_F(PEFileTest, InitWithFileMapping) {
+  EXPECT_FALSE(image_file_.use_file_mapping());
+
+  pe::PEFile mapped_file;
+  mapped_file.set_use_file_mapping(true);
+  EXPECT_TRUE(mapped_file.use_file_mapping());
+  ASSERT_TRUE(
+      mapped_file.Init(testing::GetExeRelativePath(testing::kTestDllName)));
+
+  // The mapped file has the same headers and sections as the one read to
+  // memory.
+  ASSERT_EQ(image_file_.nt_headers()->FileHeader.NumberOfSections,
+            mapped_file.nt_headers()->FileHeader.NumberOfSections);
+  EXPECT_EQ(0, ::memcmp(image_file_.nt_headers(), mapped_file.nt_headers(),
+                        sizeof(IMAGE_NT_HEADERS)));
+  for (size_t i = 0; i < image_file_.nt_headers()->FileHeader.NumberOfSections;
+       ++i) {
+    const IMAGE_SECTION_HEADER* header = image_file_.section_header(i);
+    RelativeAddress start(header->VirtualAddress);
+    size_t size = std::min(header->SizeOfRawData, header->Misc.VirtualSize);
+    if (size == 0)
+      continue;
+    const uint8_t* data = image_file_.GetImageData(start, size);
+    const uint8_t* mapped_data = mapped_file.GetImageData(start, size);
+    ASSERT_TRUE(data != NULL);
+    ASSERT_TRUE(mapped_data != NULL);
+    EXPECT_EQ(0, ::memcmp(data, mapped_data, size));
+  }
+
+  // Writing to the mapped data doesn't modify the file.
+  RelativeAddress start(image_file_.section_header(0)->VirtualAddress);
+  uint8_t* mapped_data = mapped_file.GetImageData(start, 1);
+  ASSERT_TRUE(mapped_data != NULL);
+  *mapped_data ^= 0xFF;
+  pe::PEFile other_file;
+  ASSERT_TRUE(
+      other_file.Init(testing::GetExeRelativePath(testing::kTestDllName)));
+  EXPECT_EQ(*image_file_.GetImageData(start, 1),
+            *other_file.GetImageData(start, 1));
+
+  // Missing files fail to map.
+  pe::PEFile missing_file;
+  missing_file.set_use_file_mapping(true);
+  EXPECT_FALSE(missing_file.Init(base::FilePath(L"C:\\nonexistent.dll")));
+}
+
 TEST_F(PEFileTest, GetImageData) {
   const IMAGE_NT_HEADERS* nt_headers = image_file_.nt_headers();
   ASSERT_TRUE(nt_headers != NULL);
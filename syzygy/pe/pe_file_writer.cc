@@ -18,9 +18,14 @@
 #include <winnt.h>
 #include <imagehlp.h>  // NOLINT
 
+#include <algorithm>
+
+#include "base/bind.h"
 #include "base/logging.h"
+#include "base/sys_info.h"
 #include "base/files/file_util.h"
 #include "base/win/scoped_handle.h"
+#include "syzygy/application/work_pool.h"
 #include "syzygy/common/buffer_parser.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/pe/pe_utils.h"
@@ -37,8 +42,8 @@ using pe::ImageLayout;
 namespace {
 
 template <class Type>
-bool UpdateReference(size_t start, Type new_value, std::vector<uint8_t>* data) {
-  BinaryBufferParser parser(&data->at(0), data->size());
+bool UpdateReference(size_t start, Type new_value, uint8_t* data, size_t size) {
+  BinaryBufferParser parser(data, size);
 
   Type* ref_ptr = NULL;
   if (!parser.GetAtIgnoreAlignment(start,
@@ -107,20 +112,69 @@ size_t GetSectionOffset(const ImageLayout& image_layout,
   return rel_addr - section_info.addr;
 }
 
+// Calculates the checksum of a mapped image, and writes it to its header.
+bool UpdateMappedImageChecksum(void* image_ptr, size_t image_size) {
+  DCHECK(image_ptr != NULL);
+
+  DWORD original_checksum = 0;
+  DWORD new_checksum = 0;
+  IMAGE_NT_HEADERS* nt_headers = ::CheckSumMappedFile(
+      image_ptr, static_cast<DWORD>(image_size), &original_checksum,
+      &new_checksum);
+
+  if (nt_headers == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "CheckSumMappedFile failed: " << common::LogWe(error);
+    return false;
+  }
+
+  // On success, we write the checksum back to the file header.
+  nt_headers->OptionalHeader.CheckSum = new_checksum;
+  return true;
+}
+
 }  // namespace
 
+// Writes the sections of an image to its mapping, as the work items of a
+// WorkPool. Each section only spans its own part of the file, so they can be
+// written concurrently.
+class PEFileWriter::SectionWriter {
+ public:
+  SectionWriter(PEFileWriter* writer,
+                const std::vector<BlockRange>* section_blocks,
+                uint8_t* image)
+      : writer_(writer), section_blocks_(section_blocks), image_(image) {
+    DCHECK(writer != NULL);
+    DCHECK(section_blocks != NULL);
+    DCHECK(image != NULL);
+  }
+
+  // Writes a range of blocks.
+  // @param index the index of the range in the section blocks.
+  // @returns true on success, false otherwise.
+  bool Write(size_t index) {
+    // The first range holds the headers, which aren't part of any section.
+    size_t section_index = index - 1;
+    if (index == 0)
+      section_index = BlockGraph::kInvalidSectionId;
+    return writer_->WriteSection(section_index, section_blocks_->at(index),
+                                 image_);
+  }
+
+ private:
+  PEFileWriter* writer_;
+  const std::vector<BlockRange>* section_blocks_;
+  uint8_t* image_;
+
+  DISALLOW_COPY_AND_ASSIGN(SectionWriter);
+};
+
 PEFileWriter::PEFileWriter(const ImageLayout& image_layout)
-    : image_layout_(image_layout), nt_headers_(NULL) {
+    : image_layout_(image_layout), nt_headers_(NULL),
+      thread_count_(base::SysInfo::NumberOfProcessors()) {
 }
 
 bool PEFileWriter::WriteImage(const base::FilePath& path) {
-  // Start by attempting to open the destination file.
-  base::ScopedFILE file(base::OpenFile(path, "wb"));
-  if (file.get() == NULL) {
-    LOG(ERROR) << "Unable to open " << path.value();
-    return false;
-  }
-
   if (!ValidateHeaders())
     return false;
 
@@ -128,16 +182,10 @@ bool PEFileWriter::WriteImage(const base::FilePath& path) {
 
   bool success = CalculateSectionRanges();
   if (success)
-    success = WriteBlocks(file.get());
+    success = WriteMappedImage(path);
 
   nt_headers_ = NULL;
 
-  // Close the file.
-  file.reset();
-
-  if (success)
-    success = UpdateFileChecksum(path);
-
   return success;
 }
 
@@ -177,26 +225,10 @@ bool PEFileWriter::UpdateFileChecksum(const base::FilePath& path) {
     return false;
   }
 
-  // Calculate the image checksum.
-  DWORD original_checksum = 0;
-  DWORD new_checksum = 0;
-  IMAGE_NT_HEADERS* nt_headers = ::CheckSumMappedFile(image_ptr,
-                                                      file_size,
-                                                      &original_checksum,
-                                                      &new_checksum);
-
-  if (nt_headers == NULL) {
-    DWORD error = ::GetLastError();
-    LOG(ERROR) << "CheckSumMappedFile failed: " << common::LogWe(error);
-  }
-
-  // On success, we write the checksum back to the file header.
-  if (nt_headers != NULL) {
-    nt_headers->OptionalHeader.CheckSum = new_checksum;
-  }
+  bool success = UpdateMappedImageChecksum(image_ptr, file_size);
   CHECK(::UnmapViewOfFile(image_ptr));
 
-  return nt_headers != NULL;
+  return success;
 }
 
 bool PEFileWriter::ValidateHeaders() {
@@ -325,89 +357,128 @@ bool PEFileWriter::CalculateSectionRanges() {
   return true;
 }
 
-bool PEFileWriter::WriteBlocks(FILE* file) {
-  DCHECK(file != NULL);
-
-  AbsoluteAddress image_base(nt_headers_->OptionalHeader.ImageBase);
-
-  // Create the output buffer, reserving enough room for the whole file.
+bool PEFileWriter::WriteMappedImage(const base::FilePath& path) {
   DCHECK(!image_layout_.sections.empty());
   size_t last_section_index = image_layout_.sections.size() - 1;
-  size_t image_size = section_file_range_map_[last_section_index].end().value();
-  std::vector<uint8_t> buffer;
-  buffer.reserve(image_size);
+  size_t image_size =
+      GetSectionFileRange(last_section_index).end().value();
+
+  // Create the destination file, and map it at its final size. The blocks are
+  // written straight to the mapping, without assembling the image in memory.
+  base::win::ScopedHandle file(
+      ::CreateFile(path.value().c_str(), GENERIC_READ | GENERIC_WRITE, 0,
+                   NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL));
+  if (!file.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to open " << path.value() << ": "
+               << common::LogWe(error);
+    return false;
+  }
 
-  // Iterate through all blocks in the address space writing them as we go.
-  BlockGraph::AddressSpace::RangeMap::const_iterator block_it(
+  base::win::ScopedHandle mapping(
+      ::CreateFileMapping(file.Get(), NULL, PAGE_READWRITE, 0,
+                          static_cast<DWORD>(image_size), NULL));
+  if (!mapping.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create image mapping: " << common::LogWe(error);
+    return false;
+  }
+
+  uint8_t* image = reinterpret_cast<uint8_t*>(
+      ::MapViewOfFile(mapping.Get(), FILE_MAP_WRITE, 0, 0, image_size));
+  if (image == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map image: " << common::LogWe(error);
+    return false;
+  }
+
+  bool success = WriteBlocks(image);
+  if (success)
+    success = UpdateMappedImageChecksum(image, image_size);
+
+  CHECK(::UnmapViewOfFile(image));
+
+  return success;
+}
+
+bool PEFileWriter::WriteBlocks(uint8_t* image) {
+  DCHECK(image != NULL);
+
+  // Split the blocks by section. Note that the section index is not the same
+  // thing as the section_id stored in the block; the section IDs are relative
+  // to the section data stored in the block-graph, not the ordered section
+  // infos stored in the image layout. The first range is for the headers.
+  std::vector<BlockRange> section_blocks(image_layout_.sections.size() + 1);
+  BlockGraph::AddressSpace::RangeMapConstIter block_it(
       image_layout_.blocks.address_space_impl().ranges().begin());
-  BlockGraph::AddressSpace::RangeMap::const_iterator block_end(
+  BlockGraph::AddressSpace::RangeMapConstIter block_end(
       image_layout_.blocks.address_space_impl().ranges().end());
-
-  // Write all of the blocks. We take care of writing the padding at the
-  // end of each section. Note that the section index is not the same thing as
-  // the section_id stored in the block; the section IDs are relative to the
-  // section data stored in the block-graph, not the ordered section infos
-  // stored in the image layout.
   BlockGraph::SectionId section_id = BlockGraph::kInvalidSectionId;
-  size_t section_index = BlockGraph::kInvalidSectionId;
+  size_t index = 0;
+  section_blocks[0] = BlockRange(block_it, block_it);
   for (; block_it != block_end; ++block_it) {
-    BlockGraph::Block* block = const_cast<BlockGraph::Block*>(block_it->second);
-
-    // If we're jumping to a new section output the necessary padding.
-    if (block->section() != section_id) {
-      FlushSection(section_index, &buffer);
-      section_id = block->section();
-      section_index++;
-      DCHECK_GT(image_layout_.sections.size(), section_index);
+    // If we're jumping to a new section close the range of the previous one.
+    if (block_it->second->section() != section_id) {
+      section_blocks[index].second = block_it;
+      section_id = block_it->second->section();
+      ++index;
+      DCHECK_GT(section_blocks.size(), index);
+      section_blocks[index] = BlockRange(block_it, block_it);
     }
+  }
+  section_blocks[index].second = block_end;
+  for (++index; index < section_blocks.size(); ++index)
+    section_blocks[index] = BlockRange(block_end, block_end);
+
+  SectionWriter section_writer(this, &section_blocks, image);
+  application::WorkPool pool(thread_count_);
+  return pool.Run(section_blocks.size(),
+                  base::Bind(&SectionWriter::Write,
+                             base::Unretained(&section_writer)));
+}
+
+bool PEFileWriter::WriteSection(size_t section_index,
+                                const BlockRange& blocks,
+                                uint8_t* image) {
+  DCHECK(image != NULL);
+
+  AbsoluteAddress image_base(nt_headers_->OptionalHeader.ImageBase);
+
+  // Fill the section with padding, which the blocks then overwrite.
+  const FileRange& section_file_range = GetSectionFileRange(section_index);
+  uint8_t padding_byte = GetSectionPaddingByte(image_layout_, section_index);
+  ::memset(image + section_file_range.start().value(), padding_byte,
+           section_file_range.size());
 
-    if (!WriteOneBlock(image_base, section_index, block, &buffer)) {
+  BlockGraph::AddressSpace::RangeMapConstIter block_it = blocks.first;
+  for (; block_it != blocks.second; ++block_it) {
+    const BlockGraph::Block* block = block_it->second;
+    if (!WriteOneBlock(image_base, section_index, block, image)) {
       LOG(ERROR) << "Failed to write block \"" << block->name() << "\".";
       return false;
     }
   }
 
-  FlushSection(last_section_index, &buffer);
-  DCHECK_EQ(image_size, buffer.size());
-
-  // Write the whole image to disk in one go.
-  if (::fwrite(&buffer[0], sizeof(buffer[0]), buffer.size(), file) !=
-          buffer.size()) {
-    LOG(ERROR) << "Failed to write image to file.";
-    return false;
-  }
-
   return true;
 }
 
-void PEFileWriter::FlushSection(size_t section_index,
-                                std::vector<uint8_t>* buffer) {
-  DCHECK(buffer != NULL);
-
-  size_t section_file_end =
-      section_file_range_map_[section_index].end().value();
-
-  // We've already sanity checked this in CalculateSectionFileRanges, so this
-  // should be true.
-  DCHECK_GE(section_file_end, buffer->size());
-  if (section_file_end == buffer->size())
-    return;
-
-  uint8_t padding_byte = GetSectionPaddingByte(image_layout_, section_index);
-  buffer->resize(section_file_end, padding_byte);
-
-  return;
+const PEFileWriter::FileRange& PEFileWriter::GetSectionFileRange(
+    size_t section_index) const {
+  SectionIndexFileRangeMap::const_iterator it =
+      section_file_range_map_.find(section_index);
+  DCHECK(it != section_file_range_map_.end());
+  return it->second;
 }
 
 bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
                                  size_t section_index,
                                  const BlockGraph::Block* block,
-                                 std::vector<uint8_t>* buffer) {
-  // This function walks through the data referred by the input block, and
-  // patches it to reflect the addresses and offsets of the blocks
-  // referenced before writing the block's data to the file.
+                                 uint8_t* image) {
+  // This function copies the data of the input block to its place in the
+  // image, and patches it to reflect the addresses and offsets of the blocks
+  // referenced.
   DCHECK(block != NULL);
-  DCHECK(buffer != NULL);
+  DCHECK(image != NULL);
 
   RelativeAddress addr;
   if (!image_layout_.blocks.GetAddressOf(block, &addr)) {
@@ -415,11 +486,9 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     return false;
   }
 
-  // Get the start address of the section containing this block as well as the
-  // padding byte we need to use.
+  // Get the start address of the section containing this block.
   RelativeAddress section_start(0);
   RelativeAddress section_end(image_layout_.sections[0].addr);
-  uint8_t padding_byte = GetSectionPaddingByte(image_layout_, section_index);
   if (section_index != BlockGraph::kInvalidSectionId) {
     const ImageLayout::SectionInfo& section_info =
         image_layout_.sections[section_index];
@@ -427,7 +496,7 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     section_end = section_start + section_info.size;
   }
 
-  const FileRange& section_file_range = section_file_range_map_[section_index];
+  const FileRange& section_file_range = GetSectionFileRange(section_index);
 
   // The block should lie entirely within the section.
   if (addr < section_start || addr + block->size() > section_end) {
@@ -440,11 +509,6 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
   BlockGraph::Offset section_offs = addr - section_start;
   FileOffsetAddress file_offs = section_file_range.start() + section_offs;
 
-  // We shouldn't have written anything to the spot where the block belongs.
-  // This is only a DCHECK because the address space of the image layout and
-  // the consistency of the sections guarantees this for us.
-  DCHECK_LE(buffer->size(), file_offs.value());
-
   size_t inited_data_size = GetBlockInitializedDataSize(block);
 
   // If this block is entirely in the virtual portion of the section, skip it.
@@ -466,14 +530,11 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     return false;
   }
 
-  // Add any necessary padding to get us to the block offset.
-  if (buffer->size() < file_offs.value())
-    buffer->resize(file_offs.value(), padding_byte);
-
-  // Copy the block data into the buffer.
-  buffer->insert(buffer->end(),
-                 block->data(),
-                 block->data() + block->data_size());
+  // Copy the block data to the image. The padding before the block has
+  // already been written along with the rest of the section.
+  uint8_t* block_data = image + file_offs.value();
+  if (block->data_size() > 0)
+    ::memcpy(block_data, block->data(), block->data_size());
 
   // We now want to append zeros for the implicit portion of the block data.
   size_t trailing_zeros = block->size() - block->data_size();
@@ -492,7 +553,7 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     }
 
     // Write the implicit trailing zeros.
-    buffer->insert(buffer->end(), trailing_zeros, 0);
+    ::memset(block_data + block->data_size(), 0, trailing_zeros);
   }
 
   // Patch up all the references.
@@ -539,8 +600,7 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
         // Get the offset of the block in its section, as well as the range of
         // the section on disk. Validate that the referred location is
         // actually directly represented on disk (not in implicit virtual data).
-        const FileRange& file_range =
-            section_file_range_map_[dst_section_index];
+        const FileRange& file_range = GetSectionFileRange(dst_section_index);
         size_t section_offset = GetSectionOffset(image_layout_,
                                                  dst_addr,
                                                  dst_section_index);
@@ -560,22 +620,28 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
         return false;
     }
 
-    // Now store the new value.
-    BlockGraph::Offset ref_offset = file_offs.value() + start;
+    // Now store the new value. The references all lie in the initialized
+    // portion of the block, which we've checked is on disk.
     switch (ref.size()) {
       case sizeof(uint8_t):
-        if (!UpdateReference(ref_offset, static_cast<uint8_t>(value), buffer))
+        if (!UpdateReference(start, static_cast<uint8_t>(value), block_data,
+                             inited_data_size)) {
           return false;
+        }
         break;
 
       case sizeof(uint16_t):
-        if (!UpdateReference(ref_offset, static_cast<uint16_t>(value), buffer))
+        if (!UpdateReference(start, static_cast<uint16_t>(value), block_data,
+                             inited_data_size)) {
           return false;
+        }
         break;
 
       case sizeof(uint32_t):
-        if (!UpdateReference(ref_offset, static_cast<uint32_t>(value), buffer))
+        if (!UpdateReference(start, static_cast<uint32_t>(value), block_data,
+                             inited_data_size)) {
           return false;
+        }
         break;
 
       default:
@@ -15,6 +15,9 @@
 #ifndef SYZYGY_PE_PE_FILE_WRITER_H_
 #define SYZYGY_PE_PE_FILE_WRITER_H_
 
+#include <map>
+#include <vector>
+
 #include "base/files/file_path.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/core/address_space.h"
@@ -25,7 +28,9 @@
 namespace pe {
 
 // Given an address space and header information, writes a BlockGraph out
-// to a PE image file.
+// to a PE image file. The destination file is mapped at its final size and
+// each block is copied straight to its place in the file, with its references
+// resolved in place. The sections are written concurrently.
 class PEFileWriter {
  public:
   typedef block_graph::BlockGraph BlockGraph;
@@ -39,10 +44,29 @@ class PEFileWriter {
   // Writes the image to path.
   bool WriteImage(const base::FilePath& path);
 
+  // Sets the number of threads used to write the sections. This defaults to
+  // the number of processors.
+  // @param thread_count the number of threads, which must be at least 1.
+  void set_thread_count(size_t thread_count) {
+    DCHECK_LT(0u, thread_count);
+    thread_count_ = thread_count;
+  }
+
+  // @returns the number of threads used to write the sections.
+  size_t thread_count() const { return thread_count_; }
+
   // Updates the checksum for the image @p path.
   static bool UpdateFileChecksum(const base::FilePath& path);
 
  protected:
+  class SectionWriter;
+
+  // A range of blocks of the image layout.
+  typedef BlockGraph::AddressSpace::RangeMapConstIterPair BlockRange;
+
+  // The file ranges of each section.
+  typedef core::AddressRange<core::FileOffsetAddress, size_t> FileRange;
+
   // Validates the DOS header and the NT headers in the image.
   // On success, sets the nt_headers_ pointer.
   bool ValidateHeaders();
@@ -51,26 +75,44 @@ class PEFileWriter {
   // section_file_range_map_ and section_index_space_.
   bool CalculateSectionRanges();
 
-  // Writes the entire image to the given file. Delegates to FlushSection and
-  // WriteOneBlock.
-  bool WriteBlocks(FILE* file);
-
-  // Closes off the writing of a section by adding any necessary padding to the
-  // output buffer.
-  void FlushSection(size_t section_index, std::vector<uint8_t>* buffer);
-
-  // Writes a single block to the buffer, first writing any necessary padding
-  // (the content of which depends on the section type), followed by the
-  // block data (containing finalized references).
+  // Creates the image file at path, maps it and writes the image to the
+  // mapping. Also updates the checksum of the image.
+  // @param path the path of the image file.
+  // @returns true on success, false otherwise.
+  bool WriteMappedImage(const base::FilePath& path);
+
+  // Writes the entire image to its mapping. Delegates to WriteSection, on
+  // up to thread_count_ threads.
+  // @param image the mapping of the image file.
+  // @returns true on success, false otherwise.
+  bool WriteBlocks(uint8_t* image);
+
+  // Writes a section, filling it with padding (the content of which depends
+  // on the section type) and then writing its blocks.
+  // @param section_index the index of the section, or kInvalidSectionId for
+  //     the headers.
+  // @param blocks the blocks of the section.
+  // @param image the mapping of the image file.
+  // @returns true on success, false otherwise.
+  bool WriteSection(size_t section_index,
+                    const BlockRange& blocks,
+                    uint8_t* image);
+
+  // Writes a single block to its place in the image: the block data, followed
+  // by its implicit trailing zeros, with its references finalized.
   bool WriteOneBlock(AbsoluteAddress image_base,
                      size_t section_index,
                      const BlockGraph::Block* block,
-                     std::vector<uint8_t>* buffer);
+                     uint8_t* image);
+
+  // @param section_index the index of a section, or kInvalidSectionId for the
+  //     headers.
+  // @returns the file range of the section.
+  const FileRange& GetSectionFileRange(size_t section_index) const;
 
   // The file ranges of each section. This is populated by
   // CalculateSectionRanges and is a map from section index (as ordered in
   // the image layout) to section ranges on disk.
-  typedef core::AddressRange<core::FileOffsetAddress, size_t> FileRange;
   typedef std::map<size_t, FileRange> SectionIndexFileRangeMap;
   SectionIndexFileRangeMap section_file_range_map_;
 
@@ -88,6 +130,9 @@ class PEFileWriter {
   // Refers to the nt headers from the image during WriteImage.
   const IMAGE_NT_HEADERS* nt_headers_;
 
+  // The number of threads used to write the sections.
+  size_t thread_count_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(PEFileWriter);
 };
@@ -66,6 +66,36 @@ TEST_F(PEFileWriterTest, RewriteAndLoadImage) {
   ASSERT_NO_FATAL_FAILURE(CheckTestDll(temp_file));
 }
 
+TEST_F(PEFileWriterTest, WriteImageInParallel) {
+  base::FilePath temp_dir;
+  ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir));
+  base::FilePath serial_file = temp_dir.Append(L"serial.dll");
+  base::FilePath parallel_file = temp_dir.Append(L"parallel.dll");
+
+  PEFile image_file;
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  ASSERT_TRUE(image_file.Init(image_path));
+
+  Decomposer decomposer(image_file);
+  block_graph::BlockGraph block_graph;
+  pe::ImageLayout image_layout(&block_graph);
+  ASSERT_TRUE(decomposer.Decompose(&image_layout));
+
+  PEFileWriter serial_writer(image_layout);
+  EXPECT_LT(0u, serial_writer.thread_count());
+  serial_writer.set_thread_count(1);
+  EXPECT_EQ(1u, serial_writer.thread_count());
+  ASSERT_TRUE(serial_writer.WriteImage(serial_file));
+
+  PEFileWriter parallel_writer(image_layout);
+  parallel_writer.set_thread_count(8);
+  ASSERT_TRUE(parallel_writer.WriteImage(parallel_file));
+
+  // Both writes produce the same image.
+  EXPECT_TRUE(base::ContentsEqual(serial_file, parallel_file));
+  ASSERT_NO_FATAL_FAILURE(CheckTestDll(parallel_file));
+}
+
 TEST_F(PEFileWriterTest, UpdateFileChecksum) {
   base::FilePath temp_dir;
   ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir));
@@ -17,7 +17,10 @@
 #include <algorithm>
 #include <ctime>
 
+#include "base/bind.h"
+#include "base/sys_info.h"
 #include "base/strings/string_util.h"
+#include "syzygy/application/work_pool.h"
 #include "syzygy/block_graph/typed_block.h"
 #include "syzygy/common/align.h"
 #include "syzygy/pe/pe_structs.h"
@@ -130,6 +133,82 @@ bool IsValidReference(const BlockGraph::AddressSpace& addr_space,
   return true;
 }
 
+// Validates the references of the blocks of an image, and collects the
+// addresses of their absolute references. The blocks are handed out to the
+// threads in chunks. Each block only reads the address space, which isn't
+// modified meanwhile, and the relocs of each block are kept apart so that
+// they can be written in address order whatever the number of threads.
+class RelocCollector {
+ public:
+  typedef std::pair<RelativeAddress, const BlockGraph::Block*> BlockAddress;
+  typedef std::vector<RelativeAddress> RelocVector;
+
+  // The number of consecutive blocks in a work item.
+  static const size_t kBlocksPerChunk = 256;
+
+  // @param addr_space the address space the blocks are laid out in.
+  // @param blocks the blocks to process, with their addresses.
+  // @param relocs_block the relocs block, which is laid out after the relocs
+  //     are collected. The references to it are valid.
+  // @param relocs receives the relocs of each block. It must be as large as
+  //     @p blocks.
+  RelocCollector(const BlockGraph::AddressSpace* addr_space,
+                 const std::vector<BlockAddress>* blocks,
+                 const BlockGraph::Block* relocs_block,
+                 std::vector<RelocVector>* relocs)
+      : addr_space_(addr_space), blocks_(blocks), relocs_block_(relocs_block),
+        relocs_(relocs) {
+    DCHECK(addr_space != NULL);
+    DCHECK(blocks != NULL);
+    DCHECK(relocs != NULL);
+    DCHECK_EQ(blocks->size(), relocs->size());
+  }
+
+  // Collects the relocs of a chunk of blocks.
+  // @param chunk the index of the chunk.
+  // @returns false if a block has an invalid reference, true otherwise.
+  bool CollectChunk(size_t chunk) {
+    size_t begin = kBlocksPerChunk * chunk;
+    size_t end = std::min(begin + kBlocksPerChunk, blocks_->size());
+    for (size_t i = begin; i < end; ++i) {
+      if (!CollectRelocs(blocks_->at(i), &relocs_->at(i)))
+        return false;
+    }
+    return true;
+  }
+
+ private:
+  bool CollectRelocs(const BlockAddress& block_address, RelocVector* relocs) {
+    const BlockGraph::Block* block = block_address.second;
+
+    // Iterate over all outgoing references in this block in order of
+    // increasing offset.
+    BlockGraph::Block::ReferenceMap::const_iterator ref_it(
+        block->references().begin());
+    for (; ref_it != block->references().end(); ++ref_it) {
+      if (ref_it->second.referenced() != relocs_block_ &&
+          !IsValidReference(*addr_space_, ref_it->second)) {
+        LOG(ERROR) << "Block \"" << block->name() << "\" has a reference at "
+                   << "offset " << ref_it->first << " to a block that is not "
+                   << "in the image layout.";
+        return false;
+      }
+
+      // Add each absolute reference to the relocs.
+      if (ref_it->second.type() == BlockGraph::ABSOLUTE_REF)
+        relocs->push_back(block_address.first + ref_it->first);
+    }
+    return true;
+  }
+
+  const BlockGraph::AddressSpace* addr_space_;
+  const std::vector<BlockAddress>* blocks_;
+  const BlockGraph::Block* relocs_block_;
+  std::vector<RelocVector>* relocs_;
+
+  DISALLOW_COPY_AND_ASSIGN(RelocCollector);
+};
+
 // Functor to order references by the address of their referred block.
 class RefAddrLess {
  public:
@@ -166,7 +245,9 @@ namespace pe {
 PEImageLayoutBuilder::PEImageLayoutBuilder(ImageLayout* image_layout)
     : PECoffImageLayoutBuilder(image_layout),
       dos_header_block_(NULL),
-      nt_headers_block_(NULL) {
+      nt_headers_block_(NULL),
+      original_layout_(NULL),
+      thread_count_(base::SysInfo::NumberOfProcessors()) {
 }
 
 bool PEImageLayoutBuilder::LayoutImageHeaders(
@@ -226,7 +307,8 @@ bool PEImageLayoutBuilder::LayoutOrderedBlockGraph(
       obg.ordered_sections().end();
 
   // Iterate through the sections.
-  for (; section_it != section_end; ++section_it) {
+  for (size_t section_index = 0; section_it != section_end;
+       ++section_it, ++section_index) {
     BlockGraph::Section* section = (*section_it)->section();
     DCHECK(section != NULL);
 
@@ -236,6 +318,19 @@ bool PEImageLayoutBuilder::LayoutOrderedBlockGraph(
       break;
     }
 
+    // Keep the section where it was in the original image if we can.
+    if (original_layout_ != NULL &&
+        section_index < original_layout_->sections.size()) {
+      const ImageLayout::SectionInfo& original_section =
+          original_layout_->sections[section_index];
+      if (CanLayoutSectionInPlace(**section_it, original_section)) {
+        if (!LayoutSectionInPlace(**section_it, original_section))
+          return false;
+        continue;
+      }
+      VLOG(1) << "Laying out section \"" << section->name() << "\" anew.";
+    }
+
     if (!OpenSection(*section))
       return false;
 
@@ -262,6 +357,85 @@ bool PEImageLayoutBuilder::LayoutOrderedBlockGraph(
   return true;
 }
 
+bool PEImageLayoutBuilder::CanLayoutSectionInPlace(
+    const OrderedBlockGraph::OrderedSection& section,
+    const ImageLayout::SectionInfo& original_section) const {
+  if (section.section()->name() != original_section.name ||
+      section.section()->characteristics() !=
+          original_section.characteristics) {
+    return false;
+  }
+
+  // The section must start right where the next section would be laid out.
+  // It can't move back over what's already laid out, which may have grown,
+  // and the image can't have gaps between sections either.
+  if (cursor_.AlignUp(section_alignment_) != original_section.addr)
+    return false;
+
+  RelativeAddress section_end = original_section.addr + original_section.size;
+  RelativeAddress next_addr = original_section.addr;
+  OrderedBlockGraph::BlockList::const_iterator block_it =
+      section.ordered_blocks().begin();
+  for (; block_it != section.ordered_blocks().end(); ++block_it) {
+    const BlockGraph::Block* block = *block_it;
+
+    // Blocks that were added by transforms have no original address.
+    RelativeAddress addr = block->addr();
+    if (addr == RelativeAddress::kInvalidAddress)
+      return false;
+
+    // The block must come after the previous one, with the same padding that
+    // LayoutBlock would apply, and must still fit in the section.
+    size_t padding = block->padding_before();
+    if (padding_ > 0 && next_addr > original_section.addr)
+      padding = std::max(padding, padding_);
+    if (addr < next_addr + padding || addr >= section_end ||
+        block->size() > static_cast<size_t>(section_end - addr)) {
+      return false;
+    }
+
+    size_t alignment = block->alignment();
+    if (block->type() == BlockGraph::CODE_BLOCK && alignment < code_alignment_)
+      alignment = code_alignment_;
+    RelativeAddress aligned_addr = addr + block->alignment_offset();
+    if (aligned_addr.AlignUp(alignment) != aligned_addr)
+      return false;
+
+    next_addr = addr + block->size();
+  }
+
+  return true;
+}
+
+bool PEImageLayoutBuilder::LayoutSectionInPlace(
+    const OrderedBlockGraph::OrderedSection& section,
+    const ImageLayout::SectionInfo& original_section) {
+  DCHECK(CanLayoutSectionInPlace(section, original_section));
+
+  cursor_ = original_section.addr;
+  if (!OpenSection(*section.section()))
+    return false;
+  DCHECK_EQ(original_section.addr, section_start_);
+
+  OrderedBlockGraph::BlockList::const_iterator block_it =
+      section.ordered_blocks().begin();
+  for (; block_it != section.ordered_blocks().end(); ++block_it) {
+    BlockGraph::Block* block = *block_it;
+    cursor_ = block->addr();
+    if (block->data_size() > 0)
+      section_auto_init_end_ = cursor_ + block->data_size();
+    if (!LayoutBlockImpl(block))
+      return false;
+  }
+
+  // Keep the original virtual size, so that the sections that follow can be
+  // kept in place as well.
+  DCHECK_LE(cursor_, original_section.addr + original_section.size);
+  cursor_ = original_section.addr + original_section.size;
+
+  return CloseSection();
+}
+
 bool PEImageLayoutBuilder::Finalize() {
   if (!CreateRelocsSection())
     return false;
@@ -391,30 +565,34 @@ bool PEImageLayoutBuilder::CreateRelocsSection() {
   BlockGraph::Block* relocs_block = reloc_data.block();
   CHECK_EQ(0, reloc_data.offset());
 
-  // Iterate over all blocks in the address space, in the order of increasing
+  // Gather all blocks in the address space, in the order of increasing
   // addresses.
+  std::vector<RelocCollector::BlockAddress> blocks;
+  blocks.reserve(image_layout_->blocks.size());
   BlockGraph::AddressSpace::RangeMap::const_iterator it(
       image_layout_->blocks.address_space_impl().ranges().begin());
   BlockGraph::AddressSpace::RangeMap::const_iterator end(
       image_layout_->blocks.address_space_impl().ranges().end());
+  for (; it != end; ++it)
+    blocks.push_back(std::make_pair(it->first.start(), it->second));
+
+  // Validate the references of the blocks and collect their relocs on
+  // several threads.
+  std::vector<RelocCollector::RelocVector> block_relocs(blocks.size());
+  RelocCollector collector(&image_layout_->blocks, &blocks, relocs_block,
+                           &block_relocs);
+  size_t chunk_count = (blocks.size() + RelocCollector::kBlocksPerChunk - 1) /
+      RelocCollector::kBlocksPerChunk;
+  application::WorkPool pool(thread_count_);
+  if (!pool.Run(chunk_count, base::Bind(&RelocCollector::CollectChunk,
+                                        base::Unretained(&collector)))) {
+    return false;
+  }
 
-  for (; it != end; ++it) {
-    const BlockGraph::Block* block = it->second;
-    RelativeAddress block_addr;
-    CHECK(image_layout_->blocks.GetAddressOf(block, &block_addr));
-
-    // Iterate over all outgoing references in this block in
-    // order of increasing offset.
-    BlockGraph::Block::ReferenceMap::const_iterator ref_it(
-        block->references().begin());
-    BlockGraph::Block::ReferenceMap::const_iterator ref_end(
-        block->references().end());
-    for (; ref_it != ref_end; ++ref_it) {
-      // Add each absolute reference to the relocs.
-      if (ref_it->second.type() == BlockGraph::ABSOLUTE_REF) {
-        writer.WriteReloc(block_addr + ref_it->first);
-      }
-    }
+  // The relocs are then written on this thread, in address order.
+  for (size_t i = 0; i < block_relocs.size(); ++i) {
+    for (size_t j = 0; j < block_relocs[i].size(); ++j)
+      writer.WriteReloc(block_relocs[i][j]);
   }
 
   // Get the relocations data from the writer.
@@ -48,6 +48,33 @@ class PEImageLayoutBuilder : public PECoffImageLayoutBuilder {
     return nt_headers_block_;
   }
 
+  // Sets the layout of the original image. When set, the sections whose
+  // blocks all still fit at their original addresses are laid out in place:
+  // they keep their original address and size, and their blocks keep their
+  // original addresses. This keeps the unchanged parts of an image identical
+  // when only a few of its blocks are transformed. The other sections are
+  // laid out as usual, after the sections that precede them.
+  // @param original_layout the layout of the original image, or NULL to lay
+  //     out all the sections anew. It must outlive the builder.
+  void set_original_layout(const ImageLayout* original_layout) {
+    original_layout_ = original_layout;
+  }
+
+  // @returns the layout of the original image, or NULL if there is none.
+  const ImageLayout* original_layout() const { return original_layout_; }
+
+  // Sets the number of threads used to validate the references of the blocks
+  // and to collect the relocs when finalizing. This defaults to the number of
+  // processors. The output doesn't depend on it.
+  // @param thread_count the number of threads, which must be at least 1.
+  void set_thread_count(size_t thread_count) {
+    DCHECK_LT(0u, thread_count);
+    thread_count_ = thread_count;
+  }
+
+  // @returns the number of threads used when finalizing.
+  size_t thread_count() const { return thread_count_; }
+
   // Lays out the image headers, and sets the file and section alignment using
   // the values from the header.
   // @param dos_header_block must be a block that's a valid DOS header
@@ -73,10 +100,29 @@ class PEImageLayoutBuilder : public PECoffImageLayoutBuilder {
   bool Finalize();
 
  private:
+  // Determines whether a section can be laid out in place.
+  // @param section the section to lay out.
+  // @param original_section the same section in the original layout.
+  // @returns true if all the blocks of @p section can be laid out at their
+  //     original addresses in @p original_section, honoring their alignment
+  //     and padding, and if @p original_section starts where the next
+  //     section would be laid out.
+  bool CanLayoutSectionInPlace(
+      const OrderedBlockGraph::OrderedSection& section,
+      const ImageLayout::SectionInfo& original_section) const;
+  // Lays out a section at its original address, with its blocks at their
+  // original addresses.
+  // @param section the section to lay out.
+  // @param original_section the same section in the original layout.
+  // @returns true on success, false otherwise.
+  // @pre CanLayoutSectionInPlace returns true for @p section.
+  bool LayoutSectionInPlace(const OrderedBlockGraph::OrderedSection& section,
+                            const ImageLayout::SectionInfo& original_section);
   // Ensure that the Safe SEH Table is sorted.
   bool SortSafeSehTable();
   // Allocates and populates a new relocations section containing
-  // relocations for all absolute references in address_space_.
+  // relocations for all absolute references in address_space_. This fails
+  // if a block refers to a block that isn't laid out.
   bool CreateRelocsSection();
   // Write the NT headers and section headers to the image.
   // After this is done, the image is "baked", and everything except for
@@ -94,6 +140,12 @@ class PEImageLayoutBuilder : public PECoffImageLayoutBuilder {
   BlockGraph::Block* dos_header_block_;
   BlockGraph::Block* nt_headers_block_;
 
+  // The layout of the original image, if sections are to be kept in place.
+  const ImageLayout* original_layout_;
+
+  // The number of threads used when finalizing.
+  size_t thread_count_;
+
   DISALLOW_COPY_AND_ASSIGN(PEImageLayoutBuilder);
 };
 
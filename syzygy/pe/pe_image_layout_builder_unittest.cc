@@ -107,8 +107,10 @@ TEST_F(PEImageLayoutBuilderTest, Accessors) {
 
   builder.set_padding(16);
   builder.set_code_alignment(8);
+  builder.set_thread_count(3);
   EXPECT_EQ(16, builder.padding());
   EXPECT_EQ(8, builder.code_alignment());
+  EXPECT_EQ(3u, builder.thread_count());
 }
 
 TEST_F(PEImageLayoutBuilderTest, LayoutImageHeaders) {
@@ -149,6 +151,106 @@ TEST_F(PEImageLayoutBuilderTest, RewriteTestDll) {
   EXPECT_LE(rewritten_size, orig_size);
 }
 
+TEST_F(PEImageLayoutBuilderTest, RelocsDoNotDependOnThreadCount) {
+  OrderedBlockGraph obg(&block_graph_);
+  block_graph::orderers::OriginalOrderer orig_orderer;
+  ASSERT_TRUE(orig_orderer.OrderBlockGraph(&obg, dos_header_block_));
+
+  std::vector<uint8_t> relocs[2];
+  const size_t kThreadCounts[] = { 1, 4 };
+  for (size_t i = 0; i < arraysize(kThreadCounts); ++i) {
+    ImageLayout layout(&block_graph_);
+    PEImageLayoutBuilder builder(&layout);
+    builder.set_thread_count(kThreadCounts[i]);
+    ASSERT_TRUE(builder.LayoutImageHeaders(dos_header_block_));
+    ASSERT_TRUE(builder.LayoutOrderedBlockGraph(obg));
+    ASSERT_TRUE(builder.Finalize());
+
+    const BlockGraph::Block* relocs_block =
+        layout.blocks.GetBlockByAddress(layout.sections.back().addr);
+    ASSERT_TRUE(relocs_block != NULL);
+    ASSERT_LT(0u, relocs_block->data_size());
+    relocs[i].assign(relocs_block->data(),
+                     relocs_block->data() + relocs_block->data_size());
+  }
+
+  EXPECT_EQ(relocs[0], relocs[1]);
+}
+
+TEST_F(PEImageLayoutBuilderTest, FinalizeFailsForReferenceOutsideLayout) {
+  OrderedBlockGraph obg(&block_graph_);
+  block_graph::orderers::OriginalOrderer orig_orderer;
+  ASSERT_TRUE(orig_orderer.OrderBlockGraph(&obg, dos_header_block_));
+
+  // Add a block that refers to a block that isn't laid out.
+  BlockGraph::Section* data_section = block_graph_.FindSection(".data");
+  ASSERT_TRUE(data_section != NULL);
+  BlockGraph::Block* referrer =
+      block_graph_.AddBlock(BlockGraph::DATA_BLOCK, 4, "referrer");
+  BlockGraph::Block* orphan =
+      block_graph_.AddBlock(BlockGraph::DATA_BLOCK, 4, "orphan");
+  ASSERT_TRUE(referrer->SetReference(
+      0, BlockGraph::Reference(BlockGraph::ABSOLUTE_REF, 4, orphan, 0, 0)));
+  obg.PlaceAtTail(data_section, referrer);
+
+  ImageLayout layout(&block_graph_);
+  PEImageLayoutBuilder builder(&layout);
+  builder.set_thread_count(4);
+  ASSERT_TRUE(builder.LayoutImageHeaders(dos_header_block_));
+  ASSERT_TRUE(builder.LayoutOrderedBlockGraph(obg));
+  EXPECT_FALSE(builder.Finalize());
+}
+
+TEST_F(PEImageLayoutBuilderTest, LayoutInPlaceTestDll) {
+  OrderedBlockGraph obg(&block_graph_);
+  block_graph::orderers::OriginalOrderer orig_orderer;
+  ASSERT_TRUE(orig_orderer.OrderBlockGraph(&obg, dos_header_block_));
+
+  // Add a block at the end of the last section before the relocs. It has no
+  // original address, so that section has to be laid out anew.
+  ASSERT_LE(2u, image_layout_.sections.size());
+  size_t changed_index = image_layout_.sections.size() - 2;
+  BlockGraph::Section* changed_section = block_graph_.FindSection(
+      image_layout_.sections[changed_index].name);
+  ASSERT_TRUE(changed_section != NULL);
+  BlockGraph::Block* new_block =
+      block_graph_.AddBlock(BlockGraph::DATA_BLOCK, 16, "new_block");
+  new_block->set_section(changed_section->id());
+  obg.PlaceAtTail(changed_section, new_block);
+
+  ImageLayout layout(&block_graph_);
+  PEImageLayoutBuilder builder(&layout);
+  builder.set_original_layout(&image_layout_);
+  EXPECT_EQ(&image_layout_, builder.original_layout());
+  ASSERT_TRUE(builder.LayoutImageHeaders(dos_header_block_));
+  EXPECT_TRUE(builder.LayoutOrderedBlockGraph(obg));
+  EXPECT_TRUE(builder.Finalize());
+
+  PEFileWriter writer(layout);
+  ASSERT_TRUE(writer.WriteImage(temp_file_));
+  ASSERT_NO_FATAL_FAILURE(CheckTestDll(temp_file_));
+
+  // The unchanged sections, and all their blocks, have been kept in place.
+  ASSERT_EQ(image_layout_.sections.size(), layout.sections.size());
+  for (size_t i = 0; i < changed_index; ++i)
+    EXPECT_EQ(image_layout_.sections[i], layout.sections[i]);
+  BlockGraph::AddressSpace::RangeMapConstIter it = layout.blocks.begin();
+  for (; it != layout.blocks.end(); ++it) {
+    const BlockGraph::Block* block = it->second;
+    if (block->section() == changed_section->id() ||
+        block->section() == BlockGraph::kInvalidSectionId) {
+      continue;
+    }
+    EXPECT_EQ(block->addr(), it->first.start());
+  }
+
+  // The changed section grew to hold the new block.
+  EXPECT_EQ(image_layout_.sections[changed_index].addr,
+            layout.sections[changed_index].addr);
+  EXPECT_LT(image_layout_.sections[changed_index].size,
+            layout.sections[changed_index].size);
+}
+
 TEST_F(PEImageLayoutBuilderTest, PadTestDll) {
   OrderedBlockGraph obg(&block_graph_);
   block_graph::orderers::OriginalOrderer orig_orderer;
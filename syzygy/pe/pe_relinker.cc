@@ -87,6 +87,39 @@ bool Decompose(const PEFile& pe_file,
   return true;
 }
 
+// Loads a decomposition serialized by PERelinker::DecomposeToBuffer.
+bool LoadDecomposition(const PEFile& pe_file,
+                       const std::vector<uint8_t>& decomposition,
+                       ImageLayout* image_layout,
+                       BlockGraph::Block** dos_header_block) {
+  DCHECK(image_layout != NULL);
+  DCHECK(dos_header_block != NULL);
+
+  LOG(INFO) << "Loading the shared decomposition of module: "
+            << pe_file.path().value();
+
+  core::ScopedInStreamPtr in_stream(core::CreateByteInStream(
+      decomposition.begin(), decomposition.end()));
+  core::InArchive in_archive(in_stream.get());
+  block_graph::BlockGraphSerializer::Attributes attributes = 0;
+  if (!LoadBlockGraphAndImageLayout(pe_file, &attributes, image_layout,
+                                    &in_archive)) {
+    LOG(ERROR) << "Unable to load the decomposition of module: "
+               << pe_file.path().value();
+    return false;
+  }
+
+  *dos_header_block =
+      image_layout->blocks.GetBlockByAddress(
+          BlockGraph::RelativeAddress(0));
+  if (*dos_header_block == NULL) {
+    LOG(ERROR) << "Unable to find the DOS header block.";
+    return false;
+  }
+
+  return true;
+}
+
 // Writes the image.
 bool WriteImage(const ImageLayout& image_layout,
                 const base::FilePath& output_path) {
@@ -108,10 +141,44 @@ PERelinker::PERelinker(const PETransformPolicy* pe_transform_policy)
       pe_transform_policy_(pe_transform_policy),
       add_metadata_(true), augment_pdb_(true),
       compress_pdb_(false), strip_strings_(false),
-      padding_(0), code_alignment_(1), output_guid_(GUID_NULL) {
+      padding_(0), code_alignment_(1), incremental_(false),
+      append_pdb_(false), decomposition_(NULL), output_guid_(GUID_NULL) {
   DCHECK(pe_transform_policy != NULL);
 }
 
+bool PERelinker::DecomposeToBuffer(const base::FilePath& input_path,
+                                   const base::FilePath& input_pdb_path,
+                                   std::vector<uint8_t>* decomposition) {
+  DCHECK(decomposition != NULL);
+
+  PEFile pe_file;
+  pe_file.set_use_file_mapping(true);
+  if (!pe_file.Init(input_path)) {
+    LOG(ERROR) << "Unable to load \"" << input_path.value() << "\".";
+    return false;
+  }
+
+  BlockGraph block_graph;
+  ImageLayout image_layout(&block_graph);
+  BlockGraph::Block* dos_header_block = NULL;
+  if (!Decompose(pe_file, input_pdb_path, &image_layout, &dos_header_block))
+    return false;
+
+  // The strings are kept, so that the loaded decomposition is identical.
+  decomposition->clear();
+  core::ScopedOutStreamPtr out_stream(
+      core::CreateByteOutStream(std::back_inserter(*decomposition)));
+  core::OutArchive out_archive(out_stream.get());
+  if (!SaveBlockGraphAndImageLayout(pe_file, 0, image_layout, &out_archive) ||
+      !out_archive.Flush()) {
+    LOG(ERROR) << "Unable to serialize the decomposition of module: "
+               << input_path.value();
+    return false;
+  }
+
+  return true;
+}
+
 bool PERelinker::AppendPdbMutator(PdbMutatorInterface* pdb_mutator) {
   DCHECK(pdb_mutator != NULL);
   pdb_mutators_.push_back(pdb_mutator);
@@ -140,7 +207,9 @@ bool PERelinker::Init() {
   LOG(INFO) << "Output module: " << output_path_.value();
   LOG(INFO) << "Output PDB   : " << output_pdb_path_.value();
 
-  // Open the input PE file.
+  // Open the input PE file. It's mapped rather than read, as the decomposer
+  // copies what it needs to the block-graph anyway.
+  input_pe_file_.set_use_file_mapping(true);
   if (!input_pe_file_.Init(input_path_)) {
     LOG(ERROR) << "Unable to load \"" << input_path_.value() << "\".";
     return false;
@@ -152,10 +221,19 @@ bool PERelinker::Init() {
     return false;
   }
 
-  // Decompose the image.
-  if (!Decompose(input_pe_file_, input_pdb_path_, &input_image_layout_,
-                 &headers_block_)) {
-    return false;
+  // Decompose the image, or load its shared decomposition.
+  if (decomposition_ != NULL) {
+    core::PerfReport::ScopedPhase phase(perf_report_, "load decomposition");
+    if (!LoadDecomposition(input_pe_file_, *decomposition_,
+                           &input_image_layout_, &headers_block_)) {
+      return false;
+    }
+  } else {
+    core::PerfReport::ScopedPhase phase(perf_report_, "decompose");
+    if (!Decompose(input_pe_file_, input_pdb_path_, &input_image_layout_,
+                   &headers_block_)) {
+      return false;
+    }
   }
 
   inited_ = true;
@@ -174,10 +252,13 @@ bool PERelinker::Relink() {
     return false;
 
   // Finalize the block-graph. This applies PE and Syzygy specific transforms.
-  if (!FinalizeBlockGraph(input_path_, output_pdb_path_, output_guid_,
-                          add_metadata_, pe_transform_policy_, &block_graph_,
-                          headers_block_)) {
-    return false;
+  {
+    core::PerfReport::ScopedPhase phase(perf_report_, "finalize block graph");
+    if (!FinalizeBlockGraph(input_path_, output_pdb_path_, output_guid_,
+                            add_metadata_, pe_transform_policy_, &block_graph_,
+                            headers_block_)) {
+      return false;
+    }
   }
 
   // Apply the user supplied orderers.
@@ -186,52 +267,99 @@ bool PERelinker::Relink() {
     return false;
 
   // Finalize the ordered block graph. This applies PE specific orderers.
-  if (!FinalizeOrderedBlockGraph(&ordered_block_graph, headers_block_))
-    return false;
+  {
+    core::PerfReport::ScopedPhase phase(perf_report_,
+                                        "finalize ordered block graph");
+    if (!FinalizeOrderedBlockGraph(&ordered_block_graph, headers_block_))
+      return false;
+  }
 
   // Lay it out.
   ImageLayout output_image_layout(&block_graph_);
-  if (!BuildImageLayout(padding_, code_alignment_,
-                        ordered_block_graph, headers_block_,
-                        &output_image_layout)) {
-    return false;
+  {
+    core::PerfReport::ScopedPhase phase(perf_report_, "layout");
+    if (!BuildImageLayout(padding_, code_alignment_,
+                          ordered_block_graph, headers_block_,
+                          incremental_ ? &input_image_layout_ : NULL,
+                          &output_image_layout)) {
+      return false;
+    }
   }
 
   if (!ApplyUserLayoutTransforms(&output_image_layout, &ordered_block_graph))
     return false;
 
   // Write the image.
-  if (!WriteImage(output_image_layout, output_path_))
-    return false;
+  {
+    core::PerfReport::ScopedPhase phase(perf_report_, "write image");
+    if (!WriteImage(output_image_layout, output_path_))
+      return false;
+  }
 
   // From here on down we are processing the PDB file.
 
-  // Read the PDB file.
-  LOG(INFO) << "Reading PDB file: " << input_pdb_path_.value();
-  pdb::PdbReader pdb_reader;
+  // When appending to the PDB, the output PDB starts as a copy of the input
+  // one and is read in its place, so that the streams that aren't modified
+  // can be left where they are.
+  base::FilePath pdb_path = input_pdb_path_;
   PdbFile pdb_file;
-  if (!pdb_reader.Read(input_pdb_path_, &pdb_file)) {
-    LOG(ERROR) << "Unable to read PDB file: " << input_pdb_path_.value();
-    return false;
+  PdbFile original_pdb_file;
+  {
+    core::PerfReport::ScopedPhase phase(perf_report_, "read pdb");
+    if (append_pdb_) {
+      LOG(INFO) << "Copying PDB file to: " << output_pdb_path_.value();
+      if (!base::CopyFile(input_pdb_path_, output_pdb_path_)) {
+        LOG(ERROR) << "Unable to copy PDB file \"" << input_pdb_path_.value()
+                   << "\" to \"" << output_pdb_path_.value() << "\".";
+        return false;
+      }
+      pdb_path = output_pdb_path_;
+    }
+
+    // Read the PDB file.
+    LOG(INFO) << "Reading PDB file: " << pdb_path.value();
+    pdb::PdbReader pdb_reader;
+    if (!pdb_reader.Read(pdb_path, &pdb_file)) {
+      LOG(ERROR) << "Unable to read PDB file: " << pdb_path.value();
+      return false;
+    }
+
+    // Remember the streams as they were read. The mutators replace the
+    // streams they modify, so the streams that are left are the unmodified
+    // ones.
+    for (uint32_t i = 0; i < pdb_file.StreamCount(); ++i)
+      original_pdb_file.AppendStream(pdb_file.GetStream(i).get());
   }
 
   // Apply any user specified mutators to the PDB file.
-  if (!pdb::ApplyPdbMutators(pdb_mutators_, &pdb_file))
-    return false;
+  {
+    core::PerfReport::ScopedPhase phase(perf_report_, "mutate pdb");
+    if (!pdb::ApplyPdbMutators(pdb_mutators_, &pdb_file))
+      return false;
+  }
 
   // Finalize the PDB file.
-  RelativeAddressRange input_range;
-  GetOmapRange(input_image_layout_.sections, &input_range);
-  if (!FinalizePdbFile(input_path_, output_path_, input_range,
-                       output_image_layout, output_guid_, augment_pdb_,
-                       strip_strings_, compress_pdb_, &pdb_file)) {
-    return false;
+  {
+    core::PerfReport::ScopedPhase phase(perf_report_, "finalize pdb");
+    RelativeAddressRange input_range;
+    GetOmapRange(input_image_layout_.sections, &input_range);
+    if (!FinalizePdbFile(input_path_, output_path_, input_range,
+                         output_image_layout, output_guid_, augment_pdb_,
+                         strip_strings_, compress_pdb_, &pdb_file)) {
+      return false;
+    }
   }
 
   // Write the PDB file.
   LOG(INFO) << "Writing the PDB.";
+  core::PerfReport::ScopedPhase phase(perf_report_, "write pdb");
   pdb::PdbWriter pdb_writer;
-  if (!pdb_writer.Write(output_pdb_path_, pdb_file)) {
+  bool pdb_written = false;
+  if (append_pdb_)
+    pdb_written = pdb_writer.Update(pdb_path, original_pdb_file, pdb_file);
+  else
+    pdb_written = pdb_writer.Write(output_pdb_path_, pdb_file);
+  if (!pdb_written) {
     LOG(ERROR) << "Failed to write PDB file \"" << output_pdb_path_.value()
                << "\".";
     return false;
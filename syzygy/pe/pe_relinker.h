@@ -121,6 +121,9 @@ class PERelinker : public PECoffRelinker {
   bool strip_strings() const { return strip_strings_; }
   size_t padding() const { return padding_; }
   size_t code_alignment() const { return code_alignment_; }
+  bool incremental() const { return incremental_; }
+  bool append_pdb() const { return append_pdb_; }
+  const std::vector<uint8_t>* decomposition() const { return decomposition_; }
   // @}
 
   // @name Mutators for controlling relinker behaviour.
@@ -149,8 +152,33 @@ class PERelinker : public PECoffRelinker {
   void set_code_alignment(size_t alignment) {
     code_alignment_ = alignment;
   }
+  void set_incremental(bool incremental) {
+    incremental_ = incremental;
+  }
+  void set_append_pdb(bool append_pdb) {
+    append_pdb_ = append_pdb;
+  }
+  // Sets a decomposition of the input image, as produced by
+  // DecomposeToBuffer. When set, Init loads the block-graph from it rather
+  // than decomposing the input image. This lets several relinkers of the same
+  // image share a single decomposition. The buffer is not owned, and must
+  // outlive the call to Init.
+  void set_decomposition(const std::vector<uint8_t>* decomposition) {
+    decomposition_ = decomposition;
+  }
   // @}
 
+  // Decomposes an image, and serializes its block-graph and image layout
+  // without padding blocks, for use with set_decomposition.
+  // @param input_path The path of the image to decompose.
+  // @param input_pdb_path The path of the PDB of the image. If empty, then
+  //     it's searched for.
+  // @param decomposition Receives the serialized decomposition.
+  // @returns true on success, false otherwise.
+  static bool DecomposeToBuffer(const base::FilePath& input_path,
+                                const base::FilePath& input_pdb_path,
+                                std::vector<uint8_t>* decomposition);
+
   // @see RelinkerInterface::AppendPdbMutator()
   virtual bool AppendPdbMutator(pdb::PdbMutatorInterface* pdb_mutator) override;
 
@@ -214,6 +242,18 @@ class PERelinker : public PECoffRelinker {
   size_t padding_;
   // Minimal code block alignment.
   size_t code_alignment_;
+  // If true, the sections whose blocks still fit at their original addresses
+  // are kept in place rather than laid out anew, so that only the sections
+  // that were changed by the transforms move. Defaults to false.
+  bool incremental_;
+  // If true, the output PDB starts as a copy of the input PDB, and only the
+  // streams that are modified are appended to it. The other streams aren't
+  // rewritten. Defaults to false.
+  bool append_pdb_;
+  // The serialized decomposition of the input image, if it's shared with
+  // other relinkers. Defaults to NULL, in which case the input image is
+  // decomposed.
+  const std::vector<uint8_t>* decomposition_;
 
   // The vectors of user supplied transforms, orderers and mutators to be
   // applied.
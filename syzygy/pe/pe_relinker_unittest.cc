@@ -162,6 +162,18 @@ TEST_F(PERelinkerTest, Properties) {
   EXPECT_EQ(10u, relinker.code_alignment());
   relinker.set_code_alignment(1);
   EXPECT_EQ(1u, relinker.code_alignment());
+
+  EXPECT_FALSE(relinker.incremental());
+  relinker.set_incremental(true);
+  EXPECT_TRUE(relinker.incremental());
+  relinker.set_incremental(false);
+  EXPECT_FALSE(relinker.incremental());
+
+  EXPECT_FALSE(relinker.append_pdb());
+  relinker.set_append_pdb(true);
+  EXPECT_TRUE(relinker.append_pdb());
+  relinker.set_append_pdb(false);
+  EXPECT_FALSE(relinker.append_pdb());
 }
 
 TEST_F(PERelinkerTest, AppendPdbMutators) {
@@ -224,6 +236,48 @@ TEST_F(PERelinkerTest, IntermediateAccessors) {
   EXPECT_TRUE(relinker.headers_block() != NULL);
 }
 
+TEST_F(PERelinkerTest, InitLoadsSharedDecomposition) {
+  std::vector<uint8_t> decomposition;
+  ASSERT_TRUE(PERelinker::DecomposeToBuffer(input_dll_, base::FilePath(),
+                                            &decomposition));
+  EXPECT_FALSE(decomposition.empty());
+
+  TestPERelinker decomposed(&policy_);
+  decomposed.set_input_path(input_dll_);
+  decomposed.set_output_path(temp_dll_);
+  ASSERT_TRUE(decomposed.Init());
+
+  // The relinker that loads the shared decomposition has the same blocks as
+  // the one that decomposes the image.
+  TestPERelinker loaded(&policy_);
+  loaded.set_input_path(input_dll_);
+  loaded.set_output_path(temp_dll_);
+  loaded.set_decomposition(&decomposition);
+  EXPECT_EQ(&decomposition, loaded.decomposition());
+  ASSERT_TRUE(loaded.Init());
+
+  ASSERT_TRUE(loaded.headers_block() != NULL);
+  EXPECT_EQ(decomposed.block_graph().blocks().size(),
+            loaded.block_graph().blocks().size());
+  EXPECT_EQ(decomposed.input_image_layout().blocks.size(),
+            loaded.input_image_layout().blocks.size());
+  EXPECT_EQ(decomposed.headers_block()->size(),
+            loaded.headers_block()->size());
+
+  EXPECT_TRUE(loaded.Relink());
+}
+
+TEST_F(PERelinkerTest, InitFailsOnInvalidDecomposition) {
+  // An empty decomposition is truncated.
+  std::vector<uint8_t> decomposition;
+
+  TestPERelinker relinker(&policy_);
+  relinker.set_input_path(input_dll_);
+  relinker.set_output_path(temp_dll_);
+  relinker.set_decomposition(&decomposition);
+  EXPECT_FALSE(relinker.Init());
+}
+
 TEST_F(PERelinkerTest, FailsWhenTransformFails) {
   TestPERelinker relinker(&policy_);
   StrictMock<MockTransform> transform;
@@ -329,6 +383,35 @@ TEST_F(PERelinkerTest, IdentityRelink) {
   EXPECT_EQ(pdb_path, relinker.output_pdb_path());
 }
 
+TEST_F(PERelinkerTest, AppendPdbRelink) {
+  TestPERelinker relinker(&policy_);
+
+  relinker.set_input_path(input_dll_);
+  relinker.set_output_path(temp_dll_);
+  relinker.set_append_pdb(true);
+
+  EXPECT_TRUE(relinker.Init());
+  EXPECT_TRUE(relinker.Relink());
+  EXPECT_EQ(temp_pdb_, relinker.output_pdb_path());
+
+  // The output PDB is the input PDB with the modified streams appended, so
+  // it's at least as large.
+  int64_t input_pdb_size = 0;
+  int64_t output_pdb_size = 0;
+  ASSERT_TRUE(base::GetFileSize(relinker.input_pdb_path(), &input_pdb_size));
+  ASSERT_TRUE(base::GetFileSize(temp_pdb_, &output_pdb_size));
+  EXPECT_LE(input_pdb_size, output_pdb_size);
+
+  // The output PDB can be read, and still matches the module.
+  pdb::PdbFile pdb_file;
+  pdb::PdbReader pdb_reader;
+  EXPECT_TRUE(pdb_reader.Read(temp_pdb_, &pdb_file));
+
+  base::FilePath pdb_path;
+  ASSERT_TRUE(FindPdbForModule(relinker.output_path(), &pdb_path));
+  EXPECT_EQ(pdb_path, relinker.output_pdb_path());
+}
+
 TEST_F(PERelinkerTest, BlockGraphStreamIsCreated) {
   TestPERelinker relinker(&policy_);
 
@@ -287,7 +287,10 @@ bool WriteSyzygyBlockGraphStream(const PEFile& pe_file,
     }
   }
 
-  core::OutArchive out_archive(out_stream);
+  // Every primitive value is saved by a separate write, which is costly for
+  // the compressor and the PDB stream, so they're buffered.
+  core::BufferedOutStream buffered_stream(out_stream);
+  core::OutArchive out_archive(&buffered_stream);
 
   // Set up the serialization properties.
   block_graph::BlockGraphSerializer::Attributes attributes = 0;
@@ -302,7 +305,7 @@ bool WriteSyzygyBlockGraphStream(const PEFile& pe_file,
   }
 
   // We have to flush the stream in case it's a zstream.
-  out_stream->Flush();
+  buffered_stream.Flush();
 
   return true;
 }
@@ -451,6 +454,7 @@ bool BuildImageLayout(size_t padding,
                       size_t code_alignment,
                       const OrderedBlockGraph& ordered_block_graph,
                       BlockGraph::Block* dos_header_block,
+                      const ImageLayout* original_layout,
                       ImageLayout* image_layout) {
   DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), dos_header_block);
   DCHECK_NE(reinterpret_cast<ImageLayout*>(NULL), image_layout);
@@ -460,6 +464,7 @@ bool BuildImageLayout(size_t padding,
   PEImageLayoutBuilder builder(image_layout);
   builder.set_padding(padding);
   builder.set_code_alignment(code_alignment);
+  builder.set_original_layout(original_layout);
   if (!builder.LayoutImageHeaders(dos_header_block)) {
     LOG(ERROR) << "PEImageLayoutBuilder::LayoutImageHeaders failed.";
     return false;
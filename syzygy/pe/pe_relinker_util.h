@@ -86,12 +86,16 @@ bool FinalizeOrderedBlockGraph(
 // @param code_alignment The minimum alignment to enforce for code blocks.
 // @param ordered_block_graph The image to be laid out.
 // @param dos_header_block The DOS header block in the image.
+// @param original_layout The layout of the original image, whose sections are
+//     to be kept in place where possible. May be NULL to lay out all the
+//     sections anew. @see PEImageLayoutBuilder::set_original_layout.
 // @param image_layout The image-layout to be populated.
 // @returns true on success, false otherwise.
 bool BuildImageLayout(size_t padding,
                       size_t code_alignment,
                       const block_graph::OrderedBlockGraph& ordered_block_graph,
                       block_graph::BlockGraph::Block* dos_header_block,
+                      const ImageLayout* original_layout,
                       ImageLayout* image_layout);
 
 // Given the sections from an image layout calculates the source range that any
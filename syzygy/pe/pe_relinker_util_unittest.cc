@@ -262,7 +262,7 @@ TEST_F(PERelinkerUtilTest, FinalizeOrderedBlockGraphAndBuildImageLayout) {
   size_t kCodeAlign = 16;
   ImageLayout image_layout(&block_graph_);
   EXPECT_TRUE(BuildImageLayout(kPadding, kCodeAlign, obg, dos_header_block_,
-                               &image_layout));
+                               NULL, &image_layout));
 
   // Skip over header blocks.
   BlockGraph::AddressSpace::RangeMapConstIter it = image_layout.blocks.begin();
@@ -166,11 +166,6 @@ bool AddImportsOperation::Init(const TransformPolicyInterface* policy,
     }
   }
 
-  // Configure the transform itself.
-  ImportedModuleMap::iterator it = imported_module_map_.begin();
-  for (; it != imported_module_map_.end(); ++it)
-    add_imports_tx_.AddModule(it->second);
-
   return true;
 }
 
@@ -181,6 +176,12 @@ bool AddImportsOperation::Apply(const TransformPolicyInterface* policy,
   DCHECK_NE(reinterpret_cast<BlockGraph*>(NULL), block_graph);
   DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), header_block);
 
+  // Configure the transform itself. This is deferred until now as Init may
+  // have been called more than once.
+  ImportedModuleMap::iterator it = imported_module_map_.begin();
+  for (; it != imported_module_map_.end(); ++it)
+    add_imports_tx_.AddModule(it->second);
+
   // We pass our call through the unittesting seam so that we don't have to
   // actually run the transform on a decomposed image in our tests.
   VLOG(1) << "Applying \"" << add_imports_tx_.name() << "\" transform.";
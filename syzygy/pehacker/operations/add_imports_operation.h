@@ -26,6 +26,9 @@
 namespace pehacker {
 namespace operations {
 
+// Init may be called more than once, each call adding the imports of another
+// "add_imports" configuration. This lets consecutive operations on a module be
+// fused and applied by a single pass of the transform.
 class AddImportsOperation : public OperationInterface {
  public:
   AddImportsOperation() { }
@@ -40,6 +40,26 @@ const char kSimpleConfig[] =
     "  ],\n"
     "}";
 
+const char kOtherConfig[] =
+    "{\n"
+    "  \"type\": \"add_imports\",\n"
+    "  \"modules\": [\n"
+    "    {\n"
+    "      \"module_name\": \"foo.dll\","
+    "      \"imports\": [\n"
+    "        { \"function_name\": \"bar\" },\n"
+    "        { \"function_name\": \"baz\" },\n"
+    "      ]\n"
+    "    },\n"
+    "    {\n"
+    "      \"module_name\": \"qux.dll\","
+    "      \"imports\": [\n"
+    "        { \"function_name\": \"quux\" },\n"
+    "      ]\n"
+    "    },\n"
+    "  ],\n"
+    "}";
+
 class TestAddImportsOperation : public AddImportsOperation {
  public:
   TestAddImportsOperation() { }
@@ -87,6 +107,29 @@ TEST_F(AddImportsOperationTest, Init) {
             mod_it->second->GetSymbolMode(0));
 }
 
+TEST_F(AddImportsOperationTest, InitTwiceFusesImports) {
+  TestAddImportsOperation op;
+  pe::PETransformPolicy policy;
+  ASSERT_NO_FATAL_FAILURE(InitConfig(kSimpleConfig));
+  EXPECT_TRUE(op.Init(&policy, config_.get()));
+  ASSERT_NO_FATAL_FAILURE(InitConfig(kOtherConfig));
+  EXPECT_TRUE(op.Init(&policy, config_.get()));
+
+  // The imports of both configurations are merged, without duplicates.
+  EXPECT_EQ(2u, op.imported_modules_.size());
+  ASSERT_EQ(2u, op.imported_module_map_.size());
+  TestAddImportsOperation::ImportedModuleMap::iterator mod_it =
+      op.imported_module_map_.begin();
+  EXPECT_EQ("foo.dll", mod_it->first);
+  ASSERT_EQ(2u, mod_it->second->size());
+  EXPECT_EQ("bar", mod_it->second->GetSymbolName(0));
+  EXPECT_EQ("baz", mod_it->second->GetSymbolName(1));
+  ++mod_it;
+  EXPECT_EQ("qux.dll", mod_it->first);
+  ASSERT_EQ(1u, mod_it->second->size());
+  EXPECT_EQ("quux", mod_it->second->GetSymbolName(0));
+}
+
 TEST_F(AddImportsOperationTest, RunFails) {
   TestAddImportsOperation op;
   ASSERT_NO_FATAL_FAILURE(InitConfig(kSimpleConfig));
@@ -17,18 +17,19 @@
 
 #include "syzygy/pehacker/pehacker_app.h"
 
+#include "base/bind.h"
 #include "base/files/file_util.h"
 #include "base/json/json_reader.h"
 #include "base/strings/string_split.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
+#include "syzygy/application/work_pool.h"
 #include "syzygy/block_graph/orderers/original_orderer.h"
 #include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_writer.h"
 #include "syzygy/pe/decomposer.h"
 #include "syzygy/pe/pe_file_writer.h"
 #include "syzygy/pe/pe_relinker_util.h"
-#include "syzygy/pehacker/operation.h"
 #include "syzygy/pehacker/variables.h"
 #include "syzygy/pehacker/operations/add_imports_operation.h"
 #include "syzygy/pehacker/operations/redirect_imports_operation.h"
@@ -392,38 +393,46 @@ bool PEHackerApp::ProcessOperation(bool dry_run,
   }
 
   // Dispatch to the appropriate operation implementation.
-  std::unique_ptr<OperationInterface> operation_impl;
+  std::unique_ptr<OperationInterface> new_operation;
+  OperationInterface* operation_impl = NULL;
   if (type == "none") {
     // The 'none' operation is always defined, and does nothing. This is
     // mainly there for simple unittesting of configuration files.
     return true;
   } else if (type == "add_imports") {
-    operation_impl.reset(new operations::AddImportsOperation());
+    // Consecutive add_imports operations on an image are fused, so that all
+    // of their imports are added by a single pass of the transform.
+    if (!dry_run && !image_info->operations.empty() &&
+        ::strcmp(image_info->operations.back()->name(),
+                 operations::AddImportsOperation::kName) == 0) {
+      operation_impl = image_info->operations.back();
+    } else {
+      new_operation.reset(new operations::AddImportsOperation());
+    }
   } else if (type == "redirect_imports") {
-    operation_impl.reset(new operations::RedirectImportsOperation());
+    new_operation.reset(new operations::RedirectImportsOperation());
   } else {
     LOG(ERROR) << "Unrecognized operation type \"" << type << "\".";
     return false;
   }
+  if (new_operation.get() != NULL)
+    operation_impl = new_operation.get();
 
   // Initialize the operation.
-  DCHECK_NE(reinterpret_cast<OperationInterface*>(NULL), operation_impl.get());
+  DCHECK_NE(reinterpret_cast<OperationInterface*>(NULL), operation_impl);
   if (!operation_impl->Init(&policy_, operation)) {
     LOG(ERROR) << "Failed to initialize \"" << operation_impl->name()
                << "\".";
     return false;
   }
 
-  // If not in a dry-run then apply the operation.
+  // If not in a dry-run then queue the operation. It is applied when the
+  // image is written.
   if (!dry_run) {
-    LOG(INFO) << "Applying operation \"" << type << "\" to \""
-              << image_info->input_module.value() << "\".";
-    if (!operation_impl->Apply(&policy_,
-                               &image_info->block_graph,
-                               image_info->header_block)) {
-      LOG(ERROR) << "Failed to apply \"" << operation_impl->name() << "\".";
-      return false;
-    }
+    VLOG(1) << "Queuing operation \"" << type << "\" for \""
+            << image_info->input_module.value() << "\".";
+    if (new_operation.get() != NULL)
+      image_info->operations.push_back(new_operation.release());
   }
 
   return true;
@@ -451,6 +460,7 @@ PEHackerApp::ImageInfo* PEHackerApp::GetImageInfo(
   image_info->output_module = output_module;
   image_info->input_pdb = input_pdb;
   image_info->output_pdb = output_pdb;
+  image_info->pe_file.set_use_file_mapping(true);
   if (!image_info->pe_file.Init(input_module)) {
     LOG(ERROR) << "Failed to read image: " << input_module.value();
     return NULL;
@@ -486,94 +496,124 @@ PEHackerApp::ImageInfo* PEHackerApp::GetImageInfo(
 }
 
 bool PEHackerApp::WriteImages() {
+  std::vector<ImageInfo*> image_infos;
   ImageInfoMap::iterator it = image_info_map_.begin();
-  for (; it != image_info_map_.end(); ++it) {
-    ImageInfo* image_info = it->second;
+  for (; it != image_info_map_.end(); ++it)
+    image_infos.push_back(it->second);
+
+  // The images share no state, so each of them is handled by a single thread
+  // from start to finish.
+  application::WorkPool pool(jobs());
+  return pool.Run(image_infos.size(),
+                  base::Bind(&PEHackerApp::WriteImageAt, base::Unretained(this),
+                             &image_infos));
+}
 
-    LOG(INFO) << "Finalizing and writing image \""
-              << image_info->output_module.value() << "\".";
+bool PEHackerApp::WriteImageAt(const std::vector<ImageInfo*>* image_infos,
+                               size_t index) {
+  return WriteImage(image_infos->at(index));
+}
 
-    // Create a GUID for the output PDB.
-    GUID pdb_guid = {};
-    if (FAILED(::CoCreateGuid(&pdb_guid))) {
-      LOG(ERROR) << "Failed to create new GUID for output PDB.";
-      return false;
-    }
+bool PEHackerApp::WriteImage(ImageInfo* image_info) {
+  DCHECK_NE(reinterpret_cast<ImageInfo*>(NULL), image_info);
 
-    // Finalize the block-graph.
-    VLOG(1) << "Finalizing the block-graph.";
-    if (!pe::FinalizeBlockGraph(image_info->input_module,
-                                image_info->output_pdb,
-                                pdb_guid,
-                                true,
-                                &policy_,
-                                &image_info->block_graph,
-                                image_info->header_block)) {
+  // Apply the queued operations.
+  for (size_t i = 0; i < image_info->operations.size(); ++i) {
+    OperationInterface* operation = image_info->operations[i];
+    LOG(INFO) << "Applying operation \"" << operation->name() << "\" to \""
+              << image_info->input_module.value() << "\".";
+    if (!operation->Apply(&image_info->policy,
+                          &image_info->block_graph,
+                          image_info->header_block)) {
+      LOG(ERROR) << "Failed to apply \"" << operation->name() << "\".";
       return false;
     }
+  }
 
-    // Build the ordered block-graph.
-    block_graph::OrderedBlockGraph ordered_block_graph(
-        &image_info->block_graph);
-    block_graph::orderers::OriginalOrderer orderer;
-    VLOG(1) << "Ordering the block-graph.";
-    if (!orderer.OrderBlockGraph(&ordered_block_graph,
-                                 image_info->header_block)) {
-      return false;
-    }
+  LOG(INFO) << "Finalizing and writing image \""
+            << image_info->output_module.value() << "\".";
 
-    // Finalize the ordered block-graph.
-    VLOG(1) << "Finalizing the ordered block-graph.";
-    if (!pe::FinalizeOrderedBlockGraph(&ordered_block_graph,
-                                       image_info->header_block)) {
-      return false;
-    }
+  // Create a GUID for the output PDB.
+  GUID pdb_guid = {};
+  if (FAILED(::CoCreateGuid(&pdb_guid))) {
+    LOG(ERROR) << "Failed to create new GUID for output PDB.";
+    return false;
+  }
 
-    // Build the image layout.
-    pe::ImageLayout image_layout(&image_info->block_graph);
-    VLOG(1) << "Building the image layout.";
-    if (!pe::BuildImageLayout(0, 1, ordered_block_graph,
-                              image_info->header_block, &image_layout)) {
-      return false;
-    }
+  // Finalize the block-graph.
+  VLOG(1) << "Finalizing the block-graph.";
+  if (!pe::FinalizeBlockGraph(image_info->input_module,
+                              image_info->output_pdb,
+                              pdb_guid,
+                              true,
+                              &image_info->policy,
+                              &image_info->block_graph,
+                              image_info->header_block)) {
+    return false;
+  }
 
-    // Write the image.
-    pe::PEFileWriter pe_writer(image_layout);
-    VLOG(1) << "Writing image to disk.";
-    if (!pe_writer.WriteImage(image_info->output_module))
-      return false;
+  // Build the ordered block-graph.
+  block_graph::OrderedBlockGraph ordered_block_graph(
+      &image_info->block_graph);
+  block_graph::orderers::OriginalOrderer orderer;
+  VLOG(1) << "Ordering the block-graph.";
+  if (!orderer.OrderBlockGraph(&ordered_block_graph,
+                               image_info->header_block)) {
+    return false;
+  }
 
-    LOG(INFO) << "Finalizing and writing PDB file \""
-              << image_info->output_pdb.value() << "\".";
+  // Finalize the ordered block-graph.
+  VLOG(1) << "Finalizing the ordered block-graph.";
+  if (!pe::FinalizeOrderedBlockGraph(&ordered_block_graph,
+                                     image_info->header_block)) {
+    return false;
+  }
 
-    // Parse the original PDB.
-    pdb::PdbFile pdb_file;
-    pdb::PdbReader pdb_reader;
-    VLOG(1) << "Reading original PDB.";
-    if (!pdb_reader.Read(image_info->input_pdb, &pdb_file))
-      return false;
+  // Build the image layout.
+  pe::ImageLayout image_layout(&image_info->block_graph);
+  VLOG(1) << "Building the image layout.";
+  if (!pe::BuildImageLayout(0, 1, ordered_block_graph,
+                            image_info->header_block, NULL,
+                            &image_layout)) {
+    return false;
+  }
 
-    // Finalize the PDB to reflect the transformed image.
-    VLOG(1) << "Finalizing PDB.";
-    if (!pe::FinalizePdbFile(image_info->input_module,
-                             image_info->output_module,
-                             image_info->input_omap_range,
-                             image_layout,
-                             pdb_guid,
-                             false,
-                             false,
-                             false,
-                             &pdb_file)) {
-      return false;
-    }
+  // Write the image.
+  pe::PEFileWriter pe_writer(image_layout);
+  VLOG(1) << "Writing image to disk.";
+  if (!pe_writer.WriteImage(image_info->output_module))
+    return false;
 
-    // Write the PDB.
-    pdb::PdbWriter pdb_writer;
-    VLOG(1) << "Writing transformed PDB.";
-    if (!pdb_writer.Write(image_info->output_pdb, pdb_file))
-      return false;
+  LOG(INFO) << "Finalizing and writing PDB file \""
+            << image_info->output_pdb.value() << "\".";
+
+  // Parse the original PDB.
+  pdb::PdbFile pdb_file;
+  pdb::PdbReader pdb_reader;
+  VLOG(1) << "Reading original PDB.";
+  if (!pdb_reader.Read(image_info->input_pdb, &pdb_file))
+    return false;
+
+  // Finalize the PDB to reflect the transformed image.
+  VLOG(1) << "Finalizing PDB.";
+  if (!pe::FinalizePdbFile(image_info->input_module,
+                           image_info->output_module,
+                           image_info->input_omap_range,
+                           image_layout,
+                           pdb_guid,
+                           false,
+                           false,
+                           false,
+                           &pdb_file)) {
+    return false;
   }
 
+  // Write the PDB.
+  pdb::PdbWriter pdb_writer;
+  VLOG(1) << "Writing transformed PDB.";
+  if (!pdb_writer.Write(image_info->output_pdb, pdb_file))
+    return false;
+
   return true;
 }
 
@@ -29,6 +29,7 @@
 #include "syzygy/pe/image_source_map.h"
 #include "syzygy/pe/pe_file.h"
 #include "syzygy/pe/pe_transform_policy.h"
+#include "syzygy/pehacker/operation.h"
 
 namespace pehacker {
 
@@ -72,6 +73,12 @@ class PEHackerApp : public application::AppImplBase {
     BlockGraph block_graph;
     BlockGraph::Block* header_block;
     pe::RelativeAddressRange input_omap_range;
+    // The operations to apply to the image, in order. Consecutive operations
+    // of the same type may have been fused into one.
+    ScopedVector<OperationInterface> operations;
+    // The policy used by the operations of this image. Each image has its own
+    // as the policy caches its results, and images are written in parallel.
+    pe::PETransformPolicy policy;
   };
 
   typedef std::map<ImageId, ImageInfo*> ImageInfoMap;
@@ -135,10 +142,25 @@ class PEHackerApp : public application::AppImplBase {
                           const base::FilePath& input_pdb,
                           const base::FilePath& output_pdb);
 
-  // Writes any transformed images back to disk.
+  // Applies the operations of the images and writes them back to disk. The
+  // images are independent and are processed on several threads.
   // @returns true on success, false otherwise.
   bool WriteImages();
 
+  // Applies the operations of an image and writes it back to disk, along with
+  // its PDB. This is called from WriteImages, and may be called concurrently
+  // for different images.
+  // @param image_info The image to write.
+  // @returns true on success, false otherwise.
+  bool WriteImage(ImageInfo* image_info);
+
+  // Writes the image at @p index of @p image_infos. This is the WorkPool
+  // callback of WriteImages.
+  // @param image_infos The images being written.
+  // @param index The index of the image to write.
+  // @returns true on success, false otherwise.
+  bool WriteImageAt(const std::vector<ImageInfo*>* image_infos, size_t index);
+
   // @name Command-line parameters.
   base::FilePath config_file_;
   bool overwrite_;
@@ -155,7 +177,7 @@ class PEHackerApp : public application::AppImplBase {
   ScopedVector<ImageInfo> image_infos_;
   ImageInfoMap image_info_map_;
 
-  // The policy object used by the various transforms.
+  // The policy object used to initialize the operations.
   pe::PETransformPolicy policy_;
 };
 
@@ -46,15 +46,20 @@ static wchar_t kConfigGoodNestedVariables[] =
     L"syzygy/pehacker/test_data/config-good-nested-variables.txt";
 static wchar_t kConfigGoodNop[] =
     L"syzygy/pehacker/test_data/config-good-nop.txt";
+static wchar_t kConfigGoodAddImports[] =
+    L"syzygy/pehacker/test_data/config-good-add-imports.txt";
 
 class TestPEHackerApp : public PEHackerApp {
  public:
   using PEHackerApp::LoadAndValidateConfigurationFile;
+  using PEHackerApp::ProcessConfigurationFile;
+  using PEHackerApp::WriteImages;
 
   using PEHackerApp::config_file_;
   using PEHackerApp::overwrite_;
   using PEHackerApp::variables_;
   using PEHackerApp::config_;
+  using PEHackerApp::image_infos_;
 };
 
 typedef application::Application<TestPEHackerApp> TestApp;
@@ -314,4 +319,32 @@ TEST_F(PEHackerAppTest, RunNop) {
   EXPECT_NO_FATAL_FAILURE(CheckTestDll(output_module));
 }
 
+TEST_F(PEHackerAppTest, AddImportsFusesOperations) {
+  base::FilePath input_module = testing::GetOutputRelativePath(
+      testing::kTestDllName);
+  base::FilePath output_module = temp_dir_.Append(testing::kTestDllName);
+  base::FilePath other_output_module = temp_dir_.Append(L"other.dll");
+
+  config_file_ = testing::GetSrcRelativePath(kConfigGoodAddImports);
+  cmd_line_.AppendSwitchPath("config-file", config_file_);
+  cmd_line_.AppendSwitchPath("Dinput_module", input_module);
+  cmd_line_.AppendSwitchPath("Doutput_module", output_module);
+  cmd_line_.AppendSwitchPath("Dother_output_module", other_output_module);
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  ASSERT_TRUE(test_impl_.LoadAndValidateConfigurationFile());
+  ASSERT_TRUE(test_impl_.ProcessConfigurationFile(false));
+
+  // Each target produces its own image, and the two operations of the first
+  // target are fused into one.
+  ASSERT_EQ(2u, test_impl_.image_infos_.size());
+  EXPECT_EQ(1u, test_impl_.image_infos_[0]->operations.size());
+  EXPECT_EQ(1u, test_impl_.image_infos_[1]->operations.size());
+
+  // The images are written on separate threads.
+  test_impl_.set_jobs(2);
+  ASSERT_TRUE(test_impl_.WriteImages());
+  EXPECT_NO_FATAL_FAILURE(CheckTestDll(output_module));
+  EXPECT_NO_FATAL_FAILURE(CheckTestDll(other_output_module));
+}
+
 }  // namespace pehacker
@@ -32,7 +32,8 @@ Playback::Playback(const base::FilePath& module_path,
       trace_files_(trace_files),
       pe_file_(NULL),
       image_(NULL),
-      parser_(NULL) {
+      parser_(NULL),
+      block_cache_(new BlockCache()) {
 }
 
 Playback::~Playback() {
@@ -141,6 +142,7 @@ bool Playback::LoadInstrumentedOmap() {
                << instrumented_pdb.value() << "\".";
     return false;
   }
+  omap_to_translator_.Init(omap_to_);
   LOG(INFO) << "Read OMAP data from instrumented module PDB.";
 
   return true;
@@ -224,7 +226,20 @@ bool Playback::MatchesInstrumentedModuleSignature(
 
 const Playback::BlockGraph::Block* Playback::FindFunctionBlock(
     DWORD process_id, FuncAddr function, bool* error) {
-  DCHECK(parser_ != NULL);
+  return FindFunctionBlock(parser_, process_id, function, block_cache_.get(),
+                           error);
+}
+
+const Playback::BlockGraph::Block* Playback::FindFunctionBlock(
+    const Parser* parser, DWORD process_id, FuncAddr function,
+    bool* error) const {
+  return FindFunctionBlock(parser, process_id, function, NULL, error);
+}
+
+const Playback::BlockGraph::Block* Playback::FindFunctionBlock(
+    const Parser* parser, DWORD process_id, FuncAddr function,
+    BlockCache* cache, bool* error) const {
+  DCHECK(parser != NULL);
   DCHECK(image_ != NULL);
   DCHECK(error != NULL);
 
@@ -235,7 +250,7 @@ const Playback::BlockGraph::Block* Playback::FindFunctionBlock(
 
   // Resolve the module in which the called function resides.
   const ModuleInformation* module_info =
-      parser_->GetModuleInformation(process_id, abs_address);
+      parser->GetModuleInformation(process_id, abs_address);
 
   // We should be able to resolve the instrumented module.
   if (module_info == NULL) {
@@ -250,30 +265,147 @@ const Playback::BlockGraph::Block* Playback::FindFunctionBlock(
     return NULL;
   }
 
+  const BlockGraph::Block* block =
+      FindInstrumentedFunctionBlock(*module_info, abs_address, cache);
+  if (block == NULL)
+    *error = true;
+  return block;
+}
+
+bool Playback::FindFunctionBlocks(
+    const Parser* parser,
+    DWORD process_id,
+    const TraceBatchEnterData* data,
+    BlockCache* cache,
+    std::vector<const BlockGraph::Block*>* blocks) const {
+  DCHECK(parser != NULL);
+  DCHECK(data != NULL);
+  DCHECK(cache != NULL);
+  DCHECK(blocks != NULL);
+
+  blocks->clear();
+  blocks->reserve(data->num_calls);
+
+  // The module of the previous function, and whether it's our module of
+  // interest.
+  const ModuleInformation* module_info = NULL;
+  bool is_instrumented_module = false;
+  for (size_t i = 0; i < data->num_calls; ++i) {
+    AbsoluteAddress64 abs_address =
+        reinterpret_cast<AbsoluteAddress64>(data->calls[i].function);
+
+    if (module_info == NULL ||
+        abs_address < module_info->base_address.value() ||
+        abs_address - module_info->base_address.value() >=
+            module_info->module_size) {
+      module_info = parser->GetModuleInformation(process_id, abs_address);
+      if (module_info == NULL) {
+        LOG(ERROR) << "Failed to resolve module for entry event (pid="
+                   << process_id << ", addr=0x" << data->calls[i].function
+                   << ").";
+        return false;
+      }
+      is_instrumented_module =
+          MatchesInstrumentedModuleSignature(*module_info);
+    }
+
+    if (!is_instrumented_module) {
+      blocks->push_back(NULL);
+      continue;
+    }
+
+    const BlockGraph::Block* block =
+        FindInstrumentedFunctionBlock(*module_info, abs_address, cache);
+    if (block == NULL)
+      return false;
+    blocks->push_back(block);
+  }
+
+  return true;
+}
+
+bool Playback::FindFunctionBlocks(
+    DWORD process_id,
+    const TraceBatchEnterData* data,
+    std::vector<const BlockGraph::Block*>* blocks) {
+  return FindFunctionBlocks(parser_, process_id, data, block_cache_.get(),
+                            blocks);
+}
+
+const Playback::BlockGraph::Block* Playback::FindInstrumentedFunctionBlock(
+    const ModuleInformation& module_info,
+    AbsoluteAddress64 abs_address,
+    BlockCache* cache) const {
+  DCHECK(image_ != NULL);
+
   // Convert the address to an RVA. We can only instrument 32-bit DLLs, so we're
   // sure that the following address conversion is safe.
   core::RelativeAddress rva(
-      static_cast<uint32_t>(abs_address - module_info->base_address.value()));
+      static_cast<uint32_t>(abs_address - module_info.base_address.value()));
+
+  if (cache != NULL) {
+    const BlockGraph::Block* block = cache->Find(rva);
+    if (block != NULL)
+      return block;
+  }
 
   // Convert the address from one in the instrumented module to one in the
   // original module using the OMAP data.
-  rva = pdb::TranslateAddressViaOmap(omap_to(), rva);
-
-  // Get the block that this function call refers to.
-  const BlockGraph::Block* block = image_->blocks.GetBlockByAddress(rva);
+  core::RelativeAddress orig_rva = omap_to_translator_.Translate(rva);
+
+  // Get the block that this function call refers to. Successive functions
+  // are often translated into the same block, which spares the lookup.
+  const BlockGraph::Block* block = NULL;
+  if (cache != NULL && cache->last_block() != NULL &&
+      cache->last_block()->addr() <= orig_rva &&
+      orig_rva < cache->last_block()->addr() + cache->last_block()->size()) {
+    block = cache->last_block();
+  } else {
+    block = image_->blocks.GetBlockByAddress(orig_rva);
+  }
   if (block == NULL) {
-    LOG(ERROR) << "Unable to map " << rva << " to a block.";
-    *error = true;
+    LOG(ERROR) << "Unable to map " << orig_rva << " to a block.";
     return NULL;
   }
   if (block->type() != BlockGraph::CODE_BLOCK) {
-    LOG(ERROR) << rva << " maps to a non-code block (" << block->name()
-               << " in " << module_info->path << ").";
-    *error = true;
+    LOG(ERROR) << orig_rva << " maps to a non-code block (" << block->name()
+               << " in " << module_info.path << ").";
     return NULL;
   }
 
+  if (cache != NULL)
+    cache->Insert(rva, block);
   return block;
 }
 
+Playback::BlockCache::BlockCache() : last_block_(NULL) {
+  Entry empty_entry = { core::RelativeAddress(0), NULL };
+  entries_.resize(kEntryCount, empty_entry);
+}
+
+const Playback::BlockGraph::Block* Playback::BlockCache::Find(
+    core::RelativeAddress rva) const {
+  const Entry& entry = entries_[GetEntryIndex(rva)];
+  if (entry.block == NULL || entry.rva != rva)
+    return NULL;
+  return entry.block;
+}
+
+void Playback::BlockCache::Insert(core::RelativeAddress rva,
+                                  const BlockGraph::Block* block) {
+  DCHECK(block != NULL);
+  Entry& entry = entries_[GetEntryIndex(rva)];
+  entry.rva = rva;
+  entry.block = block;
+  last_block_ = block;
+}
+
+size_t Playback::BlockCache::GetEntryIndex(core::RelativeAddress rva) {
+  // A multiplicative hash spreads the functions, which are often aligned,
+  // over the whole table.
+  static_assert((kEntryCount & (kEntryCount - 1)) == 0,
+                "The entry count must be a power of two.");
+  return ((rva.value() * 0x9E3779B1u) >> 22) & (kEntryCount - 1);
+}
+
 }  // namespace playback
@@ -28,6 +28,9 @@
 
 #include <windows.h>
 
+#include <memory>
+#include <vector>
+
 #include "base/win/event_trace_consumer.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/pdb/omap.h"
@@ -39,6 +42,8 @@ namespace playback {
 
 class Playback {
  public:
+  class BlockCache;  // Forward declaration.
+
   typedef block_graph::BlockGraph BlockGraph;
   typedef pe::ImageLayout ImageLayout;
   typedef pe::PEFile PEFile;
@@ -82,6 +87,49 @@ class Playback {
                                              FuncAddr function,
                                              bool* error);
 
+  // Same as above, but resolves the module of the function with @p parser
+  // rather than with the parser the playback was initialized with. This lets
+  // the trace files be parsed by several parsers, which may call this
+  // concurrently.
+  // @param parser The parser of the trace file the event comes from.
+  const BlockGraph::Block* FindFunctionBlock(const Parser* parser,
+                                             DWORD process_id,
+                                             FuncAddr function,
+                                             bool* error) const;
+
+  // Same as above, but looks up and records the block in @p cache. Each
+  // cache must only be used by one thread at a time.
+  // @param cache The cache of the blocks of the recently resolved functions.
+  const BlockGraph::Block* FindFunctionBlock(const Parser* parser,
+                                             DWORD process_id,
+                                             FuncAddr function,
+                                             BlockCache* cache,
+                                             bool* error) const;
+
+  // Gets the code blocks of the functions of a batch function entry event.
+  // The module of a function is only resolved again when the function isn't
+  // in the module of the previous function of the batch, as the modules of
+  // a process can't change during an event.
+  // @param parser The parser of the trace file the event comes from.
+  // @param process_id The process id of the module where the functions
+  //     reside.
+  // @param data The batch function entry event.
+  // @param cache The cache of the blocks of the recently resolved functions.
+  // @param blocks Receives the code block of each function of @p data, or
+  //     NULL for the functions that are not in our module of interest.
+  // @returns true on success, false if a function can't be mapped.
+  bool FindFunctionBlocks(const Parser* parser,
+                          DWORD process_id,
+                          const TraceBatchEnterData* data,
+                          BlockCache* cache,
+                          std::vector<const BlockGraph::Block*>* blocks) const;
+
+  // Same as above, but uses the parser the playback was initialized with and
+  // the cache of this playback.
+  bool FindFunctionBlocks(DWORD process_id,
+                          const TraceBatchEnterData* data,
+                          std::vector<const BlockGraph::Block*>* blocks);
+
   // @name Accessors
   // @{
   const PEFile* pe_file() const { return pe_file_; }
@@ -114,6 +162,18 @@ class Playback {
   bool ValidateInstrumentedModuleAndParseSignature(
       PEFile::Signature* orig_signature);
 
+  // Gets a code block from our image from the address of a function in the
+  // instrumented module.
+  // @param module_info The instrumented module.
+  // @param abs_address The absolute address of the function.
+  // @param cache The cache of the blocks of the recently resolved functions,
+  //     or NULL.
+  // @returns The code block of the function, or NULL on error.
+  const BlockGraph::Block* FindInstrumentedFunctionBlock(
+      const ModuleInformation& module_info,
+      AbsoluteAddress64 abs_address,
+      BlockCache* cache) const;
+
   // The paths of the test module, instrumented module, and trace files.
   base::FilePath module_path_;
   base::FilePath instrumented_path_;
@@ -138,8 +198,57 @@ class Playback {
   std::vector<OMAP> omap_to_;
   std::vector<OMAP> omap_from_;
 
+  // Translates the addresses of the instrumented module through omap_to_.
+  pdb::OmapTranslator omap_to_translator_;
+
   // Signature of the instrumented DLL. Used for filtering call-trace events.
   PEFile::Signature instr_signature_;
+
+  // The cache used with the parser the playback was initialized with.
+  std::unique_ptr<BlockCache> block_cache_;
+};
+
+// Caches the code blocks of the functions of the instrumented module, keyed
+// by the RVAs of the functions in the instrumented module. These never map to
+// other blocks, so the entries remain valid for the lifetime of the playback.
+// The recent functions are held in a direct-mapped table, and the block of
+// the last function is kept so that the functions that are translated into
+// it can skip the lookup in the image.
+class Playback::BlockCache {
+ public:
+  // The number of entries of the table. This must be a power of two.
+  static const size_t kEntryCount = 1024;
+
+  BlockCache();
+
+  // Looks up the block of a function.
+  // @param rva The RVA of the function in the instrumented module.
+  // @returns The block of the function, or NULL if it isn't cached.
+  const BlockGraph::Block* Find(core::RelativeAddress rva) const;
+
+  // Records the block of a function, evicting the function whose entry of the
+  // table it shares.
+  // @param rva The RVA of the function in the instrumented module.
+  // @param block The code block of the function.
+  void Insert(core::RelativeAddress rva, const BlockGraph::Block* block);
+
+  // @returns The block of the last recorded function, or NULL.
+  const BlockGraph::Block* last_block() const { return last_block_; }
+
+ protected:
+  // @returns The index of the entry of the table of @p rva.
+  static size_t GetEntryIndex(core::RelativeAddress rva);
+
+  struct Entry {
+    core::RelativeAddress rva;
+    const BlockGraph::Block* block;
+  };
+
+  std::vector<Entry> entries_;
+  const BlockGraph::Block* last_block_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BlockCache);
 };
 
 }  // namespace playback
@@ -54,6 +54,11 @@ class TestParser : public trace::parser::Parser {
   }
 };
 
+class TestBlockCache : public Playback::BlockCache {
+ public:
+  using Playback::BlockCache::GetEntryIndex;
+};
+
 class PlaybackTest : public testing::PELibUnitTest {
  public:
   PlaybackTest() : image_layout_(&block_graph_) {
@@ -210,4 +215,107 @@ TEST_F(PlaybackTest, FindFunctionBlock) {
   EXPECT_FALSE(error);
 }
 
+TEST(PlaybackBlockCacheTest, FindAndInsert) {
+  block_graph::BlockGraph block_graph;
+  block_graph::BlockGraph::Block* block1 =
+      block_graph.AddBlock(block_graph::BlockGraph::CODE_BLOCK, 0x10, "1");
+  block_graph::BlockGraph::Block* block2 =
+      block_graph.AddBlock(block_graph::BlockGraph::CODE_BLOCK, 0x10, "2");
+
+  TestBlockCache cache;
+  const core::RelativeAddress kRva(0x1000);
+  EXPECT_TRUE(cache.Find(kRva) == NULL);
+  EXPECT_TRUE(cache.last_block() == NULL);
+
+  cache.Insert(kRva, block1);
+  EXPECT_EQ(block1, cache.Find(kRva));
+  EXPECT_EQ(block1, cache.last_block());
+  EXPECT_TRUE(cache.Find(kRva + 1) == NULL);
+
+  // A function of another entry of the table doesn't evict the function.
+  core::RelativeAddress other_rva(kRva + 0x10);
+  while (TestBlockCache::GetEntryIndex(other_rva) ==
+         TestBlockCache::GetEntryIndex(kRva)) {
+    other_rva += 0x10;
+  }
+  cache.Insert(other_rva, block2);
+  EXPECT_EQ(block1, cache.Find(kRva));
+  EXPECT_EQ(block2, cache.Find(other_rva));
+  EXPECT_EQ(block2, cache.last_block());
+
+  // A function of the same entry does.
+  core::RelativeAddress colliding_rva(kRva + 0x10);
+  while (TestBlockCache::GetEntryIndex(colliding_rva) !=
+         TestBlockCache::GetEntryIndex(kRva)) {
+    colliding_rva += 0x10;
+  }
+  cache.Insert(colliding_rva, block2);
+  EXPECT_TRUE(cache.Find(kRva) == NULL);
+  EXPECT_EQ(block2, cache.Find(colliding_rva));
+}
+
+TEST_F(PlaybackTest, FindFunctionBlocks) {
+  EXPECT_TRUE(Init());
+  EXPECT_TRUE(playback_->Init(&input_dll_, &image_layout_, parser_.get()));
+
+  pe::PEFile pe_file;
+  trace::parser::ModuleInformation module_info;
+  ASSERT_TRUE(pe_file.Init(instrumented_path_));
+  pe_file.GetSignature(&module_info);
+
+  trace::parser::ModuleInformation other_module_info;
+  other_module_info.base_address.set_value(0x3F000000);
+  other_module_info.module_size = 0x00010000;
+  other_module_info.module_checksum = 0xF000BA55;
+  other_module_info.module_time_date_stamp = 0xDEADBEEF;
+  other_module_info.path = L"other_module.dll";
+
+  const DWORD kPid = 0x1234;
+  ASSERT_TRUE(parser_->active_parse_engine()->AddModuleInformation(
+      kPid, module_info));
+  ASSERT_TRUE(parser_->active_parse_engine()->AddModuleInformation(
+      kPid, other_module_info));
+
+  const IMAGE_SECTION_HEADER* text = input_dll_.GetSectionHeader(".text");
+  const IMAGE_SECTION_HEADER* data = input_dll_.GetSectionHeader(".data");
+  ASSERT_TRUE(text != NULL);
+  ASSERT_TRUE(data != NULL);
+  FuncAddr text_addr = reinterpret_cast<FuncAddr>(
+      module_info.base_address.value() + text->VirtualAddress);
+  FuncAddr data_addr = reinterpret_cast<FuncAddr>(
+      module_info.base_address.value() + data->VirtualAddress);
+  FuncAddr other_text_addr = reinterpret_cast<FuncAddr>(
+      other_module_info.base_address.value() + 0x1000);
+
+  // The functions of the instrumented module map to the same blocks as when
+  // they're looked up one at a time, whether or not they're cached.
+  bool error = false;
+  const block_graph::BlockGraph::Block* text_block =
+      playback_->FindFunctionBlock(kPid, text_addr, &error);
+  ASSERT_TRUE(text_block != NULL);
+
+  uint8_t buffer[FIELD_OFFSET(TraceBatchEnterData, calls) +
+                 3 * sizeof(TraceEnterEventData)] = {};
+  TraceBatchEnterData* batch = reinterpret_cast<TraceBatchEnterData*>(buffer);
+  batch->num_calls = 3;
+  batch->calls[0].function = text_addr;
+  batch->calls[1].function = other_text_addr;
+  batch->calls[2].function = text_addr;
+
+  Playback::BlockCache cache;
+  std::vector<const block_graph::BlockGraph::Block*> blocks;
+  ASSERT_TRUE(playback_->FindFunctionBlocks(parser_.get(), kPid, batch,
+                                            &cache, &blocks));
+  ASSERT_EQ(3u, blocks.size());
+  EXPECT_EQ(text_block, blocks[0]);
+  EXPECT_TRUE(blocks[1] == NULL);
+  EXPECT_EQ(text_block, blocks[2]);
+  EXPECT_EQ(text_block, cache.last_block());
+
+  // A function that doesn't map to a code block fails the batch.
+  batch->calls[1].function = data_addr;
+  EXPECT_FALSE(playback_->FindFunctionBlocks(parser_.get(), kPid, batch,
+                                             &cache, &blocks));
+}
+
 }  // namespace playback
@@ -17,6 +17,8 @@
 #ifndef SYZYGY_POIROT_MINIDUMP_PROCESSOR_H_
 #define SYZYGY_POIROT_MINIDUMP_PROCESSOR_H_
 
+#include <string>
+
 #include "base/files/file_path.h"
 #include "base/files/scoped_file.h"
 #include "syzygy/crashdata/crashdata.h"
@@ -41,6 +43,15 @@ class MinidumpProcessor {
   // @returns true on success, false otherwise.
   bool GenerateJsonOutput(FILE* file);
 
+  // Convert the crash data contained in the minidump into a JSON
+  // representation.
+  // @param json Receives the JSON representation.
+  // @returns true on success, false otherwise.
+  bool GenerateJson(std::string* json);
+
+  // @returns the minidump to process.
+  const base::FilePath& input_minidump() const { return input_minidump_; }
+
  protected:
   // The minidump to process.
   base::FilePath input_minidump_;
@@ -74,4 +74,16 @@ TEST(MinidumpProcessorTest, GenerateJsonOutput) {
   EXPECT_STREQ(protobuf_value.c_str(), file_data.c_str());
 }
 
+TEST(MinidumpProcessorTest, GenerateJson) {
+  TestMinidumpProcessor minidump_processor(
+      testing::GetSrcRelativePath(testing::kMinidumpUAF));
+  EXPECT_TRUE(minidump_processor.ProcessDump());
+  std::string protobuf_value;
+  EXPECT_TRUE(crashdata::ToJson(true, &minidump_processor.protobuf_value_,
+                                &protobuf_value));
+  std::string json;
+  EXPECT_TRUE(minidump_processor.GenerateJson(&json));
+  EXPECT_EQ(protobuf_value, json);
+}
+
 }  // namespace poirot
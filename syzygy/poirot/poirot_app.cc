@@ -14,26 +14,80 @@
 
 #include "syzygy/poirot/poirot_app.h"
 
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "base/at_exit.h"
+#include "base/bind.h"
 #include "base/command_line.h"
+#include "base/files/file_enumerator.h"
 #include "base/files/file_util.h"
+#include "base/json/string_escape.h"
+#include "base/strings/utf_string_conversions.h"
+#include "syzygy/application/work_pool.h"
 
 namespace poirot {
 
 namespace {
 
+// A minidump of a batch, which is processed on a thread of the pool.
+class BatchItem {
+ public:
+  explicit BatchItem(const base::FilePath& input_minidump)
+      : processor_(input_minidump), succeeded_(false) {}
+
+  void Process() {
+    succeeded_ = processor_.ProcessDump() && processor_.GenerateJson(&json_);
+  }
+
+  // @name Accessors.
+  // These are valid once the item has run.
+  // @{
+  const base::FilePath& input_minidump() const {
+    return processor_.input_minidump();
+  }
+  bool succeeded() const { return succeeded_; }
+  const std::string& json() const { return json_; }
+  // @}
+
+ private:
+  MinidumpProcessor processor_;
+  bool succeeded_;
+  std::string json_;
+
+  DISALLOW_COPY_AND_ASSIGN(BatchItem);
+};
+
+// Processes the item at @p index of @p items. A minidump that can't be
+// processed doesn't stop the batch, so this always succeeds.
+bool ProcessBatchItem(const std::vector<std::unique_ptr<BatchItem>>* items,
+                      size_t index) {
+  DCHECK(items);
+  (*items)[index]->Process();
+  return true;
+}
+
 const char kUsageFormatStr[] =
     "Usage: %ls [options]\n"
     "\n"
     "  Read a minidump and extract the Kasko protobuf that is in it.\n"
     "\n"
-    "Required parameters\n"
+    "Required parameters, one of\n"
     "  --input-minidump=<image file>\n"
     "      The minidump to process.\n"
+    "  --input-dir=<directory>\n"
+    "      A directory whose minidumps (*.dmp) are all processed. The output\n"
+    "      is a JSON list with an entry per minidump, in path order, whose\n"
+    "      crash data is null if the minidump couldn't be processed.\n"
     "Optional parameters\n"
     "  --output-file=<output file>\n"
     "      Optionally provide the name or path to the output file. If not\n"
-    "      provided, output will be to standard out.\n";
+    "      provided, output will be to standard out.\n"
+    "  --jobs=<count>\n"
+    "      The number of minidumps of --input-dir processed concurrently.\n"
+    "      Default value: the number of processors\n";
 
 }  // namespace
 
@@ -56,9 +110,10 @@ bool PoirotApp::ParseCommandLine(const base::CommandLine* cmd_line) {
   }
 
   input_minidump_ = cmd_line->GetSwitchValuePath("input-minidump");
-  if (input_minidump_.empty()) {
+  input_dir_ = cmd_line->GetSwitchValuePath("input-dir");
+  if (input_minidump_.empty() == input_dir_.empty()) {
     PrintUsage(cmd_line->GetProgram(),
-               "Must specify '--input-minidump' parameter!");
+               "Must specify one of '--input-minidump' and '--input-dir'!");
     return false;
   }
 
@@ -89,6 +144,9 @@ int PoirotApp::Run() {
     output_file = scoped_file.get();
   }
 
+  if (!input_dir_.empty())
+    return RunBatch(output_file);
+
   // Do the processing.
   MinidumpProcessor processor(input_minidump_);
   if (!processor.ProcessDump())
@@ -101,4 +159,56 @@ int PoirotApp::Run() {
   return 0;
 }
 
+int PoirotApp::RunBatch(FILE* output_file) {
+  DCHECK_NE(static_cast<FILE*>(nullptr), output_file);
+
+  if (!base::DirectoryExists(input_dir_)) {
+    LOG(ERROR) << "Input directory '" << input_dir_.value()
+               << "' doesn't exist.";
+    return 1;
+  }
+
+  // The minidumps are processed in path order, so that the output doesn't
+  // depend on the enumeration order.
+  std::vector<base::FilePath> input_minidumps;
+  base::FileEnumerator enumerator(input_dir_, false,
+                                  base::FileEnumerator::FILES, L"*.dmp");
+  for (base::FilePath path = enumerator.Next(); !path.empty();
+       path = enumerator.Next()) {
+    input_minidumps.push_back(path);
+  }
+  std::sort(input_minidumps.begin(), input_minidumps.end());
+
+  std::vector<std::unique_ptr<BatchItem>> items;
+  for (const auto& input_minidump : input_minidumps)
+    items.push_back(std::unique_ptr<BatchItem>(new BatchItem(input_minidump)));
+
+  // Process the minidumps on a single process, which saves starting one for
+  // each of them.
+  application::WorkPool pool(jobs());
+  pool.Run(items.size(), base::Bind(&ProcessBatchItem, &items));
+
+  // And write the output file.
+  size_t failure_count = 0;
+  ::fprintf(output_file, "[");
+  for (size_t i = 0; i < items.size(); ++i) {
+    const BatchItem& item = *items[i];
+    ::fprintf(output_file, "%s\n  {\"minidump\": %s, \"crash_data\": %s}",
+              i == 0 ? "" : ",",
+              base::GetQuotedJSONString(
+                  base::WideToUTF8(item.input_minidump().value())).c_str(),
+              item.succeeded() ? item.json().c_str() : "null");
+    if (!item.succeeded()) {
+      LOG(ERROR) << "Unable to process '" << item.input_minidump().value()
+                 << "'.";
+      ++failure_count;
+    }
+  }
+  ::fprintf(output_file, "\n]\n");
+
+  LOG(INFO) << "Processed " << items.size() - failure_count << " of "
+            << items.size() << " minidumps.";
+  return 0;
+}
+
 }  // namespace poirot
@@ -15,6 +15,8 @@
 #ifndef SYZYGY_POIROT_POIROT_APP_H_
 #define SYZYGY_POIROT_POIROT_APP_H_
 
+#include <stdio.h>
+
 #include "base/command_line.h"
 #include "base/files/file_path.h"
 #include "base/strings/string_piece.h"
@@ -45,9 +47,16 @@ class PoirotApp : public application::AppImplBase {
                   const base::StringPiece& message);
   // @}
 
+  // Processes all the minidumps of input_dir_ on a pool of threads, and
+  // writes their crash data to @p output_file as a JSON list.
+  // @param output_file the file to write to.
+  // @returns 0 on success, 1 on failure.
+  int RunBatch(FILE* output_file);
+
   // @name Command-line options.
   // @{
   base::FilePath input_minidump_;
+  base::FilePath input_dir_;
   base::FilePath output_file_;
   // @}
 
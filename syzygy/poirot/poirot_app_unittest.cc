@@ -14,6 +14,10 @@
 
 #include "syzygy/poirot/poirot_app.h"
 
+#include "base/files/file_util.h"
+#include "base/json/json_reader.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/values.h"
 #include "gtest/gtest.h"
 #include "syzygy/common/unittest_util.h"
 #include "syzygy/core/unittest_util.h"
@@ -25,6 +29,7 @@ namespace {
 
 class TestPoirotApp : public PoirotApp {
  public:
+  using PoirotApp::input_dir_;
   using PoirotApp::input_minidump_;
   using PoirotApp::output_file_;
 };
@@ -145,4 +150,66 @@ TEST_F(PoirotAppTest, WriteJsonOutput) {
   EXPECT_FALSE(file_content.empty());
 }
 
+TEST_F(PoirotAppTest, ParseBatchCommandLineSucceeds) {
+  cmd_line_.AppendSwitchPath("input-dir", temp_dir_);
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(temp_dir_, test_impl_.input_dir_);
+  EXPECT_TRUE(test_impl_.input_minidump_.empty());
+}
+
+TEST_F(PoirotAppTest, ParseBothInputsFails) {
+  cmd_line_.AppendSwitchPath("input-minidump",
+      testing::GetSrcRelativePath(testing::kMinidumpUAF));
+  cmd_line_.AppendSwitchPath("input-dir", temp_dir_);
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(PoirotAppTest, ProcessDirectorySucceeds) {
+  // The minidump without a Kasko stream can't be processed, but doesn't stop
+  // the batch.
+  base::FilePath input_dir = temp_dir_.Append(L"minidumps");
+  ASSERT_TRUE(base::CreateDirectory(input_dir));
+  ASSERT_TRUE(base::CopyFile(
+      testing::GetSrcRelativePath(testing::kMinidumpUAF),
+      input_dir.Append(L"a.dmp")));
+  ASSERT_TRUE(base::CopyFile(
+      testing::GetSrcRelativePath(testing::kMinidumpNoKaskoStream),
+      input_dir.Append(L"b.dmp")));
+  ASSERT_TRUE(base::CopyFile(
+      testing::GetSrcRelativePath(testing::kMinidumpUAF),
+      input_dir.Append(L"c.dmp")));
+
+  base::FilePath temp_file = temp_dir_.Append(L"output.json");
+  cmd_line_.AppendSwitchPath("input-dir", input_dir);
+  cmd_line_.AppendSwitchPath("output-file", temp_file);
+  test_impl_.set_jobs(2);
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(0, test_impl_.Run());
+
+  std::string file_content;
+  ASSERT_TRUE(base::ReadFileToString(temp_file, &file_content));
+  std::unique_ptr<base::Value> value = base::JSONReader::Read(file_content);
+  ASSERT_TRUE(value.get() != nullptr);
+  base::ListValue* list = nullptr;
+  ASSERT_TRUE(value->GetAsList(&list));
+  ASSERT_EQ(3u, list->GetSize());
+
+  const wchar_t* kNames[] = {L"a.dmp", L"b.dmp", L"c.dmp"};
+  for (size_t i = 0; i < list->GetSize(); ++i) {
+    base::DictionaryValue* entry = nullptr;
+    ASSERT_TRUE(list->GetDictionary(i, &entry));
+    std::string minidump_utf8;
+    ASSERT_TRUE(entry->GetString("minidump", &minidump_utf8));
+    EXPECT_SAME_FILE(input_dir.Append(kNames[i]),
+                     base::FilePath(base::UTF8ToWide(minidump_utf8)));
+
+    base::Value* crash_data = nullptr;
+    ASSERT_TRUE(entry->Get("crash_data", &crash_data));
+    if (i == 1)
+      EXPECT_TRUE(crash_data->IsType(base::Value::TYPE_NULL));
+    else
+      EXPECT_FALSE(crash_data->IsType(base::Value::TYPE_NULL));
+  }
+}
+
 }  // namespace poirot
@@ -14,11 +14,225 @@
 
 #include "syzygy/refinery/analyzers/analysis_runner.h"
 
+#include <algorithm>
+#include <deque>
+
+#include "base/bind.h"
 #include "base/stl_util.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "base/win/scoped_com_initializer.h"
+#include "syzygy/application/work_pool.h"
 
 namespace refinery {
 
-AnalysisRunner::AnalysisRunner() {
+namespace {
+
+// @returns true if the layer lists @p first and @p second have a layer in
+//     common.
+bool LayersIntersect(const ProcessState::LayerEnum* first,
+                     const ProcessState::LayerEnum* second) {
+  DCHECK(first);
+  DCHECK(second);
+
+  for (; *first != ProcessState::UnknownLayer; ++first) {
+    for (const ProcessState::LayerEnum* layer = second;
+         *layer != ProcessState::UnknownLayer; ++layer) {
+      if (*first == *layer)
+        return true;
+    }
+  }
+  return false;
+}
+
+// @returns true if @p first and @p second may not run concurrently. Analyzers
+//     may read a layer concurrently, but a layer may only be accessed by
+//     the analyzer that writes it.
+bool AnalyzersConflict(const Analyzer* first, const Analyzer* second) {
+  DCHECK(first);
+  DCHECK(second);
+
+  const ProcessState::LayerEnum* first_inputs = first->input_layers();
+  const ProcessState::LayerEnum* first_outputs = first->output_layers();
+  const ProcessState::LayerEnum* second_inputs = second->input_layers();
+  const ProcessState::LayerEnum* second_outputs = second->output_layers();
+  if (first_inputs == nullptr || first_outputs == nullptr ||
+      second_inputs == nullptr || second_outputs == nullptr) {
+    return true;
+  }
+
+  return LayersIntersect(first_outputs, second_inputs) ||
+         LayersIntersect(first_outputs, second_outputs) ||
+         LayersIntersect(second_outputs, first_inputs);
+}
+
+// Freezes the layers written by @p analyzer, so that the analyzers that read
+// them find their records quickly.
+// @pre no other analyzer may be using the layers.
+void FreezeOutputLayers(const Analyzer* analyzer,
+                        ProcessState* process_state) {
+  DCHECK(analyzer);
+  DCHECK(process_state);
+
+  const ProcessState::LayerEnum* layers = analyzer->output_layers();
+  if (layers == nullptr) {
+    process_state->FreezeLayers();
+    return;
+  }
+  for (; *layers != ProcessState::UnknownLayer; ++layers)
+    process_state->FreezeLayer(*layers);
+}
+
+// Runs analyzers on a pool of threads. An analyzer is started once all the
+// analyzers it conflicts with that precede it have completed, so that
+// conflicting analyzers run in the order they were added.
+class AnalysisScheduler {
+ public:
+  AnalysisScheduler(const std::vector<Analyzer*>& analyzers,
+                    const minidump::Minidump& minidump,
+                    const Analyzer::ProcessAnalysis& process_analysis);
+
+  // Runs the analyzers.
+  // @param thread_count the number of threads to run the analyzers on.
+  // @returns ANALYSIS_COMPLETE if all analyzers completed, ANALYSIS_ERROR
+  //     otherwise.
+  Analyzer::AnalysisResult Analyze(size_t thread_count);
+
+  // Waits for an analyzer to be ready, and runs it. This is the WorkPool
+  // callback of Analyze, which is run once per analyzer.
+  // @returns true if the analyzer completed, false otherwise.
+  bool RunNextAnalyzer(size_t unused_index);
+
+ private:
+  // Waits for an analyzer to be ready to start.
+  // @param index on success, receives the index of the analyzer to run.
+  // @returns true on success, false if no analyzer is left to start.
+  bool GetNextAnalyzer(size_t* index);
+
+  // Releases the analyzers waiting for the analyzer at @p index.
+  // @param index the index of the analyzer that finished running.
+  // @param result the result of the analyzer.
+  void OnAnalyzerDone(size_t index, Analyzer::AnalysisResult result);
+
+  const std::vector<Analyzer*>& analyzers_;
+  const minidump::Minidump& minidump_;
+  const Analyzer::ProcessAnalysis& process_analysis_;
+
+  // The analyzers waiting for each analyzer.
+  std::vector<std::vector<size_t>> successors_;
+
+  // Protects the members below, and signals their changes.
+  base::Lock lock_;
+  base::ConditionVariable changed_;
+
+  // The number of unfinished analyzers each analyzer waits for.
+  std::vector<size_t> predecessor_counts_;
+  // The analyzers that are ready to start, in the order they were added.
+  std::deque<size_t> ready_;
+  // The number of analyzers that haven't been started.
+  size_t pending_count_;
+  // True once an analyzer has failed.
+  bool failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(AnalysisScheduler);
+};
+
+AnalysisScheduler::AnalysisScheduler(
+    const std::vector<Analyzer*>& analyzers,
+    const minidump::Minidump& minidump,
+    const Analyzer::ProcessAnalysis& process_analysis)
+    : analyzers_(analyzers),
+      minidump_(minidump),
+      process_analysis_(process_analysis),
+      successors_(analyzers.size()),
+      changed_(&lock_),
+      predecessor_counts_(analyzers.size(), 0),
+      pending_count_(analyzers.size()),
+      failed_(false) {
+  for (size_t i = 0; i < analyzers_.size(); ++i) {
+    for (size_t j = i + 1; j < analyzers_.size(); ++j) {
+      if (AnalyzersConflict(analyzers_[i], analyzers_[j])) {
+        successors_[i].push_back(j);
+        ++predecessor_counts_[j];
+      }
+    }
+    if (predecessor_counts_[i] == 0)
+      ready_.push_back(i);
+  }
+}
+
+Analyzer::AnalysisResult AnalysisScheduler::Analyze(size_t thread_count) {
+  DCHECK_LT(0u, thread_count);
+
+  // Each work item runs whichever analyzer is ready next, so the items
+  // don't map to the analyzers of the same index.
+  application::WorkPool pool(thread_count);
+  pool.Run(analyzers_.size(),
+           base::Bind(&AnalysisScheduler::RunNextAnalyzer,
+                      base::Unretained(this)));
+
+  DCHECK(failed_ || pending_count_ == 0);
+  return failed_ ? Analyzer::ANALYSIS_ERROR : Analyzer::ANALYSIS_COMPLETE;
+}
+
+bool AnalysisScheduler::RunNextAnalyzer(size_t unused_index) {
+  // The symbol providers use DIA, which requires COM on each thread.
+  base::win::ScopedCOMInitializer com_initializer;
+
+  size_t index = 0;
+  if (!GetNextAnalyzer(&index))
+    return false;
+
+  Analyzer* analyzer = analyzers_[index];
+  Analyzer::AnalysisResult result =
+      analyzer->Analyze(minidump_, process_analysis_);
+
+  // The analyzers that use the layers of this one are still waiting.
+  if (result == Analyzer::ANALYSIS_COMPLETE)
+    FreezeOutputLayers(analyzer, process_analysis_.process_state());
+  OnAnalyzerDone(index, result);
+  return result == Analyzer::ANALYSIS_COMPLETE;
+}
+
+bool AnalysisScheduler::GetNextAnalyzer(size_t* index) {
+  DCHECK(index);
+
+  base::AutoLock auto_lock(lock_);
+  while (!failed_ && ready_.empty() && pending_count_ != 0)
+    changed_.Wait();
+  if (failed_ || ready_.empty())
+    return false;
+
+  *index = ready_.front();
+  ready_.pop_front();
+  --pending_count_;
+  return true;
+}
+
+void AnalysisScheduler::OnAnalyzerDone(size_t index,
+                                       Analyzer::AnalysisResult result) {
+  CHECK(result != Analyzer::ANALYSIS_ITERATE)
+      << "Iterative analysis is not supported.";
+
+  base::AutoLock auto_lock(lock_);
+  if (result != Analyzer::ANALYSIS_COMPLETE) {
+    LOG(ERROR) << analyzers_[index]->name() << " analysis failed";
+    failed_ = true;
+  } else {
+    for (size_t successor : successors_[index]) {
+      DCHECK_LT(0u, predecessor_counts_[successor]);
+      if (--predecessor_counts_[successor] == 0)
+        ready_.push_back(successor);
+    }
+  }
+
+  // Wake the threads waiting for an analyzer, or for the analysis to end.
+  changed_.Broadcast();
+}
+
+}  // namespace
+
+AnalysisRunner::AnalysisRunner() : thread_count_(1) {
 }
 
 AnalysisRunner::~AnalysisRunner() {
@@ -33,6 +247,11 @@ void AnalysisRunner::AddAnalyzer(std::unique_ptr<Analyzer> analyzer) {
 Analyzer::AnalysisResult AnalysisRunner::Analyze(
     const minidump::Minidump& minidump,
     const Analyzer::ProcessAnalysis& process_analysis) {
+  if (thread_count_ > 1 && analyzers_.size() > 1) {
+    AnalysisScheduler scheduler(analyzers_, minidump, process_analysis);
+    return scheduler.Analyze(std::min(thread_count_, analyzers_.size()));
+  }
+
   for (Analyzer* analyzer : analyzers_) {
     Analyzer::AnalysisResult result =
         analyzer->Analyze(minidump, process_analysis);
@@ -42,6 +261,7 @@ Analyzer::AnalysisResult AnalysisRunner::Analyze(
       LOG(ERROR) << analyzer->name() << " analysis failed";
       return Analyzer::ANALYSIS_ERROR;
     }
+    FreezeOutputLayers(analyzer, process_analysis.process_state());
   }
   return Analyzer::ANALYSIS_COMPLETE;
 }
@@ -18,6 +18,7 @@
 #include <memory>
 #include <vector>
 
+#include "base/logging.h"
 #include "base/macros.h"
 #include "syzygy/minidump/minidump.h"
 #include "syzygy/refinery/analyzers/analyzer.h"
@@ -26,7 +27,13 @@
 namespace refinery {
 
 // The analysis runner runs analyzers over a minidump to populate a process
-// state.
+// state. By default the analyzers run one after the other, in the order they
+// were added. When several threads are used, analyzers whose layers don't
+// conflict run concurrently: an analyzer waits for the earlier analyzers that
+// write a layer it reads or writes, or that read a layer it writes. Analyzers
+// that don't declare their layers wait for, and are waited for by, all the
+// others.
+// The layers an analyzer writes are frozen once it completes.
 // TODO(manzagop): support iterative analysis (analyzers returning
 // ANALYSIS_ITERATE).
 class AnalysisRunner {
@@ -39,13 +46,23 @@ class AnalysisRunner {
   //   destruction.
   void AddAnalyzer(std::unique_ptr<Analyzer> analyzer);
 
+  // @name Accessors and mutators.
+  // @{
+  size_t thread_count() const { return thread_count_; }
+  void set_thread_count(size_t thread_count) {
+    DCHECK_LT(0u, thread_count);
+    thread_count_ = thread_count;
+  }
+  // @}
+
   // Runs analyzers over @p minidump and updates the ProcessState supplied
   // through @p process_analysis.
   // @param minidump the minidump to analyze.
   // @param process_analysis the process analysis passed to the analyzers.
   // @returns an analysis result. ANALYSIS_COMPLETE is returned if all analyzers
   //   return it. Otherwise, ANALYSIS_ERROR is returned in which case @p
-  //   process_state may be inconsistent.
+  //   process_state may be inconsistent. No analyzer is started after one
+  //   has failed.
   Analyzer::AnalysisResult Analyze(
       const minidump::Minidump& minidump,
       const Analyzer::ProcessAnalysis& process_analysis);
@@ -53,6 +70,9 @@ class AnalysisRunner {
  private:
   std::vector<Analyzer*> analyzers_;  // Owned.
 
+  // The number of threads the analyzers are run on.
+  size_t thread_count_;
+
   DISALLOW_COPY_AND_ASSIGN(AnalysisRunner);
 };
 
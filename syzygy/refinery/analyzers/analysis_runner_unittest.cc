@@ -14,6 +14,11 @@
 
 #include "syzygy/refinery/analyzers/analysis_runner.h"
 
+#include <vector>
+
+#include "base/synchronization/lock.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/time/time.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/minidump/minidump.h"
@@ -46,6 +51,102 @@ MockAnalyzer* CreateMockAnalyzer(Analyzer::AnalysisResult result) {
   return analyzer;
 }
 
+// An analyzer that declares its layers, and records when it runs.
+class LayeredAnalyzer : public Analyzer {
+ public:
+  // @param input_layer the layer read, or UnknownLayer for none.
+  // @param output_layer the layer written, or UnknownLayer for none.
+  // @param log the log of the analyzers that ran, which is shared by the
+  //     analyzers of a test.
+  // @param log_lock the lock that protects @p log.
+  LayeredAnalyzer(ProcessState::LayerEnum input_layer,
+                  ProcessState::LayerEnum output_layer,
+                  std::vector<const Analyzer*>* log,
+                  base::Lock* log_lock)
+      : log_(log),
+        log_lock_(log_lock),
+        started_(nullptr),
+        peer_started_(nullptr) {
+    input_layers_[0] = input_layer;
+    input_layers_[1] = ProcessState::UnknownLayer;
+    output_layers_[0] = output_layer;
+    output_layers_[1] = ProcessState::UnknownLayer;
+  }
+
+  // Makes the analysis signal @p started, then wait for @p peer_started and
+  // fail if it isn't signaled. This requires the peer to run concurrently.
+  void set_rendezvous(base::WaitableEvent* started,
+                      base::WaitableEvent* peer_started) {
+    started_ = started;
+    peer_started_ = peer_started;
+  }
+
+  const char* name() const override { return kMockAnalyzerName; }
+  const ProcessState::LayerEnum* input_layers() const override {
+    return input_layers_;
+  }
+  const ProcessState::LayerEnum* output_layers() const override {
+    return output_layers_;
+  }
+
+  AnalysisResult Analyze(const minidump::Minidump& minidump,
+                         const ProcessAnalysis& process_analysis) override {
+    {
+      base::AutoLock auto_lock(*log_lock_);
+      log_->push_back(this);
+    }
+
+    if (started_ != nullptr) {
+      started_->Signal();
+      if (!peer_started_->TimedWait(base::TimeDelta::FromSeconds(10)))
+        return ANALYSIS_ERROR;
+    }
+    return ANALYSIS_COMPLETE;
+  }
+
+ private:
+  ProcessState::LayerEnum input_layers_[2];
+  ProcessState::LayerEnum output_layers_[2];
+  std::vector<const Analyzer*>* log_;
+  base::Lock* log_lock_;
+  base::WaitableEvent* started_;
+  base::WaitableEvent* peer_started_;
+};
+
+class ParallelAnalysisRunnerTest : public testing::Test {
+ public:
+  ParallelAnalysisRunnerTest() : analysis_(&process_state_) {}
+
+  void SetUp() override { runner_.set_thread_count(3); }
+
+  // Adds a LayeredAnalyzer to the runner.
+  LayeredAnalyzer* AddAnalyzer(ProcessState::LayerEnum input_layer,
+                               ProcessState::LayerEnum output_layer) {
+    LayeredAnalyzer* analyzer =
+        new LayeredAnalyzer(input_layer, output_layer, &log_, &log_lock_);
+    runner_.AddAnalyzer(std::unique_ptr<Analyzer>(analyzer));
+    return analyzer;
+  }
+
+  // @returns the position of @p analyzer in the log, or -1 if it didn't run.
+  int LogPosition(const Analyzer* analyzer) {
+    for (size_t i = 0; i < log_.size(); ++i) {
+      if (log_[i] == analyzer)
+        return static_cast<int>(i);
+    }
+    return -1;
+  }
+
+ protected:
+  ProcessState process_state_;
+  SimpleProcessAnalysis analysis_;
+  minidump::FileMinidump minidump_;
+  AnalysisRunner runner_;
+
+  base::Lock log_lock_;
+  std::vector<const Analyzer*> log_;
+};
+
 }  // namespace
 
 TEST(AnalysisRunnerTest, BasicSuccessTest) {
@@ -79,4 +180,70 @@ TEST(AnalysisRunnerTest, BasicErrorTest) {
   ASSERT_EQ(Analyzer::ANALYSIS_ERROR, runner.Analyze(minidump, analysis));
 }
 
+TEST_F(ParallelAnalysisRunnerTest, IndependentAnalyzersRunConcurrently) {
+  base::WaitableEvent first_started(true, false);
+  base::WaitableEvent second_started(true, false);
+  AddAnalyzer(ProcessState::UnknownLayer, ProcessState::BytesLayer)
+      ->set_rendezvous(&first_started, &second_started);
+  AddAnalyzer(ProcessState::UnknownLayer, ProcessState::ModuleLayer)
+      ->set_rendezvous(&second_started, &first_started);
+
+  ASSERT_EQ(Analyzer::ANALYSIS_COMPLETE, runner_.Analyze(minidump_, analysis_));
+  EXPECT_EQ(2u, log_.size());
+}
+
+TEST_F(ParallelAnalysisRunnerTest, ReadersOfALayerRunConcurrently) {
+  base::WaitableEvent first_started(true, false);
+  base::WaitableEvent second_started(true, false);
+  AddAnalyzer(ProcessState::BytesLayer, ProcessState::ModuleLayer)
+      ->set_rendezvous(&first_started, &second_started);
+  AddAnalyzer(ProcessState::BytesLayer, ProcessState::StackLayer)
+      ->set_rendezvous(&second_started, &first_started);
+
+  ASSERT_EQ(Analyzer::ANALYSIS_COMPLETE, runner_.Analyze(minidump_, analysis_));
+}
+
+TEST_F(ParallelAnalysisRunnerTest, ConflictingAnalyzersRunInOrder) {
+  // The reader of the bytes waits for their writer, and the second writer of
+  // the typed blocks waits for the first.
+  LayeredAnalyzer* bytes_writer =
+      AddAnalyzer(ProcessState::UnknownLayer, ProcessState::BytesLayer);
+  LayeredAnalyzer* bytes_reader =
+      AddAnalyzer(ProcessState::BytesLayer, ProcessState::TypedBlockLayer);
+  LayeredAnalyzer* module_writer =
+      AddAnalyzer(ProcessState::UnknownLayer, ProcessState::ModuleLayer);
+  LayeredAnalyzer* typed_block_writer =
+      AddAnalyzer(ProcessState::ModuleLayer, ProcessState::TypedBlockLayer);
+
+  ASSERT_EQ(Analyzer::ANALYSIS_COMPLETE, runner_.Analyze(minidump_, analysis_));
+  ASSERT_EQ(4u, log_.size());
+  EXPECT_LT(LogPosition(bytes_writer), LogPosition(bytes_reader));
+  EXPECT_LT(LogPosition(module_writer), LogPosition(typed_block_writer));
+  EXPECT_LT(LogPosition(bytes_reader), LogPosition(typed_block_writer));
+}
+
+TEST_F(ParallelAnalysisRunnerTest, UndeclaredAnalyzersRunAlone) {
+  LayeredAnalyzer* before =
+      AddAnalyzer(ProcessState::UnknownLayer, ProcessState::BytesLayer);
+  runner_.AddAnalyzer(std::unique_ptr<Analyzer>(
+      CreateMockAnalyzer(Analyzer::ANALYSIS_COMPLETE)));
+  LayeredAnalyzer* after =
+      AddAnalyzer(ProcessState::UnknownLayer, ProcessState::ModuleLayer);
+
+  ASSERT_EQ(Analyzer::ANALYSIS_COMPLETE, runner_.Analyze(minidump_, analysis_));
+  EXPECT_EQ(0, LogPosition(before));
+  EXPECT_EQ(1, LogPosition(after));
+}
+
+TEST_F(ParallelAnalysisRunnerTest, ErrorStopsAnalysis) {
+  // The failing analyzer's layers aren't declared, so no other analyzer runs
+  // concurrently with it.
+  runner_.AddAnalyzer(
+      std::unique_ptr<Analyzer>(CreateMockAnalyzer(Analyzer::ANALYSIS_ERROR)));
+  AddAnalyzer(ProcessState::UnknownLayer, ProcessState::BytesLayer);
+
+  ASSERT_EQ(Analyzer::ANALYSIS_ERROR, runner_.Analyze(minidump_, analysis_));
+  EXPECT_TRUE(log_.empty());
+}
+
 }  // namespace refinery
@@ -58,6 +58,20 @@ class Analyzer {
   //     ANALYSIS_COMPLETED.
   virtual AnalysisResult Analyze(const minidump::Minidump& minidump,
                                  const ProcessAnalysis& process_analysis) = 0;
+
+  // @name The layers the analyzer reads and writes. These are terminated by
+  //     ProcessState::UnknownLayer, and are defined by the ANALYZER_*_LAYERS
+  //     macros below.
+  // @returns the layers, or nullptr if the analyzer doesn't declare them, in
+  //     which case it's assumed to read and write every layer.
+  // @{
+  virtual const ProcessState::LayerEnum* input_layers() const {
+    return nullptr;
+  }
+  virtual const ProcessState::LayerEnum* output_layers() const {
+    return nullptr;
+  }
+  // @}
 };
 
 // A process analysis brokers the state that analyzers may need during
@@ -77,32 +91,44 @@ class Analyzer::ProcessAnalysis {
 // @name Utility macros to allow declaring analyzer input and output layer
 //     dependencies.
 // @{
-#define ANALYZER_INPUT_LAYERS(...)                          \
-  static const ProcessState::LayerEnum* InputLayers() {     \
-    static const ProcessState::LayerEnum kInputLayers[] = { \
-        __VA_ARGS__, ProcessState::UnknownLayer};           \
-    return kInputLayers;                                    \
+#define ANALYZER_INPUT_LAYERS(...)                                \
+  static const ProcessState::LayerEnum* InputLayers() {           \
+    static const ProcessState::LayerEnum kInputLayers[] = {       \
+        __VA_ARGS__, ProcessState::UnknownLayer};                 \
+    return kInputLayers;                                          \
+  }                                                               \
+  const ProcessState::LayerEnum* input_layers() const override {  \
+    return InputLayers();                                         \
   }
 
-#define ANALYZER_NO_INPUT_LAYERS()                      \
-  static const ProcessState::LayerEnum* InputLayers() { \
-    static const ProcessState::LayerEnum kSentinel =    \
-        ProcessState::UnknownLayer;                     \
-    return &kSentinel;                                  \
+#define ANALYZER_NO_INPUT_LAYERS()                                \
+  static const ProcessState::LayerEnum* InputLayers() {           \
+    static const ProcessState::LayerEnum kSentinel =              \
+        ProcessState::UnknownLayer;                               \
+    return &kSentinel;                                            \
+  }                                                               \
+  const ProcessState::LayerEnum* input_layers() const override {  \
+    return InputLayers();                                         \
   }
 
-#define ANALYZER_OUTPUT_LAYERS(...)                          \
-  static const ProcessState::LayerEnum* OutputLayers() {     \
-    static const ProcessState::LayerEnum kOutputLayers[] = { \
-        __VA_ARGS__, ProcessState::UnknownLayer};            \
-    return kOutputLayers;                                    \
+#define ANALYZER_OUTPUT_LAYERS(...)                               \
+  static const ProcessState::LayerEnum* OutputLayers() {          \
+    static const ProcessState::LayerEnum kOutputLayers[] = {      \
+        __VA_ARGS__, ProcessState::UnknownLayer};                 \
+    return kOutputLayers;                                         \
+  }                                                               \
+  const ProcessState::LayerEnum* output_layers() const override { \
+    return OutputLayers();                                        \
   }
 
-#define ANALYZER_NO_OUTPUT_LAYERS()                      \
-  static const ProcessState::LayerEnum* OutputLayers() { \
-    static const ProcessState::LayerEnum kSentinel =     \
-        ProcessState::UnknownLayer;                      \
-    return &kSentinel;                                   \
+#define ANALYZER_NO_OUTPUT_LAYERS()                               \
+  static const ProcessState::LayerEnum* OutputLayers() {          \
+    static const ProcessState::LayerEnum kSentinel =              \
+        ProcessState::UnknownLayer;                               \
+    return &kSentinel;                                            \
+  }                                                               \
+  const ProcessState::LayerEnum* output_layers() const override { \
+    return OutputLayers();                                        \
   }
 
 // @}
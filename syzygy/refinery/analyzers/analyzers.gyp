@@ -21,6 +21,7 @@
       'target_name': 'analyzers_lib',
       'type': 'static_library',
       'dependencies': [
+        '<(src)/syzygy/application/application.gyp:application_lib',
         '<(src)/syzygy/common/common.gyp:common_lib',
         '<(src)/syzygy/pe/pe.gyp:dia_sdk',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
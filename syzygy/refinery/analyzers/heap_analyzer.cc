@@ -14,8 +14,13 @@
 
 #include "syzygy/refinery/analyzers/heap_analyzer.h"
 
+#include <vector>
+
+#include "base/bind.h"
+#include "base/sys_info.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
+#include "syzygy/application/work_pool.h"
 #include "syzygy/refinery/detectors/lfh_entry_detector.h"
 #include "syzygy/refinery/process_state/process_state_util.h"
 
@@ -156,12 +161,34 @@ bool RecordFoundRuns(const LFHEntryDetector::LFHEntryRuns& found_runs,
   return true;
 }
 
+// Detects the LFH entry runs of a bytes record. The runs of each record are
+// kept apart, so that they're recorded in the order of the records whatever
+// the number of threads. Detection doesn't modify @p detector, which lets the
+// threads share it.
+// @param detector the initialized detector.
+// @param records the records to search.
+// @param found_runs receives the runs found in each record. It must be as
+//     large as @p records.
+// @param index the index of the record to search.
+// @returns true on success, false otherwise.
+bool DetectRecordRuns(LFHEntryDetector* detector,
+                      const std::vector<BytesRecordPtr>* records,
+                      std::vector<LFHEntryDetector::LFHEntryRuns>* found_runs,
+                      size_t index) {
+  DCHECK(detector);
+  DCHECK(records);
+  DCHECK(found_runs);
+  DCHECK_EQ(records->size(), found_runs->size());
+  return detector->Detect((*records)[index]->range(), &(*found_runs)[index]);
+}
+
 }  // namespace
 
 // static
 const char HeapAnalyzer::kHeapAnalyzerName[] = "HeapAnalyzer";
 
-HeapAnalyzer::HeapAnalyzer() {
+HeapAnalyzer::HeapAnalyzer()
+    : thread_count_(static_cast<size_t>(base::SysInfo::NumberOfProcessors())) {
 }
 
 Analyzer::AnalysisResult HeapAnalyzer::Analyze(
@@ -195,14 +222,20 @@ Analyzer::AnalysisResult HeapAnalyzer::Analyze(
   }
 
   // Perform detection on the records from the bytes layer.
-  for (const auto& record : *bytes_layer) {
-    // TODO(siggi): Skip stacks, and perhaps modules here.
-    LFHEntryDetector::LFHEntryRuns found_runs;
-    if (!detector.Detect(record->range(), &found_runs)) {
-      LOG(ERROR) << "Detection failed.";
-      return ANALYSIS_ERROR;
-    }
+  // TODO(siggi): Skip stacks, and perhaps modules here.
+  std::vector<BytesRecordPtr> records;
+  for (const auto& record : *bytes_layer)
+    records.push_back(record);
+  std::vector<LFHEntryDetector::LFHEntryRuns> record_runs(records.size());
+  application::WorkPool pool(thread_count_);
+  if (!pool.Run(records.size(), base::Bind(&DetectRecordRuns, &detector,
+                                           &records, &record_runs))) {
+    LOG(ERROR) << "Detection failed.";
+    return ANALYSIS_ERROR;
+  }
 
+  // The layers are then populated on this thread.
+  for (const auto& found_runs : record_runs) {
     if (found_runs.size()) {
       if (!RecordFoundRuns(found_runs, detector.entry_type(),
                            process_analysis.process_state())) {
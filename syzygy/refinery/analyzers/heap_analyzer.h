@@ -23,13 +23,25 @@
 namespace refinery {
 
 // The heap analyzer detects heap snippets in the bytes layer and populates
-// the heap metadata and allocation layers with what it finds.
+// the heap metadata and allocation layers with what it finds. The records of
+// the bytes layer are independent, and are searched on several threads.
 class HeapAnalyzer : public Analyzer {
  public:
   const char* name() const override { return kHeapAnalyzerName; }
 
   HeapAnalyzer();
 
+  // @name Accessors and mutators.
+  // The number of threads that search the bytes layer, which defaults to the
+  // number of processors.
+  // @{
+  size_t thread_count() const { return thread_count_; }
+  void set_thread_count(size_t thread_count) {
+    DCHECK_LT(0u, thread_count);
+    thread_count_ = thread_count;
+  }
+  // @}
+
   AnalysisResult Analyze(const minidump::Minidump& minidump,
                          const ProcessAnalysis& process_state) override;
 
@@ -40,6 +52,8 @@ class HeapAnalyzer : public Analyzer {
  private:
   static const char kHeapAnalyzerName[];
 
+  size_t thread_count_;
+
   DISALLOW_COPY_AND_ASSIGN(HeapAnalyzer);
 };
 
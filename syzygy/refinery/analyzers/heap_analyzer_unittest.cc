@@ -14,6 +14,8 @@
 
 #include "syzygy/refinery/analyzers/heap_analyzer.h"
 
+#include <vector>
+
 #include "gtest/gtest.h"
 #include "syzygy/common/unittest_util.h"
 #include "syzygy/refinery/unittest_util.h"
@@ -30,6 +32,7 @@ namespace refinery {
 namespace {
 
 bool AnalyzeMinidump(const base::FilePath& minidump_path,
+                     size_t thread_count,
                      ProcessState* process_state) {
   minidump::FileMinidump minidump;
   if (!minidump.Open(minidump_path))
@@ -40,8 +43,10 @@ bool AnalyzeMinidump(const base::FilePath& minidump_path,
       std::move(std::unique_ptr<Analyzer>(new refinery::MemoryAnalyzer())));
   runner.AddAnalyzer(
       std::move(std::unique_ptr<Analyzer>(new refinery::ModuleAnalyzer())));
+  std::unique_ptr<HeapAnalyzer> heap_analyzer(new refinery::HeapAnalyzer());
+  heap_analyzer->set_thread_count(thread_count);
   runner.AddAnalyzer(
-      std::move(std::unique_ptr<Analyzer>(new refinery::HeapAnalyzer())));
+      std::move(std::unique_ptr<Analyzer>(heap_analyzer.release())));
 
   SimpleProcessAnalysis analysis(process_state);
   analysis.set_symbol_provider(new SymbolProvider());
@@ -92,7 +97,7 @@ TEST_F(HeapAnalyzerTest, AnalyzeHeap) {
   ASSERT_TRUE(
       minidump.GenerateMinidump(testing::ScopedMinidump::kMinidumpWithData));
   ProcessState process_state;
-  ASSERT_TRUE(AnalyzeMinidump(minidump.minidump_path(), &process_state));
+  ASSERT_TRUE(AnalyzeMinidump(minidump.minidump_path(), 1, &process_state));
 
   // Find the lfh_block allocation.
   HeapAllocationLayerPtr alloc_layer;
@@ -126,6 +131,41 @@ TEST_F(HeapAnalyzerTest, AnalyzeHeap) {
   ASSERT_FALSE(heap_meta_records[0]->data().corrupt());
 }
 
+TEST_F(HeapAnalyzerTest, ThreadCountDoesNotAffectResults) {
+  if (testing::IsAppVerifierActive()) {
+    LOG(WARNING) << "HeapAnalyzerTest.ThreadCountDoesNotAffectResults is "
+                    "incompatible with AV.";
+    return;
+  }
+
+  testing::ScopedMinidump minidump;
+  testing::ScopedHeap heap;
+  ASSERT_TRUE(heap.Create());
+  for (size_t i = 0; i < 1000; ++i)
+    ASSERT_TRUE(heap.Allocate(19));
+
+  ASSERT_TRUE(
+      minidump.GenerateMinidump(testing::ScopedMinidump::kMinidumpWithData));
+  ProcessState serial_state;
+  ASSERT_TRUE(AnalyzeMinidump(minidump.minidump_path(), 1, &serial_state));
+  ProcessState parallel_state;
+  ASSERT_TRUE(AnalyzeMinidump(minidump.minidump_path(), 4, &parallel_state));
+
+  // The same allocations are found, in the same order.
+  HeapAllocationLayerPtr serial_layer;
+  ASSERT_TRUE(serial_state.FindLayer(&serial_layer));
+  HeapAllocationLayerPtr parallel_layer;
+  ASSERT_TRUE(parallel_state.FindLayer(&parallel_layer));
+  ASSERT_EQ(serial_layer->size(), parallel_layer->size());
+  std::vector<AddressRange> serial_ranges;
+  for (const auto& record : *serial_layer)
+    serial_ranges.push_back(record->range());
+  std::vector<AddressRange> parallel_ranges;
+  for (const auto& record : *parallel_layer)
+    parallel_ranges.push_back(record->range());
+  EXPECT_EQ(serial_ranges, parallel_ranges);
+}
+
 // TODO(siggi): Test corruption etc.
 
 }  // namespace refinery
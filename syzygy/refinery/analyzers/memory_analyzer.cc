@@ -98,27 +98,34 @@ Analyzer::AnalysisResult MemoryAnalyzer::Analyze(
     minidump::Minidump::Stream bytes_stream =
         minidump.GetStreamFor(descriptor.Memory);
 
+    // The bytes are copied straight out of minidumps that are held in memory.
     std::string bytes;
-    if (!bytes_stream.ReadAndAdvanceBytes(range_size, &bytes))
+    const uint8_t* range_bytes = bytes_stream.GetBytes(range_size);
+    if (range_bytes != nullptr) {
+      bytes.assign(reinterpret_cast<const char*>(range_bytes), range_size);
+    } else if (!bytes_stream.ReadAndAdvanceBytes(range_size, &bytes)) {
       return ANALYSIS_ERROR;
+    }
 
     AddressRange new_range(range_addr, range_size);
     if (!new_range.IsValid())
       return ANALYSIS_ERROR;
 
     // Record the new range and consolidate it with any overlaps.
-    if (!RecordMemoryContents(new_range, bytes, &memory_temp))
+    if (!RecordMemoryContents(new_range, std::move(bytes), &memory_temp))
       return ANALYSIS_ERROR;
   }
 
-  // Now transfer the temp address space to the bytes layer.
-  for (const auto& entry : memory_temp) {
+  // Now transfer the temp address space to the bytes layer. The contents are
+  // moved rather than copied, so that the memory of the process isn't held
+  // twice.
+  for (auto& entry : memory_temp) {
     // Create the memory record.
     AddressRange new_range(entry.first.start(), entry.first.size());
     BytesRecordPtr bytes_record;
     bytes_layer->CreateRecord(new_range, &bytes_record);
     Bytes* bytes_proto = bytes_record->mutable_data();
-    bytes_proto->mutable_data()->assign(entry.second);
+    bytes_proto->mutable_data()->swap(entry.second);
   }
 
   return ANALYSIS_COMPLETE;
@@ -16,6 +16,7 @@
 #include <windows.h>  // NOLINT
 #include <dbghelp.h>
 
+#include <memory>
 #include <set>
 #include <unordered_map>
 #include <vector>
@@ -72,6 +73,8 @@ class RunAnalyzerApplication : public application::AppImplBase {
   std::string analyzer_names_;
   bool resolve_dependencies_;
   std::string output_layers_;
+  base::FilePath type_cache_dir_;
+  bool lazy_types_;
 
   DISALLOW_COPY_AND_ASSIGN(RunAnalyzerApplication);
 };
@@ -125,7 +128,17 @@ const char kUsageFormatStr[] =
     "     Default value: %s\n"
     "  --no-dependencies\n"
     "     If provided, the layer dependencies of the requested analyzers\n"
-    "     won't be used to supplement the analyzer list.\n";
+    "     won't be used to supplement the analyzer list.\n"
+    "  --jobs=<count>\n"
+    "     The number of threads to run the analyzers on. Analyzers whose\n"
+    "     layers don't conflict run concurrently.\n"
+    "     Default value: the number of processors\n"
+    "  --type-cache-dir=<directory>\n"
+    "     If provided, the types crawled from the PDBs are cached in this\n"
+    "     directory, which may be shared by several runs.\n"
+    "  --lazy-types\n"
+    "     If provided, the types are crawled from the PDBs as they're used\n"
+    "     rather than all at once. This is ignored with --type-cache-dir.\n";
 
 const char kDefaultAnalyzers[] = "HeapAnalyzer,StackFrameAnalyzer,TebAnalyzer";
 const char kDefaultOutputLayers[] = "TypedDataLayer";
@@ -232,7 +245,9 @@ void RunAnalyzerApplication::PrintUsage(const base::FilePath& program,
 }
 
 RunAnalyzerApplication::RunAnalyzerApplication()
-    : AppImplBase("RunAnalyzerApplication"), resolve_dependencies_(true) {
+    : AppImplBase("RunAnalyzerApplication"),
+      resolve_dependencies_(true),
+      lazy_types_(false) {
 }
 
 bool RunAnalyzerApplication::ParseCommandLine(
@@ -267,6 +282,9 @@ bool RunAnalyzerApplication::ParseCommandLine(
     }
   }
 
+  type_cache_dir_ = cmd_line->GetSwitchValuePath("type-cache-dir");
+  lazy_types_ = cmd_line->HasSwitch("lazy-types");
+
   for (const auto& arg : cmd_line->GetArgs()) {
     if (!AppendMatchingPaths(base::FilePath(arg), &mindump_paths_)) {
       PrintUsage(
@@ -329,14 +347,17 @@ int RunAnalyzerApplication::Run() {
 
   scoped_refptr<refinery::SymbolProvider> symbol_provider(
       new refinery::SymbolProvider());
+  symbol_provider->set_cache_dir(type_cache_dir_);
+  symbol_provider->set_lazy_types(lazy_types_);
   scoped_refptr<refinery::DiaSymbolProvider> dia_symbol_provider(
       new refinery::DiaSymbolProvider());
 
   for (const auto& minidump_path : mindump_paths_) {
     ::fprintf(out(), "Processing \"%ls\"\n", minidump_path.value().c_str());
 
-    minidump::FileMinidump minidump;
-    if (!minidump.Open(minidump_path)) {
+    std::unique_ptr<minidump::Minidump> minidump =
+        minidump::OpenMinidump(minidump_path);
+    if (!minidump) {
       LOG(ERROR) << "Unable to open dump file.";
       return 1;
     }
@@ -344,7 +365,7 @@ int RunAnalyzerApplication::Run() {
     refinery::ProcessState process_state;
     refinery::SimpleProcessAnalysis analysis(
         &process_state, dia_symbol_provider, symbol_provider);
-    if (Analyze(minidump, analyzer_factory, analysis)) {
+    if (Analyze(*minidump, analyzer_factory, analysis)) {
       PrintProcessState(&process_state);
     } else {
       LOG(ERROR) << "Failure processing minidump " << minidump_path.value();
@@ -423,6 +444,7 @@ bool RunAnalyzerApplication::Analyze(
       system_info.Cpu.X86CpuInfo.AMDExtendedCpuFeatures);
 
   refinery::AnalysisRunner runner;
+  runner.set_thread_count(jobs());
   if (!AddAnalyzers(factory, &runner))
     return false;
 
@@ -21,6 +21,7 @@
 
 #include "base/debug/alias.h"
 #include "base/files/file_path.h"
+#include "base/sys_info.h"
 #include "base/threading/platform_thread.h"
 #include "base/win/scoped_com_initializer.h"
 #include "gtest/gtest.h"
@@ -117,6 +118,14 @@ class StackAndFrameAnalyzersTest : public testing::Test {
   }
 
   bool AnalyzeMinidump(ProcessState* process_state) {
+    return AnalyzeMinidump(process_state,
+                           base::SysInfo::NumberOfProcessors());
+  }
+
+  // @param stack_thread_count the number of threads on which the stacks are
+  //     walked.
+  bool AnalyzeMinidump(ProcessState* process_state,
+                       size_t stack_thread_count) {
     minidump::FileMinidump minidump;
     if (!minidump.Open(minidump_path()))
       return false;
@@ -130,8 +139,10 @@ class StackAndFrameAnalyzersTest : public testing::Test {
     runner.AddAnalyzer(std::move(analyzer));
     analyzer.reset(new refinery::ModuleAnalyzer());
     runner.AddAnalyzer(std::move(analyzer));
-    analyzer.reset(new refinery::StackAnalyzer());
-    runner.AddAnalyzer(std::move(analyzer));
+    std::unique_ptr<StackAnalyzer> stack_analyzer(
+        new refinery::StackAnalyzer());
+    stack_analyzer->set_thread_count(stack_thread_count);
+    runner.AddAnalyzer(std::move(stack_analyzer));
     analyzer.reset(new refinery::StackFrameAnalyzer());
     runner.AddAnalyzer(std::move(analyzer));
 
@@ -276,4 +287,45 @@ TEST_F(StackAndFrameAnalyzersTest, BasicTest) {
                          expected_module_id, "dummy_param", L"int32_t"));
 }
 
+#ifdef _COVERAGE_BUILD
+TEST_F(StackAndFrameAnalyzersTest, DISABLED_StacksWalkedInParallel) {
+#else
+TEST_F(StackAndFrameAnalyzersTest, StacksWalkedInParallel) {
+#endif
+  base::win::ScopedCOMInitializer com_initializer;
+
+  int dummy_argument = 22;
+  ASSERT_TRUE(SetupStackFrameAndGenerateMinidump(dummy_argument));
+
+  // Walking the stacks on several threads records the same frames as walking
+  // them on a single one.
+  ProcessState serial_state;
+  ASSERT_TRUE(AnalyzeMinidump(&serial_state, 1U));
+  ProcessState parallel_state;
+  ASSERT_TRUE(AnalyzeMinidump(&parallel_state, 4U));
+
+  StackFrameLayerPtr serial_frames;
+  ASSERT_TRUE(serial_state.FindLayer(&serial_frames));
+  StackFrameLayerPtr parallel_frames;
+  ASSERT_TRUE(parallel_state.FindLayer(&parallel_frames));
+  ASSERT_EQ(serial_frames->size(), parallel_frames->size());
+  for (StackFrameRecordPtr serial_frame : *serial_frames) {
+    std::vector<StackFrameRecordPtr> matching_frames;
+    parallel_frames->GetRecordsAt(serial_frame->range().start(),
+                                  &matching_frames);
+    ASSERT_LT(0U, matching_frames.size());
+    EXPECT_EQ(serial_frame->range().size(),
+              matching_frames[0]->range().size());
+    EXPECT_EQ(serial_frame->data().register_info().eip(),
+              matching_frames[0]->data().register_info().eip());
+  }
+
+  // The test's thread was successfully walked.
+  StackRecordPtr stack;
+  DWORD thread_id = ::GetCurrentThreadId();
+  ASSERT_TRUE(parallel_state.FindStackRecord(static_cast<size_t>(thread_id),
+                                             &stack));
+  EXPECT_TRUE(stack->data().stack_walk_success());
+}
+
 }  // namespace refinery
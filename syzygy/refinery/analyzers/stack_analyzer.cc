@@ -14,8 +14,17 @@
 
 #include "syzygy/refinery/analyzers/stack_analyzer.h"
 
+#include <dia2.h>
+
+#include <vector>
+
+#include "base/bind.h"
 #include "base/numerics/safe_math.h"
 #include "base/strings/stringprintf.h"
+#include "base/sys_info.h"
+#include "base/win/scoped_com_initializer.h"
+#include "base/win/scoped_comptr.h"
+#include "syzygy/application/work_pool.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/pe/dia_util.h"
 #include "syzygy/refinery/analyzers/stack_analyzer_impl.h"
@@ -44,70 +53,137 @@ bool GetRegisterValue(IDiaStackFrame* frame,
   return true;
 }
 
-}  // namespace
+// A frame found by walking a stack, which is recorded into the process state
+// once all the stacks have been walked.
+struct FrameInfo {
+  AddressRange range;
+  StackFrame frame;
+};
+
+// The outcome of walking a stack.
+struct StackWalkResult {
+  StackWalkResult()
+      : result(Analyzer::ANALYSIS_COMPLETE), walk_success(false) {
+  }
 
-// static
-const char StackAnalyzer::kStackAnalyzerName[] = "StackAnalyzer";
+  Analyzer::AnalysisResult result;
+  // Whether the walk reached the end of the stack.
+  bool walk_success;
+  std::vector<FrameInfo> frames;
+};
+
+// Gets the data of @p stack_frame.
+// @param stack_frame the frame.
+// @param frame_info receives the frame's data.
+// @param is_empty set to true if the frame is empty, in which case it's
+//     skipped.
+// @returns true on success, false on failure.
+// TODO(manzagop): revise when support expands beyond x86.
+bool GetStackFrameInfo(IDiaStackFrame* stack_frame,
+                       FrameInfo* frame_info,
+                       bool* is_empty) {
+  DCHECK(stack_frame); DCHECK(frame_info); DCHECK(is_empty);
+  *is_empty = false;
 
-StackAnalyzer::StackAnalyzer() : child_frame_context_(nullptr) {
-}
+  // Get the frame's base.
+  uint64_t frame_base = 0ULL;
+  if (!pe::GetFrameBase(stack_frame, &frame_base))
+    return false;
 
-Analyzer::AnalysisResult StackAnalyzer::Analyze(
-    const minidump::Minidump& minidump,
-    const ProcessAnalysis& process_analysis) {
-  DCHECK(process_analysis.process_state() != nullptr);
-  DCHECK(process_analysis.dia_symbol_provider() != nullptr);
+  // Get frame's top.
+  uint64_t frame_top = 0ULL;
+  if (!pe::GetRegisterValue(stack_frame, CV_REG_ESP, &frame_top))
+    return false;
 
-  // Create stack walker and helper.
-  if (!pe::CreateDiaObject(stack_walker_.Receive(),
-                           CLSID_DiaStackWalker)) {
-      return ANALYSIS_ERROR;
-    }
-  stack_walk_helper_ =
-      new StackWalkHelper(process_analysis.dia_symbol_provider());
+  // Get the frame's size. Note: this differs from the difference between
+  // top of frame and base in that it excludes callee parameter size.
+  uint32_t frame_size = 0U;
+  if (!pe::GetSize(stack_frame, &frame_size))
+    return false;
 
-  // Get the stack layer - it must already have been populated.
-  StackLayerPtr stack_layer;
-  if (!process_analysis.process_state()->FindLayer(&stack_layer)) {
-    LOG(ERROR) << "Missing stack layer.";
-    return ANALYSIS_ERROR;
+  // Get base address of locals.
+  uint64_t locals_base = 0ULL;
+  if (!pe::GetLocalsBase(stack_frame, &locals_base))
+    return false;
+
+  // TODO(manzagop): get register values and some notion about their validity.
+
+  // Compute the frame's full size.
+  DCHECK_LE(frame_top, frame_base);
+  base::CheckedNumeric<Size> frame_full_size =
+      base::CheckedNumeric<Size>::cast(frame_base - frame_top);
+  if (!frame_full_size.IsValid()) {
+    LOG(ERROR) << "Frame full size doesn't fit a 32bit integer.";
+    return false;
   }
 
-  // Process each thread's stack.
-  Analyzer::AnalysisResult result = ANALYSIS_COMPLETE;
-  for (StackRecordPtr stack_record : *stack_layer) {
-    // Attempt to stack walk. Note that the stack walk derailing is not an
-    // analysis error.
-    Analyzer::AnalysisResult stack_result =
-        StackWalk(stack_record, process_analysis);
-    if (stack_result == ANALYSIS_ERROR)
-      return ANALYSIS_ERROR;
-    if (stack_result == ANALYSIS_ITERATE)
-      result = ANALYSIS_ITERATE;
+  if (frame_full_size.ValueOrDie() == 0U) {
+    *is_empty = true;
+    return true;  // Skip empty frame.
   }
 
-  return result;
+  frame_info->range = AddressRange(
+      static_cast<Address>(frame_top),
+      static_cast<Size>(frame_full_size.ValueOrDie()));
+  if (!frame_info->range.IsValid()) {
+    LOG(ERROR) << "Invalid frame range.";
+    return false;
+  }
+
+  // Register context.
+  // TODO(manzagop): flesh out the register context.
+  RegisterInformation* context = frame_info->frame.mutable_register_info();
+  uint32_t eip = 0U;
+  if (!GetRegisterValue(stack_frame, CV_REG_EIP, &eip))
+    return false;
+  context->set_eip(eip);
+  uint32_t allreg_vframe = 0U;
+  if (GetRegisterValue(stack_frame, CV_ALLREG_VFRAME, &allreg_vframe)) {
+    // Register doesn't seem to always be available. Not considered an error.
+    context->set_allreg_vframe(allreg_vframe);
+  }
+
+  frame_info->frame.set_frame_size_bytes(frame_size);
+  frame_info->frame.set_locals_base(locals_base);
+
+  return true;
 }
 
-Analyzer::AnalysisResult StackAnalyzer::StackWalk(
-    StackRecordPtr stack_record,
-    const ProcessAnalysis& process_analysis) {
-  stack_walk_helper_->SetState(stack_record, process_analysis.process_state());
-  child_frame_context_ = nullptr;
+// Walks the stack of @p stack_record.
+// @param stack_walker the DIA stack walker of the calling thread.
+// @param stack_walk_helper the stack walk helper of the calling thread.
+// @param stack_record the stack to walk.
+// @param process_state the process state, which is only read.
+// @param result receives the outcome of the walk.
+void WalkStack(IDiaStackWalker* stack_walker,
+               StackWalkHelper* stack_walk_helper,
+               StackRecordPtr stack_record,
+               ProcessState* process_state,
+               StackWalkResult* result) {
+  DCHECK(stack_walker); DCHECK(stack_walk_helper); DCHECK(process_state);
+  DCHECK(result);
+
+  stack_walk_helper->SetState(stack_record, process_state);
 
   // Create the frame enumerator.
   base::win::ScopedComPtr<IDiaEnumStackFrames> frame_enumerator;
   // TODO(manzagop): this is for x86 platforms. Switch to getEnumFrames2.
-  HRESULT hr = stack_walker_->getEnumFrames(
-      static_cast<IDiaStackWalkHelper*>(stack_walk_helper_.get()),
+  HRESULT hr = stack_walker->getEnumFrames(
+      static_cast<IDiaStackWalkHelper*>(stack_walk_helper),
       frame_enumerator.Receive());
   if (hr != S_OK) {
     LOG(ERROR) << "Failed to get frame enumerator: " << common::LogHr(hr)
                << ".";
-    return ANALYSIS_ERROR;
+    result->result = Analyzer::ANALYSIS_ERROR;
+    return;
   }
   frame_enumerator->Reset();
 
+  // A frame's data is often located relative to the CV_ALLREG_VFRAME. However,
+  // we observe this is relative to the parent frame's value. For ease of
+  // access, we store the parent frame's value in the child frame's context.
+  bool has_child_frame = false;
+
   // Walk the stack frames.
   // TODO(manzagop): changes for non-X86 platforms (eg registers).
   while (true) {
@@ -117,13 +193,28 @@ Analyzer::AnalysisResult StackAnalyzer::StackWalk(
     if (!SUCCEEDED(hr)) {
       // Stack walking derailed. Not an an analyzer error per se.
       LOG(ERROR) << "Failed to get stack frame: " << common::LogHr(hr) << ".";
-      return ANALYSIS_COMPLETE;
+      return;
     }
     if (hr == S_FALSE || retrieved_cnt != 1)
       break;  // No frame.
 
-    if (!InsertStackFrameRecord(stack_frame.get(), process_analysis))
-      return ANALYSIS_ERROR;
+    FrameInfo frame_info;
+    bool is_empty = false;
+    if (!GetStackFrameInfo(stack_frame.get(), &frame_info, &is_empty)) {
+      result->result = Analyzer::ANALYSIS_ERROR;
+      return;
+    }
+    if (is_empty) {
+      has_child_frame = false;
+    } else {
+      const RegisterInformation& context = frame_info.frame.register_info();
+      if (has_child_frame && context.has_allreg_vframe()) {
+        result->frames.back().frame.mutable_register_info()->
+            set_parent_allreg_vframe(context.allreg_vframe());
+      }
+      result->frames.push_back(frame_info);
+      has_child_frame = true;
+    }
 
     // WinDBG seems to use a null return address as a termination criterion.
     ULONGLONG frame_return_addr = 0ULL;
@@ -131,98 +222,105 @@ Analyzer::AnalysisResult StackAnalyzer::StackWalk(
     if (hr != S_OK) {
       LOG(ERROR) << "Failed to get frame's return address: "
                  << common::LogHr(hr) << ".";
-      return ANALYSIS_ERROR;
+      result->result = Analyzer::ANALYSIS_ERROR;
+      return;
     }
     if (frame_return_addr == 0ULL) {
-      stack_record->mutable_data()->set_stack_walk_success(true);
+      result->walk_success = true;
       break;
     }
   }
-
-  return ANALYSIS_COMPLETE;
 }
 
-// TODO(manzagop): revise when support expands beyond x86.
-bool StackAnalyzer::InsertStackFrameRecord(
-    IDiaStackFrame* stack_frame,
-    const ProcessAnalysis& process_analysis) {
-  RegisterInformation* child_context = child_frame_context_;
-  child_frame_context_ = nullptr;
-
-  // Get the frame's base.
-  uint64_t frame_base = 0ULL;
-  if (!pe::GetFrameBase(stack_frame, &frame_base))
+// Walks the stack at @p index of @p stack_records with a DIA stack walker and
+// stack walk helper of its own, so that distinct stacks can be walked on
+// different threads. The DIA symbol provider hands each thread sessions of
+// its own, and the process state is only read.
+// @param stack_records the stacks to walk.
+// @param process_analysis the analysis the stacks belong to.
+// @param results receives the outcome of the walk of each stack.
+// @param index the index of the stack to walk.
+// @returns false if the stack walker couldn't be created, true otherwise.
+bool WalkStackAt(const std::vector<StackRecordPtr>* stack_records,
+                 const ProcessAnalysis* process_analysis,
+                 std::vector<StackWalkResult>* results,
+                 size_t index) {
+  DCHECK(stack_records); DCHECK(process_analysis); DCHECK(results);
+  DCHECK_EQ(stack_records->size(), results->size());
+
+  // DIA requires COM on the calling thread.
+  base::win::ScopedCOMInitializer com_initializer;
+
+  base::win::ScopedComPtr<IDiaStackWalker> stack_walker;
+  if (!pe::CreateDiaObject(stack_walker.Receive(), CLSID_DiaStackWalker))
     return false;
+  scoped_refptr<StackWalkHelper> stack_walk_helper(
+      new StackWalkHelper(process_analysis->dia_symbol_provider()));
 
-  // Get frame's top.
-  uint64_t frame_top = 0ULL;
-  if (!pe::GetRegisterValue(stack_frame, CV_REG_ESP, &frame_top))
-    return false;
+  WalkStack(stack_walker.get(), stack_walk_helper.get(),
+            (*stack_records)[index], process_analysis->process_state(),
+            &(*results)[index]);
+  return true;
+}
 
-  // Get the frame's size. Note: this differs from the difference between
-  // top of frame and base in that it excludes callee parameter size.
-  uint32_t frame_size = 0U;
-  if (!pe::GetSize(stack_frame, &frame_size))
-    return false;
+}  // namespace
 
-  // Get base address of locals.
-  uint64_t locals_base = 0ULL;
-  if (!pe::GetLocalsBase(stack_frame, &locals_base))
-    return false;
+// static
+const char StackAnalyzer::kStackAnalyzerName[] = "StackAnalyzer";
 
-  // TODO(manzagop): get register values and some notion about their validity.
+StackAnalyzer::StackAnalyzer()
+    : thread_count_(base::SysInfo::NumberOfProcessors()) {
+}
 
-  // Populate the stack frame layer.
+Analyzer::AnalysisResult StackAnalyzer::Analyze(
+    const minidump::Minidump& minidump,
+    const ProcessAnalysis& process_analysis) {
+  DCHECK(process_analysis.process_state() != nullptr);
+  DCHECK(process_analysis.dia_symbol_provider() != nullptr);
 
-  // Compute the frame's full size.
-  DCHECK_LE(frame_top, frame_base);
-  base::CheckedNumeric<Size> frame_full_size =
-      base::CheckedNumeric<Size>::cast(frame_base - frame_top);
-  if (!frame_full_size.IsValid()) {
-    LOG(ERROR) << "Frame full size doesn't fit a 32bit integer.";
-    return false;
+  // Get the stack layer - it must already have been populated.
+  StackLayerPtr stack_layer;
+  if (!process_analysis.process_state()->FindLayer(&stack_layer)) {
+    LOG(ERROR) << "Missing stack layer.";
+    return ANALYSIS_ERROR;
   }
-
-  if (frame_full_size.ValueOrDie() == 0U)
-    return true;  // Skip empty frame.
-
-  // Create the stack frame record.
-  AddressRange range(static_cast<Address>(frame_top),
-                     static_cast<Size>(frame_full_size.ValueOrDie()));
-  if (!range.IsValid()) {
-    LOG(ERROR) << "Invalid frame range.";
-    return false;
+  std::vector<StackRecordPtr> stack_records;
+  for (StackRecordPtr stack_record : *stack_layer)
+    stack_records.push_back(stack_record);
+
+  // Walk each thread's stack.
+  std::vector<StackWalkResult> stack_results(stack_records.size());
+  application::WorkPool pool(thread_count_);
+  if (!pool.Run(stack_records.size(),
+                base::Bind(&WalkStackAt, &stack_records, &process_analysis,
+                           &stack_results))) {
+    return ANALYSIS_ERROR;
   }
 
+  // Record the frames of the stacks, in order. Note that the stack walk
+  // derailing is not an analysis error.
+  Analyzer::AnalysisResult result = ANALYSIS_COMPLETE;
   StackFrameLayerPtr frame_layer;
-  process_analysis.process_state()->FindOrCreateLayer(&frame_layer);
-
-  StackFrameRecordPtr frame_record;
-  frame_layer->CreateRecord(range, &frame_record);
-  StackFrame* frame_proto = frame_record->mutable_data();
-
-  // Populate the stack frame record.
+  for (size_t i = 0; i < stack_records.size(); ++i) {
+    StackWalkResult& stack_result = stack_results[i];
+    for (FrameInfo& frame_info : stack_result.frames) {
+      if (frame_layer == nullptr)
+        process_analysis.process_state()->FindOrCreateLayer(&frame_layer);
+
+      StackFrameRecordPtr frame_record;
+      frame_layer->CreateRecord(frame_info.range, &frame_record);
+      frame_record->mutable_data()->Swap(&frame_info.frame);
+    }
+    if (stack_result.walk_success)
+      stack_records[i]->mutable_data()->set_stack_walk_success(true);
 
-  // Register context.
-  // TODO(manzagop): flesh out the register context.
-  RegisterInformation* context = frame_proto->mutable_register_info();
-  uint32_t eip = 0U;
-  if (!GetRegisterValue(stack_frame, CV_REG_EIP, &eip))
-    return false;
-  context->set_eip(eip);
-  uint32_t allreg_vframe = 0U;
-  if (GetRegisterValue(stack_frame, CV_ALLREG_VFRAME, &allreg_vframe)) {
-    // Register doesn't seem to always be available. Not considered an error.
-    context->set_allreg_vframe(allreg_vframe);
-    if (child_context)
-      child_context->set_parent_allreg_vframe(allreg_vframe);
+    if (stack_result.result == ANALYSIS_ERROR)
+      return ANALYSIS_ERROR;
+    if (stack_result.result == ANALYSIS_ITERATE)
+      result = ANALYSIS_ITERATE;
   }
 
-  frame_proto->set_frame_size_bytes(frame_size);
-  frame_proto->set_locals_base(locals_base);
-
-  child_frame_context_ = context;
-  return true;
+  return result;
 }
 
 }  // namespace refinery
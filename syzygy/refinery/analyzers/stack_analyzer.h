@@ -15,22 +15,17 @@
 #ifndef SYZYGY_REFINERY_ANALYZERS_STACK_ANALYZER_H_
 #define SYZYGY_REFINERY_ANALYZERS_STACK_ANALYZER_H_
 
-#include <dia2.h>
-
+#include "base/logging.h"
 #include "base/macros.h"
-#include "base/memory/ref_counted.h"
-#include "base/win/scoped_comptr.h"
 #include "syzygy/refinery/analyzers/analyzer.h"
 #include "syzygy/refinery/process_state/process_state_util.h"
-#include "syzygy/refinery/symbols/dia_symbol_provider.h"
 
 namespace refinery {
 
-// fwd.
-class StackWalkHelper;
-
 // The stack analyzer populates the process state with information resulting
-// from walking the stack.
+// from walking the stack. The stacks of the threads are walked on several
+// threads, each with its own DIA stack walker and sessions, and their frames
+// are recorded into the process state once all the walks are done.
 // TODO(manzagop): Introduce a system for managing analyzer order prerequisites?
 class StackAnalyzer : public Analyzer {
  public:
@@ -46,23 +41,22 @@ class StackAnalyzer : public Analyzer {
                         ProcessState::StackLayer)
   ANALYZER_OUTPUT_LAYERS(ProcessState::StackFrameLayer)
 
- private:
-  AnalysisResult StackWalk(StackRecordPtr stack_record,
-                           const ProcessAnalysis& process_analysis);
-
-  // Inserts data about @p stack_frame into @p process_state.
-  bool InsertStackFrameRecord(IDiaStackFrame* stack_frame,
-                              const ProcessAnalysis& process_analysis);
+  // @name Accessors and mutators.
+  // @{
+  size_t thread_count() const { return thread_count_; }
+  // Sets the number of threads on which the stacks are walked. This defaults
+  // to the number of processors.
+  void set_thread_count(size_t thread_count) {
+    DCHECK_LT(0U, thread_count);
+    thread_count_ = thread_count;
+  }
+  // @}
 
+ private:
   static const char kStackAnalyzerName[];
 
-  base::win::ScopedComPtr<IDiaStackWalker> stack_walker_;
-  scoped_refptr<StackWalkHelper> stack_walk_helper_;
-
-  // A frame's data is often located relative to the CV_ALLREG_VFRAME. However,
-  // we observe this is relative to the parent frame's value. For ease of
-  // access, we store the parent frame's value in the frame's context.
-  RegisterInformation* child_frame_context_;
+  // The number of threads on which the stacks are walked.
+  size_t thread_count_;
 
   DISALLOW_COPY_AND_ASSIGN(StackAnalyzer);
 };
@@ -162,4 +162,28 @@ bool ProcessState::GetExceptingThreadId(size_t* thread_id) {
   return true;
 }
 
+void ProcessState::FreezeLayer(LayerEnum layer) {
+  switch (layer) {
+#define FREEZE_LAYER_CASE(name)          \
+  case name##Layer: {                    \
+    scoped_refptr<Layer<name>> found;    \
+    if (FindLayer(&found))               \
+      found->Freeze();                   \
+    break;                               \
+  }
+
+    PROCESS_STATE_LAYERS(FREEZE_LAYER_CASE)
+
+#undef FREEZE_LAYER_CASE
+    default:
+      NOTREACHED();
+  }
+}
+
+void ProcessState::FreezeLayers() {
+  base::AutoLock auto_lock(layers_lock_);
+  for (const auto& entry : layers_)
+    entry.second->Freeze();
+}
+
 }  // namespace refinery
@@ -15,6 +15,7 @@
 #ifndef SYZYGY_REFINERY_PROCESS_STATE_PROCESS_STATE_H_
 #define SYZYGY_REFINERY_PROCESS_STATE_PROCESS_STATE_H_
 
+#include <algorithm>
 #include <iterator>
 #include <map>
 #include <vector>
@@ -22,6 +23,7 @@
 #include "base/logging.h"
 #include "base/macros.h"
 #include "base/memory/ref_counted.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/refinery/core/address.h"
 #include "syzygy/refinery/core/bit_source.h"
 #include "syzygy/refinery/process_state/layer_traits.h"
@@ -51,6 +53,12 @@ namespace refinery {
 // process' virtual memory space, and contains data specific to that layer and
 // range. Each layer and the data associated with a record is a protobuf of
 // a type appropriate to the layer.
+// Layers may be found and created from several threads at once, and the
+// layers and records are reference counted safely across threads. The
+// contents of a layer aren't synchronized: a layer may be read by several
+// threads at once, but only while no thread modifies it.
+// Once a layer is populated, it can be frozen to index its records by
+// address range, which makes the lookups logarithmic rather than linear.
 class ProcessState : public BitSource {
  public:
   template <typename RecordType> class Layer;
@@ -126,12 +134,24 @@ class ProcessState : public BitSource {
   // @returns true on success, false if there is no exception.
   bool GetExceptingThreadId(size_t* thread_id);
 
+  // Freezes @p layer if it exists. See Layer::Freeze.
+  // @pre @p layer must not be modified or read by another thread.
+  // @param layer the layer to freeze.
+  void FreezeLayer(LayerEnum layer);
+
+  // Freezes all layers. See Layer::Freeze.
+  // @pre the layers must not be modified or read by another thread.
+  void FreezeLayers();
+
  private:
   class LayerBase;
 
+  // @pre layers_lock_ must be held.
   template<typename RecordType>
   void CreateLayer(scoped_refptr<Layer<RecordType>>* layer);
 
+  // Protects layers_.
+  base::Lock layers_lock_;
   std::map<RecordId, scoped_refptr<LayerBase>> layers_;
 
   bool has_exception;
@@ -143,12 +163,16 @@ class ProcessState : public BitSource {
 // A layer is one view on a process (eg raw bytes, stack, stack frames,
 // typed blocks). It's a bag of records that span some part of the process'
 // address space.
-class ProcessState::LayerBase : public base::RefCounted<LayerBase> {
+class ProcessState::LayerBase
+    : public base::RefCountedThreadSafe<LayerBase> {
  public:
   LayerBase() {}
 
+  // Indexes the records of the layer. See Layer::Freeze.
+  virtual void Freeze() = 0;
+
  protected:
-  friend class base::RefCounted<LayerBase>;
+  friend class base::RefCountedThreadSafe<LayerBase>;
   virtual ~LayerBase() {}
 
  private:
@@ -158,7 +182,8 @@ class ProcessState::LayerBase : public base::RefCounted<LayerBase> {
 // An individual record of a layer. Contains the data associated with the
 // record as a protobuffer.
 template <typename RecordType>
-class ProcessState::Record : public base::RefCounted<Record<RecordType>> {
+class ProcessState::Record
+    : public base::RefCountedThreadSafe<Record<RecordType>> {
  public:
   // @pre @p range must be a valid range.
   explicit Record(AddressRange range) : range_(range) {
@@ -173,7 +198,7 @@ class ProcessState::Record : public base::RefCounted<Record<RecordType>> {
   // @}
 
  private:
-  friend class base::RefCounted<Record<RecordType>>;
+  friend class base::RefCountedThreadSafe<Record<RecordType>>;
   ~Record() {}
 
   AddressRange range_;
@@ -190,7 +215,10 @@ class ProcessState::Layer : public ProcessState::LayerBase {
   typedef scoped_refptr<Record<RecordType>> RecordPtr;
   typedef Iterator<RecordType> Iterator;
 
+  Layer() : frozen_(false) {}
+
   // @pre @p range must be a valid.
+  // @note this thaws the layer.
   void CreateRecord(AddressRange range, RecordPtr* record);
 
   // Gets records located at |addr|.
@@ -215,8 +243,20 @@ class ProcessState::Layer : public ProcessState::LayerBase {
   // Removes |record| from the layer.
   // @param record the record to remove.
   // @returns true on success, false otherwise.
+  // @note this thaws the layer.
   bool RemoveRecord(const RecordPtr& record);
 
+  // Indexes the records of the layer by address range, so that
+  // GetRecordsSpanning and GetRecordsIntersecting take a time logarithmic in
+  // the size of the layer, plus the number of records returned. Records are
+  // best created in a batch, then the layer frozen once for reading, as
+  // creating or removing a record thaws the layer and drops its index.
+  // Freezing a frozen layer has no effect.
+  void Freeze() override;
+
+  // @returns true if the layer is frozen.
+  bool frozen() const { return frozen_; }
+
   // Iterators for range-based for loop.
   Iterator begin() { return Iterator(records_.begin()); }
   Iterator end() { return Iterator(records_.end()); }
@@ -227,8 +267,34 @@ class ProcessState::Layer : public ProcessState::LayerBase {
   typename LayerTraits<RecordType>::DataType* mutable_data() { return &data_; }
 
  private:
+  // Drops the index.
+  void Thaw();
+
+  // Builds the index of the subtree of the records [@p begin, @p end).
+  // @returns the largest end address of the records of the subtree.
+  Address BuildIndex(size_t begin, size_t end);
+
+  // Gets the records of the subtree of the records [@p begin, @p end) that
+  // start at or before @p max_start and end at or after @p min_end.
+  // @param records receives the matching records, in address order.
+  void GetIndexedRecords(size_t begin,
+                         size_t end,
+                         Address max_start,
+                         Address min_end,
+                         std::vector<RecordPtr>* records) const;
+
   typename LayerTraits<RecordType>::DataType data_;
   std::multimap<Address, RecordPtr> records_;
+
+  // True if the layer is frozen, in which case the index is up to date.
+  bool frozen_;
+
+  // The index of a frozen layer. It holds the records in address order. It's
+  // laid out as an implicit balanced binary search tree: the root of the
+  // subtree of the records [begin, end) is at (begin + end) / 2, and
+  // max_ends_ holds the largest end address of the subtree of each record.
+  std::vector<RecordPtr> index_;
+  std::vector<Address> max_ends_;
 };
 
 #define DECL_LAYER_TYPES(layer_name)                                           \
@@ -277,6 +343,7 @@ template<typename RecordType>
 bool ProcessState::FindLayer(scoped_refptr<Layer<RecordType>>* layer) {
   DCHECK(layer != nullptr);
 
+  base::AutoLock auto_lock(layers_lock_);
   RecordId id = RecordTraits<RecordType>::ID;
   auto it = layers_.find(id);
   if (it != layers_.end()) {
@@ -292,8 +359,13 @@ void ProcessState::FindOrCreateLayer(
     scoped_refptr<Layer<RecordType>>* layer) {
   DCHECK(layer != nullptr);
 
-  if (FindLayer(layer))
+  base::AutoLock auto_lock(layers_lock_);
+  RecordId id = RecordTraits<RecordType>::ID;
+  auto it = layers_.find(id);
+  if (it != layers_.end()) {
+    *layer = static_cast<Layer<RecordType>*>(it->second.get());
     return;
+  }
 
   CreateLayer(layer);
 }
@@ -319,6 +391,7 @@ bool ProcessState::FindSingleRecord(Address addr,
 template<typename RecordType>
 void ProcessState::CreateLayer(scoped_refptr<Layer<RecordType>>* layer) {
   DCHECK(layer != nullptr);
+  layers_lock_.AssertAcquired();
 
   scoped_refptr<Layer<RecordType>> new_layer = new Layer<RecordType>();
   DCHECK(new_layer.get() != nullptr);
@@ -338,6 +411,8 @@ void ProcessState::Layer<RecordType>::CreateRecord(
   DCHECK(range.IsValid());
   DCHECK(record != nullptr);
 
+  Thaw();
+
   RecordPtr new_record = new Record<RecordType>(range);
   records_.insert(std::make_pair(range.start(), new_record));
 
@@ -365,6 +440,11 @@ void ProcessState::Layer<RecordType>::GetRecordsSpanning(
 
   records->clear();
 
+  if (frozen_) {
+    GetIndexedRecords(0U, index_.size(), range.start(), range.end(), records);
+    return;
+  }
+
   for (const auto& entry : records_) {
     AddressRange record_range = entry.second->range();
     DCHECK(record_range.IsValid());
@@ -385,6 +465,14 @@ void ProcessState::Layer<RecordType>::GetRecordsIntersecting(
 
   records->clear();
 
+  if (frozen_) {
+    // The ranges are valid so not empty: a record intersects the range if it
+    // starts before its end, and ends after its start.
+    GetIndexedRecords(0U, index_.size(), range.end() - 1, range.start() + 1,
+                      records);
+    return;
+  }
+
   for (const auto& entry : records_) {
     AddressRange record_range = entry.second->range();
     DCHECK(record_range.IsValid());
@@ -402,6 +490,7 @@ bool ProcessState::Layer<RecordType>::RemoveRecord(const RecordPtr& record) {
   auto matches = records_.equal_range(record->range().start());
   for (auto it = matches.first; it != matches.second; ++it) {
     if (it->second.get() == record.get()) {
+      Thaw();
       records_.erase(it);
       return true;
     }
@@ -410,6 +499,72 @@ bool ProcessState::Layer<RecordType>::RemoveRecord(const RecordPtr& record) {
   return false;
 }
 
+template <typename RecordType>
+void ProcessState::Layer<RecordType>::Freeze() {
+  if (frozen_)
+    return;
+
+  index_.reserve(records_.size());
+  for (const auto& entry : records_)
+    index_.push_back(entry.second);
+  max_ends_.resize(index_.size());
+  BuildIndex(0U, index_.size());
+
+  frozen_ = true;
+}
+
+template <typename RecordType>
+void ProcessState::Layer<RecordType>::Thaw() {
+  if (!frozen_)
+    return;
+
+  frozen_ = false;
+  std::vector<RecordPtr>().swap(index_);
+  std::vector<Address>().swap(max_ends_);
+}
+
+template <typename RecordType>
+Address ProcessState::Layer<RecordType>::BuildIndex(size_t begin,
+                                                    size_t end) {
+  if (begin == end)
+    return 0U;
+
+  size_t root = begin + (end - begin) / 2;
+  Address max_end = index_[root]->range().end();
+  max_end = std::max(max_end, BuildIndex(begin, root));
+  max_end = std::max(max_end, BuildIndex(root + 1, end));
+  max_ends_[root] = max_end;
+  return max_end;
+}
+
+template <typename RecordType>
+void ProcessState::Layer<RecordType>::GetIndexedRecords(
+    size_t begin,
+    size_t end,
+    Address max_start,
+    Address min_end,
+    std::vector<RecordPtr>* records) const {
+  DCHECK(records != nullptr);
+
+  // Visit the subtrees in order, skipping those that end too early.
+  while (begin != end) {
+    size_t root = begin + (end - begin) / 2;
+    if (max_ends_[root] < min_end)
+      return;
+
+    GetIndexedRecords(begin, root, max_start, min_end, records);
+
+    // This record and the right subtree start too late.
+    const RecordPtr& record = index_[root];
+    if (record->range().start() > max_start)
+      return;
+    if (record->range().end() >= min_end)
+      records->push_back(record);
+
+    begin = root + 1;
+  }
+}
+
 }  // namespace refinery
 
 #endif  // SYZYGY_REFINERY_PROCESS_STATE_PROCESS_STATE_H_
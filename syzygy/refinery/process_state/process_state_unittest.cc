@@ -17,6 +17,7 @@
 #include <limits>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "base/strings/string_piece.h"
 #include "gtest/gtest.h"
@@ -403,6 +404,92 @@ TEST(ProcessStateTest, RemoveRecord) {
   ASSERT_FALSE(bytes_layer->RemoveRecord(record));
 }
 
+TEST(ProcessStateTest, FrozenLayerLookups) {
+  ProcessState report;
+  BytesLayerPtr bytes_layer;
+  report.FindOrCreateLayer(&bytes_layer);
+
+  // Nested, overlapping and disjoint records, including one that spans them
+  // all and two at the same range.
+  BytesRecordPtr record;
+  bytes_layer->CreateRecord(AddressRange(0ULL, 1000U), &record);
+  for (Address addr = 100ULL; addr < 900ULL; addr += 40ULL) {
+    bytes_layer->CreateRecord(AddressRange(addr, 10U), &record);
+    bytes_layer->CreateRecord(AddressRange(addr + 5ULL, 60U), &record);
+  }
+  bytes_layer->CreateRecord(AddressRange(500ULL, 10U), &record);
+  bytes_layer->CreateRecord(AddressRange(2000ULL, 10U), &record);
+
+  std::vector<AddressRange> ranges;
+  for (Address addr = 0ULL; addr < 2100ULL; addr += 7ULL) {
+    ranges.push_back(AddressRange(addr, 1U));
+    ranges.push_back(AddressRange(addr, 30U));
+  }
+
+  // Get the records with and without the index.
+  std::vector<std::vector<BytesRecordPtr>> spanning(ranges.size());
+  std::vector<std::vector<BytesRecordPtr>> intersecting(ranges.size());
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    bytes_layer->GetRecordsSpanning(ranges[i], &spanning[i]);
+    bytes_layer->GetRecordsIntersecting(ranges[i], &intersecting[i]);
+  }
+
+  ASSERT_FALSE(bytes_layer->frozen());
+  bytes_layer->Freeze();
+  ASSERT_TRUE(bytes_layer->frozen());
+
+  std::vector<BytesRecordPtr> matching_records;
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    bytes_layer->GetRecordsSpanning(ranges[i], &matching_records);
+    EXPECT_EQ(spanning[i], matching_records);
+    bytes_layer->GetRecordsIntersecting(ranges[i], &matching_records);
+    EXPECT_EQ(intersecting[i], matching_records);
+  }
+}
+
+TEST(ProcessStateTest, ModifyingLayerThaws) {
+  ProcessState report;
+  BytesLayerPtr bytes_layer;
+  report.FindOrCreateLayer(&bytes_layer);
+  bytes_layer->Freeze();
+
+  BytesRecordPtr record;
+  bytes_layer->CreateRecord(AddressRange(80ULL, 16U), &record);
+  EXPECT_FALSE(bytes_layer->frozen());
+
+  std::vector<BytesRecordPtr> matching_records;
+  bytes_layer->Freeze();
+  bytes_layer->GetRecordsIntersecting(AddressRange(90ULL, 4U),
+                                      &matching_records);
+  EXPECT_EQ(1U, matching_records.size());
+
+  ASSERT_TRUE(bytes_layer->RemoveRecord(record));
+  EXPECT_FALSE(bytes_layer->frozen());
+  bytes_layer->GetRecordsIntersecting(AddressRange(90ULL, 4U),
+                                      &matching_records);
+  EXPECT_TRUE(matching_records.empty());
+}
+
+TEST(ProcessStateTest, FreezeLayers) {
+  ProcessState report;
+  BytesLayerPtr bytes_layer;
+  report.FindOrCreateLayer(&bytes_layer);
+  ModuleLayerPtr module_layer;
+  report.FindOrCreateLayer(&module_layer);
+
+  // Freezing a layer that doesn't exist has no effect.
+  report.FreezeLayer(ProcessState::StackLayer);
+  StackLayerPtr stack_layer;
+  EXPECT_FALSE(report.FindLayer(&stack_layer));
+
+  report.FreezeLayer(ProcessState::BytesLayer);
+  EXPECT_TRUE(bytes_layer->frozen());
+  EXPECT_FALSE(module_layer->frozen());
+
+  report.FreezeLayers();
+  EXPECT_TRUE(module_layer->frozen());
+}
+
 TEST(ProcessStateTest, LayerIteration) {
   // Create a report that has a Bytes layer with few records.
   ProcessState report;
@@ -60,11 +60,13 @@
         'process_state/layer_data_unittest.cc',
         'process_state/process_state_unittest.cc',
         'process_state/process_state_util_unittest.cc',
+        'symbols/dia_symbol_provider_unittest.cc',
         'symbols/simple_cache_unittest.cc',
         'symbols/symbol_provider_unittest.cc',
         'symbols/symbol_provider_util_unittest.cc',
         'types/type_unittest.cc',
         'types/type_repository_unittest.cc',
+        'types/type_repository_serialization_unittest.cc',
         'types/typed_data_unittest.cc',
         'types/dia_crawler_unittest.cc',
         'types/pdb_crawler_unittest.cc',
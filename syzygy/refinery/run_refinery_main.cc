@@ -112,15 +112,16 @@ int main(int argc, const char* const* argv) {
   if (!ParseCommandLine(base::CommandLine::ForCurrentProcess(), &dump_path))
     return 1;
 
-  minidump::FileMinidump minidump;
-  if (!minidump.Open(dump_path)) {
+  std::unique_ptr<minidump::Minidump> minidump =
+      minidump::OpenMinidump(dump_path);
+  if (!minidump) {
     LOG(ERROR) << "Unable to open dump file.";
     return 1;
   }
 
   // Analyze.
   ProcessState process_state;
-  if (!Analyze(minidump, &process_state))
+  if (!Analyze(*minidump, &process_state))
     return 1;
 
   // Validate and output.
@@ -24,7 +24,9 @@
 
 namespace refinery {
 
-DiaSymbolProvider::DiaSymbolProvider() {
+DiaSymbolProvider::DiaSymbolProvider()
+    : idle_timeout_(
+          base::TimeDelta::FromSeconds(kDefaultIdleTimeoutInSeconds)) {
 }
 
 DiaSymbolProvider::~DiaSymbolProvider() {
@@ -58,6 +60,16 @@ bool DiaSymbolProvider::GetVFTableRVAs(
   return crawler.GetVFTableRVAs(vftable_rvas);
 }
 
+size_t DiaSymbolProvider::EvictIdleSessions(base::TimeDelta max_idle_time) {
+  base::AutoLock auto_lock(lock_);
+  return EvictIdleSessionsLocked(base::TimeTicks::Now(), max_idle_time);
+}
+
+size_t DiaSymbolProvider::session_count() {
+  base::AutoLock auto_lock(lock_);
+  return sessions_.size();
+}
+
 void DiaSymbolProvider::GetCacheKey(const pe::PEFile::Signature& signature,
                                     base::string16* cache_key) {
   DCHECK(cache_key);
@@ -78,50 +90,84 @@ bool DiaSymbolProvider::GetOrLoad(
 
   base::string16 cache_key;
   GetCacheKey(signature, &cache_key);
+  SessionKey session_key(cache_key, base::PlatformThread::CurrentId());
 
-  // Look for a pre-existing entry.
-  auto session_it = pdb_sessions_.find(cache_key);
-  if (session_it != pdb_sessions_.end()) {
-    if (session_it->second == nullptr)
-      return false;  // Negative cache entry.
-
-    auto source_it = pdb_sources_.find(cache_key);
-    // Consistency validation: if there's a session, there should be a source.
-    DCHECK(source_it != pdb_sources_.end());
-    DCHECK(session_it->second.get() != nullptr);
-
-    *source = source_it->second;
-    *session = session_it->second;
-    return true;
-  }
-
-  // The module is not in the cache. Create negative cache entries, which will
-  // be replaced on success.
-  pdb_sources_[cache_key] = base::win::ScopedComPtr<IDiaDataSource>();
-  pdb_sessions_[cache_key] = base::win::ScopedComPtr<IDiaSession>();
-
-  // Attempt to create a dia session for the module.
   base::FilePath pdb_path;
-  if (!GetPdbPath(signature, &pdb_path))
-    return false;
+  {
+    base::AutoLock auto_lock(lock_);
+
+    // Look for a pre-existing session of this thread.
+    auto session_it = sessions_.find(session_key);
+    if (session_it != sessions_.end()) {
+      DCHECK(session_it->second.source.get() != nullptr);
+      DCHECK(session_it->second.session.get() != nullptr);
+      session_it->second.last_use = base::TimeTicks::Now();
+      *source = session_it->second.source;
+      *session = session_it->second.session;
+      return true;
+    }
+
+    // Look for the pdb's path, which is shared by all the threads.
+    auto path_it = pdb_paths_.find(cache_key);
+    if (path_it != pdb_paths_.end()) {
+      if (path_it->second.empty())
+        return false;  // Negative cache entry.
+      pdb_path = path_it->second;
+    } else {
+      // The module is not in the cache. Create a negative cache entry, which
+      // will be replaced on success.
+      pdb_paths_[cache_key] = base::FilePath();
+      if (!GetPdbPath(signature, &pdb_path))
+        return false;
+      pdb_paths_[cache_key] = pdb_path;
+    }
+  }
 
-  // Get a source for the pdb.
+  // The session is created without holding the lock, as loading a pdb is slow
+  // and no other thread creates sessions for this thread.
   base::win::ScopedComPtr<IDiaDataSource> pdb_source;
   if (!pe::CreateDiaSource(pdb_source.Receive()))
     return false;
 
-  // Get the session.
   base::win::ScopedComPtr<IDiaSession> pdb_session;
-  if (!pe::CreateDiaSession(pdb_path, pdb_source.get(), pdb_session.Receive()))
+  if (!pe::CreateDiaSession(pdb_path, pdb_source.get(),
+                            pdb_session.Receive())) {
+    base::AutoLock auto_lock(lock_);
+    pdb_paths_[cache_key] = base::FilePath();
     return false;
+  }
 
-  // Cache source and session.
-  pdb_sources_[cache_key] = pdb_source;
-  pdb_sessions_[cache_key] = pdb_session;
+  // Pool the session, and take the opportunity to evict the idle ones.
+  base::AutoLock auto_lock(lock_);
+  base::TimeTicks now = base::TimeTicks::Now();
+  EvictIdleSessionsLocked(now, idle_timeout_);
+  PooledSession& pooled_session = sessions_[session_key];
+  DCHECK(pooled_session.session.get() == nullptr);
+  pooled_session.source = pdb_source;
+  pooled_session.session = pdb_session;
+  pooled_session.last_use = now;
 
   *source = pdb_source;
   *session = pdb_session;
   return true;
 }
 
+size_t DiaSymbolProvider::EvictIdleSessionsLocked(
+    base::TimeTicks now,
+    base::TimeDelta max_idle_time) {
+  lock_.AssertAcquired();
+
+  size_t evicted = 0;
+  auto it = sessions_.begin();
+  while (it != sessions_.end()) {
+    if (now - it->second.last_use >= max_idle_time) {
+      it = sessions_.erase(it);
+      ++evicted;
+    } else {
+      ++it;
+    }
+  }
+  return evicted;
+}
+
 }  // namespace refinery
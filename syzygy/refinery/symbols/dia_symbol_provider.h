@@ -17,10 +17,16 @@
 
 #include <dia2.h>
 
+#include <map>
+#include <utility>
+
 #include "base/macros.h"
 #include "base/containers/hash_tables.h"
 #include "base/memory/ref_counted.h"
 #include "base/strings/string16.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/platform_thread.h"
+#include "base/time/time.h"
 #include "base/win/scoped_comptr.h"
 #include "syzygy/pe/pe_file.h"
 #include "syzygy/refinery/core/address.h"
@@ -28,19 +34,28 @@
 namespace refinery {
 
 // The DiaSymbolProvider provides symbol information via the DIA interfaces.
+// DIA sessions are not safe for concurrent use, so the provider pools them:
+// each thread gets its own session for a given PDB, which is created the first
+// time the thread asks for it and evicted once it's been idle for a while.
+// This lets several threads analyze the same modules at once.
 // @note It is *not* safe to interleave access to a session in the context of
 //     different process states, as the session's load address may be different.
+// @note A session must only be used on the thread it was handed out to.
 // @note use of virtual is to allow mocking.
 // TODO(manzagop): this class should share an interface with SymbolProvider, for
 // providing type repositories. This would enable replacing one implementation
 // for the other and possibly sharing some implementation.
-class DiaSymbolProvider : public base::RefCounted<DiaSymbolProvider> {
+class DiaSymbolProvider
+    : public base::RefCountedThreadSafe<DiaSymbolProvider> {
  public:
+  // The default time after which an idle session is evicted.
+  static const int kDefaultIdleTimeoutInSeconds = 300;
+
   DiaSymbolProvider();
   virtual ~DiaSymbolProvider();
 
   // Retrieves or creates an IDiaSession for the module corresponding to @p
-  // signature.
+  // signature, for use on the calling thread.
   // @note on success, the session's load address is not set.
   // @param signature the signature of the module for which to get a session.
   // @param session on success, returns a session for the module. On failure,
@@ -58,7 +73,37 @@ class DiaSymbolProvider : public base::RefCounted<DiaSymbolProvider> {
   virtual bool GetVFTableRVAs(const pe::PEFile::Signature& signature,
                               base::hash_set<RelativeAddress>* vftable_rvas);
 
+  // Releases the pooled sessions that haven't been handed out for longer than
+  // @p max_idle_time. The sessions that are still referenced by their users
+  // stay alive until they're released.
+  // @param max_idle_time the idle time after which a session is evicted.
+  // @returns the number of evicted sessions.
+  size_t EvictIdleSessions(base::TimeDelta max_idle_time);
+
+  // @name Accessors and mutators.
+  // @{
+  // The idle sessions are evicted whenever a session is created.
+  base::TimeDelta idle_timeout() const { return idle_timeout_; }
+  void set_idle_timeout(base::TimeDelta idle_timeout) {
+    idle_timeout_ = idle_timeout;
+  }
+  // @returns the number of pooled sessions.
+  size_t session_count();
+  // @}
+
  private:
+  // A pooled session, and the source it was opened from.
+  struct PooledSession {
+    base::win::ScopedComPtr<IDiaDataSource> source;
+    base::win::ScopedComPtr<IDiaSession> session;
+    base::TimeTicks last_use;
+  };
+
+  // The sessions are keyed by the cache key of their module and the thread
+  // they belong to.
+  typedef std::pair<base::string16, base::PlatformThreadId> SessionKey;
+  typedef std::map<SessionKey, PooledSession> SessionMap;
+
   // TODO(manzagop): this function is duplicated in SymbolProvider. It should
   // likely be extracted to a cross-platform Signature class.
   static void GetCacheKey(const pe::PEFile::Signature& signature,
@@ -68,16 +113,24 @@ class DiaSymbolProvider : public base::RefCounted<DiaSymbolProvider> {
                  base::win::ScopedComPtr<IDiaDataSource>* source,
                  base::win::ScopedComPtr<IDiaSession>* session);
 
-  // Caching for dia pdb file sources and sessions (matching entries). The cache
-  // key is "<basename>:<size>:<checksum>:<timestamp>". The cache may contain
-  // negative entries (indicating a failed attempt at creating a session) in the
-  // form of null pointers.
-  // The caches must be consistent: the presence of a valid source implies the
-  // presence of a valid session, and vice versa.
-  std::unordered_map<base::string16, base::win::ScopedComPtr<IDiaDataSource>>
-      pdb_sources_;
-  std::unordered_map<base::string16, base::win::ScopedComPtr<IDiaSession>>
-      pdb_sessions_;
+  // Evicts the idle sessions. The lock must be held.
+  size_t EvictIdleSessionsLocked(base::TimeTicks now,
+                                 base::TimeDelta max_idle_time);
+
+  // Caching for the paths of the pdb files. The cache key is
+  // "<basename>:<size>:<checksum>:<timestamp>". The cache may contain
+  // negative entries (indicating a failed attempt at finding a pdb or at
+  // creating a session for it) in the form of empty paths.
+  std::unordered_map<base::string16, base::FilePath> pdb_paths_;
+
+  // The pool of sessions. It only holds sessions for pdbs with a valid path.
+  SessionMap sessions_;
+
+  // The time after which an idle session is evicted.
+  base::TimeDelta idle_timeout_;
+
+  // Protects the caches, which may be used by several analyzers at once.
+  base::Lock lock_;
 
   DISALLOW_COPY_AND_ASSIGN(DiaSymbolProvider);
 };
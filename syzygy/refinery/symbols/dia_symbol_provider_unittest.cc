@@ -0,0 +1,124 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/refinery/symbols/dia_symbol_provider.h"
+
+#include "base/files/file_path.h"
+#include "base/threading/simple_thread.h"
+#include "base/win/scoped_com_initializer.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pe/pe_file.h"
+
+namespace refinery {
+
+namespace {
+
+// Gets a session on a thread of its own.
+class SessionGetter : public base::DelegateSimpleThread::Delegate {
+ public:
+  SessionGetter(DiaSymbolProvider* provider,
+                const pe::PEFile::Signature& signature)
+      : provider_(provider), signature_(signature), session_(nullptr),
+        succeeded_(false) {
+  }
+
+  void Run() override {
+    base::win::ScopedCOMInitializer com_initializer;
+    base::win::ScopedComPtr<IDiaSession> session;
+    succeeded_ = provider_->FindOrCreateDiaSession(signature_, &session);
+    session_ = session.get();
+  }
+
+  // @returns the session that was handed out to the thread. It must only be
+  //     compared, as it belongs to that thread.
+  IDiaSession* session() const { return session_; }
+  bool succeeded() const { return succeeded_; }
+
+ private:
+  DiaSymbolProvider* provider_;
+  pe::PEFile::Signature signature_;
+  IDiaSession* session_;
+  bool succeeded_;
+};
+
+class DiaSymbolProviderTest : public testing::Test {
+ public:
+  void SetUp() override {
+    // Get the signature for test_types.dll.
+    const base::FilePath module_path(testing::GetSrcRelativePath(
+        L"syzygy\\refinery\\test_data\\test_types.dll"));
+    pe::PEFile pe_file;
+    ASSERT_TRUE(pe_file.Init(module_path));
+    pe_file.GetSignature(&signature_);
+
+    provider_ = new DiaSymbolProvider();
+  }
+
+ protected:
+  base::win::ScopedCOMInitializer com_initializer_;
+  pe::PEFile::Signature signature_;
+  scoped_refptr<DiaSymbolProvider> provider_;
+};
+
+}  // namespace
+
+TEST_F(DiaSymbolProviderTest, FindOrCreateDiaSession) {
+  base::win::ScopedComPtr<IDiaSession> session;
+  ASSERT_TRUE(provider_->FindOrCreateDiaSession(signature_, &session));
+  ASSERT_TRUE(session.get() != nullptr);
+  EXPECT_EQ(1U, provider_->session_count());
+
+  // A second call on the same thread retrieves the same session.
+  base::win::ScopedComPtr<IDiaSession> second_session;
+  ASSERT_TRUE(provider_->FindOrCreateDiaSession(signature_, &second_session));
+  EXPECT_EQ(session.get(), second_session.get());
+  EXPECT_EQ(1U, provider_->session_count());
+}
+
+TEST_F(DiaSymbolProviderTest, SessionsAreThreadAffine) {
+  base::win::ScopedComPtr<IDiaSession> session;
+  ASSERT_TRUE(provider_->FindOrCreateDiaSession(signature_, &session));
+
+  // Another thread gets a session of its own for the same module.
+  SessionGetter getter(provider_.get(), signature_);
+  base::DelegateSimpleThread thread(&getter, "SessionGetter");
+  thread.Start();
+  thread.Join();
+  ASSERT_TRUE(getter.succeeded());
+  EXPECT_TRUE(getter.session() != nullptr);
+  EXPECT_NE(session.get(), getter.session());
+  EXPECT_EQ(2U, provider_->session_count());
+}
+
+TEST_F(DiaSymbolProviderTest, EvictIdleSessions) {
+  base::win::ScopedComPtr<IDiaSession> session;
+  ASSERT_TRUE(provider_->FindOrCreateDiaSession(signature_, &session));
+
+  // The session was just used.
+  EXPECT_EQ(0U, provider_->EvictIdleSessions(base::TimeDelta::FromHours(1)));
+  EXPECT_EQ(1U, provider_->session_count());
+
+  EXPECT_EQ(1U, provider_->EvictIdleSessions(base::TimeDelta()));
+  EXPECT_EQ(0U, provider_->session_count());
+
+  // The session that was handed out remains valid, and a new one is created
+  // for the thread.
+  base::win::ScopedComPtr<IDiaSession> new_session;
+  ASSERT_TRUE(provider_->FindOrCreateDiaSession(signature_, &new_session));
+  EXPECT_NE(session.get(), new_session.get());
+  EXPECT_EQ(1U, provider_->session_count());
+}
+
+}  // namespace refinery
@@ -14,14 +14,27 @@
 
 #include "syzygy/refinery/symbols/symbol_provider.h"
 
+#include <iterator>
+#include <vector>
+
 #include "base/bind.h"
+#include "base/files/file_util.h"
+#include "base/files/memory_mapped_file.h"
 #include "base/strings/stringprintf.h"
+#include "syzygy/core/serialization.h"
 #include "syzygy/refinery/symbols/symbol_provider_util.h"
 #include "syzygy/refinery/types/pdb_crawler.h"
+#include "syzygy/refinery/types/type_repository_serialization.h"
 
 namespace refinery {
 
-SymbolProvider::SymbolProvider() {
+namespace {
+
+const wchar_t kTypeRepositoryCacheExtension[] = L".types";
+
+}  // namespace
+
+SymbolProvider::SymbolProvider() : lazy_types_(false) {
 }
 
 SymbolProvider::~SymbolProvider() {
@@ -39,6 +52,7 @@ bool SymbolProvider::FindOrCreateTypeRepository(
   SimpleCache<TypeRepository>::LoadingCallback load_cb = base::Bind(
       &SymbolProvider::CreateTypeRepository, base::Unretained(this), signature);
 
+  base::AutoLock auto_lock(type_repos_lock_);
   type_repos_.GetOrLoad(cache_key, load_cb, type_repo);
   return type_repo->get() != nullptr;
 }
@@ -55,6 +69,7 @@ bool SymbolProvider::FindOrCreateTypeNameIndex(
   SimpleCache<TypeNameIndex>::LoadingCallback load_cb = base::Bind(
       &SymbolProvider::CreateTypeNameIndex, base::Unretained(this), signature);
 
+  base::AutoLock auto_lock(typename_indices_lock_);
   typename_indices_.GetOrLoad(cache_key, load_cb, typename_index);
   return typename_index->get() != nullptr;
 }
@@ -76,6 +91,70 @@ bool SymbolProvider::GetVFTableRVAs(
   return crawler.GetVFTableRVAs(vftable_rvas);
 }
 
+base::FilePath SymbolProvider::GetCachePath(
+    const pe::PEFile::Signature& signature,
+    const base::FilePath& cache_dir) {
+  // The entries are grouped by module, and named after the signature without
+  // the base address, like the in-memory cache keys.
+  base::FilePath module_name = base::FilePath(signature.path).BaseName();
+  base::string16 name = base::StringPrintf(
+      L"%08X%X%08X%ls", signature.module_time_date_stamp,
+      signature.module_size, signature.module_checksum,
+      kTypeRepositoryCacheExtension);
+  return cache_dir.Append(module_name).Append(name);
+}
+
+bool SymbolProvider::LoadTypeRepositoryFromCache(
+    const base::FilePath& cache_path,
+    scoped_refptr<TypeRepository>* type_repo) {
+  DCHECK(type_repo);
+
+  // The entry is mapped rather than read, as it may be large.
+  base::MemoryMappedFile mapped_file;
+  if (!base::PathExists(cache_path) || !mapped_file.Initialize(cache_path))
+    return false;
+
+  core::ScopedInStreamPtr in_stream(core::CreateByteInStream(
+      mapped_file.data(), mapped_file.data() + mapped_file.length()));
+  core::InArchive in_archive(in_stream.get());
+  if (!LoadTypeRepository(&in_archive, type_repo)) {
+    LOG(WARNING) << "Ignoring invalid type cache entry "
+                 << cache_path.value() << ".";
+    return false;
+  }
+
+  return true;
+}
+
+bool SymbolProvider::SaveTypeRepositoryToCache(
+    const base::FilePath& cache_path,
+    const TypeRepository& type_repo) {
+  std::vector<uint8_t> contents;
+  core::ScopedOutStreamPtr out_stream(
+      core::CreateByteOutStream(std::back_inserter(contents)));
+  core::OutArchive out_archive(out_stream.get());
+  if (!SaveTypeRepository(type_repo, &out_archive))
+    return false;
+
+  // Write to a temporary file and move it in place, so that the concurrent
+  // readers never see an incomplete entry.
+  base::FilePath dir = cache_path.DirName();
+  base::FilePath temp_path;
+  if (!base::CreateDirectory(dir) ||
+      !base::CreateTemporaryFileInDir(dir, &temp_path)) {
+    return false;
+  }
+  int size = static_cast<int>(contents.size());
+  if (base::WriteFile(temp_path, reinterpret_cast<const char*>(
+          contents.data()), size) != size ||
+      !base::ReplaceFile(temp_path, cache_path, nullptr)) {
+    base::DeleteFile(temp_path, false);
+    return false;
+  }
+
+  return true;
+}
+
 void SymbolProvider::GetCacheKey(const pe::PEFile::Signature& signature,
                                  base::string16* cache_key) {
   DCHECK(cache_key);
@@ -92,15 +171,38 @@ bool SymbolProvider::CreateTypeRepository(
   DCHECK(type_repo);
   *type_repo = nullptr;
 
+  base::FilePath cache_path;
+  if (!cache_dir_.empty()) {
+    cache_path = GetCachePath(signature, cache_dir_);
+    if (LoadTypeRepositoryFromCache(cache_path, type_repo))
+      return true;
+  }
+
   base::FilePath pdb_path;
   if (!GetPdbPath(signature, &pdb_path))
     return false;
 
-  scoped_refptr<TypeRepository> repository = new TypeRepository();
   PdbCrawler crawler;
-  if (!crawler.InitializeForFile(pdb_path) ||
-      !crawler.GetTypes(repository.get())) {
+  if (!crawler.InitializeForFile(pdb_path))
     return false;
+
+  // The cache entries hold all of the types, so the repository is only
+  // loaded lazily when there's no cache.
+  scoped_refptr<TypeRepository> repository;
+  if (lazy_types_ && cache_path.empty()) {
+    if (!crawler.GetLazyTypes(&repository))
+      return false;
+  } else {
+    repository = new TypeRepository();
+    if (!crawler.GetTypes(repository.get()))
+      return false;
+  }
+
+  // A failure to cache the repository only costs a crawl next time.
+  if (!cache_path.empty() &&
+      !SaveTypeRepositoryToCache(cache_path, *repository)) {
+    LOG(WARNING) << "Unable to cache the types in " << cache_path.value()
+                 << ".";
   }
 
   *type_repo = repository;
@@ -115,6 +217,10 @@ bool SymbolProvider::CreateTypeNameIndex(const pe::PEFile::Signature& signature,
   if (!FindOrCreateTypeRepository(signature, &repository))
     return false;
 
+  // Indexing the types by name requires all of them.
+  if (!repository->LoadAllTypes())
+    return false;
+
   *index = new TypeNameIndex(repository);
   return true;
 }
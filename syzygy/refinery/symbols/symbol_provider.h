@@ -19,8 +19,10 @@
 
 #include "base/macros.h"
 #include "base/containers/hash_tables.h"
+#include "base/files/file_path.h"
 #include "base/memory/ref_counted.h"
 #include "base/strings/string16.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/pe/pe_file.h"
 #include "syzygy/refinery/core/address.h"
 #include "syzygy/refinery/symbols/simple_cache.h"
@@ -30,7 +32,11 @@ namespace refinery {
 
 // The SymbolProvider provides symbol information. See DiaSymbolProvider for an
 // alternative.
-class SymbolProvider : public base::RefCounted<SymbolProvider> {
+// The type repositories are crawled from the PDBs, which is expensive. They
+// can be cached on disk, keyed by module signature, so that the analyses of
+// minidumps of the same build skip the crawl. The cache may be shared by
+// several processes.
+class SymbolProvider : public base::RefCountedThreadSafe<SymbolProvider> {
  public:
   SymbolProvider();
   // @note virtual to enable mocking.
@@ -66,11 +72,56 @@ class SymbolProvider : public base::RefCounted<SymbolProvider> {
   virtual bool GetVFTableRVAs(const pe::PEFile::Signature& signature,
                               base::hash_set<RelativeAddress>* vftable_rvas);
 
+  // Sets the directory of the type repository cache. An empty path, the
+  // default, disables the cache.
+  // @param cache_dir the directory of the cache.
+  void set_cache_dir(const base::FilePath& cache_dir) {
+    cache_dir_ = cache_dir;
+  }
+
+  // @returns the directory of the type repository cache, or an empty path if
+  //     the cache is disabled.
+  const base::FilePath& cache_dir() const { return cache_dir_; }
+
+  // Sets whether the types of the type repositories are loaded on demand
+  // rather than all at once. This is ignored when the cache is enabled, as its
+  // entries hold all of the types. Type name indices always load all of the
+  // types of their repository.
+  // @param lazy_types true to load the types on demand.
+  void set_lazy_types(bool lazy_types) { lazy_types_ = lazy_types; }
+  bool lazy_types() const { return lazy_types_; }
+
+  // @name Used for the type repository cache. Exposed for unittesting.
+  // @{
+  // Gets the path of the cache entry of a module.
+  // @param signature the signature of the module.
+  // @param cache_dir the directory of the cache.
+  // @returns the path of the cache entry.
+  static base::FilePath GetCachePath(const pe::PEFile::Signature& signature,
+                                     const base::FilePath& cache_dir);
+  // Loads a type repository from the cache.
+  // @param cache_path the path of the cache entry.
+  // @param type_repo on success, receives the repository.
+  // @returns true on success, false if the entry is missing or corrupt.
+  static bool LoadTypeRepositoryFromCache(
+      const base::FilePath& cache_path,
+      scoped_refptr<TypeRepository>* type_repo);
+  // Adds a type repository to the cache. The entry is written to a temporary
+  // file that is then moved in place, so that concurrent readers never see a
+  // partial entry.
+  // @param cache_path the path of the cache entry.
+  // @param type_repo the repository to cache.
+  // @returns true on success, false otherwise.
+  static bool SaveTypeRepositoryToCache(const base::FilePath& cache_path,
+                                        const TypeRepository& type_repo);
+  // @}
+
  private:
   static void GetCacheKey(const pe::PEFile::Signature& signature,
                           base::string16* cache_key);
 
-  // Creates a type repository (without caching it).
+  // Creates a type repository (without caching it in memory). The repository
+  // is loaded from the disk cache if possible, and added to it otherwise.
   bool CreateTypeRepository(const pe::PEFile::Signature& signature,
                             scoped_refptr<TypeRepository>* type_repo);
 
@@ -82,9 +133,20 @@ class SymbolProvider : public base::RefCounted<SymbolProvider> {
   // "<basename>:<size>:<checksum>:<timestamp>". The caches may contain
   // negative entries (indicating a failed attempt at creating a session) in the
   // form of null pointers.
+  // The caches may be used by several analyzers at once, and each has its own
+  // lock. Loading a type name index loads the type repository it indexes, so
+  // typename_indices_lock_ is always acquired before type_repos_lock_.
+  base::Lock type_repos_lock_;
   SimpleCache<TypeRepository> type_repos_;
+  base::Lock typename_indices_lock_;
   SimpleCache<TypeNameIndex> typename_indices_;
 
+  // The directory of the type repository cache, or an empty path.
+  base::FilePath cache_dir_;
+
+  // Whether the types of the repositories are loaded on demand.
+  bool lazy_types_;
+
   DISALLOW_COPY_AND_ASSIGN(SymbolProvider);
 };
 
@@ -18,6 +18,8 @@
 #include <vector>
 
 #include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
 #include "base/strings/utf_string_conversions.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
@@ -86,4 +88,57 @@ TEST(SymbolProviderTest, FindOrCreateTypeNameIndex) {
   ASSERT_EQ(1, matching_types.size());
 }
 
+TEST(SymbolProviderTest, TypeRepositoryCache) {
+  base::ScopedTempDir cache_dir;
+  ASSERT_TRUE(cache_dir.CreateUniqueTempDir());
+
+  const base::FilePath module_path(testing::GetSrcRelativePath(
+      L"syzygy\\refinery\\test_data\\test_types.dll"));
+  pe::PEFile pe_file;
+  ASSERT_TRUE(pe_file.Init(module_path));
+  pe::PEFile::Signature module_signature;
+  pe_file.GetSignature(&module_signature);
+
+  // The first provider crawls the types and caches them.
+  scoped_refptr<SymbolProvider> provider = new SymbolProvider();
+  provider->set_cache_dir(cache_dir.path());
+  scoped_refptr<TypeRepository> repository;
+  ASSERT_TRUE(
+      provider->FindOrCreateTypeRepository(module_signature, &repository));
+  base::FilePath cache_path =
+      SymbolProvider::GetCachePath(module_signature, cache_dir.path());
+  EXPECT_TRUE(base::PathExists(cache_path));
+
+  // Another provider, as in another process, loads them from the cache.
+  scoped_refptr<SymbolProvider> other_provider = new SymbolProvider();
+  other_provider->set_cache_dir(cache_dir.path());
+  scoped_refptr<TypeRepository> cached_repository;
+  ASSERT_TRUE(other_provider->FindOrCreateTypeRepository(module_signature,
+                                                         &cached_repository));
+  EXPECT_NE(repository.get(), cached_repository.get());
+  EXPECT_EQ(repository->size(), cached_repository->size());
+
+  scoped_refptr<TypeNameIndex> index;
+  ASSERT_TRUE(
+      other_provider->FindOrCreateTypeNameIndex(module_signature, &index));
+  std::vector<TypePtr> matching_types;
+  index->GetTypes(L"testing::TestSimpleUDT", &matching_types);
+  EXPECT_EQ(1, matching_types.size());
+}
+
+TEST(SymbolProviderTest, InvalidCacheEntryIsIgnored) {
+  base::ScopedTempDir cache_dir;
+  ASSERT_TRUE(cache_dir.CreateUniqueTempDir());
+  base::FilePath cache_path = cache_dir.path().Append(L"invalid.types");
+  const char kData[] = "not types";
+  ASSERT_EQ(static_cast<int>(sizeof(kData)),
+            base::WriteFile(cache_path, kData, sizeof(kData)));
+
+  scoped_refptr<TypeRepository> repository;
+  EXPECT_FALSE(
+      SymbolProvider::LoadTypeRepositoryFromCache(cache_path, &repository));
+  EXPECT_FALSE(SymbolProvider::LoadTypeRepositoryFromCache(
+      cache_dir.path().Append(L"missing.types"), &repository));
+}
+
 }  // namespace refinery
@@ -45,15 +45,32 @@ namespace cci = Microsoft_Cci_Pdb;
 
 const uint16_t kNoLeafType = static_cast<uint16_t>(-1);
 
-class TypeCreator {
+class TypeCreator : public TypeRepository::Loader {
  public:
-  TypeCreator(TypeRepository* repository, pdb::PdbStream* stream);
-  ~TypeCreator();
+  // @param repository the repository the types are added to. This is nullptr
+  //     for a creator that's the loader of a repository, which is bound to it
+  //     on the first load.
+  TypeCreator(TypeRepository* repository,
+              pdb::PdbStream* stream,
+              pdb::PdbStream* hash_stream);
+  ~TypeCreator() override;
+
+  // Does a first pass through @p stream_ to index its records, which is
+  // needed before creating types.
+  // @returns true on success, false on failure.
+  bool Init();
 
   // Crawls @p stream_, creates all types and assigns names to pointers.
+  // @pre Init must have been called.
   // @returns true on success, false on failure.
   bool CreateTypes();
 
+  // @name TypeRepository::Loader implementation.
+  // @{
+  bool LoadType(TypeId id, TypeRepository* repository) override;
+  bool LoadAllTypes(TypeRepository* repository) override;
+  // @}
+
  private:
   // The following functions parse objects from the data stream.
   // @returns pointer to the created object or nullptr on failure.
@@ -791,9 +808,10 @@ TypePtr TypeCreator::ReadBitfield(TypeId type_id,
   return FindOrCreateBitfieldType(underlying_id, flags);
 }
 
-TypeCreator::TypeCreator(TypeRepository* repository, pdb::PdbStream* stream)
-    : type_info_enum_(stream), repository_(repository) {
-  DCHECK(repository);
+TypeCreator::TypeCreator(TypeRepository* repository,
+                         pdb::PdbStream* stream,
+                         pdb::PdbStream* hash_stream)
+    : type_info_enum_(stream, hash_stream), repository_(repository) {
   DCHECK(stream);
 }
 
@@ -1144,9 +1162,9 @@ TypePtr TypeCreator::CreateWildcardType(TypeId type_id) {
 TypePtr TypeCreator::FindOrCreateTypeImpl(TypeId type_id) {
   TypeId concrete_type_id = LookupConcreteClassForForwardDeclaration(type_id);
   if (concrete_type_id != kNoTypeId)
-    return repository_->GetType(concrete_type_id);
+    return FindType(repository_, concrete_type_id);
 
-  TypePtr type = repository_->GetType(type_id);
+  TypePtr type = FindType(repository_, type_id);
   if (type != nullptr)
     return type;
 
@@ -1385,7 +1403,7 @@ bool TypeCreator::PrepareData() {
   return type_info_enum_.ResetStream();
 }
 
-bool TypeCreator::CreateTypes() {
+bool TypeCreator::Init() {
   if (!type_info_enum_.Init()) {
     LOG(ERROR) << "Unable to initialize type info stream enumerator.";
     return false;
@@ -1398,9 +1416,10 @@ bool TypeCreator::CreateTypes() {
   }
 
   // Create the map of forward declarations and populate the process queue.
-  if (!PrepareData())
-    return false;
+  return PrepareData();
+}
 
+bool TypeCreator::CreateTypes() {
   // Process every important type.
   for (TypeId type_id : records_to_process_) {
     if (FindOrCreateTypeImpl(type_id) == nullptr)
@@ -1410,6 +1429,27 @@ bool TypeCreator::CreateTypes() {
   return true;
 }
 
+bool TypeCreator::LoadType(TypeId id, TypeRepository* repository) {
+  DCHECK(repository);
+  DCHECK(repository_ == nullptr || repository_ == repository);
+  repository_ = repository;
+
+  // The records other than the basic types must be in the stream.
+  if (id >= type_info_enum_.type_info_header().type_min &&
+      types_map_.find(id) == types_map_.end()) {
+    return false;
+  }
+
+  return FindOrCreateTypeImpl(id) != nullptr;
+}
+
+bool TypeCreator::LoadAllTypes(TypeRepository* repository) {
+  DCHECK(repository);
+  DCHECK(repository_ == nullptr || repository_ == repository);
+  repository_ = repository;
+  return CreateTypes();
+}
+
 }  // namespace
 
 PdbCrawler::PdbCrawler() {
@@ -1427,8 +1467,11 @@ bool PdbCrawler::InitializeForFile(const base::FilePath& path) {
     return false;
   }
 
-  // Get the type stream.
+  // Get the type stream, and its hash stream which allows seeking to the
+  // type records.
   tpi_stream_ = pdb_file.GetStream(pdb::kTpiStream);
+  if (tpi_stream_ != nullptr)
+    tpi_hash_stream_ = pdb::GetTypeInfoHashStream(pdb_file, tpi_stream_.get());
 
   // Get the public symbol stream: it has a variable index, found in the Dbi
   // stream.
@@ -1496,9 +1539,25 @@ bool PdbCrawler::GetTypes(TypeRepository* types) {
   DCHECK(types);
   DCHECK(tpi_stream_);
 
-  TypeCreator creator(types, tpi_stream_.get());
+  TypeCreator creator(types, tpi_stream_.get(), tpi_hash_stream_.get());
+
+  return creator.Init() && creator.CreateTypes();
+}
+
+bool PdbCrawler::GetLazyTypes(scoped_refptr<TypeRepository>* types) {
+  DCHECK(types);
+  DCHECK(tpi_stream_);
+  *types = nullptr;
+
+  // The creator keeps the type streams, and is released along with the
+  // repository or once all the types are loaded.
+  std::unique_ptr<TypeCreator> creator(
+      new TypeCreator(nullptr, tpi_stream_.get(), tpi_hash_stream_.get()));
+  if (!creator->Init())
+    return false;
 
-  return creator.CreateTypes();
+  *types = new TypeRepository(std::move(creator));
+  return true;
 }
 
 bool PdbCrawler::GetVFTableRVAForSymbol(
@@ -22,6 +22,7 @@
 
 #include "base/containers/hash_tables.h"
 #include "base/files/file_path.h"
+#include "base/memory/ref_counted.h"
 #include "syzygy/common/binary_stream.h"
 #include "syzygy/pdb/pdb_dbi_stream.h"
 #include "syzygy/pdb/pdb_stream.h"
@@ -53,6 +54,14 @@ class PdbCrawler {
   // @returns true on success, false on failure.
   bool GetTypes(TypeRepository* types);
 
+  // Creates a repository whose types are only crawled when they're first
+  // retrieved by id, along with the types they depend on. This avoids
+  // crawling all of the types when only a few of them are used.
+  // @param types on success, receives the repository. It keeps the type
+  //     streams, and doesn't depend on this instance.
+  // @returns true on success, false on failure.
+  bool GetLazyTypes(scoped_refptr<TypeRepository>* types);
+
   // Retrieves the relative virtual addresses of all virtual function tables.
   // @param vftable_rvas on success contains zero or more relative addresses.
   // @returns true on success, false on failure.
@@ -64,8 +73,10 @@ class PdbCrawler {
                               uint16_t symbol_type,
                               common::BinaryStreamReader* symbol_reader);
 
-  // Pointers to the PDB type and symbol streams.
+  // Pointers to the PDB type and symbol streams, and to the hash stream of
+  // the type stream, which may be null.
   scoped_refptr<pdb::PdbStream> tpi_stream_;
+  scoped_refptr<pdb::PdbStream> tpi_hash_stream_;
   scoped_refptr<pdb::PdbStream> sym_stream_;
 
   // The PE section headers extracted from the pdb.
@@ -827,6 +827,44 @@ TEST_P(PdbCrawlerTest, TestUnion) {
   ValidateBasicType(udt->GetFieldType(1), sizeof(uint32_t), L"uint32_t");
 }
 
+TEST_P(PdbCrawlerTest, TestLazyTypes) {
+  TypePtr type = FindOneTypeBySuffix(L"::TestSimpleUDT");
+  ASSERT_TRUE(type);
+
+  scoped_refptr<TypeRepository> lazy_types;
+  ASSERT_TRUE(crawler_.GetLazyTypes(&lazy_types));
+  ASSERT_TRUE(lazy_types);
+  EXPECT_EQ(0U, lazy_types->size());
+
+  // Retrieving the UDT loads it along with the types of its fields, and with
+  // the same ids as the eagerly loaded types.
+  TypePtr lazy_type = lazy_types->GetType(type->type_id());
+  ASSERT_TRUE(lazy_type);
+  EXPECT_EQ(lazy_types.get(), lazy_type->repository());
+  EXPECT_EQ(type->GetName(), lazy_type->GetName());
+  EXPECT_EQ(type->size(), lazy_type->size());
+  EXPECT_LT(0U, lazy_types->size());
+  EXPECT_GT(types_->size(), lazy_types->size());
+
+  UserDefinedTypePtr udt;
+  ASSERT_TRUE(lazy_type->CastTo(&udt));
+  ASSERT_EQ(6U, udt->fields().size());
+  ValidateBasicType(udt->GetFieldType(0), sizeof(int32_t), L"int32_t");
+
+  // There's no type past the end of the stream.
+  EXPECT_FALSE(lazy_types->GetType(0x7FFFFFFF));
+
+  // Loading all the types gives the same types as the eager crawl.
+  ASSERT_TRUE(lazy_types->LoadAllTypes());
+  EXPECT_EQ(types_->size(), lazy_types->size());
+  for (auto eager_type : *types_) {
+    TypePtr loaded_type = lazy_types->GetType(eager_type->type_id());
+    ASSERT_TRUE(loaded_type);
+    EXPECT_EQ(eager_type->kind(), loaded_type->kind());
+    EXPECT_EQ(eager_type->GetName(), loaded_type->GetName());
+  }
+}
+
 // Run both the 32-bit and 64-bit tests.
 INSTANTIATE_TEST_CASE_P(InstantiateFor32and64,
                         PdbCrawlerTest,
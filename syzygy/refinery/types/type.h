@@ -36,7 +36,7 @@ const wchar_t kUnknownTypeName[] = L"<unknown>";
 
 // A base class for all Type subclasses. Types are owned by a type repository,
 // which can vend out type instances by ID on demand.
-class Type : public base::RefCounted<Type> {
+class Type : public base::RefCountedThreadSafe<Type> {
  public:
   typedef uint8_t Flags;
 
@@ -77,7 +77,7 @@ class Type : public base::RefCounted<Type> {
   bool CastTo(scoped_refptr<const SubType>* out) const;
 
  protected:
-  friend class base::RefCounted<Type>;
+  friend class base::RefCountedThreadSafe<Type>;
 
   Type(TypeKind kind, size_t size);
   virtual ~Type() = 0;
@@ -227,7 +227,8 @@ using ConstUserDefinedTypePtr = scoped_refptr<const UserDefinedType>;
 
 // Represents a field in a user defined type.
 // TODO(manzagop): add virtual base classes?
-class UserDefinedType::Field : public base::RefCounted<UserDefinedType::Field> {
+class UserDefinedType::Field
+    : public base::RefCountedThreadSafe<UserDefinedType::Field> {
  public:
   // The set of field kinds.
   enum FieldKind {
@@ -257,7 +258,7 @@ class UserDefinedType::Field : public base::RefCounted<UserDefinedType::Field> {
   virtual bool IsEqual(const Field& o) const;
 
  protected:
-  friend class base::RefCounted<UserDefinedType::Field>;
+  friend class base::RefCountedThreadSafe<UserDefinedType::Field>;
 
   // Creates a new field.
   // @param kind the kind of the field.
@@ -295,7 +296,7 @@ class UserDefinedType::BaseClassField : public UserDefinedType::Field{
   BaseClassField(ptrdiff_t offset, TypeId type_id, TypeRepository* repository);
 
  private:
-  friend class base::RefCounted<UserDefinedType::Field>;
+  friend class base::RefCountedThreadSafe<UserDefinedType::Field>;
   ~BaseClassField() {}
 
   DISALLOW_COPY_AND_ASSIGN(BaseClassField);
@@ -340,7 +341,7 @@ class UserDefinedType::MemberField : public UserDefinedType::Field {
   bool IsEqual(const Field& o) const override;
 
  private:
-  friend class base::RefCounted<UserDefinedType::Field>;
+  friend class base::RefCountedThreadSafe<UserDefinedType::Field>;
   ~MemberField() {}
 
   const base::string16 name_;
@@ -365,7 +366,7 @@ class UserDefinedType::VfptrField : public UserDefinedType::Field{
   VfptrField(ptrdiff_t offset, TypeId type_id, TypeRepository* repository);
 
  private:
-  friend class base::RefCounted<UserDefinedType::Field>;
+  friend class base::RefCountedThreadSafe<UserDefinedType::Field>;
   ~VfptrField() {}
 
   DISALLOW_COPY_AND_ASSIGN(VfptrField);
@@ -20,6 +20,7 @@
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 #include "syzygy/pe/dia_util.h"
+#include "syzygy/refinery/types/type_repository.h"
 #include "third_party/cci/files/cvinfo.h"
 
 namespace refinery {
@@ -182,6 +183,48 @@ bool TypeNamer::GetName(ConstTypePtr type,
   DCHECK(type);  DCHECK(type_name);
   type_name->clear();
 
+  switch (type->kind()) {
+    case Type::POINTER_TYPE_KIND:
+    case Type::ARRAY_TYPE_KIND:
+    case Type::FUNCTION_TYPE_KIND: {
+      // The names of these types are memoized by their repository, as they're
+      // otherwise recomputed from their constituent types on each request.
+      TypeRepository* repository = type->repository();
+      base::StringPiece16 memoized;
+      if (repository &&
+          repository->FindTypeName(type->type_id(), decorated, &memoized)) {
+        memoized.CopyToString(type_name);
+        return true;
+      }
+
+      if (!GetComposedName(type, decorated, type_name))
+        return false;
+      if (repository)
+        repository->SetTypeName(type->type_id(), decorated, *type_name);
+      return true;
+    }
+    case Type::USER_DEFINED_TYPE_KIND:
+    case Type::BASIC_TYPE_KIND:
+    case Type::GLOBAL_TYPE_KIND:
+    case Type::WILDCARD_TYPE_KIND: {
+      // These types should have their name set up.
+      if (decorated)
+        *type_name = type->GetDecoratedName();
+      else
+        *type_name = type->GetName();
+      return true;
+    }
+    default:
+      DCHECK(false);
+      return false;
+  }
+}
+
+bool TypeNamer::GetComposedName(ConstTypePtr type,
+                                bool decorated,
+                                base::string16* type_name) {
+  DCHECK(type);  DCHECK(type_name);
+
   switch (type->kind()) {
     case Type::POINTER_TYPE_KIND: {
       ConstPointerTypePtr ptr;
@@ -198,17 +241,6 @@ bool TypeNamer::GetName(ConstTypePtr type,
       CHECK(type->CastTo(&function));
       return GetFunctionName(function, decorated, type_name);
     }
-    case Type::USER_DEFINED_TYPE_KIND:
-    case Type::BASIC_TYPE_KIND:
-    case Type::GLOBAL_TYPE_KIND:
-    case Type::WILDCARD_TYPE_KIND: {
-      // These types should have their name set up.
-      if (decorated)
-        *type_name = type->GetDecoratedName();
-      else
-        *type_name = type->GetName();
-      return true;
-    }
     default:
       DCHECK(false);
       return false;
@@ -25,8 +25,12 @@ namespace refinery {
 
 bool GetSymBaseTypeName(IDiaSymbol* symbol, base::string16* type_name);
 
-// Computes type names for types whose name depends on other types.
+// Computes type names for types whose name depends on other types. The names
+// of the types that belong to a repository are memoized by the repository, and
+// are only computed once.
 // @note array names do not depend on the index type.
+// @note the names are memoized once they're successfully computed, so the
+//     types must be finalized before they're named.
 class TypeNamer {
  public:
   static bool GetName(ConstTypePtr type, base::string16* type_name);
@@ -37,6 +41,12 @@ class TypeNamer {
                       bool decorated,
                       base::string16* type_name);
 
+  // Computes the name of a pointer, array or function @p type without
+  // consulting the memoized names.
+  static bool GetComposedName(ConstTypePtr type,
+                              bool decorated,
+                              base::string16* type_name);
+
   static bool GetPointerName(ConstPointerTypePtr ptr,
                              bool decorated,
                              base::string16* type_name);
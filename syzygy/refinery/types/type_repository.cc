@@ -26,24 +26,58 @@ TypeRepository::TypeRepository(const pe::PEFile::Signature& signature)
     : is_signature_set_(true), signature_(signature) {
 }
 
+TypeRepository::TypeRepository(std::unique_ptr<Loader> loader)
+    : is_signature_set_(false), loader_(std::move(loader)) {
+  DCHECK(loader_);
+}
+
 TypeRepository::~TypeRepository() {
 }
 
 TypePtr TypeRepository::GetType(TypeId id) const {
-  auto it = types_.find(id);
-  if (it == types_.end())
+  TypePtr type = FindType(id);
+  if (type != nullptr)
+    return type;
+
+  base::AutoLock auto_lock(load_lock_);
+  if (loader_ == nullptr)
     return nullptr;
-  return it->second;
+
+  // Another thread may have loaded the type in the meantime.
+  type = FindType(id);
+  if (type != nullptr)
+    return type;
+
+  // The loader only adds types, which is why the repository is const here.
+  if (!loader_->LoadType(id, const_cast<TypeRepository*>(this)))
+    return nullptr;
+  return FindType(id);
+}
+
+bool TypeRepository::LoadAllTypes() {
+  base::AutoLock auto_lock(load_lock_);
+  if (loader_ == nullptr)
+    return true;
+
+  if (!loader_->LoadAllTypes(this))
+    return false;
+
+  // All the types are loaded, which releases the resources of the loader.
+  loader_.reset();
+  return true;
 }
 
 TypeId TypeRepository::AddType(TypePtr type) {
   DCHECK(type);
+
+  base::AutoLock auto_lock(lock_);
   TypeId id = types_.size() + 1;
 
-  bool result = AddTypeWithId(type, id);
+  // Check that the ID is unassigned.
+  DCHECK(types_.find(id) == types_.end());
 
-  // Check that the adding was successful.
-  DCHECK(result);
+  type->SetRepository(this, id);
+  types_[id] = type;
 
   return id;
 }
@@ -51,6 +85,8 @@ TypeId TypeRepository::AddType(TypePtr type) {
 bool TypeRepository::AddTypeWithId(TypePtr type, TypeId id) {
   DCHECK(type);
 
+  base::AutoLock auto_lock(lock_);
+
   // Check that the ID is unassigned.
   if (types_.find(id) != types_.end())
     return false;
@@ -61,7 +97,8 @@ bool TypeRepository::AddTypeWithId(TypePtr type, TypeId id) {
   return true;
 }
 
-bool TypeRepository::GetModuleSignature(pe::PEFile::Signature* signature) {
+bool TypeRepository::GetModuleSignature(
+    pe::PEFile::Signature* signature) const {
   DCHECK(signature);
 
   if (!is_signature_set_)
@@ -71,6 +108,7 @@ bool TypeRepository::GetModuleSignature(pe::PEFile::Signature* signature) {
 }
 
 size_t TypeRepository::size() const {
+  base::AutoLock auto_lock(lock_);
   return types_.size();
 }
 
@@ -82,10 +120,54 @@ TypeRepository::Iterator TypeRepository::end() const {
   return Iterator(types_.end());
 }
 
-TypeNameIndex::TypeNameIndex(scoped_refptr<TypeRepository> repository) {
-  DCHECK(repository);
-  for (auto type : *repository)
-    name_index_.insert(std::make_pair(type->GetName(), type));
+TypePtr TypeRepository::FindType(TypeId id) const {
+  base::AutoLock auto_lock(lock_);
+  auto it = types_.find(id);
+  if (it == types_.end())
+    return nullptr;
+  return it->second;
+}
+
+bool TypeRepository::FindTypeName(TypeId id,
+                                  bool decorated,
+                                  base::StringPiece16* name) const {
+  DCHECK(name);
+
+  base::AutoLock auto_lock(names_lock_);
+  const auto& names = decorated ? decorated_names_ : names_;
+  auto it = names.find(id);
+  if (it == names.end())
+    return false;
+  *name = it->second;
+  return true;
+}
+
+base::StringPiece16 TypeRepository::SetTypeName(
+    TypeId id,
+    bool decorated,
+    const base::string16& name) const {
+  base::AutoLock auto_lock(names_lock_);
+  base::StringPiece16 interned(*string_pool_.insert(name).first);
+
+  // Another thread may have memoized the same name in the meantime.
+  auto& names = decorated ? decorated_names_ : names_;
+  names.insert(std::make_pair(id, interned));
+  return interned;
+}
+
+base::StringPiece16 TypeRepository::InternString(
+    const base::string16& str) const {
+  base::AutoLock auto_lock(names_lock_);
+  return base::StringPiece16(*string_pool_.insert(str).first);
+}
+
+TypeNameIndex::TypeNameIndex(scoped_refptr<TypeRepository> repository)
+    : repository_(repository) {
+  DCHECK(repository_);
+  for (auto type : *repository_) {
+    name_index_.insert(
+        std::make_pair(repository_->InternString(type->GetName()), type));
+  }
 }
 
 TypeNameIndex::~TypeNameIndex() {
@@ -96,7 +178,7 @@ void TypeNameIndex::GetTypes(const base::string16& name,
   DCHECK(types);
   types->clear();
 
-  auto match = name_index_.equal_range(name);
+  auto match = name_index_.equal_range(base::StringPiece16(name));
   for (auto it = match.first; it != match.second; ++it)
     types->push_back(it->second);
 }
@@ -17,11 +17,16 @@
 
 #include <iterator>
 #include <map>
+#include <memory>
+#include <unordered_set>
 #include <vector>
 
 #include "base/macros.h"
 #include "base/containers/hash_tables.h"
 #include "base/memory/ref_counted.h"
+#include "base/strings/string16.h"
+#include "base/strings/string_piece.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/pe/pe_file.h"
 
 namespace refinery {
@@ -31,19 +36,33 @@ class Type;
 using TypePtr = scoped_refptr<Type>;
 
 // Keeps type instances, assigns them an ID and vends them out by ID on demand.
+// A repository may be given a Loader, in which case the types are only created
+// when they're first retrieved by ID. The repository may be used from several
+// threads at once.
 // TODO(manzagop): cleave the interface so as to obtain something immutable.
 // TODO(manzagop): abstract the module id away from a pe file signature.
-class TypeRepository : public base::RefCounted<TypeRepository> {
+class TypeRepository : public base::RefCountedThreadSafe<TypeRepository> {
  public:
   class Iterator;
+  class Loader;
 
   // TODO(manzagop): make it mandatory to provide a module signature.
   TypeRepository();
   explicit TypeRepository(const pe::PEFile::Signature& signature);
 
-  // Retrieve a type by @p id.
+  // Creates a repository whose types are created on demand.
+  // @param loader the loader that creates the types.
+  explicit TypeRepository(std::unique_ptr<Loader> loader);
+
+  // Retrieve a type by @p id. If the type isn't loaded yet, the loader
+  // creates it along with the types it depends on.
   TypePtr GetType(TypeId id) const;
 
+  // Loads all the types that aren't loaded yet. This is a no-op for a
+  // repository without a loader.
+  // @returns true on success, false on failure.
+  bool LoadAllTypes();
+
   // Add @p type and get its assigned id.
   // @pre @p type must not be in any repository.
   TypeId AddType(TypePtr type);
@@ -55,9 +74,40 @@ class TypeRepository : public base::RefCounted<TypeRepository> {
 
 
   // Get the signature for the module this type represents.
-  bool GetModuleSignature(pe::PEFile::Signature* signature);
+  bool GetModuleSignature(pe::PEFile::Signature* signature) const;
+
+  // @name Type names.
+  // The names of the types whose name depends on other types are memoized by
+  // type id, and the names are interned in a pool that lives as long as the
+  // repository, which lets equal names share their storage.
+  // @{
+  // Retrieves the memoized name of the type with @p id.
+  // @param id the id of the type.
+  // @param decorated whether to retrieve the decorated name.
+  // @param name on success, the interned name.
+  // @returns true if the name is memoized, false otherwise.
+  bool FindTypeName(TypeId id,
+                    bool decorated,
+                    base::StringPiece16* name) const;
+
+  // Memoizes @p name as the name of the type with @p id.
+  // @param id the id of the type.
+  // @param decorated whether @p name is the decorated name.
+  // @param name the name of the type.
+  // @returns the interned name.
+  base::StringPiece16 SetTypeName(TypeId id,
+                                  bool decorated,
+                                  const base::string16& name) const;
+
+  // Interns @p str in the pool of the repository.
+  // @returns the interned copy of @p str.
+  base::StringPiece16 InternString(const base::string16& str) const;
+  // @}
 
   // @name Accessors.
+  // @note For a repository with a loader, these only cover the types that are
+  //     loaded, and LoadAllTypes must be called before iterating over all the
+  //     types. The repository must not be modified while it's iterated over.
   // @{
   size_t size() const;
   Iterator begin() const;
@@ -65,13 +115,36 @@ class TypeRepository : public base::RefCounted<TypeRepository> {
   // @}
 
  private:
-  friend class base::RefCounted<TypeRepository>;
+  friend class base::RefCountedThreadSafe<TypeRepository>;
+  friend class Loader;
   ~TypeRepository();
 
+  // Retrieves a type by @p id without loading it.
+  TypePtr FindType(TypeId id) const;
+
   bool is_signature_set_;
   pe::PEFile::Signature signature_;
+
+  // Protects types_. This isn't held while types are loaded, as loading
+  // retrieves and adds types.
+  mutable base::Lock lock_;
   std::unordered_map<TypeId, TypePtr> types_;
 
+  // The loader of the types that are created on demand, or nullptr if all the
+  // types are loaded. The loader is only used under load_lock_, which is
+  // always acquired before lock_.
+  mutable base::Lock load_lock_;
+  std::unique_ptr<Loader> loader_;
+
+  // Protects the string pool and the memoized names. This is never held while
+  // a name is computed, as computing a name retrieves types.
+  mutable base::Lock names_lock_;
+  // The interned strings. The nodes of the set are never moved, which keeps
+  // the pieces into them valid.
+  mutable std::unordered_set<base::string16> string_pool_;
+  mutable std::unordered_map<TypeId, base::StringPiece16> names_;
+  mutable std::unordered_map<TypeId, base::StringPiece16> decorated_names_;
+
   DISALLOW_COPY_AND_ASSIGN(TypeRepository);
 };
 
@@ -100,15 +173,43 @@ class TypeRepository::Iterator
   std::unordered_map<TypeId, TypePtr>::const_iterator it_;
 };
 
-// The TypeNameIndex provides name-based indexing for types.
-// @note The underlying TypeRepository should not be modified.
+// The interface of the objects that create the types of a repository on
+// demand.
+class TypeRepository::Loader {
+ public:
+  virtual ~Loader() {}
+
+  // Creates the type with @p id and the types it depends on, and adds them to
+  // @p repository.
+  // @param id the id of the type to create.
+  // @param repository the repository to add the types to.
+  // @returns true on success, false if there's no such type or on failure.
+  virtual bool LoadType(TypeId id, TypeRepository* repository) = 0;
+
+  // Creates all the types that aren't in @p repository yet, and adds them.
+  // @param repository the repository to add the types to.
+  // @returns true on success, false on failure.
+  virtual bool LoadAllTypes(TypeRepository* repository) = 0;
+
+ protected:
+  // Retrieves a type of @p repository by @p id without loading it, which lets
+  // the loaders look up the types they already created.
+  static TypePtr FindType(const TypeRepository* repository, TypeId id) {
+    return repository->FindType(id);
+  }
+};
+
+// The TypeNameIndex provides name-based indexing for types. The names are
+// interned in the string pool of the repository, which the index keeps alive.
+// @note The underlying TypeRepository should not be modified, and its types
+//     must all be loaded.
 // @note Name-based indexing, as well as support for name collisions (using a
 //     multimap) are necessary as long as we rely on DIA. DIA does not expose
 //     mangled names (at least not the fully mangled names?) nor the PDB ids
 //     (DIA ids are not stable as they're based on the parse order).
 // TODO(manzagop): relocate to where this is used once it exists.
 // TODO(manzagop): remove once DIA is no-longer used.
-class TypeNameIndex : public base::RefCounted<TypeNameIndex> {
+class TypeNameIndex : public base::RefCountedThreadSafe<TypeNameIndex> {
  public:
   explicit TypeNameIndex(scoped_refptr<TypeRepository> repository);
 
@@ -116,10 +217,11 @@ class TypeNameIndex : public base::RefCounted<TypeNameIndex> {
   void GetTypes(const base::string16& name, std::vector<TypePtr>* types) const;
 
  private:
-  friend class base::RefCounted<TypeNameIndex>;
+  friend class base::RefCountedThreadSafe<TypeNameIndex>;
   ~TypeNameIndex();
 
-  std::multimap<base::string16, TypePtr> name_index_;
+  scoped_refptr<TypeRepository> repository_;
+  std::multimap<base::StringPiece16, TypePtr> name_index_;
 };
 
 }  // namespace refinery
@@ -0,0 +1,471 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/refinery/types/type_repository_serialization.h"
+
+#include "base/logging.h"
+#include "syzygy/refinery/types/type.h"
+
+namespace refinery {
+
+namespace {
+
+// Identifies the format of saved repositories. This must be incremented
+// whenever the format changes.
+const uint32_t kFormatVersion = 1;
+
+// The largest bit position and length of a bitfield member.
+const size_t kMaxBitfieldValue = 63;
+
+// Sizes and ids are saved as 64 bit values, so that the format doesn't depend
+// on the bitness of the process.
+bool SaveSize(size_t value, core::OutArchive* out_archive) {
+  return out_archive->Save(static_cast<uint64_t>(value));
+}
+
+bool LoadSize(core::InArchive* in_archive, size_t* value) {
+  uint64_t loaded = 0;
+  if (!in_archive->Load(&loaded))
+    return false;
+  *value = static_cast<size_t>(loaded);
+  return true;
+}
+
+bool SaveOffset(ptrdiff_t value, core::OutArchive* out_archive) {
+  return out_archive->Save(static_cast<int64_t>(value));
+}
+
+bool LoadOffset(core::InArchive* in_archive, ptrdiff_t* value) {
+  int64_t loaded = 0;
+  if (!in_archive->Load(&loaded))
+    return false;
+  *value = static_cast<ptrdiff_t>(loaded);
+  return true;
+}
+
+Type::Flags GetFlags(bool is_const, bool is_volatile) {
+  Type::Flags flags = kNoTypeFlags;
+  if (is_const)
+    flags |= Type::FLAG_CONST;
+  if (is_volatile)
+    flags |= Type::FLAG_VOLATILE;
+  return flags;
+}
+
+bool SaveArgument(const FunctionType::ArgumentType& argument,
+                  core::OutArchive* out_archive) {
+  return out_archive->Save(
+             GetFlags(argument.is_const(), argument.is_volatile())) &&
+         SaveSize(argument.type_id(), out_archive);
+}
+
+bool LoadArgument(core::InArchive* in_archive,
+                  FunctionType::ArgumentType* argument) {
+  DCHECK(argument);
+
+  Type::Flags flags = kNoTypeFlags;
+  TypeId type_id = kNoTypeId;
+  if (!in_archive->Load(&flags) || !LoadSize(in_archive, &type_id))
+    return false;
+  *argument = FunctionType::ArgumentType(flags, type_id);
+  return true;
+}
+
+bool SaveField(const UserDefinedType::Field& field,
+               core::OutArchive* out_archive) {
+  if (!out_archive->Save(static_cast<uint8_t>(field.kind())) ||
+      !SaveOffset(field.offset(), out_archive) ||
+      !SaveSize(field.type_id(), out_archive)) {
+    return false;
+  }
+
+  MemberFieldPtr member;
+  if (!field.CastTo(&member))
+    return true;
+
+  return out_archive->Save(member->name()) &&
+         out_archive->Save(
+             GetFlags(member->is_const(), member->is_volatile())) &&
+         out_archive->Save(static_cast<uint8_t>(member->bit_pos())) &&
+         out_archive->Save(static_cast<uint8_t>(member->bit_len()));
+}
+
+bool LoadField(core::InArchive* in_archive,
+               TypeRepository* repository,
+               FieldPtr* field) {
+  DCHECK(repository);
+  DCHECK(field);
+
+  uint8_t kind = 0;
+  ptrdiff_t offset = 0;
+  TypeId type_id = kNoTypeId;
+  if (!in_archive->Load(&kind) || !LoadOffset(in_archive, &offset) ||
+      !LoadSize(in_archive, &type_id)) {
+    return false;
+  }
+
+  switch (kind) {
+    case UserDefinedType::Field::BASE_CLASS_KIND:
+      *field = new UserDefinedType::BaseClassField(offset, type_id, repository);
+      return true;
+    case UserDefinedType::Field::VFPTR_KIND:
+      *field = new UserDefinedType::VfptrField(offset, type_id, repository);
+      return true;
+    case UserDefinedType::Field::MEMBER_KIND: {
+      base::string16 name;
+      Type::Flags flags = kNoTypeFlags;
+      uint8_t bit_pos = 0;
+      uint8_t bit_len = 0;
+      if (!in_archive->Load(&name) || !in_archive->Load(&flags) ||
+          !in_archive->Load(&bit_pos) || !in_archive->Load(&bit_len) ||
+          bit_pos > kMaxBitfieldValue || bit_len > kMaxBitfieldValue) {
+        return false;
+      }
+      *field = new UserDefinedType::MemberField(name, offset, flags, bit_pos,
+                                                bit_len, type_id, repository);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+bool SaveUserDefinedType(const UserDefinedType& udt,
+                         core::OutArchive* out_archive) {
+  if (!out_archive->Save(udt.GetName()) ||
+      !out_archive->Save(udt.GetDecoratedName()) ||
+      !out_archive->Save(static_cast<uint8_t>(udt.udt_kind())) ||
+      !out_archive->Save(udt.is_fwd_decl()) ||
+      !SaveSize(udt.fields().size(), out_archive)) {
+    return false;
+  }
+
+  for (const FieldPtr& field : udt.fields()) {
+    if (!SaveField(*field, out_archive))
+      return false;
+  }
+
+  if (!SaveSize(udt.functions().size(), out_archive))
+    return false;
+  for (const UserDefinedType::Function& function : udt.functions()) {
+    if (!out_archive->Save(function.name()) ||
+        !SaveSize(function.type_id(), out_archive)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool LoadUserDefinedType(core::InArchive* in_archive,
+                         size_t size,
+                         TypeRepository* repository,
+                         TypePtr* type) {
+  DCHECK(repository);
+  DCHECK(type);
+
+  base::string16 name;
+  base::string16 decorated_name;
+  uint8_t udt_kind = 0;
+  bool is_fwd_decl = false;
+  size_t field_count = 0;
+  if (!in_archive->Load(&name) || !in_archive->Load(&decorated_name) ||
+      !in_archive->Load(&udt_kind) || !in_archive->Load(&is_fwd_decl) ||
+      !LoadSize(in_archive, &field_count) ||
+      udt_kind > UserDefinedType::UDT_UNION) {
+    return false;
+  }
+
+  // The counts aren't trusted to reserve memory, as the archive may be
+  // corrupt.
+  UserDefinedType::Fields fields;
+  for (size_t i = 0; i < field_count; ++i) {
+    FieldPtr field;
+    if (!LoadField(in_archive, repository, &field))
+      return false;
+    fields.push_back(field);
+  }
+
+  size_t function_count = 0;
+  if (!LoadSize(in_archive, &function_count))
+    return false;
+  UserDefinedType::Functions functions;
+  for (size_t i = 0; i < function_count; ++i) {
+    base::string16 function_name;
+    TypeId function_type_id = kNoTypeId;
+    if (!in_archive->Load(&function_name) ||
+        !LoadSize(in_archive, &function_type_id)) {
+      return false;
+    }
+    functions.push_back(
+        UserDefinedType::Function(function_name, function_type_id));
+  }
+
+  UserDefinedTypePtr udt = new UserDefinedType(
+      name, decorated_name, size,
+      static_cast<UserDefinedType::UdtKind>(udt_kind));
+  if (is_fwd_decl) {
+    if (!fields.empty() || !functions.empty())
+      return false;
+    udt->SetIsForwardDeclaration();
+  } else {
+    udt->Finalize(&fields, &functions);
+  }
+
+  *type = udt;
+  return true;
+}
+
+bool SaveType(const Type& type, core::OutArchive* out_archive) {
+  if (!out_archive->Save(static_cast<uint8_t>(type.kind())) ||
+      !SaveSize(type.type_id(), out_archive) ||
+      !SaveSize(type.size(), out_archive)) {
+    return false;
+  }
+
+  switch (type.kind()) {
+    case Type::BASIC_TYPE_KIND:
+      return out_archive->Save(type.GetName());
+
+    case Type::USER_DEFINED_TYPE_KIND: {
+      ConstUserDefinedTypePtr udt;
+      CHECK(type.CastTo(&udt));
+      return SaveUserDefinedType(*udt, out_archive);
+    }
+
+    case Type::POINTER_TYPE_KIND: {
+      ConstPointerTypePtr ptr;
+      CHECK(type.CastTo(&ptr));
+      return out_archive->Save(static_cast<uint8_t>(ptr->ptr_mode())) &&
+             out_archive->Save(GetFlags(ptr->is_const(), ptr->is_volatile())) &&
+             SaveSize(ptr->content_type_id(), out_archive);
+    }
+
+    case Type::ARRAY_TYPE_KIND: {
+      ConstArrayTypePtr array;
+      CHECK(type.CastTo(&array));
+      return out_archive->Save(
+                 GetFlags(array->is_const(), array->is_volatile())) &&
+             SaveSize(array->index_type_id(), out_archive) &&
+             SaveSize(array->num_elements(), out_archive) &&
+             SaveSize(array->element_type_id(), out_archive);
+    }
+
+    case Type::FUNCTION_TYPE_KIND: {
+      ConstFunctionTypePtr function;
+      CHECK(type.CastTo(&function));
+      if (!out_archive->Save(
+              static_cast<uint8_t>(function->call_convention())) ||
+          !SaveArgument(function->return_type(), out_archive) ||
+          !SaveSize(function->containing_class_id(), out_archive) ||
+          !SaveSize(function->argument_types().size(), out_archive)) {
+        return false;
+      }
+      for (const FunctionType::ArgumentType& argument :
+           function->argument_types()) {
+        if (!SaveArgument(argument, out_archive))
+          return false;
+      }
+      return true;
+    }
+
+    case Type::GLOBAL_TYPE_KIND: {
+      ConstGlobalTypePtr global;
+      CHECK(type.CastTo(&global));
+      return out_archive->Save(global->GetName()) &&
+             out_archive->Save(global->rva()) &&
+             SaveSize(global->data_type_id(), out_archive);
+    }
+
+    case Type::WILDCARD_TYPE_KIND:
+      return out_archive->Save(type.GetName()) &&
+             out_archive->Save(type.GetDecoratedName());
+  }
+
+  NOTREACHED();
+  return false;
+}
+
+bool LoadType(core::InArchive* in_archive, TypeRepository* repository) {
+  DCHECK(repository);
+
+  uint8_t kind = 0;
+  TypeId type_id = kNoTypeId;
+  size_t size = 0;
+  if (!in_archive->Load(&kind) || !LoadSize(in_archive, &type_id) ||
+      !LoadSize(in_archive, &size)) {
+    return false;
+  }
+
+  TypePtr type;
+  switch (kind) {
+    case Type::BASIC_TYPE_KIND: {
+      base::string16 name;
+      if (!in_archive->Load(&name))
+        return false;
+      type = new BasicType(name, size);
+      break;
+    }
+
+    case Type::USER_DEFINED_TYPE_KIND:
+      if (!LoadUserDefinedType(in_archive, size, repository, &type))
+        return false;
+      break;
+
+    case Type::POINTER_TYPE_KIND: {
+      uint8_t ptr_mode = 0;
+      Type::Flags flags = kNoTypeFlags;
+      TypeId content_type_id = kNoTypeId;
+      if (!in_archive->Load(&ptr_mode) || !in_archive->Load(&flags) ||
+          !LoadSize(in_archive, &content_type_id) ||
+          ptr_mode > PointerType::PTR_MODE_REF) {
+        return false;
+      }
+      PointerTypePtr ptr =
+          new PointerType(size, static_cast<PointerType::Mode>(ptr_mode));
+      // Pointers that weren't finalized have no content type.
+      if (content_type_id != kNoTypeId)
+        ptr->Finalize(flags, content_type_id);
+      type = ptr;
+      break;
+    }
+
+    case Type::ARRAY_TYPE_KIND: {
+      Type::Flags flags = kNoTypeFlags;
+      TypeId index_type_id = kNoTypeId;
+      size_t num_elements = 0;
+      TypeId element_type_id = kNoTypeId;
+      if (!in_archive->Load(&flags) || !LoadSize(in_archive, &index_type_id) ||
+          !LoadSize(in_archive, &num_elements) ||
+          !LoadSize(in_archive, &element_type_id)) {
+        return false;
+      }
+      ArrayTypePtr array = new ArrayType(size);
+      array->Finalize(flags, index_type_id, num_elements, element_type_id);
+      type = array;
+      break;
+    }
+
+    case Type::FUNCTION_TYPE_KIND: {
+      uint8_t call_convention = 0;
+      FunctionType::ArgumentType return_type(kNoTypeFlags, kNoTypeId);
+      TypeId containing_class_id = kNoTypeId;
+      size_t argument_count = 0;
+      if (!in_archive->Load(&call_convention) ||
+          !LoadArgument(in_archive, &return_type) ||
+          !LoadSize(in_archive, &containing_class_id) ||
+          !LoadSize(in_archive, &argument_count) ||
+          call_convention > FunctionType::CALL_RESERVED) {
+        return false;
+      }
+      FunctionType::Arguments arguments;
+      for (size_t i = 0; i < argument_count; ++i) {
+        FunctionType::ArgumentType argument(kNoTypeFlags, kNoTypeId);
+        if (!LoadArgument(in_archive, &argument))
+          return false;
+        arguments.push_back(argument);
+      }
+      FunctionTypePtr function = new FunctionType(
+          static_cast<FunctionType::CallConvention>(call_convention));
+      function->Finalize(return_type, arguments, containing_class_id);
+      type = function;
+      break;
+    }
+
+    case Type::GLOBAL_TYPE_KIND: {
+      base::string16 name;
+      uint64_t rva = 0;
+      TypeId data_type_id = kNoTypeId;
+      if (!in_archive->Load(&name) || !in_archive->Load(&rva) ||
+          !LoadSize(in_archive, &data_type_id)) {
+        return false;
+      }
+      type = new GlobalType(name, rva, data_type_id, size);
+      break;
+    }
+
+    case Type::WILDCARD_TYPE_KIND: {
+      base::string16 name;
+      base::string16 decorated_name;
+      if (!in_archive->Load(&name) || !in_archive->Load(&decorated_name))
+        return false;
+      type = new WildcardType(name, decorated_name, size);
+      break;
+    }
+
+    default:
+      return false;
+  }
+
+  return repository->AddTypeWithId(type, type_id);
+}
+
+}  // namespace
+
+bool SaveTypeRepository(const TypeRepository& repository,
+                        core::OutArchive* out_archive) {
+  DCHECK(out_archive);
+
+  pe::PEFile::Signature signature;
+  bool has_signature = repository.GetModuleSignature(&signature);
+  if (!out_archive->Save(kFormatVersion) ||
+      !out_archive->Save(has_signature) ||
+      (has_signature && !out_archive->Save(signature)) ||
+      !SaveSize(repository.size(), out_archive)) {
+    return false;
+  }
+
+  for (const TypePtr& type : repository) {
+    if (!SaveType(*type, out_archive))
+      return false;
+  }
+
+  return true;
+}
+
+bool LoadTypeRepository(core::InArchive* in_archive,
+                        scoped_refptr<TypeRepository>* repository) {
+  DCHECK(in_archive);
+  DCHECK(repository);
+
+  uint32_t format_version = 0;
+  bool has_signature = false;
+  if (!in_archive->Load(&format_version) ||
+      format_version != kFormatVersion || !in_archive->Load(&has_signature)) {
+    return false;
+  }
+
+  scoped_refptr<TypeRepository> loaded;
+  if (has_signature) {
+    pe::PEFile::Signature signature;
+    if (!in_archive->Load(&signature))
+      return false;
+    loaded = new TypeRepository(signature);
+  } else {
+    loaded = new TypeRepository();
+  }
+
+  size_t type_count = 0;
+  if (!LoadSize(in_archive, &type_count))
+    return false;
+  for (size_t i = 0; i < type_count; ++i) {
+    if (!LoadType(in_archive, loaded.get()))
+      return false;
+  }
+
+  *repository = loaded;
+  return true;
+}
+
+}  // namespace refinery
@@ -0,0 +1,45 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares functions to save and load the types of a type repository, so
+// that the types crawled from a PDB can be cached on disk.
+
+#ifndef SYZYGY_REFINERY_TYPES_TYPE_REPOSITORY_SERIALIZATION_H_
+#define SYZYGY_REFINERY_TYPES_TYPE_REPOSITORY_SERIALIZATION_H_
+
+#include "base/memory/ref_counted.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/refinery/types/type_repository.h"
+
+namespace refinery {
+
+// Saves the module signature and the types of a repository. The types keep
+// their ids.
+// @param repository the repository to save.
+// @param out_archive the archive to save to.
+// @returns true on success, false on failure.
+bool SaveTypeRepository(const TypeRepository& repository,
+                        core::OutArchive* out_archive);
+
+// Loads a repository saved by SaveTypeRepository.
+// @param in_archive the archive to load from.
+// @param repository on success, receives the loaded repository.
+// @returns true on success, false if the archive is truncated, corrupt or of
+//     another format version.
+bool LoadTypeRepository(core::InArchive* in_archive,
+                        scoped_refptr<TypeRepository>* repository);
+
+}  // namespace refinery
+
+#endif  // SYZYGY_REFINERY_TYPES_TYPE_REPOSITORY_SERIALIZATION_H_
@@ -0,0 +1,213 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/refinery/types/type_repository_serialization.h"
+
+#include <iterator>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/refinery/types/type.h"
+
+namespace refinery {
+
+namespace {
+
+const TypeId kIntTypeId = 3;
+const TypeId kUdtTypeId = 7;
+const TypeId kPtrTypeId = 8;
+const TypeId kArrayTypeId = 11;
+const TypeId kFunctionTypeId = 12;
+const TypeId kGlobalTypeId = 13;
+const TypeId kWildcardTypeId = 14;
+const TypeId kFwdDeclTypeId = 15;
+
+class TypeRepositorySerializationTest : public testing::Test {
+ public:
+  void SetUp() override {
+    repository_ = new TypeRepository();
+
+    ASSERT_TRUE(
+        repository_->AddTypeWithId(new BasicType(L"int", 4), kIntTypeId));
+
+    UserDefinedTypePtr udt = new UserDefinedType(
+        L"Foo", L"?Foo", 12, UserDefinedType::UDT_CLASS);
+    UserDefinedType::Fields fields;
+    fields.push_back(
+        new UserDefinedType::VfptrField(0, kPtrTypeId, repository_.get()));
+    fields.push_back(new UserDefinedType::MemberField(
+        L"bits", 4, Type::FLAG_CONST, 3, 5, kIntTypeId, repository_.get()));
+    fields.push_back(new UserDefinedType::BaseClassField(8, kFwdDeclTypeId,
+                                                         repository_.get()));
+    UserDefinedType::Functions functions;
+    functions.push_back(UserDefinedType::Function(L"Bar", kFunctionTypeId));
+    udt->Finalize(&fields, &functions);
+    ASSERT_TRUE(repository_->AddTypeWithId(udt, kUdtTypeId));
+
+    UserDefinedTypePtr fwd_decl =
+        new UserDefinedType(L"Baz", 0, UserDefinedType::UDT_STRUCT);
+    fwd_decl->SetIsForwardDeclaration();
+    ASSERT_TRUE(repository_->AddTypeWithId(fwd_decl, kFwdDeclTypeId));
+
+    PointerTypePtr ptr = new PointerType(4, PointerType::PTR_MODE_REF);
+    ptr->Finalize(Type::FLAG_VOLATILE, kUdtTypeId);
+    ASSERT_TRUE(repository_->AddTypeWithId(ptr, kPtrTypeId));
+
+    ArrayTypePtr array = new ArrayType(40);
+    array->Finalize(kNoTypeFlags, kIntTypeId, 10, kIntTypeId);
+    ASSERT_TRUE(repository_->AddTypeWithId(array, kArrayTypeId));
+
+    FunctionTypePtr function = new FunctionType(FunctionType::CALL_THIS_CALL);
+    FunctionType::Arguments arguments;
+    arguments.push_back(
+        FunctionType::ArgumentType(Type::FLAG_CONST, kPtrTypeId));
+    function->Finalize(FunctionType::ArgumentType(kNoTypeFlags, kIntTypeId),
+                       arguments, kUdtTypeId);
+    ASSERT_TRUE(repository_->AddTypeWithId(function, kFunctionTypeId));
+
+    ASSERT_TRUE(repository_->AddTypeWithId(
+        new GlobalType(L"g_foo", 0x1234, kUdtTypeId, 12), kGlobalTypeId));
+    ASSERT_TRUE(repository_->AddTypeWithId(
+        new WildcardType(L"Wild", L"?Wild", 2), kWildcardTypeId));
+  }
+
+  // Saves the repository to contents_.
+  bool Save() {
+    contents_.clear();
+    core::ScopedOutStreamPtr out_stream(
+        core::CreateByteOutStream(std::back_inserter(contents_)));
+    core::OutArchive out_archive(out_stream.get());
+    return SaveTypeRepository(*repository_, &out_archive);
+  }
+
+  // Loads a repository from contents_.
+  bool Load(scoped_refptr<TypeRepository>* repository) {
+    core::ScopedInStreamPtr in_stream(
+        core::CreateByteInStream(contents_.begin(), contents_.end()));
+    core::InArchive in_archive(in_stream.get());
+    return LoadTypeRepository(&in_archive, repository);
+  }
+
+ protected:
+  scoped_refptr<TypeRepository> repository_;
+  std::vector<uint8_t> contents_;
+};
+
+}  // namespace
+
+TEST_F(TypeRepositorySerializationTest, RoundTrip) {
+  ASSERT_TRUE(Save());
+  scoped_refptr<TypeRepository> loaded;
+  ASSERT_TRUE(Load(&loaded));
+  ASSERT_EQ(repository_->size(), loaded->size());
+
+  pe::PEFile::Signature signature;
+  EXPECT_FALSE(loaded->GetModuleSignature(&signature));
+
+  for (const TypePtr& type : *repository_) {
+    TypePtr loaded_type = loaded->GetType(type->type_id());
+    ASSERT_TRUE(loaded_type);
+    EXPECT_EQ(loaded.get(), loaded_type->repository());
+    EXPECT_EQ(type->kind(), loaded_type->kind());
+    EXPECT_EQ(type->size(), loaded_type->size());
+    EXPECT_EQ(type->GetName(), loaded_type->GetName());
+    EXPECT_EQ(type->GetDecoratedName(), loaded_type->GetDecoratedName());
+  }
+
+  UserDefinedTypePtr udt;
+  ASSERT_TRUE(loaded->GetType(kUdtTypeId)->CastTo(&udt));
+  EXPECT_FALSE(udt->is_fwd_decl());
+  EXPECT_EQ(UserDefinedType::UDT_CLASS, udt->udt_kind());
+  ASSERT_EQ(3U, udt->fields().size());
+  EXPECT_EQ(UserDefinedType::Field::VFPTR_KIND, udt->fields()[0]->kind());
+  EXPECT_EQ(UserDefinedType::Field::BASE_CLASS_KIND,
+            udt->fields()[2]->kind());
+  EXPECT_EQ(8, udt->fields()[2]->offset());
+  MemberFieldPtr member;
+  ASSERT_TRUE(udt->fields()[1]->CastTo(&member));
+  EXPECT_EQ(L"bits", member->name());
+  EXPECT_EQ(4, member->offset());
+  EXPECT_TRUE(member->is_const());
+  EXPECT_FALSE(member->is_volatile());
+  EXPECT_EQ(3U, member->bit_pos());
+  EXPECT_EQ(5U, member->bit_len());
+  EXPECT_EQ(kIntTypeId, member->GetType()->type_id());
+  ASSERT_EQ(1U, udt->functions().size());
+  EXPECT_TRUE(udt->functions()[0] ==
+              UserDefinedType::Function(L"Bar", kFunctionTypeId));
+
+  UserDefinedTypePtr fwd_decl;
+  ASSERT_TRUE(loaded->GetType(kFwdDeclTypeId)->CastTo(&fwd_decl));
+  EXPECT_TRUE(fwd_decl->is_fwd_decl());
+  EXPECT_EQ(UserDefinedType::UDT_STRUCT, fwd_decl->udt_kind());
+
+  PointerTypePtr ptr;
+  ASSERT_TRUE(loaded->GetType(kPtrTypeId)->CastTo(&ptr));
+  EXPECT_EQ(PointerType::PTR_MODE_REF, ptr->ptr_mode());
+  EXPECT_FALSE(ptr->is_const());
+  EXPECT_TRUE(ptr->is_volatile());
+  EXPECT_EQ(kUdtTypeId, ptr->content_type_id());
+
+  ArrayTypePtr array;
+  ASSERT_TRUE(loaded->GetType(kArrayTypeId)->CastTo(&array));
+  EXPECT_EQ(kIntTypeId, array->index_type_id());
+  EXPECT_EQ(10U, array->num_elements());
+  EXPECT_EQ(kIntTypeId, array->element_type_id());
+
+  FunctionTypePtr function;
+  ASSERT_TRUE(loaded->GetType(kFunctionTypeId)->CastTo(&function));
+  EXPECT_EQ(FunctionType::CALL_THIS_CALL, function->call_convention());
+  EXPECT_EQ(kUdtTypeId, function->containing_class_id());
+  EXPECT_EQ(kIntTypeId, function->return_type().type_id());
+  ASSERT_EQ(1U, function->argument_types().size());
+  EXPECT_TRUE(function->argument_types()[0] ==
+              FunctionType::ArgumentType(Type::FLAG_CONST, kPtrTypeId));
+
+  GlobalTypePtr global;
+  ASSERT_TRUE(loaded->GetType(kGlobalTypeId)->CastTo(&global));
+  EXPECT_EQ(0x1234U, global->rva());
+  EXPECT_EQ(kUdtTypeId, global->data_type_id());
+}
+
+TEST_F(TypeRepositorySerializationTest, RoundTripWithSignature) {
+  pe::PEFile::Signature signature(L"foo.dll", core::AbsoluteAddress(0x10000),
+                                  0x1000, 0xCAFE, 0xF00D);
+  repository_ = new TypeRepository(signature);
+  ASSERT_TRUE(Save());
+
+  scoped_refptr<TypeRepository> loaded;
+  ASSERT_TRUE(Load(&loaded));
+  EXPECT_EQ(0U, loaded->size());
+  pe::PEFile::Signature loaded_signature;
+  ASSERT_TRUE(loaded->GetModuleSignature(&loaded_signature));
+  EXPECT_TRUE(signature == loaded_signature);
+}
+
+TEST_F(TypeRepositorySerializationTest, LoadFailsForTruncatedArchive) {
+  ASSERT_TRUE(Save());
+  contents_.resize(contents_.size() - 1);
+  scoped_refptr<TypeRepository> loaded;
+  EXPECT_FALSE(Load(&loaded));
+  EXPECT_FALSE(loaded);
+}
+
+TEST_F(TypeRepositorySerializationTest, LoadFailsForOtherVersion) {
+  ASSERT_TRUE(Save());
+  ++contents_[0];
+  scoped_refptr<TypeRepository> loaded;
+  EXPECT_FALSE(Load(&loaded));
+}
+
+}  // namespace refinery
@@ -14,6 +14,8 @@
 
 #include "syzygy/refinery/types/type_repository.h"
 
+#include <memory>
+
 #include "base/memory/ref_counted.h"
 #include "gtest/gtest.h"
 #include "syzygy/pe/pe_file.h"
@@ -21,6 +23,38 @@
 
 namespace refinery {
 
+namespace {
+
+// A loader that creates a basic type for each even id, along with the type of
+// the id that follows it.
+class TestLoader : public TypeRepository::Loader {
+ public:
+  explicit TestLoader(size_t* load_count) : load_count_(load_count) {}
+
+  bool LoadType(TypeId id, TypeRepository* repository) override {
+    ++*load_count_;
+    if (id % 2 != 0 || id > kMaxId)
+      return false;
+    return repository->AddTypeWithId(new BasicType(L"even", 4), id) &&
+           repository->AddTypeWithId(new BasicType(L"odd", 4), id + 1);
+  }
+
+  bool LoadAllTypes(TypeRepository* repository) override {
+    for (TypeId id = 0; id <= kMaxId; id += 2) {
+      if (FindType(repository, id) == nullptr && !LoadType(id, repository))
+        return false;
+    }
+    return true;
+  }
+
+  static const TypeId kMaxId = 8;
+
+ private:
+  size_t* load_count_;
+};
+
+}  // namespace
+
 TEST(TypeRepositoryTest, AddType) {
   scoped_refptr<TypeRepository> repo = new TypeRepository();
   EXPECT_EQ(0U, repo->size());
@@ -118,6 +152,81 @@ TEST(TypeRepositoryTest, Iteration) {
   EXPECT_EQ(3U, iterated);
 }
 
+TEST(TypeRepositoryTest, LoadOnDemand) {
+  size_t load_count = 0;
+  scoped_refptr<TypeRepository> repo = new TypeRepository(
+      std::unique_ptr<TypeRepository::Loader>(new TestLoader(&load_count)));
+  EXPECT_EQ(0U, repo->size());
+
+  // Retrieving a type loads it along with the type it depends on.
+  TypePtr type = repo->GetType(4);
+  ASSERT_TRUE(type);
+  EXPECT_EQ(L"even", type->GetName());
+  EXPECT_EQ(repo.get(), type->repository());
+  EXPECT_EQ(2U, repo->size());
+  EXPECT_EQ(1U, load_count);
+
+  // The loaded types aren't loaded again.
+  EXPECT_EQ(type, repo->GetType(4));
+  type = repo->GetType(5);
+  ASSERT_TRUE(type);
+  EXPECT_EQ(L"odd", type->GetName());
+  EXPECT_EQ(1U, load_count);
+
+  // Missing types aren't found.
+  EXPECT_FALSE(repo->GetType(11));
+  EXPECT_EQ(2U, repo->size());
+
+  // Loading all the types loads the remaining ones, and releases the loader.
+  ASSERT_TRUE(repo->LoadAllTypes());
+  EXPECT_EQ(TestLoader::kMaxId + 2, repo->size());
+  load_count = 0;
+  EXPECT_FALSE(repo->GetType(11));
+  ASSERT_TRUE(repo->LoadAllTypes());
+  EXPECT_EQ(0U, load_count);
+}
+
+TEST(TypeRepositoryTest, InternString) {
+  scoped_refptr<TypeRepository> repo = new TypeRepository();
+  base::StringPiece16 one = repo->InternString(L"one");
+  base::StringPiece16 two = repo->InternString(L"two");
+  EXPECT_EQ(L"one", one.as_string());
+  EXPECT_EQ(L"two", two.as_string());
+
+  // Equal strings share their storage.
+  EXPECT_EQ(one.data(), repo->InternString(L"one").data());
+  EXPECT_NE(one.data(), two.data());
+}
+
+TEST(TypeRepositoryTest, TypeNamesAreMemoized) {
+  scoped_refptr<TypeRepository> repo = new TypeRepository();
+  TypePtr basic = new BasicType(L"int", 4);
+  TypeId basic_id = repo->AddType(basic);
+  PointerTypePtr ptr = new PointerType(4, PointerType::PTR_MODE_PTR);
+  TypeId ptr_id = repo->AddType(ptr);
+
+  // A type that isn't finalized can't be named, and its name isn't memoized.
+  base::StringPiece16 name;
+  EXPECT_EQ(kUnknownTypeName, ptr->GetName());
+  EXPECT_FALSE(repo->FindTypeName(ptr_id, false, &name));
+
+  ptr->Finalize(Type::FLAG_CONST, basic_id);
+  EXPECT_EQ(L"int const*", ptr->GetName());
+  ASSERT_TRUE(repo->FindTypeName(ptr_id, false, &name));
+  EXPECT_EQ(L"int const*", name.as_string());
+  EXPECT_FALSE(repo->FindTypeName(ptr_id, true, &name));
+
+  EXPECT_EQ(L"int const*", ptr->GetDecoratedName());
+  EXPECT_TRUE(repo->FindTypeName(ptr_id, true, &name));
+
+  // The names of named types are stored by the types themselves.
+  EXPECT_EQ(L"int", basic->GetName());
+  EXPECT_FALSE(repo->FindTypeName(basic_id, false, &name));
+
+  // The memoized names are interned.
+  EXPECT_EQ(name.data(), repo->InternString(L"int const*").data());
+}
+
 TEST(TypeNameIndexTest, BasicTest) {
   const wchar_t kNotATypeName[] = L"not";
   const wchar_t kTypeNameOne[] = L"one";
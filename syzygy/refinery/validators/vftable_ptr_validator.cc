@@ -14,6 +14,7 @@
 
 #include "syzygy/refinery/validators/vftable_ptr_validator.h"
 
+#include <algorithm>
 #include <string>
 
 #include "base/strings/stringprintf.h"
@@ -25,6 +26,12 @@ namespace refinery {
 
 namespace {
 
+// The size of the blocks read by ScanForVFTablePtrs.
+const Size kScanBlockSize = 0x10000;
+
+// The granularity of the memory that may be missing from a bit source.
+const Size kScanPageSize = 0x1000;
+
 TypePtr RecoverType(ModuleLayerAccessor* accessor,
                     SymbolProvider* provider,
                     const TypedBlock& typedblock) {
@@ -83,13 +90,17 @@ Validator::ValidationResult VftablePtrValidator::Validate(
     return VALIDATION_ERROR;
   }
 
-  // Get the set of valid vftable ptrs.
+  // Get the set of valid vftable ptrs. They're sorted, which makes the
+  // lookups cheaper than in the set.
   // Go through the typed block layer for validation.
-  base::hash_set<Address> vftable_vas;
-  if (!GetVFTableVAs(process_state, symbol_provider_.get(), &vftable_vas)) {
+  base::hash_set<Address> vftable_va_set;
+  if (!GetVFTableVAs(process_state, symbol_provider_.get(), &vftable_va_set)) {
     LOG(ERROR) << "Failed to get vfptr VAs.";
     return VALIDATION_ERROR;
   }
+  std::vector<Address> vftable_vas(vftable_va_set.begin(),
+                                   vftable_va_set.end());
+  std::sort(vftable_vas.begin(), vftable_vas.end());
 
   // Validate each typed block.
   ModuleLayerAccessor accessor(process_state);
@@ -105,6 +116,57 @@ Validator::ValidationResult VftablePtrValidator::Validate(
   return VALIDATION_COMPLETE;
 }
 
+void VftablePtrValidator::ScanForVFTablePtrs(
+    BitSource* bit_source,
+    const AddressRange& range,
+    const std::vector<Address>& vftable_vas,
+    std::vector<Address>* locations) {
+  DCHECK(bit_source);
+  DCHECK(range.IsValid());
+  DCHECK(std::is_sorted(vftable_vas.begin(), vftable_vas.end()));
+  DCHECK(locations);
+  locations->clear();
+
+  if (vftable_vas.empty())
+    return;
+  const Address min_va = vftable_vas.front();
+  const Address max_va = vftable_vas.back();
+
+  // Start at the first aligned location.
+  const Address kAlignmentMask = sizeof(uint32_t) - 1;
+  const Address kPageMask = kScanPageSize - 1;
+  Address address = (range.start() + kAlignmentMask) & ~kAlignmentMask;
+  std::vector<uint32_t> block(kScanBlockSize / sizeof(uint32_t));
+  while (address < range.end() &&
+         range.end() - address >= sizeof(uint32_t)) {
+    Size size = static_cast<Size>(
+        std::min<Address>(kScanBlockSize, range.end() - address));
+    size_t data_cnt = 0;
+    if (!bit_source->GetFrom(AddressRange(address, size), &data_cnt,
+                             block.data())) {
+      // Skip to the next page, which may be available.
+      address = (address + kScanPageSize) & ~kPageMask;
+      continue;
+    }
+    DCHECK_LT(0U, data_cnt);
+
+    // Most values are outside of the bounds of the vftables, which is tested
+    // first.
+    size_t value_cnt = data_cnt / sizeof(uint32_t);
+    for (size_t i = 0; i < value_cnt; ++i) {
+      Address value = block[i];
+      if (value < min_va || value > max_va)
+        continue;
+      if (std::binary_search(vftable_vas.begin(), vftable_vas.end(), value))
+        locations->push_back(address + i * sizeof(uint32_t));
+    }
+
+    // A trailing partial value is read again with the next block, and skipped
+    // if that's all there is.
+    address += std::max<size_t>(value_cnt, 1U) * sizeof(uint32_t);
+  }
+}
+
 bool VftablePtrValidator::GetVFTableVAs(
     ProcessState* process_state,
     SymbolProvider* symbol_provider,
@@ -144,7 +206,7 @@ bool VftablePtrValidator::GetVFTableVAs(
 
 bool VftablePtrValidator::ValidateTypedData(
     const TypedData& typed_data,
-    const base::hash_set<Address>& vftable_vas,
+    const std::vector<Address>& vftable_vas,
     ValidationReport* report) {
   DCHECK(typed_data.IsValid());
   DCHECK(report);
@@ -169,7 +231,8 @@ bool VftablePtrValidator::ValidateTypedData(
       case UserDefinedType::Field::VFPTR_KIND: {
         Address vfptr;
         if (field_data.GetPointerValue(&vfptr) &&
-            vftable_vas.find(vfptr) == vftable_vas.end()) {
+            !std::binary_search(vftable_vas.begin(), vftable_vas.end(),
+                                vfptr)) {
           // The value of the vfptr was retrieved but it's not in the allowed
           // set. Add a violation.
           AddViolation(typed_data, report);
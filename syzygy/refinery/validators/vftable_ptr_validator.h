@@ -15,10 +15,13 @@
 #ifndef SYZYGY_REFINERY_VALIDATORS_VFTABLE_PTR_VALIDATOR_H_
 #define SYZYGY_REFINERY_VALIDATORS_VFTABLE_PTR_VALIDATOR_H_
 
+#include <vector>
+
 #include "base/macros.h"
 #include "base/containers/hash_tables.h"
 #include "base/memory/ref_counted.h"
 #include "syzygy/refinery/core/address.h"
+#include "syzygy/refinery/core/bit_source.h"
 #include "syzygy/refinery/symbols/symbol_provider.h"
 #include "syzygy/refinery/types/typed_data.h"
 #include "syzygy/refinery/validators/validator.h"
@@ -36,6 +39,22 @@ class VftablePtrValidator : public Validator {
   ValidationResult Validate(ProcessState* process_state,
                             ValidationReport* report) override;
 
+  // Finds the pointer aligned locations of a range that hold the address of a
+  // vftable. The range is read in large blocks, and the values are tested
+  // against the bounds of the vftables before being looked up, so that the
+  // whole memory of a process can be scanned. The parts of the range that
+  // aren't available in @p bit_source are skipped.
+  // @note this assumes 32-bit pointers.
+  // @param bit_source the source of the memory to scan.
+  // @param range the range to scan.
+  // @param vftable_vas the sorted addresses of the vftables.
+  // @param locations on return, contains the locations that hold the address
+  //     of a vftable, in increasing order.
+  static void ScanForVFTablePtrs(BitSource* bit_source,
+                                 const AddressRange& range,
+                                 const std::vector<Address>& vftable_vas,
+                                 std::vector<Address>* locations);
+
  protected:
   // Retrieves the set of vftable virtual addresses for @p process_state.
   // @param process_state the process_state.
@@ -47,8 +66,9 @@ class VftablePtrValidator : public Validator {
       base::hash_set<Address>* vftable_vas);
 
  private:
+  // @param vftable_vas the sorted addresses of the vftables.
   bool ValidateTypedData(const TypedData& typed_data,
-                         const base::hash_set<RelativeAddress>& vftable_vas,
+                         const std::vector<Address>& vftable_vas,
                          ValidationReport* report);
 
   scoped_refptr<SymbolProvider> symbol_provider_;
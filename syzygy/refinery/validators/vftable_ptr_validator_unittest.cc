@@ -15,6 +15,7 @@
 #include "syzygy/refinery/validators/vftable_ptr_validator.h"
 
 #include <string>
+#include <vector>
 
 #include "base/containers/hash_tables.h"
 #include "base/strings/string_util.h"
@@ -295,4 +296,41 @@ TEST(VftablePtrValidatorTest, GetVFTableVAs) {
   ASSERT_EQ(expected_vftable_vas, vftable_vas);
 }
 
+TEST(VftablePtrValidatorTest, ScanForVFTablePtrs) {
+  const Address kVftable = kAddress + 0x10;
+  const Address kVftableOther = kAddressOther + 0x10;
+
+  // Two runs of memory a few pages apart.
+  ProcessState state;
+  AddBytesRecord(&state, 0x1000, kVftable);
+  AddBytesRecord(&state, 0x1004, kVftable + 4);  // Within the bounds.
+  AddBytesRecord(&state, 0x1008, 1);  // Out of the bounds.
+  AddBytesRecord(&state, 0x5000, kVftableOther);
+  AddBytesRecord(&state, 0x5004, kVftable);
+
+  std::vector<Address> vftable_vas;
+  vftable_vas.push_back(kVftable);
+  vftable_vas.push_back(kVftableOther);
+
+  std::vector<Address> locations;
+  VftablePtrValidator::ScanForVFTablePtrs(
+      &state, AddressRange(0x1000, 0x5000), vftable_vas, &locations);
+  std::vector<Address> expected_locations;
+  expected_locations.push_back(0x1000);
+  expected_locations.push_back(0x5000);
+  expected_locations.push_back(0x5004);
+  EXPECT_EQ(expected_locations, locations);
+
+  // Only the aligned values that are entirely within the range are found.
+  VftablePtrValidator::ScanForVFTablePtrs(
+      &state, AddressRange(0x1001, 0x4001), vftable_vas, &locations);
+  EXPECT_TRUE(locations.empty());
+
+  // Nothing is found without vftables.
+  VftablePtrValidator::ScanForVFTablePtrs(
+      &state, AddressRange(0x1000, 0x5000), std::vector<Address>(),
+      &locations);
+  EXPECT_TRUE(locations.empty());
+}
+
 }  // namespace refinery
@@ -18,6 +18,7 @@
 #include "syzygy/block_graph/orderers/original_orderer.h"
 #include "syzygy/block_graph/orderers/random_orderer.h"
 #include "syzygy/block_graph/transforms/fuzzing_transform.h"
+#include "syzygy/core/perf_report.h"
 #include "syzygy/pe/pe_relinker.h"
 #include "syzygy/pe/transforms/explode_basic_blocks_transform.h"
 #include "syzygy/reorder/orderers/explicit_orderer.h"
@@ -57,6 +58,8 @@ const char kUsageFormatStr[] =
     "                          Default is inferred from output-image.\n"
     "    --overwrite           Allow output files to be overwritten.\n"
     "    --padding=<integer>   Add bytes of padding between blocks.\n"
+    "    --perf-report=<path>  Write the durations and the memory usage of\n"
+    "                          the phases of the relinker to a JSON file.\n"
     "    --verbose             Log verbosely.\n"
     "\n"
     "  Testing Options:\n"
@@ -122,6 +125,8 @@ bool RelinkApp::ParseCommandLine(const base::CommandLine* cmd_line) {
 
   output_pdb_path_ = cmd_line->GetSwitchValuePath("output-pdb");
   order_file_path_ = AbsolutePath(cmd_line->GetSwitchValuePath("order-file"));
+  perf_report_path_ =
+      AbsolutePath(cmd_line->GetSwitchValuePath("perf-report"));
   no_augment_pdb_ = cmd_line->HasSwitch("no-augment-pdb");
   compress_pdb_ = cmd_line->HasSwitch("compress-pdb");
   no_strip_strings_ = cmd_line->HasSwitch("no-strip-strings");
@@ -210,6 +215,11 @@ int RelinkApp::Run() {
   relinker.set_compress_pdb(compress_pdb_);
   relinker.set_strip_strings(!no_strip_strings_);
 
+  // The phases are only measured if a report is requested.
+  core::PerfReport perf_report;
+  if (!perf_report_path_.empty())
+    relinker.set_perf_report(&perf_report);
+
   // Initialize the relinker. This does the decomposition, etc.
   if (!relinker.Init()) {
     LOG(ERROR) << "Failed to initialize relinker.";
@@ -281,6 +291,9 @@ int RelinkApp::Run() {
     return 1;
   }
 
+  if (!perf_report_path_.empty() && !perf_report.Save(perf_report_path_))
+    return 1;
+
   return 0;
 }
 
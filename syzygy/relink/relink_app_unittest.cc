@@ -14,6 +14,7 @@
 
 #include "syzygy/relink/relink_app.h"
 
+#include "base/files/file_util.h"
 #include "base/strings/stringprintf.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -43,6 +44,7 @@ class TestRelinkApp : public RelinkApp {
   using RelinkApp::output_image_path_;
   using RelinkApp::output_pdb_path_;
   using RelinkApp::order_file_path_;
+  using RelinkApp::perf_report_path_;
   using RelinkApp::seed_;
   using RelinkApp::padding_;
   using RelinkApp::code_alignment_;
@@ -296,6 +298,7 @@ TEST_F(RelinkAppTest, ParseFullCommandLineWithInputSeedAndMetadata) {
   cmd_line_.AppendSwitch("no-strip-strings");
   cmd_line_.AppendSwitch("overwrite");
   cmd_line_.AppendSwitch("fuzz");
+  cmd_line_.AppendSwitchPath("perf-report", temp_dir_.Append(L"perf.json"));
 
   EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
   EXPECT_EQ(abs_input_image_path_, test_impl_.input_image_path_);
@@ -303,6 +306,7 @@ TEST_F(RelinkAppTest, ParseFullCommandLineWithInputSeedAndMetadata) {
   EXPECT_EQ(output_image_path_, test_impl_.output_image_path_);
   EXPECT_EQ(output_pdb_path_, test_impl_.output_pdb_path_);
   EXPECT_TRUE(test_impl_.order_file_path_.empty());
+  EXPECT_EQ(temp_dir_.Append(L"perf.json"), test_impl_.perf_report_path_);
   EXPECT_EQ(seed_, test_impl_.seed_);
   EXPECT_EQ(padding_, test_impl_.padding_);
   EXPECT_EQ(code_alignment_, test_impl_.code_alignment_);
@@ -353,6 +357,21 @@ TEST_F(RelinkAppTest, RandomRelink) {
   ASSERT_NO_FATAL_FAILURE(CheckTestDll(output_image_path_));
 }
 
+TEST_F(RelinkAppTest, RandomRelinkWithPerfReport) {
+  base::FilePath perf_report_path(temp_dir_.Append(L"perf.json"));
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+  cmd_line_.AppendSwitchPath("input-pdb", input_pdb_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitchPath("output-pdb", output_pdb_path_);
+  cmd_line_.AppendSwitchASCII("seed", base::StringPrintf("%d", seed_));
+  cmd_line_.AppendSwitchPath("perf-report", perf_report_path);
+  cmd_line_.AppendSwitch("overwrite");
+
+  ASSERT_EQ(0, test_app_.Run());
+  ASSERT_NO_FATAL_FAILURE(CheckTestDll(output_image_path_));
+  EXPECT_TRUE(base::PathExists(perf_report_path));
+}
+
 TEST_F(RelinkAppTest, RandomRelinkBasicBlocks) {
   cmd_line_.AppendSwitchPath("input-image", input_image_path_);
   cmd_line_.AppendSwitchPath("input-pdb", input_pdb_path_);
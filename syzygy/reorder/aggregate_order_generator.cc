@@ -0,0 +1,292 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/reorder/aggregate_order_generator.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace reorder {
+
+namespace {
+
+typedef block_graph::BlockGraph::Block Block;
+
+// @returns the bucket of the first-touch rank histograms that holds @p rank.
+size_t GetRankBucket(size_t rank) {
+  size_t bucket = 0;
+  while (rank != 0) {
+    rank >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+// A code block that was entered, and the key it is laid out by.
+struct EnteredBlock {
+  const Block* block;
+  double median_rank;
+  double weight;
+};
+
+// Orders the entered blocks by increasing median first-touch rank, then by
+// decreasing weight, then by ID so that the order is deterministic.
+bool EnteredBlockLess(const EnteredBlock& block1, const EnteredBlock& block2) {
+  if (block1.median_rank != block2.median_rank)
+    return block1.median_rank < block2.median_rank;
+  if (block1.weight != block2.weight)
+    return block1.weight > block2.weight;
+  return block1.block->id() < block2.block->id();
+}
+
+}  // namespace
+
+AggregateOrderGenerator::BlockAggregate::BlockAggregate() : weight(0.0) {
+  std::fill(rank_weights, rank_weights + kRankBucketCount, 0.0);
+}
+
+AggregateOrderGenerator::AggregateOrderGenerator()
+    : Reorderer::OrderGenerator("Aggregate Order Generator") {
+}
+
+AggregateOrderGenerator::~AggregateOrderGenerator() {
+}
+
+bool AggregateOrderGenerator::OnProcessStarted(uint32_t process_id,
+                                               const UniqueTime& time) {
+  // Process IDs get reused, and the previous process with this ID may not
+  // have ended within the logging period.
+  ProcessState& state = processes_[process_id];
+  state = ProcessState();
+
+  ProcessWeightMap::iterator it = pending_weights_.find(process_id);
+  if (it != pending_weights_.end()) {
+    state.weight = it->second;
+    pending_weights_.erase(it);
+  }
+  return true;
+}
+
+bool AggregateOrderGenerator::OnProcessEnded(uint32_t process_id,
+                                             const UniqueTime& time) {
+  processes_.erase(process_id);
+  return true;
+}
+
+bool AggregateOrderGenerator::OnProcessWeight(uint32_t process_id,
+                                              double weight) {
+  if (weight < 0.0) {
+    LOG(ERROR) << "Invalid weight " << weight << " for process " << process_id
+               << ".";
+    return false;
+  }
+  pending_weights_[process_id] = weight;
+  return true;
+}
+
+bool AggregateOrderGenerator::OnCodeBlockEntry(const BlockGraph::Block* block,
+                                               RelativeAddress address,
+                                               uint32_t process_id,
+                                               uint32_t thread_id,
+                                               const UniqueTime& time) {
+  DCHECK(block != NULL);
+
+  // Only the first entry of a block is aggregated.
+  ProcessState& state = processes_[process_id];
+  size_t rank = state.entered_blocks.size();
+  if (!state.entered_blocks.insert(block).second)
+    return true;
+
+  BlockAggregate& aggregate = aggregates_[block];
+  aggregate.weight += state.weight;
+  aggregate.rank_weights[GetRankBucket(rank)] += state.weight;
+
+  for (size_t i = 0; i < state.recent_blocks.size(); ++i) {
+    AddNeighbor(block, state.recent_blocks[i], state.weight);
+    AddNeighbor(state.recent_blocks[i], block, state.weight);
+  }
+
+  state.recent_blocks.push_back(block);
+  if (state.recent_blocks.size() > kCoOccurrenceWindow)
+    state.recent_blocks.pop_front();
+  return true;
+}
+
+bool AggregateOrderGenerator::CalculateReordering(const PEFile& pe_file,
+                                                  const ImageLayout& image,
+                                                  bool reorder_code,
+                                                  bool reorder_data,
+                                                  Order* order) {
+  DCHECK(order != NULL);
+
+  order->comment = "Aggregate first-touch ordering";
+  order->sections.clear();
+  order->sections.resize(image.sections.size());
+  for (size_t i = 0; i < image.sections.size(); ++i) {
+    const ImageLayout::SectionInfo& section = image.sections[i];
+    order->sections[i].id = i;
+    order->sections[i].name = section.name;
+    order->sections[i].characteristics = section.characteristics;
+
+    BlockSet placed_blocks;
+    bool is_code = (section.characteristics & IMAGE_SCN_CNT_CODE) != 0;
+    if (is_code && reorder_code) {
+      std::vector<EnteredBlock> entered_blocks;
+      BlockAggregateMap::const_iterator it = aggregates_.begin();
+      for (; it != aggregates_.end(); ++it) {
+        // The blocks that were only entered by processes without weight are
+        // left in their original order.
+        if (it->first->section() != i || it->second.weight <= 0.0)
+          continue;
+        EnteredBlock entered_block = {
+            it->first, GetFirstTouchQuantile(it->first, 0.5),
+            it->second.weight };
+        entered_blocks.push_back(entered_block);
+      }
+      std::sort(entered_blocks.begin(), entered_blocks.end(),
+                EnteredBlockLess);
+
+      // Lay out each block followed by the chain of its closest neighbors.
+      for (size_t j = 0; j < entered_blocks.size(); ++j) {
+        const Block* block = entered_blocks[j].block;
+        while (block != NULL && placed_blocks.insert(block).second) {
+          order->sections[i].blocks.push_back(Order::BlockSpec(block));
+          block = FindChainedNeighbor(block, placed_blocks);
+        }
+      }
+    }
+
+    // Add the remaining blocks in their original order.
+    AddressSpace::RangeMapConstIterPair section_blocks =
+        image.blocks.GetIntersectingBlocks(section.addr, section.size);
+    AddressSpace::RangeMapConstIter& section_it = section_blocks.first;
+    const AddressSpace::RangeMapConstIter& section_end = section_blocks.second;
+    for (; section_it != section_end; ++section_it) {
+      const BlockGraph::Block* block = section_it->second;
+      if (placed_blocks.count(block) > 0)
+        continue;
+      order->sections[i].blocks.push_back(Order::BlockSpec(block));
+    }
+  }
+
+  return true;
+}
+
+double AggregateOrderGenerator::GetFirstTouchQuantile(
+    const BlockGraph::Block* block, double quantile) const {
+  DCHECK(block != NULL);
+  DCHECK_LE(0.0, quantile);
+  DCHECK_GE(1.0, quantile);
+
+  BlockAggregateMap::const_iterator it = aggregates_.find(block);
+  if (it == aggregates_.end())
+    return -1.0;
+
+  // Find the bucket that holds the quantile, and interpolate linearly
+  // within it.
+  const BlockAggregate& aggregate = it->second;
+  double target = quantile * aggregate.weight;
+  double cumulative_weight = 0.0;
+  for (size_t i = 0; i < kRankBucketCount; ++i) {
+    double bucket_weight = aggregate.rank_weights[i];
+    if (bucket_weight <= 0.0)
+      continue;
+
+    double lower = i == 0 ? 0.0 : static_cast<double>(1ULL << (i - 1));
+    double upper = static_cast<double>(1ULL << i);
+    if (cumulative_weight + bucket_weight >= target) {
+      double fraction = (target - cumulative_weight) / bucket_weight;
+      return lower + fraction * (upper - lower);
+    }
+    cumulative_weight += bucket_weight;
+  }
+
+  // Rounding errors may leave the target past the last bucket.
+  return -1.0;
+}
+
+double AggregateOrderGenerator::GetCoOccurrence(
+    const BlockGraph::Block* block1, const BlockGraph::Block* block2) const {
+  DCHECK(block1 != NULL);
+  DCHECK(block2 != NULL);
+
+  BlockAggregateMap::const_iterator it = aggregates_.find(block1);
+  if (it == aggregates_.end())
+    return 0.0;
+
+  const Neighbor* neighbors = it->second.neighbors;
+  for (size_t i = 0; i < kMaxNeighbors; ++i) {
+    if (neighbors[i].block == block2)
+      return neighbors[i].weight;
+  }
+  return 0.0;
+}
+
+void AggregateOrderGenerator::AddNeighbor(const BlockGraph::Block* block,
+                                          const BlockGraph::Block* neighbor,
+                                          double weight) {
+  DCHECK(block != NULL);
+  DCHECK(neighbor != NULL);
+
+  Neighbor* neighbors = aggregates_[block].neighbors;
+  Neighbor* lightest = &neighbors[0];
+  for (size_t i = 0; i < kMaxNeighbors; ++i) {
+    if (neighbors[i].block == neighbor) {
+      neighbors[i].weight += weight;
+      return;
+    }
+    if (neighbors[i].weight < lightest->weight)
+      lightest = &neighbors[i];
+  }
+
+  // Replace the lightest neighbor, or a free slot as they weigh nothing. The
+  // new neighbor inherits its weight, which bounds how much it's
+  // underestimated.
+  lightest->block = neighbor;
+  lightest->weight += weight;
+}
+
+const BlockGraph::Block* AggregateOrderGenerator::FindChainedNeighbor(
+    const BlockGraph::Block* block,
+    const BlockSet& placed_blocks) const {
+  DCHECK(block != NULL);
+
+  BlockAggregateMap::const_iterator it = aggregates_.find(block);
+  DCHECK(it != aggregates_.end());
+
+  const Block* chained_block = NULL;
+  double chained_weight = 0.0;
+  const Neighbor* neighbors = it->second.neighbors;
+  for (size_t i = 0; i < kMaxNeighbors; ++i) {
+    const Block* neighbor = neighbors[i].block;
+    if (neighbor == NULL || neighbor->section() != block->section() ||
+        placed_blocks.count(neighbor) > 0 ||
+        neighbors[i].weight <= chained_weight) {
+      continue;
+    }
+
+    // The neighbor must be entered along with the block by most of the
+    // processes that enter it.
+    BlockAggregateMap::const_iterator neighbor_it = aggregates_.find(neighbor);
+    DCHECK(neighbor_it != aggregates_.end());
+    if (2 * neighbors[i].weight < neighbor_it->second.weight)
+      continue;
+
+    chained_block = neighbor;
+    chained_weight = neighbors[i].weight;
+  }
+  return chained_block;
+}
+
+}  // namespace reorder
@@ -0,0 +1,171 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// An implementation of a Reorderer that keeps a streaming aggregate of the
+// traces rather than their events, so that an order can be computed from a
+// large corpus of traces. The memory used grows with the number of blocks
+// that are entered, and not with the number of traces or events.
+//
+// For each block, the aggregate holds:
+//   - A histogram of the rank at which the processes first entered it, where
+//     the rank is the number of distinct blocks the process entered before.
+//     The buckets are powers of two, and the quantiles of the first-touch
+//     rank are interpolated from them.
+//   - The weight of the processes that first entered it within a few first
+//     touches of each of its neighbors. Only the heaviest neighbors of each
+//     block are tracked, the lightest one being evicted to make room for a new
+//     one, as in the space-saving algorithm.
+//
+// Each process is weighted by the weight of its trace, or 1 when the traces
+// aren't weighted. Only the blocks entered by the running processes are
+// remembered, and they are forgotten when the processes end.
+//
+// The code blocks are laid out by increasing median first-touch rank. After
+// each block come the chain of its heaviest neighbors that haven't been laid
+// out yet, as long as each is entered along with its predecessor in most of
+// the processes. The blocks that weren't entered go after the entered ones,
+// in their original order. The data sections are left in their original
+// order, as the traces only record the function entries.
+
+#ifndef SYZYGY_REORDER_AGGREGATE_ORDER_GENERATOR_H_
+#define SYZYGY_REORDER_AGGREGATE_ORDER_GENERATOR_H_
+
+#include <deque>
+#include <map>
+#include <set>
+
+#include "syzygy/reorder/reorderer.h"
+
+namespace reorder {
+
+// A streaming aggregate order generator. See comment at top of this header
+// file for more details.
+class AggregateOrderGenerator : public Reorderer::OrderGenerator {
+ public:
+  // The number of buckets of the first-touch rank histograms. The first
+  // bucket holds the rank 0, and the bucket N holds the ranks in
+  // [2^(N-1), 2^N).
+  static const size_t kRankBucketCount = 33;
+
+  // The number of preceding first touches of a process that a block is
+  // considered to be entered along with.
+  static const size_t kCoOccurrenceWindow = 4;
+
+  // The number of neighbors tracked for each block.
+  static const size_t kMaxNeighbors = 8;
+
+  AggregateOrderGenerator();
+  virtual ~AggregateOrderGenerator();
+
+  // OrderGenerator implementation.
+  virtual bool OnProcessStarted(uint32_t process_id,
+                                const UniqueTime& time) override;
+  virtual bool OnProcessEnded(uint32_t process_id,
+                              const UniqueTime& time) override;
+  virtual bool OnProcessWeight(uint32_t process_id, double weight) override;
+  virtual bool OnCodeBlockEntry(const BlockGraph::Block* block,
+                                RelativeAddress address,
+                                uint32_t process_id,
+                                uint32_t thread_id,
+                                const UniqueTime& time) override;
+  virtual bool CalculateReordering(const PEFile& pe_file,
+                                   const ImageLayout& image,
+                                   bool reorder_code,
+                                   bool reorder_data,
+                                   Order* order) override;
+
+  // Estimates a quantile of the first-touch rank of a block.
+  // @param block The block.
+  // @param quantile The quantile, in [0, 1].
+  // @returns the estimated rank, or -1 if @p block was never entered.
+  double GetFirstTouchQuantile(const BlockGraph::Block* block,
+                               double quantile) const;
+
+  // @param block1 A block.
+  // @param block2 Another block.
+  // @returns the weight of the processes that entered the blocks along with
+  //     each other, as tracked by the neighbors of @p block1.
+  double GetCoOccurrence(const BlockGraph::Block* block1,
+                         const BlockGraph::Block* block2) const;
+
+ private:
+  typedef std::set<const BlockGraph::Block*> BlockSet;
+
+  // A neighbor of a block, and the weight of their co-occurrences.
+  struct Neighbor {
+    Neighbor() : block(NULL), weight(0.0) { }
+
+    const BlockGraph::Block* block;
+    double weight;
+  };
+
+  // The aggregate of a block.
+  struct BlockAggregate {
+    BlockAggregate();
+
+    // The weight of the processes that entered the block.
+    double weight;
+    // The weight of the processes that first entered the block at each rank
+    // bucket.
+    double rank_weights[kRankBucketCount];
+    // The heaviest neighbors of the block.
+    Neighbor neighbors[kMaxNeighbors];
+  };
+  typedef std::map<const BlockGraph::Block*, BlockAggregate> BlockAggregateMap;
+
+  // The state of a running process.
+  struct ProcessState {
+    ProcessState() : weight(1.0) { }
+
+    double weight;
+    // The blocks the process entered.
+    BlockSet entered_blocks;
+    // The last blocks the process entered for the first time.
+    std::deque<const BlockGraph::Block*> recent_blocks;
+  };
+  typedef std::map<uint32_t, ProcessState> ProcessStateMap;
+  typedef std::map<uint32_t, double> ProcessWeightMap;
+
+  // Adds a co-occurrence to the neighbors of a block.
+  // @param block The block.
+  // @param neighbor The block entered along with @p block.
+  // @param weight The weight of the co-occurrence.
+  void AddNeighbor(const BlockGraph::Block* block,
+                   const BlockGraph::Block* neighbor,
+                   double weight);
+
+  // Finds the heaviest neighbor of a block that hasn't been laid out, and
+  // that is entered along with it in most of the processes that enter it.
+  // @param block The block.
+  // @param placed_blocks The blocks that have been laid out.
+  // @returns the neighbor, or NULL if there is none.
+  const BlockGraph::Block* FindChainedNeighbor(
+      const BlockGraph::Block* block,
+      const BlockSet& placed_blocks) const;
+
+  // The aggregates of the entered blocks.
+  BlockAggregateMap aggregates_;
+
+  // The running processes, by process ID.
+  ProcessStateMap processes_;
+
+  // The weights of the processes that are about to start, by process ID.
+  ProcessWeightMap pending_weights_;
+
+  DISALLOW_COPY_AND_ASSIGN(AggregateOrderGenerator);
+};
+
+}  // namespace reorder
+
+#endif  // SYZYGY_REORDER_AGGREGATE_ORDER_GENERATOR_H_
@@ -0,0 +1,180 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/reorder/aggregate_order_generator.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/reorder/order_generator_test.h"
+
+namespace reorder {
+
+namespace {
+
+using block_graph::BlockGraph;
+using block_graph::ConstBlockVector;
+
+class AggregateOrderGeneratorTest : public testing::OrderGeneratorTest {
+ protected:
+  // Runs a process of a given weight, which enters some blocks in order.
+  void RunProcess(double weight, const ConstBlockVector& blocks) {
+    const uint32_t kProcessId = 1;
+    ASSERT_TRUE(order_generator_.OnProcessWeight(kProcessId, weight));
+    ASSERT_TRUE(order_generator_.OnProcessStarted(kProcessId,
+                                                  GetSystemTime()));
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      ASSERT_TRUE(order_generator_.OnCodeBlockEntry(
+          blocks[i], blocks[i]->addr(), kProcessId, 1, GetSystemTime()));
+    }
+    ASSERT_TRUE(order_generator_.OnProcessEnded(kProcessId, GetSystemTime()));
+  }
+
+  // Adds @p count code blocks to block_graph_.
+  void AddBlocks(size_t count, ConstBlockVector* blocks) {
+    for (size_t i = 0; i < count; ++i) {
+      blocks->push_back(
+          block_graph_.AddBlock(BlockGraph::CODE_BLOCK, 0x10, "block"));
+    }
+  }
+
+  BlockGraph block_graph_;
+  AggregateOrderGenerator order_generator_;
+};
+
+}  // namespace
+
+TEST_F(AggregateOrderGeneratorTest, DoNotReorder) {
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   false,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  // Verify that the order found in order_ matches the original decomposed
+  // image.
+  for (size_t i = 0; i != order_.sections.size(); ++i) {
+    const IMAGE_SECTION_HEADER* section = input_dll_.section_header(i);
+    ExpectSameOrder(section, order_.sections[i].blocks);
+  }
+}
+
+TEST_F(AggregateOrderGeneratorTest, InvalidWeightFails) {
+  EXPECT_FALSE(order_generator_.OnProcessWeight(1, -1.0));
+}
+
+TEST_F(AggregateOrderGeneratorTest, FirstTouchQuantile) {
+  ConstBlockVector blocks;
+  AddBlocks(6, &blocks);
+  EXPECT_EQ(-1.0, order_generator_.GetFirstTouchQuantile(blocks[0], 0.5));
+
+  // The first process weighs 3 and enters blocks[0] first, the second one
+  // weighs 1 and enters it after 5 other blocks.
+  RunProcess(3.0, ConstBlockVector(1, blocks[0]));
+  ConstBlockVector reversed_blocks(blocks.rbegin(), blocks.rend());
+  RunProcess(1.0, reversed_blocks);
+
+  // The ranks are interpolated within the buckets [0, 1) and [4, 8).
+  EXPECT_DOUBLE_EQ(0.0, order_generator_.GetFirstTouchQuantile(blocks[0], 0));
+  EXPECT_DOUBLE_EQ(2.0 / 3,
+                   order_generator_.GetFirstTouchQuantile(blocks[0], 0.5));
+  EXPECT_DOUBLE_EQ(8.0, order_generator_.GetFirstTouchQuantile(blocks[0], 1));
+  EXPECT_DOUBLE_EQ(0.5,
+                   order_generator_.GetFirstTouchQuantile(blocks[5], 0.5));
+}
+
+TEST_F(AggregateOrderGeneratorTest, CoOccurrence) {
+  ConstBlockVector blocks;
+  AddBlocks(6, &blocks);
+
+  // Entering blocks again doesn't count.
+  ConstBlockVector entered_blocks(blocks);
+  entered_blocks.push_back(blocks[0]);
+  entered_blocks.push_back(blocks[5]);
+  RunProcess(2.0, entered_blocks);
+
+  // The blocks co-occur with the blocks first entered within the window.
+  EXPECT_EQ(2.0, order_generator_.GetCoOccurrence(blocks[0], blocks[1]));
+  EXPECT_EQ(2.0, order_generator_.GetCoOccurrence(blocks[4], blocks[0]));
+  EXPECT_EQ(2.0, order_generator_.GetCoOccurrence(blocks[0], blocks[4]));
+  EXPECT_EQ(0.0, order_generator_.GetCoOccurrence(blocks[0], blocks[5]));
+  EXPECT_EQ(0.0, order_generator_.GetCoOccurrence(blocks[5], blocks[0]));
+}
+
+TEST_F(AggregateOrderGeneratorTest, NeighborsAreBounded) {
+  ConstBlockVector blocks;
+  AddBlocks(AggregateOrderGenerator::kMaxNeighbors + 2, &blocks);
+
+  // blocks[0] co-occurs with blocks[1] in 3 processes, and with the next ones
+  // in one process each.
+  ConstBlockVector pair(2, blocks[0]);
+  for (size_t i = 1; i < blocks.size() - 1; ++i) {
+    pair[1] = blocks[i];
+    RunProcess(1.0, pair);
+  }
+  pair[1] = blocks[1];
+  RunProcess(1.0, pair);
+  RunProcess(1.0, pair);
+
+  // The last neighbor evicts the lightest one, and inherits its weight.
+  pair[1] = blocks.back();
+  RunProcess(1.0, pair);
+  EXPECT_EQ(3.0, order_generator_.GetCoOccurrence(blocks[0], blocks[1]));
+  EXPECT_EQ(0.0, order_generator_.GetCoOccurrence(blocks[0], blocks[2]));
+  EXPECT_EQ(2.0,
+            order_generator_.GetCoOccurrence(blocks[0], blocks.back()));
+}
+
+TEST_F(AggregateOrderGeneratorTest, ReorderCode) {
+  // Enter a few code blocks from the end of the .text section.
+  size_t text_index = input_dll_.GetSectionIndex(".text");
+  const pe::ImageLayout::SectionInfo& text = image_layout_.sections[text_index];
+  ConstBlockVector entered_blocks;
+  BlockGraph::AddressSpace::RangeMapConstIterPair text_blocks =
+      image_layout_.blocks.GetIntersectingBlocks(text.addr, text.size);
+  BlockGraph::AddressSpace::RangeMapConstIter it = text_blocks.second;
+  while (it != text_blocks.first && entered_blocks.size() < 4) {
+    --it;
+    if (it->second->type() == BlockGraph::CODE_BLOCK)
+      entered_blocks.push_back(it->second);
+  }
+  ASSERT_EQ(4U, entered_blocks.size());
+  RunProcess(1.0, entered_blocks);
+  RunProcess(1.0, entered_blocks);
+
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   true,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  // The entered blocks come first in the .text section, in the order they
+  // were entered, and the data sections are left alone.
+  const BlockSpecVector& text_specs = order_.sections[text_index].blocks;
+  ASSERT_LE(entered_blocks.size(), text_specs.size());
+  for (size_t i = 0; i < entered_blocks.size(); ++i)
+    EXPECT_EQ(entered_blocks[i], text_specs[i].block);
+  for (size_t i = 0; i != order_.sections.size(); ++i) {
+    const IMAGE_SECTION_HEADER* section = input_dll_.section_header(i);
+    if (i == text_index)
+      ExpectDifferentOrder(section, order_.sections[i].blocks);
+    else
+      ExpectSameOrder(section, order_.sections[i].blocks);
+  }
+}
+
+}  // namespace reorder
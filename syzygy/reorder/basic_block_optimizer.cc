@@ -18,6 +18,8 @@
 #include <deque>
 #include <set>
 
+#include "base/bind.h"
+#include "syzygy/application/work_pool.h"
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/basic_block_decomposer.h"
 #include "syzygy/block_graph/basic_block_subgraph.h"
@@ -575,7 +577,8 @@ void BasicBlockOptimizer::BasicBlockOrderer::AddRecursiveDataReferences(
 }
 
 BasicBlockOptimizer::BasicBlockOptimizer()
-    : cold_section_name_(kDefaultColdSectionName) {
+    : cold_section_name_(kDefaultColdSectionName),
+      thread_count_(1) {
 }
 
 bool BasicBlockOptimizer::Optimize(
@@ -611,29 +614,41 @@ bool BasicBlockOptimizer::Optimize(
   cold_section_spec->id = Order::SectionSpec::kNewSectionId;
   cold_section_spec->characteristics = pe::kCodeCharacteristics;
 
-  pe::PETransformPolicy policy;
+  // Gather the blocks of all the sections in the order in which they are
+  // placed, keeping track of where each section ends.
+  ConstBlockVector blocks;
+  std::vector<size_t> section_ends(num_sections);
+  for (size_t i = 0; i < num_sections; ++i) {
+    GetSectionBlocks(image_layout, explicit_blocks, order->sections[i],
+                     &blocks);
+    section_ends[i] = blocks.size();
+  }
+
+  // Optimize the blocks independently of each other.
+  BlockResults results(blocks.size());
+  if (!OptimizeBlocks(image_layout, entry_counts, blocks, &results))
+    return false;
 
   // Iterate over the sections in the original order and update their basic-
-  // block orderings.
+  // block orderings. The results are merged in the order of the blocks, so
+  // the ordering doesn't depend on the number of threads.
+  size_t block_index = 0;
   for (size_t i = 0; i < num_sections; ++i) {
-    Order::SectionSpec* section_spec = &order->sections[i];
     Order::BlockSpecVector warm_block_specs;
     Order::BlockSpecVector cold_block_specs;
-
-    // Get the collection of warm and cold block spec for this section.
-    if (!OptimizeSection(policy,
-                         image_layout,
-                         entry_counts,
-                         explicit_blocks,
-                         section_spec,
-                         &warm_block_specs,
-                         &cold_block_specs)) {
-      return false;
+    for (; block_index < section_ends[i]; ++block_index) {
+      BlockResult& result = results[block_index];
+      warm_block_specs.insert(warm_block_specs.end(),
+                              result.warm_block_specs.begin(),
+                              result.warm_block_specs.end());
+      cold_block_specs.insert(cold_block_specs.end(),
+                              result.cold_block_specs.begin(),
+                              result.cold_block_specs.end());
     }
 
     // Replace the block specs in the original section with those found to
     // be warm, and append the cold blocks to the end of the cold section.
-    section_spec->blocks.swap(warm_block_specs);
+    order->sections[i].blocks.swap(warm_block_specs);
     cold_section_spec->blocks.insert(cold_section_spec->blocks.end(),
                                      cold_block_specs.begin(),
                                      cold_block_specs.end());
@@ -642,6 +657,44 @@ bool BasicBlockOptimizer::Optimize(
   return true;
 }
 
+bool BasicBlockOptimizer::OptimizeBlocks(
+    const ImageLayout& image_layout,
+    const IndexedFrequencyInformation& entry_counts,
+    const ConstBlockVector& blocks,
+    BlockResults* results) const {
+  DCHECK(results != NULL);
+  DCHECK_EQ(blocks.size(), results->size());
+
+  // The blocks that failed have logged why.
+  application::WorkPool pool(thread_count_);
+  return pool.Run(blocks.size(),
+                  base::Bind(&BasicBlockOptimizer::OptimizeBlockAt,
+                             &image_layout, &entry_counts, &blocks, results));
+}
+
+// static
+bool BasicBlockOptimizer::OptimizeBlockAt(
+    const ImageLayout* image_layout,
+    const IndexedFrequencyInformation* entry_counts,
+    const ConstBlockVector* blocks,
+    BlockResults* results,
+    size_t index) {
+  DCHECK(image_layout != NULL);
+  DCHECK(entry_counts != NULL);
+  DCHECK(blocks != NULL);
+  DCHECK(results != NULL);
+
+  pe::PETransformPolicy policy;
+  BlockResult* result = &results->at(index);
+  result->succeeded = OptimizeBlock(policy,
+                                    blocks->at(index),
+                                    *image_layout,
+                                    *entry_counts,
+                                    &result->warm_block_specs,
+                                    &result->cold_block_specs);
+  return result->succeeded;
+}
+
 // Get an ordered list of warm and cold basic blocks for the given @p block.
 bool BasicBlockOptimizer::OptimizeBlock(
     const pe::PETransformPolicy& policy,
@@ -735,42 +788,29 @@ bool BasicBlockOptimizer::OptimizeBlock(
   return true;
 }
 
-bool BasicBlockOptimizer::OptimizeSection(
-    const pe::PETransformPolicy& policy,
+void BasicBlockOptimizer::GetSectionBlocks(
     const ImageLayout& image_layout,
-    const IndexedFrequencyInformation& entry_counts,
     const ConstBlockVector& explicit_blocks,
-    Order::SectionSpec* orig_section_spec,
-    Order::BlockSpecVector* warm_block_specs,
-    Order::BlockSpecVector* cold_block_specs) {
-  DCHECK(orig_section_spec != NULL);
-  DCHECK(warm_block_specs != NULL);
-  DCHECK(cold_block_specs != NULL);
+    const Order::SectionSpec& section_spec,
+    ConstBlockVector* blocks) {
+  DCHECK(blocks != NULL);
 
   // Place all of the explicitly ordered blocks.
-  for (size_t i = 0; i < orig_section_spec->blocks.size(); ++i) {
-    Order::BlockSpec* block_spec = &orig_section_spec->blocks[i];
-    DCHECK(block_spec->block != NULL);
-    DCHECK(block_spec->basic_block_offsets.empty());
-    DCHECK(IsExplicitBlock(explicit_blocks, block_spec->block));
-
-    if (!OptimizeBlock(policy,
-                       block_spec->block,
-                       image_layout,
-                       entry_counts,
-                       warm_block_specs,
-                       cold_block_specs)) {
-      return false;
-    }
+  for (size_t i = 0; i < section_spec.blocks.size(); ++i) {
+    const Order::BlockSpec& block_spec = section_spec.blocks[i];
+    DCHECK(block_spec.block != NULL);
+    DCHECK(block_spec.basic_block_offsets.empty());
+    DCHECK(IsExplicitBlock(explicit_blocks, block_spec.block));
+    blocks->push_back(block_spec.block);
   }
 
   // If we are updating a preexisting section, then account for the rest of
   // the blocks in the section. We leave these in their original relative
   // ordering.
-  if (orig_section_spec->id != Order::SectionSpec::kNewSectionId) {
-    DCHECK_GT(image_layout.sections.size(), orig_section_spec->id);
+  if (section_spec.id != Order::SectionSpec::kNewSectionId) {
+    DCHECK_GT(image_layout.sections.size(), section_spec.id);
     const ImageLayout::SectionInfo& section_info =
-        image_layout.sections[orig_section_spec->id];
+        image_layout.sections[section_spec.id];
 
     // Get an iterator pair denoting all of the blocks in the section.
     RangeMapConstIterPair iter_pair(
@@ -784,19 +824,10 @@ bool BasicBlockOptimizer::OptimizeSection(
       if (IsExplicitBlock(explicit_blocks, it->second))
         continue;
 
-      // We apply the same optimization as for explicitly placed blocks.
-      if (!OptimizeBlock(policy,
-                         it->second,
-                         image_layout,
-                         entry_counts,
-                         warm_block_specs,
-                         cold_block_specs)) {
-        return false;
-      }
+      // These get the same optimization as the explicitly placed blocks.
+      blocks->push_back(it->second);
     }
   }
-
-  return true;
 }
 
 }  // namespace reorder
@@ -16,6 +16,7 @@
 #define SYZYGY_REORDER_BASIC_BLOCK_OPTIMIZER_H_
 
 #include <string>
+#include <vector>
 
 #include "base/strings/string_piece.h"
 #include "syzygy/block_graph/basic_block.h"
@@ -54,6 +55,17 @@ class BasicBlockOptimizer {
     value.CopyToString(&cold_section_name_);
   }
 
+  // @returns the number of threads on which the blocks are optimized.
+  size_t thread_count() const { return thread_count_; }
+
+  // Sets the number of threads on which the blocks are optimized. The blocks
+  // are optimized independently of each other, and the resulting ordering
+  // doesn't depend on the number of threads.
+  void set_thread_count(size_t thread_count) {
+    DCHECK_LT(0u, thread_count);
+    thread_count_ = thread_count;
+  }
+
   // Basic-block optimize the given @p order.
   bool Optimize(const ImageLayout& image_layout,
                 const IndexedFrequencyInformation& entry_counts,
@@ -63,6 +75,26 @@ class BasicBlockOptimizer {
   typedef block_graph::BlockGraph BlockGraph;
   typedef block_graph::ConstBlockVector ConstBlockVector;
 
+  // The warm and cold block specs of an optimized block.
+  struct BlockResult {
+    BlockResult() : succeeded(false) { }
+
+    bool succeeded;
+    Order::BlockSpecVector warm_block_specs;
+    Order::BlockSpecVector cold_block_specs;
+  };
+  typedef std::vector<BlockResult> BlockResults;
+
+  // Optimizes the block at @p index of @p blocks into the result of the same
+  // index. This is called concurrently for different blocks. The transform
+  // policy caches its results, so each block gets a policy of its own.
+  // @returns true on success, false otherwise.
+  static bool OptimizeBlockAt(const ImageLayout* image_layout,
+                              const IndexedFrequencyInformation* entry_counts,
+                              const ConstBlockVector* blocks,
+                              BlockResults* results,
+                              size_t index);
+
   // Optimize the layout of all basic-blocks in a block.
   static bool OptimizeBlock(const pe::PETransformPolicy& policy,
                             const BlockGraph::Block* block,
@@ -71,20 +103,34 @@ class BasicBlockOptimizer {
                             Order::BlockSpecVector* warm_block_specs,
                             Order::BlockSpecVector* cold_block_specs);
 
-  // Optimize the layout of all basic-blocks in a section, as defined by the
-  // given @p section_spec and the original @p image_layout.
-  static bool OptimizeSection(const pe::PETransformPolicy& policy,
-                              const ImageLayout& image_layout,
-                              const IndexedFrequencyInformation& entry_counts,
-                              const ConstBlockVector& explicit_blocks,
-                              Order::SectionSpec* orig_section_spec,
-                              Order::BlockSpecVector* warm_block_specs,
-                              Order::BlockSpecVector* cold_block_specs);
+  // Gets the blocks of a section in the order in which they are placed, as
+  // defined by the given @p section_spec and the original @p image_layout:
+  // the explicitly ordered blocks first, then the other blocks of the section
+  // in their original relative order.
+  static void GetSectionBlocks(const ImageLayout& image_layout,
+                               const ConstBlockVector& explicit_blocks,
+                               const Order::SectionSpec& section_spec,
+                               ConstBlockVector* blocks);
+
+  // Optimize the layout of all basic-blocks in the given blocks, on
+  // thread_count_ threads.
+  // @param image_layout The original image layout.
+  // @param entry_counts The basic-block entry counts.
+  // @param blocks The blocks to optimize.
+  // @param results Receives the results of the blocks, in the same order.
+  // @returns true if all the blocks were optimized, false otherwise.
+  bool OptimizeBlocks(const ImageLayout& image_layout,
+                      const IndexedFrequencyInformation& entry_counts,
+                      const ConstBlockVector& blocks,
+                      BlockResults* results) const;
 
   // The name of the (new) section in which to place cold blocks and
   // basic-blocks.
   std::string cold_section_name_;
 
+  // The number of threads on which the blocks are optimized.
+  size_t thread_count_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(BasicBlockOptimizer);
 };
@@ -477,4 +477,46 @@ TEST_F(BasicBlockOptimizerTest, HotCold) {
             order.sections.back().blocks[0].basic_block_offsets.size());
 }
 
+TEST_F(BasicBlockOptimizerTest, ParallelMatchesSerial) {
+  EXPECT_EQ(1u, optimizer_.thread_count());
+
+  // Make every code block warm, so that the decomposable blocks are all
+  // basic-block optimized.
+  IndexedFrequencyInformation entry_counts;
+  entry_counts.num_entries = 0;
+  entry_counts.num_columns = 1;
+  entry_counts.data_type = ::common::IndexedFrequencyData::BASIC_BLOCK_ENTRY;
+  entry_counts.frequency_size = 4;
+  BlockGraph::AddressSpace::RangeMapConstIter it = image_layout_.blocks.begin();
+  for (; it != image_layout_.blocks.end(); ++it) {
+    if (it->second->type() == BlockGraph::CODE_BLOCK)
+      entry_counts.frequency_map[std::make_pair(it->first.start(), 0)] = 1;
+  }
+
+  Order serial_order;
+  ASSERT_TRUE(optimizer_.Optimize(image_layout_, entry_counts, &serial_order));
+
+  BasicBlockOptimizer parallel_optimizer;
+  parallel_optimizer.set_thread_count(4);
+  EXPECT_EQ(4u, parallel_optimizer.thread_count());
+  Order parallel_order;
+  ASSERT_TRUE(parallel_optimizer.Optimize(image_layout_, entry_counts,
+                                          &parallel_order));
+
+  ASSERT_EQ(serial_order.sections.size(), parallel_order.sections.size());
+  for (size_t i = 0; i < serial_order.sections.size(); ++i) {
+    const Order::BlockSpecVector& serial_blocks =
+        serial_order.sections[i].blocks;
+    const Order::BlockSpecVector& parallel_blocks =
+        parallel_order.sections[i].blocks;
+    EXPECT_EQ(serial_order.sections[i].name, parallel_order.sections[i].name);
+    ASSERT_EQ(serial_blocks.size(), parallel_blocks.size());
+    for (size_t k = 0; k < serial_blocks.size(); ++k) {
+      EXPECT_EQ(serial_blocks[k].block, parallel_blocks[k].block);
+      EXPECT_EQ(serial_blocks[k].basic_block_offsets,
+                parallel_blocks[k].basic_block_offsets);
+    }
+  }
+}
+
 }  // namespace reorder
@@ -0,0 +1,288 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/reorder/call_graph_order_generator.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace reorder {
+
+namespace {
+
+typedef block_graph::BlockGraph::Block Block;
+
+// The depth up to which the references of the code blocks are followed to
+// find the data blocks they touch. This reaches the vtables and the other
+// tables of pointers that the code refers to through global data.
+const size_t kDataReferenceDepth = 2;
+
+// A cluster of code blocks, which are laid out contiguously.
+struct Cluster {
+  Cluster() : size(0), weight(0) { }
+
+  // @returns the weight of the cluster per byte.
+  double Density() const {
+    return static_cast<double>(weight) / std::max<size_t>(size, 1);
+  }
+
+  std::vector<const Block*> blocks;
+  size_t size;
+  uint64_t weight;
+};
+
+// Sorts the blocks by decreasing weight, and then by increasing ID.
+struct BlockWeightSort {
+  bool operator()(const std::pair<const Block*, uint64_t>& bw1,
+                  const std::pair<const Block*, uint64_t>& bw2) const {
+    if (bw1.second != bw2.second)
+      return bw1.second > bw2.second;
+    return bw1.first->id() < bw2.first->id();
+  }
+};
+
+// Sorts the clusters by decreasing density.
+struct ClusterDensitySort {
+  bool operator()(const Cluster* c1, const Cluster* c2) const {
+    return c1->Density() > c2->Density();
+  }
+};
+
+}  // namespace
+
+CallGraphOrderGenerator::CallGraphOrderGenerator()
+    : Reorderer::OrderGenerator("Call Graph Order Generator"),
+      max_cluster_size_(kDefaultMaxClusterSize) {
+}
+
+CallGraphOrderGenerator::~CallGraphOrderGenerator() {
+}
+
+bool CallGraphOrderGenerator::OnProcessEnded(uint32_t process_id,
+                                             const UniqueTime& time) {
+  // Process IDs get reused, so forget about the threads of this one.
+  last_blocks_.erase(
+      last_blocks_.lower_bound(ThreadKey(process_id, 0)),
+      last_blocks_.upper_bound(ThreadKey(process_id, UINT32_MAX)));
+  return true;
+}
+
+bool CallGraphOrderGenerator::OnCodeBlockEntry(const BlockGraph::Block* block,
+                                               RelativeAddress address,
+                                               uint32_t process_id,
+                                               uint32_t thread_id,
+                                               const UniqueTime& time) {
+  DCHECK(block != NULL);
+
+  // The previous block entered on this thread is taken as the caller.
+  const BlockGraph::Block*& last_block =
+      last_blocks_[ThreadKey(process_id, thread_id)];
+  AddCalls(last_block, block, 1);
+  last_block = block;
+  return true;
+}
+
+bool CallGraphOrderGenerator::OnCodeBlockCall(const BlockGraph::Block* caller,
+                                              const BlockGraph::Block* callee,
+                                              uint32_t process_id,
+                                              uint32_t thread_id,
+                                              size_t call_count) {
+  DCHECK(caller != NULL);
+  DCHECK(callee != NULL);
+
+  AddCalls(caller, callee, call_count);
+  return true;
+}
+
+bool CallGraphOrderGenerator::CalculateReordering(const PEFile& pe_file,
+                                                  const ImageLayout& image,
+                                                  bool reorder_code,
+                                                  bool reorder_data,
+                                                  Order* order) {
+  DCHECK(order != NULL);
+
+  // Initialize the section list and ordering meta data.
+  order->comment = "Call-graph clustering ordering";
+  order->sections.clear();
+  order->sections.resize(image.sections.size());
+  for (size_t i = 0; i < image.sections.size(); ++i) {
+    order->sections[i].id = i;
+    order->sections[i].name = image.sections[i].name;
+    order->sections[i].characteristics = image.sections[i].characteristics;
+  }
+
+  // Lay out the code blocks, which also drive the layout of the data blocks.
+  block_graph::ConstBlockVector code_blocks;
+  if (reorder_code || reorder_data)
+    ClusterCodeBlocks(&code_blocks);
+
+  BlockSet inserted_blocks;
+  if (reorder_code) {
+    for (size_t i = 0; i < code_blocks.size(); ++i) {
+      const BlockGraph::Block* block = code_blocks[i];
+      order->sections[block->section()].blocks.push_back(
+          Order::BlockSpec(block));
+      inserted_blocks.insert(block);
+    }
+  }
+
+  // Place the data blocks in the order in which the code refers to them, so
+  // that the data used by the hot clusters shares pages.
+  if (reorder_data) {
+    for (size_t i = 0; i < code_blocks.size(); ++i)
+      InsertDataBlocks(kDataReferenceDepth, code_blocks[i], order,
+                       &inserted_blocks);
+  }
+
+  // Add the remaining blocks in each section to the order.
+  for (size_t i = 0; i < image.sections.size(); ++i) {
+    const ImageLayout::SectionInfo& section = image.sections[i];
+    AddressSpace::RangeMapConstIterPair section_blocks =
+        image.blocks.GetIntersectingBlocks(section.addr, section.size);
+    AddressSpace::RangeMapConstIter& section_it = section_blocks.first;
+    const AddressSpace::RangeMapConstIter& section_end = section_blocks.second;
+    for (; section_it != section_end; ++section_it) {
+      const BlockGraph::Block* block = section_it->second;
+      if (inserted_blocks.count(block) > 0)
+        continue;
+      order->sections[i].blocks.push_back(Order::BlockSpec(block));
+    }
+  }
+
+  return true;
+}
+
+void CallGraphOrderGenerator::ClusterCodeBlocks(
+    block_graph::ConstBlockVector* code_blocks) const {
+  DCHECK(code_blocks != NULL);
+
+  // Find the heaviest caller of each block.
+  typedef std::pair<const BlockGraph::Block*, uint64_t> BlockWeight;
+  std::map<const BlockGraph::Block*, BlockWeight> heaviest_callers;
+  EdgeWeightMap::const_iterator edge_it = edge_weights_.begin();
+  for (; edge_it != edge_weights_.end(); ++edge_it) {
+    BlockWeight& heaviest = heaviest_callers[edge_it->first.second];
+    if (heaviest.first == NULL || edge_it->second > heaviest.second)
+      heaviest = BlockWeight(edge_it->first.first, edge_it->second);
+  }
+
+  // Start with a cluster per block, and visit the blocks by decreasing
+  // weight.
+  std::vector<Cluster> clusters(block_weights_.size());
+  std::map<const BlockGraph::Block*, Cluster*> block_clusters;
+  std::vector<BlockWeight> sorted_blocks(block_weights_.begin(),
+                                         block_weights_.end());
+  std::sort(sorted_blocks.begin(), sorted_blocks.end(), BlockWeightSort());
+  for (size_t i = 0; i < sorted_blocks.size(); ++i) {
+    const BlockGraph::Block* block = sorted_blocks[i].first;
+    clusters[i].blocks.push_back(block);
+    clusters[i].size = block->size();
+    clusters[i].weight = sorted_blocks[i].second;
+    block_clusters[block] = &clusters[i];
+  }
+
+  // Append the cluster of each block to the cluster of its heaviest caller.
+  for (size_t i = 0; i < sorted_blocks.size(); ++i) {
+    const BlockGraph::Block* block = sorted_blocks[i].first;
+    std::map<const BlockGraph::Block*, BlockWeight>::const_iterator
+        caller_it = heaviest_callers.find(block);
+    if (caller_it == heaviest_callers.end())
+      continue;
+
+    Cluster* caller_cluster = block_clusters[caller_it->second.first];
+    Cluster* cluster = block_clusters[block];
+    if (caller_cluster == cluster ||
+        caller_cluster->size + cluster->size > max_cluster_size_) {
+      continue;
+    }
+
+    for (size_t j = 0; j < cluster->blocks.size(); ++j)
+      block_clusters[cluster->blocks[j]] = caller_cluster;
+    caller_cluster->blocks.insert(caller_cluster->blocks.end(),
+                                  cluster->blocks.begin(),
+                                  cluster->blocks.end());
+    caller_cluster->size += cluster->size;
+    caller_cluster->weight += cluster->weight;
+    *cluster = Cluster();
+  }
+
+  // Lay out the clusters by decreasing density.
+  std::vector<const Cluster*> sorted_clusters;
+  for (size_t i = 0; i < clusters.size(); ++i) {
+    if (!clusters[i].blocks.empty())
+      sorted_clusters.push_back(&clusters[i]);
+  }
+  std::stable_sort(sorted_clusters.begin(), sorted_clusters.end(),
+                   ClusterDensitySort());
+  for (size_t i = 0; i < sorted_clusters.size(); ++i) {
+    code_blocks->insert(code_blocks->end(),
+                        sorted_clusters[i]->blocks.begin(),
+                        sorted_clusters[i]->blocks.end());
+  }
+}
+
+void CallGraphOrderGenerator::InsertDataBlocks(
+    size_t max_depth,
+    const BlockGraph::Block* block,
+    Order* order,
+    BlockSet* inserted_blocks) const {
+  DCHECK(block != NULL);
+  DCHECK(order != NULL);
+  DCHECK(inserted_blocks != NULL);
+
+  if (max_depth == 0)
+    return;
+
+  // The data blocks referred to by a block are assumed to be touched along
+  // with it, and so are the blocks they refer to, up to |max_depth|.
+  block_graph::ConstBlockVector data_blocks;
+  BlockGraph::Block::ReferenceMap::const_iterator ref_it =
+      block->references().begin();
+  for (; ref_it != block->references().end(); ++ref_it) {
+    const BlockGraph::Block* ref = ref_it->second.referenced();
+    DCHECK(ref != NULL);
+    if (ref->type() != BlockGraph::DATA_BLOCK ||
+        ref->section() == pe::kInvalidSection) {
+      continue;
+    }
+    if (!inserted_blocks->insert(ref).second)
+      continue;
+
+    order->sections[ref->section()].blocks.push_back(Order::BlockSpec(ref));
+    data_blocks.push_back(ref);
+  }
+
+  for (size_t i = 0; i < data_blocks.size(); ++i)
+    InsertDataBlocks(max_depth - 1, data_blocks[i], order, inserted_blocks);
+}
+
+void CallGraphOrderGenerator::AddCalls(const BlockGraph::Block* caller,
+                                       const BlockGraph::Block* callee,
+                                       uint64_t call_count) {
+  DCHECK(callee != NULL);
+  // All code blocks should belong to a defined section.
+  DCHECK_NE(pe::kInvalidSection, callee->section());
+
+  block_weights_[callee] += call_count;
+
+  // Recursion doesn't affect the layout.
+  if (caller == NULL || caller == callee)
+    return;
+
+  // Make sure that the caller has a node, even if it was never entered.
+  block_weights_.insert(std::make_pair(caller, 0));
+  edge_weights_[Edge(caller, callee)] += call_count;
+}
+
+}  // namespace reorder
@@ -0,0 +1,134 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// An implementation of a Reorderer that lays out the code blocks by
+// clustering them on a weighted call-graph, in the manner of the C3 algorithm
+// (call-chain clustering). Functions that call each other frequently end up
+// next to each other, and the hottest clusters come first, which reduces the
+// number of pages and i-TLB entries that the hot code spans.
+//
+// The call-graph is built from the caller-callee pairs of the invocation
+// traces when there are any. For the plain call-traces, which only record the
+// entries of the functions, two functions entered one after the other on a
+// thread are considered to call each other.
+//
+// The functions are visited by decreasing weight, where the weight of a
+// function is the number of times it was entered. The cluster of each of them
+// is appended to the cluster of its heaviest caller, unless the merged cluster
+// would exceed the maximum cluster size. The clusters are then sorted by
+// decreasing density, the ratio of their weight to their size.
+//
+// The data blocks are laid out in the order in which the clustered code refers
+// to them, directly or through other data blocks such as vtables. The data
+// used by the hot code is thus packed on shared pages at the start of the data
+// sections. The blocks that weren't reached go after the ordered ones, in
+// their original order.
+
+#ifndef SYZYGY_REORDER_CALL_GRAPH_ORDER_GENERATOR_H_
+#define SYZYGY_REORDER_CALL_GRAPH_ORDER_GENERATOR_H_
+
+#include <map>
+#include <set>
+#include <utility>
+
+#include "syzygy/reorder/reorderer.h"
+
+namespace reorder {
+
+// A call-graph clustering order generator. See comment at top of this header
+// file for more details.
+class CallGraphOrderGenerator : public Reorderer::OrderGenerator {
+ public:
+  // The default maximum size of a cluster, which is the size of a page.
+  static const size_t kDefaultMaxClusterSize = 4096;
+
+  CallGraphOrderGenerator();
+  virtual ~CallGraphOrderGenerator();
+
+  // @name Accessors and mutators.
+  // @{
+  size_t max_cluster_size() const { return max_cluster_size_; }
+  void set_max_cluster_size(size_t max_cluster_size) {
+    max_cluster_size_ = max_cluster_size;
+  }
+  // @}
+
+  // OrderGenerator implementation.
+  virtual bool OnProcessEnded(uint32_t process_id,
+                              const UniqueTime& time) override;
+  virtual bool OnCodeBlockEntry(const BlockGraph::Block* block,
+                                RelativeAddress address,
+                                uint32_t process_id,
+                                uint32_t thread_id,
+                                const UniqueTime& time) override;
+  virtual bool OnCodeBlockCall(const BlockGraph::Block* caller,
+                               const BlockGraph::Block* callee,
+                               uint32_t process_id,
+                               uint32_t thread_id,
+                               size_t call_count) override;
+  virtual bool CalculateReordering(const PEFile& pe_file,
+                                   const ImageLayout& image,
+                                   bool reorder_code,
+                                   bool reorder_data,
+                                   Order* order) override;
+
+ private:
+  typedef std::pair<const BlockGraph::Block*, const BlockGraph::Block*> Edge;
+  typedef std::map<Edge, uint64_t> EdgeWeightMap;
+  typedef std::map<const BlockGraph::Block*, uint64_t> BlockWeightMap;
+  typedef std::pair<uint32_t, uint32_t> ThreadKey;
+  typedef std::map<ThreadKey, const BlockGraph::Block*> LastBlockMap;
+  typedef std::set<const BlockGraph::Block*> BlockSet;
+
+  // Clusters the code blocks seen in the traces.
+  // @param code_blocks Receives the code blocks, in layout order.
+  void ClusterCodeBlocks(block_graph::ConstBlockVector* code_blocks) const;
+
+  // Appends the data blocks that a block refers to, and that haven't been
+  // inserted yet, to the order.
+  // @param max_depth The depth up to which references are followed.
+  // @param block The block whose references are followed.
+  // @param order The order to append to.
+  // @param inserted_blocks The blocks that have already been ordered.
+  void InsertDataBlocks(size_t max_depth,
+                        const BlockGraph::Block* block,
+                        Order* order,
+                        BlockSet* inserted_blocks) const;
+
+  // Adds calls to the call-graph.
+  // @param caller The calling block.
+  // @param callee The called block.
+  // @param call_count The number of calls.
+  void AddCalls(const BlockGraph::Block* caller,
+                const BlockGraph::Block* callee,
+                uint64_t call_count);
+
+  // The maximum size of a cluster.
+  size_t max_cluster_size_;
+
+  // The weights of the call-graph edges, keyed by caller and callee.
+  EdgeWeightMap edge_weights_;
+
+  // The weights of the call-graph nodes.
+  BlockWeightMap block_weights_;
+
+  // The last block entered by each thread, keyed by process and thread ID.
+  LastBlockMap last_blocks_;
+
+  DISALLOW_COPY_AND_ASSIGN(CallGraphOrderGenerator);
+};
+
+}  // namespace reorder
+
+#endif  // SYZYGY_REORDER_CALL_GRAPH_ORDER_GENERATOR_H_
@@ -0,0 +1,229 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/reorder/call_graph_order_generator.h"
+
+#include <set>
+
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/core/address.h"
+#include "syzygy/core/random_number_generator.h"
+#include "syzygy/reorder/order_generator_test.h"
+
+namespace reorder {
+
+namespace {
+
+class CallGraphOrderGeneratorTest : public testing::OrderGeneratorTest {
+ protected:
+  // Picks distinct random code blocks, small enough to be clustered.
+  // @param count The number of blocks to pick.
+  // @param blocks Receives the blocks.
+  void GetCodeBlocks(size_t count, block_graph::ConstBlockVector* blocks) {
+    DCHECK(blocks != NULL);
+
+    // The blocks must fit in a cluster altogether.
+    const size_t kMaxBlockSize =
+        CallGraphOrderGenerator::kDefaultMaxClusterSize / count;
+
+    core::RandomNumberGenerator random(12345);
+    size_t section_index = input_dll_.GetSectionIndex(".text");
+    const IMAGE_SECTION_HEADER* section =
+        input_dll_.section_header(section_index);
+    ASSERT_TRUE(section != NULL);
+
+    std::set<const block_graph::BlockGraph::Block*> block_set;
+    while (blocks->size() < count) {
+      core::RelativeAddress addr(
+          section->VirtualAddress + random(section->Misc.VirtualSize));
+      const block_graph::BlockGraph::Block* block =
+          image_layout_.blocks.GetBlockByAddress(addr);
+      if (block == NULL ||
+          block->type() != block_graph::BlockGraph::CODE_BLOCK ||
+          block->size() > kMaxBlockSize) {
+        continue;
+      }
+      if (block_set.insert(block).second)
+        blocks->push_back(block);
+    }
+  }
+
+  // @returns the index of @p block in the .text section of the order.
+  size_t GetCodeIndex(const block_graph::BlockGraph::Block* block) {
+    const BlockSpecVector& specs =
+        order_.sections[input_dll_.GetSectionIndex(".text")].blocks;
+    for (size_t i = 0; i < specs.size(); ++i) {
+      if (specs[i].block == block)
+        return i;
+    }
+    return specs.size();
+  }
+
+  CallGraphOrderGenerator order_generator_;
+};
+
+}  // namespace
+
+TEST_F(CallGraphOrderGeneratorTest, DoNotReorder) {
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   false,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  // Verify that the order found in order_ matches the original decomposed
+  // image.
+  for (size_t i = 0; i != order_.sections.size(); ++i) {
+    const IMAGE_SECTION_HEADER* section = input_dll_.section_header(i);
+    ExpectSameOrder(section, order_.sections[i].blocks);
+  }
+}
+
+TEST_F(CallGraphOrderGeneratorTest, ClusterCallers) {
+  block_graph::ConstBlockVector blocks;
+  ASSERT_NO_FATAL_FAILURE(GetCodeBlocks(5, &blocks));
+
+  // block0 calls block1 very often, block2 calls block3 a few times, and
+  // block4 is entered once.
+  order_generator_.OnCodeBlockCall(blocks[0], blocks[1], 1, 1, 1000000);
+  order_generator_.OnCodeBlockCall(blocks[2], blocks[3], 1, 1, 10);
+  order_generator_.OnCodeBlockEntry(blocks[4], blocks[4]->addr(), 1, 2,
+                                    GetSystemTime());
+
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   true,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  // The callees follow their callers, and the hottest cluster comes first.
+  EXPECT_EQ(0U, GetCodeIndex(blocks[0]));
+  EXPECT_EQ(1U, GetCodeIndex(blocks[1]));
+  EXPECT_EQ(GetCodeIndex(blocks[2]) + 1, GetCodeIndex(blocks[3]));
+  EXPECT_GT(5U, GetCodeIndex(blocks[3]));
+  EXPECT_GT(5U, GetCodeIndex(blocks[4]));
+
+  // The data sections are left alone.
+  for (size_t i = 0; i != order_.sections.size(); ++i) {
+    const IMAGE_SECTION_HEADER* section = input_dll_.section_header(i);
+    if (input_dll_.GetSectionName(*section) == ".text")
+      ExpectDifferentOrder(section, order_.sections[i].blocks);
+    else
+      ExpectSameOrder(section, order_.sections[i].blocks);
+  }
+}
+
+TEST_F(CallGraphOrderGeneratorTest, ClusterConsecutiveEntries) {
+  block_graph::ConstBlockVector blocks;
+  ASSERT_NO_FATAL_FAILURE(GetCodeBlocks(3, &blocks));
+
+  // On a thread, block2 is entered after block0, and on another thread
+  // block2 is also entered after block1. The first thread does it more often.
+  for (size_t i = 0; i < 3; ++i) {
+    order_generator_.OnCodeBlockEntry(blocks[0], blocks[0]->addr(), 1, 1,
+                                      GetSystemTime());
+    order_generator_.OnCodeBlockEntry(blocks[2], blocks[2]->addr(), 1, 1,
+                                      GetSystemTime());
+  }
+  order_generator_.OnCodeBlockEntry(blocks[1], blocks[1]->addr(), 1, 2,
+                                    GetSystemTime());
+  order_generator_.OnCodeBlockEntry(blocks[2], blocks[2]->addr(), 1, 2,
+                                    GetSystemTime());
+
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   true,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+  EXPECT_EQ(GetCodeIndex(blocks[0]) + 1, GetCodeIndex(blocks[2]));
+  EXPECT_GT(3U, GetCodeIndex(blocks[1]));
+}
+
+TEST_F(CallGraphOrderGeneratorTest, MaxClusterSize) {
+  block_graph::ConstBlockVector blocks;
+  ASSERT_NO_FATAL_FAILURE(GetCodeBlocks(2, &blocks));
+
+  // Without clustering, the callee is hotter than its caller.
+  order_generator_.set_max_cluster_size(0);
+  order_generator_.OnCodeBlockCall(blocks[0], blocks[1], 1, 1, 1000000);
+
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   true,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+  EXPECT_EQ(0U, GetCodeIndex(blocks[1]));
+  EXPECT_EQ(1U, GetCodeIndex(blocks[0]));
+}
+
+TEST_F(CallGraphOrderGeneratorTest, ReorderData) {
+  // Find a code block that refers to a data block of another section.
+  size_t text_index = input_dll_.GetSectionIndex(".text");
+  const block_graph::BlockGraph::Block* code_block = NULL;
+  const block_graph::BlockGraph::Block* data_block = NULL;
+  block_graph::BlockGraph::BlockMap::const_iterator block_it =
+      block_graph_.blocks().begin();
+  for (; block_it != block_graph_.blocks().end() && data_block == NULL;
+       ++block_it) {
+    const block_graph::BlockGraph::Block* block = &block_it->second;
+    if (block->type() != block_graph::BlockGraph::CODE_BLOCK ||
+        block->section() != text_index) {
+      continue;
+    }
+    block_graph::BlockGraph::Block::ReferenceMap::const_iterator ref_it =
+        block->references().begin();
+    for (; ref_it != block->references().end(); ++ref_it) {
+      const block_graph::BlockGraph::Block* ref = ref_it->second.referenced();
+      if (ref->type() == block_graph::BlockGraph::DATA_BLOCK &&
+          ref->section() != text_index &&
+          ref->section() != pe::kInvalidSection) {
+        code_block = block;
+        data_block = ref;
+        break;
+      }
+    }
+  }
+  ASSERT_TRUE(data_block != NULL);
+
+  order_generator_.OnCodeBlockEntry(code_block, code_block->addr(), 1, 1,
+                                    GetSystemTime());
+
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   false,
+                                                   true,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  // The code is left alone, and the data block that the code refers to comes
+  // first in its section.
+  ExpectSameOrder(input_dll_.section_header(text_index),
+                  order_.sections[text_index].blocks);
+  const BlockSpecVector& data_specs =
+      order_.sections[data_block->section()].blocks;
+  ASSERT_FALSE(data_specs.empty());
+  EXPECT_EQ(data_block, data_specs.front().block);
+}
+
+}  // namespace reorder
@@ -15,7 +15,7 @@
 #ifndef SYZYGY_REORDER_DEAD_CODE_FINDER_H_
 #define SYZYGY_REORDER_DEAD_CODE_FINDER_H_
 
-#include <set>
+#include <unordered_set>
 
 #include "syzygy/reorder/reorderer.h"
 
@@ -47,8 +47,9 @@ class DeadCodeFinder : public Reorderer::OrderGenerator {
   // @}
 
  protected:
-  // The set of blocks observed while reading the call trace.
-  std::set<const Block*> visited_blocks_;
+  // The set of blocks observed while reading the call trace. Every block of
+  // the code sections gets looked up in this, so it's hashed.
+  std::unordered_set<const Block*> visited_blocks_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(DeadCodeFinder);
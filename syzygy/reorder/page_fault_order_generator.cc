@@ -0,0 +1,204 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/reorder/page_fault_order_generator.h"
+
+#include <algorithm>
+
+#include "syzygy/core/random_number_generator.h"
+#include "syzygy/simulate/page_fault_simulation.h"
+
+namespace reorder {
+
+namespace {
+
+typedef block_graph::BlockGraph::Block Block;
+typedef block_graph::ConstBlockVector ConstBlockVector;
+
+// Moves the block at index @p from of @p blocks to index @p to, shifting the
+// blocks in between.
+void MoveBlock(size_t from, size_t to, ConstBlockVector* blocks) {
+  DCHECK(blocks != NULL);
+  DCHECK_LT(from, blocks->size());
+  DCHECK_LT(to, blocks->size());
+
+  ConstBlockVector::iterator begin = blocks->begin();
+  if (from < to)
+    std::rotate(begin + from, begin + from + 1, begin + to + 1);
+  else
+    std::rotate(begin + to, begin + from, begin + from + 1);
+}
+
+}  // namespace
+
+PageFaultOrderGenerator::PageFaultOrderGenerator(uint32_t seed)
+    : Reorderer::OrderGenerator("Page Fault Order Generator"),
+      seed_(seed),
+      iterations_(kDefaultIterations),
+      page_size_(simulate::PageFaultSimulation::kDefaultPageSize),
+      pages_per_code_fault_(
+          simulate::PageFaultSimulation::kDefaultPagesPerCodeFault) {
+}
+
+PageFaultOrderGenerator::~PageFaultOrderGenerator() {
+}
+
+bool PageFaultOrderGenerator::OnProcessEnded(uint32_t process_id,
+                                             const UniqueTime& time) {
+  // Process IDs get reused, so the next process with this ID gets a trace of
+  // its own.
+  ProcessTraceIndexMap::iterator it = running_processes_.find(process_id);
+  if (it != running_processes_.end()) {
+    traces_[it->second].entered_blocks.clear();
+    running_processes_.erase(it);
+  }
+  return true;
+}
+
+bool PageFaultOrderGenerator::OnCodeBlockEntry(const BlockGraph::Block* block,
+                                               RelativeAddress address,
+                                               uint32_t process_id,
+                                               uint32_t thread_id,
+                                               const UniqueTime& time) {
+  DCHECK(block != NULL);
+
+  std::pair<ProcessTraceIndexMap::iterator, bool> result =
+      running_processes_.insert(std::make_pair(process_id, traces_.size()));
+  if (result.second)
+    traces_.push_back(ProcessTrace());
+
+  // Only the first entry of a block can fault.
+  ProcessTrace& trace = traces_[result.first->second];
+  if (trace.entered_blocks.insert(block).second)
+    trace.blocks.push_back(block);
+  return true;
+}
+
+bool PageFaultOrderGenerator::CalculateReordering(const PEFile& pe_file,
+                                                  const ImageLayout& image,
+                                                  bool reorder_code,
+                                                  bool reorder_data,
+                                                  Order* order) {
+  DCHECK(order != NULL);
+
+  order->comment = "Page fault minimizing ordering";
+  order->sections.clear();
+  order->sections.resize(image.sections.size());
+  for (size_t i = 0; i < image.sections.size(); ++i) {
+    const ImageLayout::SectionInfo& section = image.sections[i];
+    order->sections[i].id = i;
+    order->sections[i].name = section.name;
+    order->sections[i].characteristics = section.characteristics;
+
+    // Gather the entered blocks of the code sections, in the order of their
+    // first entry across the traces, and search for a better order.
+    BlockSet inserted_blocks;
+    bool is_code = (section.characteristics & IMAGE_SCN_CNT_CODE) != 0;
+    if (is_code && reorder_code) {
+      ConstBlockVector blocks;
+      for (size_t j = 0; j < traces_.size(); ++j) {
+        const ConstBlockVector& trace_blocks = traces_[j].blocks;
+        for (size_t k = 0; k < trace_blocks.size(); ++k) {
+          if (trace_blocks[k]->section() == i &&
+              inserted_blocks.insert(trace_blocks[k]).second) {
+            blocks.push_back(trace_blocks[k]);
+          }
+        }
+      }
+
+      LOG(INFO) << "Searching an order for " << blocks.size()
+                << " blocks of section " << i << " (" << section.name << ").";
+      SearchOrder(section.addr, seed_ + i, &blocks);
+      for (size_t j = 0; j < blocks.size(); ++j)
+        order->sections[i].blocks.push_back(Order::BlockSpec(blocks[j]));
+    }
+
+    // Add the remaining blocks in their original order.
+    AddressSpace::RangeMapConstIterPair section_blocks =
+        image.blocks.GetIntersectingBlocks(section.addr, section.size);
+    AddressSpace::RangeMapConstIter& section_it = section_blocks.first;
+    const AddressSpace::RangeMapConstIter& section_end = section_blocks.second;
+    for (; section_it != section_end; ++section_it) {
+      const BlockGraph::Block* block = section_it->second;
+      if (inserted_blocks.count(block) > 0)
+        continue;
+      order->sections[i].blocks.push_back(Order::BlockSpec(block));
+    }
+  }
+
+  return true;
+}
+
+size_t PageFaultOrderGenerator::CountPageFaults(
+    RelativeAddress start,
+    const ConstBlockVector& blocks) const {
+  // Compute the addresses of the blocks in this layout.
+  std::map<const Block*, RelativeAddress> addresses;
+  RelativeAddress address = start;
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    address = address.AlignUp(blocks[i]->alignment());
+    addresses[blocks[i]] = address;
+    address += blocks[i]->size();
+  }
+
+  // Each process starts with none of the pages loaded.
+  size_t fault_count = 0;
+  for (size_t i = 0; i < traces_.size(); ++i) {
+    simulate::PageFaultSimulation simulation;
+    simulation.set_page_size(page_size_);
+    simulation.set_pages_per_code_fault(pages_per_code_fault_);
+
+    const ConstBlockVector& trace_blocks = traces_[i].blocks;
+    for (size_t j = 0; j < trace_blocks.size(); ++j) {
+      std::map<const Block*, RelativeAddress>::const_iterator it =
+          addresses.find(trace_blocks[j]);
+      if (it != addresses.end())
+        simulation.OnRangeAccess(it->second.value(), it->first->size());
+    }
+    fault_count += simulation.fault_count();
+  }
+
+  return fault_count;
+}
+
+void PageFaultOrderGenerator::SearchOrder(RelativeAddress start,
+                                          uint32_t seed,
+                                          ConstBlockVector* blocks) const {
+  DCHECK(blocks != NULL);
+
+  if (blocks->size() < 2)
+    return;
+
+  core::RandomNumberGenerator random(seed);
+  size_t fault_count = CountPageFaults(start, *blocks);
+  for (size_t i = 0; i < iterations_; ++i) {
+    size_t from = random(static_cast<uint32_t>(blocks->size()));
+    size_t to = random(static_cast<uint32_t>(blocks->size()));
+    if (from == to)
+      continue;
+
+    // Keep the moves that don't make things worse, as they let the search
+    // move along plateaus.
+    MoveBlock(from, to, blocks);
+    size_t candidate_fault_count = CountPageFaults(start, *blocks);
+    if (candidate_fault_count <= fault_count)
+      fault_count = candidate_fault_count;
+    else
+      MoveBlock(to, from, blocks);
+  }
+
+  LOG(INFO) << "Found an order with " << fault_count << " page faults.";
+}
+
+}  // namespace reorder
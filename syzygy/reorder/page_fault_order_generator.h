@@ -0,0 +1,135 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// An implementation of a Reorderer that searches for the order of the code
+// blocks that causes the fewest page faults on the recorded traces. The
+// candidate orders are scored by replaying the traces through an in-memory
+// PageFaultSimulation, so the resulting order is measured against the same
+// fault model as the simulate tool rather than produced by a heuristic.
+//
+// Only the first entry of a block in a process can fault, as the pages that
+// are loaded stay loaded in the simulation. Each process is thus summarized as
+// the sequence of the blocks it entered, in the order in which they were
+// first entered.
+//
+// The search starts from the order of first entry, and then does a local
+// search: a random block is moved to a random position, and the move is kept
+// if it doesn't increase the number of faults. The blocks that weren't
+// entered go after the entered ones, in their original order. The data
+// sections are left in their original order, as the traces only record the
+// function entries.
+
+#ifndef SYZYGY_REORDER_PAGE_FAULT_ORDER_GENERATOR_H_
+#define SYZYGY_REORDER_PAGE_FAULT_ORDER_GENERATOR_H_
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "syzygy/reorder/reorderer.h"
+
+namespace reorder {
+
+// A page fault minimizing order generator. See comment at top of this header
+// file for more details.
+class PageFaultOrderGenerator : public Reorderer::OrderGenerator {
+ public:
+  // The default number of moves tried in each section.
+  static const size_t kDefaultIterations = 10000;
+
+  // @param seed The seed of the random moves.
+  explicit PageFaultOrderGenerator(uint32_t seed);
+  virtual ~PageFaultOrderGenerator();
+
+  // @name Accessors and mutators.
+  // @{
+  size_t iterations() const { return iterations_; }
+  void set_iterations(size_t iterations) { iterations_ = iterations; }
+  size_t page_size() const { return page_size_; }
+  void set_page_size(size_t page_size) {
+    DCHECK_LT(0U, page_size);
+    page_size_ = page_size;
+  }
+  size_t pages_per_code_fault() const { return pages_per_code_fault_; }
+  void set_pages_per_code_fault(size_t pages_per_code_fault) {
+    DCHECK_LT(0U, pages_per_code_fault);
+    pages_per_code_fault_ = pages_per_code_fault;
+  }
+  // @}
+
+  // OrderGenerator implementation.
+  virtual bool OnProcessEnded(uint32_t process_id,
+                              const UniqueTime& time) override;
+  virtual bool OnCodeBlockEntry(const BlockGraph::Block* block,
+                                RelativeAddress address,
+                                uint32_t process_id,
+                                uint32_t thread_id,
+                                const UniqueTime& time) override;
+  virtual bool CalculateReordering(const PEFile& pe_file,
+                                   const ImageLayout& image,
+                                   bool reorder_code,
+                                   bool reorder_data,
+                                   Order* order) override;
+
+  // Counts the page faults of the traces when some blocks are laid out
+  // contiguously. The accesses to the other blocks are ignored.
+  // @param start The address at which the blocks are laid out.
+  // @param blocks The blocks, in layout order.
+  // @returns the number of page faults.
+  size_t CountPageFaults(RelativeAddress start,
+                         const block_graph::ConstBlockVector& blocks) const;
+
+ protected:
+  // Searches for the order of the blocks of a section that minimizes the
+  // page faults.
+  // @param start The address of the section.
+  // @param seed The seed of the random moves.
+  // @param blocks The blocks to order. Receives them in the best order found.
+  void SearchOrder(RelativeAddress start,
+                   uint32_t seed,
+                   block_graph::ConstBlockVector* blocks) const;
+
+ private:
+  typedef std::set<const BlockGraph::Block*> BlockSet;
+
+  // The blocks entered by a process, in the order of their first entry.
+  struct ProcessTrace {
+    block_graph::ConstBlockVector blocks;
+    // The blocks that have been entered, while the process is running.
+    BlockSet entered_blocks;
+  };
+  typedef std::vector<ProcessTrace> ProcessTraceVector;
+  typedef std::map<uint32_t, size_t> ProcessTraceIndexMap;
+
+  const uint32_t seed_;
+
+  // The number of moves tried in each section.
+  size_t iterations_;
+
+  // The parameters of the page fault simulation.
+  size_t page_size_;
+  size_t pages_per_code_fault_;
+
+  // The traces of the processes, in the order in which they started.
+  ProcessTraceVector traces_;
+
+  // The indices in |traces_| of the running processes, by process ID.
+  ProcessTraceIndexMap running_processes_;
+
+  DISALLOW_COPY_AND_ASSIGN(PageFaultOrderGenerator);
+};
+
+}  // namespace reorder
+
+#endif  // SYZYGY_REORDER_PAGE_FAULT_ORDER_GENERATOR_H_
@@ -0,0 +1,180 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/reorder/page_fault_order_generator.h"
+
+#include <set>
+
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/reorder/order_generator_test.h"
+
+namespace reorder {
+
+namespace {
+
+using block_graph::BlockGraph;
+using block_graph::ConstBlockVector;
+using core::RelativeAddress;
+
+class TestPageFaultOrderGenerator : public PageFaultOrderGenerator {
+ public:
+  TestPageFaultOrderGenerator() : PageFaultOrderGenerator(1234) { }
+
+  using PageFaultOrderGenerator::SearchOrder;
+};
+
+class PageFaultOrderGeneratorTest : public testing::OrderGeneratorTest {
+ protected:
+  // Enters a block in a process.
+  void EnterBlock(const BlockGraph::Block* block, uint32_t process_id) {
+    order_generator_.OnCodeBlockEntry(block, block->addr(), process_id, 1,
+                                      GetSystemTime());
+  }
+
+  TestPageFaultOrderGenerator order_generator_;
+};
+
+}  // namespace
+
+TEST_F(PageFaultOrderGeneratorTest, DoNotReorder) {
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   false,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  // Verify that the order found in order_ matches the original decomposed
+  // image.
+  for (size_t i = 0; i != order_.sections.size(); ++i) {
+    const IMAGE_SECTION_HEADER* section = input_dll_.section_header(i);
+    ExpectSameOrder(section, order_.sections[i].blocks);
+  }
+}
+
+TEST_F(PageFaultOrderGeneratorTest, CountPageFaults) {
+  BlockGraph block_graph;
+  BlockGraph::Block* block1 =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, 0x800, "block1");
+  BlockGraph::Block* block2 =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, 0x800, "block2");
+  order_generator_.set_page_size(0x1000);
+  order_generator_.set_pages_per_code_fault(1);
+
+  // The process ID of the first process is reused by the third one, which
+  // starts with none of the pages loaded.
+  EnterBlock(block1, 1);
+  EnterBlock(block2, 1);
+  EnterBlock(block1, 1);
+  EnterBlock(block2, 2);
+  order_generator_.OnProcessEnded(1, GetSystemTime());
+  EnterBlock(block2, 1);
+
+  ConstBlockVector blocks;
+  blocks.push_back(block1);
+  blocks.push_back(block2);
+  EXPECT_EQ(3U, order_generator_.CountPageFaults(RelativeAddress(0), blocks));
+
+  // Spreading the blocks over two pages makes the first process fault once
+  // more.
+  block2->set_alignment(0x1000);
+  EXPECT_EQ(4U, order_generator_.CountPageFaults(RelativeAddress(0), blocks));
+
+  // The accesses to the blocks that aren't laid out are ignored.
+  blocks.pop_back();
+  EXPECT_EQ(1U, order_generator_.CountPageFaults(RelativeAddress(0), blocks));
+}
+
+TEST_F(PageFaultOrderGeneratorTest, SearchOrder) {
+  BlockGraph block_graph;
+  BlockGraph::Block* block1 =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, 0x800, "block1");
+  BlockGraph::Block* block2 =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, 0x800, "block2");
+  BlockGraph::Block* block3 =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, 0x800, "block3");
+  order_generator_.set_page_size(0x1000);
+  order_generator_.set_pages_per_code_fault(1);
+  order_generator_.set_iterations(100);
+
+  // Two processes use block2 and block3 together, and one uses block1 and
+  // block3 together. block3 should share its page with block2.
+  EnterBlock(block1, 1);
+  EnterBlock(block3, 1);
+  EnterBlock(block2, 2);
+  EnterBlock(block3, 2);
+  EnterBlock(block2, 3);
+  EnterBlock(block3, 3);
+
+  // The order of first entry is block1, block3, block2.
+  ConstBlockVector blocks;
+  blocks.push_back(block1);
+  blocks.push_back(block3);
+  blocks.push_back(block2);
+  EXPECT_EQ(5U, order_generator_.CountPageFaults(RelativeAddress(0), blocks));
+
+  order_generator_.SearchOrder(RelativeAddress(0), 1, &blocks);
+  ASSERT_EQ(3U, blocks.size());
+  EXPECT_EQ(4U, order_generator_.CountPageFaults(RelativeAddress(0), blocks));
+  std::set<const BlockGraph::Block*> block_set(blocks.begin(), blocks.end());
+  EXPECT_EQ(3U, block_set.size());
+}
+
+TEST_F(PageFaultOrderGeneratorTest, ReorderCode) {
+  // Enter a few code blocks from the end of the .text section.
+  size_t text_index = input_dll_.GetSectionIndex(".text");
+  const pe::ImageLayout::SectionInfo& text = image_layout_.sections[text_index];
+  ConstBlockVector entered_blocks;
+  BlockGraph::AddressSpace::RangeMapConstIterPair text_blocks =
+      image_layout_.blocks.GetIntersectingBlocks(text.addr, text.size);
+  BlockGraph::AddressSpace::RangeMapConstIter it = text_blocks.second;
+  while (it != text_blocks.first && entered_blocks.size() < 4) {
+    --it;
+    if (it->second->type() == BlockGraph::CODE_BLOCK)
+      entered_blocks.push_back(it->second);
+  }
+  ASSERT_EQ(4U, entered_blocks.size());
+  for (size_t i = 0; i < entered_blocks.size(); ++i)
+    EnterBlock(entered_blocks[i], 1);
+
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   true,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  // The entered blocks come first in the .text section, and the data sections
+  // are left alone.
+  const BlockSpecVector& text_specs = order_.sections[text_index].blocks;
+  ASSERT_LE(entered_blocks.size(), text_specs.size());
+  std::set<const BlockGraph::Block*> first_blocks;
+  for (size_t i = 0; i < entered_blocks.size(); ++i)
+    first_blocks.insert(text_specs[i].block);
+  EXPECT_EQ(std::set<const BlockGraph::Block*>(entered_blocks.begin(),
+                                               entered_blocks.end()),
+            first_blocks);
+  for (size_t i = 0; i != order_.sections.size(); ++i) {
+    const IMAGE_SECTION_HEADER* section = input_dll_.section_header(i);
+    if (i == text_index)
+      ExpectDifferentOrder(section, order_.sections[i].blocks);
+    else
+      ExpectSameOrder(section, order_.sections[i].blocks);
+  }
+}
+
+}  // namespace reorder
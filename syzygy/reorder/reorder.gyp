@@ -21,14 +21,20 @@
       'target_name': 'reorder_lib',
       'type': 'static_library',
       'sources': [
+        'aggregate_order_generator.cc',
+        'aggregate_order_generator.h',
         'basic_block_optimizer.cc',
         'basic_block_optimizer.h',
+        'call_graph_order_generator.cc',
+        'call_graph_order_generator.h',
         'dead_code_finder.cc',
         'dead_code_finder.h',
         'linear_order_generator.cc',
         'linear_order_generator.h',
         'orderers/explicit_orderer.cc',
         'orderers/explicit_orderer.h',
+        'page_fault_order_generator.cc',
+        'page_fault_order_generator.h',
         'random_order_generator.cc',
         'random_order_generator.h',
         'reorder_app.cc',
@@ -46,6 +52,7 @@
         '<(src)/syzygy/pdb/pdb.gyp:pdb_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/playback/playback.gyp:playback_lib',
+        '<(src)/syzygy/simulate/simulate.gyp:simulate_lib',
       ],
     },
     {
@@ -76,12 +83,15 @@
       'target_name': 'reorder_unittests',
       'type': 'executable',
       'sources': [
+        'aggregate_order_generator_unittest.cc',
         'basic_block_optimizer_unittest.cc',
+        'call_graph_order_generator_unittest.cc',
         'dead_code_finder_unittest.cc',
         'linear_order_generator_unittest.cc',
         'order_generator_test.cc',
         'order_generator_test.h',
         'orderers/explicit_orderer_unittest.cc',
+        'page_fault_order_generator_unittest.cc',
         'random_order_generator_unittest.cc',
         'reorder_app_unittest.cc',
         'reorderer_unittest.cc',
@@ -25,9 +25,12 @@
 #include "syzygy/grinder/basic_block_util.h"
 #include "syzygy/grinder/indexed_frequency_data_serializer.h"
 #include "syzygy/pe/find.h"
+#include "syzygy/reorder/aggregate_order_generator.h"
 #include "syzygy/reorder/basic_block_optimizer.h"
+#include "syzygy/reorder/call_graph_order_generator.h"
 #include "syzygy/reorder/dead_code_finder.h"
 #include "syzygy/reorder/linear_order_generator.h"
+#include "syzygy/reorder/page_fault_order_generator.h"
 #include "syzygy/reorder/random_order_generator.h"
 
 namespace reorder {
@@ -57,7 +60,21 @@ static const char kUsageFormatStr[] =
     "    --seed=INT generates a random ordering; don't specify ETW log files.\n"
     "    --list-dead-code instead of an ordering, output the set of functions\n"
     "        not visited during the trace.\n"
+    "    --call-graph generates an ordering by clustering the functions on\n"
+    "        the call-graph seen in the traces.\n"
+    "    --page-faults generates an ordering by searching for the layout\n"
+    "        that causes the fewest simulated page faults on the traces.\n"
+    "    --aggregate generates an ordering from a streaming aggregate of the\n"
+    "        first function entries of the traces, which scales to large\n"
+    "        numbers of traces.\n"
+    "    --trace-weights=W1,W2,... the weights of the trace files, in the\n"
+    "        order they are given. Only accepted with --aggregate.\n"
     "    --pretty-print enables pretty printing of the JSON output file.\n"
+    "    --perf-report=<path> writes the durations and the memory usage of\n"
+    "        the phases of the reordering to a JSON file.\n"
+    "    --jobs=N the number of threads on which the basic-block orderings\n"
+    "        of the functions are optimized. Defaults to the number of\n"
+    "        processors.\n"
     "    --reorderer-flags=<comma separated reorderer flags>\n"
     "  Reorderer Flags:\n"
     "    no-code: Do not reorder code sections.\n"
@@ -99,6 +116,28 @@ bool ParseFlags(const std::string& flags_str, Reorderer::Flags* flags) {
   return true;
 }
 
+// Parses a comma separated list of non-negative trace weights. Returns true on
+// success, false otherwise.
+bool ParseTraceWeights(const std::string& weights_str,
+                       Reorderer::TraceWeightList* weights) {
+  DCHECK(weights != NULL);
+
+  std::vector<std::string> text_weights = base::SplitString(
+      weights_str, ",", base::TRIM_WHITESPACE, base::SPLIT_WANT_ALL);
+  Reorderer::TraceWeightList out_weights;
+  for (size_t i = 0; i < text_weights.size(); ++i) {
+    double weight = 0.0;
+    if (!base::StringToDouble(text_weights[i], &weight) || weight < 0.0) {
+      LOG(ERROR) << "Invalid trace weight: " << text_weights[i] << ".";
+      return false;
+    }
+    out_weights.push_back(weight);
+  }
+
+  *weights = out_weights;
+  return true;
+}
+
 }  // namespace
 
 const char ReorderApp::kInstrumentedImage[] = "instrumented-image";
@@ -107,7 +146,12 @@ const char ReorderApp::kInputImage[] = "input-image";
 const char ReorderApp::kBasicBlockEntryCounts[] = "basic-block-entry-counts";
 const char ReorderApp::kSeed[] = "seed";
 const char ReorderApp::kListDeadCode[] = "list-dead-code";
+const char ReorderApp::kCallGraph[] = "call-graph";
+const char ReorderApp::kPageFaults[] = "page-faults";
+const char ReorderApp::kAggregate[] = "aggregate";
+const char ReorderApp::kTraceWeights[] = "trace-weights";
 const char ReorderApp::kPrettyPrint[] = "pretty-print";
+const char ReorderApp::kPerfReport[] = "perf-report";
 const char ReorderApp::kReordererFlags[] = "reorderer-flags";
 const char ReorderApp::kInstrumentedDll[] = "instrumented-dll";
 const char ReorderApp::kInputDll[] = "input-dll";
@@ -157,11 +201,15 @@ bool ReorderApp::ParseCommandLine(const base::CommandLine* command_line) {
   // Parse the pretty-print switch.
   pretty_print_ = command_line->HasSwitch(kPrettyPrint);
 
+  // Parse the (optional) performance report path.
+  perf_report_path_ = command_line->GetSwitchValuePath(kPerfReport);
+
   // Make all of the input paths absolute.
   input_image_path_ = AbsolutePath(input_image_path_);
   instrumented_image_path_ = AbsolutePath(instrumented_image_path_);
   output_file_path_ = AbsolutePath(output_file_path_);
   bb_entry_count_file_path_ = AbsolutePath(bb_entry_count_file_path_);
+  perf_report_path_ = AbsolutePath(perf_report_path_);
 
   // Capture the (possibly empty) set of trace files to read.
   for (size_t i = 0; i < command_line->GetArgs().size(); ++i) {
@@ -197,6 +245,54 @@ bool ReorderApp::ParseCommandLine(const base::CommandLine* command_line) {
     mode_ = kDeadCodeFinderMode;
   }
 
+  // Parse the call-graph switch.
+  if (command_line->HasSwitch(kCallGraph)) {
+    if (mode_ != kInvalidMode) {
+      LOG(ERROR) << "--" << kCallGraph << " can't be combined with --"
+                 << kSeed << "=N or --" << kListDeadCode << ".";
+      return false;
+    }
+    mode_ = kCallGraphOrderMode;
+  }
+
+  // Parse the page-faults switch.
+  if (command_line->HasSwitch(kPageFaults)) {
+    if (mode_ != kInvalidMode) {
+      LOG(ERROR) << "--" << kPageFaults << " can't be combined with --"
+                 << kSeed << "=N, --" << kListDeadCode << " or --"
+                 << kCallGraph << ".";
+      return false;
+    }
+    mode_ = kPageFaultOrderMode;
+  }
+
+  // Parse the aggregate switch.
+  if (command_line->HasSwitch(kAggregate)) {
+    if (mode_ != kInvalidMode) {
+      LOG(ERROR) << "--" << kAggregate << " can't be combined with --"
+                 << kSeed << "=N, --" << kListDeadCode << ", --"
+                 << kCallGraph << " or --" << kPageFaults << ".";
+      return false;
+    }
+    mode_ = kAggregateOrderMode;
+  }
+
+  // Parse the trace weights, which are only accepted in aggregate mode.
+  if (command_line->HasSwitch(kTraceWeights)) {
+    if (mode_ != kAggregateOrderMode) {
+      return Usage(command_line,
+                   "Trace weights are only accepted in aggregate mode.");
+    }
+    if (!ParseTraceWeights(command_line->GetSwitchValueASCII(kTraceWeights),
+                           &trace_weights_)) {
+      return Usage(command_line, "Invalid trace weights.");
+    }
+    if (trace_weights_.size() != trace_file_paths_.size()) {
+      return Usage(command_line,
+                   "There must be one trace weight per trace file.");
+    }
+  }
+
   // If we haven't found anything to over-ride the default mode (linear order),
   // then the default it is.
   if (mode_ == kInvalidMode)
@@ -240,6 +336,18 @@ bool ReorderApp::SetUp() {
     case kDeadCodeFinderMode:
       order_generator_.reset(new DeadCodeFinder());
       return true;
+
+    case kCallGraphOrderMode:
+      order_generator_.reset(new CallGraphOrderGenerator());
+      return true;
+
+    case kPageFaultOrderMode:
+      order_generator_.reset(new PageFaultOrderGenerator(seed_));
+      return true;
+
+    case kAggregateOrderMode:
+      order_generator_.reset(new AggregateOrderGenerator());
+      return true;
   }
 
   NOTREACHED();
@@ -255,6 +363,14 @@ int ReorderApp::Run() {
                       instrumented_image_path_,
                       trace_file_paths_,
                       flags_);
+  reorderer.set_trace_weights(trace_weights_);
+
+  // The phases are only measured if a report is requested.
+  core::PerfReport perf_report;
+  core::PerfReport* report = NULL;
+  if (!perf_report_path_.empty())
+    report = &perf_report;
+  reorderer.set_perf_report(report);
 
   // Generate a block-level ordering.
   if (!reorderer.Reorder(order_generator_.get(),
@@ -267,6 +383,7 @@ int ReorderApp::Run() {
 
   // Basic-block optimize the resulting order if there is an entry count file.
   if (mode_ == kLinearOrderMode && !bb_entry_count_file_path_.empty()) {
+    core::PerfReport::ScopedPhase phase(report, "optimize basic blocks");
     pe::PEFile::Signature signature;
     input_image.GetSignature(&signature);
     if (!OptimizeBasicBlocks(signature, image_layout, &order)) {
@@ -276,11 +393,17 @@ int ReorderApp::Run() {
   }
 
   // Serialize the order to JSON.
-  if (!order.SerializeToJSON(input_image, output_file_path_, pretty_print_)) {
-    LOG(ERROR) << "Unable to output order.";
-    return 1;
+  {
+    core::PerfReport::ScopedPhase phase(report, "write order");
+    if (!order.SerializeToJSON(input_image, output_file_path_, pretty_print_)) {
+      LOG(ERROR) << "Unable to output order.";
+      return 1;
+    }
   }
 
+  if (report != NULL && !report->Save(perf_report_path_))
+    return 1;
+
   // We were successful.
   return 0;
 }
@@ -309,8 +432,7 @@ bool ReorderApp::OptimizeBasicBlocks(const pe::PEFile::Signature& signature,
   // Load the basic-block entry count data.
   ModuleIndexedFrequencyMap module_entry_count_map;
   IndexedFrequencyDataSerializer serializer;
-  if (!serializer.LoadFromJson(bb_entry_count_file_path_,
-                               &module_entry_count_map)) {
+  if (!serializer.Load(bb_entry_count_file_path_, &module_entry_count_map)) {
     LOG(ERROR) << "Failed to load basic-block entry count data";
     return false;
   }
@@ -326,6 +448,7 @@ bool ReorderApp::OptimizeBasicBlocks(const pe::PEFile::Signature& signature,
 
   // Optimize the ordering at the basic-block level.
   BasicBlockOptimizer optimizer;
+  optimizer.set_thread_count(jobs());
   if (!optimizer.Optimize(image_layout, *entry_counts, order)) {
     LOG(ERROR) << "Failed to optimize basic-block ordering.";
     return false;
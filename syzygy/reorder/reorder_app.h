@@ -47,7 +47,10 @@ class ReorderApp : public application::AppImplBase {
     kInvalidMode,
     kLinearOrderMode,
     kRandomOrderMode,
-    kDeadCodeFinderMode
+    kDeadCodeFinderMode,
+    kCallGraphOrderMode,
+    kPageFaultOrderMode,
+    kAggregateOrderMode
   };
   // @name Utility members.
   // @{
@@ -67,7 +70,9 @@ class ReorderApp : public application::AppImplBase {
   base::FilePath input_image_path_;
   base::FilePath output_file_path_;
   base::FilePath bb_entry_count_file_path_;
+  base::FilePath perf_report_path_;
   FilePathVector trace_file_paths_;
+  Reorderer::TraceWeightList trace_weights_;
   uint32_t seed_;
   bool pretty_print_;
   Reorderer::Flags flags_;
@@ -81,7 +86,12 @@ class ReorderApp : public application::AppImplBase {
   static const char kBasicBlockEntryCounts[];
   static const char kSeed[];
   static const char kListDeadCode[];
+  static const char kCallGraph[];
+  static const char kPageFaults[];
+  static const char kAggregate[];
+  static const char kTraceWeights[];
   static const char kPrettyPrint[];
+  static const char kPerfReport[];
   static const char kReordererFlags[];
   static const char kInstrumentedDll[];
   static const char kInputDll[];
@@ -44,12 +44,17 @@ class TestReorderApp : public ReorderApp {
   using ReorderApp::kLinearOrderMode;
   using ReorderApp::kRandomOrderMode;
   using ReorderApp::kDeadCodeFinderMode;
+  using ReorderApp::kCallGraphOrderMode;
+  using ReorderApp::kPageFaultOrderMode;
+  using ReorderApp::kAggregateOrderMode;
   using ReorderApp::mode_;
   using ReorderApp::instrumented_image_path_;
   using ReorderApp::input_image_path_;
   using ReorderApp::output_file_path_;
   using ReorderApp::bb_entry_count_file_path_;
+  using ReorderApp::perf_report_path_;
   using ReorderApp::trace_file_paths_;
+  using ReorderApp::trace_weights_;
   using ReorderApp::seed_;
   using ReorderApp::pretty_print_;
   using ReorderApp::flags_;
@@ -59,7 +64,12 @@ class TestReorderApp : public ReorderApp {
   using ReorderApp::kBasicBlockEntryCounts;
   using ReorderApp::kSeed;
   using ReorderApp::kListDeadCode;
+  using ReorderApp::kCallGraph;
+  using ReorderApp::kPageFaults;
+  using ReorderApp::kAggregate;
+  using ReorderApp::kTraceWeights;
   using ReorderApp::kPrettyPrint;
+  using ReorderApp::kPerfReport;
   using ReorderApp::kReordererFlags;
   using ReorderApp::kInstrumentedDll;
   using ReorderApp::kInputDll;
@@ -187,6 +197,58 @@ TEST_F(ReorderAppTest, ParseWithSeedAndListDeadCodeFails) {
   ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
 }
 
+TEST_F(ReorderAppTest, ParseWithCallGraphAndListDeadCodeFails) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kListDeadCode);
+  cmd_line_.AppendSwitch(TestReorderApp::kCallGraph);
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ReorderAppTest, ParseWithPageFaultsAndCallGraphFails) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kCallGraph);
+  cmd_line_.AppendSwitch(TestReorderApp::kPageFaults);
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ReorderAppTest, ParseWithTraceWeightsWithoutAggregateFails) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitchASCII(TestReorderApp::kTraceWeights, "1");
+  cmd_line_.AppendArgPath(trace_file_path_);
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ReorderAppTest, ParseWithInvalidTraceWeightsFails) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kAggregate);
+  cmd_line_.AppendSwitchASCII(TestReorderApp::kTraceWeights, "-1");
+  cmd_line_.AppendArgPath(trace_file_path_);
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ReorderAppTest, ParseWithMismatchedTraceWeightsFails) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kAggregate);
+  cmd_line_.AppendSwitchASCII(TestReorderApp::kTraceWeights, "1,2");
+  cmd_line_.AppendArgPath(trace_file_path_);
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(ReorderAppTest, ParseWithEmptySeedFails) {
   cmd_line_.AppendSwitchPath(
       TestReorderApp::kInstrumentedImage, instrumented_image_path_);
@@ -237,12 +299,25 @@ TEST_F(ReorderAppTest, ParseMinimalLinearOrderCommandLine) {
   EXPECT_EQ(abs_trace_file_path_, test_impl_.trace_file_paths_.front());
   EXPECT_EQ(0U, test_impl_.seed_);
   EXPECT_FALSE(test_impl_.pretty_print_);
+  EXPECT_TRUE(test_impl_.perf_report_path_.empty());
   EXPECT_EQ(Reorderer::kFlagReorderCode | Reorderer::kFlagReorderData,
             test_impl_.flags_);
 
   EXPECT_TRUE(test_impl_.SetUp());
 }
 
+TEST_F(ReorderAppTest, ParsePerfReport) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kPerfReport,
+                             temp_dir_.Append(L"perf.json"));
+  cmd_line_.AppendArgPath(trace_file_path_);
+
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(temp_dir_.Append(L"perf.json"), test_impl_.perf_report_path_);
+}
+
 TEST_F(ReorderAppTest, ParseFullLinearOrderCommandLine) {
   cmd_line_.AppendSwitchPath(
       TestReorderApp::kInstrumentedImage, instrumented_image_path_);
@@ -363,6 +438,58 @@ TEST_F(ReorderAppTest, ParseDeadCodeFinderCommandLine) {
   EXPECT_TRUE(test_impl_.SetUp());
 }
 
+TEST_F(ReorderAppTest, ParseCallGraphOrderCommandLine) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kCallGraph);
+  cmd_line_.AppendArgPath(trace_file_path_);
+
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+
+  EXPECT_EQ(TestReorderApp::kCallGraphOrderMode, test_impl_.mode_);
+  EXPECT_EQ(abs_instrumented_image_path_, test_impl_.instrumented_image_path_);
+  EXPECT_EQ(abs_output_file_path_, test_impl_.output_file_path_);
+  EXPECT_EQ(abs_trace_file_path_, test_impl_.trace_file_paths_.front());
+
+  EXPECT_TRUE(test_impl_.SetUp());
+}
+
+TEST_F(ReorderAppTest, ParsePageFaultOrderCommandLine) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kPageFaults);
+  cmd_line_.AppendArgPath(trace_file_path_);
+
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+
+  EXPECT_EQ(TestReorderApp::kPageFaultOrderMode, test_impl_.mode_);
+  EXPECT_EQ(abs_instrumented_image_path_, test_impl_.instrumented_image_path_);
+  EXPECT_EQ(abs_output_file_path_, test_impl_.output_file_path_);
+  EXPECT_EQ(abs_trace_file_path_, test_impl_.trace_file_paths_.front());
+
+  EXPECT_TRUE(test_impl_.SetUp());
+}
+
+TEST_F(ReorderAppTest, ParseAggregateOrderCommandLine) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kAggregate);
+  cmd_line_.AppendSwitchASCII(TestReorderApp::kTraceWeights, "2.5");
+  cmd_line_.AppendArgPath(trace_file_path_);
+
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+
+  EXPECT_EQ(TestReorderApp::kAggregateOrderMode, test_impl_.mode_);
+  EXPECT_EQ(abs_trace_file_path_, test_impl_.trace_file_paths_.front());
+  ASSERT_EQ(1U, test_impl_.trace_weights_.size());
+  EXPECT_EQ(2.5, test_impl_.trace_weights_.front());
+
+  EXPECT_TRUE(test_impl_.SetUp());
+}
+
 TEST_F(ReorderAppTest, LinearOrderEndToEnd) {
   cmd_line_.AppendSwitchPath(
       TestReorderApp::kInstrumentedImage, instrumented_image_path_);
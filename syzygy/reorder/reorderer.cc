@@ -356,6 +356,8 @@ Reorderer::Reorderer(const base::FilePath& module_path,
     : playback_(module_path, instrumented_path, trace_files),
       flags_(flags),
       code_block_entry_events_(0),
+      process_started_events_(0),
+      perf_report_(NULL),
       order_generator_(NULL) {
 }
 
@@ -390,11 +392,15 @@ bool Reorderer::ReorderImpl(Order* order,
     return false;
   }
 
-  if (!playback_.Init(pe_file, image, &parser_))
-    return false;
+  {
+    core::PerfReport::ScopedPhase phase(perf_report_, "decompose");
+    if (!playback_.Init(pe_file, image, &parser_))
+      return false;
+  }
 
   if (playback_.trace_files().size() > 0) {
     LOG(INFO) << "Processing trace events.";
+    core::PerfReport::ScopedPhase phase(perf_report_, "parse traces");
     if (!parser_.Consume())
       return false;
 
@@ -415,6 +421,7 @@ bool Reorderer::CalculateReordering(Order* order) {
   DCHECK(order_generator_ != NULL);
 
   LOG(INFO) << "Calculating new order.";
+  core::PerfReport::ScopedPhase phase(perf_report_, "order");
   if (!order_generator_->CalculateReordering(*playback_.pe_file(),
                                              *playback_.image(),
                                              (flags_ & kFlagReorderCode) != 0,
@@ -432,6 +439,15 @@ void Reorderer::OnProcessStarted(
     base::Time time, DWORD process_id, const TraceSystemInfo* data) {
   UniqueTime entry_time(time);
 
+  // Give the weight of its trace to the order generator.
+  size_t trace_index = process_started_events_++;
+  if (trace_index < trace_weights_.size() &&
+      !order_generator_->OnProcessWeight(process_id,
+                                         trace_weights_[trace_index])) {
+    parser_.set_error_occurred(true);
+    return;
+  }
+
   if (!order_generator_->OnProcessStarted(process_id, entry_time)) {
     parser_.set_error_occurred(true);
     return;
@@ -469,6 +485,39 @@ void Reorderer::OnFunctionEntry(base::Time time,
   if (block == NULL)
     return;
 
+  OnCodeBlockEntry(time, process_id, thread_id, block);
+}
+
+void Reorderer::OnBatchFunctionEntry(base::Time time,
+                                     DWORD process_id,
+                                     DWORD thread_id,
+                                     const TraceBatchEnterData* data) {
+  DCHECK(data != NULL);
+
+  // The blocks of the batch are resolved at once, which spares resolving the
+  // module of each function.
+  std::vector<const BlockGraph::Block*> blocks;
+  if (!playback_.FindFunctionBlocks(process_id, data, &blocks)) {
+    LOG(ERROR) << "Playback::FindFunctionBlocks failed.";
+    parser_.set_error_occurred(true);
+    return;
+  }
+
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    // The functions that aren't in our module are ignored.
+    if (blocks[i] == NULL)
+      continue;
+    if (!OnCodeBlockEntry(time, process_id, thread_id, blocks[i]))
+      return;
+  }
+}
+
+bool Reorderer::OnCodeBlockEntry(base::Time time,
+                                 DWORD process_id,
+                                 DWORD thread_id,
+                                 const BlockGraph::Block* block) {
+  DCHECK(block != NULL);
+
   // Get the time of the call. Since batched function calls come in with the
   // same time stamp, we rely on their relative ordering and UniqueTime's
   // incrementing ID to maintain relative order.
@@ -482,19 +531,64 @@ void Reorderer::OnFunctionEntry(base::Time time,
                                           entry_time)) {
     LOG(ERROR) << order_generator_->name() << "::OnCodeBlockEntry failed.";
     parser_.set_error_occurred(true);
-    return;
+    return false;
   }
+
+  return true;
 }
 
-void Reorderer::OnBatchFunctionEntry(base::Time time,
-                                     DWORD process_id,
-                                     DWORD thread_id,
-                                     const TraceBatchEnterData* data) {
-  // Explode the batch event into individual function entry events.
-  TraceEnterExitEventData new_data = {};
-  for (size_t i = 0; i < data->num_calls; ++i) {
-    new_data.function = data->calls[i].function;
-    OnFunctionEntry(time, process_id, thread_id, &new_data);
+void Reorderer::OnInvocationBatch(base::Time time,
+                                  DWORD process_id,
+                                  DWORD thread_id,
+                                  size_t num_invocations,
+                                  const TraceBatchInvocationInfo* data) {
+  DCHECK(data != NULL);
+
+  for (size_t i = 0; i < num_invocations; ++i) {
+    const InvocationInfo& info = data->invocations[i];
+
+    // Dynamic symbols don't map to the blocks of the image.
+    if ((info.flags & (kCallerIsSymbol | kFunctionIsSymbol)) != 0)
+      continue;
+
+    bool error = false;
+    const BlockGraph::Block* callee =
+        playback_.FindFunctionBlock(process_id, info.function, &error);
+    if (error) {
+      LOG(ERROR) << "Playback::FindFunctionBlock failed.";
+      parser_.set_error_occurred(true);
+      return;
+    }
+    if (callee == NULL)
+      continue;
+
+    // The calls coming from other modules are ignored.
+    FuncAddr return_address = reinterpret_cast<FuncAddr>(info.caller);
+    const ModuleInformation* caller_module = parser_.GetModuleInformation(
+        process_id, reinterpret_cast<AbsoluteAddress64>(return_address));
+    if (caller_module == NULL ||
+        !playback_.MatchesInstrumentedModuleSignature(*caller_module)) {
+      continue;
+    }
+    const BlockGraph::Block* caller =
+        playback_.FindFunctionBlock(process_id, return_address, &error);
+    if (error) {
+      LOG(ERROR) << "Playback::FindFunctionBlock failed.";
+      parser_.set_error_occurred(true);
+      return;
+    }
+    if (caller == NULL)
+      continue;
+
+    if (!order_generator_->OnCodeBlockCall(caller,
+                                           callee,
+                                           process_id,
+                                           thread_id,
+                                           info.num_calls)) {
+      LOG(ERROR) << order_generator_->name() << "::OnCodeBlockCall failed.";
+      parser_.set_error_occurred(true);
+      return;
+    }
   }
 }
 
@@ -29,6 +29,7 @@
 #include <vector>
 
 #include "base/win/event_trace_consumer.h"
+#include "syzygy/core/perf_report.h"
 #include "syzygy/pe/decomposer.h"
 #include "syzygy/pe/image_layout.h"
 #include "syzygy/playback/playback.h"
@@ -52,6 +53,7 @@ class Reorderer : public trace::parser::ParseEventHandlerImpl {
   typedef pe::ImageLayout ImageLayout;
   typedef pe::PEFile PEFile;
   typedef std::vector<base::FilePath> TraceFileList;
+  typedef std::vector<double> TraceWeightList;
 
   struct Order;
   class OrderGenerator;
@@ -97,8 +99,27 @@ class Reorderer : public trace::parser::ParseEventHandlerImpl {
   // @{
   Flags flags() const { return flags_; }
   const Parser& parser() const { return parser_; }
+  const TraceWeightList& trace_weights() const { return trace_weights_; }
   // @}
 
+  // Sets the weights of the trace files, in the order of the trace files. The
+  // weight of a trace file is given to the order generator along with the
+  // process it records. The call-trace files each record a single process,
+  // and are parsed one after the other, so the Nth process to start is
+  // recorded by the Nth trace file.
+  // @param trace_weights The weights of the trace files.
+  void set_trace_weights(const TraceWeightList& trace_weights) {
+    trace_weights_ = trace_weights;
+  }
+
+  // Sets the report in which the durations and the memory usage of the
+  // phases of the reordering are recorded. By default, it is null and nothing
+  // is recorded.
+  // @param perf_report The report, which must outlive the reorderer.
+  void set_perf_report(core::PerfReport* perf_report) {
+    perf_report_ = perf_report;
+  }
+
  protected:
   typedef block_graph::BlockGraph BlockGraph;
   typedef core::RelativeAddress RelativeAddress;
@@ -127,8 +148,20 @@ class Reorderer : public trace::parser::ParseEventHandlerImpl {
                             DWORD process_id,
                             DWORD thread_id,
                             const TraceBatchEnterData* data) override;
+  void OnInvocationBatch(base::Time time,
+                         DWORD process_id,
+                         DWORD thread_id,
+                         size_t num_invocations,
+                         const TraceBatchInvocationInfo* data) override;
   // @}
 
+  // Feeds the entry of a code block to the order generator.
+  // @returns true on success, false otherwise.
+  bool OnCodeBlockEntry(base::Time time,
+                        DWORD process_id,
+                        DWORD thread_id,
+                        const BlockGraph::Block* block);
+
   // A playback, which will decompose the image for us.
   Playback playback_;
 
@@ -137,6 +170,13 @@ class Reorderer : public trace::parser::ParseEventHandlerImpl {
 
   // Number of CodeBlockEntry events processed.
   size_t code_block_entry_events_;
+  // The weights of the trace files, and the number of processes that have
+  // started so far.
+  TraceWeightList trace_weights_;
+  size_t process_started_events_;
+
+  // The report in which the phases are recorded. May be null.
+  core::PerfReport* perf_report_;
 
   // The following three variables are only valid while Reorder is executing.
   // A pointer to our order generator delegate.
@@ -324,6 +364,13 @@ class Reorderer::OrderGenerator {
     return true;
   }
 
+  // The derived class may implement this callback, which gives the weight of
+  // the trace of a process when the trace files are weighted. It is invoked
+  // just before the process is started.
+  virtual bool OnProcessWeight(uint32_t process_id, double weight) {
+    return true;
+  }
+
   // The derived class shall implement this callback, which receives
   // TRACE_ENTRY events for the module that is being reordered. Returns true
   // on success, false on error. If this returns false, no further callbacks
@@ -334,6 +381,18 @@ class Reorderer::OrderGenerator {
                                 uint32_t thread_id,
                                 const UniqueTime& time) = 0;
 
+  // The derived class may implement this callback, which receives the
+  // caller-callee pairs of the TRACE_BATCH_INVOCATION events for the module
+  // that is being reordered. Returns true on success, false on error. If this
+  // returns false, no further callbacks will be processed.
+  virtual bool OnCodeBlockCall(const BlockGraph::Block* caller,
+                               const BlockGraph::Block* callee,
+                               uint32_t process_id,
+                               uint32_t thread_id,
+                               size_t call_count) {
+    return true;
+  }
+
   // The derived class shall implement this function, which actually produces
   // the reordering. When this is called, the callee can be assured that the
   // ImageLayout is populated and all traces have been parsed. This must
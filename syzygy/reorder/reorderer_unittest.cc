@@ -103,6 +103,8 @@ class MockOrderGenerator : public Reorderer::OrderGenerator {
   MOCK_METHOD2(OnProcessEnded,
                bool(uint32_t process_id, const Reorderer::UniqueTime& time));
 
+  MOCK_METHOD2(OnProcessWeight, bool(uint32_t process_id, double weight));
+
   MOCK_METHOD5(OnCodeBlockEntry,
                bool(const BlockGraph::Block* block,
                     RelativeAddress address,
@@ -381,6 +383,34 @@ TEST_F(ReordererTest, ValidateCallbacks) {
                                        &image_layout));
 }
 
+TEST_F(ReordererTest, ValidateWeightedCallbacks) {
+  MockOrderGenerator mock_order_generator;
+  test_reorderer_->set_trace_weights(Reorderer::TraceWeightList(1, 2.5));
+
+  // Setup the expected calls.
+  InSequence s;
+  EXPECT_CALL(mock_order_generator, OnProcessWeight(kProcessId, 2.5))
+      .WillOnce(Return(true));
+  EXPECT_CALL(mock_order_generator, OnProcessStarted(kProcessId, _))
+      .WillOnce(Return(true));
+  EXPECT_CALL(mock_order_generator, OnCodeBlockEntry(_, _, _, _, _))
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(mock_order_generator, OnProcessEnded(_, _))
+      .WillOnce(Return(true));
+  EXPECT_CALL(mock_order_generator, CalculateReordering(_, _, _, _, _))
+      .WillOnce(Return(true));
+
+  // Run the reorderer.
+  Reorderer::Order order;
+  PEFile pe_file;
+  BlockGraph block_graph;
+  ImageLayout image_layout(&block_graph);
+  EXPECT_TRUE(test_reorderer_->Reorder(&mock_order_generator,
+                                       &order,
+                                       &pe_file,
+                                       &image_layout));
+}
+
 TEST_F(ReordererTest, Reorder) {
   TestOrderGenerator test_order_generator;
 
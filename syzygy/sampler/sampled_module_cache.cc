@@ -16,6 +16,9 @@
 
 #include <psapi.h>
 
+#include <algorithm>
+#include <utility>
+
 #include "base/strings/stringprintf.h"
 #include "syzygy/common/align.h"
 #include "syzygy/common/com_utils.h"
@@ -67,7 +70,12 @@ bool GetModulePath(HANDLE process, HMODULE module, base::FilePath* path) {
 }  // namespace
 
 SampledModuleCache::SampledModuleCache(size_t log2_bucket_size)
-      : log2_bucket_size_(log2_bucket_size), module_count_(0) {
+      : log2_bucket_size_(log2_bucket_size),
+        module_count_(0),
+        flush_wheel_position_(0),
+        refine_log2_bucket_size_(0),
+        refine_max_bucket_count_(0),
+        refine_min_sample_count_(0) {
   DCHECK_LE(2u, log2_bucket_size);
   DCHECK_GE(31u, log2_bucket_size);
 }
@@ -78,6 +86,27 @@ SampledModuleCache::~SampledModuleCache() {
   RemoveDeadModules();
 }
 
+void SampledModuleCache::set_flush_module_callback(
+    const FlushModuleCallback& callback, size_t flush_period) {
+  DCHECK_EQ(0u, module_count_);
+  DCHECK_LT(0u, flush_period);
+  flush_module_callback_ = callback;
+  flush_wheel_.clear();
+  flush_wheel_.resize(flush_period);
+  flush_wheel_position_ = 0;
+}
+
+void SampledModuleCache::set_refinement(size_t log2_bucket_size,
+                                        size_t max_bucket_count,
+                                        size_t min_sample_count) {
+  DCHECK_LE(2u, log2_bucket_size);
+  DCHECK_GT(log2_bucket_size_, log2_bucket_size);
+  DCHECK_LT(0u, max_bucket_count);
+  refine_log2_bucket_size_ = log2_bucket_size;
+  refine_max_bucket_count_ = max_bucket_count;
+  refine_min_sample_count_ = min_sample_count;
+}
+
 bool SampledModuleCache::AddModule(HANDLE process,
                                    HMODULE module_handle,
                                    ProfilingStatus* status,
@@ -121,9 +150,19 @@ bool SampledModuleCache::AddModule(HANDLE process,
     return false;
 
   DCHECK(*module != NULL);
-  if (*status == kProfilingStarted)
+  if (*status == kProfilingStarted) {
     ++module_count_;
 
+    // Schedule the new module to be flushed a full revolution of the wheel
+    // from now, which spreads the modules started at different times over
+    // the slots.
+    if (!flush_wheel_.empty()) {
+      Module* mod = proc->modules()[module_handle];
+      mod->flush_slot_ = flush_wheel_position_;
+      flush_wheel_[mod->flush_slot_].insert(mod);
+    }
+  }
+
   if (scoped_proc.get() != NULL) {
     // Initialization was successful so we can safely insert the newly created
     // process into the map.
@@ -148,6 +187,15 @@ void SampledModuleCache::RemoveDeadModules() {
   while (proc_it != processes_.end()) {
     ++proc_it_next;
 
+    // Unschedule the dead modules of the process from the flush wheel.
+    if (!flush_wheel_.empty()) {
+      for (const auto& mod_pair : proc_it->second->modules()) {
+        Module* mod = mod_pair.second;
+        if (!mod->alive())
+          flush_wheel_[mod->flush_slot_].erase(mod);
+      }
+    }
+
     // Remove any dead modules from the process.
     size_t old_module_count = proc_it->second->modules().size();
     proc_it->second->RemoveDeadModules(dead_module_callback_);
@@ -157,6 +205,8 @@ void SampledModuleCache::RemoveDeadModules() {
     // remove it.
     if (!proc_it->second->alive()) {
       Process* proc = proc_it->second;
+      if (!dead_process_callback_.is_null())
+        dead_process_callback_.Run(proc);
       delete proc;
       processes_.erase(proc_it);
     }
@@ -169,6 +219,51 @@ void SampledModuleCache::RemoveDeadModules() {
   }
 }
 
+void SampledModuleCache::FlushModules() {
+  if (flush_wheel_.empty())
+    return;
+
+  flush_wheel_position_ = (flush_wheel_position_ + 1) % flush_wheel_.size();
+  std::vector<ULONG> buckets;
+  for (Module* mod : flush_wheel_[flush_wheel_position_]) {
+    DCHECK_EQ(flush_wheel_position_, mod->flush_slot_);
+    uint64_t start_time = mod->last_flush_time();
+    uint64_t end_time = trace::common::GetTsc();
+    mod->TakeUnflushedBuckets(end_time, &buckets);
+    flush_module_callback_.Run(mod, buckets, start_time, end_time);
+  }
+}
+
+void SampledModuleCache::RefineModules() {
+  if (refine_log2_bucket_size_ == 0)
+    return;
+
+  for (const auto& proc_pair : processes_) {
+    for (const auto& mod_pair : proc_pair.second->modules()) {
+      Module* mod = mod_pair.second;
+      if (mod->refined() || !mod->profiler().is_started())
+        continue;
+
+      // A module this small would be refined as a whole, which would make
+      // its hot ranges indistinguishable from its coarse profile.
+      const std::vector<ULONG>& buckets = mod->profiler().buckets();
+      if (buckets.size() <= refine_max_bucket_count_)
+        continue;
+
+      uint64_t sample_count = 0;
+      for (ULONG count : buckets)
+        sample_count += count;
+      if (sample_count < refine_min_sample_count_)
+        continue;
+
+      if (!mod->Refine(refine_log2_bucket_size_, refine_max_bucket_count_)) {
+        LOG(WARNING) << "Failed to refine the profile of module \""
+                     << mod->module_path().value() << "\".";
+      }
+    }
+  }
+}
+
 SampledModuleCache::Process::Process(HANDLE process, DWORD pid)
     : process_(process), pid_(pid), alive_(true) {
   DCHECK(process != INVALID_HANDLE_VALUE);
@@ -278,6 +373,10 @@ SampledModuleCache::Module::Module(Process* process,
       log2_bucket_size_(log2_bucket_size),
       profiling_start_time_(0),
       profiling_stop_time_(0),
+      last_flush_time_(0),
+      flush_slot_(0),
+      refined_(false),
+      hot_log2_bucket_size_(0),
       alive_(true) {
   DCHECK(process != NULL);
   DCHECK(module_ != INVALID_HANDLE_VALUE);
@@ -401,14 +500,118 @@ bool SampledModuleCache::Module::Start() {
   if (!profiler_.Start())
     return false;
   profiling_start_time_ = trace::common::GetTsc();
+  last_flush_time_ = profiling_start_time_;
   return true;
 }
 
 bool SampledModuleCache::Module::Stop() {
+  bool result = true;
+  for (const auto& range : hot_ranges_) {
+    if (range->profiler.is_started() && !range->profiler.Stop())
+      result = false;
+  }
+
   if (!profiler_.Stop())
     return false;
   profiling_stop_time_ = trace::common::GetTsc();
+  return result;
+}
+
+bool SampledModuleCache::Module::Refine(size_t log2_bucket_size,
+                                        size_t max_bucket_count) {
+  DCHECK(!refined_);
+  DCHECK_GT(log2_bucket_size_, log2_bucket_size);
+  DCHECK_LT(0u, max_bucket_count);
+
+  refined_ = true;
+  hot_log2_bucket_size_ = log2_bucket_size;
+
+  // The profiler keeps counting while the hottest buckets are picked, so they
+  // are picked from a snapshot of the counts.
+  std::vector<ULONG> counts(profiler_.buckets());
+  std::vector<size_t> hot_buckets;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    if (counts[i] != 0)
+      hot_buckets.push_back(i);
+  }
+  if (hot_buckets.size() > max_bucket_count) {
+    std::nth_element(hot_buckets.begin(),
+                     hot_buckets.begin() + max_bucket_count,
+                     hot_buckets.end(),
+                     [&counts](size_t i, size_t j) {
+                       return counts[i] > counts[j];
+                     });
+    hot_buckets.resize(max_bucket_count);
+  }
+  std::sort(hot_buckets.begin(), hot_buckets.end());
+
+  // Profile each run of adjacent hot buckets as a single range.
+  size_t bucket_size = 1 << log2_bucket_size_;
+  const char* buckets_begin = reinterpret_cast<const char*>(buckets_begin_);
+  for (size_t i = 0; i < hot_buckets.size(); ) {
+    size_t j = i + 1;
+    while (j < hot_buckets.size() && hot_buckets[j] == hot_buckets[j - 1] + 1)
+      ++j;
+
+    std::unique_ptr<HotRange> range(new HotRange());
+    range->begin = buckets_begin + hot_buckets[i] * bucket_size;
+    range->end = buckets_begin + (hot_buckets[j - 1] + 1) * bucket_size;
+    size_t size = reinterpret_cast<const char*>(range->end) -
+        reinterpret_cast<const char*>(range->begin);
+    if (!range->profiler.Initialize(process_->process(),
+                                    const_cast<void*>(range->begin),
+                                    size,
+                                    log2_bucket_size)) {
+      LOG(ERROR) << "Failed to initialize profiler for address range "
+                 << base::StringPrintf("0x%08X - 0x%08X",
+                                       range->begin,
+                                       range->end)
+                 << " of process " << process_->pid() << ".";
+      return false;
+    }
+    if (!range->profiler.Start())
+      return false;
+    range->profiling_start_time = trace::common::GetTsc();
+    hot_ranges_.push_back(std::move(range));
+
+    i = j;
+  }
+
   return true;
 }
 
+void SampledModuleCache::Module::GetUnflushedBuckets(
+    std::vector<ULONG>* buckets) const {
+  DCHECK(buckets != NULL);
+
+  *buckets = profiler_.buckets();
+  if (flushed_buckets_.empty())
+    return;
+
+  // The counts only ever grow, modulo wrapping around, which the unsigned
+  // arithmetic takes care of.
+  DCHECK_EQ(buckets->size(), flushed_buckets_.size());
+  for (size_t i = 0; i < buckets->size(); ++i)
+    (*buckets)[i] -= flushed_buckets_[i];
+}
+
+void SampledModuleCache::Module::TakeUnflushedBuckets(
+    uint64_t flush_time, std::vector<ULONG>* buckets) {
+  DCHECK(buckets != NULL);
+
+  // The profiler keeps counting while this runs, so the counts are taken
+  // once, both for computing the deltas and as a reference for the next
+  // flush.
+  std::vector<ULONG> counts(profiler_.buckets());
+  *buckets = counts;
+  if (!flushed_buckets_.empty()) {
+    DCHECK_EQ(buckets->size(), flushed_buckets_.size());
+    for (size_t i = 0; i < buckets->size(); ++i)
+      (*buckets)[i] -= flushed_buckets_[i];
+  }
+
+  flushed_buckets_.swap(counts);
+  last_flush_time_ = flush_time;
+}
+
 }  // namespace sampler
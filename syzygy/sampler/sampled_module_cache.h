@@ -45,12 +45,23 @@
 //   // Clean up any modules that haven't been added (or re-added and marked as
 //   // alive). This invokes our callback with the gathered profile data.
 //   cache.RemoveDeadModules();
+//
+//   // Optionally, hand the profile data gathered since the last flush of
+//   // some of the modules to the flush callback.
+//   cache.FlushModules();
+//
+//   // Optionally, profile the hot code of the modules that have gathered
+//   // enough samples at a finer resolution.
+//   cache.RefineModules();
 // }
 
 #ifndef SYZYGY_SAMPLER_SAMPLED_MODULE_CACHE_H_
 #define SYZYGY_SAMPLER_SAMPLED_MODULE_CACHE_H_
 
 #include <map>
+#include <memory>
+#include <set>
+#include <vector>
 
 #include "base/callback.h"
 #include "base/files/file_path.h"
@@ -80,6 +91,19 @@ class SampledModuleCache {
   // dead). It is up to the callback to deal with the sample data.
   typedef base::Callback<void(const Module* module)> DeadModuleCallback;
 
+  // This is the callback that is used to periodically hand the sample data of
+  // a module over while it is still being profiled. It is up to the callback
+  // to deal with the @p buckets counts gathered from @p start_time, the time
+  // of the last flush of the module, up to @p end_time.
+  typedef base::Callback<void(const Module* module,
+                              const std::vector<ULONG>& buckets,
+                              uint64_t start_time,
+                              uint64_t end_time)> FlushModuleCallback;
+
+  // This is the callback that is used to indicate that a process is no longer
+  // being profiled, after the callbacks for all of its modules.
+  typedef base::Callback<void(const Process* process)> DeadProcessCallback;
+
   // Constructor.
   // @param log2_bucket_size The number of bits in the bucket size to be used
   //     by the sampling profiler. This must be in the range 2-31, for bucket
@@ -99,6 +123,39 @@ class SampledModuleCache {
     dead_module_callback_ = callback;
   }
 
+  // Sets up the periodic flushing of the sample data of the modules. The
+  // modules are spread over the slots of a timer wheel, which each call to
+  // FlushModules advances by one slot, so that every module is flushed once
+  // per revolution while each call only visits a fraction of them. This must
+  // be called before any module is added.
+  // @param callback The callback to be invoked for the modules being flushed.
+  // @param flush_period The number of calls to FlushModules between two
+  //     flushes of a module. This is the number of slots of the wheel.
+  void set_flush_module_callback(const FlushModuleCallback& callback,
+                                 size_t flush_period);
+
+  // Sets the callback that is invoked as dead processes are removed from the
+  // cache.
+  void set_dead_process_callback(const DeadProcessCallback& callback) {
+    dead_process_callback_ = callback;
+  }
+
+  // Sets up the profiling of the hot code of the modules at a finer
+  // resolution. Once a module has gathered enough samples at the resolution
+  // of the cache, RefineModules starts profiling the address ranges of its
+  // hottest buckets at the finer resolution, while the coarse profile of the
+  // whole module carries on.
+  // @param log2_bucket_size The number of bits in the bucket size of the hot
+  //     ranges. This must be smaller than the bucket size of the cache.
+  // @param max_bucket_count The maximum number of coarse buckets whose range
+  //     is profiled at the finer resolution, per module. Modules with no
+  //     more coarse buckets than this are not refined.
+  // @param min_sample_count The number of samples a module must have gathered
+  //     before its hottest buckets are picked.
+  void set_refinement(size_t log2_bucket_size,
+                      size_t max_bucket_count,
+                      size_t min_sample_count);
+
   // @name Accessors.
   // @{
   const ProcessMap& processes() const { return processes_; }
@@ -132,6 +189,16 @@ class SampledModuleCache {
   // module the dead module callback will be invoked, if set.
   void RemoveDeadModules();
 
+  // Advances the flush timer wheel by one slot, and invokes the flush
+  // callback for the modules in that slot. Does nothing if no flush callback
+  // has been set.
+  void FlushModules();
+
+  // Starts profiling the hot ranges of the modules that have gathered enough
+  // samples since they started being profiled. Each module is refined at most
+  // once. Does nothing if refinement has not been set up.
+  void RefineModules();
+
   // @returns the total number of modules currently being profiled across all
   // processes.
   size_t module_count() const { return module_count_; }
@@ -152,6 +219,23 @@ class SampledModuleCache {
   // The total number of modules being profiled across all processes.
   size_t module_count_;
 
+  // The callbacks that are invoked when modules are flushed, and when dead
+  // processes are removed.
+  FlushModuleCallback flush_module_callback_;
+  DeadProcessCallback dead_process_callback_;
+
+  // The timer wheel of the modules to be flushed, and the slot that was
+  // flushed last. Each module lives in the slot it was assigned when it
+  // started being profiled.
+  std::vector<std::set<Module*>> flush_wheel_;
+  size_t flush_wheel_position_;
+
+  // The refinement parameters. Refinement is disabled if the bucket size is
+  // zero.
+  size_t refine_log2_bucket_size_;
+  size_t refine_max_bucket_count_;
+  size_t refine_min_sample_count_;
+
   DISALLOW_COPY_AND_ASSIGN(SampledModuleCache);
 };
 
@@ -250,6 +334,23 @@ class SampledModuleCache::Process {
 // parent process is still running.
 class SampledModuleCache::Module {
  public:
+  // A range of hot code of the module that is profiled at a finer resolution
+  // than the rest of it.
+  struct HotRange {
+    HotRange() : begin(NULL), end(NULL), profiling_start_time(0) {}
+
+    // The range being profiled, in the remote address space.
+    const void* begin;
+    const void* end;
+
+    // The time when profiling of the range started, as reported by RDTSC.
+    uint64_t profiling_start_time;
+
+    // The sampling profiler instance that is profiling the range.
+    SamplingProfiler profiler;
+  };
+  typedef std::vector<std::unique_ptr<HotRange>> HotRanges;
+
   // Constructor.
   // @param process The process to which this module belongs.
   // @param module The handle to the module to be profiled.
@@ -275,8 +376,17 @@ class SampledModuleCache::Module {
   uint64_t profiling_stop_time() const { return profiling_stop_time_; }
   SamplingProfiler& profiler() { return profiler_; }
   const SamplingProfiler& profiler() const { return profiler_; }
+  uint64_t last_flush_time() const { return last_flush_time_; }
+  bool refined() const { return refined_; }
+  size_t hot_log2_bucket_size() const { return hot_log2_bucket_size_; }
+  const HotRanges& hot_ranges() const { return hot_ranges_; }
   // @}
 
+  // Gets the counts of the buckets since the last flush of the module, or
+  // since the start of profiling if it has never been flushed.
+  // @param buckets Receives the counts.
+  void GetUnflushedBuckets(std::vector<ULONG>* buckets) const;
+
  protected:
   friend class SampledModuleCache;
 
@@ -288,6 +398,12 @@ class SampledModuleCache::Module {
   void MarkDead() { alive_ = false; }
   // @}
 
+  // Takes the counts of the buckets since the last flush of the module, and
+  // records that they were flushed.
+  // @param flush_time The time up to which the data is flushed.
+  // @param buckets Receives the counts.
+  void TakeUnflushedBuckets(uint64_t flush_time, std::vector<ULONG>* buckets);
+
   // Initializes this module by reaching into the other process and getting
   // information about it.
   // @returns true on success, false otherwise.
@@ -297,10 +413,19 @@ class SampledModuleCache::Module {
   // @returns true on success, false otherwise.
   bool Start();
 
-  // Stops the sampling profiler.
+  // Stops the sampling profiler, and those of the hot ranges.
   // @returns true on success, false otherwise.
   bool Stop();
 
+  // Starts profiling the ranges of the hottest buckets of the module at a
+  // finer resolution. Adjacent hot buckets are profiled as a single range.
+  // This marks the module as refined, even on failure.
+  // @param log2_bucket_size The number of bits in the bucket size of the hot
+  //     ranges.
+  // @param max_bucket_count The maximum number of hot buckets.
+  // @returns true on success, false otherwise.
+  bool Refine(size_t log2_bucket_size, size_t max_bucket_count);
+
  private:
   friend class SampledModuleCacheTest;  // Testing seam.
 
@@ -333,9 +458,22 @@ class SampledModuleCache::Module {
   uint64_t profiling_start_time_;
   uint64_t profiling_stop_time_;
 
+  // The time of the last flush of the module, the bucket counts at that time
+  // and the slot of the flush timer wheel the module belongs to. The counts
+  // are empty until the first flush.
+  uint64_t last_flush_time_;
+  std::vector<ULONG> flushed_buckets_;
+  size_t flush_slot_;
+
   // The sampling profiler instance that is profiling this module.
   SamplingProfiler profiler_;
 
+  // Whether the hot ranges of the module were picked, their bucket size, and
+  // the ranges themselves.
+  bool refined_;
+  size_t hot_log2_bucket_size_;
+  HotRanges hot_ranges_;
+
   // This is used for cleaning up no longer loaded modules using a mark and
   // sweep technique.
   bool alive_;
@@ -22,6 +22,12 @@ namespace sampler {
 
 struct MockedCallbackStruct {
   MOCK_METHOD1(OnDeadModule, void(const SampledModuleCache::Module*));
+  MOCK_METHOD4(OnFlushModule,
+               void(const SampledModuleCache::Module*,
+                    const std::vector<ULONG>&,
+                    uint64_t,
+                    uint64_t));
+  MOCK_METHOD1(OnDeadProcess, void(const SampledModuleCache::Process*));
 };
 
 class SampledModuleCacheTest : public ::testing::Test {
@@ -31,6 +37,10 @@ class SampledModuleCacheTest : public ::testing::Test {
 
     dead_module_callback = base::Bind(&MockedCallbackStruct::OnDeadModule,
                                       base::Unretained(&mock));
+    flush_module_callback = base::Bind(&MockedCallbackStruct::OnFlushModule,
+                                       base::Unretained(&mock));
+    dead_process_callback = base::Bind(&MockedCallbackStruct::OnDeadProcess,
+                                       base::Unretained(&mock));
   }
 
   bool IsAlive(const SampledModuleCache::Process* process) {
@@ -43,6 +53,8 @@ class SampledModuleCacheTest : public ::testing::Test {
 
   ::testing::StrictMock<MockedCallbackStruct> mock;
   SampledModuleCache::DeadModuleCallback dead_module_callback;
+  SampledModuleCache::FlushModuleCallback flush_module_callback;
+  SampledModuleCache::DeadProcessCallback dead_process_callback;
 };
 
 TEST_F(SampledModuleCacheTest, ConstructorAndProperties) {
@@ -141,4 +153,87 @@ TEST_F(SampledModuleCacheTest, EndToEnd) {
   EXPECT_EQ(0u, cache.module_count());
 }
 
+TEST_F(SampledModuleCacheTest, FlushModules) {
+  SampledModuleCache cache(2);
+  cache.set_dead_module_callback(dead_module_callback);
+  cache.set_dead_process_callback(dead_process_callback);
+  cache.set_flush_module_callback(flush_module_callback, 2);
+
+  static const DWORD kAccess =
+      PROCESS_DUP_HANDLE | PROCESS_QUERY_INFORMATION | PROCESS_VM_READ;
+  base::win::ScopedHandle proc(
+      ::OpenProcess(kAccess, FALSE, ::GetCurrentProcessId()));
+  ASSERT_TRUE(proc.IsValid());
+
+  SampledModuleCache::ProfilingStatus status =
+      SampledModuleCache::kProfilingStarted;
+  const SampledModuleCache::Module* module = NULL;
+  HMODULE module_handle = ::GetModuleHandle(NULL);
+  ASSERT_TRUE(cache.AddModule(proc.Get(), module_handle, &status, &module));
+  const SampledModuleCache::Process* process = module->process();
+  uint64_t start_time = module->last_flush_time();
+  EXPECT_EQ(module->profiling_start_time(), start_time);
+
+  // The module is only due a full revolution of the wheel after it was added.
+  cache.FlushModules();
+  EXPECT_EQ(start_time, module->last_flush_time());
+
+  EXPECT_CALL(mock, OnFlushModule(
+      module, testing::SizeIs(module->profiler().buckets().size()),
+      start_time, testing::Ge(start_time))).Times(1);
+  cache.FlushModules();
+  EXPECT_LE(start_time, module->last_flush_time());
+
+  // The process is reported after its modules when it dies.
+  testing::InSequence in_sequence;
+  EXPECT_CALL(mock, OnDeadModule(module)).Times(1);
+  EXPECT_CALL(mock, OnDeadProcess(process)).Times(1);
+  cache.MarkAllModulesDead();
+  cache.RemoveDeadModules();
+  EXPECT_EQ(0u, cache.processes().size());
+
+  // The wheel no longer holds the module.
+  cache.FlushModules();
+  cache.FlushModules();
+}
+
+TEST_F(SampledModuleCacheTest, RefineModules) {
+  SampledModuleCache cache(4);
+  cache.set_refinement(2, 1, 0);
+
+  static const DWORD kAccess =
+      PROCESS_DUP_HANDLE | PROCESS_QUERY_INFORMATION | PROCESS_VM_READ;
+  base::win::ScopedHandle proc(
+      ::OpenProcess(kAccess, FALSE, ::GetCurrentProcessId()));
+  ASSERT_TRUE(proc.IsValid());
+
+  SampledModuleCache::ProfilingStatus status =
+      SampledModuleCache::kProfilingStarted;
+  const SampledModuleCache::Module* module = NULL;
+  ASSERT_TRUE(cache.AddModule(proc.Get(), ::GetModuleHandle(NULL), &status,
+                              &module));
+  EXPECT_FALSE(module->refined());
+  EXPECT_TRUE(module->hot_ranges().empty());
+
+  // With no minimum sample count the module is refined straight away, over
+  // at most one coarse bucket.
+  cache.RefineModules();
+  EXPECT_TRUE(module->refined());
+  EXPECT_EQ(2u, module->hot_log2_bucket_size());
+  ASSERT_GE(1u, module->hot_ranges().size());
+  for (const auto& range : module->hot_ranges()) {
+    EXPECT_LE(module->buckets_begin(), range->begin);
+    EXPECT_GE(module->buckets_end(), range->end);
+    EXPECT_EQ(4u, range->profiler.buckets().size());
+    EXPECT_TRUE(range->profiler.is_started());
+  }
+
+  // A module is only refined once.
+  cache.RefineModules();
+  EXPECT_GE(1u, module->hot_ranges().size());
+
+  cache.MarkAllModulesDead();
+  cache.RemoveDeadModules();
+}
+
 }  // namespace sampler
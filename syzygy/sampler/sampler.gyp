@@ -27,6 +27,8 @@
         'sampled_module_cache.h',
         'sampling_profiler.cc',
         'sampling_profiler.h',
+        'stack_sampler.cc',
+        'stack_sampler.h',
       ],
       'dependencies': [
         '<(src)/base/base.gyp:base',
@@ -72,6 +74,7 @@
         'sampled_module_cache_unittest.cc',
         'sampler_app_unittest.cc',
         'sampling_profiler_unittest.cc',
+        'stack_sampler_unittest.cc',
         '<(src)/syzygy/testing/run_all_unittests.cc',
       ],
       'dependencies': [
@@ -16,6 +16,8 @@
 
 #include <psapi.h>
 
+#include <utility>
+
 #include "base/bind.h"
 #include "base/files/file_util.h"
 #include "base/strings/string_number_conversions.h"
@@ -51,6 +53,11 @@ const char kUsageFormatStr[] =
     "                        the list is a whitelist.\n"
     "  --bucket-size=POSINT  Specifies the bucket size. This must be a power\n"
     "                        of two, and must be >= 4. Defaults to 4.\n"
+    "  --flush-interval=SECONDS\n"
+    "                        If non-zero, the samples gathered for each\n"
+    "                        module are written to the trace file at this\n"
+    "                        interval, rather than only when the module stops\n"
+    "                        being profiled. Defaults to 0.\n"
     "  --output-dir=DIR      The path to write trace-files. Will be created\n"
     "                        if it doesn't exist. Defaults to the current\n"
     "                        working directory.\n"
@@ -58,6 +65,16 @@ const char kUsageFormatStr[] =
     "                        used as a filter (by default a whitelist) for\n"
     "                        processes to be profiled. If not specified all\n"
     "                        processes will be potentially profiled.\n"
+    "  --refine-bucket-size=POSINT\n"
+    "                        If specified, the hottest code of each module is\n"
+    "                        also profiled with this bucket size once enough\n"
+    "                        samples have been gathered. This must be a power\n"
+    "                        of two, and must be >= 4 and smaller than the\n"
+    "                        bucket size.\n"
+    "  --refine-bucket-count=POSINT\n"
+    "                        The number of the hottest buckets of each module\n"
+    "                        that get profiled with the refined bucket size.\n"
+    "                        Defaults to 64.\n"
     "  --sampling-interval=INTERVAL\n"
     "                        Sets the sampling interval. This is a floating\n"
     "                        point value in seconds. Scientific notation is\n"
@@ -66,31 +83,39 @@ const char kUsageFormatStr[] =
     "                        available on all systems so the closest value\n"
     "                        available will be used. The actual sampling\n"
     "                        interval used will be reported.\n"
+    "  --stack-sampling-rate=INT\n"
+    "                        If non-zero, the call stacks of the threads of\n"
+    "                        the processes being profiled are also sampled,\n"
+    "                        this many times per second. This must be at\n"
+    "                        most 1000. Defaults to 0.\n"
     "  --output-dir=DIR      Specifies the output directory into which trace\n"
     "                        files will be written.\n"
     "\n";
 
-// Parses the bucket size. Leaves the value unchanged if it is not specified.
+// Parses the bucket size given by the switch @p switch_name. Leaves the value
+// unchanged if it is not specified.
 bool ParseBucketSize(const base::CommandLine* command_line,
+                     const char* switch_name,
                      size_t* log2_bucket_size) {
   DCHECK(command_line != NULL);
+  DCHECK(switch_name != NULL);
   DCHECK(log2_bucket_size != NULL);
 
-  if (!command_line->HasSwitch(SamplerApp::kBucketSize))
+  if (!command_line->HasSwitch(switch_name))
     return true;
 
-  std::string s = command_line->GetSwitchValueASCII(SamplerApp::kBucketSize);
+  std::string s = command_line->GetSwitchValueASCII(switch_name);
   size_t bucket_size = 0;
   if (!base::StringToSizeT(s, &bucket_size)) {
-    LOG(ERROR) << "--" << SamplerApp::kBucketSize << " must be an integer.";
+    LOG(ERROR) << "--" << switch_name << " must be an integer.";
     return false;
   }
   if (!common::IsPowerOfTwo(bucket_size)) {
-    LOG(ERROR) << "--" << SamplerApp::kBucketSize << " must be a power of 2.";
+    LOG(ERROR) << "--" << switch_name << " must be a power of 2.";
     return false;
   }
   if (bucket_size < 4) {
-    LOG(ERROR) << "--" << SamplerApp::kBucketSize << " must be >= 4.";
+    LOG(ERROR) << "--" << switch_name << " must be >= 4.";
     return false;
   }
 
@@ -104,6 +129,74 @@ bool ParseBucketSize(const base::CommandLine* command_line,
   return true;
 }
 
+// Parses the number of coarse buckets to be refined. Leaves the value
+// unchanged if it is not specified.
+bool ParseRefineBucketCount(const base::CommandLine* command_line,
+                            size_t* refine_bucket_count) {
+  DCHECK(command_line != NULL);
+  DCHECK(refine_bucket_count != NULL);
+
+  if (!command_line->HasSwitch(SamplerApp::kRefineBucketCount))
+    return true;
+
+  std::string s =
+      command_line->GetSwitchValueASCII(SamplerApp::kRefineBucketCount);
+  size_t count = 0;
+  if (!base::StringToSizeT(s, &count) || count == 0) {
+    LOG(ERROR) << "--" << SamplerApp::kRefineBucketCount
+               << " must be a positive integer.";
+    return false;
+  }
+
+  *refine_bucket_count = count;
+  return true;
+}
+
+// Parses the flush interval. Leaves the value unchanged if it is not
+// specified.
+bool ParseFlushInterval(const base::CommandLine* command_line,
+                        size_t* flush_interval) {
+  DCHECK(command_line != NULL);
+  DCHECK(flush_interval != NULL);
+
+  if (!command_line->HasSwitch(SamplerApp::kFlushInterval))
+    return true;
+
+  std::string s = command_line->GetSwitchValueASCII(SamplerApp::kFlushInterval);
+  if (!base::StringToSizeT(s, flush_interval)) {
+    LOG(ERROR) << "--" << SamplerApp::kFlushInterval
+               << " must be a non-negative integer.";
+    return false;
+  }
+
+  return true;
+}
+
+// Parses the stack sampling rate. Leaves the value unchanged if it is not
+// specified.
+bool ParseStackSamplingRate(const base::CommandLine* command_line,
+                            size_t* stack_sampling_rate) {
+  DCHECK(command_line != NULL);
+  DCHECK(stack_sampling_rate != NULL);
+
+  if (!command_line->HasSwitch(SamplerApp::kStackSamplingRate))
+    return true;
+
+  std::string s = command_line->GetSwitchValueASCII(
+      SamplerApp::kStackSamplingRate);
+  size_t rate = 0;
+  if (!base::StringToSizeT(s, &rate) ||
+      rate > SamplerApp::kMaxStackSamplingRate) {
+    LOG(ERROR) << "--" << SamplerApp::kStackSamplingRate
+               << " must be an integer in [0, "
+               << SamplerApp::kMaxStackSamplingRate << "].";
+    return false;
+  }
+
+  *stack_sampling_rate = rate;
+  return true;
+}
+
 // Parses the sampling interval. Leaves the value unchanged if it is not
 // specified.
 bool ParseSamplingInterval(const base::CommandLine* command_line,
@@ -525,16 +618,23 @@ bool WriteTraceModuleDataRecord(const SampledModuleCache::Module* module,
   return true;
 }
 
-// Converts the sample data in |module| to a TraceSampleData buffer and outputs
-// it to the provided TraceFileWriter.
+// Converts the sample data |buckets| of |module| gathered between |start_time|
+// and |end_time| to a TraceSampleData buffer and outputs it to the provided
+// TraceFileWriter. The buckets start at |bucket_start| and have a size of
+// 2^|log2_bucket_size|.
 bool WriteTraceSampleDataRecord(uint64_t sampling_interval_in_cycles,
                                 const SampledModuleCache::Module* module,
+                                const void* bucket_start,
+                                size_t log2_bucket_size,
+                                const std::vector<ULONG>& bucket_counts,
+                                uint64_t start_time,
+                                uint64_t end_time,
                                 TraceFileWriter* writer) {
   DCHECK(module != NULL);
   DCHECK(writer != NULL);
 
-  const ULONG* buckets = module->profiler().buckets().data();
-  size_t bucket_count = module->profiler().buckets().size();
+  const ULONG* buckets = bucket_counts.data();
+  size_t bucket_count = bucket_counts.size();
   DCHECK_LT(0u, bucket_count);
 
   // Calculate the size of the buffer required to store the samples.
@@ -552,11 +652,11 @@ bool WriteTraceSampleDataRecord(uint64_t sampling_interval_in_cycles,
   data->module_size = module->module_size();
   data->module_checksum = module->module_checksum();
   data->module_time_date_stamp = module->module_time_date_stamp();
-  data->bucket_size = 1 << module->log2_bucket_size();
-  data->bucket_start = reinterpret_cast<ModuleAddr>(module->buckets_begin());
+  data->bucket_size = 1 << log2_bucket_size;
+  data->bucket_start = reinterpret_cast<ModuleAddr>(bucket_start);
   data->bucket_count = bucket_count;
-  data->sampling_start_time = module->profiling_start_time();
-  data->sampling_end_time = module->profiling_stop_time();
+  data->sampling_start_time = start_time;
+  data->sampling_end_time = end_time;
   data->sampling_interval = sampling_interval_in_cycles;
 
   // Copy the samples into the buffer.
@@ -568,15 +668,51 @@ bool WriteTraceSampleDataRecord(uint64_t sampling_interval_in_cycles,
   return true;
 }
 
+// Outputs a TraceSampleStack buffer for each of the distinct stacks sampled
+// by |sampler| to the provided TraceFileWriter.
+bool WriteTraceSampleStackRecords(uint64_t sampling_interval_in_cycles,
+                                  const StackSampler& sampler,
+                                  TraceFileWriter* writer) {
+  DCHECK(writer != NULL);
+
+  std::vector<uint8_t> buffer;
+  for (const auto& stack_count_pair : sampler.stacks()) {
+    const StackSampler::Stack& stack = stack_count_pair.first;
+    DCHECK(!stack.empty());
+
+    size_t size = offsetof(TraceSampleStack, frames) +
+        sizeof(stack[0]) * stack.size();
+    buffer.assign(size, 0);
+    TraceSampleStack* data =
+        reinterpret_cast<TraceSampleStack*>(buffer.data());
+    data->sampling_interval = sampling_interval_in_cycles;
+    data->sample_count = stack_count_pair.second;
+    data->num_frames = stack.size();
+    ::memcpy(data->frames, stack.data(), sizeof(stack[0]) * stack.size());
+
+    if (!WriteTraceRecord(data, size, TRACE_SAMPLE_STACK, writer))
+      return false;
+  }
+
+  return true;
+}
+
 }  // namespace
 
 const char SamplerApp::kBlacklistPids[] = "blacklist-pids";
 const char SamplerApp::kBucketSize[] = "bucket-size";
+const char SamplerApp::kFlushInterval[] = "flush-interval";
 const char SamplerApp::kPids[] = "pids";
+const char SamplerApp::kRefineBucketCount[] = "refine-bucket-count";
+const char SamplerApp::kRefineBucketSize[] = "refine-bucket-size";
 const char SamplerApp::kSamplingInterval[] = "sampling-interval";
+const char SamplerApp::kStackSamplingRate[] = "stack-sampling-rate";
 const char SamplerApp::kOutputDir[] = "output-dir";
 
 const size_t SamplerApp::kDefaultLog2BucketSize = 2;
+const size_t SamplerApp::kDefaultRefineBucketCount = 64;
+const size_t SamplerApp::kRefineMinSampleCount = 1000;
+const size_t SamplerApp::kMaxStackSamplingRate = 1000;
 
 base::Lock SamplerApp::console_ctrl_lock_;
 SamplerApp* SamplerApp::console_ctrl_owner_ = NULL;
@@ -585,9 +721,14 @@ SamplerApp::SamplerApp()
     : application::AppImplBase("Sampler"),
       blacklist_pids_(true),
       log2_bucket_size_(kDefaultLog2BucketSize),
+      refine_log2_bucket_size_(0),
+      refine_bucket_count_(kDefaultRefineBucketCount),
       sampling_interval_(),
+      flush_interval_(0),
+      stack_sampling_rate_(0),
       running_(true),
-      sampling_interval_in_cycles_(0) {
+      sampling_interval_in_cycles_(0),
+      stack_sampling_interval_in_cycles_(0) {
 }
 
 SamplerApp::~SamplerApp() {
@@ -600,8 +741,19 @@ bool SamplerApp::ParseCommandLine(const base::CommandLine* command_line) {
     return PrintUsage(command_line->GetProgram(), "");
 
   // Parse the profiler parameters.
-  if (!ParseBucketSize(command_line, &log2_bucket_size_) ||
-      !ParseSamplingInterval(command_line, &sampling_interval_)) {
+  if (!ParseBucketSize(command_line, kBucketSize, &log2_bucket_size_) ||
+      !ParseBucketSize(command_line, kRefineBucketSize,
+                       &refine_log2_bucket_size_) ||
+      !ParseRefineBucketCount(command_line, &refine_bucket_count_) ||
+      !ParseSamplingInterval(command_line, &sampling_interval_) ||
+      !ParseFlushInterval(command_line, &flush_interval_) ||
+      !ParseStackSamplingRate(command_line, &stack_sampling_rate_)) {
+    return PrintUsage(command_line->GetProgram(), "");
+  }
+  if (refine_log2_bucket_size_ >= log2_bucket_size_ &&
+      refine_log2_bucket_size_ != 0) {
+    LOG(ERROR) << "--" << kRefineBucketSize << " must be smaller than --"
+               << kBucketSize << ".";
     return PrintUsage(command_line->GetProgram(), "");
   }
 
@@ -693,10 +845,29 @@ int SamplerApp::RunImpl() {
   double interval_in_seconds = sampling_interval_.InSecondsF();
   sampling_interval_in_cycles_ =
       interval_in_seconds * clock_info.tsc_info.frequency;
+  if (stack_sampling_rate_ > 0) {
+    stack_sampling_interval_in_cycles_ =
+        clock_info.tsc_info.frequency / stack_sampling_rate_;
+  }
 
   SampledModuleCache cache(log2_bucket_size_);
   cache.set_dead_module_callback(
       base::Bind(&SamplerApp::OnDeadModule, base::Unretained(this)));
+  cache.set_dead_process_callback(
+      base::Bind(&SamplerApp::OnDeadProcess, base::Unretained(this)));
+
+  if (refine_log2_bucket_size_ != 0) {
+    cache.set_refinement(refine_log2_bucket_size_, refine_bucket_count_,
+                         kRefineMinSampleCount);
+  }
+
+  // The cache is visited once per iteration of the polling loop below, so the
+  // flush period is expressed in iterations.
+  if (flush_interval_ > 0) {
+    cache.set_flush_module_callback(
+        base::Bind(&SamplerApp::OnFlushModule, base::Unretained(this)),
+        flush_interval_);
+  }
 
   // These are used for keeping track of how many modules are being profiled.
   size_t process_count = 0;
@@ -760,6 +931,12 @@ int SamplerApp::RunImpl() {
     // and causes the profile information to be written to a trace file.
     cache.RemoveDeadModules();
 
+    // Write out the samples gathered so far for the modules due a flush.
+    cache.FlushModules();
+
+    // Zoom in on the hot code of the modules that have enough samples.
+    cache.RefineModules();
+
     // Count the number of actively profiled modules and processes.
     size_t new_process_count = cache.processes().size();
     size_t new_module_count = cache.module_count();
@@ -779,8 +956,8 @@ int SamplerApp::RunImpl() {
     pids_ = filtered_pids;
 
     // We poll every second so as not to consume too much CPU time, but to not
-    // get caught too easily by PID reuse.
-    ::Sleep(1000);
+    // get caught too easily by PID reuse. The stacks are sampled in between.
+    SampleStacksForOneSecond(cache);
   }
 
   // Mark all modules as dead and remove them. This will clean up any in
@@ -834,36 +1011,136 @@ void SamplerApp::OnDeadModule(const SampledModuleCache::Module* module) {
   // Invoke our testing seam callback.
   OnStopProfiling(module);
 
-  const SampledModuleCache::Process* process = module->process();
-  DCHECK(process != NULL);
+  // Write whatever was gathered since the last flush of the module, which is
+  // everything if it was never flushed.
+  std::vector<ULONG> buckets;
+  module->GetUnflushedBuckets(&buckets);
+  WriteModuleSamples(module, module->buckets_begin(),
+                     module->log2_bucket_size(), buckets,
+                     module->last_flush_time(), module->profiling_stop_time());
+
+  // The hot ranges only refine how the samples of the whole module are
+  // distributed, so they are written once, after the coarse samples.
+  for (const auto& range : module->hot_ranges()) {
+    WriteModuleSamples(module, range->begin, module->hot_log2_bucket_size(),
+                       range->profiler.buckets(), range->profiling_start_time,
+                       module->profiling_stop_time());
+  }
 
-  base::FilePath basename = TraceFileWriter::GenerateTraceFileBaseName(
-          process->process_info());
-  base::FilePath trace_file_path = output_dir_.Append(basename);
+  // The module is about to be deleted, and its address may be reused.
+  described_modules_.erase(module);
+}
 
-  LOG(INFO) << "Writing module samples to \"" << trace_file_path.value()
-            << "\".";
+void SamplerApp::OnFlushModule(const SampledModuleCache::Module* module,
+                               const std::vector<ULONG>& buckets,
+                               uint64_t start_time,
+                               uint64_t end_time) {
+  DCHECK(module != NULL);
+  WriteModuleSamples(module, module->buckets_begin(),
+                     module->log2_bucket_size(), buckets, start_time,
+                     end_time);
+}
 
-  // TODO(chrisha): If we deal with processes with multiple profiled modules
-  //     or repeatedly loaded and unloaded modules, we could persist a trace
-  //     file writer for each process and use it repeatedly.
+void SamplerApp::OnDeadProcess(const SampledModuleCache::Process* process) {
+  DCHECK(process != NULL);
 
-  TraceFileWriter writer;
-  if (!writer.Open(trace_file_path))
-    return;
+  // The stacks are written after all the modules of the process, whose
+  // descriptions are needed to make sense of them.
+  StackSamplerMap::iterator it = stack_samplers_.find(process);
+  if (it != stack_samplers_.end()) {
+    TraceFileWriter* writer = GetTraceFileWriter(process);
+    if (writer != NULL) {
+      WriteTraceSampleStackRecords(stack_sampling_interval_in_cycles_,
+                                   *it->second, writer);
+    }
+    stack_samplers_.erase(it);
+  }
 
-  if (!writer.WriteHeader(process->process_info()))
-    return;
+  // This closes the trace file of the process, if any.
+  writers_.erase(process);
+}
 
-  if (!WriteTraceModuleDataRecord(module, &writer))
+void SamplerApp::SampleStacksForOneSecond(const SampledModuleCache& cache) {
+  if (stack_sampling_rate_ == 0) {
+    ::Sleep(1000);
     return;
+  }
+
+  // Pick up the processes and threads that were created since the last poll.
+  for (const auto& pid_process_pair : cache.processes()) {
+    const SampledModuleCache::Process* process = pid_process_pair.second;
+    StackSamplerMap::iterator it = stack_samplers_.find(process);
+    if (it != stack_samplers_.end()) {
+      it->second->UpdateThreads();
+      continue;
+    }
+
+    std::unique_ptr<StackSampler> sampler(new StackSampler());
+    if (!sampler->Initialize(process->process(), process->pid()))
+      continue;
+    stack_samplers_[process] = std::move(sampler);
+  }
+
+  DWORD period_ms = 1000 / stack_sampling_rate_;
+  for (size_t i = 0; i < stack_sampling_rate_; ++i) {
+    for (const auto& process_sampler_pair : stack_samplers_)
+      process_sampler_pair.second->SampleStacks();
+    ::Sleep(period_ms);
+  }
+}
+
+bool SamplerApp::WriteModuleSamples(const SampledModuleCache::Module* module,
+                                    const void* bucket_start,
+                                    size_t log2_bucket_size,
+                                    const std::vector<ULONG>& buckets,
+                                    uint64_t start_time,
+                                    uint64_t end_time) {
+  DCHECK(module != NULL);
+
+  TraceFileWriter* writer = GetTraceFileWriter(module->process());
+  if (writer == NULL)
+    return false;
+
+  if (described_modules_.find(module) == described_modules_.end()) {
+    if (!WriteTraceModuleDataRecord(module, writer))
+      return false;
+    described_modules_.insert(module);
+  }
 
   if (!WriteTraceSampleDataRecord(sampling_interval_in_cycles_, module,
-                                  &writer)) {
-    return;
+                                  bucket_start, log2_bucket_size, buckets,
+                                  start_time, end_time, writer)) {
+    return false;
   }
 
-  return;
+  return true;
+}
+
+TraceFileWriter* SamplerApp::GetTraceFileWriter(
+    const SampledModuleCache::Process* process) {
+  DCHECK(process != NULL);
+
+  TraceFileWriterMap::iterator it = writers_.find(process);
+  if (it != writers_.end())
+    return it->second.get();
+
+  base::FilePath basename = TraceFileWriter::GenerateTraceFileBaseName(
+          process->process_info());
+  base::FilePath trace_file_path = output_dir_.Append(basename);
+
+  LOG(INFO) << "Writing module samples to \"" << trace_file_path.value()
+            << "\".";
+
+  std::unique_ptr<TraceFileWriter> writer(new TraceFileWriter());
+  if (!writer->Open(trace_file_path))
+    return NULL;
+
+  if (!writer->WriteHeader(process->process_info()))
+    return NULL;
+
+  TraceFileWriter* raw_writer = writer.get();
+  writers_[process] = std::move(writer);
+  return raw_writer;
 }
 
 bool SamplerApp::GetModuleSignature(
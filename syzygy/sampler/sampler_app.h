@@ -18,12 +18,17 @@
 #ifndef SYZYGY_SAMPLER_SAMPLER_APP_H_
 #define SYZYGY_SAMPLER_SAMPLER_APP_H_
 
+#include <map>
+#include <memory>
 #include <set>
+#include <vector>
 
 #include "base/files/file_path.h"
 #include "base/time/time.h"
 #include "syzygy/application/application.h"
 #include "syzygy/sampler/sampled_module_cache.h"
+#include "syzygy/sampler/stack_sampler.h"
+#include "syzygy/trace/service/trace_file_writer.h"
 
 namespace sampler {
 
@@ -45,16 +50,28 @@ class SamplerApp : public application::AppImplBase {
   // @{
   static const char kBlacklistPids[];
   static const char kBucketSize[];
+  static const char kFlushInterval[];
   static const char kPids[];
+  static const char kRefineBucketCount[];
+  static const char kRefineBucketSize[];
   static const char kSamplingInterval[];
+  static const char kStackSamplingRate[];
   static const char kOutputDir[];
   // @}
 
   // @name Default command-line values.
   // @{
   static const size_t kDefaultLog2BucketSize;
+  static const size_t kDefaultRefineBucketCount;
   // @}
 
+  // The number of samples a module must have gathered before its hottest
+  // buckets are refined.
+  static const size_t kRefineMinSampleCount;
+
+  // The maximum number of times per second the stacks can be sampled.
+  static const size_t kMaxStackSamplingRate;
+
   // These are exposed for use by anonymous helper functions.
   struct ModuleSignature;
   typedef std::set<ModuleSignature> ModuleSignatureSet;
@@ -87,6 +104,53 @@ class SamplerApp : public application::AppImplBase {
   // @param module The module that has just finished profiling.
   void OnDeadModule(const SampledModuleCache::Module* module);
 
+  // The callback that is invoked periodically for the modules being profiled,
+  // if flushing is enabled.
+  // @param module The module being flushed.
+  // @param buckets The sample counts gathered since the last flush.
+  // @param start_time The time of the last flush of the module.
+  // @param end_time The time of this flush.
+  void OnFlushModule(const SampledModuleCache::Module* module,
+                     const std::vector<ULONG>& buckets,
+                     uint64_t start_time,
+                     uint64_t end_time);
+
+  // The callback that is invoked for processes once we have finished
+  // profiling all of their modules. This writes the stacks sampled in the
+  // process, if any, and closes its trace file.
+  // @param process The process that is no longer being profiled.
+  void OnDeadProcess(const SampledModuleCache::Process* process);
+
+  // Waits for a second, sampling the stacks of the processes being profiled
+  // in the meantime if stack sampling is enabled.
+  // @param cache The cache of the processes being profiled.
+  void SampleStacksForOneSecond(const SampledModuleCache& cache);
+
+  // Writes the sample data of a module to the trace file of its process,
+  // preceded by the description of the module if it is the first time data
+  // is written for it.
+  // @param module The module the samples belong to.
+  // @param bucket_start The start of the first bucket, in the address space
+  //     of the process of the module.
+  // @param log2_bucket_size The number of bits in the bucket size.
+  // @param buckets The sample counts.
+  // @param start_time The start of the period the samples were gathered in.
+  // @param end_time The end of the period the samples were gathered in.
+  // @returns true on success, false otherwise.
+  bool WriteModuleSamples(const SampledModuleCache::Module* module,
+                          const void* bucket_start,
+                          size_t log2_bucket_size,
+                          const std::vector<ULONG>& buckets,
+                          uint64_t start_time,
+                          uint64_t end_time);
+
+  // Gets the trace file writer of a process, opening the trace file and
+  // writing its header the first time.
+  // @param process The process whose trace file is to be written.
+  // @returns the writer, or NULL on failure.
+  trace::service::TraceFileWriter* GetTraceFileWriter(
+      const SampledModuleCache::Process* process);
+
   // Initializes a ModuleSignature given a path. Logs an error on failure.
   // @param module The path to the module.
   // @param sig The signature object to be initialized.
@@ -114,13 +178,24 @@ class SamplerApp : public application::AppImplBase {
   // is a whitelist.
   bool blacklist_pids_;
 
-  // Sampling profiler parameters.
+  // Sampling profiler parameters. The refined bucket size is zero if the hot
+  // code is not refined.
   size_t log2_bucket_size_;
+  size_t refine_log2_bucket_size_;
+  size_t refine_bucket_count_;
   base::TimeDelta sampling_interval_;
 
   // The output directory where trace files will be written.
   base::FilePath output_dir_;
 
+  // The interval in seconds between two flushes of the sample data of a
+  // module, or zero if the data is only written when profiling stops.
+  size_t flush_interval_;
+
+  // The number of times per second the stacks of the threads of the processes
+  // being profiled are sampled, or zero if they aren't.
+  size_t stack_sampling_rate_;
+
   // List of modules of interest. Any instances of these modules that are
   // loaded in processes of interest (those that get through our process
   // filter) will be profiled.
@@ -133,8 +208,27 @@ class SamplerApp : public application::AppImplBase {
   // @name Internal state and calculations.
   // @{
   uint64_t sampling_interval_in_cycles_;
+  uint64_t stack_sampling_interval_in_cycles_;
   // @}
 
+  // The trace file writers of the processes being profiled. A trace file is
+  // kept open for as long as any module of its process is being profiled, so
+  // that all the sample data of a process ends up in a single file.
+  typedef std::map<const SampledModuleCache::Process*,
+                   std::unique_ptr<trace::service::TraceFileWriter>>
+      TraceFileWriterMap;
+  TraceFileWriterMap writers_;
+
+  // The modules being profiled whose description was already written to the
+  // trace file of their process.
+  std::set<const SampledModuleCache::Module*> described_modules_;
+
+  // The stack samplers of the processes being profiled, if stack sampling is
+  // enabled.
+  typedef std::map<const SampledModuleCache::Process*,
+                   std::unique_ptr<StackSampler>> StackSamplerMap;
+  StackSamplerMap stack_samplers_;
+
   // Only one instance of this class can register for console control messages,
   // on a first-come first-serve basis.
   static base::Lock console_ctrl_lock_;
@@ -60,6 +60,10 @@ class TestSamplerApp : public SamplerApp {
   using SamplerApp::module_sigs_;
   using SamplerApp::log2_bucket_size_;
   using SamplerApp::sampling_interval_;
+  using SamplerApp::flush_interval_;
+  using SamplerApp::stack_sampling_rate_;
+  using SamplerApp::refine_log2_bucket_size_;
+  using SamplerApp::refine_bucket_count_;
   using SamplerApp::running_;
 
   void WaitUntilStartProfiling() {
@@ -356,6 +360,66 @@ TEST_F(SamplerAppTest, ParseValidSamplingIntervalScientific) {
   EXPECT_TRUE(impl_.output_dir_.empty());
 }
 
+TEST_F(SamplerAppTest, ParseRefineBucketSize) {
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kBucketSize, "64");
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kRefineBucketSize, "4");
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kRefineBucketCount, "16");
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+
+  EXPECT_EQ(6u, impl_.log2_bucket_size_);
+  EXPECT_EQ(2u, impl_.refine_log2_bucket_size_);
+  EXPECT_EQ(16u, impl_.refine_bucket_count_);
+}
+
+TEST_F(SamplerAppTest, ParseRefineBucketSizeNotSmallerFails) {
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kBucketSize, "8");
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kRefineBucketSize, "8");
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(SamplerAppTest, ParseInvalidRefineBucketCountFails) {
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kBucketSize, "8");
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kRefineBucketSize, "4");
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kRefineBucketCount, "0");
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(SamplerAppTest, ParseInvalidFlushIntervalFails) {
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kFlushInterval, "-1");
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(SamplerAppTest, ParseValidFlushInterval) {
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kFlushInterval, "30");
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+
+  EXPECT_THAT(impl_.module_sigs_, testing::ElementsAre(test_dll_sig));
+  EXPECT_EQ(SamplerApp::kDefaultLog2BucketSize, impl_.log2_bucket_size_);
+  EXPECT_EQ(kDefaultSamplingInterval, impl_.sampling_interval_);
+  EXPECT_EQ(30u, impl_.flush_interval_);
+}
+
+TEST_F(SamplerAppTest, ParseInvalidStackSamplingRateFails) {
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kStackSamplingRate, "1001");
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(SamplerAppTest, ParseValidStackSamplingRate) {
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kStackSamplingRate, "100");
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+
+  EXPECT_THAT(impl_.module_sigs_, testing::ElementsAre(test_dll_sig));
+  EXPECT_EQ(0u, impl_.flush_interval_);
+  EXPECT_EQ(100u, impl_.stack_sampling_rate_);
+}
+
 TEST_F(SamplerAppTest, ParseOutputDir) {
   cmd_line_.AppendSwitchASCII(TestSamplerApp::kOutputDir, "foo");
   cmd_line_.AppendArgPath(test_dll_path);
@@ -373,6 +437,7 @@ TEST_F(SamplerAppTest, ParseMinimal) {
   cmd_line_.AppendArgPath(test_dll_path);
   ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
 
+  EXPECT_EQ(0u, impl_.flush_interval_);
   EXPECT_TRUE(impl_.pids_.empty());
   EXPECT_TRUE(impl_.blacklist_pids_);
   EXPECT_THAT(impl_.module_sigs_, testing::ElementsAre(test_dll_sig));
@@ -0,0 +1,200 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/sampler/stack_sampler.h"
+
+#include <tlhelp32.h>
+
+#include <algorithm>
+#include <set>
+
+#include "base/logging.h"
+#include "syzygy/common/com_utils.h"
+
+namespace sampler {
+
+StackSampler::StackSampler()
+    : process_(NULL), pid_(0), sample_count_(0) {
+}
+
+StackSampler::~StackSampler() {
+}
+
+bool StackSampler::Initialize(HANDLE process, DWORD pid) {
+  DCHECK(process != NULL);
+  DCHECK(process_ == NULL);
+
+  process_ = process;
+  pid_ = pid;
+  buffer_.resize(kMaxStackSize);
+
+  return UpdateThreads();
+}
+
+bool StackSampler::UpdateThreads() {
+  DCHECK(process_ != NULL);
+
+  base::win::ScopedHandle snapshot(
+      ::CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0));
+  if (!snapshot.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "CreateToolhelp32Snapshot failed: " << common::LogWe(error);
+    return false;
+  }
+
+  // The snapshot holds the threads of all the processes of the system.
+  std::set<DWORD> thread_ids;
+  THREADENTRY32 entry = {};
+  entry.dwSize = sizeof(entry);
+  BOOL more = ::Thread32First(snapshot.Get(), &entry);
+  for (; more; more = ::Thread32Next(snapshot.Get(), &entry)) {
+    if (entry.th32OwnerProcessID != pid_)
+      continue;
+
+    // A thread can't sample its own stack.
+    if (pid_ == ::GetCurrentProcessId() &&
+        entry.th32ThreadID == ::GetCurrentThreadId()) {
+      continue;
+    }
+
+    thread_ids.insert(entry.th32ThreadID);
+    if (threads_.find(entry.th32ThreadID) != threads_.end())
+      continue;
+
+    const DWORD kDesiredAccess = THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT;
+    HANDLE handle = ::OpenThread(kDesiredAccess, FALSE, entry.th32ThreadID);
+    if (handle == NULL)
+      continue;
+
+    std::unique_ptr<Thread> thread(new Thread());
+    thread->handle.Set(handle);
+    threads_[entry.th32ThreadID] = std::move(thread);
+  }
+
+  // Close the threads that have exited.
+  ThreadMap::iterator it = threads_.begin();
+  while (it != threads_.end()) {
+    if (thread_ids.find(it->first) == thread_ids.end())
+      it = threads_.erase(it);
+    else
+      ++it;
+  }
+
+  return true;
+}
+
+size_t StackSampler::SampleStacks() {
+  size_t stack_count = 0;
+  Stack stack;
+  for (const auto& thread_pair : threads_) {
+    if (!SampleStack(thread_pair.second.get(), &stack))
+      continue;
+
+    ++stacks_[stack];
+    ++stack_count;
+  }
+
+  sample_count_ += stack_count;
+  return stack_count;
+}
+
+// static
+void StackSampler::WalkStack(uint32_t pc,
+                             uint32_t ebp,
+                             uint32_t stack_start,
+                             const uint8_t* data,
+                             size_t size,
+                             Stack* stack) {
+  DCHECK(data != NULL || size == 0);
+  DCHECK(stack != NULL);
+
+  stack->clear();
+  stack->push_back(reinterpret_cast<void*>(pc));
+
+  uint32_t stack_end = stack_start + size;
+  while (stack->size() < kMaxFrameCount) {
+    // The frame pointer must be aligned, and point at the saved frame pointer
+    // and the return address of the frame within the copy of the stack.
+    if (ebp < stack_start || ebp >= stack_end || stack_end - ebp < 8 ||
+        ebp % 4 != 0) {
+      break;
+    }
+    const uint32_t* frame =
+        reinterpret_cast<const uint32_t*>(data + (ebp - stack_start));
+    uint32_t next_ebp = frame[0];
+    uint32_t return_address = frame[1];
+
+    // A return address is never null, nor in the stack itself.
+    if (return_address == 0 ||
+        (return_address >= stack_start && return_address < stack_end)) {
+      break;
+    }
+    stack->push_back(reinterpret_cast<void*>(return_address));
+
+    // Frames are laid out linearly on the stack, with at least the saved
+    // frame pointer and the return address between two of them.
+    if (next_ebp <= ebp || next_ebp - ebp < 8)
+      break;
+    ebp = next_ebp;
+  }
+}
+
+bool StackSampler::SampleStack(Thread* thread, Stack* stack) {
+  DCHECK(thread != NULL);
+  DCHECK(stack != NULL);
+
+  if (::SuspendThread(thread->handle.Get()) == static_cast<DWORD>(-1))
+    return false;
+
+  // Only what is strictly needed is done while the thread is suspended: the
+  // stack is walked once it runs again.
+  CONTEXT context = {};
+  context.ContextFlags = CONTEXT_CONTROL;
+  bool got_context = ::GetThreadContext(thread->handle.Get(), &context) != 0;
+  SIZE_T bytes_read = 0;
+  if (got_context) {
+    // Find the end of the stack, unless the thread has switched to another
+    // stack since.
+    if (context.Esp >= thread->stack_end) {
+      MEMORY_BASIC_INFORMATION info = {};
+      if (::VirtualQueryEx(process_, reinterpret_cast<void*>(context.Esp),
+                           &info, sizeof(info)) == sizeof(info)) {
+        thread->stack_end = reinterpret_cast<uint32_t>(info.BaseAddress) +
+            info.RegionSize;
+      }
+    }
+
+    if (context.Esp < thread->stack_end) {
+      size_t size = std::min<size_t>(buffer_.size(),
+                                     thread->stack_end - context.Esp);
+      if (!::ReadProcessMemory(process_, reinterpret_cast<void*>(context.Esp),
+                               buffer_.data(), size, &bytes_read)) {
+        // Look for the end of the stack again on the next sample.
+        bytes_read = 0;
+        thread->stack_end = 0;
+      }
+    }
+  }
+
+  ::ResumeThread(thread->handle.Get());
+
+  if (!got_context)
+    return false;
+
+  WalkStack(context.Eip, context.Ebp, context.Esp, buffer_.data(), bytes_read,
+            stack);
+  return true;
+}
+
+}  // namespace sampler
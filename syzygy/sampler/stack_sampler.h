@@ -0,0 +1,149 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares StackSampler, which samples the call stacks of the threads of a
+// remote process. It complements the program counter histograms of the
+// SamplingProfiler with the callers of the sampled code.
+
+#ifndef SYZYGY_SAMPLER_STACK_SAMPLER_H_
+#define SYZYGY_SAMPLER_STACK_SAMPLER_H_
+
+#include <windows.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/win/scoped_handle.h"
+
+namespace sampler {
+
+// Samples the call stacks of the threads of a process, by briefly suspending
+// each thread and walking the chain of its frame pointers. The stack of a
+// thread is copied with a single read while the thread is suspended, and is
+// walked once the thread has been resumed. Each distinct stack is stored once,
+// along with the number of samples it was observed in.
+//
+// The walk follows the same invariants as agent/common/stack_walker.h, and
+// derails in the same way at frames that don't maintain a frame pointer.
+//
+// Usage:
+//   StackSampler sampler;
+//   if (!sampler.Initialize(process, pid)) ...
+//   while (...) {
+//     // Once in a while, to pick up the threads that were created since.
+//     if (!sampler.UpdateThreads()) ...
+//     sampler.SampleStacks();
+//   }
+//   for (const auto& stack : sampler.stacks()) ...
+class StackSampler {
+ public:
+  // A stack, innermost frame first. The first frame is the program counter
+  // of the thread, and the others are return addresses.
+  typedef std::vector<void*> Stack;
+
+  // The number of samples of each distinct stack.
+  typedef std::map<Stack, uint32_t> StackCounts;
+
+  // The maximum number of frames of a stack.
+  static const size_t kMaxFrameCount = 62;
+
+  // The maximum number of bytes of a stack that are read per sample.
+  static const size_t kMaxStackSize = 64 * 1024;
+
+  StackSampler();
+  ~StackSampler();
+
+  // Initializes the sampler.
+  // @param process A handle to the process, with at least the
+  //     PROCESS_QUERY_INFORMATION and PROCESS_VM_READ access rights. The
+  //     handle must outlive the sampler.
+  // @param pid The ID of the process.
+  // @returns true on success, false otherwise.
+  bool Initialize(HANDLE process, DWORD pid);
+
+  // Opens the threads of the process that were created since the last call,
+  // and closes those that have exited. Threads that can't be opened are
+  // skipped, as is the calling thread.
+  // @returns true on success, false otherwise.
+  bool UpdateThreads();
+
+  // Takes a sample of the stack of each thread of the process.
+  // @returns the number of stacks that were sampled.
+  size_t SampleStacks();
+
+  // @name Accessors.
+  // @{
+  DWORD pid() const { return pid_; }
+  size_t thread_count() const { return threads_.size(); }
+  const StackCounts& stacks() const { return stacks_; }
+  uint64_t sample_count() const { return sample_count_; }
+  // @}
+
+ protected:
+  // Walks a copy of part of the stack of a thread.
+  // @param pc The program counter of the thread.
+  // @param ebp The frame pointer of the thread.
+  // @param stack_start The address of the first byte of the copy in the
+  //     thread's address space. This is the stack pointer of the thread.
+  // @param data The copy of the stack.
+  // @param size The size of the copy.
+  // @param stack Receives the frames.
+  // @note This is exposed for unit testing.
+  static void WalkStack(uint32_t pc,
+                        uint32_t ebp,
+                        uint32_t stack_start,
+                        const uint8_t* data,
+                        size_t size,
+                        Stack* stack);
+
+ private:
+  struct Thread {
+    Thread() : stack_end(0) {}
+
+    base::win::ScopedHandle handle;
+
+    // The end of the committed region of the stack, which bounds the reads.
+    // This is found on the first sample of the thread.
+    uint32_t stack_end;
+  };
+  typedef std::map<DWORD, std::unique_ptr<Thread>> ThreadMap;
+
+  // Takes a sample of the stack of a thread.
+  // @param thread The thread to sample.
+  // @param stack Receives the frames.
+  // @returns true on success, false otherwise.
+  bool SampleStack(Thread* thread, Stack* stack);
+
+  // The process being sampled. Not owned.
+  HANDLE process_;
+  DWORD pid_;
+
+  // The threads of the process, keyed by ID.
+  ThreadMap threads_;
+
+  // The stacks sampled so far, and the number of samples taken.
+  StackCounts stacks_;
+  uint64_t sample_count_;
+
+  // The buffer the stacks are copied to.
+  std::vector<uint8_t> buffer_;
+
+  DISALLOW_COPY_AND_ASSIGN(StackSampler);
+};
+
+}  // namespace sampler
+
+#endif  // SYZYGY_SAMPLER_STACK_SAMPLER_H_
@@ -0,0 +1,114 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/sampler/stack_sampler.h"
+
+#include "base/win/scoped_handle.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace sampler {
+
+namespace {
+
+class TestStackSampler : public StackSampler {
+ public:
+  using StackSampler::WalkStack;
+};
+
+// A thread that blocks until its event is signaled.
+DWORD WINAPI WaitForEvent(void* event) {
+  ::WaitForSingleObject(reinterpret_cast<HANDLE>(event), INFINITE);
+  return 0;
+}
+
+}  // namespace
+
+TEST(StackSamplerTest, WalkStack) {
+  // A fake stack of three frames, laid out from address 0x1000.
+  const uint32_t kStackStart = 0x1000;
+  uint32_t data[12] = {};
+  data[2] = kStackStart + 6 * sizeof(uint32_t);  // Saved EBP of frame 0.
+  data[3] = 0x00401000;                         // Return address of frame 0.
+  data[6] = kStackStart + 10 * sizeof(uint32_t);  // Saved EBP of frame 1.
+  data[7] = 0x00402000;                         // Return address of frame 1.
+  data[10] = 0;                                 // Saved EBP of frame 2.
+  data[11] = 0x00403000;                        // Return address of frame 2.
+
+  StackSampler::Stack stack;
+  TestStackSampler::WalkStack(0x00400000, kStackStart + 2 * sizeof(uint32_t),
+                              kStackStart, reinterpret_cast<uint8_t*>(data),
+                              sizeof(data), &stack);
+  EXPECT_THAT(stack, testing::ElementsAre(
+      reinterpret_cast<void*>(0x00400000), reinterpret_cast<void*>(0x00401000),
+      reinterpret_cast<void*>(0x00402000),
+      reinterpret_cast<void*>(0x00403000)));
+
+  // A frame pointer outside of the copy stops the walk at the program
+  // counter.
+  TestStackSampler::WalkStack(0x00400000, kStackStart + sizeof(data),
+                              kStackStart, reinterpret_cast<uint8_t*>(data),
+                              sizeof(data), &stack);
+  EXPECT_THAT(stack,
+              testing::ElementsAre(reinterpret_cast<void*>(0x00400000)));
+
+  // A return address into the stack stops the walk.
+  data[7] = kStackStart + 4;
+  TestStackSampler::WalkStack(0x00400000, kStackStart + 2 * sizeof(uint32_t),
+                              kStackStart, reinterpret_cast<uint8_t*>(data),
+                              sizeof(data), &stack);
+  EXPECT_THAT(stack, testing::ElementsAre(
+      reinterpret_cast<void*>(0x00400000),
+      reinterpret_cast<void*>(0x00401000)));
+
+  // So does a frame pointer that goes down the stack.
+  data[7] = 0x00402000;
+  data[6] = kStackStart;
+  TestStackSampler::WalkStack(0x00400000, kStackStart + 2 * sizeof(uint32_t),
+                              kStackStart, reinterpret_cast<uint8_t*>(data),
+                              sizeof(data), &stack);
+  EXPECT_THAT(stack, testing::ElementsAre(
+      reinterpret_cast<void*>(0x00400000), reinterpret_cast<void*>(0x00401000),
+      reinterpret_cast<void*>(0x00402000)));
+}
+
+TEST(StackSamplerTest, SampleStacks) {
+  base::win::ScopedHandle event(::CreateEvent(NULL, TRUE, FALSE, NULL));
+  ASSERT_TRUE(event.IsValid());
+  base::win::ScopedHandle thread(
+      ::CreateThread(NULL, 0, &WaitForEvent, event.Get(), 0, NULL));
+  ASSERT_TRUE(thread.IsValid());
+
+  {
+    StackSampler sampler;
+    ASSERT_TRUE(sampler.Initialize(::GetCurrentProcess(),
+                                   ::GetCurrentProcessId()));
+    EXPECT_LE(1u, sampler.thread_count());
+
+    size_t stack_count = sampler.SampleStacks();
+    EXPECT_LE(1u, stack_count);
+    EXPECT_GE(sampler.thread_count(), stack_count);
+    EXPECT_EQ(stack_count, sampler.sample_count());
+    EXPECT_FALSE(sampler.stacks().empty());
+    for (const auto& stack_count_pair : sampler.stacks()) {
+      EXPECT_FALSE(stack_count_pair.first.empty());
+      EXPECT_GE(StackSampler::kMaxFrameCount, stack_count_pair.first.size());
+    }
+  }
+
+  ::SetEvent(event.Get());
+  ASSERT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(thread.Get(), INFINITE));
+}
+
+}  // namespace sampler
@@ -0,0 +1,208 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/simulate/cache_simulation.h"
+
+#include <algorithm>
+
+#include "syzygy/core/json_file_writer.h"
+
+namespace simulate {
+
+CacheSimulation::Cache::Cache(size_t set_count, size_t associativity)
+    : set_count_(set_count),
+      associativity_(associativity),
+      ways_(set_count * associativity, kInvalidIndex) {
+  DCHECK_LT(0u, set_count);
+  DCHECK_LT(0u, associativity);
+}
+
+bool CacheSimulation::Cache::Access(uint32_t index) {
+  DCHECK_NE(kInvalidIndex, index);
+
+  std::vector<uint32_t>::iterator set_begin =
+      ways_.begin() + (index % set_count_) * associativity_;
+  std::vector<uint32_t>::iterator set_end = set_begin + associativity_;
+
+  // The entry becomes the most recently used of its set. When it wasn't in
+  // the set, it replaces the least recently used entry.
+  std::vector<uint32_t>::iterator way = std::find(set_begin, set_end, index);
+  bool hit = way != set_end;
+  if (!hit) {
+    way = set_end - 1;
+    *way = index;
+  }
+  std::rotate(set_begin, way, way + 1);
+  return hit;
+}
+
+void CacheSimulation::Cache::Flush() {
+  std::fill(ways_.begin(), ways_.end(), kInvalidIndex);
+}
+
+CacheSimulation::CacheSimulation()
+    : cache_size_(kDefaultCacheSize),
+      cache_line_size_(kDefaultCacheLineSize),
+      cache_associativity_(kDefaultCacheAssociativity),
+      tlb_entries_(kDefaultTlbEntries),
+      tlb_associativity_(kDefaultTlbAssociativity),
+      page_size_(0),
+      cache_accesses_(0),
+      cache_misses_(0),
+      tlb_accesses_(0),
+      tlb_misses_(0) {
+}
+
+CacheSimulation::~CacheSimulation() {
+}
+
+bool CacheSimulation::IsValid() const {
+  size_t line_bytes = cache_line_size_ * cache_associativity_;
+  if (cache_size_ < line_bytes || cache_size_ % line_bytes != 0)
+    return false;
+  if (tlb_entries_ < tlb_associativity_ ||
+      tlb_entries_ % tlb_associativity_ != 0) {
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<SimulationEventHandler> CacheSimulation::CreateClone() const {
+  std::unique_ptr<CacheSimulation> clone(new CacheSimulation());
+  clone->cache_size_ = cache_size_;
+  clone->cache_line_size_ = cache_line_size_;
+  clone->cache_associativity_ = cache_associativity_;
+  clone->tlb_entries_ = tlb_entries_;
+  clone->tlb_associativity_ = tlb_associativity_;
+  clone->page_size_ = page_size_;
+  return std::move(clone);
+}
+
+bool CacheSimulation::MergeClone(SimulationEventHandler* clone) {
+  DCHECK(clone != NULL);
+  CacheSimulation* simulation = static_cast<CacheSimulation*>(clone);
+
+  // The page size of a clone that wasn't set by the user is set by the first
+  // process of its trace file.
+  if (page_size_ == 0) {
+    page_size_ = simulation->page_size_;
+  } else if (simulation->page_size_ != 0 &&
+             simulation->page_size_ != page_size_) {
+    LOG(ERROR) << "Can't merge cache simulations with different page sizes.";
+    return false;
+  }
+
+  cache_accesses_ += simulation->cache_accesses_;
+  cache_misses_ += simulation->cache_misses_;
+  tlb_accesses_ += simulation->tlb_accesses_;
+  tlb_misses_ += simulation->tlb_misses_;
+  return true;
+}
+
+void CacheSimulation::OnProcessStarted(base::Time /*time*/,
+                                       size_t default_page_size) {
+  DCHECK(IsValid());
+
+  // Set the page size if it wasn't set by the user yet.
+  if (page_size_ == 0) {
+    if (default_page_size != 0)
+      page_size_ = default_page_size;
+    else
+      page_size_ = kDefaultPageSize;
+
+    LOG(INFO) << "Page size set to " << page_size_;
+  }
+
+  // Each process starts with cold caches.
+  if (cache_.get() == NULL) {
+    cache_.reset(new Cache(
+        cache_size_ / (cache_line_size_ * cache_associativity_),
+        cache_associativity_));
+    tlb_.reset(new Cache(tlb_entries_ / tlb_associativity_,
+                         tlb_associativity_));
+  } else {
+    cache_->Flush();
+    tlb_->Flush();
+  }
+}
+
+void CacheSimulation::OnFunctionEntry(base::Time /*time*/,
+                                      const Block* block) {
+  DCHECK(block != NULL);
+
+  OnRangeAccess(block->addr().value(), block->size());
+}
+
+bool CacheSimulation::SerializeToJSON(FILE* output, bool pretty_print) {
+  DCHECK(output != NULL);
+  core::JSONFileWriter json_file(output, pretty_print);
+
+  // The counts are output as doubles, which hold them exactly, as they can
+  // exceed the range of an int.
+  if (!json_file.OpenDict() ||
+      !json_file.OutputKey("cache_size") ||
+      !json_file.OutputInteger(cache_size_) ||
+      !json_file.OutputKey("cache_line_size") ||
+      !json_file.OutputInteger(cache_line_size_) ||
+      !json_file.OutputKey("cache_associativity") ||
+      !json_file.OutputInteger(cache_associativity_) ||
+      !json_file.OutputKey("cache_accesses") ||
+      !json_file.OutputDouble(static_cast<double>(cache_accesses_)) ||
+      !json_file.OutputKey("cache_misses") ||
+      !json_file.OutputDouble(static_cast<double>(cache_misses_)) ||
+      !json_file.OutputKey("tlb_entries") ||
+      !json_file.OutputInteger(tlb_entries_) ||
+      !json_file.OutputKey("tlb_associativity") ||
+      !json_file.OutputInteger(tlb_associativity_) ||
+      !json_file.OutputKey("page_size") ||
+      !json_file.OutputInteger(page_size_) ||
+      !json_file.OutputKey("tlb_accesses") ||
+      !json_file.OutputDouble(static_cast<double>(tlb_accesses_)) ||
+      !json_file.OutputKey("tlb_misses") ||
+      !json_file.OutputDouble(static_cast<double>(tlb_misses_)) ||
+      !json_file.CloseDict()) {
+    return false;
+  }
+
+  DCHECK(json_file.Finished());
+  return true;
+}
+
+void CacheSimulation::OnRangeAccess(uint32_t address, size_t size) {
+  DCHECK(cache_.get() != NULL);
+  DCHECK(tlb_.get() != NULL);
+  DCHECK_NE(0u, page_size_);
+
+  if (size == 0)
+    return;
+
+  // The pages are translated before their lines are fetched, in address
+  // order.
+  const uint32_t last_address = address + static_cast<uint32_t>(size) - 1;
+  for (uint32_t page = address / page_size_;
+       page <= last_address / page_size_; ++page) {
+    ++tlb_accesses_;
+    if (!tlb_->Access(page))
+      ++tlb_misses_;
+  }
+
+  for (uint32_t line = address / cache_line_size_;
+       line <= last_address / cache_line_size_; ++line) {
+    ++cache_accesses_;
+    if (!cache_->Access(line))
+      ++cache_misses_;
+  }
+}
+
+}  // namespace simulate
@@ -0,0 +1,208 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file provides the CacheSimulation class.
+
+#ifndef SYZYGY_SIMULATE_CACHE_SIMULATION_H_
+#define SYZYGY_SIMULATE_CACHE_SIMULATION_H_
+
+#include <vector>
+
+#include "syzygy/simulate/simulation_event_handler.h"
+
+namespace simulate {
+
+// An implementation of SimulationEventHandler. CacheSimulation models an
+// instruction cache and an instruction TLB, and counts their misses when the
+// code of the functions is fetched. This lets the orderings of an image be
+// compared without hardware counters. Sample usage:
+//
+// CacheSimulation simulation;
+//
+// simulation.set_cache_size(0x8000);
+// simulation.set_cache_line_size(64);
+// simulation.set_cache_associativity(8);
+// simulation.OnProcessStarted(time, 0);
+// simulation.OnFunctionEntry(time, block1);
+// simulation.OnFunctionEntry(time, block2);
+// simulation.SerializeToJSON(file, pretty_print);
+//
+// Each function entry fetches every cache line and every page of the block of
+// the function once. Both caches are set associative and evict their least
+// recently used entries. They are flushed when a process starts.
+//
+// If the page size is not set, then it's deduced from the trace file data
+// or, if that's not possible, it's set to the default value of 0x1000 (4 KB).
+class CacheSimulation : public SimulationEventHandler {
+ public:
+  class Cache;
+
+  typedef block_graph::BlockGraph::Block Block;
+
+  // The default geometries of the caches, which match the level 1
+  // instruction cache and TLB of common x86 processors.
+  static const size_t kDefaultCacheSize = 0x8000;
+  static const size_t kDefaultCacheLineSize = 64;
+  static const size_t kDefaultCacheAssociativity = 8;
+  static const size_t kDefaultTlbEntries = 64;
+  static const size_t kDefaultTlbAssociativity = 4;
+  static const size_t kDefaultPageSize = 0x1000;
+
+  // Constructs a new CacheSimulation instance.
+  CacheSimulation();
+  ~CacheSimulation();
+
+  // @returns true if the geometries of the caches are consistent: each cache
+  //     has at least one set, and its entries fill its sets.
+  bool IsValid() const;
+
+  // @name Accessors
+  // @{
+  size_t cache_size() const { return cache_size_; }
+  size_t cache_line_size() const { return cache_line_size_; }
+  size_t cache_associativity() const { return cache_associativity_; }
+  size_t tlb_entries() const { return tlb_entries_; }
+  size_t tlb_associativity() const { return tlb_associativity_; }
+  size_t page_size() const { return page_size_; }
+  uint64_t cache_accesses() const { return cache_accesses_; }
+  uint64_t cache_misses() const { return cache_misses_; }
+  uint64_t tlb_accesses() const { return tlb_accesses_; }
+  uint64_t tlb_misses() const { return tlb_misses_; }
+  // @}
+
+  // @name Mutators
+  // These must be called before the first process is started.
+  // @{
+  void set_cache_size(size_t cache_size) {
+    DCHECK_LT(0u, cache_size);
+    cache_size_ = cache_size;
+  }
+  void set_cache_line_size(size_t cache_line_size) {
+    DCHECK_LT(0u, cache_line_size);
+    cache_line_size_ = cache_line_size;
+  }
+  void set_cache_associativity(size_t cache_associativity) {
+    DCHECK_LT(0u, cache_associativity);
+    cache_associativity_ = cache_associativity;
+  }
+  void set_tlb_entries(size_t tlb_entries) {
+    DCHECK_LT(0u, tlb_entries);
+    tlb_entries_ = tlb_entries;
+  }
+  void set_tlb_associativity(size_t tlb_associativity) {
+    DCHECK_LT(0u, tlb_associativity);
+    tlb_associativity_ = tlb_associativity;
+  }
+  void set_page_size(size_t page_size) {
+    DCHECK_LT(0u, page_size);
+    page_size_ = page_size;
+  }
+  // @}
+
+  // @name SimulationEventHandler implementation
+  // @{
+  // Creates an empty simulation with the same geometries as this one.
+  std::unique_ptr<SimulationEventHandler> CreateClone() const override;
+
+  // Adds the accesses and the misses of a clone to this simulation. As the
+  // caches are flushed when a process starts, the counts are the same as
+  // those of a simulation of the trace files one after the other.
+  // @param clone A simulation returned by CreateClone.
+  // @returns true on success, false otherwise.
+  bool MergeClone(SimulationEventHandler* clone) override;
+
+  // Sets the page size if it's not set already, and flushes the caches.
+  void OnProcessStarted(base::Time time, size_t default_page_size) override;
+
+  // Fetches the code of a function block.
+  void OnFunctionEntry(base::Time time, const Block* block) override;
+
+  // The serialization consists of a single dictionary containing the
+  // geometries of the caches, and their numbers of accesses and misses.
+  bool SerializeToJSON(FILE* output, bool pretty_print) override;
+  // @}
+
+  // Fetches the code of a range of addresses. This lets a layout other than
+  // the one of the blocks be simulated, such as a candidate order.
+  // @param address The start address of the range.
+  // @param size The size of the range, in bytes.
+  void OnRangeAccess(uint32_t address, size_t size);
+
+ protected:
+  // The geometries of the caches.
+  size_t cache_size_;
+  size_t cache_line_size_;
+  size_t cache_associativity_;
+  size_t tlb_entries_;
+  size_t tlb_associativity_;
+
+  // The size of each page, in bytes. If not set, CacheSimulation loads the
+  // system value, or uses kDefaultPageSize if it's unavailable.
+  size_t page_size_;
+
+  // The simulated caches. These are created when the first process starts.
+  std::unique_ptr<Cache> cache_;
+  std::unique_ptr<Cache> tlb_;
+
+  // The numbers of accesses and misses of the caches.
+  uint64_t cache_accesses_;
+  uint64_t cache_misses_;
+  uint64_t tlb_accesses_;
+  uint64_t tlb_misses_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(CacheSimulation);
+};
+
+// A set associative cache with a least recently used replacement policy. The
+// entries are identified by their index, which is an address divided by the
+// size of the entries.
+class CacheSimulation::Cache {
+ public:
+  // Creates an empty cache.
+  // @param set_count The number of sets of the cache.
+  // @param associativity The number of entries of each set.
+  Cache(size_t set_count, size_t associativity);
+
+  // Accesses an entry, loading it if it isn't in the cache.
+  // @param index The index of the entry.
+  // @returns true if the entry was in the cache, false otherwise.
+  bool Access(uint32_t index);
+
+  // Evicts all the entries of the cache.
+  void Flush();
+
+  // @name Accessors.
+  // @{
+  size_t set_count() const { return set_count_; }
+  size_t associativity() const { return associativity_; }
+  // @}
+
+ private:
+  // Marks the ways of the sets that hold no entry.
+  static const uint32_t kInvalidIndex = 0xFFFFFFFF;
+
+  size_t set_count_;
+  size_t associativity_;
+
+  // The entries of each set, which are stored contiguously. The entries of a
+  // set are ordered from the most recently used to the least recently used.
+  std::vector<uint32_t> ways_;
+
+  DISALLOW_COPY_AND_ASSIGN(Cache);
+};
+
+}  // namespace simulate
+
+#endif  // SYZYGY_SIMULATE_CACHE_SIMULATION_H_
@@ -0,0 +1,239 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/simulate/cache_simulation.h"
+
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/json/json_reader.h"
+#include "base/values.h"
+#include "gtest/gtest.h"
+
+namespace simulate {
+
+namespace {
+
+using block_graph::BlockGraph;
+
+class CacheSimulationTest : public testing::Test {
+ public:
+  void SetUp() override {
+    // A small cache with two sets of two lines, and a TLB of two pages.
+    simulation_.set_cache_size(256);
+    simulation_.set_cache_line_size(64);
+    simulation_.set_cache_associativity(2);
+    simulation_.set_tlb_entries(2);
+    simulation_.set_tlb_associativity(2);
+    simulation_.set_page_size(0x1000);
+    ASSERT_TRUE(simulation_.IsValid());
+  }
+
+ protected:
+  CacheSimulation simulation_;
+  base::Time time_;
+};
+
+}  // namespace
+
+TEST(CacheTest, LeastRecentlyUsedIsEvicted) {
+  CacheSimulation::Cache cache(1, 2);
+  EXPECT_FALSE(cache.Access(1));
+  EXPECT_FALSE(cache.Access(2));
+  EXPECT_TRUE(cache.Access(1));
+
+  // 2 is the least recently used entry.
+  EXPECT_FALSE(cache.Access(3));
+  EXPECT_TRUE(cache.Access(1));
+  EXPECT_TRUE(cache.Access(3));
+  EXPECT_FALSE(cache.Access(2));
+}
+
+TEST(CacheTest, EntriesMapToSets) {
+  CacheSimulation::Cache cache(2, 1);
+  EXPECT_FALSE(cache.Access(0));
+  EXPECT_FALSE(cache.Access(1));
+  EXPECT_TRUE(cache.Access(0));
+  EXPECT_TRUE(cache.Access(1));
+
+  // 2 shares the set of 0.
+  EXPECT_FALSE(cache.Access(2));
+  EXPECT_FALSE(cache.Access(0));
+  EXPECT_TRUE(cache.Access(1));
+}
+
+TEST(CacheTest, Flush) {
+  CacheSimulation::Cache cache(2, 2);
+  EXPECT_FALSE(cache.Access(5));
+  EXPECT_TRUE(cache.Access(5));
+  cache.Flush();
+  EXPECT_FALSE(cache.Access(5));
+}
+
+TEST_F(CacheSimulationTest, IsValid) {
+  CacheSimulation simulation;
+  EXPECT_TRUE(simulation.IsValid());
+
+  // The cache doesn't hold a whole set.
+  simulation.set_cache_size(256);
+  simulation.set_cache_line_size(64);
+  simulation.set_cache_associativity(8);
+  EXPECT_FALSE(simulation.IsValid());
+
+  // The cache doesn't hold a whole number of sets.
+  simulation.set_cache_associativity(1);
+  simulation.set_cache_size(100);
+  EXPECT_FALSE(simulation.IsValid());
+
+  simulation.set_cache_size(128);
+  EXPECT_TRUE(simulation.IsValid());
+  simulation.set_tlb_entries(6);
+  simulation.set_tlb_associativity(4);
+  EXPECT_FALSE(simulation.IsValid());
+}
+
+TEST_F(CacheSimulationTest, RangeAccess) {
+  simulation_.OnProcessStarted(time_, 0);
+
+  // The first line of the range is evicted by its last line, which shares
+  // its set.
+  simulation_.OnRangeAccess(0x10, 0x100);
+  EXPECT_EQ(5u, simulation_.cache_accesses());
+  EXPECT_EQ(5u, simulation_.cache_misses());
+  EXPECT_EQ(1u, simulation_.tlb_accesses());
+  EXPECT_EQ(1u, simulation_.tlb_misses());
+
+  // The lines of this range are all still cached.
+  simulation_.OnRangeAccess(0x40, 0xC0);
+  EXPECT_EQ(8u, simulation_.cache_accesses());
+  EXPECT_EQ(5u, simulation_.cache_misses());
+  EXPECT_EQ(2u, simulation_.tlb_accesses());
+  EXPECT_EQ(1u, simulation_.tlb_misses());
+
+  // Empty ranges aren't fetched.
+  simulation_.OnRangeAccess(0x40, 0);
+  EXPECT_EQ(8u, simulation_.cache_accesses());
+}
+
+TEST_F(CacheSimulationTest, ConflictingRangesThrash) {
+  simulation_.OnProcessStarted(time_, 0);
+
+  // The first lines of three pages share a set of two lines, and the pages
+  // don't fit in the TLB.
+  for (size_t i = 0; i < 2; ++i) {
+    simulation_.OnRangeAccess(0x0000, 1);
+    simulation_.OnRangeAccess(0x1000, 1);
+    simulation_.OnRangeAccess(0x2000, 1);
+  }
+  EXPECT_EQ(6u, simulation_.cache_accesses());
+  EXPECT_EQ(6u, simulation_.cache_misses());
+  EXPECT_EQ(6u, simulation_.tlb_accesses());
+  EXPECT_EQ(6u, simulation_.tlb_misses());
+}
+
+TEST_F(CacheSimulationTest, FunctionEntry) {
+  BlockGraph block_graph;
+  BlockGraph::Block* block =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, 0x80, "block");
+  block->set_addr(core::RelativeAddress(0x1FC0));
+
+  simulation_.OnProcessStarted(time_, 0);
+  simulation_.OnFunctionEntry(time_, block);
+  simulation_.OnFunctionEntry(time_, block);
+  EXPECT_EQ(4u, simulation_.cache_accesses());
+  EXPECT_EQ(2u, simulation_.cache_misses());
+  EXPECT_EQ(4u, simulation_.tlb_accesses());
+  EXPECT_EQ(2u, simulation_.tlb_misses());
+}
+
+TEST_F(CacheSimulationTest, ProcessStartFlushes) {
+  simulation_.OnProcessStarted(time_, 0);
+  simulation_.OnRangeAccess(0, 0x40);
+  simulation_.OnProcessStarted(time_, 0);
+  simulation_.OnRangeAccess(0, 0x40);
+  EXPECT_EQ(2u, simulation_.cache_misses());
+  EXPECT_EQ(2u, simulation_.tlb_misses());
+}
+
+TEST_F(CacheSimulationTest, PageSizeIsDeduced) {
+  CacheSimulation simulation;
+  simulation.OnProcessStarted(time_, 0x2000);
+  EXPECT_EQ(0x2000u, simulation.page_size());
+
+  CacheSimulation default_simulation;
+  default_simulation.OnProcessStarted(time_, 0);
+  EXPECT_EQ(CacheSimulation::kDefaultPageSize,
+            default_simulation.page_size());
+}
+
+TEST_F(CacheSimulationTest, MergeClone) {
+  std::unique_ptr<SimulationEventHandler> first = simulation_.CreateClone();
+  std::unique_ptr<SimulationEventHandler> second = simulation_.CreateClone();
+  first->OnProcessStarted(time_, 0);
+  second->OnProcessStarted(time_, 0);
+  static_cast<CacheSimulation*>(first.get())->OnRangeAccess(0, 0x40);
+  static_cast<CacheSimulation*>(second.get())->OnRangeAccess(0, 0x80);
+  static_cast<CacheSimulation*>(second.get())->OnRangeAccess(0, 0x80);
+
+  ASSERT_TRUE(simulation_.MergeClone(first.get()));
+  ASSERT_TRUE(simulation_.MergeClone(second.get()));
+  EXPECT_EQ(5u, simulation_.cache_accesses());
+  EXPECT_EQ(3u, simulation_.cache_misses());
+  EXPECT_EQ(3u, simulation_.tlb_accesses());
+  EXPECT_EQ(2u, simulation_.tlb_misses());
+
+  // Clones with another page size can't be merged.
+  CacheSimulation other;
+  other.set_page_size(0x2000);
+  EXPECT_FALSE(simulation_.MergeClone(&other));
+}
+
+TEST_F(CacheSimulationTest, JSONSucceeds) {
+  simulation_.OnProcessStarted(time_, 0);
+  simulation_.OnRangeAccess(0, 0x1000);
+
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath path;
+  base::ScopedFILE temp_file(
+      base::CreateAndOpenTemporaryFileInDir(temp_dir.path(), &path));
+  ASSERT_TRUE(temp_file.get() != NULL);
+  ASSERT_TRUE(simulation_.SerializeToJSON(temp_file.get(), false));
+  temp_file.reset();
+
+  std::string file_string;
+  ASSERT_TRUE(base::ReadFileToString(path, &file_string));
+  std::unique_ptr<base::Value> value = base::JSONReader::Read(file_string);
+  ASSERT_TRUE(value.get() != NULL);
+  base::DictionaryValue* dict = NULL;
+  ASSERT_TRUE(value->GetAsDictionary(&dict));
+
+  int cache_size = 0;
+  EXPECT_TRUE(dict->GetInteger("cache_size", &cache_size));
+  EXPECT_EQ(256, cache_size);
+  int page_size = 0;
+  EXPECT_TRUE(dict->GetInteger("page_size", &page_size));
+  EXPECT_EQ(0x1000, page_size);
+
+  double cache_accesses = 0;
+  double cache_misses = 0;
+  double tlb_misses = 0;
+  EXPECT_TRUE(dict->GetDouble("cache_accesses", &cache_accesses));
+  EXPECT_TRUE(dict->GetDouble("cache_misses", &cache_misses));
+  EXPECT_TRUE(dict->GetDouble("tlb_misses", &tlb_misses));
+  EXPECT_EQ(64.0, cache_accesses);
+  EXPECT_EQ(64.0, cache_misses);
+  EXPECT_EQ(1.0, tlb_misses);
+}
+
+}  // namespace simulate
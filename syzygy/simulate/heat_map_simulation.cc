@@ -26,6 +26,20 @@ HeatMapSimulation::HeatMapSimulation()
       output_individual_functions_(false) {
 }
 
+void HeatMapSimulation::TimeSlice::Merge(const TimeSlice& other) {
+  if (slices_.size() < other.slices_.size())
+    slices_.resize(other.slices_.size());
+
+  for (size_t i = 0; i < other.slices_.size(); ++i) {
+    const MemorySlice& other_slice = other.slices_[i];
+    MemorySlice& slice = slices_[i];
+    for (const auto& function : other_slice.functions)
+      slice.functions[function.first] += function.second;
+    slice.total += other_slice.total;
+  }
+  total_ += other.total_;
+}
+
 bool HeatMapSimulation::TimeSlice::PrintJSONFunctions(
     core::JSONFileWriter& json_file,
     const HeatMapSimulation::TimeSlice::FunctionMap& functions) {
@@ -99,20 +113,21 @@ bool HeatMapSimulation::SerializeToJSON(FILE* output, bool pretty_print) {
       return false;
     }
 
-    TimeSlice::MemorySliceMap::const_iterator slices_iter =
-        time_slice.slices().begin();
+    const TimeSlice::MemorySlices& slices = time_slice.slices();
+    for (MemorySliceId slice_id = 0; slice_id < slices.size(); ++slice_id) {
+      const TimeSlice::MemorySlice& slice = slices[slice_id];
+      if (slice.empty())
+        continue;
 
-    for (; slices_iter != time_slice.slices().end(); ++slices_iter) {
       if (!json_file.OpenDict() ||
           !json_file.OutputKey("memory_slice") ||
-          !json_file.OutputInteger(slices_iter->first) ||
+          !json_file.OutputInteger(slice_id) ||
           !json_file.OutputKey("quantity") ||
-          !json_file.OutputInteger(slices_iter->second.total))
+          !json_file.OutputInteger(slice.total))
         return false;
 
       if (output_individual_functions_) {
-        if (!TimeSlice::PrintJSONFunctions(json_file,
-                                           slices_iter->second.functions))
+        if (!TimeSlice::PrintJSONFunctions(json_file, slice.functions))
           return false;
       }
 
@@ -132,6 +147,36 @@ bool HeatMapSimulation::SerializeToJSON(FILE* output, bool pretty_print) {
   return json_file.Finished();
 }
 
+std::unique_ptr<SimulationEventHandler> HeatMapSimulation::CreateClone()
+    const {
+  std::unique_ptr<HeatMapSimulation> clone(new HeatMapSimulation());
+  clone->set_time_slice_usecs(time_slice_usecs_);
+  clone->set_memory_slice_bytes(memory_slice_bytes_);
+  clone->set_output_individual_functions(output_individual_functions_);
+  return std::move(clone);
+}
+
+bool HeatMapSimulation::MergeClone(SimulationEventHandler* clone) {
+  DCHECK(clone != NULL);
+  HeatMapSimulation* simulation = static_cast<HeatMapSimulation*>(clone);
+
+  if (simulation->time_slice_usecs_ != time_slice_usecs_ ||
+      simulation->memory_slice_bytes_ != memory_slice_bytes_) {
+    LOG(ERROR) << "Can't merge heat maps with different slice sizes.";
+    return false;
+  }
+
+  TimeMemoryMap::const_iterator it = simulation->time_memory_map_.begin();
+  for (; it != simulation->time_memory_map_.end(); ++it)
+    time_memory_map_[it->first].Merge(it->second);
+
+  max_time_slice_usecs_ =
+      std::max(max_time_slice_usecs_, simulation->max_time_slice_usecs_);
+  max_memory_slice_bytes_ =
+      std::max(max_memory_slice_bytes_, simulation->max_memory_slice_bytes_);
+  return true;
+}
+
 void HeatMapSimulation::OnProcessStarted(base::Time time,
                                          size_t /*default_page_size*/) {
   // Set the entry time of this process.
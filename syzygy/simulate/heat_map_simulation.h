@@ -19,6 +19,7 @@
 #define SYZYGY_SIMULATE_HEAT_MAP_SIMULATION_H_
 
 #include <map>
+#include <vector>
 
 #include "base/strings/string_piece.h"
 #include "syzygy/core/json_file_writer.h"
@@ -96,6 +97,18 @@ class HeatMapSimulation : public SimulationEventHandler {
 
   // @name SimulationEventHandler implementation
   // @{
+  // Creates an empty simulation with the same slice sizes and output options
+  // as this one.
+  std::unique_ptr<SimulationEventHandler> CreateClone() const override;
+
+  // Adds the heat map of a clone to this one. As the times of the heat map
+  // are relative to the start of each process, merging the clones of several
+  // trace files gives the same heat map as simulating them one after the
+  // other.
+  // @param clone A simulation returned by CreateClone.
+  // @returns true on success, false otherwise.
+  bool MergeClone(SimulationEventHandler* clone) override;
+
   // Sets the entry time of the trace file.
   // @param time The startup time of the execution.
   void OnProcessStarted(base::Time time, size_t default_page_size) override;
@@ -174,7 +187,7 @@ class HeatMapSimulation : public SimulationEventHandler {
   // @param output the file to be written to.
   // @param pretty_print enables or disables pretty printing.
   // @returns true on success, false on failure.
-  bool SerializeToJSON(FILE* output, bool pretty_print);
+  bool SerializeToJSON(FILE* output, bool pretty_print) override;
   // @}
 
  protected:
@@ -185,8 +198,6 @@ class HeatMapSimulation : public SimulationEventHandler {
   uint32_t memory_slice_bytes_;
 
   // A map which contains the density of each pair of time and memory slices.
-  // TODO(fixman): If there aren't many possible relative times,
-  // this will probably be better off as a vector.
   TimeMemoryMap time_memory_map_;
 
   // The time when the process was started. Used to convert absolute function
@@ -203,7 +214,9 @@ class HeatMapSimulation : public SimulationEventHandler {
   bool output_individual_functions_;
 };
 
-// Stores the respective memory slices of a particular time slice in a map.
+// Stores the respective memory slices of a particular time slice in a vector
+// indexed by memory slice. The memory slices are numbered from the start of
+// the image, so that the vector is no longer than the image is in slices.
 class HeatMapSimulation::TimeSlice {
  public:
   typedef std::map<std::string, uint32_t> FunctionMap;
@@ -214,8 +227,11 @@ class HeatMapSimulation::TimeSlice {
 
     MemorySlice() : total(0) {
     }
+
+    // @returns true if no function used this memory slice.
+    bool empty() const { return functions.empty(); }
   };
-  typedef std::map<MemorySliceId, MemorySlice> MemorySliceMap;
+  typedef std::vector<MemorySlice> MemorySlices;
 
   TimeSlice() : total_(0) {
   }
@@ -227,14 +243,22 @@ class HeatMapSimulation::TimeSlice {
   void AddSlice(MemorySliceId slice,
                 const base::StringPiece& name,
                 uint32_t num_bytes) {
+    if (slice >= slices_.size())
+      slices_.resize(slice + 1);
     slices_[slice].functions[name.as_string()] += num_bytes;
     slices_[slice].total += num_bytes;
     total_ += num_bytes;
   }
 
+  // Adds the memory slices of another time slice to this one.
+  // @param other The time slice to add.
+  void Merge(const TimeSlice& other);
+
   // @name Accessors.
   // @{
-  const MemorySliceMap& slices() const { return slices_; }
+  // @returns the memory slices, indexed by memory slice id. The slices that
+  //     weren't used are empty.
+  const MemorySlices& slices() const { return slices_; }
   uint32_t total() const { return total_; }
   // @}
 
@@ -249,7 +273,7 @@ class HeatMapSimulation::TimeSlice {
  protected:
   // The slices that were accumulated at this time, and how many times
   // they were called.
-  MemorySliceMap slices_;
+  MemorySlices slices_;
 
   // The total number of blocks that were called at this time.
   uint32_t total_;
@@ -30,6 +30,22 @@ namespace {
 using base::Time;
 using block_graph::BlockGraph;
 
+// The used memory slices of a time slice, by memory slice id.
+typedef std::map<HeatMapSimulation::MemorySliceId,
+                 HeatMapSimulation::TimeSlice::MemorySlice> MemorySliceMap;
+
+// @returns the memory slices of @p time_slice that were used.
+MemorySliceMap GetUsedSlices(const HeatMapSimulation::TimeSlice& time_slice) {
+  MemorySliceMap used_slices;
+  const HeatMapSimulation::TimeSlice::MemorySlices& slices =
+      time_slice.slices();
+  for (size_t i = 0; i < slices.size(); ++i) {
+    if (!slices[i].empty())
+      used_slices[i] = slices[i];
+  }
+  return used_slices;
+}
+
 // Compare two pairs of memory slice ids and memory slices.
 // @tparam CompareFunctions true to compare each separate function in the
 //     memory slices, false otherwise.
@@ -120,13 +136,13 @@ class HeatMapSimulationTest : public testing::PELibUnitTest {
   //     memory slices in each time slice.
   void CheckSimulationResult(uint32_t expected_size,
                              const uint32_t expected_times[],
-                             TimeSlice::MemorySliceMap expected_slices[]) {
+                             MemorySliceMap expected_slices[]) {
     std::vector<uint32_t> expected_totals(expected_size, 0);
 
     // Loop through all the functions and add the number of times they were
     // called to their respective MemorySlice and TimeSlice totals.
     for (uint32_t i = 0; i < expected_size; ++i) {
-      TimeSlice::MemorySliceMap::iterator u = expected_slices[i].begin();
+      MemorySliceMap::iterator u = expected_slices[i].begin();
       for (; u != expected_slices[i].end(); ++u) {
         u->second.total = 0;
 
@@ -155,11 +171,11 @@ class HeatMapSimulationTest : public testing::PELibUnitTest {
       ASSERT_NE(current_slice, simulation_->time_memory_map().end());
       EXPECT_EQ(current_slice->second.total(), expected_totals[i]);
 
-      ASSERT_TRUE(current_slice->second.slices().size() ==
-          expected_slices[i].size());
+      MemorySliceMap slices = GetUsedSlices(current_slice->second);
+      ASSERT_TRUE(slices.size() == expected_slices[i].size());
 
-      EXPECT_TRUE(std::equal(current_slice->second.slices().begin(),
-                             current_slice->second.slices().end(),
+      EXPECT_TRUE(std::equal(slices.begin(),
+                             slices.end(),
                              expected_slices[i].begin(),
                              CompareMemorySlices<true>()));
     }
@@ -291,7 +307,7 @@ TEST_F(HeatMapSimulationTest, CorrectHeatMap) {
   static const uint32_t expected_size = 2;
   static const uint32_t expected_times[expected_size] = {10000000, 30000000};
 
-  TimeSlice::MemorySliceMap expected_slices[expected_size];
+  MemorySliceMap expected_slices[expected_size];
   expected_slices[0][0].functions["A"] = 10;
   expected_slices[0][0].functions["B"] = 8;
   expected_slices[0][0].functions["C"] = 4;
@@ -312,7 +328,7 @@ TEST_F(HeatMapSimulationTest, SmallMemorySliceSize) {
   static const uint32_t expected_size = 2;
   static const uint32_t expected_times[expected_size] = {10000000, 30000000};
 
-  TimeSlice::MemorySliceMap expected_slices[expected_size];
+  MemorySliceMap expected_slices[expected_size];
   expected_slices[0][0].functions["A"] = 2;
   expected_slices[0][1].functions["A"] = 2;
   expected_slices[0][2].functions["A"] = 2;
@@ -350,7 +366,7 @@ TEST_F(HeatMapSimulationTest, BigTimeSliceSize) {
   static const uint32_t expected_size = 1;
   static const uint32_t expected_times[expected_size] = {0};
 
-  TimeSlice::MemorySliceMap expected_slices[expected_size];
+  MemorySliceMap expected_slices[expected_size];
   expected_slices[0][0].functions["A"] = 10;
   expected_slices[0][0].functions["B"] = 13;
   expected_slices[0][0].functions["C"] = 4;
@@ -371,7 +387,7 @@ TEST_F(HeatMapSimulationTest, BigTimeSliceSizeSmallMemorySliceSize) {
   static const uint32_t expected_size = 1;
   static const uint32_t expected_times[expected_size] = {0};
 
-  TimeSlice::MemorySliceMap expected_slices[expected_size];
+  MemorySliceMap expected_slices[expected_size];
   expected_slices[0][0].functions["A"] = 2;
   expected_slices[0][1].functions["A"] = 2;
   expected_slices[0][2].functions["A"] = 2;
@@ -412,7 +428,7 @@ TEST_F(HeatMapSimulationTest, RandomInput) {
   static const uint32_t expected_size = 2;
   static const uint32_t expected_times[expected_size] = {10000000, 30000000};
 
-  TimeSlice::MemorySliceMap expected_slices[expected_size];
+  MemorySliceMap expected_slices[expected_size];
   expected_slices[0][0].total = 2;
   expected_slices[0][1].total = 2;
   expected_slices[0][2].total = 4;
@@ -461,11 +477,11 @@ TEST_F(HeatMapSimulationTest, RandomInput) {
         simulation_->time_memory_map().find(expected_times[i]);
 
       ASSERT_NE(current_slice, simulation_->time_memory_map().end());
-      ASSERT_TRUE(current_slice->second.slices().size() ==
-          expected_slices[i].size());
+      MemorySliceMap slices = GetUsedSlices(current_slice->second);
+      ASSERT_TRUE(slices.size() == expected_slices[i].size());
 
-      EXPECT_TRUE(std::equal(current_slice->second.slices().begin(),
-                             current_slice->second.slices().end(),
+      EXPECT_TRUE(std::equal(slices.begin(),
+                             slices.end(),
                              expected_slices[i].begin(),
                              CompareMemorySlices<false>()));
     }
@@ -474,4 +490,58 @@ TEST_F(HeatMapSimulationTest, RandomInput) {
   }
 }
 
+TEST_F(HeatMapSimulationTest, MergeClone) {
+  simulation_->set_output_individual_functions(true);
+  simulation_->set_memory_slice_bytes(1);
+  simulation_->OnProcessStarted(time, 0);
+  for (uint32_t i = 0; i < arraysize(blocks_); i++) {
+    simulation_->OnFunctionEntry(Time::FromTimeT(blocks_[i].time),
+                                 blocks_[i].block);
+  }
+
+  // The same events are split between two clones, fed as separate processes.
+  HeatMapSimulation merged;
+  merged.set_output_individual_functions(true);
+  merged.set_memory_slice_bytes(1);
+  std::unique_ptr<SimulationEventHandler> clones[2] = {
+      merged.CreateClone(), merged.CreateClone()};
+  for (uint32_t i = 0; i < arraysize(blocks_); i++) {
+    SimulationEventHandler* clone = clones[i % 2].get();
+    if (i < 2)
+      clone->OnProcessStarted(time, 0);
+    clone->OnFunctionEntry(Time::FromTimeT(blocks_[i].time),
+                           blocks_[i].block);
+  }
+  ASSERT_TRUE(merged.MergeClone(clones[1].get()));
+  ASSERT_TRUE(merged.MergeClone(clones[0].get()));
+
+  EXPECT_EQ(simulation_->max_time_slice_usecs(),
+            merged.max_time_slice_usecs());
+  EXPECT_EQ(simulation_->max_memory_slice_bytes(),
+            merged.max_memory_slice_bytes());
+  ASSERT_EQ(simulation_->time_memory_map().size(),
+            merged.time_memory_map().size());
+
+  HeatMapSimulation::TimeMemoryMap::const_iterator expected_it =
+      simulation_->time_memory_map().begin();
+  HeatMapSimulation::TimeMemoryMap::const_iterator it =
+      merged.time_memory_map().begin();
+  for (; it != merged.time_memory_map().end(); ++it, ++expected_it) {
+    EXPECT_EQ(expected_it->first, it->first);
+    EXPECT_EQ(expected_it->second.total(), it->second.total());
+
+    MemorySliceMap expected_slices = GetUsedSlices(expected_it->second);
+    MemorySliceMap slices = GetUsedSlices(it->second);
+    ASSERT_EQ(expected_slices.size(), slices.size());
+    EXPECT_TRUE(std::equal(slices.begin(),
+                           slices.end(),
+                           expected_slices.begin(),
+                           CompareMemorySlices<true>()));
+  }
+
+  // Heat maps with different slice sizes can't be merged.
+  HeatMapSimulation other;
+  EXPECT_FALSE(merged.MergeClone(&other));
+}
+
 }  // namespace simulate
@@ -38,6 +38,33 @@ void PageFaultSimulation::OnProcessStarted(base::Time /*time*/,
   LOG(INFO) << "Page size set to " << page_size_;
 }
 
+std::unique_ptr<SimulationEventHandler> PageFaultSimulation::CreateClone()
+    const {
+  std::unique_ptr<PageFaultSimulation> clone(new PageFaultSimulation());
+  clone->page_size_ = page_size_;
+  clone->pages_per_code_fault_ = pages_per_code_fault_;
+  return std::move(clone);
+}
+
+bool PageFaultSimulation::MergeClone(SimulationEventHandler* clone) {
+  DCHECK(clone != NULL);
+  PageFaultSimulation* simulation = static_cast<PageFaultSimulation*>(clone);
+
+  // The page size of a clone that wasn't set by the user is set by the first
+  // process of its trace file.
+  if (page_size_ == 0) {
+    page_size_ = simulation->page_size_;
+  } else if (simulation->page_size_ != 0 &&
+             simulation->page_size_ != page_size_) {
+    LOG(ERROR) << "Can't merge page faults with different page sizes.";
+    return false;
+  }
+
+  fault_count_ += simulation->fault_count_;
+  pages_.insert(simulation->pages_.begin(), simulation->pages_.end());
+  return true;
+}
+
 bool PageFaultSimulation::SerializeToJSON(FILE* output,
                                           bool pretty_print) {
   DCHECK(output != NULL);
@@ -75,15 +102,17 @@ bool PageFaultSimulation::SerializeToJSON(FILE* output,
 void PageFaultSimulation::OnFunctionEntry(base::Time /*time*/,
                                           const Block* block) {
   DCHECK(block != NULL);
+
+  OnRangeAccess(block->addr().value(), block->size());
+}
+
+void PageFaultSimulation::OnRangeAccess(uint32_t address, size_t size) {
   DCHECK(page_size_ != 0);
 
-  const uint32_t block_start = block->addr().value();
-  const uint32_t block_size = block->size();
-  const size_t kStartIndex = block_start / page_size_;
-  const size_t kEndIndex = (block_start + block_size +
-      page_size_ - 1) / page_size_;
+  const size_t kStartIndex = address / page_size_;
+  const size_t kEndIndex = (address + size + page_size_ - 1) / page_size_;
 
-  // Loop through all the pages in the block, and if it isn't already in memory
+  // Loop through all the pages in the range, and if it isn't already in memory
   // then simulate a code fault and load all the faulting pages in memory.
   for (size_t i = kStartIndex; i < kEndIndex; i++) {
     if (pages_.find(i) == pages_.end()) {
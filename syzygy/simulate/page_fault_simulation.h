@@ -77,6 +77,18 @@ class PageFaultSimulation : public SimulationEventHandler {
 
   // @name SimulationEventHandler implementation
   // @{
+  // Creates an empty simulation with the same page size and pages per code
+  // fault as this one.
+  std::unique_ptr<SimulationEventHandler> CreateClone() const override;
+
+  // Adds the page faults of a clone to this simulation. Each clone starts
+  // with no pages loaded, so that a trace file simulated by a clone faults
+  // as if it was the only trace file. The fault counts are summed and the
+  // sets of loaded pages are joined.
+  // @param clone A simulation returned by CreateClone.
+  // @returns true on success, false otherwise.
+  bool MergeClone(SimulationEventHandler* clone) override;
+
   // Sets the initial page size, if it's not set already.
   void OnProcessStarted(base::Time time, size_t default_page_size) override;
 
@@ -88,6 +100,13 @@ class PageFaultSimulation : public SimulationEventHandler {
   bool SerializeToJSON(FILE* output, bool pretty_print) override;
   // @}
 
+  // Registers the page faults of an access to a range of addresses. This lets
+  // a layout other than the one of the blocks be simulated, such as a
+  // candidate order.
+  // @param address The start address of the range.
+  // @param size The size of the range, in bytes.
+  void OnRangeAccess(uint32_t address, size_t size);
+
  protected:
   // A set which contains the block number of the pages that
   // were faulted in the trace files.
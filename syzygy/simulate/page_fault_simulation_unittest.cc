@@ -329,6 +329,57 @@ TEST_F(PageFaultSimulatorTest, ExactPageFaults) {
       arraysize(expected_pages)));
 }
 
+TEST_F(PageFaultSimulatorTest, ExactPageFaultsOfRanges) {
+  simulation_->OnProcessStarted(time_, 1);
+  simulation_->set_page_size(1);
+  simulation_->set_pages_per_code_fault(4);
+
+  // The same accesses as in ExactPageFaults, described by their ranges.
+  simulation_->OnRangeAccess(0, 3);
+  simulation_->OnRangeAccess(2, 2);
+  simulation_->OnRangeAccess(5, 5);
+
+  PageSet::key_type expected_pages[] = {0, 1, 2, 3, 5, 6, 7, 8, 9, 10, 11, 12};
+  EXPECT_EQ(simulation_->fault_count(), 3);
+  EXPECT_EQ(simulation_->pages(), PageSet(expected_pages, expected_pages +
+      arraysize(expected_pages)));
+}
+
+TEST_F(PageFaultSimulatorTest, MergeClone) {
+  simulation_->set_page_size(1);
+  simulation_->set_pages_per_code_fault(4);
+
+  // The accesses of ExactPageFaultsOfRanges, split between two clones.
+  std::unique_ptr<SimulationEventHandler> first = simulation_->CreateClone();
+  std::unique_ptr<SimulationEventHandler> second = simulation_->CreateClone();
+  first->OnProcessStarted(time_, 0);
+  second->OnProcessStarted(time_, 0);
+  static_cast<PageFaultSimulation*>(first.get())->OnRangeAccess(0, 3);
+  static_cast<PageFaultSimulation*>(first.get())->OnRangeAccess(2, 2);
+  static_cast<PageFaultSimulation*>(second.get())->OnRangeAccess(5, 5);
+
+  ASSERT_TRUE(simulation_->MergeClone(first.get()));
+  ASSERT_TRUE(simulation_->MergeClone(second.get()));
+
+  PageSet::key_type expected_pages[] = {0, 1, 2, 3, 5, 6, 7, 8, 9, 10, 11, 12};
+  EXPECT_EQ(simulation_->fault_count(), 3);
+  EXPECT_EQ(simulation_->pages(), PageSet(expected_pages, expected_pages +
+      arraysize(expected_pages)));
+}
+
+TEST_F(PageFaultSimulatorTest, MergeCloneSetsPageSize) {
+  // The page size of the clone is deduced from its trace file.
+  std::unique_ptr<SimulationEventHandler> clone = simulation_->CreateClone();
+  clone->OnProcessStarted(time_, 0x2000);
+  ASSERT_TRUE(simulation_->MergeClone(clone.get()));
+  EXPECT_EQ(0x2000u, simulation_->page_size());
+
+  // Clones with another page size can't be merged.
+  PageFaultSimulation other;
+  other.set_page_size(0x1000);
+  EXPECT_FALSE(simulation_->MergeClone(&other));
+}
+
 TEST_F(PageFaultSimulatorTest, CorrectPageFaults) {
   simulation_->OnProcessStarted(time_, 1);
 
@@ -21,6 +21,8 @@
       'target_name': 'simulate_lib',
       'type': 'static_library',
       'sources': [
+        'cache_simulation.cc',
+        'cache_simulation.h',
         'heat_map_simulation.cc',
         'heat_map_simulation.h',
         'page_fault_simulation.cc',
@@ -30,6 +32,7 @@
         'simulator.h',
       ],
       'dependencies': [
+        '<(src)/syzygy/application/application.gyp:application_lib',
         '<(src)/syzygy/common/common.gyp:common_lib',
         '<(src)/syzygy/pdb/pdb.gyp:pdb_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
@@ -52,6 +55,7 @@
       'target_name': 'simulate_unittests',
       'type': 'executable',
       'sources': [
+        'cache_simulation_unittest.cc',
         'heat_map_simulation_unittest.cc',
         'page_fault_simulation_unittest.cc',
         'simulator_unittest.cc',
@@ -22,12 +22,14 @@
 #include "base/at_exit.h"
 #include "base/command_line.h"
 #include "base/strings/string_number_conversions.h"
+#include "syzygy/simulate/cache_simulation.h"
 #include "syzygy/simulate/heat_map_simulation.h"
 #include "syzygy/simulate/page_fault_simulation.h"
 #include "syzygy/simulate/simulator.h"
 
 namespace {
 
+using simulate::CacheSimulation;
 using simulate::HeatMapSimulation;
 using simulate::PageFaultSimulation;
 using simulate::SimulationEventHandler;
@@ -37,12 +39,15 @@ const char kUsage[] =
     "Usage: simulate [options] [RPC log files ...]\n"
     "  Required Options:\n"
     "    --instrumented-dll=<path> the path to the instrumented DLL.\n"
-    "    --simulate-method=pagefault|heatmap what method used to simulate\n"
-    "        the trace files.\n"
+    "    --simulate-method=pagefault|heatmap|cache what method used to\n"
+    "        simulate the trace files.\n"
     "  Optional Options:\n"
     "    --pretty-print enables pretty printing of the JSON output file.\n"
     "    --input-dll=<path> the input DLL from where the trace files belong.\n"
     "    --output-file=<path> the output file.\n"
+    "    --threads=INT the number of trace files simulated at once\n"
+    "        (default 1). Each trace file is then simulated as if it was\n"
+    "        the only one, and the results are added up.\n"
     "    For page fault method:\n"
     "      --pages-per-code-fault=INT The number of pages loaded by each\n"
     "          page-fault (default 8)\n"
@@ -53,13 +58,47 @@ const char kUsage[] =
     "      --memory-slice-bytes=INT the size of each memory slice,\n"
     "          in bytes (default 32KB).\n"
     "      --output-individual-functions Output information about each\n"
-    "          function in each time/memory block\n";
+    "          function in each time/memory block\n"
+    "    For cache method:\n"
+    "      --cache-size=INT the size of the instruction cache, in bytes\n"
+    "          (default 32KB).\n"
+    "      --cache-line-size=INT the size of each cache line, in bytes\n"
+    "          (default 64).\n"
+    "      --cache-associativity=INT the number of lines of each cache set\n"
+    "          (default 8).\n"
+    "      --tlb-entries=INT the number of pages held by the instruction\n"
+    "          TLB (default 64).\n"
+    "      --tlb-associativity=INT the number of pages of each TLB set\n"
+    "          (default 4).\n"
+    "      --page-size=INT the size of each page, in bytes (default 4KB).\n";
 
 int Usage(const char* message) {
   std::cerr << message << std::endl << kUsage;
   return 1;
 }
 
+// Parses an optional switch with a positive integer value.
+// @param cmd_line The command line to parse.
+// @param name The name of the switch.
+// @param value Receives the value of the switch, if it's present.
+// @returns true if the switch is absent or valid, false otherwise.
+bool ParsePositiveSwitch(const base::CommandLine& cmd_line,
+                         const char* name,
+                         size_t* value) {
+  DCHECK(value != NULL);
+
+  base::CommandLine::StringType value_str =
+      cmd_line.GetSwitchValueNative(name);
+  if (value_str.empty())
+    return true;
+
+  int int_value = 0;
+  if (!base::StringToInt(value_str, &int_value) || int_value <= 0)
+    return false;
+  *value = static_cast<size_t>(int_value);
+  return true;
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -95,6 +134,15 @@ int main(int argc, char** argv) {
   if (trace_paths.empty())
     return Usage("You must specify at least one trace file.");
 
+  int thread_count = 1;
+  StringType thread_count_str = cmd_line->GetSwitchValueNative("threads");
+  if (!thread_count_str.empty()) {
+    if (!base::StringToInt(thread_count_str, &thread_count) ||
+        thread_count <= 0) {
+      return Usage("Invalid threads value.");
+    }
+  }
+
   std::unique_ptr<SimulationEventHandler> simulation;
 
   if (simulate_method == "pagefault") {
@@ -149,6 +197,42 @@ int main(int argc, char** argv) {
 
     heat_map_simulation->set_output_individual_functions(
         cmd_line->HasSwitch("output-individual-functions"));
+  } else if (simulate_method == "cache") {
+    CacheSimulation* cache_simulation = new CacheSimulation();
+    simulation.reset(cache_simulation);
+
+    size_t cache_size = cache_simulation->cache_size();
+    size_t cache_line_size = cache_simulation->cache_line_size();
+    size_t cache_associativity = cache_simulation->cache_associativity();
+    size_t tlb_entries = cache_simulation->tlb_entries();
+    size_t tlb_associativity = cache_simulation->tlb_associativity();
+    size_t page_size = 0;
+    if (!ParsePositiveSwitch(*cmd_line, "cache-size", &cache_size))
+      return Usage("Invalid cache-size value.");
+    if (!ParsePositiveSwitch(*cmd_line, "cache-line-size", &cache_line_size))
+      return Usage("Invalid cache-line-size value.");
+    if (!ParsePositiveSwitch(*cmd_line, "cache-associativity",
+                             &cache_associativity)) {
+      return Usage("Invalid cache-associativity value.");
+    }
+    if (!ParsePositiveSwitch(*cmd_line, "tlb-entries", &tlb_entries))
+      return Usage("Invalid tlb-entries value.");
+    if (!ParsePositiveSwitch(*cmd_line, "tlb-associativity",
+                             &tlb_associativity)) {
+      return Usage("Invalid tlb-associativity value.");
+    }
+    if (!ParsePositiveSwitch(*cmd_line, "page-size", &page_size))
+      return Usage("Invalid page-size value.");
+
+    cache_simulation->set_cache_size(cache_size);
+    cache_simulation->set_cache_line_size(cache_line_size);
+    cache_simulation->set_cache_associativity(cache_associativity);
+    cache_simulation->set_tlb_entries(tlb_entries);
+    cache_simulation->set_tlb_associativity(tlb_associativity);
+    if (page_size != 0)
+      cache_simulation->set_page_size(page_size);
+    if (!cache_simulation->IsValid())
+      return Usage("The cache sizes don't divide into whole sets.");
   } else {
     return Usage("Invalid simulate-method value.");
   }
@@ -158,6 +242,7 @@ int main(int argc, char** argv) {
                       instrumented_dll_path,
                       trace_paths,
                       simulation.get());
+  simulator.set_thread_count(thread_count);
 
   LOG(INFO) << "Parsing trace files.";
   if (!simulator.ParseTraceFiles()) {
@@ -17,6 +17,8 @@
 #ifndef SYZYGY_SIMULATE_SIMULATION_EVENT_HANDLER_H_
 #define SYZYGY_SIMULATE_SIMULATION_EVENT_HANDLER_H_
 
+#include <memory>
+
 #include "base/time/time.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
@@ -29,6 +31,8 @@ namespace simulate {
 // in ParseEventHandler.
 class SimulationEventHandler {
  public:
+  virtual ~SimulationEventHandler() { }
+
   // Issued once, prior to the first OnFunctionEntry event in each
   // instrumented module.
   // @param time The entry time of this process.
@@ -44,6 +48,23 @@ class SimulationEventHandler {
       base::Time time,
       const block_graph::BlockGraph::Block* block) = 0;
 
+  // Creates an empty handler with the configuration of this one. When
+  // simulating several trace files in parallel, each trace file is simulated
+  // by its own clone, and the clones are merged back in the order of the
+  // trace files.
+  // @returns the clone, or nullptr if this handler can only simulate the
+  //     trace files one after the other.
+  virtual std::unique_ptr<SimulationEventHandler> CreateClone() const {
+    return nullptr;
+  }
+
+  // Merges the results of a clone into this handler.
+  // @param clone A handler returned by CreateClone.
+  // @returns true on success, false otherwise.
+  virtual bool MergeClone(SimulationEventHandler* clone) {
+    return false;
+  }
+
   // Serializes the data to JSON.
   // @param output The output FILE.
   // @param pretty_print Pretty printing on the JSON file.
@@ -14,8 +14,172 @@
 
 #include "syzygy/simulate/simulator.h"
 
+#include <algorithm>
+
+#include "base/bind.h"
+#include "syzygy/application/work_pool.h"
+
 namespace simulate {
 
+namespace {
+
+typedef block_graph::BlockGraph BlockGraph;
+typedef playback::Playback Playback;
+typedef trace::parser::Parser Parser;
+
+// Feeds a process start to a simulation.
+void SimulateProcessStarted(base::Time time,
+                            const TraceSystemInfo* data,
+                            SimulationEventHandler* simulation) {
+  DCHECK(simulation != NULL);
+
+  if (data == NULL)
+    simulation->OnProcessStarted(time, 0);
+  else
+    simulation->OnProcessStarted(time, data->system_info.dwPageSize);
+}
+
+// Feeds a function entry to a simulation, if the function belongs to the
+// module of the playback.
+void SimulateFunctionEntry(base::Time time,
+                           DWORD process_id,
+                           FuncAddr function,
+                           const Playback* playback,
+                           Parser* parser,
+                           Playback::BlockCache* block_cache,
+                           SimulationEventHandler* simulation) {
+  DCHECK(playback != NULL);
+  DCHECK(parser != NULL);
+  DCHECK(block_cache != NULL);
+  DCHECK(simulation != NULL);
+
+  bool error = false;
+  const BlockGraph::Block* block = playback->FindFunctionBlock(
+      parser, process_id, function, block_cache, &error);
+
+  if (error) {
+    LOG(ERROR) << "Playback::FindFunctionBlock failed.";
+    parser->set_error_occurred(true);
+    return;
+  }
+
+  if (block == NULL)
+    return;
+
+  // Call our simulation with the event data we have.
+  simulation->OnFunctionEntry(time, block);
+}
+
+// Feeds the function entries of a batch to a simulation, skipping the
+// functions that don't belong to the module of the playback.
+void SimulateBatchFunctionEntry(base::Time time,
+                                DWORD process_id,
+                                const TraceBatchEnterData* data,
+                                const Playback* playback,
+                                Parser* parser,
+                                Playback::BlockCache* block_cache,
+                                SimulationEventHandler* simulation) {
+  DCHECK(data != NULL);
+  DCHECK(playback != NULL);
+  DCHECK(parser != NULL);
+  DCHECK(block_cache != NULL);
+  DCHECK(simulation != NULL);
+
+  std::vector<const BlockGraph::Block*> blocks;
+  if (!playback->FindFunctionBlocks(parser, process_id, data, block_cache,
+                                    &blocks)) {
+    LOG(ERROR) << "Playback::FindFunctionBlocks failed.";
+    parser->set_error_occurred(true);
+    return;
+  }
+
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    if (blocks[i] != NULL)
+      simulation->OnFunctionEntry(time, blocks[i]);
+  }
+}
+
+// Parses a single trace file on a thread of a pool, and feeds its events to
+// a clone of the simulation.
+class TraceFileSimulator : public trace::parser::ParseEventHandlerImpl {
+ public:
+  TraceFileSimulator(const base::FilePath& trace_file,
+                     const Playback* playback,
+                     std::unique_ptr<SimulationEventHandler> simulation)
+      : trace_file_(trace_file), playback_(playback),
+        simulation_(std::move(simulation)), succeeded_(false) {
+    DCHECK(playback != NULL);
+    DCHECK(simulation_.get() != NULL);
+  }
+
+  // Parses the trace file. The outcome is reported by succeeded().
+  void Simulate() {
+    if (!parser_.Init(this)) {
+      LOG(ERROR) << "Failed to initialize call trace parser.";
+      return;
+    }
+    if (!parser_.OpenTraceFile(trace_file_)) {
+      LOG(ERROR) << "Unable to open trace log: " << trace_file_.value();
+      return;
+    }
+    succeeded_ = parser_.Consume();
+  }
+
+  // @name ParseEventHandler overrides.
+  // @{
+  void OnProcessStarted(base::Time time,
+                        DWORD process_id,
+                        const TraceSystemInfo* data) override {
+    SimulateProcessStarted(time, data, simulation_.get());
+  }
+  void OnFunctionEntry(base::Time time,
+                       DWORD process_id,
+                       DWORD thread_id,
+                       const TraceEnterExitEventData* data) override {
+    DCHECK(data != NULL);
+    SimulateFunctionEntry(time, process_id, data->function, playback_,
+                          &parser_, &block_cache_, simulation_.get());
+  }
+  void OnBatchFunctionEntry(base::Time time,
+                            DWORD process_id,
+                            DWORD thread_id,
+                            const TraceBatchEnterData* data) override {
+    SimulateBatchFunctionEntry(time, process_id, data, playback_, &parser_,
+                               &block_cache_, simulation_.get());
+  }
+  // @}
+
+  // @name Accessors.
+  // @{
+  const base::FilePath& trace_file() const { return trace_file_; }
+  SimulationEventHandler* simulation() const { return simulation_.get(); }
+  bool succeeded() const { return succeeded_; }
+  // @}
+
+ private:
+  base::FilePath trace_file_;
+  const Playback* playback_;
+  std::unique_ptr<SimulationEventHandler> simulation_;
+  Parser parser_;
+  Playback::BlockCache block_cache_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceFileSimulator);
+};
+
+// Simulates the trace file at @p index of @p simulators. The failures are
+// reported once all the trace files have been simulated, so this always
+// succeeds.
+bool SimulateTraceFile(
+    const std::vector<std::unique_ptr<TraceFileSimulator>>* simulators,
+    size_t index) {
+  DCHECK(simulators != NULL);
+  (*simulators)[index]->Simulate();
+  return true;
+}
+
+}  // namespace
+
 Simulator::Simulator(const base::FilePath& module_path,
                      const base::FilePath& instrumented_path,
                      const TraceFileList& trace_files,
@@ -26,11 +190,19 @@ Simulator::Simulator(const base::FilePath& module_path,
       simulation_(simulation),
       parser_(),
       pe_file_(),
-      image_layout_(&block_graph_) {
+      image_layout_(&block_graph_),
+      thread_count_(1) {
   DCHECK(simulation_ != NULL);
 }
 
 bool Simulator::ParseTraceFiles() {
+  if (thread_count_ > 1 && trace_files_.size() > 1) {
+    std::unique_ptr<SimulationEventHandler> clone = simulation_->CreateClone();
+    if (clone.get() != NULL)
+      return ParseTraceFilesInParallel();
+    LOG(WARNING) << "This simulation parses the trace files one at a time.";
+  }
+
   if (playback_ == NULL) {
     playback_.reset(
         new Playback(module_path_, instrumented_path_, trace_files_));
@@ -63,16 +235,62 @@ bool Simulator::ParseTraceFiles() {
   return true;
 }
 
+bool Simulator::ParseTraceFilesInParallel() {
+  DCHECK_LT(1u, thread_count_);
+
+  // The playback only decomposes the image here, as each trace file is opened
+  // by the parser of its own simulator.
+  playback_.reset(
+      new Playback(module_path_, instrumented_path_, TraceFileList()));
+  if (parser_ == NULL) {
+    parser_.reset(new Parser());
+    if (!parser_->Init(this)) {
+      LOG(ERROR) << "Failed to initialize call trace parser.";
+      parser_.reset();
+      playback_.reset();
+      return false;
+    }
+  }
+  if (!playback_->Init(&pe_file_, &image_layout_, parser_.get())) {
+    playback_.reset();
+    return false;
+  }
+
+  std::vector<std::unique_ptr<TraceFileSimulator>> simulators;
+  for (const base::FilePath& trace_file : trace_files_) {
+    simulators.push_back(std::unique_ptr<TraceFileSimulator>(
+        new TraceFileSimulator(trace_file, playback_.get(),
+                               simulation_->CreateClone())));
+  }
+
+  application::WorkPool pool(thread_count_);
+  pool.Run(simulators.size(), base::Bind(&SimulateTraceFile, &simulators));
+
+  // The clones are merged in the order of the trace files, so that the result
+  // doesn't depend on the order in which the threads finished.
+  bool success = true;
+  for (const auto& simulator : simulators) {
+    if (!simulator->succeeded()) {
+      LOG(ERROR) << "Failed to simulate trace log: "
+                 << simulator->trace_file().value();
+      success = false;
+      break;
+    }
+    if (!simulation_->MergeClone(simulator->simulation())) {
+      success = false;
+      break;
+    }
+  }
+
+  playback_.reset();
+  return success;
+}
+
 void Simulator::OnProcessStarted(base::Time time,
                                  DWORD process_id,
                                  const TraceSystemInfo* data) {
   // Call the implementation of OnProcessStarted our simulator uses.
-  DCHECK(simulation_ != NULL);
-
-  if (data == NULL)
-    simulation_->OnProcessStarted(time, 0);
-  else
-    simulation_->OnProcessStarted(time, data->system_info.dwPageSize);
+  SimulateProcessStarted(time, data, simulation_);
 }
 
 void Simulator::OnFunctionEntry(base::Time time,
@@ -81,34 +299,17 @@ void Simulator::OnFunctionEntry(base::Time time,
                                 const TraceEnterExitEventData* data) {
   DCHECK(playback_ != NULL);
   DCHECK(data != NULL);
-  bool error = false;
-  const BlockGraph::Block* block = playback_->FindFunctionBlock(
-      process_id, data->function, &error);
-
-  if (error) {
-    LOG(ERROR) << "Playback::FindFunctionBlock failed.";
-    parser_->set_error_occurred(true);
-    return;
-  }
-
-  if (block == NULL)
-    return;
-
-  // Call our simulation with the event data we have.
-  DCHECK(simulation_ != NULL);
-  simulation_->OnFunctionEntry(time, block);
+  SimulateFunctionEntry(time, process_id, data->function, playback_.get(),
+                        parser_.get(), &block_cache_, simulation_);
 }
 
 void Simulator::OnBatchFunctionEntry(base::Time time,
                                      DWORD process_id,
                                      DWORD thread_id,
                                      const TraceBatchEnterData* data) {
-  // Explode the batch event into individual function entry events.
-  TraceEnterExitEventData new_data = {};
-  for (size_t i = 0; i < data->num_calls; ++i) {
-    new_data.function = data->calls[i].function;
-    OnFunctionEntry(time, process_id, thread_id, &new_data);
-  }
+  DCHECK(playback_ != NULL);
+  SimulateBatchFunctionEntry(time, process_id, data, playback_.get(),
+                             parser_.get(), &block_cache_, simulation_);
 }
 
 }  // namespace simulate
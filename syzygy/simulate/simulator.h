@@ -47,12 +47,28 @@ class Simulator : public trace::parser::ParseEventHandlerImpl {
   // @returns true on success, false on failure.
   bool ParseTraceFiles();
 
+  // Sets the number of threads used to simulate the trace files. With more
+  // than one thread each trace file is parsed by its own parser and fed to
+  // its own clone of the simulation, and the clones are merged back into the
+  // simulation in the order of the trace files. Simulations that can't be
+  // cloned are fed the trace files one after the other.
+  // @param thread_count The number of threads, which must be at least 1.
+  void set_thread_count(size_t thread_count) {
+    DCHECK_LT(0u, thread_count);
+    thread_count_ = thread_count;
+  }
+
  protected:
   typedef block_graph::BlockGraph BlockGraph;
   typedef pe::PEFile PEFile;
   typedef pe::ImageLayout ImageLayout;
   typedef trace::parser::Parser Parser;
 
+  // Parses the trace files in parallel, each with its own clone of the
+  // simulation.
+  // @returns true on success, false on failure.
+  bool ParseTraceFilesInParallel();
+
   // @name ParseEventHandler overrides.
   // @{
   virtual void OnProcessStarted(base::Time time,
@@ -88,6 +104,12 @@ class Simulator : public trace::parser::ParseEventHandlerImpl {
 
   // A pointer to a simulation, that is to be used.
   SimulationEventHandler* simulation_;
+
+  // The cache of the blocks of the functions fed to simulation_.
+  Playback::BlockCache block_cache_;
+
+  // The number of threads used to simulate the trace files.
+  size_t thread_count_;
 };
 
 }  // namespace simulate
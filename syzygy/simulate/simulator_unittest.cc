@@ -19,6 +19,8 @@
 
 #include "gmock/gmock.h"
 #include "syzygy/core/unittest_util.h"
+#include "syzygy/simulate/heat_map_simulation.h"
+#include "syzygy/simulate/page_fault_simulation.h"
 #include "syzygy/pe/unittest_util.h"
 #include "syzygy/version/syzygy_version.h"
 
@@ -103,4 +105,80 @@ TEST_F(SimulatorTest, SuccesfulRead) {
   ASSERT_TRUE(simulator_->ParseTraceFiles());
 }
 
+TEST_F(SimulatorTest, ParallelReadOfUnclonableSimulation) {
+  ASSERT_NO_FATAL_FAILURE(InitTraceFileList());
+  ASSERT_NO_FATAL_FAILURE(InitSimulator());
+  simulator_->set_thread_count(4);
+
+  // The mock can't be cloned, so it receives the events of all the trace
+  // files itself.
+  EXPECT_CALL(simulation_event_handler_, SerializeToJSON(_, _)).Times(0);
+  EXPECT_CALL(simulation_event_handler_, OnProcessStarted(_, Gt(0u))).Times(4);
+  EXPECT_CALL(simulation_event_handler_,
+              OnFunctionEntry(_, _)).Times(AtLeast(1));
+
+  ASSERT_TRUE(simulator_->ParseTraceFiles());
+}
+
+TEST_F(SimulatorTest, ParallelReadOfHeatMap) {
+  ASSERT_NO_FATAL_FAILURE(InitTraceFileList());
+  ASSERT_NO_FATAL_FAILURE(InitSimulator());
+
+  HeatMapSimulation serial;
+  Simulator serial_simulator(module_path_, instrumented_path_, trace_files_,
+                             &serial);
+  ASSERT_TRUE(serial_simulator.ParseTraceFiles());
+
+  HeatMapSimulation parallel;
+  Simulator parallel_simulator(module_path_, instrumented_path_, trace_files_,
+                               &parallel);
+  parallel_simulator.set_thread_count(4);
+  ASSERT_TRUE(parallel_simulator.ParseTraceFiles());
+
+  // The heat maps are the same, as their times are relative to the start of
+  // each process.
+  EXPECT_FALSE(parallel.time_memory_map().empty());
+  EXPECT_EQ(serial.max_time_slice_usecs(), parallel.max_time_slice_usecs());
+  EXPECT_EQ(serial.max_memory_slice_bytes(),
+            parallel.max_memory_slice_bytes());
+  ASSERT_EQ(serial.time_memory_map().size(),
+            parallel.time_memory_map().size());
+  HeatMapSimulation::TimeMemoryMap::const_iterator serial_it =
+      serial.time_memory_map().begin();
+  HeatMapSimulation::TimeMemoryMap::const_iterator parallel_it =
+      parallel.time_memory_map().begin();
+  for (; serial_it != serial.time_memory_map().end();
+       ++serial_it, ++parallel_it) {
+    EXPECT_EQ(serial_it->first, parallel_it->first);
+    EXPECT_EQ(serial_it->second.total(), parallel_it->second.total());
+  }
+}
+
+TEST_F(SimulatorTest, ParallelReadOfPageFaults) {
+  ASSERT_NO_FATAL_FAILURE(InitTraceFileList());
+  ASSERT_NO_FATAL_FAILURE(InitSimulator());
+
+  // Each trace file simulated by itself.
+  size_t fault_count = 0;
+  PageFaultSimulation::PageSet pages;
+  for (const base::FilePath& trace_file : trace_files_) {
+    PageFaultSimulation simulation;
+    Simulator simulator(module_path_, instrumented_path_,
+                        TraceFileList(1, trace_file), &simulation);
+    ASSERT_TRUE(simulator.ParseTraceFiles());
+    fault_count += simulation.fault_count();
+    pages.insert(simulation.pages().begin(), simulation.pages().end());
+  }
+
+  PageFaultSimulation parallel;
+  Simulator parallel_simulator(module_path_, instrumented_path_, trace_files_,
+                               &parallel);
+  parallel_simulator.set_thread_count(2);
+  ASSERT_TRUE(parallel_simulator.ParseTraceFiles());
+
+  EXPECT_LT(0u, parallel.fault_count());
+  EXPECT_EQ(fault_count, parallel.fault_count());
+  EXPECT_EQ(pages, parallel.pages());
+}
+
 }  // namespace simulate
@@ -89,7 +89,11 @@ bool SwapImportApp::ParseCommandLine(const base::CommandLine* cmd_line) {
 template <typename PEFileType>
 int SwapImportApp::SwapImports() {
   // Parse the input file as a PE image.
+  // The input is mapped, unless it's about to be overwritten.
   PEFileType pe_file;
+  pe_file.set_use_file_mapping(
+      core::CompareFilePaths(input_image_, output_image_) !=
+          core::kEquivalentFilePaths);
   if (!pe_file.Init(input_image_)) {
     LOG(ERROR) << "Failed to parse image as a PE file: "
                << input_image_.value();
@@ -70,7 +70,7 @@ class SymbolInfo {
   };
 };
 
-void GetSymbolInfo(HANDLE process,
+bool GetSymbolInfo(HANDLE process,
                    DWORD frame_ptr,
                    std::string* name,
                    DWORD64* offset) {
@@ -85,9 +85,11 @@ void GetSymbolInfo(HANDLE process,
   // Lookup the symbol by address.
   if (::SymFromAddr(process, frame_ptr, offset, symbol.Get())) {
     base::SStringPrintf(name, "%s+%ld", symbol->Name, *offset);
-  } else {
-    base::SStringPrintf(name, "(unknown)+%ld", *offset);
+    return true;
   }
+
+  base::SStringPrintf(name, "(unknown)+%ld", *offset);
+  return false;
 }
 
 void GetLineInfo(HANDLE process, DWORD_PTR frame, std::string* line_info) {
@@ -104,6 +106,26 @@ void GetLineInfo(HANDLE process, DWORD_PTR frame, std::string* line_info) {
   }
 }
 
+// Renders the address, the symbol and the line of a frame of a stack trace.
+// @returns true if the symbol of the frame was found, false otherwise.
+bool GetFrameInfo(HANDLE process, DWORD frame_ptr, std::string* frame_info) {
+  DCHECK(frame_info != NULL);
+
+  DWORD64 offset = 0;
+  std::string symbol_name;
+  std::string line_info;
+  bool found = GetSymbolInfo(process, frame_ptr, &symbol_name, &offset);
+  GetLineInfo(process, frame_ptr, &line_info);
+
+  base::SStringPrintf(frame_info,
+                      "0x%012llx in %s%s%s",
+                      frame_ptr + offset,
+                      symbol_name.c_str(),
+                      line_info.empty() ? "" : " ",
+                      line_info.c_str());
+  return found;
+}
+
 // A callback function used with the StackWalk64 function. It is called when
 // StackWalk64 needs to read memory from the address space of the process.
 // http://msdn.microsoft.com/en-us/library/windows/desktop/ms680559.aspx
@@ -137,10 +159,14 @@ BOOL CALLBACK ReadProcessMemoryProc64(HANDLE process,
 
 }  // namespace
 
+const size_t AgentLogger::kLogBufferDataSize = 1 << 20;
+const int AgentLogger::kLogBufferFlushIntervalMs = 100;
+
 AgentLogger::AgentLogger()
     : trace::common::Service(L"Logger"),
       destination_(NULL),
-      symbolize_stack_traces_(true) {
+      symbolize_stack_traces_(true),
+      log_buffer_thread_stop_event_(true, false) {
 }
 
 AgentLogger::~AgentLogger() {
@@ -148,6 +174,12 @@ AgentLogger::~AgentLogger() {
     ignore_result(Stop());
     ignore_result(Join());
   }
+
+  base::AutoLock auto_lock(symbol_lock_);
+  if (symbol_handle_.IsValid() && !::SymCleanup(symbol_handle_.Get())) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "SymCleanup failed: " << ::common::LogWe(error) << ".";
+  }
 }
 
 bool AgentLogger::StartImpl() {
@@ -159,10 +191,16 @@ bool AgentLogger::StartImpl() {
   if (!StartRpc())
     return false;
 
+  if (!base::PlatformThread::Create(0, this, &log_buffer_thread_)) {
+    LOG(ERROR) << "Failed to start the log buffer thread.";
+    return false;
+  }
+
   return true;
 }
 
 bool AgentLogger::StopImpl() {
+  log_buffer_thread_stop_event_.Signal();
   if (!StopRpc())
     return false;
   return true;
@@ -176,6 +214,15 @@ bool AgentLogger::JoinImpl() {
   if (!FinishRpc())
     return false;
 
+  // Render what remains in the log buffers, now that no client can request
+  // new ones.
+  if (!log_buffer_thread_.is_null()) {
+    base::PlatformThread::Join(log_buffer_thread_);
+    log_buffer_thread_ = base::PlatformThreadHandle();
+  }
+  FlushLogBuffers();
+  FlushQueuedWrites();
+
   return true;
 }
 
@@ -199,17 +246,43 @@ bool AgentLogger::AppendTrace(HANDLE process,
     return true;
   }
 
-  // TODO(rogerm): Add an RPC session to the logger and its interface. This
-  //     would serialize calls per process and provide a convenient mechanism
-  //     for ensuring SymInitialize/Cleanup are called exactly once per client
-  //     process.
-
   base::AutoLock auto_lock(symbol_lock_);
+  if (!InitializeSymbolsUnlocked() || !AddProcessSearchPathUnlocked(process))
+    return false;
+
+  // Append each line of the trace to the message string. The same frames
+  // come back in most traces, so their symbols are only looked up once.
+  for (size_t i = 0; i < trace_length; ++i) {
+    DWORD frame_ptr = trace_data[i];
+    std::string frame_info;
+    auto it = symbol_cache_.find(frame_ptr);
+    if (it != symbol_cache_.end()) {
+      frame_info = it->second;
+    } else if (GetFrameInfo(symbol_handle_.Get(), frame_ptr, &frame_info)) {
+      symbol_cache_[frame_ptr] = frame_info;
+    }
+
+    base::StringAppendF(message, "    #%d %s\n", i, frame_info.c_str());
+  }
+
+  return true;
+}
+
+bool AgentLogger::InitializeSymbolsUnlocked() {
+  symbol_lock_.AssertAcquired();
+  if (symbol_handle_.IsValid())
+    return true;
 
   // Make a unique "handle" for this use of the symbolizer.
   base::win::ScopedHandle unique_handle(
       ::OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE,
                     ::GetCurrentProcessId()));
+  if (!unique_handle.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to open the current process: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
 
   // Initializes the symbols for the process:
   //     - Defer symbol load until they're needed
@@ -219,57 +292,51 @@ bool AgentLogger::AppendTrace(HANDLE process,
   if (!::common::SymInitialize(unique_handle.Get(), NULL, true))
     return false;
 
+  symbol_handle_.Set(unique_handle.Take());
+  return true;
+}
+
+bool AgentLogger::AddProcessSearchPathUnlocked(HANDLE process) {
+  symbol_lock_.AssertAcquired();
+  DCHECK(symbol_handle_.IsValid());
+
   // Try to find the PDB of the running process, if it's found its path will be
   // appended to the current symbol search path. It is necessary because the
   // default search path doesn't include the directory of the caller by default.
   // TODO(sebmarchand): Also append the path of the PDBs of the modules loaded
   //     by the running process.
   WCHAR temp_path[MAX_PATH];
-  if (::GetModuleFileNameEx(process, NULL, temp_path, MAX_PATH) != 0) {
-    base::FilePath module_path(temp_path);
-    base::FilePath temp_pdb_path;
-    if (pe::FindPdbForModule(module_path, &temp_pdb_path)) {
-      char current_search_path[1024];
-      if (!::SymGetSearchPath(unique_handle.Get(), current_search_path,
-                              arraysize(current_search_path))) {
-        DWORD error = ::GetLastError();
-        LOG(ERROR) << "Unable to get the current symbol search path: "
-                   << ::common::LogWe(error);
-        return false;
-      }
-      std::string new_pdb_search_path = std::string(current_search_path) + ";" +
-                                        temp_pdb_path.DirName().AsUTF8Unsafe();
-      if (!::SymSetSearchPath(unique_handle.Get(),
-                              new_pdb_search_path.c_str())) {
-        LOG(ERROR) << "Unable to set the symbol search path.";
-        return false;
-      }
-    }
-  }
-
-  // Append each line of the trace to the message string.
-  for (size_t i = 0; i < trace_length; ++i) {
-    DWORD frame_ptr = trace_data[i];
-    DWORD64 offset = 0;
-    std::string symbol_name;
-    std::string line_info;
-
-    GetSymbolInfo(unique_handle.Get(), frame_ptr, &symbol_name, &offset);
-    GetLineInfo(unique_handle.Get(), frame_ptr, &line_info);
+  if (::GetModuleFileNameEx(process, NULL, temp_path, MAX_PATH) == 0)
+    return true;
+  base::FilePath module_path(temp_path);
+  base::FilePath temp_pdb_path;
+  if (!pe::FindPdbForModule(module_path, &temp_pdb_path))
+    return true;
+  base::FilePath pdb_dir = temp_pdb_path.DirName();
+  if (!symbol_search_dirs_.insert(pdb_dir).second)
+    return true;
 
-    base::StringAppendF(message,
-                        "    #%d 0x%012llx in %s%s%s\n",
-                        i,
-                        frame_ptr + offset,
-                        symbol_name.c_str(),
-                        line_info.empty() ? "" : " ",
-                        line_info.c_str());
+  char current_search_path[1024];
+  if (!::SymGetSearchPath(symbol_handle_.Get(), current_search_path,
+                          arraysize(current_search_path))) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to get the current symbol search path: "
+               << ::common::LogWe(error);
+    return false;
+  }
+  std::string new_pdb_search_path =
+      std::string(current_search_path) + ";" + pdb_dir.AsUTF8Unsafe();
+  if (!::SymSetSearchPath(symbol_handle_.Get(), new_pdb_search_path.c_str())) {
+    LOG(ERROR) << "Unable to set the symbol search path.";
+    return false;
   }
 
-  if (!::SymCleanup(unique_handle.Get())) {
+  // Pick up the modules loaded since the symbol handler was initialized.
+  // Their symbols are loaded from the new search path on first use.
+  if (!::SymRefreshModuleList(symbol_handle_.Get())) {
     DWORD error = ::GetLastError();
-    LOG(ERROR) << "SymCleanup failed: " << ::common::LogWe(error) << ".";
-    return false;
+    LOG(ERROR) << "SymRefreshModuleList failed: " << ::common::LogWe(error)
+               << ".";
   }
 
   return true;
@@ -281,11 +348,6 @@ bool AgentLogger::CaptureRemoteTrace(HANDLE process,
   DCHECK(context != NULL);
   DCHECK(trace_data != NULL);
 
-  // TODO(rogerm): Add an RPC session to the logger and its interface. This
-  //     would serialize calls per process and provide a convenient mechanism
-  //     for ensuring SymInitialize/Cleanup are called exactly once per client
-  //     process.
-
   trace_data->clear();
   trace_data->reserve(64);
 
@@ -296,18 +358,7 @@ bool AgentLogger::CaptureRemoteTrace(HANDLE process,
   }
 
   base::AutoLock auto_lock(symbol_lock_);
-
-  // Make a unique "handle" for this use of the symbolizer.
-  base::win::ScopedHandle unique_handle(
-      ::OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE,
-                    ::GetCurrentProcessId()));
-
-  // Initializes the symbols for the process:
-  //     - Defer symbol load until they're needed
-  //     - Use undecorated names
-  //     - Get line numbers
-  ::SymSetOptions(SYMOPT_DEFERRED_LOADS | SYMOPT_UNDNAME | SYMOPT_LOAD_LINES);
-  if (!::common::SymInitialize(unique_handle.Get(), NULL, true))
+  if (!InitializeSymbolsUnlocked())
     return false;
 
   // Initialize a stack frame structure.
@@ -329,19 +380,13 @@ bool AgentLogger::CaptureRemoteTrace(HANDLE process,
   stack_frame.AddrStack.Mode = AddrModeFlat;
 
   // Walk the stack.
-  while (::StackWalk64(machine_type, unique_handle.Get(), NULL, &stack_frame,
+  while (::StackWalk64(machine_type, symbol_handle_.Get(), NULL, &stack_frame,
                        context, &ReadProcessMemoryProc64,
                        &::SymFunctionTableAccess64, &::SymGetModuleBase64,
                        NULL)) {
     trace_data->push_back(stack_frame.AddrPC.Offset);
   }
 
-  if (!::SymCleanup(unique_handle.Get())) {
-    DWORD error = ::GetLastError();
-    LOG(ERROR) << "SymCleanup failed: " << ::common::LogWe(error) << ".";
-    return false;
-  }
-
   // And we're done.
   return true;
 }
@@ -375,6 +420,34 @@ bool AgentLogger::Write(const base::StringPiece& message) {
   return true;
 }
 
+bool AgentLogger::QueueWrite(HANDLE process,
+                             const base::StringPiece& message,
+                             const DWORD* trace_data,
+                             size_t trace_length) {
+  DCHECK(trace_length == 0 || trace_data != NULL);
+
+  std::unique_ptr<QueuedWrite> queued_write(new QueuedWrite());
+  message.CopyToString(&queued_write->message);
+  if (trace_length != 0) {
+    // The process handle of the caller doesn't outlive the call.
+    HANDLE process_copy = NULL;
+    if (!::DuplicateHandle(::GetCurrentProcess(), process,
+                           ::GetCurrentProcess(), &process_copy, 0, FALSE,
+                           DUPLICATE_SAME_ACCESS)) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to copy process handle: "
+                 << ::common::LogWe(error) << ".";
+      return false;
+    }
+    queued_write->process.Set(process_copy);
+    queued_write->trace_data.assign(trace_data, trace_data + trace_length);
+  }
+
+  base::AutoLock auto_lock(queued_writes_lock_);
+  queued_writes_.push_back(std::move(queued_write));
+  return true;
+}
+
 bool AgentLogger::SaveMinidumpWithProtobufAndMemoryRanges(
     HANDLE process,
     base::ProcessId pid,
@@ -390,16 +463,15 @@ bool AgentLogger::SaveMinidumpWithProtobufAndMemoryRanges(
             memory_ranges_base_addresses);
   DCHECK_NE(static_cast<const size_t*>(nullptr), memory_ranges_lengths);
 
-  // Copy the memory ranges into a vector.
-  std::vector<kasko::api::MemoryRange> memory_ranges;
+#ifndef _WIN64
+  kasko::MinidumpRequest request;
   for (size_t i = 0; i < memory_ranges_count; ++i) {
-    kasko::api::MemoryRange memory_range = {memory_ranges_base_addresses[i],
-                                            memory_ranges_lengths[i]};
-    memory_ranges.push_back(memory_range);
+    request.user_selected_memory_ranges.push_back(
+        kasko::MinidumpRequest::MemoryRange(
+            reinterpret_cast<uint32_t>(memory_ranges_base_addresses[i]),
+            static_cast<uint32_t>(memory_ranges_lengths[i])));
   }
 
-#ifndef _WIN64
-  kasko::MinidumpRequest request;
   request.client_exception_pointers = true;
   request.exception_info_address = exc_ptr;
   if (protobuf_length) {
@@ -408,7 +480,14 @@ bool AgentLogger::SaveMinidumpWithProtobufAndMemoryRanges(
     request.custom_streams.push_back(custom_stream);
   }
 
-  request.type = kasko::MinidumpRequest::LARGER_DUMP_TYPE;
+  // When the crash comes with the memory ranges that matter (e.g., the
+  // corrupt block and its shadow), a small dump restricted to these ranges is
+  // enough. It's faster to capture and to upload than one that also walks the
+  // memory referenced by the stacks.
+  if (request.user_selected_memory_ranges.empty())
+    request.type = kasko::MinidumpRequest::LARGER_DUMP_TYPE;
+  else
+    request.type = kasko::MinidumpRequest::SMALL_DUMP_TYPE;
 
   DCHECK(!minidump_dir_.empty());
   // Create a temporary file to which to write the minidump. We'll rename it
@@ -442,7 +521,8 @@ bool AgentLogger::SaveMinidumpWithProtobufAndMemoryRanges(
     std::string log_msg = base::StringPrintf(
         "A minidump has been written to %s.",
         final_path.AsUTF8Unsafe().c_str());
-    Write(log_msg);
+    // Queue the message so that it comes after the report of the crash.
+    QueueWrite(NULL, log_msg, NULL, 0);
   } else {
     DWORD error = ::GetLastError();
     LOG(ERROR) << "Failed to move dump file to final location "
@@ -454,6 +534,138 @@ bool AgentLogger::SaveMinidumpWithProtobufAndMemoryRanges(
   return true;
 }
 
+bool AgentLogger::CreateLogBuffer(HANDLE process,
+                                  base::ProcessId pid,
+                                  HANDLE* client_handle,
+                                  size_t* buffer_size) {
+  DCHECK_NE(static_cast<HANDLE*>(nullptr), client_handle);
+  DCHECK_NE(static_cast<size_t*>(nullptr), buffer_size);
+
+  std::unique_ptr<ProcessLogBuffer> log_buffer(new ProcessLogBuffer());
+  HANDLE process_copy = NULL;
+  if (!::DuplicateHandle(::GetCurrentProcess(), process, ::GetCurrentProcess(),
+                         &process_copy, 0, FALSE, DUPLICATE_SAME_ACCESS)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to copy process handle: " << ::common::LogWe(error)
+               << ".";
+    return false;
+  }
+  log_buffer->process.Set(process_copy);
+
+  // The log buffer is a pool made of a single buffer.
+  size_t size = sizeof(trace::common::LogBufferHeader) + kLogBufferDataSize;
+  if (!log_buffer->pool.Init(nullptr, 1, size))
+    return false;
+  log_buffer->mapping.reset(
+      new trace::service::MappedBuffer(log_buffer->pool.begin()));
+  if (!log_buffer->mapping->Map())
+    return false;
+  if (!log_buffer->log_buffer.Init(log_buffer->mapping->data(), size))
+    return false;
+
+  HANDLE handle = NULL;
+  if (!::DuplicateHandle(::GetCurrentProcess(), log_buffer->pool.handle(),
+                         process, &handle, 0, FALSE, DUPLICATE_SAME_ACCESS)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to copy log buffer handle into client process: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+  log_buffer->pool.SetClientHandle(handle);
+
+  {
+    base::AutoLock auto_lock(log_buffers_lock_);
+    auto it = log_buffers_.find(pid);
+    if (it != log_buffers_.end())
+      FlushLogBufferUnlocked(it->second.get());
+    log_buffers_[pid].reset(log_buffer.release());
+  }
+
+  *client_handle = handle;
+  *buffer_size = size;
+  return true;
+}
+
+bool AgentLogger::FlushLogBuffer(base::ProcessId pid) {
+  base::AutoLock auto_lock(log_buffers_lock_);
+  auto it = log_buffers_.find(pid);
+  if (it == log_buffers_.end())
+    return false;
+  FlushLogBufferUnlocked(it->second.get());
+  return true;
+}
+
+void AgentLogger::FlushLogBuffers() {
+  base::AutoLock auto_lock(log_buffers_lock_);
+  auto it = log_buffers_.begin();
+  while (it != log_buffers_.end()) {
+    FlushLogBufferUnlocked(it->second.get());
+
+    // The process can't write any more records once it has exited.
+    if (::WaitForSingleObject(it->second->process.Get(), 0) ==
+            WAIT_OBJECT_0) {
+      it = log_buffers_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void AgentLogger::FlushLogBufferUnlocked(ProcessLogBuffer* log_buffer) {
+  DCHECK_NE(static_cast<ProcessLogBuffer*>(nullptr), log_buffer);
+  log_buffers_lock_.AssertAcquired();
+
+  log_buffer->log_buffer.Read(
+      base::Bind(&AgentLogger::WriteLogRecord, base::Unretained(this),
+                 log_buffer->process.Get()));
+}
+
+void AgentLogger::WriteLogRecord(HANDLE process,
+                                 const base::StringPiece& text,
+                                 const DWORD* trace_data,
+                                 size_t trace_length) {
+  std::string message;
+  text.CopyToString(&message);
+  if (trace_length != 0 &&
+      !AppendTrace(process, trace_data, trace_length, &message)) {
+    LOG(ERROR) << "Failed to append the stack trace of a log record.";
+  }
+  Write(message);
+}
+
+void AgentLogger::FlushQueuedWrites() {
+  QueuedWrites queued_writes;
+  {
+    base::AutoLock auto_lock(queued_writes_lock_);
+    queued_writes.swap(queued_writes_);
+  }
+
+  // Each message gets the same trailing newline as it would get from Write.
+  std::string batch;
+  for (const auto& queued_write : queued_writes) {
+    batch.append(queued_write->message);
+    if (!queued_write->trace_data.empty() &&
+        !AppendTrace(queued_write->process.Get(),
+                     queued_write->trace_data.data(),
+                     queued_write->trace_data.size(), &batch)) {
+      LOG(ERROR) << "Failed to append the stack trace of a log message.";
+    }
+    if (!batch.empty() && batch[batch.size() - 1] != '\n')
+      batch.push_back('\n');
+  }
+  Write(batch);
+}
+
+void AgentLogger::ThreadMain() {
+  base::PlatformThread::SetName("Agent Logger Log Buffer Thread");
+  const base::TimeDelta kFlushInterval =
+      base::TimeDelta::FromMilliseconds(kLogBufferFlushIntervalMs);
+  while (!log_buffer_thread_stop_event_.TimedWait(kFlushInterval)) {
+    FlushLogBuffers();
+    FlushQueuedWrites();
+  }
+}
+
 bool AgentLogger::InitRpc() {
   RPC_STATUS status = RPC_S_OK;
 
@@ -36,6 +36,7 @@
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/trace/common/common.gyp:trace_common_lib',
         '<(src)/syzygy/trace/rpc/rpc.gyp:logger_rpc_lib',
+        '<(src)/syzygy/trace/service/service.gyp:rpc_service_lib',
       ],
       'conditions': [
         ['target_arch == "ia32"', {
@@ -18,14 +18,24 @@
 #ifndef SYZYGY_TRACE_AGENT_LOGGER_AGENT_LOGGER_H_
 #define SYZYGY_TRACE_AGENT_LOGGER_AGENT_LOGGER_H_
 
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
 #include "base/callback.h"
 #include "base/files/file_util.h"
 #include "base/message_loop/message_loop.h"
 #include "base/process/process.h"
 #include "base/strings/string_piece.h"
+#include "base/synchronization/waitable_event.h"
 #include "base/threading/platform_thread.h"
+#include "syzygy/trace/common/log_buffer.h"
 #include "syzygy/trace/common/service.h"
 #include "syzygy/trace/rpc/logger_rpc.h"
+#include "syzygy/trace/service/buffer_pool.h"
+#include "syzygy/trace/service/mapped_buffer.h"
 
 namespace trace {
 namespace agent_logger {
@@ -33,8 +43,16 @@ namespace agent_logger {
 // Implements the Logger interface (see "logger_rpc.idl").
 //
 // Note: The Logger expects to be the only RPC service running in the process.
-class AgentLogger : public trace::common::Service {
+class AgentLogger : public trace::common::Service,
+                    public base::PlatformThread::Delegate {
  public:
+  // The size of the records area of the log buffers.
+  static const size_t kLogBufferDataSize;
+
+  // The interval at which the log buffers and the queued writes are rendered
+  // to the log.
+  static const int kLogBufferFlushIntervalMs;
+
   AgentLogger();
   virtual ~AgentLogger();
 
@@ -65,7 +83,8 @@ class AgentLogger : public trace::common::Service {
   // Note that the DWORD elements of @p trace_data are really void* values
   // pointing to the frame pointers of a call stack in @p process.
   //
-  // Calls to this method are serialized under symbol_lock_.
+  // Calls to this method are serialized under symbol_lock_. The symbols are
+  // loaded once, and the rendering of each frame is cached.
   bool AppendTrace(HANDLE process,
                    const DWORD* trace_data,
                    size_t trace_length,
@@ -84,6 +103,22 @@ class AgentLogger : public trace::common::Service {
   // are serialized using write_lock_.
   bool Write(const base::StringPiece& message);
 
+  // Queues @p message, followed by a stack trace of @p process, to be written
+  // to the log destination by the log buffer thread. This returns without
+  // waiting for the trace to be symbolized, so that clients don't block on
+  // each other. The queued messages are written in order.
+  // @param process An open handle to the process whose stack trace is given.
+  //     Ignored if @p trace_length is 0.
+  // @param message The message to write.
+  // @param trace_data The frame pointers of the stack trace. May be null if
+  //     @p trace_length is 0.
+  // @param trace_length The number of frames of the stack trace.
+  // @returns true on success, false otherwise.
+  bool QueueWrite(HANDLE process,
+                  const base::StringPiece& message,
+                  const DWORD* trace_data,
+                  size_t trace_length);
+
   // Generate a minidump for the calling process.
   // @param process An open handle to the running process.
   // @param pid The process id of the process to dump.
@@ -111,6 +146,24 @@ class AgentLogger : public trace::common::Service {
       const size_t* memory_ranges_lengths,
       size_t memory_ranges_count);
 
+  // Creates a shared memory log buffer for a process. This replaces the
+  // previous log buffer of the process, if any.
+  // @param process An open handle to the running process.
+  // @param pid The process id of the process.
+  // @param client_handle Receives the handle to the shared memory, valid in
+  //     @p process.
+  // @param buffer_size Receives the size of the shared memory, in bytes.
+  // @returns true on success, false otherwise.
+  bool CreateLogBuffer(HANDLE process,
+                       base::ProcessId pid,
+                       HANDLE* client_handle,
+                       size_t* buffer_size);
+
+  // Renders the records pending in the log buffer of a process.
+  // @param pid The process id of the process.
+  // @returns true on success, false if the process has no log buffer.
+  bool FlushLogBuffer(base::ProcessId pid);
+
   // Generate an event name used to signal that the logger is ready.
   // @param id The process id.
   // @param output The output string.
@@ -135,6 +188,65 @@ class AgentLogger : public trace::common::Service {
   bool FinishRpc();  // This function is blocking.
   // @}
 
+  // The log buffer of a process.
+  struct ProcessLogBuffer {
+    // An open handle to the process, used to symbolize the stack traces.
+    base::win::ScopedHandle process;
+    // The shared memory, mapped in this process.
+    trace::service::BufferPool pool;
+    std::unique_ptr<trace::service::MappedBuffer> mapping;
+    trace::common::LogBuffer log_buffer;
+  };
+  typedef std::map<base::ProcessId, std::unique_ptr<ProcessLogBuffer>>
+      ProcessLogBufferMap;
+
+  // A message queued by QueueWrite.
+  struct QueuedWrite {
+    // An open handle to the process, used to symbolize the stack trace.
+    base::win::ScopedHandle process;
+    std::string message;
+    std::vector<DWORD> trace_data;
+  };
+  typedef std::vector<std::unique_ptr<QueuedWrite>> QueuedWrites;
+
+  // @name Log buffer management functions.
+  // @{
+  // Renders the records pending in all the log buffers, and releases those of
+  // the processes that have exited. This is called periodically by the log
+  // buffer thread.
+  void FlushLogBuffers();
+
+  // Renders the records pending in a log buffer. Must be called under
+  // log_buffers_lock_.
+  void FlushLogBufferUnlocked(ProcessLogBuffer* log_buffer);
+
+  // Renders a log record of a process.
+  void WriteLogRecord(HANDLE process,
+                      const base::StringPiece& text,
+                      const DWORD* trace_data,
+                      size_t trace_length);
+
+  // Renders the queued messages, and writes them to the log destination in a
+  // single batch. This is called periodically by the log buffer thread.
+  void FlushQueuedWrites();
+
+  // Implementation of PlatformThread::Delegate, for the log buffer thread.
+  void ThreadMain() override;
+  // @}
+
+  // @name Symbolization functions. These must be called under symbol_lock_.
+  // @{
+  // Initializes the symbol handler on first use.
+  // @returns true on success, false otherwise.
+  bool InitializeSymbolsUnlocked();
+
+  // Appends the directory of the PDB of the main module of @p process to the
+  // symbol search path, if it's not there already.
+  // @param process An open handle to the running process.
+  // @returns true on success, false otherwise.
+  bool AddProcessSearchPathUnlocked(HANDLE process);
+  // @}
+
   // The file to which received log messages should be written. This must
   // remain valid for at least as long as the logger is valid. Writes to
   // the destination are serialized with lock_;
@@ -150,12 +262,39 @@ class AgentLogger : public trace::common::Service {
   // symbolize traces.
   base::Lock symbol_lock_;
 
+  // The handle of the symbol handler, which is initialized on first use and
+  // stays initialized for the lifetime of the logger. Under symbol_lock_.
+  base::win::ScopedHandle symbol_handle_;
+
+  // The directories appended to the symbol search path. Under symbol_lock_.
+  std::set<base::FilePath> symbol_search_dirs_;
+
+  // The rendered frames of the stack traces, by frame pointer. Only the
+  // frames whose symbol was found are cached. Under symbol_lock_.
+  std::map<DWORD, std::string> symbol_cache_;
+
   // Indicates if we should symbolize the stack traces. Defaults to true.
   bool symbolize_stack_traces_;
 
   // Signaled once the agent has successfully initialized.
   base::win::ScopedHandle started_event_;
 
+  // The log buffers of the client processes, by process id. Under
+  // log_buffers_lock_.
+  ProcessLogBufferMap log_buffers_;
+  base::Lock log_buffers_lock_;
+
+  // The messages waiting to be rendered by the log buffer thread. Under
+  // queued_writes_lock_.
+  QueuedWrites queued_writes_;
+  base::Lock queued_writes_lock_;
+
+  // Used to signal that the log buffer thread must exit.
+  base::WaitableEvent log_buffer_thread_stop_event_;
+
+  // Handle to the log buffer thread, used to join it when stopping.
+  base::PlatformThreadHandle log_buffer_thread_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(AgentLogger);
 };
@@ -45,8 +45,8 @@ bool GetClientInfo(handle_t binding,
     return false;
 
   // Open and return the handle to the process.
-  static const DWORD kFlags =
-      PROCESS_DUP_HANDLE | PROCESS_QUERY_INFORMATION | PROCESS_VM_READ;
+  static const DWORD kFlags = PROCESS_DUP_HANDLE | PROCESS_QUERY_INFORMATION |
+      PROCESS_VM_READ | SYNCHRONIZE;
   handle->Set(::OpenProcess(kFlags, FALSE, the_pid));
   if (!handle->IsValid()) {
     DWORD error = ::GetLastError();
@@ -92,7 +92,7 @@ void InitContext(const ExecutionContext* ext_ctx, CONTEXT* ctx) {
 // The instance to which the RPC callbacks are bound.
 AgentLogger* RpcLoggerInstanceManager::instance_ = NULL;
 
-// RPC entrypoint for AgentLogger::Write().
+// RPC entrypoint for AgentLogger::QueueWrite().
 boolean LoggerService_Write(
     /* [in] */ handle_t binding,
     /* [string][in] */ const unsigned char *text) {
@@ -104,10 +104,11 @@ boolean LoggerService_Write(
   // Get the logger instance.
   AgentLogger* instance = RpcLoggerInstanceManager::GetInstance();
 
-  // Write the log message.
-  std::string message(reinterpret_cast<const char*>(text));
-  if (!instance->Write(message))
+  // Queue the log message.
+  if (!instance->QueueWrite(NULL, reinterpret_cast<const char*>(text), NULL,
+                            0)) {
     return false;
+  }
 
   // And we're done.
   return true;
@@ -139,17 +140,12 @@ boolean LoggerService_WriteWithContext(
     return false;
   }
 
-  // Create the log message.
-  std::string message(reinterpret_cast<const char*>(text));
-  if (!instance->AppendTrace(handle.Get(), trace_data.data(), trace_data.size(),
-                             &message)) {
+  // Queue the log message, its trace is symbolized by the logger thread.
+  if (!instance->QueueWrite(handle.Get(), reinterpret_cast<const char*>(text),
+                            trace_data.data(), trace_data.size())) {
     return false;
   }
 
-  // Write the log message.
-  if (!instance->Write(message))
-    return false;
-
   // And we're done.
   return true;
 }
@@ -173,14 +169,11 @@ boolean LoggerService_WriteWithTrace(
   // Get the logger instance.
   AgentLogger* instance = RpcLoggerInstanceManager::GetInstance();
 
-  // Create the log message.
-  std::string message(reinterpret_cast<const char*>(text));
-  if (!instance->AppendTrace(handle.Get(), trace_data, trace_length, &message))
-    return false;
-
-  // Write the log message.
-  if (!instance->Write(message))
+  // Queue the log message, its trace is symbolized by the logger thread.
+  if (!instance->QueueWrite(handle.Get(), reinterpret_cast<const char*>(text),
+                            trace_data, trace_length)) {
     return false;
+  }
 
   // And we're done.
   return true;
@@ -220,6 +213,48 @@ boolean LoggerService_SaveMinidumpWithProtobufAndMemoryRanges(
   return true;
 }
 
+// RPC entrypoint for AgentLogger::CreateLogBuffer().
+boolean LoggerService_CreateLogBuffer(
+    /* [in] */ handle_t binding,
+    /* [out] */ unsigned long* shared_memory_handle,
+    /* [out] */ unsigned long* buffer_size) {
+  if (binding == NULL || shared_memory_handle == NULL || buffer_size == NULL) {
+    LOG(ERROR) << "Invalid input parameter(s).";
+    return false;
+  }
+
+  // Get the caller's process info.
+  ProcessId pid = 0;
+  ScopedHandle handle;
+  if (!GetClientInfo(binding, &pid, &handle))
+    return false;
+
+  AgentLogger* instance = RpcLoggerInstanceManager::GetInstance();
+  HANDLE client_handle = NULL;
+  size_t size = 0;
+  if (!instance->CreateLogBuffer(handle.Get(), pid, &client_handle, &size))
+    return false;
+
+  *shared_memory_handle = reinterpret_cast<unsigned long>(client_handle);
+  *buffer_size = static_cast<unsigned long>(size);
+  return true;
+}
+
+// RPC entrypoint for AgentLogger::FlushLogBuffer().
+boolean LoggerService_FlushLogBuffer(/* [in] */ handle_t binding) {
+  if (binding == NULL) {
+    LOG(ERROR) << "Invalid input parameter(s).";
+    return false;
+  }
+
+  base::ProcessId pid = ::common::rpc::GetClientProcessID(binding);
+  if (!pid)
+    return false;
+
+  AgentLogger* instance = RpcLoggerInstanceManager::GetInstance();
+  return instance->FlushLogBuffer(pid);
+}
+
 // RPC endpoint.
 unsigned long LoggerService_GetProcessId(/* [in] */ handle_t binding) {
   return ::GetCurrentProcessId();
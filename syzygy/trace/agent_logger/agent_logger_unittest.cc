@@ -220,16 +220,15 @@ void DoRpcCreateMiniDump(handle_t rpc_binding) {
       ->set_address(0xDEADC0DE);
   std::string protobuf_str;
   ASSERT_TRUE(protobuf.SerializeToString(&protobuf_str));
-  agent::asan::MemoryRanges memory_ranges;
-  memory_ranges.push_back(
-      std::make_pair(protobuf_str.data(), protobuf_str.size()));
+  // The protobuf itself is the memory range to include in the minidump.
+  unsigned long proto_address =
+      reinterpret_cast<unsigned long>(protobuf_str.data());
   unsigned long proto_size = protobuf_str.size();
   ASSERT_TRUE(LoggerClient_SaveMinidumpWithProtobufAndMemoryRanges(
       rpc_binding, ::GetCurrentThreadId(),
       reinterpret_cast<unsigned long>(&exc_ptrs),
       reinterpret_cast<const byte*>(protobuf_str.data()), protobuf_str.size(),
-      reinterpret_cast<const unsigned long*>(protobuf_str.data()), &proto_size,
-      1));
+      &proto_address, &proto_size, 1));
 }
 
 }  // namespace
@@ -255,6 +254,27 @@ TEST_F(LoggerTest, StackTraceHandling) {
   ASSERT_TRUE(function_c != std::string::npos);
 }
 
+TEST_F(LoggerTest, StackTraceHandlingIsCached) {
+  HANDLE process = ::GetCurrentProcess();
+  std::vector<DWORD> trace_data;
+  ASSERT_NO_FATAL_FAILURE(ExecuteCallbackWithKnownStack(base::Bind(
+      &LoggerTest::DoCaptureRemoteTrace,
+      base::Unretained(this),
+      process,
+      &trace_data)));
+
+  // The second rendering of the trace comes from the cache, and must be the
+  // same as the first one.
+  std::string text;
+  ASSERT_TRUE(logger_.AppendTrace(
+      process, trace_data.data(), trace_data.size(), &text));
+  std::string cached_text;
+  ASSERT_TRUE(logger_.AppendTrace(
+      process, trace_data.data(), trace_data.size(), &cached_text));
+  EXPECT_EQ(text, cached_text);
+  EXPECT_TRUE(TextContainsKnownStack(cached_text, 0));
+}
+
 TEST_F(LoggerTest, Write) {
   // Write the lines.
   ASSERT_TRUE(logger_.Write(kLine1));
@@ -282,6 +302,42 @@ TEST_F(LoggerTest, Write) {
   EXPECT_EQ(expected_contents, contents);
 }
 
+TEST_F(LoggerTest, QueueWrite) {
+  HANDLE process = ::GetCurrentProcess();
+  std::vector<DWORD> trace_data;
+  ASSERT_NO_FATAL_FAILURE(ExecuteCallbackWithKnownStack(base::Bind(
+      &LoggerTest::DoCaptureRemoteTrace,
+      base::Unretained(this),
+      process,
+      &trace_data)));
+
+  // Queue the lines, the first one with a stack trace.
+  ASSERT_TRUE(logger_.QueueWrite(process, kLine1, trace_data.data(),
+                                 trace_data.size()));
+  ASSERT_TRUE(logger_.QueueWrite(NULL, kLine2, NULL, 0));
+  ASSERT_TRUE(logger_.QueueWrite(NULL, kLine3, NULL, 0));
+
+  // Stopping the logger writes the queued lines.
+  ASSERT_TRUE(logger_.Stop());
+  ASSERT_NO_FATAL_FAILURE(WaitForLoggerToFinish());
+  log_file_.reset(NULL);
+
+  std::string text;
+  ASSERT_TRUE(base::ReadFileToString(log_file_path_, &text));
+
+  // The lines are written in order, and the first one is followed by its
+  // stack trace.
+  size_t line_1 = text.find(kLine1, 0);
+  ASSERT_NE(std::string::npos, line_1);
+  ASSERT_TRUE(TextContainsKnownStack(text, line_1));
+  std::string expected_tail(kLine2);
+  expected_tail += '\n';
+  expected_tail += kLine3;
+  ASSERT_LT(expected_tail.size(), text.size());
+  EXPECT_EQ(expected_tail,
+            text.substr(text.size() - expected_tail.size()));
+}
+
 TEST_F(LoggerTest, RpcWrite) {
   // Connect to the logger over RPC.
   ScopedRpcBinding rpc_binding;
@@ -15,6 +15,9 @@
 // A utility class to manage the RPC session and the associated memory mappings.
 #include "syzygy/trace/client/rpc_session.h"
 
+#include <malloc.h>
+#include <algorithm>
+
 #include "syzygy/common/com_utils.h"
 #include "syzygy/common/rpc/helpers.h"
 #include "syzygy/trace/client/client_utils.h"
@@ -27,11 +30,24 @@ extern "C" IMAGE_DOS_HEADER __ImageBase;
 namespace trace {
 namespace client {
 
+namespace {
+
+// How long StopBufferPrefetch waits for the pending work item. The threads
+// of the pool may have been terminated if the process is exiting, in which
+// case the work item never completes.
+const DWORD kBufferWorkTimeoutMs = 5 * 1000;
+
+}  // namespace
+
 RpcSession::RpcSession()
     : rpc_binding_(NULL),
       session_handle_(NULL),
       flags_(0),
-      is_disabled_(false) {
+      is_disabled_(false),
+      spare_buffer_count_(0),
+      buffer_work_pending_(0) {
+  ::InitializeSListHead(&spare_buffers_);
+  ::InitializeSListHead(&full_buffers_);
 }
 
 RpcSession::~RpcSession() {
@@ -41,8 +57,20 @@ RpcSession::~RpcSession() {
 bool RpcSession::MapSegmentBuffer(TraceFileSegment* segment) {
   DCHECK(segment != NULL);
 
+  uint8_t* buffer_ptr = NULL;
+  if (!MapBuffer(segment->buffer_info, &buffer_ptr))
+    return false;
+
+  InitSegment(buffer_ptr, segment);
+  return true;
+}
+
+bool RpcSession::MapBuffer(const CallTraceBuffer& buffer_info,
+                           uint8_t** buffer_ptr) {
+  DCHECK(buffer_ptr != NULL);
+
   HANDLE mem_handle =
-      reinterpret_cast<HANDLE>(segment->buffer_info.shared_memory_handle);
+      reinterpret_cast<HANDLE>(buffer_info.shared_memory_handle);
 
   // Get (or set) the mapping between the handle we've received and the
   // corresponding mapped base pointer. Note that the shared_memory_handles_
@@ -56,7 +84,7 @@ bool RpcSession::MapSegmentBuffer(TraceFileSegment* segment) {
     uint8_t*& base_ptr = shared_memory_handles_[mem_handle];
     if (base_ptr == NULL) {
       base_ptr = reinterpret_cast<uint8_t*>(::MapViewOfFile(
-          mem_handle, FILE_MAP_WRITE, 0, 0, segment->buffer_info.mapping_size));
+          mem_handle, FILE_MAP_WRITE, 0, 0, buffer_info.mapping_size));
       if (base_ptr == NULL) {
         DWORD error = ::GetLastError();
         LOG(ERROR) << "Failed to map view of shared memory: "
@@ -67,10 +95,17 @@ bool RpcSession::MapSegmentBuffer(TraceFileSegment* segment) {
       }
     }
 
-    segment->base_ptr =
-        base_ptr + segment->buffer_info.buffer_offset;
+    *buffer_ptr = base_ptr + buffer_info.buffer_offset;
   }
 
+  return true;
+}
+
+void RpcSession::InitSegment(uint8_t* buffer_ptr, TraceFileSegment* segment) {
+  DCHECK(buffer_ptr != NULL);
+  DCHECK(segment != NULL);
+
+  segment->base_ptr = buffer_ptr;
   segment->header = NULL;
   segment->write_ptr = segment->base_ptr;
   segment->end_ptr =
@@ -78,8 +113,6 @@ bool RpcSession::MapSegmentBuffer(TraceFileSegment* segment) {
   segment->WriteSegmentHeader(session_handle_);
 
   DCHECK(segment->header != NULL);
-
-  return true;
 }
 
 bool RpcSession::CreateSession(TraceFileSegment* segment) {
@@ -117,8 +150,9 @@ bool RpcSession::CreateSession(TraceFileSegment* segment) {
   }
 
   if ((flags_ & TRACE_FLAG_BATCH_ENTER) != 0) {
-    // Batch mode is mutually exclusive of all other flags.
-    flags_ = TRACE_FLAG_BATCH_ENTER;
+    // Batch mode is mutually exclusive of all other flags, but the one
+    // selecting its encoding.
+    flags_ &= TRACE_FLAG_BATCH_ENTER | TRACE_FLAG_COMPACT_BATCH_ENTER;
   }
 
   if (!MapSegmentBuffer(segment)) {
@@ -171,6 +205,28 @@ bool RpcSession::ExchangeBuffer(TraceFileSegment* segment) {
   DCHECK(IsTracing());
   DCHECK(segment != NULL);
 
+  if (spare_buffer_count_ != 0) {
+    // Swap the full buffer for a spare one, and leave it to the work item to
+    // return it. The entry of the spare buffer carries the full one.
+    BufferEntry* entry = reinterpret_cast<BufferEntry*>(
+        ::InterlockedPopEntrySList(&spare_buffers_));
+    if (entry != NULL) {
+      std::swap(entry->buffer_info, segment->buffer_info);
+      uint8_t* buffer_ptr = entry->buffer_ptr;
+      entry->buffer_ptr = NULL;
+      ::InterlockedPushEntrySList(&full_buffers_, &entry->entry);
+      ScheduleBufferWork();
+
+      InitSegment(buffer_ptr, segment);
+      return true;
+    }
+
+    // There's no spare buffer at hand, so the exchange is synchronous. The
+    // full buffers that were queued before this one are returned first.
+    if (!ReturnFullBuffers(NULL))
+      return false;
+  }
+
   bool succeeded =
       ::common::rpc::InvokeRpc(CallTraceClient_ExchangeBuffer, session_handle_,
                                &segment->buffer_info).succeeded();
@@ -182,6 +238,10 @@ bool RpcSession::ReturnBuffer(TraceFileSegment* segment) {
   DCHECK(IsTracing());
   DCHECK(segment != NULL);
 
+  // The full buffers that were queued before this one are returned first.
+  if (spare_buffer_count_ != 0 && !ReturnFullBuffers(NULL))
+    return false;
+
   return ::common::rpc::InvokeRpc(CallTraceClient_ReturnBuffer, session_handle_,
                                   &segment->buffer_info).succeeded();
 }
@@ -189,6 +249,9 @@ bool RpcSession::ReturnBuffer(TraceFileSegment* segment) {
 bool RpcSession::CloseSession() {
   DCHECK(IsTracing());
 
+  if (spare_buffer_count_ != 0)
+    StopBufferPrefetch();
+
   bool succeeded = ::common::rpc::InvokeRpc(CallTraceClient_CloseSession,
                                             &session_handle_).succeeded();
 
@@ -223,5 +286,146 @@ void RpcSession::FreeSharedMemory() {
   shared_memory_handles_.clear();
 }
 
+void RpcSession::EnableBufferPrefetch(size_t spare_buffer_count) {
+  DCHECK(IsTracing());
+  DCHECK_EQ(0u, spare_buffer_count_);
+  DCHECK_LT(0u, spare_buffer_count);
+
+  spare_buffer_count_ = spare_buffer_count;
+  ScheduleBufferWork();
+}
+
+bool RpcSession::ReturnFullBuffers(BufferEntries* entries) {
+  base::AutoLock auto_lock(return_lock_);
+
+  // The list is last in, first out, so it is reversed to return the buffers
+  // in the order in which they were filled.
+  BufferEntries full_entries;
+  SLIST_ENTRY* entry = ::InterlockedFlushSList(&full_buffers_);
+  for (; entry != NULL; entry = entry->Next)
+    full_entries.push_back(reinterpret_cast<BufferEntry*>(entry));
+  if (full_entries.empty())
+    return true;
+  std::reverse(full_entries.begin(), full_entries.end());
+
+  std::vector<CallTraceBuffer> buffers;
+  buffers.reserve(full_entries.size());
+  for (BufferEntry* full_entry : full_entries)
+    buffers.push_back(full_entry->buffer_info);
+
+  bool succeeded =
+      ::common::rpc::InvokeRpc(CallTraceClient_ReturnBuffers, session_handle_,
+                               static_cast<unsigned long>(buffers.size()),
+                               buffers.data()).succeeded();
+
+  if (entries != NULL) {
+    entries->insert(entries->end(), full_entries.begin(), full_entries.end());
+  } else {
+    for (BufferEntry* full_entry : full_entries)
+      ::_aligned_free(full_entry);
+  }
+
+  return succeeded;
+}
+
+void RpcSession::PrefetchSpareBuffers(BufferEntries* entries) {
+  DCHECK(entries != NULL);
+
+  while (::QueryDepthSList(&spare_buffers_) < spare_buffer_count_) {
+    BufferEntry* entry = NULL;
+    if (!entries->empty()) {
+      entry = entries->back();
+      entries->pop_back();
+    } else {
+      entry = reinterpret_cast<BufferEntry*>(
+          ::_aligned_malloc(sizeof(BufferEntry), MEMORY_ALLOCATION_ALIGNMENT));
+      if (entry == NULL)
+        break;
+    }
+
+    ::memset(entry, 0, sizeof(*entry));
+    if (!::common::rpc::InvokeRpc(CallTraceClient_AllocateBuffer,
+                                  session_handle_,
+                                  &entry->buffer_info).succeeded() ||
+        !MapBuffer(entry->buffer_info, &entry->buffer_ptr)) {
+      // The exchanges fall back to waiting for the service.
+      ::_aligned_free(entry);
+      break;
+    }
+
+    ::InterlockedPushEntrySList(&spare_buffers_, &entry->entry);
+  }
+
+  for (BufferEntry* entry : *entries)
+    ::_aligned_free(entry);
+  entries->clear();
+}
+
+void RpcSession::ScheduleBufferWork() {
+  if (::InterlockedCompareExchange(&buffer_work_pending_, 1, 0) != 0)
+    return;
+
+  if (!::QueueUserWorkItem(&RpcSession::BufferWorkProc, this,
+                           WT_EXECUTEDEFAULT)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to queue buffer work item: "
+               << ::common::LogWe(error) << ".";
+    ::InterlockedExchange(&buffer_work_pending_, 0);
+  }
+}
+
+DWORD WINAPI RpcSession::BufferWorkProc(void* param) {
+  RpcSession* session = reinterpret_cast<RpcSession*>(param);
+  DCHECK(session != NULL);
+
+  while (true) {
+    BufferEntries entries;
+    session->ReturnFullBuffers(&entries);
+    session->PrefetchSpareBuffers(&entries);
+
+    // The buffers that were queued while this ran would otherwise wait for
+    // the next exchange to be returned.
+    ::InterlockedExchange(&session->buffer_work_pending_, 0);
+    if (::QueryDepthSList(&session->full_buffers_) == 0 ||
+        ::InterlockedCompareExchange(
+            &session->buffer_work_pending_, 1, 0) != 0) {
+      return 0;
+    }
+  }
+}
+
+void RpcSession::StopBufferPrefetch() {
+  DCHECK_LT(0u, spare_buffer_count_);
+
+  // Subsequent exchanges are synchronous.
+  spare_buffer_count_ = 0;
+
+  // Keep new work items from being queued while waiting for the pending one.
+  DWORD start = ::GetTickCount();
+  while (::InterlockedCompareExchange(&buffer_work_pending_, 1, 0) != 0) {
+    if (::GetTickCount() - start > kBufferWorkTimeoutMs) {
+      LOG(WARNING) << "Timed out waiting for the buffer work item.";
+      break;
+    }
+    ::Sleep(1);
+  }
+
+  // The work item may have been terminated while returning buffers, leaving
+  // the lock held. The service commits the buffers that are left when the
+  // session closes anyway.
+  if (return_lock_.Try()) {
+    return_lock_.Release();
+    ReturnFullBuffers(NULL);
+  }
+
+  // The spare buffers are empty, so the service writes nothing for them.
+  SLIST_ENTRY* entry = ::InterlockedFlushSList(&spare_buffers_);
+  while (entry != NULL) {
+    SLIST_ENTRY* next = entry->Next;
+    ::_aligned_free(entry);
+    entry = next;
+  }
+}
+
 }  // namespace client
 }  // namespace trace
@@ -17,7 +17,9 @@
 #ifndef SYZYGY_TRACE_CLIENT_RPC_SESSION_H_
 #define SYZYGY_TRACE_CLIENT_RPC_SESSION_H_
 
+#include <windows.h>
 #include <map>
+#include <vector>
 
 #include "base/logging.h"
 #include "base/synchronization/lock.h"
@@ -57,6 +59,16 @@ class RpcSession {
   virtual void FreeSharedMemory();
   // @}
 
+  // Makes ExchangeBuffer swap full buffers for spare buffers that have been
+  // fetched ahead of time, rather than wait for the call trace service. The
+  // full buffers are returned in batches, and the spare buffers refilled, on
+  // a thread of the system thread pool. ExchangeBuffer only waits for the
+  // service when there is no spare buffer left. This may only be called
+  // once, after CreateSession has succeeded.
+  // @param spare_buffer_count The number of spare buffers to keep at hand
+  //     for all the threads of the process.
+  void EnableBufferPrefetch(size_t spare_buffer_count);
+
   inline bool IsEnabled(unsigned long bit_mask) const {
     return (flags_ & bit_mask) != 0;
   }
@@ -72,9 +84,52 @@ class RpcSession {
   unsigned long flags() const { return flags_; }
 
  protected:
+  // A buffer that is waiting to be used or to be returned, in one of the
+  // lock-free lists. The entry must come first.
+  struct BufferEntry {
+    SLIST_ENTRY entry;
+    CallTraceBuffer buffer_info;
+    // The start of the buffer in local memory.
+    uint8_t* buffer_ptr;
+  };
+  typedef std::vector<BufferEntry*> BufferEntries;
+
   // Map a tracefile segment buffer into local memory.
   bool MapSegmentBuffer(TraceFileSegment* segment);
 
+  // Maps a buffer into local memory.
+  // @param buffer_info the buffer to map.
+  // @param buffer_ptr receives the start of the buffer in local memory.
+  // @returns true on success, false otherwise.
+  bool MapBuffer(const CallTraceBuffer& buffer_info, uint8_t** buffer_ptr);
+
+  // Makes a segment write to a buffer that has been mapped, and writes the
+  // segment header.
+  void InitSegment(uint8_t* buffer_ptr, TraceFileSegment* segment);
+
+  // Returns the full buffers that ExchangeBuffer queued, in the order in
+  // which they were queued.
+  // @param entries receives the entries of the buffers, to be reused. May be
+  //     NULL.
+  // @returns true on success, false otherwise.
+  bool ReturnFullBuffers(BufferEntries* entries);
+
+  // Fetches spare buffers until there are as many as requested.
+  // @param entries the entries to use for the spare buffers before
+  //     allocating new ones. Those that aren't used are freed.
+  void PrefetchSpareBuffers(BufferEntries* entries);
+
+  // Queues a work item to return the full buffers and fetch spare buffers,
+  // unless one is already pending.
+  void ScheduleBufferWork();
+
+  // The work item queued by ScheduleBufferWork.
+  static DWORD WINAPI BufferWorkProc(void* param);
+
+  // Waits for the pending work item, if any, and frees the spare buffers.
+  // The full buffers are returned first.
+  void StopBufferPrefetch();
+
   // The call trace RPC binding.
   handle_t rpc_binding_;
 
@@ -103,6 +158,22 @@ class RpcSession {
   // The (optional) unique id used to differentiate concurrent instances of the
   // RPC call-trace logging service.
   std::wstring instance_id_;
+
+  // @name Buffer prefetching state.
+  // @{
+  // The number of spare buffers to keep at hand, or zero if buffers aren't
+  // prefetched.
+  size_t spare_buffer_count_;
+  // The spare buffers, which have already been mapped.
+  SLIST_HEADER spare_buffers_;
+  // The full buffers that are waiting to be returned.
+  SLIST_HEADER full_buffers_;
+  // Non-zero while a work item is queued or running.
+  volatile LONG buffer_work_pending_;
+  // Serializes the returns of full buffers, so that they are committed in
+  // order.
+  base::Lock return_lock_;
+  // @}
 };
 
 }  // namespace client
@@ -17,6 +17,7 @@
 #include <WinBase.h>
 #include <type_traits>
 
+#include "base/lazy_instance.h"
 #include "base/logging.h"
 #include "base/win/registry.h"
 
@@ -34,6 +35,45 @@ union LargeInteger {
 
 typedef ULONGLONG (*GetTickCount64Ptr)();
 
+// Reads the TSC and the performance counter at as close to the same time as
+// possible. The reads are retried a few times, and the pair for which the
+// TSC advanced the least across the read of the performance counter is kept.
+// @param tsc Receives the value of the TSC.
+// @param qpc Receives the value of the performance counter.
+void ReadTscAndQpc(uint64_t* tsc, uint64_t* qpc) {
+  DCHECK(tsc != NULL);
+  DCHECK(qpc != NULL);
+
+  const size_t kAttempts = 8;
+  uint64_t best_delta = ~0ULL;
+  for (size_t i = 0; i < kAttempts; ++i) {
+    LargeInteger counter = {};
+    uint64_t before = ::__rdtsc();
+    ::QueryPerformanceCounter(&counter.li);
+    uint64_t after = ::__rdtsc();
+    if (after - before < best_delta) {
+      best_delta = after - before;
+      *tsc = before + best_delta / 2;
+      *qpc = counter.ui64;
+    }
+  }
+}
+
+// The calibrated frequency of the TSC, or 0 if the calibration failed. The
+// TSC is calibrated once per process, as it takes a while. The concurrent
+// first callers wait for the calibration rather than repeating it.
+struct CalibratedTscFrequency {
+  CalibratedTscFrequency() : frequency(0) {
+    if (!CalibrateTscFrequency(&frequency))
+      frequency = 0;
+  }
+
+  uint64_t frequency;
+};
+
+base::LazyInstance<CalibratedTscFrequency>::Leaky calibrated_tsc_frequency =
+    LAZY_INSTANCE_INITIALIZER;
+
 }  // namespace
 
 void GetTickTimerInfo(TimerInfo* timer_info) {
@@ -60,8 +100,16 @@ void GetTscTimerInfo(TimerInfo* timer_info) {
   if ((info[3] & (1 << 8)) == 0)
     return;
 
-  // Get the CPU frequency. If all is well, this is the frequency of the TSC
-  // timer.
+  // A failed calibration is not retried.
+  uint64_t calibrated_frequency = calibrated_tsc_frequency.Get().frequency;
+  if (calibrated_frequency != 0) {
+    timer_info->frequency = calibrated_frequency;
+    timer_info->resolution = 1;
+    return;
+  }
+
+  // Get the nominal CPU frequency. If all is well, this is the frequency of
+  // the TSC timer.
   base::win::RegKey cpureg;
   DWORD mhz = 0;
   if (cpureg.Open(HKEY_LOCAL_MACHINE,
@@ -78,6 +126,32 @@ void GetTscTimerInfo(TimerInfo* timer_info) {
   timer_info->resolution = 1;
 }
 
+bool CalibrateTscFrequency(uint64_t* frequency) {
+  DCHECK(frequency != NULL);
+
+  LargeInteger qpc_frequency = {};
+  if (!::QueryPerformanceFrequency(&qpc_frequency.li) ||
+      qpc_frequency.ui64 == 0) {
+    return false;
+  }
+
+  uint64_t tsc_start = 0;
+  uint64_t qpc_start = 0;
+  ReadTscAndQpc(&tsc_start, &qpc_start);
+  ::Sleep(kTscCalibrationMs);
+  uint64_t tsc_end = 0;
+  uint64_t qpc_end = 0;
+  ReadTscAndQpc(&tsc_end, &qpc_end);
+
+  if (qpc_end <= qpc_start || tsc_end <= tsc_start)
+    return false;
+
+  double seconds = static_cast<double>(qpc_end - qpc_start) /
+                   static_cast<double>(qpc_frequency.ui64);
+  *frequency = static_cast<uint64_t>((tsc_end - tsc_start) / seconds);
+  return *frequency != 0;
+}
+
 bool TimerToFileTime(const FILETIME& file_time_ref,
                      const TimerInfo& timer_info,
                      const uint64_t& timer_ref,
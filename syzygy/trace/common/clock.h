@@ -39,11 +39,24 @@ struct TimerInfo {
 COMPILE_ASSERT_IS_POD(TimerInfo);
 
 // Gets timer information about the various timers. A timer whose information
-// can not be found will have the frequency set to 0.
+// can not be found will have the frequency set to 0. The TSC is only used if
+// it is invariant, in which case its frequency is calibrated against the
+// performance counter the first time this is called in the process. The
+// nominal frequency recorded in the registry is used if that fails.
 // @param timer_info Will be populated with the information about the timer.
 void GetTickTimerInfo(TimerInfo* timer_info);
 void GetTscTimerInfo(TimerInfo* timer_info);
 
+// Measures the frequency of the TSC against the performance counter. This
+// takes kTscCalibrationMs, and assumes that the TSC is invariant.
+// @param frequency Will be populated with the frequency of the TSC, in counts
+//     per second.
+// @returns true on success, false otherwise.
+bool CalibrateTscFrequency(uint64_t* frequency);
+
+// The time over which the frequency of the TSC is measured.
+const uint32_t kTscCalibrationMs = 50;
+
 // @returns the current value of the ticks timer.
 uint64_t GetTicks();
 
@@ -84,11 +97,12 @@ COMPILE_ASSERT_IS_POD(ClockInfo);
 
 // Populates a ClockInfo struct with information about the system clock and
 // timers.
-// NOTE: This requires read access to the registry to get full information, and
-//     is intended to be run from a process that has no restrictions. For
-//     example, if this is run from a sandboxed process the TSC timer
-//     information will be incomplete. A warning will be logged if this is the
-//     case.
+// NOTE: The first call calibrates the TSC, which takes kTscCalibrationMs. If
+//     the calibration fails, this requires read access to the registry to get
+//     full information, and is intended to be run from a process that has no
+//     restrictions. For example, if this is run from a sandboxed process the
+//     TSC timer information will be incomplete. A warning will be logged if
+//     this is the case.
 // @param clock_info The struct to be populated.
 void GetClockInfo(ClockInfo* clock_info);
 
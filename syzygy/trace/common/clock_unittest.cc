@@ -51,6 +51,21 @@ TEST(GetTscTimerInfoTest, WorksAsExpected) {
   CheckValidTscTimerInfo(ti);
 }
 
+TEST(CalibrateTscFrequencyTest, WorksAsExpected) {
+  uint64_t frequency = 0;
+  if (!CalibrateTscFrequency(&frequency))
+    return;
+
+  // The TSC of any machine that runs this ticks faster than 100 MHz.
+  EXPECT_LT(100000000u, frequency);
+
+  // The calibration is stable to well within a percent.
+  uint64_t frequency2 = 0;
+  ASSERT_TRUE(CalibrateTscFrequency(&frequency2));
+  EXPECT_GT(frequency / 100, frequency > frequency2 ? frequency - frequency2
+                                                    : frequency2 - frequency);
+}
+
 TEST(GetTicksTest, WorksAsExpected) {
   // This will busy loop until the counter advances, or until we perform
   // 2^32 iterations. The counter should definitely have advanced by then.
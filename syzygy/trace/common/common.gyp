@@ -35,6 +35,8 @@
       'sources': [
         'clock.cc',
         'clock.h',
+        'log_buffer.cc',
+        'log_buffer.h',
         'service.cc',
         'service.h',
         'service_util.cc',
@@ -50,6 +52,7 @@
       'type': 'executable',
       'sources': [
         'clock_unittest.cc',
+        'log_buffer_unittest.cc',
         'service_unittest.cc',
         'service_util_unittest.cc',
         '<(src)/syzygy/testing/run_all_unittests.cc',
@@ -0,0 +1,195 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/common/log_buffer.h"
+
+#include "base/logging.h"
+#include "syzygy/common/align.h"
+
+namespace trace {
+namespace common {
+
+LogBuffer::LogBuffer() : header_(nullptr), data_(nullptr), data_size_(0) {
+}
+
+bool LogBuffer::Init(void* buffer, size_t buffer_size) {
+  DCHECK_NE(static_cast<void*>(nullptr), buffer);
+  DCHECK(!initialized());
+
+  if (buffer_size < sizeof(LogBufferHeader) + kRecordAlignment)
+    return false;
+
+  // Find the largest power of two that fits after the header.
+  size_t data_size = kRecordAlignment;
+  size_t max_data_size = buffer_size - sizeof(LogBufferHeader);
+  while (data_size <= max_data_size / 2 && data_size < 0x80000000)
+    data_size *= 2;
+
+  header_ = reinterpret_cast<LogBufferHeader*>(buffer);
+  data_ = reinterpret_cast<uint8_t*>(header_ + 1);
+  data_size_ = static_cast<ULONG>(data_size);
+
+  ::memset(buffer, 0, sizeof(LogBufferHeader) + data_size);
+  header_->data_size = data_size_;
+  return true;
+}
+
+bool LogBuffer::Attach(void* buffer, size_t buffer_size) {
+  DCHECK_NE(static_cast<void*>(nullptr), buffer);
+  DCHECK(!initialized());
+
+  if (buffer_size < sizeof(LogBufferHeader))
+    return false;
+  LogBufferHeader* header = reinterpret_cast<LogBufferHeader*>(buffer);
+  size_t data_size = header->data_size;
+  if (data_size < kRecordAlignment || !::common::IsPowerOfTwo(data_size) ||
+      data_size > buffer_size - sizeof(LogBufferHeader)) {
+    LOG(ERROR) << "Invalid log buffer header.";
+    return false;
+  }
+
+  header_ = header;
+  data_ = reinterpret_cast<uint8_t*>(header_ + 1);
+  data_size_ = static_cast<ULONG>(data_size);
+  return true;
+}
+
+bool LogBuffer::Append(const base::StringPiece& text,
+                       const DWORD* trace_data,
+                       size_t trace_length) {
+  DCHECK(initialized());
+  DCHECK(trace_data != nullptr || trace_length == 0);
+
+  size_t payload_size = trace_length * sizeof(*trace_data) + text.size();
+  if (payload_size > data_size_)
+    return false;
+  ULONG record_size = static_cast<ULONG>(::common::AlignUp(
+      sizeof(LogRecordHeader) + payload_size, kRecordAlignment));
+  if (record_size > data_size_)
+    return false;
+
+  // Claim the space of the record, along with the end of the records area if
+  // the record doesn't fit there.
+  ULONG position = 0;
+  ULONG padding_size = 0;
+  while (true) {
+    position = static_cast<ULONG>(header_->write_position);
+    ULONG read_position = static_cast<ULONG>(header_->read_position);
+    ULONG offset = position & (data_size_ - 1);
+    padding_size = 0;
+    if (offset + record_size > data_size_)
+      padding_size = data_size_ - offset;
+    if (position - read_position + padding_size + record_size > data_size_)
+      return false;
+
+    LONG current = ::InterlockedCompareExchange(
+        &header_->write_position,
+        static_cast<LONG>(position + padding_size + record_size),
+        static_cast<LONG>(position));
+    if (current == static_cast<LONG>(position))
+      break;
+  }
+
+  if (padding_size != 0) {
+    LogRecordHeader* padding = GetRecord(position);
+    padding->type = kPaddingLogRecord;
+    ::InterlockedExchange(&padding->size, static_cast<LONG>(padding_size));
+    position += padding_size;
+  }
+
+  LogRecordHeader* record = GetRecord(position);
+  record->type = kTextLogRecord;
+  record->trace_length = static_cast<uint32_t>(trace_length);
+  record->text_length = static_cast<uint32_t>(text.size());
+  uint8_t* payload = reinterpret_cast<uint8_t*>(record + 1);
+  if (trace_length != 0) {
+    ::memcpy(payload, trace_data, trace_length * sizeof(*trace_data));
+    payload += trace_length * sizeof(*trace_data);
+  }
+  ::memcpy(payload, text.data(), text.size());
+
+  // Commit the record. The interlocked operation ensures that its contents
+  // are visible before its size.
+  ::InterlockedExchange(&record->size, static_cast<LONG>(record_size));
+  return true;
+}
+
+size_t LogBuffer::Read(const RecordCallback& callback) {
+  DCHECK(initialized());
+  DCHECK(!callback.is_null());
+
+  size_t read_count = 0;
+  while (true) {
+    ULONG position = static_cast<ULONG>(header_->read_position);
+    LogRecordHeader* record = GetRecord(position);
+    if (record->size == 0)
+      break;
+
+    // The buffer is shared with another process, so its contents can't be
+    // trusted. The header is copied before being validated.
+    LogRecordHeader header = *record;
+    if (!IsValidRecord(header, position & (data_size_ - 1))) {
+      LOG(ERROR) << "Malformed log record at position " << position << ".";
+      break;
+    }
+
+    if (header.type == kTextLogRecord) {
+      const DWORD* trace_data = nullptr;
+      if (header.trace_length != 0)
+        trace_data = reinterpret_cast<const DWORD*>(record + 1);
+      const char* text = reinterpret_cast<const char*>(record + 1) +
+          header.trace_length * sizeof(DWORD);
+      callback.Run(base::StringPiece(text, header.text_length), trace_data,
+                   header.trace_length);
+      ++read_count;
+    }
+
+    // The space must be zeroed before being handed back to the writers, as
+    // they rely on the size of an uncommitted record being zero.
+    ::memset(record, 0, header.size);
+    ::InterlockedExchange(&header_->read_position,
+                          static_cast<LONG>(position + header.size));
+  }
+
+  return read_count;
+}
+
+LogRecordHeader* LogBuffer::GetRecord(ULONG position) const {
+  return reinterpret_cast<LogRecordHeader*>(
+      data_ + (position & (data_size_ - 1)));
+}
+
+bool LogBuffer::IsValidRecord(const LogRecordHeader& record,
+                              ULONG offset) const {
+  ULONG record_size = static_cast<ULONG>(record.size);
+  if (record_size < sizeof(LogRecordHeader) ||
+      record_size % kRecordAlignment != 0 ||
+      record_size > data_size_ - offset) {
+    return false;
+  }
+
+  if (record.type == kPaddingLogRecord)
+    return true;
+  if (record.type != kTextLogRecord)
+    return false;
+
+  size_t payload_size = record_size - sizeof(LogRecordHeader);
+  if (record.trace_length > payload_size / sizeof(DWORD))
+    return false;
+  payload_size -= record.trace_length * sizeof(DWORD);
+  return record.text_length <= payload_size;
+}
+
+}  // namespace common
+}  // namespace trace
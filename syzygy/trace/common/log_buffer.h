@@ -0,0 +1,144 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares LogBuffer, a ring buffer of log records living in memory shared
+// between an instrumented process and the agent logger.
+
+#ifndef SYZYGY_TRACE_COMMON_LOG_BUFFER_H_
+#define SYZYGY_TRACE_COMMON_LOG_BUFFER_H_
+
+#include <stdint.h>
+#include <windows.h>
+
+#include "base/callback.h"
+#include "base/strings/string_piece.h"
+#include "syzygy/common/assertions.h"
+
+namespace trace {
+namespace common {
+
+// The header at the beginning of a log buffer. The positions are byte counts
+// that only ever grow, and that wrap around the records area.
+struct LogBufferHeader {
+  // The size of the records area that follows the header. This is a power of
+  // two.
+  uint32_t data_size;
+  // The position up to which the space has been claimed by the writers. This
+  // is only modified with interlocked operations.
+  volatile LONG write_position;
+  // The position of the next record to be read. This is only modified by the
+  // reader.
+  volatile LONG read_position;
+  uint32_t reserved;
+};
+COMPILE_ASSERT_IS_POD_OF_SIZE(LogBufferHeader, 16);
+
+// The types of the records.
+enum LogRecordType : uint16_t {
+  // Fills the end of the records area when a record doesn't fit there.
+  kPaddingLogRecord,
+  // A message, optionally followed by a stack trace.
+  kTextLogRecord,
+};
+
+// The header of a record. It is followed by the trace_length frames of the
+// stack trace, and then by the text_length characters of the message.
+struct LogRecordHeader {
+  // The total size of the record, including its header and its padding. This
+  // is zero until the record is completely written.
+  volatile LONG size;
+  uint16_t type;
+  uint16_t reserved;
+  uint32_t trace_length;
+  uint32_t text_length;
+};
+COMPILE_ASSERT_IS_POD_OF_SIZE(LogRecordHeader, 16);
+
+// Gives access to a log buffer. Any number of threads can append records to
+// it without locking, while a single reader consumes them in order.
+//
+// A writer never blocks: if there isn't enough free space for its record it
+// fails, and it's up to the caller to wait for the reader or to fall back to
+// another way of logging.
+class LogBuffer {
+ public:
+  // The records are aligned on this boundary, which ensures that there is
+  // always room for a padding record at the end of the records area.
+  static const size_t kRecordAlignment = sizeof(LogRecordHeader);
+
+  // The callback receiving the records that are read. The stack trace is
+  // null when @p trace_length is zero.
+  typedef base::Callback<void(const base::StringPiece& text,
+                              const DWORD* trace_data,
+                              size_t trace_length)> RecordCallback;
+
+  LogBuffer();
+
+  // Formats a new log buffer. The records area is the largest power of two
+  // that fits after the header.
+  // @param buffer The memory to format. This must remain valid as long as
+  //     this object is used.
+  // @param buffer_size The size of @p buffer.
+  // @returns true on success, false if @p buffer is too small.
+  bool Init(void* buffer, size_t buffer_size);
+
+  // Gives access to a log buffer that has been formatted already, possibly in
+  // another process.
+  // @param buffer The memory of the log buffer. This must remain valid as long
+  //     as this object is used.
+  // @param buffer_size The size of @p buffer.
+  // @returns true on success, false if the header is not valid.
+  bool Attach(void* buffer, size_t buffer_size);
+
+  // @returns true if this object has been successfully initialized or
+  //     attached.
+  bool initialized() const { return header_ != nullptr; }
+
+  // Appends a message to the buffer. This is lock-free.
+  // @param text The message.
+  // @param trace_data The frames of the stack trace to attach to the
+  //     message, if any.
+  // @param trace_length The number of frames in @p trace_data.
+  // @returns true on success, false if there isn't enough free space.
+  bool Append(const base::StringPiece& text,
+              const DWORD* trace_data,
+              size_t trace_length);
+
+  // Reads the records that have been completely written, in order, and frees
+  // their space. This must only be called by one thread at a time.
+  // @param callback The callback receiving the messages.
+  // @returns the number of messages that have been read. Reading stops at the
+  //     first malformed record.
+  size_t Read(const RecordCallback& callback);
+
+ protected:
+  // @returns the record at the given position.
+  LogRecordHeader* GetRecord(ULONG position) const;
+
+  // @returns true if the header of a record, starting at @p offset in the
+  //     records area, is consistent.
+  bool IsValidRecord(const LogRecordHeader& record, ULONG offset) const;
+
+  LogBufferHeader* header_;
+  uint8_t* data_;
+  ULONG data_size_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(LogBuffer);
+};
+
+}  // namespace common
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_COMMON_LOG_BUFFER_H_
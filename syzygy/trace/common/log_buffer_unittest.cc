@@ -0,0 +1,170 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/common/log_buffer.h"
+
+#include <string>
+#include <vector>
+
+#include "base/bind.h"
+#include "gtest/gtest.h"
+
+namespace trace {
+namespace common {
+
+namespace {
+
+class LogBufferTest : public testing::Test {
+ public:
+  // A record, as received by OnRecord.
+  struct Record {
+    std::string text;
+    std::vector<DWORD> trace;
+  };
+
+  void OnRecord(const base::StringPiece& text,
+                const DWORD* trace_data,
+                size_t trace_length) {
+    Record record;
+    text.CopyToString(&record.text);
+    if (trace_length != 0)
+      record.trace.assign(trace_data, trace_data + trace_length);
+    records_.push_back(record);
+  }
+
+  size_t Read(LogBuffer* log_buffer) {
+    return log_buffer->Read(
+        base::Bind(&LogBufferTest::OnRecord, base::Unretained(this)));
+  }
+
+ protected:
+  std::vector<Record> records_;
+};
+
+}  // namespace
+
+TEST_F(LogBufferTest, InitAndAttach) {
+  std::vector<uint8_t> buffer(sizeof(LogBufferHeader) + 1000);
+  LogBuffer writer;
+  EXPECT_FALSE(writer.initialized());
+  ASSERT_TRUE(writer.Init(buffer.data(), buffer.size()));
+  EXPECT_TRUE(writer.initialized());
+
+  // The records area is rounded down to a power of two.
+  LogBufferHeader* header = reinterpret_cast<LogBufferHeader*>(buffer.data());
+  EXPECT_EQ(512u, header->data_size);
+
+  LogBuffer reader;
+  EXPECT_TRUE(reader.Attach(buffer.data(), buffer.size()));
+
+  // A buffer that's too small can't be attached to.
+  LogBuffer small_reader;
+  EXPECT_FALSE(small_reader.Attach(buffer.data(), 256));
+
+  // Neither can a corrupt one.
+  header->data_size = 100;
+  LogBuffer corrupt_reader;
+  EXPECT_FALSE(corrupt_reader.Attach(buffer.data(), buffer.size()));
+
+  std::vector<uint8_t> tiny_buffer(sizeof(LogBufferHeader));
+  LogBuffer tiny_writer;
+  EXPECT_FALSE(tiny_writer.Init(tiny_buffer.data(), tiny_buffer.size()));
+}
+
+TEST_F(LogBufferTest, AppendAndRead) {
+  std::vector<uint8_t> buffer(sizeof(LogBufferHeader) + 1024);
+  LogBuffer writer;
+  ASSERT_TRUE(writer.Init(buffer.data(), buffer.size()));
+  LogBuffer reader;
+  ASSERT_TRUE(reader.Attach(buffer.data(), buffer.size()));
+
+  EXPECT_EQ(0u, Read(&reader));
+
+  const DWORD kTrace[] = { 0x1000, 0x2000, 0x3000 };
+  EXPECT_TRUE(writer.Append("first", nullptr, 0));
+  EXPECT_TRUE(writer.Append("second", kTrace, arraysize(kTrace)));
+  EXPECT_TRUE(writer.Append("", nullptr, 0));
+
+  EXPECT_EQ(3u, Read(&reader));
+  ASSERT_EQ(3u, records_.size());
+  EXPECT_EQ("first", records_[0].text);
+  EXPECT_TRUE(records_[0].trace.empty());
+  EXPECT_EQ("second", records_[1].text);
+  EXPECT_EQ(std::vector<DWORD>(kTrace, kTrace + arraysize(kTrace)),
+            records_[1].trace);
+  EXPECT_EQ("", records_[2].text);
+
+  // The records are only read once.
+  EXPECT_EQ(0u, Read(&reader));
+}
+
+TEST_F(LogBufferTest, FailsWhenFull) {
+  std::vector<uint8_t> buffer(sizeof(LogBufferHeader) + 256);
+  LogBuffer log_buffer;
+  ASSERT_TRUE(log_buffer.Init(buffer.data(), buffer.size()));
+
+  // A record that can never fit is refused.
+  std::string huge_text(256, 'x');
+  EXPECT_FALSE(log_buffer.Append(huge_text, nullptr, 0));
+
+  // Each of these records takes 64 bytes.
+  std::string text(40, 'a');
+  for (size_t i = 0; i < 4; ++i)
+    EXPECT_TRUE(log_buffer.Append(text, nullptr, 0));
+  EXPECT_FALSE(log_buffer.Append(text, nullptr, 0));
+
+  // Reading frees the space.
+  EXPECT_EQ(4u, Read(&log_buffer));
+  EXPECT_TRUE(log_buffer.Append(text, nullptr, 0));
+  EXPECT_EQ(1u, Read(&log_buffer));
+  EXPECT_EQ(5u, records_.size());
+}
+
+TEST_F(LogBufferTest, WrapsAround) {
+  std::vector<uint8_t> buffer(sizeof(LogBufferHeader) + 256);
+  LogBuffer log_buffer;
+  ASSERT_TRUE(log_buffer.Init(buffer.data(), buffer.size()));
+
+  // Records of 48 bytes don't evenly divide the records area, so this
+  // exercises the padding at its end.
+  std::vector<std::string> expected_texts;
+  for (size_t i = 0; i < 100; ++i) {
+    std::string text(20, static_cast<char>('a' + i % 26));
+    expected_texts.push_back(text);
+    ASSERT_TRUE(log_buffer.Append(text, nullptr, 0));
+    if (i % 3 == 2)
+      EXPECT_EQ(3u, Read(&log_buffer));
+  }
+  Read(&log_buffer);
+
+  ASSERT_EQ(expected_texts.size(), records_.size());
+  for (size_t i = 0; i < expected_texts.size(); ++i)
+    EXPECT_EQ(expected_texts[i], records_[i].text);
+}
+
+TEST_F(LogBufferTest, StopsAtMalformedRecord) {
+  std::vector<uint8_t> buffer(sizeof(LogBufferHeader) + 256);
+  LogBuffer log_buffer;
+  ASSERT_TRUE(log_buffer.Init(buffer.data(), buffer.size()));
+  ASSERT_TRUE(log_buffer.Append("text", nullptr, 0));
+
+  LogRecordHeader* record = reinterpret_cast<LogRecordHeader*>(
+      buffer.data() + sizeof(LogBufferHeader));
+  record->text_length = 1000;
+  EXPECT_EQ(0u, Read(&log_buffer));
+  EXPECT_TRUE(records_.empty());
+}
+
+}  // namespace common
+}  // namespace trace
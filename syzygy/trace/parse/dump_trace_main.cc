@@ -21,6 +21,7 @@
 #include "base/logging.h"
 #include "base/files/file_path.h"
 #include "base/files/file_util.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/threading/simple_thread.h"
 #include "base/win/event_trace_consumer.h"
 #include "base/win/event_trace_controller.h"
@@ -35,6 +36,7 @@ namespace {
 using trace::parser::Parser;
 using trace::parser::ParseEventHandler;
 using trace::parser::ModuleInformation;
+using trace::parser::TraceFilter;
 
 const char* GetIndexedDataTypeStr(uint8_t data_type) {
   const char* ret = NULL;
@@ -482,6 +484,33 @@ class TraceFileDumper : public ParseEventHandler {
               time.ToInternalValue(), process_id, data->process_heap);
   }
 
+  void OnInvocationSampling(base::Time time,
+                            DWORD process_id,
+                            DWORD thread_id,
+                            const TraceInvocationSampling* data) override {
+    DCHECK_NE(static_cast<TraceInvocationSampling*>(nullptr), data);
+    ::fprintf(file_,
+              "[%012lld] OnInvocationSampling: process-id=%d; thread-id=%d;"
+              " sampling-interval=%d\n",
+              time.ToInternalValue(), process_id, thread_id,
+              data->sampling_interval);
+  }
+
+  void OnSampleStack(base::Time time,
+                     DWORD process_id,
+                     const TraceSampleStack* data) override {
+    DCHECK_NE(static_cast<TraceSampleStack*>(nullptr), data);
+    ::fprintf(file_,
+              "[%012lld] OnSampleStack: process-id=%d;\n"
+              "    sampling-interval=0x%016llx; sample-count=%d;"
+              " num-frames=%d\n",
+              time.ToInternalValue(), process_id, data->sampling_interval,
+              data->sample_count, data->num_frames);
+    for (uint32_t i = 0; i < data->num_frames; ++i)
+      ::fprintf(file_, "    frame-%d=0x%08X\n", i,
+                reinterpret_cast<size_t>(data->frames[i]));
+  }
+
  private:
   FILE* file_;
   const char* indentation_;
@@ -496,11 +525,13 @@ class TraceFileDumper : public ParseEventHandler {
 };
 
 bool DumpTraceFiles(FILE* out_file,
-                    const std::vector<base::FilePath>& file_paths) {
+                    const std::vector<base::FilePath>& file_paths,
+                    const TraceFilter& filter) {
   Parser parser;
   TraceFileDumper dumper(out_file);
   if (!parser.Init(&dumper))
     return false;
+  parser.SetFilter(filter);
 
   std::vector<base::FilePath>::const_iterator iter = file_paths.begin();
   for (; iter != file_paths.end(); ++iter) {
@@ -511,6 +542,46 @@ bool DumpTraceFiles(FILE* out_file,
   return parser.Consume() && !parser.error_occurred();
 }
 
+// Parses the switches that restrict the events to dump. The times are in the
+// units in which the events are dumped.
+// @param cmd_line the command line.
+// @param filter receives the events to dump.
+// @returns true on success, false if a switch is invalid.
+bool ParseFilter(const base::CommandLine* cmd_line, TraceFilter* filter) {
+  DCHECK(cmd_line != NULL);
+  DCHECK(filter != NULL);
+
+  const char* const kIdSwitches[] = { "process-id", "thread-id" };
+  uint32_t* const ids[] = { &filter->process_id, &filter->thread_id };
+  for (size_t i = 0; i < arraysize(kIdSwitches); ++i) {
+    if (!cmd_line->HasSwitch(kIdSwitches[i]))
+      continue;
+    unsigned id = 0;
+    if (!base::StringToUint(cmd_line->GetSwitchValueASCII(kIdSwitches[i]),
+                            &id)) {
+      LOG(ERROR) << "Invalid --" << kIdSwitches[i] << " value.";
+      return false;
+    }
+    *ids[i] = id;
+  }
+
+  const char* const kTimeSwitches[] = { "start-time", "end-time" };
+  base::Time* const times[] = { &filter->start_time, &filter->end_time };
+  for (size_t i = 0; i < arraysize(kTimeSwitches); ++i) {
+    if (!cmd_line->HasSwitch(kTimeSwitches[i]))
+      continue;
+    int64_t time = 0;
+    if (!base::StringToInt64(cmd_line->GetSwitchValueASCII(kTimeSwitches[i]),
+                             &time)) {
+      LOG(ERROR) << "Invalid --" << kTimeSwitches[i] << " value.";
+      return false;
+    }
+    *times[i] = base::Time::FromInternalValue(time);
+  }
+
+  return true;
+}
+
 }  // namespace
 
 int main(int argc, const char** argv) {
@@ -535,11 +606,19 @@ int main(int argc, const char** argv) {
     LOG(ERROR) << "No trace file paths specified.";
 
     ::fprintf(stderr,
-              "Usage: %ls [--out=OUTPUT] TRACE_FILE(s)...\n\n",
+              "Usage: %ls [--out=OUTPUT] [--process-id=PID] [--thread-id=TID]\n"
+              "    [--start-time=TIME] [--end-time=TIME] TRACE_FILE(s)...\n\n"
+              "The times are in the units of the dumped events. Segments of\n"
+              "events outside of the filter are skipped when the trace files\n"
+              "are indexed.\n\n",
               cmd_line->GetProgram().value().c_str());
     return 1;
   }
 
+  TraceFilter filter;
+  if (!ParseFilter(cmd_line, &filter))
+    return 1;
+
   base::FilePath out_file_path(cmd_line->GetSwitchValuePath("out"));
   base::ScopedFILE out_file;
   if (!out_file_path.empty()) {
@@ -551,7 +630,7 @@ int main(int argc, const char** argv) {
     }
   }
 
-  if (!DumpTraceFiles(out_file.get(), trace_file_paths)) {
+  if (!DumpTraceFiles(out_file.get(), trace_file_paths, filter)) {
     LOG(ERROR) << "Failed to dump trace files.";
     return 1;
   }
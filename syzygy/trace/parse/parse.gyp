@@ -29,11 +29,19 @@
         'parse_utils.h',
         'parser.h',
         'parser.cc',
+        'trace_data_source.cc',
+        'trace_data_source.h',
+        'trace_file_mapping.cc',
+        'trace_file_mapping.h',
+        'trace_stream.cc',
+        'trace_stream.h',
       ],
       'dependencies': [
+        '<(src)/syzygy/application/application.gyp:application_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/trace/common/common.gyp:trace_common_lib',
         '<(src)/syzygy/trace/rpc/rpc.gyp:call_trace_rpc_lib',
+        '<(src)/third_party/zlib/zlib.gyp:zlib',
       ],
     },
     {
@@ -71,6 +79,8 @@
         'parse_engine_unittest.cc',
         'parse_utils_unittest.cc',
         'parser_unittest.cc',
+        'trace_file_mapping_unittest.cc',
+        'trace_stream_unittest.cc',
         '<(src)/syzygy/testing/run_all_unittests.cc',
       ],
       'dependencies': [
@@ -19,6 +19,8 @@
 #include <wmistr.h>  // NOLINT
 #include <evntrace.h>
 
+#include <vector>
+
 #include "base/logging.h"
 #include "syzygy/common/buffer_parser.h"
 #include "syzygy/common/com_utils.h"
@@ -29,8 +31,35 @@ namespace parser {
 
 using ::common::BinaryBufferReader;
 
+namespace {
+
+// Reads an unsigned LEB128 encoded value of a TraceCompactFunctionCalls.
+// @returns true on success, false if the value runs past the end of the data.
+template <typename ValueType>
+bool ReadLeb128(const uint8_t** cursor, const uint8_t* end, ValueType* value) {
+  DCHECK_NE(static_cast<const uint8_t**>(nullptr), cursor);
+  DCHECK_NE(static_cast<ValueType*>(nullptr), value);
+
+  *value = 0;
+  for (size_t shift = 0; shift < sizeof(ValueType) * 8; shift += 7) {
+    if (*cursor >= end)
+      return false;
+    uint8_t byte = *((*cursor)++);
+    *value |= static_cast<ValueType>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+
+  // The value has too many bytes.
+  return false;
+}
+
+}  // namespace
+
 ParseEngine::ParseEngine(const char* name, bool fail_on_module_conflict)
     : event_handler_(nullptr),
+      parallel_event_handler_(nullptr),
+      thread_count_(1),
       error_occurred_(false),
       fail_on_module_conflict_(fail_on_module_conflict) {
   DCHECK(name != nullptr);
@@ -59,6 +88,19 @@ void ParseEngine::set_event_handler(ParseEventHandler* event_handler) {
   event_handler_ = event_handler;
 }
 
+void ParseEngine::set_parallel_event_handler(
+    ParallelParseEventHandler* parallel_event_handler,
+    size_t thread_count) {
+  DCHECK(parallel_event_handler != nullptr);
+  DCHECK_LT(0u, thread_count);
+  parallel_event_handler_ = parallel_event_handler;
+  thread_count_ = thread_count;
+}
+
+bool ParseEngine::OpenTraceStream(const base::FilePath& pipe_path) {
+  return false;
+}
+
 const ModuleInformation* ParseEngine::GetModuleInformation(
     uint32_t process_id,
     AbsoluteAddress64 addr) const {
@@ -271,6 +313,22 @@ bool ParseEngine::DispatchEvent(EVENT_TRACE* event) {
       success = DispatchProcessHeap(event);
       break;
 
+    case TRACE_INVOCATION_SAMPLING:
+      success = DispatchInvocationSampling(event);
+      break;
+
+    case TRACE_COMPACT_FUNCTION_CALLS:
+      success = DispatchCompactFunctionCalls(event);
+      break;
+
+    case TRACE_SAMPLE_STACK:
+      success = DispatchSampleStack(event);
+      break;
+
+    case TRACE_COMPACT_BATCH_ENTER:
+      success = DispatchCompactBatchEnterEvent(event);
+      break;
+
     default:
       LOG(ERROR) << "Unknown event type encountered.";
       break;
@@ -360,6 +418,73 @@ bool ParseEngine::DispatchBatchEnterEvent(EVENT_TRACE* event) {
   return true;
 }
 
+bool ParseEngine::DispatchCompactBatchEnterEvent(EVENT_TRACE* event) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+  DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
+  DCHECK(!error_occurred_);
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  const TraceCompactBatchEnterData* data = nullptr;
+  // The batches are written without padding, so they may be smaller than the
+  // structure.
+  if (!reader.Read(FIELD_OFFSET(TraceCompactBatchEnterData, call_data),
+                   &data)) {
+    LOG(ERROR) << "Short or empty TraceCompactBatchEnterData event.";
+    return false;
+  }
+  DCHECK(data != nullptr);
+
+  size_t expected_length =
+      FIELD_OFFSET(TraceCompactBatchEnterData, call_data) +
+      data->call_data_size;
+  if (event->MofLength < expected_length) {
+    LOG(ERROR) << "Payload smaller than size implied by "
+               << "TraceCompactBatchEnterData header.";
+    return false;
+  }
+
+  // Each entry is encoded in at least 2 bytes, which keeps a corrupt count
+  // from causing a huge allocation.
+  if (data->num_calls > data->call_data_size / 2) {
+    LOG(ERROR) << "Invalid call count in TraceCompactBatchEnterData event.";
+    return false;
+  }
+
+  // The entries are decoded to a TraceBatchEnterData, which is dispatched as
+  // if it had been recorded as such.
+  std::vector<uint8_t> buffer(FIELD_OFFSET(TraceBatchEnterData, calls) +
+                              data->num_calls * sizeof(TraceEnterEventData));
+  TraceBatchEnterData* batch =
+      reinterpret_cast<TraceBatchEnterData*>(buffer.data());
+  batch->thread_id = event->Header.ThreadId;
+  batch->num_calls = data->num_calls;
+
+  const uint8_t* cursor = data->call_data;
+  const uint8_t* end = cursor + data->call_data_size;
+  uint32_t function = 0;
+  uint32_t retaddr = 0;
+  for (uint32_t i = 0; i < data->num_calls; ++i) {
+    uint32_t function_zigzag = 0;
+    uint32_t retaddr_zigzag = 0;
+    if (!ReadLeb128(&cursor, end, &function_zigzag) ||
+        !ReadLeb128(&cursor, end, &retaddr_zigzag)) {
+      LOG(ERROR) << "Truncated entry in TraceCompactBatchEnterData event.";
+      return false;
+    }
+    function += (function_zigzag >> 1) ^ (0 - (function_zigzag & 1));
+    retaddr += (retaddr_zigzag >> 1) ^ (0 - (retaddr_zigzag & 1));
+    batch->calls[i].function = reinterpret_cast<FuncAddr>(function);
+    batch->calls[i].retaddr = reinterpret_cast<RetAddr>(retaddr);
+  }
+
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  DWORD process_id = event->Header.ProcessId;
+  event_handler_->OnBatchFunctionEntry(time, process_id, batch->thread_id,
+                                       batch);
+  return true;
+}
+
 bool ParseEngine::DispatchProcessEndedEvent(EVENT_TRACE* event) {
   DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
   DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
@@ -616,6 +741,134 @@ bool ParseEngine::DispatchDetailedFunctionCall(EVENT_TRACE* event) {
   return true;
 }
 
+bool ParseEngine::DispatchCompactFunctionCalls(EVENT_TRACE* event) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+  DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
+  DCHECK(!error_occurred_);
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  const TraceCompactFunctionCalls* data = nullptr;
+  // The batches are written without padding, so they may be smaller than the
+  // structure.
+  if (!reader.Read(FIELD_OFFSET(TraceCompactFunctionCalls, call_data),
+                   &data)) {
+    LOG(ERROR) << "Short or empty TraceCompactFunctionCalls event.";
+    return false;
+  }
+  DCHECK(data != nullptr);
+
+  // Calculate the expected size of the payload and ensure there's
+  // enough data.
+  size_t expected_length =
+      FIELD_OFFSET(TraceCompactFunctionCalls, call_data) +
+      data->call_data_size;
+  if (event->MofLength < expected_length) {
+    LOG(ERROR) << "Payload smaller than size implied by "
+               << "TraceCompactFunctionCalls header.";
+    return false;
+  }
+
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  DWORD process_id = event->Header.ProcessId;
+  DWORD thread_id = event->Header.ThreadId;
+
+  // Each call is decoded to a TraceDetailedFunctionCall, which is dispatched
+  // as if it had been recorded as such.
+  const uint8_t* cursor = data->call_data;
+  const uint8_t* end = cursor + data->call_data_size;
+  uint64_t timestamp = data->base_timestamp;
+  uint32_t last_argument = 0;
+  std::vector<uint32_t> arg_sizes;
+  std::vector<uint8_t> buffer;
+  for (uint32_t i = 0; i < data->num_calls; ++i) {
+    uint64_t timestamp_delta = 0;
+    uint32_t function_id = 0;
+    uint32_t stack_trace_id = 0;
+    uint32_t args_count = 0;
+    if (!ReadLeb128(&cursor, end, &timestamp_delta) ||
+        !ReadLeb128(&cursor, end, &function_id) ||
+        !ReadLeb128(&cursor, end, &stack_trace_id) ||
+        !ReadLeb128(&cursor, end, &args_count)) {
+      LOG(ERROR) << "Truncated call in TraceCompactFunctionCalls event.";
+      return false;
+    }
+    timestamp += timestamp_delta;
+
+    // The argument count and lengths are bounded by the size of the call
+    // data, which keeps a corrupt count from causing huge allocations.
+    if (args_count > static_cast<size_t>(end - cursor)) {
+      LOG(ERROR) << "Invalid argument count in TraceCompactFunctionCalls "
+                 << "event.";
+      return false;
+    }
+    arg_sizes.resize(args_count);
+    size_t args_size = 0;
+    size_t min_encoded_size = 0;
+    for (uint32_t j = 0; j < args_count; ++j) {
+      if (!ReadLeb128(&cursor, end, &arg_sizes[j])) {
+        LOG(ERROR) << "Truncated call in TraceCompactFunctionCalls event.";
+        return false;
+      }
+      // A 4-byte argument is encoded in at least one byte.
+      min_encoded_size +=
+          arg_sizes[j] == sizeof(uint32_t) ? 1 : arg_sizes[j];
+      if (min_encoded_size > static_cast<size_t>(end - cursor)) {
+        LOG(ERROR) << "Invalid argument length in TraceCompactFunctionCalls "
+                   << "event.";
+        return false;
+      }
+      args_size += arg_sizes[j];
+    }
+    if (args_count > 0)
+      args_size += (args_count + 1) * sizeof(uint32_t);
+
+    buffer.assign(
+        FIELD_OFFSET(TraceDetailedFunctionCall, argument_data) + args_size, 0);
+    TraceDetailedFunctionCall* call =
+        reinterpret_cast<TraceDetailedFunctionCall*>(buffer.data());
+    call->timestamp = timestamp;
+    call->function_id = function_id;
+    call->stack_trace_id = stack_trace_id;
+    call->argument_data_size = args_size;
+
+    if (args_count > 0) {
+      uint32_t* call_arg_sizes =
+          reinterpret_cast<uint32_t*>(call->argument_data);
+      *(call_arg_sizes++) = args_count;
+      for (uint32_t j = 0; j < args_count; ++j)
+        *(call_arg_sizes++) = arg_sizes[j];
+
+      uint8_t* arg_data = reinterpret_cast<uint8_t*>(call_arg_sizes);
+      for (uint32_t j = 0; j < args_count; ++j) {
+        if (arg_sizes[j] == sizeof(uint32_t)) {
+          uint32_t zigzag = 0;
+          if (!ReadLeb128(&cursor, end, &zigzag)) {
+            LOG(ERROR) << "Truncated argument in TraceCompactFunctionCalls "
+                       << "event.";
+            return false;
+          }
+          last_argument += (zigzag >> 1) ^ (0 - (zigzag & 1));
+          ::memcpy(arg_data, &last_argument, sizeof(last_argument));
+        } else {
+          if (arg_sizes[j] > static_cast<size_t>(end - cursor)) {
+            LOG(ERROR) << "Truncated argument in TraceCompactFunctionCalls "
+                       << "event.";
+            return false;
+          }
+          ::memcpy(arg_data, cursor, arg_sizes[j]);
+          cursor += arg_sizes[j];
+        }
+        arg_data += arg_sizes[j];
+      }
+    }
+
+    event_handler_->OnDetailedFunctionCall(time, process_id, thread_id, call);
+  }
+
+  return true;
+}
+
 bool ParseEngine::DispatchComment(EVENT_TRACE* event) {
   DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
   DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
@@ -669,6 +922,59 @@ bool ParseEngine::DispatchProcessHeap(EVENT_TRACE* event) {
   return true;
 }
 
+bool ParseEngine::DispatchInvocationSampling(EVENT_TRACE* event) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+  DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
+  DCHECK(!error_occurred_);
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  const TraceInvocationSampling* data = nullptr;
+  if (!reader.Read(&data)) {
+    LOG(ERROR) << "Short or empty TraceInvocationSampling event.";
+    return false;
+  }
+  DCHECK(data != nullptr);
+
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  DWORD process_id = event->Header.ProcessId;
+  DWORD thread_id = event->Header.ThreadId;
+  event_handler_->OnInvocationSampling(time, process_id, thread_id, data);
+
+  return true;
+}
+
+bool ParseEngine::DispatchSampleStack(EVENT_TRACE* event) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+  DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
+  DCHECK(!error_occurred_);
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  const TraceSampleStack* data = nullptr;
+  if (!reader.Read(FIELD_OFFSET(TraceSampleStack, frames), &data)) {
+    LOG(ERROR) << "Short or empty TraceSampleStack event.";
+    return false;
+  }
+  DCHECK(data != nullptr);
+
+  // Calculate the expected size of the payload and ensure there's
+  // enough data.
+  size_t expected_length = FIELD_OFFSET(TraceSampleStack, frames) +
+      data->num_frames * sizeof(void*);
+  if (event->MofLength < expected_length) {
+    LOG(ERROR) << "Payload smaller than size implied by "
+               << "TraceSampleStack header.";
+    return false;
+  }
+
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  DWORD process_id = event->Header.ProcessId;
+  event_handler_->OnSampleStack(time, process_id, data);
+
+  return true;
+}
+
 namespace {
 
 void ModuleTraceDataToModuleInformation(
@@ -47,6 +47,21 @@ class ParseEngine {
   // Registers an event handler with this trace-file parse engine.
   void set_event_handler(ParseEventHandler* event_handler);
 
+  // Makes the parse engine dispatch the events on several threads, each of
+  // which dispatches to a clone of @p parallel_event_handler. Parse engines
+  // that don't support it keep dispatching the events sequentially.
+  // @param parallel_event_handler the event handler that provides the clones.
+  //     This must be the registered event handler.
+  // @param thread_count the number of threads that dispatch the events.
+  void set_parallel_event_handler(
+      ParallelParseEventHandler* parallel_event_handler,
+      size_t thread_count);
+
+  // Restricts the events that are dispatched from the trace files. Parse
+  // engines that can't seek in their trace files dispatch all of the events.
+  // @param filter the events to dispatch.
+  void set_filter(const TraceFilter& filter) { filter_ = filter; }
+
   // Returns true if the file given by @p trace_file_path is parseable by this
   // parse engine.
   virtual bool IsRecognizedTraceFile(const base::FilePath& trace_file_path) = 0;
@@ -58,6 +73,14 @@ class ParseEngine {
   // @returns true on success.
   virtual bool OpenTraceFile(const base::FilePath& trace_file_path) = 0;
 
+  // Prepares the consumption of a live stream, which a session of the call
+  // trace service writes to the named pipe given by @p pipe_path. The stream
+  // is consumed by ConsumeAllEvents, once the trace files have been.
+  //
+  // @returns true on success, false if the parse engine doesn't support
+  //     streams.
+  virtual bool OpenTraceStream(const base::FilePath& pipe_path);
+
   // Consume all events across all currently open trace files and for each
   // event call the dispatcher to notify the event handler.
   //
@@ -152,6 +175,13 @@ class ParseEngine {
   //     true.
   bool DispatchBatchEnterEvent(EVENT_TRACE* event);
 
+  // Parses and dispatches a batch of compactly encoded function entry
+  // events, as an OnBatchFunctionEntry event.
+  // @param event the event to dispatch.
+  // @returns true if the event was successfully dispatched, false otherwise.
+  //     Does not explicitly set error occurred.
+  bool DispatchCompactBatchEnterEvent(EVENT_TRACE* event);
+
   // Parses and dispatches a process ended event. Called from DispatchEvent().
   //
   // @param event The event to dispatch.
@@ -233,6 +263,13 @@ class ParseEngine {
   //     Does not explicitly set error occurred.
   bool DispatchDetailedFunctionCall(EVENT_TRACE* event);
 
+  // Parses and dispatches a batch of compactly encoded detailed function
+  // calls, as OnDetailedFunctionCall events.
+  // @param event the event to dispatch.
+  // @returns true if the event was successfully dispatched, false otherwise.
+  //     Does not explicitly set error occurred.
+  bool DispatchCompactFunctionCalls(EVENT_TRACE* event);
+
   // Parses and dispatches a call-trace comment.
   // @param event the event to dispatch.
   // @returns true if the event was successfully dispatched, false otherwise.
@@ -245,12 +282,33 @@ class ParseEngine {
   //     Does not explicitly set error occurred.
   bool DispatchProcessHeap(EVENT_TRACE* event);
 
+  // Parses and dispatches an invocation sampling record.
+  // @param event the event to dispatch.
+  // @returns true if the event was successfully dispatched, false otherwise.
+  //     Does not explicitly set error occurred.
+  bool DispatchInvocationSampling(EVENT_TRACE* event);
+
+  // Parses and dispatches a stack sample record.
+  // @param event the event to dispatch.
+  // @returns true if the event was successfully dispatched, false otherwise.
+  //     Does not explicitly set error occurred.
+  bool DispatchSampleStack(EVENT_TRACE* event);
+
   // The name by which this parse engine is known.
   std::string name_;
 
   // The event handler to be notified on trace events.
   ParseEventHandler* event_handler_;
 
+  // The event handler that provides the clones to which the events are
+  // dispatched when parsing in parallel, and the number of parsing threads.
+  // The former is NULL when parsing sequentially.
+  ParallelParseEventHandler* parallel_event_handler_;
+  size_t thread_count_;
+
+  // The events to dispatch from the trace files.
+  TraceFilter filter_;
+
   // For each process, we store its point of view of the world.
   ProcessMap processes_;
 
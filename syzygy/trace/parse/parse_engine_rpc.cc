@@ -16,11 +16,17 @@
 
 #include "syzygy/trace/parse/parse_engine_rpc.h"
 
+#include "base/bind.h"
 #include "base/logging.h"
 #include "base/files/file_util.h"
+#include "base/synchronization/lock.h"
+#include "syzygy/application/work_pool.h"
 #include "syzygy/common/align.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/trace/parse/parse_utils.h"
+#include "syzygy/trace/parse/trace_file_mapping.h"
+#include "syzygy/trace/parse/trace_stream.h"
+#include "third_party/zlib/zlib.h"
 
 using common::AlignUp;
 using common::AlignUp64;
@@ -28,6 +34,118 @@ using common::AlignUp64;
 namespace trace {
 namespace parser {
 
+namespace {
+
+// The number of segments read for each parsing thread in a batch of segments.
+const size_t kSegmentsPerThread = 4;
+
+// @returns true if @p type is the type of an event that changes the module
+//     space of a process.
+bool IsModuleEvent(uint16_t type) {
+  return type == TRACE_PROCESS_ATTACH_EVENT ||
+         type == TRACE_PROCESS_DETACH_EVENT ||
+         type == TRACE_THREAD_ATTACH_EVENT ||
+         type == TRACE_THREAD_DETACH_EVENT;
+}
+
+// Converts a TSC timestamp of a trace file to a time.
+// @param file_header the header of the trace file.
+// @param timestamp the timestamp to convert.
+// @param time receives the time of the timestamp.
+// @returns true on success, false if the trace file has no TSC information.
+bool TimestampToTime(const TraceFileHeader& file_header,
+                     uint64_t timestamp,
+                     base::Time* time) {
+  DCHECK(time != NULL);
+
+  FILETIME file_time = {};
+  if (!trace::common::TscToFileTime(file_header.clock_info, timestamp,
+                                    &file_time)) {
+    return false;
+  }
+  *time = base::Time::FromFileTime(file_time);
+  return true;
+}
+
+// @returns true if the segment described by @p entry overlaps @p filter. The
+//     segments whose times can't be determined are kept.
+bool SegmentIsInFilter(const TraceFilter& filter,
+                       const TraceFileHeader& file_header,
+                       const TraceFileIndexEntry& entry) {
+  if (filter.thread_id != 0 && filter.thread_id != entry.thread_id)
+    return false;
+
+  base::Time time;
+  if (!filter.end_time.is_null() &&
+      TimestampToTime(file_header, entry.first_timestamp, &time) &&
+      time > filter.end_time) {
+    return false;
+  }
+  if (!filter.start_time.is_null() &&
+      TimestampToTime(file_header, entry.last_timestamp, &time) &&
+      time < filter.start_time) {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+// Dispatches the segment events of a batch of segments on several threads.
+// Each segment is dispatched by whichever worker engine is free, so that a
+// worker engine, and the clone it dispatches to, is only used by one thread at
+// a time.
+class ParseEngineRpc::SegmentDispatcher {
+ public:
+  SegmentDispatcher(ParseEngineRpc* engine,
+                    const TraceFileHeader* file_header,
+                    Segments* segments)
+      : file_header_(file_header), segments_(segments) {
+    DCHECK(engine != NULL);
+    DCHECK(file_header != NULL);
+    DCHECK(segments != NULL);
+    for (const auto& worker : engine->workers_)
+      free_workers_.push_back(worker.get());
+  }
+
+  // Dispatches the events of the segment at @p index.
+  // @param index the index of the segment.
+  // @returns true on success, false otherwise.
+  bool Dispatch(size_t index) {
+    Segment& segment = (*segments_)[index];
+    if (segment.filtered_out)
+      return true;
+
+    // There are never more threads than worker engines, so one is free.
+    ParseEngineRpc* worker_engine = NULL;
+    {
+      base::AutoLock auto_lock(lock_);
+      DCHECK(!free_workers_.empty());
+      worker_engine = free_workers_.back();
+      free_workers_.pop_back();
+    }
+
+    bool succeeded = worker_engine->ConsumeSegmentEvents(
+        *file_header_, segment.header, segment.data,
+        segment.header.segment_length, kSegmentEvents);
+
+    base::AutoLock auto_lock(lock_);
+    free_workers_.push_back(worker_engine);
+    return succeeded;
+  }
+
+ private:
+  const TraceFileHeader* file_header_;
+  Segments* segments_;
+
+  // Protects free_workers_.
+  base::Lock lock_;
+  // The worker engines that no thread is dispatching to.
+  std::vector<ParseEngineRpc*> free_workers_;
+
+  DISALLOW_COPY_AND_ASSIGN(SegmentDispatcher);
+};
+
 ParseEngineRpc::ParseEngineRpc() : ParseEngine("RPC", true) {
 }
 
@@ -64,21 +182,64 @@ bool ParseEngineRpc::OpenTraceFile(const base::FilePath& trace_file_path) {
   return true;
 }
 
+bool ParseEngineRpc::OpenTraceStream(const base::FilePath& pipe_path) {
+  trace_stream_set_.push_back(pipe_path);
+  return true;
+}
+
 bool ParseEngineRpc::CloseAllTraceFiles() {
   trace_file_set_.clear();
+  trace_stream_set_.clear();
   return true;
 }
 
 bool ParseEngineRpc::ConsumeAllEvents() {
+  // When parsing in parallel, each parsing thread gets its own clone of the
+  // event handler, and an engine that dispatches the events to it.
+  if (parallel_event_handler_ != nullptr && thread_count_ > 1) {
+    for (size_t i = 0; i < thread_count_; ++i) {
+      clones_.push_back(parallel_event_handler_->CreateClone());
+      DCHECK(clones_.back().get() != nullptr);
+      workers_.push_back(
+          std::unique_ptr<ParseEngineRpc>(new ParseEngineRpc()));
+      workers_.back()->set_event_handler(clones_.back().get());
+    }
+  }
+
+  bool success = true;
   TraceFileIter it = trace_file_set_.begin();
   for (; it != trace_file_set_.end(); ++it) {
     if (!ConsumeTraceFile(*it)) {
       LOG(ERROR) << "Failed to consume '" << it->value() << "'.";
-      return false;
+      success = false;
+      break;
     }
   }
 
-  return true;
+  // The streams are consumed once the trace files are, one at a time.
+  it = trace_stream_set_.begin();
+  for (; success && it != trace_stream_set_.end(); ++it) {
+    if (!ConsumeTraceStream(*it)) {
+      LOG(ERROR) << "Failed to consume the stream of '" << it->value()
+                 << "'.";
+      success = false;
+    }
+  }
+
+  // Merge the clones back into the event handler, in a deterministic order.
+  for (size_t i = 0; success && i < clones_.size(); ++i) {
+    if (!parallel_event_handler_->MergeClone(clones_[i].get())) {
+      LOG(ERROR) << "Failed to merge the events of parsing thread " << i
+                 << ".";
+      success = false;
+    }
+  }
+
+  // The workers refer to the clones, so they go first.
+  workers_.clear();
+  clones_.clear();
+
+  return success;
 }
 
 bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
@@ -86,57 +247,62 @@ bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
 
   LOG(INFO) << "Processing '" << trace_file_path.BaseName().value() << "'.";
 
-  base::ScopedFILE trace_file(base::OpenFile(trace_file_path, "rb"));
-  if (!trace_file.get()) {
-    DWORD error = ::GetLastError();
-    LOG(ERROR) << "Unable to open '" << trace_file_path.value() << "': "
-               << ::common::LogWe(error) << ".";
+  TraceFileMapping trace_file(TraceFileMapping::kDefaultWindowSize);
+  if (!trace_file.Open(trace_file_path))
     return false;
-  }
 
-  // Let's reserve some space for the variable length header.
-  const size_t kReasonableHeaderSize = 4096;
-  std::vector<uint8_t> raw_buffer;
-  raw_buffer.reserve(kReasonableHeaderSize);
-  raw_buffer.resize(sizeof(TraceFileHeader));
+  return ConsumeTraceData(&trace_file, trace_file.length());
+}
+
+bool ParseEngineRpc::ConsumeTraceStream(const base::FilePath& pipe_path) {
+  DCHECK(!pipe_path.empty());
 
-  // Populate the buffer.
-  DCHECK_EQ(raw_buffer.size(), sizeof(TraceFileHeader));
-  size_t bytes_read = ::fread(&raw_buffer[0],
-                              1,
-                              raw_buffer.size(),
-                              trace_file.get());
-  if (bytes_read != raw_buffer.size()) {
+  TraceStream trace_stream;
+  if (!trace_stream.Open(pipe_path))
+    return false;
+
+  LOG(INFO) << "Processing the stream of '" << pipe_path.value() << "'.";
+  return ConsumeTraceData(&trace_stream, 0);
+}
+
+bool ParseEngineRpc::ConsumeTraceData(TraceDataSource* trace_file,
+                                      uint64_t file_length) {
+  DCHECK(trace_file != NULL);
+
+  scoped_refptr<TraceDataView> header_view;
+  const TraceFileHeader* mapped_header =
+      reinterpret_cast<const TraceFileHeader*>(
+          trace_file->GetData(0, sizeof(TraceFileHeader), &header_view));
+  if (mapped_header == NULL) {
     LOG(ERROR) << "Failed to read trace file header.";
     return false;
   }
 
-  // Create a typed alias to the raw buffer.
-  const TraceFileHeader* file_header =
-      reinterpret_cast<const TraceFileHeader*>(&raw_buffer[0]);
-
   // Check the file signature.
-  if (0 != memcmp(&file_header->signature,
+  if (0 != memcmp(&mapped_header->signature,
                   &TraceFileHeader::kSignatureValue,
-                  sizeof(file_header->signature))) {
+                  sizeof(mapped_header->signature))) {
     LOG(ERROR) << "Not a valid RPC call-trace file.";
     return false;
   }
 
-  // Make sure there's enough room for the variable length part of the header
-  // and then append read the rest of the header. Note that the underlying raw
-  // buffer might move when it is resized.
-  size_t bytes_to_read = file_header->header_size - raw_buffer.size();
-  raw_buffer.resize(file_header->header_size);
-  file_header = reinterpret_cast<const TraceFileHeader*>(&raw_buffer[0]);
-  bytes_read = ::fread(&raw_buffer[sizeof(TraceFileHeader)],
-                       1,
-                       bytes_to_read,
-                       trace_file.get());
-  if (bytes_read != bytes_to_read) {
+  // The header is used for the whole file, so it is copied rather than
+  // keeping its view around. This includes the variable length part of the
+  // header.
+  size_t header_size = mapped_header->header_size;
+  const uint8_t* header_data = NULL;
+  if (header_size >= sizeof(TraceFileHeader))
+    header_data = trace_file->GetData(0, header_size, &header_view);
+  if (header_data == NULL) {
     LOG(ERROR) << "Failed to read trace file header.";
     return false;
   }
+  std::vector<uint8_t> raw_buffer(header_data, header_data + header_size);
+  header_view = NULL;
+
+  // Create a typed alias to the raw buffer.
+  const TraceFileHeader* file_header =
+      reinterpret_cast<const TraceFileHeader*>(&raw_buffer[0]);
 
   // Populate the system information which will be fed to the OnProcessStarted
   // event.
@@ -156,6 +322,14 @@ bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
     return false;
   }
 
+  // The trace files of the other processes are skipped altogether.
+  if (file_length != 0 && filter_.process_id != 0 &&
+      filter_.process_id != file_header->process_id) {
+    LOG(INFO) << "Skipping the trace of process " << file_header->process_id
+              << ".";
+    return true;
+  }
+
   // Add the executable's module information to the process map. This is in
   // case the executable itself is instrumented, so that trace events will map
   // to a module in the process map.
@@ -173,71 +347,375 @@ bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
   event_handler_->OnProcessStarted(start_time, file_header->process_id,
                                    &system_info);
 
-  // Consume the body of the trace file.
-  uint64_t next_segment =
+  // Consume the body of the trace file. With a filter, the segments are
+  // located with the index of the trace file when it has one.
+  SegmentCursor cursor;
+  cursor.next_segment =
       AlignUp64(file_header->header_size, file_header->block_size);
-  std::unique_ptr<uint8_t[]> buffer;
-  size_t buffer_size = 0;
-  while (true) {
-    if (::_fseeki64(trace_file.get(), next_segment, SEEK_SET) != 0) {
-      LOG(ERROR) << "Failed to seek segment boundary " << next_segment << ".";
-      return false;
+  SegmentIndex index;
+  if (file_length != 0 && !filter_.IsEmpty() &&
+      ReadIndex(trace_file, *file_header, file_length, &index)) {
+    cursor.index = &index;
+  }
+
+  if (workers_.empty()) {
+    Segment segment;
+    while (true) {
+      bool end_of_file = false;
+      if (!ReadNextSegment(trace_file, *file_header, &cursor, &segment,
+                           &end_of_file)) {
+        return false;
+      }
+      if (end_of_file)
+        break;
+
+      if (!DecompressSegment(&segment))
+        return false;
+
+      // The other segments may depend on the module events of a segment
+      // outside of the filter, and the process ends with it.
+      if (segment.filtered_out) {
+        if (!ConsumeSegmentEvents(*file_header,
+                                  segment.header,
+                                  segment.data,
+                                  segment.header.segment_length,
+                                  kModuleEvents) ||
+            !ConsumeSegmentEvents(*file_header,
+                                  segment.header,
+                                  segment.data,
+                                  segment.header.segment_length,
+                                  kProcessEndedEvents)) {
+          return false;
+        }
+        continue;
+      }
+
+      if (!ConsumeSegmentEvents(*file_header,
+                                segment.header,
+                                segment.data,
+                                segment.header.segment_length,
+                                kAllEvents)) {
+        return false;
+      }
     }
 
-    RecordPrefix segment_prefix;
-    if (::fread(&segment_prefix,
-                sizeof(segment_prefix),
-                1,
-                trace_file.get()) != 1) {
-      if (::feof(trace_file.get()))
+    return true;
+  }
+
+  // When parsing in parallel, the segments are read in batches of a few per
+  // parsing thread. Only the last batch may be smaller.
+  Segments segments(workers_.size() * kSegmentsPerThread);
+  bool end_of_file = false;
+  while (!end_of_file) {
+    size_t segment_count = 0;
+    for (; segment_count < segments.size(); ++segment_count) {
+      if (!ReadNextSegment(trace_file, *file_header, &cursor,
+                           &segments[segment_count], &end_of_file)) {
+        return false;
+      }
+      if (end_of_file)
         break;
+    }
+
+    if (segment_count == 0)
+      break;
+    segments.resize(segment_count);
 
-      LOG(ERROR) << "Failed to read segment header prefix.";
+    if (!ConsumeSegments(*file_header, &segments))
       return false;
-    }
+  }
 
-    if (segment_prefix.type != TraceFileSegmentHeader::kTypeId ||
-        segment_prefix.size != sizeof(TraceFileSegmentHeader) ||
-        segment_prefix.version.hi != TRACE_VERSION_HI ||
-        segment_prefix.version.lo != TRACE_VERSION_LO) {
-      LOG(ERROR) << "Unrecognized record prefix for segment header.";
+  return true;
+}
+
+bool ParseEngineRpc::ReadIndex(TraceDataSource* trace_file,
+                               const TraceFileHeader& file_header,
+                               uint64_t file_length,
+                               SegmentIndex* index) {
+  DCHECK(trace_file != NULL);
+  DCHECK(index != NULL);
+
+  // The trace files that were written before the index, or whose session
+  // didn't close, have no trailer.
+  if (file_length < sizeof(TraceFileIndexTrailer))
+    return false;
+  scoped_refptr<TraceDataView> view;
+  const TraceFileIndexTrailer* trailer =
+      reinterpret_cast<const TraceFileIndexTrailer*>(trace_file->GetData(
+          file_length - sizeof(TraceFileIndexTrailer),
+          sizeof(TraceFileIndexTrailer), &view));
+  if (trailer == NULL ||
+      ::memcmp(&trailer->signature, &TraceFileIndexTrailer::kSignatureValue,
+               sizeof(trailer->signature)) != 0) {
+    LOG(INFO) << "The trace file has no index, reading all of its segments.";
+    return false;
+  }
+
+  // The index must lie between the header and the trailer.
+  const size_t kIndexHeaderLength =
+      sizeof(RecordPrefix) + sizeof(TraceFileIndexHeader);
+  uint64_t index_offset = trailer->index_offset;
+  uint32_t entry_count = trailer->entry_count;
+  uint64_t index_end = file_length - sizeof(TraceFileIndexTrailer);
+  if (index_offset <
+          AlignUp64(file_header.header_size, file_header.block_size) ||
+      index_offset + kIndexHeaderLength > index_end ||
+      entry_count > (index_end - index_offset - kIndexHeaderLength) /
+                        sizeof(TraceFileIndexEntry)) {
+    LOG(WARNING) << "Invalid trace file index trailer, reading all of the "
+                 << "segments.";
+    return false;
+  }
+
+  const RecordPrefix* prefix = reinterpret_cast<const RecordPrefix*>(
+      trace_file->GetData(index_offset, kIndexHeaderLength, &view));
+  size_t entries_length = entry_count * sizeof(TraceFileIndexEntry);
+  if (prefix == NULL || prefix->type != TraceFileIndexHeader::kTypeId ||
+      prefix->size != sizeof(TraceFileIndexHeader) + entries_length ||
+      reinterpret_cast<const TraceFileIndexHeader*>(prefix + 1)
+              ->entry_count != entry_count) {
+    LOG(WARNING) << "Invalid trace file index, reading all of the segments.";
+    return false;
+  }
+
+  index->clear();
+  if (entry_count == 0)
+    return true;
+
+  const TraceFileIndexEntry* entries =
+      reinterpret_cast<const TraceFileIndexEntry*>(trace_file->GetData(
+          index_offset + kIndexHeaderLength, entries_length, &view));
+  if (entries == NULL) {
+    LOG(WARNING) << "Failed to read the trace file index, reading all of the "
+                 << "segments.";
+    return false;
+  }
+  index->assign(entries, entries + entry_count);
+
+  return true;
+}
+
+bool ParseEngineRpc::ReadNextSegment(TraceDataSource* trace_file,
+                                     const TraceFileHeader& file_header,
+                                     SegmentCursor* cursor,
+                                     Segment* segment,
+                                     bool* end_of_file) {
+  DCHECK(cursor != NULL);
+  DCHECK(segment != NULL);
+  DCHECK(end_of_file != NULL);
+
+  // Without an index, only the thread of a segment is known before its
+  // events are read.
+  if (cursor->index == NULL) {
+    if (!ReadSegment(trace_file, file_header, &cursor->next_segment, segment,
+                     end_of_file)) {
       return false;
     }
+    segment->filtered_out = !*end_of_file && filter_.thread_id != 0 &&
+                            filter_.thread_id != segment->header.thread_id;
+    return true;
+  }
+
+  // The segments outside of the filter are skipped, unless they have events
+  // that the others depend on.
+  const uint32_t kNeededFlags = TraceFileIndexEntry::kHasModuleEvents |
+                                TraceFileIndexEntry::kHasProcessEnded;
+  while (cursor->next_entry < cursor->index->size()) {
+    const TraceFileIndexEntry& entry = (*cursor->index)[cursor->next_entry];
+    ++cursor->next_entry;
+
+    bool filtered_out = !SegmentIsInFilter(filter_, file_header, entry);
+    if (filtered_out && (entry.flags & kNeededFlags) == 0)
+      continue;
 
-    TraceFileSegmentHeader segment_header;
-    if (::fread(&segment_header,
-                sizeof(segment_header),
-                1,
-                trace_file.get()) != 1) {
-      LOG(ERROR) << "Failed to read segment header.";
+    uint64_t offset = entry.offset;
+    if (!ReadSegment(trace_file, file_header, &offset, segment, end_of_file))
+      return false;
+    if (*end_of_file || segment->header.thread_id != entry.thread_id) {
+      LOG(ERROR) << "The trace file index doesn't match its segments.";
       return false;
     }
+    segment->filtered_out = filtered_out;
+    return true;
+  }
+
+  *end_of_file = true;
+  return true;
+}
+
+bool ParseEngineRpc::ReadSegment(TraceDataSource* trace_file,
+                                 const TraceFileHeader& file_header,
+                                 uint64_t* next_segment,
+                                 Segment* segment,
+                                 bool* end_of_file) {
+  DCHECK(trace_file != NULL);
+  DCHECK(next_segment != NULL);
+  DCHECK(segment != NULL);
+  DCHECK(end_of_file != NULL);
+
+  *end_of_file = false;
+
+  // A partial segment header prefix at the end of the file marks its end, as
+  // the trailing block may not be filled.
+  uint64_t offset = *next_segment;
+  if (trace_file->EndsBefore(offset, sizeof(RecordPrefix))) {
+    *end_of_file = true;
+    return true;
+  }
+
+  const RecordPrefix* segment_prefix = reinterpret_cast<const RecordPrefix*>(
+      trace_file->GetData(offset, sizeof(RecordPrefix), &segment->view));
+  if (segment_prefix == NULL) {
+    LOG(ERROR) << "Failed to read segment header prefix.";
+    return false;
+  }
+  offset += sizeof(RecordPrefix);
+
+  if (segment_prefix->version.hi != TRACE_VERSION_HI ||
+      segment_prefix->version.lo != TRACE_VERSION_LO) {
+    LOG(ERROR) << "Unrecognized record prefix for segment header.";
+    return false;
+  }
+
+  // The index follows the last segment of a trace file.
+  if (segment_prefix->type == TraceFileIndexHeader::kTypeId) {
+    *end_of_file = true;
+    return true;
+  }
 
-    size_t aligned_size = AlignUp(segment_header.segment_length,
-                                  file_header->block_size);
+  // Compressed segments are decompressed before their events are consumed.
+  if (segment_prefix->type == TraceFileCompressedSegmentHeader::kTypeId &&
+      segment_prefix->size == sizeof(TraceFileCompressedSegmentHeader)) {
+    const TraceFileCompressedSegmentHeader* compressed_header =
+        reinterpret_cast<const TraceFileCompressedSegmentHeader*>(
+            trace_file->GetData(offset,
+                                sizeof(TraceFileCompressedSegmentHeader),
+                                &segment->view));
+    if (compressed_header == NULL) {
+      LOG(ERROR) << "Failed to read compressed segment header.";
+      return false;
+    }
+    offset += sizeof(TraceFileCompressedSegmentHeader);
 
-    if (aligned_size > buffer_size) {
-      buffer.reset(new uint8_t[aligned_size]);
-      buffer_size = aligned_size;
+    if (compressed_header->segment_length == 0 ||
+        compressed_header->compressed_length == 0) {
+      LOG(ERROR) << "Invalid compressed segment header.";
+      return false;
     }
 
-    if (::fread(buffer.get(), segment_header.segment_length, 1,
-                trace_file.get()) != 1) {
-      LOG(ERROR) << "Failed to read segment.";
+    segment->header.thread_id = compressed_header->thread_id;
+    segment->header.segment_length = compressed_header->segment_length;
+    segment->compressed_length = compressed_header->compressed_length;
+    segment->data = trace_file->GetData(offset, segment->compressed_length,
+                                        &segment->view);
+    if (segment->data == NULL) {
+      LOG(ERROR) << "Failed to read compressed segment.";
       return false;
     }
 
-    if (!ConsumeSegmentEvents(*file_header,
-                              segment_header,
-                              buffer.get(),
-                              segment_header.segment_length)) {
+    *next_segment = AlignUp64(offset + segment->compressed_length,
+                              file_header.block_size);
+    return true;
+  }
+
+  if (segment_prefix->type != TraceFileSegmentHeader::kTypeId ||
+      segment_prefix->size != sizeof(TraceFileSegmentHeader)) {
+    LOG(ERROR) << "Unrecognized record prefix for segment header.";
+    return false;
+  }
+
+  const TraceFileSegmentHeader* segment_header =
+      reinterpret_cast<const TraceFileSegmentHeader*>(trace_file->GetData(
+          offset, sizeof(TraceFileSegmentHeader), &segment->view));
+  if (segment_header == NULL) {
+    LOG(ERROR) << "Failed to read segment header.";
+    return false;
+  }
+  offset += sizeof(TraceFileSegmentHeader);
+
+  // The events are dispatched straight from the mapping.
+  segment->header = *segment_header;
+  segment->compressed_length = 0;
+  segment->data = trace_file->GetData(offset, segment->header.segment_length,
+                                      &segment->view);
+  if (segment->data == NULL || segment->header.segment_length == 0) {
+    LOG(ERROR) << "Failed to read segment.";
+    return false;
+  }
+
+  *next_segment = AlignUp64(offset + segment->header.segment_length,
+                            file_header.block_size);
+  return true;
+}
+
+bool ParseEngineRpc::DecompressSegment(Segment* segment) {
+  DCHECK(segment != NULL);
+
+  if (segment->compressed_length == 0)
+    return true;
+
+  segment->decompressed_data.resize(segment->header.segment_length);
+  uLongf length = segment->header.segment_length;
+  if (::uncompress(segment->decompressed_data.data(), &length,
+                   segment->data, segment->compressed_length) != Z_OK ||
+      length != segment->header.segment_length) {
+    LOG(ERROR) << "Failed to decompress segment.";
+    return false;
+  }
+
+  // The decompressed segment no longer needs its view.
+  segment->data = segment->decompressed_data.data();
+  segment->compressed_length = 0;
+  segment->view = NULL;
+  return true;
+}
+
+// static
+bool ParseEngineRpc::DecompressSegmentAt(Segments* segments, size_t index) {
+  DCHECK(segments != NULL);
+  return DecompressSegment(&(*segments)[index]);
+}
+
+bool ParseEngineRpc::ConsumeSegments(const TraceFileHeader& file_header,
+                                     Segments* segments) {
+  DCHECK(segments != NULL);
+  DCHECK(!workers_.empty());
+
+  application::WorkPool pool(workers_.size());
+  if (!pool.Run(segments->size(),
+                base::Bind(&ParseEngineRpc::DecompressSegmentAt, segments))) {
+    return false;
+  }
+
+  // The module events are dispatched first and in order, so that the module
+  // space of the process is complete when the parsing threads dispatch the
+  // other events. Unloaded modules stay in the module space, so the events
+  // that precede an unload in the batch still find their module.
+  for (Segment& segment : *segments) {
+    if (!ConsumeSegmentEvents(file_header,
+                              segment.header,
+                              segment.data,
+                              segment.header.segment_length,
+                              kModuleEvents)) {
       return false;
     }
+  }
 
-    next_segment = AlignUp64(
-        next_segment + sizeof(segment_prefix) + sizeof(segment_header) +
-            segment_header.segment_length,
-        file_header->block_size);
+  SegmentDispatcher dispatcher(this, &file_header, segments);
+  if (!pool.Run(segments->size(),
+                base::Bind(&SegmentDispatcher::Dispatch,
+                           base::Unretained(&dispatcher)))) {
+    return false;
+  }
+
+  for (Segment& segment : *segments) {
+    if (!ConsumeSegmentEvents(file_header,
+                              segment.header,
+                              segment.data,
+                              segment.header.segment_length,
+                              kProcessEndedEvents)) {
+      return false;
+    }
   }
 
   return true;
@@ -246,8 +724,9 @@ bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
 bool ParseEngineRpc::ConsumeSegmentEvents(
     const TraceFileHeader& file_header,
     const TraceFileSegmentHeader& segment_header,
-    uint8_t* buffer,
-    size_t buffer_length) {
+    const uint8_t* buffer,
+    size_t buffer_length,
+    EventFilter filter) {
   DCHECK(buffer != NULL);
   DCHECK(event_handler_ != NULL);
 
@@ -257,22 +736,35 @@ bool ParseEngineRpc::ConsumeSegmentEvents(
   event_record.Header.ThreadId = segment_header.thread_id;
   event_record.Header.Guid = kCallTraceEventClass;
 
-  uint8_t* read_ptr = buffer;
-  uint8_t* end_ptr = read_ptr + buffer_length;
+  const uint8_t* read_ptr = buffer;
+  const uint8_t* end_ptr = read_ptr + buffer_length;
 
   while (read_ptr < end_ptr) {
-    RecordPrefix* prefix = reinterpret_cast<RecordPrefix*>(read_ptr);
+    const RecordPrefix* prefix =
+        reinterpret_cast<const RecordPrefix*>(read_ptr);
     read_ptr += sizeof(RecordPrefix) + prefix->size;
     if (read_ptr > end_ptr) {
       // For batch-oriented records (where the record size is updated after
       // the record is initially written) there's a race condition between
       // updating the size of the segment and updating the number of items
       // in the batch record wherein the client process could be terminated
-      // leaving a truncated batch record.
-      LOG(WARNING) << "Encountered truncated record at end of segment.";
+      // leaving a truncated batch record. The segment events are consumed
+      // once per segment, so they are the ones that warn about it.
+      if (filter == kAllEvents || filter == kSegmentEvents)
+        LOG(WARNING) << "Encountered truncated record at end of segment.";
       continue;
     }
 
+    if (filter != kAllEvents) {
+      EventFilter event_filter = kSegmentEvents;
+      if (IsModuleEvent(prefix->type))
+        event_filter = kModuleEvents;
+      else if (prefix->type == TRACE_PROCESS_ENDED)
+        event_filter = kProcessEndedEvents;
+      if (event_filter != filter)
+        continue;
+    }
+
     event_record.Header.Class.Type = prefix->type;
 
     // The TimeStamp is interpreted as a FILETIME, so we convert the timer
@@ -282,7 +774,9 @@ bool ParseEngineRpc::ConsumeSegmentEvents(
         prefix->timestamp,
         reinterpret_cast<FILETIME*>(&event_record.Header.TimeStamp));
 
-    event_record.MofData = prefix + 1;
+    // The event data is handed out straight from the segment. The handlers
+    // only get const pointers to it.
+    event_record.MofData = const_cast<RecordPrefix*>(prefix + 1);
     event_record.MofLength = prefix->size;
     if (!DispatchEvent(&event_record)) {
       LOG(ERROR) << "Failed to process event of type " << prefix->type << ".";
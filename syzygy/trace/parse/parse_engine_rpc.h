@@ -17,9 +17,13 @@
 #ifndef SYZYGY_TRACE_PARSE_PARSE_ENGINE_RPC_H_
 #define SYZYGY_TRACE_PARSE_PARSE_ENGINE_RPC_H_
 
+#include <memory>
+#include <vector>
+
 #include "base/files/file_path.h"
 #include "base/time/time.h"
 #include "syzygy/trace/parse/parse_engine.h"
+#include "syzygy/trace/parse/trace_data_source.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 
 namespace trace {
@@ -35,6 +39,7 @@ class ParseEngineRpc : public ParseEngine {
   virtual bool IsRecognizedTraceFile(
       const base::FilePath& trace_file_path) override;
   virtual bool OpenTraceFile(const base::FilePath& trace_file_path) override;
+  virtual bool OpenTraceStream(const base::FilePath& pipe_path) override;
   virtual bool ConsumeAllEvents() override;
   virtual bool CloseAllTraceFiles() override;
   // @}
@@ -46,28 +51,169 @@ class ParseEngineRpc : public ParseEngine {
   // An iterator over a set of trace file paths.
   typedef TraceFileSet::iterator TraceFileIter;
 
+  // A segment read from a trace file.
+  struct Segment {
+    Segment()
+        : header(), data(NULL), compressed_length(0), filtered_out(false) {}
+
+    // The header of the segment, with the length of the uncompressed data.
+    TraceFileSegmentHeader header;
+    // The data of the segment. This points into the view of the trace file,
+    // or into decompressed_data once a compressed segment is decompressed.
+    const uint8_t* data;
+    // The length of the data of a segment that remains to be decompressed,
+    // or zero.
+    size_t compressed_length;
+    // The view of the trace file that contains the data.
+    scoped_refptr<TraceDataView> view;
+    std::vector<uint8_t> decompressed_data;
+    // Whether the segment is outside of the filter, in which case only its
+    // module events and its process ended event are dispatched.
+    bool filtered_out;
+  };
+  typedef std::vector<Segment> Segments;
+
+  // The index of the segments of a trace file.
+  typedef std::vector<TraceFileIndexEntry> SegmentIndex;
+
+  // The position of the next segment to read from a trace. This is the
+  // offset of the segment or, when the index of the trace is used, the next
+  // entry of the index.
+  struct SegmentCursor {
+    SegmentCursor() : next_segment(0), index(NULL), next_entry(0) {}
+
+    uint64_t next_segment;
+    const SegmentIndex* index;
+    size_t next_entry;
+  };
+
+  // The events dispatched by ConsumeSegmentEvents. When parsing in parallel,
+  // the module events of a batch of segments are dispatched to the event
+  // handler in order, then the parsing threads dispatch the segment events of
+  // the batch to the clones, and finally the process ended events of the
+  // batch are dispatched to the event handler.
+  enum EventFilter {
+    kAllEvents,
+    // The process and thread attach and detach events, which change the
+    // module space of the process.
+    kModuleEvents,
+    // All of the other events except TRACE_PROCESS_ENDED.
+    kSegmentEvents,
+    kProcessEndedEvents,
+  };
+
+  // Dispatches the segment events of a batch on the parsing threads.
+  class SegmentDispatcher;
+
   // Dispatches all of the events contained in the given trace file.
+  // @returns true on success
+  bool ConsumeTraceFile(const base::FilePath& trace_file_path);
+
+  // Waits for a session to connect to the given pipe, and dispatches all of
+  // the events that it streams until it disconnects.
+  // @returns true on success
+  bool ConsumeTraceStream(const base::FilePath& pipe_path);
+
+  // Dispatches all of the events contained in the given trace data.
   //
-  // For each segment in the trace file calls ConsumeSegmentEvents().
+  // For each segment in the trace calls ConsumeSegmentEvents(), or
+  // ConsumeSegments() for each batch of segments when parsing in parallel.
+  // With a filter, the segments of a trace file are read from its index, if
+  // it has one, so that those outside of the filter are skipped.
   //
+  // @param trace_file the data of the trace, in the format of a trace file.
+  // @param file_length the length of the trace file, or zero for a stream,
+  //     which can't be seeked and is consumed in full.
   // @returns true on success
-  bool ConsumeTraceFile(const base::FilePath& trace_file_path);
+  bool ConsumeTraceData(TraceDataSource* trace_file, uint64_t file_length);
+
+  // Reads the index of a trace file.
+  // @param trace_file the data of the trace file.
+  // @param file_header the header of the trace file.
+  // @param file_length the length of the trace file.
+  // @param index receives the index.
+  // @returns true if the trace file has a valid index, false otherwise.
+  bool ReadIndex(TraceDataSource* trace_file,
+                 const TraceFileHeader& file_header,
+                 uint64_t file_length,
+                 SegmentIndex* index);
+
+  // Reads the next segment of a trace that is needed by the filter, and
+  // advances @p cursor past it.
+  // @param trace_file the data of the trace.
+  // @param file_header the header of the trace.
+  // @param cursor the position of the next segment to read.
+  // @param segment receives the segment, as with ReadSegment.
+  // @param end_of_file is set to true if there are no more segments.
+  // @returns true on success, false otherwise.
+  bool ReadNextSegment(TraceDataSource* trace_file,
+                       const TraceFileHeader& file_header,
+                       SegmentCursor* cursor,
+                       Segment* segment,
+                       bool* end_of_file);
+
+  // Reads the next segment of a trace file.
+  // @param trace_file the data of the trace file.
+  // @param file_header the header of the trace file.
+  // @param next_segment the offset of the segment to read. This is advanced
+  //     to the offset of the following segment.
+  // @param segment receives the segment, which isn't decompressed. Its data
+  //     points into a view of the trace file.
+  // @param end_of_file is set to true if there are no more segments, which is
+  //     the case at the end of the trace or at its index.
+  // @returns true on success, false otherwise.
+  bool ReadSegment(TraceDataSource* trace_file,
+                   const TraceFileHeader& file_header,
+                   uint64_t* next_segment,
+                   Segment* segment,
+                   bool* end_of_file);
+
+  // Decompresses a segment into its own buffer. This does nothing if the
+  // segment isn't compressed.
+  // @param segment the segment to decompress.
+  // @returns true on success, false otherwise.
+  static bool DecompressSegment(Segment* segment);
 
-  // Dispatches all of the events in the given segment buffer.
+  // Decompresses the segment at @p index of @p segments. This is called
+  // concurrently for different segments by the parsing threads.
+  // @param segments the segments of the batch.
+  // @param index the index of the segment to decompress.
+  // @returns true on success, false otherwise.
+  static bool DecompressSegmentAt(Segments* segments, size_t index);
+
+  // Dispatches the events of a batch of segments, using the parsing threads.
+  // @param file_header the header information describing the trace file.
+  // @param segments the segments to consume. They are decompressed first.
+  // @returns true on success, false otherwise.
+  bool ConsumeSegments(const TraceFileHeader& file_header, Segments* segments);
+
+  // Dispatches the events in the given segment buffer.
   //
   // @param file_header the header information describing the trace file.
   // @param segment_header the header information describing the segment.
   // @param buffer the full segment data buffer.
   // @param buffer_length the length of the segment data buffer (in bytes).
+  // @param filter the events to dispatch.
   // @return true on success.
   bool ConsumeSegmentEvents(const TraceFileHeader& file_header,
                             const TraceFileSegmentHeader& segment_header,
-                            uint8_t* buffer,
-                            size_t buffer_length);
+                            const uint8_t* buffer,
+                            size_t buffer_length,
+                            EventFilter filter);
 
   // The set of trace files to consume when ConsumeAllEvents() is called.
   TraceFileSet trace_file_set_;
 
+  // The pipes from which to consume a stream each, once the trace files have
+  // been consumed. A pipe that appears several times is used for as many
+  // streams.
+  TraceFileSet trace_stream_set_;
+
+  // When parsing in parallel, the clones of the event handler and the engines
+  // that dispatch the events to them, one of each per parsing thread.
+  std::vector<std::unique_ptr<ParseEventHandler>> clones_;
+  std::vector<std::unique_ptr<ParseEngineRpc>> workers_;
+
   DISALLOW_COPY_AND_ASSIGN(ParseEngineRpc);
 };
 
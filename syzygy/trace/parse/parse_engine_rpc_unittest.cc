@@ -38,13 +38,17 @@
 #include "syzygy/pe/unittest_util.h"
 #include "syzygy/trace/common/unittest_util.h"
 #include "syzygy/trace/parse/parser.h"
+#include "syzygy/common/align.h"
 #include "syzygy/trace/service/process_info.h"
+#include "syzygy/trace/service/trace_file_writer.h"
 
 namespace trace {
 namespace service {
 namespace {
 
+using ::trace::parser::ParallelParseEventHandler;
 using ::trace::parser::Parser;
+using ::trace::parser::ParseEventHandler;
 using ::trace::parser::ParseEventHandlerImpl;
 
 static const uint32_t kConstantInThisModule = 0;
@@ -231,6 +235,50 @@ class TestParseEventHandler : public ParseEventHandlerImpl {
   OrderedCalls ordered_calls_;
 };
 
+// Counts the entry events, and can be fed by several parsing threads.
+class CountingParseEventHandler : public ParseEventHandlerImpl,
+                                  public ParallelParseEventHandler {
+ public:
+  CountingParseEventHandler()
+      : process_started_count_(0), entry_count_(0), clone_count_(0) {
+  }
+
+  void OnProcessStarted(base::Time time,
+                        DWORD process_id,
+                        const TraceSystemInfo* data) override {
+    ++process_started_count_;
+  }
+
+  void OnFunctionEntry(base::Time time,
+                       DWORD process_id,
+                       DWORD thread_id,
+                       const TraceEnterExitEventData* data) override {
+    ++entry_count_;
+  }
+
+  std::unique_ptr<ParseEventHandler> CreateClone() override {
+    ++clone_count_;
+    return std::unique_ptr<ParseEventHandler>(new CountingParseEventHandler());
+  }
+
+  bool MergeClone(ParseEventHandler* clone) override {
+    CountingParseEventHandler* counting_clone =
+        static_cast<CountingParseEventHandler*>(clone);
+    process_started_count_ += counting_clone->process_started_count_;
+    entry_count_ += counting_clone->entry_count_;
+    return true;
+  }
+
+  size_t process_started_count() const { return process_started_count_; }
+  size_t entry_count() const { return entry_count_; }
+  size_t clone_count() const { return clone_count_; }
+
+ private:
+  size_t process_started_count_;
+  size_t entry_count_;
+  size_t clone_count_;
+};
+
 const wchar_t* const kTestSessionName = L"TestLogSession";
 
 typedef BOOL (WINAPI *DllMainFunc)(HMODULE module,
@@ -239,12 +287,19 @@ typedef BOOL (WINAPI *DllMainFunc)(HMODULE module,
 
 extern const DllMainFunc IndirectThunkDllMain;
 
+void IndirectFunctionA();
+
 // We run events through a file session to assert that
 // the content comes through.
 class ParseEngineRpcTest: public testing::PELibUnitTest {
  public:
   typedef testing::PELibUnitTest Super;
 
+  // The TSC ticks between the events of the trace files that are written by
+  // WriteIndirectFunctionATraceFile. This is far more than the resolution of
+  // the times of the events.
+  static const uint64_t kTimestampStep = 1000000;
+
   ParseEngineRpcTest() : module_(NULL) {
   }
 
@@ -283,6 +338,77 @@ class ParseEngineRpcTest: public testing::PELibUnitTest {
     service_.Stop();
   }
 
+  // Writes a trace file whose segments each contain the same entry event
+  // many times over, which compresses well. The segments are reported by
+  // @p thread_count threads in turn, starting with the current thread, and
+  // the timestamp of each event is its index in the trace file times
+  // kTimestampStep.
+  // @param trace_file_path the trace file to write.
+  // @param segment_count the number of segments to write.
+  // @param calls_per_segment the number of entry events in each segment.
+  // @param thread_count the number of threads that report the segments.
+  void WriteIndirectFunctionATraceFile(const base::FilePath& trace_file_path,
+                                       size_t segment_count,
+                                       size_t calls_per_segment,
+                                       size_t thread_count) {
+    ProcessInfo process_info;
+    ASSERT_TRUE(process_info.Initialize(::GetCurrentProcessId()));
+
+    TraceFileWriter writer;
+    ASSERT_TRUE(writer.Open(trace_file_path));
+    ASSERT_TRUE(writer.WriteHeader(process_info));
+    writer.EnableCompression(2);
+
+    const size_t kEventLength =
+        sizeof(RecordPrefix) + sizeof(TraceEnterEventData);
+    const size_t segment_length = calls_per_segment * kEventLength;
+    std::vector<uint8_t> segment(::common::AlignUp(
+        sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader) + segment_length,
+        writer.block_size()));
+
+    RecordPrefix* prefix = reinterpret_cast<RecordPrefix*>(segment.data());
+    prefix->type = TraceFileSegmentHeader::kTypeId;
+    prefix->size = sizeof(TraceFileSegmentHeader);
+    prefix->version.hi = TRACE_VERSION_HI;
+    prefix->version.lo = TRACE_VERSION_LO;
+    TraceFileSegmentHeader* header =
+        reinterpret_cast<TraceFileSegmentHeader*>(prefix + 1);
+    header->thread_id = ::GetCurrentThreadId();
+    header->segment_length = segment_length;
+
+    uint8_t* event = reinterpret_cast<uint8_t*>(header + 1);
+    for (size_t i = 0; i < calls_per_segment; ++i) {
+      RecordPrefix* event_prefix = reinterpret_cast<RecordPrefix*>(event);
+      event_prefix->type = TRACE_ENTER_EVENT;
+      event_prefix->size = sizeof(TraceEnterEventData);
+      event_prefix->version.hi = TRACE_VERSION_HI;
+      event_prefix->version.lo = TRACE_VERSION_LO;
+      TraceEnterEventData* data =
+          reinterpret_cast<TraceEnterEventData*>(event_prefix + 1);
+      data->function = reinterpret_cast<FuncAddr>(&IndirectFunctionA);
+      event += kEventLength;
+    }
+
+    std::vector<std::vector<uint8_t>> segments(segment_count, segment);
+    TraceFileWriter::Records records;
+    for (size_t i = 0; i < segment_count; ++i) {
+      uint8_t* data = segments[i].data();
+      reinterpret_cast<TraceFileSegmentHeader*>(data + sizeof(RecordPrefix))
+          ->thread_id = ::GetCurrentThreadId() + i % thread_count;
+      event = data + sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+      for (size_t j = 0; j < calls_per_segment; ++j) {
+        reinterpret_cast<RecordPrefix*>(event)->timestamp =
+            (i * calls_per_segment + j) * kTimestampStep;
+        event += kEventLength;
+      }
+
+      TraceFileWriter::Record record = { data, segments[i].size() };
+      records.push_back(record);
+    }
+    ASSERT_TRUE(writer.WriteRecords(records));
+    ASSERT_TRUE(writer.Close());
+  }
+
   void ConsumeEventsFromTempSession() {
     // Stop the call trace service to ensure all buffers have been flushed.
     ASSERT_NO_FATAL_FAILURE(StopCallTraceService());
@@ -802,5 +928,121 @@ TEST_F(ParseEngineRpcTest, MultiThreadWithStopCallTrace) {
   ASSERT_EQ(77, entered_addresses_.count(IndirectFunctionB));
 }
 
+TEST_F(ParseEngineRpcTest, CompressedSegments) {
+  base::FilePath trace_file_path = temp_dir_.Append(L"trace-compressed.bin");
+  const size_t kSegmentCount = 3;
+  const size_t kCallsPerSegment = 1000;
+  ASSERT_NO_FATAL_FAILURE(WriteIndirectFunctionATraceFile(
+      trace_file_path, kSegmentCount, kCallsPerSegment, 1));
+
+  // The parser decompresses the segments transparently.
+  TestParseEventHandler consumer;
+  Parser parser;
+  ASSERT_TRUE(parser.Init(&consumer));
+  ASSERT_TRUE(parser.OpenTraceFile(trace_file_path));
+  ASSERT_TRUE(parser.Consume());
+
+  consumer.GetEnteredAddresses(&entered_addresses_);
+  EXPECT_EQ(kSegmentCount * kCallsPerSegment, entered_addresses_.size());
+  EXPECT_EQ(kSegmentCount * kCallsPerSegment,
+            entered_addresses_.count(IndirectFunctionA));
+}
+
+TEST_F(ParseEngineRpcTest, ParallelParse) {
+  base::FilePath trace_file_path = temp_dir_.Append(L"trace-parallel.bin");
+
+  // More segments than fit in a batch, so that the last batch is partial.
+  const size_t kSegmentCount = 37;
+  const size_t kCallsPerSegment = 100;
+  ASSERT_NO_FATAL_FAILURE(WriteIndirectFunctionATraceFile(
+      trace_file_path, kSegmentCount, kCallsPerSegment, 1));
+
+  CountingParseEventHandler consumer;
+  Parser parser;
+  ASSERT_TRUE(parser.Init(&consumer));
+  parser.EnableParallelParse(&consumer, 4);
+  ASSERT_TRUE(parser.OpenTraceFile(trace_file_path));
+  ASSERT_TRUE(parser.Consume());
+
+  // Each parsing thread had its own clone, and the clones were merged. The
+  // process started event went to the handler itself.
+  EXPECT_EQ(4u, consumer.clone_count());
+  EXPECT_EQ(1u, consumer.process_started_count());
+  EXPECT_EQ(kSegmentCount * kCallsPerSegment, consumer.entry_count());
+}
+
+TEST_F(ParseEngineRpcTest, FilterByThread) {
+  base::FilePath trace_file_path = temp_dir_.Append(L"trace-threads.bin");
+  const size_t kSegmentCount = 9;
+  const size_t kCallsPerSegment = 10;
+  ASSERT_NO_FATAL_FAILURE(WriteIndirectFunctionATraceFile(
+      trace_file_path, kSegmentCount, kCallsPerSegment, 3));
+
+  // Only the segments of the second thread are dispatched, sequentially and
+  // in parallel.
+  trace::parser::TraceFilter filter;
+  filter.thread_id = ::GetCurrentThreadId() + 1;
+  for (size_t thread_count = 1; thread_count <= 2; ++thread_count) {
+    CountingParseEventHandler consumer;
+    Parser parser;
+    ASSERT_TRUE(parser.Init(&consumer));
+    parser.EnableParallelParse(&consumer, thread_count);
+    parser.SetFilter(filter);
+    ASSERT_TRUE(parser.OpenTraceFile(trace_file_path));
+    ASSERT_TRUE(parser.Consume());
+
+    EXPECT_EQ(1u, consumer.process_started_count());
+    EXPECT_EQ(3 * kCallsPerSegment, consumer.entry_count());
+  }
+
+  // The trace files of other processes are skipped.
+  filter.process_id = ::GetCurrentProcessId() + 1;
+  CountingParseEventHandler consumer;
+  Parser parser;
+  ASSERT_TRUE(parser.Init(&consumer));
+  parser.SetFilter(filter);
+  ASSERT_TRUE(parser.OpenTraceFile(trace_file_path));
+  ASSERT_TRUE(parser.Consume());
+  EXPECT_EQ(0u, consumer.process_started_count());
+  EXPECT_EQ(0u, consumer.entry_count());
+}
+
+TEST_F(ParseEngineRpcTest, FilterByTime) {
+  base::FilePath trace_file_path = temp_dir_.Append(L"trace-times.bin");
+  const size_t kSegmentCount = 5;
+  const size_t kCallsPerSegment = 10;
+  ASSERT_NO_FATAL_FAILURE(WriteIndirectFunctionATraceFile(
+      trace_file_path, kSegmentCount, kCallsPerSegment, 1));
+
+  // The timestamps of the events are converted with the clock of the trace
+  // file.
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(trace_file_path, &contents));
+  ASSERT_LE(sizeof(TraceFileHeader), contents.size());
+  const TraceFileHeader* header =
+      reinterpret_cast<const TraceFileHeader*>(contents.data());
+  FILETIME start_time = {};
+  FILETIME end_time = {};
+  ASSERT_TRUE(trace::common::TscToFileTime(
+      header->clock_info, (kCallsPerSegment + 1) * kTimestampStep,
+      &start_time));
+  ASSERT_TRUE(trace::common::TscToFileTime(
+      header->clock_info, (3 * kCallsPerSegment - 1) * kTimestampStep,
+      &end_time));
+
+  // The range overlaps the second and the third segments, which are
+  // dispatched in full.
+  trace::parser::TraceFilter filter;
+  filter.start_time = base::Time::FromFileTime(start_time);
+  filter.end_time = base::Time::FromFileTime(end_time);
+  CountingParseEventHandler consumer;
+  Parser parser;
+  ASSERT_TRUE(parser.Init(&consumer));
+  parser.SetFilter(filter);
+  ASSERT_TRUE(parser.OpenTraceFile(trace_file_path));
+  ASSERT_TRUE(parser.Consume());
+  EXPECT_EQ(2 * kCallsPerSegment, consumer.entry_count());
+}
+
 }  // namespace service
 }  // namespace trace
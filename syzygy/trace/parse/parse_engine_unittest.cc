@@ -31,6 +31,9 @@
 namespace {
 
 using testing::_;
+using testing::AllOf;
+using testing::Field;
+using testing::Pointee;
 using trace::parser::Parser;
 using trace::parser::ParseEngine;
 using trace::parser::ParseEventHandler;
@@ -47,7 +50,8 @@ class ParseEngineUnitTest
   ParseEngineUnitTest()
       : ParseEngine("Test", true),
         basic_block_frequencies(0),
-        expected_data(NULL) {
+        expected_data(NULL),
+        batch_is_decoded(false) {
     ::memset(&event_record_, 0, sizeof(event_record_));
     set_event_handler(this);
   }
@@ -123,9 +127,12 @@ class ParseEngineUnitTest
                             const TraceBatchEnterData* data) override {
     ASSERT_EQ(process_id, kProcessId);
     ASSERT_EQ(thread_id, kThreadId);
-    ASSERT_TRUE(reinterpret_cast<const void*>(data) == expected_data);
+    ASSERT_EQ(kThreadId, data->thread_id);
+    if (!batch_is_decoded)
+      ASSERT_TRUE(reinterpret_cast<const void*>(data) == expected_data);
     for (size_t i = 0; i < data->num_calls; ++i) {
       function_entries.insert(data->calls[i].function);
+      return_addresses.push_back(data->calls[i].retaddr);
     }
   }
 
@@ -222,6 +229,15 @@ class ParseEngineUnitTest
                void(base::Time time,
                     DWORD process_id,
                     const TraceProcessHeap* data));
+  MOCK_METHOD4(OnInvocationSampling,
+               void(base::Time time,
+                    DWORD process_id,
+                    DWORD thread_id,
+                    const TraceInvocationSampling* data));
+  MOCK_METHOD3(OnSampleStack,
+               void(base::Time time,
+                    DWORD process_id,
+                    const TraceSampleStack* data));
 
   static const DWORD kProcessId;
   static const DWORD kThreadId;
@@ -240,8 +256,13 @@ class ParseEngineUnitTest
   ModuleSet thread_attaches;
   ModuleSet thread_detaches;
   size_t basic_block_frequencies;
+  std::vector<RetAddr> return_addresses;
 
   const void* expected_data;
+
+  // Set when the batch entry events are decoded from a compact encoding, so
+  // they aren't dispatched from |expected_data|.
+  bool batch_is_decoded;
 };
 
 const DWORD ParseEngineUnitTest::kProcessId = 0xAAAAAAAA;
@@ -496,6 +517,66 @@ TEST_F(ParseEngineUnitTest, BatchFunctionEntry) {
   ASSERT_TRUE(error_occurred());
 }
 
+TEST_F(ParseEngineUnitTest, CompactBatchFunctionEntry) {
+  // Appends the zigzag LEB128 encoded delta from |previous| to |value|.
+  auto append_delta = [](const void* previous, const void* value,
+                         std::vector<uint8_t>* data) {
+    int32_t delta = static_cast<int32_t>(reinterpret_cast<uintptr_t>(value) -
+                                         reinterpret_cast<uintptr_t>(previous));
+    uint32_t zigzag = (static_cast<uint32_t>(delta) << 1) ^
+                      static_cast<uint32_t>(delta >> 31);
+    do {
+      uint8_t byte = zigzag & 0x7F;
+      zigzag >>= 7;
+      data->push_back(zigzag != 0 ? byte | 0x80 : byte);
+    } while (zigzag != 0);
+  };
+
+  const FuncAddr kFunctions[] = {&TestFunc1, &TestFunc2, &TestFunc1};
+  const RetAddr kRetAddrs[] = {
+      reinterpret_cast<RetAddr>(0x1000),
+      reinterpret_cast<RetAddr>(0x0FF0),
+      reinterpret_cast<RetAddr>(0x40000)};
+  std::vector<uint8_t> calls;
+  const void* function = nullptr;
+  const void* retaddr = nullptr;
+  for (size_t i = 0; i < arraysize(kFunctions); ++i) {
+    append_delta(function, kFunctions[i], &calls);
+    append_delta(retaddr, kRetAddrs[i], &calls);
+    function = kFunctions[i];
+    retaddr = kRetAddrs[i];
+  }
+
+  std::vector<uint8_t> buffer(
+      FIELD_OFFSET(TraceCompactBatchEnterData, call_data) + calls.size());
+  TraceCompactBatchEnterData* data =
+      reinterpret_cast<TraceCompactBatchEnterData*>(buffer.data());
+  data->num_calls = arraysize(kFunctions);
+  data->call_data_size = calls.size();
+  ::memcpy(data->call_data, calls.data(), calls.size());
+
+  batch_is_decoded = true;
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_COMPACT_BATCH_ENTER, data, buffer.size()));
+  ASSERT_FALSE(error_occurred());
+  EXPECT_EQ(2u, function_entries.count(&TestFunc1));
+  EXPECT_EQ(1u, function_entries.count(&TestFunc2));
+  EXPECT_EQ(std::vector<RetAddr>(kRetAddrs, kRetAddrs + arraysize(kRetAddrs)),
+            return_addresses);
+
+  // A truncated record makes the parser error.
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_COMPACT_BATCH_ENTER, data, buffer.size() - 1));
+  ASSERT_TRUE(error_occurred());
+
+  // So does a count of calls that doesn't fit in the call data.
+  set_error_occurred(false);
+  data->num_calls = data->call_data_size;
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_COMPACT_BATCH_ENTER, data, buffer.size()));
+  ASSERT_TRUE(error_occurred());
+}
+
 TEST_F(ParseEngineUnitTest, ProcessAttachIncomplete) {
   TraceModuleData incomplete(kModuleData);
   incomplete.module_base_addr = NULL;
@@ -715,6 +796,29 @@ TEST_F(ParseEngineUnitTest, StackTrace) {
   ASSERT_TRUE(error_occurred());
 }
 
+TEST_F(ParseEngineUnitTest, SampleStack) {
+  char buffer[FIELD_OFFSET(TraceSampleStack, frames) +
+      sizeof(void*) * 3] = {};
+  TraceSampleStack* data = reinterpret_cast<TraceSampleStack*>(buffer);
+
+  data->sampling_interval = 1000;
+  data->sample_count = 7;
+  data->num_frames = 3;
+  data->frames[0] = reinterpret_cast<void*>(0xDEADBEEF);
+  data->frames[1] = reinterpret_cast<void*>(0x900DF00D);
+  data->frames[2] = reinterpret_cast<void*>(0xCAFEBABE);
+
+  EXPECT_CALL(*this, OnSampleStack(_, kProcessId, data));
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_SAMPLE_STACK, data, sizeof(buffer)));
+  ASSERT_FALSE(error_occurred());
+
+  // Dispatch a malformed record and make sure the parser errors.
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_SAMPLE_STACK, data, sizeof(buffer) - 1));
+  ASSERT_TRUE(error_occurred());
+}
+
 TEST_F(ParseEngineUnitTest, DetailedFunctionCall) {
   const uint8_t kDummyArguments[] = {
       0x02,
@@ -756,6 +860,59 @@ TEST_F(ParseEngineUnitTest, DetailedFunctionCall) {
   ASSERT_TRUE(error_occurred());
 }
 
+TEST_F(ParseEngineUnitTest, CompactFunctionCalls) {
+  const uint8_t kDummyCalls[] = {
+      0x00,  // Call 0: timestamp delta 0.
+      0x25,  // Function ID 37.
+      0x00,  // Stack trace ID 0.
+      0x02,  // 2 arguments.
+      0x04,  // Argument 0 length 4.
+      0x01,  // Argument 1 length 1.
+      0x20,  // Argument 0: 0x10, zigzag encoded.
+      'A',   // Argument 1: 'A'.
+      0x80,
+      0x01,  // Call 1: timestamp delta 128.
+      0x01,  // Function ID 1.
+      0x00,  // Stack trace ID 0.
+      0x01,  // 1 argument.
+      0x04,  // Argument 0 length 4.
+      0x01,  // Argument 0: 0x10 - 1, zigzag encoded.
+  };
+  char buffer[FIELD_OFFSET(TraceCompactFunctionCalls, call_data) +
+      arraysize(kDummyCalls)] = {};
+  TraceCompactFunctionCalls* data =
+      reinterpret_cast<TraceCompactFunctionCalls*>(buffer);
+
+  data->base_timestamp = 0x0102030405060708;
+  data->num_calls = 2;
+  data->call_data_size = arraysize(kDummyCalls);
+  ::memcpy(data->call_data, kDummyCalls, arraysize(kDummyCalls));
+
+  // Number of arguments, sizes of arguments, contents of arguments.
+  const size_t kArgumentDataSize0 = 3 * sizeof(uint32_t) + 4 + 1;
+  const size_t kArgumentDataSize1 = 2 * sizeof(uint32_t) + 4;
+  EXPECT_CALL(*this, OnDetailedFunctionCall(_, kProcessId, kThreadId,
+      AllOf(Field(&TraceDetailedFunctionCall::timestamp,
+                  0x0102030405060708),
+            Field(&TraceDetailedFunctionCall::function_id, 37u),
+            Field(&TraceDetailedFunctionCall::argument_data_size,
+                  kArgumentDataSize0))));
+  EXPECT_CALL(*this, OnDetailedFunctionCall(_, kProcessId, kThreadId,
+      AllOf(Field(&TraceDetailedFunctionCall::timestamp,
+                  0x0102030405060788),
+            Field(&TraceDetailedFunctionCall::function_id, 1u),
+            Field(&TraceDetailedFunctionCall::argument_data_size,
+                  kArgumentDataSize1))));
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_COMPACT_FUNCTION_CALLS, data, sizeof(buffer)));
+  ASSERT_FALSE(error_occurred());
+
+  // Dispatch a malformed record and make sure the parser errors.
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_COMPACT_FUNCTION_CALLS, data, sizeof(buffer) - 1));
+  ASSERT_TRUE(error_occurred());
+}
+
 TEST_F(ParseEngineUnitTest, Comment) {
   const char kDummyComment[] = "This is a comment!";
   char buffer[FIELD_OFFSET(TraceComment, comment) +
@@ -791,4 +948,19 @@ TEST_F(ParseEngineUnitTest, ProcessHeap) {
   ASSERT_TRUE(error_occurred());
 }
 
+TEST_F(ParseEngineUnitTest, InvocationSampling) {
+  TraceInvocationSampling sampling = {16};
+
+  EXPECT_CALL(*this,
+              OnInvocationSampling(_, kProcessId, kThreadId, &sampling));
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(TRACE_INVOCATION_SAMPLING,
+                                            &sampling, sizeof(sampling)));
+  ASSERT_FALSE(error_occurred());
+
+  // Dispatch a malformed record and make sure the parser errors.
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(TRACE_INVOCATION_SAMPLING,
+                                            &sampling, sizeof(sampling) - 1));
+  ASSERT_TRUE(error_occurred());
+}
+
 }  // namespace
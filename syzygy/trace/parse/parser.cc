@@ -67,6 +67,23 @@ bool Parser::Init(ParseEventHandler* event_handler) {
   return true;
 }
 
+void Parser::EnableParallelParse(
+    ParallelParseEventHandler* parallel_event_handler,
+    size_t thread_count) {
+  DCHECK(parallel_event_handler != NULL);
+  DCHECK_LT(0u, thread_count);
+
+  ParseEngineIter it = parse_engine_set_.begin();
+  for (; it != parse_engine_set_.end(); ++it)
+    (*it)->set_parallel_event_handler(parallel_event_handler, thread_count);
+}
+
+void Parser::SetFilter(const TraceFilter& filter) {
+  ParseEngineIter it = parse_engine_set_.begin();
+  for (; it != parse_engine_set_.end(); ++it)
+    (*it)->set_filter(filter);
+}
+
 bool Parser::error_occurred() const {
   DCHECK(active_parse_engine_ != NULL);
   return active_parse_engine_->error_occurred();
@@ -88,6 +105,27 @@ bool Parser::OpenTraceFile(const base::FilePath& trace_file_path) {
   return active_parse_engine_->OpenTraceFile(trace_file_path);
 }
 
+bool Parser::OpenTraceStream(const base::FilePath& pipe_path) {
+  DCHECK(!pipe_path.empty());
+
+  if (active_parse_engine_ != NULL)
+    return active_parse_engine_->OpenTraceStream(pipe_path);
+
+  // Streams go to the first engine that supports them.
+  ParseEngineIter it = parse_engine_set_.begin();
+  for (; it != parse_engine_set_.end(); ++it) {
+    ParseEngine* engine = *it;
+    if (engine->OpenTraceStream(pipe_path)) {
+      LOG(INFO) << "Using " << engine->name() << " Call-Trace Parser.";
+      active_parse_engine_ = engine;
+      return true;
+    }
+  }
+
+  LOG(ERROR) << "No parse engine supports trace streams.";
+  return false;
+}
+
 bool Parser::Consume() {
   if (active_parse_engine_ == NULL) {
     LOG(ERROR) << "No open trace files to consume.";
@@ -252,5 +290,17 @@ void ParseEventHandlerImpl::OnProcessHeap(base::Time time,
                                           const TraceProcessHeap* data) {
 }
 
+void ParseEventHandlerImpl::OnInvocationSampling(
+    base::Time time,
+    DWORD process_id,
+    DWORD thread_id,
+    const TraceInvocationSampling* data) {
+}
+
+void ParseEventHandlerImpl::OnSampleStack(base::Time time,
+                                          DWORD process_id,
+                                          const TraceSampleStack* data) {
+}
+
 }  // namespace parser
 }  // namespace trace
@@ -18,6 +18,7 @@
 #define SYZYGY_TRACE_PARSE_PARSER_H_
 
 #include <list>
+#include <memory>
 
 #include "base/files/file_path.h"
 #include "base/strings/string_piece.h"
@@ -52,7 +53,34 @@ typedef core::AddressSpace<AbsoluteAddress64,
                            Size64,
                            AnnotatedModuleInformation> ModuleSpace;
 
+// Restricts the events that the parse engines dispatch to those of a process,
+// of a thread or of a time range, so that they can skip the parts of the
+// traces that aren't of interest. The filter applies to whole segments of
+// events: the segments that overlap it are dispatched in full, and only the
+// module events and the end of the process are dispatched from the others.
+// The parse engines that can't seek in a trace dispatch all of its events.
+struct TraceFilter {
+  TraceFilter() : process_id(0), thread_id(0) {}
+
+  // @returns true if the filter lets all of the events through.
+  bool IsEmpty() const {
+    return process_id == 0 && thread_id == 0 && start_time.is_null() &&
+           end_time.is_null();
+  }
+
+  // The process and the thread whose events are dispatched, or zero for all
+  // of them.
+  uint32_t process_id;
+  uint32_t thread_id;
+
+  // The range of time whose events are dispatched. A null time leaves its end
+  // of the range open.
+  base::Time start_time;
+  base::Time end_time;
+};
+
 // Forward declarations.
+class ParallelParseEventHandler;
 class ParseEngine;
 class ParseEventHandler;
 
@@ -76,6 +104,20 @@ class Parser {
   // Initialize the parser implementation.
   bool Init(ParseEventHandler* event_handler);
 
+  // Makes the parse engines dispatch the events of the trace files on several
+  // threads, if they support it. This must be called after Init.
+  // @param parallel_event_handler the handler that was passed to Init, which
+  //     provides the clones to which the parsing threads dispatch the events.
+  // @param thread_count the number of parsing threads. Passing 1 parses the
+  //     trace files sequentially.
+  void EnableParallelParse(ParallelParseEventHandler* parallel_event_handler,
+                           size_t thread_count);
+
+  // Restricts the events that are dispatched from the trace files. This must
+  // be called after Init.
+  // @param filter the events to dispatch.
+  void SetFilter(const TraceFilter& filter);
+
   // Returns true if an error occurred while parsing the trace files.
   bool error_occurred() const;
 
@@ -88,6 +130,13 @@ class Parser {
   // open trace files of different type in a single parse session.
   bool OpenTraceFile(const base::FilePath& trace_file_path);
 
+  // Add a live stream to the parse session, which a session of the call trace
+  // service writes to the named pipe given by @p pipe_path. The parser waits
+  // for the session to connect when the events are consumed. This can be
+  // called several times for the same pipe, to consume as many sessions.
+  // This may not be mixed with trace files of another type.
+  bool OpenTraceStream(const base::FilePath& pipe_path);
+
   // Consume all events across all currently open trace files.
   bool Consume();
 
@@ -234,6 +283,17 @@ class ParseEventHandler {
   virtual void OnProcessHeap(base::Time time,
                              DWORD process_id,
                              const TraceProcessHeap* data) = 0;
+
+  // Issued for invocation sampling records.
+  virtual void OnInvocationSampling(base::Time time,
+                                    DWORD process_id,
+                                    DWORD thread_id,
+                                    const TraceInvocationSampling* data) = 0;
+
+  // Issued for stack sample records.
+  virtual void OnSampleStack(base::Time time,
+                             DWORD process_id,
+                             const TraceSampleStack* data) = 0;
 };
 
 // A default implementation of the ParseEventHandler interface. Provides
@@ -311,9 +371,38 @@ class ParseEventHandlerImpl : public ParseEventHandler {
   void OnProcessHeap(base::Time time,
                      DWORD process_id,
                      const TraceProcessHeap* data) override;
+  void OnInvocationSampling(base::Time time,
+                            DWORD process_id,
+                            DWORD thread_id,
+                            const TraceInvocationSampling* data) override;
+  void OnSampleStack(base::Time time,
+                     DWORD process_id,
+                     const TraceSampleStack* data) override;
   // @}
 };
 
+// An event handler whose events can be dispatched by several threads at once.
+// When parsing in parallel, each parsing thread dispatches the events of the
+// segments it consumes to its own clone of the handler, and the clones are
+// merged back into the handler once all of the events have been consumed.
+// The events that change the module space of a process (process and thread
+// attach and detach events), as well as OnProcessStarted and OnProcessEnded,
+// are still dispatched to the handler itself, in order. The clones may call
+// Parser::GetModuleInformation while they handle their events.
+class ParallelParseEventHandler {
+ public:
+  virtual ~ParallelParseEventHandler() { }
+
+  // @returns a new, empty handler to which a parsing thread dispatches the
+  //     events of its segments.
+  virtual std::unique_ptr<ParseEventHandler> CreateClone() = 0;
+
+  // Merges the events that were dispatched to a clone into this handler.
+  // @param clone a handler that was returned by CreateClone.
+  // @returns true on success, false otherwise.
+  virtual bool MergeClone(ParseEventHandler* clone) = 0;
+};
+
 }  // namespace parser
 }  // namespace trace
 
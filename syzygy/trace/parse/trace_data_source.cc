@@ -0,0 +1,43 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/parse/trace_data_source.h"
+
+#include "base/logging.h"
+
+namespace trace {
+namespace parser {
+
+TraceDataView::TraceDataView(const uint8_t* data,
+                             uint64_t offset,
+                             size_t length)
+    : data_(data), offset_(offset), length_(length) {
+  DCHECK(data != NULL || length == 0);
+}
+
+TraceDataView::~TraceDataView() {
+}
+
+bool TraceDataView::Contains(uint64_t offset, size_t length) const {
+  return offset >= offset_ && offset - offset_ <= length_ &&
+         length <= length_ - (offset - offset_);
+}
+
+const uint8_t* TraceDataView::GetData(uint64_t offset) const {
+  DCHECK(Contains(offset, 0));
+  return data_ + static_cast<size_t>(offset - offset_);
+}
+
+}  // namespace parser
+}  // namespace trace
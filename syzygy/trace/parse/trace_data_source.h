@@ -0,0 +1,89 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the interface through which the RPC parse engine reads the data
+// of a trace, whether it comes from a trace file or from a live stream.
+
+#ifndef SYZYGY_TRACE_PARSE_TRACE_DATA_SOURCE_H_
+#define SYZYGY_TRACE_PARSE_TRACE_DATA_SOURCE_H_
+
+#include <stdint.h>
+
+#include "base/macros.h"
+#include "base/memory/ref_counted.h"
+
+namespace trace {
+namespace parser {
+
+// A contiguous part of the data of a trace. It remains valid as long as it
+// is referred to.
+class TraceDataView : public base::RefCounted<TraceDataView> {
+ public:
+  // @param data the data of the view.
+  // @param offset the offset of the data in the trace.
+  // @param length the number of bytes in the view.
+  TraceDataView(const uint8_t* data, uint64_t offset, size_t length);
+
+  // @returns true if the view contains the @p length bytes at @p offset.
+  bool Contains(uint64_t offset, size_t length) const;
+
+  // @returns a pointer to the data at @p offset in the trace, which must be
+  //     in the view.
+  const uint8_t* GetData(uint64_t offset) const;
+
+  // @name Accessors.
+  // @{
+  uint64_t offset() const { return offset_; }
+  size_t length() const { return length_; }
+  // @}
+
+ protected:
+  friend class base::RefCounted<TraceDataView>;
+  virtual ~TraceDataView();
+
+  const uint8_t* data_;
+  uint64_t offset_;
+  size_t length_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(TraceDataView);
+};
+
+// The source of the data of a trace. The data is read from start to end, so
+// sources that can't seek back only need to keep the last view around.
+class TraceDataSource {
+ public:
+  virtual ~TraceDataSource() { }
+
+  // @param offset the offset of the data in the trace.
+  // @param length the number of bytes.
+  // @returns true if the trace ends before the @p length bytes at @p offset.
+  virtual bool EndsBefore(uint64_t offset, size_t length) = 0;
+
+  // Gets the data at a given offset of the trace.
+  // @param offset the offset of the data in the trace.
+  // @param length the number of bytes to get.
+  // @param view receives the view containing the data. The data remains
+  //     valid as long as this reference exists.
+  // @returns a pointer to the data, or NULL if it extends past the end of the
+  //     trace or can't be read.
+  virtual const uint8_t* GetData(uint64_t offset,
+                                 size_t length,
+                                 scoped_refptr<TraceDataView>* view) = 0;
+};
+
+}  // namespace parser
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_PARSE_TRACE_DATA_SOURCE_H_
@@ -0,0 +1,183 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/parse/trace_file_mapping.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "syzygy/common/align.h"
+#include "syzygy/common/com_utils.h"
+
+namespace trace {
+namespace parser {
+
+namespace {
+
+// The declarations of PrefetchVirtualMemory, which is only available from
+// Windows 8 onwards.
+struct MemoryRangeEntry {
+  void* virtual_address;
+  size_t number_of_bytes;
+};
+typedef BOOL (WINAPI* PrefetchVirtualMemoryFunc)(HANDLE process,
+                                                 ULONG_PTR number_of_entries,
+                                                 MemoryRangeEntry* entries,
+                                                 ULONG flags);
+
+// A view of the trace file, which is unmapped once the last reference to it
+// is released.
+class MappedView : public TraceDataView {
+ public:
+  MappedView(const uint8_t* base, uint64_t offset, size_t length)
+      : TraceDataView(base, offset, length) {
+    DCHECK(base != NULL);
+  }
+
+ private:
+  ~MappedView() override {
+    if (!::UnmapViewOfFile(data_)) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to unmap trace file view: "
+                 << ::common::LogWe(error) << ".";
+    }
+  }
+
+  DISALLOW_COPY_AND_ASSIGN(MappedView);
+};
+
+}  // namespace
+
+TraceFileMapping::TraceFileMapping(size_t window_size)
+    : length_(0), window_size_(window_size), allocation_granularity_(0) {
+  DCHECK_LT(0u, window_size);
+
+  SYSTEM_INFO system_info = {};
+  ::GetSystemInfo(&system_info);
+  allocation_granularity_ = system_info.dwAllocationGranularity;
+  window_size_ = ::common::AlignUp(window_size_, allocation_granularity_);
+}
+
+TraceFileMapping::~TraceFileMapping() {
+}
+
+bool TraceFileMapping::Open(const base::FilePath& path) {
+  DCHECK(!file_.IsValid());
+
+  // The file is read from start to end, which lets the cache manager read
+  // ahead aggressively.
+  file_.Set(::CreateFile(path.value().c_str(), GENERIC_READ, FILE_SHARE_READ,
+                         NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+                         NULL));
+  if (!file_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to open '" << path.value() << "': "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  LARGE_INTEGER length = {};
+  if (!::GetFileSizeEx(file_.Get(), &length)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to get the size of '" << path.value() << "': "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+  length_ = length.QuadPart;
+
+  // Empty files can't be mapped, and have no data to get anyways.
+  if (length_ == 0) {
+    path_ = path;
+    return true;
+  }
+
+  mapping_.Set(::CreateFileMapping(file_.Get(), NULL, PAGE_READONLY, 0, 0,
+                                   NULL));
+  if (!mapping_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to map '" << path.value() << "': "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  path_ = path;
+  return true;
+}
+
+bool TraceFileMapping::EndsBefore(uint64_t offset, size_t length) {
+  return offset > length_ || length > length_ - offset;
+}
+
+const uint8_t* TraceFileMapping::GetData(uint64_t offset,
+                                         size_t length,
+                                         scoped_refptr<TraceDataView>* view) {
+  DCHECK(file_.IsValid());
+  DCHECK(view != NULL);
+
+  if (EndsBefore(offset, length) || !mapping_.IsValid())
+    return NULL;
+
+  if (view_.get() == NULL || !view_->Contains(offset, length)) {
+    if (!MapView(offset, length))
+      return NULL;
+  }
+
+  DCHECK(view_->Contains(offset, length));
+  *view = view_;
+  return view_->GetData(offset);
+}
+
+bool TraceFileMapping::MapView(uint64_t offset, size_t length) {
+  DCHECK(mapping_.IsValid());
+  DCHECK_LE(offset + length, length_);
+
+  // Views start on a multiple of the allocation granularity, and extend to a
+  // full window if the file is long enough.
+  uint64_t view_offset = ::common::AlignDown64(offset, allocation_granularity_);
+  uint64_t view_end = std::max(offset + length, view_offset + window_size_);
+  view_end = std::min(view_end, length_);
+  size_t view_length = static_cast<size_t>(view_end - view_offset);
+
+  const uint8_t* base = reinterpret_cast<const uint8_t*>(::MapViewOfFile(
+      mapping_.Get(), FILE_MAP_READ, static_cast<DWORD>(view_offset >> 32),
+      static_cast<DWORD>(view_offset), view_length));
+  if (base == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map " << view_length << " bytes at offset "
+               << view_offset << " of '" << path_.value() << "': "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  PrefetchView(base, view_length);
+  view_ = new MappedView(base, view_offset, view_length);
+  return true;
+}
+
+void TraceFileMapping::PrefetchView(const uint8_t* base, size_t length) {
+  DCHECK(base != NULL);
+
+  static PrefetchVirtualMemoryFunc prefetch_virtual_memory =
+      reinterpret_cast<PrefetchVirtualMemoryFunc>(::GetProcAddress(
+          ::GetModuleHandle(L"kernel32.dll"), "PrefetchVirtualMemory"));
+  if (prefetch_virtual_memory == NULL)
+    return;
+
+  // This is only a hint, so failures are ignored.
+  MemoryRangeEntry entry = { const_cast<uint8_t*>(base), length };
+  prefetch_virtual_memory(::GetCurrentProcess(), 1, &entry, 0);
+}
+
+}  // namespace parser
+}  // namespace trace
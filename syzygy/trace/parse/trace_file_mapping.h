@@ -0,0 +1,96 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a read-only mapping of a trace file, which lets the parse engine
+// dispatch the events straight from the mapped pages.
+
+#ifndef SYZYGY_TRACE_PARSE_TRACE_FILE_MAPPING_H_
+#define SYZYGY_TRACE_PARSE_TRACE_FILE_MAPPING_H_
+
+#include <windows.h>
+
+#include "base/macros.h"
+#include "base/files/file_path.h"
+#include "base/memory/ref_counted.h"
+#include "base/win/scoped_handle.h"
+#include "syzygy/trace/parse/trace_data_source.h"
+
+namespace trace {
+namespace parser {
+
+// Maps a trace file a window at a time, so that trace files larger than the
+// address space of the process can be read. Each window is mapped as a view
+// that remains mapped as long as it is referred to, so the data of several
+// windows can be used at once. The file is read sequentially, so each new
+// view is prefetched as a whole when the system supports it.
+//
+// Usage:
+//   TraceFileMapping mapping(TraceFileMapping::kDefaultWindowSize);
+//   if (!mapping.Open(path)) ...
+//   scoped_refptr<TraceDataView> view;
+//   const uint8_t* data = mapping.GetData(offset, length, &view);
+//   if (data == NULL) ...
+class TraceFileMapping : public TraceDataSource {
+ public:
+  // The default size of the windows that are mapped. Requests that are
+  // larger than a window get a view of their own size.
+  static const size_t kDefaultWindowSize = 64 * 1024 * 1024;
+
+  // @param window_size the number of bytes to map at once. It is rounded up
+  //     to the allocation granularity of the system.
+  explicit TraceFileMapping(size_t window_size);
+  ~TraceFileMapping() override;
+
+  // Opens and maps a trace file.
+  // @param path the trace file to open.
+  // @returns true on success, false otherwise.
+  bool Open(const base::FilePath& path);
+
+  // @returns the length of the trace file.
+  uint64_t length() const { return length_; }
+
+  // @name TraceDataSource implementation. The data is mapped as needed.
+  // @{
+  bool EndsBefore(uint64_t offset, size_t length) override;
+  const uint8_t* GetData(uint64_t offset,
+                         size_t length,
+                         scoped_refptr<TraceDataView>* view) override;
+  // @}
+
+ private:
+  // Maps the view containing the @p length bytes at @p offset.
+  // @returns true on success, false otherwise.
+  bool MapView(uint64_t offset, size_t length);
+
+  // Hints to the system that the view is about to be read.
+  void PrefetchView(const uint8_t* base, size_t length);
+
+  base::FilePath path_;
+  base::win::ScopedHandle file_;
+  base::win::ScopedHandle mapping_;
+  uint64_t length_;
+  size_t window_size_;
+  size_t allocation_granularity_;
+
+  // The view that was mapped last, from which the next data is likely to be
+  // read.
+  scoped_refptr<TraceDataView> view_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceFileMapping);
+};
+
+}  // namespace parser
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_PARSE_TRACE_FILE_MAPPING_H_
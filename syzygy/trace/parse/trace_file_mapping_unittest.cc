@@ -0,0 +1,113 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/parse/trace_file_mapping.h"
+
+#include <vector>
+
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "gtest/gtest.h"
+
+namespace trace {
+namespace parser {
+
+namespace {
+
+class TraceFileMappingTest : public ::testing::Test {
+ public:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    path_ = temp_dir_.path().Append(L"trace.bin");
+
+    SYSTEM_INFO system_info = {};
+    ::GetSystemInfo(&system_info);
+    granularity_ = system_info.dwAllocationGranularity;
+
+    // A little over two windows of the smallest size.
+    data_.resize(2 * granularity_ + 100);
+    for (size_t i = 0; i < data_.size(); ++i)
+      data_[i] = static_cast<uint8_t>(i * 7);
+    ASSERT_EQ(static_cast<int>(data_.size()),
+              base::WriteFile(path_, reinterpret_cast<const char*>(
+                                         data_.data()),
+                              static_cast<int>(data_.size())));
+  }
+
+ protected:
+  base::ScopedTempDir temp_dir_;
+  base::FilePath path_;
+  size_t granularity_;
+  std::vector<uint8_t> data_;
+};
+
+}  // namespace
+
+TEST_F(TraceFileMappingTest, OpenFailsOnMissingFile) {
+  TraceFileMapping mapping(TraceFileMapping::kDefaultWindowSize);
+  EXPECT_FALSE(mapping.Open(temp_dir_.path().Append(L"missing.bin")));
+}
+
+TEST_F(TraceFileMappingTest, GetData) {
+  // Windows are rounded up to the allocation granularity.
+  TraceFileMapping mapping(1);
+  ASSERT_TRUE(mapping.Open(path_));
+  EXPECT_EQ(data_.size(), mapping.length());
+
+  scoped_refptr<TraceDataView> first_view;
+  const uint8_t* first = mapping.GetData(10, 20, &first_view);
+  ASSERT_TRUE(first != NULL);
+  ASSERT_TRUE(first_view.get() != NULL);
+  EXPECT_EQ(0, ::memcmp(data_.data() + 10, first, 20));
+
+  // Data that straddles two windows gets a new view.
+  scoped_refptr<TraceDataView> second_view;
+  size_t offset = granularity_ - 10;
+  const uint8_t* second = mapping.GetData(offset, 20, &second_view);
+  ASSERT_TRUE(second != NULL);
+  EXPECT_NE(first_view.get(), second_view.get());
+  EXPECT_EQ(0, ::memcmp(data_.data() + offset, second, 20));
+
+  // The first view remains mapped.
+  EXPECT_EQ(0, ::memcmp(data_.data() + 10, first, 20));
+
+  // Data in the window that was mapped last reuses its view.
+  scoped_refptr<TraceDataView> third_view;
+  ASSERT_TRUE(mapping.GetData(granularity_ + 20, 10, &third_view) != NULL);
+  scoped_refptr<TraceDataView> fourth_view;
+  const uint8_t* fourth =
+      mapping.GetData(granularity_ + 40, 10, &fourth_view);
+  ASSERT_TRUE(fourth != NULL);
+  EXPECT_EQ(third_view.get(), fourth_view.get());
+  EXPECT_EQ(0, ::memcmp(data_.data() + granularity_ + 40, fourth, 10));
+
+  // The last window is shorter.
+  scoped_refptr<TraceDataView> last_view;
+  const uint8_t* last = mapping.GetData(data_.size() - 1, 1, &last_view);
+  ASSERT_TRUE(last != NULL);
+  EXPECT_EQ(data_.back(), *last);
+}
+
+TEST_F(TraceFileMappingTest, GetDataPastEndFails) {
+  TraceFileMapping mapping(TraceFileMapping::kDefaultWindowSize);
+  ASSERT_TRUE(mapping.Open(path_));
+
+  scoped_refptr<TraceDataView> view;
+  EXPECT_TRUE(mapping.GetData(0, data_.size(), &view) != NULL);
+  EXPECT_TRUE(mapping.GetData(1, data_.size(), &view) == NULL);
+  EXPECT_TRUE(mapping.GetData(data_.size() + 1, 0, &view) == NULL);
+}
+
+}  // namespace parser
+}  // namespace trace
@@ -0,0 +1,169 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/parse/trace_stream.h"
+
+#include <vector>
+
+#include "base/logging.h"
+#include "syzygy/common/com_utils.h"
+
+namespace trace {
+namespace parser {
+
+namespace {
+
+// A view that owns the data that was read from the pipe.
+class StreamView : public TraceDataView {
+ public:
+  StreamView(std::vector<uint8_t>* data, uint64_t offset)
+      : TraceDataView(NULL, offset, 0) {
+    DCHECK(data != NULL);
+    data_buffer_.swap(*data);
+    data_ = data_buffer_.data();
+    length_ = data_buffer_.size();
+  }
+
+ private:
+  ~StreamView() override {}
+
+  std::vector<uint8_t> data_buffer_;
+
+  DISALLOW_COPY_AND_ASSIGN(StreamView);
+};
+
+}  // namespace
+
+TraceStream::TraceStream() : position_(0), ended_(false) {
+}
+
+TraceStream::~TraceStream() {
+}
+
+bool TraceStream::Open(const base::FilePath& pipe_path) {
+  DCHECK(!pipe_.IsValid());
+
+  pipe_.Set(::CreateNamedPipe(pipe_path.value().c_str(),
+                              PIPE_ACCESS_INBOUND,
+                              PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+                              PIPE_UNLIMITED_INSTANCES,
+                              0,
+                              kPipeBufferSize,
+                              0,
+                              NULL));
+  if (!pipe_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to create pipe '" << pipe_path.value() << "': "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  LOG(INFO) << "Waiting for a session to stream to '" << pipe_path.value()
+            << "'.";
+  if (!::ConnectNamedPipe(pipe_.Get(), NULL)) {
+    DWORD error = ::GetLastError();
+    if (error != ERROR_PIPE_CONNECTED) {
+      LOG(ERROR) << "Failed to connect pipe '" << pipe_path.value() << "': "
+                 << ::common::LogWe(error) << ".";
+      return false;
+    }
+  }
+
+  path_ = pipe_path;
+  return true;
+}
+
+bool TraceStream::EndsBefore(uint64_t offset, size_t length) {
+  // The data has to be read to find out, and is kept in the last view.
+  scoped_refptr<TraceDataView> view;
+  return GetData(offset, length, &view) == NULL && ended_;
+}
+
+const uint8_t* TraceStream::GetData(uint64_t offset,
+                                    size_t length,
+                                    scoped_refptr<TraceDataView>* view) {
+  DCHECK(pipe_.IsValid());
+  DCHECK(view != NULL);
+
+  if (view_.get() != NULL && view_->Contains(offset, length)) {
+    *view = view_;
+    return view_->GetData(offset);
+  }
+
+  // Only the last view can be read again.
+  uint64_t view_start = position_;
+  if (view_.get() != NULL)
+    view_start = view_->offset();
+  if (offset < view_start) {
+    LOG(ERROR) << "Can't seek back to offset " << offset << " of '"
+               << path_.value() << "'.";
+    return NULL;
+  }
+
+  // Skip the data up to the offset. This is the padding of the segments.
+  std::vector<uint8_t> data;
+  if (offset > position_) {
+    data.resize(static_cast<size_t>(offset - position_));
+    if (!Read(data.data(), data.size()))
+      return NULL;
+    data.clear();
+  }
+
+  // The part of the last view that is requested again is copied.
+  if (offset < position_) {
+    DCHECK(view_.get() != NULL);
+    const uint8_t* tail = view_->GetData(offset);
+    data.assign(tail, tail + static_cast<size_t>(position_ - offset));
+  }
+
+  size_t read_length = length - data.size();
+  data.resize(length);
+  if (!Read(data.data() + length - read_length, read_length))
+    return NULL;
+
+  view_ = new StreamView(&data, offset);
+  *view = view_;
+  return view_->GetData(offset);
+}
+
+bool TraceStream::Read(uint8_t* buffer, size_t length) {
+  DCHECK(buffer != NULL || length == 0);
+
+  while (length > 0) {
+    if (ended_)
+      return false;
+
+    DWORD bytes_read = 0;
+    if (!::ReadFile(pipe_.Get(), buffer, static_cast<DWORD>(length),
+                    &bytes_read, NULL)) {
+      DWORD error = ::GetLastError();
+      if (error == ERROR_BROKEN_PIPE) {
+        ended_ = true;
+        return false;
+      }
+      LOG(ERROR) << "Failed to read from '" << path_.value() << "': "
+                 << ::common::LogWe(error) << ".";
+      return false;
+    }
+
+    buffer += bytes_read;
+    length -= bytes_read;
+    position_ += bytes_read;
+  }
+
+  return true;
+}
+
+}  // namespace parser
+}  // namespace trace
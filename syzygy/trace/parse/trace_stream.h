@@ -0,0 +1,90 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a live trace stream, which receives the trace of a session from
+// the call trace service over a named pipe as it is being written.
+
+#ifndef SYZYGY_TRACE_PARSE_TRACE_STREAM_H_
+#define SYZYGY_TRACE_PARSE_TRACE_STREAM_H_
+
+#include <windows.h>
+
+#include "base/macros.h"
+#include "base/files/file_path.h"
+#include "base/win/scoped_handle.h"
+#include "syzygy/trace/parse/trace_data_source.h"
+
+namespace trace {
+namespace parser {
+
+// Reads the trace of a session from a named pipe, to which the call trace
+// service writes it in the format of a trace file. The stream can't seek, so
+// the data must be read from start to end. Only the last view can be read
+// again, and the data that is skipped over is discarded.
+//
+// Usage:
+//   TraceStream stream;
+//   if (!stream.Open(L"\\\\.\\pipe\\my-trace")) ...
+//   scoped_refptr<TraceDataView> view;
+//   const uint8_t* data = stream.GetData(offset, length, &view);
+//   if (data == NULL) ...
+class TraceStream : public TraceDataSource {
+ public:
+  // The size of the buffers of the pipe.
+  static const size_t kPipeBufferSize = 1024 * 1024;
+
+  TraceStream();
+  ~TraceStream() override;
+
+  // Creates an instance of the named pipe and waits for the call trace
+  // service to connect a session to it.
+  // @param pipe_path the name of the pipe.
+  // @returns true on success, false otherwise.
+  bool Open(const base::FilePath& pipe_path);
+
+  // @name TraceDataSource implementation. The data is read from the pipe as
+  //     needed.
+  // @{
+  bool EndsBefore(uint64_t offset, size_t length) override;
+  const uint8_t* GetData(uint64_t offset,
+                         size_t length,
+                         scoped_refptr<TraceDataView>* view) override;
+  // @}
+
+ private:
+  // Reads from the pipe.
+  // @param buffer receives the data.
+  // @param length the number of bytes to read.
+  // @returns true on success, false if the stream ended or on error.
+  bool Read(uint8_t* buffer, size_t length);
+
+  base::FilePath path_;
+  base::win::ScopedHandle pipe_;
+
+  // The number of bytes that have been read from the pipe.
+  uint64_t position_;
+
+  // Whether the service has closed its end of the pipe.
+  bool ended_;
+
+  // The view that was read last, which ends at position_.
+  scoped_refptr<TraceDataView> view_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceStream);
+};
+
+}  // namespace parser
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_PARSE_TRACE_STREAM_H_
@@ -0,0 +1,108 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/parse/trace_stream.h"
+
+#include <vector>
+
+#include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
+#include "base/win/scoped_handle.h"
+#include "gtest/gtest.h"
+
+namespace trace {
+namespace parser {
+
+namespace {
+
+// Connects to a pipe and writes data to it, as the call trace service does.
+class PipeWriter : public base::DelegateSimpleThread::Delegate {
+ public:
+  PipeWriter(const base::FilePath& pipe_path,
+             const std::vector<uint8_t>& data)
+      : pipe_path_(pipe_path), data_(data), succeeded_(false) {
+  }
+
+  void Run() override {
+    // Wait for the stream to create the pipe.
+    base::win::ScopedHandle pipe;
+    for (size_t i = 0; i < 100 && !pipe.IsValid(); ++i) {
+      pipe.Set(::CreateFile(pipe_path_.value().c_str(), GENERIC_WRITE, 0,
+                            NULL, OPEN_EXISTING, 0, NULL));
+      if (!pipe.IsValid())
+        ::Sleep(50);
+    }
+    if (!pipe.IsValid())
+      return;
+
+    DWORD bytes_written = 0;
+    succeeded_ = ::WriteFile(pipe.Get(), data_.data(),
+                             static_cast<DWORD>(data_.size()),
+                             &bytes_written, NULL) &&
+                 bytes_written == data_.size();
+  }
+
+  bool succeeded() const { return succeeded_; }
+
+ private:
+  base::FilePath pipe_path_;
+  std::vector<uint8_t> data_;
+  bool succeeded_;
+};
+
+}  // namespace
+
+TEST(TraceStreamTest, GetData) {
+  base::FilePath pipe_path(base::StringPrintf(
+      L"\\\\.\\pipe\\trace-stream-unittest-%d", ::GetCurrentProcessId()));
+  std::vector<uint8_t> data(300);
+  for (size_t i = 0; i < data.size(); ++i)
+    data[i] = static_cast<uint8_t>(i);
+
+  PipeWriter writer(pipe_path, data);
+  base::DelegateSimpleThread thread(&writer, "PipeWriter");
+  thread.Start();
+
+  TraceStream stream;
+  ASSERT_TRUE(stream.Open(pipe_path));
+
+  // The last view can be read again, and extended.
+  scoped_refptr<TraceDataView> first_view;
+  const uint8_t* first = stream.GetData(0, 10, &first_view);
+  ASSERT_TRUE(first != NULL);
+  EXPECT_EQ(0, ::memcmp(data.data(), first, 10));
+  scoped_refptr<TraceDataView> second_view;
+  const uint8_t* second = stream.GetData(0, 20, &second_view);
+  ASSERT_TRUE(second != NULL);
+  EXPECT_EQ(0, ::memcmp(data.data(), second, 20));
+
+  // The first view remains valid.
+  EXPECT_EQ(0, ::memcmp(data.data(), first, 10));
+
+  // Data is skipped over up to the requested offset, but can't be read back.
+  const uint8_t* third = stream.GetData(100, 50, &first_view);
+  ASSERT_TRUE(third != NULL);
+  EXPECT_EQ(0, ::memcmp(data.data() + 100, third, 50));
+  EXPECT_TRUE(stream.GetData(50, 10, &first_view) == NULL);
+
+  // The stream ends once the writer disconnects.
+  EXPECT_FALSE(stream.EndsBefore(200, 100));
+  EXPECT_TRUE(stream.EndsBefore(300, 1));
+
+  thread.Join();
+  EXPECT_TRUE(writer.succeeded());
+}
+
+}  // namespace parser
+}  // namespace trace
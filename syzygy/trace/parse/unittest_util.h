@@ -99,6 +99,15 @@ class MockParseEventHandler : public trace::parser::ParseEventHandler {
                void(base::Time time,
                     DWORD process_id,
                     const TraceProcessHeap* data));
+  MOCK_METHOD4(OnInvocationSampling,
+               void(base::Time time,
+                    DWORD process_id,
+                    DWORD thread_id,
+                    const TraceInvocationSampling* data));
+  MOCK_METHOD3(OnSampleStack,
+               void(base::Time time,
+                    DWORD process_id,
+                    const TraceSampleStack* data));
 };
 
 typedef testing::StrictMock<MockParseEventHandler> StrictMockParseEventHandler;
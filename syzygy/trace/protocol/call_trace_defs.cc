@@ -80,6 +80,9 @@ void MakeInstanceString(const base::StringPiece16& prefix,
 const TraceFileHeader::Signature TraceFileHeader::kSignatureValue = {
     'S', 'Z', 'G', 'Y' };
 
+const TraceFileIndexTrailer::Signature TraceFileIndexTrailer::kSignatureValue =
+    { 'S', 'Z', 'I', 'X' };
+
 void GetSyzygyCallTraceRpcProtocol(std::wstring* protocol) {
   DCHECK(protocol != NULL);
   protocol->assign(kCallTraceRpcProtocol);
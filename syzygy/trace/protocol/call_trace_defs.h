@@ -72,6 +72,10 @@ enum {
 enum TraceEventType {
   // Header prefix for a "page" of call trace events.
   TRACE_PAGE_HEADER,
+  // Header prefix for a compressed "page" of call trace events.
+  TRACE_COMPRESSED_PAGE_HEADER,
+  // Header prefix for the index of the segments of a trace file.
+  TRACE_SEGMENT_INDEX_HEADER,
   // The actual events are below.
   TRACE_PROCESS_STARTED = 10,
   TRACE_PROCESS_ENDED,
@@ -93,6 +97,10 @@ enum TraceEventType {
   TRACE_DETAILED_FUNCTION_CALL,
   TRACE_COMMENT,
   TRACE_PROCESS_HEAP,
+  TRACE_INVOCATION_SAMPLING,
+  TRACE_COMPACT_FUNCTION_CALLS,
+  TRACE_SAMPLE_STACK,
+  TRACE_COMPACT_BATCH_ENTER,
 };
 
 // All traces are emitted at this trace level.
@@ -111,6 +119,9 @@ enum TraceEventFlags {
   TRACE_FLAG_THREAD_EVENTS  = 0x0010,
   // Batch entry traces.
   TRACE_FLAG_BATCH_ENTER    = 0x0020,
+  // Record the batch entry traces as TraceCompactBatchEnterData. This is only
+  // meaningful along with TRACE_FLAG_BATCH_ENTER.
+  TRACE_FLAG_COMPACT_BATCH_ENTER = 0x0040,
 };
 
 // Max depth of stack trace captured on entry/exit.
@@ -251,6 +262,89 @@ struct TraceFileSegmentHeader {
 };
 COMPILE_ASSERT_IS_POD(TraceFileSegmentHeader);
 
+// Written at the beginning of a compressed call trace file segment, in place
+// of a TraceFileSegmentHeader. The records of the segment are compressed with
+// zlib, and the compressed data follows the header. Like other segments, a
+// compressed segment is rounded up to the block_size on disk. As the header
+// records both sizes, the segments can be located without being decompressed,
+// and can then be decompressed independently of each other.
+struct TraceFileCompressedSegmentHeader {
+  // Type identifiers used for these headers.
+  enum { kTypeId = TRACE_COMPRESSED_PAGE_HEADER };
+
+  // The identity of the thread that is reporting in this segment
+  // of the trace file.
+  uint32_t thread_id;
+
+  // The number of data bytes in this segment once it is decompressed. This
+  // is the segment_length of the original TraceFileSegmentHeader.
+  uint32_t segment_length;
+
+  // The number of compressed data bytes that follow this header.
+  uint32_t compressed_length;
+};
+COMPILE_ASSERT_IS_POD(TraceFileCompressedSegmentHeader);
+
+// Describes a segment of a trace file in its index. The timestamps are those
+// of the records of the segment, before it is compressed.
+struct TraceFileIndexEntry {
+  // The flags describing the events of the segment.
+  enum Flags {
+    // The segment contains events that change the module space of the
+    // process.
+    kHasModuleEvents = 1 << 0,
+    // The segment contains the TRACE_PROCESS_ENDED event.
+    kHasProcessEnded = 1 << 1,
+  };
+
+  // The offset of the segment in the trace file.
+  uint64_t offset;
+
+  // The smallest and the largest timestamps of the records of the segment.
+  uint64_t first_timestamp;
+  uint64_t last_timestamp;
+
+  // The identity of the thread that reported the segment.
+  uint32_t thread_id;
+
+  // A combination of Flags.
+  uint32_t flags;
+};
+COMPILE_ASSERT_IS_POD_OF_SIZE(TraceFileIndexEntry, 32);
+
+// Written after the last segment of a trace file, in the place of a segment
+// header. The index lets a parser seek to the segments of a thread or of a
+// time range rather than reading the whole trace file. The entries follow the
+// header, in the order of the segments, and the index is rounded up to the
+// block_size like the segments. Its last block ends with a
+// TraceFileIndexTrailer, which locates the index from the end of the file.
+struct TraceFileIndexHeader {
+  // Type identifiers used for these headers.
+  enum { kTypeId = TRACE_SEGMENT_INDEX_HEADER };
+
+  // The number of TraceFileIndexEntry that follow this header.
+  uint32_t entry_count;
+};
+COMPILE_ASSERT_IS_POD(TraceFileIndexHeader);
+
+// The last bytes of a trace file that ends with an index.
+struct TraceFileIndexTrailer {
+  // In a valid trailer this will be "SZIX".
+  typedef char Signature[4];
+
+  // A canonical value for the signature.
+  static const Signature kSignatureValue;
+
+  // The offset of the RecordPrefix of the index in the trace file.
+  uint64_t index_offset;
+
+  // The number of entries of the index.
+  uint32_t entry_count;
+
+  Signature signature;
+};
+COMPILE_ASSERT_IS_POD_OF_SIZE(TraceFileIndexTrailer, 16);
+
 // The structure traced on function entry or exit.
 template<int TypeId>
 struct TraceEnterExitEventDataTempl {
@@ -519,4 +613,95 @@ struct TraceProcessHeap {
 };
 COMPILE_ASSERT_IS_POD(TraceProcessHeap);
 
+// Records that the invocations that a thread records from then on are a
+// sample of one in every |sampling_interval| of its calls. The number of
+// calls and the cycles of each invocation are to be scaled up accordingly.
+struct TraceInvocationSampling {
+  enum { kTypeId = TRACE_INVOCATION_SAMPLING };
+
+  uint32_t sampling_interval;
+};
+COMPILE_ASSERT_IS_POD(TraceInvocationSampling);
+
+// Records a batch of detailed function calls made by a thread, in a compact
+// encoding. Each call decodes to the equivalent TraceDetailedFunctionCall.
+struct TraceCompactFunctionCalls {
+  enum { kTypeId = TRACE_COMPACT_FUNCTION_CALLS };
+
+  // The timestamp that the timestamp of the first call is relative to.
+  uint64_t base_timestamp;
+
+  // The number of calls in the batch.
+  uint32_t num_calls;
+
+  // The size of the call data.
+  uint32_t call_data_size;
+
+  // The blob of encoded calls. This is actually of size |call_data_size|.
+  // Each call is laid out as follows, where the values are unsigned LEB128
+  // encoded:
+  // timestamp delta from the previous call, or from |base_timestamp|
+  // function_id
+  // stack_trace_id
+  // argument_count
+  // argument_length_0
+  // argument_length_1
+  // ...
+  // argument_data_0
+  // argument_data_1
+  // ...
+  // Arguments of 4 bytes, which are mostly pointers and sizes, are stored as
+  // the zigzag then LEB128 encoded delta from the previous 4-byte argument of
+  // the batch. Other arguments are stored as is.
+  uint8_t call_data[1];
+};
+COMPILE_ASSERT_IS_POD(TraceCompactFunctionCalls);
+
+// Records a call stack that was observed by periodically sampling the stacks
+// of the threads of a process. Each distinct stack is recorded once, along
+// with the number of samples it was observed in.
+struct TraceSampleStack {
+  enum { kTypeId = TRACE_SAMPLE_STACK };
+
+  // The interval between two samples of the stack of a thread, expressed in
+  // clock cycles.
+  uint64_t sampling_interval;
+
+  // The number of samples of this stack.
+  uint32_t sample_count;
+
+  // The number of frames in the stack.
+  uint32_t num_frames;
+
+  // The frames of the stack, innermost first. The first frame is the program
+  // counter of the thread, and the others are return addresses. There are
+  // actually |num_frames| frames in total.
+  void* frames[1];
+};
+COMPILE_ASSERT_IS_POD(TraceSampleStack);
+
+// Records a batch of function entries made by a thread, in a compact
+// encoding. This decodes to the equivalent TraceBatchEnterData. The thread ID
+// isn't repeated, it is that of the segment containing the batch.
+struct TraceCompactBatchEnterData {
+  enum { kTypeId = TRACE_COMPACT_BATCH_ENTER };
+
+  // The number of function entries in the batch.
+  uint32_t num_calls;
+
+  // The size of the call data.
+  uint32_t call_data_size;
+
+  // The blob of encoded entries. This is actually of size |call_data_size|.
+  // Each entry is laid out as follows, where the values are the zigzag then
+  // unsigned LEB128 encoded deltas from the same field of the previous entry
+  // of the batch, or from zero for the first entry:
+  // function
+  // retaddr
+  // Consecutive entries are mostly to nearby functions, called from nearby
+  // sites, so each entry usually takes 2 to 6 bytes rather than 8.
+  uint8_t call_data[1];
+};
+COMPILE_ASSERT_IS_POD(TraceCompactBatchEnterData);
+
 #endif  // SYZYGY_TRACE_PROTOCOL_CALL_TRACE_DEFS_H_
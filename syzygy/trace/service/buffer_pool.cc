@@ -33,6 +33,13 @@ BufferPool::~BufferPool() {
 bool BufferPool::Init(Session* session,
                       size_t num_buffers,
                       size_t buffer_size) {
+  return Init(session, num_buffers, buffer_size, NUMA_NO_PREFERRED_NODE);
+}
+
+bool BufferPool::Init(Session* session,
+                      size_t num_buffers,
+                      size_t buffer_size,
+                      uint32_t numa_node) {
   DCHECK(num_buffers != 0);
   DCHECK(buffer_size != 0);
   DCHECK(!handle_.IsValid());
@@ -42,9 +49,10 @@ bool BufferPool::Init(Session* session,
   VLOG(1) << "Creating " << (mapping_size >> 20) << "MB memory pool.";
 
   // Create a pagefile backed memory mapped file. This will be cut up into a
-  // pool of buffers.
-  base::win::ScopedHandle new_handle(
-      ::CreateFileMapping(NULL, NULL, PAGE_READWRITE, 0, mapping_size, NULL));
+  // pool of buffers. Its pages are preferably allocated on the NUMA node of
+  // the client, which is the one that fills them.
+  base::win::ScopedHandle new_handle(::CreateFileMappingNuma(
+      NULL, NULL, PAGE_READWRITE, 0, mapping_size, NULL, numa_node));
   if (!new_handle.IsValid()) {
     DWORD error = ::GetLastError();
     LOG(ERROR) << "Failed to allocate buffer: " << ::common::LogWe(error)
@@ -72,6 +80,39 @@ bool BufferPool::Init(Session* session,
   return true;
 }
 
+bool BufferPool::Discard() {
+  DCHECK(handle_.IsValid());
+  DCHECK(!buffers_.empty());
+
+  size_t mapping_size = buffers_[0].mapping_size;
+  void* base_ptr = ::MapViewOfFile(handle_.Get(), FILE_MAP_WRITE, 0, 0,
+                                   mapping_size);
+  if (base_ptr == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map buffer pool: " << ::common::LogWe(error)
+               << ".";
+    return false;
+  }
+
+  bool succeeded = true;
+  if (::VirtualAlloc(base_ptr, mapping_size, MEM_RESET, PAGE_READWRITE) ==
+          NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to discard buffer pool: " << ::common::LogWe(error)
+               << ".";
+    succeeded = false;
+  }
+
+  if (!::UnmapViewOfFile(base_ptr)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to unmap buffer pool: " << ::common::LogWe(error)
+               << ".";
+    succeeded = false;
+  }
+
+  return succeeded;
+}
+
 void BufferPool::SetClientHandle(HANDLE client_handle) {
   DCHECK(client_handle != NULL);
 
@@ -24,6 +24,7 @@
 #include <utility>
 #include <vector>
 
+#include "base/time/time.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/trace/rpc/call_trace_rpc.h"
 
@@ -59,6 +60,8 @@ struct Buffer : public ::CallTraceBuffer {
   Session* session;
   BufferPool* pool;
   BufferState state;
+  // The time at which the buffer entered its current state.
+  base::TimeTicks state_change_time;
 };
 
 // A BufferPool manages a collection of buffers that all belong to the same
@@ -72,12 +75,27 @@ class BufferPool {
   // @p num_buffers, each of size @p buffer_size.
   bool Init(Session* session, size_t num_buffers, size_t buffer_size);
 
+  // Allocates and maps a shared memory segment sufficiently large for
+  // @p num_buffers, each of size @p buffer_size, preferably in the physical
+  // memory of NUMA node @p numa_node. This may be NUMA_NO_PREFERRED_NODE to
+  // leave the placement to the system.
+  bool Init(Session* session,
+            size_t num_buffers,
+            size_t buffer_size,
+            uint32_t numa_node);
+
   // Updates each buffer in buffers_ with @p client_handle, which should be
   // a copy of handle_, valid in the client process these buffers are to be
   // shared with.
   // @p num_buffers, each of size @p buffer_size.
   void SetClientHandle(HANDLE client_handle);
 
+  // Tells the system that the contents of the pool are no longer needed, so
+  // that its pages can be reclaimed without being written to the pagefile.
+  // The pool remains usable, but its contents are undefined afterwards.
+  // @returns true on success, false otherwise.
+  bool Discard();
+
   Buffer* begin() { return &buffers_[0]; }
   Buffer* end() { return begin() + buffers_.size(); }
 
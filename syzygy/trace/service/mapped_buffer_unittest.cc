@@ -189,5 +189,17 @@ TEST_F(MappedBufferTest, MappedViewIsReaped) {
   EXPECT_EQ(MEM_FREE, info.State);
 }
 
+TEST_F(MappedBufferTest, MapBufferOfNumaPool) {
+  // A pool may be placed on a NUMA node, which every system has at least one
+  // of.
+  BufferPool numa_pool;
+  ASSERT_TRUE(numa_pool.Init(session.get(), 1, kBufferSize, 0));
+
+  TestMappedBuffer mb(numa_pool.begin());
+  ASSERT_TRUE(mb.Map());
+  ::memset(mb.data(), 0xCC, kBufferSize);
+  EXPECT_TRUE(mb.Unmap());
+}
+
 }  // namespace service
 }  // namespace trace
@@ -299,6 +299,39 @@ bool GetProcessNtHeaders(uint32_t pid,
   return true;
 }
 
+// Gets the NUMA node on which most of the processors that a process may run
+// on are. Returns NUMA_NO_PREFERRED_NODE if it can't be determined, or if
+// the system has a single node.
+uint32_t GetProcessNumaNode(HANDLE handle) {
+  DWORD_PTR process_mask = 0;
+  DWORD_PTR system_mask = 0;
+  ULONG highest_node = 0;
+  if (!::GetProcessAffinityMask(handle, &process_mask, &system_mask) ||
+      !::GetNumaHighestNodeNumber(&highest_node) || highest_node == 0) {
+    return NUMA_NO_PREFERRED_NODE;
+  }
+
+  uint32_t best_node = NUMA_NO_PREFERRED_NODE;
+  size_t best_count = 0;
+  for (ULONG node = 0; node <= highest_node; ++node) {
+    ULONGLONG node_mask = 0;
+    if (!::GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &node_mask))
+      continue;
+
+    // Count the processors of the node that the process may run on.
+    ULONGLONG mask = node_mask & process_mask;
+    size_t count = 0;
+    for (; mask != 0; mask &= mask - 1)
+      ++count;
+    if (count > best_count) {
+      best_node = node;
+      best_count = count;
+    }
+  }
+
+  return best_node;
+}
+
 }  // namespace
 
 ProcessInfo::ProcessInfo()
@@ -306,7 +339,8 @@ ProcessInfo::ProcessInfo()
       exe_base_address(0),
       exe_image_size(0),
       exe_checksum(0),
-      exe_time_date_stamp(0) {
+      exe_time_date_stamp(0),
+      numa_node(NUMA_NO_PREFERRED_NODE) {
   ::memset(&os_version_info, 0, sizeof(os_version_info));
   ::memset(&system_info, 0, sizeof(system_info));
   ::memset(&memory_status, 0, sizeof(memory_status));
@@ -328,6 +362,7 @@ void ProcessInfo::Reset() {
   exe_image_size = 0;
   exe_checksum = 0;
   exe_time_date_stamp = 0;
+  numa_node = NUMA_NO_PREFERRED_NODE;
 }
 
 bool ProcessInfo::Initialize(uint32_t pid) {
@@ -399,6 +434,9 @@ bool ProcessInfo::Initialize(uint32_t pid) {
   exe_checksum = nt_headers.OptionalHeader.CheckSum;
   exe_time_date_stamp = nt_headers.FileHeader.TimeDateStamp;
 
+  // This is only a placement hint, so failing to get it isn't an error.
+  numa_node = GetProcessNumaNode(process_handle.Get());
+
   return true;
 }
 
@@ -96,6 +96,10 @@ struct ProcessInfo {
   // The time/date stamp of the executable, taken from the NT headers.
   uint32_t exe_time_date_stamp;
 
+  // The NUMA node on which most of the processors the process may run on
+  // are, or NUMA_NO_PREFERRED_NODE if that is unknown.
+  uint32_t numa_node;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(ProcessInfo);
 };
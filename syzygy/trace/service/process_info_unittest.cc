@@ -104,10 +104,19 @@ TEST(ProcessInfoTest, CurrentProcess) {
   EXPECT_EQ(memory_status.ullTotalPhys,
             process_info.memory_status.ullTotalPhys);
 
+  ULONG highest_node = 0;
+  ASSERT_TRUE(::GetNumaHighestNodeNumber(&highest_node));
+  if (highest_node == 0) {
+    EXPECT_EQ(NUMA_NO_PREFERRED_NODE, process_info.numa_node);
+  } else {
+    EXPECT_LE(process_info.numa_node, highest_node);
+  }
+
   process_info.Reset();
   EXPECT_EQ(0, process_info.process_id);
   EXPECT_FALSE(process_info.process_handle.IsValid());
   EXPECT_TRUE(process_info.executable_path.empty());
+  EXPECT_EQ(NUMA_NO_PREFERRED_NODE, process_info.numa_node);
   EXPECT_TRUE(process_info.command_line.empty());
   EXPECT_EQ(0, process_info.environment.size());
   EXPECT_EQ(0, process_info.exe_base_address);
@@ -29,6 +29,7 @@
 #include "syzygy/common/align.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/common/rpc/helpers.h"
+#include "syzygy/trace/common/clock.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 #include "syzygy/trace/service/buffer_consumer.h"
 #include "syzygy/trace/service/session.h"
@@ -38,6 +39,8 @@ namespace service {
 
 const size_t Service::kDefaultBufferSize = 2 * 1024 * 1024;
 const size_t Service::kDefaultNumIncrementalBuffers = 16;
+const size_t Service::kDefaultMaxIncrementalBuffers = 128;
+const int Service::kDefaultIdlePoolTimeoutInSeconds = 30;
 
 // The choice of this value is not particularly important, but it should be
 // something that is relatively prime to the number of buffers created per
@@ -50,6 +53,9 @@ const size_t Service::kDefaultMaxBuffersPendingWrite = 13;
 Service::Service(BufferConsumerFactory* factory)
     : num_active_sessions_(0),
       num_incremental_buffers_(kDefaultNumIncrementalBuffers),
+      max_incremental_buffers_(kDefaultMaxIncrementalBuffers),
+      idle_pool_timeout_(
+          base::TimeDelta::FromSeconds(kDefaultIdlePoolTimeoutInSeconds)),
       buffer_size_in_bytes_(kDefaultBufferSize),
       max_buffers_pending_write_(kDefaultMaxBuffersPendingWrite),
       owner_thread_(base::PlatformThread::CurrentId()),
@@ -317,6 +323,11 @@ bool Service::Start(bool non_blocking) {
   if (!OpenServiceEvent())
     return false;
 
+  // Calibrate the TSC now, as it takes a while. Otherwise the first session
+  // would pay for it while its client waits on the RPC that creates it.
+  trace::common::TimerInfo tsc_info = {};
+  trace::common::GetTscTimerInfo(&tsc_info);
+
   if (!InitializeRpc()) {
     ReleaseServiceMutex();
     return false;
@@ -553,6 +564,30 @@ bool Service::CommitAndExchangeBuffer(SessionHandle session_handle,
   return result;
 }
 
+// RPC entry-point.
+bool Service::ReturnBuffers(SessionHandle session_handle,
+                            size_t num_buffers,
+                            CallTraceBuffer* call_trace_buffers) {
+  if (session_handle == NULL ||
+      (num_buffers != 0 && call_trace_buffers == NULL)) {
+    LOG(WARNING) << "Invalid RPC parameters.";
+    return false;
+  }
+
+  // The buffers are committed in order, so that the segments of each thread
+  // are written in the order in which they were filled. The buffers after
+  // one that fails are still returned.
+  bool result = true;
+  for (size_t i = 0; i < num_buffers; ++i) {
+    if (!CommitAndExchangeBuffer(session_handle, &call_trace_buffers[i],
+                                 DO_NOT_PERFORM_EXCHANGE)) {
+      result = false;
+    }
+  }
+
+  return result;
+}
+
 // RPC entry-point.
 bool Service::CloseSession(SessionHandle* session_handle) {
   if (session_handle == NULL || *session_handle == NULL) {
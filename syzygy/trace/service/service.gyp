@@ -43,8 +43,10 @@
       ],
       'dependencies': [
         '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/application/application.gyp:application_lib',
         '<(src)/syzygy/trace/common/common.gyp:trace_common_lib',
         '<(src)/syzygy/trace/rpc/rpc.gyp:call_trace_rpc_lib',
+        '<(src)/third_party/zlib/zlib.gyp:zlib',
       ],
     },
     {
@@ -71,6 +73,7 @@
         '<(src)/syzygy/pe/pe.gyp:pe_unittest_utils',
         '<(src)/testing/gtest.gyp:gtest',
         '<(src)/testing/gmock.gyp:gmock',
+        '<(src)/third_party/zlib/zlib.gyp:zlib',
       ],
     },
     {
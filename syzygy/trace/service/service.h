@@ -27,6 +27,7 @@
 #include "base/synchronization/condition_variable.h"
 #include "base/threading/platform_thread.h"
 #include "base/threading/thread.h"
+#include "base/time/time.h"
 #include "syzygy/trace/rpc/call_trace_rpc.h"
 
 namespace trace {
@@ -75,6 +76,14 @@ class Service {
   // pool allocated for a given client session.
   static const size_t kDefaultNumIncrementalBuffers;
 
+  // The default maximum number of buffers to allocate when expanding the
+  // buffer pool of a session that is short of buffers.
+  static const size_t kDefaultMaxIncrementalBuffers;
+
+  // The default time (in seconds) after which a session releases the buffer
+  // pools it hasn't used.
+  static const int kDefaultIdlePoolTimeoutInSeconds;
+
   // The default size (in bytes) for each call trace buffer.
   static const size_t kDefaultBufferSize;
 
@@ -92,8 +101,9 @@ class Service {
   // The flags value should be bitmask composed of the values from the
   // TraceEventType enumeration (see call_trace_defs.h).
   //
-  // @note TRACE_FLAG_BATCH_ENTER is mutually exclusive with all other flags.
-  //     If TRACE_FLAG_BATCH_ENTER is set, all other flags will be ignored.
+  // @note TRACE_FLAG_BATCH_ENTER is mutually exclusive with all other flags
+  //     but TRACE_FLAG_COMPACT_BATCH_ENTER. If TRACE_FLAG_BATCH_ENTER is set,
+  //     the other flags will be ignored.
   void set_flags(uint32_t flags) { flags_ = flags; }
 
   // Set the number of buffers by which to grow a sessions
@@ -102,6 +112,21 @@ class Service {
     num_incremental_buffers_ = n;
   }
 
+  // Sets the largest number of buffers by which to grow a session's buffer
+  // pool. Sessions that keep running out of buffers double the size of their
+  // allocations, starting from num_incremental_buffers, up to this cap.
+  // @param n the max number of buffers to allocate at once.
+  void set_max_incremental_buffers(size_t n) {
+    max_incremental_buffers_ = n;
+  }
+
+  // Sets the time after which a session releases the buffer pools that it
+  // hasn't used. A zero delay keeps the pools for the lifetime of the session.
+  // @param timeout the cool-down after which an idle pool is released.
+  void set_idle_pool_timeout(base::TimeDelta timeout) {
+    idle_pool_timeout_ = timeout;
+  }
+
   // Set the number of bytes comprising each buffer in a
   // sessions buffer pool.
   void set_buffer_size_in_bytes(size_t n) {
@@ -119,6 +144,12 @@ class Service {
   // @returns the number of new buffers to be created per allocation.
   size_t num_incremental_buffers() const { return num_incremental_buffers_; }
 
+  // @returns the maximum number of new buffers to be created per allocation.
+  size_t max_incremental_buffers() const { return max_incremental_buffers_; }
+
+  // @returns the time after which sessions release their idle buffer pools.
+  base::TimeDelta idle_pool_timeout() const { return idle_pool_timeout_; }
+
   // @returns the size (in bytes) of new buffers to be allocated.
   size_t buffer_size_in_bytes() const { return buffer_size_in_bytes_; }
 
@@ -193,6 +224,12 @@ class Service {
                                CallTraceBuffer* call_trace_buffer,
                                ExchangeFlag perform_exchange);
 
+  // RPC implementation of CallTraceService::ReturnBuffers(). See
+  // call_trace_rpc.idl for further info.
+  bool ReturnBuffers(SessionHandle session_handle,
+                     size_t num_buffers,
+                     CallTraceBuffer* call_trace_buffers);
+
   // RPC implementation of CallTraceService::CloseSession().
   // See call_trace_rpc.idl for further info.
   bool CloseSession(SessionHandle* session_handle);
@@ -268,6 +305,12 @@ class Service {
   // The number of buffers to allocate with each increment.
   size_t num_incremental_buffers_;
 
+  // The maximum number of buffers to allocate with each increment.
+  size_t max_incremental_buffers_;
+
+  // The time after which a session releases a pool it hasn't used.
+  base::TimeDelta idle_pool_timeout_;
+
   // The number of bytes in each buffer.
   size_t buffer_size_in_bytes_;
 
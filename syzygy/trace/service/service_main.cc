@@ -28,6 +28,7 @@
 #include "base/strings/string_piece.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/sys_info.h"
 #include "base/threading/thread.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/common/rpc/helpers.h"
@@ -89,7 +90,35 @@ const char kUsage[] =
     "                     The number of buffers by which to grow the buffer\n"
     "                     pool each time the client exhausts its available\n"
     "                     buffer space.\n"
+    "  --max-incremental-buffers=NUM\n"
+    "                     The largest number of buffers by which to grow\n"
+    "                     the buffer pool. A client that keeps exhausting\n"
+    "                     its buffers gets twice as many each time, up to\n"
+    "                     this number.\n"
+    "  --idle-pool-timeout=SECONDS\n"
+    "                     The time after which a session releases the\n"
+    "                     buffer pools it hasn't used. Zero keeps them for\n"
+    "                     the lifetime of the session.\n"
+    "  --writer-threads=NUM\n"
+    "                     The number of threads over which the sessions\n"
+    "                     spread the writing of their trace files. By\n"
+    "                     default all the sessions share a single thread.\n"
+    "  --compress[=THREADS]\n"
+    "                     Compress the segments of the trace files, on up\n"
+    "                     to THREADS threads per session (by default, as\n"
+    "                     many as there are processors).\n"
+    "  --stream-to=PIPE   Stream the traces to a parser waiting on the named\n"
+    "                     pipe PIPE, instead of writing them to trace files.\n"
+    "  --max-stream-buffers=NUM\n"
+    "                     The number of buffers that a stream lets wait for\n"
+    "                     a parser that falls behind. Beyond these, the\n"
+    "                     oldest buffers are dropped, and the drop is noted\n"
+    "                     in the stream. By default no buffer is dropped.\n"
     "  --enable-exits     Enable exit tracing (off by default).\n"
+    "  --compact-batch-enter\n"
+    "                     Have the clients record their batch entry traces\n"
+    "                     in a compact encoding. This is ignored along with\n"
+    "                     --enable-exits.\n"
     "  --verbose          Increase the logging verbosity to also include\n"
     "                     debug-level information.\n"
     "  --instance-id=ID   A unique identifier to use for the RPC endpoint.\n"
@@ -198,8 +227,51 @@ bool RunService(const base::CommandLine* cmd_line,
     call_trace_service.set_buffer_size_in_bytes(num);
   }
 
+  // Setup the writer threads.
+  std::wstring writer_threads_str(
+      cmd_line->GetSwitchValueNative("writer-threads"));
+  if (!writer_threads_str.empty()) {
+    int num = 0;
+    if (!base::StringToInt(writer_threads_str, &num) || num < 1) {
+      LOG(ERROR) << "Number of writer threads must be at least 1.";
+      return false;
+    }
+    if (!session_trace_file_writer_factory.StartWriterThreads(num))
+      return false;
+  }
+
+  // Setup the compression of the trace files.
+  if (cmd_line->HasSwitch("compress")) {
+    int num = base::SysInfo::NumberOfProcessors();
+    std::wstring compress_str(cmd_line->GetSwitchValueNative("compress"));
+    if (!compress_str.empty() &&
+        (!base::StringToInt(compress_str, &num) || num < 1)) {
+      LOG(ERROR) << "Number of compression threads must be at least 1.";
+      return false;
+    }
+    session_trace_file_writer_factory.set_compression_thread_count(num);
+  }
+
+  // Setup the streaming of the traces.
+  base::FilePath stream_pipe_path(cmd_line->GetSwitchValuePath("stream-to"));
+  if (!stream_pipe_path.empty())
+    session_trace_file_writer_factory.set_stream_pipe_path(stream_pipe_path);
+  std::wstring max_stream_buffers_str(
+      cmd_line->GetSwitchValueNative("max-stream-buffers"));
+  if (!max_stream_buffers_str.empty()) {
+    int num = 0;
+    if (!base::StringToInt(max_stream_buffers_str, &num) || num < 1) {
+      LOG(ERROR) << "Maximum number of stream buffers must be at least 1.";
+      return false;
+    }
+    session_trace_file_writer_factory.set_max_stream_buffers(num);
+  }
+
   if (cmd_line->HasSwitch("enable-exits")) {
     call_trace_service.set_flags(TRACE_FLAG_ENTER | TRACE_FLAG_EXIT);
+  } else if (cmd_line->HasSwitch("compact-batch-enter")) {
+    call_trace_service.set_flags(TRACE_FLAG_BATCH_ENTER |
+                                 TRACE_FLAG_COMPACT_BATCH_ENTER);
   }
 
   // Setup the number of incremental buffers
@@ -215,6 +287,34 @@ bool RunService(const base::CommandLine* cmd_line,
     call_trace_service.set_num_incremental_buffers(num);
   }
 
+  // Setup the cap on the growth of the buffer pools.
+  std::wstring max_buffers_str(
+      cmd_line->GetSwitchValueNative("max-incremental-buffers"));
+  if (!max_buffers_str.empty()) {
+    int num = 0;
+    if (!base::StringToInt(max_buffers_str, &num) ||
+        num < static_cast<int>(
+            call_trace_service.num_incremental_buffers())) {
+      LOG(ERROR) << "Maximum number of incremental buffers is smaller than "
+                 << "the number of incremental buffers.";
+      return false;
+    }
+    call_trace_service.set_max_incremental_buffers(num);
+  }
+
+  // Setup the release of the idle buffer pools.
+  std::wstring idle_timeout_str(
+      cmd_line->GetSwitchValueNative("idle-pool-timeout"));
+  if (!idle_timeout_str.empty()) {
+    int seconds = 0;
+    if (!base::StringToInt(idle_timeout_str, &seconds) || seconds < 0) {
+      LOG(ERROR) << "Idle pool timeout must not be negative.";
+      return false;
+    }
+    call_trace_service.set_idle_pool_timeout(
+        base::TimeDelta::FromSeconds(seconds));
+  }
+
   if (app_cmd_line->get() != NULL) {
     // Run the service in non-blocking mode.
     call_trace_service.Start(true);
@@ -76,6 +76,16 @@ boolean CallTraceService_ReturnBuffer(
                                            Service::DO_NOT_PERFORM_EXCHANGE);
 }
 
+// RPC entrypoint for CallTraceService::ReturnBuffers().
+boolean CallTraceService_ReturnBuffers(
+    /* [in] */ SessionHandle session_handle,
+    /* [in] */ unsigned long num_buffers,
+    /* [in] */ CallTraceBuffer* call_trace_buffers) {
+  Service* instance = RpcServiceInstanceManager::GetInstance();
+  return instance->ReturnBuffers(session_handle, num_buffers,
+                                 call_trace_buffers);
+}
+
 // RPC entrypoint for CallTraceService::CloseSession().
 boolean CallTraceService_CloseSession(
     /* [out][in] */ SessionHandle* session_handle) {
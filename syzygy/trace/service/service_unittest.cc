@@ -17,6 +17,7 @@
 #include <psapi.h>
 #include <userenv.h>
 #include <memory>
+#include <vector>
 
 #include "base/command_line.h"
 #include "base/environment.h"
@@ -270,6 +271,28 @@ class CallTraceServiceTest : public testing::Test {
     segment->header = NULL;
   }
 
+  void ReturnBuffers(SessionHandle session_handle,
+                     size_t num_segments,
+                     TraceFileSegment* segments) {
+    std::vector<CallTraceBuffer> buffers;
+    for (size_t i = 0; i < num_segments; ++i)
+      buffers.push_back(segments[i].buffer_info);
+
+    RpcStatus status = InvokeRpc(CallTraceClient_ReturnBuffers,
+                                 session_handle,
+                                 static_cast<unsigned long>(buffers.size()),
+                                 buffers.data());
+
+    ASSERT_FALSE(status.exception_occurred);
+    ASSERT_TRUE(status.result);
+
+    for (size_t i = 0; i < num_segments; ++i) {
+      segments[i].write_ptr = NULL;
+      segments[i].end_ptr = NULL;
+      segments[i].header = NULL;
+    }
+  }
+
   void CloseSession(SessionHandle* session_handle) {
     // Free all outstanding mappings associated with this session.
     FreeMappings();
@@ -516,9 +539,10 @@ TEST_F(CallTraceServiceTest, Connect) {
   TraceFileHeader* header =
       reinterpret_cast<TraceFileHeader*>(&trace_file_contents[0]);
 
+  // The process ended event is followed by the index of the trace file.
   ASSERT_NO_FATAL_FAILURE(ValidateTraceFileHeader(*header));
   ASSERT_EQ(trace_file_contents.length(),
-            RoundedSize(*header) + header->block_size);
+            RoundedSize(*header) + 2 * header->block_size);
 }
 
 TEST_F(CallTraceServiceTest, Allocate) {
@@ -558,7 +582,7 @@ TEST_F(CallTraceServiceTest, Allocate) {
 
   ASSERT_NO_FATAL_FAILURE(ValidateTraceFileHeader(*header));
   ASSERT_EQ(trace_file_contents.length(),
-            RoundedSize(*header) + 3 * header->block_size);
+            RoundedSize(*header) + 4 * header->block_size);
 
   // Locate and validate the segment header prefix and segment header.
   // This should be segment 2.
@@ -648,7 +672,7 @@ TEST_F(CallTraceServiceTest, AllocateLargeBuffer) {
 
   ASSERT_NO_FATAL_FAILURE(ValidateTraceFileHeader(*header));
   ASSERT_EQ(trace_file_contents.length(),
-            RoundedSize(*header) + 3 * header->block_size +
+            RoundedSize(*header) + 4 * header->block_size +
                 sizeof(LargeRecordType));
 
   // Locate and validate the segment header prefix and segment header.
@@ -740,11 +764,12 @@ TEST_F(CallTraceServiceTest, SendBuffer) {
 
   // Read and validate the trace file header. We expect to have written
   // the header (rounded up to a block) plus num_blocks of data,
-  // plus 1 block containing the process ended event.
+  // plus 1 block containing the process ended event, plus 1 block containing
+  // the index.
   TraceFileHeader* header =
       reinterpret_cast<TraceFileHeader*>(&trace_file_contents[0]);
   ASSERT_NO_FATAL_FAILURE(ValidateTraceFileHeader(*header));
-  size_t total_blocks = 1 + num_blocks;
+  size_t total_blocks = 2 + num_blocks;
   EXPECT_EQ(trace_file_contents.length(),
             RoundedSize(*header) + total_blocks * header->block_size);
 
@@ -811,5 +836,55 @@ TEST_F(CallTraceServiceTest, SendBuffer) {
             RawPtrDiff(prefix + 1, segment_header + 1));
 }
 
+TEST_F(CallTraceServiceTest, ReturnBuffers) {
+  SessionHandle session_handle = NULL;
+  TraceFileSegment segments[3];
+  const char* messages[] = {
+      "This is message number 1",
+      "The quick brown fox jumped over the lazy dog.",
+      "And now for something completely different ...",
+  };
+  ASSERT_EQ(arraysize(segments), arraysize(messages));
+
+  ASSERT_TRUE(call_trace_service_.Start(true));
+  ASSERT_NO_FATAL_FAILURE(CreateSession(&session_handle, &segments[0]));
+  for (size_t i = 1; i < arraysize(segments); ++i)
+    ASSERT_NO_FATAL_FAILURE(AllocateBuffer(session_handle, &segments[i]));
+
+  // Fill the buffers, and return them all at once.
+  for (size_t i = 0; i < arraysize(segments); ++i) {
+    MyRecordType* record = segments[i].AllocateTraceRecord<MyRecordType>();
+    base::strlcpy(record->message, messages[i], arraysize(record->message));
+  }
+  ASSERT_NO_FATAL_FAILURE(
+      ReturnBuffers(session_handle, arraysize(segments), segments));
+  ASSERT_NO_FATAL_FAILURE(CloseSession(&session_handle));
+  ASSERT_TRUE(call_trace_service_.Stop());
+
+  std::string trace_file_contents;
+  ASSERT_NO_FATAL_FAILURE(ReadTraceFile(&trace_file_contents));
+  TraceFileHeader* header =
+      reinterpret_cast<TraceFileHeader*>(&trace_file_contents[0]);
+  ASSERT_NO_FATAL_FAILURE(ValidateTraceFileHeader(*header));
+
+  // The segments are written in the order in which they were returned, and
+  // are followed by the process ended event and the index.
+  EXPECT_EQ(trace_file_contents.length(),
+            RoundedSize(*header) + 5 * header->block_size);
+  size_t segment_offset = AlignUp(header->header_size, header->block_size);
+  for (size_t i = 0; i < arraysize(segments); ++i) {
+    RecordPrefix* prefix = reinterpret_cast<RecordPrefix*>(
+        &trace_file_contents[0] + segment_offset);
+    ASSERT_EQ(prefix->type, TraceFileSegmentHeader::kTypeId);
+    TraceFileSegmentHeader* segment_header =
+        reinterpret_cast<TraceFileSegmentHeader*>(prefix + 1);
+    prefix = reinterpret_cast<RecordPrefix*>(segment_header + 1);
+    ASSERT_EQ(prefix->type, MyRecordType::kTypeId);
+    MyRecordType* record = reinterpret_cast<MyRecordType*>(prefix + 1);
+    EXPECT_STREQ(messages[i], record->message);
+    segment_offset += header->block_size;
+  }
+}
+
 }  // namespace service
 }  // namespace trace
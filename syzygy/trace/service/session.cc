@@ -23,10 +23,12 @@
 #include "syzygy/trace/service/session.h"
 
 #include <time.h>
+#include <algorithm>
 #include <memory>
 
 #include "base/command_line.h"
 #include "base/logging.h"
+#include "base/macros.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
 #include "syzygy/common/align.h"
@@ -59,6 +61,7 @@ Session::Session(Service* call_trace_service)
       buffer_requests_waiting_for_recycle_(0),
       buffer_is_available_(&lock_),
       buffer_id_(0),
+      next_incremental_buffers_(0),
       input_error_already_logged_(false) {
   DCHECK(call_trace_service != NULL);
   ::memset(buffer_state_counts_, 0, sizeof(buffer_state_counts_));
@@ -76,6 +79,17 @@ Session::~Session() {
   DCHECK_EQ(0u, buffer_state_counts_[Buffer::kInUse]);
   DCHECK_EQ(0u, buffer_state_counts_[Buffer::kPendingWrite]);
 
+  VLOG(1) << "Session for PID=" << client_.process_id << " allocated "
+          << statistics_.pools_allocated << " buffer pools and released "
+          << statistics_.pools_released << " of them, holding at most "
+          << statistics_.peak_buffer_count << " buffers. "
+          << statistics_.buffers_returned << " buffers were returned, in "
+          << (statistics_.buffers_returned == 0 ? 0 :
+                  statistics_.total_return_latency.InMilliseconds() /
+                      statistics_.buffers_returned)
+          << " ms on average and at most "
+          << statistics_.max_return_latency.InMilliseconds() << " ms.";
+
   // Not strictly necessary, but let's make sure nothing refers to the
   // client buffers before we delete the underlying memory.
   buffers_.clear();
@@ -147,6 +161,13 @@ bool Session::Close() {
   return true;
 }
 
+void Session::GetStatistics(Statistics* statistics) {
+  DCHECK(statistics != NULL);
+
+  base::AutoLock lock(lock_);
+  *statistics = statistics_;
+}
+
 bool Session::FindBuffer(CallTraceBuffer* call_trace_buffer,
                          Buffer** client_buffer) {
   DCHECK(call_trace_buffer != NULL);
@@ -220,6 +241,13 @@ bool Session::ReturnBuffer(Buffer* buffer) {
     if (is_closing_)
       return true;
 
+    // Keep track of how long the client held on to the buffer.
+    base::TimeDelta latency = GetTime() - buffer->state_change_time;
+    ++statistics_.buffers_returned;
+    statistics_.total_return_latency += latency;
+    statistics_.max_return_latency =
+        std::max(statistics_.max_return_latency, latency);
+
     ChangeBufferState(Buffer::kPendingWrite, buffer);
   }
 
@@ -255,6 +283,10 @@ bool Session::RecycleBuffer(Buffer* buffer) {
   buffers_available_.push_front(buffer);
   buffer_is_available_.Signal();
 
+  // Now that a buffer has come back, see whether the pools that have been
+  // idle for a while can be let go of.
+  ReleaseIdlePools();
+
   // If the session is closing and all outstanding buffers have been recycled
   // then it's safe to destroy this session.
   if (is_closing_ && buffer_state_counts_[Buffer::kInUse] == 0 &&
@@ -283,6 +315,7 @@ void Session::ChangeBufferState(BufferState new_state, Buffer* buffer) {
 
   // Apply the state change.
   buffer->state = new_state;
+  buffer->state_change_time = GetTime();
   buffer_state_counts_[old_state]--;
   buffer_state_counts_[new_state]++;
 }
@@ -342,7 +375,7 @@ bool Session::AllocateBufferPool(
 
   // Initialize the shared buffer pool.
   buffer_size = ::common::AlignUp(buffer_size, buffer_consumer_->block_size());
-  if (!pool->Init(this, num_buffers, buffer_size)) {
+  if (!pool->Init(this, num_buffers, buffer_size, client_.numa_node)) {
     LOG(ERROR) << "Failed to initialize shared memory buffer.";
     return false;
   }
@@ -372,6 +405,7 @@ bool Session::AllocateBufferPool(
 
   // Save the shared memory block so that it's managed by the session.
   shared_memory_buffers_.push_back(pool.get());
+  ++statistics_.pools_allocated;
   *out_pool = pool.release();
 
   return true;
@@ -390,16 +424,20 @@ bool Session::AllocateBuffers(size_t num_buffers, size_t buffer_size) {
 
   // Put the client buffers into the list of available buffers and update
   // the buffer state information.
+  base::TimeTicks now = GetTime();
   for (Buffer* buf = pool_ptr->begin(); buf != pool_ptr->end(); ++buf) {
     Buffer::ID buffer_id = Buffer::GetID(*buf);
 
     buf->state = Buffer::kAvailable;
+    buf->state_change_time = now;
     CHECK(buffers_.insert(std::make_pair(buffer_id, buf)).second);
 
     buffer_state_counts_[Buffer::kAvailable]++;
     buffers_available_.push_back(buf);
     buffer_is_available_.Signal();
   }
+  statistics_.peak_buffer_count =
+      std::max(statistics_.peak_buffer_count, buffers_.size());
 
   DCHECK(BufferBookkeepingIsConsistent());
 
@@ -425,8 +463,11 @@ bool Session::AllocateBufferForImmediateUse(size_t minimum_size,
 
   // Update the bookkeeping.
   buffer->state = Buffer::kInUse;
+  buffer->state_change_time = GetTime();
   CHECK(buffers_.insert(std::make_pair(buffer_id, buffer)).second);
   buffer_state_counts_[Buffer::kInUse]++;
+  statistics_.peak_buffer_count =
+      std::max(statistics_.peak_buffer_count, buffers_.size());
 
   DCHECK(BufferBookkeepingIsConsistent());
 
@@ -481,7 +522,7 @@ bool Session::GetNextBufferUnlocked(Buffer** out_buffer) {
       --buffer_requests_waiting_for_recycle_;
     } else {
       // Otherwise, force an allocation.
-      if (!AllocateBuffers(call_trace_service_->num_incremental_buffers(),
+      if (!AllocateBuffers(GetIncrementalBufferCount(),
                            call_trace_service_->buffer_size_in_bytes())) {
         return false;
       }
@@ -537,6 +578,7 @@ bool Session::DestroySingletonBuffer(Buffer* buffer) {
 
   // Remove the buffer from our buffer statistics.
   buffer_state_counts_[Buffer::kPendingWrite]--;
+  ++statistics_.pools_released;
   DCHECK(BufferBookkeepingIsConsistent());
 
   // Finally, delete the pool. This will clean up the buffer.
@@ -545,6 +587,102 @@ bool Session::DestroySingletonBuffer(Buffer* buffer) {
   return true;
 }
 
+size_t Session::GetIncrementalBufferCount() {
+  lock_.AssertAcquired();
+
+  size_t min_count = call_trace_service_->num_incremental_buffers();
+  size_t max_count =
+      std::max(min_count, call_trace_service_->max_incremental_buffers());
+  base::TimeDelta timeout = call_trace_service_->idle_pool_timeout();
+  base::TimeTicks now = GetTime();
+
+  // A client that hasn't been short of buffers for a while starts over with
+  // the smallest allocations.
+  if (next_incremental_buffers_ < min_count ||
+      (!timeout.is_zero() && now - last_growth_time_ >= timeout)) {
+    next_incremental_buffers_ = min_count;
+  }
+
+  size_t count = std::min(next_incremental_buffers_, max_count);
+  next_incremental_buffers_ = std::min(2 * count, max_count);
+  last_growth_time_ = now;
+
+  return count;
+}
+
+void Session::ReleaseIdlePools() {
+  lock_.AssertAcquired();
+
+  base::TimeDelta timeout = call_trace_service_->idle_pool_timeout();
+  if (is_closing_ || timeout.is_zero())
+    return;
+
+  // Looking for idle pools visits all of the buffers, so it's done only a few
+  // times per timeout.
+  base::TimeTicks now = GetTime();
+  if (now - last_idle_pool_check_ < timeout / 4)
+    return;
+  last_idle_pool_check_ = now;
+
+  SharedMemoryBufferCollection::iterator it = shared_memory_buffers_.begin();
+  while (it != shared_memory_buffers_.end() &&
+         shared_memory_buffers_.size() > 1) {
+    BufferPool* pool = *it;
+
+    bool is_idle = true;
+    for (Buffer* buf = pool->begin(); buf != pool->end(); ++buf) {
+      if (buf->state != Buffer::kAvailable ||
+          now - buf->state_change_time < timeout) {
+        is_idle = false;
+        break;
+      }
+    }
+
+    if (!is_idle) {
+      ++it;
+      continue;
+    }
+
+    it = shared_memory_buffers_.erase(it);
+    ReleasePool(pool);
+  }
+}
+
+void Session::ReleasePool(BufferPool* pool) {
+  DCHECK(pool != NULL);
+  lock_.AssertAcquired();
+
+  // Call our testing seam notification.
+  OnReleaseIdlePool(pool);
+
+  // Remove the buffers of the pool from the free list, the buffer map and the
+  // buffer statistics.
+  buffers_available_.erase(
+      std::remove_if(buffers_available_.begin(), buffers_available_.end(),
+                     [pool](Buffer* buf) { return buf->pool == pool; }),
+      buffers_available_.end());
+  for (Buffer* buf = pool->begin(); buf != pool->end(); ++buf) {
+    DCHECK_EQ(Buffer::kAvailable, buf->state);
+    CHECK_EQ(1u, buffers_.erase(Buffer::GetID(*buf)));
+    buffer_state_counts_[Buffer::kAvailable]--;
+  }
+  DCHECK(BufferBookkeepingIsConsistent());
+
+  VLOG(1) << "Releasing idle " << (pool->end() - pool->begin())
+          << "-buffer pool of PID=" << client_.process_id << ".";
+
+  // The client keeps its mapping of the pool, so discarding the contents of
+  // the pool is what lets the system reclaim its pages. The session only holds
+  // on to its own handle.
+  ignore_result(pool->Discard());
+  ++statistics_.pools_released;
+
+  // The client is no longer pressed for buffers.
+  next_incremental_buffers_ = 0;
+
+  delete pool;
+}
+
 bool Session::CreateProcessEndedEvent(Buffer** buffer) {
   DCHECK(buffer != NULL);
   lock_.AssertAcquired();
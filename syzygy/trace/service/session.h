@@ -26,6 +26,7 @@
 #include "base/process/process.h"
 #include "base/synchronization/condition_variable.h"
 #include "base/synchronization/lock.h"
+#include "base/time/time.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/trace/service/buffer_consumer.h"
 #include "syzygy/trace/service/buffer_pool.h"
@@ -45,6 +46,27 @@ class Session : public base::RefCountedThreadSafe<Session> {
  public:
   typedef base::ProcessId ProcessId;
 
+  // Statistics about the buffer management of a session.
+  struct Statistics {
+    Statistics()
+        : pools_allocated(0),
+          pools_released(0),
+          peak_buffer_count(0),
+          buffers_returned(0) {
+    }
+
+    // The number of shared memory pools allocated and released.
+    size_t pools_allocated;
+    size_t pools_released;
+    // The largest number of buffers the session has held at once.
+    size_t peak_buffer_count;
+    // The number of buffers returned by the client, and the time they spent
+    // in the client between being handed out and being returned.
+    size_t buffers_returned;
+    base::TimeDelta total_return_latency;
+    base::TimeDelta max_return_latency;
+  };
+
   explicit Session(Service* call_trace_service);
 
  public:
@@ -96,6 +118,10 @@ class Session : public base::RefCountedThreadSafe<Session> {
   bool FindBuffer(::CallTraceBuffer* call_trace_buffer,
                   Buffer** client_buffer);
 
+  // Gets the buffer management statistics of this session.
+  // @param statistics receives the statistics.
+  void GetStatistics(Statistics* statistics);
+
   // Returns the process id of the client process.
   ProcessId client_process_id() const { return client_.process_id; }
 
@@ -123,6 +149,11 @@ class Session : public base::RefCountedThreadSafe<Session> {
 
   virtual void OnDestroySingletonBuffer(Buffer* buffer) { }
 
+  virtual void OnReleaseIdlePool(BufferPool* pool) { }
+
+  // @returns the current time. This is used to time the buffers and pools.
+  virtual base::TimeTicks GetTime() { return base::TimeTicks::Now(); }
+
   // Initialize process information for @p process_id.
   // @param process_id the process we want to capture information for.
   // @param client the record where we store the captured info.
@@ -193,6 +224,27 @@ class Session : public base::RefCountedThreadSafe<Session> {
   //     a single buffer.
   bool DestroySingletonBuffer(Buffer* buffer);
 
+  // Gets the number of buffers by which to grow the buffer pool. This doubles
+  // on each consecutive allocation, starting from the service's
+  // num_incremental_buffers, up to its max_incremental_buffers. It starts over
+  // once the session has gone an idle pool timeout without growing.
+  // @returns the number of buffers to allocate.
+  // @pre Under lock_.
+  size_t GetIncrementalBufferCount();
+
+  // Releases the pools whose buffers have all been available for longer than
+  // the service's idle pool timeout. At least one pool is kept, so that a
+  // client that resumes doesn't immediately cause an allocation.
+  // @pre Under lock_.
+  void ReleaseIdlePools();
+
+  // Releases a pool whose buffers are all available. The contents of the pool
+  // are discarded before the session lets go of it, as the client keeps its
+  // mapping of the pool until the end of the session.
+  // @param pool the pool to release.
+  // @pre Under lock_.
+  void ReleasePool(BufferPool* pool);
+
   // Transitions the buffer to the given state. This only updates the buffer's
   // internal state and buffer_state_counts_, but not buffers_available_.
   // DCHECKs on any attempted invalid state changes.
@@ -258,6 +310,17 @@ class Session : public base::RefCountedThreadSafe<Session> {
   // state.
   base::Lock lock_;
 
+  // The number of buffers the next growth of the buffer pool will allocate,
+  // and the time of the last growth.
+  size_t next_incremental_buffers_;  // Under lock_.
+  base::TimeTicks last_growth_time_;  // Under lock_.
+
+  // The last time the pools were checked for idleness.
+  base::TimeTicks last_idle_pool_check_;  // Under lock_.
+
+  // The buffer management statistics.
+  Statistics statistics_;  // Under lock_.
+
   // Tracks whether or not invalid input errors have already been logged.
   // When an error of this type occurs, there will typically be numerous
   // follow-on occurrences that we don't want to log.
@@ -19,8 +19,14 @@
 
 #include "syzygy/trace/service/session_trace_file_writer.h"
 
+#include <algorithm>
+#include <memory>
+#include <string>
+
 #include "base/bind.h"
 #include "base/files/file_util.h"
+#include "base/strings/stringprintf.h"
+#include "syzygy/common/align.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 #include "syzygy/trace/service/buffer_pool.h"
 #include "syzygy/trace/service/mapped_buffer.h"
@@ -29,10 +35,20 @@
 namespace trace {
 namespace service {
 
+namespace {
+
+const size_t kSegmentHeaderLength =
+    sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+
+}  // namespace
+
 SessionTraceFileWriter::SessionTraceFileWriter(
     base::MessageLoop* message_loop, const base::FilePath& trace_directory)
     : message_loop_(message_loop),
-      trace_file_path_(trace_directory) {
+      trace_file_path_(trace_directory),
+      max_pending_buffers_(0),
+      dropped_buffer_count_(0),
+      dropped_byte_count_(0) {
   DCHECK(message_loop != NULL);
   DCHECK(!trace_directory.empty());
 }
@@ -40,6 +56,12 @@ SessionTraceFileWriter::SessionTraceFileWriter(
 bool SessionTraceFileWriter::Open(Session* session) {
   DCHECK(session != NULL);
 
+  if (!stream_pipe_path_.empty()) {
+    trace_file_path_ = stream_pipe_path_;
+    return writer_.OpenPipe(stream_pipe_path_) &&
+           writer_.WriteHeader(session->client_info());
+  }
+
   if (!base::CreateDirectory(trace_file_path_)) {
     LOG(ERROR) << "Failed to create trace directory: '"
                << trace_file_path_.value() << "'.";
@@ -62,7 +84,20 @@ bool SessionTraceFileWriter::Open(Session* session) {
 }
 
 bool SessionTraceFileWriter::Close(Session* /* session */) {
-  return true;
+  // A session that failed to open has nothing to close.
+  if (writer_.path().empty())
+    return true;
+
+  if (dropped_buffer_count_ != 0) {
+    LOG(WARNING) << "Dropped " << dropped_buffer_count_ << " buffers ("
+                 << dropped_byte_count_ << " bytes) of the stream to '"
+                 << trace_file_path_.value() << "'.";
+  }
+
+  // The session only closes its consumer once all of its buffers have been
+  // written and recycled, so the trace file is no longer in use. Closing it
+  // appends the index of its segments.
+  return writer_.Close();
 }
 
 bool SessionTraceFileWriter::ConsumeBuffer(Buffer* buffer) {
@@ -70,11 +105,19 @@ bool SessionTraceFileWriter::ConsumeBuffer(Buffer* buffer) {
   DCHECK(buffer->session != NULL);
   DCHECK(message_loop_ != NULL);
 
-  message_loop_->PostTask(FROM_HERE,
-                          base::Bind(&SessionTraceFileWriter::WriteBuffer,
-                                     this,
-                                     scoped_refptr<Session>(buffer->session),
-                                     base::Unretained(buffer)));
+  // Only post a task for the first pending buffer. The buffers that come in
+  // before it runs are written by the same task.
+  {
+    base::AutoLock auto_lock(pending_buffers_lock_);
+    pending_buffers_.push_back(
+        PendingBuffer(scoped_refptr<Session>(buffer->session), buffer));
+    if (pending_buffers_.size() > 1)
+      return true;
+  }
+
+  message_loop_->PostTask(
+      FROM_HERE,
+      base::Bind(&SessionTraceFileWriter::WritePendingBuffers, this));
 
   return true;
 }
@@ -83,32 +126,180 @@ size_t SessionTraceFileWriter::block_size() const {
   return writer_.block_size();
 }
 
-void SessionTraceFileWriter::WriteBuffer(scoped_refptr<Session> session,
-                                         Buffer* buffer) {
-  DCHECK(session != NULL);
-  DCHECK(buffer != NULL);
-  DCHECK_EQ(session, buffer->session);
-  DCHECK_EQ(Buffer::kPendingWrite, buffer->state);
+void SessionTraceFileWriter::WritePendingBuffers() {
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+
+  PendingBuffers buffers;
+  {
+    base::AutoLock auto_lock(pending_buffers_lock_);
+    buffers.swap(pending_buffers_);
+  }
+
+  // A parser that falls behind the stream loses the oldest buffers in excess,
+  // rather than holding up the clients. The drop is reported where it
+  // happened in the stream.
+  if (!stream_pipe_path_.empty() && max_pending_buffers_ != 0 &&
+      buffers.size() > max_pending_buffers_) {
+    uint64_t byte_count = 0;
+    size_t buffer_count = DropBuffers(buffers.size() - max_pending_buffers_,
+                                      &buffers, &byte_count);
+    if (buffer_count != 0) {
+      dropped_buffer_count_ += buffer_count;
+      dropped_byte_count_ += byte_count;
+      WriteDropComment(buffer_count, byte_count);
+    }
+  }
+
+  // Write the buffers in groups, to bound the number of views that are
+  // mapped at once.
+  for (size_t i = 0; i < buffers.size(); i += kMaxBuffersPerWrite) {
+    size_t end = std::min(i + kMaxBuffersPerWrite, buffers.size());
+    WriteBuffers(PendingBuffers(buffers.begin() + i, buffers.begin() + end));
+  }
+}
+
+void SessionTraceFileWriter::WriteBuffers(const PendingBuffers& buffers) {
   DCHECK_EQ(base::MessageLoop::current(), message_loop_);
 
-  MappedBuffer mapped_buffer(buffer);
-  if (!mapped_buffer.Map())
-    return;
+  std::vector<std::unique_ptr<MappedBuffer>> mapped_buffers;
+  TraceFileWriter::Records records;
+  for (const PendingBuffer& pending : buffers) {
+    Buffer* buffer = pending.second;
+    DCHECK(pending.first != NULL);
+    DCHECK(buffer != NULL);
+    DCHECK_EQ(pending.first, buffer->session);
+    DCHECK_EQ(Buffer::kPendingWrite, buffer->state);
+
+    // A buffer that can't be mapped is neither written nor recycled.
+    std::unique_ptr<MappedBuffer> mapped_buffer(new MappedBuffer(buffer));
+    if (!mapped_buffer->Map()) {
+      mapped_buffers.push_back(std::unique_ptr<MappedBuffer>());
+      continue;
+    }
+
+    TraceFileWriter::Record record = { mapped_buffer->data(),
+                                       buffer->buffer_size };
+    records.push_back(record);
+    mapped_buffers.push_back(std::move(mapped_buffer));
+  }
 
   // We deliberately ignore the return status. However, this will log if
   // anything goes wrong.
-  writer_.WriteRecord(mapped_buffer.data(), buffer->buffer_size);
-
-  // It's entirely possible for this buffer to be handed out to another client
-  // and for the service to be forcibly shutdown before the client has had a
-  // chance to even touch the buffer. In that case, we'll end up writing the
-  // buffer again. We clear the RecordPrefix and the TraceFileSegmentHeader so
-  // that we'll at least see the buffer as empty and write nothing.
-  ::memset(mapped_buffer.data(), 0,
-           sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader));
-
-  mapped_buffer.Unmap();
-  session->RecycleBuffer(buffer);
+  writer_.WriteRecords(records);
+
+  for (size_t i = 0; i < buffers.size(); ++i) {
+    if (mapped_buffers[i].get() == NULL)
+      continue;
+
+    // It's entirely possible for this buffer to be handed out to another
+    // client and for the service to be forcibly shutdown before the client
+    // has had a chance to even touch the buffer. In that case, we'll end up
+    // writing the buffer again. We clear the RecordPrefix and the
+    // TraceFileSegmentHeader so that we'll at least see the buffer as empty
+    // and write nothing.
+    ::memset(mapped_buffers[i]->data(), 0,
+             sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader));
+
+    mapped_buffers[i]->Unmap();
+    buffers[i].first->RecycleBuffer(buffers[i].second);
+  }
+}
+
+size_t SessionTraceFileWriter::DropBuffers(size_t drop_count,
+                                           PendingBuffers* buffers,
+                                           uint64_t* byte_count) {
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+  DCHECK(buffers != NULL);
+  DCHECK(byte_count != NULL);
+
+  *byte_count = 0;
+  size_t dropped = 0;
+  PendingBuffers kept_buffers;
+  kept_buffers.reserve(buffers->size());
+  for (const PendingBuffer& pending : *buffers) {
+    Buffer* buffer = pending.second;
+    DCHECK_EQ(Buffer::kPendingWrite, buffer->state);
+    if (dropped == drop_count || buffer->buffer_size < kSegmentHeaderLength) {
+      kept_buffers.push_back(pending);
+      continue;
+    }
+
+    // A buffer that can't be mapped is left for WriteBuffers to report.
+    MappedBuffer mapped_buffer(buffer);
+    if (!mapped_buffer.Map()) {
+      kept_buffers.push_back(pending);
+      continue;
+    }
+
+    TraceFileIndexEntry entry = {};
+    TraceFileWriter::GetIndexEntry(mapped_buffer.data(), buffer->buffer_size,
+                                   &entry);
+    if ((entry.flags & (TraceFileIndexEntry::kHasModuleEvents |
+                        TraceFileIndexEntry::kHasProcessEnded)) != 0) {
+      kept_buffers.push_back(pending);
+      continue;
+    }
+
+    // The buffer is cleared as if it had been written, as it may be handed
+    // out again before its client touches it.
+    const TraceFileSegmentHeader* header =
+        reinterpret_cast<const TraceFileSegmentHeader*>(
+            mapped_buffer.data() + sizeof(RecordPrefix));
+    *byte_count += std::min<size_t>(header->segment_length,
+                                    buffer->buffer_size - kSegmentHeaderLength);
+    ::memset(mapped_buffer.data(), 0, kSegmentHeaderLength);
+    mapped_buffer.Unmap();
+    pending.first->RecycleBuffer(buffer);
+    ++dropped;
+  }
+
+  buffers->swap(kept_buffers);
+  return dropped;
+}
+
+void SessionTraceFileWriter::WriteDropComment(size_t buffer_count,
+                                              uint64_t byte_count) {
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+
+  std::string comment = base::StringPrintf(
+      "Dropped %d buffers (%llu bytes) of the stream.",
+      static_cast<int>(buffer_count), byte_count);
+
+  // The comment is a segment of its own, with a single event. It belongs to
+  // no thread, like the end of the process.
+  const size_t event_size = offsetof(TraceComment, comment) + comment.size();
+  const size_t segment_length = sizeof(RecordPrefix) + event_size;
+  std::vector<uint8_t> data(::common::AlignUp(
+      kSegmentHeaderLength + segment_length, writer_.block_size()));
+
+  uint64_t timestamp = trace::common::GetTsc();
+  RecordPrefix* segment_prefix = reinterpret_cast<RecordPrefix*>(data.data());
+  segment_prefix->timestamp = timestamp;
+  segment_prefix->size = sizeof(TraceFileSegmentHeader);
+  segment_prefix->type = TraceFileSegmentHeader::kTypeId;
+  segment_prefix->version.hi = TRACE_VERSION_HI;
+  segment_prefix->version.lo = TRACE_VERSION_LO;
+
+  TraceFileSegmentHeader* segment_header =
+      reinterpret_cast<TraceFileSegmentHeader*>(segment_prefix + 1);
+  segment_header->thread_id = 0;
+  segment_header->segment_length = static_cast<uint32_t>(segment_length);
+
+  RecordPrefix* event_prefix =
+      reinterpret_cast<RecordPrefix*>(segment_header + 1);
+  event_prefix->timestamp = timestamp;
+  event_prefix->size = static_cast<uint32_t>(event_size);
+  event_prefix->type = TRACE_COMMENT;
+  event_prefix->version.hi = TRACE_VERSION_HI;
+  event_prefix->version.lo = TRACE_VERSION_LO;
+
+  TraceComment* event = reinterpret_cast<TraceComment*>(event_prefix + 1);
+  event->comment_size = static_cast<uint32_t>(comment.size());
+  ::memcpy(event->comment, comment.data(), comment.size());
+
+  // We deliberately ignore the return status, as WriteRecord logs on
+  // failure.
+  writer_.WriteRecord(data.data(), data.size());
 }
 
 }  // namespace service
@@ -19,7 +19,11 @@
 #ifndef SYZYGY_TRACE_SERVICE_SESSION_TRACE_FILE_WRITER_H_
 #define SYZYGY_TRACE_SERVICE_SESSION_TRACE_FILE_WRITER_H_
 
+#include <utility>
+#include <vector>
+
 #include "base/files/file_path.h"
+#include "base/synchronization/lock.h"
 #include "base/threading/thread.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/trace/service/buffer_consumer.h"
@@ -33,7 +37,9 @@ class Session;
 class SessionTraceFileWriterFactory;
 
 // This class implements the interface the buffer consumer thread uses to
-// process incoming buffers.
+// process incoming buffers. The buffers that are consumed while others are
+// waiting to be written are written along with them, so that a busy writer
+// coalesces them into as few writes as possible.
 class SessionTraceFileWriter : public BufferConsumer {
  public:
   // Construct a SessionTraceFileWriter instance.
@@ -54,9 +60,76 @@ class SessionTraceFileWriter : public BufferConsumer {
   size_t block_size() const override;
   // @}
 
+  // Makes this writer compress the segments of the trace file.
+  // @param thread_count The maximum number of threads on which to compress
+  //     each group of buffers.
+  void EnableCompression(size_t thread_count) {
+    writer_.EnableCompression(thread_count);
+  }
+
+  // Makes this writer stream the trace to a parser over a named pipe, rather
+  // than write it to the trace directory.
+  // @param pipe_path The name of the pipe on which the parser is waiting.
+  void StreamTo(const base::FilePath& pipe_path) {
+    stream_pipe_path_ = pipe_path;
+  }
+
+  // Bounds the number of buffers that wait to be streamed. When the parser
+  // falls behind, the oldest buffers in excess are dropped rather than left
+  // to exhaust the buffer pools of the clients. The buffers holding module
+  // events or the end of the process are kept, as the parser needs them to
+  // make sense of the other buffers. Each drop is reported in the stream by
+  // a comment event. This has no effect on traces written to files.
+  // @param max_pending_buffers The maximum number of buffers waiting to be
+  //     streamed, or zero for no maximum.
+  void set_max_pending_buffers(size_t max_pending_buffers) {
+    max_pending_buffers_ = max_pending_buffers;
+  }
+
+  // @name Accessors.
+  // These may only be used on message_loop_, or once the writer is closed.
+  // @{
+  size_t max_pending_buffers() const { return max_pending_buffers_; }
+  size_t dropped_buffer_count() const { return dropped_buffer_count_; }
+  uint64_t dropped_byte_count() const { return dropped_byte_count_; }
+  // @}
+
  protected:
-  // Commit a trace buffer to disk. This will be called on message_loop_.
-  void WriteBuffer(scoped_refptr<Session>, Buffer* buffer);
+  // A buffer waiting to be written, with a reference to its session to keep
+  // it alive until the buffer has been recycled.
+  typedef std::pair<scoped_refptr<Session>, Buffer*> PendingBuffer;
+  typedef std::vector<PendingBuffer> PendingBuffers;
+
+  // The maximum number of buffers that are mapped and written at once.
+  static const size_t kMaxBuffersPerWrite = 16;
+
+  // Commits the pending trace buffers to disk. This will be called on
+  // message_loop_.
+  void WritePendingBuffers();
+
+  // Commits trace buffers to disk, and recycles them. This will be called on
+  // message_loop_.
+  // @param buffers The buffers to commit.
+  void WriteBuffers(const PendingBuffers& buffers);
+
+  // Drops the oldest buffers that can be dropped, and recycles them without
+  // writing them. This will be called on message_loop_.
+  // @param drop_count The number of buffers to drop.
+  // @param buffers The buffers waiting to be written. The dropped buffers are
+  //     removed from these.
+  // @param byte_count Receives the number of bytes of trace data that were
+  //     dropped.
+  // @returns the number of buffers that were dropped. This is less than
+  //     drop_count if too many of the buffers have to be kept.
+  size_t DropBuffers(size_t drop_count,
+                     PendingBuffers* buffers,
+                     uint64_t* byte_count);
+
+  // Writes a comment event reporting dropped buffers. This will be called on
+  // message_loop_.
+  // @param buffer_count The number of buffers that were dropped.
+  // @param byte_count The number of bytes of trace data that were dropped.
+  void WriteDropComment(size_t buffer_count, uint64_t byte_count);
 
   // The message loop on which this trace file writer will do IO.
   base::MessageLoop* const message_loop_;
@@ -66,9 +139,32 @@ class SessionTraceFileWriter : public BufferConsumer {
   // Open().
   base::FilePath trace_file_path_;
 
+  // The name of the pipe to which the trace is streamed, or empty if it is
+  // written to a trace file.
+  base::FilePath stream_pipe_path_;
+
   // This is used for committing actual buffers to disk.
   TraceFileWriter writer_;
 
+  // The buffers that have been consumed but not written yet, in the order in
+  // which they were consumed. A task to write them is pending whenever this
+  // isn't empty.
+  PendingBuffers pending_buffers_;
+
+  // Protects pending_buffers_, which is accessed from the threads that
+  // consume the buffers and from message_loop_.
+  base::Lock pending_buffers_lock_;
+
+  // The maximum number of buffers waiting to be streamed, or zero for no
+  // maximum.
+  size_t max_pending_buffers_;
+
+  // The numbers of buffers and of bytes of trace data that were dropped
+  // from the stream. These are only accessed on message_loop_ while the
+  // writer is open.
+  size_t dropped_buffer_count_;
+  uint64_t dropped_byte_count_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(SessionTraceFileWriter);
 };
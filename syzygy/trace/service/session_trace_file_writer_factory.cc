@@ -16,6 +16,8 @@
 
 #include "base/files/file_util.h"
 #include "base/message_loop/message_loop.h"
+#include "base/strings/stringprintf.h"
+#include "base/threading/thread.h"
 #include "syzygy/trace/service/session_trace_file_writer.h"
 
 namespace trace {
@@ -23,11 +25,41 @@ namespace service {
 
 SessionTraceFileWriterFactory::SessionTraceFileWriterFactory(
     base::MessageLoop* message_loop)
-    : message_loop_(message_loop), trace_file_directory_(L".") {
+    : message_loop_(message_loop),
+      trace_file_directory_(L"."),
+      next_writer_thread_(0),
+      compression_thread_count_(0),
+      max_stream_buffers_(0) {
   DCHECK(message_loop != NULL);
   DCHECK_EQ(base::MessageLoop::TYPE_IO, message_loop->type());
 }
 
+SessionTraceFileWriterFactory::~SessionTraceFileWriterFactory() {
+  for (auto& thread : writer_threads_)
+    thread->Stop();
+}
+
+bool SessionTraceFileWriterFactory::StartWriterThreads(size_t thread_count) {
+  DCHECK_LT(0u, thread_count);
+  DCHECK(writer_threads_.empty());
+
+  std::vector<std::unique_ptr<base::Thread>> threads;
+  for (size_t i = 0; i < thread_count; ++i) {
+    std::unique_ptr<base::Thread> thread(new base::Thread(
+        base::StringPrintf("trace-file-writer-%d", static_cast<int>(i))));
+    if (!thread->StartWithOptions(
+            base::Thread::Options(base::MessageLoop::TYPE_IO, 0))) {
+      LOG(ERROR) << "Failed to start trace file writer thread.";
+      return false;
+    }
+    threads.push_back(std::move(thread));
+  }
+
+  base::AutoLock auto_lock(lock_);
+  writer_threads_.swap(threads);
+  return true;
+}
+
 bool SessionTraceFileWriterFactory::SetTraceFileDirectory(
     const base::FilePath& path) {
   DCHECK(!path.empty());
@@ -46,8 +78,27 @@ bool SessionTraceFileWriterFactory::CreateConsumer(
   DCHECK(consumer != NULL);
   DCHECK(message_loop_ != NULL);
 
+  // Pick the message loop of the new trace file writer, spreading the
+  // writers over the dedicated writer threads if there are any.
+  base::MessageLoop* message_loop = message_loop_;
+  {
+    base::AutoLock auto_lock(lock_);
+    if (!writer_threads_.empty()) {
+      message_loop = writer_threads_[next_writer_thread_]->message_loop();
+      next_writer_thread_ = (next_writer_thread_ + 1) % writer_threads_.size();
+    }
+  }
+
   // Allocate a new trace file writer.
-  *consumer = new SessionTraceFileWriter(message_loop_, trace_file_directory_);
+  scoped_refptr<SessionTraceFileWriter> writer(
+      new SessionTraceFileWriter(message_loop, trace_file_directory_));
+  if (compression_thread_count_ != 0)
+    writer->EnableCompression(compression_thread_count_);
+  if (!stream_pipe_path_.empty()) {
+    writer->StreamTo(stream_pipe_path_);
+    writer->set_max_pending_buffers(max_stream_buffers_);
+  }
+  *consumer = writer;
   return true;
 }
 
@@ -18,7 +18,9 @@
 #ifndef SYZYGY_TRACE_SERVICE_SESSION_TRACE_FILE_WRITER_FACTORY_H_
 #define SYZYGY_TRACE_SERVICE_SESSION_TRACE_FILE_WRITER_FACTORY_H_
 
+#include <memory>
 #include <set>
+#include <vector>
 
 #include "base/files/file_path.h"
 #include "base/synchronization/lock.h"
@@ -26,7 +28,10 @@
 #include "syzygy/trace/service/buffer_consumer.h"
 
 // Forward declaration.
-namespace base { class MessageLoop; }
+namespace base {
+class MessageLoop;
+class Thread;
+}  // namespace base
 
 namespace trace {
 namespace service {
@@ -44,6 +49,10 @@ class SessionTraceFileWriterFactory : public BufferConsumerFactory {
   //     must outlive the factory instance.
   explicit SessionTraceFileWriterFactory(base::MessageLoop* message_loop);
 
+  // Destructor. This stops the writer threads, so all the trace file writers
+  // created by this factory must have been closed.
+  ~SessionTraceFileWriterFactory();
+
   // @name BufferConsumerFactory implementation.
   // @{
   virtual bool CreateConsumer(scoped_refptr<BufferConsumer>* consumer) override;
@@ -53,9 +62,53 @@ class SessionTraceFileWriterFactory : public BufferConsumerFactory {
   // file writers will output trace files.
   bool SetTraceFileDirectory(const base::FilePath& path);
 
+  // Starts dedicated writer threads. The trace file writers that are
+  // subsequently created are spread over these threads rather than all doing
+  // their IO on message_loop(), so that the sessions don't have to wait for
+  // each other's writes. This may only be called once.
+  // @param thread_count The number of writer threads to start.
+  // @returns true on success, false otherwise.
+  bool StartWriterThreads(size_t thread_count);
+
+  // Sets the number of threads on which the subsequently created trace file
+  // writers compress their segments. Zero, the default, leaves the trace
+  // files uncompressed.
+  // @param thread_count The number of threads on which to compress.
+  void set_compression_thread_count(size_t thread_count) {
+    compression_thread_count_ = thread_count;
+  }
+
+  // Makes the subsequently created trace file writers stream their traces to
+  // a parser over a named pipe, instead of writing them to the trace file
+  // directory. Each session connects to its own instance of the pipe.
+  // @param pipe_path The name of the pipe, or empty to write trace files.
+  void set_stream_pipe_path(const base::FilePath& pipe_path) {
+    stream_pipe_path_ = pipe_path;
+  }
+
+  // Sets the maximum number of buffers that each stream lets wait for the
+  // parser before it drops the oldest ones. Zero, the default, never drops
+  // buffers.
+  // @param max_buffers The maximum number of buffers waiting to be streamed.
+  void set_max_stream_buffers(size_t max_buffers) {
+    max_stream_buffers_ = max_buffers;
+  }
+
   // Get the message loop the trace file writers should use for IO.
   base::MessageLoop* message_loop() { return message_loop_; }
 
+  // @returns the number of dedicated writer threads.
+  size_t writer_thread_count() const { return writer_threads_.size(); }
+
+  // @returns the number of threads on which the trace files are compressed.
+  size_t compression_thread_count() const { return compression_thread_count_; }
+
+  // @returns the name of the pipe to which the traces are streamed.
+  const base::FilePath& stream_pipe_path() const { return stream_pipe_path_; }
+
+  // @returns the maximum number of buffers waiting to be streamed.
+  size_t max_stream_buffers() const { return max_stream_buffers_; }
+
  protected:
   // The message loop the trace file writers should use for IO.
   base::MessageLoop* const message_loop_;
@@ -69,6 +122,25 @@ class SessionTraceFileWriterFactory : public BufferConsumerFactory {
   // Used to protect access to the set of active consumers.
   base::Lock lock_;
 
+  // The dedicated writer threads, if any.
+  std::vector<std::unique_ptr<base::Thread>> writer_threads_;
+
+  // The writer thread on which the next trace file writer will do IO.
+  // Protected by lock_.
+  size_t next_writer_thread_;
+
+  // The number of threads on which the trace file writers compress their
+  // segments, or zero if they don't compress them.
+  size_t compression_thread_count_;
+
+  // The name of the pipe to which the traces are streamed, or empty if they
+  // are written to trace files.
+  base::FilePath stream_pipe_path_;
+
+  // The maximum number of buffers waiting to be streamed, or zero for no
+  // maximum.
+  size_t max_stream_buffers_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(SessionTraceFileWriterFactory);
 };
@@ -149,7 +149,9 @@ class TestSession : public Session {
         last_singleton_buffer_destroyed_(NULL),
         singleton_buffers_destroyed_(0),
         allocating_buffers_(&lock_),
-        allocating_buffers_state_(false) {
+        allocating_buffers_state_(false),
+        last_idle_pool_released_(NULL),
+        now_(base::TimeTicks::Now()) {
   }
 
   void AllowBuffersToBeRecycled(size_t num_buffers) {
@@ -193,6 +195,22 @@ class TestSession : public Session {
     waiting_for_buffer_to_be_recycled_state_ = false;
   }
 
+  void AdvanceTime(base::TimeDelta delta) {
+    base::AutoLock lock(lock_);
+    now_ += delta;
+  }
+
+  bool AllocateUnusedBuffers(size_t count) {
+    base::AutoLock lock(lock_);
+    size_t size = call_trace_service_->buffer_size_in_bytes();
+    return Session::AllocateBuffers(count, size);
+  }
+
+  void ReleaseIdlePoolsNow() {
+    base::AutoLock lock(lock_);
+    ReleaseIdlePools();
+  }
+
   size_t buffer_requests_waiting_for_recycle() {
     base::AutoLock lock(lock_);
     return buffer_requests_waiting_for_recycle_;
@@ -212,6 +230,16 @@ class TestSession : public Session {
     destroying_singleton_buffer_.Signal();
   }
 
+  void OnReleaseIdlePool(BufferPool* pool) override {
+    lock_.AssertAcquired();
+    last_idle_pool_released_ = pool;
+  }
+
+  base::TimeTicks GetTime() override {
+    lock_.AssertAcquired();
+    return now_;
+  }
+
   bool InitializeProcessInfo(ProcessId process_id,
                              ProcessInfo* client) override {
     DCHECK(client != NULL);
@@ -242,6 +270,7 @@ class TestSession : public Session {
 
     allocating_buffers_state_ = true;
     allocating_buffers_.Signal();
+    allocation_counts_.push_back(count);
 
     // Forward this to the original implementation.
     return Session::AllocateBuffers(count, size);
@@ -260,6 +289,11 @@ class TestSession : public Session {
   // Under lock_.
   base::ConditionVariable allocating_buffers_;
   bool allocating_buffers_state_;
+  std::vector<size_t> allocation_counts_;
+
+  // Under lock_.
+  BufferPool* last_idle_pool_released_;
+  base::TimeTicks now_;
 };
 
 typedef scoped_refptr<TestSession> TestSessionPtr;
@@ -576,5 +610,92 @@ TEST_F(SessionTest, LargeBufferRequestAvoidsBackPressure) {
   ASSERT_EQ(buffer3, session->last_singleton_buffer_destroyed_);
 }
 
+TEST_F(SessionTest, BufferPoolGrowsExponentially) {
+  call_trace_service_.set_max_incremental_buffers(8);
+  ASSERT_TRUE(call_trace_service_.Start(true));
+
+  TestSessionPtr session = call_trace_service_.CreateTestSession();
+  ASSERT_TRUE(session != NULL);
+
+  // Exhaust the buffers 4 times. The allocations double from 2 buffers until
+  // they reach the cap of 8 buffers.
+  std::vector<Buffer*> buffers;
+  for (size_t i = 0; i < 2 + 4 + 8 + 8; ++i) {
+    Buffer* buffer = NULL;
+    ASSERT_TRUE(session->GetNextBuffer(&buffer));
+    ASSERT_TRUE(buffer != NULL);
+    buffers.push_back(buffer);
+  }
+
+  std::vector<size_t> expected_counts = { 2, 4, 8, 8 };
+  EXPECT_EQ(expected_counts, session->allocation_counts_);
+
+  // The client holds on to the first buffer a bit longer.
+  const base::TimeDelta kLatency = base::TimeDelta::FromSeconds(5);
+  session->AdvanceTime(kLatency);
+  ASSERT_TRUE(session->ReturnBuffer(buffers[0]));
+
+  Session::Statistics statistics;
+  session->GetStatistics(&statistics);
+  EXPECT_EQ(4u, statistics.pools_allocated);
+  EXPECT_EQ(0u, statistics.pools_released);
+  EXPECT_EQ(buffers.size(), statistics.peak_buffer_count);
+  EXPECT_EQ(1u, statistics.buffers_returned);
+  EXPECT_EQ(kLatency, statistics.total_return_latency);
+  EXPECT_EQ(kLatency, statistics.max_return_latency);
+
+  for (size_t i = 1; i < buffers.size(); ++i)
+    ASSERT_TRUE(session->ReturnBuffer(buffers[i]));
+  session->AllowBuffersToBeRecycled(9999);
+}
+
+TEST_F(SessionTest, IdleBufferPoolIsReleased) {
+  const base::TimeDelta kTimeout = base::TimeDelta::FromSeconds(10);
+  call_trace_service_.set_idle_pool_timeout(kTimeout);
+  ASSERT_TRUE(call_trace_service_.Start(true));
+
+  TestSessionPtr session = call_trace_service_.CreateTestSession();
+  ASSERT_TRUE(session != NULL);
+
+  // Hold on to all of the buffers of the first pool.
+  Buffer* buffer1 = NULL;
+  ASSERT_TRUE(session->GetNextBuffer(&buffer1));
+  Buffer* buffer2 = NULL;
+  ASSERT_TRUE(session->GetNextBuffer(&buffer2));
+  ASSERT_EQ(buffer1->pool, buffer2->pool);
+
+  // Add a pool which isn't used.
+  ASSERT_TRUE(session->AllocateUnusedBuffers(2));
+
+  // Nothing is released before the timeout.
+  session->AdvanceTime(kTimeout / 2);
+  session->ReleaseIdlePoolsNow();
+  EXPECT_TRUE(session->last_idle_pool_released_ == NULL);
+
+  // Afterwards, the unused pool is released but the busy one is kept.
+  session->AdvanceTime(kTimeout);
+  session->ReleaseIdlePoolsNow();
+  EXPECT_TRUE(session->last_idle_pool_released_ != NULL);
+  EXPECT_NE(buffer1->pool, session->last_idle_pool_released_);
+
+  Session::Statistics statistics;
+  session->GetStatistics(&statistics);
+  EXPECT_EQ(2u, statistics.pools_allocated);
+  EXPECT_EQ(1u, statistics.pools_released);
+
+  // The session is out of buffers again, so the next request allocates a new
+  // pool of the initial size.
+  session->allocation_counts_.clear();
+  Buffer* buffer3 = NULL;
+  ASSERT_TRUE(session->GetNextBuffer(&buffer3));
+  std::vector<size_t> expected_counts = { 2 };
+  EXPECT_EQ(expected_counts, session->allocation_counts_);
+
+  ASSERT_TRUE(session->ReturnBuffer(buffer1));
+  ASSERT_TRUE(session->ReturnBuffer(buffer2));
+  ASSERT_TRUE(session->ReturnBuffer(buffer3));
+  session->AllowBuffersToBeRecycled(9999);
+}
+
 }  // namespace service
 }  // namespace trace
@@ -15,19 +15,29 @@
 #include "syzygy/trace/service/trace_file_writer.h"
 
 #include <time.h>
+#include <algorithm>
+#include <limits>
 
+#include "base/bind.h"
 #include "base/strings/stringprintf.h"
+#include "syzygy/application/work_pool.h"
 #include "syzygy/common/align.h"
 #include "syzygy/common/buffer_writer.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/common/path_util.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
+#include "third_party/zlib/zlib.h"
 
 namespace trace {
 namespace service {
 
 namespace {
 
+const size_t kSegmentHeaderLength =
+    sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+const size_t kCompressedSegmentHeaderLength =
+    sizeof(RecordPrefix) + sizeof(TraceFileCompressedSegmentHeader);
+
 bool OpenTraceFile(const base::FilePath& file_path,
                    base::win::ScopedHandle* file_handle) {
   DCHECK(!file_path.empty());
@@ -81,12 +91,112 @@ bool GetBlockSize(const base::FilePath& path, size_t* block_size) {
   return true;
 }
 
+// Compresses the segments of records. Distinct records may be compressed on
+// different threads.
+class RecordCompressor {
+ public:
+  // @param block_size the block size of the trace file.
+  // @param records the records to compress, with the number of bytes to write
+  //     for each of them. The records that compress are replaced.
+  // @param compressed_records receives the compressed records. It must be as
+  //     large as @p records.
+  RecordCompressor(size_t block_size,
+                   TraceFileWriter::Records* records,
+                   std::vector<std::vector<uint8_t>>* compressed_records)
+      : block_size_(block_size),
+        records_(records),
+        compressed_records_(compressed_records) {
+    DCHECK_LT(0u, block_size);
+    DCHECK(records != NULL);
+    DCHECK(compressed_records != NULL);
+    DCHECK_EQ(records->size(), compressed_records->size());
+  }
+
+  // Compresses the record at @p index. A record that doesn't compress is
+  // written as is, so this always succeeds.
+  // @param index the index of the record to compress.
+  // @returns true.
+  bool Compress(size_t index) {
+    DCHECK_LT(index, records_->size());
+    CompressRecord(&(*records_)[index], &(*compressed_records_)[index]);
+    return true;
+  }
+
+ private:
+  void CompressRecord(TraceFileWriter::Record* record,
+                      std::vector<uint8_t>* compressed_record) {
+    const RecordPrefix* prefix =
+        reinterpret_cast<const RecordPrefix*>(record->data);
+    const TraceFileSegmentHeader* header =
+        reinterpret_cast<const TraceFileSegmentHeader*>(prefix + 1);
+
+    // The client may still be playing with the buffer, so the segment is
+    // kept within the length that was checked.
+    size_t segment_length = std::min<size_t>(
+        header->segment_length, record->length - kSegmentHeaderLength);
+    const uint8_t* segment =
+        reinterpret_cast<const uint8_t*>(record->data) + kSegmentHeaderLength;
+
+    uLong bound = ::compressBound(segment_length);
+    compressed_record->resize(::common::AlignUp(
+        kCompressedSegmentHeaderLength + bound, block_size_));
+    uint8_t* compressed_segment =
+        compressed_record->data() + kCompressedSegmentHeaderLength;
+    uLongf compressed_length = bound;
+    if (::compress2(compressed_segment, &compressed_length, segment,
+                    segment_length, Z_BEST_SPEED) != Z_OK) {
+      LOG(WARNING) << "Failed to compress a segment, writing it as is.";
+      return;
+    }
+
+    // Segments that don't get any smaller are written as they are.
+    size_t length = ::common::AlignUp(
+        kCompressedSegmentHeaderLength + compressed_length, block_size_);
+    if (length >= record->length)
+      return;
+
+    RecordPrefix* compressed_prefix =
+        reinterpret_cast<RecordPrefix*>(compressed_record->data());
+    *compressed_prefix = *prefix;
+    compressed_prefix->type = TraceFileCompressedSegmentHeader::kTypeId;
+    compressed_prefix->size = sizeof(TraceFileCompressedSegmentHeader);
+
+    TraceFileCompressedSegmentHeader* compressed_header =
+        reinterpret_cast<TraceFileCompressedSegmentHeader*>(
+            compressed_prefix + 1);
+    compressed_header->thread_id = header->thread_id;
+    compressed_header->segment_length = segment_length;
+    compressed_header->compressed_length = compressed_length;
+
+    // Clear the padding up to the block size.
+    ::memset(compressed_segment + compressed_length, 0,
+             length - kCompressedSegmentHeaderLength - compressed_length);
+
+    record->data = compressed_record->data();
+    record->length = length;
+  }
+
+  size_t block_size_;
+  TraceFileWriter::Records* records_;
+  std::vector<std::vector<uint8_t>>* compressed_records_;
+
+  DISALLOW_COPY_AND_ASSIGN(RecordCompressor);
+};
+
 }  // namespace
 
-TraceFileWriter::TraceFileWriter() : block_size_(0) {
+TraceFileWriter::TraceFileWriter()
+    : block_size_(0),
+      batch_buffer_(NULL),
+      batch_length_(0),
+      compression_thread_count_(0),
+      file_offset_(0),
+      write_index_(false) {
 }
 
 TraceFileWriter::~TraceFileWriter() {
+  if (batch_buffer_ != NULL)
+    ::VirtualFree(batch_buffer_, 0, MEM_RELEASE);
 }
 
 base::FilePath TraceFileWriter::GenerateTraceFileBaseName(
@@ -111,6 +221,53 @@ base::FilePath TraceFileWriter::GenerateTraceFileBaseName(
       process_info.process_id));
 }
 
+void TraceFileWriter::GetIndexEntry(const void* data,
+                                    size_t length,
+                                    TraceFileIndexEntry* entry) {
+  DCHECK(data != NULL);
+  DCHECK_LE(kSegmentHeaderLength, length);
+  DCHECK(entry != NULL);
+
+  const RecordPrefix* prefix = reinterpret_cast<const RecordPrefix*>(data);
+  const TraceFileSegmentHeader* header =
+      reinterpret_cast<const TraceFileSegmentHeader*>(prefix + 1);
+
+  ::memset(entry, 0, sizeof(*entry));
+  entry->thread_id = header->thread_id;
+  entry->first_timestamp = std::numeric_limits<uint64_t>::max();
+
+  const uint8_t* read_ptr =
+      reinterpret_cast<const uint8_t*>(data) + kSegmentHeaderLength;
+  const uint8_t* end_ptr = read_ptr +
+      std::min<size_t>(header->segment_length, length - kSegmentHeaderLength);
+  while (static_cast<size_t>(end_ptr - read_ptr) >= sizeof(RecordPrefix)) {
+    const RecordPrefix* record =
+        reinterpret_cast<const RecordPrefix*>(read_ptr);
+    size_t remaining = end_ptr - read_ptr - sizeof(RecordPrefix);
+    if (record->size > remaining)
+      break;
+    read_ptr += sizeof(RecordPrefix) + record->size;
+
+    entry->first_timestamp =
+        std::min(entry->first_timestamp, record->timestamp);
+    entry->last_timestamp = std::max(entry->last_timestamp, record->timestamp);
+    if (record->type == TRACE_PROCESS_ATTACH_EVENT ||
+        record->type == TRACE_PROCESS_DETACH_EVENT ||
+        record->type == TRACE_THREAD_ATTACH_EVENT ||
+        record->type == TRACE_THREAD_DETACH_EVENT) {
+      entry->flags |= TraceFileIndexEntry::kHasModuleEvents;
+    } else if (record->type == TRACE_PROCESS_ENDED) {
+      entry->flags |= TraceFileIndexEntry::kHasProcessEnded;
+    }
+  }
+
+  // A segment without complete records gets the timestamp of the segment.
+  if (entry->first_timestamp > entry->last_timestamp) {
+    entry->first_timestamp = prefix->timestamp;
+    entry->last_timestamp = prefix->timestamp;
+  }
+}
+
 bool TraceFileWriter::Open(const base::FilePath& path) {
   // Open the trace file.
   base::win::ScopedHandle temp_handle;
@@ -130,6 +287,42 @@ bool TraceFileWriter::Open(const base::FilePath& path) {
   path_ = path;
   handle_.Set(temp_handle.Take());
   block_size_ = block_size;
+  write_index_ = true;
+
+  return true;
+}
+
+bool TraceFileWriter::OpenPipe(const base::FilePath& pipe_path) {
+  DCHECK(!pipe_path.empty());
+
+  // Wait for the parser to create an instance of the pipe, so that the
+  // session doesn't fail if it starts first.
+  if (!::WaitNamedPipe(pipe_path.value().c_str(), kPipeConnectTimeoutMs)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to wait for pipe '" << pipe_path.value() << "': "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  base::win::ScopedHandle temp_handle(
+      ::CreateFile(pipe_path.value().c_str(),
+                   GENERIC_WRITE,
+                   0, /* dwShareMode */
+                   NULL, /* lpSecurityAttributes */
+                   OPEN_EXISTING,
+                   0, /* dwFlagsAndAttributes */
+                   NULL /* hTemplateFile */));
+  if (!temp_handle.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to open pipe '" << pipe_path.value()
+               << "' for writing: " << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  // A pipe has no sectors, so any block size will do.
+  path_ = pipe_path;
+  handle_.Set(temp_handle.Take());
+  block_size_ = kPipeBlockSize;
 
   return true;
 }
@@ -189,6 +382,7 @@ bool TraceFileWriter::WriteHeader(const ProcessInfo& process_info) {
                << ".";
     return false;
   }
+  file_offset_ = buffer.size();
 
   return true;
 }
@@ -196,10 +390,123 @@ bool TraceFileWriter::WriteHeader(const ProcessInfo& process_info) {
 bool TraceFileWriter::WriteRecord(const void* data, size_t length) {
   DCHECK(data != NULL);
 
-  const size_t kHeaderLength =
-      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+  size_t bytes_to_write = 0;
+  if (!GetRecordLength(data, length, &bytes_to_write))
+    return false;
+  if (bytes_to_write == 0)
+    return true;
+
+  TraceFileIndexEntry entry = {};
+  if (write_index_) {
+    GetIndexEntry(data, bytes_to_write, &entry);
+    entry.offset = file_offset_;
+  }
+
+  if (!WriteBlocks(data, bytes_to_write))
+    return false;
+
+  if (write_index_)
+    index_.push_back(entry);
+  return true;
+}
+
+void TraceFileWriter::EnableCompression(size_t thread_count) {
+  DCHECK_LT(0u, thread_count);
+  compression_thread_count_ = thread_count;
+}
+
+bool TraceFileWriter::WriteRecords(const Records& records) {
+  DCHECK_EQ(0u, batch_length_);
+
+  if (!AllocateBatchBuffer())
+    return false;
+
+  // Check the records, and keep the number of bytes to write for each of
+  // them.
+  bool succeeded = true;
+  Records checked_records;
+  checked_records.reserve(records.size());
+  for (const Record& record : records) {
+    DCHECK(record.data != NULL);
+
+    size_t bytes_to_write = 0;
+    if (!GetRecordLength(record.data, record.length, &bytes_to_write)) {
+      succeeded = false;
+      continue;
+    }
+    if (bytes_to_write == 0)
+      continue;
+
+    Record checked_record = { record.data, bytes_to_write };
+    checked_records.push_back(checked_record);
+  }
+
+  // The segments are indexed before they are compressed.
+  std::vector<TraceFileIndexEntry> entries;
+  if (write_index_) {
+    entries.resize(checked_records.size());
+    for (size_t i = 0; i < checked_records.size(); ++i) {
+      GetIndexEntry(checked_records[i].data, checked_records[i].length,
+                    &entries[i]);
+    }
+  }
+
+  std::vector<std::vector<uint8_t>> compressed_records;
+  if (compression_thread_count_ != 0)
+    CompressRecords(&checked_records, &compressed_records);
+
+  for (size_t i = 0; i < checked_records.size(); ++i) {
+    const Record& record = checked_records[i];
+    size_t bytes_to_write = record.length;
+
+    // Make room for the record, or write it directly if it doesn't fit in the
+    // batch buffer at all.
+    if (batch_length_ + bytes_to_write > kBatchBufferSize &&
+        !FlushBatchBuffer()) {
+      return false;
+    }
+
+    // The record is written at the end of the batch buffer, or right away.
+    if (write_index_) {
+      entries[i].offset = file_offset_ + batch_length_;
+      index_.push_back(entries[i]);
+    }
+
+    if (bytes_to_write > kBatchBufferSize) {
+      const RecordPrefix* prefix =
+          reinterpret_cast<const RecordPrefix*>(record.data);
+      if (prefix->type != TraceFileCompressedSegmentHeader::kTypeId) {
+        if (!WriteBlocks(record.data, bytes_to_write))
+          return false;
+        continue;
+      }
+
+      // Compressed records aren't aligned for unbuffered writes, so they go
+      // through the batch buffer one piece at a time.
+      if (!WriteUnaligned(record.data, bytes_to_write))
+        return false;
+      continue;
+    }
+
+    // Copy the record, as it is now. The client may still be playing with
+    // the buffer, but the length that was checked is the one that's copied.
+    ::memcpy(batch_buffer_ + batch_length_, record.data, bytes_to_write);
+    batch_length_ += bytes_to_write;
+  }
 
-  if (length < kHeaderLength) {
+  if (!FlushBatchBuffer())
+    return false;
+
+  return succeeded;
+}
+
+bool TraceFileWriter::GetRecordLength(const void* data,
+                                      size_t length,
+                                      size_t* bytes_to_write) const {
+  DCHECK(data != NULL);
+  DCHECK(bytes_to_write != NULL);
+
+  if (length < kSegmentHeaderLength) {
     LOG(ERROR) << "Dropped buffer: too short.";
     return false;
   }
@@ -222,46 +529,156 @@ bool TraceFileWriter::WriteRecord(const void* data, size_t length) {
   size_t segment_length = header->segment_length;
   if (segment_length == 0) {
     LOG(INFO) << "Not writing empty buffer.";
+    *bytes_to_write = 0;
     return true;
   }
 
   // Figure out the total size that we'll write to disk.
-  size_t bytes_to_write = ::common::AlignUp(kHeaderLength + segment_length,
-                                            block_size_);
+  *bytes_to_write = ::common::AlignUp(kSegmentHeaderLength + segment_length,
+                                      block_size_);
 
   // Ensure that the total number of bytes to write does not exceed the
   // maximum record length.
-  if (bytes_to_write > length) {
+  if (*bytes_to_write > length) {
     LOG(ERROR) << "Dropped buffer: bytes written exceeds buffer size.";
     return false;
   }
 
+  return true;
+}
+
+void TraceFileWriter::CompressRecords(
+    Records* records,
+    std::vector<std::vector<uint8_t>>* compressed_records) {
+  DCHECK(records != NULL);
+  DCHECK(compressed_records != NULL);
+  DCHECK_LT(0u, compression_thread_count_);
+
+  compressed_records->resize(records->size());
+  RecordCompressor compressor(block_size_, records, compressed_records);
+  application::WorkPool pool(compression_thread_count_);
+  pool.Run(records->size(), base::Bind(&RecordCompressor::Compress,
+                                       base::Unretained(&compressor)));
+}
+
+bool TraceFileWriter::AllocateBatchBuffer() {
+  if (batch_buffer_ != NULL)
+    return true;
+
+  DCHECK_EQ(0u, kBatchBufferSize % block_size_);
+  batch_buffer_ = reinterpret_cast<uint8_t*>(::VirtualAlloc(
+      NULL, kBatchBufferSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+  if (batch_buffer_ == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to allocate the batch buffer: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  return true;
+}
+
+bool TraceFileWriter::WriteUnaligned(const void* data, size_t length) {
+  DCHECK(data != NULL);
+  DCHECK(batch_buffer_ != NULL);
+  DCHECK_EQ(0u, batch_length_);
+  DCHECK_EQ(0u, length % block_size_);
+
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+  for (size_t offset = 0; offset < length; offset += kBatchBufferSize) {
+    size_t piece_length = std::min(kBatchBufferSize, length - offset);
+    ::memcpy(batch_buffer_, bytes + offset, piece_length);
+    batch_length_ = piece_length;
+    if (!FlushBatchBuffer())
+      return false;
+  }
+
+  return true;
+}
+
+bool TraceFileWriter::WriteIndex() {
+  DCHECK(write_index_);
+  DCHECK_EQ(0u, batch_length_);
+
+  // The index is a record of its own, which ends with the trailer in the
+  // last bytes of its last block.
+  size_t entries_length = index_.size() * sizeof(TraceFileIndexEntry);
+  size_t index_length = ::common::AlignUp(
+      sizeof(RecordPrefix) + sizeof(TraceFileIndexHeader) + entries_length +
+          sizeof(TraceFileIndexTrailer),
+      block_size_);
+  std::vector<uint8_t> buffer(index_length, 0);
+
+  RecordPrefix* prefix = reinterpret_cast<RecordPrefix*>(buffer.data());
+  prefix->type = TraceFileIndexHeader::kTypeId;
+  prefix->size = sizeof(TraceFileIndexHeader) + entries_length;
+  prefix->version.hi = TRACE_VERSION_HI;
+  prefix->version.lo = TRACE_VERSION_LO;
+
+  TraceFileIndexHeader* header =
+      reinterpret_cast<TraceFileIndexHeader*>(prefix + 1);
+  header->entry_count = index_.size();
+  if (!index_.empty())
+    ::memcpy(header + 1, index_.data(), entries_length);
+
+  TraceFileIndexTrailer* trailer = reinterpret_cast<TraceFileIndexTrailer*>(
+      buffer.data() + index_length - sizeof(TraceFileIndexTrailer));
+  trailer->index_offset = file_offset_;
+  trailer->entry_count = index_.size();
+  ::memcpy(&trailer->signature, &TraceFileIndexTrailer::kSignatureValue,
+           sizeof(trailer->signature));
+
+  return AllocateBatchBuffer() && WriteUnaligned(buffer.data(), index_length);
+}
+
+bool TraceFileWriter::WriteBlocks(const void* data, size_t length) {
+  DCHECK(data != NULL);
+  DCHECK_LT(0u, length);
+  DCHECK_EQ(0u, length % block_size_);
+
   // Commit the buffer to disk.
   // TODO(rogerm): Use overlapped I/O.
-  DCHECK_LT(0u, bytes_to_write);
   DWORD bytes_written = 0;
   if (!::WriteFile(handle_.Get(),
-                   record,
-                   bytes_to_write,
+                   data,
+                   length,
                    &bytes_written,
                    NULL) ||
-      bytes_written != bytes_to_write) {
+      bytes_written != length) {
     DWORD error = ::GetLastError();
     LOG(ERROR) << "Failed writing to '" << path_.value()
                << "': " << ::common::LogWe(error) << ".";
     return false;
   }
+  file_offset_ += length;
 
   return true;
 }
 
+bool TraceFileWriter::FlushBatchBuffer() {
+  if (batch_length_ == 0)
+    return true;
+
+  size_t length = batch_length_;
+  batch_length_ = 0;
+  return WriteBlocks(batch_buffer_, length);
+}
+
 bool TraceFileWriter::Close() {
+  // The index is only written to trace files whose header was written.
+  bool succeeded = true;
+  if (write_index_ && file_offset_ != 0 && !WriteIndex()) {
+    LOG(ERROR) << "Failed to write the index of '" << path_.value() << "'.";
+    succeeded = false;
+  }
+  write_index_ = false;
+
   if (::CloseHandle(handle_.Take()) == 0) {
     DWORD error = ::GetLastError();
     LOG(ERROR) << "CloseHandle failed: " << ::common::LogWe(error) << ".";
     return false;
   }
-  return true;
+  return succeeded;
 }
 
 }  // namespace service
@@ -20,7 +20,7 @@
 // Intended use:
 //
 //   TraceFileWriter w;
-//   if (!w.Open(path))
+//   if (!w.Open(path))  // Or w.OpenPipe(pipe_path) to stream the trace.
 //     ...
 //
 //   // Use w.block_size() to make sure we are getting data with the appropriate
@@ -33,14 +33,24 @@
 //       ...
 //   }
 //
+//   // Several records can also be written at once, which coalesces them into
+//   // as few writes as possible. They can optionally be compressed.
+//   w.EnableCompression(thread_count);
+//   if (!w.WriteRecords(records))
+//     ...
+//
+//   // When writing to a file, Close appends the index of the segments to it.
 //   if (!w.Close())
 //     ...
 
 #ifndef SYZYGY_TRACE_SERVICE_TRACE_FILE_WRITER_H_
 #define SYZYGY_TRACE_SERVICE_TRACE_FILE_WRITER_H_
 
+#include <vector>
+
 #include "base/files/file_path.h"
 #include "base/win/scoped_handle.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
 #include "syzygy/trace/service/process_info.h"
 
 namespace trace {
@@ -50,6 +60,25 @@ namespace service {
 // writing a trace file. It is not thread-safe.
 class TraceFileWriter {
  public:
+  // A record to be written by WriteRecords.
+  struct Record {
+    // The record, which must contain a RecordPrefix.
+    const void* data;
+    // The maximum length of continuous data that may be contained in the
+    // record.
+    size_t length;
+  };
+  typedef std::vector<Record> Records;
+
+  // The size of the buffer in which WriteRecords coalesces the records.
+  static const size_t kBatchBufferSize = 1024 * 1024;
+
+  // The block size of the traces that are written to a pipe.
+  static const size_t kPipeBlockSize = 4096;
+
+  // How long OpenPipe waits for an instance of the pipe to be available.
+  static const uint32_t kPipeConnectTimeoutMs = 30 * 1000;
+
   // Constructor.
   TraceFileWriter();
 
@@ -64,11 +93,29 @@ class TraceFileWriter {
   static base::FilePath GenerateTraceFileBaseName(
       const ProcessInfo& process_info);
 
+  // Describes a segment in the index of a trace file, from the prefixes of
+  // its records. The records of a segment that is still being written may be
+  // truncated, so the walk stops at the first record that doesn't fit.
+  // @param data the record containing the segment.
+  // @param length the number of bytes of the record that are written. This
+  //     must cover at least the headers of the segment.
+  // @param entry receives the description of the segment, but for its offset.
+  static void GetIndexEntry(const void* data,
+                            size_t length,
+                            TraceFileIndexEntry* entry);
+
   // Opens a trace file at the given path.
   // @param path The path of the trace file to write.
   // @returns true on success, false otherwise.
   bool Open(const base::FilePath& path);
 
+  // Connects to a named pipe on which a parser is waiting, and writes the
+  // trace to it instead of to a file. The trace is written in the format of
+  // a trace file, so the parser reads it as it would read the file.
+  // @param pipe_path The name of the pipe.
+  // @returns true on success, false otherwise.
+  bool OpenPipe(const base::FilePath& pipe_path);
+
   // Writes the header to the trace file. A trace file is associated with a
   // single running process, so we require a populated process-info struct.
   // @param process_info Information about the process to which this trace file
@@ -86,7 +133,25 @@ class TraceFileWriter {
   // @returns true on success, false otherwise.
   bool WriteRecord(const void* data, size_t length);
 
-  // Closes the trace file.
+  // Makes WriteRecords compress the segments of the records that it writes.
+  // @param thread_count The maximum number of threads on which to compress
+  //     the records.
+  void EnableCompression(size_t thread_count);
+
+  // Writes several records of data to disk. The records are copied one after
+  // the other into a block aligned buffer, which is written whenever it is
+  // full, so that the records take a lot fewer writes than with WriteRecord.
+  // The trace file is the same as if WriteRecord was called on each of them
+  // in order. If compression is enabled, the segments that compress are
+  // written as compressed segments instead.
+  // @param records The records to be written. Each of them is subject to the
+  //     same requirements as in WriteRecord.
+  // @returns true on success, false otherwise. The valid records are written
+  //     even if others are dropped.
+  bool WriteRecords(const Records& records);
+
+  // Closes the trace file. A trace file, but not a pipe, ends with the index
+  // of the segments that were written to it, which is written here.
   // @returns true on success, false otherwise.
   // @note If this is not called manually the trace-file will close itself when
   //     the writer goes out of scope.
@@ -100,7 +165,62 @@ class TraceFileWriter {
   // @note This is only valid after Open has returned successfully.
   size_t block_size() const { return block_size_; }
 
+  // @returns the number of threads on which the records are compressed, or
+  //     zero if they aren't.
+  size_t compression_thread_count() const { return compression_thread_count_; }
+
+  // @returns the index of the segments written so far, in the order in which
+  //     they were written.
+  const std::vector<TraceFileIndexEntry>& index() const { return index_; }
+
  protected:
+  // Checks that a record can be written, and computes the number of bytes to
+  // write for it.
+  // @param data The record to check.
+  // @param length The maximum length of the record.
+  // @param bytes_to_write Receives the number of bytes to write. This is zero
+  //     for the records that are empty.
+  // @returns true if the record can be written, false if it must be dropped.
+  bool GetRecordLength(const void* data,
+                       size_t length,
+                       size_t* bytes_to_write) const;
+
+  // Compresses the segments of records whose lengths have been checked. The
+  // records that compress are replaced by compressed records, which point
+  // into @p compressed_records.
+  // @param records The records to compress, with the number of bytes to
+  //     write for each of them.
+  // @param compressed_records Receives the compressed records.
+  void CompressRecords(Records* records,
+                       std::vector<std::vector<uint8_t>>* compressed_records);
+
+  // Allocates the batch buffer, if it isn't allocated yet.
+  // @returns true on success, false otherwise.
+  bool AllocateBatchBuffer();
+
+  // Writes blocks of data that may not be aligned for unbuffered writes, by
+  // copying them through the batch buffer. The batch buffer must be empty.
+  // @param data The data to write.
+  // @param length The number of bytes to write. This must be a multiple of
+  //     the block size.
+  // @returns true on success, false otherwise.
+  bool WriteUnaligned(const void* data, size_t length);
+
+  // Writes the index of the segments, followed by its trailer.
+  // @returns true on success, false otherwise.
+  bool WriteIndex();
+
+  // Writes blocks of data at the current position of the trace file.
+  // @param data The data to write.
+  // @param length The number of bytes to write. This must be a multiple of
+  //     the block size.
+  // @returns true on success, false otherwise.
+  bool WriteBlocks(const void* data, size_t length);
+
+  // Writes the records that are in the batch buffer.
+  // @returns true on success, false otherwise.
+  bool FlushBatchBuffer();
+
   // The path to the trace file being written.
   base::FilePath path_;
 
@@ -110,6 +230,28 @@ class TraceFileWriter {
   // The block size being used by the trace file writer.
   size_t block_size_;
 
+  // The buffer in which WriteRecords coalesces the records. It is allocated
+  // with VirtualAlloc so that it is suitably aligned for unbuffered writes.
+  uint8_t* batch_buffer_;
+
+  // The number of bytes used in the batch buffer.
+  size_t batch_length_;
+
+  // The number of threads on which WriteRecords compresses the records, or
+  // zero if it doesn't compress them.
+  size_t compression_thread_count_;
+
+  // The offset at which the next blocks are written, or zero until the
+  // header has been written.
+  uint64_t file_offset_;
+
+  // Whether the segments are indexed. A pipe can't be seeked, so the traces
+  // that are streamed have no index.
+  bool write_index_;
+
+  // The index of the segments that have been written.
+  std::vector<TraceFileIndexEntry> index_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(TraceFileWriter);
 };
@@ -14,12 +14,17 @@
 
 #include "syzygy/trace/service/trace_file_writer.h"
 
+#include <algorithm>
+
 #include "base/files/file_util.h"
+#include "base/strings/stringprintf.h"
+#include "base/win/scoped_handle.h"
 #include "gtest/gtest.h"
 #include "syzygy/common/align.h"
 #include "syzygy/pe/unittest_util.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 #include "syzygy/trace/service/process_info.h"
+#include "third_party/zlib/zlib.h"
 
 namespace trace {
 namespace service {
@@ -31,6 +36,20 @@ class TestTraceFileWriter : public TraceFileWriter {
   using TraceFileWriter::handle_;
 };
 
+// Initializes a record with a segment of the given length.
+void InitRecord(size_t segment_length, std::vector<uint8_t>* data) {
+  data->resize(std::max(data->size(), sizeof(RecordPrefix) +
+                        sizeof(TraceFileSegmentHeader) + segment_length));
+  RecordPrefix* record = reinterpret_cast<RecordPrefix*>(data->data());
+  TraceFileSegmentHeader* header = reinterpret_cast<TraceFileSegmentHeader*>(
+      record + 1);
+  record->size = sizeof(TraceFileSegmentHeader);
+  record->type = TraceFileSegmentHeader::kTypeId;
+  record->version.hi = TRACE_VERSION_HI;
+  record->version.lo = TRACE_VERSION_LO;
+  header->segment_length = segment_length;
+}
+
 class TraceFileWriterTest : public testing::PELibUnitTest {
  public:
   void SetUp() override {
@@ -53,6 +72,42 @@ TEST_F(TraceFileWriterTest, GenerateTraceFileBaseName) {
   EXPECT_FALSE(basename.empty());
 }
 
+TEST_F(TraceFileWriterTest, GetIndexEntry) {
+  // A segment with a thread attach event, and a truncated event.
+  std::vector<uint8_t> data;
+  InitRecord(3 * sizeof(RecordPrefix), &data);
+  RecordPrefix* segment_prefix = reinterpret_cast<RecordPrefix*>(data.data());
+  segment_prefix->timestamp = 5;
+  TraceFileSegmentHeader* header =
+      reinterpret_cast<TraceFileSegmentHeader*>(segment_prefix + 1);
+  header->thread_id = 42;
+  RecordPrefix* events = reinterpret_cast<RecordPrefix*>(header + 1);
+  events[0].timestamp = 10;
+  events[0].size = 0;
+  events[0].type = TRACE_THREAD_ATTACH_EVENT;
+  events[1].timestamp = 20;
+  events[1].size = 0;
+  events[1].type = TRACE_ENTER_EVENT;
+  events[2].timestamp = 30;
+  events[2].size = 1;
+  events[2].type = TRACE_PROCESS_ENDED;
+
+  TraceFileIndexEntry entry = {};
+  TraceFileWriter::GetIndexEntry(data.data(), data.size(), &entry);
+  EXPECT_EQ(42u, entry.thread_id);
+  EXPECT_EQ(10u, entry.first_timestamp);
+  EXPECT_EQ(20u, entry.last_timestamp);
+  EXPECT_EQ(static_cast<uint32_t>(TraceFileIndexEntry::kHasModuleEvents),
+            entry.flags);
+
+  // A segment without events gets the timestamp of the segment.
+  header->segment_length = 0;
+  TraceFileWriter::GetIndexEntry(data.data(), data.size(), &entry);
+  EXPECT_EQ(5u, entry.first_timestamp);
+  EXPECT_EQ(5u, entry.last_timestamp);
+  EXPECT_EQ(0u, entry.flags);
+}
+
 TEST_F(TraceFileWriterTest, Constructor) {
   TestTraceFileWriter w;
   EXPECT_TRUE(w.path().empty());
@@ -103,6 +158,48 @@ TEST_F(TraceFileWriterTest, WriteHeader) {
   EXPECT_EQ(0, trace_file_size % w.block_size());
 }
 
+TEST_F(TraceFileWriterTest, OpenPipeFailsWithoutParser) {
+  TestTraceFileWriter w;
+  EXPECT_FALSE(w.OpenPipe(base::FilePath(
+      L"\\\\.\\pipe\\this-pipe-should-not-exist-and-open-should-fail")));
+  EXPECT_TRUE(w.path().empty());
+  EXPECT_FALSE(w.handle_.IsValid());
+  EXPECT_EQ(0u, w.block_size());
+}
+
+TEST_F(TraceFileWriterTest, WriteHeaderToPipe) {
+  base::FilePath pipe_path(base::StringPrintf(
+      L"\\\\.\\pipe\\trace-file-writer-unittest-%d",
+      ::GetCurrentProcessId()));
+  base::win::ScopedHandle pipe(::CreateNamedPipe(
+      pipe_path.value().c_str(), PIPE_ACCESS_INBOUND,
+      PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, 0,
+      TraceFileWriter::kBatchBufferSize, 0, NULL));
+  ASSERT_TRUE(pipe.IsValid());
+
+  TestTraceFileWriter w;
+  ASSERT_TRUE(w.OpenPipe(pipe_path));
+  EXPECT_EQ(pipe_path, w.path());
+  EXPECT_EQ(TraceFileWriter::kPipeBlockSize, w.block_size());
+
+  ProcessInfo pi;
+  ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+  ASSERT_TRUE(w.WriteHeader(pi));
+  ASSERT_TRUE(w.Close());
+
+  // The header is streamed as it is written to a trace file.
+  std::vector<uint8_t> data(w.block_size());
+  DWORD bytes_read = 0;
+  ASSERT_TRUE(::ReadFile(pipe.Get(), data.data(),
+                         static_cast<DWORD>(data.size()), &bytes_read, NULL));
+  ASSERT_LT(sizeof(TraceFileHeader), bytes_read);
+  const TraceFileHeader* header =
+      reinterpret_cast<const TraceFileHeader*>(data.data());
+  EXPECT_EQ(0, ::memcmp(header->signature, TraceFileHeader::kSignatureValue,
+                        sizeof(header->signature)));
+  EXPECT_EQ(w.block_size(), header->block_size);
+}
+
 TEST_F(TraceFileWriterTest, WriteRecordFailsTooShort) {
   TestTraceFileWriter w;
   ASSERT_TRUE(w.Open(trace_path));
@@ -180,5 +277,226 @@ TEST_F(TraceFileWriterTest, WriteRecordSucceeds) {
   EXPECT_EQ(0, trace_file_size % w.block_size());
 }
 
+TEST_F(TraceFileWriterTest, WriteRecordsSucceeds) {
+  TestTraceFileWriter w;
+  ASSERT_TRUE(w.Open(trace_path));
+
+  ProcessInfo pi;
+  ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+  ASSERT_TRUE(w.WriteHeader(pi));
+  int64_t header_size = 0;
+  ASSERT_TRUE(base::GetFileSize(trace_path, &header_size));
+
+  // A record of one block, an empty record, a record of several blocks and
+  // a record that is larger than the batch buffer.
+  size_t block_size = w.block_size();
+  std::vector<uint8_t> small_data(block_size);
+  InitRecord(1, &small_data);
+  std::vector<uint8_t> empty_data(block_size);
+  InitRecord(0, &empty_data);
+  std::vector<uint8_t> medium_data(3 * block_size);
+  InitRecord(2 * block_size, &medium_data);
+  std::vector<uint8_t> large_data(TraceFileWriter::kBatchBufferSize +
+                                  block_size);
+  InitRecord(TraceFileWriter::kBatchBufferSize, &large_data);
+
+  TraceFileWriter::Records records;
+  TraceFileWriter::Record small = { small_data.data(), small_data.size() };
+  records.push_back(small);
+  TraceFileWriter::Record empty = { empty_data.data(), empty_data.size() };
+  records.push_back(empty);
+  TraceFileWriter::Record medium = { medium_data.data(), medium_data.size() };
+  records.push_back(medium);
+  TraceFileWriter::Record large = { large_data.data(), large_data.size() };
+  records.push_back(large);
+  records.push_back(small);
+  EXPECT_TRUE(w.WriteRecords(records));
+
+  // An invalid record is dropped, but the others are still written.
+  RecordPrefix invalid_record = {};
+  TraceFileWriter::Record invalid = { &invalid_record,
+                                      sizeof(invalid_record) };
+  records.clear();
+  records.push_back(invalid);
+  records.push_back(small);
+  EXPECT_FALSE(w.WriteRecords(records));
+
+  ASSERT_TRUE(w.Close());
+
+  // The five segments are followed by their index, which fits in a block.
+  EXPECT_EQ(5u, w.index().size());
+  int64_t trace_file_size = 0;
+  ASSERT_TRUE(base::GetFileSize(trace_path, &trace_file_size));
+  EXPECT_EQ(header_size + 7 * block_size + large_data.size(),
+            trace_file_size);
+}
+
+TEST_F(TraceFileWriterTest, WriteRecordsCompresses) {
+  TestTraceFileWriter w;
+  ASSERT_TRUE(w.Open(trace_path));
+  w.EnableCompression(2);
+  EXPECT_EQ(2u, w.compression_thread_count());
+
+  ProcessInfo pi;
+  ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+  ASSERT_TRUE(w.WriteHeader(pi));
+  int64_t header_size = 0;
+  ASSERT_TRUE(base::GetFileSize(trace_path, &header_size));
+
+  // A segment of zeros, which compresses well, and a segment of noise, which
+  // doesn't.
+  const size_t kHeaderLength =
+      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+  size_t block_size = w.block_size();
+  size_t segment_length = 4 * block_size;
+  std::vector<uint8_t> zero_data(kHeaderLength + segment_length);
+  InitRecord(segment_length, &zero_data);
+  zero_data.resize(::common::AlignUp(zero_data.size(), block_size));
+  std::vector<uint8_t> noise_data(zero_data.size());
+  uint32_t seed = 0x12345678;
+  for (size_t i = kHeaderLength; i < noise_data.size(); ++i) {
+    seed = seed * 1103515245 + 12345;
+    noise_data[i] = static_cast<uint8_t>(seed >> 16);
+  }
+  InitRecord(segment_length, &noise_data);
+
+  TraceFileWriter::Records records;
+  TraceFileWriter::Record zero = { zero_data.data(), zero_data.size() };
+  records.push_back(zero);
+  TraceFileWriter::Record noise = { noise_data.data(), noise_data.size() };
+  records.push_back(noise);
+  EXPECT_TRUE(w.WriteRecords(records));
+  ASSERT_TRUE(w.Close());
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(trace_path, &contents));
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(contents.data());
+  size_t offset = static_cast<size_t>(header_size);
+
+  // The first segment is compressed, and decompresses to the original.
+  ASSERT_LE(offset + block_size, contents.size());
+  const RecordPrefix* prefix =
+      reinterpret_cast<const RecordPrefix*>(data + offset);
+  EXPECT_EQ(TraceFileCompressedSegmentHeader::kTypeId, prefix->type);
+  EXPECT_EQ(sizeof(TraceFileCompressedSegmentHeader), prefix->size);
+  const TraceFileCompressedSegmentHeader* compressed_header =
+      reinterpret_cast<const TraceFileCompressedSegmentHeader*>(prefix + 1);
+  EXPECT_EQ(segment_length, compressed_header->segment_length);
+
+  std::vector<uint8_t> segment(segment_length, 0xFF);
+  uLongf length = segment.size();
+  ASSERT_EQ(Z_OK, ::uncompress(segment.data(), &length,
+                               reinterpret_cast<const Bytef*>(
+                                   compressed_header + 1),
+                               compressed_header->compressed_length));
+  EXPECT_EQ(segment_length, length);
+  EXPECT_EQ(std::vector<uint8_t>(segment_length, 0), segment);
+
+  // The second segment is written as it is, and is followed by the index.
+  offset = ::common::AlignUp(
+      offset + sizeof(*prefix) + sizeof(*compressed_header) +
+          compressed_header->compressed_length,
+      block_size);
+  ASSERT_EQ(offset + noise_data.size() + block_size, contents.size());
+  EXPECT_EQ(0, ::memcmp(noise_data.data(), data + offset, noise_data.size()));
+
+  // The index locates the compressed segment, but describes it as it was
+  // before it was compressed.
+  ASSERT_EQ(2u, w.index().size());
+  EXPECT_EQ(static_cast<uint64_t>(header_size), w.index()[0].offset);
+  EXPECT_EQ(offset, w.index()[1].offset);
+}
+
+TEST_F(TraceFileWriterTest, CloseWritesIndex) {
+  TestTraceFileWriter w;
+  ASSERT_TRUE(w.Open(trace_path));
+
+  ProcessInfo pi;
+  ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+  ASSERT_TRUE(w.WriteHeader(pi));
+  int64_t header_size = 0;
+  ASSERT_TRUE(base::GetFileSize(trace_path, &header_size));
+
+  // A segment of two events on a thread, and a segment with a module event
+  // and the end of the process on another.
+  const size_t kHeaderLength =
+      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+  const size_t kEventLength = sizeof(RecordPrefix) + sizeof(TraceModuleData);
+  size_t block_size = w.block_size();
+  std::vector<uint8_t> first_data(
+      ::common::AlignUp(kHeaderLength + 2 * kEventLength, block_size));
+  InitRecord(2 * kEventLength, &first_data);
+  std::vector<uint8_t> second_data(first_data.size());
+  InitRecord(2 * kEventLength, &second_data);
+
+  const uint16_t kFirstTypes[] = { TRACE_ENTER_EVENT, TRACE_EXIT_EVENT };
+  const uint16_t kSecondTypes[] = { TRACE_PROCESS_ATTACH_EVENT,
+                                    TRACE_PROCESS_ENDED };
+  for (size_t i = 0; i < 2; ++i) {
+    RecordPrefix* first = reinterpret_cast<RecordPrefix*>(
+        first_data.data() + kHeaderLength + i * kEventLength);
+    first->timestamp = 100 + i;
+    first->size = sizeof(TraceModuleData);
+    first->type = kFirstTypes[i];
+    RecordPrefix* second = reinterpret_cast<RecordPrefix*>(
+        second_data.data() + kHeaderLength + i * kEventLength);
+    second->timestamp = 300 - i;
+    second->size = sizeof(TraceModuleData);
+    second->type = kSecondTypes[i];
+  }
+  reinterpret_cast<TraceFileSegmentHeader*>(
+      first_data.data() + sizeof(RecordPrefix))->thread_id = 1;
+  reinterpret_cast<TraceFileSegmentHeader*>(
+      second_data.data() + sizeof(RecordPrefix))->thread_id = 2;
+
+  EXPECT_TRUE(w.WriteRecord(first_data.data(), first_data.size()));
+  TraceFileWriter::Records records;
+  TraceFileWriter::Record second = { second_data.data(), second_data.size() };
+  records.push_back(second);
+  EXPECT_TRUE(w.WriteRecords(records));
+  ASSERT_TRUE(w.Close());
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(trace_path, &contents));
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(contents.data());
+  ASSERT_EQ(header_size + 2 * first_data.size() + block_size,
+            contents.size());
+
+  // The trailer locates the index, which follows the segments.
+  const TraceFileIndexTrailer* trailer =
+      reinterpret_cast<const TraceFileIndexTrailer*>(
+          data + contents.size() - sizeof(TraceFileIndexTrailer));
+  EXPECT_EQ(0, ::memcmp(trailer->signature,
+                        TraceFileIndexTrailer::kSignatureValue,
+                        sizeof(trailer->signature)));
+  EXPECT_EQ(contents.size() - block_size, trailer->index_offset);
+  EXPECT_EQ(2u, trailer->entry_count);
+
+  const RecordPrefix* prefix =
+      reinterpret_cast<const RecordPrefix*>(data + trailer->index_offset);
+  EXPECT_EQ(TraceFileIndexHeader::kTypeId, prefix->type);
+  EXPECT_EQ(sizeof(TraceFileIndexHeader) + 2 * sizeof(TraceFileIndexEntry),
+            prefix->size);
+  const TraceFileIndexHeader* header =
+      reinterpret_cast<const TraceFileIndexHeader*>(prefix + 1);
+  ASSERT_EQ(2u, header->entry_count);
+  const TraceFileIndexEntry* entries =
+      reinterpret_cast<const TraceFileIndexEntry*>(header + 1);
+
+  EXPECT_EQ(static_cast<uint64_t>(header_size), entries[0].offset);
+  EXPECT_EQ(1u, entries[0].thread_id);
+  EXPECT_EQ(100u, entries[0].first_timestamp);
+  EXPECT_EQ(101u, entries[0].last_timestamp);
+  EXPECT_EQ(0u, entries[0].flags);
+
+  EXPECT_EQ(header_size + first_data.size(), entries[1].offset);
+  EXPECT_EQ(2u, entries[1].thread_id);
+  EXPECT_EQ(299u, entries[1].first_timestamp);
+  EXPECT_EQ(300u, entries[1].last_timestamp);
+  EXPECT_EQ(TraceFileIndexEntry::kHasModuleEvents |
+                TraceFileIndexEntry::kHasProcessEnded,
+            entries[1].flags);
+}
+
 }  // namespace service
 }  // namespace trace
@@ -32,6 +32,8 @@ typedef struct _PSAPI_WORKING_SET_INFORMATION PSAPI_WORKING_SET_INFORMATION;
 
 namespace wsdump {
 
+class WorkingSetSampler;
+
 // Captures working set for a given process at a point in time,
 // summarizes per-module as well as overall statistics.
 class ProcessWorkingSet {
@@ -71,6 +73,9 @@ class ProcessWorkingSet {
   const ModuleStatsVector& module_stats() const { return module_stats_; }
 
  protected:
+  // The sampler reuses the capture functions.
+  friend class WorkingSetSampler;
+
   // These are protected members to allow unittesting them.
   typedef std::unique_ptr<PSAPI_WORKING_SET_INFORMATION> ScopedWsPtr;
   static bool CaptureWorkingSet(HANDLE process, ScopedWsPtr* working_set);
@@ -0,0 +1,165 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/wsdump/working_set_sampler.h"
+
+#include <psapi.h>
+#include <algorithm>
+
+#include "base/logging.h"
+#include "syzygy/common/com_utils.h"
+#include "syzygy/core/address_space.h"
+#include "syzygy/wsdump/process_working_set.h"
+
+namespace wsdump {
+
+WorkingSetSampler::WorkingSetSampler()
+    : process_id_(0), last_module_range_(NULL) {
+}
+
+bool WorkingSetSampler::Initialize(DWORD process_id) {
+  DCHECK(!process_.IsValid());
+
+  const DWORD kProcessPermissions = PROCESS_QUERY_INFORMATION | PROCESS_VM_READ;
+  process_.Set(::OpenProcess(kProcessPermissions, FALSE, process_id));
+  if (!process_.IsValid()) {
+    DWORD err = ::GetLastError();
+    LOG(ERROR) << "OpenProcess failed: " << common::LogWe(err);
+    return false;
+  }
+  process_id_ = process_id;
+
+  return RefreshModules();
+}
+
+bool WorkingSetSampler::RefreshModules() {
+  ProcessWorkingSet::ModuleAddressSpace modules;
+  if (!ProcessWorkingSet::CaptureModules(process_id_, &modules))
+    return false;
+
+  module_ranges_.clear();
+  last_module_range_ = NULL;
+  ProcessWorkingSet::ModuleAddressSpace::RangeMap::const_iterator it =
+      modules.begin();
+  for (; it != modules.end(); ++it)
+    AddModule(it->first.start(), it->first.size(), it->second);
+
+  return true;
+}
+
+bool WorkingSetSampler::Sample(Delta* delta) {
+  DCHECK(delta != NULL);
+  DCHECK(process_.IsValid());
+
+  ProcessWorkingSet::ScopedWsPtr working_set;
+  if (!ProcessWorkingSet::CaptureWorkingSet(process_.Get(), &working_set))
+    return false;
+
+  // The working set isn't reported in address order.
+  std::vector<size_t> pages;
+  pages.reserve(working_set->NumberOfEntries);
+  for (size_t i = 0; i < working_set->NumberOfEntries; ++i)
+    pages.push_back(working_set->WorkingSetInfo[i].VirtualPage);
+  std::sort(pages.begin(), pages.end());
+
+  ComputeDelta(&pages, delta);
+  return true;
+}
+
+void WorkingSetSampler::AddModule(size_t address,
+                                  size_t size,
+                                  const std::wstring& name) {
+  std::map<std::wstring, size_t>::const_iterator id_it =
+      module_ids_.find(name);
+  if (id_it == module_ids_.end()) {
+    id_it = module_ids_.insert(
+        std::make_pair(name, module_names_.size())).first;
+    module_names_.push_back(name);
+  }
+
+  ModuleRange range = { address, address + size, id_it->second };
+  ModuleRanges::iterator it = std::upper_bound(
+      module_ranges_.begin(), module_ranges_.end(), range);
+  module_ranges_.insert(it, range);
+  last_module_range_ = NULL;
+}
+
+void WorkingSetSampler::ComputeDelta(std::vector<size_t>* pages,
+                                     Delta* delta) {
+  DCHECK(pages != NULL);
+  DCHECK(delta != NULL);
+  DCHECK(std::is_sorted(pages->begin(), pages->end()));
+
+  delta->added.clear();
+  delta->removed.clear();
+
+  // Walk both working sets in address order.
+  std::vector<size_t>::const_iterator old_it = pages_.begin();
+  std::vector<size_t>::const_iterator new_it = pages->begin();
+  while (old_it != pages_.end() || new_it != pages->end()) {
+    if (new_it == pages->end() ||
+        (old_it != pages_.end() && *old_it < *new_it)) {
+      AppendPage(*old_it, &delta->removed);
+      ++old_it;
+    } else if (old_it == pages_.end() || *new_it < *old_it) {
+      AppendPage(*new_it, &delta->added);
+      ++new_it;
+    } else {
+      ++old_it;
+      ++new_it;
+    }
+  }
+
+  pages_.swap(*pages);
+}
+
+void WorkingSetSampler::AppendPage(size_t page, PageRanges* ranges) {
+  DCHECK(ranges != NULL);
+
+  size_t address = page * kPageSize;
+  size_t module_id = FindModuleId(address);
+  if (!ranges->empty()) {
+    PageRange& last = ranges->back();
+    if (last.module_id == module_id &&
+        last.address + last.page_count * kPageSize == address) {
+      ++last.page_count;
+      return;
+    }
+  }
+
+  PageRange range = { address, 1, module_id };
+  ranges->push_back(range);
+}
+
+size_t WorkingSetSampler::FindModuleId(size_t address) {
+  if (last_module_range_ != NULL && last_module_range_->start <= address &&
+      address < last_module_range_->end) {
+    return last_module_range_->module_id;
+  }
+
+  // Find the last module starting at or before the address.
+  ModuleRange key = { address, address, kNoModule };
+  ModuleRanges::const_iterator it = std::upper_bound(
+      module_ranges_.begin(), module_ranges_.end(), key);
+  if (it == module_ranges_.begin())
+    return kNoModule;
+  --it;
+  if (address >= it->end)
+    return kNoModule;
+
+  last_module_range_ = &(*it);
+  return it->module_id;
+}
+
+}  // namespace wsdump
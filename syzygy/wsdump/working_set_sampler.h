@@ -0,0 +1,154 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the WorkingSetSampler class, which samples the working set of a
+// process repeatedly and reports how it changes between samples.
+
+#ifndef SYZYGY_WSDUMP_WORKING_SET_SAMPLER_H_
+#define SYZYGY_WSDUMP_WORKING_SET_SAMPLER_H_
+
+#include <windows.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/win/scoped_handle.h"
+
+namespace wsdump {
+
+// Samples the working set of a process, and reports the pages that were added
+// to it or removed from it since the previous sample. The pages are resolved
+// to the modules of the process, which are captured once rather than at each
+// sample, and the changes are coalesced into runs of adjacent pages of the
+// same module. This keeps sampling cheap enough to be done at high frequency.
+//
+// Sample usage:
+//
+//   WorkingSetSampler sampler;
+//   sampler.Initialize(process_id);
+//   WorkingSetSampler::Delta delta;
+//   while (sampler.Sample(&delta)) {
+//     // Consume delta.added and delta.removed.
+//   }
+class WorkingSetSampler {
+ public:
+  // The module ID of the pages that don't belong to a module.
+  static const size_t kNoModule = static_cast<size_t>(-1);
+
+  // The size of the pages of the working set.
+  static const size_t kPageSize = 4096;
+
+  // A run of adjacent pages that belong to the same module.
+  struct PageRange {
+    size_t address;
+    size_t page_count;
+    // The index of the module in module_names(), or kNoModule.
+    size_t module_id;
+  };
+  typedef std::vector<PageRange> PageRanges;
+
+  // The changes to the working set between two samples.
+  struct Delta {
+    PageRanges added;
+    PageRanges removed;
+  };
+
+  WorkingSetSampler();
+
+  // Opens a process and captures its modules.
+  // @param process_id The ID of the process to sample.
+  // @returns true on success, false otherwise.
+  bool Initialize(DWORD process_id);
+
+  // Captures the modules of the process again. This should be called when
+  // modules are loaded or unloaded, as the pages of the modules loaded since
+  // the last capture are reported as not belonging to a module. The IDs of
+  // the modules already seen are preserved.
+  // @returns true on success, false otherwise.
+  bool RefreshModules();
+
+  // Samples the working set of the process. The first sample reports all of
+  // the pages of the working set as being added.
+  // @param delta Receives the changes since the previous sample.
+  // @returns true on success, false otherwise.
+  bool Sample(Delta* delta);
+
+  // @returns the names of the modules, indexed by module ID.
+  const std::vector<std::wstring>& module_names() const {
+    return module_names_;
+  }
+
+  // @returns the number of pages in the working set as of the last sample.
+  size_t page_count() const { return pages_.size(); }
+
+ protected:
+  // The address range of a module.
+  struct ModuleRange {
+    size_t start;
+    size_t end;
+    size_t module_id;
+    bool operator<(const ModuleRange& rhs) const { return start < rhs.start; }
+  };
+  typedef std::vector<ModuleRange> ModuleRanges;
+
+  // Adds a module, assigning it an ID if it hasn't been seen yet.
+  // @param address The base address of the module.
+  // @param size The size of the module, in bytes.
+  // @param name The name of the module.
+  void AddModule(size_t address, size_t size, const std::wstring& name);
+
+  // Diffs a new working set against the one of the previous sample, and makes
+  // it the current one.
+  // @param pages The page numbers of the new working set, sorted. This is
+  //     swapped with the previous working set.
+  // @param delta Receives the changes from the previous working set.
+  void ComputeDelta(std::vector<size_t>* pages, Delta* delta);
+
+  // Appends a page to a list of page ranges, extending its last run if the
+  // page is adjacent to it and belongs to the same module.
+  // @param page The page number of the page.
+  // @param ranges The page ranges to append to.
+  void AppendPage(size_t page, PageRanges* ranges);
+
+  // Looks up the module holding an address.
+  // @param address The address to look up.
+  // @returns the ID of the module, or kNoModule.
+  size_t FindModuleId(size_t address);
+
+  // The process being sampled.
+  base::win::ScopedHandle process_;
+  DWORD process_id_;
+
+  // The ranges of the modules, sorted by address.
+  ModuleRanges module_ranges_;
+
+  // The range of the last module lookup. Working sets are walked in address
+  // order, so most lookups hit the same range as the previous one.
+  const ModuleRange* last_module_range_;
+
+  // The names of the modules and the map from names to module IDs.
+  std::vector<std::wstring> module_names_;
+  std::map<std::wstring, size_t> module_ids_;
+
+  // The sorted page numbers of the working set of the last sample.
+  std::vector<size_t> pages_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(WorkingSetSampler);
+};
+
+}  // namespace wsdump
+
+#endif  // SYZYGY_WSDUMP_WORKING_SET_SAMPLER_H_
@@ -0,0 +1,143 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/wsdump/working_set_sampler.h"
+
+#include <set>
+
+#include "gtest/gtest.h"
+
+namespace wsdump {
+
+namespace {
+
+const size_t kPageSize = WorkingSetSampler::kPageSize;
+
+class TestWorkingSetSampler : public WorkingSetSampler {
+ public:
+  using WorkingSetSampler::AddModule;
+  using WorkingSetSampler::ComputeDelta;
+};
+
+// Applies the changes of a delta to a set of page addresses.
+void ApplyDelta(const WorkingSetSampler::Delta& delta,
+                std::set<size_t>* pages) {
+  for (size_t i = 0; i < delta.removed.size(); ++i) {
+    for (size_t j = 0; j < delta.removed[i].page_count; ++j)
+      EXPECT_EQ(1u, pages->erase(delta.removed[i].address + j * kPageSize));
+  }
+  for (size_t i = 0; i < delta.added.size(); ++i) {
+    for (size_t j = 0; j < delta.added[i].page_count; ++j) {
+      EXPECT_TRUE(pages->insert(
+          delta.added[i].address + j * kPageSize).second);
+    }
+  }
+}
+
+}  // namespace
+
+TEST(WorkingSetSamplerTest, ComputeDeltaCoalescesPages) {
+  TestWorkingSetSampler sampler;
+  sampler.AddModule(0x10 * kPageSize, 0x4 * kPageSize, L"foo.dll");
+  sampler.AddModule(0x14 * kPageSize, 0x4 * kPageSize, L"bar.dll");
+  ASSERT_EQ(2u, sampler.module_names().size());
+
+  // The run of pages from 0x10 to 0x15 spans both modules.
+  size_t kPages[] = { 0x1, 0x2, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x20 };
+  std::vector<size_t> pages(kPages, kPages + arraysize(kPages));
+  WorkingSetSampler::Delta delta;
+  sampler.ComputeDelta(&pages, &delta);
+  EXPECT_EQ(arraysize(kPages), sampler.page_count());
+  EXPECT_TRUE(delta.removed.empty());
+
+  ASSERT_EQ(4u, delta.added.size());
+  EXPECT_EQ(0x1 * kPageSize, delta.added[0].address);
+  EXPECT_EQ(2u, delta.added[0].page_count);
+  EXPECT_EQ(WorkingSetSampler::kNoModule, delta.added[0].module_id);
+  EXPECT_EQ(0x10 * kPageSize, delta.added[1].address);
+  EXPECT_EQ(4u, delta.added[1].page_count);
+  EXPECT_EQ(0u, delta.added[1].module_id);
+  EXPECT_EQ(0x14 * kPageSize, delta.added[2].address);
+  EXPECT_EQ(2u, delta.added[2].page_count);
+  EXPECT_EQ(1u, delta.added[2].module_id);
+  EXPECT_EQ(0x20 * kPageSize, delta.added[3].address);
+  EXPECT_EQ(1u, delta.added[3].page_count);
+  EXPECT_EQ(WorkingSetSampler::kNoModule, delta.added[3].module_id);
+}
+
+TEST(WorkingSetSamplerTest, ComputeDeltaReportsChanges) {
+  TestWorkingSetSampler sampler;
+  sampler.AddModule(0x10 * kPageSize, 0x10 * kPageSize, L"foo.dll");
+
+  size_t kPages0[] = { 0x1, 0x10, 0x11, 0x12 };
+  std::vector<size_t> pages(kPages0, kPages0 + arraysize(kPages0));
+  WorkingSetSampler::Delta delta;
+  sampler.ComputeDelta(&pages, &delta);
+
+  // Only the pages that changed are reported.
+  size_t kPages1[] = { 0x10, 0x12, 0x13, 0x14 };
+  pages.assign(kPages1, kPages1 + arraysize(kPages1));
+  sampler.ComputeDelta(&pages, &delta);
+  EXPECT_EQ(arraysize(kPages1), sampler.page_count());
+
+  ASSERT_EQ(2u, delta.removed.size());
+  EXPECT_EQ(0x1 * kPageSize, delta.removed[0].address);
+  EXPECT_EQ(1u, delta.removed[0].page_count);
+  EXPECT_EQ(0x11 * kPageSize, delta.removed[1].address);
+  EXPECT_EQ(1u, delta.removed[1].page_count);
+  EXPECT_EQ(0u, delta.removed[1].module_id);
+
+  ASSERT_EQ(1u, delta.added.size());
+  EXPECT_EQ(0x13 * kPageSize, delta.added[0].address);
+  EXPECT_EQ(2u, delta.added[0].page_count);
+  EXPECT_EQ(0u, delta.added[0].module_id);
+
+  // An unchanged working set has an empty delta.
+  pages.assign(kPages1, kPages1 + arraysize(kPages1));
+  sampler.ComputeDelta(&pages, &delta);
+  EXPECT_TRUE(delta.added.empty());
+  EXPECT_TRUE(delta.removed.empty());
+}
+
+TEST(WorkingSetSamplerTest, ModuleIdsAreStable) {
+  TestWorkingSetSampler sampler;
+  sampler.AddModule(0x10 * kPageSize, kPageSize, L"foo.dll");
+  sampler.AddModule(0x20 * kPageSize, kPageSize, L"foo.dll");
+  sampler.AddModule(0x30 * kPageSize, kPageSize, L"bar.dll");
+  ASSERT_EQ(2u, sampler.module_names().size());
+  EXPECT_EQ(L"foo.dll", sampler.module_names()[0]);
+  EXPECT_EQ(L"bar.dll", sampler.module_names()[1]);
+}
+
+TEST(WorkingSetSamplerTest, SampleCurrentProcess) {
+  WorkingSetSampler sampler;
+  ASSERT_TRUE(sampler.Initialize(::GetCurrentProcessId()));
+  EXPECT_LT(0u, sampler.module_names().size());
+
+  // The first sample adds the whole working set.
+  WorkingSetSampler::Delta delta;
+  ASSERT_TRUE(sampler.Sample(&delta));
+  EXPECT_TRUE(delta.removed.empty());
+  std::set<size_t> pages;
+  ApplyDelta(delta, &pages);
+  EXPECT_EQ(sampler.page_count(), pages.size());
+
+  // Touch some new memory, and check that the deltas track the working set.
+  std::vector<uint8_t> buffer(16 * kPageSize, 1);
+  ASSERT_TRUE(sampler.Sample(&delta));
+  ApplyDelta(delta, &pages);
+  EXPECT_EQ(sampler.page_count(), pages.size());
+}
+
+}  // namespace wsdump
@@ -20,12 +20,15 @@
 #include "base/logging.h"
 #include "base/files/file_util.h"
 #include "base/process/process_iterator.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/utf_string_conversions.h"
 #include "pcrecpp.h"  // NOLINT
 #include "syzygy/core/json_file_writer.h"
 #include "syzygy/wsdump/process_working_set.h"
+#include "syzygy/wsdump/working_set_sampler.h"
 
 using wsdump::ProcessWorkingSet;
+using wsdump::WorkingSetSampler;
 
 namespace {
 
@@ -68,10 +71,24 @@ bool RegexpProcessFilter::Includes(const base::ProcessEntry& entry) const {
 
 const char kUsage[] =
 "Usage: wsdump [--process-name=<process_re>]\n"
+"              [--sample-count=<count> [--sample-interval-ms=<ms>]]\n"
 "\n"
 "    Captures and outputs working set statistics for all processes,\n"
 "    or only for processess whose executable name matches <process_re>.\n"
 "\n"
+"    If --sample-count is specified, the working sets are instead sampled\n"
+"    <count> times, every <ms> milliseconds (100 by default), and each\n"
+"    process has the following items:\n"
+"      * exe_file, pid and parent_pid - as below.\n"
+"      * modules - an array of the module names, indexed by module ID.\n"
+"      * samples - an array of dictionaries, one for each sample, with\n"
+"        the \"added\" and \"removed\" arrays of the page ranges that\n"
+"        changed since the previous sample. The first sample adds the\n"
+"        whole working set. Each page range has the following keys:\n"
+"        * page - the number of the first page of the range.\n"
+"        * pages - the number of pages in the range.\n"
+"        * module - the module ID of the range, or -1.\n"
+"\n"
 "    The output is JSON encoded array, where each element of the array\n"
 "    is a dictionary describing a process. Each process has the following\n"
 "    items:\n"
@@ -173,6 +190,125 @@ void OutputProcessInfo(const ProcessInfo& info,
   json->CloseDict();
 }
 
+// The samples of the working set of a process.
+struct ProcessSamples {
+  ProcessSamples() : pid(0), parent_pid(0) {
+  }
+
+  std::wstring exe_file;
+  base::ProcessId pid;
+  base::ProcessId parent_pid;
+  WorkingSetSampler sampler;
+  std::vector<WorkingSetSampler::Delta> deltas;
+};
+
+void OutputPageRanges(const WorkingSetSampler::PageRanges& ranges,
+                      core::JSONFileWriter* json) {
+  DCHECK(json != NULL);
+
+  json->OpenList();
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    json->OpenDict();
+    json->OutputKey("page");
+    json->OutputInteger(
+        static_cast<int>(ranges[i].address / WorkingSetSampler::kPageSize));
+    json->OutputKey("pages");
+    json->OutputInteger(static_cast<int>(ranges[i].page_count));
+    json->OutputKey("module");
+    json->OutputInteger(static_cast<int>(ranges[i].module_id));
+    json->CloseDict();
+  }
+  json->CloseList();
+}
+
+void OutputProcessSamples(const ProcessSamples& samples,
+                          core::JSONFileWriter* json) {
+  DCHECK(json != NULL);
+
+  json->OpenDict();
+  json->OutputKey("exe_file");
+  json->OutputString(samples.exe_file);
+  json->OutputKey("pid");
+  json->OutputInteger(samples.pid);
+  json->OutputKey("parent_pid");
+  json->OutputInteger(samples.parent_pid);
+
+  json->OutputKey("modules");
+  json->OpenList();
+  const std::vector<std::wstring>& module_names =
+      samples.sampler.module_names();
+  for (size_t i = 0; i < module_names.size(); ++i)
+    json->OutputString(module_names[i]);
+  json->CloseList();
+
+  json->OutputKey("samples");
+  json->OpenList();
+  for (size_t i = 0; i < samples.deltas.size(); ++i) {
+    json->OpenDict();
+    json->OutputKey("added");
+    OutputPageRanges(samples.deltas[i].added, json);
+    json->OutputKey("removed");
+    OutputPageRanges(samples.deltas[i].removed, json);
+    json->CloseDict();
+  }
+  json->CloseList();
+  json->CloseDict();
+}
+
+// Samples the working sets of the processes matching |filter|, and outputs
+// their deltas.
+int SampleWorkingSets(const base::ProcessFilter* filter,
+                      size_t sample_count,
+                      int sample_interval_ms) {
+  DCHECK(filter != NULL);
+
+  typedef std::list<ProcessSamples> ProcessSamplesList;
+  ProcessSamplesList processes;
+
+  base::ProcessIterator process_iterator(filter);
+  const base::ProcessEntry* entry = process_iterator.NextProcessEntry();
+  while (entry) {
+    processes.push_back(ProcessSamples());
+    ProcessSamples& samples = processes.back();
+    if (samples.sampler.Initialize(entry->pid())) {
+      samples.exe_file = entry->exe_file();
+      samples.pid = entry->pid();
+      samples.parent_pid = entry->parent_pid();
+    } else {
+      LOG(ERROR) << "Unable to sample working set for pid: " << entry->pid();
+      processes.pop_back();
+    }
+    entry = process_iterator.NextProcessEntry();
+  }
+
+  // The deltas are kept in memory, so that the output doesn't perturb the
+  // working sets being sampled.
+  for (size_t i = 0; i < sample_count; ++i) {
+    if (i != 0)
+      ::Sleep(sample_interval_ms);
+
+    ProcessSamplesList::iterator it = processes.begin();
+    for (; it != processes.end(); ++it) {
+      it->deltas.push_back(WorkingSetSampler::Delta());
+      if (!it->sampler.Sample(&it->deltas.back())) {
+        // The process may have exited. Keep the samples taken so far.
+        LOG(ERROR) << "Unable to sample working set for pid: " << it->pid;
+        it->deltas.pop_back();
+      }
+    }
+  }
+
+  core::JSONFileWriter json(stdout, true);
+  json.OpenList();
+  ProcessSamplesList::const_iterator it = processes.begin();
+  for (; it != processes.end(); ++it)
+    OutputProcessSamples(*it, &json);
+  json.CloseList();
+  json.Flush();
+
+  return 0;
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -201,6 +337,25 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  if (cmd_line->HasSwitch("sample-count")) {
+    size_t sample_count = 0;
+    if (!base::StringToSizeT(cmd_line->GetSwitchValueASCII("sample-count"),
+                             &sample_count) || sample_count == 0) {
+      LOG(ERROR) << "Invalid sample count.";
+      return Usage();
+    }
+    int sample_interval_ms = 100;
+    if (cmd_line->HasSwitch("sample-interval-ms") &&
+        (!base::StringToInt(
+             cmd_line->GetSwitchValueASCII("sample-interval-ms"),
+             &sample_interval_ms) ||
+         sample_interval_ms < 0)) {
+      LOG(ERROR) << "Invalid sample interval.";
+      return Usage();
+    }
+    return SampleWorkingSets(&filter, sample_count, sample_interval_ms);
+  }
+
   typedef std::list<ProcessInfo> WorkingSets;
   WorkingSets working_sets;
 
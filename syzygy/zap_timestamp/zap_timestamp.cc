@@ -28,6 +28,12 @@
 // canonical (as long as the underlying PdbWriter doesn't change). We load all
 // of the streams into memory, reach in and make local modifications, and
 // rewrite the entire file to disk.
+//
+// Alternatively, the PDB file can be patched in place. Only the streams that
+// are normalized are read, through a writable mapping of the file, and only
+// the pages holding bytes that change are written. The layout of the file is
+// left as the linker wrote it, so the result is only canonical if that layout
+// is deterministic.
 
 #include "syzygy/zap_timestamp/zap_timestamp.h"
 
@@ -39,6 +45,7 @@
 #include "base/files/file_util.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/strings/stringprintf.h"
+#include "base/win/scoped_handle.h"
 #include "syzygy/block_graph/typed_block.h"
 #include "syzygy/core/file_util.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
@@ -374,13 +381,13 @@ void OutputSummaryStats(base::FilePath& path) {
   LOG(INFO) << "  Digest: " << md5_string;
 }
 
-bool NormalizeDbiStream(DWORD pdb_age_data, PdbByteStream* dbi_stream) {
-  DCHECK(dbi_stream != NULL);
+bool NormalizeDbiStream(DWORD pdb_age_data, uint8_t* data, size_t length) {
+  DCHECK(data != NULL);
 
   LOG(INFO) << "Updating PDB DBI stream.";
 
-  uint8_t* dbi_data = dbi_stream->data();
-  if (dbi_stream->length() < sizeof(pdb::DbiHeader)) {
+  uint8_t* dbi_data = data;
+  if (length < sizeof(pdb::DbiHeader)) {
     LOG(ERROR) << "DBI stream too short.";
     return false;
   }
@@ -392,7 +399,7 @@ bool NormalizeDbiStream(DWORD pdb_age_data, PdbByteStream* dbi_stream) {
   dbi_data += sizeof(*dbi_header);
 
   // Ensure that the module information is addressable.
-  if (dbi_stream->length() < dbi_header->gp_modi_size) {
+  if (length < dbi_header->gp_modi_size) {
     LOG(ERROR) << "Invalid DBI header gp_modi_size.";
     return false;
   }
@@ -416,15 +423,15 @@ bool NormalizeDbiStream(DWORD pdb_age_data, PdbByteStream* dbi_stream) {
     ++dbi_data;
 
     // Skip until we're at a multiple of 4 position.
-    size_t offset = dbi_data - dbi_stream->data();
+    size_t offset = dbi_data - data;
     offset = ((offset + 3) / 4) * 4;
-    dbi_data = dbi_stream->data() + offset;
+    dbi_data = data + offset;
   }
 
   // Ensure that the section contributions are addressable.
   size_t section_contrib_end_pos = dbi_header->gp_modi_size + sizeof(uint32_t) +
                                    dbi_header->section_contribution_size;
-  if (dbi_stream->length() < section_contrib_end_pos) {
+  if (length < section_contrib_end_pos) {
     LOG(ERROR) << "Invalid DBI header gp_modi_size.";
     return false;
   }
@@ -444,11 +451,10 @@ bool NormalizeDbiStream(DWORD pdb_age_data, PdbByteStream* dbi_stream) {
   return true;
 }
 
-bool NormalizeSymbolRecordStream(PdbByteStream* stream) {
-  DCHECK(stream != NULL);
+bool NormalizeSymbolRecordStream(uint8_t* data, size_t length) {
+  DCHECK(data != NULL);
 
-  uint8_t* data = stream->data();
-  uint8_t* data_end = data + stream->length();
+  uint8_t* data_end = data + length;
 
   while (data < data_end) {
     // Get the size of the symbol record and skip past it.
@@ -487,6 +493,205 @@ bool NormalizeSymbolRecordStream(PdbByteStream* stream) {
   return true;
 }
 
+// A writable memory mapping of an MSF file, through which the streams of the
+// file are read and patched in place. Only the pages that are written to are
+// dirtied, so patching a few fields of a large file is cheap.
+class MappedMsfFile {
+ public:
+  MappedMsfFile() : data_(NULL), length_(0), page_size_(0) {}
+  ~MappedMsfFile() {
+    if (data_ != NULL)
+      CHECK(::UnmapViewOfFile(data_));
+  }
+
+  // Reads the directory of an MSF file, and maps it for writing.
+  // @param path The path of the file to map.
+  // @returns true on success, false otherwise.
+  bool Init(const base::FilePath& path);
+
+  // @returns the number of streams in the file.
+  size_t stream_count() const { return stream_lengths_.size(); }
+
+  // @param index The index of a stream.
+  // @returns the length of the stream, in bytes.
+  size_t stream_length(size_t index) const {
+    DCHECK_GT(stream_lengths_.size(), index);
+    return stream_lengths_[index];
+  }
+
+  // Reads the contents of a stream.
+  // @param index The index of the stream.
+  // @param data Receives the contents of the stream.
+  // @returns true on success, false otherwise.
+  bool ReadStream(size_t index, std::vector<uint8_t>* data) const;
+
+  // Writes data to a stream. The bytes that are unchanged aren't written, so
+  // that their pages aren't dirtied.
+  // @param index The index of the stream.
+  // @param pos The position to write to in the stream.
+  // @param count The number of bytes to write.
+  // @param data The data to write.
+  // @returns true on success, false otherwise.
+  bool WriteStream(size_t index, size_t pos, size_t count, const void* data);
+
+  // Flushes the modified pages to disk.
+  // @returns true on success, false otherwise.
+  bool Flush();
+
+ private:
+  // Gets the part of a range of a stream that is held in a single page.
+  // @param index The index of the stream.
+  // @param pos The start of the range in the stream.
+  // @param count The length of the range.
+  // @param chunk_size Receives the number of bytes of the range in the page.
+  // @returns a pointer to the start of the range in the mapping, NULL if the
+  //     range or its page is out of bounds.
+  uint8_t* GetChunk(size_t index, size_t pos, size_t count,
+                    size_t* chunk_size) const;
+
+  base::win::ScopedHandle file_;
+  base::win::ScopedHandle mapping_;
+  uint8_t* data_;
+  size_t length_;
+  size_t page_size_;
+
+  // The length and the pages of each stream.
+  std::vector<size_t> stream_lengths_;
+  std::vector<std::vector<uint32_t>> stream_pages_;
+
+  DISALLOW_COPY_AND_ASSIGN(MappedMsfFile);
+};
+
+bool MappedMsfFile::Init(const base::FilePath& path) {
+  DCHECK(data_ == NULL);
+
+  msf::MsfHeader header = {};
+  std::vector<uint32_t> directory;
+  PdbReader pdb_reader;
+  if (!pdb_reader.ReadDirectory(path, &header, &directory))
+    return false;
+  page_size_ = header.page_size;
+
+  // Split the directory into the lengths and the pages of the streams.
+  size_t stream_count = directory[0];
+  if (directory.size() < 1 + stream_count) {
+    LOG(ERROR) << "Invalid MSF directory.";
+    return false;
+  }
+  size_t page_index = 1 + stream_count;
+  for (size_t i = 0; i < stream_count; ++i) {
+    size_t length = directory[1 + i];
+    size_t page_count = (length + page_size_ - 1) / page_size_;
+    if (directory.size() < page_index + page_count) {
+      LOG(ERROR) << "Invalid MSF directory.";
+      return false;
+    }
+    stream_lengths_.push_back(length);
+    stream_pages_.push_back(std::vector<uint32_t>(
+        directory.begin() + page_index,
+        directory.begin() + page_index + page_count));
+    page_index += page_count;
+  }
+
+  file_.Set(::CreateFile(path.value().c_str(), GENERIC_READ | GENERIC_WRITE,
+                         0, NULL, OPEN_EXISTING, 0, NULL));
+  if (!file_.IsValid()) {
+    LOG(ERROR) << "Failed to open file " << path.value();
+    return false;
+  }
+  length_ = ::GetFileSize(file_.Get(), NULL);
+
+  mapping_.Set(::CreateFileMapping(file_.Get(), NULL, PAGE_READWRITE, 0, 0,
+                                   NULL));
+  if (mapping_.IsValid()) {
+    data_ = reinterpret_cast<uint8_t*>(
+        ::MapViewOfFile(mapping_.Get(), FILE_MAP_WRITE, 0, 0, length_));
+  }
+  if (data_ == NULL) {
+    LOG(ERROR) << "Failed to map file " << path.value();
+    return false;
+  }
+
+  return true;
+}
+
+bool MappedMsfFile::ReadStream(size_t index,
+                               std::vector<uint8_t>* data) const {
+  DCHECK(data != NULL);
+  DCHECK_GT(stream_lengths_.size(), index);
+
+  data->resize(stream_lengths_[index]);
+  size_t pos = 0;
+  while (pos < data->size()) {
+    size_t chunk_size = 0;
+    const uint8_t* chunk = GetChunk(index, pos, data->size() - pos,
+                                    &chunk_size);
+    if (chunk == NULL) {
+      LOG(ERROR) << "Failed to read stream " << index << ".";
+      return false;
+    }
+    ::memcpy(data->data() + pos, chunk, chunk_size);
+    pos += chunk_size;
+  }
+
+  return true;
+}
+
+bool MappedMsfFile::WriteStream(size_t index,
+                                size_t pos,
+                                size_t count,
+                                const void* data) {
+  DCHECK(data != NULL);
+  DCHECK_GT(stream_lengths_.size(), index);
+
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+  while (count > 0) {
+    size_t chunk_size = 0;
+    uint8_t* chunk = GetChunk(index, pos, count, &chunk_size);
+    if (chunk == NULL) {
+      LOG(ERROR) << "Failed to write " << count << " bytes at position " << pos
+                 << " of stream " << index << ".";
+      return false;
+    }
+    if (::memcmp(chunk, bytes, chunk_size) != 0)
+      ::memcpy(chunk, bytes, chunk_size);
+    bytes += chunk_size;
+    pos += chunk_size;
+    count -= chunk_size;
+  }
+
+  return true;
+}
+
+bool MappedMsfFile::Flush() {
+  DCHECK(data_ != NULL);
+  if (!::FlushViewOfFile(data_, length_)) {
+    LOG(ERROR) << "Failed to flush the mapped file.";
+    return false;
+  }
+  return true;
+}
+
+uint8_t* MappedMsfFile::GetChunk(size_t index,
+                                 size_t pos,
+                                 size_t count,
+                                 size_t* chunk_size) const {
+  DCHECK_GT(stream_lengths_.size(), index);
+  DCHECK_LT(0u, count);
+  DCHECK(chunk_size != NULL);
+
+  if (pos >= stream_lengths_[index] || count > stream_lengths_[index] - pos)
+    return NULL;
+
+  size_t page = stream_pages_[index][pos / page_size_];
+  size_t offset = pos % page_size_;
+  if (page >= length_ / page_size_)
+    return NULL;
+
+  *chunk_size = std::min(count, page_size_ - offset);
+  return data_ + page * page_size_ + offset;
+}
+
 }  // namespace
 
 ZapTimestamp::ZapTimestamp()
@@ -494,7 +699,8 @@ ZapTimestamp::ZapTimestamp()
       dos_header_block_(NULL),
       write_image_(true),
       write_pdb_(true),
-      overwrite_(false) {
+      overwrite_(false),
+      in_place_pdb_(false) {
   // The timestamp can't just be set to zero as that represents a special
   // value in the PE file. We set it to some arbitrary fixed date in the past.
   // This is Jan 1, 2010, 0:00:00 GMT. This date shouldn't be too much in
@@ -524,7 +730,8 @@ bool ZapTimestamp::Init() {
     if (!CalculatePdbGuid())
       return false;
 
-    if (!LoadAndUpdatePdbFile())
+    // When patching in place the PDB file is only read when it is written.
+    if (!in_place_pdb_ && !LoadAndUpdatePdbFile())
       return false;
   }
 
@@ -875,7 +1082,8 @@ bool ZapTimestamp::LoadAndUpdatePdbFile() {
   scoped_refptr<PdbByteStream> dbi_stream(new PdbByteStream());
   CHECK(dbi_stream->Init(pdb_file_->GetStream(pdb::kDbiStream).get()));
   pdb_file_->ReplaceStream(pdb::kDbiStream, dbi_stream.get());
-  if (!NormalizeDbiStream(pdb_age_data_, dbi_stream.get())) {
+  if (!NormalizeDbiStream(pdb_age_data_, dbi_stream->data(),
+                          dbi_stream->length())) {
     LOG(ERROR) << "Failed to normalize DBI stream.";
     return false;
   }
@@ -889,7 +1097,8 @@ bool ZapTimestamp::LoadAndUpdatePdbFile() {
       pdb_file_->GetStream(dbi_header->symbol_record_stream).get()));
   pdb_file_->ReplaceStream(dbi_header->symbol_record_stream,
                            symrec_stream.get());
-  if (!NormalizeSymbolRecordStream(symrec_stream.get())) {
+  if (!NormalizeSymbolRecordStream(symrec_stream->data(),
+                                   symrec_stream->length())) {
     LOG(ERROR) << "Failed to normalize symbol record stream.";
     return false;
   }
@@ -933,6 +1142,9 @@ bool ZapTimestamp::WritePeFile() {
 bool ZapTimestamp::WritePdbFile() {
   DCHECK(!input_pdb_.empty());
 
+  if (in_place_pdb_)
+    return PatchPdbFile();
+
   // We actually completely rewrite the PDB file to a temporary location, and
   // then move it over top of the existing one. This is because pdb_file_
   // actually has an open file handle to the original PDB.
@@ -973,4 +1185,91 @@ bool ZapTimestamp::WritePdbFile() {
   return true;
 }
 
+bool ZapTimestamp::PatchPdbFile() {
+  DCHECK(!input_pdb_.empty());
+  DCHECK(pdb_file_.get() == NULL);
+
+  if (core::CompareFilePaths(input_pdb_, output_pdb_) !=
+      core::kEquivalentFilePaths) {
+    if (::CopyFileW(input_pdb_.value().c_str(), output_pdb_.value().c_str(),
+                    FALSE) == FALSE) {
+      LOG(ERROR) << "Failed to write output PDB: " << output_pdb_.value();
+      return false;
+    }
+  }
+
+  LOG(INFO) << "Patching PDB file: " << output_pdb_.value();
+  MappedMsfFile msf_file;
+  if (!msf_file.Init(output_pdb_))
+    return false;
+  if (msf_file.stream_count() <= pdb::kDbiStream) {
+    LOG(ERROR) << "PDB file is missing streams: " << output_pdb_.value();
+    return false;
+  }
+
+  // Update the timestamp, the age and the signature.
+  LOG(INFO) << "Updating PDB header.";
+  uint32_t timestamp = timestamp_data_;
+  uint32_t pdb_age = pdb_age_data_;
+  if (!msf_file.WriteStream(pdb::kPdbHeaderInfoStream,
+                            offsetof(pdb::PdbInfoHeader70, timestamp),
+                            sizeof(timestamp), &timestamp) ||
+      !msf_file.WriteStream(pdb::kPdbHeaderInfoStream,
+                            offsetof(pdb::PdbInfoHeader70, pdb_age),
+                            sizeof(pdb_age), &pdb_age) ||
+      !msf_file.WriteStream(pdb::kPdbHeaderInfoStream,
+                            offsetof(pdb::PdbInfoHeader70, signature),
+                            sizeof(pdb_guid_data_), &pdb_guid_data_)) {
+    LOG(ERROR) << "Failed to update PDB header.";
+    return false;
+  }
+
+  // Normalize the DBI stream.
+  std::vector<uint8_t> dbi_data;
+  if (!msf_file.ReadStream(pdb::kDbiStream, &dbi_data))
+    return false;
+  if (!NormalizeDbiStream(pdb_age_data_, dbi_data.data(), dbi_data.size())) {
+    LOG(ERROR) << "Failed to normalize DBI stream.";
+    return false;
+  }
+  if (!msf_file.WriteStream(pdb::kDbiStream, 0, dbi_data.size(),
+                            dbi_data.data())) {
+    return false;
+  }
+  const pdb::DbiHeader* dbi_header =
+      reinterpret_cast<const pdb::DbiHeader*>(dbi_data.data());
+
+  // Normalize the symbol record stream.
+  size_t symrec_index = dbi_header->symbol_record_stream;
+  if (symrec_index >= msf_file.stream_count()) {
+    LOG(ERROR) << "Invalid symbol record stream.";
+    return false;
+  }
+  std::vector<uint8_t> symrec_data;
+  if (!msf_file.ReadStream(symrec_index, &symrec_data))
+    return false;
+  if (!symrec_data.empty() &&
+      !NormalizeSymbolRecordStream(symrec_data.data(), symrec_data.size())) {
+    LOG(ERROR) << "Failed to normalize symbol record stream.";
+    return false;
+  }
+  if (!symrec_data.empty() &&
+      !msf_file.WriteStream(symrec_index, 0, symrec_data.size(),
+                            symrec_data.data())) {
+    return false;
+  }
+
+  // Normalize the public symbol info stream. There's a DWORD of padding at
+  // offset 24 that we want to zero.
+  size_t pubsym_index = dbi_header->public_symbol_info_stream;
+  uint32_t padding = 0;
+  if (pubsym_index >= msf_file.stream_count() ||
+      !msf_file.WriteStream(pubsym_index, 24, sizeof(padding), &padding)) {
+    LOG(ERROR) << "Failed to normalize public symbol info stream.";
+    return false;
+  }
+
+  return msf_file.Flush();
+}
+
 }  // namespace zap_timestamp
@@ -57,6 +57,9 @@ class ZapTimestamp {
   void set_overwrite(bool overwrite) {
     overwrite_ = overwrite;
   }
+  void set_in_place_pdb(bool in_place_pdb) {
+    in_place_pdb_ = in_place_pdb;
+  }
   void set_timestamp_value(size_t timestamp_value) {
     timestamp_data_ = static_cast<size_t>(timestamp_value);
   }
@@ -71,6 +74,7 @@ class ZapTimestamp {
   bool write_image() const { return write_image_; }
   bool write_pdb() const { return write_pdb_; }
   bool overwrite() const { return overwrite_; }
+  bool in_place_pdb() const { return in_place_pdb_; }
   size_t timestamp_value() const {
     return static_cast<size_t>(timestamp_data_);
   }
@@ -124,6 +128,11 @@ class ZapTimestamp {
   bool WritePdbFile();
   // @}
 
+  // Patches the fields of the PDB file that need updating in place, through
+  // a memory mapping, rather than rewriting the whole file. This is used by
+  // WritePdbFile when |in_place_pdb_| is set.
+  bool PatchPdbFile();
+
   // Initialized by DecomposePeFile.
   block_graph::BlockGraph block_graph_;
   pe::ImageLayout image_layout_;
@@ -149,6 +158,9 @@ class ZapTimestamp {
   bool write_image_;
   bool write_pdb_;
   bool overwrite_;
+  // If true the PDB file is patched in place rather than rewritten. The old
+  // directory stream and the layout of the file are then left unchanged.
+  bool in_place_pdb_;
 
   DISALLOW_COPY_AND_ASSIGN(ZapTimestamp);
 };
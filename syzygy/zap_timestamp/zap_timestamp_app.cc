@@ -28,6 +28,11 @@ const char kUsageFormatStr[] =
     "  be tracked down automatically.\n"
     "\n"
     "Options:\n"
+    "  --in-place-pdb\n"
+    "    If specified then the PDB file is patched in place rather than\n"
+    "    rewritten, which is much faster for large PDB files. Its layout is\n"
+    "    left unchanged, so the output is only canonical if the linker\n"
+    "    output is deterministic.\n"
     "  --input-pdb=<PDB path>\n"
     "    If specified then this PDB will be used as the matching PDB. Will\n"
     "    fail if the PDB and the PE file are not paired.\n"
@@ -86,6 +91,7 @@ bool ZapTimestampApp::ParseCommandLine(const base::CommandLine* command_line) {
   zap_.set_write_image(!command_line->HasSwitch("no-write-image"));
   zap_.set_write_pdb(!command_line->HasSwitch("no-write-pdb"));
   zap_.set_overwrite(command_line->HasSwitch("overwrite"));
+  zap_.set_in_place_pdb(command_line->HasSwitch("in-place-pdb"));
 
   if (command_line->HasSwitch("timestamp-value")) {
     size_t timestamp_value = 0;
@@ -96,6 +96,7 @@ TEST_F(ZapTimestampAppTest, ParseMinimalCommandLine) {
   EXPECT_TRUE(test_impl_.zap_.write_image());
   EXPECT_TRUE(test_impl_.zap_.write_pdb());
   EXPECT_FALSE(test_impl_.zap_.overwrite());
+  EXPECT_FALSE(test_impl_.zap_.in_place_pdb());
 }
 
 TEST_F(ZapTimestampAppTest, ParseMaximalCommandLine) {
@@ -111,6 +112,7 @@ TEST_F(ZapTimestampAppTest, ParseMaximalCommandLine) {
   cmd_line_.AppendSwitch("no-write-image");
   cmd_line_.AppendSwitch("no-write-pdb");
   cmd_line_.AppendSwitch("overwrite");
+  cmd_line_.AppendSwitch("in-place-pdb");
   cmd_line_.AppendSwitchASCII("timestamp-value", "42");
   EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
 
@@ -121,6 +123,7 @@ TEST_F(ZapTimestampAppTest, ParseMaximalCommandLine) {
   EXPECT_FALSE(test_impl_.zap_.write_image());
   EXPECT_FALSE(test_impl_.zap_.write_pdb());
   EXPECT_TRUE(test_impl_.zap_.overwrite());
+  EXPECT_TRUE(test_impl_.zap_.in_place_pdb());
   EXPECT_EQ(42, test_impl_.zap_.timestamp_value());
 }
 
@@ -18,6 +18,9 @@
 #include "base/files/scoped_temp_dir.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
+#include "syzygy/pdb/pdb_file.h"
+#include "syzygy/pdb/pdb_reader.h"
+#include "syzygy/pe/pdb_info.h"
 #include "syzygy/pe/unittest_util.h"
 
 namespace zap_timestamp {
@@ -45,6 +48,35 @@ RawPePdbPathPair kRawTestPaths[] = {
     { TEST_DATA_PREFIX L"copy2\\test_dll.dll",
       TEST_DATA_PREFIX L"copy2\\test_dll.pdb" } };
 
+// Expects the streams of two PDB files to have the same contents, other than
+// the old directory stream which is dropped when a PDB file is rewritten.
+void ExpectPdbStreamsEqual(const base::FilePath& path0,
+                           const base::FilePath& path1) {
+  pdb::PdbFile pdb_file0;
+  pdb::PdbFile pdb_file1;
+  pdb::PdbReader pdb_reader;
+  ASSERT_TRUE(pdb_reader.Read(path0, &pdb_file0));
+  ASSERT_TRUE(pdb_reader.Read(path1, &pdb_file1));
+  ASSERT_EQ(pdb_file0.StreamCount(), pdb_file1.StreamCount());
+
+  for (size_t i = 1; i < pdb_file0.StreamCount(); ++i) {
+    scoped_refptr<pdb::PdbStream> stream0 = pdb_file0.GetStream(i);
+    scoped_refptr<pdb::PdbStream> stream1 = pdb_file1.GetStream(i);
+    ASSERT_EQ(stream0.get() == NULL, stream1.get() == NULL);
+    if (stream0.get() == NULL)
+      continue;
+
+    ASSERT_EQ(stream0->length(), stream1->length());
+    std::vector<uint8_t> data0(stream0->length());
+    std::vector<uint8_t> data1(stream1->length());
+    if (data0.empty())
+      continue;
+    ASSERT_TRUE(stream0->ReadBytesAt(0, data0.size(), data0.data()));
+    ASSERT_TRUE(stream1->ReadBytesAt(0, data1.size(), data1.data()));
+    EXPECT_TRUE(data0 == data1) << "Stream " << i << " differs.";
+  }
+}
+
 struct PePdbPathPair {
   base::FilePath pe_path;
   base::FilePath pdb_path;
@@ -334,4 +366,64 @@ TEST_F(ZapTimestampTest, IsIdempotentNoPdb) {
   EXPECT_TRUE(base::ContentsEqual(temp_pe_path_, pe_path_0));
 }
 
+TEST_F(ZapTimestampTest, PatchesPdbInPlace) {
+  ASSERT_NO_FATAL_FAILURE(CopyTestData(0));
+  base::FilePath pe_path = temp_dir_.path().Append(L"test_dll.new.dll");
+  base::FilePath pdb_path = temp_dir_.path().Append(L"test_dll.new.dll.pdb");
+
+  // Zap the files by rewriting the PDB.
+  ZapTimestamp zap0;
+  zap0.set_input_image(temp_pe_path_);
+  zap0.set_output_image(pe_path);
+  zap0.set_output_pdb(pdb_path);
+  EXPECT_TRUE(zap0.Init());
+  EXPECT_TRUE(zap0.Zap());
+
+  // Zap them again by patching the PDB in place.
+  int64_t pdb_size = 0;
+  ASSERT_TRUE(base::GetFileSize(temp_pdb_path_, &pdb_size));
+  ZapTimestamp zap1;
+  zap1.set_input_image(temp_pe_path_);
+  zap1.set_overwrite(true);
+  zap1.set_in_place_pdb(true);
+  EXPECT_TRUE(zap1.Init());
+  EXPECT_TRUE(zap1.Zap());
+
+  // The layout of the patched PDB is unchanged, but its streams match those
+  // of the rewritten PDB, and it still matches the image.
+  int64_t patched_pdb_size = 0;
+  ASSERT_TRUE(base::GetFileSize(temp_pdb_path_, &patched_pdb_size));
+  EXPECT_EQ(pdb_size, patched_pdb_size);
+  EXPECT_NO_FATAL_FAILURE(ExpectPdbStreamsEqual(temp_pdb_path_, pdb_path));
+  EXPECT_TRUE(base::ContentsEqual(temp_pe_path_, pe_path));
+  EXPECT_TRUE(pe::PeAndPdbAreMatched(temp_pe_path_, temp_pdb_path_));
+}
+
+TEST_F(ZapTimestampTest, PatchesPdbInPlaceIsIdempotent) {
+  ASSERT_NO_FATAL_FAILURE(CopyTestData(0));
+  ZapTimestamp zap0;
+  zap0.set_input_image(temp_pe_path_);
+  zap0.set_overwrite(true);
+  zap0.set_in_place_pdb(true);
+  EXPECT_TRUE(zap0.Init());
+  EXPECT_TRUE(zap0.Zap());
+
+  // Make a copy of the singly zapped files.
+  base::FilePath pe_path_0 = temp_dir_.path().Append(L"test_dll_0.dll");
+  base::FilePath pdb_path_0 = temp_dir_.path().Append(L"test_dll_0.pdb");
+  ASSERT_TRUE(base::CopyFile(temp_pe_path_, pe_path_0));
+  ASSERT_TRUE(base::CopyFile(temp_pdb_path_, pdb_path_0));
+
+  // Zap them again.
+  ZapTimestamp zap1;
+  zap1.set_input_image(temp_pe_path_);
+  zap1.set_overwrite(true);
+  zap1.set_in_place_pdb(true);
+  EXPECT_TRUE(zap1.Init());
+  EXPECT_TRUE(zap1.Zap());
+
+  EXPECT_TRUE(base::ContentsEqual(temp_pe_path_, pe_path_0));
+  EXPECT_TRUE(base::ContentsEqual(temp_pdb_path_, pdb_path_0));
+}
+
 }  // namespace zap_timestamp